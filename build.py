@@ -150,9 +150,15 @@ runStage("build_scripts/B_compileNonPluginSourcesForPlugins.py")
 runStage("build_scripts/C_compilePluginSources.py")
 runStage("build_scripts/D_linkPlugins_dependsOn_BC.py")
 runStage("build_scripts/E_compileMainProgram_dependsOn_A.py")
+runStage("build_scripts/F_compileHeadlessProgram_dependsOn_A.py")
 
 
 sh.copy("build/E_compileMainProgram_dependsOn_A/angame", "build/angame")
+sh.copy("build/F_compileHeadlessProgram_dependsOn_A/headless", "build/headless")
+sh.copy("build/F_compileHeadlessProgram_dependsOn_A/benchmark", "build/benchmark")
+sh.copy("build/F_compileHeadlessProgram_dependsOn_A/sort_benchmark", "build/sort_benchmark")
+sh.copy("build/F_compileHeadlessProgram_dependsOn_A/thread_pool_benchmark", "build/thread_pool_benchmark")
+sh.copy("build/F_compileHeadlessProgram_dependsOn_A/morton_range_check", "build/morton_range_check")
 sh.copytree("build/E_compileMainProgram_dependsOn_A/shaders", "build/shaders")
 
 
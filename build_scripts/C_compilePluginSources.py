@@ -1,19 +1,20 @@
 #!/bin/python3
 
+# Also run by the app to hot-reload a plugin, so it's incremental: each object is only recompiled if the hash of
+# its preprocessed source and of its compile command changed since the last run, and the objects that do need it
+# are compiled in parallel. The compilers' output is captured, and printed per file, so that the app can log it.
+
+import hashlib
 import subprocess as sp
 import os
-import shutil as sh
 import tomllib
-import subprocess as sp
 import sys
 
 import common
 
 
 STAGE_DIR = "build/C_compilePluginSources"
-if (os.path.exists(STAGE_DIR)):
-    sh.rmtree(STAGE_DIR)
-os.mkdir(STAGE_DIR)
+os.makedirs(STAGE_DIR, exist_ok=True)
 
 
 lib_names: list[str]
@@ -34,10 +35,24 @@ else:
     if (nonexistent_lib): sys.exit("Error: Not all requested plugins exist.")
 
 
+def preprocessCommand(compile_command: list[str]) -> list[str]:
+    # The same flags, so that the defines and the include paths are the same; with the line markers, so that a
+    # change that only moves lines still updates the debug info.
+    command: list[str] = compile_command.copy()
+    command.remove('-c')
+    output_idx: int = command.index('-o')
+    del command[output_idx:output_idx + 2]
+    return command + ['-E']
+
+
+# (source, hash file, hash, compile command) of every object that isn't up to date; no hash if the source
+# didn't preprocess
+stale_objects: list[tuple[str, str, str, list[str]]] = []
+
 for lib_name in lib_names:
 
     plugin_compiled_objects_dir = STAGE_DIR + '/' + lib_name
-    os.mkdir(plugin_compiled_objects_dir)
+    os.makedirs(plugin_compiled_objects_dir, exist_ok=True)
 
     plugin_src_dir = f"plugins_src/{lib_name}"
 
@@ -49,6 +64,9 @@ for lib_name in lib_names:
     assert(type(src_filepaths) == list)
     for elem in src_filepaths: assert(type(elem) == str)
 
+    object_filenames: list[str] = []
+    preprocess_processes: list[tuple[sp.Popen, str, str, list[str]]] = []
+
     for src_filepath in src_filepaths:
 
         src_filepath = f"{plugin_src_dir}/{src_filepath}"
@@ -64,12 +82,14 @@ for lib_name in lib_names:
             warning_flags.remove('-Wmissing-declarations')
 
         compiled_object_filename: str = src_filepath.replace('/', '_') + '.o'
+        object_filenames.append(compiled_object_filename)
+        object_filepath: str = f'{plugin_compiled_objects_dir}/{compiled_object_filename}'
         compile_command: list[str] = (
             [
                 'g++', '-c', '-fPIC',
                 '-isystem', 'libs',
                 src_filepath,
-                '-o', f'{plugin_compiled_objects_dir}/{compiled_object_filename}',
+                '-o', object_filepath,
             ]
             + warning_flags
             + common.getCompilerFlag_DNDEBUG()
@@ -80,6 +100,58 @@ for lib_name in lib_names:
             + common.getCompilerAndLinkerFlags_sanitizers()
         )
 
-        # TODO OPTIMIZE: do this in parallel for all files, using Popen
-        result: sp.CompletedProcess = sp.run(compile_command)
-        if (result.returncode != 0): sys.exit(f"Error: Failed to compile file `{src_filepath}`.")
+        process = sp.Popen(preprocessCommand(compile_command), stdout=sp.PIPE, stderr=sp.DEVNULL)
+        preprocess_processes.append((process, src_filepath, object_filepath, compile_command))
+
+    for (process, src_filepath, object_filepath, compile_command) in preprocess_processes:
+
+        hash_filepath: str = object_filepath + '.sha256'
+        preprocessed, _ = process.communicate()
+        # if it doesn't even preprocess, the compiler reports why
+        if (process.returncode != 0):
+            stale_objects.append((src_filepath, hash_filepath, '', compile_command))
+            continue
+
+        hasher = hashlib.sha256()
+        hasher.update(' '.join(compile_command).encode())
+        hasher.update(preprocessed)
+        digest: str = hasher.hexdigest()
+
+        if (os.path.isfile(object_filepath) and os.path.isfile(hash_filepath)):
+            with open(hash_filepath) as file:
+                if (file.read() == digest): continue
+
+        # written once the object is, so that a failed compile is retried
+        if (os.path.exists(hash_filepath)): os.remove(hash_filepath)
+        stale_objects.append((src_filepath, hash_filepath, digest, compile_command))
+
+    # the objects of the sources that were removed from `info.toml`, which stage D would still link
+    for filename in os.listdir(plugin_compiled_objects_dir):
+        object_filename: str = filename.removesuffix('.sha256')
+        if (object_filename not in object_filenames):
+            os.remove(f'{plugin_compiled_objects_dir}/{filename}')
+
+
+compilation_processes: list[tuple[sp.Popen, str, str, str]] = []
+for (src_filepath, hash_filepath, digest, compile_command) in stale_objects:
+    process = sp.Popen(compile_command, stdout=sp.PIPE, stderr=sp.STDOUT)
+    compilation_processes.append((process, src_filepath, hash_filepath, digest))
+
+a_compilation_failed: bool = False
+for (process, src_filepath, hash_filepath, digest) in compilation_processes:
+
+    output, _ = process.communicate()
+    if (len(output) != 0):
+        print(f"Output of compiling `{src_filepath}`:")
+        sys.stdout.write(output.decode(errors='replace'))
+
+    if (process.returncode != 0):
+        print(f"Error: Failed to compile file `{src_filepath}`.")
+        a_compilation_failed = True
+    elif (digest != ''):
+        with open(hash_filepath, 'w') as file:
+            file.write(digest)
+
+print(f"Compiled {len(compilation_processes)} plugin source files; the others were up to date.")
+sys.stdout.flush()
+if a_compilation_failed: sys.exit("Error: A plugin source file failed to compile.")
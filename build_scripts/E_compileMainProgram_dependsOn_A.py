@@ -63,7 +63,8 @@ os.mkdir(SPIRV_DIR_PATH)
 # compile shaders --------------------------------------------------------------------------------------------
 
 shader_source_files = filter(
-    lambda s: s.endswith('.vert') or s.endswith('.frag') or s.endswith('.comp'),
+    lambda s: s.endswith('.vert') or s.endswith('.frag') or s.endswith('.comp')
+        or s.endswith('.task') or s.endswith('.mesh'),
     os.listdir('src')
 )
 
@@ -73,6 +74,7 @@ for shader_source_file in shader_source_files:
          + [
             'glslc',
             'src/' + shader_source_file,
+            '--target-env=vulkan1.3', # subgroup operations need SPIR-V 1.3
             '-g',
             '-o', SPIRV_DIR_PATH + '/' + shader_source_file + '.spv'
         ]
@@ -0,0 +1,135 @@
+#!/bin/python3
+
+# Builds `headless`, which steps the fluid sim plugin without a window, `benchmark`, which times it, and the
+# microbenchmarks `sort_benchmark` and `thread_pool_benchmark`, and `morton_range_check`, which checks the Morton
+# range traversal against brute force. They don't link GLFW, ImGui or the renderer; the first two reuse the
+# shaders compiled by stage E.
+
+import os
+import subprocess as sp
+
+import common
+
+
+TIME_COMMAND: list[str]
+if (os.environ.get('ANGAME_PROFILE_BUILD') is not None):
+    TIME_COMMAND = ['time', '-f', 'real %e user %U sys %S command %C']
+else:
+    TIME_COMMAND = []
+
+
+BUILD_DIR_PATH = 'build/F_compileHeadlessProgram_dependsOn_A'
+INTERMEDIATE_OBJECTS_PATH = BUILD_DIR_PATH + '/intermediate_objects'
+
+COMMON_COMPILE_FLAGS: list[str] = (
+    common.getCompilerFlag_DNDEBUG() +
+    common.getCompilerFlag_g() +
+    common.getCompilerFlag_O() +
+    common.getCompilerFlags_TracyDefines() +
+    common.getCompilerFlags_m() +
+    common.getCompilerAndLinkerFlags_sanitizers()
+)
+
+LINK_FLAGS = ['-lc', '-ldl', '-lpthread'] + common.getCompilerAndLinkerFlags_sanitizers()
+
+# one executable per main source file, each linked with all the shared objects
+PROGRAMS: dict[str, str] = {
+    'headless': 'src/headless/main.cpp',
+    'benchmark': 'src/headless/benchmark.cpp',
+    'sort_benchmark': 'src/headless/sort_benchmark.cpp',
+    'thread_pool_benchmark': 'src/headless/thread_pool_benchmark.cpp',
+    'gpu_primitives_benchmark': 'src/headless/gpu_primitives_benchmark.cpp',
+    'morton_range_check': 'src/headless/morton_range_check.cpp',
+}
+
+# the parts of `src` that don't touch the window or the renderer
+SHARED_SOURCE_FILE_PATHS: list[str] = [
+    'src/headless/compute_context.cpp',
+    'src/headless/headless_util.cpp',
+    'src/error_util.cpp',
+    'src/fence_waiter.cpp',
+    'src/file_util.cpp',
+    'src/file_watch.cpp',
+    'src/frame_capture.cpp',
+    'src/gpu_primitives.cpp',
+    'src/plugin.cpp',
+    'src/readback_ring.cpp',
+    'src/sort.cpp',
+    'src/str_util.cpp',
+    'src/thread_pool.cpp',
+    'src/trace.cpp',
+]
+
+
+os.mkdir(BUILD_DIR_PATH)
+os.mkdir(INTERMEDIATE_OBJECTS_PATH)
+
+compilation_processes: list[sp.Popen] = []
+
+def getObjectPath(source_file_path: str) -> str:
+    return INTERMEDIATE_OBJECTS_PATH + '/' + source_file_path.replace('/', '_') + '.o'
+
+for source_file_path in SHARED_SOURCE_FILE_PATHS + list(PROGRAMS.values()):
+    gcc_process = sp.Popen(
+        TIME_COMMAND
+        + [
+            'g++',
+            '-c',
+            '-o', getObjectPath(source_file_path),
+            source_file_path,
+        ]
+        + COMMON_COMPILE_FLAGS
+        + ['-isystem', 'libs']
+        + common.WARNING_FLAGS
+    )
+    compilation_processes.append(gcc_process)
+
+gcc_process = sp.Popen(
+    TIME_COMMAND
+    + [
+        'g++',
+        '-c',
+        '-o', getObjectPath('libs/loguru/loguru.cpp'),
+        'libs/loguru/loguru.cpp',
+        '-I', 'libs/loguru',
+    ]
+    + COMMON_COMPILE_FLAGS
+)
+compilation_processes.append(gcc_process)
+
+a_compilation_failed: bool = False
+for p in compilation_processes:
+    p.communicate()
+    if p.returncode != 0: a_compilation_failed = True
+if a_compilation_failed:
+    print('A compilation failed; aborting build.')
+    exit(1);
+
+# link -------------------------------------------------------------------------------------------------------
+
+shared_object_paths: list[str] = (
+    [getObjectPath(s) for s in SHARED_SOURCE_FILE_PATHS] + [getObjectPath('libs/loguru/loguru.cpp')]
+)
+
+link_processes: list[sp.Popen] = []
+for program_name, main_source_file_path in PROGRAMS.items():
+    gcc_process = sp.Popen(
+        TIME_COMMAND
+        + [
+            'g++',
+            '-o', BUILD_DIR_PATH + '/' + program_name,
+        ]
+        + LINK_FLAGS
+        + [getObjectPath(main_source_file_path)]
+        + shared_object_paths
+        + (['./build/tracy.so'] if common.isTracyEnabled() else [])
+    )
+    link_processes.append(gcc_process)
+
+a_link_failed: bool = False
+for p in link_processes:
+    p.communicate()
+    if p.returncode != 0: a_link_failed = True
+if a_link_failed:
+    print('Link failed; aborting build.')
+    exit(1)
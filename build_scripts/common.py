@@ -45,11 +45,25 @@ def getCompilerFlag_g() -> list[str]:
     return ['-g3']
 
 
+def getZoneLevel() -> int:
+    # see `ZONE_LEVEL` in src/trace.hpp: 0 for no zones, 1 for the per-frame ones, 2 to add the per-stage ones,
+    # and 3 to add the per-task ones
+    env_str = os.environ.get("ANGAME_ZONE_LEVEL")
+    if (env_str is not None):
+        level = int(env_str)
+        if (level < 0 or level > 3):
+            raise ValueError(f"ANGAME_ZONE_LEVEL must be in [0, 3], not {level}")
+        return level
+    return 3
+
+
 def getCompilerFlags_TracyDefines() -> list[str]:
+    zone_level_flags = [f'-DZONE_LEVEL={getZoneLevel()}']
     if isTracyEnabled():
-        return ['-DTRACY_ENABLE', '-DTRACY_ON_DEMAND', '-DTRACY_NO_BROADCAST', '-DTRACY_VK_USE_SYMBOL_TABLE']
+        return ['-DTRACY_ENABLE', '-DTRACY_ON_DEMAND', '-DTRACY_NO_BROADCAST', '-DTRACY_VK_USE_SYMBOL_TABLE'] \
+            + zone_level_flags
     else:
-        return []
+        return zone_level_flags
 
 def getCompilerAndLinkerFlags_sanitizers() -> list[str]:
     env_str = os.environ.get("ANGAME_SANITIZE_ADDRESS")
@@ -1,8 +1,15 @@
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
 #include <cinttypes>
 #include <cmath>
-#include <x86intrin.h>
+#include <ctime>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <immintrin.h>
 
 #define GLM_FORCE_EXPLICIT_CTOR
 #include <glm/glm.hpp>
@@ -13,8 +20,10 @@
 #include <VulkanMemoryAllocator/vk_mem_alloc.h>
 #include <tracy/tracy/Tracy.hpp>
 #include <tracy/tracy/TracyVulkan.hpp>
+#include <shaderc/shaderc.h>
 
 #include "../src/types.hpp"
+#include "../src/trace.hpp"
 #include "../src/error_util.hpp"
 #include "../src/math_util.hpp"
 #include "../src/alloc_util.hpp"
@@ -23,16 +32,24 @@
 #include "../src/vulkan_context.hpp"
 #include "../src/defer.hpp"
 #include "../src/thread_pool.hpp"
-#include "../src/sort.hpp"
-#include "../src/thread_pool.hpp"
+#include "../src/file_watch.hpp"
+#include "../src/libshaderc_procs.hpp"
 #include "../src/descriptor_management.hpp"
+#include "../src/sort.hpp"
+#include "../src/morton.hpp"
+#include "../src/gpu_primitives.hpp"
+#include "../src/pass_graph.hpp"
 #include "fluid_sim_types.hpp"
 
 namespace fluid_sim {
 
 using glm::vec3;
 using glm::vec4;
+using glm::uvec2;
 using glm::uvec3;
+using glm::uvec4;
+using glm::ivec3;
+using glm::ivec4;
 
 //
 // ===========================================================================================================
@@ -42,8 +59,73 @@ constexpr f32 PI = (f32)M_PI;
 
 constexpr struct {
     u32 local_size_x = 0;
+    u32 morton_code_word_count = 1;
+    u32 open_addressing_cell_table = 2;
+    u32 dense_cell_grid = 16;
+    u32 baked_sim_params = 3;
+    u32 particle_interaction_radius = 4;
+    u32 spring_rest_length = 5;
+    u32 spring_stiffness = 6;
+    u32 cell_size_reciprocal = 7;
+    u32 hilbert_cell_order = 8;
+    u32 periodic_axes = 9;
+    u32 periodic_box_min_x = 10; // and y, z after it
+    u32 periodic_box_size_x = 13; // and y, z after it
+    u32 particle_chunk_shift = 17;
 } COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS;
 
+struct ComputeShaderSpecializationConstants {
+    u32 local_size_x;
+    // 1 for 30-bit Morton codes, 2 for 63-bit Morton codes. Must match `fluidSim_util.comp.h`.
+    u32 morton_code_word_count;
+    // Nonzero to use the open-addressing cell table. Must match `fluidSim_util.comp.h`.
+    u32 open_addressing_cell_table;
+    // Nonzero to let the open-addressing cell table be a dense grid. Must match `fluidSim_util.comp.h`.
+    u32 dense_cell_grid;
+    // Nonzero to sort the particles by the Hilbert codes of their cells. Must match `fluidSim_util.comp.h`.
+    u32 hilbert_cell_order;
+    PeriodicBox periodic_box;
+    // `GpuResources::particle_chunk_shift`. Must match `fluidSim_updateParticles.comp.h`.
+    u32 particle_chunk_shift;
+    // Nonzero to use `baked_params` instead of their copies in the uniform buffer. Must match
+    // `fluidSim_updateParticles.comp.h`.
+    u32 baked_sim_params;
+    BakedSimParams baked_params;
+};
+
+// These must match the constants in `fluidSim_radixSort.comp.h`.
+constexpr u32 RADIX_SORT_BITS_PER_PASS = 8;
+constexpr u32 RADIX_SORT_BUCKET_COUNT = 1 << RADIX_SORT_BITS_PER_PASS;
+constexpr u32 RADIX_SORT_ITEMS_PER_INVOCATION = 16;
+
+// 3 * (bits per cell index component).
+constexpr u32 MORTON_CODE_BIT_COUNT_NARROW = 30;
+constexpr u32 MORTON_CODE_BIT_COUNT_WIDE = 63;
+
+// When the particle update computes the Morton codes, the domain origin is kept until some particle moves
+// below it, or more than twice this many cells above it.
+constexpr f32 DOMAIN_ORIGIN_GUARD_BAND_CELL_COUNT = 2.0f;
+
+// The velocities are stored as a structure of arrays; see "Particle layout" in `fluidSim_util.comp.h`.
+constexpr u32 VELOCITY_COMPONENT_COUNT = 3;
+
+// Used for all the compute pipelines, unless `SimParameters::autotune_workgroup_size`.
+constexpr u32 DEFAULT_WORKGROUP_SIZE = 128;
+// The sizes that the autotuner tries, skipping those above the device limit.
+constexpr u32 AUTOTUNE_WORKGROUP_SIZES[] { 64, 128, 256, 512 };
+// Untimed, so that lazy pipeline compilation and cold caches don't count.
+constexpr u32 AUTOTUNE_WARMUP_STEP_COUNT = 2;
+constexpr u32 AUTOTUNE_TIMED_STEP_COUNT = 16;
+constexpr f32 AUTOTUNE_DELTA_T = 1.0f / 480.0f; // s
+// One line per tuning run, `<workgroup size> <device name>`; the last line for a device wins. Delete the file
+// to retune. Relative to the working directory, like the shader paths.
+constexpr const char* WORKGROUP_SIZE_CACHE_FILEPATH = "build/fluid_sim_workgroup_sizes.txt";
+// `GpuResources::stage_query_pool` has a slot per domain bounds slot, each with a begin and an end timestamp
+// per `SimStage`. The spatial structure builds outside of a step (e.g. in `create()`) use no slot.
+constexpr u32 STAGE_TIMESTAMP_SLOT_COUNT = 1 + GPU_RESIDENT_FRAMES_IN_FLIGHT;
+constexpr u32 STAGE_TIMESTAMP_SLOT_NONE = UINT32_MAX;
+constexpr u32 STAGE_TIMESTAMP_QUERIES_PER_SLOT = 2 * SIM_STAGE_COUNT;
+
 //
 // descriptor set layouts ====================================================================================
 //
@@ -51,42 +133,169 @@ constexpr struct {
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
 
 enum DescriptorSetLayoutBinding_Reduction {
-    LAYOUT_BINDING_REDUCTION__POSITIONS_IN = 0,
-    LAYOUT_BINDING_REDUCTION__POSITIONS_OUT = 1,
+    LAYOUT_BINDING_REDUCTION__POSITIONS = 0,
+    LAYOUT_BINDING_REDUCTION__PARTIALS = 1,
+    LAYOUT_BINDING_REDUCTION__STATE = 2,
+    LAYOUT_BINDING_REDUCTION__UNIFORMS = 3,
+    LAYOUT_BINDING_REDUCTION__DOMAIN_BOUNDS = 4,
 
     LAYOUT_BINDING_COUNT__REDUCTION
 };
 constexpr VkDescriptorType DESCRIPTOR_SET_LAYOUT__REDUCTION[] {
-    [LAYOUT_BINDING_REDUCTION__POSITIONS_IN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430
-    [LAYOUT_BINDING_REDUCTION__POSITIONS_OUT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430
+    [LAYOUT_BINDING_REDUCTION__POSITIONS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
+    [LAYOUT_BINDING_REDUCTION__PARTIALS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, DomainBounds[workgroup_count]
+    [LAYOUT_BINDING_REDUCTION__STATE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, ReductionState
+    [LAYOUT_BINDING_REDUCTION__UNIFORMS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, UniformBufferData::domain_min
+    [LAYOUT_BINDING_REDUCTION__DOMAIN_BOUNDS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, DomainBounds[]
 };
 static_assert(ARRAY_SIZE(DESCRIPTOR_SET_LAYOUT__REDUCTION) == LAYOUT_BINDING_COUNT__REDUCTION);
 
+enum DescriptorSetLayoutBinding_RadixSort {
+    LAYOUT_BINDING_RADIX_SORT__KEYS_IN = 0,
+    LAYOUT_BINDING_RADIX_SORT__VALUES_IN = 1,
+    LAYOUT_BINDING_RADIX_SORT__KEYS_OUT = 2,
+    LAYOUT_BINDING_RADIX_SORT__VALUES_OUT = 3,
+    LAYOUT_BINDING_RADIX_SORT__HISTOGRAMS = 4,
+    LAYOUT_BINDING_RADIX_SORT__SORT_STATE = 5,
+
+    LAYOUT_BINDING_COUNT__RADIX_SORT
+};
+constexpr VkDescriptorType DESCRIPTOR_SET_LAYOUT__RADIX_SORT[] {
+    [LAYOUT_BINDING_RADIX_SORT__KEYS_IN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_RADIX_SORT__VALUES_IN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_RADIX_SORT__KEYS_OUT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_RADIX_SORT__VALUES_OUT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_RADIX_SORT__HISTOGRAMS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[bucket_count * tile_count]
+    [LAYOUT_BINDING_RADIX_SORT__SORT_STATE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, RadixSortState
+};
+static_assert(ARRAY_SIZE(DESCRIPTOR_SET_LAYOUT__RADIX_SORT) == LAYOUT_BINDING_COUNT__RADIX_SORT);
+
+enum DescriptorSetLayoutBinding_Scan {
+    LAYOUT_BINDING_SCAN__DATA = 0,
+    LAYOUT_BINDING_SCAN__BLOCK_SUMS = 1,
+
+    LAYOUT_BINDING_COUNT__SCAN
+};
+constexpr VkDescriptorType DESCRIPTOR_SET_LAYOUT__SCAN[] {
+    [LAYOUT_BINDING_SCAN__DATA] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[array_size]
+    [LAYOUT_BINDING_SCAN__BLOCK_SUMS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[block_count]
+};
+static_assert(ARRAY_SIZE(DESCRIPTOR_SET_LAYOUT__SCAN) == LAYOUT_BINDING_COUNT__SCAN);
+
 enum DescriptorSetLayoutBindings_General {
     LAYOUT_BINDING_GENERAL__UNIFORMS = 0,
     LAYOUT_BINDING_GENERAL__POSITIONS_SORTED = 1,
     LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED = 2,
     LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED = 3,
     LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED = 4,
-    LAYOUT_BINDING_GENERAL__C_BEGIN = 5,
-    LAYOUT_BINDING_GENERAL__C_LENGTH = 6,
+    LAYOUT_BINDING_GENERAL__CELLS = 5,
+    LAYOUT_BINDING_GENERAL__HASH_BUCKETS = 6,
     LAYOUT_BINDING_GENERAL__H_BEGIN = 7,
     LAYOUT_BINDING_GENERAL__H_LENGTH = 8,
-    LAYOUT_BINDING_GENERAL__MORTON_CODES_OR_PERMUTATION = 9,
+    LAYOUT_BINDING_GENERAL__PERMUTATION = 9,
+    LAYOUT_BINDING_GENERAL__MORTON_CODES = 10,
+    LAYOUT_BINDING_GENERAL__CELL_COUNT = 11,
+    LAYOUT_BINDING_GENERAL__CELL_STARTS_SCAN = 12,
+    LAYOUT_BINDING_GENERAL__C_BEGIN_MORTON_ORDER = 13,
+    LAYOUT_BINDING_GENERAL__C_LENGTH_MORTON_ORDER = 14,
+    LAYOUT_BINDING_GENERAL__CELL_HASH_RANKS = 15,
+    LAYOUT_BINDING_GENERAL__POSITIONS_REFERENCE = 16,
+    LAYOUT_BINDING_GENERAL__MAX_DISPLACEMENT = 17,
+    LAYOUT_BINDING_GENERAL__REDUCTION_PARTIALS = 18,
+    LAYOUT_BINDING_GENERAL__NEIGHBOR_LISTS = 19,
+    LAYOUT_BINDING_GENERAL__NEIGHBOR_COUNTS = 20,
+    LAYOUT_BINDING_GENERAL__NEIGHBOR_LIST_OVERFLOW = 21,
+    LAYOUT_BINDING_GENERAL__POSITIONS_QUANTIZED = 22,
+    LAYOUT_BINDING_GENERAL__CELL_SLOTS = 23,
+    LAYOUT_BINDING_GENERAL__CELL_CODES_MORTON_ORDER = 24,
+    LAYOUT_BINDING_GENERAL__REMOVED_PARTICLE_COUNT = 25,
+    LAYOUT_BINDING_GENERAL__DELTA_TS = 26,
+    LAYOUT_BINDING_GENERAL__COLLIDER_SLOTS = 27,
+    LAYOUT_BINDING_GENERAL__COLLIDER_DISTANCES = 28,
+    LAYOUT_BINDING_GENERAL__DENSITIES = 29,
+    LAYOUT_BINDING_GENERAL__MAX_MOTION = 30,
+    LAYOUT_BINDING_GENERAL__CALM_STEPS_SORTED = 31,
+    LAYOUT_BINDING_GENERAL__CALM_STEPS_UNSORTED = 32,
+    LAYOUT_BINDING_GENERAL__CELL_AWAKE = 33,
+    LAYOUT_BINDING_GENERAL__CELL_ACTIVE = 34,
+    LAYOUT_BINDING_GENERAL__ACTIVE_PARTICLES = 35,
+    LAYOUT_BINDING_GENERAL__SLEEP_STATE = 36,
+    LAYOUT_BINDING_GENERAL__ENSEMBLE_MEMBERS = 37,
+    LAYOUT_BINDING_GENERAL__MEMBER_IDS_SORTED = 38,
+    LAYOUT_BINDING_GENERAL__MEMBER_IDS_UNSORTED = 39,
+    LAYOUT_BINDING_GENERAL__PARTICLE_IDS_SORTED = 40,
+    LAYOUT_BINDING_GENERAL__PARTICLE_IDS_UNSORTED = 41,
+    LAYOUT_BINDING_GENERAL__SPATIAL_QUERIES = 42,
+    LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_RESULTS = 43,
+    LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_HITS = 44,
+    LAYOUT_BINDING_GENERAL__REGION_OFFSETS = 45,
+    LAYOUT_BINDING_GENERAL__REGION_READBACK = 46,
+    LAYOUT_BINDING_GENERAL__PBF_POSITIONS = 47,
+    LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_SORTED = 48,
+    LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_UNSORTED = 49,
+    LAYOUT_BINDING_GENERAL__FLIP_GRID = 50,
+    LAYOUT_BINDING_GENERAL__PERSISTENT_UPDATE = 51,
+    LAYOUT_BINDING_GENERAL__VOLUME_EXPORT = 52,
+    LAYOUT_BINDING_GENERAL__DIAGNOSTICS = 53,
 
     LAYOUT_BINDING_COUNT__GENERAL
 };
 constexpr VkDescriptorType DESCRIPTOR_SET_LAYOUT__GENERAL[] {
     [LAYOUT_BINDING_GENERAL__UNIFORMS] = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // std140
-    [LAYOUT_BINDING_GENERAL__POSITIONS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
-    [LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
-    [LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
-    [LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
-    [LAYOUT_BINDING_GENERAL__C_BEGIN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
-    [LAYOUT_BINDING_GENERAL__C_LENGTH] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count
+    [LAYOUT_BINDING_GENERAL__POSITIONS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec4[particle_count]
+    [LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[3 or 2 * particle_count]
+    [LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec4[particle_count]
+    [LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[3 or 2 * particle_count]
+    [LAYOUT_BINDING_GENERAL__CELLS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, uvec2[particle_count]
+    [LAYOUT_BINDING_GENERAL__HASH_BUCKETS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, uvec2[hash_table_size]
     [LAYOUT_BINDING_GENERAL__H_BEGIN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
     [LAYOUT_BINDING_GENERAL__H_LENGTH] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
-    [LAYOUT_BINDING_GENERAL__MORTON_CODES_OR_PERMUTATION] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__PERMUTATION] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__MORTON_CODES] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__CELL_COUNT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, CellCountState
+    [LAYOUT_BINDING_GENERAL__CELL_STARTS_SCAN] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__C_BEGIN_MORTON_ORDER] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count + 1]
+    [LAYOUT_BINDING_GENERAL__C_LENGTH_MORTON_ORDER] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__CELL_HASH_RANKS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__POSITIONS_REFERENCE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec3[particle_count]
+    [LAYOUT_BINDING_GENERAL__MAX_DISPLACEMENT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32
+    [LAYOUT_BINDING_GENERAL__REDUCTION_PARTIALS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, DomainBounds[workgroup_count]
+    [LAYOUT_BINDING_GENERAL__NEIGHBOR_LISTS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count * neighbor_list_capacity], MAX_BUFFER_CHUNK_COUNT chunks
+    [LAYOUT_BINDING_GENERAL__NEIGHBOR_COUNTS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__NEIGHBOR_LIST_OVERFLOW] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32
+    [LAYOUT_BINDING_GENERAL__POSITIONS_QUANTIZED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, uvec2[particle_count]
+    [LAYOUT_BINDING_GENERAL__CELL_SLOTS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, uvec4[cell_slot_count]
+    [LAYOUT_BINDING_GENERAL__CELL_CODES_MORTON_ORDER] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, uvec2[particle_count]
+    [LAYOUT_BINDING_GENERAL__REMOVED_PARTICLE_COUNT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32
+    [LAYOUT_BINDING_GENERAL__DELTA_TS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, f32[1 + GPU_RESIDENT_FRAMES_IN_FLIGHT]
+    [LAYOUT_BINDING_GENERAL__COLLIDER_SLOTS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, ivec4[collider_slot_count]
+    [LAYOUT_BINDING_GENERAL__COLLIDER_DISTANCES] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, f32[brick capacity * COLLIDER_BRICK_SAMPLE_COUNT]
+    [LAYOUT_BINDING_GENERAL__DENSITIES] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, f32[particle_count]
+    [LAYOUT_BINDING_GENERAL__MAX_MOTION] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, MaxMotion[1 + GPU_RESIDENT_FRAMES_IN_FLIGHT]
+    [LAYOUT_BINDING_GENERAL__CALM_STEPS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__CALM_STEPS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__CELL_AWAKE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__CELL_ACTIVE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__ACTIVE_PARTICLES] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__SLEEP_STATE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, SleepState
+    [LAYOUT_BINDING_GENERAL__ENSEMBLE_MEMBERS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, EnsembleMemberParams[ensemble_member_count]
+    [LAYOUT_BINDING_GENERAL__MEMBER_IDS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__MEMBER_IDS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__PARTICLE_IDS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__PARTICLE_IDS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__SPATIAL_QUERIES] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, SpatialQuery[spatial_query_capacity]
+    [LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_RESULTS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, SpatialQueryResult[spatial_query_capacity]
+    [LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_HITS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, SpatialQueryHit[spatial_query_hit_capacity]
+    [LAYOUT_BINDING_GENERAL__REGION_OFFSETS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__REGION_READBACK] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, see `GpuResources::buffer_region_readback`
+    [LAYOUT_BINDING_GENERAL__PBF_POSITIONS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, vec4[2 * particle_count]
+    [LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_SORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_UNSORTED] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, u32[particle_count]
+    [LAYOUT_BINDING_GENERAL__FLIP_GRID] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, f32[getFlipGridFloatCount()]
+    // std430, see `fluidSim_updateParticlesPersistent.comp`
+    [LAYOUT_BINDING_GENERAL__PERSISTENT_UPDATE] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    [LAYOUT_BINDING_GENERAL__VOLUME_EXPORT] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, see `GpuResources::buffer_volume_export`
+    [LAYOUT_BINDING_GENERAL__DIAGNOSTICS] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // std430, Diagnostics[1 + GPU_RESIDENT_FRAMES_IN_FLIGHT]
 };
 static_assert(ARRAY_SIZE(DESCRIPTOR_SET_LAYOUT__GENERAL) == LAYOUT_BINDING_COUNT__GENERAL);
 
@@ -116,43 +325,269 @@ static inline u32 divCeil(u32 numerator, u32 denominator) {
 }
 
 
-/// Get the index of the cell that contains the particle.
-static inline uvec3 cellIndex(vec3 particle, vec3 domain_min, f32 cell_size_reciprocal) {
-
-    return uvec3((particle - domain_min) * cell_size_reciprocal);
+/// The multigrid levels of the FLIP grid: `resolution >> level` cells per axis, down to 4. Same as `flipLevelCount`
+/// in `fluidSim_flip.comp.h`.
+static u32 getFlipLevelCount(const u32 resolution) {
+    u32 level_count = 0;
+    while ((resolution >> level_count) >= 4) level_count++;
+    return level_count;
 }
 
 
-// TODO FIXME OPTIMIZE:
-//     1. This will not work on ARM.
-//     2. Even on x86, this will only work with CPUs supporting BMI2.
-//     3. On AMD Zen 1 and Zen 2, PDEP is slow as shit. https://fgiesen.wordpress.com/2022/09/09/morton-codes-addendum/
-static inline u32 cellMortonCode(uvec3 cell_index) {
+/// The size of `GpuResources::buffer_flip_grid`; see the layout in `fluidSim_flip.comp.h`. 0 without a grid.
+static u64 getFlipGridFloatCount(const u32 resolution, const u32 workgroup_size) {
 
-    // OPTIMIZE: if you do this using inline assembly instead of the intrinsics, you can use 1 less register
-    // and avoid the `or`s, if the compiler isn't already smart enough to do that.
-
-    u32 result = 0;
-    result |= _pdep_u32(cell_index.x, 0b00'001001001001001001001001001001);
-    result |= _pdep_u32(cell_index.y, 0b00'010010010010010010010010010010);
-    result |= _pdep_u32(cell_index.z, 0b00'100100100100100100100100100100);
-    return result;
-}
+    if (resolution == 0) return 0;
 
+    const u64 cell_count = (u64)resolution * resolution * resolution;
+    u64 level_cell_total = 0;
+    for (u32 level = 0; level < getFlipLevelCount(resolution); level++)
+    {
+        const u64 level_resolution = resolution >> level;
+        level_cell_total += level_resolution * level_resolution * level_resolution;
+    }
+    constexpr u64 velocity_array_count = 6; // 3 axes, before and after the projection
+    constexpr u64 level_array_count = 4; // FLIP_ARRAY_COUNT
+    constexpr u64 cg_array_count = 3; // FLIP_CG_ARRAY_COUNT
+    constexpr u64 scalar_count = 4; // FLIP_SCALAR_COUNT
 
-static inline u32 mortonCodeHash(u32 cell_morton_code, u32 hash_modulus) {
-    return cell_morton_code % hash_modulus;
+    return (velocity_array_count + cg_array_count) * cell_count + level_array_count * level_cell_total + scalar_count
+        + divCeil((u32)cell_count, workgroup_size);
 }
 
 
 struct ParticleUpdatePushConstants {
-    alignas(4) f32 delta_t;
-    alignas(4) u32 cell_count;
+    alignas(4) u32 delta_t_slot; // of `buffer_delta_ts`
+    alignas(4) u32 use_reference_positions;
+    alignas(4) u32 write_morton_codes;
+    alignas(4) u32 use_neighbor_lists;
+    alignas(4) u32 neighbor_list_capacity;
+    alignas(4) f32 neighbor_list_cutoff;
+    alignas(4) u32 use_quantized_positions;
+    alignas(4) u32 cell_slot_count;
+    alignas(4) u32 use_morton_ranges;
+    alignas(4) u32 cell_level_count; // 1 for only the fine cells
+    alignas(4) u32 sparse_cell_particle_count;
+    alignas(4) u32 collider_slot_count; // 0 if there are no collider bricks
+    alignas(4) f32 collider_cell_size_reciprocal;
+    alignas(4) u32 sph_pass; // SphPass
+    alignas(4) u32 pbf_positions_offset; // the half of `buffer_pbf_positions` that the PBF passes read
+    alignas(4) u32 track_max_motion; // into slot `delta_t_slot` of `buffer_max_motion`
+    alignas(4) u32 track_diagnostics; // into slot `delta_t_slot` of `buffer_diagnostics`
+    alignas(4) u32 sleep_step_count; // 0 unless `SimParameters::sleeping`
+    alignas(4) f32 sleep_speed;
+    alignas(4) f32 sleep_acceleration;
+    alignas(4) u32 ensemble_member_count; // 0 unless the sim is an ensemble
+    alignas(4) u32 persistent_pass; // PersistentPass, for `fluidSim_updateParticlesPersistent` only
+};
+
+// The passes of `fluidSim_updateParticlesPersistent.comp`; must match its PERSISTENT_PASS_* constants.
+enum PersistentPass : u32 {
+    PERSISTENT_PASS_RANK = 0,
+    PERSISTENT_PASS_SCATTER = 1,
+    PERSISTENT_PASS_UPDATE = 2,
+};
+// The cost buckets of the chunks' queue, one per bit of a cost; must match its PERSISTENT_BUCKET_COUNT.
+constexpr u32 PERSISTENT_UPDATE_BUCKET_COUNT = 32;
+
+// What the plain particle update computes; must match the SPH_PASS_* constants in `fluidSim_updateParticles.comp.h`.
+enum SphPass : u32 {
+    SPH_PASS_NONE = 0, // the springs
+    SPH_PASS_DENSITY = 1, // `fluidSim_computeDensities`
+    SPH_PASS_FORCES = 2, // the update, with the densities of the density pass
+    // `SimParameters::pbf`: the passes of `fluidSim_solveDensityConstraints`, then the update
+    SPH_PASS_PBF_PREDICT = 3,
+    SPH_PASS_PBF_MULTIPLIERS = 4,
+    SPH_PASS_PBF_CORRECT = 5,
+    SPH_PASS_PBF_FINISH = 6, // the update, towards the corrected predicted positions
+    // `SimParameters::flip`: `fluidSim_flip_transferToGrid`, then the pressure solve, then the update
+    SPH_PASS_FLIP_TRANSFER = 7,
+    SPH_PASS_FLIP_FINISH = 8, // the update, to the velocities from the grid
+};
+
+// The passes of `fluidSim_flip_solvePressure.comp`; must match its FLIP_PASS_* constants.
+enum FlipPass : u32 {
+    FLIP_PASS_DIVERGENCE = 0,
+    FLIP_PASS_COARSEN = 1,
+    FLIP_PASS_SMOOTH = 2,
+    FLIP_PASS_RESTRICT = 3,
+    FLIP_PASS_PROLONG = 4,
+    FLIP_PASS_DOT_RZ = 5,
+    FLIP_PASS_REDUCE_RZ = 6,
+    FLIP_PASS_UPDATE_P = 7,
+    FLIP_PASS_APPLY = 8,
+    FLIP_PASS_REDUCE_PQ = 9,
+    FLIP_PASS_UPDATE_XR = 10,
+    FLIP_PASS_PROJECT = 11,
+};
+
+// Must match `PushConstants` in `fluidSim_flip_solvePressure.comp`.
+struct FlipPressurePushConstants {
+    alignas(4) u32 pass; // FlipPass
+    alignas(4) u32 resolution; // of level 0
+    alignas(4) u32 level;
+    alignas(4) u32 z_array; // FLIP_ARRAY_Z0 or FLIP_ARRAY_Z1 of `fluidSim_flip.comp.h`
+    alignas(4) u32 zero_initial_guess;
+};
+
+// Must match `PushConstants` in `fluidSim_removeParticles.comp`.
+struct RemoveParticlesPushConstants {
+    alignas(16) vec3 box_min;
+    alignas(16) vec3 box_max;
+};
+
+// What a `SpatialQuery` finds; must match the SPATIAL_QUERY_* constants in `fluidSim_spatialQuery.comp`.
+enum SpatialQueryType : u32 {
+    SPATIAL_QUERY_RADIUS = 0, // `queryRadius()`
+    SPATIAL_QUERY_BOX = 1, // `queryBox()`
+    SPATIAL_QUERY_K_NEAREST = 2, // `queryKNearest()`
+};
+
+// Must match `PushConstants` in `fluidSim_spatialQuery.comp`.
+struct SpatialQueryPushConstants {
+    alignas(4) u32 query_count;
+    alignas(4) u32 permuted;
+    alignas(4) f32 max_displacement;
+    alignas(4) u32 cell_slot_count;
+};
+
+// Must match `PushConstants` in `fluidSim_regionReadback_mark.comp` and `fluidSim_regionReadback_scatter.comp`.
+struct RegionReadbackPushConstants {
+    alignas(16) vec4 planes[MAX_REGION_PLANE_COUNT];
+    alignas(4) u32 plane_count;
+    alignas(4) u32 field_mask;
+    alignas(4) u32 capacity;
+};
+
+// Must match `PushConstants` in `fluidSim_exportVolume.comp`.
+struct VolumeExportPushConstants {
+    alignas(4) u32 slot_offset; // in u32s
+    alignas(4) u32 brick_capacity;
+    alignas(4) u32 permuted;
+    alignas(4) u32 cell_slot_count;
+};
+
+// Must match `PushConstants` in `fluidSim_generateParticles.comp`.
+struct GenerateParticlesPushConstants {
+    alignas(16) vec3 box_min;
+    alignas(16) vec3 box_max;
+    alignas(4) u32 shape;
+    alignas(4) f32 lattice_spacing;
+    alignas(4) f32 jitter;
+    alignas(4) u32 seed;
+    alignas(4) u32 attribute_first;
+    alignas(4) u32 attribute_last;
+    alignas(4) u32 lattice_row_length;
+    alignas(4) u32 lattice_layer_length;
+};
+
+struct SortParticlesPushConstants {
+    alignas(4) u32 gather;
+    alignas(4) u32 use_permutation;
+    alignas(4) u32 write_reference_positions;
+    alignas(4) u32 write_quantized_positions;
+    alignas(4) u32 sleep_step_count; // 0 unless `SimParameters::sleeping`
+    alignas(4) u32 sort_member_ids; // if the sim is an ensemble
 };
 
 struct ReductionPushConstants {
     alignas(4) u32 array_size;
+    alignas(4) u32 domain_bounds_slot;
+};
+
+struct DomainOriginPushConstants {
+    alignas(4) u32 partial_count;
+    alignas(4) u32 domain_bounds_slot;
+    alignas(4) f32 guard_band;
+    alignas(4) u32 morton_code_workgroup_count;
+};
+
+// Must match `domain_bounds_` and the layout of `partials_` in `fluidSim_computeBounds.comp`.
+struct DomainBounds {
+    alignas(16) vec3 min;
+    alignas(16) vec3 max;
+};
+static_assert(sizeof(DomainBounds) == 2 * sizeof(vec4));
+
+// Must match `MaxMotion` in `fluidSim_updateParticles.comp.h`. The maxima are stored as their bit patterns, like
+// `buffer_max_displacement`, so that the update can reduce them with integer atomics.
+struct MaxMotion {
+    alignas(4) u32 speed_bits;
+    alignas(4) u32 acceleration_bits;
+};
+
+// Must match `DIAGNOSTICS_*` in `fluidSim_updateParticles.comp.h`. Each workgroup adds its sums as 64-bit two's
+// complement fixed point, split into (low, high) words that the update adds with a carry, so that the totals
+// neither lose the small workgroups' sums to rounding nor depend on the order that the workgroups add them in.
+struct Diagnostics {
+    alignas(4) u32 momentum[3][2];
+    alignas(4) u32 kinetic_energy[2];
+    alignas(4) u32 max_density_bits; // like `MaxMotion`'s
+    alignas(4) u32 escaped_count;
+    alignas(4) u32 step_count; // added to by the first workgroup of each step
+    alignas(4) u32 pad_;
+};
+static_assert(sizeof(Diagnostics) == 12 * sizeof(u32));
+constexpr f64 DIAGNOSTICS_FIXED_POINT_SCALE = 1048576.0; // 2^20
+
+// Must match `PushConstants` in `fluidSim_hashTable_insertCells.comp`.
+struct InsertCellsPushConstants {
+    alignas(4) u32 cell_slot_count;
+    alignas(4) u32 bounds_pass; // only with `GpuResources::dense_cell_grid`
+};
+
+struct ScanPushConstants {
+    alignas(4) u32 array_size;
+};
+
+struct RadixSortPushConstants {
+    alignas(4) u32 array_size;
+    alignas(4) u32 bit_shift;
+    alignas(4) u32 tile_count;
+    alignas(4) u32 is_first_pass;
+};
+
+// Must match `SortState` in `fluidSim_radixSort.comp.h`.
+struct RadixSortState {
+    alignas(4) u32 descent_count;
+    alignas(4) VkDispatchIndirectCommand tiles_dispatch;
+    alignas(4) VkDispatchIndirectCommand single_workgroup_dispatch;
+    alignas(4) VkDispatchIndirectCommand identity_dispatch;
+};
+static_assert(sizeof(RadixSortState) == 10 * sizeof(u32));
+
+// Must match `ReductionState` in `fluidSim_computeBounds.comp` and `fluidSim_updateDomainOrigin.comp`.
+struct ReductionState {
+    alignas(4) u32 finished_workgroup_count;
+    alignas(4) VkDispatchIndirectCommand morton_codes_dispatch;
+};
+static_assert(sizeof(ReductionState) == 4 * sizeof(u32));
+
+// Must match `CellCount` in `fluidSim_cellList_scatter.comp`. Written with the cell list, so that the passes over
+// the cells are sized on the GPU; the other shaders only declare `cell_count`.
+struct CellCountState {
+    alignas(4) u32 cell_count;
+    alignas(4) VkDispatchIndirectCommand cells_dispatch; // one invocation per cell
+};
+static_assert(sizeof(CellCountState) == 4 * sizeof(u32));
+
+// Must match `SleepState` in `fluidSim_updateParticles.comp.h`. Reset before each step of the sleeping mode, and
+// written by `fluidSim_sleep_compactParticles`.
+struct SleepState {
+    alignas(4) u32 active_particle_count;
+    alignas(4) VkDispatchIndirectCommand active_particles_dispatch; // one invocation per active particle
+};
+static_assert(sizeof(SleepState) == 4 * sizeof(u32));
+
+// Must match `ensemble_members_` in `fluidSim_updateParticles.comp.h`: the parameters that the members of an
+// ensemble don't share (see `EnsembleMember`).
+struct EnsembleMemberParams {
+    alignas(4) f32 spring_stiffness;
+    alignas(4) f32 sph_stiffness;
+    alignas(4) f32 sph_viscosity;
+    alignas(4) f32 padding;
 };
+static_assert(sizeof(EnsembleMemberParams) == sizeof(vec4));
 
 struct UniformBufferData {
 
@@ -170,2101 +605,12492 @@ struct UniformBufferData {
 
         // stuff whose lifetime is the lifetime of the sim
         alignas(4) u32 particle_count;
-        alignas(4) u32 hash_modulus;
+        alignas(4) u32 hash_table_size;
+        alignas(4) u32 particle_capacity;
+        alignas(4) u32 half_velocities;
+        alignas(4) u32 particle_ids;
+        alignas(4) u32 particle_levels;
+
+        // Sim parameters that only the particle update kernels read, so they're last, and the other shaders
+        // leave them out of their uniform blocks.
+        alignas(4) f32 sph_stiffness;
+        alignas(4) f32 sph_viscosity;
+        alignas(4) f32 sph_density_kernel_coefficient;
+        alignas(4) f32 sph_gradient_kernel_coefficient;
+        alignas(4) f32 pbf_relaxation_epsilon;
+        alignas(4) f32 flip_ratio;
+        alignas(4) u32 flip_grid_resolution;
     } updated_by_host;
 };
 
 
-struct PipelineBarrierSrcInfo {
-    VkPipelineStageFlags src_stage_mask;
-    VkPipelineStageFlags src_access_mask;
-};
-[[nodiscard]] static PipelineBarrierSrcInfo recordMinReductionCommands(
+static void recordComputeToComputeBarrier(const VulkanContext* vk_ctx, const VkCommandBuffer command_buffer) {
+
+    const VkMemoryBarrier memory_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &memory_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+}
+
+
+/// Like `recordComputeToComputeBarrier()`, but also makes the writes visible to the indirect dispatches after it.
+static void recordComputeToIndirectBarrier(const VulkanContext* vk_ctx, const VkCommandBuffer command_buffer) {
+
+    const VkMemoryBarrier memory_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &memory_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+}
+
+
+static void recordTransferToComputeBarrier(const VulkanContext* vk_ctx, const VkCommandBuffer command_buffer) {
+
+    const VkMemoryBarrier memory_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &memory_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+}
+
+
+/// Clears the timestamps of `slot`, so that those of the stages that the step skips read as unavailable. Must
+/// be recorded before the step's first timestamp. Does nothing if `SimParameters::stage_timestamps` is off.
+static void recordStageTimestampReset(
     const SimData* s,
     const VulkanContext* vk_ctx,
-    const VkCommandBuffer command_buffer
+    const VkCommandBuffer command_buffer,
+    const u32 slot
 ) {
+    const VkQueryPool query_pool = s->gpu_resources.stage_query_pool;
+    if (query_pool == VK_NULL_HANDLE or slot == STAGE_TIMESTAMP_SLOT_NONE) return;
 
-    ZoneScoped;
+    vk_ctx->procs_dev.CmdResetQueryPool(
+        command_buffer, query_pool, slot * STAGE_TIMESTAMP_QUERIES_PER_SLOT, STAGE_TIMESTAMP_QUERIES_PER_SLOT
+    );
+}
 
 
-    u32 array_length = (u32)s->particle_count;
-    VkDescriptorSet descriptor_set = s->gpu_resources.descriptor_set_reduction__positions_to_reduction1;
-    VkBuffer dst_buffer = s->gpu_resources.buffer_reduction_1.buffer;
+/// Writes the begin (or, if `end`, the end) timestamp of `stage` to `slot`, once the commands before it have
+/// finished. Does nothing if `SimParameters::stage_timestamps` is off.
+static void recordStageTimestamp(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const u32 slot,
+    const SimStage stage,
+    const bool end
+) {
+    const VkQueryPool query_pool = s->gpu_resources.stage_query_pool;
+    if (query_pool == VK_NULL_HANDLE or slot == STAGE_TIMESTAMP_SLOT_NONE) return;
 
-    while (true)
-    {
-        vk_ctx->procs_dev.CmdBindPipeline(
-            command_buffer,
-            VK_PIPELINE_BIND_POINT_COMPUTE,
-            s->gpu_resources.pipeline_computeMin
-        );
-        vk_ctx->procs_dev.CmdBindDescriptorSets(
-            command_buffer,
-            VK_PIPELINE_BIND_POINT_COMPUTE,
-            s->gpu_resources.pipeline_layout_computeMin,
-            0, // firstSet
-            1, // descriptorSetCount
-            &descriptor_set,
-            0, // dynamicOffsetCount
-            NULL // pDynamicOffsets
-        );
+    const u32 query_idx = slot * STAGE_TIMESTAMP_QUERIES_PER_SLOT + 2 * stage + (end ? 1u : 0u);
+    vk_ctx->procs_dev.CmdWriteTimestamp(
+        command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, query_idx
+    );
+}
 
-        const ReductionPushConstants push_constants { .array_size = array_length };
-        vk_ctx->procs_dev.CmdPushConstants(
-            command_buffer,
-            s->gpu_resources.pipeline_layout_computeMin,
-            VK_SHADER_STAGE_COMPUTE_BIT,
-            0, // offset
-            sizeof(ReductionPushConstants), // size
-            &push_constants
-        );
-        // OPTIMIZE: Maybe should tune a special workgroup size for this pipeline, since the optimal
-        //     parameters for this might not be the same as the optimal parameters for other GPU work.
-        vk_ctx->procs_dev.CmdDispatch(command_buffer, s->gpu_resources.workgroup_count, 1, 1);
 
-        array_length = divCeil(array_length, 2);
+/// Orders the transfers and compute shaders after the barrier after everything before it.
+static void recordStepBarrier(const VulkanContext* vk_ctx, const VkCommandBuffer command_buffer) {
 
-        // ---------------------------------------------------------------------------------------------------
-        if (array_length == 1) break;
-        // ---------------------------------------------------------------------------------------------------
+    const VkMemoryBarrier memory_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &memory_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+}
 
-        const VkBufferMemoryBarrier buffer_memory_barrier {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-            .srcQueueFamilyIndex = vk_ctx->queue_family_index,
-            .dstQueueFamilyIndex = vk_ctx->queue_family_index,
-            .buffer = dst_buffer,
-            .offset = 0,
-            .size = VK_WHOLE_SIZE, // OPTIMIZE this can be smaller: array_size * sizeof(vec4)
-        };
-        vk_ctx->procs_dev.CmdPipelineBarrier(
-            command_buffer,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0, // dependencyFlags
-            0, // memoryBarrierCount
-            NULL, // pMemoryBarriers
-            1, // bufferMemoryBarrierCount
-            &buffer_memory_barrier,
-            0, // imageMemoryBarrierCount
-            NULL // pImageMemoryBarriers
-        );
 
-        descriptor_set =
-            (descriptor_set == s->gpu_resources.descriptor_set_reduction__reduction1_to_reduction2)
-            ? s->gpu_resources.descriptor_set_reduction__reduction2_to_reduction1
-            : s->gpu_resources.descriptor_set_reduction__reduction1_to_reduction2;
-        dst_buffer =
-            (dst_buffer == s->gpu_resources.buffer_reduction_2.buffer)
-            ? s->gpu_resources.buffer_reduction_1.buffer
-            : s->gpu_resources.buffer_reduction_2.buffer;
-    }
+/// The main descriptor set for the next dispatches; see `GpuResources::particle_buffers_swapped`.
+static VkDescriptorSet getMainDescriptorSet(const GpuResources* res) {
+    return res->particle_buffers_swapped ? res->descriptor_set_main_swapped : res->descriptor_set_main;
+}
 
-    // copy result to uniform buffer
-    {
-        const VkBuffer src_buffer = dst_buffer;
-        dst_buffer = s->gpu_resources.buffer_uniforms.buffer;
 
-        const VkBufferMemoryBarrier buffer_memory_barrier {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-            .srcQueueFamilyIndex = vk_ctx->queue_family_index,
-            .dstQueueFamilyIndex = vk_ctx->queue_family_index,
-            .buffer = src_buffer,
-            .offset = 0,
-            .size = sizeof(vec3),
-        };
-        vk_ctx->procs_dev.CmdPipelineBarrier(
-            command_buffer,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0, // dependencyFlags
-            0, // memoryBarrierCount
-            NULL, // pMemoryBarriers
-            1, // bufferMemoryBarrierCount
-            &buffer_memory_barrier,
-            0, // imageMemoryBarrierCount
-            NULL // pImageMemoryBarriers
-        );
+struct ParticleBufferSet {
+    VkBuffer positions;
+    VkBuffer velocities;
+    VkBuffer calm_steps;
+    VkBuffer member_ids;
+    VkBuffer particle_ids;
+    VkBuffer particle_levels;
+};
 
-        const VkBufferCopy buffer_copy {
-            .srcOffset = 0,
-            .dstOffset = offsetof(UniformBufferData, domain_min),
-            .size = sizeof(vec3),
+/// The particle buffers that `getMainDescriptorSet()` binds as the sorted ones (the particle update's input), or
+/// as the unsorted ones (its output).
+static ParticleBufferSet getParticleBuffers(const GpuResources* res, bool sorted) {
+
+    if (sorted != res->particle_buffers_swapped)
+    {
+        return ParticleBufferSet {
+            .positions = res->buffer_positions_sorted.buffer,
+            .velocities = res->buffer_velocities_sorted.buffer,
+            .calm_steps = res->buffer_calm_steps_sorted.buffer,
+            .member_ids = res->buffer_member_ids_sorted.buffer,
+            .particle_ids = res->buffer_particle_ids_sorted.buffer,
+            .particle_levels = res->buffer_particle_levels_sorted.buffer,
         };
-        vk_ctx->procs_dev.CmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &buffer_copy);
     }
-
-    return PipelineBarrierSrcInfo {
-        .src_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT,
-        .src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    return ParticleBufferSet {
+        .positions = res->buffer_positions_unsorted.buffer,
+        .velocities = res->buffer_velocities_unsorted.buffer,
+        .calm_steps = res->buffer_calm_steps_unsorted.buffer,
+        .member_ids = res->buffer_member_ids_unsorted.buffer,
+        .particle_ids = res->buffer_particle_ids_unsorted.buffer,
+        .particle_levels = res->buffer_particle_levels_unsorted.buffer,
     };
-};
+}
 
 
-// Use for clearing / signalling semaphores.
-static void emptyQueueSubmit(
+static void recordComputeBindings(
     const VulkanContext* vk_ctx,
-    VkSemaphore optional_wait_semaphore,
-    VkSemaphore optional_signal_semaphore,
-    VkFence optional_signal_fence
+    const VkCommandBuffer command_buffer,
+    const VkPipeline pipeline,
+    const VkPipelineLayout pipeline_layout,
+    const VkDescriptorSet descriptor_set, // VK_NULL_HANDLE if the descriptors were pushed; see `recordPushDescriptors()`
+    const u32 push_constants_size, // 0 if the pipeline has no push constants
+    const void* p_push_constants
 ) {
 
-    VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-    VkSubmitInfo submit_info {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = optional_wait_semaphore == VK_NULL_HANDLE ? (u32)0 : (u32)1,
-        .pWaitSemaphores = &optional_wait_semaphore,
-        .pWaitDstStageMask = &wait_dst_stage_mask,
-        .signalSemaphoreCount = optional_signal_semaphore == VK_NULL_HANDLE ? (u32)0 : (u32)1,
-        .pSignalSemaphores = &optional_signal_semaphore,
-    };
-    VkResult result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, optional_signal_fence);
-    assertVk(result);
+    vk_ctx->procs_dev.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    if (descriptor_set != VK_NULL_HANDLE) vk_ctx->procs_dev.CmdBindDescriptorSets(
+        command_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        pipeline_layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    if (push_constants_size != 0) vk_ctx->procs_dev.CmdPushConstants(
+        command_buffer,
+        pipeline_layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0, // offset
+        push_constants_size,
+        p_push_constants
+    );
 }
 
 
-static void memsetZeroHostVisibleGpuBuffer(
+static void recordComputeDispatch(
     const VulkanContext* vk_ctx,
-    const VkDeviceSize size_bytes,
-    const VmaAllocation dst
+    const VkCommandBuffer command_buffer,
+    const VkPipeline pipeline,
+    const VkPipelineLayout pipeline_layout,
+    const VkDescriptorSet descriptor_set,
+    const u32 push_constants_size, // 0 if the pipeline has no push constants
+    const void* p_push_constants,
+    const u32 workgroup_count
 ) {
 
-    ZoneScoped;
+    recordComputeBindings(
+        vk_ctx, command_buffer, pipeline, pipeline_layout, descriptor_set, push_constants_size, p_push_constants
+    );
+    vk_ctx->procs_dev.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+}
 
-    VkResult result = VK_ERROR_UNKNOWN;
 
-    void* p_mapped_memory = NULL;
-    {
-        result = vmaMapMemory(vk_ctx->vma_allocator, dst, &p_mapped_memory);
-        assertVk(result);
-    }
+/// Like `recordComputeDispatch`, but the workgroup count is read from a `VkDispatchIndirectCommand` in
+/// `indirect_buffer` when the dispatch executes.
+static void recordComputeDispatchIndirect(
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const VkPipeline pipeline,
+    const VkPipelineLayout pipeline_layout,
+    const VkDescriptorSet descriptor_set,
+    const u32 push_constants_size, // 0 if the pipeline has no push constants
+    const void* p_push_constants,
+    const VkBuffer indirect_buffer,
+    const VkDeviceSize indirect_buffer_offset
+) {
 
-    memset(p_mapped_memory, 0, size_bytes);
+    recordComputeBindings(
+        vk_ctx, command_buffer, pipeline, pipeline_layout, descriptor_set, push_constants_size, p_push_constants
+    );
+    vk_ctx->procs_dev.CmdDispatchIndirect(command_buffer, indirect_buffer, indirect_buffer_offset);
+}
 
-    result = vmaFlushAllocation(vk_ctx->vma_allocator, dst, 0, size_bytes);
-    assertVk(result);
 
-    vmaUnmapMemory(vk_ctx->vma_allocator, dst);
-};
+/// The buffers of a radix sort pass, by binding: from the primary buffers, which the rest of the sim reads (the
+/// Morton codes and the permutation), to the scratch ones, or back.
+static void getRadixSortBufferInfos(
+    const GpuResources* res,
+    const bool scratch_to_primary,
+    VkDescriptorBufferInfo p_buffer_infos_out[LAYOUT_BINDING_COUNT__RADIX_SORT]
+) {
 
+    const VkBuffer primary_keys = res->buffer_morton_codes.buffer;
+    const VkBuffer primary_values = res->buffer_permutation.buffer;
+    const VkBuffer scratch_keys = res->buffer_radix_sort_keys_scratch.buffer;
+    const VkBuffer scratch_values = res->buffer_radix_sort_values_scratch.buffer;
+
+    const VkBuffer buffers[LAYOUT_BINDING_COUNT__RADIX_SORT] {
+        [LAYOUT_BINDING_RADIX_SORT__KEYS_IN] = scratch_to_primary ? scratch_keys : primary_keys,
+        [LAYOUT_BINDING_RADIX_SORT__VALUES_IN] = scratch_to_primary ? scratch_values : primary_values,
+        [LAYOUT_BINDING_RADIX_SORT__KEYS_OUT] = scratch_to_primary ? primary_keys : scratch_keys,
+        [LAYOUT_BINDING_RADIX_SORT__VALUES_OUT] = scratch_to_primary ? primary_values : scratch_values,
+        [LAYOUT_BINDING_RADIX_SORT__HISTOGRAMS] = res->buffer_radix_sort_histograms.buffer,
+        [LAYOUT_BINDING_RADIX_SORT__SORT_STATE] = res->buffer_radix_sort_state.buffer,
+    };
+    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__RADIX_SORT; i++) {
+        p_buffer_infos_out[i] = VkDescriptorBufferInfo { .buffer = buffers[i], .offset = 0, .range = VK_WHOLE_SIZE };
+    }
+}
 
-static void uploadBufferToHostVisibleGpuMemory(
-    const VulkanContext* vk_ctx,
-    const VkDeviceSize size_bytes,
-    const void* src,
-    const VmaAllocation dst,
-    const uintptr_t dst_offset
+/// The buffers of a scan of `data_buffer` in place, by binding.
+static void getScanBufferInfos(
+    const GpuResources* res,
+    const VkBuffer data_buffer,
+    VkDescriptorBufferInfo p_buffer_infos_out[LAYOUT_BINDING_COUNT__SCAN]
 ) {
+    p_buffer_infos_out[LAYOUT_BINDING_SCAN__DATA] =
+        VkDescriptorBufferInfo { .buffer = data_buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+    p_buffer_infos_out[LAYOUT_BINDING_SCAN__BLOCK_SUMS] =
+        VkDescriptorBufferInfo { .buffer = res->buffer_scan_block_sums.buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+}
 
-    ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+constexpr u32 MAX_PUSHED_BINDING_COUNT = 8;
+static_assert(LAYOUT_BINDING_COUNT__RADIX_SORT <= MAX_PUSHED_BINDING_COUNT);
+static_assert(LAYOUT_BINDING_COUNT__SCAN <= MAX_PUSHED_BINDING_COUNT);
+
+/// Pushes the buffers into set 0 of `pipeline_layout`, one per binding, for the dispatches that follow with a
+/// compatible layout, which then bind no set (see `recordComputeBindings()`); until the next push. Only if
+/// `GpuResources::push_descriptors`.
+static void recordPushDescriptors(
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const VkPipelineLayout pipeline_layout,
+    const u32 binding_count,
+    const VkDescriptorType* p_descriptor_types,
+    const VkDescriptorBufferInfo* p_buffer_infos
+) {
 
+    assert(vk_ctx->cmd_push_descriptor_set != NULL);
+    assert(binding_count <= MAX_PUSHED_BINDING_COUNT);
 
-    void* p_mapped_memory = NULL;
+    VkWriteDescriptorSet writes[MAX_PUSHED_BINDING_COUNT] {};
+    for (u32 binding_idx = 0; binding_idx < binding_count; binding_idx++)
     {
-        void* ptr = NULL;
+        writes[binding_idx] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = VK_NULL_HANDLE, // ignored when pushing
+            .dstBinding = binding_idx,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = p_descriptor_types[binding_idx],
+            .pBufferInfo = &p_buffer_infos[binding_idx],
+        };
+    }
 
-        result = vmaMapMemory(vk_ctx->vma_allocator, dst, &ptr);
-        assertVk(result);
+    vk_ctx->cmd_push_descriptor_set(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, binding_count, writes
+    );
+}
+
+/// The set of the radix sort's dispatches from the primary buffers to the scratch ones, or back. With push
+/// descriptors, pushes their buffers instead, and returns VK_NULL_HANDLE; the radix sort's pipelines all have
+/// compatible layouts.
+static VkDescriptorSet recordRadixSortDescriptors(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const bool scratch_to_primary
+) {
 
-        p_mapped_memory = (void*)( (uintptr_t)ptr + dst_offset );
+    if (!res->push_descriptors) {
+        return scratch_to_primary
+            ? res->descriptor_set_radix_sort__scratch_to_primary
+            : res->descriptor_set_radix_sort__primary_to_scratch;
     }
 
-    memcpy(p_mapped_memory, src, size_bytes);
+    VkDescriptorBufferInfo buffer_infos[LAYOUT_BINDING_COUNT__RADIX_SORT] {};
+    getRadixSortBufferInfos(res, scratch_to_primary, buffer_infos);
+    recordPushDescriptors(
+        vk_ctx, command_buffer, res->pipeline_layout_radixSort_histogram,
+        LAYOUT_BINDING_COUNT__RADIX_SORT, DESCRIPTOR_SET_LAYOUT__RADIX_SORT, buffer_infos
+    );
+    return VK_NULL_HANDLE;
+}
+
+/// Like `recordRadixSortDescriptors()`, for the scan of `data_buffer`: `buffer_cell_starts_scan` or `buffer_H_begin`.
+static VkDescriptorSet recordScanDescriptors(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const VkBuffer data_buffer
+) {
 
-    result = vmaFlushAllocation(vk_ctx->vma_allocator, dst, dst_offset, size_bytes);
-    assertVk(result);
+    if (!res->push_descriptors) {
+        if (data_buffer == res->buffer_cell_starts_scan.buffer) return res->descriptor_set_scan__cell_starts;
+        assert(data_buffer == res->buffer_H_begin.buffer);
+        return res->descriptor_set_scan__hash_table;
+    }
 
-    vmaUnmapMemory(vk_ctx->vma_allocator, dst);
+    VkDescriptorBufferInfo buffer_infos[LAYOUT_BINDING_COUNT__SCAN] {};
+    getScanBufferInfos(res, data_buffer, buffer_infos);
+    recordPushDescriptors(
+        vk_ctx, command_buffer, res->pipeline_layout_scan_blocks,
+        LAYOUT_BINDING_COUNT__SCAN, DESCRIPTOR_SET_LAYOUT__SCAN, buffer_infos
+    );
+    return VK_NULL_HANDLE;
 }
 
 
-// Initializes both sorted and unsorted buffers, because it's easier to not think about which one needs to
-// be initialized.
-static void initPositionsAndVelocitiesBuffers(
-    const GpuResources* res,
+struct PipelineBarrierSrcInfo {
+    VkPipelineStageFlags src_stage_mask;
+    VkPipelineStageFlags src_access_mask;
+};
+/// Reduces the positions to the domain bounds, in a single dispatch. Writes the min to the uniform buffer, and
+/// the bounds to slot `domain_bounds_slot` of `buffer_domain_bounds`, where they are made visible to the host.
+/// The caller must make the positions visible to compute shader reads before this executes.
+[[nodiscard]] static PipelineBarrierSrcInfo recordBoundsReductionCommands(
+    const SimData* s,
     const VulkanContext* vk_ctx,
-    const u32fast particle_count,
-    const vec4 *const p_initial_positions
+    const VkCommandBuffer command_buffer,
+    const u32 domain_bounds_slot
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    const GpuResources* res = &s->gpu_resources;
 
+    // OPTIMIZE: Maybe should tune a special workgroup size for this pipeline, since the optimal
+    //     parameters for this might not be the same as the optimal parameters for other GPU work.
+    const ReductionPushConstants push_constants {
+        .array_size = (u32)s->particle_count,
+        .domain_bounds_slot = domain_bounds_slot,
+    };
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_computeBounds, res->pipeline_layout_computeBounds,
+        res->descriptor_set_reduction,
+        sizeof(push_constants), &push_constants,
+        res->workgroup_count
+    );
 
-    const VkCommandBuffer command_buffer = res->general_purpose_command_buffer;
-    const VkDeviceSize data_size_bytes = particle_count * sizeof(vec4);
+    const VkBufferMemoryBarrier host_barrier {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+        .dstQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+        .buffer = res->buffer_domain_bounds.buffer,
+        .offset = domain_bounds_slot * sizeof(DomainBounds),
+        .size = sizeof(DomainBounds),
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0, // dependencyFlags
+        0, // memoryBarrierCount
+        NULL, // pMemoryBarriers
+        1, // bufferMemoryBarrierCount
+        &host_barrier,
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+
+    return PipelineBarrierSrcInfo {
+        .src_stage_mask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .src_access_mask = VK_ACCESS_SHADER_WRITE_BIT,
+    };
+};
 
-    VkBuffer staging_buffer = VK_NULL_HANDLE;
-    VmaAllocation staging_allocation = VK_NULL_HANDLE;
-    {
-        const VkBufferCreateInfo buffer_info {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = data_size_bytes,
-            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount = 1,
-            .pQueueFamilyIndices = &vk_ctx->queue_family_index,
-        };
-        const VmaAllocationCreateInfo alloc_info {
-            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        };
-        result = vmaCreateBuffer(
-            vk_ctx->vma_allocator, &buffer_info, &alloc_info, &staging_buffer, &staging_allocation, NULL
-        );
-        assertVk(result);
-    }
 
-    uploadBufferToHostVisibleGpuMemory(vk_ctx, data_size_bytes, p_initial_positions, staging_allocation, 0);
+/// Sorts `buffer_morton_codes` in place, and writes the sorting permutation to `buffer_permutation`.
+/// The caller must make the Morton codes visible to compute shader reads before this executes.
+/// On completion, the results have been written by the compute shader stage, and the descent count in
+/// `buffer_radix_sort_state` has been made visible to the host.
+static void recordRadixSortCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer
+) {
 
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    // The particles are stored in the previous step's sort order, so the keys are often already sorted, in
+    // which case we skip the sort passes. The GPU decides which dispatches run, so that this doesn't cost a
+    // round trip to the host.
     {
-        const VkCommandBufferBeginInfo cmd_buf_begin_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        const RadixSortPushConstants push_constants {
+            .array_size = (u32)s->particle_count,
+            .bit_shift = 0,
+            .tile_count = res->radix_sort_tile_count,
+            .is_first_pass = true,
         };
-        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
-        assertVk(result);
+
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer,
+            res->buffer_radix_sort_state.buffer,
+            offsetof(RadixSortState, descent_count),
+            sizeof(u32),
+            0
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        const VkDescriptorSet descriptor_set__primary_to_scratch =
+            recordRadixSortDescriptors(res, vk_ctx, command_buffer, false);
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_radixSort_countDescents, res->pipeline_layout_radixSort_countDescents,
+            descriptor_set__primary_to_scratch,
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_radixSort_prepareDispatch, res->pipeline_layout_radixSort_prepareDispatch,
+            descriptor_set__primary_to_scratch,
+            sizeof(push_constants), &push_constants,
+            1 // workgroup count
+        );
         {
-            const VkBufferCopy buffer_copy {
-                .srcOffset = 0,
-                .dstOffset = 0,
-                .size = data_size_bytes,
+            const VkMemoryBarrier memory_barrier {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT,
             };
-            vk_ctx->procs_dev.CmdCopyBuffer(
-                command_buffer, staging_buffer, res->buffer_positions_unsorted.buffer, 1, &buffer_copy
-            );
-            vk_ctx->procs_dev.CmdCopyBuffer(
-                command_buffer, staging_buffer, res->buffer_positions_sorted.buffer, 1, &buffer_copy
+            vk_ctx->procs_dev.CmdPipelineBarrier(
+                command_buffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                0, // dependencyFlags
+                1, // memoryBarrierCount
+                &memory_barrier,
+                0, // bufferMemoryBarrierCount
+                NULL, // pBufferMemoryBarriers
+                0, // imageMemoryBarrierCount
+                NULL // pImageMemoryBarriers
             );
         }
-        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
-        assertVk(result);
+
+        // `values_out_` of this set is `buffer_permutation`.
+        const VkDescriptorSet descriptor_set__scratch_to_primary =
+            recordRadixSortDescriptors(res, vk_ctx, command_buffer, true);
+        recordComputeDispatchIndirect(
+            vk_ctx, command_buffer,
+            res->pipeline_radixSort_writeIdentity, res->pipeline_layout_radixSort_writeIdentity,
+            descriptor_set__scratch_to_primary,
+            sizeof(push_constants), &push_constants,
+            res->buffer_radix_sort_state.buffer, offsetof(RadixSortState, identity_dispatch)
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
     }
 
+    const VkPipeline pipelines[] {
+        res->pipeline_radixSort_histogram,
+        res->pipeline_radixSort_scan,
+        res->pipeline_radixSort_scatter,
+    };
+    const VkPipelineLayout pipeline_layouts[] {
+        res->pipeline_layout_radixSort_histogram,
+        res->pipeline_layout_radixSort_scan,
+        res->pipeline_layout_radixSort_scatter,
+    };
+    // offsets of the `VkDispatchIndirectCommand`s in `buffer_radix_sort_state`
+    const VkDeviceSize dispatch_offsets[] {
+        offsetof(RadixSortState, tiles_dispatch),
+        offsetof(RadixSortState, single_workgroup_dispatch), // the scan is done by a single workgroup
+        offsetof(RadixSortState, tiles_dispatch),
+    };
+    constexpr u32fast stage_count = ARRAY_SIZE(pipelines);
+    static_assert(ARRAY_SIZE(pipeline_layouts) == stage_count);
+    static_assert(ARRAY_SIZE(dispatch_offsets) == stage_count);
+
+    const u32 pass_count = res->radix_sort_pass_count;
+    for (u32 pass_idx = 0; pass_idx < pass_count; pass_idx++)
     {
-        const VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &command_buffer,
-        };
-        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, res->fence);
-        assertVk(result);
+        const VkDescriptorSet descriptor_set = recordRadixSortDescriptors(res, vk_ctx, command_buffer, pass_idx % 2 != 0);
 
-        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &res->fence, VK_TRUE, UINT64_MAX);
-        assertVk(result);
+        const RadixSortPushConstants push_constants {
+            .array_size = (u32)s->particle_count,
+            .bit_shift = pass_idx * RADIX_SORT_BITS_PER_PASS,
+            .tile_count = res->radix_sort_tile_count,
+            .is_first_pass = pass_idx == 0,
+        };
 
-        result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &res->fence);
-        assertVk(result);
+        for (u32fast stage_idx = 0; stage_idx < stage_count; stage_idx++)
+        {
+            recordComputeDispatchIndirect(
+                vk_ctx, command_buffer,
+                pipelines[stage_idx], pipeline_layouts[stage_idx], descriptor_set,
+                sizeof(push_constants), &push_constants,
+                res->buffer_radix_sort_state.buffer, dispatch_offsets[stage_idx]
+            );
 
-        result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
-        assertVk(result);
+            // The last scatter is synchronized by the caller.
+            bool is_last_dispatch = pass_idx == pass_count - 1 and stage_idx == stage_count - 1;
+            if (!is_last_dispatch) recordComputeToComputeBarrier(vk_ctx, command_buffer);
+        }
     }
+}
+
+
+/// In-place exclusive prefix sum of `data_buffer`: `buffer_cell_starts_scan` or `buffer_H_begin`.
+/// The caller must make the array visible to compute shader reads and writes before this executes.
+/// On completion, the results have been written by the compute shader stage.
+static void recordScanCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const VkBuffer data_buffer,
+    const u32 array_size
+) {
+
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+    const VkDescriptorSet descriptor_set = recordScanDescriptors(res, vk_ctx, command_buffer, data_buffer);
+
+    const ScanPushConstants push_constants { .array_size = array_size };
+    const u32 block_count = divCeil(array_size, res->workgroup_size);
+
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_scan_blocks, res->pipeline_layout_scan_blocks,
+        descriptor_set,
+        sizeof(push_constants), &push_constants,
+        block_count
+    );
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_scan_blockSums, res->pipeline_layout_scan_blockSums,
+        descriptor_set,
+        sizeof(push_constants), &push_constants,
+        1 // the block sums are scanned by a single workgroup
+    );
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_scan_addBlockOffsets, res->pipeline_layout_scan_addBlockOffsets,
+        descriptor_set,
+        sizeof(push_constants), &push_constants,
+        block_count
+    );
+}
+
+
+/// Builds `C_begin` and `C_length` in Morton code order, and the cell count, from the sorted Morton codes.
+/// The caller must make the sorted Morton codes visible to compute shader reads before this executes.
+/// On completion, the results have been written by the compute shader stage.
+static void recordCellListCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer
+) {
 
-    memsetZeroHostVisibleGpuBuffer(vk_ctx, data_size_bytes, staging_allocation);
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_cellList_markCellStarts, res->pipeline_layout_cellList_markCellStarts,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->workgroup_count
+    );
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+    // exclusive scan of the cell starts, which gives each particle the index of its cell
+    recordScanCommands(s, vk_ctx, command_buffer, res->buffer_cell_starts_scan.buffer, (u32)s->particle_count);
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_cellList_scatter, res->pipeline_layout_cellList_scatter,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->workgroup_count
+    );
+    // The scatter also wrote `CellCountState::cells_dispatch`, which sizes the passes over the cells from here on,
+    // including those of the hash table.
+    recordComputeToIndirectBarrier(vk_ctx, command_buffer);
+
+    recordComputeDispatchIndirect(
+        vk_ctx, command_buffer,
+        res->pipeline_cellList_computeLengths, res->pipeline_layout_cellList_computeLengths,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
+    );
 
+    // for `fitHashTableSize()`
+    if (s->parameters.hash_table_resize_interval > 0)
     {
-        const VkCommandBufferBeginInfo cmd_buf_begin_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        const VkBufferMemoryBarrier host_barrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .dstQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .buffer = res->buffer_cell_count.buffer,
+            .offset = offsetof(CellCountState, cell_count),
+            .size = sizeof(u32),
         };
-        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
-        assertVk(result);
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            0, // memoryBarrierCount
+            NULL, // pMemoryBarriers
+            1, // bufferMemoryBarrierCount
+            &host_barrier,
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+    }
+}
+
+
+/// Builds `cells` (in hash order) and `hash_buckets` from the Morton-ordered cell list, by counting-sorting the
+/// cells by hash, with `H_length` and `H_begin` as the sort's counts and offsets. With the open-addressing cell
+/// table, builds `cell_slots` instead.
+/// The caller must make the cell list visible to compute shader reads before this executes, and must make
+/// sure that previous readers of the hash table have finished (the table is cleared by the transfer stage).
+/// On completion, the results have been written by the compute shader stage.
+static void recordHashTableCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer
+) {
+
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    if (res->cell_slot_count > 0)
+    {
+        // Every word 0xFFFFFFFF, i.e. `CELL_SLOT_EMPTY`. The header (see CELL_TABLE_DENSE in `fluidSim_util.comp.h`)
+        // too, which makes the table hashed, unless the dense grid mode clears it for the bounds pass.
+        const VkDeviceSize slots_size = (VkDeviceSize)res->cell_slot_count * sizeof(uvec4);
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer, res->buffer_cell_slots.buffer, 0, res->dense_cell_grid ? slots_size : VK_WHOLE_SIZE,
+            UINT32_MAX
+        );
+        if (res->dense_cell_grid)
         {
-            const VkBufferCopy buffer_copy {
-                .srcOffset = 0,
-                .dstOffset = 0,
-                .size = data_size_bytes,
-            };
-            vk_ctx->procs_dev.CmdCopyBuffer(
-                command_buffer, staging_buffer, res->buffer_velocities_unsorted.buffer, 1, &buffer_copy
+            vk_ctx->procs_dev.CmdFillBuffer(
+                command_buffer, res->buffer_cell_slots.buffer, slots_size, sizeof(uvec4), 0
             );
-            vk_ctx->procs_dev.CmdCopyBuffer(
-                command_buffer, staging_buffer, res->buffer_velocities_sorted.buffer, 1, &buffer_copy
+        }
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        for (u32 bounds_pass = res->dense_cell_grid ? 1 : 0; ; bounds_pass--)
+        {
+            const InsertCellsPushConstants push_constants {
+                .cell_slot_count = res->cell_slot_count,
+                .bounds_pass = bounds_pass,
+            };
+            recordComputeDispatchIndirect(
+                vk_ctx, command_buffer,
+                res->pipeline_hashTable_insertCells, res->pipeline_layout_hashTable_insertCells,
+                getMainDescriptorSet(res),
+                sizeof(push_constants), &push_constants,
+                res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
             );
+            if (bounds_pass == 0) break;
+            recordComputeToComputeBarrier(vk_ctx, command_buffer);
         }
-        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
-        assertVk(result);
+        return;
     }
+    const VkDeviceSize hash_table_size_bytes = s->hash_table_size * sizeof(u32);
+
+    vk_ctx->procs_dev.CmdFillBuffer(command_buffer, res->buffer_H_length.buffer, 0, hash_table_size_bytes, 0);
+    // only the buckets with cells are written by scatterCells
+    vk_ctx->procs_dev.CmdFillBuffer(command_buffer, res->buffer_hash_buckets.buffer, 0, VK_WHOLE_SIZE, 0);
+    recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+    recordComputeDispatchIndirect(
+        vk_ctx, command_buffer,
+        res->pipeline_hashTable_countCells, res->pipeline_layout_hashTable_countCells,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
+    );
 
+    // `H_begin` is the exclusive prefix sum of `H_length`.
     {
-        const VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &command_buffer,
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
         };
-        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, res->fence);
-        assertVk(result);
-
-        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &res->fence, VK_TRUE, UINT64_MAX);
-        assertVk(result);
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
 
-        result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &res->fence);
-        assertVk(result);
+        const VkBufferCopy buffer_copy {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = hash_table_size_bytes,
+        };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_H_length.buffer, res->buffer_H_begin.buffer, 1, &buffer_copy
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
 
-        result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
-        assertVk(result);
+        recordScanCommands(s, vk_ctx, command_buffer, res->buffer_H_begin.buffer, s->hash_table_size);
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
     }
 
-    vmaDestroyBuffer(vk_ctx->vma_allocator, staging_buffer, staging_allocation);
+    recordComputeDispatchIndirect(
+        vk_ctx, command_buffer,
+        res->pipeline_hashTable_scatterCells, res->pipeline_layout_hashTable_scatterCells,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
+    );
 }
 
-static void initGpuBuffers(
-    const GpuResources* res,
+
+/// In Verlet skin mode, the spatial structure is only rebuilt when `advance()` sees that some particle has
+/// moved too far.
+static bool isVerletSkinActive(const SimData* s) {
+    return s->parameters.verlet_skin_distance > 0.0f and !s->parameters.gpu_resident;
+}
+
+
+/// Whether the next step reuses the spatial structure, and so runs with the particle buffers swapped instead of
+/// copying the particles to the sorted buffers in their old order; see `GpuResources::particle_buffers_swapped`.
+/// Only in the synchronous mode: a GPU-resident step only reuses the structure if it's the first one after a
+/// synchronous step that did, and then it copies them.
+static bool isSwappedStep(const SimData* s) {
+    return !s->spatial_structure_rebuilt_last_step and !s->parameters.gpu_resident;
+}
+
+
+/// Whether the particle update uses the neighbor lists this step. They are built whenever the spatial structure
+/// was rebuilt, and reused while it isn't. If the sim parameters changed since the last rebuild, the lists may
+/// be too short, so we traverse the cells until the next rebuild.
+static bool areNeighborListsInUse(const SimData* s) {
+    return s->gpu_resources.neighbor_list_capacity > 0 and !s->spatial_structure_outdated;
+}
+
+
+static BakedSimParams getBakedSimParams(const SimData::Params* params) {
+    return BakedSimParams {
+        .particle_interaction_radius = params->particle_interaction_radius,
+        .spring_rest_length = params->spring_rest_length,
+        .spring_stiffness = params->spring_stiffness,
+        .cell_size_reciprocal = params->cell_size_reciprocal,
+    };
+}
+
+
+static bool bakedSimParamsEqual(const BakedSimParams* a, const BakedSimParams* b) {
+    return a->particle_interaction_radius == b->particle_interaction_radius
+       and a->spring_rest_length == b->spring_rest_length
+       and a->spring_stiffness == b->spring_stiffness
+       and a->cell_size_reciprocal == b->cell_size_reciprocal;
+}
+
+
+/// Whether the plain particle update can use `pipeline_updateParticles_baked`, i.e. whether it was built for
+/// the current sim parameters.
+static bool isBakedUpdatePipelineCurrent(const SimData* s) {
+
+    const GpuResources* res = &s->gpu_resources;
+    if (!s->parameters.bake_sim_params_into_update) return false;
+    if (res->pipeline_updateParticles_baked == VK_NULL_HANDLE) return false;
+
+    const BakedSimParams params = getBakedSimParams(&s->parameters);
+    return bakedSimParamsEqual(&res->updateParticles_baked_params, &params);
+}
+
+
+/// Records the passes of `fluidSim_flip_solvePressure` (see its description) over the velocities that
+/// `fluidSim_flip_transferToGrid` wrote, and leaves the projected ones visible to the update. A fixed
+/// `SimParameters::flip_pressure_iteration_count` conjugate gradient iterations, each preconditioned by one V-cycle;
+/// the reductions stay on the GPU, so the solve reads nothing back.
+static void recordFlipPressureSolve(
+    const SimData* s,
     const VulkanContext* vk_ctx,
-    const SimData::Params *const sim_params,
-    const u32 particle_count,
-    const vec4 *const p_initial_positions,
-    const u32 hash_modulus
+    const VkCommandBuffer command_buffer
 ) {
-
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
-
+    const GpuResources* res = &s->gpu_resources;
+    const u32 resolution = res->flip_grid_resolution;
+    const u32 level_count = getFlipLevelCount(resolution);
+    constexpr u32 flip_array_z0 = 2; // FLIP_ARRAY_Z0
+    constexpr u32 flip_array_z1 = 3; // FLIP_ARRAY_Z1
+    // per level, on the way down and again on the way up; even, so that the sweeps end in FLIP_ARRAY_Z0
+    constexpr u32 smoothing_sweep_count = 2;
+    constexpr u32 coarsest_sweep_count = 8;
+
+    FlipPressurePushConstants push_constants {
+        .pass = FLIP_PASS_DIVERGENCE,
+        .resolution = resolution,
+        .level = 0,
+        .z_array = flip_array_z0,
+        .zero_initial_guess = false,
+    };
 
-    vec3 domain_min = vec3(INFINITY);
-    {
-        vec3 domain_max = vec3(-INFINITY);
-        for (u32fast i = 0; i < particle_count; i++)
+    // one invocation per cell of `push_constants.level`, or one workgroup for the reductions
+    const auto recordPass = [&](FlipPass pass, u32 level) {
+        push_constants.pass = pass;
+        push_constants.level = level;
+        const u32 level_resolution = resolution >> level;
+        const u32 workgroup_count = (pass == FLIP_PASS_REDUCE_RZ or pass == FLIP_PASS_REDUCE_PQ)
+            ? 1 : divCeil(level_resolution * level_resolution * level_resolution, res->workgroup_size);
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_flip_solvePressure, res->pipeline_layout_flip_solvePressure,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            workgroup_count
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+    };
+    const auto recordSmoothing = [&](u32 level, u32 sweep_count, bool zero_initial_guess) {
+        for (u32 sweep = 0; sweep < sweep_count; sweep++)
         {
-            const vec3 pos = vec3(p_initial_positions[i]);
-            domain_min = glm::min(domain_min, pos);
-            domain_max = glm::max(domain_max, pos);
+            push_constants.z_array = (sweep % 2 == 0) ? flip_array_z0 : flip_array_z1;
+            push_constants.zero_initial_guess = zero_initial_guess and sweep == 0;
+            recordPass(FLIP_PASS_SMOOTH, level);
         }
-        const uvec3 cell_count = uvec3(
-            glm::ceil((domain_max - domain_min) * sim_params->cell_size_reciprocal)
-            + 0.5f
-        );
-        // 32-bit Morton codes can handle at most a 1024x1024x1024 grid.
-        assert(cell_count.x < 1024 and cell_count.y < 1024 and cell_count.z < 1024);
-        (void)cell_count; // to prevent "unused variable" complaints when compiling with NDEBUG
-    }
-
-    const UniformBufferData uniform_data {
-        .domain_min = domain_min,
-        .updated_by_host {
-            .rest_particle_density = sim_params->rest_particle_density,
-            .particle_interaction_radius = sim_params->particle_interaction_radius,
-            .spring_rest_length = sim_params->spring_rest_length,
-            .spring_stiffness = sim_params->spring_stiffness,
-            .cell_size_reciprocal = sim_params->cell_size_reciprocal,
-            .particle_count = particle_count,
-            .hash_modulus = hash_modulus
-        },
+        push_constants.zero_initial_guess = false;
     };
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        sizeof(uniform_data),
-        &uniform_data,
-        res->buffer_uniforms.allocation,
-        0 // dst_offset
-    );
 
+    recordPass(FLIP_PASS_DIVERGENCE, 0);
+    for (u32 level = 1; level < level_count; level++) recordPass(FLIP_PASS_COARSEN, level);
+
+    for (u32 iteration = 0; iteration < s->parameters.flip_pressure_iteration_count; iteration++)
     {
-        u32* p_mapped_morton_codes = NULL;
+        // the V-cycle, from the residual in level 0's right-hand side to its correction in level 0's FLIP_ARRAY_Z0
+        for (u32 level = 0; level + 1 < level_count; level++)
         {
-            void* ptr = NULL;
-
-            result = vmaMapMemory(
-                vk_ctx->vma_allocator, res->buffer_morton_codes_or_permutation.allocation, &ptr
-            );
-            assertVk(result);
-
-            p_mapped_morton_codes = (u32*)ptr;
+            recordSmoothing(level, smoothing_sweep_count, true);
+            recordPass(FLIP_PASS_RESTRICT, level + 1);
         }
-
-        for (u32fast i = 0; i < particle_count; i++)
+        recordSmoothing(level_count - 1, coarsest_sweep_count, true);
+        for (u32 level = level_count - 1; level-- > 0;)
         {
-            vec3 pos = vec3(p_initial_positions[i]);
-            u32 morton_code = cellMortonCode(cellIndex(pos, domain_min, sim_params->cell_size_reciprocal));
-            p_mapped_morton_codes[i] = morton_code;
+            recordPass(FLIP_PASS_PROLONG, level);
+            recordSmoothing(level, smoothing_sweep_count, false);
         }
 
-        result = vmaFlushAllocation(
-            vk_ctx->vma_allocator,
-            res->buffer_morton_codes_or_permutation.allocation,
-            0, // offset
-            VK_WHOLE_SIZE
-        );
-        assertVk(result);
-
-        vmaUnmapMemory(vk_ctx->vma_allocator, res->buffer_morton_codes_or_permutation.allocation);
+        recordPass(FLIP_PASS_DOT_RZ, 0);
+        recordPass(FLIP_PASS_REDUCE_RZ, 0);
+        recordPass(FLIP_PASS_UPDATE_P, 0);
+        recordPass(FLIP_PASS_APPLY, 0);
+        recordPass(FLIP_PASS_REDUCE_PQ, 0);
+        recordPass(FLIP_PASS_UPDATE_XR, 0);
     }
 
-    initPositionsAndVelocitiesBuffers(res, vk_ctx, particle_count, p_initial_positions);
+    recordPass(FLIP_PASS_PROJECT, 0);
 }
 
 
-static void createBuffers(
-    GpuResources* res,
+/// Records `sortParticles`, `buildNeighborLists` (if needed), `computeDensities` (in the SPH mode),
+/// `solveDensityConstraints` (in the PBF mode), the FLIP transfers and pressure solve (in the FLIP mode), the active
+/// particle compaction (in the sleeping mode), and `updateParticles`. The spatial structure must already have been
+/// built.
+/// The caller must make the spatial structure and the unsorted positions and velocities visible to compute
+/// shader reads before this executes.
+/// On completion, the results have been written by the compute shader stage (and, if
+/// `GpuResources::particle_buffers_swapped`, the positions copied to the unsorted buffer by the transfer stage), and
+/// the neighbor list overflow count (if the lists were built) and the max motion (if `adaptive_time_step`) have
+/// been made visible to the host.
+static void recordParticleUpdateCommands(
+    const SimData* s,
     const VulkanContext* vk_ctx,
-    const u32fast particle_count,
-    const u32fast hash_modulus
+    const VkCommandBuffer command_buffer,
+    const u32 delta_t_slot // see `writeDeltaT()`
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    const GpuResources* res = &s->gpu_resources;
+
+    // If the spatial structure was rebuilt, it was built from `positions_in_` (after they are sorted), so we
+    // don't need the reference positions this step; but we record them in case the next rebuild is skipped.
+    const bool rebuilt = s->spatial_structure_rebuilt_last_step;
+
+    const bool use_neighbor_lists = areNeighborListsInUse(s);
+    const bool build_neighbor_lists = use_neighbor_lists and rebuilt;
+    const bool sleeping = s->parameters.sleeping;
+    const u32 sleep_step_count = sleeping ? s->parameters.sleep_step_count : 0;
+
+    // The FLIP grid only covers the sim's own domain, which the members of an ensemble share.
+    const bool flip = s->parameters.flip and res->flip_grid_resolution > 0 and res->ensemble_member_count == 0;
+    const bool pbf = s->parameters.pbf and !flip;
+    const bool sph = s->parameters.sph and !pbf and !flip;
+
+    // Everything up to the particle update proper: the clears, the sort, the neighbor lists and the SPH densities.
+    // The barriers between them, and the one after them, are worked out by `pass_graph`.
+    pass_graph::Graph graph {};
+    const ParticleBufferSet sorted = getParticleBuffers(res, true);
+    const ParticleBufferSet unsorted = getParticleBuffers(res, false);
+    // what the traversals of `fluidSim_updateParticles.comp.h` read that the graph writes
+    const auto readsSortedParticles = [&]() {
+        pass_graph::reads(&graph, sorted.positions, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, sorted.velocities, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, sorted.calm_steps, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, sorted.member_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, sorted.particle_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, sorted.particle_levels, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, res->buffer_positions_quantized.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, res->buffer_positions_reference.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, res->buffer_cell_awake.buffer, 0, VK_WHOLE_SIZE);
+    };
+
+    if (build_neighbor_lists)
+    {
+        pass_graph::addFill(&graph, res->buffer_neighbor_list_overflow.buffer, 0, sizeof(u32), 0);
+    }
+    if (sleeping)
+    {
+        // the sort marks the awake cells, and the compaction counts the active particles
+        pass_graph::addFill(&graph, res->buffer_cell_awake.buffer, 0, VK_WHOLE_SIZE, 0);
+        const SleepState sleep_state {
+            .active_particle_count = 0,
+            .active_particles_dispatch = { .x = 0, .y = 1, .z = 1 },
+        };
+        pass_graph::addUpdate(&graph, res->buffer_sleep_state.buffer, 0, sizeof(sleep_state), &sleep_state);
+    }
 
+    // In a swapped step, the particles keep their order, and `advanceSynchronous()` has swapped the buffers so
+    // that they're already where the particle update reads them; then the sort only has work to do for the
+    // sleeping mode and the quantized positions.
+    const bool swapped_step = isSwappedStep(s);
+    if (!swapped_step or sleeping or s->parameters.quantized_neighbor_positions)
+    {
+        const SortParticlesPushConstants sort_push_constants {
+            .gather = !swapped_step,
+            .use_permutation = rebuilt,
+            .write_reference_positions = rebuilt and isVerletSkinActive(s),
+            .write_quantized_positions = s->parameters.quantized_neighbor_positions,
+            .sleep_step_count = sleep_step_count,
+            .sort_member_ids = res->ensemble_member_count > 0,
+        };
+        pass_graph::addDispatch(
+            &graph,
+            res->pipeline_sortParticles, res->pipeline_layout_sortParticles,
+            getMainDescriptorSet(res),
+            sizeof(sort_push_constants), &sort_push_constants,
+            res->workgroup_count
+        );
+        pass_graph::reads(&graph, unsorted.positions, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, unsorted.velocities, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, unsorted.calm_steps, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, unsorted.member_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, unsorted.particle_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, unsorted.particle_levels, 0, VK_WHOLE_SIZE);
+        pass_graph::reads(&graph, res->buffer_permutation.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.positions, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.velocities, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.calm_steps, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.member_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.particle_ids, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, sorted.particle_levels, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, res->buffer_positions_quantized.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, res->buffer_positions_reference.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, res->buffer_cell_awake.buffer, 0, VK_WHOLE_SIZE);
+    }
 
-    struct BufferCreateInfo {
-        GpuBuffer* p_buffer_out;
-        VkDeviceSize size;
-        VkBufferUsageFlags buffer_usage;
-        VmaAllocationCreateFlags alloc_flags;
-        VmaMemoryUsage mem_usage;
-        VkMemoryPropertyFlags required_mem_flags;
+    ParticleUpdatePushConstants push_constants {
+        .delta_t_slot = delta_t_slot,
+        .use_reference_positions = !rebuilt,
+        .write_morton_codes = s->parameters.fuse_morton_codes_into_update,
+        .use_neighbor_lists = use_neighbor_lists,
+        .neighbor_list_capacity = res->neighbor_list_capacity,
+        // see the comment on `cell_size` in `setParams()`
+        .neighbor_list_cutoff = s->parameters.cell_size,
+        // the quantized positions are relative to cells that don't wrap around the periodic box
+        .use_quantized_positions = s->parameters.quantized_neighbor_positions and res->periodic_box.axes == 0,
+        .cell_slot_count = res->cell_slot_count,
+        // The Hilbert-ordered cell list can't be walked in Morton order, and the Morton ranges and the coarse cells
+        // don't wrap around the periodic box.
+        .use_morton_ranges =
+            s->parameters.morton_range_traversal and !res->hilbert_cell_order and res->periodic_box.axes == 0,
+        .cell_level_count =
+            (res->hilbert_cell_order or res->periodic_box.axes != 0) ? 1 : s->parameters.cell_level_count,
+        .sparse_cell_particle_count = s->parameters.sparse_cell_particle_count,
+        .collider_slot_count = (res->collider_brick_count > 0) ? res->collider_slot_count : 0,
+        .collider_cell_size_reciprocal = (res->collider_brick_count > 0) ? 1.0f / res->collider_cell_size : 0.0f,
+        .sph_pass = SPH_PASS_NONE,
+        .pbf_positions_offset = 0,
+        .track_max_motion = s->parameters.adaptive_time_step,
+        .track_diagnostics = s->parameters.diagnostics,
+        .sleep_step_count = sleep_step_count,
+        .sleep_speed = s->parameters.sleep_speed,
+        .sleep_acceleration = s->parameters.sleep_acceleration,
+        .ensemble_member_count = res->ensemble_member_count,
+        .persistent_pass = PERSISTENT_PASS_UPDATE,
     };
 
-    const BufferCreateInfo buffer_infos[] {
-        {
-            .p_buffer_out = &res->buffer_uniforms,
-            .size = sizeof(UniformBufferData),
-            .buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+    if (build_neighbor_lists)
+    {
+        pass_graph::addDispatch(
+            &graph,
+            res->pipeline_buildNeighborLists, res->pipeline_layout_buildNeighborLists,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        readsSortedParticles();
+        for (u32 chunk_idx = 0; chunk_idx < res->buffer_neighbor_lists.chunk_count; chunk_idx++)
         {
-            .p_buffer_out = &res->buffer_positions_sorted,
-            .size = particle_count * sizeof(vec4),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT // OPTIMIZE maybe unnecessary
-                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // OPTIMIZE maybe unnecessary
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        },
+            pass_graph::writes(&graph, res->buffer_neighbor_lists.chunks[chunk_idx].buffer, 0, VK_WHOLE_SIZE);
+        }
+        pass_graph::writes(&graph, res->buffer_neighbor_counts.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, res->buffer_neighbor_list_overflow.buffer, 0, sizeof(u32));
+
+        pass_graph::addHostRead(&graph, res->buffer_neighbor_list_overflow.buffer, 0, sizeof(u32));
+    }
+
+    if (sph)
+    {
+        // Same traversal as the update, through the same lists or cells; the update then reads the densities
+        // instead of recomputing them for each pair.
+        push_constants.sph_pass = SPH_PASS_DENSITY;
+        pass_graph::addDispatch(
+            &graph,
+            res->pipeline_computeDensities, res->pipeline_layout_computeDensities,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        push_constants.sph_pass = SPH_PASS_FORCES;
+        readsSortedParticles();
+        for (u32 chunk_idx = 0; chunk_idx < res->buffer_neighbor_lists.chunk_count; chunk_idx++)
         {
-            .p_buffer_out = &res->buffer_velocities_sorted,
-            .size = particle_count * sizeof(vec4),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            pass_graph::reads(&graph, res->buffer_neighbor_lists.chunks[chunk_idx].buffer, 0, VK_WHOLE_SIZE);
+        }
+        pass_graph::reads(&graph, res->buffer_neighbor_counts.buffer, 0, VK_WHOLE_SIZE);
+        pass_graph::writes(&graph, res->buffer_densities.buffer, 0, VK_WHOLE_SIZE);
+    }
+
+    pass_graph::record(
+        &graph, vk_ctx, command_buffer,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT
+    );
+
+    if (pbf)
+    {
+        const auto recordPbfPass = [&](SphPass pass) {
+            push_constants.sph_pass = pass;
+            recordComputeDispatch(
+                vk_ctx, command_buffer,
+                res->pipeline_solveDensityConstraints, res->pipeline_layout_solveDensityConstraints,
+                getMainDescriptorSet(res),
+                sizeof(push_constants), &push_constants,
+                res->workgroup_count
+            );
+            recordComputeToComputeBarrier(vk_ctx, command_buffer);
+        };
+
+        // The passes run on every particle, the sleeping ones too, whose predictions the active ones read; and
+        // read the predicted positions, which aren't quantized.
+        push_constants.use_quantized_positions = false;
+        push_constants.pbf_positions_offset = 0;
+        recordPbfPass(SPH_PASS_PBF_PREDICT);
+
+        // All the multipliers must be in before any position moves, so an iteration is two passes. The corrected
+        // positions go to the other half, because the neighbors still read the ones that they replace.
+        for (u32 iteration = 0; iteration < s->parameters.pbf_iteration_count; iteration++)
+        {
+            recordPbfPass(SPH_PASS_PBF_MULTIPLIERS);
+            recordPbfPass(SPH_PASS_PBF_CORRECT);
+            push_constants.pbf_positions_offset = (u32)s->particle_capacity - push_constants.pbf_positions_offset;
+        }
+        push_constants.sph_pass = SPH_PASS_PBF_FINISH;
+    }
+
+    if (flip)
+    {
+        // The transfer gathers from every particle, the sleeping ones too, at their exact positions.
+        const u32 resolution = res->flip_grid_resolution;
+        push_constants.sph_pass = SPH_PASS_FLIP_TRANSFER;
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_flip_transferToGrid, res->pipeline_layout_flip_transferToGrid,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            divCeil(resolution * resolution * resolution, res->workgroup_size)
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        recordFlipPressureSolve(s, vk_ctx, command_buffer);
+        push_constants.sph_pass = SPH_PASS_FLIP_FINISH;
+    }
+
+    if (sleeping)
+    {
+        // The cells that the spatial structure was built with are still current, and so is their dispatch.
+        recordComputeDispatchIndirect(
+            vk_ctx, command_buffer,
+            res->pipeline_sleep_markActiveCells, res->pipeline_layout_sleep_markActiveCells,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_sleep_compactParticles, res->pipeline_layout_sleep_compactParticles,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        recordComputeToIndirectBarrier(vk_ctx, command_buffer);
+    }
+
+    // The tiled and subgroup kernels use neither the neighbor lists nor the densities or the predicted positions,
+    // run on every particle, and know nothing of ensemble members, of the cells wrapping around the periodic box,
+    // of the particles' masses, or of the custom pair force.
+    const bool plain_only = use_neighbor_lists or sph or pbf or flip or sleeping or res->ensemble_member_count > 0
+        or res->periodic_box.axes != 0 or res->particle_levels or res->user_pair_acceleration;
+    const bool tiled = s->parameters.tiled_particle_update and !plain_only;
+    const bool subgroup = s->parameters.subgroup_particle_update and !plain_only
+        and res->pipeline_updateParticlesSubgroup != VK_NULL_HANDLE;
+    // The persistent kernel runs the plain update, so everything but the sleeping particles' indirect dispatch.
+    const bool persistent = s->parameters.persistent_update_workgroup_count > 0 and !sleeping and !tiled and !subgroup;
+
+    VkPipeline pipeline = res->pipeline_updateParticles;
+    VkPipelineLayout pipeline_layout = res->pipeline_layout_updateParticles;
+    if (tiled)
+    {
+        pipeline = res->pipeline_updateParticlesTiled;
+        pipeline_layout = res->pipeline_layout_updateParticlesTiled;
+    }
+    else if (subgroup)
+    {
+        pipeline = res->pipeline_updateParticlesSubgroup;
+        pipeline_layout = res->pipeline_layout_updateParticlesSubgroup;
+    }
+    else if (persistent)
+    {
+        pipeline = res->pipeline_updateParticlesPersistent;
+        pipeline_layout = res->pipeline_layout_updateParticlesPersistent;
+    }
+    else if (isBakedUpdatePipelineCurrent(s))
+    {
+        pipeline = res->pipeline_updateParticles_baked;
+        pipeline_layout = res->pipeline_layout_updateParticles_baked;
+    }
+
+    if (sleeping)
+    {
+        recordComputeDispatchIndirect(
+            vk_ctx, command_buffer,
+            pipeline, pipeline_layout,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->buffer_sleep_state.buffer, offsetof(SleepState, active_particles_dispatch)
+        );
+    }
+    else if (persistent)
+    {
+        // a chunk's key keeps its slot in its bucket below the bucket's 5 bits
+        alwaysAssert(res->workgroup_count < (1u << 27));
+
+        // Rank the chunks into the cost buckets, then scatter them into the queue, heaviest first; the previous
+        // step's update has finished with the queue before this step's barrier.
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer, res->buffer_persistent_update.buffer, 0,
+            (1 + PERSISTENT_UPDATE_BUCKET_COUNT) * sizeof(u32), 0
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        push_constants.persistent_pass = PERSISTENT_PASS_RANK;
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            pipeline, pipeline_layout,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        push_constants.persistent_pass = PERSISTENT_PASS_SCATTER;
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            pipeline, pipeline_layout,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            divCeil(res->workgroup_count, res->workgroup_size)
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        // more workgroups than chunks would only find the queue empty
+        push_constants.persistent_pass = PERSISTENT_PASS_UPDATE;
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            pipeline, pipeline_layout,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            glm::min(s->parameters.persistent_update_workgroup_count, res->workgroup_count)
+        );
+    }
+    else
+    {
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            pipeline, pipeline_layout,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+    }
+
+    VkBufferMemoryBarrier host_barriers[2] {};
+    u32 host_barrier_count = 0;
+    if (s->parameters.adaptive_time_step)
+    {
+        host_barriers[host_barrier_count++] = VkBufferMemoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .dstQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .buffer = res->buffer_max_motion.buffer,
+            .offset = delta_t_slot * sizeof(MaxMotion),
+            .size = sizeof(MaxMotion),
+        };
+    }
+    if (s->parameters.diagnostics)
+    {
+        host_barriers[host_barrier_count++] = VkBufferMemoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .dstQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .buffer = res->buffer_diagnostics.buffer,
+            .offset = delta_t_slot * sizeof(Diagnostics),
+            .size = sizeof(Diagnostics),
+        };
+    }
+    if (host_barrier_count > 0)
+    {
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            0, // memoryBarrierCount
+            NULL, // pMemoryBarriers
+            host_barrier_count,
+            host_barriers,
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+    }
+
+    // The positions are read from the unsorted buffer by the renderer, and by the next spatial structure build.
+    if (res->particle_buffers_swapped)
+    {
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+
+        const VkBufferCopy positions_copy {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = s->particle_count * sizeof(vec4),
+        };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_positions_sorted.buffer, res->buffer_positions_unsorted.buffer,
+            1, &positions_copy
+        );
+    }
+}
+
+
+/// Computes the max distance between the updated positions and the reference positions, into
+/// `buffer_max_displacement`.
+/// The caller must make the updated positions visible to compute shader reads before this executes.
+/// On completion, the result has been made visible to the host.
+static void recordMaxDisplacementCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer
+) {
+
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+    const VkBuffer max_displacement = res->buffer_max_displacement.buffer;
+
+    // only the one word is cleared, reduced into and read back, so the barriers cover only it
+    pass_graph::Graph graph {};
+    pass_graph::addFill(&graph, max_displacement, 0, sizeof(u32), 0);
+    pass_graph::addDispatch(
+        &graph,
+        res->pipeline_computeMaxDisplacement, res->pipeline_layout_computeMaxDisplacement,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->workgroup_count
+    );
+    pass_graph::writes(&graph, max_displacement, 0, sizeof(u32));
+    pass_graph::addHostRead(&graph, max_displacement, 0, sizeof(u32));
+    pass_graph::record(&graph, vk_ctx, command_buffer, 0, 0);
+}
+
+
+/// For when the particle update has already written the Morton codes and the per-workgroup bounds. Reduces
+/// the bounds, moves the domain origin if some particle has left its guard band, and in that case recomputes
+/// the Morton codes. Otherwise like `recordBoundsReductionCommands` followed by the Morton code pass.
+static void recordDomainOriginCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const u32 domain_bounds_slot
+) {
+
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    const DomainOriginPushConstants push_constants {
+        .partial_count = res->workgroup_count,
+        .domain_bounds_slot = domain_bounds_slot,
+        .guard_band = DOMAIN_ORIGIN_GUARD_BAND_CELL_COUNT * s->parameters.cell_size,
+        .morton_code_workgroup_count = res->workgroup_count,
+    };
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_updateDomainOrigin, res->pipeline_layout_updateDomainOrigin,
+        res->descriptor_set_reduction,
+        sizeof(push_constants), &push_constants,
+        1 // workgroup count
+    );
+
+    // the domain min, the dispatch command, and the bounds for the host
+    const VkMemoryBarrier memory_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+                       | VK_ACCESS_UNIFORM_READ_BIT
+                       | VK_ACCESS_SHADER_READ_BIT
+                       | VK_ACCESS_HOST_READ_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &memory_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
+
+    // Zero workgroups unless the origin moved.
+    recordComputeDispatchIndirect(
+        vk_ctx, command_buffer,
+        res->pipeline_computeMortonCodes, res->pipeline_layout_computeMortonCodes,
+        getMainDescriptorSet(res),
+        0, NULL, // push constants
+        res->buffer_reduction_state.buffer, offsetof(ReductionState, morton_codes_dispatch)
+    );
+}
+
+
+/// Records the domain bounds and the Morton codes of the unsorted positions: the first part of
+/// `recordSpatialStructureCommands`, which has the details.
+static void recordMortonCodeCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const u32 domain_bounds_slot,
+    const bool morton_codes_from_update
+) {
+
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    if (morton_codes_from_update)
+    {
+        recordDomainOriginCommands(s, vk_ctx, command_buffer, domain_bounds_slot);
+    }
+    else
+    {
+        PipelineBarrierSrcInfo barrier_src_info =
+            recordBoundsReductionCommands(s, vk_ctx, command_buffer, domain_bounds_slot);
+
+        VkBufferMemoryBarrier buffer_memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = barrier_src_info.src_access_mask,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT,
+            .srcQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .dstQueueFamilyIndex = vk_ctx->compute_queue_family_index,
+            .buffer = res->buffer_uniforms.buffer,
+            .offset = offsetof(UniformBufferData, domain_min),
+            .size = sizeof(vec3),
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            barrier_src_info.src_stage_mask,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, // dependencyFlags
+            0, // memoryBarrierCount,
+            NULL, // pMemoryBarriers,
+            1, // bufferMemoryBarrierCount,
+            &buffer_memory_barrier,
+            0, // imageMemoryBarrierCount,
+            NULL // pImageMemoryBarriers
+        );
+
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_computeMortonCodes, res->pipeline_layout_computeMortonCodes,
+            getMainDescriptorSet(res),
+            0, NULL, // push constants
+            res->workgroup_count
+        );
+    }
+}
+
+
+/// Records everything that builds the spatial structure from the unsorted positions: the domain bounds, the
+/// Morton codes, the sort, the cell list and the hash table. See `recordBoundsReductionCommands` for
+/// `domain_bounds_slot`.
+/// If `morton_codes_from_update`, the particle update already wrote the Morton codes and the per-workgroup
+/// bounds (see `recordDomainOriginCommands`).
+/// The stages are timed into `timestamp_slot` (see `recordStageTimestamp`), unless it's
+/// STAGE_TIMESTAMP_SLOT_NONE.
+/// The caller must make the unsorted positions visible to compute shader reads, and make sure that previous
+/// readers of the spatial structure have finished, before this executes.
+/// On completion, the results have been written by the compute shader stage.
+static void recordSpatialStructureCommands(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer,
+    const u32 domain_bounds_slot,
+    const bool morton_codes_from_update,
+    const u32 timestamp_slot
+) {
+
+    ZoneScoped;
+
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_MORTON_CODES, false);
+    recordMortonCodeCommands(s, vk_ctx, command_buffer, domain_bounds_slot, morton_codes_from_update);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_MORTON_CODES, true);
+
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_SORT, false);
+    recordRadixSortCommands(s, vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_SORT, true);
+
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_CELL_LIST, false);
+    recordCellListCommands(s, vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_CELL_LIST, true);
+
+    recordComputeToComputeBarrier(vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_HASH_TABLE, false);
+    recordHashTableCommands(s, vk_ctx, command_buffer);
+    recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_HASH_TABLE, true);
+}
+
+
+/// The host-visible buffers are persistently mapped (`VMA_ALLOCATION_CREATE_MAPPED_BIT`), so this is just the
+/// pointer; nothing needs to be mapped or unmapped per access.
+static void* getMappedPointer(const GpuBuffer* buffer) {
+    alwaysAssert(buffer->allocation_info.pMappedData != NULL);
+    return buffer->allocation_info.pMappedData;
+}
+
+
+/// Counts a write of the host to the mapped GPU memory, or a read from it; see `TransferStats`. The helpers below
+/// count their own; whatever writes or reads a mapped pointer directly counts it with this.
+static void countTransfer(
+    TransferStats* transfers,
+    const TransferCategory category,
+    const bool download,
+    const VkDeviceSize size_bytes
+) {
+    assert(category < TRANSFER_CATEGORY_COUNT);
+    if (download)
+    {
+        transfers->download_byte_counts[category] += size_bytes;
+        transfers->download_counts[category]++;
+    }
+    else
+    {
+        transfers->upload_byte_counts[category] += size_bytes;
+        transfers->upload_counts[category]++;
+    }
+}
+
+
+static void memsetZeroHostVisibleGpuBuffer(
+    const VulkanContext* vk_ctx,
+    const VkDeviceSize size_bytes,
+    const GpuBuffer* dst,
+    TransferStats* transfers,
+    const TransferCategory category
+) {
+
+    ZoneScoped;
+
+    memset(getMappedPointer(dst), 0, size_bytes);
+    countTransfer(transfers, category, false, size_bytes);
+
+    VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, dst->allocation, 0, size_bytes);
+    assertVk(result);
+};
+
+
+/// The caller must make the data visible to the host before this executes.
+static void downloadFromHostVisibleGpuBuffer(
+    const VulkanContext* vk_ctx,
+    const VkDeviceSize size_bytes,
+    const GpuBuffer* src,
+    const VkDeviceSize src_offset,
+    void* dst,
+    TransferStats* transfers,
+    const TransferCategory category
+) {
+
+    ZoneScoped;
+
+    VkResult result = vmaInvalidateAllocation(vk_ctx->vma_allocator, src->allocation, src_offset, size_bytes);
+    assertVk(result);
+
+    memcpy(dst, (const void*)( (uintptr_t)getMappedPointer(src) + src_offset ), size_bytes);
+    countTransfer(transfers, category, true, size_bytes);
+}
+
+
+/// Aborts if the domain spans more cells along some axis than the Morton codes can represent.
+static void assertDomainFitsMortonCodes(
+    const DomainBounds* bounds,
+    const f32 cell_size_reciprocal,
+    const u32 morton_code_word_count
+) {
+    const u32 bit_count =
+        (morton_code_word_count == 2) ? MORTON_CODE_BIT_COUNT_WIDE : MORTON_CODE_BIT_COUNT_NARROW;
+    const u32 max_cell_count_per_axis = (u32)1 << (bit_count / 3);
+
+    // The largest cell index along each axis is `floor(extent / cell_size)`.
+    const vec3 extent_in_cells = (bounds->max - bounds->min) * cell_size_reciprocal;
+    const f32 limit = (f32)max_cell_count_per_axis;
+
+    // negated, so that NaNs also fail
+    if (!(extent_in_cells.x < limit and extent_in_cells.y < limit and extent_in_cells.z < limit))
+    {
+        ABORT_F(
+            "The fluid domain spans (%f, %f, %f) cells, but %u-bit Morton codes can only represent %u cells "
+            "per axis.%s",
+            extent_in_cells.x, extent_in_cells.y, extent_in_cells.z,
+            bit_count, max_cell_count_per_axis,
+            (morton_code_word_count == 2) ? "" : " Consider enabling `SimParameters::morton_codes_64_bit`."
+        );
+    }
+}
+
+
+static void uploadBufferToHostVisibleGpuMemory(
+    const VulkanContext* vk_ctx,
+    const VkDeviceSize size_bytes,
+    const void* src,
+    const GpuBuffer* dst,
+    const uintptr_t dst_offset,
+    TransferStats* transfers,
+    const TransferCategory category
+) {
+
+    ZoneScoped;
+
+    memcpy((void*)( (uintptr_t)getMappedPointer(dst) + dst_offset ), src, size_bytes);
+
+    VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, dst->allocation, dst_offset, size_bytes);
+    assertVk(result);
+    countTransfer(transfers, category, false, size_bytes);
+}
+
+
+/// Sets the time step of the particle updates recorded with `slot` (see `recordParticleUpdateCommands()`), which
+/// is the same as their domain bounds slot. The steps last submitted with it must have finished; the write is made
+/// visible to them by the next submission.
+static void writeDeltaT(SimData* s, const VulkanContext* vk_ctx, const u32 slot, const f32 delta_t) {
+
+    assert(slot < 1 + GPU_RESIDENT_FRAMES_IN_FLIGHT);
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, sizeof(delta_t), &delta_t, &s->gpu_resources.buffer_delta_ts, slot * sizeof(f32),
+        &s->transfers, TRANSFER_UNIFORMS
+    );
+    s->uploaded_byte_count += sizeof(delta_t);
+}
+
+
+/// `SimParameters::adaptive_time_step`: reads the max motion of the steps last submitted with `slot` into
+/// `SimData::time_step`, and clears it for the steps about to be submitted with it. Like `writeDeltaT()`, the
+/// steps last submitted with it must have finished. A slot that no step has written since it was cleared, e.g.
+/// the synchronous mode's after a stretch in GPU-resident mode, leaves the maxima as they were.
+static void readAndClearMaxMotion(SimData* s, const VulkanContext* vk_ctx, const u32 slot) {
+
+    assert(slot < 1 + GPU_RESIDENT_FRAMES_IN_FLIGHT);
+    GpuResources* res = &s->gpu_resources;
+
+    MaxMotion max_motion {};
+    downloadFromHostVisibleGpuBuffer(
+        vk_ctx, sizeof(max_motion), &res->buffer_max_motion, slot * sizeof(MaxMotion), &max_motion,
+        &s->transfers, TRANSFER_STEP_FEEDBACK
+    );
+    if (max_motion.speed_bits != 0 or max_motion.acceleration_bits != 0)
+    {
+        s->time_step.max_speed = glm::uintBitsToFloat(max_motion.speed_bits);
+        s->time_step.max_acceleration = glm::uintBitsToFloat(max_motion.acceleration_bits);
+    }
+
+    const MaxMotion cleared {};
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, sizeof(cleared), &cleared, &res->buffer_max_motion, slot * sizeof(MaxMotion),
+        &s->transfers, TRANSFER_STEP_FEEDBACK
+    );
+    s->uploaded_byte_count += sizeof(cleared);
+}
+
+
+/// Two's complement fixed point, as `Diagnostics` stores it.
+static f64 diagnosticsSum(const u32 words[2]) {
+    const i64 fixed = (i64)(((u64)words[1] << 32) | words[0]);
+    return (f64)fixed / DIAGNOSTICS_FIXED_POINT_SCALE;
+}
+
+
+/// `SimParameters::diagnostics`: like `readAndClearMaxMotion()`, reads what the steps last submitted with `slot`
+/// reduced into `SimData::diagnostics`, and clears it.
+static void readAndClearDiagnostics(SimData* s, const VulkanContext* vk_ctx, const u32 slot) {
+
+    assert(slot < 1 + GPU_RESIDENT_FRAMES_IN_FLIGHT);
+    GpuResources* res = &s->gpu_resources;
+
+    Diagnostics diagnostics {};
+    downloadFromHostVisibleGpuBuffer(
+        vk_ctx, sizeof(diagnostics), &res->buffer_diagnostics, slot * sizeof(Diagnostics), &diagnostics,
+        &s->transfers, TRANSFER_STEP_FEEDBACK
+    );
+    if (diagnostics.step_count != 0)
+    {
+        const f64 step_count = diagnostics.step_count;
+        s->diagnostics = SimData::Diagnostics {
+            .step_count = diagnostics.step_count,
+            .kinetic_energy = (f32)(diagnosticsSum(diagnostics.kinetic_energy) / step_count),
+            .momentum = vec3(
+                diagnosticsSum(diagnostics.momentum[0]) / step_count,
+                diagnosticsSum(diagnostics.momentum[1]) / step_count,
+                diagnosticsSum(diagnostics.momentum[2]) / step_count
+            ),
+            .max_density = glm::uintBitsToFloat(diagnostics.max_density_bits),
+            .escaped_particle_count = (f32)(diagnostics.escaped_count / step_count),
+        };
+        TracyPlot("sim::KineticEnergy", s->diagnostics.kinetic_energy);
+        TracyPlot("sim::MaxDensity", s->diagnostics.max_density);
+        TracyPlot("sim::EscapedParticleCount", s->diagnostics.escaped_particle_count);
+    }
+
+    const Diagnostics cleared {};
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, sizeof(cleared), &cleared, &res->buffer_diagnostics, slot * sizeof(Diagnostics),
+        &s->transfers, TRANSFER_STEP_FEEDBACK
+    );
+    s->uploaded_byte_count += sizeof(cleared);
+}
+
+
+/// `SimParameters::adaptive_time_step`: the fewest equal substeps of `delta_t` that the latest maxima allow, at
+/// least 1 and at most `max_substep_count`.
+static u32 getAdaptiveSubstepCount(const SimData* s, const f32 delta_t) {
+
+    const SimData::Params* params = &s->parameters;
+    const f32 radius = params->particle_interaction_radius;
+
+    // the time to cross the interaction radius at the max speed, and from rest at the max acceleration
+    f32 max_substep_delta_t = INFINITY;
+    if (s->time_step.max_speed > 0.0f)
+    {
+        max_substep_delta_t = glm::min(max_substep_delta_t, params->cfl_number * radius / s->time_step.max_speed);
+    }
+    if (s->time_step.max_acceleration > 0.0f)
+    {
+        max_substep_delta_t = glm::min(
+            max_substep_delta_t, params->cfl_number * sqrtf(2.0f * radius / s->time_step.max_acceleration)
+        );
+    }
+
+    const f32 substep_count = ceilf(delta_t / max_substep_delta_t);
+    // also catches a NaN, from a sim that has blown up
+    if (!(substep_count > 1.0f)) return 1;
+    if (substep_count >= (f32)params->max_substep_count) return params->max_substep_count;
+    return (u32)substep_count;
+}
+
+
+// Tracy's GPU zones take new queries each time they're recorded, so the GPU-resident command buffers are recorded
+// every step when profiling.
+#ifdef TRACY_ENABLE
+constexpr bool REUSE_GPU_RESIDENT_RECORDINGS = false;
+#else
+constexpr bool REUSE_GPU_RESIDENT_RECORDINGS = true;
+#endif
+
+/// Has the GPU-resident command buffers re-recorded before they're next submitted, after something that they
+/// recorded changed: the parameters, the particle count, or a pipeline.
+static void discardGpuResidentRecordings(GpuResources* res) {
+    for (u32 i = 0; i < GPU_RESIDENT_FRAMES_IN_FLIGHT; i++) res->gpu_resident_recordings[i].valid = false;
+}
+
+
+/// A persistently mapped host-visible buffer for copying particles to the GPU (or, if `readback`, from it).
+static GpuBuffer createParticleStagingBuffer(
+    const VulkanContext* vk_ctx,
+    const VkDeviceSize size_bytes,
+    const bool readback
+) {
+
+    ZoneScoped;
+
+    GpuBuffer staging {};
+
+    const VkBufferCreateInfo buffer_info {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size_bytes,
+        .usage = readback ? (VkBufferUsageFlags)VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                          : (VkBufferUsageFlags)VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk_ctx->compute_queue_family_index,
+    };
+    const VmaAllocationCreateFlags host_access = readback
+        ? VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+        : VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    const VmaAllocationCreateInfo alloc_info {
+        .flags = host_access | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    };
+    VkResult result = vmaCreateBuffer(
+        vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+        &staging.buffer, &staging.allocation, &staging.allocation_info
+    );
+    assertVk(result);
+
+    return staging;
+}
+
+
+/// The velocity buffers are this many arrays of `particle_capacity` words; see `GpuResources::half_velocities`.
+static u32 getVelocityArrayCount(const GpuResources* res) {
+    return res->half_velocities ? 2 : VELOCITY_COMPONENT_COUNT;
+}
+
+
+/// The layout of `count` particles in the staging buffers, and in checkpoint files: the positions, then the
+/// velocities in the layout of the velocity buffers, but with a stride of `count` instead of `particle_capacity`.
+/// Checkpoint files always have 32-bit velocities; the staging buffers have half velocities if the sim does (see
+/// `GpuResources::half_velocities`), and then leave the last third of the velocities unused.
+static VkDeviceSize getPackedParticlesSize(const u32fast count) {
+    return count * sizeof(vec4) + VELOCITY_COMPONENT_COUNT * count * sizeof(f32);
+}
+
+
+/// Converts `count` packed 32-bit velocities (see `getPackedParticlesSize()`) to the layout of
+/// `GpuResources::half_velocities`, which takes two arrays of `count` words.
+static void packHalfVelocities(const f32* p_src, u32* p_dst, const u32fast count) {
+
+    for (u32fast i = 0; i < count; i++)
+    {
+        p_dst[i] = glm::packHalf2x16(glm::vec2(p_src[i], p_src[count + i]));
+        p_dst[count + i] = glm::packHalf2x16(glm::vec2(p_src[2 * count + i], 0.0f));
+    }
+}
+
+
+/// The inverse of `packHalfVelocities()`, in place: `p_velocities` has room for the three arrays of floats.
+static void unpackHalfVelocities(void* p_velocities, const u32fast count) {
+
+    f32* p_floats = (f32*)p_velocities;
+    u32* p_words = (u32*)p_velocities;
+    // backwards, so that no particle's words are overwritten before they're read
+    for (u32fast i = count; i-- > 0;)
+    {
+        const glm::vec2 xy = glm::unpackHalf2x16(p_words[i]);
+        const f32 z = glm::unpackHalf2x16(p_words[count + i]).x;
+        p_floats[i] = xy.x;
+        p_floats[count + i] = xy.y;
+        p_floats[2 * count + i] = z;
+    }
+}
+
+
+/// Copies `count` packed particles (see `getPackedParticlesSize()`) from `staging` to the particle buffers,
+/// starting at particle `first_idx`, and waits for the copy to finish. The copy goes to the transfer queue, so the
+/// caller must have waited for the steps that use the particle buffers. With `GpuResources::half_velocities`, the
+/// staged velocities must already be packed by `packHalfVelocities()`.
+/// Writes both the sorted and the unsorted buffers, because it's easier to not think about which one needs
+/// to be written.
+static void copyStagedParticles(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const u32fast particle_capacity,
+    const u32fast first_idx,
+    const u32fast count,
+    const GpuBuffer* staging
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    alwaysAssert(count > 0);
+    alwaysAssert(first_idx + count <= particle_capacity);
+
+
+    const VkCommandBuffer command_buffer = res->transfer_command_buffer;
+
+    const VkDeviceSize positions_size_bytes = count * sizeof(vec4);
+    const VkDeviceSize velocity_component_size_bytes = count * sizeof(f32);
+    const u32 velocity_array_count = getVelocityArrayCount(res);
+
+    {
+        const VkCommandBufferBeginInfo cmd_buf_begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
+        assertVk(result);
+        {
+            const VkBufferCopy positions_copy {
+                .srcOffset = 0,
+                .dstOffset = first_idx * sizeof(vec4),
+                .size = positions_size_bytes,
+            };
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, staging->buffer, res->buffer_positions_unsorted.buffer, 1, &positions_copy
+            );
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, staging->buffer, res->buffer_positions_sorted.buffer, 1, &positions_copy
+            );
+
+            VkBufferCopy velocity_copies[VELOCITY_COMPONENT_COUNT] {};
+            for (u32fast d = 0; d < velocity_array_count; d++)
+            {
+                velocity_copies[d] = VkBufferCopy {
+                    .srcOffset = positions_size_bytes + d * velocity_component_size_bytes,
+                    .dstOffset = (d * particle_capacity + first_idx) * sizeof(f32),
+                    .size = velocity_component_size_bytes,
+                };
+            }
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, staging->buffer, res->buffer_velocities_unsorted.buffer,
+                velocity_array_count, velocity_copies
+            );
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, staging->buffer, res->buffer_velocities_sorted.buffer,
+                velocity_array_count, velocity_copies
+            );
+        }
+        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+        assertVk(result);
+    }
+
+    {
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+        };
+        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->transfer_queue, 1, &submit_info, res->fence);
+        assertVk(result);
+
+        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &res->fence, VK_TRUE, UINT64_MAX);
+        assertVk(result);
+
+        result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &res->fence);
+        assertVk(result);
+
+        result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
+        assertVk(result);
+    }
+}
+
+
+/// Uploads `count` particles, starting at particle `first_idx`, and waits for the upload to finish. If
+/// `p_velocities_optional` is NULL, the velocities are zero.
+static void uploadParticles(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const u32fast particle_capacity,
+    const u32fast first_idx,
+    const u32fast count,
+    const vec4 *const p_positions,
+    const vec3 *const p_velocities_optional,
+    TransferStats* transfers
+) {
+
+    ZoneScoped;
+
+    const VkDeviceSize positions_size_bytes = count * sizeof(vec4);
+    const VkDeviceSize staging_size_bytes = getPackedParticlesSize(count);
+
+    const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, staging_size_bytes, false);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+
+    {
+        void* p_staging = getMappedPointer(&staging);
+        memcpy(p_staging, p_positions, positions_size_bytes);
+
+        void* p_velocities = (void*)( (uintptr_t)p_staging + positions_size_bytes );
+        for (u32fast i = 0; i < count; i++)
+        {
+            const vec3 velocity = (p_velocities_optional != NULL) ? p_velocities_optional[i] : vec3(0.0f);
+            if (res->half_velocities)
+            {
+                ((u32*)p_velocities)[i] = glm::packHalf2x16(glm::vec2(velocity.x, velocity.y));
+                ((u32*)p_velocities)[count + i] = glm::packHalf2x16(glm::vec2(velocity.z, 0.0f));
+            }
+            else
+            {
+                ((f32*)p_velocities)[i] = velocity.x;
+                ((f32*)p_velocities)[count + i] = velocity.y;
+                ((f32*)p_velocities)[2 * count + i] = velocity.z;
+            }
+        }
+
+        VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, staging.allocation, 0, staging_size_bytes);
+        assertVk(result);
+        countTransfer(transfers, TRANSFER_PARTICLES, false, staging_size_bytes);
+    }
+
+    copyStagedParticles(res, vk_ctx, particle_capacity, first_idx, count, &staging);
+}
+
+
+/// `uploadParticles()` for particles that are already packed like in checkpoint files; see
+/// `getPackedParticlesSize()`.
+static void uploadPackedParticles(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const u32fast particle_capacity,
+    const u32fast first_idx,
+    const u32fast count,
+    const void* p_packed_particles,
+    TransferStats* transfers
+) {
+
+    ZoneScoped;
+
+    const VkDeviceSize staging_size_bytes = getPackedParticlesSize(count);
+
+    const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, staging_size_bytes, false);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+
+    if (res->half_velocities)
+    {
+        const VkDeviceSize positions_size_bytes = count * sizeof(vec4);
+        void* p_staging = getMappedPointer(&staging);
+        memcpy(p_staging, p_packed_particles, positions_size_bytes);
+        packHalfVelocities(
+            (const f32*)( (uintptr_t)p_packed_particles + positions_size_bytes ),
+            (u32*)( (uintptr_t)p_staging + positions_size_bytes ),
+            count
+        );
+
+        VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, staging.allocation, 0, staging_size_bytes);
+        assertVk(result);
+        countTransfer(transfers, TRANSFER_PARTICLES, false, staging_size_bytes);
+    }
+    else
+    {
+        uploadBufferToHostVisibleGpuMemory(
+            vk_ctx, staging_size_bytes, p_packed_particles, &staging, 0, transfers, TRANSFER_PARTICLES
+        );
+    }
+
+    copyStagedParticles(res, vk_ctx, particle_capacity, first_idx, count, &staging);
+}
+
+
+static DomainBounds getParticleBounds(const u32fast particle_count, const vec4 *const p_positions) {
+
+    DomainBounds bounds { .min = vec3(INFINITY), .max = vec3(-INFINITY) };
+    for (u32fast i = 0; i < particle_count; i++)
+    {
+        const vec3 pos = vec3(p_positions[i]);
+        bounds.min = glm::min(bounds.min, pos);
+        bounds.max = glm::max(bounds.max, pos);
+    }
+
+    return bounds;
+}
+
+
+/// `initial_bounds` must contain the initial positions. If `p_initial_positions_optional` is NULL, the
+/// particles aren't uploaded, and the caller must write them before building the spatial structure.
+static void initGpuBuffers(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const SimData::Params *const sim_params,
+    const u32 particle_count,
+    const u32 particle_capacity,
+    const vec4 *const p_initial_positions_optional,
+    const DomainBounds* initial_bounds,
+    const u32 hash_table_size,
+    TransferStats* transfers
+) {
+
+    ZoneScoped;
+
+
+    assertDomainFitsMortonCodes(initial_bounds, sim_params->cell_size_reciprocal, res->morton_code_word_count);
+
+    const UniformBufferData uniform_data {
+        .domain_min = initial_bounds->min,
+        .updated_by_host {
+            .rest_particle_density = sim_params->rest_particle_density,
+            .particle_interaction_radius = sim_params->particle_interaction_radius,
+            .spring_rest_length = sim_params->spring_rest_length,
+            .spring_stiffness = sim_params->spring_stiffness,
+            .cell_size_reciprocal = sim_params->cell_size_reciprocal,
+            .particle_count = particle_count,
+            .hash_table_size = hash_table_size,
+            .particle_capacity = particle_capacity,
+            .half_velocities = res->half_velocities,
+            .particle_ids = res->particle_ids,
+            .particle_levels = res->particle_levels,
+            .sph_stiffness = sim_params->sph_stiffness,
+            .sph_viscosity = sim_params->sph_viscosity,
+            .sph_density_kernel_coefficient = sim_params->sph_density_kernel_coefficient,
+            .sph_gradient_kernel_coefficient = sim_params->sph_gradient_kernel_coefficient,
+            .pbf_relaxation_epsilon = sim_params->pbf_relaxation_epsilon,
+            .flip_ratio = sim_params->flip_ratio,
+            .flip_grid_resolution = res->flip_grid_resolution,
+        },
+    };
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx,
+        sizeof(uniform_data),
+        &uniform_data,
+        &res->buffer_uniforms,
+        0, // dst_offset
+        transfers,
+        TRANSFER_UNIFORMS
+    );
+
+    // The GPU-resident mode reads each slot before the first submission that writes it has completed.
+    memsetZeroHostVisibleGpuBuffer(
+        vk_ctx, res->buffer_domain_bounds.allocation_info.size, &res->buffer_domain_bounds, transfers,
+        TRANSFER_STEP_FEEDBACK
+    );
+    // `advance()` reads this before the first neighbor list build.
+    memsetZeroHostVisibleGpuBuffer(
+        vk_ctx, res->buffer_neighbor_list_overflow.allocation_info.size, &res->buffer_neighbor_list_overflow,
+        transfers, TRANSFER_STEP_FEEDBACK
+    );
+
+    if (p_initial_positions_optional != NULL)
+    {
+        uploadParticles(
+            res, vk_ctx, particle_capacity, 0, particle_count, p_initial_positions_optional, NULL, transfers
+        );
+    }
+}
+
+
+/// The size of `GpuResources::buffer_region_readback`: the particle count, padded to the alignment of the
+/// positions, then the positions, velocities and ids. Can't be empty, because it's bound to a descriptor even if
+/// the readback is disabled.
+static VkDeviceSize getRegionReadbackSize(u32 capacity) {
+    return sizeof(vec4) + glm::max(capacity, 1u) * (sizeof(vec4) + sizeof(vec3) + sizeof(u32));
+}
+
+
+// The slots of `GpuResources::buffer_volume_export`, so that one can be written to a file while the GPU fills the
+// other; see `exportVolume()`.
+constexpr u32 VOLUME_EXPORT_SLOT_COUNT = 2;
+
+/// The size of a slot of `GpuResources::buffer_volume_export`: the cell count, padded to 16 bytes, then the bricks.
+static VkDeviceSize getVolumeExportSlotSize(u32 brick_capacity) {
+    return sizeof(uvec4) + (VkDeviceSize)brick_capacity * sizeof(VolumeBrick);
+}
+
+/// `GpuResources::particle_chunk_shift` for `capacity` particles: 0 if a whole array of the chunked buffers fits
+/// in one storage buffer binding of `max_range` bytes, and otherwise the most particles, as a power of two, whose
+/// part of it does. Only the neighbor lists are chunked, so they decide it.
+static u32 getParticleChunkShift(u64 capacity, u32 neighbor_list_capacity, u64 max_range) {
+    const u64 bytes_per_particle = glm::max(neighbor_list_capacity, 1u) * sizeof(u32);
+    if (capacity * bytes_per_particle <= max_range) return 0;
+
+    u32 shift = 1;
+    while (shift < 31 and ((u64)2 << shift) * bytes_per_particle <= max_range) shift++;
+    return shift;
+}
+
+/// The chunks that each of the chunked buffers has for `capacity` particles; see `ChunkedGpuBuffer`.
+static u64 getParticleChunkCount(u64 capacity, u32 particle_chunk_shift) {
+    if (particle_chunk_shift == 0) return 1;
+    return (capacity + ((u64)1 << particle_chunk_shift) - 1) >> particle_chunk_shift;
+}
+
+
+static void createBuffers(
+    GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const u32fast particle_capacity,
+    const u32fast hash_table_size
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+
+    struct BufferCreateInfo {
+        GpuBuffer* p_buffer_out;
+        VkDeviceSize size;
+        VkBufferUsageFlags buffer_usage;
+        VmaAllocationCreateFlags alloc_flags;
+        VmaMemoryUsage mem_usage;
+        VkMemoryPropertyFlags required_mem_flags;
+        // If not NULL, the buffer is transient: it has no memory of its own, but is bound to the start of this
+        // buffer's, which must be device-local and at least as large. Their contents are only live during
+        // different passes of a step (or between steps), which the step's barriers already order, so each one
+        // may clobber the other's outside of those.
+        const GpuBuffer* p_aliased_buffer;
+    };
+
+    const BufferCreateInfo buffer_infos[] {
+        {
+            .p_buffer_out = &res->buffer_uniforms,
+            .size = sizeof(UniformBufferData),
+            .buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+                          | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT // the bounds reduction writes `domain_min`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            // Read by every invocation of every step, but only ever written by the host. This lands in
+            // host-visible device-local memory (resizable BAR) if there is some, and in host memory otherwise.
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_positions_sorted,
+            .size = particle_capacity * sizeof(vec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT // OPTIMIZE maybe unnecessary
+                          // copied back by `removeParticles()`, and by the steps while `particle_buffers_swapped`
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // OPTIMIZE maybe unnecessary
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_velocities_sorted,
+            .size = particle_capacity * getVelocityArrayCount(res) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          // copied back by `removeParticles()` and `unswapParticleBuffers()`, and read back by
+                          // `saveCheckpoint()` while `particle_buffers_swapped`
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_positions_unsorted,
+            .size = particle_capacity * sizeof(vec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                          // `saveCheckpoint()` and `getSpatialStructureStats()` read it back
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_velocities_unsorted,
+            .size = particle_capacity * getVelocityArrayCount(res) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `saveCheckpoint()` reads it back
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cells,
+            .size = particle_capacity * sizeof(uvec2),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_hash_buckets,
+            .size = hash_table_size * sizeof(uvec2),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_H_begin,
+            .size = hash_table_size * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_H_length,
+            .size = hash_table_size * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_C_begin_morton_order,
+            .size = (particle_capacity + 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // `getSpatialStructureStats()` reads it back
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_C_length_morton_order,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // `getSpatialStructureStats()` reads it back
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_codes_morton_order,
+            .size = particle_capacity * sizeof(uvec2),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // `getSpatialStructureStats()` reads it back
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_hash_ranks,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_positions_reference,
+            .size = particle_capacity * sizeof(vec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_max_displacement,
+            .size = sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            // host-visible, because the host decides whether to rebuild the spatial structure
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_domain_bounds,
+            // slot 0 for the synchronous mode, and one slot per frame in flight for the GPU-resident mode
+            .size = (1 + GPU_RESIDENT_FRAMES_IN_FLIGHT) * sizeof(DomainBounds),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_delta_ts,
+            // Slots like `buffer_domain_bounds`. Written by the host before each submission, rather than pushed,
+            // so that the GPU-resident mode can resubmit its command buffers as they are.
+            .size = (1 + GPU_RESIDENT_FRAMES_IN_FLIGHT) * sizeof(f32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_max_motion,
+            // slots like `buffer_delta_ts`; read back and cleared by the host
+            .size = (1 + GPU_RESIDENT_FRAMES_IN_FLIGHT) * sizeof(MaxMotion),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_diagnostics,
+            // slots like `buffer_max_motion`
+            .size = (1 + GPU_RESIDENT_FRAMES_IN_FLIGHT) * sizeof(Diagnostics),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_reduction_partials,
+            // one element per workgroup
+            .size = res->workgroup_count * sizeof(DomainBounds),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_reduction_state,
+            .size = sizeof(ReductionState),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_slots,
+            // and the header; can't be empty, because it's bound to a descriptor even if the table is disabled
+            .size = (res->cell_slot_count + 1) * sizeof(uvec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_positions_quantized,
+            .size = particle_capacity * sizeof(uvec2),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_neighbor_counts,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_densities,
+            .size = particle_capacity * sizeof(f32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            // Written and read within the particle update. The sort's values are only live during the sort, and
+            // the region readback's offsets within its own submission.
+            .p_aliased_buffer = &res->buffer_radix_sort_values_scratch,
+        },
+        {
+            .p_buffer_out = &res->buffer_pbf_positions,
+            .size = 2 * particle_capacity * sizeof(vec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_flip_grid,
+            // can't be empty, because it's bound to the descriptor set
+            .size = glm::max(getFlipGridFloatCount(res->flip_grid_resolution, res->workgroup_size), (u64)1)
+                * sizeof(f32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_persistent_update,
+            // the queue's head and buckets, then a key and a queue item per chunk
+            .size = (1 + PERSISTENT_UPDATE_BUCKET_COUNT + 2 * (u64)res->workgroup_count) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_calm_steps_sorted,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `unswapParticleBuffers()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_calm_steps_unsorted,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            // at most one cell per particle
+            .p_buffer_out = &res->buffer_cell_awake,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_active,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_active_particles,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_sleep_state,
+            .size = sizeof(SleepState),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            // a placeholder unless the sim is an ensemble
+            .p_buffer_out = &res->buffer_member_ids_sorted,
+            .size = ((res->ensemble_member_count > 0) ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_member_ids_unsorted,
+            .size = ((res->ensemble_member_count > 0) ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `getEnsembleMemberIdsBuffer()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            // a placeholder unless `particle_ids`
+            .p_buffer_out = &res->buffer_particle_ids_sorted,
+            .size = (res->particle_ids ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `removeParticles()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_particle_ids_unsorted,
+            .size = (res->particle_ids ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `getParticleIdsBuffer()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            // a placeholder unless `particle_levels`
+            .p_buffer_out = &res->buffer_particle_levels_sorted,
+            .size = (res->particle_levels ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `removeParticles()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_particle_levels_unsorted,
+            .size = (res->particle_levels ? particle_capacity : 1) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT // `readBackParticleLevels()`
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            // written by the host, by `setEnsembleMemberParams()`
+            .p_buffer_out = &res->buffer_ensemble_members,
+            .size = glm::max(res->ensemble_member_count, 1u) * sizeof(EnsembleMemberParams),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_neighbor_list_overflow,
+            .size = sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            // host-visible, so that `advance()` can report it
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_removed_particle_count,
+            .size = sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            // host-visible, so that `removeParticles()` can read it back
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            // written by the host, by `submitSpatialQueries()`
+            .p_buffer_out = &res->buffer_spatial_queries,
+            .size = glm::max(res->spatial_query_capacity, 1u) * sizeof(SpatialQuery),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            // host-visible, so that `getSpatialQueryResults()` can point into them
+            .p_buffer_out = &res->buffer_spatial_query_results,
+            .size = glm::max(res->spatial_query_capacity, 1u) * sizeof(SpatialQueryResult),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_spatial_query_hits,
+            .size = glm::max(res->spatial_query_hit_capacity, 1u) * sizeof(SpatialQueryHit),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            // host-visible, so that `readBackParticlesInRegion()` can point into it
+            .p_buffer_out = &res->buffer_region_readback,
+            .size = getRegionReadbackSize(res->region_readback_capacity),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            // host-visible, so that `exportVolume()` can write the bricks to the files straight from it
+            .p_buffer_out = &res->buffer_volume_export,
+            .size = VOLUME_EXPORT_SLOT_COUNT * getVolumeExportSlotSize(res->volume_export_brick_capacity),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_collider_slots,
+            // can't be empty, because it's bound to a descriptor even if the collider is disabled
+            .size = glm::max(res->collider_slot_count, 1u) * sizeof(ivec4),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_collider_distances,
+            .size = glm::max(res->collider_brick_capacity, 1u) * COLLIDER_BRICK_SAMPLE_COUNT * sizeof(f32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_morton_codes,
+            .size = particle_capacity * res->morton_code_word_count * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_permutation,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // `getSpatialStructureStats()` reads it back
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_count,
+            .size = sizeof(CellCountState),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // `getSpatialStructureStats()` reads it back
+            // host-visible, so that `fitHashTableSize()` can read the cell count
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_cell_starts_scan,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            // Written by the cell list and read up to the next particle update; the sort's keys are only live
+            // during the sort, which comes after that update, and before the cell list that rewrites this.
+            .p_aliased_buffer = &res->buffer_radix_sort_keys_scratch,
+        },
+        {
+            .p_buffer_out = &res->buffer_scan_block_sums,
+            // shared by all scans; the largest one is over the hash table
+            .size = divCeil((u32)hash_table_size, res->workgroup_size) * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_radix_sort_keys_scratch,
+            .size = particle_capacity * res->morton_code_word_count * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_radix_sort_values_scratch,
+            .size = particle_capacity * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_radix_sort_histograms,
+            .size = RADIX_SORT_BUCKET_COUNT * res->radix_sort_tile_count * sizeof(u32),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .alloc_flags = 0,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        },
+        {
+            .p_buffer_out = &res->buffer_radix_sort_state,
+            .size = sizeof(RadixSortState),
+            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            // host-visible, so that we can read back the descent count
+            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            .mem_usage = VMA_MEMORY_USAGE_AUTO,
+            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        },
+    };
+
+    // The chunked buffers after them, one entry per chunk.
+    BufferCreateInfo create_infos[ARRAY_SIZE(buffer_infos) + MAX_BUFFER_CHUNK_COUNT] {};
+    memcpy(create_infos, buffer_infos, sizeof(buffer_infos));
+    u32fast buffer_info_count = ARRAY_SIZE(buffer_infos);
+    {
+        const u64 chunk_count = getParticleChunkCount(particle_capacity, res->particle_chunk_shift);
+        alwaysAssert(chunk_count <= MAX_BUFFER_CHUNK_COUNT); // see `checkMemoryUsage()`
+        res->buffer_neighbor_lists.chunk_count = (u32)chunk_count;
+
+        const u64 chunk_particle_count =
+            (res->particle_chunk_shift == 0) ? particle_capacity : (u64)1 << res->particle_chunk_shift;
+        for (u32 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx++)
+        {
+            const u64 particle_count =
+                glm::min(particle_capacity - chunk_idx * chunk_particle_count, chunk_particle_count);
+            create_infos[buffer_info_count++] = BufferCreateInfo {
+                .p_buffer_out = &res->buffer_neighbor_lists.chunks[chunk_idx],
+                // can't be empty, because it's bound to a descriptor even if the neighbor lists are disabled
+                .size = glm::max(particle_count * res->neighbor_list_capacity, (u64)1) * sizeof(u32),
+                .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                .alloc_flags = 0,
+                .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            };
+        }
+    }
+
+    // The renderer reads the positions on the graphics queue, and the uploads and frame captures copy on the
+    // transfer queue. If those are separate families, the buffers are shared concurrently instead of transferring
+    // their ownership twice per frame.
+    // OPTIMIZE: only the particle buffers need this.
+    u32 queue_families[3] {};
+    const u32 queue_family_count = getSharedQueueFamilies(vk_ctx, queue_families);
+
+    // the transient buffers last, once the buffers whose memory they're bound to exist
+    for (u32fast i = 0; i < 2 * buffer_info_count; i++)
+    {
+        const BufferCreateInfo* create_info = &create_infos[i % buffer_info_count];
+        const bool transient = create_info->p_aliased_buffer != NULL;
+        if (transient != (i >= buffer_info_count)) continue;
+
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = create_info->size,
+            .usage = create_info->buffer_usage,
+            .sharingMode = (queue_family_count > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = queue_family_count,
+            .pQueueFamilyIndices = queue_families,
+        };
+        GpuBuffer* buffer = create_info->p_buffer_out;
+
+        // Each is bound whole, as a single storage buffer, and the chunked buffers' chunks are sized to fit;
+        // `checkMemoryUsage()` refuses sims that don't.
+        if (create_info->buffer_usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+        {
+            alwaysAssert(create_info->size <= vk_ctx->physical_device_properties.limits.maxStorageBufferRange);
+        }
+
+        if (transient)
+        {
+            const GpuBuffer* aliased_buffer = create_info->p_aliased_buffer;
+            alwaysAssert(aliased_buffer->allocation != VK_NULL_HANDLE);
+            alwaysAssert(aliased_buffer->allocation_info.size >= create_info->size);
+
+            // no allocation of its own, so `vmaDestroyBuffer()` only destroys the buffer
+            *buffer = GpuBuffer {};
+            result = vmaCreateAliasingBuffer(
+                vk_ctx->vma_allocator, aliased_buffer->allocation, &buffer_info, &buffer->buffer
+            );
+            assertVk(result);
+
+            res->aliased_buffer_memory_size += create_info->size;
+            continue;
+        }
+
+        // Map the host-visible buffers once, for their whole lifetime.
+        VmaAllocationCreateFlags alloc_flags = create_info->alloc_flags;
+        if (create_info->required_mem_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            alloc_flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        }
+
+        const VmaAllocationCreateInfo alloc_info {
+            .flags = alloc_flags,
+            .usage = create_info->mem_usage,
+            .requiredFlags = create_info->required_mem_flags,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &buffer->buffer, &buffer->allocation, &buffer->allocation_info
+        );
+        assertVk(result);
+
+        res->buffer_memory_size += buffer->allocation_info.size;
+    }
+    TracyAllocN(res->buffer_positions_unsorted.buffer, res->buffer_memory_size, "fluid_sim GPU buffers");
+
+    {
+        VkMemoryPropertyFlags mem_flags = 0;
+        vmaGetMemoryTypeProperties(
+            vk_ctx->vma_allocator, res->buffer_uniforms.allocation_info.memoryType, &mem_flags
+        );
+        LOG_F(
+            INFO, "Uniform buffer is in %s memory.",
+            (mem_flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device-local" : "host"
+        );
+    }
+    LOG_F(
+        INFO, "GPU buffers: %.1lf MiB, and %.1lf MiB more of transient buffers in their memory.",
+        (f64)res->buffer_memory_size / (1024.0 * 1024.0), (f64)res->aliased_buffer_memory_size / (1024.0 * 1024.0)
+    );
+}
+
+
+static void createDescriptorStuff(
+    GpuResources* res,
+    const VulkanContext* vk_ctx
+) {
+    using descriptor_management::DescriptorSetLayout;
+
+    VkDescriptorSetLayoutBinding layout_bindings_general[LAYOUT_BINDING_COUNT__GENERAL] {};
+    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__GENERAL; i++)
+    {
+        layout_bindings_general[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = DESCRIPTOR_SET_LAYOUT__GENERAL[i],
+            // one per chunk; see `ChunkedGpuBuffer`
+            .descriptorCount = i == LAYOUT_BINDING_GENERAL__NEIGHBOR_LISTS ? MAX_BUFFER_CHUNK_COUNT : 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+
+    VkDescriptorSetLayoutBinding layout_bindings_reduction[LAYOUT_BINDING_COUNT__REDUCTION] {};
+    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__REDUCTION; i++)
+    {
+        layout_bindings_reduction[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = DESCRIPTOR_SET_LAYOUT__REDUCTION[i],
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+
+    VkDescriptorSetLayoutBinding layout_bindings_radix_sort[LAYOUT_BINDING_COUNT__RADIX_SORT] {};
+    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__RADIX_SORT; i++)
+    {
+        layout_bindings_radix_sort[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = DESCRIPTOR_SET_LAYOUT__RADIX_SORT[i],
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+
+    VkDescriptorSetLayoutBinding layout_bindings_scan[LAYOUT_BINDING_COUNT__SCAN] {};
+    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__SCAN; i++)
+    {
+        layout_bindings_scan[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = DESCRIPTOR_SET_LAYOUT__SCAN[i],
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+
+    res->push_descriptors = vk_ctx->cmd_push_descriptor_set != NULL;
+    const VkDescriptorSetLayoutCreateFlags pushed_layout_flags =
+        res->push_descriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+
+    constexpr u32fast layout_count = 4;
+    const DescriptorSetLayout layout_infos[layout_count] {
+        DescriptorSetLayout {
+            .binding_count = LAYOUT_BINDING_COUNT__GENERAL,
+            .p_bindings = layout_bindings_general,
+        },
+        DescriptorSetLayout {
+            .binding_count = LAYOUT_BINDING_COUNT__REDUCTION,
+            .p_bindings = layout_bindings_reduction,
+        },
+        DescriptorSetLayout {
+            .binding_count = LAYOUT_BINDING_COUNT__RADIX_SORT,
+            .p_bindings = layout_bindings_radix_sort,
+            .flags = pushed_layout_flags,
+        },
+        DescriptorSetLayout {
+            .binding_count = LAYOUT_BINDING_COUNT__SCAN,
+            .p_bindings = layout_bindings_scan,
+            .flags = pushed_layout_flags,
+        },
+    };
+
+    // the main set and its swapped twin (see `GpuResources::particle_buffers_swapped`)
+    const u32 pair_count = res->push_descriptors ? 0 : 2;
+    // the scans of the cell starts and the hash table
+    const u32 scan_count = res->push_descriptors ? 0 : 2;
+    const u32 descriptor_set_counts[layout_count] { 2, 1, pair_count, scan_count };
+    constexpr u32 total_descriptor_set_count = 7; // at most
+
+    VkDescriptorSetLayout descriptor_set_layouts[layout_count] {};
+    VkDescriptorSet descriptor_sets[total_descriptor_set_count] {};
+    {
+        descriptor_management::createDescriptorPoolAndSets(
+            vk_ctx,
+            layout_count,
+            layout_infos,
+            descriptor_set_counts,
+            &res->descriptor_pool,
+            descriptor_set_layouts,
+            descriptor_sets
+        );
+    }
+
+    res->descriptor_set_layout_main = descriptor_set_layouts[0];
+    res->descriptor_set_layout_reduction = descriptor_set_layouts[1];
+    res->descriptor_set_layout_radix_sort = descriptor_set_layouts[2];
+    res->descriptor_set_layout_scan = descriptor_set_layouts[3];
+
+    res->descriptor_set_main = descriptor_sets[0];
+    res->descriptor_set_main_swapped = descriptor_sets[1];
+    res->descriptor_set_reduction = descriptor_sets[2];
+    // VK_NULL_HANDLE if they're pushed
+    res->descriptor_set_radix_sort__primary_to_scratch = descriptor_sets[3];
+    res->descriptor_set_radix_sort__scratch_to_primary = descriptor_sets[4];
+    res->descriptor_set_scan__cell_starts = descriptor_sets[5];
+    res->descriptor_set_scan__hash_table = descriptor_sets[6];
+
+    // initialize descriptors --------------------------------------------------------------------------------
+
+    {
+        ZoneScopedN("WriteDescriptorSets");
+
+        const VkDescriptorBufferInfo buffer_infos[LAYOUT_BINDING_COUNT__GENERAL] {
+            [LAYOUT_BINDING_GENERAL__UNIFORMS] = { .buffer = res->buffer_uniforms.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__POSITIONS_SORTED] = { .buffer = res->buffer_positions_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED] = { .buffer = res->buffer_velocities_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED] = { .buffer = res->buffer_positions_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED] = { .buffer = res->buffer_velocities_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELLS] = { .buffer = res->buffer_cells.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__HASH_BUCKETS] = { .buffer = res->buffer_hash_buckets.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__H_BEGIN] = { .buffer = res->buffer_H_begin.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__H_LENGTH] = { .buffer = res->buffer_H_length.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PERMUTATION] = { .buffer = res->buffer_permutation.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__MORTON_CODES] = { .buffer = res->buffer_morton_codes.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_COUNT] = { .buffer = res->buffer_cell_count.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_STARTS_SCAN] = { .buffer = res->buffer_cell_starts_scan.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__C_BEGIN_MORTON_ORDER] = { .buffer = res->buffer_C_begin_morton_order.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__C_LENGTH_MORTON_ORDER] = { .buffer = res->buffer_C_length_morton_order.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_HASH_RANKS] = { .buffer = res->buffer_cell_hash_ranks.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__POSITIONS_REFERENCE] = { .buffer = res->buffer_positions_reference.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__MAX_DISPLACEMENT] = { .buffer = res->buffer_max_displacement.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__REDUCTION_PARTIALS] = { .buffer = res->buffer_reduction_partials.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__NEIGHBOR_LISTS] = {}, // see `neighbor_list_infos`
+            [LAYOUT_BINDING_GENERAL__NEIGHBOR_COUNTS] = { .buffer = res->buffer_neighbor_counts.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__NEIGHBOR_LIST_OVERFLOW] = { .buffer = res->buffer_neighbor_list_overflow.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__POSITIONS_QUANTIZED] = { .buffer = res->buffer_positions_quantized.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_SLOTS] = { .buffer = res->buffer_cell_slots.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_CODES_MORTON_ORDER] = { .buffer = res->buffer_cell_codes_morton_order.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__REMOVED_PARTICLE_COUNT] = { .buffer = res->buffer_removed_particle_count.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__DELTA_TS] = { .buffer = res->buffer_delta_ts.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__COLLIDER_SLOTS] = { .buffer = res->buffer_collider_slots.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__COLLIDER_DISTANCES] = { .buffer = res->buffer_collider_distances.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__DENSITIES] = { .buffer = res->buffer_densities.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__MAX_MOTION] = { .buffer = res->buffer_max_motion.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CALM_STEPS_SORTED] = { .buffer = res->buffer_calm_steps_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CALM_STEPS_UNSORTED] = { .buffer = res->buffer_calm_steps_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_AWAKE] = { .buffer = res->buffer_cell_awake.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__CELL_ACTIVE] = { .buffer = res->buffer_cell_active.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__ACTIVE_PARTICLES] = { .buffer = res->buffer_active_particles.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__SLEEP_STATE] = { .buffer = res->buffer_sleep_state.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__ENSEMBLE_MEMBERS] = { .buffer = res->buffer_ensemble_members.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__MEMBER_IDS_SORTED] = { .buffer = res->buffer_member_ids_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__MEMBER_IDS_UNSORTED] = { .buffer = res->buffer_member_ids_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PARTICLE_IDS_SORTED] = { .buffer = res->buffer_particle_ids_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PARTICLE_IDS_UNSORTED] = { .buffer = res->buffer_particle_ids_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__SPATIAL_QUERIES] = { .buffer = res->buffer_spatial_queries.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_RESULTS] = { .buffer = res->buffer_spatial_query_results.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__SPATIAL_QUERY_HITS] = { .buffer = res->buffer_spatial_query_hits.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            // the sort's scratch, which is free between steps
+            [LAYOUT_BINDING_GENERAL__REGION_OFFSETS] = { .buffer = res->buffer_radix_sort_values_scratch.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__REGION_READBACK] = { .buffer = res->buffer_region_readback.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PBF_POSITIONS] = { .buffer = res->buffer_pbf_positions.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__FLIP_GRID] = { .buffer = res->buffer_flip_grid.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PERSISTENT_UPDATE] = { .buffer = res->buffer_persistent_update.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__VOLUME_EXPORT] = { .buffer = res->buffer_volume_export.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__DIAGNOSTICS] = { .buffer = res->buffer_diagnostics.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_SORTED] = { .buffer = res->buffer_particle_levels_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_UNSORTED] = { .buffer = res->buffer_particle_levels_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        // see `GpuResources::particle_buffers_swapped`
+        VkDescriptorBufferInfo buffer_infos_swapped[LAYOUT_BINDING_COUNT__GENERAL] {};
+        memcpy(buffer_infos_swapped, buffer_infos, sizeof(buffer_infos));
+        constexpr u32 swapped_pairs[][2] {
+            { LAYOUT_BINDING_GENERAL__POSITIONS_SORTED, LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED },
+            { LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED, LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED },
+            { LAYOUT_BINDING_GENERAL__CALM_STEPS_SORTED, LAYOUT_BINDING_GENERAL__CALM_STEPS_UNSORTED },
+            { LAYOUT_BINDING_GENERAL__MEMBER_IDS_SORTED, LAYOUT_BINDING_GENERAL__MEMBER_IDS_UNSORTED },
+            { LAYOUT_BINDING_GENERAL__PARTICLE_IDS_SORTED, LAYOUT_BINDING_GENERAL__PARTICLE_IDS_UNSORTED },
+            { LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_SORTED, LAYOUT_BINDING_GENERAL__PARTICLE_LEVELS_UNSORTED },
+        };
+        for (u32 pair_idx = 0; pair_idx < ARRAY_SIZE(swapped_pairs); pair_idx++)
+        {
+            SWAP(buffer_infos_swapped[swapped_pairs[pair_idx][0]], buffer_infos_swapped[swapped_pairs[pair_idx][1]]);
+        }
+
+        // Every element of the array must be valid, so the ones past the last chunk repeat it.
+        VkDescriptorBufferInfo neighbor_list_infos[MAX_BUFFER_CHUNK_COUNT] {};
+        for (u32 chunk_idx = 0; chunk_idx < MAX_BUFFER_CHUNK_COUNT; chunk_idx++)
+        {
+            const u32 last_chunk_idx = res->buffer_neighbor_lists.chunk_count - 1;
+            neighbor_list_infos[chunk_idx] = VkDescriptorBufferInfo {
+                .buffer = res->buffer_neighbor_lists.chunks[glm::min(chunk_idx, last_chunk_idx)].buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE,
+            };
+        }
+
+        constexpr u32 write_count = 2 * LAYOUT_BINDING_COUNT__GENERAL;
+        VkWriteDescriptorSet writes[write_count] {};
+        for (u32 binding_idx = 0; binding_idx < LAYOUT_BINDING_COUNT__GENERAL; binding_idx++)
+        {
+            const bool chunked = binding_idx == LAYOUT_BINDING_GENERAL__NEIGHBOR_LISTS;
+            writes[binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = getMainDescriptorSet(res),
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = chunked ? MAX_BUFFER_CHUNK_COUNT : 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__GENERAL[binding_idx],
+                .pBufferInfo = chunked ? neighbor_list_infos : &buffer_infos[binding_idx],
+            };
+            writes[LAYOUT_BINDING_COUNT__GENERAL + binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_main_swapped,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = chunked ? MAX_BUFFER_CHUNK_COUNT : 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__GENERAL[binding_idx],
+                .pBufferInfo = chunked ? neighbor_list_infos : &buffer_infos_swapped[binding_idx],
+            };
+        }
+
+        vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, write_count, writes, 0, NULL);
+    }
+
+    // `buffer_positions_unsorted` has the last step's positions even while `particle_buffers_swapped`, so this set
+    // needs no swapped twin.
+    {
+        const VkDescriptorBufferInfo buffer_infos[LAYOUT_BINDING_COUNT__REDUCTION] {
+            [LAYOUT_BINDING_REDUCTION__POSITIONS] = { .buffer = res->buffer_positions_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_REDUCTION__PARTIALS] = { .buffer = res->buffer_reduction_partials.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_REDUCTION__STATE] = { .buffer = res->buffer_reduction_state.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+            [LAYOUT_BINDING_REDUCTION__UNIFORMS] = { .buffer = res->buffer_uniforms.buffer, .offset = offsetof(UniformBufferData, domain_min), .range = sizeof(vec3) },
+            [LAYOUT_BINDING_REDUCTION__DOMAIN_BOUNDS] = { .buffer = res->buffer_domain_bounds.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        VkWriteDescriptorSet writes[LAYOUT_BINDING_COUNT__REDUCTION] {};
+        for (u32 binding_idx = 0; binding_idx < LAYOUT_BINDING_COUNT__REDUCTION; binding_idx++)
+        {
+            writes[binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_reduction,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__REDUCTION[binding_idx],
+                .pBufferInfo = &buffer_infos[binding_idx],
+            };
+        }
+
+        vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, LAYOUT_BINDING_COUNT__REDUCTION, writes, 0, NULL);
+    }
+
+    if (!res->push_descriptors) {
+        VkDescriptorBufferInfo primary_to_scratch[LAYOUT_BINDING_COUNT__RADIX_SORT] {};
+        getRadixSortBufferInfos(res, false, primary_to_scratch);
+        VkDescriptorBufferInfo scratch_to_primary[LAYOUT_BINDING_COUNT__RADIX_SORT] {};
+        getRadixSortBufferInfos(res, true, scratch_to_primary);
+
+        constexpr u32 write_count = 2 * LAYOUT_BINDING_COUNT__RADIX_SORT;
+        VkWriteDescriptorSet writes[write_count] {};
+        for (u32 binding_idx = 0; binding_idx < LAYOUT_BINDING_COUNT__RADIX_SORT; binding_idx++)
+        {
+            writes[binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_radix_sort__primary_to_scratch,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__RADIX_SORT[binding_idx],
+                .pBufferInfo = &primary_to_scratch[binding_idx],
+            };
+            writes[LAYOUT_BINDING_COUNT__RADIX_SORT + binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_radix_sort__scratch_to_primary,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__RADIX_SORT[binding_idx],
+                .pBufferInfo = &scratch_to_primary[binding_idx],
+            };
+        }
+
+        vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, write_count, writes, 0, NULL);
+    }
+
+    if (!res->push_descriptors) {
+        VkDescriptorBufferInfo cell_starts[LAYOUT_BINDING_COUNT__SCAN] {};
+        getScanBufferInfos(res, res->buffer_cell_starts_scan.buffer, cell_starts);
+        VkDescriptorBufferInfo hash_table[LAYOUT_BINDING_COUNT__SCAN] {};
+        getScanBufferInfos(res, res->buffer_H_begin.buffer, hash_table);
+
+        constexpr u32 write_count = 2 * LAYOUT_BINDING_COUNT__SCAN;
+        VkWriteDescriptorSet writes[write_count] {};
+        for (u32 binding_idx = 0; binding_idx < LAYOUT_BINDING_COUNT__SCAN; binding_idx++)
+        {
+            writes[binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_scan__cell_starts,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__SCAN[binding_idx],
+                .pBufferInfo = &cell_starts[binding_idx],
+            };
+            writes[LAYOUT_BINDING_COUNT__SCAN + binding_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = res->descriptor_set_scan__hash_table,
+                .dstBinding = binding_idx,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = DESCRIPTOR_SET_LAYOUT__SCAN[binding_idx],
+                .pBufferInfo = &hash_table[binding_idx],
+            };
+        }
+
+        vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, write_count, writes, 0, NULL);
+    }
+};
+
+
+static void createComputePipelineFromSpirv(
+    const VulkanContext* vk_ctx,
+    const u32* p_spirv,
+    size_t spirv_byte_count,
+    const ComputeShaderSpecializationConstants* specialization_constants,
+    const VkDescriptorSetLayout descriptor_set_layout,
+    const u32 push_constants_size, // 0 if the pipeline has no push constants
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    {
+        VkPushConstantRange push_constant_range {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = push_constants_size,
+        };
+
+        VkPipelineLayoutCreateInfo layout_info {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &descriptor_set_layout,
+            .pushConstantRangeCount = push_constants_size == 0 ? (u32)0 : (u32)1,
+            .pPushConstantRanges = push_constants_size == 0 ? NULL : &push_constant_range,
+        };
+        result = vk_ctx->procs_dev.CreatePipelineLayout(vk_ctx->device, &layout_info, NULL, &pipeline_layout);
+        assertVk(result);
+    }
+    *pipeline_layout_out = pipeline_layout;
+
+    // Shaders that don't declare some of these ignore them.
+    const VkSpecializationMapEntry specialization_map_entries[] {
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.local_size_x,
+            .offset = offsetof(ComputeShaderSpecializationConstants, local_size_x),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.morton_code_word_count,
+            .offset = offsetof(ComputeShaderSpecializationConstants, morton_code_word_count),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.open_addressing_cell_table,
+            .offset = offsetof(ComputeShaderSpecializationConstants, open_addressing_cell_table),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.dense_cell_grid,
+            .offset = offsetof(ComputeShaderSpecializationConstants, dense_cell_grid),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.hilbert_cell_order,
+            .offset = offsetof(ComputeShaderSpecializationConstants, hilbert_cell_order),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_axes,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.axes),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_min_x,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.min),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_min_x + 1,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.min) + sizeof(f32),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_min_x + 2,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.min) + 2 * sizeof(f32),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_size_x,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.size),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_size_x + 1,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.size) + sizeof(f32),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.periodic_box_size_x + 2,
+            .offset = offsetof(ComputeShaderSpecializationConstants, periodic_box.size) + 2 * sizeof(f32),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.particle_chunk_shift,
+            .offset = offsetof(ComputeShaderSpecializationConstants, particle_chunk_shift),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.baked_sim_params,
+            .offset = offsetof(ComputeShaderSpecializationConstants, baked_sim_params),
+            .size = sizeof(u32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.particle_interaction_radius,
+            .offset = offsetof(ComputeShaderSpecializationConstants, baked_params.particle_interaction_radius),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.spring_rest_length,
+            .offset = offsetof(ComputeShaderSpecializationConstants, baked_params.spring_rest_length),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.spring_stiffness,
+            .offset = offsetof(ComputeShaderSpecializationConstants, baked_params.spring_stiffness),
+            .size = sizeof(f32),
+        },
+        {
+            .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.cell_size_reciprocal,
+            .offset = offsetof(ComputeShaderSpecializationConstants, baked_params.cell_size_reciprocal),
+            .size = sizeof(f32),
+        },
+    };
+
+    const VkSpecializationInfo specialization_info {
+        .mapEntryCount = ARRAY_SIZE(specialization_map_entries),
+        .pMapEntries = specialization_map_entries,
+        .dataSize = sizeof(ComputeShaderSpecializationConstants),
+        .pData = specialization_constants,
+    };
+
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    {
+        alwaysAssert(spirv_byte_count != 0);
+        alwaysAssert((uintptr_t)p_spirv % alignof(u32) == 0);
+        alwaysAssert(spirv_byte_count % sizeof(u32) == 0);
+
+        const VkShaderModuleCreateInfo shader_module_info {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = spirv_byte_count,
+            .pCode = p_spirv,
+        };
+        result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &shader_module_info, NULL, &shader_module);
+        assertVk(result);
+    }
+    defer(vk_ctx->procs_dev.DestroyShaderModule(vk_ctx->device, shader_module, NULL));
+
+    const VkPipelineShaderStageCreateInfo shader_stage_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = shader_module,
+        .pName = "main",
+        .pSpecializationInfo = &specialization_info,
+    };
+
+    const VkComputePipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = shader_stage_info,
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    result = vk_ctx->procs_dev.CreateComputePipelines(
+        vk_ctx->device,
+        vk_ctx->pipeline_cache,
+        1, // createInfoCount
+        &pipeline_info,
+        NULL, // pAllocator
+        pipeline_out
+    );
+    assertVk(result);
+}
+
+static void createComputePipeline(
+    const VulkanContext* vk_ctx,
+    const char* spirv_filepath,
+    const ComputeShaderSpecializationConstants* specialization_constants,
+    const VkDescriptorSetLayout descriptor_set_layout,
+    const u32 push_constants_size, // 0 if the pipeline has no push constants
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    size_t spirv_byte_count = 0;
+    void* p_spirv = file_util::readEntireFile(spirv_filepath, &spirv_byte_count);
+    if (p_spirv == NULL) ABORT_F("Failed to read SPIR-V file `%s`.", spirv_filepath);
+    defer(free(p_spirv));
+
+    createComputePipelineFromSpirv(
+        vk_ctx, (const u32*)p_spirv, spirv_byte_count, specialization_constants, descriptor_set_layout,
+        push_constants_size, pipeline_out, pipeline_layout_out
+    );
+}
+
+/// The GPU backend's compute pipelines, except for the baked `updateParticles`. Each is created from
+/// "build/shaders/<shader_filename>.spv", which the build compiles from "src/<shader_filename>"; or, once
+/// `reloadModifiedShaderSourceFiles()` has reloaded it, from the source.
+struct ComputePipelineInfo {
+    const char* shader_filename;
+    VkDescriptorSetLayout descriptor_set_layout;
+    u32 push_constants_size;
+    VkPipeline* p_pipeline;
+    VkPipelineLayout* p_pipeline_layout;
+    // If true, the device can't run the shader, so the pipeline isn't created and stays VK_NULL_HANDLE.
+    bool unsupported;
+};
+
+static void getComputePipelineInfos(GpuResources* res, ComputePipelineInfo p_infos_out[COMPUTE_PIPELINE_COUNT]) {
+
+    assert(res->descriptor_set_layout_main != VK_NULL_HANDLE);
+    assert(res->descriptor_set_layout_reduction != VK_NULL_HANDLE);
+    assert(res->descriptor_set_layout_radix_sort != VK_NULL_HANDLE);
+    assert(res->descriptor_set_layout_scan != VK_NULL_HANDLE);
+
+    const ComputePipelineInfo pipeline_infos[] {
+        {
+            .shader_filename = "fluidSim_computeBounds.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_reduction,
+            .push_constants_size = sizeof(ReductionPushConstants),
+            .p_pipeline = &res->pipeline_computeBounds,
+            .p_pipeline_layout = &res->pipeline_layout_computeBounds,
+        },
+        {
+            .shader_filename = "fluidSim_updateDomainOrigin.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_reduction,
+            .push_constants_size = sizeof(DomainOriginPushConstants),
+            .p_pipeline = &res->pipeline_updateDomainOrigin,
+            .p_pipeline_layout = &res->pipeline_layout_updateDomainOrigin,
+        },
+        {
+            .shader_filename = "fluidSim_computeMortonCodes.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_computeMortonCodes,
+            .p_pipeline_layout = &res->pipeline_layout_computeMortonCodes,
+        },
+        {
+            .shader_filename = "fluidSim_removeParticles.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(RemoveParticlesPushConstants),
+            .p_pipeline = &res->pipeline_removeParticles,
+            .p_pipeline_layout = &res->pipeline_layout_removeParticles,
+        },
+        {
+            .shader_filename = "fluidSim_spatialQuery.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(SpatialQueryPushConstants),
+            .p_pipeline = &res->pipeline_spatialQuery,
+            .p_pipeline_layout = &res->pipeline_layout_spatialQuery,
+        },
+        {
+            .shader_filename = "fluidSim_regionReadback_mark.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(RegionReadbackPushConstants),
+            .p_pipeline = &res->pipeline_regionReadback_mark,
+            .p_pipeline_layout = &res->pipeline_layout_regionReadback_mark,
+        },
+        {
+            .shader_filename = "fluidSim_regionReadback_scatter.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(RegionReadbackPushConstants),
+            .p_pipeline = &res->pipeline_regionReadback_scatter,
+            .p_pipeline_layout = &res->pipeline_layout_regionReadback_scatter,
+        },
+        {
+            .shader_filename = "fluidSim_exportVolume.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(VolumeExportPushConstants),
+            .p_pipeline = &res->pipeline_exportVolume,
+            .p_pipeline_layout = &res->pipeline_layout_exportVolume,
+        },
+        {
+            .shader_filename = "fluidSim_generateParticles.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(GenerateParticlesPushConstants),
+            .p_pipeline = &res->pipeline_generateParticles,
+            .p_pipeline_layout = &res->pipeline_layout_generateParticles,
+        },
+        {
+            .shader_filename = "fluidSim_updateParticles.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_updateParticles,
+            .p_pipeline_layout = &res->pipeline_layout_updateParticles,
+        },
+        {
+            .shader_filename = "fluidSim_updateParticlesTiled.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_updateParticlesTiled,
+            .p_pipeline_layout = &res->pipeline_layout_updateParticlesTiled,
         },
         {
-            .p_buffer_out = &res->buffer_positions_unsorted,
-            .size = particle_count * sizeof(vec4),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        },
+            .shader_filename = "fluidSim_updateParticlesSubgroup.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_updateParticlesSubgroup,
+            .p_pipeline_layout = &res->pipeline_layout_updateParticlesSubgroup,
+            .unsupported = !res->subgroup_particle_update_supported,
+        },
+        {
+            .shader_filename = "fluidSim_updateParticlesPersistent.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_updateParticlesPersistent,
+            .p_pipeline_layout = &res->pipeline_layout_updateParticlesPersistent,
+        },
+        {
+            .shader_filename = "fluidSim_buildNeighborLists.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_buildNeighborLists,
+            .p_pipeline_layout = &res->pipeline_layout_buildNeighborLists,
+        },
+        {
+            .shader_filename = "fluidSim_computeDensities.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_computeDensities,
+            .p_pipeline_layout = &res->pipeline_layout_computeDensities,
+        },
+        {
+            .shader_filename = "fluidSim_solveDensityConstraints.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_solveDensityConstraints,
+            .p_pipeline_layout = &res->pipeline_layout_solveDensityConstraints,
+        },
+        {
+            .shader_filename = "fluidSim_flip_transferToGrid.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_flip_transferToGrid,
+            .p_pipeline_layout = &res->pipeline_layout_flip_transferToGrid,
+        },
+        {
+            .shader_filename = "fluidSim_flip_solvePressure.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(FlipPressurePushConstants),
+            .p_pipeline = &res->pipeline_flip_solvePressure,
+            .p_pipeline_layout = &res->pipeline_layout_flip_solvePressure,
+        },
+        {
+            .shader_filename = "fluidSim_sleep_markActiveCells.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_sleep_markActiveCells,
+            .p_pipeline_layout = &res->pipeline_layout_sleep_markActiveCells,
+        },
+        {
+            .shader_filename = "fluidSim_sleep_compactParticles.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(ParticleUpdatePushConstants),
+            .p_pipeline = &res->pipeline_sleep_compactParticles,
+            .p_pipeline_layout = &res->pipeline_layout_sleep_compactParticles,
+        },
+        {
+            .shader_filename = "fluidSim_computeMaxDisplacement.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_computeMaxDisplacement,
+            .p_pipeline_layout = &res->pipeline_layout_computeMaxDisplacement,
+        },
+        {
+            .shader_filename = "fluidSim_sortParticles.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(SortParticlesPushConstants),
+            .p_pipeline = &res->pipeline_sortParticles,
+            .p_pipeline_layout = &res->pipeline_layout_sortParticles,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_countDescents.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_countDescents,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_countDescents,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_prepareDispatch.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_prepareDispatch,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_prepareDispatch,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_writeIdentity.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_writeIdentity,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_writeIdentity,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_histogram.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_histogram,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_histogram,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_scan.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_scan,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_scan,
+        },
+        {
+            .shader_filename = "fluidSim_radixSort_scatter.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_radix_sort,
+            .push_constants_size = sizeof(RadixSortPushConstants),
+            .p_pipeline = &res->pipeline_radixSort_scatter,
+            .p_pipeline_layout = &res->pipeline_layout_radixSort_scatter,
+        },
+        {
+            .shader_filename = "fluidSim_cellList_markCellStarts.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_cellList_markCellStarts,
+            .p_pipeline_layout = &res->pipeline_layout_cellList_markCellStarts,
+        },
+        {
+            .shader_filename = "fluidSim_scan_blocks.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_scan,
+            .push_constants_size = sizeof(ScanPushConstants),
+            .p_pipeline = &res->pipeline_scan_blocks,
+            .p_pipeline_layout = &res->pipeline_layout_scan_blocks,
+        },
+        {
+            .shader_filename = "fluidSim_scan_blockSums.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_scan,
+            .push_constants_size = sizeof(ScanPushConstants),
+            .p_pipeline = &res->pipeline_scan_blockSums,
+            .p_pipeline_layout = &res->pipeline_layout_scan_blockSums,
+        },
+        {
+            .shader_filename = "fluidSim_scan_addBlockOffsets.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_scan,
+            .push_constants_size = sizeof(ScanPushConstants),
+            .p_pipeline = &res->pipeline_scan_addBlockOffsets,
+            .p_pipeline_layout = &res->pipeline_layout_scan_addBlockOffsets,
+        },
+        {
+            .shader_filename = "fluidSim_cellList_scatter.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_cellList_scatter,
+            .p_pipeline_layout = &res->pipeline_layout_cellList_scatter,
+        },
+        {
+            .shader_filename = "fluidSim_cellList_computeLengths.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_cellList_computeLengths,
+            .p_pipeline_layout = &res->pipeline_layout_cellList_computeLengths,
+        },
+        {
+            .shader_filename = "fluidSim_hashTable_countCells.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_hashTable_countCells,
+            .p_pipeline_layout = &res->pipeline_layout_hashTable_countCells,
+        },
+        {
+            .shader_filename = "fluidSim_hashTable_scatterCells.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = 0,
+            .p_pipeline = &res->pipeline_hashTable_scatterCells,
+            .p_pipeline_layout = &res->pipeline_layout_hashTable_scatterCells,
+        },
+        {
+            .shader_filename = "fluidSim_hashTable_insertCells.comp",
+            .descriptor_set_layout = res->descriptor_set_layout_main,
+            .push_constants_size = sizeof(InsertCellsPushConstants),
+            .p_pipeline = &res->pipeline_hashTable_insertCells,
+            .p_pipeline_layout = &res->pipeline_layout_hashTable_insertCells,
+        },
+    };
+    static_assert(ARRAY_SIZE(pipeline_infos) == COMPUTE_PIPELINE_COUNT);
+
+    memcpy(p_infos_out, pipeline_infos, sizeof(pipeline_infos));
+}
+
+static ComputeShaderSpecializationConstants getSpecializationConstants(const GpuResources* res) {
+    return ComputeShaderSpecializationConstants {
+        .local_size_x = res->workgroup_size,
+        .morton_code_word_count = res->morton_code_word_count,
+        .open_addressing_cell_table = res->cell_slot_count > 0,
+        .dense_cell_grid = res->dense_cell_grid,
+        .hilbert_cell_order = res->hilbert_cell_order,
+        .periodic_box = res->periodic_box,
+        .particle_chunk_shift = res->particle_chunk_shift,
+        .baked_sim_params = 0,
+        .baked_params {},
+    };
+}
+
+/// A `thread_pool` task that creates a compute pipeline; see `createComputePipelines()`. `p_arg` is the
+/// `ComputePipelineTask*`.
+struct ComputePipelineTask {
+    const VulkanContext* vk_ctx;
+    const ComputePipelineInfo* info;
+    const ComputeShaderSpecializationConstants* specialization_constants;
+};
+static void createComputePipelineTask(void* p_arg) {
+
+    const ComputePipelineTask* task = (const ComputePipelineTask*)p_arg;
+
+    char spirv_filepath[256];
+    int char_count = snprintf(
+        spirv_filepath, sizeof(spirv_filepath), "build/shaders/%s.spv", task->info->shader_filename
+    );
+    alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(spirv_filepath));
+
+    createComputePipeline(
+        task->vk_ctx,
+        spirv_filepath,
+        task->specialization_constants,
+        task->info->descriptor_set_layout,
+        task->info->push_constants_size,
+        task->info->p_pipeline,
+        task->info->p_pipeline_layout
+    );
+}
+
+/// The pipelines are created concurrently on `thread_pool`, as pipeline creation is thread-safe and the pipeline
+/// cache is internally synchronized; it returns once they all exist.
+static void createComputePipelines(
+    GpuResources* res,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool
+) {
+
+    ZoneScoped;
+
+    const ComputeShaderSpecializationConstants specialization_constants = getSpecializationConstants(res);
+
+    ComputePipelineInfo pipeline_infos[COMPUTE_PIPELINE_COUNT];
+    getComputePipelineInfos(res, pipeline_infos);
+
+    ComputePipelineTask tasks[COMPUTE_PIPELINE_COUNT];
+    u32 task_count = 0;
+    for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+    {
+        if (pipeline_infos[i].unsupported) continue;
+        tasks[task_count++] = ComputePipelineTask {
+            .vk_ctx = vk_ctx,
+            .info = &pipeline_infos[i],
+            .specialization_constants = &specialization_constants,
+        };
+    }
+
+    thread_pool::TaskGroup task_group {};
+    thread_pool::enqueueTasks(
+        thread_pool, &task_group, task_count, createComputePipelineTask, tasks, sizeof(tasks[0])
+    );
+    thread_pool::waitForGroup(thread_pool, &task_group);
+};
+
+
+/// Thread pool task that builds `updateParticles` with `BakedPipelineBuild::params` baked in. `p_arg` is the
+/// `BakedPipelineBuild*`.
+static void buildBakedUpdatePipeline(void* p_arg) {
+
+    ZoneScoped;
+
+    BakedPipelineBuild* build = (BakedPipelineBuild*)p_arg;
+
+    const ComputeShaderSpecializationConstants specialization_constants {
+        .local_size_x = build->workgroup_size,
+        .morton_code_word_count = build->morton_code_word_count,
+        .open_addressing_cell_table = build->open_addressing_cell_table,
+        .dense_cell_grid = build->dense_cell_grid,
+        .hilbert_cell_order = build->hilbert_cell_order,
+        .periodic_box = build->periodic_box,
+        .particle_chunk_shift = build->particle_chunk_shift,
+        .baked_sim_params = 1,
+        .baked_params = build->params,
+    };
+    if (build->p_spirv != NULL) createComputePipelineFromSpirv(
+        build->vk_ctx,
+        build->p_spirv,
+        build->spirv_byte_count,
+        &specialization_constants,
+        build->descriptor_set_layout,
+        sizeof(ParticleUpdatePushConstants),
+        &build->pipeline,
+        &build->pipeline_layout
+    );
+    else createComputePipeline(
+        build->vk_ctx,
+        "build/shaders/fluidSim_updateParticles.comp.spv",
+        &specialization_constants,
+        build->descriptor_set_layout,
+        sizeof(ParticleUpdatePushConstants),
+        &build->pipeline,
+        &build->pipeline_layout
+    );
+
+    // The owner may free `build` as soon as it sees this, so this must be the last access.
+    __atomic_store_n(&build->finished, true, __ATOMIC_RELEASE);
+}
+
+
+/// Keeps `pipeline_updateParticles_baked` in sync with the sim parameters, if `bake_sim_params_into_update`:
+/// starts a background build when they change, and swaps the result in once it's finished. In the meantime,
+/// the update reads the parameters from the uniform buffer.
+static void updateBakedUpdatePipeline(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool
+) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    BakedPipelineBuild* build = &res->baked_pipeline_build;
+
+    if (build->in_progress)
+    {
+        if (!__atomic_load_n(&build->finished, __ATOMIC_ACQUIRE)) return;
+
+        thread_pool::waitForTask(thread_pool, build->task_id);
+        build->in_progress = false;
+
+        if (res->pipeline_updateParticles_baked != VK_NULL_HANDLE)
+        {
+            // Submitted steps may still use the old pipeline. This only happens once per parameter change.
+            VkResult result = vk_ctx->procs_dev.QueueWaitIdle(vk_ctx->compute_queue);
+            assertVk(result);
+
+            vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticles_baked, NULL);
+            vk_ctx->procs_dev.DestroyPipelineLayout(
+                vk_ctx->device, res->pipeline_layout_updateParticles_baked, NULL
+            );
+        }
+        res->pipeline_updateParticles_baked = build->pipeline;
+        res->pipeline_layout_updateParticles_baked = build->pipeline_layout;
+        res->updateParticles_baked_params = build->params;
+        discardGpuResidentRecordings(res);
+    }
+
+    if (!s->parameters.bake_sim_params_into_update) return;
+    if (isBakedUpdatePipelineCurrent(s)) return;
+
+    build->vk_ctx = vk_ctx;
+    build->descriptor_set_layout = res->descriptor_set_layout_main;
+    build->workgroup_size = res->workgroup_size;
+    build->morton_code_word_count = res->morton_code_word_count;
+    build->open_addressing_cell_table = res->cell_slot_count > 0;
+    build->dense_cell_grid = res->dense_cell_grid;
+    build->hilbert_cell_order = res->hilbert_cell_order;
+    build->periodic_box = res->periodic_box;
+    build->particle_chunk_shift = res->particle_chunk_shift;
+    build->params = getBakedSimParams(&s->parameters);
+    build->p_spirv = res->updateParticles_reloaded_spirv;
+    build->spirv_byte_count = res->updateParticles_reloaded_spirv_byte_count;
+    build->pipeline = VK_NULL_HANDLE;
+    build->pipeline_layout = VK_NULL_HANDLE;
+    build->finished = false;
+    build->in_progress = true;
+    // no step waits for it, so it mustn't hold up the frame's tasks
+    build->task_id = thread_pool::enqueueBackgroundTask(thread_pool, buildBakedUpdatePipeline, build);
+}
+
+
+//
+// Compute shader hot reload ================================================================================
+//
+
+// The headers that the compute shaders include, from src/.
+const char* const COMPUTE_SHADER_INCLUDE_FILENAMES[COMPUTE_SHADER_INCLUDE_COUNT] {
+    "fluidSim_util.comp.h",
+    "fluidSim_bounds.comp.h",
+    "fluidSim_radixSort.comp.h",
+    "fluidSim_scan.comp.h",
+    "fluidSim_updateParticles.comp.h",
+    "fluidSim_userForces.comp.h",
+    "fluidSim_flip.comp.h",
+};
+
+const char* const USER_FORCES_INCLUDE_FILENAME = "fluidSim_userForces.comp.h";
+
+/// Resolves the `#include`s of a compute shader like the build's glslc does: relative to src/, where they all
+/// are; except for src/fluidSim_userForces.comp.h, in place of which it returns `p_user_data`, the
+/// `GpuResources::user_forces_src`, if that isn't NULL. On failure, the result has an empty name and the error as
+/// its content, as shaderc expects.
+static shaderc_include_result* resolveShaderInclude(
+    void* p_user_data,
+    const char* requested_source,
+    int include_type,
+    const char* requesting_source,
+    size_t include_depth
+) {
+    (void)include_type;
+    (void)requesting_source;
+    (void)include_depth;
+
+    shaderc_include_result* p_result = (shaderc_include_result*)calloc(1, sizeof(shaderc_include_result));
+    assertErrno(p_result != NULL);
+
+    constexpr size_t filepath_capacity = 256;
+    char* filepath = (char*)malloc(filepath_capacity);
+    assertErrno(filepath != NULL);
+    int char_count = snprintf(filepath, filepath_capacity, "src/%s", requested_source);
+    alwaysAssert(char_count > 0 and (size_t)char_count < filepath_capacity);
+
+    const char* user_forces_src = (const char*)p_user_data;
+    const bool is_user_forces = user_forces_src != NULL and strcmp(requested_source, USER_FORCES_INCLUDE_FILENAME) == 0;
+
+    size_t content_size = 0;
+    void* p_content = NULL;
+    if (is_user_forces)
+    {
+        content_size = strlen(user_forces_src);
+        p_content = malloc(content_size + 1);
+        assertErrno(p_content != NULL);
+        memcpy(p_content, user_forces_src, content_size + 1);
+    }
+    else p_content = file_util::readEntireFile(filepath, &content_size);
+    if (p_content == NULL)
+    {
+        free(filepath);
+        p_result->source_name = "";
+        p_result->content = "Failed to read the included file.";
+        p_result->content_length = strlen(p_result->content);
+        return p_result;
+    }
+
+    p_result->source_name = filepath;
+    p_result->source_name_length = (size_t)char_count;
+    p_result->content = (const char*)p_content;
+    p_result->content_length = content_size;
+    p_result->user_data = p_content; // NULL on failure
+    return p_result;
+}
+
+static void releaseShaderInclude(void* p_user_data, shaderc_include_result* p_result) {
+    (void)p_user_data;
+    if (p_result->user_data != NULL)
+    {
+        free(p_result->user_data);
+        free((void*)p_result->source_name);
+    }
+    free(p_result);
+}
+
+/// The reload of a pipeline, on the thread pool; see `reloadModifiedShaderSourceFiles()`. `p_arg` is the
+/// `ComputeShaderReload*`. On failure, leaves nothing behind.
+struct ComputeShaderReload {
+    // inputs
+    const VulkanContext* vk_ctx;
+    shaderc_compiler_t compiler;
+    const ComputePipelineInfo* info;
+    const ComputeShaderSpecializationConstants* specialization_constants;
+    const char* user_forces_src; // `GpuResources::user_forces_src`
+
+    // outputs, only if `success`
+    u32* p_spirv; // for `updateParticles_reloaded_spirv`; free it otherwise
+    size_t spirv_byte_count;
+    VkPipeline pipeline;
+    VkPipelineLayout pipeline_layout;
+    bool success;
+};
+static void reloadComputeShaderTask(void* p_arg) {
+
+    ZoneScoped;
+
+    ComputeShaderReload* p_reload = (ComputeShaderReload*)p_arg;
+    p_reload->success = false;
+
+    char src_filepath[256];
+    int char_count = snprintf(src_filepath, sizeof(src_filepath), "src/%s", p_reload->info->shader_filename);
+    alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(src_filepath));
+
+    size_t src_size = 0;
+    void* p_src = file_util::readEntireFile(src_filepath, &src_size);
+    if (p_src == NULL) return;
+    defer(free(p_src));
+
+    // as the build compiles them; see E_compileMainProgram_dependsOn_A.py
+    shaderc_compile_options_t options = libshaderc_procs_.compile_options_initialize();
+    alwaysAssert(options != NULL);
+    defer(libshaderc_procs_.compile_options_release(options));
+    libshaderc_procs_.compile_options_set_target_env(
+        options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3
+    );
+    libshaderc_procs_.compile_options_set_generate_debug_info(options);
+    libshaderc_procs_.compile_options_set_include_callbacks(
+        options, resolveShaderInclude, releaseShaderInclude, (void*)p_reload->user_forces_src
+    );
+
+    shaderc_compilation_result_t result = libshaderc_procs_.compile_into_spv(
+        p_reload->compiler,
+        (const char*)p_src,
+        src_size,
+        shaderc_glsl_compute_shader,
+        src_filepath,
+        "main",
+        options
+    );
+    alwaysAssert(result != NULL);
+    defer(libshaderc_procs_.result_release(result));
+
+    if (libshaderc_procs_.result_get_compilation_status(result) != shaderc_compilation_status_success)
+    {
+        const char* error_message = libshaderc_procs_.result_get_error_message(result);
+        if (error_message == NULL) error_message = "(NO ERROR MESSAGE PROVIDED)";
+        LOG_F(
+            ERROR, "Failed to compile shader `%s`. %zu errors: `%s`.",
+            src_filepath, libshaderc_procs_.result_get_num_errors(result), error_message
+        );
+        return;
+    }
+
+    const size_t spirv_byte_count = libshaderc_procs_.result_get_length(result);
+    u32* p_spirv = (u32*)malloc(spirv_byte_count);
+    assertErrno(p_spirv != NULL);
+    memcpy(p_spirv, libshaderc_procs_.result_get_bytes(result), spirv_byte_count);
+
+    createComputePipelineFromSpirv(
+        p_reload->vk_ctx,
+        p_spirv,
+        spirv_byte_count,
+        p_reload->specialization_constants,
+        p_reload->info->descriptor_set_layout,
+        p_reload->info->push_constants_size,
+        &p_reload->pipeline,
+        &p_reload->pipeline_layout
+    );
+
+    p_reload->p_spirv = p_spirv;
+    p_reload->spirv_byte_count = spirv_byte_count;
+    p_reload->success = true;
+}
+
+
+/// dlopen()s libshaderc once per version of the plugin, as a reloaded plugin starts without it.
+static bool loadLibshaderc(void) {
+    if (libshaderc_procs_.compile_into_spv != NULL) return true;
+    bool success = libshaderc_procs_.init();
+    LOG_IF_F(ERROR, !success, "Failed to load libshaderc; the fluid sim's compute shaders can't be reloaded.");
+    return success;
+}
+
+/// Watches the sources of the compute shaders, and the headers that they include, for
+/// `reloadModifiedShaderSourceFiles()`; they're only there when run from the repository. Returns false on failure
+/// to enable, and with the CPU backend, which has no shaders.
+extern "C" bool setShaderSourceFileModificationTracking(SimData* s, bool enable) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    if (s->cpu_backend) return !enable;
+    if (enable == (res->shader_watchlist != NULL)) return true;
+
+    if (!enable)
+    {
+        filewatch::destroyWatchlist(res->shader_watchlist);
+        res->shader_watchlist = NULL;
+        return true;
+    }
+
+    if (!loadLibshaderc()) return false;
+
+    filewatch::Watchlist watchlist = filewatch::createWatchlist();
+    if (watchlist == NULL) return false;
+
+    ComputePipelineInfo pipeline_infos[COMPUTE_PIPELINE_COUNT];
+    getComputePipelineInfos(res, pipeline_infos);
+
+    char filepath[256];
+    u32 watched_count = 0;
+    for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT + COMPUTE_SHADER_INCLUDE_COUNT; i++)
+    {
+        const bool is_include = i >= COMPUTE_PIPELINE_COUNT;
+        const char* filename = is_include
+            ? COMPUTE_SHADER_INCLUDE_FILENAMES[i - COMPUTE_PIPELINE_COUNT]
+            : pipeline_infos[i].shader_filename;
+        filewatch::FileID* p_id = is_include
+            ? &res->shader_include_watch_ids[i - COMPUTE_PIPELINE_COUNT]
+            : &res->shader_watch_ids[i];
+
+        int char_count = snprintf(filepath, sizeof(filepath), "src/%s", filename);
+        alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(filepath));
+
+        // addFileToModificationWatchlist() aborts on a missing file
+        *p_id = filewatch::INVALID_FILE_ID;
+        if (access(filepath, R_OK) != 0) continue;
+        *p_id = filewatch::addFileToModificationWatchlist(watchlist, filepath);
+        watched_count++;
+    }
+
+    if (watched_count == 0)
+    {
+        LOG_F(WARNING, "The fluid sim's compute shader sources aren't in `src/`; not watching them.");
+        filewatch::destroyWatchlist(watchlist);
+        return false;
+    }
+
+    res->shader_watchlist = watchlist;
+    return true;
+}
+
+/// Recompiles the compute shaders of the pipelines in `reload`, from source with libshaderc, and rebuilds only
+/// those pipelines, concurrently on `thread_pool`. The buffers, and so the particles, are kept. If any of them
+/// fails to compile, keeps all of the old pipelines, so that the step never mixes versions that may disagree on a
+/// layout. libshaderc must be loaded.
+static ShaderReloadResult reloadComputePipelines(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const bool reload[COMPUTE_PIPELINE_COUNT]
+) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+
+    const ComputeShaderSpecializationConstants specialization_constants = getSpecializationConstants(res);
+    ComputePipelineInfo pipeline_infos[COMPUTE_PIPELINE_COUNT];
+    getComputePipelineInfos(res, pipeline_infos);
+
+    shaderc_compiler_t compiler = libshaderc_procs_.compiler_initialize();
+    alwaysAssert(compiler != NULL);
+    defer(libshaderc_procs_.compiler_release(compiler));
+
+    ComputeShaderReload reloads[COMPUTE_PIPELINE_COUNT];
+    u32 reload_count = 0;
+    for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+    {
+        if (!reload[i] or pipeline_infos[i].unsupported) continue;
+        reloads[reload_count++] = ComputeShaderReload {
+            .vk_ctx = vk_ctx,
+            .compiler = compiler,
+            .info = &pipeline_infos[i],
+            .specialization_constants = &specialization_constants,
+            .user_forces_src = res->user_forces_src,
+        };
+    }
+
+    {
+        thread_pool::TaskGroup task_group {};
+        thread_pool::enqueueTasks(
+            thread_pool, &task_group, reload_count, reloadComputeShaderTask, reloads, sizeof(reloads[0])
+        );
+        thread_pool::waitForGroup(thread_pool, &task_group);
+    }
+
+    bool all_succeeded = true;
+    for (u32 i = 0; i < reload_count; i++) all_succeeded = all_succeeded and reloads[i].success;
+
+    if (!all_succeeded)
+    {
+        for (u32 i = 0; i < reload_count; i++)
+        {
+            if (!reloads[i].success) continue;
+            vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, reloads[i].pipeline, NULL);
+            vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, reloads[i].pipeline_layout, NULL);
+            free(reloads[i].p_spirv);
+        }
+        return ShaderReloadResult::error;
+    }
+
+    // Submitted steps may still use the old pipelines.
+    VkResult result = vk_ctx->procs_dev.QueueWaitIdle(vk_ctx->compute_queue);
+    assertVk(result);
+    discardGpuResidentRecordings(res);
+
+    for (u32 i = 0; i < reload_count; i++)
+    {
+        const ComputePipelineInfo* info = reloads[i].info;
+        vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, *info->p_pipeline, NULL);
+        vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, *info->p_pipeline_layout, NULL);
+        *info->p_pipeline = reloads[i].pipeline;
+        *info->p_pipeline_layout = reloads[i].pipeline_layout;
+
+        if (info->p_pipeline != &res->pipeline_updateParticles)
+        {
+            free(reloads[i].p_spirv);
+            continue;
+        }
+
+        // The baked variant is rebuilt from the new SPIR-V, by the next `updateBakedUpdatePipeline()`; a build of
+        // the old one that's still running is waited for, as it reads the old SPIR-V, and discarded.
+        BakedPipelineBuild* build = &res->baked_pipeline_build;
+        if (build->in_progress)
+        {
+            thread_pool::waitForTask(thread_pool, build->task_id);
+            build->in_progress = false;
+            vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, build->pipeline, NULL);
+            vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, build->pipeline_layout, NULL);
+        }
+        vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticles_baked, NULL);
+        vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticles_baked, NULL);
+        res->pipeline_updateParticles_baked = VK_NULL_HANDLE;
+        res->pipeline_layout_updateParticles_baked = VK_NULL_HANDLE;
+
+        free(res->updateParticles_reloaded_spirv);
+        res->updateParticles_reloaded_spirv = reloads[i].p_spirv;
+        res->updateParticles_reloaded_spirv_byte_count = reloads[i].spirv_byte_count;
+    }
+
+    LOG_F(INFO, "Reloaded %" PRIu32 " fluid sim shaders.", reload_count);
+    return ShaderReloadResult::success;
+}
+
+/// Recompiles the compute shaders whose sources, or included headers, have changed since the last call; see
+/// `reloadComputePipelines()`. Shader source tracking must be enabled.
+extern "C" ShaderReloadResult reloadModifiedShaderSourceFiles(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool
+) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    if (res->shader_watchlist == NULL) return ShaderReloadResult::no_shaders_need_reloading;
+
+    u32 event_count = 0;
+    const filewatch::FileID* p_events = NULL;
+    filewatch::poll(res->shader_watchlist, &event_count, &p_events);
+    if (event_count == 0) return ShaderReloadResult::no_shaders_need_reloading;
+
+    bool modified[COMPUTE_PIPELINE_COUNT] {};
+    bool any_modified = false;
+    for (u32 event_idx = 0; event_idx < event_count; event_idx++)
+    {
+        for (u32 i = 0; i < COMPUTE_SHADER_INCLUDE_COUNT; i++)
+        {
+            if (res->shader_include_watch_ids[i] != p_events[event_idx]) continue;
+            for (u32 j = 0; j < COMPUTE_PIPELINE_COUNT; j++) modified[j] = true;
+            any_modified = true;
+        }
+        for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+        {
+            if (res->shader_watch_ids[i] != p_events[event_idx]) continue;
+            modified[i] = true;
+            any_modified = true;
+        }
+    }
+    if (!any_modified) return ShaderReloadResult::no_shaders_need_reloading;
+    if (!loadLibshaderc()) return ShaderReloadResult::error;
+
+    ComputePipelineInfo pipeline_infos[COMPUTE_PIPELINE_COUNT];
+    getComputePipelineInfos(res, pipeline_infos);
+    for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+    {
+        if (!modified[i] or pipeline_infos[i].unsupported) continue;
+        LOG_F(INFO, "Fluid sim shader `%s` changed. Will reload.", pipeline_infos[i].shader_filename);
+    }
+
+    return reloadComputePipelines(s, vk_ctx, thread_pool, modified);
+}
+
+/// What `setForceKernels()` compiles in place of src/fluidSim_userForces.comp.h; NULL if it has no snippets. The
+/// caller frees it.
+static char* generateUserForcesSource(const ForceKernels* kernels) {
+
+    struct Hook {
+        const char* snippet;
+        const char* declaration;
+    };
+    const Hook hooks[] {
+        {
+            kernels->pair_acceleration,
+            "#define USER_PAIR_ACCELERATION\n"
+            "vec3 userPairAcceleration(const uint particle_idx, const uint other_idx, const vec3 disp, "
+            "const float dist_sq) {\n",
+        },
+        {
+            kernels->body_acceleration,
+            "#define USER_BODY_ACCELERATION\n"
+            "vec3 userBodyAcceleration(const uint particle_idx, const vec3 pos, const vec3 velocity) {\n",
+        },
+        {
+            kernels->post_integrate,
+            "#define USER_POST_INTEGRATE\n"
+            "void userPostIntegrate(const uint particle_idx, inout vec3 pos, inout vec3 velocity) {\n",
+        },
+    };
+    constexpr u32 hook_count = sizeof(hooks) / sizeof(hooks[0]);
+
+    size_t src_size = 1;
+    for (u32 i = 0; i < hook_count; i++)
+    {
+        if (hooks[i].snippet != NULL) src_size += strlen(hooks[i].declaration) + strlen(hooks[i].snippet) + 16;
+    }
+    if (src_size == 1) return NULL;
+
+    char* src = (char*)malloc(src_size);
+    assertErrno(src != NULL);
+    size_t length = 0;
+    for (u32 i = 0; i < hook_count; i++)
+    {
+        if (hooks[i].snippet == NULL) continue;
+        // the line directive makes the compile errors' line numbers relative to the snippet
+        int char_count = snprintf(
+            &src[length], src_size - length, "%s#line 1\n%s\n}\n", hooks[i].declaration, hooks[i].snippet
+        );
+        alwaysAssert(char_count > 0 and (size_t)char_count < src_size - length);
+        length += (size_t)char_count;
+    }
+    return src;
+}
+
+/// Splices `kernels` into the update kernels (see `ForceKernels`), by recompiling the compute shaders from source
+/// with libshaderc, like `reloadModifiedShaderSourceFiles()` does, so the sources must be in src/; the later
+/// reloads keep them. All NULL goes back to none. The snippets then cost no pass, nor memory traffic, of their
+/// own. Returns false, and keeps the current ones, if they fail to compile, with the errors logged; and with the
+/// CPU backend.
+extern "C" bool setForceKernels(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const ForceKernels* kernels
+) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    if (s->cpu_backend)
+    {
+        LOG_F(ERROR, "The fluid sim's CPU backend has no force kernels.");
+        return false;
+    }
+    if (!loadLibshaderc()) return false;
+
+    char* prev_src = res->user_forces_src;
+    res->user_forces_src = generateUserForcesSource(kernels);
+
+    // every pipeline that includes the header, like a reload after a change to it
+    bool reload[COMPUTE_PIPELINE_COUNT];
+    for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++) reload[i] = true;
+
+    if (reloadComputePipelines(s, vk_ctx, thread_pool, reload) != ShaderReloadResult::success)
+    {
+        LOG_F(ERROR, "Failed to compile the fluid sim's force kernels; keeping the current ones.");
+        free(res->user_forces_src);
+        res->user_forces_src = prev_src;
+        return false;
+    }
+
+    free(prev_src);
+    res->user_pair_acceleration = kernels->pair_acceleration != NULL;
+    return true;
+}
+
+
+static f32 getParticleInteractionRadius(const SimParameters* params) {
+
+    // Number of particles contained in sphere at rest ~= sphere volume * rest particle density.
+    // :: N = (4/3 pi r^3) rho
+    // :: r = cuberoot(N * 3 / (4 pi rho)).
+    return cbrtf(
+        (f32)params->rest_particle_interaction_count_approx * 3.f / (4.f * PI * params->rest_particle_density)
+    );
+}
+
+
+static PeriodicBox getPeriodicBox(const SimParameters* params) {
+
+    PeriodicBox box { .axes = 0, .min = params->periodic_box_min, .size = vec3(0.0f) };
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        if (!(params->periodic_box_size[(int)axis] > 0.0f)) continue;
+        box.axes |= 1u << axis;
+        box.size[(int)axis] = params->periodic_box_size[(int)axis];
+    }
+    return box;
+}
+
+
+/// Makes the plugin's zones record to `tracer` too, or to nothing if NULL; see trace.hpp. The plugin has its
+/// own copy of the tracer's state, which the program's `trace::setTracer()` doesn't reach.
+extern "C" void setTracer(trace::Tracer* tracer) {
+    trace::setTracer(tracer);
+}
+
+
+extern "C" void setParams(SimData* s, const SimParameters* params) {
+    s->parameters.rest_particle_density = params->rest_particle_density;
+    s->parameters.spring_stiffness = params->spring_stiffness;
+    s->parameters.sph = params->sph;
+    s->parameters.sph_stiffness = params->sph_stiffness;
+    s->parameters.sph_viscosity = params->sph_viscosity;
+    alwaysAssert(params->pbf_iteration_count > 0);
+    alwaysAssert(params->pbf_relaxation >= 0.0f);
+    s->parameters.pbf = params->pbf;
+    s->parameters.pbf_iteration_count = params->pbf_iteration_count;
+    alwaysAssert(params->flip_ratio >= 0.0f and params->flip_ratio <= 1.0f);
+    alwaysAssert(params->flip_pressure_iteration_count > 0);
+    s->parameters.flip = params->flip;
+    s->parameters.flip_ratio = params->flip_ratio;
+    s->parameters.flip_pressure_iteration_count = params->flip_pressure_iteration_count;
+    alwaysAssert(params->adaptive_max_level <= MAX_PARTICLE_LEVEL);
+    alwaysAssert(params->adaptive_surface_fraction <= params->adaptive_interior_fraction);
+    s->parameters.adaptive_resolution_interval = params->adaptive_resolution_interval;
+    s->parameters.adaptive_max_level = params->adaptive_max_level;
+    s->parameters.adaptive_interior_mass =
+        params->adaptive_interior_fraction * params->rest_particle_interaction_count_approx;
+    s->parameters.adaptive_surface_mass =
+        params->adaptive_surface_fraction * params->rest_particle_interaction_count_approx;
+    s->parameters.gpu_resident = params->gpu_resident;
+    // the fused Morton codes would skip the sleeping particles, which the update doesn't write
+    s->parameters.fuse_morton_codes_into_update = params->fuse_morton_codes_into_update and !params->sleeping;
+    s->parameters.tiled_particle_update = params->tiled_particle_update;
+    s->parameters.subgroup_particle_update = params->subgroup_particle_update;
+    s->parameters.persistent_update_workgroup_count = params->persistent_update_workgroup_count;
+    s->parameters.cluster_pair_forces = params->cluster_pair_forces;
+    s->parameters.quantized_neighbor_positions = params->quantized_neighbor_positions;
+    s->parameters.morton_range_traversal = params->morton_range_traversal;
+    alwaysAssert(params->cell_level_count >= 1 and params->cell_level_count <= MAX_CELL_LEVEL_COUNT);
+    s->parameters.cell_level_count = params->cell_level_count;
+    s->parameters.sparse_cell_particle_count = params->sparse_cell_particle_count;
+    s->parameters.bake_sim_params_into_update = params->bake_sim_params_into_update;
+    s->parameters.hash_table_max_load_factor = params->hash_table_max_load_factor;
+    s->parameters.hash_table_resize_interval = params->hash_table_resize_interval;
+
+    s->parameters.particle_interaction_radius = getParticleInteractionRadius(params);
+
+    // TODO FIXME didn't really think about a good way to compute this
+    s->parameters.spring_rest_length = s->parameters.particle_interaction_radius * 0.5f;
+
+    // The SPH kernels of Mueller et al., "Particle-Based Fluid Simulation for Interactive Applications": poly6 for
+    // the density, (315 / (64 pi h^9)) (h^2 - r^2)^3, and the gradient of spiky for the pressure,
+    // -(45 / (pi h^6)) (h - r)^2 r / |r|; both normalized, so the density is in particles per m^3.
+    {
+        const f32 h = s->parameters.particle_interaction_radius;
+        const f32 h3 = h * h * h;
+        s->parameters.sph_density_kernel_coefficient = 315.0f / (64.0f * PI * h3 * h3 * h3);
+        s->parameters.sph_gradient_kernel_coefficient = 45.0f / (PI * h3 * h3);
+
+        // At the rest density, the squared PBF constraint gradients of a particle's neighbors sum to about the
+        // integral of the squared spiky gradient over the kernel, over the rest density: 8100 / (105 pi h^5 rho_0).
+        const f32 rest_gradient_sq_sum = 8100.0f / (105.0f * PI * h3 * h * h * params->rest_particle_density);
+        s->parameters.pbf_relaxation_epsilon = params->pbf_relaxation * rest_gradient_sq_sum;
+    }
+
+    alwaysAssert(params->verlet_skin >= 0.0f);
+    // The FLIP grid's cells are the spatial structure's, and its transfer gathers the particles at their current
+    // positions from the 27 cells around each.
+    const bool flip = params->flip and params->flip_grid_resolution > 0;
+    s->parameters.verlet_skin_distance = flip ? 0.0f : s->parameters.particle_interaction_radius * params->verlet_skin;
+
+    alwaysAssert(params->cfl_number > 0.0f and params->cfl_number <= 1.0f);
+    alwaysAssert(params->max_substep_count > 0);
+    s->parameters.adaptive_time_step = params->adaptive_time_step;
+    s->parameters.cfl_number = params->cfl_number;
+    s->parameters.max_substep_count = params->max_substep_count;
+    // no stale readings while they're off
+    if (!params->diagnostics) s->diagnostics = SimData::Diagnostics {};
+    s->parameters.diagnostics = params->diagnostics;
+
+    alwaysAssert(params->sleep_speed >= 0.0f and params->sleep_acceleration >= 0.0f);
+    alwaysAssert(params->sleep_step_count > 0);
+    // the calm steps aren't tracked while the mode is off
+    if (params->sleeping and !s->parameters.sleeping) s->calm_steps_outdated = true;
+    s->parameters.sleeping = params->sleeping;
+    s->parameters.sleep_speed = params->sleep_speed;
+    s->parameters.sleep_acceleration = params->sleep_acceleration;
+    s->parameters.sleep_step_count = params->sleep_step_count;
+
+    // Particles move at most half the skin between rebuilds, so pairs that are within the interaction radius
+    // now were within `radius + skin` of each other at the last rebuild.
+    const f32 cell_size = s->parameters.particle_interaction_radius + s->parameters.verlet_skin_distance;
+    s->parameters.cell_size = cell_size;
+    s->parameters.cell_size_reciprocal = 1.0f / cell_size;
+
+    // With fewer cells, the cells on either side of a particle's are the same one, and its pairs count twice.
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        const f32 box_size = params->periodic_box_size[(int)axis];
+        LOG_IF_F(
+            WARNING, box_size > 0.0f and box_size < 3.0f * cell_size,
+            "The periodic box is %.2f cells across along axis %" PRIu32 ", fewer than the 3 it needs.",
+            box_size / cell_size, axis
+        );
+    }
+
+    s->spatial_structure_outdated = true;
+    s->uniforms_dirty = true;
+
+    LOG_F(INFO, "Set fluid sim parameters: "
+        "REST_PARTICLE_DENSITY = %f, "
+        "SPRING_STIFFNESS = %f, "
+        "SPRING_REST_LENGTH = %f, "
+        "SPH = %i, "
+        "SPH_STIFFNESS = %f, "
+        "SPH_VISCOSITY = %f, "
+        "PBF = %i, "
+        "PBF_ITERATION_COUNT = %u, "
+        "PBF_RELAXATION_EPSILON = %f, "
+        "FLIP = %i, "
+        "FLIP_RATIO = %f, "
+        "FLIP_PRESSURE_ITERATION_COUNT = %u, "
+        "PARTICLE_INTERACTION_RADIUS = %f, "
+        "CELL_SIZE = %f, "
+        "VERLET_SKIN_DISTANCE = %f, "
+        "ADAPTIVE_TIME_STEP = %i, "
+        "CFL_NUMBER = %f, "
+        "MAX_SUBSTEP_COUNT = %u, "
+        "DIAGNOSTICS = %i, "
+        "SLEEPING = %i, "
+        "SLEEP_SPEED = %f, "
+        "SLEEP_ACCELERATION = %f, "
+        "SLEEP_STEP_COUNT = %u, "
+        "GPU_RESIDENT = %i, "
+        "FUSE_MORTON_CODES_INTO_UPDATE = %i, "
+        "TILED_PARTICLE_UPDATE = %i, "
+        "SUBGROUP_PARTICLE_UPDATE = %i, "
+        "PERSISTENT_UPDATE_WORKGROUP_COUNT = %u, "
+        "CLUSTER_PAIR_FORCES = %i, "
+        "QUANTIZED_NEIGHBOR_POSITIONS = %i, "
+        "MORTON_RANGE_TRAVERSAL = %i, "
+        "CELL_LEVEL_COUNT = %u, "
+        "SPARSE_CELL_PARTICLE_COUNT = %u, "
+        "BAKE_SIM_PARAMS_INTO_UPDATE = %i.",
+        s->parameters.rest_particle_density,
+        s->parameters.spring_stiffness,
+        s->parameters.spring_rest_length,
+        (int)s->parameters.sph,
+        s->parameters.sph_stiffness,
+        s->parameters.sph_viscosity,
+        (int)s->parameters.pbf,
+        s->parameters.pbf_iteration_count,
+        s->parameters.pbf_relaxation_epsilon,
+        (int)s->parameters.flip,
+        s->parameters.flip_ratio,
+        s->parameters.flip_pressure_iteration_count,
+        s->parameters.particle_interaction_radius,
+        s->parameters.cell_size,
+        s->parameters.verlet_skin_distance,
+        (int)s->parameters.adaptive_time_step,
+        s->parameters.cfl_number,
+        s->parameters.max_substep_count,
+        (int)s->parameters.diagnostics,
+        (int)s->parameters.sleeping,
+        s->parameters.sleep_speed,
+        s->parameters.sleep_acceleration,
+        s->parameters.sleep_step_count,
+        (int)s->parameters.gpu_resident,
+        (int)s->parameters.fuse_morton_codes_into_update,
+        (int)s->parameters.tiled_particle_update,
+        (int)s->parameters.subgroup_particle_update,
+        s->parameters.persistent_update_workgroup_count,
+        (int)s->parameters.cluster_pair_forces,
+        (int)s->parameters.quantized_neighbor_positions,
+        (int)s->parameters.morton_range_traversal,
+        s->parameters.cell_level_count,
+        s->parameters.sparse_cell_particle_count,
+        (int)s->parameters.bake_sim_params_into_update
+    );
+}
+
+
+/// The number of hash table buckets (and open-addressing cell table slots): the smallest power of two that
+/// keeps the table at most `max_load_factor` full, because there are at most as many cells as particles.
+static u32 getHashTableSize(u32fast particle_count, f32 max_load_factor) {
+
+    alwaysAssert(max_load_factor > 0.0f and max_load_factor <= 1.0f);
+
+    const f64 min_size = ceil((f64)particle_count / (f64)max_load_factor);
+    alwaysAssert(min_size <= (f64)(1u << 31));
+
+    u32 size = 2; // `mortonCodeHash` needs at least 1 bit
+    while ((f64)size < min_size) size *= 2;
+    return size;
+}
+
+
+// `GpuResources::collider_slots` are `ivec4(brick coordinate, brick index)`, resolved by linear probing; empty slots
+// have this as the brick index. Must match COLLIDER_SLOT_EMPTY in `fluidSim_updateParticles.comp.h`.
+constexpr i32 COLLIDER_SLOT_EMPTY = -1;
+
+/// At most half full, so that the probe sequences stay short.
+static u32 getColliderSlotCount(u32 brick_capacity) {
+
+    alwaysAssert(brick_capacity <= (1u << 29));
+
+    u32 count = 2;
+    while (count <= 2 * brick_capacity) count *= 2;
+    return count;
+}
+
+
+/// Same as `colliderBrickHash()` in `fluidSim_updateParticles.comp.h`.
+static u32 colliderBrickHash(ivec3 coord) {
+    return ((u32)coord.x * 73856093u) ^ ((u32)coord.y * 19349663u) ^ ((u32)coord.z * 83492791u);
+}
+
+
+/// The index of the brick's slot, which is empty if the brick isn't in the table.
+static u32 findColliderSlot(const GpuResources* res, ivec3 coord) {
+
+    const u32 mask = res->collider_slot_count - 1;
+    u32 slot_idx = colliderBrickHash(coord) & mask;
+    while (true)
+    {
+        const ivec4 slot = res->collider_slots[slot_idx];
+        if (slot.w == COLLIDER_SLOT_EMPTY or ivec3(slot) == coord) return slot_idx;
+        slot_idx = (slot_idx + 1) & mask;
+    }
+}
+
+
+/// Empties the slot, and moves the slots after it back into the gap where their probe sequences allow, so that no
+/// probe sequence is broken.
+static void removeColliderSlot(GpuResources* res, u32 slot_idx) {
+
+    const u32 mask = res->collider_slot_count - 1;
+    ivec4* p_slots = res->collider_slots;
+
+    u32 gap_idx = slot_idx;
+    u32 idx = slot_idx;
+    while (true)
+    {
+        idx = (idx + 1) & mask;
+        const ivec4 slot = p_slots[idx];
+        if (slot.w == COLLIDER_SLOT_EMPTY) break;
+
+        // it stays if its home is cyclically in (gap_idx, idx]
+        const u32 home_idx = colliderBrickHash(ivec3(slot)) & mask;
+        const bool stays =
+            (gap_idx <= idx) ? (gap_idx < home_idx and home_idx <= idx) : (gap_idx < home_idx or home_idx <= idx);
+        if (stays) continue;
+
+        p_slots[gap_idx] = slot;
+        gap_idx = idx;
+    }
+    p_slots[gap_idx] = ivec4(0, 0, 0, COLLIDER_SLOT_EMPTY);
+}
+
+
+/// The command pools and buffers, the timeline semaphore and the fence.
+static void createCommandBuffersAndSyncObjects(GpuResources* res, const VulkanContext* vk_ctx) {
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    {
+        VkCommandPoolCreateInfo pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = vk_ctx->compute_queue_family_index
+        };
+        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &pool_info, NULL, &res->command_pool);
+        assertVk(result);
+    }
+    {
+        constexpr u32 command_buffer_count = 4 + GPU_RESIDENT_FRAMES_IN_FLIGHT;
+        VkCommandBuffer command_buffers[command_buffer_count] {};
+
+        VkCommandBufferAllocateInfo alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = res->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = command_buffer_count,
+        };
+        result = vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &alloc_info, command_buffers);
+        assertVk(result);
+
+        res->general_purpose_command_buffer = command_buffers[0];
+        res->morton_code_command_buffer = command_buffers[1];
+        res->spatial_query_command_buffer = command_buffers[2];
+        res->state_export_command_buffer = command_buffers[3];
+        for (u32 i = 0; i < GPU_RESIDENT_FRAMES_IN_FLIGHT; i++)
+        {
+            res->gpu_resident_command_buffers[i] = command_buffers[4 + i];
+        }
+    }
+    {
+        const VkCommandPoolCreateInfo pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = vk_ctx->transfer_queue_family_index,
+        };
+        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &pool_info, NULL, &res->transfer_command_pool);
+        assertVk(result);
+
+        const VkCommandBufferAllocateInfo alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = res->transfer_command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result = vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &alloc_info, &res->transfer_command_buffer);
+        assertVk(result);
+    }
+
+    {
+        const VkSemaphoreTypeCreateInfo semaphore_type_info {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        const VkSemaphoreCreateInfo semaphore_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphore_type_info,
+        };
+        result = vk_ctx->procs_dev.CreateSemaphore(
+            vk_ctx->device, &semaphore_info, NULL, &res->timeline_semaphore
+        );
+        assertVk(result);
+        res->timeline_value = 0;
+
+        const VkFenceCreateInfo fence_info { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        result = vk_ctx->procs_dev.CreateFence(vk_ctx->device, &fence_info, NULL, &res->fence);
+        assertVk(result);
+    }
+}
+
+
+/// `SimParameters::stage_timestamps`. Leaves `GpuResources::stage_query_pool` VK_NULL_HANDLE if the device
+/// can't write timestamps on the compute queue.
+static void createStageQueryPool(GpuResources* res, const VulkanContext* vk_ctx) {
+
+    res->stage_query_last_slot = STAGE_TIMESTAMP_SLOT_NONE;
+
+    if (!vk_ctx->physical_device_properties.limits.timestampComputeAndGraphics)
+    {
+        LOG_F(WARNING, "Can't time the sim stages, because the device doesn't support timestamps.");
+        return;
+    }
+
+    const VkQueryPoolCreateInfo query_pool_info {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = STAGE_TIMESTAMP_SLOT_COUNT * STAGE_TIMESTAMP_QUERIES_PER_SLOT,
+    };
+    VkResult result = vk_ctx->procs_dev.CreateQueryPool(
+        vk_ctx->device, &query_pool_info, NULL, &res->stage_query_pool
+    );
+    assertVk(result);
+}
+
+/// Whether the device can run fluidSim_updateParticlesSubgroup.comp. The kernel's cell block only pays off with
+/// at least 8 invocations per subgroup.
+static bool deviceSupportsSubgroupParticleUpdate(const VulkanContext* vk_ctx) {
+
+    const VkPhysicalDeviceSubgroupProperties* subgroup_props = &vk_ctx->physical_device_subgroup_properties;
+    const VkSubgroupFeatureFlags required_operations =
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_BIT;
+
+    return (subgroup_props->supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+        and (subgroup_props->supportedOperations & required_operations) == required_operations
+        and subgroup_props->subgroupSize >= 8;
+}
+
+
+/// `preferred_workgroup_size` is used unless it doesn't fit the device limits. The buffers, and the workgroup
+/// and tile counts, are sized for `particle_capacity` particles; `setParticleCount()` lowers the counts.
+static GpuResources createGpuResources(
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_capacity,
+    u32fast hash_table_size,
+    bool morton_codes_64_bit,
+    bool hilbert_cell_order,
+    PeriodicBox periodic_box,
+    bool half_velocities,
+    bool particle_ids,
+    bool particle_levels,
+    u32 neighbor_list_capacity,
+    bool open_addressing_cell_table,
+    bool dense_cell_grid,
+    u32 flip_grid_resolution, // 0 for no FLIP grid
+    u32 collider_brick_capacity,
+    f32 collider_cell_size,
+    u32 ensemble_member_count, // 0 unless the sim is an ensemble
+    u32 spatial_query_capacity,
+    u32 spatial_query_hit_capacity,
+    u32 region_readback_capacity,
+    u32 volume_export_brick_capacity,
+    u32 preferred_workgroup_size
+) {
+
+    ZoneScoped;
+
+    GpuResources resources {};
+
+    {
+        const u32 morton_code_bit_count =
+            morton_codes_64_bit ? MORTON_CODE_BIT_COUNT_WIDE : MORTON_CODE_BIT_COUNT_NARROW;
+        resources.morton_code_word_count = morton_codes_64_bit ? 2 : 1;
+        resources.hilbert_cell_order = hilbert_cell_order;
+        resources.periodic_box = periodic_box;
+        resources.radix_sort_pass_count = divCeil(morton_code_bit_count, RADIX_SORT_BITS_PER_PASS);
+
+        // The passes ping-pong between two pairs of buffers, and the result must end up in the primary pair.
+        alwaysAssert(resources.radix_sort_pass_count % 2 == 0);
+    }
+
+    resources.half_velocities = half_velocities;
+    resources.particle_ids = particle_ids;
+    resources.particle_levels = particle_levels;
+    resources.neighbor_list_capacity = neighbor_list_capacity;
+    resources.particle_chunk_shift = getParticleChunkShift(
+        particle_capacity, neighbor_list_capacity, vk_ctx->physical_device_properties.limits.maxStorageBufferRange
+    );
+    resources.ensemble_member_count = ensemble_member_count;
+
+    // The linear probing only terminates if some slot is always empty.
+    if (open_addressing_cell_table)
+    {
+        alwaysAssert(hash_table_size > particle_capacity);
+        resources.cell_slot_count = (u32)hash_table_size;
+        resources.dense_cell_grid = dense_cell_grid;
+    }
+
+    // The multigrid halves the grid down to 4 cells per axis.
+    if (flip_grid_resolution > 0)
+    {
+        alwaysAssert(flip_grid_resolution >= 8);
+        alwaysAssert((flip_grid_resolution & (flip_grid_resolution - 1)) == 0);
+    }
+    resources.flip_grid_resolution = flip_grid_resolution;
+
+    if (collider_brick_capacity > 0)
+    {
+        alwaysAssert(collider_cell_size > 0.0f);
+        resources.collider_brick_capacity = collider_brick_capacity;
+        resources.collider_cell_size = collider_cell_size;
+        resources.collider_slot_count = getColliderSlotCount(collider_brick_capacity);
+
+        resources.collider_slots = mallocArray(resources.collider_slot_count, ivec4);
+        for (u32 i = 0; i < resources.collider_slot_count; i++)
+        {
+            resources.collider_slots[i] = ivec4(0, 0, 0, COLLIDER_SLOT_EMPTY);
+        }
+        // popped from the end, so that the bricks fill the buffer from the start
+        resources.collider_free_bricks = mallocArray(collider_brick_capacity, u32);
+        for (u32 i = 0; i < collider_brick_capacity; i++)
+        {
+            resources.collider_free_bricks[i] = collider_brick_capacity - 1 - i;
+        }
+    }
+
+    if (spatial_query_capacity > 0)
+    {
+        resources.spatial_query_capacity = spatial_query_capacity;
+        resources.spatial_query_hit_capacity = spatial_query_hit_capacity;
+        resources.spatial_queries = mallocArray(spatial_query_capacity, SpatialQuery);
+    }
+    resources.region_readback_capacity = region_readback_capacity;
+    resources.volume_export_brick_capacity = volume_export_brick_capacity;
+
+
+    u32 workgroup_size = 0;
+    u32 workgroup_count = 0;
+    {
+        const u32 max_workgroup_size = vk_ctx->physical_device_properties.limits.maxComputeWorkGroupSize[0];
+        const u32 max_workgroup_count = vk_ctx->physical_device_properties.limits.maxComputeWorkGroupCount[0];
+
+        workgroup_size = glm::min(preferred_workgroup_size, max_workgroup_size);
+
+        workgroup_count = divCeil((u32)particle_capacity, workgroup_size);
+        if (workgroup_count > max_workgroup_count)
+        {
+            workgroup_count = max_workgroup_count;
+            workgroup_size = divCeil((u32)particle_capacity, workgroup_count);
+        }
+
+        alwaysAssert(workgroup_size > 0);
+        alwaysAssert(workgroup_count > 0);
+        alwaysAssert(workgroup_size <= max_workgroup_size);
+        alwaysAssert(workgroup_count <= max_workgroup_count);
+
+        assert(workgroup_size * workgroup_count >= particle_capacity);
+
+        resources.workgroup_size = workgroup_size;
+        resources.workgroup_count = workgroup_count;
+
+        const u32 radix_sort_tile_count =
+            divCeil((u32)particle_capacity, workgroup_size * RADIX_SORT_ITEMS_PER_INVOCATION);
+        alwaysAssert(radix_sort_tile_count <= max_workgroup_count);
+        resources.radix_sort_tile_count = radix_sort_tile_count;
+
+        // the largest scan is over the hash table
+        alwaysAssert(divCeil((u32)hash_table_size, workgroup_size) <= max_workgroup_count);
+
+        const u32 flip_cell_count = flip_grid_resolution * flip_grid_resolution * flip_grid_resolution;
+        alwaysAssert(divCeil(flip_cell_count, workgroup_size) <= max_workgroup_count);
+    }
+
+    // the bounds reduction uses subgroup arithmetic
+    {
+        const VkPhysicalDeviceSubgroupProperties* subgroup_props = &vk_ctx->physical_device_subgroup_properties;
+        alwaysAssert(subgroup_props->supportedStages & VK_SHADER_STAGE_COMPUTE_BIT);
+        alwaysAssert(subgroup_props->supportedOperations & VK_SUBGROUP_FEATURE_BASIC_BIT);
+        alwaysAssert(subgroup_props->supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+    }
+    resources.subgroup_particle_update_supported = deviceSupportsSubgroupParticleUpdate(vk_ctx);
+    if (!resources.subgroup_particle_update_supported)
+    {
+        LOG_F(INFO, "The device's subgroups can't run the subgroup particle update; it is unavailable.");
+    }
+
+
+    createCommandBuffersAndSyncObjects(&resources, vk_ctx);
+    createBuffers(&resources, vk_ctx, particle_capacity, hash_table_size);
+    createDescriptorStuff(&resources, vk_ctx);
+    createComputePipelines(&resources, vk_ctx, thread_pool);
+
+    // Unlike the sim's own scans, it isn't bounded by the square of the workgroup size, nor hot-reloaded.
+    if (region_readback_capacity > 0)
+    {
+        const gpu_primitives::BufferRange offsets {
+            resources.buffer_radix_sort_values_scratch.buffer, 0, VK_WHOLE_SIZE
+        };
+        resources.gpu_primitives = gpu_primitives::createContext(vk_ctx);
+        resources.region_offsets_scan = gpu_primitives::createScan(
+            resources.gpu_primitives, vk_ctx, offsets, offsets, (u32)particle_capacity
+        );
+    }
+
+    return resources;
+}
+
+
+/// Sets the number of live particles, and the dispatch sizes that depend on it.
+static void setParticleCount(SimData* s, const u32fast particle_count) {
+
+    // the bounds reduction and the sort don't handle an empty array
+    alwaysAssert(particle_count > 0);
+    alwaysAssert(particle_count <= s->particle_capacity);
+
+    GpuResources* res = &s->gpu_resources;
+
+    s->particle_count = particle_count;
+    res->workgroup_count = divCeil((u32)particle_count, res->workgroup_size);
+    res->radix_sort_tile_count =
+        divCeil((u32)particle_count, res->workgroup_size * RADIX_SORT_ITEMS_PER_INVOCATION);
+
+    s->uniforms_dirty = true;
+}
+
+
+/// Unmaps and removes the shared memory of `startStateExport()`, if any. A pending copy must have finished.
+static void destroyStateExport(GpuResources* res, const VulkanContext* vk_ctx) {
+
+    if (res->state_export == NULL) return;
+
+    munmap(res->state_export, res->state_export_size);
+    // the readers that still have it mapped keep it until they unmap it
+    shm_unlink(res->state_export_name);
+    free(res->state_export_name);
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_state_export_staging.buffer, res->buffer_state_export_staging.allocation
+    );
+
+    res->state_export = NULL;
+    res->state_export_size = 0;
+    res->state_export_name = NULL;
+    res->state_export_timeline_value = 0;
+    res->buffer_state_export_staging = GpuBuffer {};
+}
+
+
+// A file's bricks are written by this many `thread_pool` tasks, each `pwrite`ing its own range of them.
+constexpr u32 VOLUME_EXPORT_WRITE_TASK_COUNT = 8;
+
+struct VolumeWriteTask {
+    int fd;
+    const void* p_data; // in the slot's mapped memory
+    u64 size;
+    u64 file_offset;
+    bool failed;
+};
+
+// A slot of `GpuResources::buffer_volume_export`: free, waiting for the GPU to fill it, or being written to a file.
+struct VolumeExportSlot {
+    VkCommandBuffer command_buffer;
+    u64 timeline_value; // of the GPU's pass, while it's pending; 0 otherwise
+    u64 state_number; // of the file, from 1
+    int fd; // of the file, while its bricks are written; -1 otherwise
+    u64 file_size;
+    thread_pool::TaskGroup write_group;
+    VolumeWriteTask write_tasks[VOLUME_EXPORT_WRITE_TASK_COUNT];
+};
+
+struct VolumeExport {
+    char* path_prefix;
+    thread_pool::ThreadPool* thread_pool;
+    VolumeExportSlot slots[VOLUME_EXPORT_SLOT_COUNT];
+    u64 state_count; // submitted so far
+    VolumeExportStats stats;
+};
+
+
+/// A `thread_pool` task that writes a range of a slot's bricks to its file; see `exportVolume()`. `p_arg` is the
+/// `VolumeWriteTask`.
+static void writeVolumeBricksTask(void* p_arg) {
+
+    ZoneScoped;
+
+    VolumeWriteTask* task = (VolumeWriteTask*)p_arg;
+    const u8* p_data = (const u8*)task->p_data;
+
+    u64 written = 0;
+    while (written < task->size)
+    {
+        const ssize_t result =
+            pwrite(task->fd, p_data + written, task->size - written, (off_t)(task->file_offset + written));
+        if (result == -1 && errno == EINTR) continue;
+        if (result <= 0)
+        {
+            task->failed = true;
+            return;
+        }
+        written += (u64)result;
+    }
+}
+
+
+/// Closes the file of a slot whose writes have finished, and counts it.
+static void finishVolumeFile(VolumeExport* volume_export, VolumeExportSlot* slot) {
+
+    bool failed = close(slot->fd) != 0;
+    for (u32 i = 0; i < VOLUME_EXPORT_WRITE_TASK_COUNT; i++) failed = failed or slot->write_tasks[i].failed;
+    slot->fd = -1;
+
+    if (failed)
+    {
+        LOG_F(
+            ERROR, "Failed to write volume file %" PRIu64 " of `%s`.", slot->state_number, volume_export->path_prefix
+        );
+        return;
+    }
+    volume_export->stats.written_count++;
+    volume_export->stats.written_byte_count += slot->file_size;
+}
+
+
+/// Waits for the files being written, if any, and frees the state of `startVolumeExport()`. The GPU's pending
+/// passes must have finished, and are dropped.
+static void destroyVolumeExport(GpuResources* res, const VulkanContext* vk_ctx) {
+
+    VolumeExport* volume_export = res->volume_export;
+    if (volume_export == NULL) return;
+
+    for (u32 slot_idx = 0; slot_idx < VOLUME_EXPORT_SLOT_COUNT; slot_idx++)
+    {
+        VolumeExportSlot* slot = &volume_export->slots[slot_idx];
+        if (slot->fd != -1)
+        {
+            thread_pool::waitForGroup(volume_export->thread_pool, &slot->write_group);
+            finishVolumeFile(volume_export, slot);
+        }
+        vk_ctx->procs_dev.FreeCommandBuffers(vk_ctx->device, res->command_pool, 1, &slot->command_buffer);
+    }
+
+    free(volume_export->path_prefix);
+    free(volume_export);
+    res->volume_export = NULL;
+}
+
+
+static void destroyGpuResources(GpuResources* res, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    VkResult result = vk_ctx->procs_dev.QueueWaitIdle(vk_ctx->compute_queue);
+    assertVk(result);
+
+    // A background build can't be cancelled, and we don't have the thread pool here to wait for it.
+    if (res->baked_pipeline_build.in_progress)
+    {
+        while (!__atomic_load_n(&res->baked_pipeline_build.finished, __ATOMIC_ACQUIRE)) sched_yield();
+
+        const BakedPipelineBuild* build = &res->baked_pipeline_build;
+        vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, build->pipeline, NULL);
+        vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, build->pipeline_layout, NULL);
+    }
+
+    TracyFreeN(res->buffer_positions_unsorted.buffer, "fluid_sim GPU buffers");
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_uniforms.buffer, res->buffer_uniforms.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_sorted.buffer, res->buffer_positions_sorted.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_velocities_sorted.buffer, res->buffer_velocities_sorted.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_unsorted.buffer, res->buffer_positions_unsorted.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_velocities_unsorted.buffer, res->buffer_velocities_unsorted.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cells.buffer, res->buffer_cells.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_hash_buckets.buffer, res->buffer_hash_buckets.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_H_begin.buffer, res->buffer_H_begin.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_H_length.buffer, res->buffer_H_length.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_C_begin_morton_order.buffer, res->buffer_C_begin_morton_order.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_C_length_morton_order.buffer, res->buffer_C_length_morton_order.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_codes_morton_order.buffer, res->buffer_cell_codes_morton_order.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_hash_ranks.buffer, res->buffer_cell_hash_ranks.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_reference.buffer, res->buffer_positions_reference.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_max_displacement.buffer, res->buffer_max_displacement.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_domain_bounds.buffer, res->buffer_domain_bounds.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_delta_ts.buffer, res->buffer_delta_ts.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_max_motion.buffer, res->buffer_max_motion.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_diagnostics.buffer, res->buffer_diagnostics.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_reduction_partials.buffer, res->buffer_reduction_partials.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_reduction_state.buffer, res->buffer_reduction_state.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_quantized.buffer, res->buffer_positions_quantized.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_slots.buffer, res->buffer_cell_slots.allocation);
+    for (u32 chunk_idx = 0; chunk_idx < res->buffer_neighbor_lists.chunk_count; chunk_idx++)
+    {
+        const GpuBuffer* chunk = &res->buffer_neighbor_lists.chunks[chunk_idx];
+        vmaDestroyBuffer(vk_ctx->vma_allocator, chunk->buffer, chunk->allocation);
+    }
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_neighbor_counts.buffer, res->buffer_neighbor_counts.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_neighbor_list_overflow.buffer, res->buffer_neighbor_list_overflow.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_densities.buffer, res->buffer_densities.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_pbf_positions.buffer, res->buffer_pbf_positions.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_flip_grid.buffer, res->buffer_flip_grid.allocation);
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_persistent_update.buffer, res->buffer_persistent_update.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_calm_steps_sorted.buffer, res->buffer_calm_steps_sorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_calm_steps_unsorted.buffer, res->buffer_calm_steps_unsorted.allocation
+    );
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_awake.buffer, res->buffer_cell_awake.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_active.buffer, res->buffer_cell_active.allocation);
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_active_particles.buffer, res->buffer_active_particles.allocation
+    );
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_sleep_state.buffer, res->buffer_sleep_state.allocation);
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_member_ids_sorted.buffer, res->buffer_member_ids_sorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_member_ids_unsorted.buffer, res->buffer_member_ids_unsorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_particle_ids_sorted.buffer, res->buffer_particle_ids_sorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_particle_ids_unsorted.buffer, res->buffer_particle_ids_unsorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_particle_levels_sorted.buffer,
+        res->buffer_particle_levels_sorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_particle_levels_unsorted.buffer,
+        res->buffer_particle_levels_unsorted.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_ensemble_members.buffer, res->buffer_ensemble_members.allocation
+    );
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_removed_particle_count.buffer, res->buffer_removed_particle_count.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_spatial_queries.buffer, res->buffer_spatial_queries.allocation);
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_spatial_query_results.buffer, res->buffer_spatial_query_results.allocation
+    );
+    vmaDestroyBuffer(
+        vk_ctx->vma_allocator, res->buffer_spatial_query_hits.buffer, res->buffer_spatial_query_hits.allocation
+    );
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_region_readback.buffer, res->buffer_region_readback.allocation);
+    destroyStateExport(res, vk_ctx);
+    destroyVolumeExport(res, vk_ctx);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_volume_export.buffer, res->buffer_volume_export.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_collider_slots.buffer, res->buffer_collider_slots.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_collider_distances.buffer, res->buffer_collider_distances.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_morton_codes.buffer, res->buffer_morton_codes.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_permutation.buffer, res->buffer_permutation.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_count.buffer, res->buffer_cell_count.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_cell_starts_scan.buffer, res->buffer_cell_starts_scan.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_scan_block_sums.buffer, res->buffer_scan_block_sums.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_radix_sort_keys_scratch.buffer, res->buffer_radix_sort_keys_scratch.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_radix_sort_values_scratch.buffer, res->buffer_radix_sort_values_scratch.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_radix_sort_histograms.buffer, res->buffer_radix_sort_histograms.allocation);
+    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_radix_sort_state.buffer, res->buffer_radix_sort_state.allocation);
+
+    vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, res->command_pool, NULL);
+    vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, res->transfer_command_pool, NULL);
+
+    free(res->updateParticles_reloaded_spirv);
+    free(res->user_forces_src);
+    free(res->collider_slots);
+    free(res->collider_free_bricks);
+    free(res->ensemble_member_offsets);
+    free(res->spatial_queries);
+    if (res->shader_watchlist != NULL) filewatch::destroyWatchlist(res->shader_watchlist);
+
+    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_main, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_reduction, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_radix_sort, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_scan, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorPool(vk_ctx->device, res->descriptor_pool, NULL);
+
+    if (res->region_offsets_scan != NULL) gpu_primitives::destroyPlan(res->region_offsets_scan, vk_ctx);
+    if (res->gpu_primitives != NULL) gpu_primitives::destroyContext(res->gpu_primitives, vk_ctx);
+
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticles_baked, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticles_baked, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticlesTiled, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticlesTiled, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticlesSubgroup, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticlesSubgroup, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticlesPersistent, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticlesPersistent, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_buildNeighborLists, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_buildNeighborLists, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeBounds, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeBounds, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateDomainOrigin, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateDomainOrigin, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeMortonCodes, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeMortonCodes, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_removeParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_removeParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_spatialQuery, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_spatialQuery, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_regionReadback_mark, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_regionReadback_mark, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_regionReadback_scatter, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_regionReadback_scatter, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_exportVolume, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_exportVolume, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_generateParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_generateParticles, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_sortParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_sortParticles, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeDensities, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeDensities, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_solveDensityConstraints, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_solveDensityConstraints, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_flip_transferToGrid, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_flip_transferToGrid, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_flip_solvePressure, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_flip_solvePressure, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_sleep_markActiveCells, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_sleep_markActiveCells, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_sleep_compactParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_sleep_compactParticles, NULL);
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeMaxDisplacement, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeMaxDisplacement, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_histogram, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_histogram, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_scan, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_scan, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_scatter, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_scatter, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_countDescents, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_countDescents, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_prepareDispatch, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_prepareDispatch, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_radixSort_writeIdentity, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_radixSort_writeIdentity, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_cellList_markCellStarts, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_cellList_markCellStarts, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_scan_blocks, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_scan_blocks, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_scan_blockSums, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_scan_blockSums, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_scan_addBlockOffsets, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_scan_addBlockOffsets, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_cellList_scatter, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_cellList_scatter, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_cellList_computeLengths, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_cellList_computeLengths, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_hashTable_countCells, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_hashTable_countCells, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_hashTable_scatterCells, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_hashTable_scatterCells, NULL);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_hashTable_insertCells, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_hashTable_insertCells, NULL);
+
+
+    vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, res->timeline_semaphore, NULL);
+    vk_ctx->procs_dev.DestroyFence(vk_ctx->device, res->fence, NULL);
+    vk_ctx->procs_dev.DestroyQueryPool(vk_ctx->device, res->stage_query_pool, NULL);
+}
+
+
+static void waitForTimelineValue(const VulkanContext* vk_ctx, const GpuResources* res, u64 value) {
+
+    const VkSemaphoreWaitInfo wait_info {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &res->timeline_semaphore,
+        .pValues = &value,
+    };
+    VkResult result = vk_ctx->procs_dev.WaitSemaphores(vk_ctx->device, &wait_info, UINT64_MAX);
+    assertVk(result);
+}
+
+
+static UniformBufferData::UpdatedByHost getUniformsUpdatedByHost(const SimData* s) {
+
+    return UniformBufferData::UpdatedByHost {
+        .rest_particle_density = s->parameters.rest_particle_density,
+        .particle_interaction_radius = s->parameters.particle_interaction_radius,
+        .spring_rest_length = s->parameters.spring_rest_length,
+        .spring_stiffness = s->parameters.spring_stiffness,
+        .cell_size_reciprocal = s->parameters.cell_size_reciprocal,
+
+        .particle_count = (u32)s->particle_count,
+        .hash_table_size = s->hash_table_size,
+        .particle_capacity = (u32)s->particle_capacity,
+        .half_velocities = s->gpu_resources.half_velocities,
+        .particle_ids = s->gpu_resources.particle_ids,
+        .particle_levels = s->gpu_resources.particle_levels,
+
+        .sph_stiffness = s->parameters.sph_stiffness,
+        .sph_viscosity = s->parameters.sph_viscosity,
+        .sph_density_kernel_coefficient = s->parameters.sph_density_kernel_coefficient,
+        .sph_gradient_kernel_coefficient = s->parameters.sph_gradient_kernel_coefficient,
+        .pbf_relaxation_epsilon = s->parameters.pbf_relaxation_epsilon,
+        .flip_ratio = s->parameters.flip_ratio,
+        .flip_grid_resolution = s->gpu_resources.flip_grid_resolution,
+    };
+}
+
+
+/// Uploads the host-written uniforms, if they changed since they were last uploaded.
+static void uploadDataToGpu(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    if (s->uniforms_dirty)
+    {
+        const UniformBufferData::UpdatedByHost uniform_data = getUniformsUpdatedByHost(s);
+        uploadBufferToHostVisibleGpuMemory(
+            vk_ctx,
+            sizeof(uniform_data),
+            &uniform_data,
+            &s->gpu_resources.buffer_uniforms,
+            offsetof(UniformBufferData, updated_by_host),
+            &s->transfers,
+            TRANSFER_UNIFORMS
+        );
+        s->uploaded_byte_count += sizeof(uniform_data);
+        s->uniforms_dirty = false;
+    }
+}
+
+
+/// The workgroup size that was cached for device `device_name`, or 0 if there is none.
+static u32 readCachedWorkgroupSize(const char* device_name) {
+
+    FILE* file = fopen(WORKGROUP_SIZE_CACHE_FILEPATH, "r");
+    if (file == NULL) return 0; // nothing has been tuned yet
+
+    u32 workgroup_size = 0;
+
+    char line[32 + VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char* name = NULL;
+        const unsigned long size = strtoul(line, &name, 10);
+        if (name == line or *name != ' ' or size > UINT32_MAX) continue; // malformed
+        name++;
+        name[strcspn(name, "\n")] = '\0';
+
+        if (strcmp(name, device_name) == 0) workgroup_size = (u32)size;
+    }
+
+    const int result = fclose(file);
+    assertErrno(result == 0);
+
+    return workgroup_size;
+}
+
+
+static void writeCachedWorkgroupSize(const char* device_name, u32 workgroup_size) {
+
+    FILE* file = fopen(WORKGROUP_SIZE_CACHE_FILEPATH, "a");
+    if (file == NULL)
+    {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            WORKGROUP_SIZE_CACHE_FILEPATH, errno, strerror(errno)
+        );
+        return;
+    }
+
+    const int char_count = fprintf(file, "%u %s\n", workgroup_size, device_name);
+    assertErrno(char_count >= 0);
+
+    const int result = fclose(file);
+    assertErrno(result == 0);
+}
+
+
+/// Builds a throwaway sim whose compute pipelines use `workgroup_size`, and returns the GPU time (ns) taken by
+/// `AUTOTUNE_TIMED_STEP_COUNT` steps. The steps are recorded into one command buffer like in the GPU-resident
+/// mode, so the spatial structure is rebuilt every step.
+static f64 benchmarkWorkgroupSize(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    const vec4* p_initial_positions,
+    u32fast hash_table_size,
+    u32 workgroup_size
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    SimData s {};
+    s.particle_count = particle_count;
+    s.particle_capacity = particle_count;
+    s.hash_table_size = (u32)hash_table_size;
+    s.hash_table_capacity = (u32)hash_table_size;
+    setParams(&s, params);
+
+    s.gpu_resources = createGpuResources(
+        vk_ctx, thread_pool, particle_count, hash_table_size,
+        params->morton_codes_64_bit, params->hilbert_cell_order, getPeriodicBox(params),
+        params->half_velocities, params->particle_ids, params->adaptive_resolution,
+        params->neighbor_list_capacity, params->open_addressing_cell_table, params->dense_cell_grid,
+        params->flip_grid_resolution,
+        0, 0.0f, // the collider doesn't affect the timings
+        0, // and neither does being an ensemble
+        0, 0, 0, 0, // nor the spatial queries, the region readback or the volume export
+        workgroup_size
+    );
+    defer(destroyGpuResources(&s.gpu_resources, vk_ctx));
+
+    const DomainBounds initial_bounds = getParticleBounds(particle_count, p_initial_positions);
+    initGpuBuffers(
+        &s.gpu_resources, vk_ctx, &s.parameters, (u32)particle_count, (u32)particle_count, p_initial_positions,
+        &initial_bounds, (u32)hash_table_size, &s.transfers
+    );
+    s.spatial_structure_rebuilt_last_step = true;
+    s.spatial_structure_outdated = false;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    {
+        const VkQueryPoolCreateInfo query_pool_info {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+        };
+        result = vk_ctx->procs_dev.CreateQueryPool(vk_ctx->device, &query_pool_info, NULL, &query_pool);
+        assertVk(result);
+    }
+    defer(vk_ctx->procs_dev.DestroyQueryPool(vk_ctx->device, query_pool, NULL));
+
+    writeDeltaT(&s, vk_ctx, 0, AUTOTUNE_DELTA_T);
+
+    const VkCommandBuffer command_buffer = s.gpu_resources.general_purpose_command_buffer;
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+    assertVk(result);
+    {
+        vk_ctx->procs_dev.CmdResetQueryPool(command_buffer, query_pool, 0, 2);
+
+        // the initial build, as in `create()`
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer, s.gpu_resources.buffer_reduction_state.buffer,
+            offsetof(ReductionState, finished_workgroup_count), sizeof(u32), 0
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+        recordSpatialStructureCommands(&s, vk_ctx, command_buffer, 0, false, STAGE_TIMESTAMP_SLOT_NONE);
+
+        for (u32 step = 0; step < AUTOTUNE_WARMUP_STEP_COUNT + AUTOTUNE_TIMED_STEP_COUNT; step++)
+        {
+            recordStepBarrier(vk_ctx, command_buffer);
+            if (step == AUTOTUNE_WARMUP_STEP_COUNT)
+            {
+                // written once the warmup steps have finished
+                vk_ctx->procs_dev.CmdWriteTimestamp(
+                    command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 0
+                );
+            }
+
+            recordParticleUpdateCommands(&s, vk_ctx, command_buffer, 0);
+            recordComputeToComputeBarrier(vk_ctx, command_buffer);
+            recordSpatialStructureCommands(
+                &s, vk_ctx, command_buffer, 0, s.parameters.fuse_morton_codes_into_update, STAGE_TIMESTAMP_SLOT_NONE
+            );
+        }
+
+        vk_ctx->procs_dev.CmdWriteTimestamp(
+            command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1
+        );
+    }
+    result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+    assertVk(result);
+
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+    };
+    result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, s.gpu_resources.fence);
+    assertVk(result);
+
+    // the resources are destroyed on return
+    result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &s.gpu_resources.fence, true, UINT64_MAX);
+    assertVk(result);
+
+    u64 timestamps[2] {};
+    result = vk_ctx->procs_dev.GetQueryPoolResults(
+        vk_ctx->device, query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(u64),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+    );
+    assertVk(result);
+
+    const f64 ns_per_tick = (f64)vk_ctx->physical_device_properties.limits.timestampPeriod;
+    return (f64)(timestamps[1] - timestamps[0]) * ns_per_tick;
+}
+
+
+/// The workgroup size for all the compute pipelines: the one cached for this device if there is one, otherwise
+/// the fastest of AUTOTUNE_WORKGROUP_SIZES, which is then cached.
+/// A single size, because the scan block size, the radix sort tile size and the number of reduction partials
+/// are all derived from it.
+static u32 getTunedWorkgroupSize(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    const vec4* p_initial_positions,
+    u32fast hash_table_size
+) {
+
+    ZoneScoped;
+
+    const VkPhysicalDeviceLimits* limits = &vk_ctx->physical_device_properties.limits;
+    const char* device_name = vk_ctx->physical_device_properties.deviceName;
+    const u32 max_workgroup_size = glm::min(
+        limits->maxComputeWorkGroupSize[0], limits->maxComputeWorkGroupInvocations
+    );
+
+    const u32 cached_workgroup_size = readCachedWorkgroupSize(device_name);
+    if (cached_workgroup_size > 0 and cached_workgroup_size <= max_workgroup_size)
+    {
+        LOG_F(INFO, "Using cached workgroup_size=%u for device `%s`.", cached_workgroup_size, device_name);
+        return cached_workgroup_size;
+    }
+
+    if (!limits->timestampComputeAndGraphics)
+    {
+        LOG_F(WARNING, "Can't autotune the workgroup size, because the device doesn't support timestamps.");
+        return DEFAULT_WORKGROUP_SIZE;
+    }
+
+    u32 best_workgroup_size = DEFAULT_WORKGROUP_SIZE;
+    f64 best_time_ns = INFINITY;
+    for (u32 i = 0; i < ARRAY_SIZE(AUTOTUNE_WORKGROUP_SIZES); i++)
+    {
+        const u32 workgroup_size = AUTOTUNE_WORKGROUP_SIZES[i];
+        if (workgroup_size > max_workgroup_size) continue;
+
+        const f64 time_ns = benchmarkWorkgroupSize(
+            params, vk_ctx, thread_pool, particle_count, p_initial_positions, hash_table_size, workgroup_size
+        );
+        LOG_F(
+            INFO, "Autotune: workgroup_size=%u took %f ms for %u steps.",
+            workgroup_size, time_ns * 1e-6, AUTOTUNE_TIMED_STEP_COUNT
+        );
+
+        if (time_ns < best_time_ns)
+        {
+            best_time_ns = time_ns;
+            best_workgroup_size = workgroup_size;
+        }
+    }
+
+    LOG_F(INFO, "Autotune: picked workgroup_size=%u for device `%s`.", best_workgroup_size, device_name);
+    writeCachedWorkgroupSize(device_name, best_workgroup_size);
+
+    return best_workgroup_size;
+}
+
+
+/// Begins a command buffer for changing the sim outside of `advance()`. Everything that the sim submitted
+/// before must have finished.
+static VkCommandBuffer beginOneOffCommands(const SimData* s, const VulkanContext* vk_ctx) {
+
+    const VkCommandBuffer command_buffer = s->gpu_resources.morton_code_command_buffer;
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+    assertVk(result);
+
+    return command_buffer;
+}
+
+
+/// Ends and submits the commands from `beginOneOffCommands()`. The submission signals the next timeline
+/// value, so that the next `advance()` waits for it.
+static void submitOneOffCommands(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    const VkCommandBuffer command_buffer
+) {
+
+    VkResult result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+    assertVk(result);
+
+    const u64 signal_value = ++s->gpu_resources.timeline_value;
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &signal_value,
+    };
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &s->gpu_resources.timeline_semaphore,
+    };
+    result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+    assertVk(result);
+}
+
+
+/// If `GpuResources::particle_buffers_swapped`, copies the last step's particles back to the unsorted buffers, and
+/// clears it; for what reads or writes the particle buffers directly, or records steps that start from the unsorted
+/// buffers. The positions are already there, and the two orders of the ids always agree, so only the velocities
+/// and the calm steps are copied. Waits for the sim's submissions to finish.
+static void unswapParticleBuffers(SimData* s, const VulkanContext* vk_ctx) {
+
+    GpuResources* res = &s->gpu_resources;
+    if (!res->particle_buffers_swapped) return;
+
+    ZoneScoped;
+
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+    const u32 velocity_array_count = getVelocityArrayCount(res);
+    VkBufferCopy velocity_copies[VELOCITY_COMPONENT_COUNT] {};
+    for (u32fast d = 0; d < velocity_array_count; d++)
+    {
+        velocity_copies[d] = VkBufferCopy {
+            .srcOffset = d * s->particle_capacity * sizeof(u32),
+            .dstOffset = d * s->particle_capacity * sizeof(u32),
+            .size = s->particle_count * sizeof(u32),
+        };
+    }
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, res->buffer_velocities_sorted.buffer, res->buffer_velocities_unsorted.buffer,
+        velocity_array_count, velocity_copies
+    );
+
+    // Otherwise they aren't tracked, and are reset when the sleeping mode is turned on.
+    if (s->parameters.sleeping)
+    {
+        const VkBufferCopy calm_steps_copy { .srcOffset = 0, .dstOffset = 0, .size = s->particle_count * sizeof(u32) };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_calm_steps_sorted.buffer, res->buffer_calm_steps_unsorted.buffer,
+            1, &calm_steps_copy
+        );
+    }
+
+    recordTransferToComputeBarrier(vk_ctx, command_buffer);
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+
+    res->particle_buffers_swapped = false;
+}
+
+
+/// Gives particles `first_idx` to `first_idx + count - 1` the next `count` ids, in both orders; see
+/// `SimParameters::particle_ids`. Does nothing unless `GpuResources::particle_ids`. Waits for the sim's
+/// submissions to finish, and then for the upload.
+static void uploadParticleIds(SimData* s, const VulkanContext* vk_ctx, u32fast first_idx, u32fast count) {
+
+    GpuResources* res = &s->gpu_resources;
+    if (!res->particle_ids) return;
+
+    ZoneScoped;
+
+    const VkDeviceSize size_bytes = count * sizeof(u32);
+    const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, size_bytes, false);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+
+    u32* p_ids = (u32*)getMappedPointer(&staging);
+    for (u32fast i = 0; i < count; i++) p_ids[i] = res->next_particle_id + (u32)i;
+    res->next_particle_id += (u32)count;
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, false, size_bytes);
+
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+    const VkBufferCopy copy { .srcOffset = 0, .dstOffset = first_idx * sizeof(u32), .size = size_bytes };
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, staging.buffer, res->buffer_particle_ids_sorted.buffer, 1, &copy
+    );
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, staging.buffer, res->buffer_particle_ids_unsorted.buffer, 1, &copy
+    );
+    recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+    // before the staging buffer goes
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+}
+
+
+/// Sets the levels of particles `first_idx` to `first_idx + count - 1` to `p_levels_optional`, or to the finest
+/// level if it's NULL, in both orders; see `SimParameters::adaptive_resolution`. Does nothing unless
+/// `GpuResources::particle_levels`. Waits for the sim's submissions to finish, and then for the upload.
+static void uploadParticleLevels(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32fast first_idx,
+    u32fast count,
+    const u32* p_levels_optional
+) {
+
+    GpuResources* res = &s->gpu_resources;
+    if (!res->particle_levels) return;
+
+    ZoneScoped;
+
+    const VkDeviceSize size_bytes = count * sizeof(u32);
+    const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, size_bytes, false);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+
+    if (p_levels_optional != NULL) memcpy(getMappedPointer(&staging), p_levels_optional, size_bytes);
+    else memset(getMappedPointer(&staging), 0, size_bytes);
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, false, size_bytes);
+
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+    const VkBufferCopy copy { .srcOffset = 0, .dstOffset = first_idx * sizeof(u32), .size = size_bytes };
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, staging.buffer, res->buffer_particle_levels_sorted.buffer, 1, &copy
+    );
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, staging.buffer, res->buffer_particle_levels_unsorted.buffer, 1, &copy
+    );
+    recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+    // before the staging buffer goes
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+}
+
+
+/// Copies the live particles to `p_packed_out`, packed as in a checkpoint (see `getPackedParticlesSize()`), with
+/// 32-bit velocities even if `SimParameters::half_velocities`. Waits for the sim's submissions to finish.
+static void readBackPackedParticles(SimData* s, const VulkanContext* vk_ctx, void* p_packed_out) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    const u32fast count = s->particle_count;
+    const VkDeviceSize positions_size_bytes = count * sizeof(vec4);
+    const VkDeviceSize velocity_component_size_bytes = count * sizeof(f32);
+    const VkDeviceSize packed_size_bytes = getPackedParticlesSize(count);
+
+    unswapParticleBuffers(s, vk_ctx);
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    if (s->cpu_backend)
+    {
+        const CpuState* cpu = &s->cpu_state;
+
+        vec4* p_positions = (vec4*)p_packed_out;
+        for (u32fast i = 0; i < count; i++)
+        {
+            p_positions[i] = vec4(
+                cpu->positions[0][i], cpu->positions[1][i], cpu->positions[2][i], cpu->attributes[i]
+            );
+        }
+        for (u32 d = 0; d < VELOCITY_COMPONENT_COUNT; d++)
+        {
+            const uintptr_t offset = positions_size_bytes + d * velocity_component_size_bytes;
+            void* p_dst = (void*)( (uintptr_t)p_packed_out + offset );
+            memcpy(p_dst, cpu->velocities[d], velocity_component_size_bytes);
+        }
+        return;
+    }
+
+    const GpuBuffer readback = createParticleStagingBuffer(vk_ctx, packed_size_bytes, true);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, readback.buffer, readback.allocation));
+
+    // Once unswapped, the unsorted buffers hold the current state.
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    {
+        recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+        const VkBufferCopy positions_copy {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = positions_size_bytes,
+        };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_positions_unsorted.buffer, readback.buffer, 1, &positions_copy
+        );
+
+        const u32 velocity_array_count = getVelocityArrayCount(res);
+        VkBufferCopy velocity_copies[VELOCITY_COMPONENT_COUNT] {};
+        for (u32fast d = 0; d < velocity_array_count; d++)
+        {
+            velocity_copies[d] = VkBufferCopy {
+                .srcOffset = d * s->particle_capacity * sizeof(f32),
+                .dstOffset = positions_size_bytes + d * velocity_component_size_bytes,
+                .size = velocity_component_size_bytes,
+            };
+        }
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_velocities_unsorted.buffer, readback.buffer,
+            velocity_array_count, velocity_copies
+        );
+
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+    }
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    const VkResult result =
+        vmaInvalidateAllocation(vk_ctx->vma_allocator, readback.allocation, 0, packed_size_bytes);
+    assertVk(result);
+
+    memcpy(p_packed_out, getMappedPointer(&readback), packed_size_bytes);
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, true, packed_size_bytes);
+    if (res->half_velocities)
+    {
+        unpackHalfVelocities((void*)( (uintptr_t)p_packed_out + positions_size_bytes ), count);
+    }
+}
+
+
+/// Copies the levels of the live particles (see `SimParameters::adaptive_resolution`) to `p_levels_out`, in the
+/// order of `readBackPackedParticles()`, which must have unswapped the particle buffers just before. Waits for the
+/// sim's submissions to finish.
+static void readBackParticleLevels(SimData* s, const VulkanContext* vk_ctx, u32* p_levels_out) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    alwaysAssert(res->particle_levels and !res->particle_buffers_swapped);
+
+    const VkDeviceSize size_bytes = s->particle_count * sizeof(u32);
+    const GpuBuffer readback = createParticleStagingBuffer(vk_ctx, size_bytes, true);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, readback.buffer, readback.allocation));
+
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    {
+        recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+        const VkBufferCopy copy { .srcOffset = 0, .dstOffset = 0, .size = size_bytes };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, res->buffer_particle_levels_unsorted.buffer, readback.buffer, 1, &copy
+        );
+
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+    }
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    const VkResult result = vmaInvalidateAllocation(vk_ctx->vma_allocator, readback.allocation, 0, size_bytes);
+    assertVk(result);
+
+    memcpy(p_levels_out, getMappedPointer(&readback), size_bytes);
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, true, size_bytes);
+}
+
+
+//
+// ===========================================================================================================
+//
+
+// The `SimParameters::cpu_backend` mode. Each step mirrors the GPU path with the spatial structure rebuilt
+// every step: the particles are sorted by the Morton code of their cell, the cells are collected into a hash
+// table, and each particle is updated from the particles in the 27 cells around it, as in
+// `fluidSim_updateParticles.comp.h`. The passes are split into chunks with `thread_pool::parallelFor()`.
+// In the spring mode, the spring forces are computed once per pair instead of once per particle of the pair,
+// and added to both of its particles; see `cpuPass_accumulateSpringForces()`. Or with
+// `SimParameters::cluster_pair_forces`, from both ends, by clusters of particles; see
+// `cpuPass_accumulateClusterPairForces()`. With `SimParameters::hybrid_gpu_update`, the GPU updates a range of
+// the cells at the same time; see `cpuHybridUpdate()`.
+
+// `CpuState::cell_table` slots are filled with this byte to mark them empty.
+constexpr u8 CPU_CELL_TABLE_EMPTY_BYTE = 0xFF;
+constexpr u32 CPU_CELL_TABLE_EMPTY = UINT32_MAX;
+
+// The Morton codes of the CPU backend are 30 bits, so that they fit in `KeyVal::key`.
+constexpr u32 CPU_MORTON_CODE_WORD_COUNT = 1;
+constexpr u32 CPU_MAX_CELL_COUNT_PER_AXIS = 1 << (MORTON_CODE_BIT_COUNT_NARROW / 3);
+
+// Particles per chunk of the passes over the particles; cells per chunk of the passes over the cells.
+constexpr u64 CPU_PARTICLE_GRAIN = 4096;
+constexpr u64 CPU_CELL_GRAIN = 64;
+// The most cells that a cell's particles interact with: its own, and the 26 around it.
+constexpr u32 CPU_NEIGHBOR_CELL_COUNT = 27;
+// Half of the 26 cells around a cell, so that of any two neighboring cells, exactly one has the other here: the
+// 9 at the next x, the 3 at the same x and the next y, and the one at the same x and y and the next z.
+constexpr u32 CPU_HALF_STENCIL_CELL_COUNT = 13;
+constexpr i32 CPU_HALF_STENCIL_OFFSETS[CPU_HALF_STENCIL_CELL_COUNT][3] {
+    { 1, -1, -1 }, { 1, -1, 0 }, { 1, -1, 1 },
+    { 1, 0, -1 }, { 1, 0, 0 }, { 1, 0, 1 },
+    { 1, 1, -1 }, { 1, 1, 0 }, { 1, 1, 1 },
+    { 0, 1, -1 }, { 0, 1, 0 }, { 0, 1, 1 },
+    { 0, 0, 1 },
+};
+// The particles of a cluster of `SimParameters::cluster_pair_forces`, one per AVX2 lane. Cluster `c` is the sorted
+// particles `[CPU_CLUSTER_SIZE * c, CPU_CLUSTER_SIZE * (c + 1))`, the last one possibly fewer.
+constexpr u32 CPU_CLUSTER_SIZE = 8;
+// Clusters per chunk of the passes over the clusters.
+constexpr u64 CPU_CLUSTER_GRAIN = 64;
+// The most clusters that `cpuPass_accumulateClusterPairForces()` collects before it evaluates them.
+constexpr u32 CPU_CLUSTER_PAIR_LIST_CAPACITY = 256;
+
+/// The `p_ctx` of the CPU backend's passes.
+struct CpuPass {
+    SimData* s;
+    f32 delta_t;
+    u32 slab_parity; // of the slabs of `cpuPass_accumulateSpringForces()`
+    u32 pbf_read_half; // of `CpuState::pbf_positions`, that the PBF passes read
+    bool pbf_find_neighbor_cells; // in the first PBF multiplier pass
+    // `cpuHybridUpdate()`: the GPU's first cell, and first sorted particle, and the first sorted particle of the
+    // cells around its cells
+    u32 hybrid_split_cell;
+    u32 hybrid_first_particle;
+    u32 hybrid_halo_first_particle;
+};
+
+
+/// Same as `cellMortonCode30()` in `fluidSim_util.comp.h`.
+static u32 cellMortonCode30(uvec3 cell_index) {
+    return morton::encode30(cell_index.x, cell_index.y, cell_index.z);
+}
+
+/// Same as `cellHilbertCode()` in `fluidSim_util.comp.h`, with `level_count` bits per component (at most 21), as a
+/// single word: bits `3 * i` to `3 * i + 2` are level `i`, like in `cellMortonCode63()`.
+static u64 cellHilbertCode63(uvec3 cell_index, u32 level_count) {
+
+    u32 x[3] { cell_index.x, cell_index.y, cell_index.z };
+    for (u32 i = 0; i < 3; i++) x[i] &= ((u32)1 << level_count) - 1;
+
+    // inverse undo
+    for (u32 q = (u32)1 << (level_count - 1); q > 1; q >>= 1)
+    {
+        const u32 p = q - 1;
+        for (u32 i = 0; i < 3; i++)
+        {
+            if (x[i] & q) x[0] ^= p; // invert
+            else
+            {
+                // exchange
+                const u32 swapped = (x[0] ^ x[i]) & p;
+                x[0] ^= swapped;
+                x[i] ^= swapped;
+            }
+        }
+    }
+
+    // Gray encode
+    x[1] ^= x[0];
+    x[2] ^= x[1];
+    u32 t = 0;
+    for (u32 q = (u32)1 << (level_count - 1); q > 1; q >>= 1)
+    {
+        if (x[2] & q) t ^= q - 1;
+    }
+    for (u32 i = 0; i < 3; i++) x[i] ^= t;
+
+    // the transpose's first component is the highest bit of each level
+    return morton::encode63(x[2], x[1], x[0]);
+}
+
+/// Inverse of `cellHilbertCode63()`.
+static uvec3 cellIndexFromHilbertCode63(u64 code, u32 level_count) {
+
+    u32 x[3] { morton::decode63(code, 2), morton::decode63(code, 1), morton::decode63(code, 0) };
+
+    // Gray decode
+    const u32 t = x[2] >> 1;
+    x[2] ^= x[1];
+    x[1] ^= x[0];
+    x[0] ^= t;
+
+    // undo the excess work
+    for (u32 q = 2; q != ((u32)1 << level_count); q <<= 1)
+    {
+        const u32 p = q - 1;
+        for (u32 i = 3; i-- > 0; )
+        {
+            if (x[i] & q) x[0] ^= p;
+            else
+            {
+                const u32 swapped = (x[0] ^ x[i]) & p;
+                x[0] ^= swapped;
+                x[i] ^= swapped;
+            }
+        }
+    }
+
+    return uvec3(x[0], x[1], x[2]);
+}
+
+/// The code that the CPU backend sorts the particles by, and keys its cell table with; see
+/// `SimParameters::hilbert_cell_order`.
+static u32 cpuCellCode(const CpuState* cpu, uvec3 cell_index) {
+    if (cpu->hilbert_cell_order) return (u32)cellHilbertCode63(cell_index, MORTON_CODE_BIT_COUNT_NARROW / 3);
+    return cellMortonCode30(cell_index);
+}
+
+/// Same as `cellIndex()` in `fluidSim_util.comp.h`.
+static uvec3 cellIndex(vec3 particle, vec3 domain_min, f32 cell_size_reciprocal) {
+    return uvec3((particle - domain_min) * cell_size_reciprocal);
+}
+
+/// Same as `mortonCodeHash()` in `fluidSim_util.comp.h`, for 30-bit codes. `table_size` must be a power of
+/// two, at least 2.
+static u32 cpuCellTableHash(u32 cell_code, u32 table_size) {
+    const u32 bit_count = (u32)__builtin_ctz(table_size);
+    return (cell_code * 0x9E3779B1u) >> (32 - bit_count);
+}
+
+/// The index of the cell with code `cell_code` (see `cpuCellCode()`), or CPU_CELL_TABLE_EMPTY if it has no particles.
+static u32 cpuFindCell(const CpuState* cpu, u32 cell_code) {
+
+    const u32 mask = cpu->cell_table_size - 1;
+
+    // terminates because the table is never more than half full
+    for (u32 slot = cpuCellTableHash(cell_code, cpu->cell_table_size); ; slot = (slot + 1) & mask)
+    {
+        const u32 cell_idx = cpu->cell_table[slot];
+        if (cell_idx == CPU_CELL_TABLE_EMPTY or cpu->cell_codes[cell_idx] == cell_code) return cell_idx;
+    }
+}
+
+
+/// Accumulates the bounds of the particles `[begin, end)` into the `DomainBounds` at `p_partial`.
+static void cpuPass_computeBounds(void* p_ctx, u64 begin, u64 end, void* p_partial) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const CpuState* cpu = &pass->s->cpu_state;
+    DomainBounds* bounds = (DomainBounds*)p_partial;
+
+    for (glm::length_t d = 0; d < 3; d++)
+    {
+        const f32* p_components = cpu->positions[d];
+
+        f32 component_min = bounds->min[d];
+        f32 component_max = bounds->max[d];
+        for (u64 i = begin; i < end; i++)
+        {
+            component_min = glm::min(component_min, p_components[i]);
+            component_max = glm::max(component_max, p_components[i]);
+        }
+
+        bounds->min[d] = component_min;
+        bounds->max[d] = component_max;
+    }
+}
+
+static void cpuPass_combineBounds(void*, void* p_accum, const void* p_partial) {
+
+    DomainBounds* accum = (DomainBounds*)p_accum;
+    const DomainBounds* partial = (const DomainBounds*)p_partial;
+
+    accum->min = glm::min(accum->min, partial->min);
+    accum->max = glm::max(accum->max, partial->max);
+}
+
+
+#ifdef __AVX2__
+/// `morton::spreadBits30()` of each lane.
+static __m256i spreadBits30(__m256i x) {
+    x = _mm256_and_si256(x, _mm256_set1_epi32(0x000003ff));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 16)), _mm256_set1_epi32(0xff0000ff));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 8)), _mm256_set1_epi32(0x0300f00f));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 4)), _mm256_set1_epi32(0x030c30c3));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 2)), _mm256_set1_epi32(morton::BITS_30_X));
+    return x;
+}
+#endif
+
+static void cpuPass_computeCellKeys(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+    const f32 cell_size_reciprocal = pass->s->parameters.cell_size_reciprocal;
+
+    u64 i = begin;
+
+    #ifdef __AVX2__
+    // The Morton codes of 8 particles at a time, interleaved with their indices into 8 keys; the cell indices are
+    // truncated like `cellIndex()`, which is exact since the particles are within the domain.
+    if (!cpu->hilbert_cell_order)
+    {
+        const __m256 reciprocal = _mm256_set1_ps(cell_size_reciprocal);
+        const __m256i lane_indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const auto spreadCellIndices = [&](glm::length_t d) {
+            const __m256 offset =
+                _mm256_sub_ps(_mm256_loadu_ps(cpu->positions[d] + i), _mm256_set1_ps(cpu->domain_min[d]));
+            return spreadBits30(_mm256_cvttps_epi32(_mm256_mul_ps(offset, reciprocal)));
+        };
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256i codes = _mm256_or_si256(
+                spreadCellIndices(0),
+                _mm256_or_si256(_mm256_slli_epi32(spreadCellIndices(1), 1), _mm256_slli_epi32(spreadCellIndices(2), 2))
+            );
+            const __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((i32)i), lane_indices);
+
+            // keys 0, 1, 4 and 5, and keys 2, 3, 6 and 7, which the permutes put in order
+            const __m256i keys_low = _mm256_unpacklo_epi32(codes, indices);
+            const __m256i keys_high = _mm256_unpackhi_epi32(codes, indices);
+            _mm256_storeu_si256((__m256i*)&cpu->cell_keys[i], _mm256_permute2x128_si256(keys_low, keys_high, 0x20));
+            _mm256_storeu_si256((__m256i*)&cpu->cell_keys[i + 4], _mm256_permute2x128_si256(keys_low, keys_high, 0x31));
+        }
+    }
+    #endif
+
+    for (; i < end; i++)
+    {
+        const vec3 particle(cpu->positions[0][i], cpu->positions[1][i], cpu->positions[2][i]);
+        cpu->cell_keys[i] = KeyVal {
+            .key = cpuCellCode(cpu, cellIndex(particle, cpu->domain_min, cell_size_reciprocal)),
+            .val = (u32)i,
+        };
+    }
+}
+
+
+static void cpuPass_gatherSortedParticles(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    for (u64 k = begin; k < end; k++)
+    {
+        const u32 i = cpu->cell_keys[k].val;
+
+        for (u32 d = 0; d < 3; d++)
+        {
+            cpu->positions_sorted[d][k] = cpu->positions[d][i];
+            cpu->velocities_sorted[d][k] = cpu->velocities[d][i];
+        }
+        cpu->attributes_sorted[k] = cpu->attributes[i];
+    }
+
+    // `cpuPass_accumulateSpringForces()` adds to them
+    if (!pass->s->parameters.sph)
+    {
+        for (u32 d = 0; d < 3; d++) memset(cpu->accelerations[d] + begin, 0, (end - begin) * sizeof(f32));
+    }
+}
+
+
+/// Calls `visit(k, mask)` with masks of the sorted particles `[begin, end)` that start a cell, their first particle or
+/// one whose key differs from the previous one's: bit `b` is particle `k + b`, and the masks cover the range in order.
+/// Compares 8 keys at a time with AVX2.
+template<typename F>
+static void cpuScanCellStarts(const KeyVal* keys, u64 begin, u64 end, const F& visit) {
+
+    u64 k = begin;
+    if (k == 0 and k < end)
+    {
+        visit(0, 1);
+        k++;
+    }
+
+    #ifdef __AVX2__
+    // the keys of the 8 `KeyVal`s at `p`, in order
+    const auto loadKeys = [](const KeyVal* p) {
+        const __m256 low = _mm256_loadu_ps((const f32*)p);
+        const __m256 high = _mm256_loadu_ps((const f32*)(p + 4));
+        const __m256 shuffled = _mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)); // 0, 1, 4, 5, 2, 3, 6, 7
+        return _mm256_permute4x64_epi64(_mm256_castps_si256(shuffled), _MM_SHUFFLE(3, 1, 2, 0));
+    };
+    for (; k + 8 <= end; k += 8)
+    {
+        const __m256i equal = _mm256_cmpeq_epi32(loadKeys(&keys[k]), loadKeys(&keys[k - 1]));
+        const u32 mask = ~(u32)_mm256_movemask_ps(_mm256_castsi256_ps(equal)) & 0xFF;
+        if (mask != 0) visit(k, mask);
+    }
+    #endif
+
+    for (; k < end; k++)
+    {
+        if (keys[k].key != keys[k - 1].key) visit(k, 1);
+    }
+}
+
+/// Counts the cells that start in the chunk `[begin, end)` of the sorted particles, into the next chunk's element
+/// of `CpuState::chunk_first_cells`.
+static void cpuPass_countCellStarts(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    u32 count = 0;
+    cpuScanCellStarts(cpu->cell_keys, begin, end, [&](u64, u32 mask) { count += (u32)__builtin_popcount(mask); });
+    cpu->chunk_first_cells[begin / CPU_PARTICLE_GRAIN + 1] = count;
+}
+
+/// Writes the code and first particle of each cell that starts in the chunk `[begin, end)` of the sorted particles,
+/// from the chunk's first cell on.
+static void cpuPass_writeCellStarts(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    u32 cell = cpu->chunk_first_cells[begin / CPU_PARTICLE_GRAIN];
+    cpuScanCellStarts(cpu->cell_keys, begin, end, [&](u64 k, u32 mask) {
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const u32 first_particle = (u32)k + (u32)__builtin_ctz(mask);
+            cpu->cell_codes[cell] = cpu->cell_keys[first_particle].key;
+            cpu->cell_first_particles[cell] = first_particle;
+            cell++;
+        }
+    });
+}
+
+/// Counts the particles of the cells `[begin, end)`, and writes their home slots in the cell table, which
+/// `cpuBuildCells()` probes from, to `CpuState::cell_slots`.
+static void cpuPass_finishCells(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+    const u32 particle_count = (u32)pass->s->particle_count;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u32 next_first_particle = (c + 1 < cpu->cell_count) ? cpu->cell_first_particles[c + 1] : particle_count;
+        cpu->cell_particle_counts[c] = next_first_particle - cpu->cell_first_particles[c];
+        cpu->cell_slots[c] = cpuCellTableHash(cpu->cell_codes[c], cpu->cell_table_size);
+    }
+}
+
+/// Clears the cell table slots of the previous step's cells `[begin, end)`.
+static void cpuPass_clearCellTable(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    for (u64 c = begin; c < end; c++) cpu->cell_table[cpu->cell_slots[c]] = CPU_CELL_TABLE_EMPTY;
+}
+
+
+/// Collects the cells of the sorted particles, and inserts them into the cell table. Only the slots of the previous
+/// step's cells are cleared, instead of the whole table. The cells are found in parallel, in two passes over the
+/// chunks of particles: one counts each chunk's cells, and after a prefix sum of the counts, the other writes them
+/// from the chunk's first one on. Only the insertion is serial, as the probes of neighboring cells collide; the
+/// cells' home slots are computed in parallel before it. Then sorts the cells into slabs by their x index, with a
+/// counting sort.
+static void cpuBuildCells(const CpuPass* pass, thread_pool::ThreadPool* thread_pool) {
+
+    ZoneScoped;
+
+    CpuState* cpu = &pass->s->cpu_state;
+    const u32fast particle_count = pass->s->particle_count;
+    const f32 cell_size_reciprocal = pass->s->parameters.cell_size_reciprocal;
+    void* p_ctx = (void*)pass;
+
+    thread_pool::parallelFor(thread_pool, 0, cpu->cell_count, CPU_PARTICLE_GRAIN, cpuPass_clearCellTable, p_ctx);
+
+    thread_pool::parallelFor(thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, cpuPass_countCellStarts, p_ctx);
+    const u32fast chunk_count = (particle_count + CPU_PARTICLE_GRAIN - 1) / CPU_PARTICLE_GRAIN;
+    cpu->chunk_first_cells[0] = 0;
+    for (u32fast chunk = 0; chunk < chunk_count; chunk++)
+    {
+        cpu->chunk_first_cells[chunk + 1] += cpu->chunk_first_cells[chunk];
+    }
+    const u32 cell_count = cpu->chunk_first_cells[chunk_count];
+    cpu->cell_count = cell_count;
+    thread_pool::parallelFor(thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, cpuPass_writeCellStarts, p_ctx);
+    thread_pool::parallelFor(thread_pool, 0, cell_count, CPU_PARTICLE_GRAIN, cpuPass_finishCells, p_ctx);
+
+    {
+        ZoneScopedN("InsertCells");
+
+        const u32 mask = cpu->cell_table_size - 1;
+        for (u32 c = 0; c < cell_count; c++)
+        {
+            u32 slot = cpu->cell_slots[c];
+            while (cpu->cell_table[slot] != CPU_CELL_TABLE_EMPTY) slot = (slot + 1) & mask;
+            cpu->cell_table[slot] = c;
+            cpu->cell_slots[c] = slot;
+        }
+    }
+
+    // the x index of a cell, from its first particle like `cellIndex()`
+    const auto getCellX = [&](u32 cell) {
+        const f32 x = cpu->positions_sorted[0][cpu->cell_first_particles[cell]];
+        return (u32)((x - cpu->domain_min.x) * cell_size_reciprocal);
+    };
+
+    u32 slab_count = 0;
+    memset(cpu->slab_first_cells, 0, (CPU_MAX_CELL_COUNT_PER_AXIS + 1) * sizeof(u32));
+    for (u32 c = 0; c < cell_count; c++)
+    {
+        const u32 x = getCellX(c);
+        cpu->slab_first_cells[x + 1]++;
+        slab_count = glm::max(slab_count, x + 1);
+    }
+    for (u32 x = 0; x < slab_count; x++) cpu->slab_first_cells[x + 1] += cpu->slab_first_cells[x];
+    for (u32 c = 0; c < cell_count; c++)
+    {
+        // during this, `slab_first_cells[x]` is the next free index of slab `x`
+        const u32 x = getCellX(c);
+        cpu->slab_cells[cpu->slab_first_cells[x]++] = c;
+    }
+    // each now holds the first cell of the next slab
+    for (u32 x = slab_count; x > 0; x--) cpu->slab_first_cells[x] = cpu->slab_first_cells[x - 1];
+    cpu->slab_first_cells[0] = 0;
+    cpu->slab_count = slab_count;
+}
+
+
+#ifdef __AVX2__
+static f32 horizontalSum(__m256 v) {
+    const __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+    const __m128 sum_1 = _mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 1));
+    return _mm_cvtss_f32(sum_1);
+}
+#endif
+
+/// `accelerationDueToParticle()` in `fluidSim_updateParticles.comp.h`, for the pairs of the sorted particle `i`
+/// with each of the sorted particles `[begin, end)`: adds the acceleration of each pair to `i`'s in
+/// `CpuState::accelerations`, and if `symmetric`, the opposite one to the other particle's, since a spring pulls
+/// its two ends alike; `[begin, end)` must then not include `i`. Takes 8 particles at a time with AVX2, and the
+/// rest one at a time. The compiler doesn't vectorize the plain loop, because `sqrtf()` may set `errno`.
+template <bool symmetric>
+static void cpuAccumulateSpringForces(
+    CpuState* cpu,
+    const SimData::Params* params,
+    const u32 i,
+    const u32 begin,
+    const u32 end
+) {
+    const f32* xs = cpu->positions_sorted[0];
+    const f32* ys = cpu->positions_sorted[1];
+    const f32* zs = cpu->positions_sorted[2];
+    f32* accel_xs = cpu->accelerations[0];
+    f32* accel_ys = cpu->accelerations[1];
+    f32* accel_zs = cpu->accelerations[2];
+
+    const vec3 pos(xs[i], ys[i], zs[i]);
+    const f32 radius = params->particle_interaction_radius;
+    const f32 rest_length = params->spring_rest_length;
+    const f32 stiffness = params->spring_stiffness;
+    // `accelerationDueToParticle()` ignores pairs closer than this
+    const f32 min_dist = 1e-7f;
+
+    vec3 accel(0.0f);
+    u32 j = begin;
+
+
+    #ifdef __AVX2__
+    {
+        const __m256 pos_x = _mm256_set1_ps(pos.x);
+        const __m256 pos_y = _mm256_set1_ps(pos.y);
+        const __m256 pos_z = _mm256_set1_ps(pos.z);
+        const __m256 radius_v = _mm256_set1_ps(radius);
+        const __m256 rest_length_v = _mm256_set1_ps(rest_length);
+        const __m256 stiffness_v = _mm256_set1_ps(stiffness);
+        const __m256 min_dist_v = _mm256_set1_ps(min_dist);
+
+        __m256 accel_x = _mm256_setzero_ps();
+        __m256 accel_y = _mm256_setzero_ps();
+        __m256 accel_z = _mm256_setzero_ps();
+
+        for (; j + 8 <= end; j += 8)
+        {
+            const __m256 disp_x = _mm256_sub_ps(_mm256_loadu_ps(xs + j), pos_x);
+            const __m256 disp_y = _mm256_sub_ps(_mm256_loadu_ps(ys + j), pos_y);
+            const __m256 disp_z = _mm256_sub_ps(_mm256_loadu_ps(zs + j), pos_z);
+            const __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(
+                _mm256_mul_ps(disp_x, disp_x),
+                _mm256_add_ps(_mm256_mul_ps(disp_y, disp_y), _mm256_mul_ps(disp_z, disp_z))
+            ));
+
+            const __m256 scale =
+                _mm256_div_ps(_mm256_mul_ps(stiffness_v, _mm256_sub_ps(dist, rest_length_v)), dist);
+            const __m256 interacts = _mm256_and_ps(
+                _mm256_cmp_ps(dist, radius_v, _CMP_LT_OQ), _mm256_cmp_ps(dist, min_dist_v, _CMP_GE_OQ)
+            );
+            // computed for every pair and then masked out, so that there is no branch
+            const __m256 masked_scale = _mm256_and_ps(interacts, scale);
+
+            const __m256 pair_x = _mm256_mul_ps(masked_scale, disp_x);
+            const __m256 pair_y = _mm256_mul_ps(masked_scale, disp_y);
+            const __m256 pair_z = _mm256_mul_ps(masked_scale, disp_z);
+            accel_x = _mm256_add_ps(accel_x, pair_x);
+            accel_y = _mm256_add_ps(accel_y, pair_y);
+            accel_z = _mm256_add_ps(accel_z, pair_z);
+            if constexpr (symmetric)
+            {
+                _mm256_storeu_ps(accel_xs + j, _mm256_sub_ps(_mm256_loadu_ps(accel_xs + j), pair_x));
+                _mm256_storeu_ps(accel_ys + j, _mm256_sub_ps(_mm256_loadu_ps(accel_ys + j), pair_y));
+                _mm256_storeu_ps(accel_zs + j, _mm256_sub_ps(_mm256_loadu_ps(accel_zs + j), pair_z));
+            }
+        }
+
+        accel += vec3(horizontalSum(accel_x), horizontalSum(accel_y), horizontalSum(accel_z));
+    }
+    #endif
+
+    for (; j < end; j++)
+    {
+        const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+        const f32 dist = glm::length(disp);
+
+        if (dist >= radius or dist < min_dist) continue;
+        const vec3 pair_accel = stiffness * (dist - rest_length) / dist * disp;
+        accel += pair_accel;
+        if constexpr (symmetric)
+        {
+            accel_xs[j] -= pair_accel.x;
+            accel_ys[j] -= pair_accel.y;
+            accel_zs[j] -= pair_accel.z;
+        }
+    }
+
+    accel_xs[i] += accel.x;
+    accel_ys[i] += accel.y;
+    accel_zs[i] += accel.z;
+}
+
+
+/// The index of cell `cell` along each axis, from its first particle.
+static uvec3 cpuCellIndex3d(const CpuState* cpu, const SimData::Params* params, const u32 cell) {
+
+    const u32 first_particle_idx = cpu->cell_first_particles[cell];
+    const vec3 first_particle(
+        cpu->positions_sorted[0][first_particle_idx],
+        cpu->positions_sorted[1][first_particle_idx],
+        cpu->positions_sorted[2][first_particle_idx]
+    );
+    return cellIndex(first_particle, cpu->domain_min, params->cell_size_reciprocal);
+}
+
+
+/// Writes the indices of the cells around cell `cell`, including itself, that have particles, in the same order
+/// as `interactionsWithNeighborCells()`. Returns their count, at most CPU_NEIGHBOR_CELL_COUNT.
+static u32 cpuFindNeighborCells(
+    const CpuState* cpu,
+    const SimData::Params* params,
+    const u32 cell,
+    u32* neighbor_cells_out
+) {
+
+    const uvec3 cell_idx_3d = cpuCellIndex3d(cpu, params, cell);
+
+    u32 neighbor_cell_count = 0;
+    for (u32 x = 0; x < 3; x++) for (u32 y = 0; y < 3; y++) for (u32 z = 0; z < 3; z++)
+    {
+        // cells below 0 wrap around, and are then out of range like the ones past the end
+        const uvec3 neighbor = cell_idx_3d + uvec3(x, y, z) - uvec3(1);
+        if (
+            neighbor.x >= CPU_MAX_CELL_COUNT_PER_AXIS or
+            neighbor.y >= CPU_MAX_CELL_COUNT_PER_AXIS or
+            neighbor.z >= CPU_MAX_CELL_COUNT_PER_AXIS
+        ) continue;
+
+        const u32 neighbor_cell = cpuFindCell(cpu, cpuCellCode(cpu, neighbor));
+        if (neighbor_cell == CPU_CELL_TABLE_EMPTY) continue; // cell doesn't exist
+        neighbor_cells_out[neighbor_cell_count++] = neighbor_cell;
+    }
+
+    return neighbor_cell_count;
+}
+
+
+/// Accumulates the spring forces between the particles of the slabs `2 * i + CpuPass::slab_parity`, for `i` in
+/// `[begin, end)`, into `CpuState::accelerations`, once per pair. Each cell takes the pairs within itself and those
+/// with its CPU_HALF_STENCIL_OFFSETS cells, whose own half stencils have the cell's other neighbors. So a slab only
+/// writes the accelerations of its own particles and of those of the next slab, and the slabs of one parity can
+/// be taken at the same time, then those of the other.
+static void cpuPass_accumulateSpringForces(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    for (u64 i = begin; i < end; i++)
+    {
+        const u32 slab = 2 * (u32)i + pass->slab_parity;
+
+        for (u32 s = cpu->slab_first_cells[slab]; s < cpu->slab_first_cells[slab + 1]; s++)
+        {
+            const u32 cell = cpu->slab_cells[s];
+            const uvec3 cell_idx_3d = cpuCellIndex3d(cpu, params, cell);
+
+            u32 neighbor_cell_count = 0;
+            u32 neighbor_cells[CPU_HALF_STENCIL_CELL_COUNT];
+            for (const i32* offset : CPU_HALF_STENCIL_OFFSETS)
+            {
+                // cells below 0 wrap around, and are then out of range like the ones past the end
+                const uvec3 neighbor = cell_idx_3d + uvec3(ivec3(offset[0], offset[1], offset[2]));
+                if (
+                    neighbor.x >= CPU_MAX_CELL_COUNT_PER_AXIS or
+                    neighbor.y >= CPU_MAX_CELL_COUNT_PER_AXIS or
+                    neighbor.z >= CPU_MAX_CELL_COUNT_PER_AXIS
+                ) continue;
+
+                const u32 neighbor_cell = cpuFindCell(cpu, cpuCellCode(cpu, neighbor));
+                if (neighbor_cell == CPU_CELL_TABLE_EMPTY) continue; // cell doesn't exist
+                neighbor_cells[neighbor_cell_count++] = neighbor_cell;
+            }
+
+            const u32 particle_begin = cpu->cell_first_particles[cell];
+            const u32 particle_end = particle_begin + cpu->cell_particle_counts[cell];
+            for (u32 k = particle_begin; k < particle_end; k++)
+            {
+                // the pairs within the cell, each from its first particle
+                cpuAccumulateSpringForces<true>(cpu, params, k, k + 1, particle_end);
+
+                for (u32 n = 0; n < neighbor_cell_count; n++)
+                {
+                    const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+                    const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+                    cpuAccumulateSpringForces<true>(cpu, params, k, neighbor_begin, neighbor_end);
+                }
+            }
+        }
+    }
+}
+
+
+/// Like `cpuPass_accumulateSpringForces()`, but for the cells `[begin, end)`, and each particle sums all of its
+/// pairs itself, so that the cells may be any of them: the pairs across the end of the range are only taken from
+/// this side. For `cpuHybridUpdate()`, whose other side is the GPU's.
+static void cpuPass_gatherSpringForces(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        u32 neighbor_cells[CPU_NEIGHBOR_CELL_COUNT];
+        const u32 neighbor_cell_count = cpuFindNeighborCells(cpu, params, (u32)c, neighbor_cells);
+
+        const u32 particle_begin = cpu->cell_first_particles[c];
+        const u32 particle_end = particle_begin + cpu->cell_particle_counts[c];
+        for (u32 k = particle_begin; k < particle_end; k++)
+        {
+            // the particle's own cell is one of them; its pair with itself is skipped for being too close
+            for (u32 n = 0; n < neighbor_cell_count; n++)
+            {
+                const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+                const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+                cpuAccumulateSpringForces<false>(cpu, params, k, neighbor_begin, neighbor_end);
+            }
+        }
+    }
+}
+
+
+/// The bounds of the particles of each of the clusters `[begin, end)`, into `CpuState::cluster_bounds`.
+static void cpuPass_computeClusterBounds(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+    const u64 particle_count = pass->s->particle_count;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u64 particle_begin = c * CPU_CLUSTER_SIZE;
+        const u64 particle_end = glm::min(particle_begin + CPU_CLUSTER_SIZE, particle_count);
+        f32* bounds = cpu->cluster_bounds + 6 * c;
+
+        for (u32 d = 0; d < 3; d++)
+        {
+            const f32* p_components = cpu->positions_sorted[d];
+
+            f32 component_min = INFINITY;
+            f32 component_max = -INFINITY;
+            for (u64 k = particle_begin; k < particle_end; k++)
+            {
+                component_min = glm::min(component_min, p_components[k]);
+                component_max = glm::max(component_max, p_components[k]);
+            }
+
+            bounds[d] = component_min;
+            bounds[3 + d] = component_max;
+        }
+    }
+}
+
+
+/// `accelerationDueToParticle()` in `fluidSim_updateParticles.comp.h`, for the pairs of each particle of cluster
+/// `cluster` with each particle of the clusters `other_clusters`, which may include `cluster` itself: adds the
+/// accelerations of the pairs to the particles of `cluster` only. With AVX2, a full cluster takes a tile of
+/// CPU_CLUSTER_SIZE by CPU_CLUSTER_SIZE pairs at a time, its own particles in the lanes and each particle of the
+/// other cluster broadcast to all of them in turn, so that the sums need no horizontal adds; the last cluster, if
+/// it isn't full, takes its pairs one at a time.
+static void cpuAccumulateClusterPairForces(
+    CpuState* cpu,
+    const SimData::Params* params,
+    const u32fast particle_count,
+    const u32 cluster,
+    const u32* other_clusters,
+    const u32 other_cluster_count
+) {
+    const f32* xs = cpu->positions_sorted[0];
+    const f32* ys = cpu->positions_sorted[1];
+    const f32* zs = cpu->positions_sorted[2];
+    f32* accel_xs = cpu->accelerations[0];
+    f32* accel_ys = cpu->accelerations[1];
+    f32* accel_zs = cpu->accelerations[2];
+
+    const f32 radius = params->particle_interaction_radius;
+    const f32 rest_length = params->spring_rest_length;
+    const f32 stiffness = params->spring_stiffness;
+    // `accelerationDueToParticle()` ignores pairs closer than this, which also leaves out each particle's pair
+    // with itself
+    const f32 min_dist = 1e-7f;
+
+    const u32 first = cluster * CPU_CLUSTER_SIZE;
+    const u32 cluster_end = (u32)glm::min((u32fast)first + CPU_CLUSTER_SIZE, particle_count);
+    const auto getClusterEnd = [&](u32 c) {
+        return (u32)glm::min((u32fast)(c + 1) * CPU_CLUSTER_SIZE, particle_count);
+    };
+
+
+    #ifdef __AVX2__
+    if (cluster_end - first == CPU_CLUSTER_SIZE)
+    {
+        const __m256 pos_x = _mm256_loadu_ps(xs + first);
+        const __m256 pos_y = _mm256_loadu_ps(ys + first);
+        const __m256 pos_z = _mm256_loadu_ps(zs + first);
+        const __m256 radius_v = _mm256_set1_ps(radius);
+        const __m256 rest_length_v = _mm256_set1_ps(rest_length);
+        const __m256 stiffness_v = _mm256_set1_ps(stiffness);
+        const __m256 min_dist_v = _mm256_set1_ps(min_dist);
+
+        __m256 accel_x = _mm256_setzero_ps();
+        __m256 accel_y = _mm256_setzero_ps();
+        __m256 accel_z = _mm256_setzero_ps();
+
+        for (u32 o = 0; o < other_cluster_count; o++)
+        {
+            const u32 other_end = getClusterEnd(other_clusters[o]);
+            for (u32 j = other_clusters[o] * CPU_CLUSTER_SIZE; j < other_end; j++)
+            {
+                const __m256 disp_x = _mm256_sub_ps(_mm256_set1_ps(xs[j]), pos_x);
+                const __m256 disp_y = _mm256_sub_ps(_mm256_set1_ps(ys[j]), pos_y);
+                const __m256 disp_z = _mm256_sub_ps(_mm256_set1_ps(zs[j]), pos_z);
+                const __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(
+                    _mm256_mul_ps(disp_x, disp_x),
+                    _mm256_add_ps(_mm256_mul_ps(disp_y, disp_y), _mm256_mul_ps(disp_z, disp_z))
+                ));
+
+                const __m256 scale =
+                    _mm256_div_ps(_mm256_mul_ps(stiffness_v, _mm256_sub_ps(dist, rest_length_v)), dist);
+                const __m256 interacts = _mm256_and_ps(
+                    _mm256_cmp_ps(dist, radius_v, _CMP_LT_OQ), _mm256_cmp_ps(dist, min_dist_v, _CMP_GE_OQ)
+                );
+                const __m256 masked_scale = _mm256_and_ps(interacts, scale);
+
+                accel_x = _mm256_add_ps(accel_x, _mm256_mul_ps(masked_scale, disp_x));
+                accel_y = _mm256_add_ps(accel_y, _mm256_mul_ps(masked_scale, disp_y));
+                accel_z = _mm256_add_ps(accel_z, _mm256_mul_ps(masked_scale, disp_z));
+            }
+        }
+
+        _mm256_storeu_ps(accel_xs + first, _mm256_add_ps(_mm256_loadu_ps(accel_xs + first), accel_x));
+        _mm256_storeu_ps(accel_ys + first, _mm256_add_ps(_mm256_loadu_ps(accel_ys + first), accel_y));
+        _mm256_storeu_ps(accel_zs + first, _mm256_add_ps(_mm256_loadu_ps(accel_zs + first), accel_z));
+        return;
+    }
+    #endif
+
+    for (u32 i = first; i < cluster_end; i++)
+    {
+        const vec3 pos(xs[i], ys[i], zs[i]);
+        vec3 accel(0.0f);
+
+        for (u32 o = 0; o < other_cluster_count; o++)
+        {
+            const u32 other_end = getClusterEnd(other_clusters[o]);
+            for (u32 j = other_clusters[o] * CPU_CLUSTER_SIZE; j < other_end; j++)
+            {
+                const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+                const f32 dist = glm::length(disp);
+
+                if (dist >= radius or dist < min_dist) continue;
+                accel += stiffness * (dist - rest_length) / dist * disp;
+            }
+        }
+
+        accel_xs[i] += accel.x;
+        accel_ys[i] += accel.y;
+        accel_zs[i] += accel.z;
+    }
+}
+
+
+/// Accumulates the spring forces on the particles of the clusters `[begin, end)` into `CpuState::accelerations`,
+/// for `SimParameters::cluster_pair_forces`. Each cluster collects the clusters with particles in the cells around
+/// its own particles' cells, keeps those whose bounds are within the interaction radius of its own, and takes them
+/// with `cpuAccumulateClusterPairForces()`, CPU_CLUSTER_PAIR_LIST_CAPACITY at a time. A cluster only writes its own
+/// particles' accelerations, so any chunks can run at the same time.
+static void cpuPass_accumulateClusterPairForces(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+    const u32fast particle_count = pass->s->particle_count;
+    const f32 radius_sq = params->particle_interaction_radius * params->particle_interaction_radius;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u32 cluster = (u32)c;
+        const u32 particle_begin = cluster * CPU_CLUSTER_SIZE;
+        const u32 particle_end = (u32)glm::min((u32fast)particle_begin + CPU_CLUSTER_SIZE, particle_count);
+
+        // The ranges of clusters of the cells around each of the cluster's cells, as (first << 32 | last), which
+        // the particles' sort order keeps to a cell or two.
+        u32 range_count = 0;
+        u64 ranges[CPU_CLUSTER_SIZE * CPU_NEIGHBOR_CELL_COUNT];
+        for (u32 k = particle_begin; k < particle_end; k++)
+        {
+            if (k != particle_begin and cpu->cell_keys[k].key == cpu->cell_keys[k - 1].key) continue;
+
+            u32 neighbor_cells[CPU_NEIGHBOR_CELL_COUNT];
+            const u32 cell = cpuFindCell(cpu, cpu->cell_keys[k].key);
+            const u32 neighbor_cell_count = cpuFindNeighborCells(cpu, params, cell, neighbor_cells);
+            for (u32 n = 0; n < neighbor_cell_count; n++)
+            {
+                const u32 first_particle = cpu->cell_first_particles[neighbor_cells[n]];
+                const u32 last_particle = first_particle + cpu->cell_particle_counts[neighbor_cells[n]] - 1;
+                ranges[range_count++] =
+                    (u64)(first_particle / CPU_CLUSTER_SIZE) << 32 | (last_particle / CPU_CLUSTER_SIZE);
+            }
+        }
+        // an insertion sort, by their first clusters, so that the overlapping ones are next to each other
+        for (u32 r = 1; r < range_count; r++)
+        {
+            const u64 range = ranges[r];
+            u32 q = r;
+            for (; q > 0 and ranges[q - 1] > range; q--) ranges[q] = ranges[q - 1];
+            ranges[q] = range;
+        }
+
+        const f32* bounds = cpu->cluster_bounds + 6 * cluster;
+        u32 pair_count = 0;
+        u32 pair_list[CPU_CLUSTER_PAIR_LIST_CAPACITY];
+        u32 next_cluster = 0; // past the clusters already taken, since the ranges can overlap
+        for (u32 r = 0; r < range_count; r++)
+        {
+            const u32 range_last = (u32)ranges[r];
+            for (u32 other = glm::max((u32)(ranges[r] >> 32), next_cluster); other <= range_last; other++)
+            {
+                // the distance between the bounds of the two clusters
+                const f32* other_bounds = cpu->cluster_bounds + 6 * other;
+                f32 gap_sq = 0.0f;
+                for (u32 d = 0; d < 3; d++)
+                {
+                    const f32 gap = glm::max(
+                        glm::max(other_bounds[d] - bounds[3 + d], bounds[d] - other_bounds[3 + d]), 0.0f
+                    );
+                    gap_sq += gap * gap;
+                }
+                if (gap_sq >= radius_sq) continue;
+
+                pair_list[pair_count++] = other;
+                if (pair_count == CPU_CLUSTER_PAIR_LIST_CAPACITY)
+                {
+                    cpuAccumulateClusterPairForces(cpu, params, particle_count, cluster, pair_list, pair_count);
+                    pair_count = 0;
+                }
+            }
+            next_cluster = glm::max(next_cluster, range_last + 1);
+        }
+        cpuAccumulateClusterPairForces(cpu, params, particle_count, cluster, pair_list, pair_count);
+    }
+}
+
+
+/// Same as `sphPressureTerm()` in `fluidSim_updateParticles.comp.h`.
+static f32 cpuSphPressureTerm(const SimData::Params* params, f32 density) {
+    return params->sph_stiffness * glm::max(density - params->rest_particle_density, 0.0f) / (density * density);
+}
+
+
+/// The SPH density of each particle of the cells `[begin, end)`, into `CpuState::densities`. Also stores the
+/// cells' neighbor cells, for `cpuPass_updateParticles()`.
+static void cpuPass_computeDensities(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    const f32* xs = cpu->positions_sorted[0];
+    const f32* ys = cpu->positions_sorted[1];
+    const f32* zs = cpu->positions_sorted[2];
+    const f32 radius_sq = params->particle_interaction_radius * params->particle_interaction_radius;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        u32* neighbor_cells = &cpu->cell_neighbor_cells[c * CPU_NEIGHBOR_CELL_COUNT];
+        const u32 neighbor_cell_count = cpuFindNeighborCells(cpu, params, (u32)c, neighbor_cells);
+        cpu->cell_neighbor_cell_counts[c] = neighbor_cell_count;
+
+        const u32 first_particle_idx = cpu->cell_first_particles[c];
+        const u32 particle_end = first_particle_idx + cpu->cell_particle_counts[c];
+
+        for (u32 k = first_particle_idx; k < particle_end; k++)
+        {
+            const vec3 pos(xs[k], ys[k], zs[k]);
+
+            // same as `sphDensityKernel()`; the particle itself counts too
+            f32 density = 0.0f;
+            for (u32 n = 0; n < neighbor_cell_count; n++)
+            {
+                const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+                const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+                for (u32 j = neighbor_begin; j < neighbor_end; j++)
+                {
+                    const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+                    const f32 d = radius_sq - glm::dot(disp, disp);
+                    if (d > 0.0f) density += d * d * d;
+                }
+            }
+            cpu->densities[k] = params->sph_density_kernel_coefficient * density;
+        }
+    }
+}
+
+
+/// Same as `interactionWithParticle()` in the SPH_PASS_FORCES pass, summed over the particles of
+/// `neighbor_cells` other than the sorted particle `k`.
+static vec3 cpuSphAcceleration(
+    const CpuState* cpu,
+    const SimData::Params* params,
+    const u32 k,
+    const u32* neighbor_cells,
+    const u32 neighbor_cell_count
+) {
+    const f32* xs = cpu->positions_sorted[0];
+    const f32* ys = cpu->positions_sorted[1];
+    const f32* zs = cpu->positions_sorted[2];
+
+    const f32 radius = params->particle_interaction_radius;
+    const vec3 pos(xs[k], ys[k], zs[k]);
+    const vec3 velocity(cpu->velocities_sorted[0][k], cpu->velocities_sorted[1][k], cpu->velocities_sorted[2][k]);
+    const f32 pressure_term = cpuSphPressureTerm(params, cpu->densities[k]);
+
+    vec3 accel(0.0f);
+    for (u32 n = 0; n < neighbor_cell_count; n++)
+    {
+        const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+        const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+        for (u32 j = neighbor_begin; j < neighbor_end; j++)
+        {
+            if (j == k) continue;
+
+            const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+            const f32 dist_sq = glm::dot(disp, disp);
+            if (dist_sq >= radius * radius) continue;
+
+            const f32 other_density = cpu->densities[j];
+            const f32 dist = sqrtf(dist_sq);
+            if (dist >= 1e-7f)
+            {
+                const f32 radius_minus_dist = radius - dist;
+                accel -= (pressure_term + cpuSphPressureTerm(params, other_density))
+                    * params->sph_gradient_kernel_coefficient * radius_minus_dist * radius_minus_dist / dist * disp;
+            }
+
+            const f32 d = radius * radius - dist_sq;
+            const f32 kernel = params->sph_density_kernel_coefficient * d * d * d;
+            const vec3 other_velocity(
+                cpu->velocities_sorted[0][j], cpu->velocities_sorted[1][j], cpu->velocities_sorted[2][j]
+            );
+            accel += params->sph_viscosity * kernel / other_density * (other_velocity - velocity);
+        }
+    }
+
+    return accel;
+}
+
+
+/// The predicted positions of the sorted particles `[begin, end)`, into `CpuState::pbf_positions[0]`; same as the
+/// SPH_PASS_PBF_PREDICT pass of `fluidSim_solveDensityConstraints.comp`.
+static void cpuPass_predictPbfPositions(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+    const f32 delta_t = pass->delta_t;
+    const f32 velocity_factor = delta_t * (1.0f - 0.5f * delta_t); // the integration, without an acceleration
+
+    for (u32 d = 0; d < 3; d++)
+    {
+        const f32* positions = cpu->positions_sorted[d];
+        const f32* velocities = cpu->velocities_sorted[d];
+        f32* predicted = cpu->pbf_positions[0][d];
+        for (u64 k = begin; k < end; k++) predicted[k] = positions[k] + velocity_factor * velocities[k];
+    }
+}
+
+
+/// Same as the kernel gradient of `pbfInteractionWithParticle()` in `fluidSim_updateParticles.comp.h`, for a pair
+/// `disp` apart within the interaction radius.
+static vec3 cpuPbfKernelGradient(const SimData::Params* params, const vec3 disp, const f32 dist_sq) {
+
+    const f32 dist = sqrtf(dist_sq);
+    if (dist < 1e-7f) return vec3(0.0f);
+
+    const f32 radius_minus_dist = params->particle_interaction_radius - dist;
+    return params->sph_gradient_kernel_coefficient * radius_minus_dist * radius_minus_dist / dist * disp;
+}
+
+
+/// The PBF constraint multiplier of each particle of the cells `[begin, end)`, at the predicted positions of
+/// `CpuPass::pbf_read_half`, into `CpuState::densities`; same as the SPH_PASS_PBF_MULTIPLIERS pass. With
+/// `CpuPass::pbf_find_neighbor_cells`, also stores the cells' neighbor cells, for the passes after it.
+static void cpuPass_computePbfMultipliers(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    const f32* xs = cpu->pbf_positions[pass->pbf_read_half][0];
+    const f32* ys = cpu->pbf_positions[pass->pbf_read_half][1];
+    const f32* zs = cpu->pbf_positions[pass->pbf_read_half][2];
+    const f32 radius_sq = params->particle_interaction_radius * params->particle_interaction_radius;
+    const f32 rest_density_reciprocal = 1.0f / params->rest_particle_density;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        u32* neighbor_cells = &cpu->cell_neighbor_cells[c * CPU_NEIGHBOR_CELL_COUNT];
+        if (pass->pbf_find_neighbor_cells)
+        {
+            cpu->cell_neighbor_cell_counts[c] = cpuFindNeighborCells(cpu, params, (u32)c, neighbor_cells);
+        }
+        const u32 neighbor_cell_count = cpu->cell_neighbor_cell_counts[c];
+
+        const u32 first_particle_idx = cpu->cell_first_particles[c];
+        const u32 particle_end = first_particle_idx + cpu->cell_particle_counts[c];
+
+        for (u32 k = first_particle_idx; k < particle_end; k++)
+        {
+            const vec3 pos(xs[k], ys[k], zs[k]);
+
+            // the particle itself counts towards the density, and has no gradient
+            f32 density = 0.0f;
+            vec3 gradient_sum(0.0f);
+            f32 gradient_sq_sum = 0.0f;
+            for (u32 n = 0; n < neighbor_cell_count; n++)
+            {
+                const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+                const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+                for (u32 j = neighbor_begin; j < neighbor_end; j++)
+                {
+                    const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+                    const f32 dist_sq = glm::dot(disp, disp);
+                    const f32 d = radius_sq - dist_sq;
+                    if (d <= 0.0f) continue;
+
+                    density += d * d * d;
+                    const vec3 gradient = cpuPbfKernelGradient(params, disp, dist_sq);
+                    gradient_sum += gradient;
+                    gradient_sq_sum += glm::dot(gradient, gradient);
+                }
+            }
+            density *= params->sph_density_kernel_coefficient;
+
+            const f32 constraint = glm::max(density * rest_density_reciprocal - 1.0f, 0.0f);
+            const f32 constraint_gradient_sq_sum = (glm::dot(gradient_sum, gradient_sum) + gradient_sq_sum)
+                * rest_density_reciprocal * rest_density_reciprocal;
+            cpu->densities[k] = (constraint > 0.0f)
+                ? -constraint / (constraint_gradient_sq_sum + params->pbf_relaxation_epsilon)
+                : 0.0f;
+        }
+    }
+}
+
+
+/// Moves the predicted positions of the particles of the cells `[begin, end)` of `CpuPass::pbf_read_half` by the
+/// multipliers, into the other half; same as the SPH_PASS_PBF_CORRECT pass.
+static void cpuPass_correctPbfPositions(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    const f32* xs = cpu->pbf_positions[pass->pbf_read_half][0];
+    const f32* ys = cpu->pbf_positions[pass->pbf_read_half][1];
+    const f32* zs = cpu->pbf_positions[pass->pbf_read_half][2];
+    f32* const* corrected = cpu->pbf_positions[1 - pass->pbf_read_half];
+    const f32 radius_sq = params->particle_interaction_radius * params->particle_interaction_radius;
+    const f32 rest_density_reciprocal = 1.0f / params->rest_particle_density;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u32* neighbor_cells = &cpu->cell_neighbor_cells[c * CPU_NEIGHBOR_CELL_COUNT];
+        const u32 neighbor_cell_count = cpu->cell_neighbor_cell_counts[c];
+
+        const u32 first_particle_idx = cpu->cell_first_particles[c];
+        const u32 particle_end = first_particle_idx + cpu->cell_particle_counts[c];
+
+        for (u32 k = first_particle_idx; k < particle_end; k++)
+        {
+            const vec3 pos(xs[k], ys[k], zs[k]);
+            const f32 multiplier = cpu->densities[k];
+
+            vec3 correction(0.0f);
+            for (u32 n = 0; n < neighbor_cell_count; n++)
+            {
+                const u32 neighbor_begin = cpu->cell_first_particles[neighbor_cells[n]];
+                const u32 neighbor_end = neighbor_begin + cpu->cell_particle_counts[neighbor_cells[n]];
+                for (u32 j = neighbor_begin; j < neighbor_end; j++)
+                {
+                    if (j == k) continue;
+
+                    const vec3 disp = vec3(xs[j], ys[j], zs[j]) - pos;
+                    const f32 dist_sq = glm::dot(disp, disp);
+                    if (dist_sq >= radius_sq) continue;
+
+                    correction += (multiplier + cpu->densities[j]) * cpuPbfKernelGradient(params, disp, dist_sq);
+                }
+            }
+
+            const vec3 corrected_pos = pos + rest_density_reciprocal * correction;
+            for (glm::length_t d = 0; d < 3; d++) corrected[d][k] = corrected_pos[d];
+        }
+    }
+}
+
+
+/// The partials of `cpuPass_updateParticles()`; see `SimData::TimeStep`.
+struct CpuMaxMotion {
+    f32 speed;
+    f32 acceleration;
+};
+
+static void cpuPass_combineMaxMotion(void*, void* p_accum, const void* p_partial) {
+
+    CpuMaxMotion* accum = (CpuMaxMotion*)p_accum;
+    const CpuMaxMotion* partial = (const CpuMaxMotion*)p_partial;
+
+    accum->speed = glm::max(accum->speed, partial->speed);
+    accum->acceleration = glm::max(accum->acceleration, partial->acceleration);
+}
+
+
+/// Updates the particles of the cells `[begin, end)`, and accumulates their max speed and acceleration into the
+/// `CpuMaxMotion` at `p_partial`. Writes the particles in sorted order, to the unsorted arrays and to the staging
+/// buffer.
+static void cpuPass_updateParticles(void* p_ctx, u64 begin, u64 end, void* p_partial) {
+
+    ZoneScopedTask;
+
+    CpuMaxMotion* max_motion = (CpuMaxMotion*)p_partial;
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData* s = pass->s;
+    CpuState* cpu = &pass->s->cpu_state;
+    const f32 delta_t = pass->delta_t;
+
+    vec4* p_staging_positions = (vec4*)getMappedPointer(&cpu->buffer_positions_staging);
+    const bool pbf = s->parameters.pbf;
+    const bool sph = s->parameters.sph and !pbf;
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u32 first_particle_idx = cpu->cell_first_particles[c];
+        const u32 particle_end = first_particle_idx + cpu->cell_particle_counts[c];
+
+        // In the SPH mode, `cpuPass_computeDensities()` looked up the neighbor cells, once per cell; otherwise,
+        // `cpuPass_accumulateSpringForces()` already summed the accelerations, or the PBF passes moved the
+        // predicted positions, and they aren't read.
+        const u32 neighbor_cell_count = sph ? cpu->cell_neighbor_cell_counts[c] : 0;
+        const u32* neighbor_cells = &cpu->cell_neighbor_cells[c * CPU_NEIGHBOR_CELL_COUNT];
+
+        for (u32 k = first_particle_idx; k < particle_end; k++)
+        {
+            const vec3 pos(
+                cpu->positions_sorted[0][k], cpu->positions_sorted[1][k], cpu->positions_sorted[2][k]
+            );
+            const vec3 old_velocity(
+                cpu->velocities_sorted[0][k], cpu->velocities_sorted[1][k], cpu->velocities_sorted[2][k]
+            );
+
+            vec3 accel;
+            if (pbf)
+            {
+                // same as `pbfAcceleration()`
+                const f32* const* predicted = cpu->pbf_positions[pass->pbf_read_half];
+                const vec3 predicted_pos(predicted[0][k], predicted[1][k], predicted[2][k]);
+                accel = (predicted_pos - pos) / (delta_t * delta_t) - (1.0f / delta_t - 0.5f) * old_velocity;
+            }
+            else if (sph)
+            {
+                accel = cpuSphAcceleration(cpu, &s->parameters, k, neighbor_cells, neighbor_cell_count);
+            }
+            else
+            {
+                accel = vec3(cpu->accelerations[0][k], cpu->accelerations[1][k], cpu->accelerations[2][k]);
+            }
+
+            // same integration as `finishParticleUpdate()`
+            vec3 new_velocity = old_velocity;
+            new_velocity += accel * delta_t;
+            new_velocity -= 0.5f * delta_t * old_velocity; // damping
+
+            const vec3 new_pos = pos + delta_t * new_velocity;
+            const f32 attribute = cpu->attributes_sorted[k];
+
+            max_motion->speed = glm::max(max_motion->speed, glm::length(new_velocity));
+            max_motion->acceleration = glm::max(max_motion->acceleration, glm::length(accel));
+
+            for (glm::length_t d = 0; d < 3; d++)
+            {
+                cpu->positions[d][k] = new_pos[d];
+                cpu->velocities[d][k] = new_velocity[d];
+            }
+            cpu->attributes[k] = attribute;
+            p_staging_positions[k] = vec4(new_pos, attribute);
+        }
+    }
+}
+
+
+// `SimParameters::hybrid_gpu_update`: the GPU's share of the particles in the first step, the bounds that keep
+// both sides busy enough to be measured, and how far each step moves the share toward the one that would have
+// balanced it, so that one noisy step doesn't throw it off.
+constexpr f32 HYBRID_INITIAL_GPU_FRACTION = 0.5f;
+constexpr f32 HYBRID_MIN_GPU_FRACTION = 1.0f / 16.0f;
+constexpr f32 HYBRID_MAX_GPU_FRACTION = 15.0f / 16.0f;
+constexpr f32 HYBRID_TUNING_RATE = 0.25f;
+
+/// Must match `HybridCell` in fluidSim_hybridUpdate.comp.
+struct HybridCell {
+    u32 neighbor_count;
+    u32 pad_;
+    uvec2 neighbors[CPU_NEIGHBOR_CELL_COUNT]; // (first sorted particle, particle count)
+};
+static_assert(sizeof(HybridCell) == 2 * sizeof(u32) + CPU_NEIGHBOR_CELL_COUNT * sizeof(uvec2));
+
+/// Must match `PushConstants` in fluidSim_hybridUpdate.comp.
+struct HybridPushConstants {
+    u32 first_particle;
+    u32 particle_count;
+    u32 halo_first_particle;
+    f32 delta_t;
+    f32 particle_interaction_radius;
+    f32 spring_rest_length;
+    f32 spring_stiffness;
+};
+
+// of `CpuState::Hybrid::buffer_results`, before the particles
+constexpr VkDeviceSize HYBRID_RESULTS_HEADER_SIZE = 4 * sizeof(u32);
+
+
+static u64 nowNs(void) {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000 + (u64)time.tv_nsec;
+}
+
+
+/// Writes the `HybridCell` of each of the GPU's cells `[begin, end)`, and the cell and the velocity of each of
+/// their particles, and lowers the u32 at `p_partial` to the first sorted particle of the cells around them.
+static void cpuPass_writeHybridCells(void* p_ctx, u64 begin, u64 end, void* p_partial) {
+
+    ZoneScopedTask;
+
+    u32* halo_first_particle = (u32*)p_partial;
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const SimData::Params* params = &pass->s->parameters;
+    const CpuState* cpu = &pass->s->cpu_state;
+
+    HybridCell* cells = (HybridCell*)getMappedPointer(&cpu->hybrid.buffer_cells);
+    u32* particle_cells = (u32*)getMappedPointer(&cpu->hybrid.buffer_particle_cells);
+    vec4* velocities = (vec4*)getMappedPointer(&cpu->hybrid.buffer_velocities);
+
+    for (u64 c = begin; c < end; c++)
+    {
+        const u32 gpu_cell = (u32)c - pass->hybrid_split_cell;
+
+        u32 neighbor_cells[CPU_NEIGHBOR_CELL_COUNT];
+        const u32 neighbor_cell_count = cpuFindNeighborCells(cpu, params, (u32)c, neighbor_cells);
+
+        // only the neighbors that exist, since the buffer may be across the bus
+        HybridCell* cell = &cells[gpu_cell];
+        cell->neighbor_count = neighbor_cell_count;
+        for (u32 n = 0; n < neighbor_cell_count; n++)
+        {
+            const u32 neighbor_first_particle = cpu->cell_first_particles[neighbor_cells[n]];
+            cell->neighbors[n] = uvec2(neighbor_first_particle, cpu->cell_particle_counts[neighbor_cells[n]]);
+            *halo_first_particle = glm::min(*halo_first_particle, neighbor_first_particle);
+        }
+
+        const u32 particle_begin = cpu->cell_first_particles[c];
+        const u32 particle_end = particle_begin + cpu->cell_particle_counts[c];
+        for (u32 k = particle_begin; k < particle_end; k++)
+        {
+            const u32 gpu_particle = k - pass->hybrid_first_particle;
+            particle_cells[gpu_particle] = gpu_cell;
+            velocities[gpu_particle] = vec4(
+                cpu->velocities_sorted[0][k], cpu->velocities_sorted[1][k], cpu->velocities_sorted[2][k], 0.0f
+            );
+        }
+    }
+}
+
+static void cpuPass_combineMinParticle(void*, void* p_accum, const void* p_partial) {
+
+    u32* accum = (u32*)p_accum;
+    *accum = glm::min(*accum, *(const u32*)p_partial);
+}
+
+
+/// Writes the sorted particles `[begin, end)`, which are from `CpuPass::hybrid_halo_first_particle` on, for the
+/// GPU.
+static void cpuPass_writeHybridPositions(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    const CpuState* cpu = &pass->s->cpu_state;
+
+    vec4* positions = (vec4*)getMappedPointer(&cpu->hybrid.buffer_positions);
+    for (u64 k = begin; k < end; k++)
+    {
+        positions[k - pass->hybrid_halo_first_particle] = vec4(
+            cpu->positions_sorted[0][k], cpu->positions_sorted[1][k], cpu->positions_sorted[2][k],
+            cpu->attributes_sorted[k]
+        );
+    }
+}
+
+
+/// Copies the GPU's updated particles, of the sorted particles `[begin, end)`, to where
+/// `cpuPass_updateParticles()` writes the host's.
+static void cpuPass_readHybridResults(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const CpuPass* pass = (const CpuPass*)p_ctx;
+    CpuState* cpu = &pass->s->cpu_state;
+
+    const vec4* results =
+        (const vec4*)((const u8*)getMappedPointer(&cpu->hybrid.buffer_results) + HYBRID_RESULTS_HEADER_SIZE);
+    vec4* p_staging_positions = (vec4*)getMappedPointer(&cpu->buffer_positions_staging);
+
+    for (u64 k = begin; k < end; k++)
+    {
+        const u32 gpu_particle = (u32)k - pass->hybrid_first_particle;
+        const vec4 pos = results[2 * gpu_particle];
+        const vec4 velocity = results[2 * gpu_particle + 1];
+
+        for (glm::length_t d = 0; d < 3; d++)
+        {
+            cpu->positions[d][k] = pos[d];
+            cpu->velocities[d][k] = velocity[d];
+        }
+        cpu->attributes[k] = pos.w;
+        p_staging_positions[k] = pos;
+    }
+}
+
+
+/// A storage buffer of `CpuState::Hybrid`: host-visible and written sequentially by the host, or, if `readback`,
+/// host-cached and read by it.
+static void createHybridBuffer(const VulkanContext* vk_ctx, VkDeviceSize size, bool readback, GpuBuffer* buffer_out) {
+
+    const VkBufferCreateInfo buffer_info {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | (readback ? VK_BUFFER_USAGE_TRANSFER_DST_BIT : 0u),
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk_ctx->compute_queue_family_index,
+    };
+    // Without a preference, the uploads may go to device-local memory that the host can write (resizable BAR).
+    const VmaAllocationCreateInfo alloc_info {
+        .flags = (
+            readback
+            ? VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+            : VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+        ) | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = readback ? VMA_MEMORY_USAGE_AUTO_PREFER_HOST : VMA_MEMORY_USAGE_AUTO,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    };
+    const VkResult result = vmaCreateBuffer(
+        vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+        &buffer_out->buffer, &buffer_out->allocation, &buffer_out->allocation_info
+    );
+    assertVk(result);
+}
+
+
+static void writeHybridDescriptorSet(const CpuState::Hybrid* hybrid, const VulkanContext* vk_ctx) {
+
+    const GpuBuffer* buffers[5] {
+        &hybrid->buffer_positions,
+        &hybrid->buffer_velocities,
+        &hybrid->buffer_particle_cells,
+        &hybrid->buffer_cells,
+        &hybrid->buffer_results,
+    };
+
+    VkDescriptorBufferInfo buffer_infos[ARRAY_SIZE(buffers)] {};
+    VkWriteDescriptorSet writes[ARRAY_SIZE(buffers)] {};
+    for (u32 i = 0; i < ARRAY_SIZE(buffers); i++)
+    {
+        buffer_infos[i] = { .buffer = buffers[i]->buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = hybrid->descriptor_set,
+            .dstBinding = i,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffer_infos[i],
+        };
+    }
+    vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+
+/// Recreates `CpuState::Hybrid::buffer_cells` for at least `cell_count` cells, if it's smaller. The GPU must be
+/// done with it.
+static void reserveHybridCells(SimData* s, const VulkanContext* vk_ctx, u32 cell_count) {
+
+    CpuState::Hybrid* hybrid = &s->cpu_state.hybrid;
+    if (cell_count <= hybrid->cell_capacity) return;
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    GpuBuffer* buffer = &hybrid->buffer_cells;
+    res->buffer_memory_size -= buffer->allocation_info.size;
+    vmaDestroyBuffer(vk_ctx->vma_allocator, buffer->buffer, buffer->allocation);
+
+    // twice as many, so that a growing sim doesn't recreate it every step
+    hybrid->cell_capacity = glm::max(cell_count, 2 * hybrid->cell_capacity);
+    createHybridBuffer(vk_ctx, hybrid->cell_capacity * sizeof(HybridCell), false, buffer);
+    res->buffer_memory_size += buffer->allocation_info.size;
+
+    writeHybridDescriptorSet(hybrid, vk_ctx);
+}
+
+
+/// `SimParameters::hybrid_gpu_update`: the buffers, the pipeline and its descriptor set, the command buffer and
+/// the query pool. After `createCpuBackendBuffers()`.
+static void createCpuHybrid(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    CpuState::Hybrid* hybrid = &s->cpu_state.hybrid;
+    GpuResources* res = &s->gpu_resources;
+    const u64 capacity = s->particle_capacity;
+
+    hybrid->enabled = true;
+    hybrid->gpu_fraction = HYBRID_INITIAL_GPU_FRACTION;
+
+    createHybridBuffer(vk_ctx, capacity * sizeof(vec4), false, &hybrid->buffer_positions);
+    createHybridBuffer(vk_ctx, capacity * sizeof(vec4), false, &hybrid->buffer_velocities);
+    createHybridBuffer(vk_ctx, capacity * sizeof(u32), false, &hybrid->buffer_particle_cells);
+    // grown by `reserveHybridCells()`; a cell per 8 particles to start with
+    hybrid->cell_capacity = (u32)glm::max(capacity / 8, (u64)1);
+    createHybridBuffer(vk_ctx, hybrid->cell_capacity * sizeof(HybridCell), false, &hybrid->buffer_cells);
+    createHybridBuffer(
+        vk_ctx, HYBRID_RESULTS_HEADER_SIZE + 2 * capacity * sizeof(vec4), true, &hybrid->buffer_results
+    );
+    res->buffer_memory_size += hybrid->buffer_positions.allocation_info.size
+        + hybrid->buffer_velocities.allocation_info.size + hybrid->buffer_particle_cells.allocation_info.size
+        + hybrid->buffer_cells.allocation_info.size + hybrid->buffer_results.allocation_info.size;
+
+    {
+        using descriptor_management::DescriptorSetLayout;
+
+        VkDescriptorSetLayoutBinding layout_bindings[5] {};
+        for (u32 i = 0; i < ARRAY_SIZE(layout_bindings); i++)
+        {
+            layout_bindings[i] = VkDescriptorSetLayoutBinding {
+                .binding = i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            };
+        }
+        const DescriptorSetLayout layout_info {
+            .binding_count = ARRAY_SIZE(layout_bindings),
+            .p_bindings = layout_bindings,
+        };
+        const u32 descriptor_set_count = 1;
+        descriptor_management::createDescriptorPoolAndSets(
+            vk_ctx, 1, &layout_info, &descriptor_set_count,
+            &hybrid->descriptor_pool, &hybrid->descriptor_set_layout, &hybrid->descriptor_set
+        );
+        writeHybridDescriptorSet(hybrid, vk_ctx);
+    }
+
+    // the shader uses none of the others
+    const ComputeShaderSpecializationConstants specialization_constants { .local_size_x = DEFAULT_WORKGROUP_SIZE };
+    createComputePipeline(
+        vk_ctx,
+        "build/shaders/fluidSim_hybridUpdate.comp.spv",
+        &specialization_constants,
+        hybrid->descriptor_set_layout,
+        sizeof(HybridPushConstants),
+        &hybrid->pipeline,
+        &hybrid->pipeline_layout
+    );
+
+    {
+        const VkCommandBufferAllocateInfo alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = res->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        const VkResult result =
+            vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &alloc_info, &hybrid->command_buffer);
+        assertVk(result);
+    }
+
+    // without timestamps, the GPU's side is timed on the host; see `cpuHybridUpdate()`
+    hybrid->query_pool = VK_NULL_HANDLE;
+    if (vk_ctx->physical_device_properties.limits.timestampComputeAndGraphics)
+    {
+        const VkQueryPoolCreateInfo query_pool_info {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+        };
+        const VkResult result =
+            vk_ctx->procs_dev.CreateQueryPool(vk_ctx->device, &query_pool_info, NULL, &hybrid->query_pool);
+        assertVk(result);
+    }
+}
+
+
+/// Frees what `createCpuHybrid()` created, except for the command buffer, which goes with
+/// `GpuResources::command_pool`. The GPU must be done with it.
+static void destroyCpuHybrid(const CpuState::Hybrid* hybrid, const VulkanContext* vk_ctx) {
+
+    const GpuBuffer* buffers[] {
+        &hybrid->buffer_positions,
+        &hybrid->buffer_velocities,
+        &hybrid->buffer_particle_cells,
+        &hybrid->buffer_cells,
+        &hybrid->buffer_results,
+    };
+    for (const GpuBuffer* buffer : buffers) vmaDestroyBuffer(vk_ctx->vma_allocator, buffer->buffer, buffer->allocation);
+
+    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, hybrid->pipeline, NULL);
+    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, hybrid->pipeline_layout, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorPool(vk_ctx->device, hybrid->descriptor_pool, NULL);
+    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, hybrid->descriptor_set_layout, NULL);
+    vk_ctx->procs_dev.DestroyQueryPool(vk_ctx->device, hybrid->query_pool, NULL);
+}
+
+
+/// Records and submits the GPU's side of `cpuHybridUpdate()`, which signals the next timeline value.
+static void submitHybridUpdate(const SimData* s, const VulkanContext* vk_ctx, GpuResources* res, const CpuPass* pass) {
+
+    ZoneScoped;
+
+    const CpuState::Hybrid* hybrid = &s->cpu_state.hybrid;
+    const u32 gpu_particle_count = (u32)s->particle_count - pass->hybrid_first_particle;
+    const VkCommandBuffer command_buffer = hybrid->command_buffer;
+
+    VkResult result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
+    assertVk(result);
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+    assertVk(result);
+    {
+        if (hybrid->query_pool != VK_NULL_HANDLE)
+        {
+            vk_ctx->procs_dev.CmdResetQueryPool(command_buffer, hybrid->query_pool, 0, 2);
+            vk_ctx->procs_dev.CmdWriteTimestamp(
+                command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, hybrid->query_pool, 0
+            );
+        }
+
+        const HybridPushConstants push_constants {
+            .first_particle = pass->hybrid_first_particle,
+            .particle_count = gpu_particle_count,
+            .halo_first_particle = pass->hybrid_halo_first_particle,
+            .delta_t = pass->delta_t,
+            .particle_interaction_radius = s->parameters.particle_interaction_radius,
+            .spring_rest_length = s->parameters.spring_rest_length,
+            .spring_stiffness = s->parameters.spring_stiffness,
+        };
+        const VkBuffer results = hybrid->buffer_results.buffer;
+        const VkDeviceSize results_size = HYBRID_RESULTS_HEADER_SIZE + 2 * gpu_particle_count * sizeof(vec4);
+
+        // The host wrote the other buffers before the submission, which makes its writes visible.
+        pass_graph::Graph graph {};
+        pass_graph::addFill(&graph, results, 0, HYBRID_RESULTS_HEADER_SIZE, 0);
+        pass_graph::addDispatch(
+            &graph, hybrid->pipeline, hybrid->pipeline_layout, hybrid->descriptor_set,
+            sizeof(push_constants), &push_constants,
+            (gpu_particle_count + DEFAULT_WORKGROUP_SIZE - 1) / DEFAULT_WORKGROUP_SIZE
+        );
+        pass_graph::writes(&graph, results, 0, results_size);
+        pass_graph::addHostRead(&graph, results, 0, results_size);
+        pass_graph::record(&graph, vk_ctx, command_buffer, 0, 0);
+
+        if (hybrid->query_pool != VK_NULL_HANDLE)
+        {
+            vk_ctx->procs_dev.CmdWriteTimestamp(
+                command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, hybrid->query_pool, 1
+            );
+        }
+    }
+    result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+    assertVk(result);
+
+    const u64 signal_value = ++res->timeline_value;
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &signal_value,
+    };
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &res->timeline_semaphore,
+    };
+    result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+    assertVk(result);
+}
+
+
+/// The particle update of a spring-mode step with `SimParameters::hybrid_gpu_update`, once the cells are built,
+/// instead of the spring passes and `cpuPass_updateParticles()`. The cells are in the order of their codes, so
+/// those from `split_cell` on are a contiguous range of space; they have `CpuState::Hybrid::gpu_fraction` of the
+/// particles, give or take a cell, and go to the GPU. The host writes them, their velocities, and the positions
+/// of the particles from the first one that they see (the halo: the particles of the cells just before
+/// `split_cell` in space, which are mostly just before it in the order too) to host-visible memory, and submits
+/// fluidSim_hybridUpdate.comp over them. Meanwhile the pool's threads update the cells before `split_cell`, each
+/// particle summing all of its pairs, since the pairs across the split are taken by both sides. Then the GPU's
+/// results are copied to the arrays, and `gpu_fraction` moves toward the split that would have had both sides
+/// finish together, from their measured rates.
+static void cpuHybridUpdate(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    CpuPass* pass,
+    CpuMaxMotion* p_max_motion_out
+) {
+
+    ZoneScoped;
+
+    CpuState* cpu = &s->cpu_state;
+    CpuState::Hybrid* hybrid = &cpu->hybrid;
+    GpuResources* res = &s->gpu_resources;
+    const u32 particle_count = (u32)s->particle_count;
+
+    // the first cell that starts at or after the CPU's share of the particles
+    const u32 target_cpu_particle_count = (u32)((1.0f - hybrid->gpu_fraction) * (f32)particle_count);
+    u32 split_cell = 0;
+    u32 hi = cpu->cell_count;
+    while (split_cell < hi)
+    {
+        const u32 mid = split_cell + (hi - split_cell) / 2;
+        if (cpu->cell_first_particles[mid] < target_cpu_particle_count) split_cell = mid + 1;
+        else hi = mid;
+    }
+    const u32 gpu_first_particle =
+        (split_cell < cpu->cell_count) ? cpu->cell_first_particles[split_cell] : particle_count;
+    const u32 gpu_particle_count = particle_count - gpu_first_particle;
+    const u32 cpu_particle_count = gpu_first_particle;
+
+    pass->hybrid_split_cell = split_cell;
+    pass->hybrid_first_particle = gpu_first_particle;
+    pass->hybrid_halo_first_particle = gpu_first_particle;
+
+    u64 gpu_submit_time_ns = 0;
+    if (gpu_particle_count > 0)
+    {
+        ZoneScopedN("WriteHybridHalo");
+
+        // the last step's submission has finished, with the copy after it
+        reserveHybridCells(s, vk_ctx, cpu->cell_count - split_cell);
+
+        u32 halo_first_particle = gpu_first_particle;
+        thread_pool::parallelReduce(
+            thread_pool, split_cell, cpu->cell_count, CPU_CELL_GRAIN,
+            cpuPass_writeHybridCells, cpuPass_combineMinParticle, pass,
+            &halo_first_particle, sizeof(halo_first_particle)
+        );
+        pass->hybrid_halo_first_particle = halo_first_particle;
+        thread_pool::parallelFor(
+            thread_pool, halo_first_particle, particle_count, CPU_PARTICLE_GRAIN, cpuPass_writeHybridPositions, pass
+        );
+
+        const GpuBuffer* uploads[] {
+            &hybrid->buffer_positions,
+            &hybrid->buffer_velocities,
+            &hybrid->buffer_particle_cells,
+            &hybrid->buffer_cells,
+        };
+        const VkDeviceSize upload_sizes[ARRAY_SIZE(uploads)] {
+            (particle_count - halo_first_particle) * sizeof(vec4),
+            gpu_particle_count * sizeof(vec4),
+            gpu_particle_count * sizeof(u32),
+            (cpu->cell_count - split_cell) * sizeof(HybridCell),
+        };
+        for (u32 i = 0; i < ARRAY_SIZE(uploads); i++)
+        {
+            const VkResult result =
+                vmaFlushAllocation(vk_ctx->vma_allocator, uploads[i]->allocation, 0, upload_sizes[i]);
+            assertVk(result);
+            s->uploaded_byte_count += upload_sizes[i];
+            countTransfer(&s->transfers, TRANSFER_PARTICLES, false, upload_sizes[i]);
+        }
+
+        gpu_submit_time_ns = nowNs();
+        submitHybridUpdate(s, vk_ctx, res, pass);
+    }
+
+    const u64 cpu_begin_time_ns = nowNs();
+    CpuMaxMotion max_motion { .speed = 0.0f, .acceleration = 0.0f };
+    {
+        ZoneScopedN("CpuSide");
+
+        thread_pool::parallelFor(thread_pool, 0, split_cell, CPU_CELL_GRAIN, cpuPass_gatherSpringForces, pass);
+        thread_pool::parallelReduce(
+            thread_pool, 0, split_cell, CPU_CELL_GRAIN,
+            cpuPass_updateParticles, cpuPass_combineMaxMotion, pass, &max_motion, sizeof(max_motion)
+        );
+    }
+    const f64 cpu_seconds = (f64)(nowNs() - cpu_begin_time_ns) * 1e-9;
+
+    f64 gpu_seconds = 0.0;
+    if (gpu_particle_count > 0)
+    {
+        {
+            ZoneScopedN("WaitForGpuSide");
+            waitForTimelineValue(vk_ctx, res, res->timeline_value);
+        }
+        // An upper bound without timestamps: the GPU may have finished before the host started waiting.
+        gpu_seconds = (f64)(nowNs() - gpu_submit_time_ns) * 1e-9;
+        if (hybrid->query_pool != VK_NULL_HANDLE)
+        {
+            u64 timestamps[2] {};
+            const VkResult result = vk_ctx->procs_dev.GetQueryPoolResults(
+                vk_ctx->device, hybrid->query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(u64),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+            );
+            assertVk(result);
+            const f64 ns_per_tick = (f64)vk_ctx->physical_device_properties.limits.timestampPeriod;
+            gpu_seconds = (f64)(timestamps[1] - timestamps[0]) * ns_per_tick * 1e-9;
+        }
+
+        const VkDeviceSize results_size = HYBRID_RESULTS_HEADER_SIZE + 2 * gpu_particle_count * sizeof(vec4);
+        const VkResult result =
+            vmaInvalidateAllocation(vk_ctx->vma_allocator, hybrid->buffer_results.allocation, 0, results_size);
+        assertVk(result);
+        countTransfer(&s->transfers, TRANSFER_PARTICLES, true, results_size);
+
+        thread_pool::parallelFor(
+            thread_pool, gpu_first_particle, particle_count, CPU_PARTICLE_GRAIN, cpuPass_readHybridResults, pass
+        );
+
+        const u32* header = (const u32*)getMappedPointer(&hybrid->buffer_results);
+        max_motion.speed = glm::max(max_motion.speed, glm::uintBitsToFloat(header[0]));
+        max_motion.acceleration = glm::max(max_motion.acceleration, glm::uintBitsToFloat(header[1]));
+    }
+    *p_max_motion_out = max_motion;
+
+    // Particles per second of each side, and the split at which both would have taken as long. A side that had
+    // no particles, or too few to be timed, leaves it as it is.
+    if (cpu_particle_count > 0 and gpu_particle_count > 0 and cpu_seconds > 0.0 and gpu_seconds > 0.0)
+    {
+        const f64 cpu_rate = (f64)cpu_particle_count / cpu_seconds;
+        const f64 gpu_rate = (f64)gpu_particle_count / gpu_seconds;
+        const f32 balanced_fraction = (f32)(gpu_rate / (cpu_rate + gpu_rate));
+        hybrid->gpu_fraction += HYBRID_TUNING_RATE * (balanced_fraction - hybrid->gpu_fraction);
+    }
+    hybrid->gpu_fraction = glm::clamp(hybrid->gpu_fraction, HYBRID_MIN_GPU_FRACTION, HYBRID_MAX_GPU_FRACTION);
+    TracyPlot("sim::HybridGpuFraction", (f64)hybrid->gpu_fraction);
+}
+
+
+/// One step of the CPU backend. The new positions are in the staging buffer afterwards, but not copied to the
+/// GPU yet.
+static void advanceCpuStep(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    f32 delta_t
+) {
+
+    ZoneScoped;
+
+    CpuState* cpu = &s->cpu_state;
+    const u32fast particle_count = s->particle_count;
+    CpuPass pass {
+        .s = s,
+        .delta_t = delta_t,
+        .slab_parity = 0,
+        .pbf_read_half = 0,
+        .pbf_find_neighbor_cells = false,
+        .hybrid_split_cell = 0,
+        .hybrid_first_particle = 0,
+        .hybrid_halo_first_particle = 0,
+    };
+
+    const u32 thread_count = thread_pool::getThreadCount(thread_pool);
+    if (cpu->task_count != thread_count)
+    {
+        destroySortContext(cpu->sort_context);
+        cpu->task_count = thread_count;
+        cpu->sort_context = createSortContext(thread_count);
+    }
+
+    {
+        DomainBounds bounds { .min = vec3(INFINITY), .max = vec3(-INFINITY) };
+        thread_pool::parallelReduce(
+            thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN,
+            cpuPass_computeBounds, cpuPass_combineBounds, &pass, &bounds, sizeof(bounds)
+        );
+        assertDomainFitsMortonCodes(&bounds, s->parameters.cell_size_reciprocal, CPU_MORTON_CODE_WORD_COUNT);
+
+        cpu->domain_min = bounds.min;
+    }
+
+    thread_pool::parallelFor(thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, cpuPass_computeCellKeys, &pass);
+    radixSortMultiThreaded(
+        cpu->sort_context, thread_pool, cpu->task_count, particle_count, cpu->cell_keys, cpu->cell_keys_scratch
+    );
+    thread_pool::parallelFor(
+        thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, cpuPass_gatherSortedParticles, &pass
+    );
+    cpuBuildCells(&pass, thread_pool);
+
+    {
+        ZoneScopedN("WaitForPreviousCopy");
+        // the previous copy reads the staging buffer
+        waitForTimelineValue(vk_ctx, &s->gpu_resources, s->gpu_resources.timeline_value);
+    }
+
+    // The chunks get the same number of cells, but not necessarily the same number of particles; the threads
+    // that finish their chunks first take more of them.
+    const bool hybrid = cpu->hybrid.enabled and !s->parameters.pbf and !s->parameters.sph;
+    if (s->parameters.pbf)
+    {
+        thread_pool::parallelFor(
+            thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, cpuPass_predictPbfPositions, &pass
+        );
+        for (u32 iteration = 0; iteration < s->parameters.pbf_iteration_count; iteration++)
+        {
+            pass.pbf_find_neighbor_cells = iteration == 0;
+            thread_pool::parallelFor(
+                thread_pool, 0, cpu->cell_count, CPU_CELL_GRAIN, cpuPass_computePbfMultipliers, &pass
+            );
+            thread_pool::parallelFor(
+                thread_pool, 0, cpu->cell_count, CPU_CELL_GRAIN, cpuPass_correctPbfPositions, &pass
+            );
+            pass.pbf_read_half = 1 - pass.pbf_read_half;
+        }
+    }
+    else if (s->parameters.sph)
+    {
+        thread_pool::parallelFor(thread_pool, 0, cpu->cell_count, CPU_CELL_GRAIN, cpuPass_computeDensities, &pass);
+    }
+    else if (hybrid)
+    {
+        // `cpuHybridUpdate()` sums the spring forces on each side of its split
+    }
+    else if (s->parameters.cluster_pair_forces)
+    {
+        const u64 cluster_count = (particle_count + CPU_CLUSTER_SIZE - 1) / CPU_CLUSTER_SIZE;
+        thread_pool::parallelFor(
+            thread_pool, 0, cluster_count, CPU_CLUSTER_GRAIN, cpuPass_computeClusterBounds, &pass
+        );
+        thread_pool::parallelFor(
+            thread_pool, 0, cluster_count, CPU_CLUSTER_GRAIN, cpuPass_accumulateClusterPairForces, &pass
+        );
+    }
+    else for (u32 parity = 0; parity < 2; parity++)
+    {
+        // a slab per chunk: there are far fewer slabs than cells
+        pass.slab_parity = parity;
+        const u64 slab_pair_count = (cpu->slab_count + 1 - parity) / 2;
+        thread_pool::parallelFor(thread_pool, 0, slab_pair_count, 1, cpuPass_accumulateSpringForces, &pass);
+    }
+    CpuMaxMotion max_motion { .speed = 0.0f, .acceleration = 0.0f };
+    if (hybrid)
+    {
+        cpuHybridUpdate(s, vk_ctx, thread_pool, &pass, &max_motion);
+    }
+    else
+    {
+        thread_pool::parallelReduce(
+            thread_pool, 0, cpu->cell_count, CPU_CELL_GRAIN,
+            cpuPass_updateParticles, cpuPass_combineMaxMotion, &pass, &max_motion, sizeof(max_motion)
+        );
+    }
+    if (s->parameters.adaptive_time_step)
+    {
+        s->time_step.max_speed = max_motion.speed;
+        s->time_step.max_acceleration = max_motion.acceleration;
+    }
+}
+
+
+/// Copies the positions of the live particles from the staging buffer to `buffer_positions_unsorted`, after
+/// `optional_wait_semaphore`. Signals `optional_signal_semaphore` and the next timeline value once they are
+/// copied. The staging buffer must not be written until then.
+static void submitCpuPositionsCopy(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    VkSemaphore optional_wait_semaphore,
+    VkSemaphore optional_signal_semaphore
+) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    const GpuBuffer* staging = &s->cpu_state.buffer_positions_staging;
+    const VkDeviceSize size_bytes = s->particle_count * sizeof(vec4);
+
+    VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, staging->allocation, 0, size_bytes);
+    assertVk(result);
+    s->uploaded_byte_count += size_bytes;
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, false, size_bytes);
+
+    // The previous copy was waited for before the staging buffer was written, so the command buffer is free.
+    const VkCommandBuffer command_buffer = res->general_purpose_command_buffer;
+
+    result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
+    assertVk(result);
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+    assertVk(result);
+    {
+        const VkBufferCopy copy {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = size_bytes,
+        };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, staging->buffer, res->buffer_positions_unsorted.buffer, 1, &copy
+        );
+    }
+    result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+    assertVk(result);
+
+    // The user semaphore guards the positions buffer, which is written by the copy.
+    const VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const u32 wait_semaphore_count = (optional_wait_semaphore == VK_NULL_HANDLE) ? (u32)0 : (u32)1;
+    const u64 wait_value = 0;
+
+    const u32 signal_semaphore_count = (optional_signal_semaphore == VK_NULL_HANDLE) ? (u32)1 : (u32)2;
+    const VkSemaphore signal_semaphores[2] { res->timeline_semaphore, optional_signal_semaphore };
+    const u64 signal_values[2] { ++res->timeline_value, 0 }; // binary semaphores ignore the value
+
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = wait_semaphore_count,
+        .pWaitSemaphoreValues = &wait_value,
+        .signalSemaphoreValueCount = signal_semaphore_count,
+        .pSignalSemaphoreValues = signal_values,
+    };
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = wait_semaphore_count,
+        .pWaitSemaphores = &optional_wait_semaphore,
+        .pWaitDstStageMask = &wait_dst_stage_mask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = signal_semaphore_count,
+        .pSignalSemaphores = signal_semaphores,
+    };
+    result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+    assertVk(result);
+}
+
+
+/// `buffer_positions_unsorted`, which the renderer reads, and the staging buffer that it's copied from.
+static void createCpuBackendBuffers(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    const VkDeviceSize positions_size_bytes = s->particle_capacity * sizeof(vec4);
+
+    {
+        // See `createBuffers()`.
+        u32 queue_families[3] {};
+        const u32 queue_family_count = getSharedQueueFamilies(vk_ctx, queue_families);
+
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = positions_size_bytes,
+            // the sim thread copies it into its snapshots; see src/sim_thread.hpp
+            .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                   | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = (queue_family_count > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = queue_family_count,
+            .pQueueFamilyIndices = queue_families,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        GpuBuffer* buffer = &s->gpu_resources.buffer_positions_unsorted;
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &buffer->buffer, &buffer->allocation, &buffer->allocation_info
+        );
+        assertVk(result);
+    }
+    {
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = positions_size_bytes,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &vk_ctx->compute_queue_family_index,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        };
+        GpuBuffer* buffer = &s->cpu_state.buffer_positions_staging;
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &buffer->buffer, &buffer->allocation, &buffer->allocation_info
+        );
+        assertVk(result);
+    }
+
+    GpuResources* res = &s->gpu_resources;
+    res->buffer_memory_size =
+        res->buffer_positions_unsorted.allocation_info.size + s->cpu_state.buffer_positions_staging.allocation_info.size;
+    TracyAllocN(res->buffer_positions_unsorted.buffer, res->buffer_memory_size, "fluid_sim GPU buffers");
+}
+
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t HOST_SLAB_ALIGNMENT = 64; // a cache line, so that the threads' chunks of two arrays don't share one
+
+/// Maps `size` bytes (a multiple of `HUGE_PAGE_SIZE`) for the arrays of the CPU backend, in 2 MiB pages if the
+/// system allows it, so that streaming over millions of particles doesn't miss the TLB every 4 KiB. The pages
+/// are zeroed and only backed once touched.
+static u8* mapHostSlab(size_t size) {
+
+    assert(size % HUGE_PAGE_SIZE == 0);
+
+    // explicit huge pages, if some are reserved (`vm.nr_hugepages`)
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return (u8*)p;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assertErrno(p != MAP_FAILED);
+    // transparent huge pages, if they're enabled in "madvise" mode; it's only a hint
+    (void)madvise(p, size, MADV_HUGEPAGE);
+
+    return (u8*)p;
+}
+
+/// Of the `CpuState` arrays for `capacity` particles, each rounded up to `HOST_SLAB_ALIGNMENT`.
+static size_t getHostSlabSize(u32fast capacity) {
+
+    const size_t f32_array_size = roundUpMultiple(capacity * sizeof(f32), HOST_SLAB_ALIGNMENT);
+    const size_t key_array_size = roundUpMultiple(capacity * sizeof(KeyVal), HOST_SLAB_ALIGNMENT);
+    const size_t u32_array_size = roundUpMultiple(capacity * sizeof(u32), HOST_SLAB_ALIGNMENT);
+    // see `CpuState::cell_table_size`
+    const size_t cell_table_size = roundUpMultiple(
+        getHashTableSize(capacity + 1, 0.5f) * sizeof(u32), HOST_SLAB_ALIGNMENT
+    );
+    const size_t slab_first_cells_size =
+        roundUpMultiple((CPU_MAX_CELL_COUNT_PER_AXIS + 1) * sizeof(u32), HOST_SLAB_ALIGNMENT);
+    const size_t cluster_bounds_size = roundUpMultiple(
+        (capacity + CPU_CLUSTER_SIZE - 1) / CPU_CLUSTER_SIZE * 6 * sizeof(f32), HOST_SLAB_ALIGNMENT
+    );
+    const size_t chunk_first_cells_size = roundUpMultiple(
+        ((capacity + CPU_PARTICLE_GRAIN - 1) / CPU_PARTICLE_GRAIN + 1) * sizeof(u32), HOST_SLAB_ALIGNMENT
+    );
+
+    return roundUpMultiple(
+        24 * f32_array_size + 2 * key_array_size + (6 + CPU_NEIGHBOR_CELL_COUNT) * u32_array_size + cell_table_size
+            + slab_first_cells_size + cluster_bounds_size + chunk_first_cells_size,
+        HUGE_PAGE_SIZE
+    );
+}
+
+/// The next `size` bytes of `cpu->host_slab`; `size` is a multiple of `HOST_SLAB_ALIGNMENT`.
+static void* carveHostSlab(CpuState* cpu, size_t* p_offset, size_t size) {
+
+    assert(size % HOST_SLAB_ALIGNMENT == 0);
+    alwaysAssert(*p_offset + size <= cpu->host_slab_size);
+
+    void* p = cpu->host_slab + *p_offset;
+    *p_offset += size;
+    return p;
+}
+
+
+/// `create()` for `SimParameters::cpu_backend`.
+static SimData createCpuBackend(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    u32fast particle_count,
+    const vec4* p_initial_positions
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(particle_count > 0);
+
+    SimData s {};
+    s.cpu_backend = true;
+    s.particle_count = particle_count;
+    s.particle_capacity = particle_count + params->extra_particle_capacity;
+    setParams(&s, params);
+    createCommandBuffersAndSyncObjects(&s.gpu_resources, vk_ctx);
+    createCpuBackendBuffers(&s, vk_ctx);
+    if (params->hybrid_gpu_update) createCpuHybrid(&s, vk_ctx);
+
+    CpuState* cpu = &s.cpu_state;
+    {
+        const u32fast capacity = s.particle_capacity;
+        // at most half full, because there are at most as many cells as particles
+        cpu->cell_table_size = getHashTableSize(capacity + 1, 0.5f);
+
+        const size_t f32_array_size = roundUpMultiple(capacity * sizeof(f32), HOST_SLAB_ALIGNMENT);
+        const size_t key_array_size = roundUpMultiple(capacity * sizeof(KeyVal), HOST_SLAB_ALIGNMENT);
+        const size_t u32_array_size = roundUpMultiple(capacity * sizeof(u32), HOST_SLAB_ALIGNMENT);
+        const size_t cell_table_size = roundUpMultiple(cpu->cell_table_size * sizeof(u32), HOST_SLAB_ALIGNMENT);
+        const size_t chunk_first_cells_size = roundUpMultiple(
+            ((capacity + CPU_PARTICLE_GRAIN - 1) / CPU_PARTICLE_GRAIN + 1) * sizeof(u32), HOST_SLAB_ALIGNMENT
+        );
+
+        cpu->host_slab_size = getHostSlabSize(capacity);
+        cpu->host_slab = mapHostSlab(cpu->host_slab_size);
+        TracyAllocN(cpu->host_slab, cpu->host_slab_size, "fluid_sim host arrays");
+        size_t slab_offset = 0;
+
+        // Not touched here: the pool's threads first touch them in the first step, so that with a pinned pool
+        // their pages are spread over the threads' NUMA nodes, instead of all on this thread's.
+        for (u32 d = 0; d < 3; d++)
+        {
+            cpu->positions[d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+            cpu->velocities[d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+            cpu->positions_sorted[d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+            cpu->velocities_sorted[d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        }
+        cpu->attributes = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        cpu->attributes_sorted = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        cpu->densities = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        for (u32 d = 0; d < 3; d++) cpu->accelerations[d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        // the PBF mode's only, like `cell_neighbor_cells` below
+        for (u32 half = 0; half < 2; half++) for (u32 d = 0; d < 3; d++)
+        {
+            cpu->pbf_positions[half][d] = (f32*)carveHostSlab(cpu, &slab_offset, f32_array_size);
+        }
+
+        cpu->cell_keys = (KeyVal*)carveHostSlab(cpu, &slab_offset, key_array_size);
+        cpu->cell_keys_scratch = (KeyVal*)carveHostSlab(cpu, &slab_offset, key_array_size);
+
+        cpu->cell_codes = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        cpu->cell_first_particles = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        cpu->cell_particle_counts = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        cpu->chunk_first_cells = (u32*)carveHostSlab(cpu, &slab_offset, chunk_first_cells_size);
+        cpu->cell_table = (u32*)carveHostSlab(cpu, &slab_offset, cell_table_size);
+        // `cpuBuildCells()` only clears the slots of the previous step's cells
+        memset(cpu->cell_table, CPU_CELL_TABLE_EMPTY_BYTE, cpu->cell_table_size * sizeof(u32));
+        cpu->cell_slots = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        // at most one cell per particle; the SPH and PBF modes' only, so that without them, their pages are never
+        // touched
+        cpu->cell_neighbor_cells =
+            (u32*)carveHostSlab(cpu, &slab_offset, CPU_NEIGHBOR_CELL_COUNT * u32_array_size);
+        cpu->cell_neighbor_cell_counts = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        cpu->cell_count = 0;
+        cpu->slab_cells = (u32*)carveHostSlab(cpu, &slab_offset, u32_array_size);
+        cpu->slab_first_cells = (u32*)carveHostSlab(
+            cpu, &slab_offset, roundUpMultiple((CPU_MAX_CELL_COUNT_PER_AXIS + 1) * sizeof(u32), HOST_SLAB_ALIGNMENT)
+        );
+        cpu->slab_count = 0;
+        // the cluster-pair mode's only
+        cpu->cluster_bounds = (f32*)carveHostSlab(
+            cpu, &slab_offset,
+            roundUpMultiple((capacity + CPU_CLUSTER_SIZE - 1) / CPU_CLUSTER_SIZE * 6 * sizeof(f32), HOST_SLAB_ALIGNMENT)
+        );
+
+        // the first step creates them, for the thread pool that it's given
+        cpu->task_count = 0;
+        cpu->sort_context = NULL;
+        cpu->hilbert_cell_order = params->hilbert_cell_order;
+    }
+
+    vec4* p_staging_positions = (vec4*)getMappedPointer(&cpu->buffer_positions_staging);
+    for (u32fast i = 0; i < particle_count; i++)
+    {
+        const vec4 particle = p_initial_positions[i];
+        for (glm::length_t d = 0; d < 3; d++)
+        {
+            cpu->positions[d][i] = particle[d];
+            cpu->velocities[d][i] = 0.0f;
+        }
+        cpu->attributes[i] = particle.w;
+        p_staging_positions[i] = particle;
+    }
+
+    submitCpuPositionsCopy(&s, vk_ctx, VK_NULL_HANDLE, VK_NULL_HANDLE);
+    waitForTimelineValue(vk_ctx, &s.gpu_resources, s.gpu_resources.timeline_value);
+    s.uploaded_byte_count = 0;
+
+    LOG_F(
+        INFO, "Initialized fluid sim on the CPU%s with %" PRIuFAST32 " particles.",
+        cpu->hybrid.enabled ? ", sharing the particle update with the GPU," : "", s.particle_count
+    );
+
+    return s;
+}
+
+
+/// Frees the host arrays, the staging buffer, and the hybrid mode's objects. The GPU must be done with them.
+static void destroyCpuState(CpuState* cpu, const VulkanContext* vk_ctx) {
+
+    TracyFreeN(cpu->host_slab, "fluid_sim host arrays");
+    int result = munmap(cpu->host_slab, cpu->host_slab_size);
+    assertErrno(result == 0);
+    destroySortContext(cpu->sort_context);
+
+    vmaDestroyBuffer(vk_ctx->vma_allocator, cpu->buffer_positions_staging.buffer, cpu->buffer_positions_staging.allocation);
+    if (cpu->hybrid.enabled) destroyCpuHybrid(&cpu->hybrid, vk_ctx);
+}
+
+
+/// `emitParticles()` for the CPU backend; `count` already fits.
+static void emitParticlesCpu(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32fast count,
+    const vec4* p_positions,
+    const vec3* p_velocities_optional
+) {
+
+    ZoneScoped;
+
+    CpuState* cpu = &s->cpu_state;
+
+    // the previous copy reads the staging buffer
+    waitForTimelineValue(vk_ctx, &s->gpu_resources, s->gpu_resources.timeline_value);
+
+    vec4* p_staging_positions = (vec4*)getMappedPointer(&cpu->buffer_positions_staging);
+    for (u32fast i = 0; i < count; i++)
+    {
+        const u32fast k = s->particle_count + i;
+        const vec3 velocity = (p_velocities_optional != NULL) ? p_velocities_optional[i] : vec3(0.0f);
+
+        for (glm::length_t d = 0; d < 3; d++)
+        {
+            cpu->positions[d][k] = p_positions[i][d];
+            cpu->velocities[d][k] = velocity[d];
+        }
+        cpu->attributes[k] = p_positions[i].w;
+        p_staging_positions[k] = p_positions[i];
+    }
+    s->particle_count += count;
+
+    submitCpuPositionsCopy(s, vk_ctx, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+
+/// `removeParticles()` for the CPU backend. Compacts the particles that are left, in place.
+static u32fast removeParticlesCpu(SimData* s, const VulkanContext* vk_ctx, vec3 box_min, vec3 box_max) {
+
+    ZoneScoped;
+
+    CpuState* cpu = &s->cpu_state;
+
+    const auto is_in_box = [&](u32fast i) {
+        const vec3 particle(cpu->positions[0][i], cpu->positions[1][i], cpu->positions[2][i]);
+        return
+            glm::all(glm::greaterThanEqual(particle, box_min)) and
+            glm::all(glm::lessThanEqual(particle, box_max));
+    };
+
+    u32fast removed_count = 0;
+    for (u32fast i = 0; i < s->particle_count; i++) removed_count += is_in_box(i);
+
+    if (removed_count == 0) return 0;
+    if (removed_count >= s->particle_count)
+    {
+        LOG_F(
+            WARNING, "All %" PRIuFAST32 " particles are in the removal box, but the sim can't be empty; "
+            "removing none.",
+            s->particle_count
+        );
+        return 0;
+    }
+
+    // the previous copy reads the staging buffer
+    waitForTimelineValue(vk_ctx, &s->gpu_resources, s->gpu_resources.timeline_value);
+
+    vec4* p_staging_positions = (vec4*)getMappedPointer(&cpu->buffer_positions_staging);
+    u32fast kept_count = 0;
+    for (u32fast i = 0; i < s->particle_count; i++)
+    {
+        if (is_in_box(i)) continue;
+
+        for (u32 d = 0; d < 3; d++)
+        {
+            cpu->positions[d][kept_count] = cpu->positions[d][i];
+            cpu->velocities[d][kept_count] = cpu->velocities[d][i];
+        }
+        cpu->attributes[kept_count] = cpu->attributes[i];
+        p_staging_positions[kept_count] = vec4(
+            cpu->positions[0][i], cpu->positions[1][i], cpu->positions[2][i], cpu->attributes[i]
+        );
+        kept_count++;
+    }
+    s->particle_count = kept_count;
+
+    submitCpuPositionsCopy(s, vk_ctx, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+    LOG_F(
+        INFO, "Removed %" PRIuFAST32 " particles; %" PRIuFAST32 " are left.", removed_count, s->particle_count
+    );
+    return removed_count;
+}
+
+//
+// ===========================================================================================================
+//
+
+
+// The PCG hash from Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020). Must match `pcgHash()` in
+// `fluidSim_generateParticles.comp`.
+static u32 pcgHash(u32 x) {
+    const u32 state = x * 747796405u + 2891336453u;
+    const u32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+static f32 random01(u32 seed, u32 counter) {
+    return (f32)(pcgHash(pcgHash(counter) ^ seed) >> 8u) * (1.0f / 16777216.0f);
+}
+
+
+static GenerateParticlesPushConstants getGenerateParticlesPushConstants(
+    const ParticleGenerator* generator,
+    u32fast particle_count
+) {
+
+    const bool is_lattice = generator->shape == PARTICLE_GENERATOR_LATTICE
+                         or generator->shape == PARTICLE_GENERATOR_JITTERED_LATTICE;
+
+    u32 row_length = 1;
+    u32 layer_length = 1;
+    if (is_lattice)
+    {
+        alwaysAssert(generator->lattice_spacing > 0.0f);
+
+        // as many points as fit in the box, but no longer than needed for `particle_count`
+        const vec3 extent = glm::max(generator->box_max - generator->box_min, vec3(0.0f));
+        const vec3 points_per_axis = glm::floor(extent / generator->lattice_spacing) + 1.0f;
+
+        row_length = (u32)math::min((f32)particle_count, points_per_axis.x);
+        const u32 column_length = (u32)math::min(
+            (f32)divCeil((u32)particle_count, row_length), points_per_axis.y
+        );
+        layer_length = row_length * column_length;
+    }
+
+    return GenerateParticlesPushConstants {
+        .box_min = generator->box_min,
+        .box_max = generator->box_max,
+        .shape = generator->shape,
+        .lattice_spacing = generator->lattice_spacing,
+        .jitter = generator->jitter,
+        .seed = generator->seed,
+        .attribute_first = generator->attribute_first,
+        .attribute_last = generator->attribute_last,
+        .lattice_row_length = row_length,
+        .lattice_layer_length = layer_length,
+    };
+}
+
+
+/// Bounds that contain every particle of the generator.
+static DomainBounds getGeneratorBounds(const GenerateParticlesPushConstants* g, u32fast particle_count) {
+
+    if (g->shape == PARTICLE_GENERATOR_BOX or g->shape == PARTICLE_GENERATOR_SPHERE)
+    {
+        return DomainBounds { .min = g->box_min, .max = g->box_max };
+    }
+
+    const u32 layer_count = divCeil((u32)particle_count, g->lattice_layer_length);
+    const vec3 last_point = vec3(
+        (f32)(g->lattice_row_length - 1),
+        (f32)(g->lattice_layer_length / g->lattice_row_length - 1),
+        (f32)(layer_count - 1)
+    );
+    const f32 jitter =
+        (g->shape == PARTICLE_GENERATOR_JITTERED_LATTICE) ? g->jitter * g->lattice_spacing : 0.0f;
+
+    return DomainBounds {
+        .min = g->box_min - jitter,
+        .max = g->box_min + g->lattice_spacing * last_point + jitter,
+    };
+}
+
+
+/// What `fluidSim_generateParticles.comp` writes for particle `particle_idx`, up to rounding.
+static vec4 generateParticleOnHost(
+    const GenerateParticlesPushConstants* g,
+    u32fast particle_count,
+    u32 particle_idx
+) {
+
+    const vec3 u = vec3(
+        random01(g->seed, 4 * particle_idx),
+        random01(g->seed, 4 * particle_idx + 1),
+        random01(g->seed, 4 * particle_idx + 2)
+    );
+
+    vec3 position = vec3(0.0f);
+    if (g->shape == PARTICLE_GENERATOR_BOX) position = glm::mix(g->box_min, g->box_max, u);
+    else if (g->shape == PARTICLE_GENERATOR_SPHERE)
+    {
+        const vec3 half_extent = 0.5f * (g->box_max - g->box_min);
+        const f32 max_radius = math::min(half_extent.x, math::min(half_extent.y, half_extent.z));
+        const f32 radius = max_radius * powf(u.x, 1.0f / 3.0f);
+        const f32 cos_theta = 1.0f - 2.0f * u.y;
+        const f32 sin_theta = sqrtf(math::max(0.0f, 1.0f - cos_theta * cos_theta));
+        const f32 phi = 2.0f * PI * u.z;
+        const vec3 direction = vec3(sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta);
+        position = g->box_min + half_extent + radius * direction;
+    }
+    else
+    {
+        const vec3 lattice_idx = vec3(
+            (f32)(particle_idx % g->lattice_row_length),
+            (f32)((particle_idx % g->lattice_layer_length) / g->lattice_row_length),
+            (f32)(particle_idx / g->lattice_layer_length)
+        );
+        position = g->box_min + g->lattice_spacing * lattice_idx;
+
+        if (g->shape == PARTICLE_GENERATOR_JITTERED_LATTICE)
+        {
+            position += (g->jitter * g->lattice_spacing) * (2.0f * u - 1.0f);
+        }
+    }
+
+    const f32 t = (f32)particle_idx / (f32)particle_count;
+    u32 attribute = 0;
+    for (u32 b = 0; b < 4; b++)
+    {
+        const f32 first = (f32)((g->attribute_first >> (8 * b)) & 0xFF);
+        const f32 last = (f32)((g->attribute_last >> (8 * b)) & 0xFF);
+        attribute |= (u32)roundf(glm::mix(first, last, t)) << (8 * b);
+    }
+
+    vec4 particle = vec4(position, 0.0f);
+    memcpy(&particle.w, &attribute, sizeof(f32));
+
+    return particle;
+}
+
+struct GenerateParticlesOnHostPass {
+    const GenerateParticlesPushConstants* g;
+    u32fast particle_count;
+    vec4* p_positions;
+};
+
+/// `generateParticleOnHost()` for each particle in `[begin, end)`; each particle only depends on its index, so the
+/// chunks run in parallel.
+static void generateParticlesOnHostChunk(void* p_ctx, u64 begin, u64 end) {
+
+    ZoneScopedTask;
+
+    const GenerateParticlesOnHostPass* pass = (const GenerateParticlesOnHostPass*)p_ctx;
+    for (u64 i = begin; i < end; i++)
+    {
+        pass->p_positions[i] = generateParticleOnHost(pass->g, pass->particle_count, (u32)i);
+    }
+}
+
+
+// Point set files, for `createFromFile()`. Either
+//     - a `PointSetHeader`, then `PointSetHeader::particle_count` vec4s laid out like the `p_initial_positions`
+//       of `create()`, in host byte order; or
+//     - a binary little-endian PLY file whose first element is `vertex`, with `float` or `double` properties
+//       `x`, `y`, `z`, and optionally `uchar` properties `red`, `green`, `blue` and `alpha`, which are packed
+//       into the attribute like a `u8vec4` (the components that are missing are 255). Other scalar
+//       properties and the elements after `vertex` are ignored.
+constexpr char POINT_SET_MAGIC[8] = { 'F', 'L', 'S', 'I', 'M', 'P', 'T', 'S' };
+constexpr u32 POINT_SET_VERSION = 1;
+
+struct PointSetHeader {
+    char magic[8]; // POINT_SET_MAGIC
+    u32 version; // POINT_SET_VERSION
+    u32 reserved;
+    u64 particle_count;
+};
+
+// The particles a staging buffer holds at once while uploading a point set.
+constexpr u32 POINT_SET_UPLOAD_CHUNK_PARTICLE_COUNT = 1 << 16;
+
+constexpr u32 POINT_SET_NO_PROPERTY = UINT32_MAX;
+
+/// A mapped point set file. Particle `i` starts at byte `i * stride` of `p_particles`; the offsets are relative
+/// to that, and POINT_SET_NO_PROPERTY if the property is missing.
+struct PointSetFile {
+    void* p_file;
+    u64 file_size;
+    const u8* p_particles;
+    u64 particle_count;
+    u32 stride;
+    u32 coordinate_offsets[3];
+    bool coordinates_f64;
+    // the raw attribute, which excludes `color_offsets`
+    u32 attribute_offset;
+    u32 color_offsets[4];
+};
+
+
+static vec4 readPointSetParticle(const PointSetFile* file, u64 particle_idx) {
+
+    const u8* p_particle = file->p_particles + particle_idx * file->stride;
+
+    vec4 particle = vec4(0.0f);
+    for (u32 d = 0; d < 3; d++)
+    {
+        if (file->coordinates_f64)
+        {
+            f64 coordinate = 0.0;
+            memcpy(&coordinate, p_particle + file->coordinate_offsets[d], sizeof(coordinate));
+            particle[(glm::length_t)d] = (f32)coordinate;
+        }
+        else memcpy(&particle[(glm::length_t)d], p_particle + file->coordinate_offsets[d], sizeof(f32));
+    }
+
+    if (file->attribute_offset != POINT_SET_NO_PROPERTY)
+    {
+        memcpy(&particle.w, p_particle + file->attribute_offset, sizeof(f32));
+    }
+    else
+    {
+        u32 attribute = 0;
+        for (u32 c = 0; c < 4; c++)
+        {
+            const u32 component = (file->color_offsets[c] != POINT_SET_NO_PROPERTY)
+                ? p_particle[file->color_offsets[c]] : 255u;
+            attribute |= component << (8 * c);
+        }
+        memcpy(&particle.w, &attribute, sizeof(f32));
+    }
+
+    return particle;
+}
+
+
+/// The size of a scalar PLY property type, or 0 if it isn't one.
+static u32 getPlyTypeSize(const char* type) {
+
+    const char* types[] {
+        "char", "uchar", "int8", "uint8",
+        "short", "ushort", "int16", "uint16",
+        "int", "uint", "int32", "uint32", "float", "float32",
+        "double", "float64",
+    };
+    const u32 sizes[] { 1, 1, 1, 1, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 8, 8 };
+    static_assert(ARRAY_SIZE(types) == ARRAY_SIZE(sizes));
+
+    for (u32 i = 0; i < ARRAY_SIZE(types); i++) if (strcmp(type, types[i]) == 0) return sizes[i];
+    return 0;
+}
+
+
+/// Fills in the layout of the vertices of a PLY file. Logs an error and returns false if the file isn't one
+/// that `createFromFile()` supports.
+static bool parsePlyHeader(const char* filepath, PointSetFile* file) {
+
+    const char* p_text = (const char*)file->p_file;
+    const u64 text_size = file->file_size;
+
+    bool in_vertex_element = false;
+    bool seen_vertex_element = false;
+    bool coordinates_f64[3] {};
+    for (u32 d = 0; d < 3; d++) file->coordinate_offsets[d] = POINT_SET_NO_PROPERTY;
+    for (u32 c = 0; c < 4; c++) file->color_offsets[c] = POINT_SET_NO_PROPERTY;
+    file->attribute_offset = POINT_SET_NO_PROPERTY;
+
+    u64 line_start = 0;
+    while (true)
+    {
+        u64 line_end = line_start;
+        while (line_end < text_size and p_text[line_end] != '\n') line_end++;
+        if (line_end == text_size)
+        {
+            LOG_F(ERROR, "The PLY header of `%s` has no `end_header`.", filepath);
+            return false;
+        }
+
+        char line[256] {};
+        const u64 line_length = line_end - line_start;
+        if (line_length >= sizeof(line))
+        {
+            LOG_F(
+                ERROR, "The PLY header of `%s` has a line longer than %zu bytes.", filepath, sizeof(line) - 1
+            );
+            return false;
+        }
+        memcpy(line, p_text + line_start, line_length);
+        if (line_length > 0 and line[line_length - 1] == '\r') line[line_length - 1] = '\0';
+        line_start = line_end + 1;
+
+        char word_0[64] {};
+        char word_1[64] {};
+        char word_2[64] {};
+        const int word_count = sscanf(line, "%63s %63s %63s", word_0, word_1, word_2);
+
+        if (word_count <= 0 or strcmp(word_0, "comment") == 0 or strcmp(word_0, "obj_info") == 0) continue;
+        else if (strcmp(word_0, "ply") == 0) continue;
+        else if (strcmp(word_0, "end_header") == 0) break;
+        else if (strcmp(word_0, "format") == 0)
+        {
+            if (word_count < 2 or strcmp(word_1, "binary_little_endian") != 0)
+            {
+                LOG_F(
+                    ERROR, "`%s` is a `%s` PLY file; only `binary_little_endian` is supported.",
+                    filepath, word_1
+                );
+                return false;
+            }
+        }
+        else if (strcmp(word_0, "element") == 0)
+        {
+            if (word_count < 3)
+            {
+                LOG_F(ERROR, "Malformed PLY header line `%s` in `%s`.", line, filepath);
+                return false;
+            }
+            in_vertex_element = strcmp(word_1, "vertex") == 0 and !seen_vertex_element;
+            if (!in_vertex_element and !seen_vertex_element)
+            {
+                LOG_F(ERROR, "The first PLY element of `%s` is `%s`, not `vertex`.", filepath, word_1);
+                return false;
+            }
+            if (in_vertex_element)
+            {
+                seen_vertex_element = true;
+                file->particle_count = strtoull(word_2, NULL, 10);
+            }
+        }
+        else if (strcmp(word_0, "property") == 0)
+        {
+            if (!in_vertex_element) continue;
+
+            const u32 size = getPlyTypeSize(word_1);
+            if (word_count < 3 or size == 0)
+            {
+                LOG_F(ERROR, "Unsupported PLY vertex property `%s` in `%s`.", line, filepath);
+                return false;
+            }
+
+            const char* coordinate_names[3] { "x", "y", "z" };
+            const char* color_names[4] { "red", "green", "blue", "alpha" };
+            for (u32 d = 0; d < 3; d++) if (strcmp(word_2, coordinate_names[d]) == 0)
+            {
+                if (size != 4 and size != 8)
+                {
+                    LOG_F(
+                        ERROR, "The PLY property `%s` in `%s` must be `float` or `double`.", word_2, filepath
+                    );
+                    return false;
+                }
+                file->coordinate_offsets[d] = file->stride;
+                coordinates_f64[d] = size == 8;
+            }
+            for (u32 c = 0; c < 4; c++) if (strcmp(word_2, color_names[c]) == 0 and size == 1)
+            {
+                file->color_offsets[c] = file->stride;
+            }
+
+            file->stride += size;
+        }
+        else
+        {
+            LOG_F(ERROR, "Unknown PLY header line `%s` in `%s`.", line, filepath);
+            return false;
+        }
+    }
+
+    for (u32 d = 0; d < 3; d++) if (file->coordinate_offsets[d] == POINT_SET_NO_PROPERTY)
+    {
+        LOG_F(ERROR, "The PLY vertices in `%s` have no `x`, `y` and `z` properties.", filepath);
+        return false;
+    }
+    if (coordinates_f64[0] != coordinates_f64[1] or coordinates_f64[0] != coordinates_f64[2])
+    {
+        LOG_F(ERROR, "The PLY vertex coordinates in `%s` must all have the same type.", filepath);
+        return false;
+    }
+    file->coordinates_f64 = coordinates_f64[0];
+    file->p_particles = (const u8*)file->p_file + line_start;
+
+    return true;
+}
+
+
+/// Maps a point set file and fills in its layout. Logs an error and returns false on failure. On success, the
+/// caller must `closePointSetFile()`.
+static bool openPointSetFile(const char* filepath, PointSetFile* p_file_out) {
+
+    ZoneScoped;
+
+    PointSetFile file {};
+
+    const int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno)
+        );
+        return false;
+    }
+    // the mapping stays valid after the descriptor is closed
+    defer(close(fd));
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0)
+    {
+        LOG_F(ERROR, "Failed to stat file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    file.file_size = (u64)file_stat.st_size;
+    if (file.file_size < sizeof(PointSetHeader))
+    {
+        LOG_F(ERROR, "`%s` is too small to be a point set.", filepath);
+        return false;
+    }
+
+    file.p_file = mmap(NULL, file.file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file.p_file == MAP_FAILED)
+    {
+        LOG_F(ERROR, "Failed to map file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    // it's read front to back, once for the bounds and once for the upload
+    (void)madvise(file.p_file, file.file_size, MADV_SEQUENTIAL);
+
+    bool success = false;
+    if (memcmp(file.p_file, POINT_SET_MAGIC, sizeof(POINT_SET_MAGIC)) == 0)
+    {
+        PointSetHeader header {};
+        memcpy(&header, file.p_file, sizeof(header));
+
+        if (header.version != POINT_SET_VERSION)
+        {
+            LOG_F(
+                ERROR, "`%s` is a version %u point set, but this is version %u.",
+                filepath, header.version, POINT_SET_VERSION
+            );
+        }
+        else
+        {
+            file.p_particles = (const u8*)file.p_file + sizeof(PointSetHeader);
+            file.particle_count = header.particle_count;
+            file.stride = sizeof(vec4);
+            for (u32 d = 0; d < 3; d++) file.coordinate_offsets[d] = d * (u32)sizeof(f32);
+            file.coordinates_f64 = false;
+            file.attribute_offset = 3 * sizeof(f32);
+            success = true;
+        }
+    }
+    else if (memcmp(file.p_file, "ply", 3) == 0) success = parsePlyHeader(filepath, &file);
+    else LOG_F(ERROR, "`%s` is neither a point set nor a PLY file.", filepath);
+
+    if (success)
+    {
+        const u64 data_offset = (u64)(file.p_particles - (const u8*)file.p_file);
+        const u64 data_size_limit = file.file_size - data_offset;
+        if (
+            file.particle_count == 0 or file.particle_count > UINT32_MAX or
+            (file.stride > 0 and file.particle_count > data_size_limit / file.stride)
+        ) {
+            LOG_F(ERROR, "The point set `%s` is empty, truncated or corrupt.", filepath);
+            success = false;
+        }
+    }
+
+    if (!success)
+    {
+        munmap(file.p_file, file.file_size);
+        return false;
+    }
+
+    *p_file_out = file;
+    return true;
+}
+
+
+static void closePointSetFile(PointSetFile* file) {
+    munmap(file->p_file, file->file_size);
+    *file = PointSetFile {};
+}
+
+
+static DomainBounds getPointSetBounds(const PointSetFile* file) {
+
+    ZoneScoped;
+
+    DomainBounds bounds { .min = vec3(INFINITY), .max = vec3(-INFINITY) };
+    for (u64 i = 0; i < file->particle_count; i++)
+    {
+        const vec3 pos = vec3(readPointSetParticle(file, i));
+        bounds.min = glm::min(bounds.min, pos);
+        bounds.max = glm::max(bounds.max, pos);
+    }
+
+    return bounds;
+}
+
+
+/// Uploads the particles of the file to the start of the particle buffers, with zero velocity, through a
+/// staging buffer of POINT_SET_UPLOAD_CHUNK_PARTICLE_COUNT particles, and waits for the upload to finish.
+static void uploadPointSetFile(
+    const GpuResources* res,
+    const VulkanContext* vk_ctx,
+    const u32fast particle_capacity,
+    const PointSetFile* file,
+    TransferStats* transfers
+) {
+
+    ZoneScoped;
+
+    const u32fast chunk_capacity = math::min((u64)POINT_SET_UPLOAD_CHUNK_PARTICLE_COUNT, file->particle_count);
+    const GpuBuffer staging = createParticleStagingBuffer(
+        vk_ctx, getPackedParticlesSize(chunk_capacity), false
+    );
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+
+    for (u64 first_idx = 0; first_idx < file->particle_count; first_idx += chunk_capacity)
+    {
+        const u32fast count = (u32fast)math::min((u64)chunk_capacity, file->particle_count - first_idx);
+
+        // packed like `uploadParticles()` does, for `count` particles
+        vec4* p_positions = (vec4*)getMappedPointer(&staging);
+        for (u32fast i = 0; i < count; i++) p_positions[i] = readPointSetParticle(file, first_idx + i);
+        memset(&p_positions[count], 0, VELOCITY_COMPONENT_COUNT * count * sizeof(f32)); // zero in either layout
+
+        VkResult result = vmaFlushAllocation(
+            vk_ctx->vma_allocator, staging.allocation, 0, getPackedParticlesSize(count)
+        );
+        assertVk(result);
+        countTransfer(transfers, TRANSFER_PARTICLES, false, getPackedParticlesSize(count));
+
+        copyStagedParticles(res, vk_ctx, particle_capacity, (u32fast)first_idx, count, &staging);
+    }
+}
+
+
+/// `create()`, with the initial particles from exactly one of `p_initial_positions_optional`, a generator that
+/// runs on the GPU, or a point set file that is streamed to the GPU. `ensemble_member_count` is 0 unless
+/// `createEnsemble()` is creating the sim, which then uploads the members itself.
+static SimData createGpuBackend(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    const vec4* p_initial_positions_optional,
+    const ParticleGenerator* p_generator_optional,
+    const PointSetFile* p_point_set_optional,
+    u32 ensemble_member_count
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(
+        (p_initial_positions_optional != NULL) + (p_generator_optional != NULL) + (p_point_set_optional != NULL)
+        == 1
+    );
+    // the autotune needs the positions on the host
+    alwaysAssert(p_initial_positions_optional != NULL or !params->autotune_workgroup_size);
+
+    const u32fast particle_capacity = particle_count + params->extra_particle_capacity;
+    const u32fast hash_table_size = getHashTableSize(particle_capacity, params->hash_table_max_load_factor);
+
+    SimData s {};
+    {
+        s.particle_count = particle_count;
+        s.particle_capacity = particle_capacity;
+        s.hash_table_size = (u32)hash_table_size;
+        s.hash_table_capacity = (u32)hash_table_size;
+
+        setParams(&s, params);
+
+        const u32 workgroup_size = params->autotune_workgroup_size
+            ? getTunedWorkgroupSize(
+                params, vk_ctx, thread_pool, particle_count, p_initial_positions_optional, hash_table_size
+            )
+            : DEFAULT_WORKGROUP_SIZE;
+        s.gpu_resources = createGpuResources(
+            vk_ctx, thread_pool, particle_capacity, hash_table_size,
+            params->morton_codes_64_bit, params->hilbert_cell_order, getPeriodicBox(params),
+            params->half_velocities, params->particle_ids, params->adaptive_resolution,
+            params->neighbor_list_capacity,
+            params->open_addressing_cell_table, params->dense_cell_grid, params->flip_grid_resolution,
+            params->collider_brick_capacity, params->collider_cell_size, ensemble_member_count,
+            params->spatial_query_capacity, params->spatial_query_hit_capacity, params->region_readback_capacity,
+            params->volume_export_brick_capacity, workgroup_size
+        );
+        setParticleCount(&s, particle_count);
+        if (params->stage_timestamps) createStageQueryPool(&s.gpu_resources, vk_ctx);
+    }
+
+    GenerateParticlesPushConstants generator_push_constants {};
+    DomainBounds initial_bounds {};
+    if (p_generator_optional != NULL)
+    {
+        generator_push_constants = getGenerateParticlesPushConstants(p_generator_optional, particle_count);
+        initial_bounds = getGeneratorBounds(&generator_push_constants, particle_count);
+    }
+    else if (p_point_set_optional != NULL) initial_bounds = getPointSetBounds(p_point_set_optional);
+    else initial_bounds = getParticleBounds(particle_count, p_initial_positions_optional);
+
+    initGpuBuffers(
+        &s.gpu_resources,
+        vk_ctx,
+        &s.parameters,
+        (u32)particle_count,
+        (u32)particle_capacity,
+        p_initial_positions_optional,
+        &initial_bounds,
+        (u32)hash_table_size,
+        &s.transfers
+    );
+    s.uniforms_dirty = false; // `initGpuBuffers()` uploaded them
+
+    if (p_point_set_optional != NULL)
+    {
+        uploadPointSetFile(&s.gpu_resources, vk_ctx, particle_capacity, p_point_set_optional, &s.transfers);
+    }
+
+    // Build the initial spatial structure, so that `advance()` finds it in the same state that the previous
+    // `advance()` would have left it in. This also signals the timeline semaphore, so that we don't deadlock
+    // when waiting for it in `advance()`.
+    {
+        const VkCommandBuffer command_buffer = beginOneOffCommands(&s, vk_ctx);
+
+        // the bounds reduction expects this to be 0, and resets it to 0 itself afterwards
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer, s.gpu_resources.buffer_reduction_state.buffer,
+            offsetof(ReductionState, finished_workgroup_count), sizeof(u32), 0
+        );
+
+        // the positions were uploaded by the transfer stage
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        if (p_generator_optional != NULL)
+        {
+            recordComputeDispatch(
+                vk_ctx, command_buffer,
+                s.gpu_resources.pipeline_generateParticles, s.gpu_resources.pipeline_layout_generateParticles,
+                s.gpu_resources.descriptor_set_main,
+                sizeof(generator_push_constants), &generator_push_constants,
+                s.gpu_resources.workgroup_count
+            );
+            recordComputeToComputeBarrier(vk_ctx, command_buffer);
+        }
+
+        recordSpatialStructureCommands(&s, vk_ctx, command_buffer, 0, false, STAGE_TIMESTAMP_SLOT_NONE);
+
+        submitOneOffCommands(&s, vk_ctx, command_buffer);
+
+        s.spatial_structure_rebuilt_last_step = true;
+        s.spatial_structure_outdated = false;
+    }
+
+    // the particles are still in their initial order, which the first step's sort changes
+    uploadParticleIds(&s, vk_ctx, 0, particle_count);
+    uploadParticleLevels(&s, vk_ctx, 0, particle_count, NULL);
+
+
+    LOG_F(
+         INFO,
+         "Initialized fluid sim with %" PRIuFAST32 " particles, workgroup_size=%u, workgroup_count=%u, "
+         "hash_table_size=%u.",
+         s.particle_count, s.gpu_resources.workgroup_size, s.gpu_resources.workgroup_count, s.hash_table_size
+     );
+
+    return s;
+}
+
+
+/// `p_initial_positions[i].xyz` is the position of particle `i`. `p_initial_positions[i].w` is an opaque
+/// 32-bit attribute (e.g. a packed color): the sim never reads or modifies it, but keeps it with the particle,
+/// so it can be read back through `getPositionsVertexBuffer()`.
+extern "C" SimData create(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    const vec4* p_initial_positions
+) {
+
+    ZoneScoped;
+
+    LOG_F(INFO, "Initializing fluid sim.");
+
+    if (params->cpu_backend) return createCpuBackend(params, vk_ctx, particle_count, p_initial_positions);
+    return createGpuBackend(params, vk_ctx, thread_pool, particle_count, p_initial_positions, NULL, NULL, 0);
+}
+
+
+/// `create()`, with the initial particles written on the GPU by a compute shader, so that they never exist on
+/// the host. Only the CPU backend and `SimParameters::autotune_workgroup_size` need them on the host; then
+/// they are generated there instead, with the same distribution.
+extern "C" SimData createFromGenerator(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    const ParticleGenerator* generator
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(particle_count > 0);
+
+    if (params->cpu_backend or params->autotune_workgroup_size)
+    {
+        const GenerateParticlesPushConstants g = getGenerateParticlesPushConstants(generator, particle_count);
+
+        vec4* p_positions = mallocArray(particle_count, vec4);
+        defer(free(p_positions));
+        GenerateParticlesOnHostPass pass { .g = &g, .particle_count = particle_count, .p_positions = p_positions };
+        thread_pool::parallelFor(
+            thread_pool, 0, particle_count, CPU_PARTICLE_GRAIN, generateParticlesOnHostChunk, &pass
+        );
+
+        return create(params, vk_ctx, thread_pool, particle_count, p_positions);
+    }
+
+    LOG_F(INFO, "Initializing fluid sim from a particle generator.");
+
+    return createGpuBackend(params, vk_ctx, thread_pool, particle_count, NULL, generator, NULL, 0);
+}
+
+
+/// `create()`, with the initial particles read from a point set file (see `PointSetHeader`) or a PLY file.
+/// The file is mapped and streamed to the GPU in chunks, so the particles never all exist in host memory,
+/// except for the CPU backend and `SimParameters::autotune_workgroup_size`. The velocities are zero. Logs an
+/// error and returns false if the file can't be read.
+extern "C" bool createFromFile(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const char* filepath,
+    SimData* p_sim_out
+) {
+
+    ZoneScoped;
+
+    PointSetFile file {};
+    if (!openPointSetFile(filepath, &file)) return false;
+    defer(closePointSetFile(&file));
+
+    const u32fast particle_count = (u32fast)file.particle_count;
+    LOG_F(INFO, "Loading %" PRIuFAST32 " particles from `%s`.", particle_count, filepath);
+
+    if (params->cpu_backend or params->autotune_workgroup_size)
+    {
+        vec4* p_positions = mallocArray(particle_count, vec4);
+        defer(free(p_positions));
+        for (u32fast i = 0; i < particle_count; i++) p_positions[i] = readPointSetParticle(&file, i);
+
+        *p_sim_out = create(params, vk_ctx, thread_pool, particle_count, p_positions);
+        return true;
+    }
+
+    *p_sim_out = createGpuBackend(params, vk_ctx, thread_pool, particle_count, NULL, NULL, &file, 0);
+    return true;
+}
+
+
+static EnsembleMemberParams getEnsembleMemberParams(const SimParameters* params) {
+    return EnsembleMemberParams {
+        .spring_stiffness = params->spring_stiffness,
+        .sph_stiffness = params->sph_stiffness,
+        .sph_viscosity = params->sph_viscosity,
+        .padding = 0.0f,
+    };
+}
+
+
+/// Packs `member_count` independent sims into one, for parameter studies of many small sims: the whole ensemble is
+/// sorted, built and updated with the dispatches of a single sim, instead of each member leaving the GPU mostly
+/// idle with dispatches of its own. Each particle carries the index of its member, which the sort moves along with
+/// it, and the particles of different members never interact. The members are laid out on a grid of cells, at
+/// least two cells apart, so that they mostly occupy distinct cells, and distinct ranges of the Morton order: member
+/// `m` is translated by `GpuResources::ensemble_member_offsets[m]`. They share `params`, except for the parameters
+/// of `EnsembleMember`; see `setEnsembleMemberParams()`.
+/// Not for the CPU backend. Ensembles can't emit or remove particles, or be saved to checkpoints.
+extern "C" SimData createEnsemble(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32 member_count,
+    const EnsembleMember* p_members
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(member_count > 0);
+    alwaysAssert(!params->cpu_backend);
+
+    LOG_F(INFO, "Initializing a fluid sim ensemble of %u members.", member_count);
+
+    // first the minimum corner of each member, then its offset
+    vec3* p_offsets = mallocArray(member_count, vec3);
+
+    u32fast particle_count = 0;
+    vec3 max_extent = vec3(0.0f);
+    for (u32 m = 0; m < member_count; m++)
+    {
+        const EnsembleMember* member = &p_members[m];
+        alwaysAssert(member->particle_count > 0);
+
+        const DomainBounds bounds = getParticleBounds(member->particle_count, member->p_initial_positions);
+        p_offsets[m] = bounds.min;
+        max_extent = glm::max(max_extent, bounds.max - bounds.min);
+        particle_count += member->particle_count;
+    }
+
+    // A cube of members, rather than a row, keeps the domain within the Morton codes' range for longer.
+    const f32 cell_size = getParticleInteractionRadius(params) * (1.0f + params->verlet_skin);
+    const vec3 member_stride = max_extent + 2.0f * cell_size;
+    const u32 members_per_axis = (u32)ceilf(cbrtf((f32)member_count));
+
+    vec4* p_positions = mallocArray(particle_count, vec4);
+    defer(free(p_positions));
+    u32* p_member_ids = mallocArray(particle_count, u32);
+    defer(free(p_member_ids));
+    EnsembleMemberParams* p_member_params = mallocArray(member_count, EnsembleMemberParams);
+    defer(free(p_member_params));
+
+    u32fast first_idx = 0;
+    for (u32 m = 0; m < member_count; m++)
+    {
+        const EnsembleMember* member = &p_members[m];
+
+        const vec3 grid_position = vec3(
+            m % members_per_axis, (m / members_per_axis) % members_per_axis, m / (members_per_axis * members_per_axis)
+        );
+        p_offsets[m] = grid_position * member_stride - p_offsets[m];
+
+        for (u32fast i = 0; i < member->particle_count; i++)
+        {
+            const vec4 particle = member->p_initial_positions[i];
+            p_positions[first_idx + i] = vec4(vec3(particle) + p_offsets[m], particle.w);
+            p_member_ids[first_idx + i] = m;
+        }
+        p_member_params[m] = getEnsembleMemberParams(member->params);
+
+        first_idx += member->particle_count;
+    }
+
+    SimData s = createGpuBackend(params, vk_ctx, thread_pool, particle_count, p_positions, NULL, NULL, member_count);
+    GpuResources* res = &s.gpu_resources;
+    res->ensemble_member_offsets = p_offsets;
+
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, member_count * sizeof(EnsembleMemberParams), p_member_params, &res->buffer_ensemble_members, 0,
+        &s.transfers, TRANSFER_UNIFORMS
+    );
+
+    // The member ids go to both orders, like the particles in `copyStagedParticles()`.
+    {
+        const VkDeviceSize size_bytes = particle_count * sizeof(u32);
+        const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, size_bytes, false);
+        defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
+        memcpy(getMappedPointer(&staging), p_member_ids, size_bytes);
+        countTransfer(&s.transfers, TRANSFER_PARTICLES, false, size_bytes);
+
+        // after the initial spatial structure build
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
+        const VkCommandBuffer command_buffer = beginOneOffCommands(&s, vk_ctx);
+
+        const VkBufferCopy copy { .srcOffset = 0, .dstOffset = 0, .size = size_bytes };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, staging.buffer, res->buffer_member_ids_sorted.buffer, 1, &copy
+        );
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, staging.buffer, res->buffer_member_ids_unsorted.buffer, 1, &copy
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        submitOneOffCommands(&s, vk_ctx, command_buffer);
+        // before the staging buffer goes
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    }
+
+    return s;
+}
+
+
+/// Changes the parameters of member `member_idx` of an ensemble that are its own (see `EnsembleMember`); the others
+/// are the ensemble's, which `setParams()` changes. Waits for the sim's submissions to finish, because the steps
+/// read the parameters in place.
+extern "C" void setEnsembleMemberParams(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32 member_idx,
+    const SimParameters* params
+) {
+
+    GpuResources* res = &s->gpu_resources;
+    alwaysAssert(member_idx < res->ensemble_member_count);
+
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    const EnsembleMemberParams member_params = getEnsembleMemberParams(params);
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, sizeof(member_params), &member_params, &res->buffer_ensemble_members,
+        member_idx * sizeof(EnsembleMemberParams), &s->transfers, TRANSFER_UNIFORMS
+    );
+}
+
+
+/// One u32 per particle of `getPositionsVertexBuffer()`, in the same order: the member of the ensemble that it's
+/// in, whose offset is to be subtracted from its position. Returns false, and writes nothing, if the sim isn't an
+/// ensemble.
+extern "C" bool getEnsembleMemberIdsBuffer(const SimData* s, VkBuffer* buffer_out, VkDeviceSize* buffer_size_out) {
+
+    const GpuResources* res = &s->gpu_resources;
+    if (res->ensemble_member_count == 0) return false;
+
+    *buffer_out = res->buffer_member_ids_unsorted.buffer;
+    *buffer_size_out = s->particle_capacity * sizeof(u32);
+    return true;
+}
+
+
+/// One u32 per particle of `getPositionsVertexBuffer()`, in the same order: an id that stays with the particle
+/// through the sorts and the removals. The initial particles count from 0, then the emitted ones continue; an id is
+/// never reused, and checkpoints don't save them. Returns false, and writes nothing, without
+/// `SimParameters::particle_ids` or with the CPU backend.
+extern "C" bool getParticleIdsBuffer(const SimData* s, VkBuffer* buffer_out, VkDeviceSize* buffer_size_out) {
+
+    const GpuResources* res = &s->gpu_resources;
+    if (!res->particle_ids or s->cpu_backend) return false;
+
+    *buffer_out = res->buffer_particle_ids_unsorted.buffer;
+    *buffer_size_out = s->particle_capacity * sizeof(u32);
+    return true;
+}
+
+
+extern "C" void destroy(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    // waits for the GPU to be idle, so it goes first
+    destroyGpuResources(&s->gpu_resources, vk_ctx);
+    if (s->cpu_backend) destroyCpuState(&s->cpu_state, vk_ctx);
+
+    memset(s, 0, sizeof(*s));
+}
+
+
+/// Hands `s`, which an older (or newer) version of the plugin created and stepped, over to this version, after a hot
+/// reload; so that the reload keeps the particles, the spatial structure and every buffer and pipeline, instead of
+/// recreating the sim. `layout_version` and `sim_data_size` are `SIM_DATA_LAYOUT_VERSION` and `sizeof(SimData)`
+/// as the caller was compiled with, i.e. the layout that `s` is in.
+/// Returns false, and leaves `s` alone, if the layout differs from this version's: then neither version may touch
+/// the other's sim, and the caller must keep using the version that created it (or recreate the sim, if its own
+/// `SimData` matches this version's). Converting between layouts would go here, keyed by `layout_version`.
+/// Nothing else may use `s` during the call.
+extern "C" bool migrate(SimData* s, const VulkanContext* vk_ctx, u32 layout_version, size_t sim_data_size) {
+
+    ZoneScoped;
+
+    (void)vk_ctx;
+
+    if (layout_version != SIM_DATA_LAYOUT_VERSION or sim_data_size != sizeof(SimData))
+    {
+        LOG_F(
+            ERROR, "Can't adopt a fluid sim of layout version %" PRIu32 " (%zu bytes); this version's is %" PRIu32
+            " (%zu bytes).", layout_version, sim_data_size, SIM_DATA_LAYOUT_VERSION, sizeof(SimData)
+        );
+        return false;
+    }
+
+    // The buffers, pipelines and semaphores are adopted as they are. What the previous version's code derived from
+    // them is redone by this version's: it may record the steps, or lay out the uniforms, differently.
+    discardGpuResidentRecordings(&s->gpu_resources);
+    s->uniforms_dirty = true;
+
+    return true;
+}
+
+
+/// The memory that `s` holds for its whole lifetime; the staging buffers of uploads and readbacks come and go.
+extern "C" void getMemoryUsage(const SimData* s, SimMemoryUsage* p_usage_out) {
+
+    const GpuResources* res = &s->gpu_resources;
+    const u64 collider_host_bytes =
+        res->collider_slot_count * sizeof(ivec4) + res->collider_brick_capacity * sizeof(u32);
+    const u64 spatial_query_host_bytes = res->spatial_query_capacity * sizeof(SpatialQuery);
+    // the shared memory, and its staging buffer, which `createBuffers()` didn't allocate
+    const u64 state_export_gpu_bytes =
+        (res->state_export != NULL) ? res->buffer_state_export_staging.allocation_info.size : 0;
+
+    *p_usage_out = SimMemoryUsage {
+        .host_bytes = (s->cpu_backend ? s->cpu_state.host_slab_size : 0) + collider_host_bytes
+            + spatial_query_host_bytes + res->state_export_size,
+        .gpu_bytes = res->buffer_memory_size + state_export_gpu_bytes,
+        .gpu_bytes_aliased = res->aliased_buffer_memory_size,
+    };
+}
+
+
+/// What `getMemoryUsage()` would return after `create()` with these parameters, without allocating anything. Only
+/// counts the arrays that scale with the particle count, and not the allocator's alignment, so it's a few KiB
+/// short.
+static SimMemoryUsage estimateMemoryUsage(const SimParameters* params, u32fast particle_count) {
+
+    const u64 capacity = particle_count + params->extra_particle_capacity;
+
+    if (params->cpu_backend)
+    {
+        // see `createCpuBackendBuffers()`, and `createCpuHybrid()`, less the cells that it grows
+        const u64 hybrid_bytes_per_particle =
+            params->hybrid_gpu_update ? 4 * sizeof(vec4) + sizeof(u32) + sizeof(HybridCell) / 8 : 0;
+        return SimMemoryUsage {
+            .host_bytes = getHostSlabSize(capacity),
+            .gpu_bytes = (2 * sizeof(vec4) + hybrid_bytes_per_particle) * capacity,
+        };
+    }
+
+    const u64 hash_table_size = getHashTableSize(capacity, params->hash_table_max_load_factor);
+    const u64 morton_code_word_count = params->morton_codes_64_bit ? 2 : 1;
+    const u64 velocity_array_count = params->half_velocities ? 2 : VELOCITY_COMPONENT_COUNT;
+    const u64 particle_id_array_count = params->particle_ids ? 2 : 0;
+    const u64 particle_level_array_count = params->adaptive_resolution ? 2 : 0;
+
+    // see `createBuffers()`
+    const u64 bytes_per_particle =
+        3 * sizeof(vec4) // positions: sorted, unsorted, reference
+        + 2 * sizeof(vec4) // PBF predicted positions
+        + 2 * velocity_array_count * sizeof(u32) // velocities: sorted, unsorted
+        + 2 * sizeof(uvec2) // cell codes, quantized positions
+        + 2 * morton_code_word_count * sizeof(u32) // Morton codes, and the sort's scratch
+        // cells in both orders, hash ranks, neighbor counts, permutation, sort scratch; the cell indices and
+        // the SPH densities are in the memory of the sort's scratch
+        + 8 * sizeof(u32)
+        + 5 * sizeof(u32) // sleeping: calm steps in both orders, awake and active cells, active particles
+        + particle_id_array_count * sizeof(u32) // particle ids in both orders
+        + particle_level_array_count * sizeof(u32) // particle levels in both orders
+        + params->neighbor_list_capacity * sizeof(u32);
+    u64 bytes_per_hash_table_entry = 2 * sizeof(u32) + sizeof(uvec2);
+    if (params->open_addressing_cell_table) bytes_per_hash_table_entry += sizeof(uvec4);
+
+    // the collider's slots are on both sides, see `getMemoryUsage()`
+    const u64 collider_slot_bytes = (params->collider_brick_capacity > 0)
+        ? getColliderSlotCount(params->collider_brick_capacity) * sizeof(ivec4)
+        : 0;
+    const u64 collider_brick_bytes = (u64)params->collider_brick_capacity * COLLIDER_BRICK_SAMPLE_COUNT * sizeof(f32);
+
+    // the queries are on both sides too
+    const u64 spatial_query_bytes = (u64)params->spatial_query_capacity * sizeof(SpatialQuery);
+    const u64 spatial_query_gpu_bytes = (params->spatial_query_capacity > 0)
+        ? spatial_query_bytes + params->spatial_query_capacity * sizeof(SpatialQueryResult)
+            + (u64)params->spatial_query_hit_capacity * sizeof(SpatialQueryHit)
+        : 0;
+    const u64 region_readback_bytes =
+        (params->region_readback_capacity > 0) ? getRegionReadbackSize(params->region_readback_capacity) : 0;
+    const u64 volume_export_bytes =
+        VOLUME_EXPORT_SLOT_COUNT * getVolumeExportSlotSize(params->volume_export_brick_capacity);
+    // the partial sums depend on the workgroup size a little
+    const u64 flip_grid_bytes =
+        getFlipGridFloatCount(params->flip_grid_resolution, DEFAULT_WORKGROUP_SIZE) * sizeof(f32);
+
+    return SimMemoryUsage {
+        .host_bytes = collider_slot_bytes + params->collider_brick_capacity * sizeof(u32) + spatial_query_bytes,
+        .gpu_bytes = capacity * bytes_per_particle + hash_table_size * bytes_per_hash_table_entry
+            + collider_slot_bytes + collider_brick_bytes + spatial_query_gpu_bytes + region_readback_bytes
+            + volume_export_bytes + flip_grid_bytes,
+    };
+}
+
+
+/// The size of the largest buffer that `createBuffers()` would bind to a storage buffer descriptor for `capacity`
+/// particles, not counting the chunked buffers, whose chunks `getParticleChunkShift()` sizes to fit. Each other
+/// particle array is a single `VkBuffer`, bound whole, so this must be at most `maxStorageBufferRange`.
+static u64 getLargestStorageBufferRange(const SimParameters* params, u64 capacity) {
+
+    const u64 hash_table_size = getHashTableSize(capacity, params->hash_table_max_load_factor);
+    const u64 velocity_array_count = params->half_velocities ? 2 : VELOCITY_COMPONENT_COUNT;
+
+    const u64 ranges[] {
+        capacity * sizeof(vec4), // positions
+        capacity * velocity_array_count * sizeof(u32), // every velocity array is in the same buffer
+        capacity * sizeof(uvec2), // cell codes, quantized positions, 63-bit Morton codes
+        hash_table_size * (params->open_addressing_cell_table ? sizeof(uvec4) : sizeof(uvec2)),
+        getRegionReadbackSize(params->region_readback_capacity),
+        VOLUME_EXPORT_SLOT_COUNT * getVolumeExportSlotSize(params->volume_export_brick_capacity),
+        glm::max(params->spatial_query_hit_capacity, 1u) * sizeof(SpatialQueryHit),
+        getFlipGridFloatCount(params->flip_grid_resolution, 1) * sizeof(f32), // at most this many partial sums
+    };
+
+    u64 largest = 0;
+    for (u32 i = 0; i < ARRAY_SIZE(ranges); i++) largest = glm::max(largest, ranges[i]);
+    return largest;
+}
+
+
+/// Writes an estimate of the memory that `create()` would allocate for `particle_count` particles (see
+/// `getMemoryUsage()`) to `p_usage_out`, and returns whether it fits: in what's left of the budgets of the
+/// device-local heaps (`vmaGetHeapBudgets()`), and in the free physical memory. The memory of
+/// `p_replaced_sim_optional` counts as free, for a sim that is destroyed before the new one is created. Logs an
+/// error if it doesn't fit, so that the caller can refuse instead of running out of memory halfway. Also refuses
+/// (with `*p_usage_out` zeroed) if some particle array would exceed the device's `maxStorageBufferRange`, or need
+/// more than MAX_BUFFER_CHUNK_COUNT chunks of it, or the hash table its 2^31 buckets.
+extern "C" bool checkMemoryUsage(
+    const SimParameters* params,
+    const VulkanContext* vk_ctx,
+    u32fast particle_count,
+    const SimData* p_replaced_sim_optional,
+    SimMemoryUsage* p_usage_out
+) {
+
+    ZoneScoped;
+
+    *p_usage_out = SimMemoryUsage {};
+
+    // The particles are indexed with `u32`s, and the hash table has at most 2^31 buckets.
+    const u64 capacity = particle_count + params->extra_particle_capacity;
+    if (!params->cpu_backend and (f64)capacity / (f64)params->hash_table_max_load_factor > (f64)(1u << 31))
+    {
+        LOG_F(
+            ERROR, "A sim with %" PRIu64 " particles needs more than 2^31 hash table buckets, at a load factor of %g.",
+            capacity, (f64)params->hash_table_max_load_factor
+        );
+        return false;
+    }
+    // Every particle array must fit in a single storage buffer binding, or in the chunks of a chunked buffer.
+    if (!params->cpu_backend)
+    {
+        const u64 largest_range = getLargestStorageBufferRange(params, capacity);
+        const u64 max_range = vk_ctx->physical_device_properties.limits.maxStorageBufferRange;
+        if (largest_range > max_range)
         {
-            .p_buffer_out = &res->buffer_velocities_unsorted,
-            .size = particle_count * sizeof(vec4),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        },
+            LOG_F(
+                ERROR,
+                "A sim with %" PRIu64 " particles needs a %.1lf MiB storage buffer, but the device binds at most "
+                "%.1lf MiB.",
+                capacity, (f64)largest_range / (1024.0 * 1024.0), (f64)max_range / (1024.0 * 1024.0)
+            );
+            return false;
+        }
+
+        const u32 chunk_shift = getParticleChunkShift(capacity, params->neighbor_list_capacity, max_range);
+        const u64 chunk_count = getParticleChunkCount(capacity, chunk_shift);
+        if (chunk_count > MAX_BUFFER_CHUNK_COUNT)
         {
-            .p_buffer_out = &res->buffer_C_begin,
-            .size = (particle_count + 1) * sizeof(u32),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            // OPTIMIZE we should definitely try using PREFER_DEVICE + DEVICE_LOCAL + a staging buffer for
-            //     this one, because the shaders access it many times per frame.
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+            LOG_F(
+                ERROR,
+                "A sim with %" PRIu64 " particles needs its neighbor lists in %" PRIu64 " storage buffers of at most "
+                "%.1lf MiB, but at most %u are bound.",
+                capacity, chunk_count, (f64)max_range / (1024.0 * 1024.0), MAX_BUFFER_CHUNK_COUNT
+            );
+            return false;
+        }
+    }
+
+    const SimMemoryUsage usage = estimateMemoryUsage(params, particle_count);
+    *p_usage_out = usage;
+
+    SimMemoryUsage replaced_usage {};
+    if (p_replaced_sim_optional != NULL) getMemoryUsage(p_replaced_sim_optional, &replaced_usage);
+
+    u64 gpu_available_bytes = replaced_usage.gpu_bytes;
+    {
+        const VkPhysicalDeviceMemoryProperties* mem_props = NULL;
+        vmaGetMemoryProperties(vk_ctx->vma_allocator, &mem_props);
+
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS] {};
+        vmaGetHeapBudgets(vk_ctx->vma_allocator, budgets);
+
+        for (u32 heap_idx = 0; heap_idx < mem_props->memoryHeapCount; heap_idx++)
         {
-            .p_buffer_out = &res->buffer_C_length,
-            .size = (particle_count + 1) * sizeof(u32),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            // OPTIMIZE we should definitely try using PREFER_DEVICE + DEVICE_LOCAL + a staging buffer for
-            //     this one, because the shaders access it many times per frame.
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+            if (!(mem_props->memoryHeaps[heap_idx].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+            const VmaBudget* budget = &budgets[heap_idx];
+            if (budget->budget > budget->usage) gpu_available_bytes += budget->budget - budget->usage;
+        }
+    }
+
+    u64 host_available_bytes = replaced_usage.host_bytes;
+    {
+        const long page_count = sysconf(_SC_AVPHYS_PAGES);
+        const long page_size = sysconf(_SC_PAGESIZE);
+        if (page_count > 0 and page_size > 0) host_available_bytes += (u64)page_count * (u64)page_size;
+    }
+
+    if (usage.gpu_bytes > gpu_available_bytes or usage.host_bytes > host_available_bytes)
+    {
+        LOG_F(
+            ERROR,
+            "A sim with %" PRIuFAST32 " particles needs about %.1lf MiB of GPU memory and %.1lf MiB of host "
+            "memory, but only %.1lf MiB and %.1lf MiB are available.",
+            particle_count,
+            (f64)usage.gpu_bytes / (1024.0 * 1024.0), (f64)usage.host_bytes / (1024.0 * 1024.0),
+            (f64)gpu_available_bytes / (1024.0 * 1024.0), (f64)host_available_bytes / (1024.0 * 1024.0)
+        );
+        return false;
+    }
+
+    return true;
+}
+
+
+/// `SimParameters::gpu_resident` mode.
+/// All `substep_count` steps go into a single command buffer, so that the host only records and submits; and the
+/// time step is read from `buffer_delta_ts`, so that the command buffer is only recorded again when something that
+/// it recorded changes (see `GpuResidentRecording`). The host only waits for the submission from
+/// `GPU_RESIDENT_FRAMES_IN_FLIGHT` frames ago, to recycle its command buffer. Every substep writes the same
+/// domain bounds slot, so only the last substep's bounds are checked.
+static void advanceGpuResident(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    f32 delta_t,
+    u32 substep_count,
+    VkSemaphore optional_wait_semaphore,
+    VkSemaphore optional_signal_semaphore
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    GpuResources* res = &s->gpu_resources;
+
+    // The recorded steps always rebuild the spatial structure, so they start from the unsorted buffers; but the
+    // synchronous mode's steps may have left the buffers swapped.
+    unswapParticleBuffers(s, vk_ctx);
+
+    const u32 frame_idx = res->gpu_resident_frame_idx;
+    res->gpu_resident_frame_idx = (frame_idx + 1) % GPU_RESIDENT_FRAMES_IN_FLIGHT;
+
+    const VkCommandBuffer command_buffer = res->gpu_resident_command_buffers[frame_idx];
+
+    {
+        ZoneScopedN("WaitForFrameInFlight");
+        waitForTimelineValue(vk_ctx, res, res->gpu_resident_timeline_values[frame_idx]);
+    }
+
+    // The bounds that the submission from `GPU_RESIDENT_FRAMES_IN_FLIGHT` frames ago built its spatial
+    // structure from, so an oversized domain is only caught that many frames late.
+    {
+        DomainBounds bounds {};
+        downloadFromHostVisibleGpuBuffer(
+            vk_ctx, sizeof(bounds), &res->buffer_domain_bounds, (1 + frame_idx) * sizeof(DomainBounds), &bounds,
+            &s->transfers, TRANSFER_STEP_FEEDBACK
+        );
+        assertDomainFitsMortonCodes(&bounds, s->parameters.cell_size_reciprocal, res->morton_code_word_count);
+    }
+
+    writeDeltaT(s, vk_ctx, 1 + frame_idx, delta_t);
+    if (s->parameters.adaptive_time_step) readAndClearMaxMotion(s, vk_ctx, 1 + frame_idx);
+    if (s->parameters.diagnostics) readAndClearDiagnostics(s, vk_ctx, 1 + frame_idx);
+
+    // The uniforms are dirtied by every change of the parameters or of the particle count, which the recordings
+    // depend on; and a recording that updates them would undo a later update if it were resubmitted.
+    if (s->uniforms_dirty) discardGpuResidentRecordings(res);
+
+    GpuResidentRecording* recording = &res->gpu_resident_recordings[frame_idx];
+    const bool recording_current =
+        recording->valid and
+        recording->substep_count == substep_count and
+        recording->spatial_structure_rebuilt_last_step == s->spatial_structure_rebuilt_last_step;
+
+    if (!recording_current)
+    {
+        ZoneScopedN("RecordGpuResidentCommandBuffer");
+
+        *recording = GpuResidentRecording {
+            .valid = REUSE_GPU_RESIDENT_RECORDINGS,
+            .substep_count = substep_count,
+            .spatial_structure_rebuilt_last_step = s->spatial_structure_rebuilt_last_step,
+        };
+
+        result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
+        assertVk(result);
+
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = 0, // resubmitted until it's discarded
+        };
+        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+        assertVk(result);
+        {
+            TracyVkZone(vk_ctx->compute_tracy_vk_ctx, command_buffer, "sim::GpuResidentAdvance");
+
+            // The first synchronization scope of a barrier includes all commands earlier in submission order, so
+            // this orders the whole step after the previous steps, which may still be in flight.
+            recordStepBarrier(vk_ctx, command_buffer);
+            recordStageTimestampReset(s, vk_ctx, command_buffer, 1 + frame_idx);
+
+            // Update the uniforms from the command buffer rather than from the host, because the previous steps
+            // may still be reading them. The update is ordered in the queue, so it only needs to be recorded once
+            // per change.
+            if (s->uniforms_dirty)
+            {
+                const UniformBufferData::UpdatedByHost uniform_data = getUniformsUpdatedByHost(s);
+                vk_ctx->procs_dev.CmdUpdateBuffer(
+                    command_buffer,
+                    res->buffer_uniforms.buffer,
+                    offsetof(UniformBufferData, updated_by_host),
+                    sizeof(uniform_data),
+                    &uniform_data
+                );
+
+                const VkMemoryBarrier memory_barrier {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT,
+                };
+                vk_ctx->procs_dev.CmdPipelineBarrier(
+                    command_buffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    0, // dependencyFlags
+                    1, // memoryBarrierCount
+                    &memory_barrier,
+                    0, // bufferMemoryBarrierCount
+                    NULL, // pBufferMemoryBarriers
+                    0, // imageMemoryBarrierCount
+                    NULL // pImageMemoryBarriers
+                );
+
+                s->uploaded_byte_count += sizeof(uniform_data);
+                countTransfer(&s->transfers, TRANSFER_UNIFORMS, false, sizeof(uniform_data));
+                s->uniforms_dirty = false;
+            }
+
+            // Same order as the synchronous mode (the spatial structure is built at the end of the step, for the
+            // next step), so that we can switch between the modes at any time.
+            for (u32 substep = 0; substep < substep_count; substep++)
+            {
+                if (substep > 0) recordStepBarrier(vk_ctx, command_buffer);
+
+                // A query can only be written once per reset, so only the last substep is timed.
+                const u32 timestamp_slot =
+                    (substep == substep_count - 1) ? 1 + frame_idx : STAGE_TIMESTAMP_SLOT_NONE;
+
+                recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_PARTICLE_UPDATE, false);
+                recordParticleUpdateCommands(s, vk_ctx, command_buffer, 1 + frame_idx);
+                recordStageTimestamp(s, vk_ctx, command_buffer, timestamp_slot, SIM_STAGE_PARTICLE_UPDATE, true);
+                recordComputeToComputeBarrier(vk_ctx, command_buffer);
+                recordSpatialStructureCommands(
+                    s, vk_ctx, command_buffer, 1 + frame_idx, s->parameters.fuse_morton_codes_into_update,
+                    timestamp_slot
+                );
+
+                // what the next substep's `recordParticleUpdateCommands()` expects
+                s->spatial_structure_rebuilt_last_step = true;
+                s->spatial_structure_outdated = false;
+            }
+
+            TracyVkCollect(vk_ctx->compute_tracy_vk_ctx, command_buffer);
+        }
+        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+        assertVk(result);
+    }
+
+    // what the recorded substeps leave behind, whether or not they were just recorded
+    res->spatial_structure_bounds_slot = 1 + frame_idx;
+    s->spatial_structure_rebuilt_last_step = true;
+    s->spatial_structure_outdated = false;
+
+    {
+        ZoneScopedN("SubmitGpuResidentCommandBuffer");
+
+        // The user semaphore guards the positions buffer, which is first written by the particle update.
+        const VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        const u32 wait_semaphore_count = (optional_wait_semaphore == VK_NULL_HANDLE) ? (u32)0 : (u32)1;
+
+        const u64 signal_value = ++res->timeline_value;
+        res->gpu_resident_timeline_values[frame_idx] = signal_value;
+        res->stage_query_last_slot = 1 + frame_idx;
+
+        const VkSemaphore signal_semaphores[2] { res->timeline_semaphore, optional_signal_semaphore };
+        const u64 signal_values[2] { signal_value, 0 }; // binary semaphores ignore their value
+        const u32 signal_semaphore_count = (optional_signal_semaphore == VK_NULL_HANDLE) ? (u32)1 : (u32)2;
+
+        const u64 wait_value = 0;
+        const VkTimelineSemaphoreSubmitInfo timeline_info {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = wait_semaphore_count,
+            .pWaitSemaphoreValues = &wait_value,
+            .signalSemaphoreValueCount = signal_semaphore_count,
+            .pSignalSemaphoreValues = signal_values,
+        };
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = wait_semaphore_count,
+            .pWaitSemaphores = &optional_wait_semaphore,
+            .pWaitDstStageMask = &wait_dst_stage_mask,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+            .signalSemaphoreCount = signal_semaphore_count,
+            .pSignalSemaphores = signal_semaphores,
+        };
+        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+        assertVk(result);
+    }
+}
+
+
+/// Submits a rebuild of the spatial structure from the unsorted buffers, after the previous submissions and
+/// uploads.
+static void rebuildSpatialStructure(SimData* s, const VulkanContext* vk_ctx) {
+
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+
+    // after the upload, and after the previous steps
+    recordStepBarrier(vk_ctx, command_buffer);
+    recordSpatialStructureCommands(s, vk_ctx, command_buffer, 0, false, STAGE_TIMESTAMP_SLOT_NONE);
+    s->gpu_resources.spatial_structure_bounds_slot = 0;
+
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+
+    s->spatial_structure_rebuilt_last_step = true;
+    s->spatial_structure_outdated = false;
+    // the particles were added or replaced
+    s->calm_steps_outdated = true;
+}
+
+
+/// True if `pos` is in one of the collider's bricks, which only exist where there is a surface nearby.
+static bool isInColliderBrick(const GpuResources* res, vec3 pos) {
+
+    if (res->collider_slot_count == 0) return false;
+
+    const ivec3 brick = ivec3(glm::floor(pos / res->collider_cell_size)) >> (i32)COLLIDER_BRICK_SIZE_LOG2;
+    return res->collider_slots[findColliderSlot(res, brick)].w != COLLIDER_SLOT_EMPTY;
+}
+
+
+/// Every `SimParameters::adaptive_resolution_interval` steps, merges and splits the particles; see
+/// `SimParameters::adaptive_resolution`. The particles are read back, the host decides, and the new particles
+/// replace the old ones, like in `replaceParticles()`. The decisions only look at each particle's neighbors
+/// within the interaction radius, found on a grid of that size, without the periodic images. The sim's
+/// submissions must have finished.
+static void adaptParticleResolution(SimData* s, const VulkanContext* vk_ctx) {
+
+    GpuResources* res = &s->gpu_resources;
+
+    const u32 interval = s->parameters.adaptive_resolution_interval;
+    if (!res->particle_levels or interval == 0 or res->ensemble_member_count > 0) return;
+    if (++s->steps_since_resolution_adaptation < interval) return;
+    s->steps_since_resolution_adaptation = 0;
+
+    ZoneScoped;
+
+    const u32fast count = s->particle_count;
+    const u32fast capacity = s->particle_capacity;
+
+    void* p_packed = malloc(getPackedParticlesSize(count));
+    alwaysAssert(p_packed != NULL);
+    defer(free(p_packed));
+    readBackPackedParticles(s, vk_ctx, p_packed);
+
+    const vec4* p_positions = (const vec4*)p_packed;
+    const f32* p_velocities = (const f32*)( (uintptr_t)p_packed + count * sizeof(vec4) );
+    const auto getVelocity = [&](u32fast i) {
+        return vec3(p_velocities[i], p_velocities[count + i], p_velocities[2 * count + i]);
+    };
+
+    u32* p_levels = mallocArray(count, u32);
+    defer(free(p_levels));
+    readBackParticleLevels(s, vk_ctx, p_levels);
+
+    const auto getMass = [](u32 level) { return (f32)(1u << level); };
+
+    // The particles, bucketed by a hash of their cell: bucket `b` holds `p_bucketed[p_bucket_begins[b]]` to
+    // `p_bucketed[p_bucket_begins[b + 1] - 1]`. A bucket may hold several cells, which the distance tests tell apart.
+    const f32 radius = s->parameters.particle_interaction_radius;
+    const u32 bucket_mask = getHashTableSize(count, 0.5f) - 1;
+    const auto getBucket = [&](ivec3 cell) { return colliderBrickHash(cell) & bucket_mask; };
+    const auto getCell = [&](vec3 pos) { return ivec3(glm::floor(pos / radius)); };
+
+    u32* p_bucket_begins = callocArray((bucket_mask + 2), u32);
+    defer(free(p_bucket_begins));
+    u32* p_bucketed = mallocArray(count, u32);
+    defer(free(p_bucketed));
+    {
+        for (u32fast i = 0; i < count; i++) p_bucket_begins[getBucket(getCell(vec3(p_positions[i]))) + 1]++;
+        for (u32 b = 0; b <= bucket_mask; b++) p_bucket_begins[b + 1] += p_bucket_begins[b];
+
+        u32* p_cursors = mallocArray((bucket_mask + 1), u32);
+        defer(free(p_cursors));
+        memcpy(p_cursors, p_bucket_begins, (bucket_mask + 1) * sizeof(u32));
+        for (u32fast i = 0; i < count; i++)
         {
-            .p_buffer_out = &res->buffer_H_begin,
-            .size = hash_modulus * sizeof(u32),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            // OPTIMIZE we should definitely try using PREFER_DEVICE + DEVICE_LOCAL + a staging buffer for
-            //     this one, because the shaders access it many times per frame.
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+            p_bucketed[p_cursors[getBucket(getCell(vec3(p_positions[i])))]++] = (u32)i;
+        }
+    }
+
+    // Calls `visit(j, dist_sq)` for each particle `j` within the interaction radius of particle `i`, other than `i`.
+    const auto forEachNeighbor = [&](u32fast i, auto&& visit) {
+
+        const vec3 pos = vec3(p_positions[i]);
+        const ivec3 cell = getCell(pos);
+
+        // two of the cells may share a bucket, whose particles must only be visited once
+        u32 visited_buckets[27];
+        u32 visited_bucket_count = 0;
+
+        for (i32 z = -1; z <= 1; z++)
+        for (i32 y = -1; y <= 1; y++)
+        for (i32 x = -1; x <= 1; x++)
         {
-            .p_buffer_out = &res->buffer_H_length,
-            .size = hash_modulus * sizeof(u32),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            // OPTIMIZE we should definitely try using PREFER_DEVICE + DEVICE_LOCAL + a staging buffer for
-            //     this one, because the shaders access it many times per frame.
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+            const u32 bucket = getBucket(cell + ivec3(x, y, z));
+            bool visited = false;
+            for (u32 k = 0; k < visited_bucket_count; k++) visited |= visited_buckets[k] == bucket;
+            if (visited) continue;
+            visited_buckets[visited_bucket_count++] = bucket;
+
+            for (u32 k = p_bucket_begins[bucket]; k < p_bucket_begins[bucket + 1]; k++)
+            {
+                const u32 j = p_bucketed[k];
+                const vec3 disp = vec3(p_positions[j]) - pos;
+                const f32 dist_sq = glm::dot(disp, disp);
+                if (j != i and dist_sq < radius * radius) visit(j, dist_sq);
+            }
+        }
+    };
+
+    // the mass within each particle's interaction radius, itself included
+    f32* p_neighborhood_masses = mallocArray(count, f32);
+    defer(free(p_neighborhood_masses));
+    for (u32fast i = 0; i < count; i++)
+    {
+        f32 mass = getMass(p_levels[i]);
+        forEachNeighbor(i, [&](u32 j, f32) { mass += getMass(p_levels[j]); });
+        p_neighborhood_masses[i] = mass;
+    }
+
+    const u32 max_level = s->parameters.adaptive_max_level;
+    const f32 interior_mass = s->parameters.adaptive_interior_mass;
+    const f32 surface_mass = s->parameters.adaptive_surface_mass;
+    const auto canMerge = [&](u32fast i) {
+        return p_levels[i] < max_level and p_neighborhood_masses[i] >= interior_mass
+            and !isInColliderBrick(res, vec3(p_positions[i]));
+    };
+
+    vec4* p_new_positions = mallocArray(capacity, vec4);
+    defer(free(p_new_positions));
+    vec3* p_new_velocities = mallocArray(capacity, vec3);
+    defer(free(p_new_velocities));
+    u32* p_new_levels = mallocArray(capacity, u32);
+    defer(free(p_new_levels));
+
+    bool* p_merged = callocArray(count, bool); // the particles that an earlier one merged with
+    defer(free(p_merged));
+
+    u32fast new_count = 0;
+    u32fast merge_count = 0;
+    u32fast split_count = 0;
+    for (u32fast i = 0; i < count; i++)
+    {
+        if (p_merged[i]) continue;
+
+        const u32 level = p_levels[i];
+        const vec3 pos = vec3(p_positions[i]);
+
+        // with the nearest of the later particles that could merge with one of the same level
+        if (canMerge(i))
         {
-            .p_buffer_out = &res->buffer_reduction_1,
-            .size = particle_count * sizeof(vec4), // OPTIMIZE this can be smaller (divCeil(size, 2)?)
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        },
+            u32fast partner = count;
+            f32 partner_dist_sq = INFINITY;
+            forEachNeighbor(i, [&](u32 j, f32 dist_sq) {
+                if (j < i or p_merged[j] or p_levels[j] != level or dist_sq >= partner_dist_sq) return;
+                if (!canMerge(j)) return;
+                partner = j;
+                partner_dist_sq = dist_sq;
+            });
+
+            if (partner < count)
+            {
+                // Of the same mass, so the merged particle is at their midpoint, with their mean velocity, which
+                // keeps their momentum. It keeps the first one's attribute.
+                p_merged[partner] = true;
+                p_new_positions[new_count] = vec4(0.5f * (pos + vec3(p_positions[partner])), p_positions[i].w);
+                p_new_velocities[new_count] = 0.5f * (getVelocity(i) + getVelocity(partner));
+                p_new_levels[new_count] = level + 1;
+                new_count++;
+                merge_count++;
+                continue;
+            }
+        }
+
+        // Into two halves, with the same velocity, a quarter of the particle spacing of the old level away on
+        // either side, in a direction that varies from particle to particle, so that the splits don't line up.
+        // Only if the particles still to come fit as they are.
+        const bool split = level > 0
+            and (p_neighborhood_masses[i] < surface_mass or isInColliderBrick(res, pos))
+            and new_count + 2 + (count - i - 1) <= capacity;
+        if (split)
         {
-            .p_buffer_out = &res->buffer_reduction_2,
-            .size = particle_count * sizeof(vec4), // OPTIMIZE this can be smaller (divCeil(size, 4)?)
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            .alloc_flags = 0,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .required_mem_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        },
+            const u32 hash = (u32)i * 2654435769u;
+            const f32 cos_theta = 1.0f - 2.0f * (f32)(hash >> 8) * (1.0f / 16777216.0f);
+            const f32 phi = 2.0f * PI * (f32)((hash * 2246822519u) >> 8) * (1.0f / 16777216.0f);
+            const f32 sin_theta = sqrtf(math::max(0.0f, 1.0f - cos_theta * cos_theta));
+            const vec3 direction = vec3(sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta);
+
+            const f32 spacing = cbrtf(getMass(level) / s->parameters.rest_particle_density);
+            const vec3 offset = 0.25f * spacing * direction;
+
+            for (i32 side = -1; side <= 1; side += 2)
+            {
+                p_new_positions[new_count] = vec4(pos + (f32)side * offset, p_positions[i].w);
+                p_new_velocities[new_count] = getVelocity(i);
+                p_new_levels[new_count] = level - 1;
+                new_count++;
+            }
+            split_count++;
+            continue;
+        }
+
+        p_new_positions[new_count] = p_positions[i];
+        p_new_velocities[new_count] = getVelocity(i);
+        p_new_levels[new_count] = level;
+        new_count++;
+    }
+
+    if (merge_count == 0 and split_count == 0) return;
+
+    uploadParticles(res, vk_ctx, capacity, 0, new_count, p_new_positions, p_new_velocities, &s->transfers);
+    uploadParticleLevels(s, vk_ctx, 0, new_count, p_new_levels);
+    uploadParticleIds(s, vk_ctx, 0, new_count);
+    setParticleCount(s, new_count);
+    uploadDataToGpu(s, vk_ctx);
+
+    // The spatial structure is of the old particles.
+    rebuildSpatialStructure(s, vk_ctx);
+
+    LOG_F(
+        INFO, "Merged %" PRIuFAST32 " pairs of particles, and split %" PRIuFAST32 "; %" PRIuFAST32 " are left.",
+        merge_count, split_count, new_count
+    );
+}
+
+
+/// Every `SimParameters::hash_table_resize_interval` steps, resizes the hash table to fit the cells that the last
+/// rebuild found, and if it did, rebuilds the spatial structure, because the cells' buckets have changed. The
+/// sim's submissions must have finished.
+static void fitHashTableSize(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+
+    const u32 interval = s->parameters.hash_table_resize_interval;
+    if (interval == 0 or res->cell_slot_count > 0) return;
+    if (++s->steps_since_hash_table_fit < interval) return;
+    s->steps_since_hash_table_fit = 0;
+
+    u32 cell_count = 0;
+    downloadFromHostVisibleGpuBuffer(
+        vk_ctx, sizeof(cell_count), &res->buffer_cell_count, offsetof(CellCountState, cell_count), &cell_count,
+        &s->transfers, TRANSFER_STEP_FEEDBACK
+    );
+    TracyPlot("sim::CellCount", (int64_t)cell_count);
+
+    const u32 fitted_size = math::min(
+        getHashTableSize(cell_count, s->parameters.hash_table_max_load_factor), s->hash_table_capacity
+    );
+    // the hysteresis: a table that was just grown doesn't shrink unless the cells are more than halved
+    const bool resize = fitted_size > s->hash_table_size or (u64)fitted_size * 4 <= s->hash_table_size;
+    if (!resize) return;
+
+    LOG_F(
+        INFO, "Resized the hash table from %u to %u buckets, for %u cells.",
+        s->hash_table_size, fitted_size, cell_count
+    );
+    s->hash_table_size = fitted_size;
+    TracyPlot("sim::HashTableSize", (int64_t)fitted_size);
+
+    // The rebuild reads the size from the uniforms, and the recordings have it baked in.
+    s->uniforms_dirty = true;
+    uploadDataToGpu(s, vk_ctx);
+    discardGpuResidentRecordings(res);
+    rebuildSpatialStructure(s, vk_ctx);
+}
+
+
+/// The synchronous mode: one step, whose spatial structure rebuild the host can skip (in Verlet skin mode).
+static void advanceSynchronous(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    f32 delta_t,
+    VkSemaphore optional_wait_semaphore,
+    VkSemaphore particle_update_finished_signal_semaphore_optional
+) {
+
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    GpuResources* res = &s->gpu_resources;
+
+    {
+        ZoneScopedN("WaitForPreviousStep");
+
+        // This includes any steps that were submitted in GPU-resident mode, because we write the uniforms from
+        // the host below.
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    }
+
+    if (s->spatial_structure_rebuilt_last_step)
+    {
+        DomainBounds bounds {};
+        downloadFromHostVisibleGpuBuffer(
+            vk_ctx, sizeof(bounds), &s->gpu_resources.buffer_domain_bounds, 0, &bounds,
+            &s->transfers, TRANSFER_STEP_FEEDBACK
+        );
+        assertDomainFitsMortonCodes(
+            &bounds, s->parameters.cell_size_reciprocal, s->gpu_resources.morton_code_word_count
+        );
+    }
+
+    // how far the previous step's sort was from sorted order; 0 means that the sort passes were skipped
+    #ifdef TRACY_ENABLE
+    if (s->spatial_structure_rebuilt_last_step)
+    {
+        u32 descent_count = 0;
+        downloadFromHostVisibleGpuBuffer(
+            vk_ctx, sizeof(descent_count),
+            &s->gpu_resources.buffer_radix_sort_state, offsetof(RadixSortState, descent_count),
+            &descent_count, &s->transfers, TRANSFER_STEP_FEEDBACK
+        );
+        TracyPlot("sim::SortDescentCount", (int64_t)descent_count);
+    }
+    #endif
+
+    // Recorded every step, but it only changes when the lists are rebuilt.
+    if (s->gpu_resources.neighbor_list_capacity > 0)
+    {
+        downloadFromHostVisibleGpuBuffer(
+            vk_ctx, sizeof(s->neighbor_list_overflow_count),
+            &s->gpu_resources.buffer_neighbor_list_overflow, 0, &s->neighbor_list_overflow_count,
+            &s->transfers, TRANSFER_STEP_FEEDBACK
+        );
+        TracyPlot("sim::NeighborListOverflowCount", (int64_t)s->neighbor_list_overflow_count);
+    }
+
+    fitHashTableSize(s, vk_ctx);
+    adaptParticleResolution(s, vk_ctx);
+
+    // The user semaphore only guards the positions, which the host doesn't touch, so it's waited on by the
+    // particle update rather than here.
+    uploadDataToGpu(s, vk_ctx);
+    writeDeltaT(s, vk_ctx, 0, delta_t);
+    if (s->parameters.adaptive_time_step) readAndClearMaxMotion(s, vk_ctx, 0);
+    if (s->parameters.diagnostics) readAndClearDiagnostics(s, vk_ctx, 0);
+
+    const bool verlet_skin_active = isVerletSkinActive(s);
+
+    // The particles stay where the previous step wrote them, rather than being copied to the sorted buffers.
+    if (isSwappedStep(s)) res->particle_buffers_swapped = !res->particle_buffers_swapped;
+
+
+    result = vk_ctx->procs_dev.ResetCommandBuffer(s->gpu_resources.general_purpose_command_buffer, 0);
+    assertVk(result);
+
+    VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(s->gpu_resources.general_purpose_command_buffer, &begin_info);
+    assertVk(result);
+    {
+        TracyVkZone(vk_ctx->compute_tracy_vk_ctx, s->gpu_resources.general_purpose_command_buffer, "sim::SortAndUpdateParticles");
+
+        const VkCommandBuffer command_buffer = s->gpu_resources.general_purpose_command_buffer;
+
+        // slot 0, like the domain bounds; the previous step has finished, so it's free
+        recordStageTimestampReset(s, vk_ctx, command_buffer, 0);
+
+        recordStageTimestamp(s, vk_ctx, command_buffer, 0, SIM_STAGE_PARTICLE_UPDATE, false);
+        recordParticleUpdateCommands(s, vk_ctx, command_buffer, 0);
+        recordStageTimestamp(s, vk_ctx, command_buffer, 0, SIM_STAGE_PARTICLE_UPDATE, true);
+
+        if (verlet_skin_active)
         {
-            .p_buffer_out = &res->buffer_morton_codes_or_permutation,
-            .size = particle_count * sizeof(u32),
-            .buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            .alloc_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-            .mem_usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            .required_mem_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        },
+            recordComputeToComputeBarrier(vk_ctx, command_buffer);
+            recordStageTimestamp(s, vk_ctx, command_buffer, 0, SIM_STAGE_MAX_DISPLACEMENT, false);
+            recordMaxDisplacementCommands(s, vk_ctx, command_buffer);
+            recordStageTimestamp(s, vk_ctx, command_buffer, 0, SIM_STAGE_MAX_DISPLACEMENT, true);
+        }
+
+        TracyVkCollect(vk_ctx->compute_tracy_vk_ctx, s->gpu_resources.general_purpose_command_buffer);
+    }
+    result = vk_ctx->procs_dev.EndCommandBuffer(s->gpu_resources.general_purpose_command_buffer);
+    assertVk(result);
+
+    const u64 particle_update_finished_value = ++res->timeline_value;
+    res->stage_query_last_slot = 0;
+    {
+        ZoneScopedN("SubmitParticleUpdateCommandBuffer");
+
+        // The user semaphore guards the positions buffer, which is first written by the particle update.
+        const VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        const u32 wait_semaphore_count = (optional_wait_semaphore == VK_NULL_HANDLE) ? (u32)0 : (u32)1;
+        const u64 wait_value = 0;
+
+        const u32 signal_semaphore_count =
+            (particle_update_finished_signal_semaphore_optional == VK_NULL_HANDLE)
+            ? (u32)1
+            : (u32)2;
+
+        const VkSemaphore signal_semaphores[2] {
+            res->timeline_semaphore,
+            particle_update_finished_signal_semaphore_optional,
+        };
+        const u64 signal_values[2] { particle_update_finished_value, 0 }; // binary semaphores ignore the value
+
+        const VkTimelineSemaphoreSubmitInfo timeline_info {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = wait_semaphore_count,
+            .pWaitSemaphoreValues = &wait_value,
+            .signalSemaphoreValueCount = signal_semaphore_count,
+            .pSignalSemaphoreValues = signal_values,
+        };
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = wait_semaphore_count,
+            .pWaitSemaphores = &optional_wait_semaphore,
+            .pWaitDstStageMask = &wait_dst_stage_mask,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &res->general_purpose_command_buffer,
+            .signalSemaphoreCount = signal_semaphore_count,
+            .pSignalSemaphores = signal_semaphores,
+        };
+        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+        assertVk(result);
+    }
+
+    bool rebuild = true;
+    if (verlet_skin_active)
+    {
+        ZoneScopedN("WaitForMaxDisplacement");
+
+        waitForTimelineValue(vk_ctx, res, particle_update_finished_value);
+
+        f32 max_displacement = 0.0f;
+        downloadFromHostVisibleGpuBuffer(
+            vk_ctx, sizeof(max_displacement), &s->gpu_resources.buffer_max_displacement, 0, &max_displacement,
+            &s->transfers, TRANSFER_STEP_FEEDBACK
+        );
+
+        rebuild =
+            s->spatial_structure_outdated
+            or max_displacement > 0.5f * s->parameters.verlet_skin_distance;
+    }
+
+    s->spatial_structure_rebuilt_last_step = rebuild;
+    if (rebuild) s->spatial_structure_outdated = false;
+
+    // The particle update's timeline value is the last one of this step, so there is nothing else to submit.
+    if (!rebuild) return;
+
+    result = vk_ctx->procs_dev.ResetCommandBuffer(s->gpu_resources.morton_code_command_buffer, 0);
+    assertVk(result);
+
+    begin_info = VkCommandBufferBeginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(s->gpu_resources.morton_code_command_buffer, &begin_info);
+    assertVk(result);
+    {
+        TracyVkZone(vk_ctx->compute_tracy_vk_ctx, s->gpu_resources.morton_code_command_buffer, "sim::DomainMinAndSpatialStructure");
+
+        recordSpatialStructureCommands(
+            s, vk_ctx, s->gpu_resources.morton_code_command_buffer, 0,
+            s->parameters.fuse_morton_codes_into_update, 0
+        );
+        s->gpu_resources.spatial_structure_bounds_slot = 0;
+
+        TracyVkCollect(vk_ctx->compute_tracy_vk_ctx, s->gpu_resources.morton_code_command_buffer);
+    }
+    result = vk_ctx->procs_dev.EndCommandBuffer(s->gpu_resources.morton_code_command_buffer);
+    assertVk(result);
+
+    {
+        ZoneScopedN("SubmitMortonCodeCommandBuffer");
+
+        // The hash table is cleared by the transfer stage, so that must also wait for the particle update.
+        const VkPipelineStageFlags p_wait_dst_stage_mask {
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT
+        };
+        const u64 signal_value = ++res->timeline_value;
+        const VkTimelineSemaphoreSubmitInfo timeline_info {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &particle_update_finished_value,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &signal_value,
+        };
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &res->timeline_semaphore,
+            .pWaitDstStageMask = &p_wait_dst_stage_mask,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &res->morton_code_command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &res->timeline_semaphore,
+        };
+        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+        assertVk(result);
+    }
+}
+
+
+/// Advances the sim by `substep_count` steps of `delta_t` each. `optional_wait_semaphore` is waited on before
+/// the first substep writes the positions, and `optional_signal_semaphore` is signalled once, when the last
+/// substep's positions are written.
+/// In GPU-resident mode, all the substeps are recorded into one command buffer, so the whole call is a single
+/// submission. In the synchronous mode, the host still checks each substep's displacement (to decide whether
+/// to rebuild the spatial structure), so each substep is a separate step. With the CPU backend, the substeps
+/// run on the thread pool, and only the last substep's positions are copied to the GPU.
+/// If `SimParameters::adaptive_time_step`, the sim advances by `substep_count * delta_t` all the same, but picks
+/// the substeps itself.
+/// Wakes every particle of the sleeping mode, by zeroing the calm steps; see `SimData::calm_steps_outdated`. Waits
+/// for the sim's submissions to finish, so only for after the particles or the parameters changed.
+static void resetCalmSteps(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+    vk_ctx->procs_dev.CmdFillBuffer(command_buffer, res->buffer_calm_steps_sorted.buffer, 0, VK_WHOLE_SIZE, 0);
+    vk_ctx->procs_dev.CmdFillBuffer(command_buffer, res->buffer_calm_steps_unsorted.buffer, 0, VK_WHOLE_SIZE, 0);
+    recordTransferToComputeBarrier(vk_ctx, command_buffer);
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+
+    s->calm_steps_outdated = false;
+}
+
+
+extern "C" void advanceSubsteps(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    f32 delta_t,
+    u32 substep_count,
+    VkSemaphore optional_wait_semaphore,
+    VkSemaphore optional_signal_semaphore
+) {
+
+    ZoneScoped;
+
+    assert(delta_t > 1e-5); // assert nonzero
+    alwaysAssert(substep_count > 0);
+
+    if (s->parameters.adaptive_time_step)
+    {
+        const f32 total_delta_t = (f32)substep_count * delta_t;
+        substep_count = getAdaptiveSubstepCount(s, total_delta_t);
+        delta_t = total_delta_t / (f32)substep_count;
+    }
+    s->time_step.substep_delta_t = delta_t;
+    s->time_step.substep_count = substep_count;
+
+    s->uploaded_byte_count = 0;
+
+    if (s->cpu_backend)
+    {
+        for (u32 substep = 0; substep < substep_count; substep++)
+        {
+            advanceCpuStep(s, vk_ctx, thread_pool, delta_t);
+        }
+        submitCpuPositionsCopy(s, vk_ctx, optional_wait_semaphore, optional_signal_semaphore);
+        return;
+    }
+
+    // The spatial structure is built entirely on the GPU, so the thread pool is only used to build pipelines.
+    updateBakedUpdatePipeline(s, vk_ctx, thread_pool);
+
+    if (s->parameters.sleeping and s->calm_steps_outdated) resetCalmSteps(s, vk_ctx);
+
+    // In both modes, the Morton codes were sorted, and the cell list and hash table were built, on the GPU at
+    // the end of the previous step (or in `create()`).
+
+    if (s->parameters.gpu_resident)
+    {
+        advanceGpuResident(
+            s, vk_ctx, delta_t, substep_count, optional_wait_semaphore, optional_signal_semaphore
+        );
+        return;
+    }
+
+    for (u32 substep = 0; substep < substep_count; substep++)
+    {
+        advanceSynchronous(
+            s, vk_ctx, delta_t,
+            (substep == 0) ? optional_wait_semaphore : VK_NULL_HANDLE,
+            (substep == substep_count - 1) ? optional_signal_semaphore : VK_NULL_HANDLE
+        );
+    }
+}
+
+
+extern "C" void advance(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    f32 delta_t,
+    VkSemaphore optional_wait_semaphore,
+    VkSemaphore particle_update_finished_signal_semaphore_optional
+) {
+    advanceSubsteps(
+        s, vk_ctx, thread_pool, delta_t, 1,
+        optional_wait_semaphore, particle_update_finished_signal_semaphore_optional
+    );
+}
+
+
+/// One vec4 per particle: xyz is the position, and w is the attribute that the particle was given in `create()` or
+/// `emitParticles()`. Only the first `SimData::particle_count` are alive. Despite its name, the buffer is in the
+/// order of the last sort by cell, as the particle update writes each particle where the sort put it; so a draw
+/// reads it with the spatial coherence of the sorted buffers, at no extra cost. The order changes with each sort;
+/// `getParticleIdsBuffer()` names the particles across sorts.
+extern "C" void getPositionsVertexBuffer(
+    const SimData* s,
+    VkBuffer* buffer_out,
+    VkDeviceSize* buffer_size_out
+) {
+    *buffer_out = s->gpu_resources.buffer_positions_unsorted.buffer;
+    // the whole capacity, so that the buffer can be bound once and still cover the particles emitted later
+    *buffer_size_out = s->particle_capacity * sizeof(vec4);
+}
+
+
+/// The velocities of the particles of `getPositionsVertexBuffer()`, in the same order, as of the last step
+/// submitted, which writes them with the positions: an array per component, `*component_stride_out` words apart, of
+/// floats; or, if `*half_out`, two arrays of packed halves. See "Particle layout" in fluidSim_util.comp.h. Returns
+/// false, and writes nothing, with the CPU backend.
+extern "C" bool getVelocitiesBuffer(
+    const SimData* s,
+    VkBuffer* buffer_out,
+    u32* component_stride_out,
+    bool* half_out
+) {
+    if (s->cpu_backend) return false;
+
+    const GpuResources* res = &s->gpu_resources;
+    // the particle update's output; see `GpuResources::particle_buffers_swapped`
+    *buffer_out = getParticleBuffers(res, false).velocities;
+    *component_stride_out = (u32)s->particle_capacity;
+    *half_out = res->half_velocities;
+    return true;
+}
+
+
+/// The spatial structure as of the last step submitted, for the renderer to look particles up by cell (e.g. to
+/// ray march through the cells). Returns false, and writes nothing, with the CPU backend, whose structure is on
+/// the host.
+extern "C" bool getSpatialStructureBuffers(const SimData* s, SpatialStructureBuffers* p_buffers_out) {
+
+    if (s->cpu_backend) return false;
+
+    const GpuResources* res = &s->gpu_resources;
+
+    // Like in `getSpatialStructureStats()`: the structure was built at the end of the last step from the
+    // unsorted positions, unless it hasn't been rebuilt since, and then the positions are in sorted order.
+    const bool permuted = s->spatial_structure_rebuilt_last_step;
+
+    *p_buffers_out = SpatialStructureBuffers {
+        .cells = res->buffer_cells.buffer,
+        .hash_buckets = res->buffer_hash_buckets.buffer,
+        .cell_slots = res->buffer_cell_slots.buffer,
+        .hash_table_size = s->hash_table_size,
+        .cell_slot_count = res->cell_slot_count,
+        .permuted = permuted,
+        .permutation = res->buffer_permutation.buffer,
+        .reference_positions = res->buffer_positions_reference.buffer,
+        // otherwise the structure would have been rebuilt; see `advanceSynchronous()`
+        .max_displacement = permuted ? 0.0f : 0.5f * s->parameters.verlet_skin_distance,
+        .domain_bounds = res->buffer_domain_bounds.buffer,
+        .domain_bounds_slot = res->spatial_structure_bounds_slot,
+        .cell_size_reciprocal = s->parameters.cell_size_reciprocal,
+        .timeline_semaphore = res->timeline_semaphore,
+        .timeline_value = res->timeline_value,
     };
-    const u32fast buffer_info_count = ARRAY_SIZE(buffer_infos);
+    return true;
+}
 
-    for (u32fast i = 0; i < buffer_info_count; i++)
-    {
-        VkBufferCreateInfo buffer_info {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = buffer_infos[i].size,
-            .usage = buffer_infos[i].buffer_usage,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount = 1,
-            .pQueueFamilyIndices = &vk_ctx->queue_family_index,
-        };
-        VmaAllocationCreateInfo alloc_info {
-            .flags = buffer_infos[i].alloc_flags,
-            .usage = buffer_infos[i].mem_usage,
-            .requiredFlags = buffer_infos[i].required_mem_flags,
-        };
-        result = vmaCreateBuffer(
-            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
-            &buffer_infos[i].p_buffer_out->buffer,
-            &buffer_infos[i].p_buffer_out->allocation,
-            &buffer_infos[i].p_buffer_out->allocation_info
-        );
-        assertVk(result);
-    }
+
+/// A timeline semaphore that reaches `getTimelineValue()` once every step submitted so far is done. Wait on it
+/// (on the host or in a submission) before reading the sim's buffers back, instead of waiting on every step.
+extern "C" VkSemaphore getTimelineSemaphore(const SimData* s) {
+    return s->gpu_resources.timeline_semaphore;
 }
 
+extern "C" u64 getTimelineValue(const SimData* s) {
+    return s->gpu_resources.timeline_value;
+}
 
-static void createDescriptorStuff(
-    GpuResources* res,
-    const VulkanContext* vk_ctx
+
+/// Writes the GPU time (ns) that each `SimStage` took in the last step submitted to
+/// `p_stage_times_ns_out[SIM_STAGE_COUNT]`: 0 for the stages that the step skipped, e.g. the spatial structure
+/// build if the Verlet skin was still valid. In GPU-resident mode, this is the last substep.
+/// Returns false, and writes nothing, if `SimParameters::stage_timestamps` is off or unsupported, or if no step
+/// has been submitted yet. If `wait`, waits for the sim's submissions to finish; otherwise also returns false
+/// if the last step hasn't finished, e.g. to poll it once per frame without stalling.
+extern "C" bool getStageGpuTimes(
+    const SimData* s,
+    const VulkanContext* vk_ctx,
+    bool wait,
+    f64* p_stage_times_ns_out
 ) {
-    using descriptor_management::DescriptorSetLayout;
 
-    VkDescriptorSetLayoutBinding layout_bindings_general[LAYOUT_BINDING_COUNT__GENERAL] {};
-    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__GENERAL; i++)
+    ZoneScoped;
+
+    const GpuResources* res = &s->gpu_resources;
+    if (res->stage_query_pool == VK_NULL_HANDLE or res->stage_query_last_slot == STAGE_TIMESTAMP_SLOT_NONE)
     {
-        layout_bindings_general[i] = VkDescriptorSetLayoutBinding {
-            .binding = i,
-            .descriptorType = DESCRIPTOR_SET_LAYOUT__GENERAL[i],
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        };
+        return false;
     }
 
-    VkDescriptorSetLayoutBinding layout_bindings_reduction[LAYOUT_BINDING_COUNT__REDUCTION] {};
-    for (u32 i = 0; i < LAYOUT_BINDING_COUNT__REDUCTION; i++)
+    if (wait) waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    // (timestamp, availability) per query; the skipped stages' queries are unavailable, hence no WAIT_BIT
+    u64 results[STAGE_TIMESTAMP_QUERIES_PER_SLOT][2] {};
+    const VkResult result = vk_ctx->procs_dev.GetQueryPoolResults(
+        vk_ctx->device, res->stage_query_pool,
+        res->stage_query_last_slot * STAGE_TIMESTAMP_QUERIES_PER_SLOT, STAGE_TIMESTAMP_QUERIES_PER_SLOT,
+        sizeof(results), results, sizeof(results[0]),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+    );
+    if (result != VK_NOT_READY) assertVk(result);
+
+    // every step updates the particles, so this is only unavailable if the step is still running
+    const u64* update_end = results[2 * SIM_STAGE_PARTICLE_UPDATE + 1];
+    if (update_end[1] == 0) return false;
+
+    const f64 ns_per_tick = (f64)vk_ctx->physical_device_properties.limits.timestampPeriod;
+    for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++)
     {
-        layout_bindings_reduction[i] = VkDescriptorSetLayoutBinding {
-            .binding = i,
-            .descriptorType = DESCRIPTOR_SET_LAYOUT__REDUCTION[i],
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        };
+        const u64* begin = results[2 * stage];
+        const u64* end = results[2 * stage + 1];
+        const bool available = begin[1] != 0 and end[1] != 0;
+        p_stage_times_ns_out[stage] = available ? (f64)(end[0] - begin[0]) * ns_per_tick : 0.0;
     }
 
-    constexpr u32fast layout_count = 2;
-    const DescriptorSetLayout layout_infos[layout_count] {
-        DescriptorSetLayout {
-            .binding_count = LAYOUT_BINDING_COUNT__GENERAL,
-            .p_bindings = layout_bindings_general,
-        },
-        DescriptorSetLayout {
-            .binding_count = LAYOUT_BINDING_COUNT__REDUCTION,
-            .p_bindings = layout_bindings_reduction,
-        },
+    return true;
+}
+
+
+/// Adds a query to the next batch; see `queryRadius()`.
+static u32 addSpatialQuery(
+    SimData* s,
+    const SpatialQueryType type,
+    const vec3 center,
+    const f32 radius,
+    const vec3 box_max,
+    const u32 max_hit_count
+) {
+
+    if (s->cpu_backend) return SPATIAL_QUERY_NONE;
+
+    GpuResources* res = &s->gpu_resources;
+    if (res->spatial_query_count == res->spatial_query_capacity) return SPATIAL_QUERY_NONE;
+
+    const u32 hit_count = glm::min(max_hit_count, res->spatial_query_hit_capacity - res->spatial_query_hit_count);
+
+    const u32 query_idx = res->spatial_query_count++;
+    res->spatial_queries[query_idx] = SpatialQuery {
+        .center = center,
+        .radius = radius,
+        .box_max = box_max,
+        .type = type,
+        .first_hit = res->spatial_query_hit_count,
+        .max_hit_count = hit_count,
     };
+    res->spatial_query_hit_count += hit_count;
 
-    const u32 descriptor_set_counts[layout_count] { 1, 3 };
-    constexpr u32 total_descriptor_set_count = 4;
+    return query_idx;
+}
 
-    VkDescriptorSetLayout descriptor_set_layouts[layout_count] {};
-    VkDescriptorSet descriptor_sets[total_descriptor_set_count] {};
+
+/// Adds a query for the particles within `radius` of `center` to the batch that the next `submitSpatialQueries()`
+/// runs on the GPU, and returns its index in the batch's results (see `SpatialQueryResults`); or
+/// SPATIAL_QUERY_NONE if the batch already has `SimParameters::spatial_query_capacity` queries, or with the CPU
+/// backend. At most `max_result_count` of the particles are returned, in no particular order, fewer if the batch's
+/// `spatial_query_hit_capacity` runs out; 0 only counts them.
+extern "C" u32 queryRadius(SimData* s, vec3 center, f32 radius, u32 max_result_count) {
+
+    alwaysAssert(radius >= 0.0f);
+    return addSpatialQuery(s, SPATIAL_QUERY_RADIUS, center, radius, vec3(0.0f), max_result_count);
+}
+
+
+/// Like `queryRadius()`, for the particles in the box with corners `box_min` and `box_max`, bounds included.
+extern "C" u32 queryBox(SimData* s, vec3 box_min, vec3 box_max, u32 max_result_count) {
+
+    alwaysAssert(glm::all(glm::lessThanEqual(box_min, box_max)));
+    return addSpatialQuery(s, SPATIAL_QUERY_BOX, box_min, 0.0f, box_max, max_result_count);
+}
+
+
+/// Like `queryRadius()`, for the `k` particles nearest to `center` (at most MAX_SPATIAL_QUERY_K), nearest first.
+/// Only the particles within `max_distance` are considered, which bounds the cells that the query looks up.
+extern "C" u32 queryKNearest(SimData* s, vec3 center, u32 k, f32 max_distance) {
+
+    alwaysAssert(k >= 1 and k <= MAX_SPATIAL_QUERY_K);
+    alwaysAssert(max_distance >= 0.0f);
+    return addSpatialQuery(s, SPATIAL_QUERY_K_NEAREST, center, max_distance, vec3(0.0f), k);
+}
+
+
+/// Submits the queries added since the last submission, which run after the steps submitted so far, against
+/// their particles and spatial structure; the next step waits for them. Waits for the previous batch to finish,
+/// if it hasn't, since this one reuses its buffers. Returns false if there were no queries.
+extern "C" bool submitSpatialQueries(SimData* s, const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    if (s->cpu_backend) return false;
+
+    GpuResources* res = &s->gpu_resources;
+    if (res->spatial_query_count == 0) return false;
+
+    if (res->spatial_query_timeline_value != 0) waitForTimelineValue(vk_ctx, res, res->spatial_query_timeline_value);
+
+    uploadBufferToHostVisibleGpuMemory(
+        vk_ctx, res->spatial_query_count * sizeof(SpatialQuery), res->spatial_queries, &res->buffer_spatial_queries, 0,
+        &s->transfers, TRANSFER_QUERIES
+    );
+
+    const VkCommandBuffer command_buffer = res->spatial_query_command_buffer;
     {
-        descriptor_management::createDescriptorPoolAndSets(
-            vk_ctx,
-            layout_count,
-            layout_infos,
-            descriptor_set_counts,
-            &res->descriptor_pool,
-            descriptor_set_layouts,
-            descriptor_sets
-        );
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        VkResult result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+        assertVk(result);
     }
 
-    res->descriptor_set_layout_main = descriptor_set_layouts[0];
-    res->descriptor_set_layout_reduction = descriptor_set_layouts[1];
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
 
-    res->descriptor_set_main = descriptor_sets[0];
-    res->descriptor_set_reduction__positions_to_reduction1 = descriptor_sets[1];
-    res->descriptor_set_reduction__reduction1_to_reduction2 = descriptor_sets[2];
-    res->descriptor_set_reduction__reduction2_to_reduction1 = descriptor_sets[3];
+    // Like in `getSpatialStructureBuffers()`. The unswapped set has the last step's positions and ids in the
+    // unsorted buffers either way; see `unswapParticleBuffers()`.
+    const bool permuted = s->spatial_structure_rebuilt_last_step;
+    const SpatialQueryPushConstants push_constants {
+        .query_count = res->spatial_query_count,
+        .permuted = permuted,
+        .max_displacement = permuted ? 0.0f : 0.5f * s->parameters.verlet_skin_distance,
+        .cell_slot_count = res->cell_slot_count,
+    };
+    recordComputeDispatch(
+        vk_ctx, command_buffer,
+        res->pipeline_spatialQuery, res->pipeline_layout_spatialQuery,
+        res->descriptor_set_main,
+        sizeof(push_constants), &push_constants,
+        divCeil(res->spatial_query_count, res->workgroup_size)
+    );
 
-    // initialize descriptors --------------------------------------------------------------------------------
+    const VkMemoryBarrier host_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &host_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
 
-    {
-        ZoneScopedN("WriteDescriptorSets");
+    submitOneOffCommands(s, vk_ctx, command_buffer);
 
-        const VkDescriptorBufferInfo buffer_infos[LAYOUT_BINDING_COUNT__GENERAL] {
-            [LAYOUT_BINDING_GENERAL__UNIFORMS] = { .buffer = res->buffer_uniforms.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__POSITIONS_SORTED] = { .buffer = res->buffer_positions_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__VELOCITIES_SORTED] = { .buffer = res->buffer_velocities_sorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__POSITIONS_UNSORTED] = { .buffer = res->buffer_positions_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__VELOCITIES_UNSORTED] = { .buffer = res->buffer_velocities_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__C_BEGIN] = { .buffer = res->buffer_C_begin.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__C_LENGTH] = { .buffer = res->buffer_C_length.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__H_BEGIN] = { .buffer = res->buffer_H_begin.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__H_LENGTH] = { .buffer = res->buffer_H_length.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-            [LAYOUT_BINDING_GENERAL__MORTON_CODES_OR_PERMUTATION] = { .buffer = res->buffer_morton_codes_or_permutation.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
-        };
+    res->spatial_query_timeline_value = res->timeline_value;
+    res->submitted_spatial_query_count = res->spatial_query_count;
+    res->spatial_query_count = 0;
+    res->spatial_query_hit_count = 0;
 
-        VkWriteDescriptorSet writes[LAYOUT_BINDING_COUNT__GENERAL] {};
-        {
-            for (u32 binding_idx = 0; binding_idx < LAYOUT_BINDING_COUNT__GENERAL; binding_idx++)
-            {
-                writes[binding_idx] = VkWriteDescriptorSet {
-                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                    .dstSet = res->descriptor_set_main,
-                    .dstBinding = binding_idx,
-                    .dstArrayElement = 0,
-                    .descriptorCount = 1,
-                    .descriptorType = DESCRIPTOR_SET_LAYOUT__GENERAL[binding_idx],
-                    .pBufferInfo = &buffer_infos[binding_idx],
-                };
-            }
-        }
+    return true;
+}
 
-        vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, LAYOUT_BINDING_COUNT__GENERAL, writes, 0, NULL);
-    }
 
-    {
-        VkDescriptorBufferInfo buffer_info_positions
-            { .buffer = res->buffer_positions_unsorted.buffer, .offset = 0, .range = VK_WHOLE_SIZE };
-        VkDescriptorBufferInfo buffer_info_reduction1
-            { .buffer = res->buffer_reduction_1.buffer, .offset = 0, .range = VK_WHOLE_SIZE };
-        VkDescriptorBufferInfo buffer_info_reduction2
-            { .buffer = res->buffer_reduction_2.buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+/// Writes the results of the batch that `submitSpatialQueries()` submitted last to `p_results_out`. Returns false,
+/// and writes nothing, if no batch has been submitted. If `wait`, waits for the batch to finish; otherwise also
+/// returns false if it hasn't, e.g. to poll it once per frame without stalling.
+extern "C" bool getSpatialQueryResults(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    bool wait,
+    SpatialQueryResults* p_results_out
+) {
 
-        {
-            const VkWriteDescriptorSet write_template = {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = VK_NULL_HANDLE, // to be filled
-                .dstBinding = UINT32_MAX, // to be filled
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                .pBufferInfo = NULL, // to be filled
-            };
+    ZoneScoped;
 
-            constexpr u32 write_count = 6;
-            VkWriteDescriptorSet writes[write_count] {};
-
-            writes[0] = write_template;
-            writes[0].dstSet = res->descriptor_set_reduction__positions_to_reduction1;
-            writes[0].dstBinding = 0;
-            writes[0].pBufferInfo = &buffer_info_positions;
-            writes[1] = write_template;
-            writes[1].dstSet = res->descriptor_set_reduction__positions_to_reduction1;
-            writes[1].dstBinding = 1;
-            writes[1].pBufferInfo = &buffer_info_reduction1;
-
-            writes[2] = write_template;
-            writes[2].dstSet = res->descriptor_set_reduction__reduction1_to_reduction2;
-            writes[2].dstBinding = 0;
-            writes[2].pBufferInfo = &buffer_info_reduction1;
-            writes[3] = write_template;
-            writes[3].dstSet = res->descriptor_set_reduction__reduction1_to_reduction2;
-            writes[3].dstBinding = 1;
-            writes[3].pBufferInfo = &buffer_info_reduction2;
-
-            writes[4] = write_template;
-            writes[4].dstSet = res->descriptor_set_reduction__reduction2_to_reduction1;
-            writes[4].dstBinding = 0;
-            writes[4].pBufferInfo = &buffer_info_reduction2;
-            writes[5] = write_template;
-            writes[5].dstSet = res->descriptor_set_reduction__reduction2_to_reduction1;
-            writes[5].dstBinding = 1;
-            writes[5].pBufferInfo = &buffer_info_reduction1;
-
-            vk_ctx->procs_dev.UpdateDescriptorSets(vk_ctx->device, write_count, writes, 0, NULL);
-        }
+    const GpuResources* res = &s->gpu_resources;
+    if (s->cpu_backend or res->spatial_query_timeline_value == 0) return false;
+
+    if (wait)
+    {
+        waitForTimelineValue(vk_ctx, res, res->spatial_query_timeline_value);
     }
-};
+    else
+    {
+        u64 value = 0;
+        const VkResult counter_result =
+            vk_ctx->procs_dev.GetSemaphoreCounterValue(vk_ctx->device, res->timeline_semaphore, &value);
+        assertVk(counter_result);
+        if (value < res->spatial_query_timeline_value) return false;
+    }
+
+    VkResult result = vmaInvalidateAllocation(
+        vk_ctx->vma_allocator, res->buffer_spatial_query_results.allocation, 0, VK_WHOLE_SIZE
+    );
+    assertVk(result);
+    result = vmaInvalidateAllocation(
+        vk_ctx->vma_allocator, res->buffer_spatial_query_hits.allocation, 0, VK_WHOLE_SIZE
+    );
+    assertVk(result);
+
+    *p_results_out = SpatialQueryResults {
+        .query_count = res->submitted_spatial_query_count,
+        .p_results = (const SpatialQueryResult*)getMappedPointer(&res->buffer_spatial_query_results),
+        .p_hits = (const SpatialQueryHit*)getMappedPointer(&res->buffer_spatial_query_hits),
+    };
+
+    // what the caller can read
+    u64 hit_count = 0;
+    for (u32 i = 0; i < p_results_out->query_count; i++) hit_count += p_results_out->p_results[i].hit_count;
+    countTransfer(
+        &s->transfers, TRANSFER_QUERIES, true,
+        p_results_out->query_count * sizeof(SpatialQueryResult) + hit_count * sizeof(SpatialQueryHit)
+    );
+    return true;
+}
 
 
-static void createComputePipeline_updateParticles(
+/// Copies the fields in `field_mask` (`ParticleField` bits) of the particles in a convex region to the sim's
+/// host-visible readback buffer, and writes where they are to `p_readback_out`: at most
+/// `SimParameters::region_readback_capacity` particles, in no particular order. The region is the points that
+/// are on the inner side of all of its `plane_count` planes (at most MAX_REGION_PLANE_COUNT), where
+/// `dot(vec3(plane), p) + plane.w >= 0`; e.g. the faces of a box (see `readBackParticlesInBox()`), or the frustum
+/// of a camera, like `getFrustumPlanes()` in graphics.cpp. The particles in the region are compacted on the GPU,
+/// by a prefix sum over which ones are inside, so only those are copied. Returns false, and writes nothing, if the
+/// readback is disabled, or with the CPU backend. Waits for the sim's submissions to finish.
+extern "C" bool readBackParticlesInRegion(
+    SimData* s,
     const VulkanContext* vk_ctx,
-    const u32 workgroup_size,
-    const VkDescriptorSetLayout descriptor_set_layout,
-    VkPipeline* pipeline_out,
-    VkPipelineLayout* pipeline_layout_out
+    u32 plane_count,
+    const vec4* p_planes,
+    u32 field_mask,
+    ParticleReadback* p_readback_out
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    GpuResources* res = &s->gpu_resources;
+    if (s->cpu_backend or res->region_readback_capacity == 0) return false;
 
+    alwaysAssert(plane_count <= MAX_REGION_PLANE_COUNT);
 
-    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    const u32 capacity = res->region_readback_capacity;
+    u32 match_count = 0;
+
+    if (s->particle_count > 0)
     {
-        VkPushConstantRange push_constant_range {
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-            .offset = 0,
-            .size = sizeof(ParticleUpdatePushConstants),
+        RegionReadbackPushConstants push_constants {
+            .plane_count = plane_count,
+            .field_mask = field_mask,
+            .capacity = capacity,
         };
+        for (u32 i = 0; i < plane_count; i++) push_constants.planes[i] = p_planes[i];
 
-        VkPipelineLayoutCreateInfo layout_info {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
-            .pSetLayouts = &descriptor_set_layout,
-            .pushConstantRangeCount = 1,
-            .pPushConstantRanges = &push_constant_range,
+        // the offsets are in the sort's scratch
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+        const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+        recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+        // Either set binds the last step's particles as the unsorted ones; see `getMainDescriptorSet()`.
+        const VkDescriptorSet descriptor_set = getMainDescriptorSet(res);
+
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_regionReadback_mark, res->pipeline_layout_regionReadback_mark,
+            descriptor_set,
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        // exclusive scan of which particles are inside, which gives each of them its index in the readback
+        gpu_primitives::recordScan(
+            res->gpu_primitives, vk_ctx, command_buffer, res->region_offsets_scan, (u32)s->particle_count
+        );
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
+
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_regionReadback_scatter, res->pipeline_layout_regionReadback_scatter,
+            descriptor_set,
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
+
+        const VkMemoryBarrier host_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
         };
-        result = vk_ctx->procs_dev.CreatePipelineLayout(vk_ctx->device, &layout_info, NULL, &pipeline_layout);
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &host_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+
+        submitOneOffCommands(s, vk_ctx, command_buffer);
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+        const VkResult result = vmaInvalidateAllocation(
+            vk_ctx->vma_allocator, res->buffer_region_readback.allocation, 0, VK_WHOLE_SIZE
+        );
         assertVk(result);
+
+        match_count = *(const u32*)getMappedPointer(&res->buffer_region_readback);
     }
-    *pipeline_layout_out = pipeline_layout;
 
-    const VkSpecializationMapEntry specialization_map_entry {
-        .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.local_size_x,
-        .offset = 0,
-        .size = sizeof(u32),
+    // see `getRegionReadbackSize()`
+    const uintptr_t positions = (uintptr_t)getMappedPointer(&res->buffer_region_readback) + sizeof(vec4);
+    const uintptr_t velocities = positions + capacity * sizeof(vec4);
+    const uintptr_t ids = velocities + capacity * sizeof(vec3);
+
+    // the match count, and what the caller can read
+    const u32 read_count = glm::min(match_count, capacity);
+    VkDeviceSize read_size_bytes = sizeof(vec4);
+    if (field_mask & PARTICLE_FIELD_POSITIONS) read_size_bytes += read_count * sizeof(vec4);
+    if (field_mask & PARTICLE_FIELD_VELOCITIES) read_size_bytes += read_count * sizeof(vec3);
+    if (field_mask & PARTICLE_FIELD_IDS) read_size_bytes += read_count * sizeof(u32);
+    countTransfer(&s->transfers, TRANSFER_PARTICLES, true, read_size_bytes);
+
+    *p_readback_out = ParticleReadback {
+        .particle_count = glm::min(match_count, capacity),
+        .match_count = match_count,
+        .p_positions = (field_mask & PARTICLE_FIELD_POSITIONS) ? (const vec4*)positions : NULL,
+        .p_velocities = (field_mask & PARTICLE_FIELD_VELOCITIES) ? (const vec3*)velocities : NULL,
+        .p_ids = (field_mask & PARTICLE_FIELD_IDS) ? (const u32*)ids : NULL,
     };
+    return true;
+}
 
-    const VkSpecializationInfo specialization_info {
-        .mapEntryCount = 1,
-        .pMapEntries = &specialization_map_entry,
-        .dataSize = sizeof(u32),
-        .pData = &workgroup_size,
+
+/// `readBackParticlesInRegion()` for the box with corners `box_min` and `box_max`, bounds included.
+extern "C" bool readBackParticlesInBox(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    vec3 box_min,
+    vec3 box_max,
+    u32 field_mask,
+    ParticleReadback* p_readback_out
+) {
+
+    alwaysAssert(glm::all(glm::lessThanEqual(box_min, box_max)));
+
+    const vec4 planes[6] {
+        vec4(1.0f, 0.0f, 0.0f, -box_min.x),
+        vec4(-1.0f, 0.0f, 0.0f, box_max.x),
+        vec4(0.0f, 1.0f, 0.0f, -box_min.y),
+        vec4(0.0f, -1.0f, 0.0f, box_max.y),
+        vec4(0.0f, 0.0f, 1.0f, -box_min.z),
+        vec4(0.0f, 0.0f, -1.0f, box_max.z),
     };
+    return readBackParticlesInRegion(s, vk_ctx, 6, planes, field_mask, p_readback_out);
+}
 
-    VkShaderModule shader_module = VK_NULL_HANDLE;
+
+/// Starts publishing the particles to the POSIX shared memory object `name` (e.g. "/fluid_sim"), which other
+/// processes can map to read them without copies or files; see `StateExportHeader` for the layout, and for how to
+/// read it. Each `exportState()` publishes a state to the next of its `slot_count` slots. Replaces the previous
+/// export, if any. Returns false if the shared memory couldn't be created, and with the CPU backend.
+/// Waits for the sim's submissions to finish.
+extern "C" bool startStateExport(SimData* s, const VulkanContext* vk_ctx, const char* name, u32 slot_count) {
+
+    ZoneScoped;
+
+    alwaysAssert(slot_count >= 2);
+
+    if (s->cpu_backend) return false;
+
+    GpuResources* res = &s->gpu_resources;
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    destroyStateExport(res, vk_ctx);
+
+    // the arrays are sized for the capacity, so that emitting particles doesn't change the layout
+    const u64 capacity = s->particle_capacity;
+    const u64 positions_offset = sizeof(StateExportSlot);
+    const u64 velocities_offset = positions_offset + capacity * sizeof(vec4);
+    const u64 ids_offset = velocities_offset + getVelocityArrayCount(res) * capacity * sizeof(u32);
+    const u64 arrays_end = ids_offset + (res->particle_ids ? capacity * sizeof(u32) : 0);
+    const u64 slot_alignment = alignof(StateExportSlot);
+    const u64 slot_size = (arrays_end + slot_alignment - 1) / slot_alignment * slot_alignment;
+    const size_t size = sizeof(StateExportHeader) + slot_count * slot_size;
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
     {
-        size_t spirv_size = 0;
-        // TODO FIXME Create some central shader/pipeline manager so that we can hot-reload this without
-        // rewriting all the hot-reloading code that's currently in graphics.cpp.
-        void* p_spirv = file_util::readEntireFile("build/shaders/fluidSim_updateParticles.comp.spv", &spirv_size);
-        alwaysAssert(p_spirv != NULL);
-        alwaysAssert(spirv_size != 0);
-        defer(free(p_spirv));
+        LOG_F(
+            ERROR, "Failed to create shared memory `%s`; errno: `%i`, description: `%s`.", name, errno, strerror(errno)
+        );
+        return false;
+    }
+    defer(close(fd));
 
-        alwaysAssert((uintptr_t)p_spirv % alignof(u32) == 0);
-        alwaysAssert(spirv_size % sizeof(u32) == 0);
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        LOG_F(ERROR, "Failed to resize shared memory `%s` to %zu bytes; errno: `%i`.", name, size, errno);
+        shm_unlink(name);
+        return false;
+    }
 
-        const VkShaderModuleCreateInfo shader_module_info {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = spirv_size,
-            .pCode = (u32*)p_spirv,
-        };
-        result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &shader_module_info, NULL, &shader_module);
-        assertVk(result);
+    void* p_shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p_shared == MAP_FAILED)
+    {
+        LOG_F(ERROR, "Failed to map shared memory `%s`; errno: `%i`.", name, errno);
+        shm_unlink(name);
+        return false;
     }
-    defer(vk_ctx->procs_dev.DestroyShaderModule(vk_ctx->device, shader_module, NULL));
 
-    const VkPipelineShaderStageCreateInfo shader_stage_info {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = shader_module,
-        .pName = "main",
-        .pSpecializationInfo = &specialization_info,
-    };
+    // the rest is zero, as the object was truncated
+    StateExportHeader* header = (StateExportHeader*)p_shared;
+    memcpy(header->magic, STATE_EXPORT_MAGIC, sizeof(STATE_EXPORT_MAGIC));
+    header->version = STATE_EXPORT_VERSION;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->particle_capacity = (u32)capacity;
+    header->half_velocities = res->half_velocities;
+    header->positions_offset = positions_offset;
+    header->velocities_offset = velocities_offset;
+    header->ids_offset = res->particle_ids ? ids_offset : 0;
+
+    res->state_export = header;
+    res->state_export_size = size;
+    res->state_export_name = strdup(name);
+    // laid out like the arrays of a slot
+    res->buffer_state_export_staging = createParticleStagingBuffer(vk_ctx, arrays_end - positions_offset, true);
+
+    return true;
+}
+
+
+/// Stops the export of `startStateExport()`, and removes its shared memory; the readers that have it mapped can
+/// still read the last states. Waits for the pending copy to finish, if any.
+extern "C" void stopStateExport(SimData* s, const VulkanContext* vk_ctx) {
+
+    GpuResources* res = &s->gpu_resources;
+    if (res->state_export == NULL) return;
+
+    if (res->state_export_timeline_value != 0) {
+        waitForTimelineValue(vk_ctx, res, res->state_export_timeline_value);
+    }
+    destroyStateExport(res, vk_ctx);
+}
 
-    const VkComputePipelineCreateInfo pipeline_info {
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = shader_stage_info,
-        .layout = pipeline_layout,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
-    };
 
-    result = vk_ctx->procs_dev.CreateComputePipelines(
-        vk_ctx->device,
-        VK_NULL_HANDLE, // pipelineCache
-        1, // createInfoCount
-        &pipeline_info,
-        NULL, // pAllocator
-        pipeline_out
+/// Copies the pending state's particles from the staging buffer to the next slot of the shared memory, around
+/// the slot's seqlock; see `StateExportHeader`. The GPU's copy must have finished.
+static void publishExportedState(GpuResources* res, const VulkanContext* vk_ctx, TransferStats* transfers) {
+
+    ZoneScoped;
+
+    StateExportHeader* header = res->state_export;
+    const u64 state_number = header->published_count + 1;
+
+    const uintptr_t slot_address =
+        (uintptr_t)header + sizeof(StateExportHeader) + ((state_number - 1) % header->slot_count) * header->slot_size;
+    StateExportSlot* slot = (StateExportSlot*)slot_address;
+
+    const VkResult result = vmaInvalidateAllocation(
+        vk_ctx->vma_allocator, res->buffer_state_export_staging.allocation, 0, VK_WHOLE_SIZE
     );
     assertVk(result);
+
+    __atomic_store_n(&slot->sequence, 2 * state_number - 1, __ATOMIC_RELAXED);
+    // so that no reader sees the new arrays with the old sequence
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // Only the live particles of each array. The staging buffer is laid out like the slot, without its
+    // `StateExportSlot`.
+    const u64 count = res->state_export_particle_count;
+    const u64 capacity = header->particle_capacity;
+    const uintptr_t staging_address =
+        (uintptr_t)getMappedPointer(&res->buffer_state_export_staging) - sizeof(StateExportSlot);
+
+    memcpy(
+        (void*)(slot_address + header->positions_offset),
+        (const void*)(staging_address + header->positions_offset),
+        count * sizeof(vec4)
+    );
+    for (u64 d = 0; d < getVelocityArrayCount(res); d++)
+    {
+        const u64 offset = header->velocities_offset + d * capacity * sizeof(u32);
+        memcpy((void*)(slot_address + offset), (const void*)(staging_address + offset), count * sizeof(u32));
+    }
+    if (header->ids_offset != 0)
+    {
+        memcpy(
+            (void*)(slot_address + header->ids_offset),
+            (const void*)(staging_address + header->ids_offset),
+            count * sizeof(u32)
+        );
+    }
+    slot->particle_count = (u32)count;
+    countTransfer(
+        transfers, TRANSFER_PARTICLES, true,
+        count * (sizeof(vec4) + getVelocityArrayCount(res) * sizeof(u32) + (header->ids_offset != 0) * sizeof(u32))
+    );
+
+    __atomic_store_n(&slot->sequence, 2 * state_number, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->published_count, state_number, __ATOMIC_RELEASE);
 }
 
-static void createComputePipeline_sortParticles(
-    const VulkanContext* vk_ctx,
-    const u32 workgroup_size,
-    const VkDescriptorSetLayout descriptor_set_layout,
-    VkPipeline* pipeline_out,
-    VkPipelineLayout* pipeline_layout_out
-) {
+
+/// Publishes the state of the last `exportState()`, if its copy has finished, and submits a copy of the
+/// particles as of the steps submitted so far, to be published by the next call; so it never waits for the
+/// GPU, and doesn't delay the steps, which the copy runs between. If the previous copy hasn't finished, only
+/// returns false, skipping this state. Returns false too if the state isn't exported; see `startStateExport()`.
+extern "C" bool exportState(SimData* s, const VulkanContext* vk_ctx) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    GpuResources* res = &s->gpu_resources;
+    if (res->state_export == NULL) return false;
+
+    if (res->state_export_timeline_value != 0)
+    {
+        u64 value = 0;
+        const VkResult result =
+            vk_ctx->procs_dev.GetSemaphoreCounterValue(vk_ctx->device, res->timeline_semaphore, &value);
+        assertVk(result);
+        if (value < res->state_export_timeline_value) return false;
 
+        publishExportedState(res, vk_ctx, &s->transfers);
+        res->state_export_timeline_value = 0;
+    }
 
-    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    const VkCommandBuffer command_buffer = res->state_export_command_buffer;
     {
-        VkPipelineLayoutCreateInfo layout_info {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
-            .pSetLayouts = &descriptor_set_layout,
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = NULL,
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         };
-        result = vk_ctx->procs_dev.CreatePipelineLayout(vk_ctx->device, &layout_info, NULL, &pipeline_layout);
+        VkResult result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
         assertVk(result);
     }
-    *pipeline_layout_out = pipeline_layout;
 
-    const VkSpecializationMapEntry specialization_map_entry {
-        .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.local_size_x,
-        .offset = 0,
-        .size = sizeof(u32),
-    };
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
 
-    const VkSpecializationInfo specialization_info {
-        .mapEntryCount = 1,
-        .pMapEntries = &specialization_map_entry,
-        .dataSize = sizeof(u32),
-        .pData = &workgroup_size,
+    // The last step's particles, in the slot's layout; see `startStateExport()`.
+    const StateExportHeader* header = res->state_export;
+    const u64 capacity = header->particle_capacity;
+    const u64 count = s->particle_count;
+    const u64 staging_offset = sizeof(StateExportSlot);
+    const ParticleBufferSet particles = getParticleBuffers(res, false);
+
+    const VkBufferCopy positions_copy {
+        .srcOffset = 0,
+        .dstOffset = header->positions_offset - staging_offset,
+        .size = count * sizeof(vec4),
     };
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, particles.positions, res->buffer_state_export_staging.buffer, 1, &positions_copy
+    );
 
-    VkShaderModule shader_module = VK_NULL_HANDLE;
+    const u32 velocity_array_count = getVelocityArrayCount(res);
+    VkBufferCopy velocity_copies[VELOCITY_COMPONENT_COUNT] {};
+    for (u32 d = 0; d < velocity_array_count; d++)
     {
-        size_t spirv_size = 0;
-        // TODO FIXME Create some central shader/pipeline manager so that we can hot-reload this without
-        // rewriting all the hot-reloading code that's currently in graphics.cpp.
-        void* p_spirv = file_util::readEntireFile("build/shaders/fluidSim_sortParticles.comp.spv", &spirv_size);
-        alwaysAssert(p_spirv != NULL);
-        alwaysAssert(spirv_size != 0);
-        defer(free(p_spirv));
-
-        alwaysAssert((uintptr_t)p_spirv % alignof(u32) == 0);
-        alwaysAssert(spirv_size % sizeof(u32) == 0);
+        velocity_copies[d] = VkBufferCopy {
+            .srcOffset = d * s->particle_capacity * sizeof(u32),
+            .dstOffset = header->velocities_offset - staging_offset + d * capacity * sizeof(u32),
+            .size = count * sizeof(u32),
+        };
+    }
+    vk_ctx->procs_dev.CmdCopyBuffer(
+        command_buffer, particles.velocities, res->buffer_state_export_staging.buffer,
+        velocity_array_count, velocity_copies
+    );
 
-        const VkShaderModuleCreateInfo shader_module_info {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = spirv_size,
-            .pCode = (u32*)p_spirv,
+    if (header->ids_offset != 0)
+    {
+        const VkBufferCopy ids_copy {
+            .srcOffset = 0,
+            .dstOffset = header->ids_offset - staging_offset,
+            .size = count * sizeof(u32),
         };
-        result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &shader_module_info, NULL, &shader_module);
-        assertVk(result);
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, particles.particle_ids, res->buffer_state_export_staging.buffer, 1, &ids_copy
+        );
     }
-    defer(vk_ctx->procs_dev.DestroyShaderModule(vk_ctx->device, shader_module, NULL));
 
-    const VkPipelineShaderStageCreateInfo shader_stage_info {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = shader_module,
-        .pName = "main",
-        .pSpecializationInfo = &specialization_info,
+    const VkMemoryBarrier host_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
     };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &host_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
 
-    const VkComputePipelineCreateInfo pipeline_info {
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = shader_stage_info,
-        .layout = pipeline_layout,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
-    };
+    submitOneOffCommands(s, vk_ctx, command_buffer);
 
-    result = vk_ctx->procs_dev.CreateComputePipelines(
-        vk_ctx->device,
-        VK_NULL_HANDLE, // pipelineCache
-        1, // createInfoCount
-        &pipeline_info,
-        NULL, // pAllocator
-        pipeline_out
-    );
-    assertVk(result);
+    res->state_export_timeline_value = res->timeline_value;
+    res->state_export_particle_count = (u32)count;
+
+    return true;
 }
 
-static void createComputePipeline_computeMortonCodes(
+
+/// Starts writing the density field to the files `<path_prefix>_<state number>.vol`, one per `exportVolume()`, for
+/// tools and renderers that want a volume rather than points; see `VolumeFileHeader` for the format. The files are
+/// written on `thread_pool`'s workers. Replaces the previous export, if any. Returns false with the CPU backend,
+/// and if `SimParameters::volume_export_brick_capacity` is 0. Waits for the sim's submissions to finish.
+extern "C" bool startVolumeExport(
+    SimData* s,
     const VulkanContext* vk_ctx,
-    const u32 workgroup_size,
-    const VkDescriptorSetLayout descriptor_set_layout,
-    VkPipeline* pipeline_out,
-    VkPipelineLayout* pipeline_layout_out
+    thread_pool::ThreadPool* thread_pool,
+    const char* path_prefix
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    if (s->cpu_backend) return false;
 
+    GpuResources* res = &s->gpu_resources;
+    if (res->volume_export_brick_capacity == 0) return false;
+    // the shader addresses the slots in u32s
+    alwaysAssert(
+        VOLUME_EXPORT_SLOT_COUNT * getVolumeExportSlotSize(res->volume_export_brick_capacity) / sizeof(u32)
+            <= UINT32_MAX
+    );
 
-    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+    destroyVolumeExport(res, vk_ctx);
+
+    VkCommandBuffer command_buffers[VOLUME_EXPORT_SLOT_COUNT] {};
     {
-        VkPipelineLayoutCreateInfo layout_info {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
-            .pSetLayouts = &descriptor_set_layout,
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = NULL,
+        const VkCommandBufferAllocateInfo alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = res->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = VOLUME_EXPORT_SLOT_COUNT,
         };
-        result = vk_ctx->procs_dev.CreatePipelineLayout(vk_ctx->device, &layout_info, NULL, &pipeline_layout);
+        const VkResult result = vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &alloc_info, command_buffers);
         assertVk(result);
     }
-    *pipeline_layout_out = pipeline_layout;
-
-    const VkSpecializationMapEntry specialization_map_entry {
-        .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.local_size_x,
-        .offset = 0,
-        .size = sizeof(u32),
-    };
-
-    const VkSpecializationInfo specialization_info {
-        .mapEntryCount = 1,
-        .pMapEntries = &specialization_map_entry,
-        .dataSize = sizeof(u32),
-        .pData = &workgroup_size,
-    };
 
-    VkShaderModule shader_module = VK_NULL_HANDLE;
+    VolumeExport* volume_export = callocArray(1, VolumeExport);
+    volume_export->path_prefix = strdup(path_prefix);
+    volume_export->thread_pool = thread_pool;
+    for (u32 slot_idx = 0; slot_idx < VOLUME_EXPORT_SLOT_COUNT; slot_idx++)
     {
-        size_t spirv_size = 0;
-        // TODO FIXME Create some central shader/pipeline manager so that we can hot-reload this without
-        // rewriting all the hot-reloading code that's currently in graphics.cpp.
-        void* p_spirv = file_util::readEntireFile("build/shaders/fluidSim_computeMortonCodes.comp.spv", &spirv_size);
-        alwaysAssert(p_spirv != NULL);
-        alwaysAssert(spirv_size != 0);
-        defer(free(p_spirv));
+        volume_export->slots[slot_idx].command_buffer = command_buffers[slot_idx];
+        volume_export->slots[slot_idx].fd = -1;
+    }
+    res->volume_export = volume_export;
 
-        alwaysAssert((uintptr_t)p_spirv % alignof(u32) == 0);
-        alwaysAssert(spirv_size % sizeof(u32) == 0);
+    return true;
+}
 
-        const VkShaderModuleCreateInfo shader_module_info {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = spirv_size,
-            .pCode = (u32*)p_spirv,
-        };
-        result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &shader_module_info, NULL, &shader_module);
-        assertVk(result);
-    }
-    defer(vk_ctx->procs_dev.DestroyShaderModule(vk_ctx->device, shader_module, NULL));
 
-    const VkPipelineShaderStageCreateInfo shader_stage_info {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = shader_module,
-        .pName = "main",
-        .pSpecializationInfo = &specialization_info,
-    };
+/// Creates the file of a slot that the GPU has filled, writes its header, and starts writing its bricks on the
+/// thread pool, straight from the slot's mapped memory; `finishVolumeFile()` closes it once they're written.
+static void startVolumeFile(const SimData* s, GpuResources* res, const VulkanContext* vk_ctx, u32 slot_idx) {
 
-    const VkComputePipelineCreateInfo pipeline_info {
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = shader_stage_info,
-        .layout = pipeline_layout,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
-    };
+    ZoneScoped;
 
-    result = vk_ctx->procs_dev.CreateComputePipelines(
-        vk_ctx->device,
-        VK_NULL_HANDLE, // pipelineCache
-        1, // createInfoCount
-        &pipeline_info,
-        NULL, // pAllocator
-        pipeline_out
+    VolumeExport* volume_export = res->volume_export;
+    VolumeExportSlot* slot = &volume_export->slots[slot_idx];
+
+    const u32 capacity = res->volume_export_brick_capacity;
+    const VkDeviceSize slot_size = getVolumeExportSlotSize(capacity);
+    const VkResult result = vmaInvalidateAllocation(
+        vk_ctx->vma_allocator, res->buffer_volume_export.allocation, slot_idx * slot_size, slot_size
     );
     assertVk(result);
-}
 
-static void createComputePipeline_computeMin(
-    const VulkanContext* vk_ctx,
-    const u32 workgroup_size,
-    const VkDescriptorSetLayout descriptor_set_layout,
-    VkPipeline* pipeline_out,
-    VkPipelineLayout* pipeline_layout_out
-) {
+    const uintptr_t slot_address = (uintptr_t)getMappedPointer(&res->buffer_volume_export) + slot_idx * slot_size;
+    const u32 cell_count = *(const u32*)slot_address;
+    const u64 brick_count = glm::min(cell_count, capacity);
+    volume_export->stats.exported_count++;
 
-    ZoneScoped;
+    char path[512];
+    const int char_count = snprintf(
+        path, sizeof(path), "%s_%06" PRIu64 ".vol", volume_export->path_prefix, slot->state_number
+    );
+    alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(path));
 
-    VkResult result = VK_ERROR_UNKNOWN;
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        LOG_F(
+            ERROR, "Failed to create volume file `%s`; errno: `%i`, description: `%s`.", path, errno, strerror(errno)
+        );
+        return;
+    }
 
+    VolumeFileHeader header {
+        .version = VOLUME_FILE_VERSION,
+        .brick_resolution = VOLUME_BRICK_RESOLUTION,
+        .brick_count = brick_count,
+        .dropped_brick_count = cell_count - brick_count,
+        .brick_size = s->parameters.cell_size,
+        .padding = 0,
+    };
+    memcpy(header.magic, VOLUME_FILE_MAGIC, sizeof(VOLUME_FILE_MAGIC));
+    slot->file_size = sizeof(header) + brick_count * sizeof(VolumeBrick);
 
-    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    // sized up front, so that the tasks' writes don't each extend it
+    if (ftruncate(fd, (off_t)slot->file_size) != 0 or pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
     {
-        VkPushConstantRange push_constant_range {
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-            .offset = 0,
-            .size = sizeof(ReductionPushConstants),
-        };
+        LOG_F(ERROR, "Failed to write volume file `%s`; errno: `%i`.", path, errno);
+        close(fd);
+        return;
+    }
+    slot->fd = fd;
 
-        VkPipelineLayoutCreateInfo layout_info {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 1,
-            .pSetLayouts = &descriptor_set_layout,
-            .pushConstantRangeCount = 1,
-            .pPushConstantRanges = &push_constant_range,
+    const u64 bricks_per_task = (brick_count + VOLUME_EXPORT_WRITE_TASK_COUNT - 1) / VOLUME_EXPORT_WRITE_TASK_COUNT;
+    u32 task_count = 0;
+    memset(slot->write_tasks, 0, sizeof(slot->write_tasks));
+    for (u64 first_brick = 0; first_brick < brick_count; first_brick += bricks_per_task)
+    {
+        const u64 task_brick_count = glm::min(bricks_per_task, brick_count - first_brick);
+        slot->write_tasks[task_count++] = VolumeWriteTask {
+            .fd = fd,
+            .p_data = (const void*)(slot_address + sizeof(uvec4) + first_brick * sizeof(VolumeBrick)),
+            .size = task_brick_count * sizeof(VolumeBrick),
+            .file_offset = sizeof(header) + first_brick * sizeof(VolumeBrick),
+            .failed = false,
         };
-        result = vk_ctx->procs_dev.CreatePipelineLayout(vk_ctx->device, &layout_info, NULL, &pipeline_layout);
-        assertVk(result);
     }
-    *pipeline_layout_out = pipeline_layout;
+    if (task_count > 0)
+    {
+        thread_pool::enqueueTasks(
+            volume_export->thread_pool, &slot->write_group, task_count, writeVolumeBricksTask,
+            slot->write_tasks, sizeof(slot->write_tasks[0])
+        );
+    }
+}
 
-    const VkSpecializationMapEntry specialization_map_entry {
-        .constantID = COMPUTE_SHADER_SPECIALIZATION_CONSTANT_IDS.local_size_x,
-        .offset = 0,
-        .size = sizeof(u32),
-    };
 
-    const VkSpecializationInfo specialization_info {
-        .mapEntryCount = 1,
-        .pMapEntries = &specialization_map_entry,
-        .dataSize = sizeof(u32),
-        .pData = &workgroup_size,
-    };
+/// Starts writing the files of the states whose density the GPU has computed since the last call, closes those
+/// that have been written, and submits the computation of the density as of the steps submitted so far into a
+/// free slot, to be written by a later call; so it never waits for the GPU or for the disk, and doesn't delay the
+/// steps, which the computation runs between. One brick per occupied cell; see `fluidSim_exportVolume.comp`. If
+/// no slot is free, only returns false, skipping this state. Returns false too if the volume isn't exported; see
+/// `startVolumeExport()`.
+extern "C" bool exportVolume(SimData* s, const VulkanContext* vk_ctx) {
 
-    VkShaderModule shader_module = VK_NULL_HANDLE;
+    ZoneScoped;
+
+    GpuResources* res = &s->gpu_resources;
+    VolumeExport* volume_export = res->volume_export;
+    if (volume_export == NULL) return false;
+
+    u64 completed_value = 0;
     {
-        size_t spirv_size = 0;
-        // TODO FIXME Create some central shader/pipeline manager so that we can hot-reload this without
-        // rewriting all the hot-reloading code that's currently in graphics.cpp.
-        void* p_spirv = file_util::readEntireFile("build/shaders/fluidSim_computeMin.comp.spv", &spirv_size);
-        alwaysAssert(p_spirv != NULL);
-        alwaysAssert(spirv_size != 0);
-        defer(free(p_spirv));
+        const VkResult result =
+            vk_ctx->procs_dev.GetSemaphoreCounterValue(vk_ctx->device, res->timeline_semaphore, &completed_value);
+        assertVk(result);
+    }
 
-        alwaysAssert((uintptr_t)p_spirv % alignof(u32) == 0);
-        alwaysAssert(spirv_size % sizeof(u32) == 0);
+    u32 free_slot_idx = VOLUME_EXPORT_SLOT_COUNT;
+    for (u32 slot_idx = 0; slot_idx < VOLUME_EXPORT_SLOT_COUNT; slot_idx++)
+    {
+        VolumeExportSlot* slot = &volume_export->slots[slot_idx];
+        if (slot->timeline_value != 0 and completed_value >= slot->timeline_value)
+        {
+            slot->timeline_value = 0;
+            startVolumeFile(s, res, vk_ctx, slot_idx);
+        }
+        if (slot->fd != -1 and thread_pool::isGroupFinished(&slot->write_group)) finishVolumeFile(volume_export, slot);
+        if (slot->timeline_value == 0 and slot->fd == -1) free_slot_idx = slot_idx;
+    }
+    if (free_slot_idx == VOLUME_EXPORT_SLOT_COUNT)
+    {
+        volume_export->stats.skipped_count++;
+        return false;
+    }
 
-        const VkShaderModuleCreateInfo shader_module_info {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = spirv_size,
-            .pCode = (u32*)p_spirv,
+    VolumeExportSlot* slot = &volume_export->slots[free_slot_idx];
+    const VkCommandBuffer command_buffer = slot->command_buffer;
+    {
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         };
-        result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &shader_module_info, NULL, &shader_module);
+        VkResult result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
         assertVk(result);
     }
-    defer(vk_ctx->procs_dev.DestroyShaderModule(vk_ctx->device, shader_module, NULL));
 
-    const VkPipelineShaderStageCreateInfo shader_stage_info {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = shader_module,
-        .pName = "main",
-        .pSpecializationInfo = &specialization_info,
-    };
+    recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
 
-    const VkComputePipelineCreateInfo pipeline_info {
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = shader_stage_info,
-        .layout = pipeline_layout,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
+    // Like in `submitSpatialQueries()`; the levels are in the unsorted buffer either way too, like the ids.
+    const VolumeExportPushConstants push_constants {
+        .slot_offset = (u32)(free_slot_idx * getVolumeExportSlotSize(res->volume_export_brick_capacity) / sizeof(u32)),
+        .brick_capacity = res->volume_export_brick_capacity,
+        .permuted = s->spatial_structure_rebuilt_last_step,
+        .cell_slot_count = res->cell_slot_count,
     };
-
-    result = vk_ctx->procs_dev.CreateComputePipelines(
-        vk_ctx->device,
-        VK_NULL_HANDLE, // pipelineCache
-        1, // createInfoCount
-        &pipeline_info,
-        NULL, // pAllocator
-        pipeline_out
+    recordComputeDispatchIndirect(
+        vk_ctx, command_buffer,
+        res->pipeline_exportVolume, res->pipeline_layout_exportVolume,
+        res->descriptor_set_main,
+        sizeof(push_constants), &push_constants,
+        res->buffer_cell_count.buffer, offsetof(CellCountState, cells_dispatch)
     );
-    assertVk(result);
-}
-
-static void createComputePipelines(
-    GpuResources* res,
-    const VulkanContext* vk_ctx,
-    const u32 workgroup_size
-) {
 
-    ZoneScoped;
+    const VkMemoryBarrier host_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0, // dependencyFlags
+        1, // memoryBarrierCount
+        &host_barrier,
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        0, // imageMemoryBarrierCount
+        NULL // pImageMemoryBarriers
+    );
 
-    assert(res->descriptor_set_layout_main != VK_NULL_HANDLE);
-    assert(res->descriptor_set_layout_reduction != VK_NULL_HANDLE);
+    submitOneOffCommands(s, vk_ctx, command_buffer);
 
-    createComputePipeline_computeMin(
-        vk_ctx, workgroup_size, res->descriptor_set_layout_reduction,
-        &res->pipeline_computeMin, &res->pipeline_layout_computeMin
-    );
-    createComputePipeline_computeMortonCodes(
-        vk_ctx, workgroup_size, res->descriptor_set_layout_main,
-        &res->pipeline_computeMortonCodes, &res->pipeline_layout_computeMortonCodes
-    );
-    createComputePipeline_updateParticles(
-        vk_ctx, workgroup_size, res->descriptor_set_layout_main,
-        &res->pipeline_updateParticles, &res->pipeline_layout_updateParticles
-    );
-    createComputePipeline_sortParticles(
-        vk_ctx, workgroup_size, res->descriptor_set_layout_main,
-        &res->pipeline_sortParticles, &res->pipeline_layout_sortParticles
-    );
-};
+    slot->timeline_value = res->timeline_value;
+    slot->state_number = ++volume_export->state_count;
 
+    return true;
+}
 
-extern "C" void setParams(SimData* s, const SimParameters* params) {
-    s->parameters.rest_particle_density = params->rest_particle_density;
-    s->parameters.spring_stiffness = params->spring_stiffness;
 
-    // Number of particles contained in sphere at rest ~= sphere volume * rest particle density.
-    // :: N = (4/3 pi r^3) rho
-    // :: r = cuberoot(N * 3 / (4 pi rho)).
-    s->parameters.particle_interaction_radius = cbrtf(
-        (f32)params->rest_particle_interaction_count_approx * 3.f / (4.f * PI * params->rest_particle_density)
-    );
+/// Stops the export of `startVolumeExport()`, after writing the files of the states still pending, and logs its
+/// stats. Waits for the GPU and for the writes to finish.
+extern "C" void stopVolumeExport(SimData* s, const VulkanContext* vk_ctx) {
 
-    // TODO FIXME didn't really think about a good way to compute this
-    s->parameters.spring_rest_length = s->parameters.particle_interaction_radius * 0.5f;
+    ZoneScoped;
 
-    const f32 cell_size = s->parameters.particle_interaction_radius;
-    s->parameters.cell_size = cell_size;
-    s->parameters.cell_size_reciprocal = 1.0f / cell_size;
+    GpuResources* res = &s->gpu_resources;
+    VolumeExport* volume_export = res->volume_export;
+    if (volume_export == NULL) return;
 
-    LOG_F(INFO, "Set fluid sim parameters: "
-        "REST_PARTICLE_DENSITY = %f, "
-        "SPRING_STIFFNESS = %f, "
-        "SPRING_REST_LENGTH = %f, "
-        "PARTICLE_INTERACTION_RADIUS = %f, "
-        "CELL_SIZE = %f.",
-        s->parameters.rest_particle_density,
-        s->parameters.spring_stiffness,
-        s->parameters.spring_rest_length,
-        s->parameters.particle_interaction_radius,
-        s->parameters.cell_size
+    for (u32 slot_idx = 0; slot_idx < VOLUME_EXPORT_SLOT_COUNT; slot_idx++)
+    {
+        VolumeExportSlot* slot = &volume_export->slots[slot_idx];
+        if (slot->timeline_value != 0)
+        {
+            waitForTimelineValue(vk_ctx, res, slot->timeline_value);
+            slot->timeline_value = 0;
+            startVolumeFile(s, res, vk_ctx, slot_idx);
+        }
+        if (slot->fd != -1)
+        {
+            thread_pool::waitForGroup(volume_export->thread_pool, &slot->write_group);
+            finishVolumeFile(volume_export, slot);
+        }
+    }
+
+    const VolumeExportStats* stats = &volume_export->stats;
+    LOG_F(
+        INFO, "Exported %" PRIu64 " fluid sim volumes to `%s_*.vol`: %" PRIu64 " files, %" PRIu64 " bytes, %" PRIu64
+        " states skipped.", stats->exported_count, volume_export->path_prefix, stats->written_count,
+        stats->written_byte_count, stats->skipped_count
     );
+    destroyVolumeExport(res, vk_ctx);
 }
 
 
-static void sortCells(
-
-    thread_pool::ThreadPool* thread_pool,
-    u32 thread_count,
-
-    const u32fast cell_count,
+/// Writes the stats of the export of `startVolumeExport()` so far to `p_stats_out`. Returns false, and writes
+/// nothing, if the volume isn't exported.
+extern "C" bool getVolumeExportStats(const SimData* s, VolumeExportStats* p_stats_out) {
 
-    u32 **const pp_cells,
-    u32 **const pp_lengths,
-    u32 **const pp_cells_scratch,
-    u32 **const pp_lengths_scratch,
+    const VolumeExport* volume_export = s->gpu_resources.volume_export;
+    if (volume_export == NULL) return false;
 
-    KeyVal *const p_scratch1,
-    KeyVal *const p_scratch2,
+    *p_stats_out = volume_export->stats;
+    return true;
+}
 
-    const u32 *const p_morton_codes,
 
-    const u32 hash_modulus
+/// Adds `count` particles after the existing ones. `p_positions` is like `p_initial_positions` in `create()`;
+/// if `p_velocities_optional` is NULL, the new particles are at rest. Returns the number of particles added,
+/// which is less than `count` if `SimData::particle_capacity` runs out, and 0 for an ensemble.
+/// Waits for the sim's submissions to finish. Nothing else may be reading the positions at the same time.
+extern "C" u32fast emitParticles(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32fast count,
+    const vec4* p_positions,
+    const vec3* p_velocities_optional
 ) {
 
     ZoneScoped;
 
-    KeyVal* p_keyvals = p_scratch1;
-    KeyVal* p_scratch = p_scratch2;
-
-    u32* p_cells_in = *pp_cells;
-    u32* p_lengths_in = *pp_lengths;
-    u32* p_cells_out = *pp_cells_scratch;
-    u32* p_lengths_out = *pp_lengths_scratch;
+    GpuResources* res = &s->gpu_resources;
 
+    const u32fast free_count = s->particle_capacity - s->particle_count;
+    if (count > free_count)
     {
-        ZoneScopedN("init cell hashes");
-
-        for (u32 i = 0; i < cell_count; i++)
-        {
-            const u32 particle_idx = p_cells_in[i];
-            const u32 morton_code = p_morton_codes[particle_idx];
-            const u32 cell_hash = mortonCodeHash(morton_code, hash_modulus);
-
-            p_keyvals[i].key = cell_hash;
-            p_keyvals[i].val = i;
-        }
+        LOG_F(
+            WARNING, "Tried to emit %" PRIuFAST32 " particles, but there is only room for %" PRIuFAST32 ".",
+            count, free_count
+        );
+        count = free_count;
     }
+    if (count == 0) return 0;
 
-    alwaysAssert(thread_count > 0);
-    mergeSortMultiThreaded(
-        thread_pool,
-        thread_count,
-        cell_count,
-        p_keyvals,
-        p_scratch
-    );
+    if (res->ensemble_member_count > 0)
+    {
+        LOG_F(WARNING, "Tried to emit particles into an ensemble, which doesn't know which member they'd be in.");
+        return 0;
+    }
 
+    if (s->cpu_backend)
     {
-        ZoneScopedN("sort by permutation");
+        emitParticlesCpu(s, vk_ctx, count, p_positions, p_velocities_optional);
+        return count;
+    }
 
-        for (u32fast i = 0; i < cell_count; i++)
-        {
-            u32fast src_idx = p_keyvals[i].val;
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
 
-            p_cells_out[i] = p_cells_in[src_idx];
-            p_cells_out[i] = p_cells_in[src_idx];
+    const u32fast first_idx = s->particle_count;
+    uploadParticles(
+        res, vk_ctx, s->particle_capacity, first_idx, count, p_positions, p_velocities_optional, &s->transfers
+    );
+    uploadParticleIds(s, vk_ctx, first_idx, count);
+    uploadParticleLevels(s, vk_ctx, first_idx, count, NULL);
+    setParticleCount(s, first_idx + count);
+    uploadDataToGpu(s, vk_ctx);
 
-            p_lengths_out[i] = p_lengths_in[src_idx];
-            p_lengths_out[i] = p_lengths_in[src_idx];
-        }
-    }
+    // The new particles aren't in the spatial structure yet.
+    rebuildSpatialStructure(s, vk_ctx);
 
-    *pp_cells = p_cells_out;
-    *pp_lengths = p_lengths_out;
-    *pp_cells_scratch = p_cells_in;
-    *pp_lengths_scratch = p_lengths_in;
-};
+    return count;
+}
 
 
-static u32fast getNextPrimeNumberExclusive(u32fast n) {
+/// Replaces all the particles with `count` new ones, like `emitParticles()` into an empty sim; e.g. to step a
+/// different part of a larger set of particles than fits the sim, with the same sim. Returns false, and changes
+/// nothing, if `count` is 0 or more than `SimData::particle_capacity`, or for an ensemble.
+/// Waits for the sim's submissions to finish. Nothing else may be reading the positions at the same time.
+extern "C" bool replaceParticles(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32fast count,
+    const vec4* p_positions,
+    const vec3* p_velocities_optional
+) {
 
     ZoneScoped;
 
-    if (n == 0 || n == 1) return 2;
-
-    n++; // never return input
-    if (!(n & 1)) n++; // if even, make it odd
+    GpuResources* res = &s->gpu_resources;
 
-    // maybe this is 1 too large, that's fine
-    const u32fast max = (u32fast)(ceil(sqrt((f64)n)) + 0.5);
+    if (count == 0 or count > s->particle_capacity)
+    {
+        LOG_F(
+            WARNING, "Tried to replace the particles with %" PRIuFAST32 ", but the capacity is %" PRIuFAST32 ".",
+            count, s->particle_capacity
+        );
+        return false;
+    }
+    if (res->ensemble_member_count > 0)
+    {
+        LOG_F(WARNING, "Tried to replace the particles of an ensemble, which can't.");
+        return false;
+    }
 
-    while (true)
+    if (s->cpu_backend)
     {
-        bool prime = true;
-        for (u32fast i = 3; i <= max; i++)
-        {
-            if (n % i == 0)
-            {
-                prime = false;
-                break;
-            }
-        }
-        if (prime) return n;
-        n += 2;
+        s->particle_count = 0;
+        emitParticlesCpu(s, vk_ctx, count, p_positions, p_velocities_optional);
+        return true;
     }
+
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
+
+    uploadParticles(res, vk_ctx, s->particle_capacity, 0, count, p_positions, p_velocities_optional, &s->transfers);
+    uploadParticleIds(s, vk_ctx, 0, count);
+    uploadParticleLevels(s, vk_ctx, 0, count, NULL);
+    setParticleCount(s, count);
+    uploadDataToGpu(s, vk_ctx);
+
+    // The spatial structure is of the old particles.
+    rebuildSpatialStructure(s, vk_ctx);
+
+    return true;
 }
 
 
-static GpuResources createGpuResources(
+/// Removes the particles in the box with corners `box_min` and `box_max`, and returns how many there were.
+/// Removes none if that would remove every particle, or if the sim is an ensemble.
+/// The removed particles are sorted after the others, and the others are compacted by the same
+/// `sortParticles` pass that applies the sort in every step, so only the count is read back.
+/// Waits for the sim's submissions to finish. Nothing else may be reading the positions at the same time.
+extern "C" u32fast removeParticles(
+    SimData* s,
     const VulkanContext* vk_ctx,
-    u32fast particle_count,
-    u32fast hash_modulus
+    vec3 box_min,
+    vec3 box_max
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
-    GpuResources resources {};
+    if (s->cpu_backend) return removeParticlesCpu(s, vk_ctx, box_min, box_max);
 
+    GpuResources* res = &s->gpu_resources;
 
-    u32 workgroup_size = 0;
-    u32 workgroup_count = 0;
+    // The compaction below doesn't move the member ids.
+    if (res->ensemble_member_count > 0)
     {
-        const u32 max_workgroup_size = vk_ctx->physical_device_properties.limits.maxComputeWorkGroupSize[0];
-        const u32 max_workgroup_count = vk_ctx->physical_device_properties.limits.maxComputeWorkGroupCount[0];
-
-        workgroup_size = 128; // OPTIMIZE find a decent way to tune this number
-        workgroup_size = glm::min(workgroup_size, max_workgroup_size);
-
-        workgroup_count = divCeil((u32)particle_count, workgroup_size);
-        if (workgroup_count > max_workgroup_count)
-        {
-            workgroup_count = max_workgroup_count;
-            workgroup_size = divCeil((u32)particle_count, workgroup_count);
-        }
+        LOG_F(WARNING, "Tried to remove particles from an ensemble, which can't.");
+        return 0;
+    }
 
-        alwaysAssert(workgroup_size > 0);
-        alwaysAssert(workgroup_count > 0);
-        alwaysAssert(workgroup_size <= max_workgroup_size);
-        alwaysAssert(workgroup_count <= max_workgroup_count);
+    // the compaction gathers from the unsorted buffers, and copies back to them
+    unswapParticleBuffers(s, vk_ctx);
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
 
-        assert(workgroup_size * workgroup_count >= particle_count);
+    // Sort the particles in the box after the others, and count them.
+    {
+        const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+        recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
 
-        resources.workgroup_size = workgroup_size;
-        resources.workgroup_count = workgroup_count;
-    }
+        vk_ctx->procs_dev.CmdFillBuffer(
+            command_buffer, res->buffer_removed_particle_count.buffer, 0, sizeof(u32), 0
+        );
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
 
+        recordMortonCodeCommands(s, vk_ctx, command_buffer, 0, false);
+        recordComputeToComputeBarrier(vk_ctx, command_buffer);
 
-    {
-        VkCommandPoolCreateInfo pool_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-            .queueFamilyIndex = vk_ctx->queue_family_index
+        const RemoveParticlesPushConstants push_constants {
+            .box_min = box_min,
+            .box_max = box_max,
         };
-        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &pool_info, NULL, &resources.command_pool);
-        assertVk(result);
-    }
-    {
-        constexpr u32 command_buffer_count = 2;
-        VkCommandBuffer command_buffers[command_buffer_count] {};
+        recordComputeDispatch(
+            vk_ctx, command_buffer,
+            res->pipeline_removeParticles, res->pipeline_layout_removeParticles,
+            getMainDescriptorSet(res),
+            sizeof(push_constants), &push_constants,
+            res->workgroup_count
+        );
 
-        VkCommandBufferAllocateInfo alloc_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = resources.command_pool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = command_buffer_count,
+        // the Morton codes for the sort, and the count for the host
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT,
         };
-        result = vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &alloc_info, command_buffers);
-        assertVk(result);
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
+
+        recordRadixSortCommands(s, vk_ctx, command_buffer);
 
-        resources.general_purpose_command_buffer = command_buffers[0];
-        resources.morton_code_command_buffer = command_buffers[1];
+        submitOneOffCommands(s, vk_ctx, command_buffer);
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
     }
 
+    u32 removed_count = 0;
+    downloadFromHostVisibleGpuBuffer(
+        vk_ctx, sizeof(removed_count), &res->buffer_removed_particle_count, 0, &removed_count,
+        &s->transfers, TRANSFER_PARTICLES
+    );
+    if (removed_count >= s->particle_count)
     {
-        const VkSemaphoreCreateInfo semaphore_info = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
-        result = vk_ctx->procs_dev.CreateSemaphore(
-            vk_ctx->device, &semaphore_info, NULL, &resources.particle_update_finished_semaphore
+        LOG_F(
+            WARNING, "All %" PRIuFAST32 " particles are in the removal box, but the sim can't be empty; "
+            "removing none.",
+            s->particle_count
         );
+        removed_count = 0;
+    }
 
-        const VkFenceCreateInfo fence_info { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-        result = vk_ctx->procs_dev.CreateFence(vk_ctx->device, &fence_info, NULL, &resources.fence);
-        assertVk(result);
+    if (removed_count > 0)
+    {
+        setParticleCount(s, s->particle_count - removed_count);
+        uploadDataToGpu(s, vk_ctx);
+        // the compaction below doesn't move the calm steps
+        s->calm_steps_outdated = true;
     }
 
+    // Compact the particles that are left, and rebuild the spatial structure (which the Morton codes above
+    // have clobbered either way).
+    {
+        const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+        recordStepBarrier(vk_ctx, command_buffer); // after the sort
 
-    createBuffers(&resources, vk_ctx, particle_count, hash_modulus);
-    createDescriptorStuff(&resources, vk_ctx);
-    createComputePipelines(&resources, vk_ctx, workgroup_size);
+        if (removed_count > 0)
+        {
+            // Gathers the first `particle_count` particles in the sort order into the sorted buffers, which
+            // leaves out the removed ones.
+            const SortParticlesPushConstants sort_push_constants {
+                .gather = true,
+                .use_permutation = true,
+                .write_reference_positions = false,
+                .write_quantized_positions = false,
+                .sleep_step_count = 0,
+                .sort_member_ids = false, // ensembles can't remove particles
+            };
+            recordComputeDispatch(
+                vk_ctx, command_buffer,
+                res->pipeline_sortParticles, res->pipeline_layout_sortParticles,
+                getMainDescriptorSet(res),
+                sizeof(sort_push_constants), &sort_push_constants,
+                res->workgroup_count
+            );
+            recordStepBarrier(vk_ctx, command_buffer);
 
+            // The steps start from the unsorted buffers.
+            const VkBufferCopy positions_copy {
+                .srcOffset = 0,
+                .dstOffset = 0,
+                .size = s->particle_count * sizeof(vec4),
+            };
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, res->buffer_positions_sorted.buffer, res->buffer_positions_unsorted.buffer,
+                1, &positions_copy
+            );
 
-    return resources;
-}
+            const u32 velocity_array_count = getVelocityArrayCount(res);
+            VkBufferCopy velocity_copies[VELOCITY_COMPONENT_COUNT] {};
+            for (u32fast d = 0; d < velocity_array_count; d++)
+            {
+                velocity_copies[d] = VkBufferCopy {
+                    .srcOffset = d * s->particle_capacity * sizeof(f32),
+                    .dstOffset = d * s->particle_capacity * sizeof(f32),
+                    .size = s->particle_count * sizeof(f32),
+                };
+            }
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, res->buffer_velocities_sorted.buffer, res->buffer_velocities_unsorted.buffer,
+                velocity_array_count, velocity_copies
+            );
 
+            if (res->particle_ids)
+            {
+                const VkBufferCopy ids_copy {
+                    .srcOffset = 0,
+                    .dstOffset = 0,
+                    .size = s->particle_count * sizeof(u32),
+                };
+                vk_ctx->procs_dev.CmdCopyBuffer(
+                    command_buffer, res->buffer_particle_ids_sorted.buffer, res->buffer_particle_ids_unsorted.buffer,
+                    1, &ids_copy
+                );
+            }
+            if (res->particle_levels)
+            {
+                const VkBufferCopy levels_copy {
+                    .srcOffset = 0,
+                    .dstOffset = 0,
+                    .size = s->particle_count * sizeof(u32),
+                };
+                vk_ctx->procs_dev.CmdCopyBuffer(
+                    command_buffer,
+                    res->buffer_particle_levels_sorted.buffer, res->buffer_particle_levels_unsorted.buffer,
+                    1, &levels_copy
+                );
+            }
 
-static void destroyGpuResources(GpuResources* res, const VulkanContext* vk_ctx) {
+            recordTransferToComputeBarrier(vk_ctx, command_buffer);
+        }
 
-    ZoneScoped;
+        recordSpatialStructureCommands(s, vk_ctx, command_buffer, 0, false, STAGE_TIMESTAMP_SLOT_NONE);
+        res->spatial_structure_bounds_slot = 0;
 
-    VkResult result = vk_ctx->procs_dev.QueueWaitIdle(vk_ctx->queue);
-    assertVk(result);
+        submitOneOffCommands(s, vk_ctx, command_buffer);
 
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_uniforms.buffer, res->buffer_uniforms.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_sorted.buffer, res->buffer_positions_sorted.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_velocities_sorted.buffer, res->buffer_velocities_sorted.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_positions_unsorted.buffer, res->buffer_positions_unsorted.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_velocities_unsorted.buffer, res->buffer_velocities_unsorted.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_C_begin.buffer, res->buffer_C_begin.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_C_length.buffer, res->buffer_C_length.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_H_begin.buffer, res->buffer_H_begin.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_H_length.buffer, res->buffer_H_length.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_reduction_1.buffer, res->buffer_reduction_1.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_reduction_2.buffer, res->buffer_reduction_2.allocation);
-    vmaDestroyBuffer(vk_ctx->vma_allocator, res->buffer_morton_codes_or_permutation.buffer, res->buffer_morton_codes_or_permutation.allocation);
+        s->spatial_structure_rebuilt_last_step = true;
+        s->spatial_structure_outdated = false;
+    }
 
-    vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, res->command_pool, NULL);
+    if (removed_count > 0)
+    {
+        LOG_F(INFO, "Removed %u particles; %" PRIuFAST32 " are left.", removed_count, s->particle_count);
+    }
+    return removed_count;
+}
 
-    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_main, NULL);
-    vk_ctx->procs_dev.DestroyDescriptorSetLayout(vk_ctx->device, res->descriptor_set_layout_reduction, NULL);
-    vk_ctx->procs_dev.DestroyDescriptorPool(vk_ctx->device, res->descriptor_pool, NULL);
 
+/// Adds the `brick_count` bricks of the collider at `p_bricks`, replacing those already at their coordinates, and
+/// then removes those at `p_removed_coords`; so that the host can re-voxelize what changed and send only that. The
+/// new bricks' coordinates must be distinct; removing a brick that isn't there does nothing. Where there is no
+/// brick, the particles don't collide with anything. The particle update samples the field trilinearly, once per
+/// particle, and projects the particles that end up inside out along its gradient, dropping their velocity into
+/// the surface.
+/// Returns false, and changes nothing, if the bricks wouldn't fit in `SimParameters::collider_brick_capacity`.
+/// Does nothing with the CPU backend, which has no collider. Waits for the sim's submissions to finish.
+extern "C" bool updateColliderBricks(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    u32 brick_count,
+    const ColliderBrick* p_bricks,
+    u32 removed_count,
+    const glm::ivec3* p_removed_coords
+) {
 
-    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_updateParticles, NULL);
-    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_updateParticles, NULL);
+    ZoneScoped;
 
-    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeMin, NULL);
-    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeMin, NULL);
+    if (s->cpu_backend) return true;
 
-    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_computeMortonCodes, NULL);
-    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_computeMortonCodes, NULL);
+    GpuResources* res = &s->gpu_resources;
 
-    vk_ctx->procs_dev.DestroyPipeline(vk_ctx->device, res->pipeline_sortParticles, NULL);
-    vk_ctx->procs_dev.DestroyPipelineLayout(vk_ctx->device, res->pipeline_layout_sortParticles, NULL);
+    if (brick_count > 0 and res->collider_brick_capacity == 0)
+    {
+        LOG_F(ERROR, "Can't add collider bricks, as the collider is disabled.");
+        return false;
+    }
+    if (brick_count == 0 and (removed_count == 0 or res->collider_brick_count == 0)) return true;
+
+    // Before the removals, so it's the worst case.
+    u32 new_count = 0;
+    for (u32 i = 0; i < brick_count; i++)
+    {
+        new_count += res->collider_slots[findColliderSlot(res, p_bricks[i].coord)].w == COLLIDER_SLOT_EMPTY;
+    }
+    if (new_count > res->collider_brick_capacity - res->collider_brick_count)
+    {
+        LOG_F(
+            ERROR, "%u new collider bricks don't fit in the capacity of %u, of which %u are in use.",
+            new_count, res->collider_brick_capacity, res->collider_brick_count
+        );
+        return false;
+    }
 
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
 
-    vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, res->particle_update_finished_semaphore, NULL);
-    vk_ctx->procs_dev.DestroyFence(vk_ctx->device, res->fence, NULL);
-}
+    constexpr VkDeviceSize brick_size_bytes = COLLIDER_BRICK_SAMPLE_COUNT * sizeof(f32);
+    const VkDeviceSize slots_size_bytes = res->collider_slot_count * sizeof(ivec4);
+    const VkDeviceSize staging_size_bytes = slots_size_bytes + brick_count * brick_size_bytes;
 
+    const GpuBuffer staging = createParticleStagingBuffer(vk_ctx, staging_size_bytes, false);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging.buffer, staging.allocation));
 
-static void downloadBufferFromHostVisibleGpuMemory(
-    const VulkanContext* vk_ctx,
-    const u32fast size_bytes,
-    const VmaAllocation src,
-    void* dst,
-    const VkDeviceSize src_offset
-) {
+    // The staging buffer has the slots, then the new bricks' distances; each is copied to its brick.
+    VkBufferCopy* p_brick_copies = mallocArray(glm::max(brick_count, 1u), VkBufferCopy);
+    defer(free(p_brick_copies));
+    {
+        u8* p_staging = (u8*)getMappedPointer(&staging);
+        for (u32 i = 0; i < brick_count; i++)
+        {
+            const u32 slot_idx = findColliderSlot(res, p_bricks[i].coord);
+            i32 brick_idx = res->collider_slots[slot_idx].w;
+            if (brick_idx == COLLIDER_SLOT_EMPTY)
+            {
+                const u32 free_count = res->collider_brick_capacity - res->collider_brick_count;
+                brick_idx = (i32)res->collider_free_bricks[free_count - 1];
+                res->collider_brick_count++;
+                res->collider_slots[slot_idx] = ivec4(p_bricks[i].coord, brick_idx);
+            }
 
-    VkResult result = VK_ERROR_UNKNOWN;
+            const VkDeviceSize staging_offset = slots_size_bytes + i * brick_size_bytes;
+            memcpy(p_staging + staging_offset, p_bricks[i].distances, brick_size_bytes);
+            p_brick_copies[i] = VkBufferCopy {
+                .srcOffset = staging_offset,
+                .dstOffset = (VkDeviceSize)brick_idx * brick_size_bytes,
+                .size = brick_size_bytes,
+            };
+        }
 
+        for (u32 i = 0; i < removed_count; i++)
+        {
+            if (res->collider_brick_count == 0) break;
 
-    const void* p_mapped_memory = NULL;
-    {
-        void* ptr = NULL;
+            const u32 slot_idx = findColliderSlot(res, p_removed_coords[i]);
+            const i32 brick_idx = res->collider_slots[slot_idx].w;
+            if (brick_idx == COLLIDER_SLOT_EMPTY) continue;
 
-        result = vmaMapMemory(vk_ctx->vma_allocator, src, &ptr);
-        assertVk(result);
+            removeColliderSlot(res, slot_idx);
+            res->collider_brick_count--;
+            res->collider_free_bricks[res->collider_brick_capacity - res->collider_brick_count - 1] = (u32)brick_idx;
+        }
 
-        p_mapped_memory = (void*)( (uintptr_t)ptr + (uintptr_t)src_offset );
-    }
+        memcpy(p_staging, res->collider_slots, slots_size_bytes);
 
-    result = vmaInvalidateAllocation(vk_ctx->vma_allocator, src, src_offset, size_bytes);
-    assertVk(result);
+        VkResult result = vmaFlushAllocation(vk_ctx->vma_allocator, staging.allocation, 0, staging_size_bytes);
+        assertVk(result);
+        countTransfer(&s->transfers, TRANSFER_COLLIDER, false, staging_size_bytes);
+    }
 
     {
-        ZoneScopedN("memcpy");
-        memcpy(dst, p_mapped_memory, size_bytes);
+        const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+
+        const VkBufferCopy slots_copy { .srcOffset = 0, .dstOffset = 0, .size = slots_size_bytes };
+        vk_ctx->procs_dev.CmdCopyBuffer(
+            command_buffer, staging.buffer, res->buffer_collider_slots.buffer, 1, &slots_copy
+        );
+        if (brick_count > 0)
+        {
+            vk_ctx->procs_dev.CmdCopyBuffer(
+                command_buffer, staging.buffer, res->buffer_collider_distances.buffer, brick_count, p_brick_copies
+            );
+        }
+        // for the next steps
+        recordTransferToComputeBarrier(vk_ctx, command_buffer);
+
+        submitOneOffCommands(s, vk_ctx, command_buffer);
+        // before the staging buffer goes
+        waitForTimelineValue(vk_ctx, res, res->timeline_value);
     }
 
-    vmaUnmapMemory(vk_ctx->vma_allocator, src);
-}
+    // The particle update's push constants depend on whether there are any bricks.
+    discardGpuResidentRecordings(res);
 
+    return true;
+}
 
-static void uploadDataToGpu(const SimData* s, const VulkanContext* vk_ctx) {
+//
+// ===========================================================================================================
+//
 
-    ZoneScoped;
+// A host copy of the spatial structure, for `getSpatialStructureStats()`. The cells are in Morton order, and
+// `positions` are in the order that the cells index, i.e. sorted by cell.
+struct SpatialStructureSnapshot {
+    u32 particle_count;
+    u32 cell_count;
+    const u64* cell_codes;
+    const u32* cell_first_particles;
+    const u32* cell_particle_counts;
+    const vec4* positions;
+    u32 morton_code_bit_count; // MORTON_CODE_BIT_COUNT_NARROW or MORTON_CODE_BIT_COUNT_WIDE
+    // If `SimParameters::hilbert_cell_order`, the cell codes are Hilbert codes, in increasing order. Then the GPU's
+    // hash tables are still keyed by the Morton codes, but the CPU backend's by the Hilbert codes, which
+    // `hilbert_table_keys` says.
+    bool hilbert_cell_order;
+    bool hilbert_table_keys;
+};
 
-    {
-        const UniformBufferData::UpdatedByHost uniform_data {
-            .rest_particle_density = s->parameters.rest_particle_density,
-            .particle_interaction_radius = s->parameters.particle_interaction_radius,
-            .spring_rest_length = s->parameters.spring_rest_length,
-            .spring_stiffness = s->parameters.spring_stiffness,
-            .cell_size_reciprocal = s->parameters.cell_size_reciprocal,
 
-            .particle_count = (u32)s->particle_count,
-            .hash_modulus = s->hash_modulus,
-        };
-        uploadBufferToHostVisibleGpuMemory(
-            vk_ctx,
-            sizeof(uniform_data),
-            &uniform_data,
-            s->gpu_resources.buffer_uniforms.allocation,
-            offsetof(UniformBufferData, updated_by_host)
-        );
-    }
+/// `cellMortonCode()` in `fluidSim_util.comp.h`, as a single word. If every component is less than 1024, this
+/// is also `cellMortonCode30()`.
+static u64 cellMortonCode63(uvec3 cell_index) {
+    return morton::encode63(cell_index.x, cell_index.y, cell_index.z);
+}
 
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        s->particle_count * sizeof(u32),
-        s->p_permutation,
-        s->gpu_resources.buffer_morton_codes_or_permutation.allocation,
-        0 // dst_offset
-    );
+static uvec3 cellIndexFromMortonCode63(u64 code) {
+    return uvec3(morton::decode63(code, 0), morton::decode63(code, 1), morton::decode63(code, 2));
+}
 
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        s->cell_count * sizeof(*s->C_begin),
-        s->C_begin,
-        s->gpu_resources.buffer_C_begin.allocation,
-        0 // dst_offset
-    );
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        s->cell_count * sizeof(*s->C_length),
-        s->C_length,
-        s->gpu_resources.buffer_C_length.allocation,
-        0 // dst_offset
-    );
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        s->hash_modulus * sizeof(*s->H_begin),
-        s->H_begin,
-        s->gpu_resources.buffer_H_begin.allocation,
-        0 // dst_offset
-    );
-    uploadBufferToHostVisibleGpuMemory(
-        vk_ctx,
-        s->hash_modulus * sizeof(*s->H_length),
-        s->H_length,
-        s->gpu_resources.buffer_H_length.allocation,
-        0 // dst_offset
-    );
+static uvec3 snapshotCellIndex(const SpatialStructureSnapshot* snapshot, u64 code) {
+    if (snapshot->hilbert_cell_order) return cellIndexFromHilbertCode63(code, snapshot->morton_code_bit_count / 3);
+    return cellIndexFromMortonCode63(code);
 }
 
+static u64 snapshotCellCode(const SpatialStructureSnapshot* snapshot, uvec3 cell_index) {
+    if (snapshot->hilbert_cell_order) return cellHilbertCode63(cell_index, snapshot->morton_code_bit_count / 3);
+    return cellMortonCode63(cell_index);
+}
 
-static void downloadDataFromGpu(SimData* s, const VulkanContext* vk_ctx, vec3* p_domain_min_out) {
+/// The key of cell `cell_idx` in the hash tables that the snapshot was built with.
+static u64 snapshotCellTableKey(const SpatialStructureSnapshot* snapshot, u32 cell_idx) {
+    const u64 code = snapshot->cell_codes[cell_idx];
+    if (!snapshot->hilbert_cell_order or snapshot->hilbert_table_keys) return code;
+    return cellMortonCode63(cellIndexFromHilbertCode63(code, snapshot->morton_code_bit_count / 3));
+}
 
-    ZoneScoped;
+/// Same as `mortonCodeHash()` in `fluidSim_util.comp.h`; for 30-bit codes, also the same as
+/// `cpuCellTableHash()`. `table_size` must be a power of two.
+static u32 mortonCodeHash64(u64 code, u32 table_size) {
+    const u32 bit_count = (u32)__builtin_ctz(table_size);
+    if (bit_count == 0) return 0;
 
-    // OPTIMIZE why copy the buffer? We can just map and use it directly, since it's host-allocated anyway.
-    downloadBufferFromHostVisibleGpuMemory(
-        vk_ctx,
-        s->particle_count * sizeof(u32),
-        s->gpu_resources.buffer_morton_codes_or_permutation.allocation,
-        s->p_morton_codes,
-        0 // src_offset
-    );
-    downloadBufferFromHostVisibleGpuMemory(
-        vk_ctx,
-        sizeof(vec3),
-        s->gpu_resources.buffer_uniforms.allocation,
-        p_domain_min_out,
-        offsetof(UniformBufferData, domain_min)
-    );
+    const u32 key = (u32)code ^ ((u32)(code >> 32) * 0x85EBCA6Bu);
+    return (key * 0x9E3779B1u) >> (32 - bit_count);
 }
 
 
-static void allocateHostBuffers(SimData* s, u32fast particle_count, u32fast hash_modulus) {
+/// The index of the cell with code `code` (see `snapshotCellCode()`), or `cell_count` if no particle is in it.
+static u32 findSnapshotCell(const SpatialStructureSnapshot* snapshot, u64 code) {
 
-    ZoneScoped;
+    u32 lo = 0;
+    u32 hi = snapshot->cell_count;
+    while (lo < hi)
+    {
+        const u32 mid = lo + (hi - lo) / 2;
+        if (snapshot->cell_codes[mid] < code) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return (lo < snapshot->cell_count and snapshot->cell_codes[lo] == code) ? lo : snapshot->cell_count;
+}
 
-    s->p_cells_scratch_buffer1 = callocArray(particle_count + 1, u32);
-    s->p_cells_scratch_buffer2 = callocArray(particle_count + 1, u32);
+/// The index of the cell that sorted particle `particle_idx` is in.
+static u32 findSnapshotCellOfParticle(const SpatialStructureSnapshot* snapshot, u32 particle_idx) {
 
-    s->p_scratch_keyval_buffer_1 = callocArray(particle_count + 1, KeyVal);
-    s->p_scratch_keyval_buffer_2 = callocArray(particle_count + 1, KeyVal);
+    // the last cell whose first particle is at most `particle_idx`
+    u32 lo = 0;
+    u32 hi = snapshot->cell_count;
+    while (hi - lo > 1)
+    {
+        const u32 mid = lo + (hi - lo) / 2;
+        if (snapshot->cell_first_particles[mid] <= particle_idx) lo = mid;
+        else hi = mid;
+    }
 
-    s->C_begin = callocArray(particle_count + 1, u32);
-    s->C_length = callocArray(particle_count + 1, u32);
+    return lo;
+}
 
-    s->H_begin = callocArray(hash_modulus, u32);
-    s->H_length = callocArray(hash_modulus, u32);
 
-    s->p_morton_codes = callocArray(particle_count, u32);
-    s->p_permutation = callocArray(particle_count, u32);
+static u32 spatialStatsHistogramBin(u32 value) {
+    return math::min(value, SPATIAL_STATS_HISTOGRAM_BIN_COUNT - 1);
 }
 
 
-extern "C" SimData create(
-    const SimParameters* params,
-    const VulkanContext* vk_ctx,
-    u32fast particle_count,
-    const vec4* p_initial_positions
+/// The hash chains are recomputed from the cell codes, with the same hash as the shaders, instead of being read
+/// back. If `open_addressing`, the cells are inserted in code order; the GPU inserts them in parallel, so its
+/// probe lengths are distributed differently among the cells, but with linear probing their sum (and so the
+/// mean) doesn't depend on the insertion order.
+static SpatialStructureStats computeSpatialStructureStats(
+    const SpatialStructureSnapshot* snapshot,
+    u32 hash_table_size,
+    bool open_addressing,
+    bool dense_cell_grid,
+    f32 interaction_radius
 ) {
 
     ZoneScoped;
 
-    LOG_F(INFO, "Initializing fluid sim.");
+    const u32 cell_count = snapshot->cell_count;
 
+    SpatialStructureStats stats {
+        .particle_count = snapshot->particle_count,
+        .cell_count = cell_count,
+        .hash_table_size = hash_table_size,
+        .open_addressing = open_addressing,
+    };
+    if (cell_count == 0) return stats;
 
-    // smallest prime number larger than the maximum number of particles
-    // OPTIMIZE profile this and optimize if too slow
-    u32fast hash_modulus = getNextPrimeNumberExclusive(particle_count);
-    assert(hash_modulus <= UINT32_MAX);
+    // cell occupancy
+    {
+        u64 occupancy_sum = 0;
+        for (u32 c = 0; c < cell_count; c++)
+        {
+            const u32 occupancy = snapshot->cell_particle_counts[c];
+            stats.cell_occupancy_histogram[spatialStatsHistogramBin(occupancy)]++;
+            stats.cell_occupancy_max = math::max(stats.cell_occupancy_max, occupancy);
+            occupancy_sum += occupancy;
+        }
+        stats.cell_occupancy_mean = (f32)((f64)occupancy_sum / (f64)cell_count);
+    }
 
-    SimData s {};
+    // hash chains
     {
-        s.particle_count = particle_count;
-        s.cell_count = 0;
-        s.hash_modulus = (u32)hash_modulus;
+        // 1 + the cell in each slot (0 if empty) if `open_addressing`; otherwise the cells per bucket
+        u32* p_table = callocArray(hash_table_size, u32);
+        defer(free(p_table));
 
-        allocateHostBuffers(&s, particle_count, hash_modulus);
-        setParams(&s, params);
-        s.gpu_resources = createGpuResources(vk_ctx, particle_count, hash_modulus);
+        // like `fluidSim_hashTable_insertCells.comp`
+        if (open_addressing and dense_cell_grid)
+        {
+            uvec3 max_cell_idx_3d(0);
+            for (u32 c = 0; c < cell_count; c++)
+            {
+                max_cell_idx_3d = glm::max(max_cell_idx_3d, snapshotCellIndex(snapshot, snapshot->cell_codes[c]));
+            }
+            const u64 grid_cell_count =
+                (u64)(max_cell_idx_3d.x + 1) * (u64)(max_cell_idx_3d.y + 1) * (u64)(max_cell_idx_3d.z + 1);
+            stats.dense_grid = grid_cell_count <= hash_table_size;
+        }
 
+        u64 lookup_read_count_sum = 0;
+        if (stats.dense_grid)
         {
-            long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
-
-            if (processor_count < 0)
+            stats.hash_chain_length_histogram[spatialStatsHistogramBin(1)] = cell_count;
+            stats.hash_chain_length_max = 1;
+            lookup_read_count_sum = cell_count;
+        }
+        else if (open_addressing)
+        {
+            // terminates because the tables always have more slots than cells
+            const u32 mask = hash_table_size - 1;
+            for (u32 c = 0; c < cell_count; c++)
             {
-                const int err = errno;
-                const char* err_description = strerror(err);
-                if (err_description == NULL) err_description = "(NO DESCRIPTION PROVIDED)";
-
-                LOG_F(
-                    ERROR, "Failed to get processor count; (errno %i, description `%s`).",
-                    err, err_description
-                );
-                processor_count = 1;
+                u32 slot = mortonCodeHash64(snapshotCellTableKey(snapshot, c), hash_table_size);
+                u32 probe_count = 1;
+                while (p_table[slot] != 0)
+                {
+                    slot = (slot + 1) & mask;
+                    probe_count++;
+                }
+                p_table[slot] = 1 + c;
+
+                stats.hash_chain_length_histogram[spatialStatsHistogramBin(probe_count)]++;
+                stats.hash_chain_length_max = math::max(stats.hash_chain_length_max, probe_count);
+                lookup_read_count_sum += probe_count;
             }
-            else if (processor_count == 0)
+        }
+        else
+        {
+            for (u32 c = 0; c < cell_count; c++)
             {
-                LOG_F(ERROR, "Failed to get processor count (got 0).");
-                processor_count = 1;
+                p_table[mortonCodeHash64(snapshotCellTableKey(snapshot, c), hash_table_size)]++;
             }
 
-            LOG_F(INFO, "Using processor_count=%li.", processor_count);
-            s.processor_count = (u32)processor_count;
+            // a lookup reads the whole chain of the cell's bucket
+            for (u32 bucket = 0; bucket < hash_table_size; bucket++)
+            {
+                const u32 length = p_table[bucket];
+                stats.hash_chain_length_histogram[spatialStatsHistogramBin(length)]++;
+                stats.hash_chain_length_max = math::max(stats.hash_chain_length_max, length);
+                lookup_read_count_sum += (u64)length * length;
+            }
         }
+        stats.hash_chain_length_mean = (f32)((f64)lookup_read_count_sum / (f64)cell_count);
     }
 
-    initGpuBuffers(
-        &s.gpu_resources,
-        vk_ctx,
-        &s.parameters,
-        (u32)particle_count,
-        p_initial_positions,
-        (u32)hash_modulus
-    );
-
-    // signal the fence, so that we don't deadlock when waiting for it in `advance()`.
-    emptyQueueSubmit(vk_ctx, VK_NULL_HANDLE, VK_NULL_HANDLE, s.gpu_resources.fence);
-
-
-    LOG_F(
-         INFO,
-         "Initialized fluid sim with %" PRIuFAST32 " particles, workgroup_size=%u, workgroup_count=%u.",
-         s.particle_count, s.gpu_resources.workgroup_size, s.gpu_resources.workgroup_count
-     );
-
-    return s;
-}
-
-
-extern "C" void destroy(SimData* s, const VulkanContext* vk_ctx) {
-
-    ZoneScoped;
-
-    destroyGpuResources(&s->gpu_resources, vk_ctx);
+    // neighbors of a sample of the particles
+    {
+        // Like the shaders' unsigned cell indices, the neighboring cells wrap around the codes' range.
+        const u32 axis_mask = (1u << (snapshot->morton_code_bit_count / 3)) - 1;
+        const f32 radius_squared = interaction_radius * interaction_radius;
+        const u32 sample_count = math::min(SPATIAL_STATS_NEIGHBOR_SAMPLE_COUNT, snapshot->particle_count);
+
+        u64 candidate_count_sum = 0;
+        u64 neighbor_count_sum = 0;
+        for (u32 sample = 0; sample < sample_count; sample++)
+        {
+            const u32 k = (u32)((u64)sample * snapshot->particle_count / sample_count);
+            const vec3 particle = vec3(snapshot->positions[k]);
+            const uvec3 cell_idx_3d =
+                snapshotCellIndex(snapshot, snapshot->cell_codes[findSnapshotCellOfParticle(snapshot, k)]);
 
-    free(s->p_cells_scratch_buffer1);
-    free(s->p_cells_scratch_buffer2);
+            for (u32 offset_idx = 0; offset_idx < 27; offset_idx++)
+            {
+                // `+ axis_mask` is `- 1` modulo the range
+                const uvec3 offset(offset_idx % 3, offset_idx / 3 % 3, offset_idx / 9);
+                const uvec3 neighbor_cell_idx_3d = (cell_idx_3d + offset + uvec3(axis_mask)) & uvec3(axis_mask);
 
-    free(s->p_scratch_keyval_buffer_1);
-    free(s->p_scratch_keyval_buffer_2);
+                const u32 c = findSnapshotCell(snapshot, snapshotCellCode(snapshot, neighbor_cell_idx_3d));
+                if (c == cell_count) continue;
 
-    free(s->C_begin);
-    free(s->C_length);
+                const u32 begin = snapshot->cell_first_particles[c];
+                const u32 end = begin + snapshot->cell_particle_counts[c];
+                for (u32 i = begin; i < end; i++)
+                {
+                    if (i == k) continue;
+                    candidate_count_sum++;
 
-    free(s->H_begin);
-    free(s->H_length);
+                    const vec3 d = vec3(snapshot->positions[i]) - particle;
+                    if (glm::dot(d, d) < radius_squared) neighbor_count_sum++;
+                }
+            }
+        }
 
-    free(s->p_morton_codes);
-    free(s->p_permutation);
+        stats.neighbor_sample_count = sample_count;
+        if (sample_count > 0)
+        {
+            stats.neighbor_candidate_count_mean = (f32)((f64)candidate_count_sum / (f64)sample_count);
+            stats.neighbor_count_mean = (f32)((f64)neighbor_count_sum / (f64)sample_count);
+        }
+    }
 
-    memset(s, 0, sizeof(*s));
+    return stats;
 }
 
 
-extern "C" void advance(
+/// Writes statistics of the spatial structure that the next step will use to `p_stats_out`, for tuning the
+/// cell size and the hash table size. Waits for the sim's submissions, then copies the structure and the
+/// positions to the host (36 bytes per particle, none for the CPU backend), so it costs about as much as a few
+/// steps; call it every few hundred frames at most, not every frame.
+extern "C" void getSpatialStructureStats(
     SimData* s,
     const VulkanContext* vk_ctx,
-    thread_pool::ThreadPool* thread_pool,
-    f32 delta_t,
-    VkSemaphore optional_wait_semaphore,
-    VkSemaphore particle_update_finished_signal_semaphore_optional
+    SpatialStructureStats* p_stats_out
 ) {
 
     ZoneScoped;
 
-    VkResult result = VK_ERROR_UNKNOWN;
-
-    assert(delta_t > 1e-5); // assert nonzero
-
+    const u32 particle_count = (u32)s->particle_count;
+    const f32 interaction_radius = s->parameters.particle_interaction_radius;
 
+    if (particle_count == 0)
     {
-        ZoneScopedN("WaitForFences");
-        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &s->gpu_resources.fence, true, UINT64_MAX);
-        assertVk(result);
+        *p_stats_out = SpatialStructureStats {};
+        return;
     }
-    result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &s->gpu_resources.fence);
-    assertVk(result);
 
-    vec3 domain_min = vec3(INFINITY);
-    downloadDataFromGpu(s, vk_ctx, &domain_min);
+    u64* p_cell_codes = mallocArray(particle_count, u64); // at most one cell per particle
+    defer(free(p_cell_codes));
+    vec4* p_positions = mallocArray(particle_count, vec4);
+    defer(free(p_positions));
 
-    const u32fast particle_count = s->particle_count;
+    SpatialStructureSnapshot snapshot {
+        .particle_count = particle_count,
+        .cell_codes = p_cell_codes,
+        .positions = p_positions,
+    };
+
+    if (s->cpu_backend)
+    {
+        const CpuState* cpu = &s->cpu_state;
+
+        snapshot.cell_count = cpu->cell_count;
+        snapshot.cell_first_particles = cpu->cell_first_particles;
+        snapshot.cell_particle_counts = cpu->cell_particle_counts;
+        snapshot.morton_code_bit_count = MORTON_CODE_BIT_COUNT_NARROW;
+        snapshot.hilbert_cell_order = cpu->hilbert_cell_order;
+        snapshot.hilbert_table_keys = true;
 
-    // TODO FIXME WARNING:
-    //     If the domain spans more than 1024 cells in any dimension, the simulation is invalid, because
-    //     we store 30-bit Morton codes (so a uvec3 cell index is 10 bits per dimension; 2^10 = 1024).
-    //     We should assert that the domain is not too big.
-    //     But to do that, we need the domain min and domain max.
-    //     But we can't compute the domain max, because we need the list of particle positions to do that,
-    //     and we don't have the list of particle positions because we only store it on the GPU.
-    //     We could write a GPU reduction to get the max, but that might be a significant performance hit
-    //     just to do an assertion.
-    //     On the other hand, we _should_ make this assertion, because otherwise the simulation will start
-    //     behaving incorrectly.
-    //     Figure out what to do about this.
-
-    {
-        // OPTIMIZE doing this interspersion and then un-interspersing them seems like kind of a waste of time?
-        //     Although we are accessing the data many times during the merge sort, so maybe worth it.
-        //     See if it's faster to sort the permutation array without actually modifying the morton codes
-        //     array, by using the permutation data as indices into the morton codes.
+        for (u32 c = 0; c < cpu->cell_count; c++) p_cell_codes[c] = cpu->cell_codes[c];
+        // the cells were built from these
         for (u32 i = 0; i < particle_count; i++)
         {
-            s->p_scratch_keyval_buffer_1[i].key = s->p_morton_codes[i];
-            s->p_scratch_keyval_buffer_1[i].val = i;
+            p_positions[i] = vec4(
+                cpu->positions_sorted[0][i], cpu->positions_sorted[1][i], cpu->positions_sorted[2][i], 0.0f
+            );
         }
-        mergeSortMultiThreaded(
-            thread_pool,
-            s->processor_count,
-            particle_count,
-            s->p_scratch_keyval_buffer_1,
-            s->p_scratch_keyval_buffer_2
-        );
 
-        for (u32fast i = 0; i < particle_count; i++)
-        {
-            // OPTIMIZE Don't bother writing this to p_permutation; we can write it directly to the
-            //     host-visible VkBuffer.
-            s->p_morton_codes[i] = s->p_scratch_keyval_buffer_1[i].key;
-            s->p_permutation[i] = s->p_scratch_keyval_buffer_1[i].val;
-        }
+        *p_stats_out = computeSpatialStructureStats(&snapshot, cpu->cell_table_size, true, interaction_radius);
+        return;
     }
 
-    // fill cell list
-    {
-        ZoneScopedN("fillCellList");
-
-        u32 prev_morton_code = 0;
-        if (particle_count > 0)
-        {
-            s->C_begin[0] = 0;
-            prev_morton_code = s->p_morton_codes[0];
-        }
+    GpuResources* res = &s->gpu_resources;
 
-        u32fast cell_idx = 1;
-        for (u32fast particle_idx = 1; particle_idx < particle_count; particle_idx++)
-        {
-            u32 morton_code = s->p_morton_codes[particle_idx];
-            if (morton_code == prev_morton_code) continue;
+    // The structure was built at the end of the last step from the unsorted positions, so those are in the
+    // order it indexes after the permutation from the sort, unless it hasn't been rebuilt since (like in
+    // `sortParticles`).
+    const bool permuted = s->spatial_structure_rebuilt_last_step;
 
-            s->C_begin[cell_idx] = (u32)particle_idx;
+    const VkDeviceSize positions_offset = 0;
+    const VkDeviceSize codes_offset = positions_offset + particle_count * sizeof(vec4);
+    const VkDeviceSize first_particles_offset = codes_offset + particle_count * sizeof(uvec2);
+    const VkDeviceSize particle_counts_offset = first_particles_offset + particle_count * sizeof(u32);
+    const VkDeviceSize permutation_offset = particle_counts_offset + particle_count * sizeof(u32);
+    const VkDeviceSize cell_count_offset = permutation_offset + particle_count * sizeof(u32);
+    const VkDeviceSize readback_size = cell_count_offset + sizeof(u32);
 
-            prev_morton_code = morton_code;
-            cell_idx++;
-        }
-        s->C_begin[cell_idx] = (u32)particle_count;
+    GpuBuffer readback = createParticleStagingBuffer(vk_ctx, readback_size, true);
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, readback.buffer, readback.allocation));
 
-        const u32fast cell_count = cell_idx;
-        s->cell_count = cell_count;
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
 
-        for (cell_idx = 0; cell_idx < cell_count; cell_idx++)
+    const VkCommandBuffer command_buffer = beginOneOffCommands(s, vk_ctx);
+    {
+        recordStepBarrier(vk_ctx, command_buffer); // after the previous steps
+
+        // All cells are copied, because the cell count is only known on the GPU.
+        const struct { VkBuffer src; VkDeviceSize dst_offset; VkDeviceSize size; } copies[] {
+            { res->buffer_positions_unsorted.buffer, positions_offset, particle_count * sizeof(vec4) },
+            { res->buffer_cell_codes_morton_order.buffer, codes_offset, particle_count * sizeof(uvec2) },
+            { res->buffer_C_begin_morton_order.buffer, first_particles_offset, particle_count * sizeof(u32) },
+            { res->buffer_C_length_morton_order.buffer, particle_counts_offset, particle_count * sizeof(u32) },
+            { res->buffer_permutation.buffer, permutation_offset, particle_count * sizeof(u32) },
+            { res->buffer_cell_count.buffer, cell_count_offset, sizeof(u32) },
+        };
+        for (u32 i = 0; i < ARRAY_SIZE(copies); i++)
         {
-            s->C_length[cell_idx] = (u32)s->C_begin[cell_idx+1] - s->C_begin[cell_idx];
+            const VkBufferCopy copy {
+                .srcOffset = 0,
+                .dstOffset = copies[i].dst_offset,
+                .size = copies[i].size,
+            };
+            vk_ctx->procs_dev.CmdCopyBuffer(command_buffer, copies[i].src, readback.buffer, 1, &copy);
         }
+
+        const VkMemoryBarrier memory_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &memory_barrier,
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            0, // imageMemoryBarrierCount
+            NULL // pImageMemoryBarriers
+        );
     }
-    sortCells(
-        thread_pool,
-        s->processor_count,
-        s->cell_count,
-        &s->C_begin,
-        &s->C_length,
-        &s->p_cells_scratch_buffer1,
-        &s->p_cells_scratch_buffer2,
-        s->p_scratch_keyval_buffer_1,
-        s->p_scratch_keyval_buffer_2,
-        s->p_morton_codes,
-        s->hash_modulus
-    );
+    submitOneOffCommands(s, vk_ctx, command_buffer);
+    waitForTimelineValue(vk_ctx, res, res->timeline_value);
 
+    VkResult result = vmaInvalidateAllocation(vk_ctx->vma_allocator, readback.allocation, 0, readback_size);
+    assertVk(result);
+    countTransfer(&s->transfers, TRANSFER_QUERIES, true, readback_size);
+
+    const uintptr_t p_mapped = (uintptr_t)getMappedPointer(&readback);
+    const vec4* p_positions_unsorted = (const vec4*)(p_mapped + positions_offset);
+    const uvec2* p_codes = (const uvec2*)(p_mapped + codes_offset);
+    const u32* p_permutation = (const u32*)(p_mapped + permutation_offset);
+
+    snapshot.cell_count = math::min(*(const u32*)(p_mapped + cell_count_offset), particle_count);
+    snapshot.cell_first_particles = (const u32*)(p_mapped + first_particles_offset);
+    snapshot.cell_particle_counts = (const u32*)(p_mapped + particle_counts_offset);
+    snapshot.morton_code_bit_count =
+        (res->morton_code_word_count == 2) ? MORTON_CODE_BIT_COUNT_WIDE : MORTON_CODE_BIT_COUNT_NARROW;
+    snapshot.hilbert_cell_order = res->hilbert_cell_order;
+    snapshot.hilbert_table_keys = false;
+
+    for (u32 c = 0; c < snapshot.cell_count; c++)
+    {
+        p_cell_codes[c] = (u64)p_codes[c].x | ((u64)p_codes[c].y << 32);
+    }
+    for (u32 k = 0; k < particle_count; k++)
     {
-        ZoneScopedN("fillHashTable");
+        p_positions[k] = p_positions_unsorted[permuted ? p_permutation[k] : k];
+    }
 
-        for (u32fast i = 0; i < s->hash_modulus; i++) s->H_begin[i] = UINT32_MAX;
-        for (u32fast i = 0; i < s->hash_modulus; i++) s->H_length[i] = 0;
+    const bool open_addressing = res->cell_slot_count > 0;
+    const u32 hash_table_size = open_addressing ? res->cell_slot_count : s->hash_table_size;
+    *p_stats_out = computeSpatialStructureStats(
+        &snapshot, hash_table_size, open_addressing, res->dense_cell_grid, interaction_radius
+    );
+}
 
-        const u32 cell_count = (u32)s->cell_count;
+//
+// ===========================================================================================================
+//
 
-        s->H_begin[0] = 0;
-        if (cell_count > 0) s->H_length[0] = 1;
-        u32 prev_hash;
-        {
-            const u32 particle_idx = s->C_begin[0];
-            const u32 morton_code = s->p_morton_codes[particle_idx];
-            prev_hash = mortonCodeHash(morton_code, s->hash_modulus);
-        }
-        u32 hash = UINT32_MAX;
-        u32 cells_with_this_hash_count = 1;
+// Checkpoint files: a `CheckpointHeader`, then, at `CheckpointHeader::data_offset`, the particles packed like
+// in the staging buffers (see `getPackedParticlesSize()`), so that loading is a single copy from the mapped
+// file into a staging buffer. In host byte order; only meant to be read back on the same machine.
+constexpr char CHECKPOINT_MAGIC[8] = { 'F', 'L', 'S', 'I', 'M', 'C', 'K', 'P' };
+// Bump when the header, the data layout or `SimParameters` changes.
+constexpr u32 CHECKPOINT_VERSION = 16;
+// The particle data starts at a multiple of this, so that it can be mapped on its own.
+constexpr u64 CHECKPOINT_DATA_ALIGNMENT = 4096;
+
+struct CheckpointHeader {
+    char magic[8]; // CHECKPOINT_MAGIC
+    u32 version; // CHECKPOINT_VERSION
+    u32 sim_parameters_size; // `sizeof(SimParameters)`, to catch a layout change without a version bump
+    u64 particle_count;
+    u64 data_offset; // bytes from the start of the file
+    // the bounds of the particles when the checkpoint was written
+    vec3 domain_min;
+    vec3 domain_max;
+    SimParameters parameters;
+};
+// the data goes right after the first alignment boundary
+static_assert(sizeof(CheckpointHeader) <= CHECKPOINT_DATA_ALIGNMENT);
 
-        for (u32 cell_idx = 1; cell_idx < cell_count; cell_idx++)
-        {
-            const u32 particle_idx = s->C_begin[cell_idx];
-            const u32 morton_code = s->p_morton_codes[particle_idx];
-            hash = mortonCodeHash(morton_code, s->hash_modulus);
 
-            if (hash != prev_hash)
-            {
-                s->H_begin[hash] = cell_idx;
-                s->H_length[prev_hash] = cells_with_this_hash_count;
+/// Writes the header, and `getPackedParticlesSize(header->particle_count)` bytes of `p_packed_particles` at
+/// `header->data_offset`. Logs an error and returns false on failure.
+static bool writeCheckpointFile(
+    const char* filepath,
+    const CheckpointHeader* header,
+    const void* p_packed_particles
+) {
 
-                // OPTIMIZE: if `cells_with_this_hash_count == 1`, set `H_begin[prev_hash] = cell_idx-1`.
-                // Make sure you account for this embedding in lookups.
+    ZoneScoped;
 
-                cells_with_this_hash_count = 0;
-                prev_hash = hash;
-            }
-            cells_with_this_hash_count++;
-        }
-        if (cell_count > 0) s->H_length[prev_hash] = cells_with_this_hash_count;
+    FILE* file = fopen(filepath, "wb");
+    if (file == NULL)
+    {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno)
+        );
+        return false;
     }
 
+    const size_t data_size = getPackedParticlesSize(header->particle_count);
 
-    // OPTIMIZE we can probably wait later than here
-    if (optional_wait_semaphore != VK_NULL_HANDLE) {
+    // the gap between the header and the data is a hole, which reads as zeros
+    const bool success =
+        fwrite(header, sizeof(*header), 1, file) == 1 and
+        fseek(file, (long)header->data_offset, SEEK_SET) == 0 and
+        fwrite(p_packed_particles, data_size, 1, file) == 1;
+    if (!success) LOG_F(ERROR, "Failed to write file `%s`; errno: `%i`.", filepath, errno);
 
-        ZoneScopedN("WaitForUserSemaphore");
+    const int result = fclose(file);
+    if (result != 0)
+    {
+        LOG_F(ERROR, "Failed to close file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
 
-        const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    return success;
+}
 
-        VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &optional_wait_semaphore,
-            .pWaitDstStageMask = &wait_stage,
-            .commandBufferCount = 0,
-            .pCommandBuffers = NULL,
-            .signalSemaphoreCount = 0,
-            .pSignalSemaphores = NULL,
-        };
-        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, s->gpu_resources.fence);
-        assertVk(result);
 
-        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &s->gpu_resources.fence, true, UINT64_MAX);
-        assertVk(result);
+/// Copies the live particles to `p_positions_out` (`SimData::particle_count` vec4s, like `p_initial_positions`
+/// in `create()`), and their velocities to `p_velocities_out`, in the sim's current order, which changes every
+/// step. Waits for the sim's submissions to finish.
+extern "C" void readBackParticles(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    vec4* p_positions_out,
+    vec3* p_velocities_out
+) {
 
-        result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &s->gpu_resources.fence);
-        assertVk(result);
-    }
+    ZoneScoped;
 
-    uploadDataToGpu(s, vk_ctx);
+    const u32fast count = s->particle_count;
 
+    void* p_packed = malloc(getPackedParticlesSize(count));
+    alwaysAssert(p_packed != NULL);
+    defer(free(p_packed));
+    readBackPackedParticles(s, vk_ctx, p_packed);
 
-    result = vk_ctx->procs_dev.ResetCommandBuffer(s->gpu_resources.general_purpose_command_buffer, 0);
-    assertVk(result);
+    memcpy(p_positions_out, p_packed, count * sizeof(vec4));
 
-    VkCommandBufferBeginInfo begin_info {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-    };
-    result = vk_ctx->procs_dev.BeginCommandBuffer(s->gpu_resources.general_purpose_command_buffer, &begin_info);
-    assertVk(result);
+    const f32* p_velocities = (const f32*)( (uintptr_t)p_packed + count * sizeof(vec4) );
+    for (u32fast i = 0; i < count; i++)
     {
-        TracyVkZone(vk_ctx->tracy_vk_ctx, s->gpu_resources.general_purpose_command_buffer, "sim::SortAndUpdateParticles");
+        p_velocities_out[i] = vec3(p_velocities[i], p_velocities[count + i], p_velocities[2 * count + i]);
+    }
+}
 
-        // sort particles
-        {
-            vk_ctx->procs_dev.CmdBindPipeline(
-                s->gpu_resources.general_purpose_command_buffer,
-                VK_PIPELINE_BIND_POINT_COMPUTE,
-                s->gpu_resources.pipeline_sortParticles
-            );
 
-            vk_ctx->procs_dev.CmdBindDescriptorSets(
-                s->gpu_resources.general_purpose_command_buffer,
-                    VK_PIPELINE_BIND_POINT_COMPUTE,
-                    s->gpu_resources.pipeline_layout_sortParticles,
-                    0, // firstSet
-                    1, // descriptorSetCount
-                    &s->gpu_resources.descriptor_set_main,
-                    0, // dynamicOffsetCount
-                    NULL // pDynamicOffsets
-            );
+/// Writes the particles and `*params` to a checkpoint file at `filepath`, which `loadCheckpoint()` can restart
+/// the sim from. `params` should be the parameters that the sim was created with, with the later `setParams()`
+/// changes applied; the sim doesn't keep a copy of its `SimParameters`.
+/// Waits for the sim's submissions to finish. Logs an error and returns false on failure, or for an ensemble, or a
+/// sim with `SimParameters::adaptive_resolution`, whose members and levels the file format has no room for.
+extern "C" bool saveCheckpoint(
+    SimData* s,
+    const VulkanContext* vk_ctx,
+    const SimParameters* params,
+    const char* filepath
+) {
 
-            vk_ctx->procs_dev.CmdDispatch(
-                s->gpu_resources.general_purpose_command_buffer,
-                s->gpu_resources.workgroup_count,
-                1, // groupCountY
-                1 // groupCountZ
-            );
-        }
+    ZoneScoped;
 
-        {
-            const VkBufferMemoryBarrier buffer_memory_barriers[] {
-                {
-                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-                    .srcQueueFamilyIndex = vk_ctx->queue_family_index,
-                    .dstQueueFamilyIndex = vk_ctx->queue_family_index,
-                    .buffer = s->gpu_resources.buffer_positions_sorted.buffer,
-                    .offset = 0,
-                    .size = VK_WHOLE_SIZE,
-                },
-                {
-                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-                    .srcQueueFamilyIndex = vk_ctx->queue_family_index,
-                    .dstQueueFamilyIndex = vk_ctx->queue_family_index,
-                    .buffer = s->gpu_resources.buffer_velocities_sorted.buffer,
-                    .offset = 0,
-                    .size = VK_WHOLE_SIZE,
-                },
-            };
-            constexpr u32 buffer_memory_barrier_count = ARRAY_SIZE(buffer_memory_barriers);
+    if (s->gpu_resources.ensemble_member_count > 0)
+    {
+        LOG_F(ERROR, "Can't save a checkpoint of an ensemble to `%s`.", filepath);
+        return false;
+    }
+    if (s->gpu_resources.particle_levels)
+    {
+        LOG_F(ERROR, "Can't save a checkpoint of particles with levels to `%s`.", filepath);
+        return false;
+    }
 
-            vk_ctx->procs_dev.CmdPipelineBarrier(
-                s->gpu_resources.general_purpose_command_buffer,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                0, // dependencyFlags
-                0, // memoryBarrierCount
-                NULL, // pMemoryBarriers
-                buffer_memory_barrier_count,
-                buffer_memory_barriers,
-                0, // imageMemoryBarrierCount
-                NULL // pImageMemoryBarriers
-            );
+    const u32fast count = s->particle_count;
+
+    void* p_packed = malloc(getPackedParticlesSize(count));
+    alwaysAssert(p_packed != NULL);
+    defer(free(p_packed));
+    readBackPackedParticles(s, vk_ctx, p_packed);
+
+    CheckpointHeader header {
+        .version = CHECKPOINT_VERSION,
+        .sim_parameters_size = sizeof(SimParameters),
+        .particle_count = count,
+        .data_offset = CHECKPOINT_DATA_ALIGNMENT,
+        .domain_min = vec3(INFINITY),
+        .domain_max = vec3(-INFINITY),
+        .parameters = *params,
+    };
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    {
+        const vec4* p_positions = (const vec4*)p_packed;
+        for (u32fast i = 0; i < count; i++)
+        {
+            header.domain_min = glm::min(header.domain_min, vec3(p_positions[i]));
+            header.domain_max = glm::max(header.domain_max, vec3(p_positions[i]));
         }
+    }
 
-        // update particles
-        {
-            vk_ctx->procs_dev.CmdBindPipeline(
-                s->gpu_resources.general_purpose_command_buffer,
-                VK_PIPELINE_BIND_POINT_COMPUTE,
-                s->gpu_resources.pipeline_updateParticles
-            );
+    if (!writeCheckpointFile(filepath, &header, p_packed)) return false;
 
-            const ParticleUpdatePushConstants push_constants {
-                .delta_t = delta_t,
-                .cell_count = (u32)s->cell_count
-            };
-            vk_ctx->procs_dev.CmdPushConstants(
-                s->gpu_resources.general_purpose_command_buffer,
-                s->gpu_resources.pipeline_layout_updateParticles,
-                VK_SHADER_STAGE_COMPUTE_BIT,
-                0, // offset
-                sizeof(ParticleUpdatePushConstants),
-                &push_constants
-            );
+    LOG_F(INFO, "Saved a checkpoint with %" PRIuFAST32 " particles to `%s`.", count, filepath);
+    return true;
+}
 
-            vk_ctx->procs_dev.CmdBindDescriptorSets(
-                s->gpu_resources.general_purpose_command_buffer,
-                VK_PIPELINE_BIND_POINT_COMPUTE,
-                s->gpu_resources.pipeline_layout_updateParticles,
-                0, // firstSet
-                1, // descriptorSetCount
-                &s->gpu_resources.descriptor_set_main,
-                0, // dynamicOffsetCount
-                NULL // pDynamicOffsets
-            );
 
-            vk_ctx->procs_dev.CmdDispatch(
-                s->gpu_resources.general_purpose_command_buffer,
-                s->gpu_resources.workgroup_count, // groupCountX
-                1, // groupCountY
-                1 // groupCountZ
-            );
-        }
+/// Creates a sim from a checkpoint file written by `saveCheckpoint()`, with the parameters from the file, which
+/// are also written to `p_params_out`. The file is memory-mapped, and the particles are copied straight from
+/// the mapping into the staging buffer.
+/// Logs an error and returns false, and writes nothing, if the file can't be read or isn't a checkpoint of this
+/// version.
+extern "C" bool loadCheckpoint(
+    const VulkanContext* vk_ctx,
+    const char* filepath,
+    SimParameters* p_params_out,
+    SimData* p_sim_out
+) {
 
-        TracyVkCollect(vk_ctx->tracy_vk_ctx, s->gpu_resources.general_purpose_command_buffer);
-    }
-    result = vk_ctx->procs_dev.EndCommandBuffer(s->gpu_resources.general_purpose_command_buffer);
-    assertVk(result);
+    ZoneScoped;
 
+    const int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
     {
-        ZoneScopedN("SubmitParticleUpdateCommandBuffer");
-
-        const u32 signal_semaphore_count =
-            (particle_update_finished_signal_semaphore_optional == VK_NULL_HANDLE)
-            ? (u32)1
-            : (u32)2;
-
-        const VkSemaphore signal_semaphores[2] {
-            s->gpu_resources.particle_update_finished_semaphore,
-            particle_update_finished_signal_semaphore_optional,
-        };
-
-        const VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 0,
-            .pWaitSemaphores = NULL,
-            .pWaitDstStageMask = 0,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &s->gpu_resources.general_purpose_command_buffer,
-            .signalSemaphoreCount = signal_semaphore_count,
-            .pSignalSemaphores = signal_semaphores,
-        };
-        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, VK_NULL_HANDLE);
-        assertVk(result);
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno)
+        );
+        return false;
     }
+    defer(close(fd));
 
-    result = vk_ctx->procs_dev.ResetCommandBuffer(s->gpu_resources.morton_code_command_buffer, 0);
-    assertVk(result);
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0)
+    {
+        LOG_F(ERROR, "Failed to stat file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    const u64 file_size = (u64)file_stat.st_size;
+    if (file_size < sizeof(CheckpointHeader))
+    {
+        LOG_F(ERROR, "`%s` is too small to be a checkpoint.", filepath);
+        return false;
+    }
 
-    begin_info = VkCommandBufferBeginInfo {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-    };
-    result = vk_ctx->procs_dev.BeginCommandBuffer(s->gpu_resources.morton_code_command_buffer, &begin_info);
-    assertVk(result);
+    void* p_file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p_file == MAP_FAILED)
     {
-        TracyVkZone(vk_ctx->tracy_vk_ctx, s->gpu_resources.morton_code_command_buffer, "sim::DomainMinAndMortonCodes");
+        LOG_F(ERROR, "Failed to map file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    defer(munmap(p_file, file_size));
+    // it's read once, front to back
+    (void)madvise(p_file, file_size, MADV_SEQUENTIAL);
 
-        PipelineBarrierSrcInfo barrier_src_info =
-            recordMinReductionCommands(s, vk_ctx, s->gpu_resources.morton_code_command_buffer);
+    CheckpointHeader header {};
+    memcpy(&header, p_file, sizeof(header));
 
-        VkBufferMemoryBarrier buffer_memory_barrier {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-            .srcAccessMask = barrier_src_info.src_access_mask,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-            .srcQueueFamilyIndex = vk_ctx->queue_family_index,
-            .dstQueueFamilyIndex = vk_ctx->queue_family_index,
-            .buffer = s->gpu_resources.buffer_uniforms.buffer,
-            .offset = offsetof(UniformBufferData, domain_min),
-            .size = sizeof(vec3),
-        };
-        vk_ctx->procs_dev.CmdPipelineBarrier(
-            s->gpu_resources.morton_code_command_buffer,
-            barrier_src_info.src_stage_mask,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0, // dependencyFlags
-            0, // memoryBarrierCount,
-            NULL, // pMemoryBarriers,
-            1, // bufferMemoryBarrierCount,
-            &buffer_memory_barrier,
-            0, // imageMemoryBarrierCount,
-            NULL // pImageMemoryBarriers
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        LOG_F(ERROR, "`%s` is not a checkpoint.", filepath);
+        return false;
+    }
+    if (header.version != CHECKPOINT_VERSION or header.sim_parameters_size != sizeof(SimParameters))
+    {
+        LOG_F(
+            ERROR, "`%s` is a version %u checkpoint with %u-byte parameters, but this is version %u with %zu.",
+            filepath, header.version, header.sim_parameters_size, CHECKPOINT_VERSION, sizeof(SimParameters)
         );
+        return false;
+    }
+    const u64 data_size = getPackedParticlesSize(header.particle_count);
+    if (
+        header.particle_count == 0 or header.particle_count > UINT32_MAX or
+        header.data_offset % CHECKPOINT_DATA_ALIGNMENT != 0 or
+        !(header.data_offset <= file_size and data_size <= file_size - header.data_offset)
+    ) {
+        LOG_F(ERROR, "The checkpoint `%s` is truncated or corrupt.", filepath);
+        return false;
+    }
 
-        vk_ctx->procs_dev.CmdBindPipeline(
-            s->gpu_resources.morton_code_command_buffer,
-            VK_PIPELINE_BIND_POINT_COMPUTE,
-            s->gpu_resources.pipeline_computeMortonCodes
-        );
-        vk_ctx->procs_dev.CmdBindDescriptorSets(
-            s->gpu_resources.morton_code_command_buffer,
-            VK_PIPELINE_BIND_POINT_COMPUTE,
-            s->gpu_resources.pipeline_layout_computeMortonCodes,
-            0, // firstSet
-            1, // descriptorSetCount
-            &s->gpu_resources.descriptor_set_main,
-            0, // dynamicOffsetCount
-            NULL // pDynamicOffsets
-        );
-        vk_ctx->procs_dev.CmdDispatch(
-            s->gpu_resources.morton_code_command_buffer,
-            s->gpu_resources.workgroup_count,
-            1, // groupCountY
-            1 // groupCountZ
-        );
+    const u32fast count = (u32fast)header.particle_count;
+    const void* p_packed = (const void*)( (uintptr_t)p_file + header.data_offset );
+    const vec4* p_positions = (const vec4*)p_packed;
 
-        TracyVkCollect(vk_ctx->tracy_vk_ctx, s->gpu_resources.morton_code_command_buffer);
-    }
-    result = vk_ctx->procs_dev.EndCommandBuffer(s->gpu_resources.morton_code_command_buffer);
-    assertVk(result);
+    // `create()` uploads the positions at rest; the velocities are uploaded after.
+    SimData s = create(&header.parameters, vk_ctx, count, p_positions);
 
+    if (s.cpu_backend)
     {
-        ZoneScopedN("SubmitMortonCodeCommandBuffer");
-
-        const VkPipelineStageFlags p_wait_dst_stage_mask { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
-        const VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &s->gpu_resources.particle_update_finished_semaphore,
-            .pWaitDstStageMask = &p_wait_dst_stage_mask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &s->gpu_resources.morton_code_command_buffer,
-            .signalSemaphoreCount = 0,
-            .pSignalSemaphores = NULL,
-        };
-        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, s->gpu_resources.fence);
-        assertVk(result);
+        CpuState* cpu = &s.cpu_state;
+        for (u32 d = 0; d < VELOCITY_COMPONENT_COUNT; d++)
+        {
+            const uintptr_t offset = count * sizeof(vec4) + d * count * sizeof(f32);
+            memcpy(cpu->velocities[d], (const void*)( (uintptr_t)p_packed + offset ), count * sizeof(f32));
+        }
+    }
+    else
+    {
+        // `create()` has already submitted the spatial structure build, which reads these buffers.
+        waitForTimelineValue(vk_ctx, &s.gpu_resources, s.gpu_resources.timeline_value);
+        uploadPackedParticles(&s.gpu_resources, vk_ctx, s.particle_capacity, 0, count, p_packed, &s.transfers);
+        rebuildSpatialStructure(&s, vk_ctx);
     }
-}
 
+    LOG_F(
+        INFO, "Loaded a checkpoint with %" PRIuFAST32 " particles in (%f, %f, %f) to (%f, %f, %f) from `%s`.",
+        count,
+        header.domain_min.x, header.domain_min.y, header.domain_min.z,
+        header.domain_max.x, header.domain_max.y, header.domain_max.z,
+        filepath
+    );
 
-extern "C" void getPositionsVertexBuffer(
-    const SimData* s,
-    VkBuffer* buffer_out,
-    VkDeviceSize* buffer_size_out
-) {
-    *buffer_out = s->gpu_resources.buffer_positions_unsorted.buffer;
-    *buffer_size_out = s->particle_count * sizeof(vec4);
+    *p_params_out = header.parameters;
+    *p_sim_out = s;
+    return true;
 }
 
 //
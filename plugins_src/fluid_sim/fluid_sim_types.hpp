@@ -5,10 +5,16 @@
 // #include "../../src/types.hpp"
 // #include "../../libs/glm/glm.hpp"
 // #include "../../src/vk_procs.hpp"
+// #include "../../src/thread_pool.hpp"
+// #include "../../src/file_watch.hpp"
 // #include "../../src/sort.hpp"
 
+// held by pointer, so that the includers needn't include gpu_primitives.hpp
+namespace gpu_primitives { struct Context; struct Plan; }
+
 namespace fluid_sim {
 
+using glm::vec3;
 using glm::vec4;
 
 //
@@ -20,6 +26,595 @@ struct SimParameters {
     /// The number of particles within the interaction radius at rest.
     f32 rest_particle_interaction_count_approx;
     f32 spring_stiffness;
+    /// If true, the particles push each other apart with SPH (smoothed-particle hydrodynamics) pressure forces,
+    /// and drag each other along with viscosity forces, instead of the springs. The step then has a density pass
+    /// before the update, which shares the update's spatial structure or neighbor lists; with the lists, neither
+    /// pass looks up any cells. The SPH mode always uses the plain particle update, like the neighbor lists.
+    bool sph;
+    /// The pressure is `sph_stiffness * max(density - rest_particle_density, 0)`, with the density in particles
+    /// per m^3, i.e. for particles of unit mass; so this is the squared speed of sound, in m^2/s^2.
+    f32 sph_stiffness;
+    /// How quickly the velocities of the particles within the interaction radius even out, in 1/s.
+    f32 sph_viscosity;
+    /// If true, the particles keep to the rest density with position-based fluids (PBF) density constraints
+    /// (Macklin and Mueller, "Position Based Fluids"), instead of the springs or the SPH forces, which stays stable
+    /// with several times longer steps. Each step predicts the positions from the velocities, moves the predicted
+    /// positions towards the rest density `pbf_iteration_count` times, and takes the velocities from how far the
+    /// particles got. Each iteration is two passes over the sorted particles, through the update's neighbor lists or
+    /// cells: the constraint multiplier of each particle, then its correction from its own and its neighbors'. The
+    /// neighbors are found at the step's start positions, so longer steps want a Verlet skin to cover how far the
+    /// particles move in one. Takes precedence over `sph`, and always uses the plain particle update.
+    bool pbf;
+    u32 pbf_iteration_count;
+    /// Softens the constraints, and bounds the corrections of particles with few neighbors; as a fraction of the
+    /// sum of the squared constraint gradients of a particle at the rest density.
+    f32 pbf_relaxation;
+    /// If true (and `flip_grid_resolution` isn't 0), the particles keep their volume with a FLIP/PIC hybrid (Zhu and
+    /// Bridson, "Animating Sand as a Fluid") instead of the springs, the SPH forces or PBF: each step transfers the
+    /// particles' velocities to a MAC grid of the spatial structure's cells, makes them divergence-free with a
+    /// pressure solve on the grid, and gives each particle the grid's change in velocity. The pressure solve is a
+    /// conjugate gradient solve preconditioned by a geometric multigrid V-cycle, all in compute shaders, which runs
+    /// `flip_pressure_iteration_count` iterations without reading anything back. The grid covers
+    /// `flip_grid_resolution` cells per axis from the domain origin; the particles outside it only get the custom
+    /// body acceleration. The grid has no solid cells, so the collider only acts in the update, and it doesn't wrap
+    /// around a periodic box. Takes precedence over `pbf` and `sph`, always uses the plain particle update, and
+    /// disables the Verlet skin, as the grid's cells must be the spatial structure's. Only on the GPU, and not for
+    /// ensembles.
+    bool flip;
+    /// The blend of the particles' velocities: 1 only adds the grid's change (FLIP), which keeps the most detail;
+    /// 0 takes the grid's velocity (PIC), which is the most damped. In [0, 1].
+    f32 flip_ratio;
+    u32 flip_pressure_iteration_count;
+    /// The cells per axis of the FLIP grid: a power of two, at least 8; or 0 for no grid, which disables `flip`.
+    /// The grid's buffer takes about 60 bytes per cell. Only read by `create()`.
+    u32 flip_grid_resolution;
+    /// Verlet skin, as a fraction of the particle interaction radius. The cells are padded by the skin, and
+    /// the spatial structure is only rebuilt once some particle has moved more than half the skin since the
+    /// last rebuild. 0 rebuilds every step.
+    /// Ignored if `gpu_resident`, because deciding whether to rebuild needs a round trip to the host.
+    f32 verlet_skin;
+    /// If true, the `delta_t` of `advance()` is the time to advance by, and the sim splits it into the fewest equal
+    /// substeps that keep each one within `cfl_number` times the time that the fastest particle takes to cross the
+    /// interaction radius, and the time that the largest acceleration takes to move a particle that far from rest.
+    /// The particle update reduces the max speed and acceleration as it goes, and the host reads them back once a
+    /// step has finished; so they lag a step behind (`GPU_RESIDENT_FRAMES_IN_FLIGHT` frames if `gpu_resident`).
+    /// See `SimData::time_step` for what was chosen.
+    bool adaptive_time_step;
+    f32 cfl_number; // in (0, 1]; lower is more stable
+    /// The substeps of `adaptive_time_step` are longer than `cfl_number` allows rather than more than this many.
+    u32 max_substep_count;
+    /// If true, the particle update also sums the particles' kinetic energy and momentum, and finds the largest SPH
+    /// density and the particles that have left the domain, as it writes them; each workgroup reduces its own
+    /// particles and adds them to a small buffer that the host reads back like the maxima of `adaptive_time_step`,
+    /// so the run's health is watched without another pass over the particles. See `SimData::diagnostics`.
+    bool diagnostics;
+    /// If true, a particle that has moved slower than `sleep_speed` and accelerated less than `sleep_acceleration`
+    /// for `sleep_step_count` steps in a row falls asleep, and stays put at rest, unless a particle in its cell or
+    /// in one of the 26 cells around it is awake. The particle update then only runs on the particles of those
+    /// active cells, gathered by a compaction pass and dispatched indirectly, so that the neighbor traversal
+    /// scales with the moving part of the fluid. Overrides `fuse_morton_codes_into_update`,
+    /// `tiled_particle_update` and `subgroup_particle_update`. Ignored by the CPU backend.
+    bool sleeping;
+    f32 sleep_speed; // m/s
+    f32 sleep_acceleration; // m/s^2
+    u32 sleep_step_count;
+    /// If true, `advance()` records the whole step into a single command buffer and doesn't wait for the GPU,
+    /// except to recycle the command buffer from `GPU_RESIDENT_FRAMES_IN_FLIGHT` frames ago.
+    bool gpu_resident;
+    /// If true, the Morton codes are 63 bits (21 bits per axis) instead of 30 (10 bits per axis), so that
+    /// the domain can span more than 1024 cells along each axis. This doubles the radix sort passes.
+    /// Only read by `create()`.
+    bool morton_codes_64_bit;
+    /// If true, the particles are sorted by the Hilbert code of their cell instead of its Morton code. The Hilbert
+    /// curve never jumps between distant cells, unlike the Morton curve at its octant boundaries, so the cells
+    /// around a particle are more often near it in memory. Costs a few bit operations per level of the code for
+    /// each particle's key, and a decode per cell for the hash tables, which are still keyed by the Morton code.
+    /// Disables `morton_range_traversal`, which walks the cells in Morton order. Only read by `create()`.
+    bool hilbert_cell_order;
+    /// If true, the velocities are stored as 16-bit floats, which cuts the bytes of velocity that each step reads
+    /// and writes by a third; the positions, and the arithmetic, stay 32-bit. The velocity's rounding error is
+    /// about 1/2048 of its magnitude, and an acceleration that changes it by less than that in a step is lost, so
+    /// slow, nearly settled fluid can stall. The checkpoints of `saveCheckpoint()` still hold 32-bit velocities.
+    /// Ignored by the CPU backend. Only read by `create()`.
+    bool half_velocities;
+    /// If true, each particle carries an id, which moves with it as the particles are sorted and removed; see
+    /// `getParticleIdsBuffer()`. Costs two more u32 per particle of capacity, and a u32 read and write per particle
+    /// per step. Ignored by the CPU backend. Only read by `create()`.
+    bool particle_ids;
+    /// If true, each particle has a level, and the mass of 2^level particles of the finest level (0), which weights
+    /// its share of its neighbors' sums: the density, the forces and the PBF constraints. Every
+    /// `adaptive_resolution_interval` steps, pairs of interior particles of the same level merge into one of the
+    /// next level, and the particles above the finest level near the surface or in a collider brick split into two
+    /// of the level below; so the interior carries the same mass with fewer particles, and the surface keeps its
+    /// detail. The interaction radius is the same on every level, so each level halves the interior's neighbors;
+    /// the coarse cells of `cell_level_count` then serve the sparser interior. Meant for the SPH and PBF modes,
+    /// whose rest density the merged particles keep. Costs two more u32 per particle of capacity, and uses the
+    /// plain particle update. Ignored by the CPU backend. Only read by `create()`.
+    bool adaptive_resolution;
+    /// The steps between the merges and splits of `adaptive_resolution`, each of which reads the particles back,
+    /// and uploads them again, with new ids (see `particle_ids`). 0 never adapts. Ignored for ensembles, and in
+    /// `gpu_resident` mode.
+    u32 adaptive_resolution_interval;
+    u32 adaptive_max_level; // at most `MAX_PARTICLE_LEVEL`
+    /// A particle is in the interior, and may merge, if the mass within its interaction radius, itself included,
+    /// is at least this fraction of `rest_particle_interaction_count_approx`; and near the surface, and splits, if
+    /// the mass is below `adaptive_surface_fraction`. The gap between the two keeps the particles from merging and
+    /// splitting back and forth.
+    f32 adaptive_interior_fraction;
+    f32 adaptive_surface_fraction;
+    /// If true, the particle update also computes the Morton codes and the bounds of the new positions, which
+    /// saves a pass over the positions. The domain origin is then only moved (and the codes recomputed) when
+    /// some particle leaves a guard band around it.
+    bool fuse_morton_codes_into_update;
+    /// If true, the particle update uses the cell-tiled kernel: each workgroup stages the particles in the
+    /// cells around its own particles into shared memory, instead of each invocation traversing its own 27
+    /// cells. Same results; which one is faster depends on the device and the particle distribution.
+    bool tiled_particle_update;
+    /// If true, the particle update uses the subgroup kernel: each subgroup looks up the cells around its own
+    /// particles once, and passes their particles' positions between its invocations with subgroup shuffles,
+    /// without shared memory or barriers. Ignored if the device lacks subgroup shuffles; overridden by
+    /// `tiled_particle_update`.
+    bool subgroup_particle_update;
+    /// If nonzero, the particle update runs as this many persistent workgroups (about the device's multiprocessors
+    /// times the workgroups that fit on each), which pull chunks of particles from an atomic queue until it's empty,
+    /// rather than a workgroup per chunk. A pass first ranks the chunks by the particles in their particles' cells,
+    /// heaviest first, so that the chunks in dense regions, which test the most neighbors, start first, and a slow
+    /// chunk at the end of the queue doesn't set the step time. Costs a cell lookup per particle and two small
+    /// passes per step. Same results as the plain kernel, which it otherwise is; overridden by the sleeping mode and
+    /// by `tiled_particle_update` and `subgroup_particle_update`.
+    u32 persistent_update_workgroup_count;
+    /// If true, the CPU backend's spring mode takes the particles in clusters of 8 consecutive sorted particles,
+    /// which are close together because the sort is by cell code, and evaluates the forces between each cluster and
+    /// the clusters whose bounds are within the interaction radius of its own as dense 8x8 tiles, a lane per
+    /// particle of the cluster, with the pairs out of range masked out rather than branched around. Each pair is
+    /// computed from both of its ends, but the threads need no slab ordering, and most of the work is the tiles'
+    /// arithmetic rather than the cells' lookups. Same results up to rounding. Ignored by the GPU backend, whose
+    /// subgroup kernel does the same with the subgroup's invocations; see `subgroup_particle_update`.
+    bool cluster_pair_forces;
+    /// If nonzero, the spatial structure build is followed by a pass that writes up to this many neighbor
+    /// indices per particle, and the particle update iterates over those instead of traversing the cells. In
+    /// Verlet skin mode the lists are reused until the next rebuild. Particles with more neighbors fall back to
+    /// traversing the cells; see `SimData::neighbor_list_overflow_count`. Overrides `tiled_particle_update` and
+    /// `subgroup_particle_update`.
+    /// Only read by `create()`.
+    u32 neighbor_list_capacity;
+    /// If true, the cell traversal in the particle update reads the other particles' positions as 16-bit
+    /// offsets within their cell, which halves the bytes read per tested pair. The integration still uses the
+    /// full-precision positions. Doesn't affect the neighbor lists or the cell-tiled update.
+    bool quantized_neighbor_positions;
+    /// If true, the cell traversal in the particle update walks the cells in Morton order between the corners
+    /// of the 3x3x3 block around each particle, skipping the codes outside the block, instead of looking up
+    /// each of the 27 cells in the hash table. Same pairs, summed in a different order. Doesn't affect the
+    /// neighbor lists or the cell-tiled update, and ignores `quantized_neighbor_positions`.
+    bool morton_range_traversal;
+    /// If above 1, the cell traversal in the particle update also uses coarser levels of cells, each twice the
+    /// size of the one below, up to this many levels in all (at most `MAX_CELL_LEVEL_COUNT`). Each particle
+    /// traverses the coarsest level whose cell around it holds at most `sparse_cell_particle_count` particles,
+    /// as 8 runs of particles instead of 27 cell lookups; so sparse regions use coarse cells, and dense regions
+    /// the fine ones. The coarse cells are runs of the Morton-ordered cell list, so there is nothing more to
+    /// build. Same pairs, summed in a different order. Doesn't affect the neighbor lists or the cell-tiled and
+    /// subgroup updates; ignored with `hilbert_cell_order`, and by the CPU backend.
+    u32 cell_level_count;
+    /// See `cell_level_count`. Higher values put more particles on the coarse levels, where each one tests more
+    /// particles in exchange for fewer lookups.
+    u32 sparse_cell_particle_count;
+    /// If true, a variant of the plain particle update pipeline with the interaction radius, spring constants
+    /// and cell size baked in as specialization constants is built in the background whenever they change,
+    /// and used once it's ready; until then, the update reads them from the uniform buffer. Doesn't affect
+    /// the cell-tiled update.
+    bool bake_sim_params_into_update;
+    /// If true, the cells are stored in an open-addressing hash table whose slots hold the cell's Morton code,
+    /// first particle and particle count, so that each probe is a single 16-byte read instead of a chain of
+    /// dependent reads ending in a particle position. Only read by `create()`.
+    bool open_addressing_cell_table;
+    /// If true (only with `open_addressing_cell_table`), each rebuild of the cell table checks whether the box of
+    /// the occupied cells has at most as many cells as the table has slots, and if so, puts each cell in the slot
+    /// at its index in that box instead of hashing it, so that a lookup is a single read, without probing. The
+    /// slots are proportional to the particles, so this picks the grid for the domains that are bounded and
+    /// reasonably full, and the hash for sparse ones. Costs an extra pass over the cells per rebuild. Only read
+    /// by `create()`.
+    bool dense_cell_grid;
+    /// The hash table size is the smallest power of two such that `particle_count / size` is at most this.
+    /// Lower values use more memory, but have fewer collisions. In (0, 1]; must be below 1 if
+    /// `open_addressing_cell_table`. Read by `create()`, and by the resizing of `hash_table_resize_interval`.
+    f32 hash_table_max_load_factor;
+    /// If true, `create()` picks the compute workgroup size by timing a few steps with each candidate size, and
+    /// caches the result per device name, so that later runs reuse it. Only read by `create()`.
+    bool autotune_workgroup_size;
+    /// The buffers are sized for this many particles on top of the initial ones, so that `emitParticles()`
+    /// can add them without recreating the sim. Only read by `create()`.
+    u32 extra_particle_capacity;
+    /// If true, the sim runs on the host, on the thread pool, and the GPU only gets a copy of the positions
+    /// after each step, for rendering. For devices that can't run the compute pipelines. The cells are
+    /// rebuilt every step, and the options above that only concern the GPU kernels are ignored.
+    /// Only read by `create()`.
+    bool cpu_backend;
+    /// With `cpu_backend`, in the spring mode: the GPU updates a contiguous range of the cells in the order of
+    /// their codes, from copies of them and the particles around them in mapped memory, while the pool's threads
+    /// update the rest. The split follows the measured time of each side, so that both finish together. Ignored
+    /// without `cpu_backend`, and in the SPH and PBF modes. Only read by `create()`.
+    bool hybrid_gpu_update;
+    /// If true, the GPU time of each `SimStage` is measured with timestamp queries; see `getStageGpuTimes()`.
+    /// Ignored if the device doesn't support timestamps on the compute queue, and by the CPU backend.
+    /// Only read by `create()`.
+    bool stage_timestamps;
+    /// The number of bricks of the collider's signed distance field that the buffers fit; see
+    /// `updateColliderBricks()`. 0 disables the collider. Ignored by the CPU backend. Only read by `create()`.
+    u32 collider_brick_capacity;
+    /// The edge length of the cells of the collider's signed distance field, whose corners are the samples. Only
+    /// read by `create()`.
+    f32 collider_cell_size;
+    /// The most queries in a batch of `submitSpatialQueries()`; 0 disables the spatial queries. Ignored by the CPU
+    /// backend. Only read by `create()`.
+    u32 spatial_query_capacity;
+    /// The particles that the queries of a batch can return between them; see `queryRadius()`. Only read by
+    /// `create()`.
+    u32 spatial_query_hit_capacity;
+    /// The most particles that a `readBackParticlesInRegion()` returns; 0 disables it. Ignored by the CPU
+    /// backend. Only read by `create()`.
+    u32 region_readback_capacity;
+    /// The most bricks, one per occupied cell, that an `exportVolume()` writes; the cells past it are left out of
+    /// the file. 0 disables the volume export. Ignored by the CPU backend. Only read by `create()`.
+    u32 volume_export_brick_capacity;
+    /// If positive, every this many steps the hash table is resized to fit the cells that the last rebuild found,
+    /// rather than the particles: to the smallest power of two that keeps it at most `hash_table_max_load_factor`
+    /// full. It grows as soon as it's fuller than that, but only shrinks once a quarter of it would do, so that it
+    /// doesn't flip between two sizes; and never beyond the size that `create()` allocated. Sparse scenes then
+    /// clear, scan and cache a table the size of their cells. Each resize rebuilds the spatial structure, and
+    /// wakes the sleeping particles. Ignored with `open_addressing_cell_table`, by the CPU backend, and in
+    /// `gpu_resident` mode.
+    u32 hash_table_resize_interval;
+    /// Along each axis where this is positive, the domain is periodic: a particle that leaves the box from
+    /// `periodic_box_min` to `periodic_box_min + periodic_box_size` comes back in on the other side, and the
+    /// particles interact across the boundary, with the nearest image of each other (the minimum image convention).
+    /// So a small periodic box stands in for the bulk of a much larger fluid. The box must be at least 3 cells
+    /// (`SimData::Params::cell_size`) across along each periodic axis; 0 leaves the axis open. The particle update
+    /// then uses the plain kernel and the fine cells, without `quantized_neighbor_positions` or
+    /// `morton_range_traversal`; the spatial queries and the region readback don't look across the boundary.
+    /// Ignored by the CPU backend. Only read by `create()`.
+    vec3 periodic_box_size;
+    vec3 periodic_box_min;
+};
+
+constexpr u32 GPU_RESIDENT_FRAMES_IN_FLIGHT = 2;
+
+// The most levels of `SimParameters::cell_level_count`; the coarsest cells are then 8 cells across.
+constexpr u32 MAX_CELL_LEVEL_COUNT = 4;
+
+// The coarsest level of `SimParameters::adaptive_resolution`, whose particles weigh 8 of the finest.
+constexpr u32 MAX_PARTICLE_LEVEL = 3;
+
+// The GPU backend's compute pipelines, other than the baked `updateParticles`; and the headers that their shaders
+// include. See `reloadModifiedShaderSourceFiles()`.
+constexpr u32 COMPUTE_PIPELINE_COUNT = 37;
+constexpr u32 COMPUTE_SHADER_INCLUDE_COUNT = 7;
+
+enum class [[nodiscard]] ShaderReloadResult {
+    success,
+    no_shaders_need_reloading,
+    error,
+};
+
+/// Custom physics for `setForceKernels()`, as GLSL snippets that it splices into the update kernels, so that it
+/// runs in the update's own pass over the particles. Each is the body of a function (see
+/// src/fluidSim_userForces.comp.h for their exact declarations), or NULL for none. They may read the update's
+/// buffers and uniforms, e.g. `velocities_in_` through `LOAD_VELOCITY`, and `particle_ids_in_`.
+struct ForceKernels {
+    // `vec3 userPairAcceleration(uint particle_idx, uint other_idx, vec3 disp, float dist_sq)`: the acceleration
+    // of the particle due to a neighbor `disp` away, within the interaction radius; weighted by the neighbor's
+    // mass, like the built-in forces. Not applied in the PBF mode, and runs the plain update kernel.
+    const char* pair_acceleration;
+    // `vec3 userBodyAcceleration(uint particle_idx, vec3 pos, vec3 velocity)`: an acceleration that doesn't
+    // depend on the neighbors, e.g. a field, at the start of the step.
+    const char* body_acceleration;
+    // `void userPostIntegrate(uint particle_idx, inout vec3 pos, inout vec3 velocity)`: after the integration and
+    // the collision with the collider, before the periodic box wraps the position.
+    const char* post_integrate;
+};
+
+// The collider is a signed distance field, sampled at the corners of a grid of `SimParameters::collider_cell_size`
+// cells whose origin is the world origin. It's stored sparsely, in bricks of COLLIDER_BRICK_SIZE^3 cells: only
+// where there is a surface nearby. Each brick has the samples of all of its cells' corners, so the samples on a
+// face are in both of the bricks that share it, and a trilinear sample never needs a second brick.
+constexpr u32 COLLIDER_BRICK_SIZE_LOG2 = 3;
+constexpr u32 COLLIDER_BRICK_SIZE = 1 << COLLIDER_BRICK_SIZE_LOG2;
+constexpr u32 COLLIDER_BRICK_SAMPLES_PER_AXIS = COLLIDER_BRICK_SIZE + 1;
+constexpr u32 COLLIDER_BRICK_SAMPLE_COUNT =
+    COLLIDER_BRICK_SAMPLES_PER_AXIS * COLLIDER_BRICK_SAMPLES_PER_AXIS * COLLIDER_BRICK_SAMPLES_PER_AXIS;
+
+/// See `updateColliderBricks()`.
+struct ColliderBrick {
+    /// Brick `coord` has the cells in `[COLLIDER_BRICK_SIZE * coord, COLLIDER_BRICK_SIZE * (coord + 1))`.
+    glm::ivec3 coord;
+    /// The signed distance to the surface at each sample, x fastest, then y, then z; in m, and negative inside.
+    /// Only needs to be accurate near the surface, as the particles only react to the inside.
+    f32 distances[COLLIDER_BRICK_SAMPLE_COUNT];
+};
+
+/// The parts of a step that `SimParameters::stage_timestamps` measures separately.
+enum SimStage : u32 {
+    // including the gather into sorted order and the neighbor list build
+    SIM_STAGE_PARTICLE_UPDATE,
+    SIM_STAGE_MAX_DISPLACEMENT, // only in Verlet skin mode
+    // the domain bounds and the Morton codes
+    SIM_STAGE_MORTON_CODES,
+    SIM_STAGE_SORT,
+    SIM_STAGE_CELL_LIST,
+    SIM_STAGE_HASH_TABLE,
+    SIM_STAGE_COUNT,
+};
+
+constexpr const char* SIM_STAGE_NAMES[SIM_STAGE_COUNT] {
+    "particle_update",
+    "max_displacement",
+    "morton_codes",
+    "sort",
+    "cell_list",
+    "hash_table",
+};
+
+/// See `ParticleGenerator`.
+enum ParticleGeneratorShape : u32 {
+    PARTICLE_GENERATOR_BOX, // uniformly random in the box
+    PARTICLE_GENERATOR_SPHERE, // uniformly random in the largest ball centered in the box
+    // A cubic lattice with one corner at `box_min`, filled row by row along x, then layer by layer along z.
+    // The rows and layers are as long as fits in the box; the layers continue past `box_max.z` if needed.
+    PARTICLE_GENERATOR_LATTICE,
+    // `PARTICLE_GENERATOR_LATTICE`, with each particle displaced by up to `jitter * lattice_spacing` along
+    // each axis
+    PARTICLE_GENERATOR_JITTERED_LATTICE,
+};
+
+/// An initial particle distribution that `createFromGenerator()` writes on the GPU. The random numbers are
+/// a hash of the seed and the particle index, so the same generator always gives the same particles.
+struct ParticleGenerator {
+    ParticleGeneratorShape shape;
+    vec3 box_min;
+    vec3 box_max;
+    f32 lattice_spacing; // m; lattice shapes only
+    f32 jitter; // fraction of `lattice_spacing`; `PARTICLE_GENERATOR_JITTERED_LATTICE` only
+    u32 seed;
+    /// The attribute of particle `i` (see `create()`) is interpolated byte by byte from `attribute_first`
+    /// towards `attribute_last` by `i / particle_count`, so that e.g. a packed color becomes a gradient.
+    u32 attribute_first;
+    u32 attribute_last;
+};
+
+/// One of the independent sims that `createEnsemble()` packs into a single one. Only `spring_stiffness`,
+/// `sph_stiffness` and `sph_viscosity` of `params` are the member's own; the rest shape the cells and kernels that
+/// the members share, so they are the ensemble's.
+struct EnsembleMember {
+    const SimParameters* params;
+    u32fast particle_count;
+    const vec4* p_initial_positions; // like in `create()`
+};
+
+/// What the host's writes to and reads from GPU memory are for; see `TransferStats`.
+enum TransferCategory : u32 {
+    // the particles, their ids and their ensemble members: creation, emission, removal, checkpoints, readbacks,
+    // state exports, and the CPU backend's positions after each step
+    TRANSFER_PARTICLES,
+    // the uniform buffer, the time steps and the ensemble members' parameters
+    TRANSFER_UNIFORMS,
+    // what the host reads back to drive the steps: the domain bounds, the max motion and displacement, the cell
+    // count and the overflow counts
+    TRANSFER_STEP_FEEDBACK,
+    // the spatial queries and their results, and `getSpatialStructureStats()`
+    TRANSFER_QUERIES,
+    // the voxel collider's bricks
+    TRANSFER_COLLIDER,
+    TRANSFER_CATEGORY_COUNT
+};
+constexpr const char* TRANSFER_CATEGORY_NAMES[TRANSFER_CATEGORY_COUNT] {
+    "particles", "uniforms", "step feedback", "queries", "collider",
+};
+
+/// The bytes that the host has written to or read from the sim's mapped GPU memory since it was created, and how
+/// many writes or reads they took, per `TransferCategory`; on a discrete GPU, they cross the bus (PCIe). The
+/// totals only grow, so that whoever samples them, e.g. once a frame, gets the transfers in between as the
+/// difference.
+struct TransferStats {
+    u64 upload_byte_counts[TRANSFER_CATEGORY_COUNT];
+    u64 upload_counts[TRANSFER_CATEGORY_COUNT];
+    u64 download_byte_counts[TRANSFER_CATEGORY_COUNT];
+    u64 download_counts[TRANSFER_CATEGORY_COUNT];
+};
+
+constexpr u32 SPATIAL_STATS_HISTOGRAM_BIN_COUNT = 32;
+// the particles whose neighbors `getSpatialStructureStats()` counts, evenly spaced in the sorted order
+constexpr u32 SPATIAL_STATS_NEIGHBOR_SAMPLE_COUNT = 4096;
+
+/// See `getSpatialStructureStats()`. In the histograms, bin `i` counts the values equal to `i`, and the last
+/// bin also counts the larger ones.
+struct SpatialStructureStats {
+    u32 particle_count;
+    u32 cell_count; // the occupied cells
+
+    // particles per occupied cell, i.e. `C_length`
+    u32 cell_occupancy_histogram[SPATIAL_STATS_HISTOGRAM_BIN_COUNT];
+    u32 cell_occupancy_max;
+    f32 cell_occupancy_mean;
+
+    // Buckets or slots. `SimData::hash_table_size`, or the slot count of the open-addressing cell table.
+    u32 hash_table_size;
+    bool open_addressing;
+    // If `open_addressing`, whether the cells are in a dense grid (see `SimParameters::dense_cell_grid`); then each
+    // lookup reads a single slot.
+    bool dense_grid;
+    // If `open_addressing`, the slots that a lookup of each cell probes, which is at least 1. Otherwise the
+    // cells per bucket, i.e. `H_length`, including the empty buckets in bin 0.
+    u32 hash_chain_length_histogram[SPATIAL_STATS_HISTOGRAM_BIN_COUNT];
+    u32 hash_chain_length_max;
+    // The cells or slots that a lookup of an occupied cell reads on average, which is what the chain length
+    // costs the particle update.
+    f32 hash_chain_length_mean;
+
+    u32 neighbor_sample_count;
+    // per sampled particle: the other particles in the 27 cells around its cell, and those of them within the
+    // interaction radius
+    f32 neighbor_candidate_count_mean;
+    f32 neighbor_count_mean;
+};
+
+/// See `getSpatialStructureBuffers()`. The buffers are the sim's; they're valid until it's destroyed.
+struct SpatialStructureBuffers {
+    // `cells` and `hash_buckets` (see `GpuResources`), unless `cell_slot_count > 0`; then `cell_slots` replaces
+    // them, with a header slot after the `cell_slot_count` slots; see CELL_TABLE_DENSE in `fluidSim_util.comp.h`.
+    VkBuffer cells;
+    VkBuffer hash_buckets;
+    VkBuffer cell_slots;
+    u32 hash_table_size;
+    u32 cell_slot_count;
+
+    // If `permuted`, the `i`th particle of the cell list is `positions[permutation[i]]`, where `positions` is
+    // the buffer from `getPositionsVertexBuffer()`; otherwise it's `positions[i]`, and the structure was built
+    // from `reference_positions[i]` (`vec3`s with std430 padding), which the particles have moved at most
+    // `max_displacement` away from.
+    bool permuted;
+    VkBuffer permutation;
+    VkBuffer reference_positions;
+    f32 max_displacement; // m
+
+    // `vec4`s, a min and a max per slot; slot `domain_bounds_slot`'s min is the origin of the cells.
+    VkBuffer domain_bounds;
+    u32 domain_bounds_slot;
+    f32 cell_size_reciprocal;
+
+    // The buffers are written until `timeline_semaphore` reaches `timeline_value`.
+    VkSemaphore timeline_semaphore;
+    u64 timeline_value;
+};
+
+// returned by `queryRadius()`, `queryBox()` and `queryKNearest()` if the batch is full
+constexpr u32 SPATIAL_QUERY_NONE = 0xFFFFFFFF;
+// the most particles that `queryKNearest()` finds
+constexpr u32 MAX_SPATIAL_QUERY_K = 16;
+
+/// A particle that a spatial query found; see `SpatialQueryResults`.
+struct SpatialQueryHit {
+    u32 particle_idx; // in `getPositionsVertexBuffer()`, as of the step before the batch was submitted
+    u32 particle_id; // see `getParticleIdsBuffer()`; 0 without `SimParameters::particle_ids`
+    f32 distance; // m, from the center of a radius or k-nearest query; 0 for a box query
+};
+
+/// What a spatial query found: its hits are `p_hits[first_hit]` to `p_hits[first_hit + hit_count - 1]`.
+struct SpatialQueryResult {
+    u32 first_hit;
+    u32 hit_count;
+    /// Every particle that matched; more than `hit_count` if the query's `max_result_count` ran out. For
+    /// `queryKNearest()`, those within `max_distance`, of which the hits are the `k` nearest, nearest first.
+    u32 match_count;
+};
+
+/// See `getSpatialQueryResults()`. Points into the sim's host-visible buffers, so it's only valid until the next
+/// `submitSpatialQueries()`.
+struct SpatialQueryResults {
+    u32 query_count;
+    const SpatialQueryResult* p_results; // per query, by the index that its `query*()` call returned
+    const SpatialQueryHit* p_hits;
+};
+
+// the particle fields that `readBackParticlesInRegion()` returns
+enum ParticleField : u32 {
+    PARTICLE_FIELD_POSITIONS = 1 << 0,
+    PARTICLE_FIELD_VELOCITIES = 1 << 1,
+    PARTICLE_FIELD_IDS = 1 << 2,
+};
+
+// the most planes of a region of `readBackParticlesInRegion()`
+constexpr u32 MAX_REGION_PLANE_COUNT = 6;
+
+/// See `readBackParticlesInRegion()`. Points into the sim's host-visible readback buffer, so it's only valid
+/// until the next readback. The arrays of the fields that weren't requested are NULL.
+struct ParticleReadback {
+    u32 particle_count; // in the arrays; at most `SimParameters::region_readback_capacity`
+    u32 match_count; // every particle in the region
+    const vec4* p_positions; // w is the particle's attribute, see `create()`
+    const vec3* p_velocities; // m/s
+    const u32* p_ids; // see `getParticleIdsBuffer()`; 0 without `SimParameters::particle_ids`
+};
+
+// The shared memory of `startStateExport()`, for other processes to map: a `StateExportHeader`, then
+// `slot_count` slots of `slot_size` bytes, each a `StateExportSlot` and then the particle arrays, at the offsets
+// in the header. Each published state goes to the next slot, so a reader can read the latest while the one after
+// is written. To read the latest state without locking the writer out (a seqlock): load `published_count` `n`
+// (acquire), and from slot `(n - 1) % slot_count`, `sequence` (acquire), which is `2 * n` if the slot still
+// holds that state; copy out what's needed, then issue an acquire fence and load `sequence` again. If it's
+// unchanged, the copy is consistent; otherwise start over. Zeroed until the first state is published.
+constexpr char STATE_EXPORT_MAGIC[8] = { 'F', 'L', 'S', 'I', 'M', 'S', 'H', 'M' };
+// Bump when the layout of the shared memory changes.
+constexpr u32 STATE_EXPORT_VERSION = 1;
+
+struct alignas(64) StateExportHeader {
+    char magic[8]; // STATE_EXPORT_MAGIC
+    u32 version; // STATE_EXPORT_VERSION
+    u32 slot_count;
+    u64 slot_size; // bytes; slot `i` is at `sizeof(StateExportHeader) + i * slot_size`
+    u32 particle_capacity; // of the arrays
+    // If nonzero, the velocities are packed as halves; see the particle layout in fluidSim_util.comp.h.
+    u32 half_velocities;
+    // Of the arrays, from the start of a slot: `particle_capacity` positions like `getPositionsVertexBuffer()`,
+    // the velocity arrays like in fluidSim_util.comp.h, and the particle ids; `ids_offset` is 0 without
+    // `SimParameters::particle_ids`.
+    u64 positions_offset;
+    u64 velocities_offset;
+    u64 ids_offset;
+    u64 published_count; // written last; the number of states published so far
+};
+
+// The files of `startVolumeExport()`, one per exported state, for downstream renderers that want volumes rather
+// than points: a `VolumeFileHeader`, then `brick_count` `VolumeBrick`s, in the order of the sim's cell list.
+// A brick is an occupied cell of the sim's spatial structure, sampled at the centers of
+// VOLUME_BRICK_RESOLUTION^3 voxels; the density is 0 outside of the bricks. Everything is little-endian.
+constexpr char VOLUME_FILE_MAGIC[8] = { 'F', 'L', 'S', 'I', 'M', 'V', 'O', 'L' };
+// Bump when the layout of the file changes.
+constexpr u32 VOLUME_FILE_VERSION = 1;
+// Must match VOLUME_BRICK_RESOLUTION in `fluidSim_exportVolume.comp`.
+constexpr u32 VOLUME_BRICK_RESOLUTION = 4;
+constexpr u32 VOLUME_BRICK_SAMPLE_COUNT =
+    VOLUME_BRICK_RESOLUTION * VOLUME_BRICK_RESOLUTION * VOLUME_BRICK_RESOLUTION;
+
+struct VolumeFileHeader {
+    char magic[8]; // VOLUME_FILE_MAGIC
+    u32 version; // VOLUME_FILE_VERSION
+    u32 brick_resolution; // VOLUME_BRICK_RESOLUTION
+    u64 brick_count;
+    // Occupied cells past `SimParameters::volume_export_brick_capacity`, which aren't in the file; their density
+    // is missing, not 0.
+    u64 dropped_brick_count;
+    f32 brick_size; // m, the sim's cell size; a voxel is `brick_size / brick_resolution` across
+    u32 padding;
+};
+static_assert(sizeof(VolumeFileHeader) == 40);
+
+/// Must match VOLUME_BRICK_WORD_COUNT in `fluidSim_exportVolume.comp`.
+struct VolumeBrick {
+    alignas(16) vec3 min; // m, the brick's corner with the least coordinates
+    alignas(4) f32 max_density; // of its samples, so that a reader can skip the empty ones
+    // Particles / m^3, as `SimParameters::sph` computes it, but at the voxel's center; x varies fastest, then y.
+    alignas(4) f32 densities[VOLUME_BRICK_SAMPLE_COUNT];
+};
+static_assert(sizeof(VolumeBrick) == 16 + VOLUME_BRICK_SAMPLE_COUNT * sizeof(f32));
+
+struct VolumeExportStats {
+    u64 exported_count; // states whose bricks the GPU has computed, including those not yet written
+    u64 written_count; // files
+    u64 skipped_count; // `exportVolume()`s that found both slots busy
+    u64 written_byte_count;
+};
+
+struct alignas(64) StateExportSlot {
+    u64 sequence; // `2 * n - 1` while the `n`th state is written to the slot, and `2 * n` once it's complete
+    u32 particle_count; // the first this many particles of the arrays are alive
+};
+
+/// See `getMemoryUsage()`.
+struct SimMemoryUsage {
+    u64 host_bytes;
+    u64 gpu_bytes; // of `VkBuffer`s, whether in device-local or host-visible memory
+    // What the transient buffers would add to `gpu_bytes` if they had memory of their own, rather than sharing
+    // that of buffers whose lifetimes within a step don't overlap with theirs; see `createBuffers()`.
+    u64 gpu_bytes_aliased;
 };
 
 struct GpuBuffer {
@@ -28,97 +623,677 @@ struct GpuBuffer {
     VmaAllocationInfo allocation_info;
 };
 
+/// The most chunks of a `ChunkedGpuBuffer`. Each is a descriptor of its own, in the same binding. Must match
+/// `fluidSim_updateParticles.comp.h`.
+constexpr u32 MAX_BUFFER_CHUNK_COUNT = 8;
+
+/// A particle array that is too large for a single storage buffer binding, split into chunks of
+/// `1 << GpuResources::particle_chunk_shift` particles each, one `VkBuffer` per chunk. Bound as an array of
+/// `MAX_BUFFER_CHUNK_COUNT` descriptors, the ones past `chunk_count` repeating the last chunk; the shaders find
+/// particle `i` in chunk `i >> shift`, at `i & ((1 << shift) - 1)`.
+struct ChunkedGpuBuffer {
+    u32 chunk_count; // at least 1
+    GpuBuffer chunks[MAX_BUFFER_CHUNK_COUNT];
+};
+
+/// `SimParameters::periodic_box_size`, as the compute pipelines have it. Must match the `PERIODIC_*`
+/// specialization constants in `fluidSim_util.comp.h`.
+struct PeriodicBox {
+    u32 axes; // 1 for x, 2 for y, 4 for z; 0 for an open domain
+    vec3 min;
+    vec3 size; // 0 along the open axes
+};
+
+/// The sim parameters that `GpuResources::pipeline_updateParticles_baked` has as specialization constants.
+struct BakedSimParams {
+    f32 particle_interaction_radius;
+    f32 spring_rest_length;
+    f32 spring_stiffness;
+    f32 cell_size_reciprocal;
+};
+
+/// A build of `GpuResources::pipeline_updateParticles_baked` on the thread pool.
+struct BakedPipelineBuild {
+    // inputs
+    const VulkanContext* vk_ctx;
+    VkDescriptorSetLayout descriptor_set_layout;
+    u32 workgroup_size;
+    u32 morton_code_word_count;
+    u32 open_addressing_cell_table;
+    u32 dense_cell_grid;
+    u32 hilbert_cell_order;
+    PeriodicBox periodic_box;
+    u32 particle_chunk_shift;
+    BakedSimParams params;
+    // `GpuResources::updateParticles_reloaded_spirv`; NULL for the built SPIR-V file
+    const u32* p_spirv;
+    size_t spirv_byte_count;
+
+    // outputs, valid once `finished`
+    VkPipeline pipeline;
+    VkPipelineLayout pipeline_layout;
+
+    bool in_progress;
+    bool finished; // accessed atomically
+    thread_pool::TaskId task_id;
+};
+
+/// A query of the batch that `submitSpatialQueries()` submits. Must match `SpatialQuery` in
+/// `fluidSim_spatialQuery.comp`.
+struct SpatialQuery {
+    alignas(16) vec3 center; // or the box's min
+    alignas(4) f32 radius; // or the k-nearest query's `max_distance`; unused by a box query
+    alignas(16) vec3 box_max;
+    alignas(4) u32 type; // SpatialQueryType
+    alignas(4) u32 first_hit;
+    alignas(4) u32 max_hit_count; // or `k`
+};
+
+/// What a GPU-resident command buffer was recorded for, to tell whether it can be resubmitted as it is. The rest of
+/// what it depends on is either read from buffers when it executes (the time step; see `writeDeltaT()`), or
+/// discards every recording when it changes (see `discardGpuResidentRecordings()`).
+struct GpuResidentRecording {
+    bool valid;
+    u32 substep_count;
+    bool spatial_structure_rebuilt_last_step; // before the first substep
+};
+
+// The state of `startVolumeExport()`; see fluid_sim.cpp.
+struct VolumeExport;
+
 struct GpuResources {
 
     u32 workgroup_size;
     u32 workgroup_count;
+    u32 radix_sort_tile_count;
+    u32 morton_code_word_count; // 1 or 2
+    bool hilbert_cell_order; // `SimParameters::hilbert_cell_order`
+    PeriodicBox periodic_box;
+    u32 radix_sort_pass_count;
+    u32 neighbor_list_capacity; // 0 if the neighbor lists are disabled
+    // The particles per chunk of the `ChunkedGpuBuffer`s, as a power of two: the most whose neighbor lists fit in
+    // `maxStorageBufferRange`. 0 if one chunk holds them all.
+    u32 particle_chunk_shift;
+    u32 cell_slot_count; // 0 if the open-addressing cell table is disabled; not counting the header slot
+    bool dense_cell_grid; // `SimParameters::dense_cell_grid`, if `cell_slot_count > 0`
+    u32 flip_grid_resolution; // `SimParameters::flip_grid_resolution`
+
+    // See `updateColliderBricks()`. `collider_slots` is the host's copy of `buffer_collider_slots`, which is
+    // uploaded whole after each change; `collider_free_bricks` is a stack of the bricks of
+    // `buffer_collider_distances` that no slot refers to.
+    u32 collider_brick_capacity; // 0 if the collider is disabled
+    u32 collider_brick_count;
+    u32 collider_slot_count; // a power of two, more than twice the brick capacity; 0 if the collider is disabled
+    f32 collider_cell_size;
+    glm::ivec4* collider_slots; // brick coordinate, brick index; see COLLIDER_SLOT_EMPTY
+    u32* collider_free_bricks;
+
+    u64 buffer_memory_size; // of all of the buffers below, for `getMemoryUsage()`
+    u64 aliased_buffer_memory_size; // of those that have no memory of their own; not in `buffer_memory_size`
 
 
     VkCommandPool command_pool;
     VkCommandBuffer general_purpose_command_buffer;
     VkCommandBuffer morton_code_command_buffer;
+    VkCommandBuffer spatial_query_command_buffer;
+    VkCommandBuffer state_export_command_buffer;
+    // For `VulkanContext::transfer_queue`, whose family may differ; see `copyStagedParticles()`.
+    VkCommandPool transfer_command_pool;
+    VkCommandBuffer transfer_command_buffer;
+
+    u32 gpu_resident_frame_idx;
+    VkCommandBuffer gpu_resident_command_buffers[GPU_RESIDENT_FRAMES_IN_FLIGHT];
+    // The `timeline_semaphore` value signalled by each command buffer's last submission; 0 if never submitted.
+    u64 gpu_resident_timeline_values[GPU_RESIDENT_FRAMES_IN_FLIGHT];
+    GpuResidentRecording gpu_resident_recordings[GPU_RESIDENT_FRAMES_IN_FLIGHT];
+
+    // `SimParameters::stage_timestamps`; VK_NULL_HANDLE if disabled. A begin and an end timestamp per stage,
+    // for each domain bounds slot (see `recordBoundsReductionCommands`), since the GPU-resident frames in
+    // flight each write their own slot.
+    VkQueryPool stage_query_pool;
+    // the slot written by the last step submitted, or STAGE_TIMESTAMP_SLOT_NONE; only set if the pool exists
+    u32 stage_query_last_slot;
+    // the domain bounds slot that the spatial structure was last built with
+    u32 spatial_structure_bounds_slot;
 
 
     VkDescriptorPool descriptor_pool;
 
     VkDescriptorSetLayout descriptor_set_layout_main;
     VkDescriptorSet descriptor_set_main;
+    // `descriptor_set_main` with each pair of sorted and unsorted particle buffers swapped; used while
+    // `particle_buffers_swapped`, see there.
+    VkDescriptorSet descriptor_set_main_swapped;
 
     VkDescriptorSetLayout descriptor_set_layout_reduction;
-    VkDescriptorSet descriptor_set_reduction__positions_to_reduction1;
-    VkDescriptorSet descriptor_set_reduction__reduction1_to_reduction2;
-    VkDescriptorSet descriptor_set_reduction__reduction2_to_reduction1;
+    VkDescriptorSet descriptor_set_reduction;
+
+    // The radix sort's and the scan's buffers change between their passes and uses. If `push_descriptors`, they're
+    // pushed before each (see `recordRadixSortDescriptors()` and `recordScanDescriptors()`), and these sets are
+    // VK_NULL_HANDLE; otherwise there's a set for each combination.
+    bool push_descriptors;
+
+    VkDescriptorSetLayout descriptor_set_layout_radix_sort;
+    VkDescriptorSet descriptor_set_radix_sort__primary_to_scratch;
+    VkDescriptorSet descriptor_set_radix_sort__scratch_to_primary;
+
+    VkDescriptorSetLayout descriptor_set_layout_scan;
+    VkDescriptorSet descriptor_set_scan__cell_starts;
+    VkDescriptorSet descriptor_set_scan__hash_table;
 
 
     VkPipeline pipeline_updateParticles;
     VkPipelineLayout pipeline_layout_updateParticles;
 
-    VkPipeline pipeline_computeMin;
-    VkPipelineLayout pipeline_layout_computeMin;
+    // `updateParticles` with `updateParticles_baked_params` baked in. VK_NULL_HANDLE until the first
+    // background build finishes.
+    VkPipeline pipeline_updateParticles_baked;
+    VkPipelineLayout pipeline_layout_updateParticles_baked;
+    BakedSimParams updateParticles_baked_params;
+    BakedPipelineBuild baked_pipeline_build;
+    // The SPIR-V of fluidSim_updateParticles.comp, once `reloadModifiedShaderSourceFiles()` has reloaded it, for
+    // the baked builds; NULL until then.
+    u32* updateParticles_reloaded_spirv;
+    size_t updateParticles_reloaded_spirv_byte_count;
+    // `setForceKernels()`: what the compute shaders were built with in place of src/fluidSim_userForces.comp.h,
+    // which the reloads keep using; NULL for the file itself. `user_pair_acceleration` if it has the pair force,
+    // which only the plain update kernel applies.
+    char* user_forces_src;
+    bool user_pair_acceleration;
+
+    VkPipeline pipeline_updateParticlesTiled;
+    VkPipelineLayout pipeline_layout_updateParticlesTiled;
+
+    // VK_NULL_HANDLE unless `subgroup_particle_update_supported`.
+    bool subgroup_particle_update_supported; // see `deviceSupportsSubgroupParticleUpdate()`
+    VkPipeline pipeline_updateParticlesSubgroup;
+    VkPipelineLayout pipeline_layout_updateParticlesSubgroup;
+
+    VkPipeline pipeline_updateParticlesPersistent;
+    VkPipelineLayout pipeline_layout_updateParticlesPersistent;
+
+    VkPipeline pipeline_buildNeighborLists;
+    VkPipelineLayout pipeline_layout_buildNeighborLists;
+    VkPipeline pipeline_computeDensities;
+    VkPipelineLayout pipeline_layout_computeDensities;
+    VkPipeline pipeline_solveDensityConstraints;
+    VkPipelineLayout pipeline_layout_solveDensityConstraints;
+    VkPipeline pipeline_flip_transferToGrid;
+    VkPipelineLayout pipeline_layout_flip_transferToGrid;
+    VkPipeline pipeline_flip_solvePressure;
+    VkPipelineLayout pipeline_layout_flip_solvePressure;
+
+    VkPipeline pipeline_sleep_markActiveCells;
+    VkPipelineLayout pipeline_layout_sleep_markActiveCells;
+    VkPipeline pipeline_sleep_compactParticles;
+    VkPipelineLayout pipeline_layout_sleep_compactParticles;
+
+    VkPipeline pipeline_computeBounds;
+    VkPipelineLayout pipeline_layout_computeBounds;
+
+    VkPipeline pipeline_updateDomainOrigin;
+    VkPipelineLayout pipeline_layout_updateDomainOrigin;
 
     VkPipeline pipeline_computeMortonCodes;
     VkPipelineLayout pipeline_layout_computeMortonCodes;
 
+    VkPipeline pipeline_computeMaxDisplacement;
+    VkPipelineLayout pipeline_layout_computeMaxDisplacement;
+
+    VkPipeline pipeline_removeParticles;
+    VkPipelineLayout pipeline_layout_removeParticles;
+    VkPipeline pipeline_spatialQuery;
+    VkPipelineLayout pipeline_layout_spatialQuery;
+    VkPipeline pipeline_regionReadback_mark;
+    VkPipelineLayout pipeline_layout_regionReadback_mark;
+    VkPipeline pipeline_regionReadback_scatter;
+    VkPipelineLayout pipeline_layout_regionReadback_scatter;
+    VkPipeline pipeline_exportVolume;
+    VkPipelineLayout pipeline_layout_exportVolume;
+    VkPipeline pipeline_generateParticles;
+    VkPipelineLayout pipeline_layout_generateParticles;
+
     VkPipeline pipeline_sortParticles;
     VkPipelineLayout pipeline_layout_sortParticles;
 
+    VkPipeline pipeline_radixSort_countDescents;
+    VkPipelineLayout pipeline_layout_radixSort_countDescents;
+
+    VkPipeline pipeline_radixSort_prepareDispatch;
+    VkPipelineLayout pipeline_layout_radixSort_prepareDispatch;
+
+    VkPipeline pipeline_radixSort_writeIdentity;
+    VkPipelineLayout pipeline_layout_radixSort_writeIdentity;
+
+    VkPipeline pipeline_radixSort_histogram;
+    VkPipelineLayout pipeline_layout_radixSort_histogram;
+
+    VkPipeline pipeline_radixSort_scan;
+    VkPipelineLayout pipeline_layout_radixSort_scan;
+
+    VkPipeline pipeline_radixSort_scatter;
+    VkPipelineLayout pipeline_layout_radixSort_scatter;
+
+    VkPipeline pipeline_cellList_markCellStarts;
+    VkPipelineLayout pipeline_layout_cellList_markCellStarts;
+
+    VkPipeline pipeline_scan_blocks;
+    VkPipelineLayout pipeline_layout_scan_blocks;
+
+    VkPipeline pipeline_scan_blockSums;
+    VkPipelineLayout pipeline_layout_scan_blockSums;
+
+    VkPipeline pipeline_scan_addBlockOffsets;
+    VkPipelineLayout pipeline_layout_scan_addBlockOffsets;
+
+    VkPipeline pipeline_cellList_scatter;
+    VkPipelineLayout pipeline_layout_cellList_scatter;
+
+    VkPipeline pipeline_cellList_computeLengths;
+    VkPipelineLayout pipeline_layout_cellList_computeLengths;
+
+    VkPipeline pipeline_hashTable_countCells;
+    VkPipelineLayout pipeline_layout_hashTable_countCells;
+
+    VkPipeline pipeline_hashTable_scatterCells;
+    VkPipelineLayout pipeline_layout_hashTable_scatterCells;
+
+    VkPipeline pipeline_hashTable_insertCells;
+    VkPipelineLayout pipeline_layout_hashTable_insertCells;
+
+    // `setShaderSourceFileModificationTracking()`; NULL if disabled. The ids of the pipelines' shaders, in the
+    // order of `getComputePipelineInfos()`, and of the headers, a change to which reloads every pipeline.
+    // INVALID_FILE_ID for those whose source file isn't there.
+    filewatch::Watchlist shader_watchlist;
+    filewatch::FileID shader_watch_ids[COMPUTE_PIPELINE_COUNT];
+    filewatch::FileID shader_include_watch_ids[COMPUTE_SHADER_INCLUDE_COUNT];
 
-    VkSemaphore particle_update_finished_semaphore;
+
+    // Every submission that later submissions or the host wait for signals the next value, so that reaching
+    // a value means that everything submitted up to it is done (there is only one queue). `timeline_value` is
+    // the last value submitted.
+    VkSemaphore timeline_semaphore;
+    u64 timeline_value;
+    // Only for one-off submissions that the host waits for immediately.
     VkFence fence;
 
 
     GpuBuffer buffer_uniforms;
 
+    // Positions are `vec4[particle_capacity]`: xyz is the position, and w is the per-particle attribute passed
+    // to `create()`, which moves along with the particle. Velocities are `f32[3 * particle_capacity]`, all x
+    // components first, then all y, then all z; or, if `half_velocities`, `u32[2 * particle_capacity]`, the x and
+    // y components packed into the first array, and the z component into the second. Only the first
+    // `particle_count` particles are alive. See "Particle layout" in `fluidSim_util.comp.h`.
+    bool half_velocities; // `SimParameters::half_velocities`
     GpuBuffer buffer_positions_sorted;
     GpuBuffer buffer_velocities_sorted;
     GpuBuffer buffer_positions_unsorted;
     GpuBuffer buffer_velocities_unsorted;
+    // A step that reuses the spatial structure (in Verlet skin mode) doesn't reorder the particles, so rather
+    // than having `sortParticles` copy them from the unsorted buffers to the sorted ones, it runs under
+    // `descriptor_set_main_swapped`, and updates them from where the previous step wrote them. While this is set,
+    // the particles of the last step are in the sorted buffers, except for the positions, which are also copied
+    // to `buffer_positions_unsorted` for the renderer; see `unswapParticleBuffers()`. Never set in GPU-resident
+    // mode, whose steps always rebuild the spatial structure.
+    bool particle_buffers_swapped;
+    // The positions that the spatial structure was last built from, in the same order as the sorted buffers.
+    // Only maintained in Verlet skin mode.
+    GpuBuffer buffer_positions_reference;
+    GpuBuffer buffer_max_displacement;
+    // 16-bit fixed-point positions relative to each particle's cell, in the same order as the sorted buffers.
+    // Only written if `quantized_neighbor_positions`.
+    GpuBuffer buffer_positions_quantized;
 
-    GpuBuffer buffer_C_begin;
-    GpuBuffer buffer_C_length;
+    // From the paper "Multi-Level Memory Structures for Simulating and
+    // Rendering Smoothed Particle Hydrodynamics" by Winchenbach and Kolb.
+    // The cells are in hash order, as `uvec2`s of (first particle, particle count); the buckets are `uvec2`s of
+    // (first cell, cell count), so that each probe of a lookup is one 8-byte load.
+    GpuBuffer buffer_cells;
+    GpuBuffer buffer_hash_buckets;
+    // The counting sort's per-hash cell counts and their exclusive prefix sum; see `recordHashTableCommands()`.
     GpuBuffer buffer_H_begin;
     GpuBuffer buffer_H_length;
+    // Replaces `buffer_cells` and `buffer_hash_buckets` if `cell_slot_count > 0`. See CELL_SLOT_EMPTY in
+    // `fluidSim_util.comp.h`.
+    GpuBuffer buffer_cell_slots;
+
+    GpuBuffer buffer_C_begin_morton_order;
+    GpuBuffer buffer_C_length_morton_order;
+    GpuBuffer buffer_cell_codes_morton_order;
+    GpuBuffer buffer_cell_hash_ranks;
+
+    GpuBuffer buffer_cell_count;
+    // The cell of each particle, in the cell list; from the rebuild that writes it to the next particle update.
+    // In the memory of `buffer_radix_sort_keys_scratch`, which is only live during the sort, in between.
+    GpuBuffer buffer_cell_starts_scan;
+    GpuBuffer buffer_scan_block_sums;
+
+    // (min, max) of the positions that the spatial structure was built from, read back to check that the
+    // domain fits in the Morton codes
+    GpuBuffer buffer_domain_bounds;
+    // the time step of each domain bounds slot's steps; see `writeDeltaT()`
+    GpuBuffer buffer_delta_ts;
+    // the max speed and acceleration of each domain bounds slot's steps; see `readAndClearMaxMotion()`
+    GpuBuffer buffer_max_motion;
+    // `SimParameters::diagnostics`, per domain bounds slot like `buffer_max_motion`; see `readAndClearDiagnostics()`
+    GpuBuffer buffer_diagnostics;
+    // one (min, max) per workgroup, written by the bounds reduction or by the fused particle update
+    GpuBuffer buffer_reduction_partials;
+    GpuBuffer buffer_reduction_state;
+
+    // `neighbor_list_capacity` indices per particle, in the same order as the sorted buffers. Chunked, because at
+    // `neighbor_list_capacity` words per particle it's the largest particle array, by far.
+    ChunkedGpuBuffer buffer_neighbor_lists;
+    GpuBuffer buffer_neighbor_counts;
+    GpuBuffer buffer_neighbor_list_overflow;
+
+    // The SPH density of each particle, in the same order as the sorted buffers; see `SimParameters::sph`. Only
+    // live during the particle update, so it's in the memory of `buffer_radix_sort_values_scratch`.
+    GpuBuffer buffer_densities;
+    // See `SimParameters::pbf`. Two halves of `particle_capacity` predicted positions, in the same order as the
+    // sorted buffers, which the constraint iterations alternate between. Live across the passes of the particle
+    // update, which already uses the sort's scratch for the constraint multipliers, in `buffer_densities`.
+    GpuBuffer buffer_pbf_positions;
+    // See `SimParameters::flip`: the grid's velocities and the pressure solve's arrays; see `fluidSim_flip.comp.h`.
+    // A single float if there is no grid.
+    GpuBuffer buffer_flip_grid;
+    // See `SimParameters::persistent_update_workgroup_count`: the queue and the ranking of the chunks of particles;
+    // see `fluidSim_updateParticlesPersistent.comp`.
+    GpuBuffer buffer_persistent_update;
+
+    // See `SimParameters::sleeping`. The calm steps of each particle, in the same order as the sorted and the
+    // unsorted buffers; and per cell of the Morton-ordered cell list, whether it's awake and whether it's active.
+    GpuBuffer buffer_calm_steps_sorted;
+    GpuBuffer buffer_calm_steps_unsorted;
+    GpuBuffer buffer_cell_awake;
+    GpuBuffer buffer_cell_active;
+    // the particles that the update runs on, and their count and dispatch
+    GpuBuffer buffer_active_particles;
+    GpuBuffer buffer_sleep_state;
+
+    // See `createEnsemble()`. 0 members unless the sim is an ensemble; then, the member of each particle, in the same
+    // order as the sorted and the unsorted buffers, and each member's own parameters.
+    u32 ensemble_member_count;
+    // per member, what was added to its initial positions to place it in the ensemble
+    vec3* ensemble_member_offsets;
+    GpuBuffer buffer_member_ids_sorted;
+    GpuBuffer buffer_member_ids_unsorted;
+    GpuBuffer buffer_ensemble_members;
 
-    GpuBuffer buffer_reduction_1;
-    GpuBuffer buffer_reduction_2;
+    // See `SimParameters::particle_ids`. The id of each particle, in the same order as the sorted and the unsorted
+    // buffers, which hold the same ids after each step; placeholders unless `particle_ids`.
+    bool particle_ids;
+    u32 next_particle_id; // of the next particle emitted
+    GpuBuffer buffer_particle_ids_sorted;
+    GpuBuffer buffer_particle_ids_unsorted;
 
-    GpuBuffer buffer_morton_codes_or_permutation;
+    // See `SimParameters::adaptive_resolution`. The level of each particle, in the same order as the sorted and
+    // the unsorted buffers, which hold the same levels after each step, like the ids; placeholders unless
+    // `particle_levels`.
+    bool particle_levels;
+    GpuBuffer buffer_particle_levels_sorted;
+    GpuBuffer buffer_particle_levels_unsorted;
+
+    // the number of particles that `removeParticles()` found in the box
+    GpuBuffer buffer_removed_particle_count;
+
+    // See `queryRadius()`. The host fills `spatial_queries`, which is the next batch, and `submitSpatialQueries()`
+    // copies them to `buffer_spatial_queries`; the submitted batch's results are ready once `timeline_semaphore`
+    // reaches `spatial_query_timeline_value` (0 if none was submitted). The buffers are host-visible, and are
+    // placeholders if `spatial_query_capacity` is 0.
+    u32 spatial_query_capacity; // per batch
+    u32 spatial_query_hit_capacity; // per batch, shared by its queries
+    SpatialQuery* spatial_queries;
+    u32 spatial_query_count; // of the next batch
+    u32 spatial_query_hit_count; // reserved by the next batch's queries
+    u32 submitted_spatial_query_count;
+    u64 spatial_query_timeline_value;
+    GpuBuffer buffer_spatial_queries;
+    GpuBuffer buffer_spatial_query_results;
+    GpuBuffer buffer_spatial_query_hits;
+
+    // See `readBackParticlesInRegion()`. Host-visible, and a placeholder if `region_readback_capacity` is 0: the
+    // particle count, padded to 16 bytes, then the arrays of `region_readback_capacity` positions, velocities
+    // and ids. If it isn't 0, the readback's exclusive scan of which particles are inside, in place in
+    // `buffer_radix_sort_values_scratch`, is `region_offsets_scan`'s, over `gpu_primitives`.
+    u32 region_readback_capacity;
+    GpuBuffer buffer_region_readback;
+    gpu_primitives::Context* gpu_primitives;
+    gpu_primitives::Plan* region_offsets_scan;
+
+    // See `startStateExport()`. `state_export` is the mapped shared memory, or NULL if the state isn't exported.
+    // `exportState()` copies the particles to the staging buffer, and publishes them once `timeline_semaphore`
+    // reaches `state_export_timeline_value` (0 if no copy is pending).
+    StateExportHeader* state_export;
+    size_t state_export_size;
+    char* state_export_name; // of the shared memory object
+    u64 state_export_timeline_value;
+    u32 state_export_particle_count; // of the pending copy
+    GpuBuffer buffer_state_export_staging;
+
+    // See `startVolumeExport()`: NULL if the density isn't exported. `buffer_volume_export` is host-visible:
+    // VOLUME_EXPORT_SLOT_COUNT slots, each the cell count, padded to 16 bytes, then `volume_export_brick_capacity`
+    // `VolumeBrick`s.
+    u32 volume_export_brick_capacity;
+    VolumeExport* volume_export;
+    GpuBuffer buffer_volume_export;
+
+    // `collider_slot_count` slots, and `collider_brick_capacity` times COLLIDER_BRICK_SAMPLE_COUNT distances
+    GpuBuffer buffer_collider_slots;
+    GpuBuffer buffer_collider_distances;
+
+    GpuBuffer buffer_morton_codes;
+    GpuBuffer buffer_permutation;
+
+    GpuBuffer buffer_radix_sort_keys_scratch;
+    GpuBuffer buffer_radix_sort_values_scratch;
+    GpuBuffer buffer_radix_sort_histograms;
+    GpuBuffer buffer_radix_sort_state;
 };
 
-struct SimData {
-    u32fast particle_count;
 
-    u32* p_cells_scratch_buffer1;
-    u32* p_cells_scratch_buffer2;
+/// The state of the `SimParameters::cpu_backend` mode. The particle arrays have `SimData::particle_capacity`
+/// elements, and are structures of arrays, so that the loops over them vectorize. All of the arrays are in
+/// `host_slab`, each aligned to a cache line.
+struct CpuState {
 
-    KeyVal* p_scratch_keyval_buffer_1;
-    KeyVal* p_scratch_keyval_buffer_2;
+    u8* host_slab; // mapped, in huge pages if possible
+    size_t host_slab_size;
 
-    // From the paper "Multi-Level Memory Structures for Simulating and
-    // Rendering Smoothed Particle Hydrodynamics" by Winchenbach and Kolb.
-    u32fast cell_count;
-    u32* C_begin;
-    u32* C_length;
+    // The particles, in the order in which the last step wrote them. `attributes` are the w components of
+    // the positions.
+    f32* positions[3];
+    f32* velocities[3];
+    f32* attributes;
+    // the same particles, sorted by cell
+    f32* positions_sorted[3];
+    f32* velocities_sorted[3];
+    f32* attributes_sorted;
+    // by sorted particle; only written in the SPH mode, and in the PBF mode, as the constraint multipliers
+    f32* densities;
+    // By sorted particle, the acceleration due to the springs, accumulated a pair at a time; see
+    // `cpuPass_accumulateSpringForces()`. Not written in the SPH or PBF modes.
+    f32* accelerations[3];
+    // by sorted particle, the two halves of `GpuResources::buffer_pbf_positions`; only written in the PBF mode
+    f32* pbf_positions[2][3];
+
+    // (cell code, particle index), sorted by the code: the cell's Morton code, or its Hilbert code if
+    // `hilbert_cell_order`
+    KeyVal* cell_keys;
+    KeyVal* cell_keys_scratch;
+    SortContext* sort_context; // for `task_count` threads
+    vec3 domain_min;
+    bool hilbert_cell_order; // `SimParameters::hilbert_cell_order`
+
+    // The cells in the order of their codes. `cell_first_particles` index the sorted particles.
+    u32 cell_count;
+    u32* cell_codes;
+    u32* cell_first_particles;
+    u32* cell_particle_counts;
+    // per chunk of CPU_PARTICLE_GRAIN sorted particles, and one more, the index of the first cell that starts in it;
+    // see `cpuBuildCells()`
+    u32* chunk_first_cells;
+    // Open-addressing table from cell code to cell index, resolved by linear probing; see CPU_CELL_TABLE_EMPTY.
+    u32 cell_table_size; // power of two, more than twice the capacity
+    u32* cell_table;
+    u32* cell_slots; // per cell, its slot in `cell_table`
+    // In the SPH mode, the density pass looks up the cells around each cell, and the update reuses them; in the
+    // PBF mode, the first multiplier pass, and the passes after it:
+    // CPU_NEIGHBOR_CELL_COUNT per cell, of which the first `cell_neighbor_cell_counts[cell]` exist.
+    u32* cell_neighbor_cells;
+    u32* cell_neighbor_cell_counts;
+    // The cells by slab, a slab being the cells with the same x index: those of slab `x` are
+    // `slab_cells[slab_first_cells[x]]` to `slab_cells[slab_first_cells[x + 1] - 1]`, in the order of their codes.
+    u32 slab_count;
+    u32* slab_first_cells; // CPU_MAX_CELL_COUNT_PER_AXIS + 1
+    u32* slab_cells; // per cell
+    // `SimParameters::cluster_pair_forces`: per cluster of CPU_CLUSTER_SIZE sorted particles, the bounds of its
+    // particles, as the minimum x, y and z, then the maximum ones.
+    f32* cluster_bounds;
+
+    u32 task_count; // threads of the sort: those of the thread pool of the last step
+
+    // The positions as `vec4`s, copied to `GpuResources::buffer_positions_unsorted` after each step.
+    GpuBuffer buffer_positions_staging;
+
+    // `SimParameters::hybrid_gpu_update`; see `cpuHybridUpdate()`. All VK_NULL_HANDLE without it.
+    struct Hybrid {
+        bool enabled;
+        // of the particles, that the GPU updates in the next step; tuned after each step
+        f32 gpu_fraction;
+
+        // Host-visible, written by the host each step and read by the GPU, by sorted particle from the first one
+        // that the GPU's cells see (`HybridPush::halo_first_particle`), and from the GPU's first one:
+        GpuBuffer buffer_positions; // vec4, with the attribute
+        GpuBuffer buffer_velocities; // vec4
+        GpuBuffer buffer_particle_cells; // u32, the index of the particle's cell among the GPU's
+        GpuBuffer buffer_cells; // `HybridCell`, per GPU cell; grown as needed
+        u32 cell_capacity;
+        // Host-cached, written by the GPU: the max speed and acceleration as `floatBitsToUint()`, two more u32s,
+        // then per GPU particle, its new position and velocity, as two vec4s.
+        GpuBuffer buffer_results;
 
-    u32 hash_modulus;
-    u32* H_begin;
-    u32* H_length;
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkDescriptorPool descriptor_pool;
+        VkDescriptorSet descriptor_set;
+        VkPipeline pipeline;
+        VkPipelineLayout pipeline_layout;
+        VkCommandBuffer command_buffer;
+        VkQueryPool query_pool; // 2 timestamps, or VK_NULL_HANDLE if the device can't write them
+    } hybrid;
+};
 
-    u32* p_morton_codes;
-    u32* p_permutation;
+/// Bump on any change to the layout of `SimData`, or of anything it contains by value, so that `migrate()` refuses
+/// to hand a sim over between plugin versions that disagree on it. The host's copy of this is the layout of its
+/// own `SimData`, which a hot reload of the plugin alone doesn't change.
+constexpr u32 SIM_DATA_LAYOUT_VERSION = 31;
+
+struct SimData {
+    u32fast particle_count;
+    // The buffers fit this many particles, so `emitParticles()` can add `particle_capacity - particle_count`.
+    u32fast particle_capacity;
+    u32 hash_table_size; // power of two
+    // The size of the hash table's buffers, which `hash_table_size` is at most; see
+    // `SimParameters::hash_table_resize_interval`.
+    u32 hash_table_capacity;
+    u32 steps_since_hash_table_fit;
+    u32 steps_since_resolution_adaptation; // see `SimParameters::adaptive_resolution_interval`
 
     struct Params {
         f32 rest_particle_density;
         f32 particle_interaction_radius;
         f32 spring_rest_length;
         f32 spring_stiffness;
+        bool sph;
+        f32 sph_stiffness;
+        f32 sph_viscosity;
+        // of the density kernel (poly6) and of its gradient (spiky), for the interaction radius
+        f32 sph_density_kernel_coefficient;
+        f32 sph_gradient_kernel_coefficient;
+        bool pbf;
+        u32 pbf_iteration_count;
+        f32 pbf_relaxation_epsilon; // the relaxation in 1/m^2, for the interaction radius
+        bool flip;
+        f32 flip_ratio;
+        u32 flip_pressure_iteration_count;
+        u32 adaptive_resolution_interval;
+        u32 adaptive_max_level;
+        // the thresholds of `SimParameters::adaptive_interior_fraction` and `adaptive_surface_fraction`, as masses
+        f32 adaptive_interior_mass;
+        f32 adaptive_surface_mass;
         f32 cell_size; // edge length
         f32 cell_size_reciprocal;
+        f32 verlet_skin_distance; // m
+        bool adaptive_time_step;
+        f32 cfl_number;
+        u32 max_substep_count;
+        bool diagnostics;
+        bool sleeping;
+        f32 sleep_speed;
+        f32 sleep_acceleration;
+        u32 sleep_step_count;
+        bool gpu_resident;
+        bool fuse_morton_codes_into_update;
+        bool tiled_particle_update;
+        bool subgroup_particle_update;
+        u32 persistent_update_workgroup_count;
+        bool cluster_pair_forces;
+        bool quantized_neighbor_positions;
+        bool morton_range_traversal;
+        u32 cell_level_count;
+        u32 sparse_cell_particle_count;
+        bool bake_sim_params_into_update;
+        f32 hash_table_max_load_factor;
+        u32 hash_table_resize_interval;
     } parameters;
 
+    // The spatial structure is built at the end of a step, for the next one.
+    bool spatial_structure_rebuilt_last_step;
+    // forces a rebuild at the end of the next step, e.g. because the cell size changed
+    bool spatial_structure_outdated;
+    // Wakes every particle before the next step, because the particles changed, or the sleeping mode was just
+    // turned on and the calm steps weren't tracked before; see `resetCalmSteps()`.
+    bool calm_steps_outdated;
+
+    // The number of particles whose neighbor list didn't fit in `neighbor_list_capacity`, as of the last list
+    // build. Only updated in synchronous mode.
+    u32 neighbor_list_overflow_count;
+
+    // The substeps of the last `advance()`, and the maxima that `SimParameters::adaptive_time_step` chose them
+    // from; those are only tracked in that mode, and are of the latest step that the host has seen finish.
+    struct TimeStep {
+        f32 substep_delta_t; // s
+        u32 substep_count;
+        f32 max_speed; // m/s
+        f32 max_acceleration; // m/s^2, due to the other particles
+    } time_step;
+
+    // What `SimParameters::diagnostics` reduced in the steps that the host has most recently seen finish, which
+    // lag like `time_step`'s maxima; the sums are the mean of those steps'. The masses are in particles of the finest
+    // level (see `SimParameters::adaptive_resolution`). Not computed by the CPU backend.
+    struct Diagnostics {
+        u32 step_count; // the steps that these are of; 0 if none has been read back yet
+        f32 kinetic_energy; // the sum of m v^2 / 2, in particle masses * m^2/s^2
+        vec3 momentum; // the sum of m v, in particle masses * m/s
+        f32 max_density; // the largest SPH density, in particles / m^3; 0 unless `SimParameters::sph`
+        // The particles whose new position isn't finite, or is farther from the domain origin, along some axis,
+        // than the spatial structure's cell codes reach; the next build would abort on them.
+        f32 escaped_particle_count;
+    } diagnostics;
+
+    // Set when the parameters change; the host-written part of the uniform buffer is only uploaded then.
+    bool uniforms_dirty;
+    // The number of bytes that the last `advance()` uploaded from the host to the GPU.
+    u64 uploaded_byte_count;
+    TransferStats transfers;
+
     GpuResources gpu_resources;
 
-    u32 processor_count;
+    // `SimParameters::cpu_backend`. Only the command pool, the synchronization objects and
+    // `buffer_positions_unsorted` of `gpu_resources` exist then.
+    bool cpu_backend;
+    CpuState cpu_state;
 };
 
 //
@@ -162,6 +162,124 @@ struct ArrayList {
     };
 };
 
+/// Fixed-size objects with stable addresses, unlike the elements of an `ArrayList`: they're allocated from chunks
+/// of `chunk_size` objects, which are never moved, and freed objects are linked into a freelist through their own
+/// storage, so both `alloc()` and `dealloc()` are O(1). A chunk is added whenever the freelist is empty. `T` must
+/// be trivially copyable. Not thread-safe.
+template<typename T>
+struct Pool {
+    union Slot {
+        T value;
+        Slot* next_free;
+    };
+
+    ArrayList<Slot*> chunks;
+    u32 chunk_size;
+    Slot* free_head;
+
+    /// Allocates nothing until the first `alloc()`.
+    static Pool<T> create(u32 chunk_size) {
+        assert(chunk_size != 0);
+        return Pool { .chunks = ArrayList<Slot*>::create(), .chunk_size = chunk_size, .free_head = NULL };
+    }
+
+    /// Frees every object, allocated or not.
+    void free() {
+        for (u32 i = 0; i < this->chunks.size; i++) std::free(this->chunks.ptr[i]);
+        this->chunks.free();
+        this->free_head = NULL;
+    }
+
+    /// Uninitialized.
+    T* alloc() {
+
+        if (this->free_head == NULL)
+        {
+            Slot* chunk = mallocArray(this->chunk_size, Slot);
+            this->chunks.push(chunk);
+
+            for (u32 i = 0; i < this->chunk_size - 1; i++) chunk[i].next_free = &chunk[i + 1];
+            chunk[this->chunk_size - 1].next_free = NULL;
+            this->free_head = chunk;
+        }
+
+        Slot* slot = this->free_head;
+        this->free_head = slot->next_free;
+        return &slot->value;
+    }
+
+    /// `p` must be from `alloc()` of this pool.
+    void dealloc(T* p) {
+        Slot* slot = (Slot*)p;
+        slot->next_free = this->free_head;
+        this->free_head = slot;
+    }
+};
+
+constexpr size_t FRAME_ARENA_ALIGNMENT = 64; // a cache line
+
+/// A bump allocator for temporaries that live until the end of a frame (or of any other scope that can be
+/// rewound to a `mark()`): allocating is an add, and everything is freed at once by `reset()`. Each allocation is
+/// aligned to a cache line, so that arrays written by different threads don't share one. Not thread-safe; give
+/// each thread of a pool its own `subArena()`, indexed by `thread_pool::getCurrentWorkerIdx()`.
+struct FrameArena {
+    u8* ptr;
+    size_t size; // in use
+    size_t capacity;
+
+    static FrameArena create(size_t capacity) {
+        capacity = roundUpMultiple(capacity, FRAME_ARENA_ALIGNMENT);
+        u8* ptr = (u8*)allocAlignedAsserted(FRAME_ARENA_ALIGNMENT, capacity);
+        return FrameArena { .ptr = ptr, .size = 0, .capacity = capacity };
+    }
+
+    /// Only for an arena from `create()`, not from `subArena()`.
+    void free() {
+        std::free(this->ptr);
+        this->ptr = NULL;
+        this->size = 0;
+        this->capacity = 0;
+    }
+
+    /// Aborts if the arena is full; size it for the worst frame.
+    void* alloc(size_t byte_count) {
+
+        const size_t aligned_size = roundUpMultiple(byte_count, FRAME_ARENA_ALIGNMENT);
+        alwaysAssert(aligned_size <= this->capacity - this->size);
+
+        void* p = this->ptr + this->size;
+        this->size += aligned_size;
+        return p;
+    }
+
+    template<typename U>
+    U* allocArray(size_t count) {
+        return (U*)this->alloc(count * sizeof(U));
+    }
+
+    /// A `sub_capacity`-byte arena in this one, which frees its memory when this one is reset past it. For each
+    /// thread to allocate from its own, without synchronizing.
+    FrameArena subArena(size_t sub_capacity) {
+        sub_capacity = roundUpMultiple(sub_capacity, FRAME_ARENA_ALIGNMENT);
+        u8* sub_ptr = (u8*)this->alloc(sub_capacity);
+        return FrameArena { .ptr = sub_ptr, .size = 0, .capacity = sub_capacity };
+    }
+
+    size_t mark() const {
+        return this->size;
+    }
+
+    /// Frees everything allocated since `mark` was returned by `mark()`.
+    void resetTo(size_t mark) {
+        assert(mark <= this->size);
+        this->size = mark;
+    }
+
+    void reset() {
+        this->size = 0;
+    }
+};
+
 //
 // ===========================================================================================================
 //
@@ -1,19 +1,12 @@
 #version 450
 
-layout(location = 0) in uint voxel_idx_;
+// an outlined voxel per instance
+layout(location = 0) in ivec3 voxel_coord_;
 
 layout(binding = 0, std140) uniform Uniforms {
     mat4 world_to_screen_transform_;
 };
 
-struct Voxel {
-    ivec3 coord;
-    uint material_idx;
-};
-layout(binding = 1, std430) buffer Voxels {
-    Voxel voxels_[];
-};
-
 layout(constant_id = 0) const float CUBE_RADIUS = 0.5;
 #define CUBE_DIAMETER (2.0f * CUBE_RADIUS);
 
@@ -67,8 +60,7 @@ const vec2 BASE_RECTANGLE_VERTICES[6] = {
 
 void main(void) {
 
-    const Voxel voxel = voxels_[voxel_idx_];
-    const vec3 voxel_coord = vec3(voxel.coord) * CUBE_DIAMETER;
+    const vec3 voxel_coord = vec3(voxel_coord_) * CUBE_DIAMETER;
 
     const vec2 base_vertex = BASE_RECTANGLE_VERTICES[gl_VertexIndex % 6];
 
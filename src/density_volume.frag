@@ -0,0 +1,157 @@
+#version 450
+
+layout(location = 0) out vec4 color_out_;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// The sim's domain, which the volume spans; see `gfx::ParticleGrid`.
+layout(binding = 12, std430) readonly buffer DomainBounds { vec4 domain_bounds_[]; };
+
+// What density_volume_splat.comp splatted; see `recordDensityVolume()` in graphics.cpp. Must match the
+// DENSITY_VOLUME_* constants there, and density_volume_splat.comp, which we can't #include, because the shaders in
+// this file are compiled at runtime without an include callback.
+#define RESOLUTION 64u
+#define BRICK_SIZE 8u
+#define BRICK_RESOLUTION (RESOLUTION / BRICK_SIZE)
+layout(binding = 47, std430) readonly buffer DensityVolume {
+    uint counts_[RESOLUTION * RESOLUTION * RESOLUTION];
+    uint brick_counts_[BRICK_RESOLUTION * BRICK_RESOLUTION * BRICK_RESOLUTION];
+};
+
+// Must match `DensityVolumePipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    mat4 world_to_screen_transform_inverse_;
+    vec3 camera_position_;
+    float particle_radius_;
+    vec2 viewport_offset_in_window_;
+    vec2 viewport_size_in_window_;
+    uint particle_count_;
+    uint permuted_;
+    float cell_size_reciprocal_;
+    uint domain_bounds_slot_;
+    float rest_particle_density_; // particles / m^3
+};
+
+#define DOMAIN_MIN (domain_bounds_[2 * domain_bounds_slot_].xyz)
+#define DOMAIN_MAX (domain_bounds_[2 * domain_bounds_slot_ + 1].xyz)
+
+// The most steps of a ray, samples and skipped bricks alike, which bounds the cost of a pixel whatever the particle
+// count. At half a voxel per sample, enough to cross the volume along its diagonal.
+const uint MAX_STEP_COUNT = 256;
+// The ray stops once less than this fraction of what's behind would show through.
+const float MIN_TRANSMITTANCE = 0.01f;
+// The samples less opaque than this are clear enough to see through, for the depth.
+const float MIN_SAMPLE_OPACITY = 0.01f;
+const vec3 FLUID_COLOR = vec3(0.0f, 0.5f, 1.0f);
+// of the sparse parts, e.g. the spray
+const vec3 FOAM_COLOR = vec3(0.8f, 0.9f, 1.0f);
+// Same as fluid_composite.frag's: the fraction of the light that crosses a particle's diameter of fluid at the rest
+// density is exp(-ABSORPTION).
+const float ABSORPTION = 0.3f;
+
+/// Same as fluid_composite.frag's.
+vec3 rayDirection(vec2 window_coord) {
+
+    // [-1, 1] over the viewport; the y-axis flip is done by the transform
+    const vec2 f = 2.0f * (window_coord - viewport_offset_in_window_) / viewport_size_in_window_ - 1.0f;
+
+    const vec4 pn = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 0.0f, 1.0f);
+    const vec4 pf = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 1.0f, 1.0f);
+    return normalize(pf.xyz / pf.w - pn.xyz / pn.w);
+}
+
+/// Same as density_volume_splat.comp's.
+float voxelSize() {
+    const vec3 extent = DOMAIN_MAX - DOMAIN_MIN;
+    return max(max(extent.x, extent.y), max(extent.z, 1e-6f)) / float(RESOLUTION);
+}
+
+float voxelCount(ivec3 voxel) {
+    if (any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, ivec3(RESOLUTION)))) return 0.0f;
+    return float(counts_[(voxel.z * RESOLUTION + voxel.y) * RESOLUTION + voxel.x]);
+}
+
+/// The particle count per voxel at `p`, in voxels from the volume's corner, interpolated trilinearly between the
+/// voxels' centers.
+float sampleCount(vec3 p) {
+
+    const vec3 q = p - 0.5f;
+    const ivec3 v = ivec3(floor(q));
+    const vec3 f = q - vec3(v);
+
+    const float c00 = mix(voxelCount(v + ivec3(0, 0, 0)), voxelCount(v + ivec3(1, 0, 0)), f.x);
+    const float c10 = mix(voxelCount(v + ivec3(0, 1, 0)), voxelCount(v + ivec3(1, 1, 0)), f.x);
+    const float c01 = mix(voxelCount(v + ivec3(0, 0, 1)), voxelCount(v + ivec3(1, 0, 1)), f.x);
+    const float c11 = mix(voxelCount(v + ivec3(0, 1, 1)), voxelCount(v + ivec3(1, 1, 1)), f.x);
+    return mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);
+}
+
+// `PARTICLE_RENDER_MODE_DENSITY_VOLUME`: marches the pixel's ray through the volume, front to back, absorbing and
+// emitting in proportion to the density, and skipping the bricks that are empty; then blends the result over
+// what's behind, at the depth of the first sample that shows.
+void main(void) {
+
+    const vec3 ray_direction_unit = rayDirection(gl_FragCoord.xy);
+    // no infinities in the divisions below
+    const vec3 ray_direction = mix(ray_direction_unit, vec3(1e-8f), equal(ray_direction_unit, vec3(0.0f)));
+
+    const float voxel_size = voxelSize();
+    const vec3 volume_min = DOMAIN_MIN;
+    const vec3 volume_max = volume_min + float(RESOLUTION) * voxel_size;
+
+    // the part of the ray in the volume, in front of the camera
+    const vec3 t_a = (volume_min - camera_position_) / ray_direction;
+    const vec3 t_b = (volume_max - camera_position_) / ray_direction;
+    const vec3 t_near = min(t_a, t_b);
+    const vec3 t_far = max(t_a, t_b);
+    const float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0f));
+    const float t_exit = min(min(t_far.x, t_far.y), t_far.z);
+    if (t_enter >= t_exit) discard;
+
+    const float step_size = 0.5f * voxel_size;
+    const float rest_count = rest_particle_density_ * voxel_size * voxel_size * voxel_size;
+    // the extinction per unit length at the rest density
+    const float rest_extinction = ABSORPTION / (2.0f * particle_radius_);
+
+    vec3 color = vec3(0.0f);
+    float transmittance = 1.0f;
+    float t_first = -1.0f;
+    float t = t_enter + 0.5f * step_size;
+    for (uint step_idx = 0; step_idx < MAX_STEP_COUNT && t < t_exit; step_idx++)
+    {
+        const vec3 p = (camera_position_ + t * ray_direction_unit - volume_min) / voxel_size;
+
+        const uvec3 brick = uvec3(clamp(ivec3(floor(p)), ivec3(0), ivec3(RESOLUTION - 1))) / BRICK_SIZE;
+        if (brick_counts_[(brick.z * BRICK_RESOLUTION + brick.y) * BRICK_RESOLUTION + brick.x] == 0)
+        {
+            // to the next sample past where the ray leaves the brick
+            const vec3 brick_min = vec3(brick * BRICK_SIZE);
+            const vec3 boundary = mix(brick_min, brick_min + float(BRICK_SIZE), greaterThan(ray_direction, vec3(0.0f)));
+            const vec3 t_boundary = (boundary - p) * voxel_size / ray_direction;
+            const float skipped = max(min(min(t_boundary.x, t_boundary.y), t_boundary.z), 0.0f);
+            t += (floor(skipped / step_size) + 1.0f) * step_size;
+            continue;
+        }
+
+        const float density = sampleCount(p) / rest_count; // relative to the rest density
+        const float opacity = 1.0f - exp(-rest_extinction * density * step_size);
+        if (t_first < 0.0f && opacity > MIN_SAMPLE_OPACITY) t_first = t;
+
+        const vec3 sample_color = mix(FOAM_COLOR, FLUID_COLOR, clamp(density, 0.0f, 1.0f));
+        color += transmittance * opacity * sample_color;
+        transmittance *= 1.0f - opacity;
+        if (transmittance < MIN_TRANSMITTANCE) break;
+
+        t += step_size;
+    }
+    if (t_first < 0.0f) discard;
+
+    // blended as straight alpha, so the color is divided by what the premultiplied sum covers
+    const float alpha = 1.0f - transmittance;
+    color_out_ = vec4(color / alpha, alpha);
+
+    const vec3 first_point = camera_position_ + t_first * ray_direction_unit;
+    const vec4 first_clip_space = world_to_screen_transform_ * vec4(first_point, 1.0f);
+    gl_FragDepth = first_clip_space.z / first_clip_space.w;
+}
@@ -0,0 +1,83 @@
+// The depth pyramid of occlusion culling; see `recordOcclusionCulling()` in graphics.cpp. Shared by
+// depth_pyramid.comp, which builds it, and by voxel_cull.comp and particle_mesh.task, which test against it.
+//
+// Level 0 has half the resolution of the depth buffer along each side, rounded up, and each level has half of the
+// one below, down to 1x1; so the texel of level l that covers pixel p is p >> (l + 1). A texel holds the farthest
+// depth of the pixels that it covers. The levels are laid out one after the other, each by rows.
+
+// Must match `UniformBuffer` in graphics.cpp.
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+    // the viewport's offset and size, in pixels of the depth buffer
+    vec4 viewport_;
+    uvec2 depth_buffer_size_;
+    uint depth_pyramid_level_count_;
+    // whether the pyramid holds the previous frame's depths, for the first phase to test against; the second phase
+    // always tests against this frame's
+    uint depth_pyramid_valid_;
+};
+
+layout(binding = 28, std430) buffer DepthPyramid {
+    float depth_pyramid_[];
+};
+
+uvec2 depthPyramidLevelSize(uint level) {
+    return (depth_buffer_size_ + (2u << level) - 1) >> (level + 1);
+}
+
+/// The index in `depth_pyramid_` of the level's first texel.
+uint depthPyramidLevelOffset(uint level) {
+    uint offset = 0;
+    for (uint l = 0; l < level; l++)
+    {
+        const uvec2 size = depthPyramidLevelSize(l);
+        offset += size.x * size.y;
+    }
+    return offset;
+}
+
+/// Whether the box is hidden behind the depths in the pyramid, as `world_to_screen_transform_` sees it. A box that
+/// reaches behind the camera's near plane is never hidden, as its footprint on screen is unbounded.
+bool depthPyramidOccludes(vec3 box_min, vec3 box_max) {
+
+    vec2 ndc_min = vec2(1.0f / 0.0f);
+    vec2 ndc_max = vec2(-1.0f / 0.0f);
+    float nearest_depth = 1.0f;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        const bvec3 upper = bvec3((corner & 1) != 0, (corner & 2) != 0, (corner & 4) != 0);
+        const vec4 clip = world_to_screen_transform_ * vec4(mix(box_min, box_max, upper), 1.0f);
+        if (clip.w <= 0.0f) return false;
+
+        const vec3 ndc = clip.xyz / clip.w;
+        ndc_min = min(ndc_min, ndc.xy);
+        ndc_max = max(ndc_max, ndc.xy);
+        nearest_depth = min(nearest_depth, ndc.z);
+    }
+    if (nearest_depth <= 0.0f) return false;
+
+    const vec2 last_pixel = vec2(depth_buffer_size_ - 1);
+    const uvec2 pixel_min = uvec2(clamp(viewport_.xy + (0.5f * ndc_min + 0.5f) * viewport_.zw, vec2(0.0f), last_pixel));
+    const uvec2 pixel_max = uvec2(clamp(viewport_.xy + (0.5f * ndc_max + 0.5f) * viewport_.zw, vec2(0.0f), last_pixel));
+
+    // the finest level at which the footprint spans at most 2x2 texels
+    uint level = 0;
+    while (
+        level + 1 < depth_pyramid_level_count_ &&
+        any(greaterThan((pixel_max >> (level + 1)) - (pixel_min >> (level + 1)), uvec2(1)))
+    ) level++;
+
+    const uvec2 texel_min = pixel_min >> (level + 1);
+    const uvec2 texel_max = pixel_max >> (level + 1);
+    const uint width = depthPyramidLevelSize(level).x;
+    const uint offset = depthPyramidLevelOffset(level);
+
+    float farthest_depth = 0.0f;
+    for (uint y = texel_min.y; y <= texel_max.y; y++) {
+        for (uint x = texel_min.x; x <= texel_max.x; x++) {
+            farthest_depth = max(farthest_depth, depth_pyramid_[offset + y * width + x]);
+        }
+    }
+    // the depth test passes at equal depths
+    return nearest_depth > farthest_depth;
+}
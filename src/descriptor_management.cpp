@@ -32,7 +32,7 @@ extern void createDescriptorPoolAndSets(
 
     const u32fast layout_count,
     const DescriptorSetLayout *const p_layouts,
-    const u32 *const p_set_counts, // how many descriptor sets to allocate with each layout
+    const u32 *const p_set_counts, // how many descriptor sets to allocate with each layout; 0 if it's pushed
 
     VkDescriptorPool *const p_descriptor_pool_out,
     VkDescriptorSetLayout *const p_descriptor_set_layouts_out, // [layout_count]
@@ -48,14 +48,17 @@ extern void createDescriptorPoolAndSets(
         {
             const DescriptorSetLayout* layout = &p_layouts[layout_idx];
             const u32 alloc_count = p_set_counts[layout_idx];
-            assert(alloc_count > 0);
+            // no sets of a pushed layout
+            assert((alloc_count > 0) != bool(layout->flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR));
 
             assert(layout->binding_count > 0);
             for (u32fast binding_idx = 0; binding_idx < layout->binding_count; binding_idx++)
             {
                 VkDescriptorType descriptor_type = layout->p_bindings[binding_idx].descriptorType;
                 assert(descriptor_type <= MAX_SUPPORTED_DESCRIPTOR_TYPE);
-                descriptor_type_counts[descriptor_type] += alloc_count;
+                // a binding can be an array of descriptors
+                const u32 descriptor_count = layout->p_bindings[binding_idx].descriptorCount;
+                descriptor_type_counts[descriptor_type] += alloc_count * descriptor_count;
             }
         }
     }
@@ -105,6 +108,7 @@ extern void createDescriptorPoolAndSets(
         const DescriptorSetLayout* p_layout = &p_layouts[layout_idx];
         VkDescriptorSetLayoutCreateInfo layout_info {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .flags = p_layout->flags,
             .bindingCount = p_layout->binding_count,
             .pBindings = p_layout->p_bindings,
         };
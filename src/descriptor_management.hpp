@@ -35,6 +35,9 @@ constexpr u32 MAX_SUPPORTED_DESCRIPTOR_TYPE = 10;
 struct DescriptorSetLayout {
     u32 binding_count;
     VkDescriptorSetLayoutBinding* p_bindings;
+    // VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR for a layout whose descriptors are pushed, which no
+    // set may be allocated with
+    VkDescriptorSetLayoutCreateFlags flags;
 };
 
 void createDescriptorPoolAndSets(
@@ -43,7 +46,7 @@ void createDescriptorPoolAndSets(
 
     const u32fast layout_count,
     const DescriptorSetLayout *const p_layouts,
-    const u32 *const p_set_counts, // how many descriptor sets to allocate with each layout
+    const u32 *const p_set_counts, // how many descriptor sets to allocate with each layout; 0 if it's pushed
 
     VkDescriptorPool *const p_descriptor_pool_out,
     VkDescriptorSetLayout *const p_descriptor_set_layouts_out, // length = layout_count
@@ -0,0 +1,231 @@
+#include <cassert>
+#include <cstdlib>
+#include <pthread.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "fence_waiter.hpp"
+
+namespace fence_waiter {
+
+//
+// ===========================================================================================================
+//
+
+struct PendingFence {
+    VkFence fence;
+    thread_pool::PFN_TaskProc p_procedure;
+    void* p_arg;
+};
+
+struct FenceWaiter {
+    const VulkanContext* vk_ctx;
+    thread_pool::ThreadPool* thread_pool;
+    pthread_t thread;
+
+    pthread_mutex_t mutex;
+    // signaled when a fence is added while there were none, and when the thread should quit
+    pthread_cond_t fence_added_condition;
+    // guarded by `mutex`
+    ArrayList<PendingFence> pending_fences;
+    bool should_quit;
+
+    // only used by the thread: a copy of the pending fences, to wait on without holding `mutex`
+    ArrayList<VkFence> waited_fences;
+};
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+/// Enqueues the tasks of the signaled fences, and forgets them. With `mutex`.
+static void enqueueSignaledFences(FenceWaiter* waiter) {
+
+    const VulkanContext* vk_ctx = waiter->vk_ctx;
+    ArrayList<PendingFence>* pending_fences = &waiter->pending_fences;
+
+    u32 i = 0;
+    while (i < pending_fences->size)
+    {
+        const PendingFence pending = pending_fences->ptr[i];
+
+        const VkResult result = vk_ctx->procs_dev.GetFenceStatus(vk_ctx->device, pending.fence);
+        if (result == VK_NOT_READY)
+        {
+            i++;
+            continue;
+        }
+        assertVk(result);
+
+        pending_fences->ptr[i] = pending_fences->ptr[pending_fences->size - 1];
+        pending_fences->size--;
+
+        thread_pool::enqueueTask(waiter->thread_pool, pending.p_procedure, pending.p_arg);
+    }
+}
+
+
+static void* threadProcedure(void* p_waiter) {
+
+    ZoneScoped;
+
+    FenceWaiter* waiter = (FenceWaiter*)p_waiter;
+    const VulkanContext* vk_ctx = waiter->vk_ctx;
+
+    while (true)
+    {
+        int result = pthread_mutex_lock(&waiter->mutex);
+        alwaysAssert(result == 0);
+
+        while (waiter->pending_fences.size == 0 and !waiter->should_quit)
+        {
+            result = pthread_cond_wait(&waiter->fence_added_condition, &waiter->mutex);
+            alwaysAssert(result == 0);
+        }
+
+        // the pending fences are waited for before quitting
+        if (waiter->pending_fences.size == 0)
+        {
+            result = pthread_mutex_unlock(&waiter->mutex);
+            alwaysAssert(result == 0);
+            return NULL;
+        }
+
+        waiter->waited_fences.size = 0;
+        waiter->waited_fences.reserve(waiter->pending_fences.size);
+        for (u32 i = 0; i < waiter->pending_fences.size; i++)
+        {
+            waiter->waited_fences.push(waiter->pending_fences.ptr[i].fence);
+        }
+
+        result = pthread_mutex_unlock(&waiter->mutex);
+        alwaysAssert(result == 0);
+
+        // Until any of them is signaled; the timeout is so that the fences added in the meantime are waited for
+        // too.
+        VkResult vk_result = VK_ERROR_UNKNOWN;
+        {
+            ZoneScopedN("vkWaitForFences");
+            vk_result = vk_ctx->procs_dev.WaitForFences(
+                vk_ctx->device, waiter->waited_fences.size, waiter->waited_fences.ptr, VK_FALSE, POLL_INTERVAL_NS
+            );
+        }
+        if (vk_result == VK_TIMEOUT) continue;
+        assertVk(vk_result);
+
+        result = pthread_mutex_lock(&waiter->mutex);
+        alwaysAssert(result == 0);
+
+        enqueueSignaledFences(waiter);
+
+        result = pthread_mutex_unlock(&waiter->mutex);
+        alwaysAssert(result == 0);
+    }
+}
+
+
+FenceWaiter* create(const VulkanContext* vk_ctx, thread_pool::ThreadPool* thread_pool) {
+
+    ZoneScoped;
+
+    FenceWaiter* waiter = callocArray(1, FenceWaiter);
+    waiter->vk_ctx = vk_ctx;
+    waiter->thread_pool = thread_pool;
+    waiter->pending_fences = ArrayList<PendingFence>::create();
+    waiter->waited_fences = ArrayList<VkFence>::create();
+
+    int result = pthread_mutex_init(&waiter->mutex, NULL);
+    alwaysAssert(result == 0);
+    result = pthread_cond_init(&waiter->fence_added_condition, NULL);
+    alwaysAssert(result == 0);
+
+    result = pthread_create(&waiter->thread, NULL, threadProcedure, waiter);
+    alwaysAssert(result == 0);
+
+    return waiter;
+}
+
+
+void destroy(FenceWaiter* waiter) {
+
+    ZoneScoped;
+
+    int result = pthread_mutex_lock(&waiter->mutex);
+    alwaysAssert(result == 0);
+
+    waiter->should_quit = true;
+    result = pthread_cond_signal(&waiter->fence_added_condition);
+    alwaysAssert(result == 0);
+
+    result = pthread_mutex_unlock(&waiter->mutex);
+    alwaysAssert(result == 0);
+
+    result = pthread_join(waiter->thread, NULL);
+    alwaysAssert(result == 0);
+
+    pthread_cond_destroy(&waiter->fence_added_condition);
+    pthread_mutex_destroy(&waiter->mutex);
+
+    waiter->pending_fences.free();
+    waiter->waited_fences.free();
+    free(waiter);
+}
+
+
+void enqueueTaskAfterFence(
+    FenceWaiter* waiter,
+    VkFence fence,
+    thread_pool::PFN_TaskProc p_procedure,
+    void* p_arg
+) {
+
+    ZoneScoped;
+
+    int result = pthread_mutex_lock(&waiter->mutex);
+    alwaysAssert(result == 0);
+
+    assert(!waiter->should_quit);
+
+    waiter->pending_fences.push(PendingFence {
+        .fence = fence,
+        .p_procedure = p_procedure,
+        .p_arg = p_arg,
+    });
+    if (waiter->pending_fences.size == 1)
+    {
+        result = pthread_cond_signal(&waiter->fence_added_condition);
+        alwaysAssert(result == 0);
+    }
+
+    result = pthread_mutex_unlock(&waiter->mutex);
+    alwaysAssert(result == 0);
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
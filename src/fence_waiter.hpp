@@ -0,0 +1,38 @@
+#ifndef _FENCE_WAITER_HPP
+#define _FENCE_WAITER_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "vulkan_context.hpp"
+// #include "thread_pool.hpp"
+
+/// A thread that waits for the GPU on behalf of the others: each fence that it's given is polled, and a
+/// `thread_pool` task is enqueued once it's signaled. So the work that needs a submission to have finished is
+/// started by it, instead of the main thread or a thread of the pool blocking in `vkWaitForFences()`. Work that
+/// needs other tasks to have finished can wait without blocking in the same way, with a `thread_pool::TaskGraph`.
+namespace fence_waiter {
+
+//
+// ===========================================================================================================
+//
+
+struct FenceWaiter;
+
+/// `vk_ctx` and `thread_pool` must outlive it.
+FenceWaiter* create(const VulkanContext*, thread_pool::ThreadPool*);
+/// Waits for the fences that are left, and enqueues their tasks.
+void destroy(FenceWaiter*);
+
+/// Enqueues `p_procedure(p_arg)` on the pool once `fence` is signaled. The fence must have been submitted, and
+/// may not be reset or destroyed until the task has started. If the waiter is already waiting for other fences,
+/// it notices this one within `POLL_INTERVAL_NS`.
+void enqueueTaskAfterFence(FenceWaiter*, VkFence fence, thread_pool::PFN_TaskProc p_procedure, void* p_arg);
+
+constexpr u64 POLL_INTERVAL_NS = 1'000'000;
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -52,6 +52,29 @@ extern void* readEntireFile(const char* fname, size_t* size_out) {
     return buffer;
 }
 
+extern bool writeEntireFile(const char* fname, const void* data, size_t size) {
+
+    FILE* file = fopen(fname, "w");
+    if (file == NULL) {
+        LOG_F(ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", fname, errno, strerror(errno));
+        return false;
+    }
+
+    bool success = true;
+    if (size > 0) {
+        size_t n_items_written = fwrite(data, size, 1, file);
+        if (n_items_written != 1) {
+            LOG_F(ERROR, "Failed to write file `%s`.", fname);
+            success = false;
+        }
+    }
+
+    int result = fclose(file);
+    assertErrno(result == 0);
+
+    return success;
+}
+
 //
 // ===========================================================================================================
 //
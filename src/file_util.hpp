@@ -11,6 +11,9 @@ namespace file_util {
 /// On error, either aborts or returns `NULL`.
 [[nodiscard]] void* readEntireFile(const char* fname, size_t* size_out);
 
+/// Creates or truncates the file. Logs an error and returns false on failure.
+[[nodiscard]] bool writeEntireFile(const char* fname, const void* data, size_t size);
+
 //
 // ===========================================================================================================
 //
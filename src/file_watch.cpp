@@ -1,6 +1,9 @@
 #ifdef linux
     #include <sys/inotify.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
     #include <unistd.h>
+    #include <pthread.h>
     #include <linux/limits.h>
 #else
     #error("Whatever OS you're compiling for is not supported.")
@@ -10,6 +13,7 @@
 #include <cerrno>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 
 #include <loguru/loguru.hpp>
 
@@ -25,42 +29,302 @@ namespace filewatch {
 // ===========================================================================================================
 //
 
+// Editors often write a file in several bursts (truncate, write, write, ...), so a watchlist's events are only
+// published once none have arrived for this long; one save then gives one event per file.
+constexpr u64 DEBOUNCE_NS = 30'000'000;
+// Per watchlist. If `poll()` falls this far behind, the watcher keeps the rest until it catches up.
+constexpr u32 EVENT_RING_CAPACITY = 256;
+
 struct WatchlistImpl {
-    ArrayList<FileID> modified_files;
     int inotify_fd;
+
+    // Written by the watcher thread, read by `poll()`: a single-producer, single-consumer ring, so that polling
+    // is a couple of atomic loads and no syscall. `ring_tail` is only written by the watcher, and `ring_head`
+    // only by the polling thread.
+    FileID ring[EVENT_RING_CAPACITY];
+    u32 ring_head; // accessed atomically
+    u32 ring_tail; // accessed atomically
+
+    // the watcher thread's; under `watcher_.mutex`
+    ArrayList<FileID> pending; // not yet published, without duplicates
+    u64 last_event_ns;
+
+    // `poll()`'s; the buffer that it returns
+    ArrayList<FileID> modified_files;
+};
+
+// Watchlists are created and destroyed as file watching is toggled, so they're reused instead of reallocated.
+static Pool<WatchlistImpl> watchlist_pool_ = Pool<WatchlistImpl>::create(8);
+
+/// One thread blocks in `epoll_wait()` over the inotify fds of every watchlist, and publishes their events into
+/// their rings. It's started with the first watchlist, and stopped with the last, so that a plugin (which has its
+/// own copy of this file) doesn't leave a thread behind once it's unloaded. Like before it, the watchlists are
+/// only created and destroyed from one thread at a time.
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    int epoll_fd;
+    int wake_fd; // an eventfd, to wake the thread up to quit
+
+    // under `mutex`
+    ArrayList<WatchlistImpl*> watchlists;
+    bool should_quit;
+} watcher_ {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .epoll_fd = -1,
+    .wake_fd = -1,
 };
 
 //
 // ===========================================================================================================
 //
 
+static u64 nowNs(void) {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1'000'000'000 + (u64)now.tv_nsec;
+}
+
+/// Reads every event queued on `fd` without blocking; if `watchlist` isn't NULL, adds their files to its pending
+/// ones.
+static void drainInotifyEvents(int fd, WatchlistImpl* watchlist) {
+
+    while (true) {
+
+        // The last member of `struct inotify_event` is a variable-length `char name[]`.
+        // `man 7 inotify` says that "`sizeof(struct inotify_event) + NAME_MAX + 1` will be sufficient".
+        constexpr size_t event_buffer_size = sizeof(inotify_event) + NAME_MAX + 1;
+        alignas(inotify_event) u8 event_buffer[event_buffer_size];
+
+        const ssize_t bytes_read_count = read(fd, &event_buffer, event_buffer_size);
+
+        if (bytes_read_count < 0) {
+            // EAGAIN means that the fd is marked nonblocking and the read would block. See `man 2 read`.
+            if (errno == EAGAIN) return;
+            if (errno == EINTR) continue;
+            assertErrno(false);
+        }
+
+        if (watchlist == NULL) continue;
+
+        size_t buffer_pos = 0;
+        while (buffer_pos < (size_t)bytes_read_count) {
+            const inotify_event* p_event = (const inotify_event*)&event_buffer[buffer_pos];
+            buffer_pos += sizeof(inotify_event) + p_event->len;
+
+            const FileID id = (FileID)p_event->wd;
+            bool already_pending = false;
+            for (u32 i = 0; i < watchlist->pending.size; i++) {
+                if (watchlist->pending.ptr[i] == id) already_pending = true;
+            }
+            if (!already_pending) watchlist->pending.push(id);
+        }
+    }
+}
+
+/// Moves as many of the pending events as fit into the ring.
+static void publishPendingEvents(WatchlistImpl* watchlist) {
+
+    const u32 head = __atomic_load_n(&watchlist->ring_head, __ATOMIC_ACQUIRE);
+    u32 tail = watchlist->ring_tail;
+
+    u32 published_count = 0;
+    while (published_count < watchlist->pending.size and tail - head < EVENT_RING_CAPACITY) {
+        watchlist->ring[tail % EVENT_RING_CAPACITY] = watchlist->pending.ptr[published_count];
+        tail++;
+        published_count++;
+    }
+    __atomic_store_n(&watchlist->ring_tail, tail, __ATOMIC_RELEASE);
+
+    const u32 remaining_count = watchlist->pending.size - published_count;
+    memmove(
+        watchlist->pending.ptr, watchlist->pending.ptr + published_count, remaining_count * sizeof(FileID)
+    );
+    watchlist->pending.size = remaining_count;
+}
+
+static void* watcherThreadProcedure(void*) {
+
+    constexpr int MAX_EVENTS_PER_WAIT = 16;
+
+    int timeout_ms = -1;
+    while (true) {
+
+        epoll_event events[MAX_EVENTS_PER_WAIT];
+        const int event_count = epoll_wait(watcher_.epoll_fd, events, MAX_EVENTS_PER_WAIT, timeout_ms);
+        if (event_count < 0) assertErrno(errno == EINTR);
+
+        int result = pthread_mutex_lock(&watcher_.mutex);
+        alwaysAssert(result == 0);
+
+        if (watcher_.should_quit) {
+            result = pthread_mutex_unlock(&watcher_.mutex);
+            alwaysAssert(result == 0);
+            return NULL;
+        }
+
+        const u64 now_ns = nowNs();
+
+        for (int event_idx = 0; event_idx < event_count; event_idx++) {
+
+            WatchlistImpl* watchlist = (WatchlistImpl*)events[event_idx].data.ptr;
+            if (watchlist == NULL) continue; // the wake fd, which is only written to quit
+
+            // It may have been destroyed between the wait and the lock; then its slot in the pool may even hold
+            // a new watchlist, whose fd is drained without harm.
+            bool live = false;
+            for (u32 i = 0; i < watcher_.watchlists.size; i++) {
+                if (watcher_.watchlists.ptr[i] == watchlist) live = true;
+            }
+            if (!live) continue;
+
+            drainInotifyEvents(watchlist->inotify_fd, watchlist);
+            watchlist->last_event_ns = now_ns;
+        }
+
+        // until the next watchlist whose burst of events is over
+        u64 wait_ns = UINT64_MAX;
+        for (u32 i = 0; i < watcher_.watchlists.size; i++) {
+
+            WatchlistImpl* watchlist = watcher_.watchlists.ptr[i];
+            if (watchlist->pending.size == 0) continue;
+
+            const u64 quiet_ns = now_ns - watchlist->last_event_ns;
+            if (quiet_ns >= DEBOUNCE_NS) {
+                publishPendingEvents(watchlist);
+                // if the ring was full, retry after another debounce period
+                if (watchlist->pending.size != 0) wait_ns = math::min(wait_ns, DEBOUNCE_NS);
+            }
+            else wait_ns = math::min(wait_ns, DEBOUNCE_NS - quiet_ns);
+        }
+        timeout_ms = (wait_ns == UINT64_MAX) ? -1 : (int)((wait_ns + 999'999) / 1'000'000);
+
+        result = pthread_mutex_unlock(&watcher_.mutex);
+        alwaysAssert(result == 0);
+    }
+}
+
+/// With `watcher_.mutex`. Returns false, after logging the error, on failure.
+[[nodiscard]] static bool startWatcherThread(void) {
+
+    watcher_.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (watcher_.epoll_fd < 0) {
+        LOG_F(ERROR, "Failed to create an epoll instance. errno %d, strerror: `%s`.", errno, strerror(errno));
+        return false;
+    }
+
+    watcher_.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher_.wake_fd < 0) {
+        LOG_F(ERROR, "Failed to create an eventfd. errno %d, strerror: `%s`.", errno, strerror(errno));
+        int result = close(watcher_.epoll_fd);
+        assertErrno(result == 0);
+        watcher_.epoll_fd = -1;
+        return false;
+    }
+
+    epoll_event event { .events = EPOLLIN, .data = { .ptr = NULL } };
+    int result = epoll_ctl(watcher_.epoll_fd, EPOLL_CTL_ADD, watcher_.wake_fd, &event);
+    assertErrno(result == 0);
+
+    watcher_.watchlists = ArrayList<WatchlistImpl*>::withCapacity(4);
+    watcher_.should_quit = false;
+
+    result = pthread_create(&watcher_.thread, NULL, watcherThreadProcedure, NULL);
+    alwaysAssert(result == 0);
+
+    return true;
+}
+
+/// With `watcher_.mutex`, which it releases while it waits for the thread.
+static void stopWatcherThread(void) {
+
+    watcher_.should_quit = true;
+    const u64 one = 1;
+    ssize_t written_size = write(watcher_.wake_fd, &one, sizeof(one));
+    assertErrno(written_size == (ssize_t)sizeof(one));
+
+    int result = pthread_mutex_unlock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+    result = pthread_join(watcher_.thread, NULL);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_lock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+
+    result = close(watcher_.wake_fd);
+    assertErrno(result == 0);
+    result = close(watcher_.epoll_fd);
+    assertErrno(result == 0);
+    watcher_.wake_fd = -1;
+    watcher_.epoll_fd = -1;
+    watcher_.watchlists.free();
+}
+
+//
+// ===========================================================================================================
+//
+
 Watchlist createWatchlist(void) {
 
-    int inotify_fd = inotify_init1(IN_NONBLOCK);
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (inotify_fd < 0) {
         LOG_F(ERROR, "Failed to initialize inotify. errno %d, strerror: `%s`.", errno, strerror(errno));
         return NULL;
     }
 
-    WatchlistImpl* ptr = (WatchlistImpl*)mallocAsserted(sizeof(WatchlistImpl));
+    int result = pthread_mutex_lock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+
+    if (watcher_.epoll_fd < 0 and !startWatcherThread()) {
+        result = pthread_mutex_unlock(&watcher_.mutex);
+        alwaysAssert(result == 0);
+        result = close(inotify_fd);
+        assertErrno(result == 0);
+        return NULL;
+    }
+
+    WatchlistImpl* ptr = watchlist_pool_.alloc();
     *ptr = WatchlistImpl {
-        // TODO we should ditch ArrayList here and just use realloc or whatever. Then we can store all this in
-        // a struct WatchListImpl { int inotify_fd, u32 modified_file_count, FileID modified_files[] } where
-        // the end of the struct is variable-length and the whole struct is heap-allocated.
-        .modified_files = ArrayList<FileID>::withCapacity(1), // TODO weird arbitrary choice
         .inotify_fd = inotify_fd,
+        .pending = ArrayList<FileID>::withCapacity(8),
+        .modified_files = ArrayList<FileID>::withCapacity(8),
     };
 
+    epoll_event event { .events = EPOLLIN, .data = { .ptr = ptr } };
+    result = epoll_ctl(watcher_.epoll_fd, EPOLL_CTL_ADD, inotify_fd, &event);
+    assertErrno(result == 0);
+    watcher_.watchlists.push(ptr);
+
+    result = pthread_mutex_unlock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+
     return ptr;
 }
 
 void destroyWatchlist(Watchlist watchlist) {
 
-    int result = close(watchlist->inotify_fd);
+    int result = pthread_mutex_lock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+
+    result = epoll_ctl(watcher_.epoll_fd, EPOLL_CTL_DEL, watchlist->inotify_fd, NULL);
+    assertErrno(result == 0);
+
+    for (u32 i = 0; i < watcher_.watchlists.size; i++) {
+        if (watcher_.watchlists.ptr[i] != watchlist) continue;
+        watcher_.watchlists.ptr[i] = watcher_.watchlists.ptr[watcher_.watchlists.size - 1];
+        watcher_.watchlists.size--;
+        break;
+    }
+    if (watcher_.watchlists.size == 0) stopWatcherThread();
+
+    result = pthread_mutex_unlock(&watcher_.mutex);
+    alwaysAssert(result == 0);
+
+    result = close(watchlist->inotify_fd);
     assertErrno(result == 0);
 
+    watchlist->pending.free();
     watchlist->modified_files.free();
-    free(watchlist);
+    watchlist_pool_.dealloc(watchlist);
 }
 
 FileID addFileToModificationWatchlist(Watchlist watchlist, const char* filepath) {
@@ -75,6 +339,8 @@ FileID addFileToModificationWatchlist(Watchlist watchlist, const char* filepath)
     return (FileID)watch_descriptor;
 }
 
+/// Doesn't make any syscall: it only takes the events that the watcher thread has published, which happens once a
+/// file has stopped being written to for a moment. Each file is reported at most once per burst of writes.
 /// You do not own the returned buffer.
 /// The returned pointer is valid until one of the following occurs:
 /// - the next call to `poll()` on this watchlist
@@ -85,75 +351,34 @@ void poll(Watchlist watchlist, u32* event_count_out, const FileID** events_out)
 
     watchlist->modified_files.resetSize();
 
-    while (true) {
-
-        // The last member of `struct inotify_event` is a variable-length `char name[]`.
-        // `man 7 inotify` says that "`sizeof(struct inotify_event) + NAME_MAX + 1` will be sufficient".
-        constexpr size_t event_buffer_size = sizeof(inotify_event) + NAME_MAX + 1;
-        alignas(inotify_event) u8 event_buffer[event_buffer_size];
-
-        const ssize_t bytes_read_count = read(
-            watchlist->inotify_fd,
-            &event_buffer,
-            sizeof(inotify_event) + NAME_MAX + 1
-        );
-
-        if (bytes_read_count < 0) {
-            // EAGAIN means that the fd is marked nonblocking and the read would block. See `man 2 read`.
-            if (errno == EAGAIN) goto LABEL_EXIT_EVENT_READ_LOOP;
-            // TODO deal with EINTR?
-            else assertErrno(false);
-        }
-
-
-        u32 event_count = 0;
-        size_t buffer_pos = 0;
-        while (buffer_pos < (size_t)bytes_read_count) {
-            event_count++;
-            inotify_event* p_event = (inotify_event*)&event_buffer[buffer_pos];
-            buffer_pos += sizeof(inotify_event) + p_event->len;
-        }
-        watchlist->modified_files.reserveAdditional(event_count);
-
-        buffer_pos = 0;
-        while (buffer_pos < (size_t)bytes_read_count) {
-            inotify_event* p_event = (inotify_event*)&event_buffer[buffer_pos];
-            watchlist->modified_files.push((FileID)p_event->wd);
-            buffer_pos += sizeof(inotify_event) + p_event->len;
-        }
-    }
-    LABEL_EXIT_EVENT_READ_LOOP: {}
+    const u32 tail = __atomic_load_n(&watchlist->ring_tail, __ATOMIC_ACQUIRE);
+    u32 head = watchlist->ring_head;
+    watchlist->modified_files.reserve(tail - head);
+    for (; head != tail; head++) watchlist->modified_files.push(watchlist->ring[head % EVENT_RING_CAPACITY]);
+    __atomic_store_n(&watchlist->ring_head, head, __ATOMIC_RELEASE);
 
     *event_count_out = watchlist->modified_files.size;
     *events_out = watchlist->modified_files.ptr;
 }
 
+/// Discards the published events, and those that the watcher thread hasn't published yet.
 void clearEvents(Watchlist watchlist) {
 
     assert(watchlist->inotify_fd >= 0 && "Watchlist is invalid. Did you forget to initialize it by calling createWatchlist()?");
 
     watchlist->modified_files.resetSize();
 
-    while (true) {
-
-        // The last member of `struct inotify_event` is a variable-length `char name[]`.
-        // `man 7 inotify` says that "`sizeof(struct inotify_event) + NAME_MAX + 1` will be sufficient".
-        constexpr size_t event_buffer_size = sizeof(inotify_event) + NAME_MAX + 1;
-        alignas(inotify_event) u8 event_buffer[event_buffer_size];
+    int result = pthread_mutex_lock(&watcher_.mutex);
+    alwaysAssert(result == 0);
 
-        const ssize_t bytes_read_count = read(
-            watchlist->inotify_fd,
-            &event_buffer,
-            sizeof(inotify_event) + NAME_MAX + 1
-        );
+    // and the ones that the thread hasn't read yet
+    drainInotifyEvents(watchlist->inotify_fd, NULL);
+    watchlist->pending.resetSize();
+    const u32 tail = __atomic_load_n(&watchlist->ring_tail, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&watchlist->ring_head, tail, __ATOMIC_RELEASE);
 
-        if (bytes_read_count < 0) {
-            // EAGAIN means that the fd is marked nonblocking and the read would block. See `man 2 read`.
-            if (errno == EAGAIN) return;
-            // TODO deal with EINTR?
-            else assertErrno(false);
-        }
-    }
+    result = pthread_mutex_unlock(&watcher_.mutex);
+    alwaysAssert(result == 0);
 }
 
 //
@@ -161,4 +386,3 @@ void clearEvents(Watchlist watchlist) {
 //
 
 } // namespace
-
@@ -10,6 +10,8 @@ namespace filewatch {
 //
 
 using FileID = u32;
+/// Never returned by `addFileToModificationWatchlist()`.
+constexpr FileID INVALID_FILE_ID = UINT32_MAX;
 
 struct WatchlistImpl;
 using Watchlist = WatchlistImpl*;
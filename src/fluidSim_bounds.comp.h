@@ -0,0 +1,34 @@
+
+// Shared by the shaders that reduce particle positions to (min, max) bounds.
+//
+// Requires GL_KHR_shader_subgroup_arithmetic, and must be included after the workgroup size is declared.
+
+// One element per subgroup. The subgroup size isn't known at compile time, but it is at least 1.
+shared vec3 shared_min[gl_WorkGroupSize.x];
+shared vec3 shared_max[gl_WorkGroupSize.x];
+
+/// Must be called in uniform control flow. The result is only valid in invocation 0.
+void workgroupMinMax(inout vec3 v_min, inout vec3 v_max) {
+
+    v_min = subgroupMin(v_min);
+    v_max = subgroupMax(v_max);
+    if (subgroupElect())
+    {
+        shared_min[gl_SubgroupID] = v_min;
+        shared_max[gl_SubgroupID] = v_max;
+    }
+    barrier();
+
+    if (gl_SubgroupID == 0)
+    {
+        v_min = vec3(1.0f / 0.0f);
+        v_max = vec3(-1.0f / 0.0f);
+        for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups; i += gl_SubgroupSize)
+        {
+            v_min = min(v_min, shared_min[i]);
+            v_max = max(v_max, shared_max[i]);
+        }
+        v_min = subgroupMin(v_min);
+        v_max = subgroupMax(v_max);
+    }
+}
@@ -0,0 +1,83 @@
+// The grid of the FLIP mode (see `SimParameters::flip`), shared by `fluidSim_flip_transferToGrid.comp`,
+// `fluidSim_flip_solvePressure.comp` and the particle update.
+//
+// The grid is `resolution`^3 cells of the sim's cell size, from the domain origin, so grid cell (i, j, k) is the
+// spatial structure's cell (i, j, k). It's a MAC grid: each cell stores the velocity component along each axis on
+// its face towards the lower neighbor along that axis. The outermost layer of cells is always air, so every face
+// of a fluid cell is stored.
+//
+// `flip_grid_` holds, as floats, in this order:
+//  - the face velocities before and after the pressure projection; see `flipVelocityIdx`.
+//  - per level of the multigrid (`resolution >> level` cells per axis, down to 4), the FLIP_ARRAY_* arrays; see
+//    `flipLevelArrayIdx`. Level 0 is the grid itself.
+//  - the FLIP_CG_* arrays of the conjugate gradient solve, on level 0; see `flipCgArrayIdx`.
+//  - FLIP_SCALAR_COUNT scalars of the solve, then a partial sum per workgroup of level 0; see `flipScalarIdx`.
+// Must match `getFlipGridFloatCount()` in fluid_sim.cpp.
+
+layout(binding = 50, std430) buffer FlipGrid { float flip_grid_[]; };
+
+#define FLIP_VELOCITIES_BEFORE 0u
+#define FLIP_VELOCITIES_AFTER 1u
+
+#define FLIP_ARRAY_FLUID 0u // 1 for the fluid cells, 0 for the air
+#define FLIP_ARRAY_RHS 1u // the right-hand side: on level 0, the residual of the solve; below, the restricted one
+#define FLIP_ARRAY_Z0 2u // the correction that the V-cycle smooths, which ends up here
+#define FLIP_ARRAY_Z1 3u // and the other half of the Jacobi sweeps' ping-pong
+#define FLIP_ARRAY_COUNT 4u
+
+#define FLIP_CG_X 0u // the pressure, scaled so that a face's velocity drops by the difference across it
+#define FLIP_CG_P 1u // the search direction
+#define FLIP_CG_Q 2u // the Laplacian of the search direction
+#define FLIP_CG_ARRAY_COUNT 3u
+
+#define FLIP_SCALAR_RZ 0u // the dot product of the residual and its preconditioned correction
+#define FLIP_SCALAR_ALPHA 1u // the step along the search direction
+#define FLIP_SCALAR_BETA 2u // the weight of the previous search direction in the next one
+#define FLIP_SCALAR_COUNT 4u
+
+uint flipCellIdx(const uint level_resolution, const uvec3 cell) {
+    return cell.x + level_resolution * (cell.y + level_resolution * cell.z);
+}
+
+uvec3 flipCell(const uint level_resolution, const uint cell_idx) {
+    return uvec3(
+        cell_idx % level_resolution,
+        (cell_idx / level_resolution) % level_resolution,
+        cell_idx / (level_resolution * level_resolution)
+    );
+}
+
+uint flipLevelCount(const uint resolution) {
+    return uint(findMSB(resolution)) - 1u;
+}
+
+/// The cells of the levels above `level`.
+uint flipLevelOffset(const uint resolution, const uint level) {
+    uint offset = 0;
+    for (uint l = 0; l < level; l++)
+    {
+        const uint level_resolution = resolution >> l;
+        offset += level_resolution * level_resolution * level_resolution;
+    }
+    return offset;
+}
+
+uint flipVelocityIdx(const uint resolution, const uint set, const uint axis, const uint cell_idx) {
+    return (3u * set + axis) * (resolution * resolution * resolution) + cell_idx;
+}
+
+uint flipLevelArrayIdx(const uint resolution, const uint array, const uint level, const uint cell_idx) {
+    const uint level_cell_total = flipLevelOffset(resolution, flipLevelCount(resolution));
+    return 6u * (resolution * resolution * resolution) + array * level_cell_total
+        + flipLevelOffset(resolution, level) + cell_idx;
+}
+
+uint flipCgArrayIdx(const uint resolution, const uint array, const uint cell_idx) {
+    return flipLevelArrayIdx(resolution, FLIP_ARRAY_COUNT, 0u, 0u)
+        + array * (resolution * resolution * resolution) + cell_idx;
+}
+
+/// The partial sums follow the scalars: `flipScalarIdx(resolution, FLIP_SCALAR_COUNT + workgroup_idx)`.
+uint flipScalarIdx(const uint resolution, const uint scalar) {
+    return flipCgArrayIdx(resolution, FLIP_CG_ARRAY_COUNT, 0u) + scalar;
+}
@@ -0,0 +1,51 @@
+
+// Shared by the `fluidSim_radixSort_*.comp` stages.
+//
+// Least-significant-digit radix sort of (key, value) pairs, RADIX_SORT_BITS_PER_PASS bits per pass. Each pass
+// is three dispatches:
+//     1. histogram: each workgroup counts the digits in its tile of the input.
+//     2. scan: a single workgroup computes the exclusive prefix sum of all tile histograms, which gives each
+//        (digit, tile) pair its first output index.
+//     3. scatter: each workgroup writes its tile to the output, in stable order.
+// The histograms are stored digit-major (`histograms_[digit * tile_count + tile_idx]`), so that a single
+// linear scan over the whole array yields the global offsets.
+
+// The keys are Morton codes (see `fluidSim_util.comp.h`). A pass's digit never straddles the two words.
+
+#include "fluidSim_util.comp.h"
+
+// These must match the constants in fluid_sim.cpp.
+#define RADIX_SORT_BITS_PER_PASS 8
+#define RADIX_SORT_BUCKET_COUNT (1 << RADIX_SORT_BITS_PER_PASS)
+#define RADIX_SORT_ITEMS_PER_INVOCATION 16
+
+layout(binding = 0, std430) readonly buffer KeysIn { uint keys_in_[]; };
+layout(binding = 1, std430) readonly buffer ValuesIn { uint values_in_[]; };
+layout(binding = 2, std430) writeonly buffer KeysOut { uint keys_out_[]; };
+layout(binding = 3, std430) writeonly buffer ValuesOut { uint values_out_[]; };
+layout(binding = 4, std430) buffer Histograms { uint histograms_[]; };
+// Must match `RadixSortState` in fluid_sim.cpp. Each `*_dispatch_` is a `VkDispatchIndirectCommand`.
+layout(binding = 5, std430) buffer SortState {
+    // The number of `i` such that `keys_in_[i] > keys_in_[i + 1]`, before the sort.
+    uint descent_count_;
+    uint tiles_dispatch_[3];
+    uint single_workgroup_dispatch_[3];
+    uint identity_dispatch_[3];
+};
+
+layout(push_constant, std140) uniform PushConstants {
+    uint array_size_;
+    uint bit_shift_;
+    uint tile_count_;
+    // If nonzero, `values_in_` is ignored and each key's value is its index in the input.
+    uint is_first_pass_;
+};
+
+uint radixSortTileSize(void) {
+    return gl_WorkGroupSize.x * RADIX_SORT_ITEMS_PER_INVOCATION;
+}
+
+uint radixSortDigit(uvec2 key) {
+    const uint word = (bit_shift_ < 32) ? key.x : key.y;
+    return (word >> (bit_shift_ % 32)) & (RADIX_SORT_BUCKET_COUNT - 1);
+}
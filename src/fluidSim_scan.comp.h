@@ -0,0 +1,19 @@
+
+// Shared by the `fluidSim_scan_*.comp` stages.
+//
+// In-place exclusive prefix sum of a u32 array, in three dispatches:
+//     1. blocks: each workgroup scans its block of `gl_WorkGroupSize.x` elements, and writes the block's
+//        total to `block_sums_`.
+//     2. blockSums: a single workgroup scans `block_sums_`.
+//     3. addBlockOffsets: each workgroup adds its block's offset to its elements.
+
+layout(binding = 0, std430) buffer Data { uint data_[]; };
+layout(binding = 1, std430) buffer BlockSums { uint block_sums_[]; };
+
+layout(push_constant, std140) uniform PushConstants {
+    uint array_size_;
+};
+
+uint scanBlockCount(void) {
+    return (array_size_ + gl_WorkGroupSize.x - 1) / gl_WorkGroupSize.x;
+}
@@ -0,0 +1,1176 @@
+
+// Shared by the `fluidSim_updateParticles*.comp` kernels.
+//
+// Data structure reference:
+//     "Multi-Level Memory Structures for Simulating and Rendering Smoothed Particle Hydrodynamics"
+//     by R. Winchenbach and A. Kolb.
+//
+// Requires GL_KHR_shader_subgroup_arithmetic, and must be included after the workgroup size is declared.
+
+#include "fluidSim_util.comp.h"
+#include "fluidSim_bounds.comp.h"
+#include "fluidSim_flip.comp.h"
+
+layout(binding = 0, std140) uniform Uniforms {
+
+    // stuff that may change every frame
+    vec3 domain_min_;
+
+    // stuff whose lifetime is the lifetime of the sim parameters
+    float rest_particle_density_;
+    float particle_interaction_radius_;
+    float spring_rest_length_;
+    float spring_stiffness_;
+    float cell_size_reciprocal_;
+
+    // stuff whose lifetime is the lifetime of the sim
+    uint particle_count_;
+    uint hash_table_size_;
+    uint particle_capacity_; // the stride of the velocity arrays
+    uint half_velocities_; // see "Particle layout" in `fluidSim_util.comp.h`
+    uint particle_ids_; // nonzero if the particles have ids, which are copied to `particle_ids_out_`
+    uint particle_levels_; // nonzero if the particles have levels, which are copied to `particle_levels_out_`
+
+    // Only read by the particle update kernels; see `SimParameters::sph`, `SimParameters::pbf` and
+    // `SimParameters::flip`.
+    float sph_stiffness_;
+    float sph_viscosity_;
+    float sph_density_kernel_coefficient_;
+    float sph_gradient_kernel_coefficient_;
+    float pbf_relaxation_epsilon_; // 1/m^2
+    float flip_ratio_;
+    uint flip_grid_resolution_; // 0 if there is no grid
+};
+
+// If nonzero, the sim parameters below are baked into the pipeline, and their copies in the uniform buffer are
+// ignored. Must match `ComputeShaderSpecializationConstants` in fluid_sim.cpp.
+layout(constant_id = 3) const uint BAKED_SIM_PARAMS = 0;
+layout(constant_id = 4) const float BAKED_PARTICLE_INTERACTION_RADIUS = 0.0f;
+layout(constant_id = 5) const float BAKED_SPRING_REST_LENGTH = 0.0f;
+layout(constant_id = 6) const float BAKED_SPRING_STIFFNESS = 0.0f;
+layout(constant_id = 7) const float BAKED_CELL_SIZE_RECIPROCAL = 0.0f;
+// The particles per chunk of the chunked buffers, as a power of two; 0 if there is only one chunk. See
+// `ChunkedGpuBuffer` in fluid_sim_types.hpp.
+layout(constant_id = 17) const uint PARTICLE_CHUNK_SHIFT = 0;
+
+#define PARTICLE_INTERACTION_RADIUS \
+    ((BAKED_SIM_PARAMS != 0) ? BAKED_PARTICLE_INTERACTION_RADIUS : particle_interaction_radius_)
+#define SPRING_REST_LENGTH ((BAKED_SIM_PARAMS != 0) ? BAKED_SPRING_REST_LENGTH : spring_rest_length_)
+// In an ensemble, the particle's member has its own, in `ensemble_member_params_`.
+#define SPRING_STIFFNESS ( \
+    (ensemble_member_count_ != 0) ? ensemble_member_params_.x \
+    : (BAKED_SIM_PARAMS != 0) ? BAKED_SPRING_STIFFNESS : spring_stiffness_)
+#define SPH_STIFFNESS ((ensemble_member_count_ != 0) ? ensemble_member_params_.y : sph_stiffness_)
+#define SPH_VISCOSITY ((ensemble_member_count_ != 0) ? ensemble_member_params_.z : sph_viscosity_)
+#define CELL_SIZE_RECIPROCAL ((BAKED_SIM_PARAMS != 0) ? BAKED_CELL_SIZE_RECIPROCAL : cell_size_reciprocal_)
+
+// See "Particle layout" in `fluidSim_util.comp.h`.
+layout(binding = 1, std430) readonly buffer PositionsIn { vec4 positions_in_[]; };
+layout(binding = 2, std430) readonly buffer VelocitiesIn { uint velocities_in_[]; };
+layout(binding = 3, std430) writeonly buffer PositionsOut { vec4 positions_out_[]; };
+layout(binding = 4, std430) writeonly buffer VelocitiesOut { uint velocities_out_[]; };
+// (first particle, particle count) per cell, in hash order; (first cell, cell count) per hash bucket
+layout(binding = 5, std430) readonly buffer Cells { uvec2 cells_[]; };
+layout(binding = 6, std430) readonly buffer HashBuckets { uvec2 hash_buckets_[]; };
+layout(binding = 10, std430) writeonly buffer MortonCodes { uint morton_codes_[]; };
+layout(binding = 11, std430) readonly buffer CellCount { uint cell_count_; };
+// The index of each particle's cell in the Morton-ordered cell list.
+layout(binding = 12, std430) readonly buffer CellIndices { uint cell_indices_[]; };
+layout(binding = 13, std430) readonly buffer CBeginMortonOrder { uint C_begin_morton_order_[]; };
+layout(binding = 16, std430) readonly buffer PositionsReference { vec3 positions_reference_[]; };
+// One (min, max) pair per workgroup.
+layout(binding = 18, std430) writeonly buffer ReductionPartials { vec4 reduction_partials_[]; };
+// Must match the constant of the same name in fluid_sim_types.hpp.
+#define MAX_BUFFER_CHUNK_COUNT 8
+// `neighbor_list_capacity_` indices per particle, written by `fluidSim_buildNeighborLists`. Chunked; only access
+// them through `loadNeighborListEntry` and `storeNeighborListEntry`.
+layout(binding = 19, std430) buffer NeighborLists { uint entries[]; } neighbor_list_chunks_[MAX_BUFFER_CHUNK_COUNT];
+// The number of neighbors that each particle has, which can exceed `neighbor_list_capacity_`; in that case its
+// list is incomplete.
+layout(binding = 20, std430) buffer NeighborCounts { uint neighbor_counts_[]; };
+// The number of particles whose list is incomplete. Must be 0 before `fluidSim_buildNeighborLists`.
+layout(binding = 21, std430) buffer NeighborListOverflow { uint neighbor_list_overflow_count_; };
+// `positions_in_`, relative to each particle's cell; see `quantizePosition`.
+layout(binding = 22, std430) readonly buffer PositionsQuantized { uvec2 positions_quantized_[]; };
+// See CELL_SLOT_EMPTY. Only used if OPEN_ADDRESSING_CELL_TABLE.
+layout(binding = 23, std430) readonly buffer CellSlots { uvec4 cell_slots_[]; };
+// The Morton code of each cell in the Morton-ordered cell list, so in increasing order. Only used by
+// `interactionsWithMortonRanges`, which the host doesn't select with `HILBERT_CELL_ORDER`.
+layout(binding = 24, std430) readonly buffer CellCodesMortonOrder { uvec2 cell_codes_morton_order_[]; };
+// The time step of each slot; written by the host before each submission, so that a recorded step can be
+// resubmitted with a different one.
+layout(binding = 26, std430) readonly buffer DeltaTs { float delta_ts_[]; };
+// The collider's bricks by coordinate; see COLLIDER_SLOT_EMPTY.
+layout(binding = 27, std430) readonly buffer ColliderSlots { ivec4 collider_slots_[]; };
+// COLLIDER_BRICK_SAMPLE_COUNT signed distances per brick; see `ColliderBrick` in fluid_sim_types.hpp.
+layout(binding = 28, std430) readonly buffer ColliderDistances { float collider_distances_[]; };
+// The SPH density of each particle; written by `fluidSim_computeDensities`, and read by the update after it. In the
+// PBF mode, the constraint multiplier of each particle instead; written by the SPH_PASS_PBF_MULTIPLIERS pass.
+layout(binding = 29, std430) buffer Densities { float densities_[]; };
+// Must match `MaxMotion` in fluid_sim.cpp: `floatBitsToUint` of the max speed and acceleration of the steps of each
+// `delta_ts_` slot, so that they can be reduced with `atomicMax`. Cleared by the host.
+layout(binding = 30, std430) buffer MaxMotion { uvec2 max_motion_bits_[]; };
+// Must match `Diagnostics` in fluid_sim.cpp: DIAGNOSTICS_WORD_COUNT words per `delta_ts_` slot, at these offsets.
+// The sums are 64-bit two's complement fixed point, as (low, high) words. Cleared by the host.
+layout(binding = 53, std430) buffer Diagnostics { uint diagnostics_[]; };
+#define DIAGNOSTICS_WORD_COUNT 12u
+#define DIAGNOSTICS_MOMENTUM 0u // 3 sums
+#define DIAGNOSTICS_KINETIC_ENERGY 6u
+#define DIAGNOSTICS_MAX_DENSITY_BITS 8u
+#define DIAGNOSTICS_ESCAPED_COUNT 9u
+#define DIAGNOSTICS_STEP_COUNT 10u
+#define DIAGNOSTICS_FIXED_POINT_SCALE 1048576.0f // 2^20
+// Per particle, in the order of `positions_in_` and `positions_out_`: the steps since it last moved faster than
+// `sleep_speed_` or accelerated faster than `sleep_acceleration_`, up to `sleep_step_count_`. Only maintained in
+// the sleeping mode (see `SimParameters::sleeping`).
+layout(binding = 31, std430) readonly buffer CalmStepsIn { uint calm_steps_in_[]; };
+layout(binding = 32, std430) writeonly buffer CalmStepsOut { uint calm_steps_out_[]; };
+// Per cell of the Morton-ordered cell list: nonzero if any of its particles has been calm for fewer than
+// `sleep_step_count_` steps; written by `fluidSim_sortParticles`.
+layout(binding = 33, std430) buffer CellAwake { uint cell_awake_[]; };
+// Per cell of the Morton-ordered cell list: nonzero if it or any of the 26 cells around it is awake; written by
+// `fluidSim_sleep_markActiveCells`. The particles of the other cells sleep.
+layout(binding = 34, std430) buffer CellActive { uint cell_active_[]; };
+// The particles of the active cells, in no particular order, which the update runs on in the sleeping mode.
+layout(binding = 35, std430) buffer ActiveParticles { uint active_particles_[]; };
+// Must match `SleepState` in fluid_sim.cpp. Written by `fluidSim_sleep_compactParticles`.
+layout(binding = 36, std430) buffer SleepState {
+    uint active_particle_count_;
+    // the dispatch of the update, with an invocation per active particle
+    uint active_particles_dispatch_[3];
+};
+// See `createEnsemble()` in fluid_sim.cpp. Per member: the spring stiffness, the SPH stiffness and the SPH viscosity;
+// must match `EnsembleMemberParams` there. Per particle, in the order of `positions_in_` and `positions_out_`: its
+// member, which only interacts with itself.
+layout(binding = 37, std430) readonly buffer EnsembleMembers { vec4 ensemble_members_[]; };
+layout(binding = 38, std430) readonly buffer MemberIdsIn { uint member_ids_in_[]; };
+layout(binding = 39, std430) writeonly buffer MemberIdsOut { uint member_ids_out_[]; };
+// See `SimParameters::particle_ids`; in the same order as `member_ids_in_` and `member_ids_out_`.
+layout(binding = 40, std430) readonly buffer ParticleIdsIn { uint particle_ids_in_[]; };
+layout(binding = 41, std430) writeonly buffer ParticleIdsOut { uint particle_ids_out_[]; };
+// See `SimParameters::pbf`: two halves of `particle_capacity_` predicted positions, in the order of `positions_in_`;
+// the PBF passes read the half at `pbf_positions_offset_`, and the correction pass writes the other one.
+layout(binding = 47, std430) buffer PbfPositions { vec4 pbf_positions_[]; };
+// See `SimParameters::adaptive_resolution`; in the same order as `particle_ids_in_` and `particle_ids_out_`.
+layout(binding = 48, std430) readonly buffer ParticleLevelsIn { uint particle_levels_in_[]; };
+layout(binding = 49, std430) writeonly buffer ParticleLevelsOut { uint particle_levels_out_[]; };
+
+layout(push_constant, std140) uniform PushConstants {
+
+    // this step's slot of `delta_ts_`
+    uint delta_t_slot_;
+    // Nonzero if the spatial structure was built from `positions_reference_` rather than `positions_in_`
+    // (Verlet skin mode).
+    uint use_reference_positions_;
+    // If nonzero, also write the Morton codes of the new positions (relative to the current `domain_min_`), and
+    // each workgroup's bounds of the new positions, for `fluidSim_updateDomainOrigin`.
+    uint write_morton_codes_;
+    // If nonzero, use the neighbor lists instead of traversing the cells, for the particles whose list is
+    // complete.
+    uint use_neighbor_lists_;
+    uint neighbor_list_capacity_;
+    // The lists contain the particles within this distance of each other, measured at `cellLookupPosition`.
+    float neighbor_list_cutoff_; // m
+    // If nonzero, the cell traversal reads the other particles' positions from `positions_quantized_`, which
+    // is half the size. The particle's own position, and the integration, still use `positions_in_`.
+    uint use_quantized_positions_;
+    // The size of `cell_slots_`, a power of two, not counting the header (see CELL_TABLE_DENSE).
+    uint cell_slot_count_;
+    // If nonzero, the cell traversal walks the Morton-ordered cell list instead of looking up each cell; see
+    // `interactionsWithMortonRanges`.
+    uint use_morton_ranges_;
+    // If above 1, the cell traversal may use the coarser levels of cells; see `interactionsWithCellLevels`.
+    uint cell_level_count_;
+    uint sparse_cell_particle_count_;
+    // The size of `collider_slots_`, a power of two; 0 if there is no collider to collide with.
+    uint collider_slot_count_;
+    float collider_cell_size_reciprocal_;
+    // one of the SPH_PASS_* constants
+    uint sph_pass_;
+    uint pbf_positions_offset_; // in particles
+    // if nonzero, `finishParticleUpdate` reduces into `max_motion_bits_[delta_t_slot_]`
+    uint track_max_motion_;
+    // if nonzero, `finishParticleUpdate` reduces into slot `delta_t_slot_` of `diagnostics_`
+    uint track_diagnostics_;
+    // If nonzero, the sleeping mode: the update only runs on `active_particles_`, and tracks `calm_steps_out_`.
+    uint sleep_step_count_;
+    float sleep_speed_; // m/s
+    float sleep_acceleration_; // m/s^2
+    // 0 unless the sim is an ensemble
+    uint ensemble_member_count_;
+    // one of the PERSISTENT_PASS_* constants of `fluidSim_updateParticlesPersistent.comp`; only read there
+    uint persistent_pass_;
+};
+
+// The chunk of the chunked buffers that holds the particle, and its index in that chunk.
+uint particleChunk(const uint particle_idx) {
+    return (PARTICLE_CHUNK_SHIFT == 0) ? 0 : particle_idx >> PARTICLE_CHUNK_SHIFT;
+}
+uint particleIndexInChunk(const uint particle_idx) {
+    return (PARTICLE_CHUNK_SHIFT == 0) ? particle_idx : particle_idx & ((1u << PARTICLE_CHUNK_SHIFT) - 1);
+}
+
+// Entry `k` of the particle's neighbor list. The chunk is selected with a switch, because indexing the array of
+// buffers with a non-constant index would need `shaderStorageBufferArrayDynamicIndexing`, and the particle index
+// isn't uniform anyway.
+uint loadNeighborListEntry(const uint particle_idx, const uint k) {
+    const uint i = particleIndexInChunk(particle_idx) * neighbor_list_capacity_ + k;
+    switch (particleChunk(particle_idx))
+    {
+        case 0: return neighbor_list_chunks_[0].entries[i];
+        case 1: return neighbor_list_chunks_[1].entries[i];
+        case 2: return neighbor_list_chunks_[2].entries[i];
+        case 3: return neighbor_list_chunks_[3].entries[i];
+        case 4: return neighbor_list_chunks_[4].entries[i];
+        case 5: return neighbor_list_chunks_[5].entries[i];
+        case 6: return neighbor_list_chunks_[6].entries[i];
+        default: return neighbor_list_chunks_[7].entries[i];
+    }
+}
+void storeNeighborListEntry(const uint particle_idx, const uint k, const uint value) {
+    const uint i = particleIndexInChunk(particle_idx) * neighbor_list_capacity_ + k;
+    switch (particleChunk(particle_idx))
+    {
+        case 0: neighbor_list_chunks_[0].entries[i] = value; break;
+        case 1: neighbor_list_chunks_[1].entries[i] = value; break;
+        case 2: neighbor_list_chunks_[2].entries[i] = value; break;
+        case 3: neighbor_list_chunks_[3].entries[i] = value; break;
+        case 4: neighbor_list_chunks_[4].entries[i] = value; break;
+        case 5: neighbor_list_chunks_[5].entries[i] = value; break;
+        case 6: neighbor_list_chunks_[6].entries[i] = value; break;
+        default: neighbor_list_chunks_[7].entries[i] = value; break;
+    }
+}
+
+// What `interactionWithParticle` computes. Must match `SphPass` in fluid_sim.cpp.
+#define SPH_PASS_NONE 0u // the springs' acceleration
+#define SPH_PASS_DENSITY 1u // the SPH density
+#define SPH_PASS_FORCES 2u // the SPH pressure and viscosity acceleration, from `densities_`
+// The PBF passes; see `fluidSim_solveDensityConstraints.comp`.
+#define SPH_PASS_PBF_PREDICT 3u // nothing; the pass doesn't traverse the neighbors
+#define SPH_PASS_PBF_MULTIPLIERS 4u // the constraint gradient in xyz and the density share in w, at the predictions
+#define SPH_PASS_PBF_CORRECT 5u // the position correction, from `densities_`, at the predictions
+#define SPH_PASS_PBF_FINISH 6u // the acceleration towards the corrected prediction; see `pbfAcceleration`
+// The FLIP passes; see `fluidSim_flip_transferToGrid.comp` and `fluidSim_flip_solvePressure.comp`.
+#define SPH_PASS_FLIP_TRANSFER 7u // nothing; the pass gathers per grid cell
+#define SPH_PASS_FLIP_FINISH 8u // the acceleration to the velocity from the grid; see `flipAcceleration`
+
+// Must match the constants of the same names in fluid_sim_types.hpp and fluid_sim.cpp. Each slot of
+// `collider_slots_` is the brick coordinate and the brick index; empty slots have COLLIDER_SLOT_EMPTY as the
+// index. Collisions are resolved by linear probing.
+#define COLLIDER_BRICK_SIZE_LOG2 3
+#define COLLIDER_BRICK_SAMPLES_PER_AXIS 9u
+#define COLLIDER_BRICK_SAMPLE_COUNT (9u * 9u * 9u)
+#define COLLIDER_SLOT_EMPTY (-1)
+
+
+/// The position that the spatial structure was built from. Cell lookups must use this, not the current
+/// position.
+vec3 cellLookupPosition(const uint particle_idx) {
+    return (use_reference_positions_ != 0)
+        ? positions_reference_[particle_idx]
+        : positions_in_[particle_idx].xyz;
+}
+
+/// The mass of particle `particle_idx`, in particles of the finest level; see `SimParameters::adaptive_resolution`.
+float particleMass(const uint particle_idx) {
+    return (particle_levels_ != 0) ? float(1u << particle_levels_in_[particle_idx]) : 1.0f;
+}
+
+/// The position that the particle interacts at: the current one, or, in the PBF constraint passes, the predicted
+/// one. `sph_pass_` is uniform, so this doesn't diverge.
+vec3 interactionPosition(const uint particle_idx) {
+    return (sph_pass_ == SPH_PASS_PBF_MULTIPLIERS || sph_pass_ == SPH_PASS_PBF_CORRECT)
+        ? pbf_positions_[pbf_positions_offset_ + particle_idx].xyz
+        : positions_in_[particle_idx].xyz;
+}
+
+// The particle whose interactions `interactionsWithNeighbors` sums; set there, for `userPairAcceleration`.
+uint interacting_particle_idx_;
+
+#include "fluidSim_userForces.comp.h"
+
+
+struct CompactCell {
+    uint first_particle_idx;
+    uint particle_count;
+};
+
+/// Each probe is a single 16-byte read, and there is no need to read any particle positions. In a dense grid (see
+/// CELL_TABLE_DENSE), there is only one, of the cell's own slot, after the read of the header.
+CompactCell cell3dToCellOpenAddressing(const uvec3 cell_idx_3d, const uvec2 morton_code) {
+
+    CompactCell ret;
+    ret.first_particle_idx = 0xFFFFFFFF;
+    ret.particle_count = 0;
+
+    if (DENSE_CELL_GRID != 0)
+    {
+        const uvec4 header = cell_slots_[cell_slot_count_];
+        if (header.w == CELL_TABLE_DENSE)
+        {
+            const uint slot_idx = denseCellSlot(cell_idx_3d, header);
+            if (slot_idx == CELL_SLOT_EMPTY) return ret;
+
+            const uvec4 slot = cell_slots_[slot_idx];
+            if (slot.z == CELL_SLOT_EMPTY) return ret;
+            ret.first_particle_idx = slot.z;
+            ret.particle_count = slot.w;
+            return ret;
+        }
+    }
+
+    // The table is never full, so this finds an empty slot if the cell doesn't exist.
+    uint slot_idx = mortonCodeHash(morton_code, cell_slot_count_);
+    while (true)
+    {
+        const uvec4 slot = cell_slots_[slot_idx];
+        if (slot.z == CELL_SLOT_EMPTY) return ret;
+        if (slot.xy == morton_code)
+        {
+            ret.first_particle_idx = slot.z;
+            ret.particle_count = slot.w;
+            return ret;
+        }
+
+        slot_idx = (slot_idx + 1) & (cell_slot_count_ - 1);
+    }
+}
+
+CompactCell cell3dToCell(const uvec3 cell_idx_3d, const vec3 domain_min) {
+
+    const uvec2 morton_code = cellMortonCode(cell_idx_3d);
+    if (OPEN_ADDRESSING_CELL_TABLE != 0) return cell3dToCellOpenAddressing(cell_idx_3d, morton_code);
+
+    // (first cell with the hash, cell count), then (first particle, particle count) per probe: one load each
+    const uvec2 bucket = hash_buckets_[mortonCodeHash(morton_code, hash_table_size_)];
+
+    CompactCell ret;
+    ret.first_particle_idx = 0xFFFFFFFF;
+    ret.particle_count = 0;
+
+    if (bucket.y == 0) return ret;
+
+    uint cell_idx = bucket.x;
+    const uint cell_idx_end = cell_idx + bucket.y;
+
+    for (; cell_idx < cell_idx_end; cell_idx++)
+    {
+        const uvec2 cell = cells_[cell_idx];
+
+        const vec3 first_particle_in_cell = cellLookupPosition(cell.x);
+        if (
+            cellMortonCode(cellIndex(first_particle_in_cell, domain_min, CELL_SIZE_RECIPROCAL))
+            == morton_code
+        ) {
+            ret.first_particle_idx = cell.x;
+            ret.particle_count = cell.y;
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+CompactCell particleToCell(const vec3 particle, const vec3 domain_min) {
+
+    const uvec3 cell_idx_3d = cellIndex(particle, domain_min, CELL_SIZE_RECIPROCAL);
+    return cell3dToCell(cell_idx_3d, domain_min);
+}
+
+// Of the particle whose interactions `interactionsWithNeighbors` sums, in an ensemble; set there, like
+// `sph_velocity_` below.
+uint ensemble_member_;
+vec4 ensemble_member_params_;
+
+/// The acceleration of a particle at `pos` due to a different particle at `other_pos`.
+vec3 accelerationDueToParticle(const vec3 pos, const vec3 other_pos) {
+
+    vec3 disp = minimumImage(other_pos - pos);
+    float dist = length(disp);
+
+    if (dist >= PARTICLE_INTERACTION_RADIUS) return vec3(0.0f);
+    vec3 disp_unit = disp / dist;
+    if (dist < 1e-7) return vec3(0.0f); // OPTIMIZE remove this check?
+
+    return SPRING_STIFFNESS * (dist - SPRING_REST_LENGTH) * disp_unit;
+}
+
+/// The SPH density kernel; `dist_sq` must be less than the squared interaction radius.
+float sphDensityKernel(const float dist_sq) {
+    const float d = PARTICLE_INTERACTION_RADIUS * PARTICLE_INTERACTION_RADIUS - dist_sq;
+    return sph_density_kernel_coefficient_ * d * d * d;
+}
+
+/// The pressure over the squared density, which is what the symmetric SPH pressure force sums.
+float sphPressureTerm(const float density) {
+    return SPH_STIFFNESS * max(density - rest_particle_density_, 0.0f) / (density * density);
+}
+
+// Of the particle whose interactions `interactionsWithNeighbors` sums, in the SPH_PASS_FORCES pass; set there,
+// so they are read once per particle rather than once per pair.
+vec3 sph_velocity_;
+float sph_pressure_term_;
+
+// Of the particle whose interactions `interactionsWithNeighbors` sums: in the SPH_PASS_PBF_MULTIPLIERS pass, the
+// sum of the squared kernel gradients, which `interactionWithParticle` accumulates, since the vec4 that it returns
+// is full; in the SPH_PASS_PBF_CORRECT pass, the particle's multiplier, and its mass, set there.
+float pbf_gradient_sq_sum_;
+float pbf_multiplier_;
+float pbf_mass_;
+
+/// The PBF interaction of a particle with a different particle, `other_idx`, `disp` away and within the
+/// interaction radius: in the SPH_PASS_PBF_MULTIPLIERS pass, the gradient of the spiky kernel with respect to the
+/// particle in xyz, and `kernel`, the other particle's share of the density, in w; in the SPH_PASS_PBF_CORRECT
+/// pass, the sum of their multipliers times that gradient, which moves the particle away from the other one if the
+/// pair is compressed. Each is weighted by `other_mass`, and the particle's own multiplier by the inverse of its own
+/// mass, as the position-based dynamics weights the corrections.
+vec4 pbfInteractionWithParticle(
+    const vec3 disp,
+    const float dist_sq,
+    const float kernel,
+    const uint other_idx,
+    const float other_mass
+) {
+
+    // towards the other particle; coincident particles have no direction to move each other in
+    vec3 gradient = vec3(0.0f);
+    const float dist = sqrt(dist_sq);
+    if (dist >= 1e-7)
+    {
+        const float radius_minus_dist = PARTICLE_INTERACTION_RADIUS - dist;
+        gradient = (sph_gradient_kernel_coefficient_ * radius_minus_dist * radius_minus_dist / dist) * disp;
+    }
+
+    if (sph_pass_ == SPH_PASS_PBF_CORRECT)
+    {
+        return vec4((pbf_multiplier_ * other_mass / pbf_mass_ + densities_[other_idx]) * gradient, 0.0f);
+    }
+
+    pbf_gradient_sq_sum_ += other_mass * dot(gradient, gradient);
+    return other_mass * vec4(gradient, kernel);
+}
+
+/// The interaction of a particle at `pos` with a different particle, `other_idx`, at `other_pos`: the
+/// acceleration in xyz, or, in the SPH_PASS_DENSITY pass, the other particle's share of the density in w; or, in
+/// the PBF constraint passes, see `pbfInteractionWithParticle`. Each is weighted by the other particle's mass, so
+/// that the pairs' forces on each other are equal and opposite.
+vec4 interactionWithParticle(const vec3 pos, const uint other_idx, const vec3 other_pos) {
+
+    // the members of an ensemble are independent sims, even where their particles meet
+    if (ensemble_member_count_ != 0 && member_ids_in_[other_idx] != ensemble_member_) return vec4(0.0f);
+
+    const float other_mass = particleMass(other_idx);
+    if (sph_pass_ == SPH_PASS_NONE)
+    {
+        vec3 spring_accel = accelerationDueToParticle(pos, other_pos);
+#ifdef USER_PAIR_ACCELERATION
+        const vec3 spring_disp = minimumImage(other_pos - pos);
+        const float spring_dist_sq = dot(spring_disp, spring_disp);
+        if (spring_dist_sq < PARTICLE_INTERACTION_RADIUS * PARTICLE_INTERACTION_RADIUS)
+        {
+            spring_accel += userPairAcceleration(interacting_particle_idx_, other_idx, spring_disp, spring_dist_sq);
+        }
+#endif
+        return vec4(other_mass * spring_accel, 0.0f);
+    }
+
+    const vec3 disp = minimumImage(other_pos - pos);
+    const float dist_sq = dot(disp, disp);
+    const float radius = PARTICLE_INTERACTION_RADIUS;
+    if (dist_sq >= radius * radius) return vec4(0.0f);
+
+    const float kernel = sphDensityKernel(dist_sq);
+    if (sph_pass_ == SPH_PASS_DENSITY) return vec4(0.0f, 0.0f, 0.0f, other_mass * kernel);
+    if (sph_pass_ != SPH_PASS_FORCES) return pbfInteractionWithParticle(disp, dist_sq, kernel, other_idx, other_mass);
+
+    const float other_density = densities_[other_idx];
+    vec3 accel = vec3(0.0f);
+
+    // -(p_i / rho_i^2 + p_j / rho_j^2) times the kernel gradient, which points from the other particle to this
+    // one; coincident particles have no direction to push each other in
+    const float dist = sqrt(dist_sq);
+    if (dist >= 1e-7)
+    {
+        const float pressure_term = sph_pressure_term_ + sphPressureTerm(other_density);
+        const float radius_minus_dist = radius - dist;
+        accel -= (pressure_term * sph_gradient_kernel_coefficient_ * radius_minus_dist * radius_minus_dist / dist)
+            * disp;
+    }
+
+    const vec3 other_velocity = LOAD_VELOCITY(velocities_in_, other_idx, particle_capacity_, half_velocities_);
+    accel += (SPH_VISCOSITY * kernel / other_density) * (other_velocity - sph_velocity_);
+#ifdef USER_PAIR_ACCELERATION
+    accel += userPairAcceleration(interacting_particle_idx_, other_idx, disp, dist_sq);
+#endif
+
+    return vec4(other_mass * accel, 0.0f);
+}
+
+vec4 interactionsWithParticlesInCell(
+    const uint target_particle_idx,
+    const uvec3 cell_idx_3d,
+    const vec3 domain_min
+) {
+
+    const CompactCell cell = cell3dToCell(cell_idx_3d, domain_min);
+    if (cell.particle_count == 0) return vec4(0.0f); // cell doesn't exist
+
+    const vec3 pos = interactionPosition(target_particle_idx);
+
+    vec4 sum = vec4(0.0f);
+
+    uint i = cell.first_particle_idx;
+    const uint i_end = i + cell.particle_count;
+
+    for (; i < i_end; i++)
+    {
+        // OPTIMIZE: we can remove this check if we know that none of the particles are the target particle.
+        //     E.g. if the particle list comes from a different cell than the target particle.
+        if (i == target_particle_idx) continue;
+
+        const vec3 other_pos = (use_quantized_positions_ != 0)
+            ? dequantizePosition(positions_quantized_[i], cell_idx_3d, domain_min, CELL_SIZE_RECIPROCAL)
+            : interactionPosition(i);
+
+        sum += interactionWithParticle(pos, i, other_pos);
+    }
+
+    return sum;
+}
+
+/// Along the periodic axes, the cells wrap around the box; see `periodicCellCounts`.
+uvec3 offsetCell(uvec3 cell_idx, int x, int y, int z) {
+
+    // OPTIMIZE: 
+    //     1. figure out whether wrapping behavior is guaranteed for unsigned ints.
+    //     2. if yes, delete this function and just do `cell_idx + uvec3(x, y, z)` at the call site.
+
+    const uvec3 cell_idx_in = cell_idx;
+
+    if (x == -1 && cell_idx.x == 0) cell_idx.x = 0xFFFFFFFF;
+    else cell_idx.x += x;
+
+    if (y == -1 && cell_idx.y == 0) cell_idx.y = 0xFFFFFFFF;
+    else cell_idx.y += y;
+
+    if (z == -1 && cell_idx.z == 0) cell_idx.z = 0xFFFFFFFF;
+    else cell_idx.z += z;
+
+    if (PERIODIC_AXES != 0)
+    {
+        const uvec3 counts = periodicCellCounts(CELL_SIZE_RECIPROCAL);
+        // `uvec3(ivec3(-1))` wraps to `counts - 1` once added to `counts`
+        const uvec3 wrapped = (cell_idx_in + counts + uvec3(ivec3(x, y, z))) % counts;
+        cell_idx = mix(cell_idx, wrapped, periodicAxes());
+    }
+
+    return cell_idx;
+}
+
+/// The sum of `interactionWithParticle` over the particles in particle `particle_idx`'s own cell and the 26
+/// cells around it.
+vec4 interactionsWithNeighborCells(const uint particle_idx) {
+
+    vec4 sum = vec4(0);
+
+    const uvec3 cell_index_3d = cellIndex(cellLookupPosition(particle_idx), domain_min_, CELL_SIZE_RECIPROCAL);
+
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1, -1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1, -1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1, -1,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  0, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  0,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  0,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d, -1,  1,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0, -1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0, -1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0, -1,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  0, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  0,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  0,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  0,  1,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1, -1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1, -1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1, -1,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  0, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  0,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  0,  1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  1, -1), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  1,  0), domain_min_);
+    sum += interactionsWithParticlesInCell(particle_idx, offsetCell(cell_index_3d,  1,  1,  1), domain_min_);
+
+    return sum;
+}
+
+/// The first index in `[begin, end)` of the Morton-ordered cell list whose cell's code is not less than `code`,
+/// or `end` if there is none.
+uint lowerBoundCellCode(uint begin, uint end, const uvec2 code) {
+
+    while (begin < end)
+    {
+        const uint mid = begin + (end - begin) / 2;
+        if (mortonCodeLessThan(cell_codes_morton_order_[mid], code)) begin = mid + 1;
+        else end = mid;
+    }
+    return begin;
+}
+
+/// `lowerBoundCellCode(begin, cell_count_, code)`, if the cells before `begin` have lesser codes. Takes time
+/// logarithmic in the distance from `begin` to the result rather than in the cell count.
+uint gallopForwardToCellCode(uint begin, const uvec2 code) {
+
+    const uint cell_count = cell_count_;
+    uint step = 1;
+    while (true)
+    {
+        const uint probe = begin + step - 1;
+        if (probe >= cell_count) return lowerBoundCellCode(begin, cell_count, code);
+        if (!mortonCodeLessThan(cell_codes_morton_order_[probe], code))
+        {
+            return lowerBoundCellCode(begin, probe, code);
+        }
+
+        begin = probe + 1;
+        step *= 2;
+    }
+}
+
+/// `lowerBoundCellCode(0, end, code)`, if the code of cell `end` is not less than `code`. Takes time
+/// logarithmic in the distance from the result to `end`.
+uint gallopBackwardToCellCode(uint end, const uvec2 code) {
+
+    uint step = 1;
+    while (true)
+    {
+        if (end < step) return lowerBoundCellCode(0, end, code);
+        const uint probe = end - step;
+        if (mortonCodeLessThan(cell_codes_morton_order_[probe], code))
+        {
+            return lowerBoundCellCode(probe + 1, end, code);
+        }
+
+        end = probe;
+        step *= 2;
+    }
+}
+
+/// Same as `interactionsWithNeighborCells`, but instead of 27 hash table lookups, walks the Morton-ordered
+/// cell list from the code of the block's lowest corner to the code of its highest corner. Most of the cells in
+/// that range are in the block; when the walk reaches one that isn't, it skips ahead to the next code that is
+/// (see `mortonCodeBigMin`). The searches start from nearby cells, starting with the particle's own, so they
+/// are short.
+/// Visits the same particles as `interactionsWithNeighborCells`, in a different order, so the sum can differ
+/// by rounding. Doesn't use the quantized positions.
+vec4 interactionsWithMortonRanges(const uint particle_idx) {
+
+    const uvec3 cell_idx_3d = cellIndex(cellLookupPosition(particle_idx), domain_min_, CELL_SIZE_RECIPROCAL);
+    // cells below 0 don't exist
+    const uvec2 block_min = cellMortonCode(cell_idx_3d - min(cell_idx_3d, uvec3(1)));
+    const uvec2 block_max = cellMortonCode(cell_idx_3d + 1);
+
+    const vec3 pos = interactionPosition(particle_idx);
+    vec4 sum = vec4(0.0f);
+
+    const uint cell_count = cell_count_;
+    // the particle's own cell is in the block, so its code is not less than `block_min`
+    uint cell = gallopBackwardToCellCode(cell_indices_[particle_idx], block_min);
+    while (cell < cell_count)
+    {
+        const uvec2 code = cell_codes_morton_order_[cell];
+        if (mortonCodeLessThan(block_max, code)) break;
+
+        if (!mortonCodeIsInBox(code, block_min, block_max))
+        {
+            cell = gallopForwardToCellCode(cell + 1, mortonCodeBigMin(code, block_min, block_max));
+            continue;
+        }
+
+        // `C_begin_morton_order_[cell_count]` is the particle count
+        const uint i_end = C_begin_morton_order_[cell + 1];
+        for (uint i = C_begin_morton_order_[cell]; i < i_end; i++)
+        {
+            if (i == particle_idx) continue;
+            sum += interactionWithParticle(pos, i, interactionPosition(i));
+        }
+        cell++;
+    }
+
+    return sum;
+}
+
+/// `lowerBoundCellCode(0, cell_count_, code)`, searching outwards from cell `near_cell` of the Morton-ordered cell
+/// list; so the search is short if the result is near it.
+uint lowerBoundCellCodeNear(const uint near_cell, const uvec2 code) {
+
+    if (mortonCodeLessThan(cell_codes_morton_order_[near_cell], code))
+    {
+        return gallopForwardToCellCode(near_cell + 1, code);
+    }
+    return gallopBackwardToCellCode(near_cell, code);
+}
+
+/// The cells of the Morton-ordered cell list that are in the level-`level` cell `coarse_idx_3d`, as
+/// uvec2(begin, end). A level-`level` cell is 2^`level` cells along each axis, whose codes only differ in their
+/// low `3 * level` bits, so they are a run of the list, and their particles a run of the sorted particles: the
+/// list is the cell list of every level at once. The searches start from cell `near_cell`.
+uvec2 coarseCellRange(const uvec3 coarse_idx_3d, const uint level, const uint near_cell) {
+
+    const uvec2 first_code = cellMortonCode(coarse_idx_3d << level);
+    // the first code of the next level-`level` cell in Morton order
+    uint carry;
+    const uint end_code_low = uaddCarry(first_code.x, 1u << (3u * level), carry);
+    const uvec2 end_code = uvec2(end_code_low, first_code.y + carry);
+
+    return uvec2(lowerBoundCellCodeNear(near_cell, first_code), lowerBoundCellCodeNear(near_cell, end_code));
+}
+
+/// Same as `interactionsWithNeighborCells` (or `interactionsWithMortonRanges`), but on the coarsest level of
+/// cells, below `cell_level_count_`, whose cell around the particle holds at most `sparse_cell_particle_count_`
+/// particles. A cell of level 1 or above is at least twice the interaction radius across, so the particle's
+/// neighbors are all in the 2x2x2 block of them on the particle's side of its own cell: 8 runs of particles
+/// instead of 27 cells, at the cost of testing more particles, which is cheap where they're sparse. The level
+/// is chosen per particle, so the dense regions stay on the fine cells. Visits the same neighbors, in a
+/// different order. Doesn't use the quantized positions.
+vec4 interactionsWithCellLevels(const uint particle_idx) {
+
+    const uvec3 cell_idx_3d = cellIndex(cellLookupPosition(particle_idx), domain_min_, CELL_SIZE_RECIPROCAL);
+    const uint own_cell = cell_indices_[particle_idx];
+
+    uint level = 0;
+    for (uint l = 1; l < cell_level_count_; l++)
+    {
+        // `C_begin_morton_order_[cell_count]` is the particle count
+        const uvec2 cells = coarseCellRange(cell_idx_3d >> l, l, own_cell);
+        if (C_begin_morton_order_[cells.y] - C_begin_morton_order_[cells.x] > sparse_cell_particle_count_) break;
+        level = l;
+    }
+    if (level == 0)
+    {
+        if (use_morton_ranges_ != 0) return interactionsWithMortonRanges(particle_idx);
+        return interactionsWithNeighborCells(particle_idx);
+    }
+
+    // on each axis, the particle's own cell and the one beside the half of it that the particle is in
+    const uvec3 upper_half = (cell_idx_3d >> (level - 1)) & 1u;
+    const uvec3 block_min = (cell_idx_3d >> level) - (uvec3(1u) - upper_half);
+
+    const vec3 pos = interactionPosition(particle_idx);
+    vec4 sum = vec4(0.0f);
+
+    for (uint k = 0; k < 8; k++)
+    {
+        const uvec3 coarse_idx_3d = block_min + uvec3(k & 1u, (k >> 1) & 1u, k >> 2);
+        // cells below 0 don't exist
+        if (any(equal(coarse_idx_3d, uvec3(0xFFFFFFFFu)))) continue;
+
+        const uvec2 cells = coarseCellRange(coarse_idx_3d, level, own_cell);
+        const uint i_end = C_begin_morton_order_[cells.y];
+        for (uint i = C_begin_morton_order_[cells.x]; i < i_end; i++)
+        {
+            if (i == particle_idx) continue;
+            sum += interactionWithParticle(pos, i, interactionPosition(i));
+        }
+    }
+
+    return sum;
+}
+
+/// In the SPH_PASS_PBF_FINISH pass, the acceleration that takes particle `particle_idx` from its position and
+/// velocity to its corrected predicted position through the integration of `finishParticleUpdate`, which then
+/// leaves it with the velocity that covers that distance in the step.
+vec3 pbfAcceleration(const uint particle_idx) {
+
+    const float delta_t = delta_ts_[delta_t_slot_];
+    const vec3 velocity = LOAD_VELOCITY(velocities_in_, particle_idx, particle_capacity_, half_velocities_);
+    const vec3 displacement =
+        pbf_positions_[pbf_positions_offset_ + particle_idx].xyz - positions_in_[particle_idx].xyz;
+
+    return displacement / (delta_t * delta_t) - (1.0f / delta_t - 0.5f) * velocity;
+}
+
+/// The trilinear interpolation of the face velocities of `set` along `axis` at `pos_in_cells`, a position in grid
+/// cells that is at least one cell away from the grid's boundary.
+float flipSampleVelocity(const uint set, const uint axis, const vec3 pos_in_cells) {
+
+    const uint resolution = flip_grid_resolution_;
+    vec3 node = vec3(0.5f);
+    node[axis] = 0.0f;
+    const vec3 pos_in_nodes = pos_in_cells - node;
+    const uvec3 base = uvec3(floor(pos_in_nodes));
+    const vec3 t = pos_in_nodes - vec3(base);
+
+    float velocity = 0.0f;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        const uvec3 offset = uvec3(corner & 1u, (corner >> 1) & 1u, corner >> 2);
+        const vec3 weights = mix(1.0f - t, t, vec3(offset));
+        const uint cell_idx = flipCellIdx(resolution, base + offset);
+        velocity += weights.x * weights.y * weights.z * flip_grid_[flipVelocityIdx(resolution, set, axis, cell_idx)];
+    }
+    return velocity;
+}
+
+/// In the SPH_PASS_FLIP_FINISH pass, the acceleration that takes particle `particle_idx` through the integration of
+/// `finishParticleUpdate` to the velocity from the grid: the particle's velocity after the custom body
+/// acceleration, plus the grid's change in the projection (FLIP), blended by `flip_ratio_` with the projected grid
+/// velocity itself (PIC). The particles outside the grid only get the custom body acceleration.
+vec3 flipAcceleration(const uint particle_idx) {
+
+    const float delta_t = delta_ts_[delta_t_slot_];
+    const vec3 velocity = LOAD_VELOCITY(velocities_in_, particle_idx, particle_capacity_, half_velocities_);
+    const vec3 pos = positions_in_[particle_idx].xyz;
+
+    vec3 new_velocity = velocity;
+#ifdef USER_BODY_ACCELERATION
+    new_velocity += delta_t * userBodyAcceleration(particle_idx, pos, velocity);
+#endif
+
+    const vec3 pos_in_cells = (pos - domain_min_) * CELL_SIZE_RECIPROCAL;
+    if (all(greaterThanEqual(pos_in_cells, vec3(1.0f)))
+        && all(lessThan(pos_in_cells, vec3(float(flip_grid_resolution_ - 1u)))))
+    {
+        vec3 before;
+        vec3 after;
+        for (uint axis = 0; axis < 3; axis++)
+        {
+            before[axis] = flipSampleVelocity(FLIP_VELOCITIES_BEFORE, axis, pos_in_cells);
+            after[axis] = flipSampleVelocity(FLIP_VELOCITIES_AFTER, axis, pos_in_cells);
+        }
+        new_velocity = mix(after, new_velocity + (after - before), flip_ratio_);
+    }
+
+    return (new_velocity - velocity) / delta_t + 0.5f * velocity;
+}
+
+/// The sum of `interactionWithParticle` over the particles in particle `particle_idx`'s neighbor list, if the list
+/// is in use and complete; otherwise over the particles in the 27 cells around it. So the SPH and PBF passes share
+/// the update's traversal: with complete lists, none of them probes the cell table.
+vec4 interactionsWithNeighbors(const uint particle_idx) {
+
+    if (sph_pass_ == SPH_PASS_PBF_FINISH) return vec4(pbfAcceleration(particle_idx), 0.0f);
+    if (sph_pass_ == SPH_PASS_FLIP_FINISH) return vec4(flipAcceleration(particle_idx), 0.0f);
+
+    interacting_particle_idx_ = particle_idx;
+    if (ensemble_member_count_ != 0)
+    {
+        ensemble_member_ = member_ids_in_[particle_idx];
+        ensemble_member_params_ = ensemble_members_[ensemble_member_];
+    }
+
+    if (sph_pass_ == SPH_PASS_FORCES)
+    {
+        sph_velocity_ = LOAD_VELOCITY(velocities_in_, particle_idx, particle_capacity_, half_velocities_);
+        sph_pressure_term_ = sphPressureTerm(densities_[particle_idx]);
+    }
+    pbf_gradient_sq_sum_ = 0.0f;
+    if (sph_pass_ == SPH_PASS_PBF_CORRECT)
+    {
+        pbf_multiplier_ = densities_[particle_idx];
+        pbf_mass_ = particleMass(particle_idx);
+    }
+
+    if (use_neighbor_lists_ != 0)
+    {
+        const uint neighbor_count = neighbor_counts_[particle_idx];
+        if (neighbor_count <= neighbor_list_capacity_)
+        {
+            const vec3 pos = interactionPosition(particle_idx);
+
+            vec4 sum = vec4(0.0f);
+            for (uint k = 0; k < neighbor_count; k++)
+            {
+                const uint other_idx = loadNeighborListEntry(particle_idx, k);
+                sum += interactionWithParticle(pos, other_idx, interactionPosition(other_idx));
+            }
+            return sum;
+        }
+    }
+
+    if (cell_level_count_ > 1) return interactionsWithCellLevels(particle_idx);
+    if (use_morton_ranges_ != 0) return interactionsWithMortonRanges(particle_idx);
+    return interactionsWithNeighborCells(particle_idx);
+}
+
+/// Same as `colliderBrickHash()` in fluid_sim.cpp.
+uint colliderBrickHash(const ivec3 coord) {
+    return (uint(coord.x) * 73856093u) ^ (uint(coord.y) * 19349663u) ^ (uint(coord.z) * 83492791u);
+}
+
+/// Returns false if `pos` is in no brick of the collider. Otherwise writes the collider's signed distance at `pos`,
+/// and its gradient, from a trilinear interpolation of the corners of the cell that contains `pos`; they're in the
+/// same brick, and the gradient is that of the interpolation, so it takes the 8 samples and nothing else.
+/// `collider_slot_count_` must be nonzero.
+bool sampleCollider(const vec3 pos, out float distance_out, out vec3 gradient_out) {
+
+    const vec3 pos_in_cells = pos * collider_cell_size_reciprocal_;
+    const vec3 cell_min = floor(pos_in_cells);
+    const ivec3 cell = ivec3(cell_min);
+    const ivec3 brick = cell >> COLLIDER_BRICK_SIZE_LOG2; // rounds down
+
+    const uint slot_mask = collider_slot_count_ - 1;
+    uint slot_idx = colliderBrickHash(brick) & slot_mask;
+    int brick_idx = COLLIDER_SLOT_EMPTY;
+    while (true)
+    {
+        const ivec4 slot = collider_slots_[slot_idx];
+        if (slot.w == COLLIDER_SLOT_EMPTY) return false;
+        if (slot.xyz == brick)
+        {
+            brick_idx = slot.w;
+            break;
+        }
+        slot_idx = (slot_idx + 1) & slot_mask;
+    }
+
+    const ivec3 cell_in_brick = cell - (brick << COLLIDER_BRICK_SIZE_LOG2);
+    const uint stride_y = COLLIDER_BRICK_SAMPLES_PER_AXIS;
+    const uint stride_z = COLLIDER_BRICK_SAMPLES_PER_AXIS * COLLIDER_BRICK_SAMPLES_PER_AXIS;
+    const uint base = uint(brick_idx) * COLLIDER_BRICK_SAMPLE_COUNT
+        + uint(cell_in_brick.x) + stride_y * uint(cell_in_brick.y) + stride_z * uint(cell_in_brick.z);
+
+    const float d000 = collider_distances_[base];
+    const float d100 = collider_distances_[base + 1u];
+    const float d010 = collider_distances_[base + stride_y];
+    const float d110 = collider_distances_[base + stride_y + 1u];
+    const float d001 = collider_distances_[base + stride_z];
+    const float d101 = collider_distances_[base + stride_z + 1u];
+    const float d011 = collider_distances_[base + stride_z + stride_y];
+    const float d111 = collider_distances_[base + stride_z + stride_y + 1u];
+
+    const vec3 t = pos_in_cells - cell_min;
+
+    // along x, on each of the 4 edges
+    const float d_00 = mix(d000, d100, t.x);
+    const float d_10 = mix(d010, d110, t.x);
+    const float d_01 = mix(d001, d101, t.x);
+    const float d_11 = mix(d011, d111, t.x);
+    // then along y, on the 2 faces
+    const float d__0 = mix(d_00, d_10, t.y);
+    const float d__1 = mix(d_01, d_11, t.y);
+    distance_out = mix(d__0, d__1, t.z);
+
+    const float ddx = mix(mix(d100 - d000, d110 - d010, t.y), mix(d101 - d001, d111 - d011, t.y), t.z);
+    const float ddy = mix(d_10 - d_00, d_11 - d_01, t.z);
+    const float ddz = d__1 - d__0;
+    gradient_out = vec3(ddx, ddy, ddz) * collider_cell_size_reciprocal_;
+
+    return true;
+}
+
+/// If `pos` is inside the collider, moves it out to the surface along the gradient of the distance, and drops
+/// the part of `velocity` that goes into the surface; so the particle slides along it, without bouncing.
+void collideWithCollider(inout vec3 pos, inout vec3 velocity) {
+
+    float signed_distance;
+    vec3 gradient;
+    if (!sampleCollider(pos, signed_distance, gradient) || signed_distance >= 0.0f) return;
+
+    const float gradient_length = length(gradient);
+    if (gradient_length == 0.0f) return; // deep inside, where the field is flat; nowhere to go
+
+    const vec3 normal = gradient / gradient_length;
+    pos -= (signed_distance / gradient_length) * normal;
+    velocity -= min(dot(velocity, normal), 0.0f) * normal;
+}
+
+/// The particle of this update invocation, in `particle_idx_out`; returns false if there is none. In the sleeping
+/// mode, the invocations only cover the active particles.
+bool getUpdatedParticle(out uint particle_idx_out) {
+
+    const uint invocation_idx = gl_GlobalInvocationID.x;
+    if (sleep_step_count_ == 0)
+    {
+        particle_idx_out = invocation_idx;
+        return invocation_idx < particle_count_;
+    }
+
+    const bool has_particle = invocation_idx < active_particle_count_;
+    particle_idx_out = has_particle ? active_particles_[invocation_idx] : 0;
+    return has_particle;
+}
+
+// The slot of `reduction_partials_` that `finishParticleUpdate` writes the workgroup's bounds to: the workgroup's
+// own, unless the kernel hands its workgroups other chunks of particles (see fluidSim_updateParticlesPersistent.comp).
+#ifndef UPDATE_CHUNK_IDX
+#define UPDATE_CHUNK_IDX gl_WorkGroupID.x
+#endif
+
+/// Adds `value` to the fixed-point sum at word `word_idx` of `diagnostics_`: the low words wrap around with a carry
+/// into the high ones, so that the sum is exact whatever order the workgroups add in.
+void addToDiagnosticsSum(const uint word_idx, const float value) {
+
+    // saturated at 2^62, so that the high word fits; the total wraps around past 2^43 anyway
+    const float magnitude = min(abs(round(value * DIAGNOSTICS_FIXED_POINT_SCALE)), 4611686018427387904.0f);
+    const float high_f = floor(magnitude / 4294967296.0f);
+    uint low = uint(magnitude - high_f * 4294967296.0f); // exact: the float has no bits below these
+    uint high = uint(high_f);
+    if (value < 0.0f)
+    {
+        low = ~low + 1u;
+        high = ~high + ((low == 0u) ? 1u : 0u);
+    }
+
+    const uint old_low = atomicAdd(diagnostics_[word_idx], low);
+    const uint carry = (old_low + low < old_low) ? 1u : 0u;
+    atomicAdd(diagnostics_[word_idx + 1u], high + carry);
+}
+
+/// `track_diagnostics_`: reduces the workgroup's momentum, and (kinetic energy, escaped particle count, max density),
+/// into `diagnostics_`. Must be called in uniform control flow. Reuses `workgroupMinMax`'s shared arrays.
+void reduceDiagnostics(vec3 momentum, vec3 energy_escaped_density) {
+
+    momentum = subgroupAdd(momentum);
+    energy_escaped_density = vec3(
+        subgroupAdd(energy_escaped_density.xy),
+        subgroupMax(energy_escaped_density.z)
+    );
+    barrier(); // `workgroupMinMax`'s last readers of the arrays may not be done
+    if (subgroupElect())
+    {
+        shared_min[gl_SubgroupID] = momentum;
+        shared_max[gl_SubgroupID] = energy_escaped_density;
+    }
+    barrier();
+
+    if (gl_SubgroupID == 0)
+    {
+        momentum = vec3(0.0f);
+        energy_escaped_density = vec3(0.0f);
+        for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups; i += gl_SubgroupSize)
+        {
+            momentum += shared_min[i];
+            energy_escaped_density.xy += shared_max[i].xy;
+            energy_escaped_density.z = max(energy_escaped_density.z, shared_max[i].z);
+        }
+        momentum = subgroupAdd(momentum);
+        energy_escaped_density = vec3(
+            subgroupAdd(energy_escaped_density.xy),
+            subgroupMax(energy_escaped_density.z)
+        );
+
+        if (subgroupElect())
+        {
+            const uint base = delta_t_slot_ * DIAGNOSTICS_WORD_COUNT;
+            for (uint axis = 0; axis < 3; axis++)
+            {
+                addToDiagnosticsSum(base + DIAGNOSTICS_MOMENTUM + 2u * axis, momentum[axis]);
+            }
+            addToDiagnosticsSum(base + DIAGNOSTICS_KINETIC_ENERGY, energy_escaped_density.x);
+            if (energy_escaped_density.y > 0.0f)
+            {
+                atomicAdd(diagnostics_[base + DIAGNOSTICS_ESCAPED_COUNT], uint(energy_escaped_density.y));
+            }
+            atomicMax(diagnostics_[base + DIAGNOSTICS_MAX_DENSITY_BITS], floatBitsToUint(energy_escaped_density.z));
+            if (UPDATE_CHUNK_IDX == 0) atomicAdd(diagnostics_[base + DIAGNOSTICS_STEP_COUNT], 1u);
+        }
+    }
+}
+
+/// Integrates particle `particle_idx` given its acceleration, and writes the outputs. Must be called by every
+/// invocation, in uniform control flow; `should_run` is false for invocations that have no particle. Adds the
+/// custom body acceleration, if any, except in the PBF and FLIP modes, whose accelerations already have it.
+void finishParticleUpdate(const uint particle_idx, const bool should_run, vec3 accel) {
+
+    vec3 new_pos_min = vec3(1.0f / 0.0f);
+    vec3 new_pos_max = vec3(-1.0f / 0.0f);
+    float speed = 0.0f;
+    vec3 momentum = vec3(0.0f);
+    vec3 energy_escaped_density = vec3(0.0f); // for `reduceDiagnostics`
+
+    if (should_run)
+    {
+        const float delta_t = delta_ts_[delta_t_slot_];
+
+        const vec3 old_velocity = LOAD_VELOCITY(velocities_in_, particle_idx, particle_capacity_, half_velocities_);
+        const vec4 old_pos = positions_in_[particle_idx];
+#ifdef USER_BODY_ACCELERATION
+        if (sph_pass_ != SPH_PASS_PBF_FINISH && sph_pass_ != SPH_PASS_FLIP_FINISH)
+        {
+            accel += userBodyAcceleration(particle_idx, old_pos.xyz, old_velocity);
+        }
+#endif
+
+        vec3 new_velocity = old_velocity;
+        new_velocity += accel * delta_t;
+        new_velocity -= 0.5f * delta_t * old_velocity; // damping
+
+        vec3 new_pos = old_pos.xyz + delta_t * new_velocity;
+        if (collider_slot_count_ != 0) collideWithCollider(new_pos, new_velocity);
+#ifdef USER_POST_INTEGRATE
+        userPostIntegrate(particle_idx, new_pos, new_velocity);
+#endif
+        new_pos = wrapIntoPeriodicBox(new_pos);
+
+        speed = length(new_velocity);
+        STORE_VELOCITY(velocities_out_, particle_idx, particle_capacity_, half_velocities_, new_velocity);
+        if (sleep_step_count_ != 0)
+        {
+            const bool calm = speed <= sleep_speed_ && length(accel) <= sleep_acceleration_;
+            calm_steps_out_[particle_idx] = calm ? min(calm_steps_in_[particle_idx] + 1, sleep_step_count_) : 0;
+        }
+        positions_out_[particle_idx] = vec4(new_pos, old_pos.w); // carry the attribute along
+        if (ensemble_member_count_ != 0) member_ids_out_[particle_idx] = member_ids_in_[particle_idx];
+        if (particle_ids_ != 0) particle_ids_out_[particle_idx] = particle_ids_in_[particle_idx];
+        if (particle_levels_ != 0) particle_levels_out_[particle_idx] = particle_levels_in_[particle_idx];
+
+        if (track_diagnostics_ != 0)
+        {
+            // Escaped: the cell codes of the next build can't reach it. A lost particle is only counted, since
+            // its velocity would swamp the sums, or make them NaN.
+            const bool escaped =
+                any(isnan(new_pos)) || any(isinf(new_pos)) ||
+                any(greaterThanEqual(
+                    abs(new_pos - domain_min_) * CELL_SIZE_RECIPROCAL, vec3(float(1u << HILBERT_CODE_LEVEL_COUNT))
+                ));
+            const float mass = particleMass(particle_idx);
+            momentum = escaped ? vec3(0.0f) : mass * new_velocity;
+            energy_escaped_density = vec3(
+                escaped ? 0.0f : 0.5f * mass * speed * speed,
+                escaped ? 1.0f : 0.0f,
+                (sph_pass_ == SPH_PASS_FORCES) ? densities_[particle_idx] : 0.0f
+            );
+        }
+
+        if (write_morton_codes_ != 0)
+        {
+            // If the domain origin moves, `fluidSim_updateDomainOrigin` has these recomputed.
+            const uvec2 code = cellSortCode(cellIndex(new_pos, domain_min_, CELL_SIZE_RECIPROCAL));
+            STORE_MORTON_CODE(morton_codes_, particle_idx, code);
+
+            new_pos_min = new_pos;
+            new_pos_max = new_pos;
+        }
+    }
+
+    // `write_morton_codes_` is uniform, so this is uniform control flow
+    if (write_morton_codes_ != 0)
+    {
+        workgroupMinMax(new_pos_min, new_pos_max);
+        if (gl_LocalInvocationIndex == 0)
+        {
+            reduction_partials_[2 * UPDATE_CHUNK_IDX] = vec4(new_pos_min, 0.0f);
+            reduction_partials_[2 * UPDATE_CHUNK_IDX + 1] = vec4(new_pos_max, 0.0f);
+        }
+    }
+
+    // `track_max_motion_` is uniform too; one atomic per subgroup, and the floats are non-negative, so their bit
+    // patterns have the same order
+    if (track_max_motion_ != 0)
+    {
+        const float max_speed = subgroupMax(speed);
+        const float max_accel = subgroupMax(should_run ? length(accel) : 0.0f);
+        if (subgroupElect())
+        {
+            atomicMax(max_motion_bits_[delta_t_slot_].x, floatBitsToUint(max_speed));
+            atomicMax(max_motion_bits_[delta_t_slot_].y, floatBitsToUint(max_accel));
+        }
+    }
+
+    // `track_diagnostics_` is uniform too
+    if (track_diagnostics_ != 0) reduceDiagnostics(momentum, energy_escaped_density);
+}
@@ -0,0 +1,19 @@
+// The custom forces of the update kernels; included by fluidSim_updateParticles.comp.h. This file has none:
+// `setForceKernels()` in fluid_sim.cpp compiles the kernels with its snippets in place of it, as
+//
+//     #define USER_PAIR_ACCELERATION
+//     vec3 userPairAcceleration(const uint particle_idx, const uint other_idx, const vec3 disp, const float dist_sq) {
+//         <ForceKernels::pair_acceleration>
+//     }
+//
+//     #define USER_BODY_ACCELERATION
+//     vec3 userBodyAcceleration(const uint particle_idx, const vec3 pos, const vec3 velocity) {
+//         <ForceKernels::body_acceleration>
+//     }
+//
+//     #define USER_POST_INTEGRATE
+//     void userPostIntegrate(const uint particle_idx, inout vec3 pos, inout vec3 velocity) {
+//         <ForceKernels::post_integrate>
+//     }
+//
+// for those that it's given. The update only calls the ones whose macro is defined, so the others cost nothing.
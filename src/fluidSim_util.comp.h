@@ -1,27 +1,388 @@
-/// Get the index of the cell that contains the particle.
+
+// Morton codes are stored as this many consecutive `uint`s: 1 for 30-bit codes, 2 for 63-bit codes (low word
+// first). Must match `ComputeShaderSpecializationConstants::morton_code_word_count` in fluid_sim.cpp.
+layout(constant_id = 1) const uint MORTON_CODE_WORD_COUNT = 1;
+
+// If nonzero, the cells are looked up in the open-addressing table `CellSlots` instead of the `HashBuckets`,
+// `Cells` hash table. Must match
+// `ComputeShaderSpecializationConstants::open_addressing_cell_table` in fluid_sim.cpp.
+layout(constant_id = 2) const uint OPEN_ADDRESSING_CELL_TABLE = 0;
+
+// If nonzero (only with OPEN_ADDRESSING_CELL_TABLE), the cell table may be a dense grid; see CELL_TABLE_DENSE.
+// Must match `ComputeShaderSpecializationConstants::dense_cell_grid` in fluid_sim.cpp.
+layout(constant_id = 16) const uint DENSE_CELL_GRID = 0;
+
+// If nonzero, the particles are sorted by the Hilbert code of their cell (see `cellHilbertCode`) instead of its
+// Morton code: the codes in the sorted `MortonCodes` buffers, and so the order of the particles and of the cell
+// list, are Hilbert codes. The hash tables are still keyed by the Morton code, so the lookups don't change. Must
+// match `ComputeShaderSpecializationConstants::hilbert_cell_order` in fluid_sim.cpp.
+layout(constant_id = 8) const uint HILBERT_CELL_ORDER = 0;
+
+// The periodic axes of the domain, as a mask (1 for x, 2 for y, 4 for z), and the box that the particles wrap
+// around in along them; see `SimParameters::periodic_box_size`. 0 for an open domain, which compiles the wrapping
+// out. Must match `ComputeShaderSpecializationConstants` in fluid_sim.cpp.
+layout(constant_id = 9) const uint PERIODIC_AXES = 0;
+layout(constant_id = 10) const float PERIODIC_BOX_MIN_X = 0.0f;
+layout(constant_id = 11) const float PERIODIC_BOX_MIN_Y = 0.0f;
+layout(constant_id = 12) const float PERIODIC_BOX_MIN_Z = 0.0f;
+layout(constant_id = 13) const float PERIODIC_BOX_SIZE_X = 0.0f;
+layout(constant_id = 14) const float PERIODIC_BOX_SIZE_Y = 0.0f;
+layout(constant_id = 15) const float PERIODIC_BOX_SIZE_Z = 0.0f;
+
+#define PERIODIC_BOX_MIN vec3(PERIODIC_BOX_MIN_X, PERIODIC_BOX_MIN_Y, PERIODIC_BOX_MIN_Z)
+#define PERIODIC_BOX_SIZE vec3(PERIODIC_BOX_SIZE_X, PERIODIC_BOX_SIZE_Y, PERIODIC_BOX_SIZE_Z)
+
+// Each slot of the open-addressing cell table is 4 `uint`s: the cell's Morton code (low word, high word), the
+// index of its first particle, and its particle count. Empty slots have CELL_SLOT_EMPTY as the first particle
+// index. Collisions are resolved by linear probing.
+#define CELL_SLOT_EMPTY 0xFFFFFFFFu
+
+// The slot after the last one of the open-addressing cell table is its header: the largest cell index along each
+// axis, and CELL_TABLE_DENSE in w if the cells are in a dense grid of that size, at `denseCellSlot()`, rather than
+// hashed. The insertion picks the grid whenever it fits in the table; see `SimParameters::dense_cell_grid`. Any
+// other w (the table is cleared to CELL_SLOT_EMPTY) means hashed.
+#define CELL_TABLE_DENSE 1u
+
+// Morton codes are passed around as uvec2(low word, high word); the high word is 0 for 30-bit codes.
+#define LOAD_MORTON_CODE(codes, idx) \
+    uvec2( \
+        codes[MORTON_CODE_WORD_COUNT * (idx)], \
+        (MORTON_CODE_WORD_COUNT == 2) ? codes[MORTON_CODE_WORD_COUNT * (idx) + 1] : 0u \
+    )
+#define STORE_MORTON_CODE(codes, idx, code) \
+    { \
+        codes[MORTON_CODE_WORD_COUNT * (idx)] = (code).x; \
+        if (MORTON_CODE_WORD_COUNT == 2) codes[MORTON_CODE_WORD_COUNT * (idx) + 1] = (code).y; \
+    }
+
+// Particle layout; must match the comments on the particle buffers in fluid_sim_types.hpp.
+//     positions: vec4 per particle. xyz is the position; w is an opaque per-particle attribute (e.g. a packed
+//         color) that the sim never interprets, but moves along with the particle.
+//     velocities: structure of arrays `[x_0 .. x_(n-1), y_0 .. y_(n-1), z_0 .. z_(n-1)]` of floats, so that
+//         there is no padding to read and write. `n` is the particle capacity, not the particle count, so that
+//         the layout doesn't change when particles are added or removed. The arrays are declared as `uint`,
+//         because with `half_velocities_` they are instead `[packHalf2x16(x_i, y_i) ..]` and
+//         `[packHalf2x16(z_i, 0) ..]`; each particle's components still take whole words, so that the invocations
+//         never write the same word.
+#define LOAD_VELOCITY(velocities, idx, capacity, half) ( \
+    ((half) != 0u) \
+        ? vec3(unpackHalf2x16(velocities[(idx)]), unpackHalf2x16(velocities[(capacity) + (idx)]).x) \
+        : uintBitsToFloat(uvec3( \
+            velocities[(idx)], velocities[(capacity) + (idx)], velocities[2 * (capacity) + (idx)] \
+        )) \
+    )
+#define STORE_VELOCITY(velocities, idx, capacity, half, velocity) \
+    { \
+        if ((half) != 0u) \
+        { \
+            velocities[(idx)] = packHalf2x16((velocity).xy); \
+            velocities[(capacity) + (idx)] = packHalf2x16(vec2((velocity).z, 0.0f)); \
+        } \
+        else \
+        { \
+            velocities[(idx)] = floatBitsToUint((velocity).x); \
+            velocities[(capacity) + (idx)] = floatBitsToUint((velocity).y); \
+            velocities[2 * (capacity) + (idx)] = floatBitsToUint((velocity).z); \
+        } \
+    }
+
+bvec3 periodicAxes(void) {
+    return bvec3((PERIODIC_AXES & 1u) != 0, (PERIODIC_AXES & 2u) != 0, (PERIODIC_AXES & 4u) != 0);
+}
+
+/// The cells along each periodic axis: the whole cells that fit in the box. The part of a cell that's left over
+/// belongs to cell 0, which it's next to across the boundary; so every cell is at least a cell size across, and
+/// the particles within a cell size of one are still in the cells next to it. There must be at least 3, so that
+/// those are distinct.
+uvec3 periodicCellCounts(float cell_size_reciprocal) {
+    return max(uvec3(PERIODIC_BOX_SIZE * cell_size_reciprocal), uvec3(1));
+}
+
+/// Get the index of the cell that contains the particle. Along the periodic axes, the cells wrap around the box,
+/// starting from `domain_min`.
 uvec3 cellIndex(vec3 particle, vec3 domain_min, float cell_size_reciprocal) {
 
-    return uvec3((particle - domain_min) * cell_size_reciprocal);
+    if (PERIODIC_AXES == 0) return uvec3((particle - domain_min) * cell_size_reciprocal);
+
+    const bvec3 periodic = periodicAxes();
+    const vec3 offset = mix(particle - domain_min, mod(particle - domain_min, PERIODIC_BOX_SIZE), periodic);
+    const uvec3 cell_idx = uvec3(offset * cell_size_reciprocal);
+    return mix(cell_idx, cell_idx % periodicCellCounts(cell_size_reciprocal), periodic);
+}
+
+/// The displacement `disp` between two particles, to the nearest image of the second one along the periodic axes
+/// (the minimum image convention).
+vec3 minimumImage(vec3 disp) {
+
+    if (PERIODIC_AXES == 0) return disp;
+    return mix(disp, disp - PERIODIC_BOX_SIZE * round(disp / PERIODIC_BOX_SIZE), periodicAxes());
+}
+
+/// Moves a particle that has left the box along a periodic axis back in from the other side.
+vec3 wrapIntoPeriodicBox(vec3 pos) {
+
+    if (PERIODIC_AXES == 0) return pos;
+    return mix(pos, PERIODIC_BOX_MIN + mod(pos - PERIODIC_BOX_MIN, PERIODIC_BOX_SIZE), periodicAxes());
+}
+
+// Quantized positions are 16-bit fixed-point offsets from the corner of a cell, covering
+// `[QUANTIZED_POSITION_MIN, QUANTIZED_POSITION_MIN + QUANTIZED_POSITION_RANGE)` cells along each axis. The
+// range extends past the cell because in Verlet skin mode particles move away from the cell they were sorted
+// into; offsets outside the range are clamped.
+#define QUANTIZED_POSITION_MIN (-0.5f)
+#define QUANTIZED_POSITION_RANGE 2.0f
+
+/// Packs the position of a particle relative to cell `cell_idx_3d` into uvec2(x | y << 16, z).
+uvec2 quantizePosition(vec3 particle, uvec3 cell_idx_3d, vec3 domain_min, float cell_size_reciprocal) {
+
+    const vec3 offset_in_cells = (particle - domain_min) * cell_size_reciprocal - vec3(cell_idx_3d);
+    const vec3 normalized = (offset_in_cells - QUANTIZED_POSITION_MIN) / QUANTIZED_POSITION_RANGE;
+    return uvec2(packUnorm2x16(normalized.xy), packUnorm2x16(vec2(normalized.z, 0.0f)));
+}
+
+/// Inverse of `quantizePosition`, up to the quantization error.
+vec3 dequantizePosition(uvec2 quantized, uvec3 cell_idx_3d, vec3 domain_min, float cell_size_reciprocal) {
+
+    const vec3 normalized = vec3(unpackUnorm2x16(quantized.x), unpackUnorm2x16(quantized.y).x);
+    const vec3 offset_in_cells = normalized * QUANTIZED_POSITION_RANGE + QUANTIZED_POSITION_MIN;
+    return domain_min + (vec3(cell_idx_3d) + offset_in_cells) / cell_size_reciprocal;
 }
 
 // For some input integer with bits [... b3 b2 b1 b0]
 // returns [... 0 0 b3 0 0 b2 0 0 b1 0 0 b0].
 uint separateBitsByTwo(uint x) {
     // https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
-    // TODO FIXME OPTIMIZE there's a faster way to do this:
-    //     https://fgiesen.wordpress.com/2022/09/09/morton-codes-addendum/
-    x &= 0x000003ff;                  // 0b0000'0000'0000'0000'0000'0011'1111'1111
-    x = (x ^ (x << 16)) & 0xff0000ff; // 0b1111'1111'0000'0000'0000'0000'1111'1111
-    x = (x ^ (x <<  8)) & 0x0300f00f; // 0b0000'0011'0000'0000'1111'0000'0000'1111
-    x = (x ^ (x <<  4)) & 0x030c30c3; // 0b0000'0011'0000'1100'0011'0000'1100'0011
-    x = (x ^ (x <<  2)) & 0x09249249; // 0b0000'1001'0010'0100'1001'0010'0100'1001
+    // with https://fgiesen.wordpress.com/2022/09/09/morton-codes-addendum/: the shifted copies never overlap, so
+    // each shift-and-xor is a multiply: two instructions per step instead of three. Same as
+    // `morton::spreadBits30()` on the CPU.
+    x &= 0x000003ff;                     // 0b0000'0000'0000'0000'0000'0011'1111'1111
+    x = (x * 0x00010001u) & 0xff0000ff;  // 0b1111'1111'0000'0000'0000'0000'1111'1111
+    x = (x * 0x00000101u) & 0x0300f00f;  // 0b0000'0011'0000'0000'1111'0000'0000'1111
+    x = (x * 0x00000011u) & 0x030c30c3;  // 0b0000'0011'0000'1100'0011'0000'1100'0011
+    x = (x * 0x00000005u) & 0x09249249;  // 0b0000'1001'0010'0100'1001'0010'0100'1001
     return x;
 }
 
-uint cellMortonCode(uvec3 cell_index) {
+/// 30-bit Morton code of the low 10 bits of each component.
+uint cellMortonCode30(uvec3 cell_index) {
     return
         (separateBitsByTwo(cell_index.x)     ) |
         (separateBitsByTwo(cell_index.y) << 1) |
         (separateBitsByTwo(cell_index.z) << 2) ;
 }
 
+/// 63-bit Morton code of the low 21 bits of each component, as uvec2(low word, high word). If every component
+/// is less than 1024, this is the 30-bit code with a zero high word.
+uvec2 cellMortonCode(uvec3 cell_index) {
+
+    // bits 0..9 of each component go to bits 0..29
+    uint lo = cellMortonCode30(cell_index);
+    // bit 10 of each component goes to bits 30, 31, 32
+    lo |= ((cell_index.x >> 10) & 1u) << 30;
+    lo |= ((cell_index.y >> 10) & 1u) << 31;
+    uint hi = (cell_index.z >> 10) & 1u;
+    // bits 11..20 of each component go to bits 33..62
+    hi |= cellMortonCode30(cell_index >> 11) << 1;
+
+    return uvec2(lo, hi);
+}
+
+// For some input integer with bits [... 0 0 b3 0 0 b2 0 0 b1 0 0 b0]
+// returns [... b3 b2 b1 b0]; the inverse of `separateBitsByTwo`.
+uint compactBitsByTwo(uint x) {
+    x &= 0x09249249;
+    x = (x ^ (x >>  2)) & 0x030c30c3;
+    x = (x ^ (x >>  4)) & 0x0300f00f;
+    x = (x ^ (x >>  8)) & 0xff0000ff;
+    x = (x ^ (x >> 16)) & 0x000003ff;
+    return x;
+}
+
+/// Inverse of `cellMortonCode`, for components of at most 21 bits.
+uvec3 mortonCodeCellIndex(uvec2 code) {
+
+    const uvec3 low = uvec3(compactBitsByTwo(code.x), compactBitsByTwo(code.x >> 1), compactBitsByTwo(code.x >> 2));
+    const uvec3 bit_10 = uvec3((code.x >> 30) & 1u, code.x >> 31, code.y & 1u);
+    const uvec3 high =
+        uvec3(compactBitsByTwo(code.y >> 1), compactBitsByTwo(code.y >> 2), compactBitsByTwo(code.y >> 3));
+    return low | (bit_10 << 10) | (high << 11);
+}
+
+// The bits per component of the Hilbert codes: as many as the Morton codes have.
+#define HILBERT_CODE_LEVEL_COUNT ((MORTON_CODE_WORD_COUNT == 2) ? 21u : 10u)
+
+/// The Hilbert code of the low `HILBERT_CODE_LEVEL_COUNT` bits of each component, as uvec2(low word, high word).
+/// Unlike the Morton order, consecutive codes are always adjacent cells, so the sorted particles don't jump
+/// across the domain at the octant boundaries. The first 8^k codes cover the cells whose components are below 2^k,
+/// so the codes of a domain take as many bits as its Morton codes.
+///
+/// From "Programming the Hilbert curve" by J. Skilling: the components are transformed in place into the
+/// "transpose" of the code, whose bits interleave like a Morton code's, with the first component's highest. This
+/// is a few bit operations per level, with no table to read.
+uvec2 cellHilbertCode(uvec3 cell_index) {
+
+    const uint level_count = HILBERT_CODE_LEVEL_COUNT;
+    uint x[3] = uint[3](cell_index.x, cell_index.y, cell_index.z);
+    for (uint i = 0; i < 3; i++) x[i] &= (1u << level_count) - 1u;
+
+    // inverse undo
+    for (uint q = 1u << (level_count - 1u); q > 1u; q >>= 1)
+    {
+        const uint p = q - 1u;
+        for (uint i = 0; i < 3; i++)
+        {
+            if ((x[i] & q) != 0u) x[0] ^= p; // invert
+            else
+            {
+                // exchange
+                const uint swapped = (x[0] ^ x[i]) & p;
+                x[0] ^= swapped;
+                x[i] ^= swapped;
+            }
+        }
+    }
+
+    // Gray encode
+    x[1] ^= x[0];
+    x[2] ^= x[1];
+    uint t = 0;
+    for (uint q = 1u << (level_count - 1u); q > 1u; q >>= 1)
+    {
+        if ((x[2] & q) != 0u) t ^= q - 1u;
+    }
+    for (uint i = 0; i < 3; i++) x[i] ^= t;
+
+    // `cellMortonCode` puts its first component lowest
+    return cellMortonCode(uvec3(x[2], x[1], x[0]));
+}
+
+/// Inverse of `cellHilbertCode`.
+uvec3 hilbertCodeCellIndex(uvec2 code) {
+
+    const uint level_count = HILBERT_CODE_LEVEL_COUNT;
+    const uvec3 transpose = mortonCodeCellIndex(code);
+    uint x[3] = uint[3](transpose.z, transpose.y, transpose.x);
+
+    // Gray decode
+    const uint t = x[2] >> 1;
+    x[2] ^= x[1];
+    x[1] ^= x[0];
+    x[0] ^= t;
+
+    // undo the excess work
+    for (uint q = 2u; q != (1u << level_count); q <<= 1)
+    {
+        const uint p = q - 1u;
+        for (uint i = 3; i-- > 0; )
+        {
+            if ((x[i] & q) != 0u) x[0] ^= p;
+            else
+            {
+                const uint swapped = (x[0] ^ x[i]) & p;
+                x[0] ^= swapped;
+                x[i] ^= swapped;
+            }
+        }
+    }
+
+    return uvec3(x[0], x[1], x[2]);
+}
+
+/// The code that the particles are sorted by; see `HILBERT_CELL_ORDER`.
+uvec2 cellSortCode(uvec3 cell_index) {
+    return (HILBERT_CELL_ORDER != 0) ? cellHilbertCode(cell_index) : cellMortonCode(cell_index);
+}
+
+/// The Morton code of the cell whose `cellSortCode` is `sort_code`, for the hash tables.
+uvec2 sortCodeToMortonCode(uvec2 sort_code) {
+    return (HILBERT_CELL_ORDER != 0) ? cellMortonCode(hilbertCodeCellIndex(sort_code)) : sort_code;
+}
+
+bool mortonCodeLessThan(uvec2 a, uvec2 b) {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+// The bits of a Morton code (as uvec2(low word, high word)) that come from each component.
+const uvec2 MORTON_CODE_COMPONENT_MASKS[3] = uvec2[3](
+    uvec2(0x49249249u, 0x12492492u), // x: bits 0, 3, ..., 60
+    uvec2(0x92492492u, 0x24924924u), // y: bits 1, 4, ..., 61
+    uvec2(0x24924924u, 0x49249249u)  // z: bits 2, 5, ..., 62
+);
+
+/// Whether the cell with Morton code `code` is in the box of cells whose corners have the codes `box_min` and
+/// `box_max`. Masking out the other components preserves the order of each component, so nothing needs to be
+/// decoded. Same as `morton::isInBox()` on the CPU.
+bool mortonCodeIsInBox(uvec2 code, uvec2 box_min, uvec2 box_max) {
+    for (uint d = 0; d < 3; d++)
+    {
+        const uvec2 mask = MORTON_CODE_COMPONENT_MASKS[d];
+        if (mortonCodeLessThan(code & mask, box_min & mask)) return false;
+        if (mortonCodeLessThan(box_max & mask, code & mask)) return false;
+    }
+    return true;
+}
+
+/// The smallest Morton code greater than `code` that is in the box with corners `box_min` and `box_max`, where
+/// `code` is between the corners but not in the box. uvec2(0xFFFFFFFF) if there is none.
+///
+/// This is BIGMIN from "Multidimensional Range Search in Dynamically Balanced Trees" by H. Tropf and
+/// H. Herzog: going from the high bit down, whenever the box straddles a bit of one component, it's split
+/// into a lower and an upper half along that component, and we keep the half that can contain the answer.
+/// Same as `morton::bigMin()` on the CPU.
+uvec2 mortonCodeBigMin(uvec2 code, uvec2 box_min, uvec2 box_max) {
+
+    uvec2 big_min = uvec2(0xFFFFFFFFu);
+
+    for (uint bit = 63; bit-- > 0; )
+    {
+        const uint b = bit % 32;
+        const uvec2 bit_mask = (bit < 32) ? uvec2(1u << b, 0u) : uvec2(0u, 1u << b);
+        const uvec2 below_mask = (bit < 32) ? uvec2(bit_mask.x - 1u, 0u) : uvec2(0xFFFFFFFFu, bit_mask.y - 1u);
+        // the lower bits of the same component
+        const uvec2 component_below_mask = MORTON_CODE_COMPONENT_MASKS[bit % 3] & below_mask;
+
+        const bool code_bit = (code & bit_mask) != uvec2(0u);
+        const bool min_bit = (box_min & bit_mask) != uvec2(0u);
+        const bool max_bit = (box_max & bit_mask) != uvec2(0u);
+
+        // (min_bit && !max_bit) can't happen: it would mean that the box is empty.
+        if (!min_bit && max_bit)
+        {
+            // the lowest code of the upper half, and the highest code of the lower half
+            const uvec2 upper_min = (box_min | bit_mask) & ~component_below_mask;
+            const uvec2 lower_max = (box_max & ~bit_mask) | component_below_mask;
+
+            if (code_bit) box_min = upper_min;
+            else
+            {
+                big_min = upper_min;
+                box_max = lower_max;
+            }
+        }
+        else if (code_bit != min_bit)
+        {
+            // the whole box is above `code`, or the whole box is below it
+            return code_bit ? big_min : box_min;
+        }
+    }
+
+    return big_min;
+}
+
+/// The slot of the cell in the dense grid of the open-addressing cell table whose header is `header` (see
+/// CELL_TABLE_DENSE), or CELL_SLOT_EMPTY if the cell is outside of the grid, and so has no particles. The
+/// cells below the domain origin wrap around to large indices, which are outside of it too.
+uint denseCellSlot(uvec3 cell_idx_3d, uvec4 header) {
+    if (any(greaterThan(cell_idx_3d, header.xyz))) return CELL_SLOT_EMPTY;
+    const uvec3 dims = header.xyz + 1u;
+    return cell_idx_3d.x + dims.x * (cell_idx_3d.y + dims.y * cell_idx_3d.z);
+}
+
+/// `hash_table_size` must be a power of two, at least 2.
+uint mortonCodeHash(uvec2 cell_morton_code, uint hash_table_size) {
+    // Fibonacci hashing: multiply by 2^32 / phi and keep the high bits, which depend on every bit of the key.
+    // Unlike a modulus, this doesn't need an integer division.
+    const uint key = cell_morton_code.x ^ (cell_morton_code.y * 0x85EBCA6Bu);
+    const int bit_count = findMSB(hash_table_size);
+    return (key * 0x9E3779B1u) >> (32 - bit_count);
+}
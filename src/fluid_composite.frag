@@ -0,0 +1,106 @@
+#version 450
+
+layout(location = 0) out vec4 color_out_;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// The frame's screen-space fluid, written by fluid_depth.frag, fluid_thickness.frag and fluid_smooth.comp; see
+// `recordFluidSurface()` in graphics.cpp. Must match the FLUID_SURFACE_* bindings there.
+layout(binding = 18) uniform sampler2D fluid_depth_;
+layout(binding = 19) uniform sampler2D fluid_thickness_;
+
+// Must match `FluidCompositePipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    mat4 world_to_screen_transform_inverse_;
+    vec3 camera_position_;
+    float particle_radius_;
+    vec2 viewport_offset_in_window_;
+    vec2 viewport_size_in_window_;
+    // FLUID_SURFACE_DOWNSCALE times less, and the render scale; see `recordFluidSurface()` in graphics.cpp
+    float texels_per_pixel_;
+};
+
+const vec3 LIGHT_DIRECTION_UNIT = vec3(0.57735027f);
+const vec3 FLUID_COLOR = vec3(0.0f, 0.5f, 1.0f);
+const vec3 SKY_COLOR = vec3(0.6f, 0.7f, 0.8f);
+// The fraction of the light that crosses a particle's diameter of fluid is exp(-ABSORPTION).
+const float ABSORPTION = 0.3f;
+
+/// The unit direction from the camera through `window_coord`, in pixels like gl_FragCoord.
+vec3 rayDirection(vec2 window_coord) {
+
+    // [-1, 1] over the viewport; the y-axis flip is done by the transform
+    const vec2 f = 2.0f * (window_coord - viewport_offset_in_window_) / viewport_size_in_window_ - 1.0f;
+
+    const vec4 pn = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 0.0f, 1.0f);
+    const vec4 pf = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 1.0f, 1.0f);
+    return normalize(pf.xyz / pf.w - pn.xyz / pn.w);
+}
+
+/// The point of the surface seen through the center of `texel`; false if there's none, or `texel` is outside the
+/// image.
+bool getSurfacePoint(ivec2 texel, out vec3 point_out) {
+
+    point_out = vec3(0.0f);
+    if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, textureSize(fluid_depth_, 0)))) return false;
+
+    const float t = texelFetch(fluid_depth_, texel, 0).r;
+    point_out = camera_position_ + t * rayDirection((vec2(texel) + 0.5f) / texels_per_pixel_);
+    return t > 0.0f;
+}
+
+/// The difference of the surface points along a screen axis, from the neighbor on the side with the smaller step,
+/// so that the normals don't bend across a silhouette; 0 if neither neighbor is on the surface.
+vec3 getSurfaceDifference(vec3 p, bool has_before, vec3 before, bool has_after, vec3 after) {
+
+    const vec3 d_before = p - before;
+    const vec3 d_after = after - p;
+    if (has_before && has_after) return (dot(d_before, d_before) < dot(d_after, d_after)) ? d_before : d_after;
+    if (has_before) return d_before;
+    if (has_after) return d_after;
+    return vec3(0.0f);
+}
+
+// The last pass of the screen-space fluid surface: shades the smoothed surface, reconstructed from its distances,
+// over what's behind it, as much as its thickness absorbs.
+void main(void) {
+
+    const ivec2 texel = ivec2(gl_FragCoord.xy * texels_per_pixel_);
+
+    const float t = texelFetch(fluid_depth_, texel, 0).r;
+    if (t == 0.0f) discard;
+
+    const vec3 ray_direction_unit = rayDirection(gl_FragCoord.xy);
+    const vec3 surface_point = camera_position_ + t * ray_direction_unit;
+
+    vec3 center, left, right, down, up;
+    getSurfacePoint(texel, center);
+    const bool has_left = getSurfacePoint(texel - ivec2(1, 0), left);
+    const bool has_right = getSurfacePoint(texel + ivec2(1, 0), right);
+    const bool has_down = getSurfacePoint(texel - ivec2(0, 1), down);
+    const bool has_up = getSurfacePoint(texel + ivec2(0, 1), up);
+
+    vec3 normal = cross(
+        getSurfaceDifference(center, has_left, left, has_right, right),
+        getSurfaceDifference(center, has_down, down, has_up, up)
+    );
+    // a lone texel: face the camera
+    normal = (dot(normal, normal) > 0.0f) ? normalize(normal) : -ray_direction_unit;
+    if (dot(normal, ray_direction_unit) > 0.0f) normal = -normal;
+
+    const vec3 view_direction_unit = -ray_direction_unit;
+    const float diffuse = max(dot(normal, LIGHT_DIRECTION_UNIT), 0.0f);
+    const float specular = pow(max(dot(normal, normalize(LIGHT_DIRECTION_UNIT + view_direction_unit)), 0.0f), 64.0f);
+    // Schlick's approximation, for water
+    const float fresnel = 0.02f + 0.98f * pow(1.0f - max(dot(normal, view_direction_unit), 0.0f), 5.0f);
+
+    const float thickness = texelFetch(fluid_thickness_, texel, 0).r;
+    const float opacity = 1.0f - exp(-ABSORPTION * thickness / (2.0f * particle_radius_));
+
+    const vec3 color = mix(FLUID_COLOR * (0.3f + 0.7f * diffuse), SKY_COLOR, fresnel) + specular;
+    color_out_ = vec4(color, max(opacity, fresnel));
+
+    const vec4 surface_clip_space = world_to_screen_transform_ * vec4(surface_point, 1.0f);
+    gl_FragDepth = surface_clip_space.z / surface_clip_space.w;
+}
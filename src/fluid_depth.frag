@@ -0,0 +1,38 @@
+#version 450
+
+layout(location = 0) in vec3 position_worldspace_in_;
+layout(location = 1) flat in vec3 particle_coord_worldspace_in_;
+
+// along the texel's ray, from the camera to the nearest sphere; 0 where there's none
+layout(location = 0) out float distance_out_;
+// The sphere is behind its quad, so the depth test against the quad's depth can still be done early.
+layout(depth_greater) out float gl_FragDepth;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp, and particle_rasterize.vert.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+};
+
+// The first pass of the screen-space fluid surface; see `recordFluidSurface()` in graphics.cpp. Ray casts the
+// spheres like particle_rasterize.frag, but keeps the distance to the nearest one instead of its color.
+void main(void) {
+
+    const float r = particle_radius_;
+    const vec3 ray_direction_unit = normalize(position_worldspace_in_ - camera_position_);
+    const vec3 to_center = particle_coord_worldspace_in_ - camera_position_;
+
+    // the nearer root of |camera + t * direction - center| = r
+    const float b = dot(ray_direction_unit, to_center);
+    const float discriminant = b * b - (dot(to_center, to_center) - r * r);
+    if (discriminant < 0.0f) discard;
+    const float t = b - sqrt(discriminant);
+
+    distance_out_ = t;
+
+    const vec4 hit_clip_space = world_to_screen_transform_ * vec4(camera_position_ + t * ray_direction_unit, 1.0f);
+    gl_FragDepth = hit_clip_space.z / hit_clip_space.w;
+}
@@ -0,0 +1,78 @@
+#ifndef _FLUID_SIM_PARAMS_DEFAULT_HPP
+#define _FLUID_SIM_PARAMS_DEFAULT_HPP
+
+// #include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
+
+//
+// ===========================================================================================================
+//
+
+/// Shared by the app and the headless executable, so that both run the same sim unless told otherwise.
+constexpr fluid_sim::SimParameters FLUID_SIM_PARAMS_DEFAULT {
+    .rest_particle_density = 1000,
+    .rest_particle_interaction_count_approx = 50,
+    .spring_stiffness = 0.05f, // TODO FIXME didn't really think about this
+    .sph = false,
+    .sph_stiffness = 10.0f,
+    .sph_viscosity = 2.0f,
+    .pbf = false,
+    .pbf_iteration_count = 4,
+    .pbf_relaxation = 0.05f,
+    .flip = false,
+    .flip_ratio = 0.95f,
+    .flip_pressure_iteration_count = 10,
+    .flip_grid_resolution = 0,
+    .verlet_skin = 0.0f,
+    .adaptive_time_step = false,
+    .cfl_number = 0.4f,
+    .max_substep_count = 8,
+    .diagnostics = false,
+    .sleeping = false,
+    .sleep_speed = 0.05f,
+    .sleep_acceleration = 0.5f,
+    .sleep_step_count = 30,
+    .gpu_resident = true,
+    .morton_codes_64_bit = false,
+    .hilbert_cell_order = false,
+    .half_velocities = false,
+    .particle_ids = false,
+    .adaptive_resolution = false,
+    .adaptive_resolution_interval = 50,
+    .adaptive_max_level = 2,
+    .adaptive_interior_fraction = 0.85f,
+    .adaptive_surface_fraction = 0.65f,
+    .fuse_morton_codes_into_update = true,
+    .tiled_particle_update = false,
+    .subgroup_particle_update = false,
+    .persistent_update_workgroup_count = 0,
+    .cluster_pair_forces = false,
+    .neighbor_list_capacity = 0,
+    .quantized_neighbor_positions = false,
+    .morton_range_traversal = false,
+    .cell_level_count = 1,
+    .sparse_cell_particle_count = 8,
+    .bake_sim_params_into_update = false,
+    .open_addressing_cell_table = false,
+    .dense_cell_grid = false,
+    .hash_table_max_load_factor = 0.5f,
+    .autotune_workgroup_size = false,
+    .extra_particle_capacity = 0,
+    .cpu_backend = false,
+    .hybrid_gpu_update = false,
+    .stage_timestamps = false,
+    .collider_brick_capacity = 0,
+    .collider_cell_size = 0.0f,
+    .spatial_query_capacity = 0,
+    .spatial_query_hit_capacity = 0,
+    .region_readback_capacity = 0,
+    .volume_export_brick_capacity = 0,
+    .hash_table_resize_interval = 0,
+    .periodic_box_size = glm::vec3(0.0f),
+    .periodic_box_min = glm::vec3(0.0f),
+};
+
+//
+// ===========================================================================================================
+//
+
+#endif // include guard
@@ -0,0 +1,29 @@
+#version 450
+
+layout(location = 0) in vec3 position_worldspace_in_;
+layout(location = 1) flat in vec3 particle_coord_worldspace_in_;
+
+// the length of the texel's ray inside this sphere; the spheres' lengths are added by blending
+layout(location = 0) out float thickness_out_;
+
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp, and particle_rasterize.vert.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+};
+
+// The second pass of the screen-space fluid surface; see `recordFluidSurface()` in graphics.cpp. Without a depth
+// test, so every sphere along the ray counts.
+void main(void) {
+
+    const float r = particle_radius_;
+    const vec3 ray_direction_unit = normalize(position_worldspace_in_ - camera_position_);
+    const vec3 to_center = particle_coord_worldspace_in_ - camera_position_;
+
+    // the roots of |camera + t * direction - center| = r are `b -+ sqrt(discriminant)`
+    const float b = dot(ray_direction_unit, to_center);
+    const float discriminant = b * b - (dot(to_center, to_center) - r * r);
+    if (discriminant < 0.0f) discard;
+
+    thickness_out_ = 2.0f * sqrt(discriminant);
+}
@@ -0,0 +1,675 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "fence_waiter.hpp"
+#include "readback_ring.hpp"
+#include "frame_capture.hpp"
+
+namespace frame_capture {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 COMPONENT_COUNT = 4; // xyz and the attribute
+constexpr u32 PARTICLE_SIZE = COMPONENT_COUNT * sizeof(u32);
+
+// A zero-run control byte stands for `c - ZERO_RUN_CONTROL + MIN_ZERO_RUN` zeros; below that, for `c + 1`
+// literals. See `frame_capture.hpp`.
+constexpr u32 ZERO_RUN_CONTROL = 128;
+constexpr u32 MIN_ZERO_RUN = 2;
+constexpr u32 MAX_ZERO_RUN = 255 - ZERO_RUN_CONTROL + MIN_ZERO_RUN;
+constexpr u32 MAX_LITERAL_RUN = ZERO_RUN_CONTROL;
+
+// The most viewers of the stream that are connected at once; the others are turned away.
+constexpr u32 MAX_VIEWER_COUNT = 8;
+
+struct FrameCapture;
+
+/// A connection to a viewer of the stream. Only used by the writer task, and by `destroy()` once it has finished.
+struct Viewer {
+    int socket_fd;
+    // The bytes that the socket hasn't taken yet, in [pending_begin, pending_end): whole frames, as a frame is
+    // only queued once the previous ones have been sent.
+    u8* p_pending;
+    size_t pending_capacity;
+    size_t pending_begin;
+    size_t pending_end;
+    bool needs_keyframe; // just connected, or skipped a frame
+};
+
+/// What was read back into a slot of the ring. Written by `captureFrame()` before the slot is submitted, and read
+/// by the writer once its copy has finished.
+struct SlotFrame {
+    u64 step_idx;
+    u32 particle_count;
+};
+
+struct FrameCapture {
+    const VulkanContext* vk_ctx;
+    CreateInfo info;
+
+    FILE* file; // NULL if the frames are only streamed
+    readback_ring::Ring* ring;
+    SlotFrame* slot_frames; // by slot
+
+    // only used by the writer task
+    u32* p_words;
+    u32* p_previous_words;
+    u8* p_planes;
+    u8* p_encoded;
+    u32 previous_particle_count; // 0 if there is no previous frame
+    u64 frames_since_keyframe;
+    int listen_fd; // -1 unless the frames are streamed
+    Viewer viewers[MAX_VIEWER_COUNT];
+    u32 viewer_count;
+    bool force_keyframe; // for a viewer that just connected, or that waits for one that would never come
+
+    pthread_mutex_t mutex;
+    // Guarded by `mutex`. Only the counts that the ring doesn't keep: the bytes, and the viewers.
+    Stats stats;
+};
+
+//
+// ===========================================================================================================
+//
+
+static u32 floatBits(f32 value) {
+    u32 bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static u32 zigzag(u32 delta) {
+    return (delta << 1) ^ (u32)( (i32)delta >> 31 );
+}
+
+
+/// `count` bytes of `p_src` as in step 1 of the format in `frame_capture.hpp`. `p_dst` must fit
+/// `count + divCeil(count, MAX_LITERAL_RUN)` bytes. Returns the encoded size.
+static size_t encodeZeroRuns(const u8* p_src, size_t count, u8* p_dst) {
+
+    size_t dst_idx = 0;
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t zero_count = 0;
+        while (i + zero_count < count and p_src[i + zero_count] == 0 and zero_count < MAX_ZERO_RUN)
+        {
+            zero_count++;
+        }
+
+        if (zero_count >= MIN_ZERO_RUN)
+        {
+            p_dst[dst_idx++] = (u8)(ZERO_RUN_CONTROL + zero_count - MIN_ZERO_RUN);
+            i += zero_count;
+            continue;
+        }
+
+        // literals, up to the next zero run
+        const size_t literals_begin = i;
+        while (
+            i < count and i - literals_begin < MAX_LITERAL_RUN and
+            !(i + 1 < count and p_src[i] == 0 and p_src[i + 1] == 0)
+        ) {
+            i++;
+        }
+        const size_t literal_count = i - literals_begin;
+
+        p_dst[dst_idx++] = (u8)(literal_count - 1);
+        memcpy(&p_dst[dst_idx], &p_src[literals_begin], literal_count);
+        dst_idx += literal_count;
+    }
+
+    return dst_idx;
+}
+
+
+/// Encodes `particle_count` vec4s at `p_positions`, `stride` vec4s apart, into `capture->p_encoded`, and returns
+/// the size and the flags. Steps 5 to 1 of the format in `frame_capture.hpp`.
+static size_t encodeFrame(
+    FrameCapture* capture,
+    const f32* p_positions,
+    const u32 particle_count,
+    const u32 stride,
+    u32* p_flags_out
+) {
+
+    ZoneScoped;
+
+    const u32 word_count = COMPONENT_COUNT * particle_count;
+    const f32 step = capture->info.quantization_step;
+    const bool quantized = step > 0.0f;
+
+    const u32 keyframe_interval = capture->info.keyframe_interval;
+    const bool keyframe =
+        capture->previous_particle_count != particle_count or capture->force_keyframe or
+        (keyframe_interval > 0 and capture->frames_since_keyframe >= keyframe_interval);
+
+    u32* p_words = capture->p_words;
+    for (u32 i = 0; i < particle_count; i++)
+    {
+        for (u32 d = 0; d < COMPONENT_COUNT; d++)
+        {
+            const f32 value = p_positions[COMPONENT_COUNT * (i * stride) + d];
+
+            u32 word = floatBits(value);
+            if (quantized and d < 3)
+            {
+                // clamped, because converting an out-of-range float is undefined
+                const f64 units = math::clamp(round((f64)value / (f64)step), (f64)INT32_MIN, (f64)INT32_MAX);
+                word = (u32)(i32)units;
+            }
+
+            const u32 idx = d * particle_count + i;
+            if (!keyframe)
+            {
+                const u32 previous = capture->p_previous_words[idx];
+                capture->p_previous_words[idx] = word;
+                word = (quantized and d < 3) ? zigzag(word - previous) : (word ^ previous);
+            }
+            else capture->p_previous_words[idx] = word;
+
+            p_words[idx] = word;
+        }
+    }
+
+    for (u32 b = 0; b < sizeof(u32); b++)
+    {
+        u8* p_plane = &capture->p_planes[b * word_count];
+        for (u32 j = 0; j < word_count; j++) p_plane[j] = (u8)(p_words[j] >> (8 * b));
+    }
+
+    capture->previous_particle_count = particle_count;
+    capture->frames_since_keyframe = keyframe ? 1 : capture->frames_since_keyframe + 1;
+    capture->force_keyframe = false;
+
+    *p_flags_out = (keyframe ? FRAME_FLAG_KEYFRAME : 0) | (quantized ? FRAME_FLAG_QUANTIZED : 0);
+    return encodeZeroRuns(capture->p_planes, (size_t)word_count * sizeof(u32), capture->p_encoded);
+}
+
+
+static FileHeader makeFileHeader() {
+
+    FileHeader file_header { .version = FILE_VERSION };
+    memcpy(file_header.magic, FILE_MAGIC, sizeof(file_header.magic));
+    return file_header;
+}
+
+
+/// Appends `count` bytes to the viewer's pending bytes.
+static void queueBytes(Viewer* viewer, const void* p_bytes, size_t count) {
+
+    if (viewer->pending_end + count > viewer->pending_capacity)
+    {
+        viewer->pending_capacity = viewer->pending_end + count;
+        viewer->p_pending = reallocArray(viewer->p_pending, viewer->pending_capacity, u8);
+    }
+    memcpy(&viewer->p_pending[viewer->pending_end], p_bytes, count);
+    viewer->pending_end += count;
+}
+
+
+/// Sends as many of the viewer's pending bytes as the socket takes without blocking, and adds them to
+/// `p_sent_byte_count`. Returns false if the viewer has disconnected.
+static bool flushViewer(Viewer* viewer, u64* p_sent_byte_count) {
+
+    while (viewer->pending_begin < viewer->pending_end)
+    {
+        const ssize_t sent = send(
+            viewer->socket_fd, &viewer->p_pending[viewer->pending_begin],
+            viewer->pending_end - viewer->pending_begin, MSG_NOSIGNAL
+        );
+        if (sent < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN or errno == EWOULDBLOCK;
+        }
+        viewer->pending_begin += (size_t)sent;
+        *p_sent_byte_count += (u64)sent;
+    }
+
+    viewer->pending_begin = 0;
+    viewer->pending_end = 0;
+    return true;
+}
+
+
+static void disconnectViewer(FrameCapture* capture, u32 viewer_idx) {
+
+    Viewer* viewer = &capture->viewers[viewer_idx];
+    close(viewer->socket_fd);
+    free(viewer->p_pending);
+
+    *viewer = capture->viewers[--capture->viewer_count];
+}
+
+
+/// Accepts the viewers that are waiting to connect, and queues the `FileHeader` for each; the next frame is a
+/// keyframe for them.
+static void acceptViewers(FrameCapture* capture) {
+
+    while (true)
+    {
+        const int socket_fd = accept4(capture->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket_fd == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN and errno != EWOULDBLOCK)
+            {
+                LOG_F(WARNING, "Failed to accept a stream viewer; errno: `%i`.", errno);
+            }
+            return;
+        }
+
+        if (capture->viewer_count == MAX_VIEWER_COUNT)
+        {
+            LOG_F(WARNING, "Turned a stream viewer away; %u are connected already.", MAX_VIEWER_COUNT);
+            close(socket_fd);
+            continue;
+        }
+
+        // the frames are sent whole, so there is nothing to gain from coalescing them
+        const int no_delay = 1;
+        setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        Viewer* viewer = &capture->viewers[capture->viewer_count++];
+        *viewer = Viewer { .socket_fd = socket_fd, .needs_keyframe = true };
+
+        const FileHeader file_header = makeFileHeader();
+        queueBytes(viewer, &file_header, sizeof(file_header));
+
+        capture->force_keyframe = true;
+        LOG_F(INFO, "A stream viewer connected; %u are connected.", capture->viewer_count);
+    }
+}
+
+
+/// Queues the frame for the viewers that have taken the previous ones, and sends what their sockets take. The
+/// others skip it, and wait for a keyframe; see `frame_capture.hpp`.
+static void streamFrame(
+    FrameCapture* capture,
+    const FrameHeader* header,
+    const u8* p_encoded,
+    Stats* p_stats_inout
+) {
+
+    ZoneScoped;
+
+    const bool keyframe = (header->flags & FRAME_FLAG_KEYFRAME) != 0;
+
+    // backwards, because disconnecting moves the last viewer into the gap
+    for (u32 viewer_idx = capture->viewer_count; viewer_idx-- > 0;)
+    {
+        Viewer* viewer = &capture->viewers[viewer_idx];
+
+        if (!flushViewer(viewer, &p_stats_inout->streamed_byte_count))
+        {
+            disconnectViewer(capture, viewer_idx);
+            LOG_F(INFO, "A stream viewer disconnected; %u are connected.", capture->viewer_count);
+            continue;
+        }
+
+        if (viewer->pending_begin != viewer->pending_end or (viewer->needs_keyframe and !keyframe))
+        {
+            p_stats_inout->stream_skipped_frame_count++;
+            viewer->needs_keyframe = true;
+            // otherwise the only keyframes are the ones where the particle count changes
+            if (capture->info.keyframe_interval == 0) capture->force_keyframe = true;
+            continue;
+        }
+
+        queueBytes(viewer, header, sizeof(*header));
+        queueBytes(viewer, p_encoded, header->encoded_size);
+        viewer->needs_keyframe = false;
+
+        if (!flushViewer(viewer, &p_stats_inout->streamed_byte_count))
+        {
+            disconnectViewer(capture, viewer_idx);
+            LOG_F(INFO, "A stream viewer disconnected; %u are connected.", capture->viewer_count);
+        }
+    }
+}
+
+
+/// Encodes one frame, and writes it to the file and streams it to the viewers, adding to the counts of
+/// `p_stats_inout`. Logs an error and returns false if the file can't be written.
+static bool encodeAndWriteFrame(
+    FrameCapture* capture,
+    const SlotFrame* frame,
+    const f32* p_positions,
+    Stats* p_stats_inout
+) {
+
+    ZoneScoped;
+
+    if (capture->listen_fd != -1) acceptViewers(capture);
+
+    // Nobody would read it. The next frame that is encoded is then a keyframe.
+    if (capture->file == NULL and capture->viewer_count == 0)
+    {
+        capture->previous_particle_count = 0;
+        return true;
+    }
+
+    const u32 stride = math::max(capture->info.lod_stride, 1u);
+    const u32 particle_count = (frame->particle_count + stride - 1) / stride;
+
+    u32 flags = 0;
+    const size_t encoded_size = encodeFrame(capture, p_positions, particle_count, stride, &flags);
+
+    const FrameHeader header {
+        .step_idx = frame->step_idx,
+        .particle_count = particle_count,
+        .flags = flags,
+        .quantization_step = (flags & FRAME_FLAG_QUANTIZED) ? capture->info.quantization_step : 0.0f,
+        .encoded_size = encoded_size,
+    };
+
+    if (capture->file != NULL)
+    {
+        const bool success =
+            fwrite(&header, sizeof(header), 1, capture->file) == 1 and
+            fwrite(capture->p_encoded, encoded_size, 1, capture->file) == 1;
+        if (!success)
+        {
+            LOG_F(
+                ERROR, "Failed to write frame capture file `%s`; errno: `%i`, description: `%s`.",
+                capture->info.filepath, errno, strerror(errno)
+            );
+            return false;
+        }
+    }
+
+    if (capture->listen_fd != -1) streamFrame(capture, &header, capture->p_encoded, p_stats_inout);
+
+    p_stats_inout->raw_byte_count += (u64)particle_count * PARTICLE_SIZE;
+    p_stats_inout->encoded_byte_count += sizeof(header) + encoded_size;
+    return true;
+}
+
+
+/// `readback_ring::PFN_WriteFrame`.
+static bool writeFrame(void* p_user_data, u32 slot_idx, const void* p_data) {
+
+    FrameCapture* capture = (FrameCapture*)p_user_data;
+
+    Stats counts {};
+    const bool success = encodeAndWriteFrame(
+        capture, &capture->slot_frames[slot_idx], (const f32*)p_data, &counts
+    );
+
+    int result = pthread_mutex_lock(&capture->mutex);
+    alwaysAssert(result == 0);
+
+    capture->stats.raw_byte_count += counts.raw_byte_count;
+    capture->stats.encoded_byte_count += counts.encoded_byte_count;
+    capture->stats.streamed_byte_count += counts.streamed_byte_count;
+    capture->stats.stream_skipped_frame_count += counts.stream_skipped_frame_count;
+    capture->stats.stream_viewer_count = capture->viewer_count;
+
+    result = pthread_mutex_unlock(&capture->mutex);
+    alwaysAssert(result == 0);
+
+    return success;
+}
+
+//
+// ===========================================================================================================
+//
+
+FrameCapture* create(
+    const VulkanContext* vk_ctx,
+    fence_waiter::FenceWaiter* fence_waiter,
+    const CreateInfo* info
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(info->particle_capacity > 0 and info->particle_capacity <= UINT32_MAX / COMPONENT_COUNT);
+    alwaysAssert(info->slot_count > 0);
+    alwaysAssert(info->quantization_step >= 0.0f);
+    alwaysAssert(info->filepath != NULL or info->stream_port != 0);
+
+    FILE* file = NULL;
+    if (info->filepath != NULL)
+    {
+        file = fopen(info->filepath, "wb");
+        if (file == NULL)
+        {
+            LOG_F(
+                ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+                info->filepath, errno, strerror(errno)
+            );
+            return NULL;
+        }
+
+        const FileHeader file_header = makeFileHeader();
+        if (fwrite(&file_header, sizeof(file_header), 1, file) != 1)
+        {
+            LOG_F(ERROR, "Failed to write file `%s`; errno: `%i`.", info->filepath, errno);
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    int listen_fd = -1;
+    if (info->stream_port != 0)
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        const int reuse_address = 1;
+        const sockaddr_in address {
+            .sin_family = AF_INET,
+            .sin_port = htons(info->stream_port),
+            .sin_addr = { .s_addr = htonl(INADDR_ANY) },
+        };
+        const bool success =
+            listen_fd != -1 and
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address)) == 0 and
+            bind(listen_fd, (const sockaddr*)&address, sizeof(address)) == 0 and
+            listen(listen_fd, MAX_VIEWER_COUNT) == 0;
+        if (!success)
+        {
+            LOG_F(
+                ERROR, "Failed to listen on port %u; errno: `%i`, description: `%s`.",
+                (u32)info->stream_port, errno, strerror(errno)
+            );
+            if (listen_fd != -1) close(listen_fd);
+            if (file != NULL) fclose(file);
+            return NULL;
+        }
+    }
+
+    FrameCapture* capture = callocArray(1, FrameCapture);
+    capture->vk_ctx = vk_ctx;
+    capture->info = *info;
+    capture->file = file;
+    capture->listen_fd = listen_fd;
+
+    capture->slot_frames = callocArray(info->slot_count, SlotFrame);
+
+    const readback_ring::CreateInfo ring_info {
+        // on the copy engine, if there is one, so that the copy overlaps the next step instead of delaying it
+        .queue_family_index = vk_ctx->transfer_queue_family_index,
+        .slot_size = info->particle_capacity * PARTICLE_SIZE,
+        .slot_count = info->slot_count,
+        .copy_finished_semaphores = true,
+        .p_write_frame = writeFrame,
+        .p_user_data = capture,
+    };
+    capture->ring = readback_ring::create(vk_ctx, fence_waiter, &ring_info);
+
+    const u32 word_count = COMPONENT_COUNT * (u32)info->particle_capacity;
+    const size_t plane_size = (size_t)word_count * sizeof(u32);
+    capture->p_words = mallocArray(word_count, u32);
+    capture->p_previous_words = mallocArray(word_count, u32);
+    capture->p_planes = mallocArray(plane_size, u8);
+    capture->p_encoded = mallocArray(plane_size + plane_size / MAX_LITERAL_RUN + 1, u8);
+
+    const int pthread_result = pthread_mutex_init(&capture->mutex, NULL);
+    alwaysAssert(pthread_result == 0);
+
+    LOG_F(
+        INFO, "Capturing frames to `%s`, streaming on port %u: slot_count=%u, keyframe_interval=%u, "
+        "quantization_step=%g, lod_stride=%u.",
+        (info->filepath != NULL) ? info->filepath : "", (u32)info->stream_port, info->slot_count,
+        info->keyframe_interval, (f64)info->quantization_step, math::max(info->lod_stride, 1u)
+    );
+
+    return capture;
+}
+
+
+void destroy(FrameCapture* capture) {
+
+    ZoneScoped;
+
+    // waits for the writer
+    const readback_ring::Stats ring_stats = readback_ring::destroy(capture->ring);
+
+    Stats stats = capture->stats;
+    stats.captured_frame_count = ring_stats.captured_frame_count;
+    stats.dropped_frame_count = ring_stats.dropped_frame_count;
+    stats.written_frame_count = ring_stats.written_frame_count;
+
+    const char* filepath = (capture->file != NULL) ? capture->info.filepath : "";
+    if (capture->file != NULL and fclose(capture->file) != 0) LOG_F(ERROR, "Failed to close file `%s`.", filepath);
+
+    // the writer task has finished, so the viewers are ours
+    for (u32 viewer_idx = 0; viewer_idx < capture->viewer_count; viewer_idx++)
+    {
+        close(capture->viewers[viewer_idx].socket_fd);
+        free(capture->viewers[viewer_idx].p_pending);
+    }
+    if (capture->listen_fd != -1) close(capture->listen_fd);
+
+    LOG_F(
+        INFO,
+        "Captured %" PRIu64 " frames to `%s`, and dropped %" PRIu64 ". Wrote %" PRIu64 " frames: %" PRIu64
+        " bytes, from %" PRIu64 " (%.1lf%%).",
+        stats.captured_frame_count, filepath, stats.dropped_frame_count,
+        stats.written_frame_count, stats.encoded_byte_count, stats.raw_byte_count,
+        stats.raw_byte_count > 0 ? 100.0 * (f64)stats.encoded_byte_count / (f64)stats.raw_byte_count : 0.0
+    );
+    if (capture->listen_fd != -1)
+    {
+        LOG_F(
+            INFO, "Streamed %" PRIu64 " bytes; the viewers skipped %" PRIu64 " frames.",
+            stats.streamed_byte_count, stats.stream_skipped_frame_count
+        );
+    }
+    if (ring_stats.write_failed) LOG_F(ERROR, "Some frames couldn't be written to `%s`.", filepath);
+
+    pthread_mutex_destroy(&capture->mutex);
+
+    free(capture->p_words);
+    free(capture->p_previous_words);
+    free(capture->p_planes);
+    free(capture->p_encoded);
+    free(capture->slot_frames);
+    free(capture);
+}
+
+
+VkSemaphore captureFrame(
+    FrameCapture* capture,
+    VkBuffer positions_buffer,
+    u32fast particle_count,
+    VkSemaphore wait_semaphore,
+    u64 wait_value,
+    u64 step_idx
+) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = capture->vk_ctx;
+
+    alwaysAssert(particle_count > 0 and particle_count <= capture->info.particle_capacity);
+
+    readback_ring::Slot slot {};
+    if (!readback_ring::beginFrame(capture->ring, false, &slot))
+    {
+        // only this thread drops frames
+        if (readback_ring::getStats(capture->ring).dropped_frame_count == 1)
+        {
+            LOG_F(WARNING, "Dropped frame capture of step %" PRIu64 "; the writer can't keep up.", step_idx);
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    // the writer doesn't read it until the slot is submitted
+    capture->slot_frames[slot.idx] = SlotFrame { .step_idx = step_idx, .particle_count = (u32)particle_count };
+
+    const VkDeviceSize copy_size = particle_count * PARTICLE_SIZE;
+    const VkBufferCopy region { .srcOffset = 0, .dstOffset = 0, .size = copy_size };
+    vk_ctx->procs_dev.CmdCopyBuffer(slot.command_buffer, positions_buffer, slot.readback_buffer, 1, &region);
+
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    // only the wait semaphore is a timeline semaphore
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &wait_value,
+    };
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &wait_semaphore,
+        .pWaitDstStageMask = &wait_stage,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &slot.copy_finished_semaphore,
+    };
+    readback_ring::submitFrame(capture->ring, &slot, vk_ctx->transfer_queue, submit_info, copy_size);
+
+    return slot.copy_finished_semaphore;
+}
+
+
+Stats getStats(FrameCapture* capture) {
+
+    const readback_ring::Stats ring_stats = readback_ring::getStats(capture->ring);
+
+    int result = pthread_mutex_lock(&capture->mutex);
+    alwaysAssert(result == 0);
+
+    Stats stats = capture->stats;
+
+    result = pthread_mutex_unlock(&capture->mutex);
+    alwaysAssert(result == 0);
+
+    stats.captured_frame_count = ring_stats.captured_frame_count;
+    stats.dropped_frame_count = ring_stats.dropped_frame_count;
+    stats.written_frame_count = ring_stats.written_frame_count;
+    return stats;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
@@ -0,0 +1,123 @@
+#ifndef _FRAME_CAPTURE_HPP
+#define _FRAME_CAPTURE_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+// #include "thread_pool.hpp"
+// #include "fence_waiter.hpp"
+
+/// Records the particle positions of selected steps to a file, without stalling the sim: each frame is copied
+/// into a `readback_ring`, whose writer encodes the frame and writes it once the copy has finished. If every slot
+/// of the ring is still waiting to be written, the frame is dropped and counted in `Stats::dropped_frame_count`.
+///
+/// File format, in host byte order: a `FileHeader`, then one `FrameHeader` and `FrameHeader::encoded_size`
+/// bytes per frame. Decoding a frame (see `encodeFrame()` in `frame_capture.cpp` for the inverse):
+///     1. Undo the zero-run encoding into `16 * particle_count` bytes: a control byte `c < 128` is followed by
+///        `c + 1` literal bytes; a control byte `c >= 128` stands for `c - 128 + 2` zero bytes.
+///     2. Those are 4 byte planes: byte `b` of word `j` is at `b * 4 * particle_count + j`.
+///     3. The words are component-major: word `d * particle_count + i` is component `d` of particle `i`, where
+///        component 3 is the attribute.
+///     4. Unless `FRAME_FLAG_KEYFRAME`, the words are deltas against the previous frame's words: the zigzag
+///        encoded difference for quantized coordinates, and the XOR otherwise (including the attribute).
+///     5. If `FRAME_FLAG_QUANTIZED`, the coordinates are `i32`s in units of `FrameHeader::quantization_step`;
+///        otherwise the words are the `f32` bits.
+/// The particles aren't tracked across frames: the delta is against the same index in the previous frame,
+/// which is the same particle, or a nearby one, because the sim keeps the particles spatially sorted.
+///
+/// The frames can also be streamed over TCP, to viewers on other machines: a viewer that connects to
+/// `CreateInfo::stream_port` receives the same bytes as the file, from a `FileHeader` and a keyframe on. Each
+/// viewer is sent whole frames, without blocking the writer: a viewer that hasn't taken the previous frame yet
+/// skips the next ones until a keyframe, which is how the rate adapts to each viewer's bandwidth.
+namespace frame_capture {
+
+//
+// ===========================================================================================================
+//
+
+struct FileHeader {
+    char magic[8]; // FILE_MAGIC
+    u32 version; // FILE_VERSION
+    u32 reserved;
+};
+constexpr char FILE_MAGIC[8] = { 'P', 'S', 'I', 'M', 'F', 'R', 'M', 'S' };
+constexpr u32 FILE_VERSION = 1;
+
+constexpr u32 FRAME_FLAG_KEYFRAME = 1 << 0;
+constexpr u32 FRAME_FLAG_QUANTIZED = 1 << 1;
+
+struct FrameHeader {
+    u64 step_idx; // as passed to `captureFrame()`
+    u32 particle_count;
+    u32 flags; // FRAME_FLAG_*
+    f32 quantization_step; // m; 0 unless FRAME_FLAG_QUANTIZED
+    u32 reserved;
+    u64 encoded_size; // bytes
+};
+
+struct CreateInfo {
+    const char* filepath; // created or truncated; NULL to only stream the frames
+    /// The readback buffers are sized for this many particles; `captureFrame()` can't capture more.
+    u32fast particle_capacity;
+    /// The slots of the readback ring, of `16 * particle_capacity` bytes each; more ride out slower disks
+    /// without dropping frames.
+    u32 slot_count;
+    /// Every this many frames is a keyframe, which doesn't depend on the previous ones. 0 for only the first
+    /// frame (and the frames whose particle count changed).
+    u32 keyframe_interval;
+    /// If positive, the coordinates are rounded to multiples of this (m), which makes the deltas much smaller.
+    /// If 0, the frames are lossless.
+    f32 quantization_step;
+    /// Only every this many particles are recorded, for a level of detail: as the particles are sorted by cell,
+    /// every cell keeps about the same fraction of its particles. 0 or 1 records them all.
+    u32 lod_stride;
+    /// If nonzero, the frames are also streamed to the viewers that connect to this TCP port, on any address.
+    u16 stream_port;
+};
+
+struct Stats {
+    u64 captured_frame_count; // including the ones that haven't been written yet
+    u64 dropped_frame_count;
+    u64 written_frame_count;
+    u64 raw_byte_count; // of the written frames, at 16 bytes per particle
+    u64 encoded_byte_count; // of the written frames, including the frame headers
+    u64 streamed_byte_count; // sent to the viewers, in total
+    u64 stream_skipped_frame_count; // frames that some viewer skipped, because it was still taking the previous one
+    u32 stream_viewer_count; // connected
+};
+
+struct FrameCapture;
+
+/// Logs an error and returns NULL if the file can't be created, or the port can't be listened on. `vk_ctx` and
+/// `fence_waiter` must outlive the capture.
+FrameCapture* create(const VulkanContext*, fence_waiter::FenceWaiter*, const CreateInfo* info);
+/// Waits for the frames that are left to be written, then closes the file and the viewers' connections, and logs
+/// the `Stats`. Every submission that waits on a semaphore returned by `captureFrame()` must have finished.
+void destroy(FrameCapture*);
+
+/// Submits a copy of the first `particle_count` vec4s of `positions_buffer` to `vk_ctx->transfer_queue`, once
+/// `wait_semaphore` (a timeline semaphore, like `fluid_sim::getTimelineSemaphore()`) reaches `wait_value`.
+/// `positions_buffer` must be shared with the transfer queue's family; the sim's are (see
+/// `getSharedQueueFamilies()`).
+/// Never waits for the GPU or the disk.
+/// Returns a binary semaphore that is signaled once the copy is done; the next submission that writes
+/// `positions_buffer` must wait on it (e.g. as the `optional_wait_semaphore` of the next `advance()`).
+/// Returns VK_NULL_HANDLE if the frame was dropped, which needs no wait.
+VkSemaphore captureFrame(
+    FrameCapture*,
+    VkBuffer positions_buffer,
+    u32fast particle_count,
+    VkSemaphore wait_semaphore,
+    u64 wait_value,
+    u64 step_idx
+);
+
+Stats getStats(FrameCapture*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
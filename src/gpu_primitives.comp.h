@@ -0,0 +1,113 @@
+
+// Shared by the `gpu_primitives_*.comp` kernels of gpu_primitives.cpp, which all have the same descriptor set layout
+// and push constants, and each use the bindings they need. The includer enables GL_KHR_shader_subgroup_arithmetic
+// and declares the workgroup size first.
+//
+// The kernels lean on the subgroup operations, so that a workgroup-wide scan or reduction is one subgroup operation,
+// a barrier, and one more subgroup operation over the subgroups' totals, instead of log2(workgroup size) rounds
+// through shared memory. They assume that the workgroup size is a multiple of the subgroup size.
+
+// Must match the `BINDING_*` constants in gpu_primitives.cpp. Each kernel's comment says what it binds to them.
+layout(binding = 0, std430) buffer Input { uint input_[]; };
+layout(binding = 1, std430) buffer Output { uint output_[]; };
+layout(binding = 2, std430) buffer Scratch { uint scratch_[]; };
+layout(binding = 3, std430) buffer Auxiliary { uint auxiliary_[]; };
+
+// Must match `PushConstants` in gpu_primitives.cpp. The offsets are in words.
+layout(push_constant, std140) uniform PushConstants {
+    uint count_;
+    uint input_offset_;
+    uint output_offset_;
+    uint scratch_offset_;
+    uint flags_;
+    uint param_0_;
+    uint param_1_;
+    uint param_2_;
+};
+
+// Must match `ReduceOp` in gpu_primitives.hpp.
+#define REDUCE_OP_ADD 0u
+#define REDUCE_OP_MIN 1u
+#define REDUCE_OP_MAX 2u
+
+// Must match the `FLAG_*` constants in gpu_primitives.cpp.
+#define FLAG_PREDICATE 1u // scan `input_[i] != 0` instead of `input_[i]`
+#define FLAG_FINAL_PASS 2u // of a two-pass kernel
+
+// Must match SCAN_ITEMS_PER_INVOCATION in gpu_primitives.cpp.
+#define SCAN_ITEMS_PER_INVOCATION 4u
+#define SCAN_BLOCK_SIZE (gl_WorkGroupSize.x * SCAN_ITEMS_PER_INVOCATION)
+
+// a total per subgroup, of which there are at most as many as invocations
+shared uint subgroup_totals[gl_WorkGroupSize.x];
+shared uint workgroup_total;
+
+
+uint reduceIdentity(const uint op) {
+    return (op == REDUCE_OP_MIN) ? 0xFFFFFFFFu : 0u;
+}
+
+uint reduceCombine(const uint op, const uint a, const uint b) {
+    if (op == REDUCE_OP_MIN) return min(a, b);
+    if (op == REDUCE_OP_MAX) return max(a, b);
+    return a + b;
+}
+
+// `op` must be the same over the subgroup.
+uint subgroupReduce(const uint op, const uint value) {
+    if (op == REDUCE_OP_MIN) return subgroupMin(value);
+    if (op == REDUCE_OP_MAX) return subgroupMax(value);
+    return subgroupAdd(value);
+}
+
+// The reduction of `value` over the workgroup, in every invocation. Must be called in uniform control flow.
+uint workgroupReduce(const uint op, const uint value) {
+
+    const uint subgroup_value = subgroupReduce(op, value);
+    if (subgroupElect()) subgroup_totals[gl_SubgroupID] = subgroup_value;
+    barrier();
+
+    if (gl_SubgroupID == 0)
+    {
+        uint total = reduceIdentity(op);
+        for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups; i += gl_SubgroupSize)
+        {
+            total = reduceCombine(op, total, subgroup_totals[i]);
+        }
+        total = subgroupReduce(op, total);
+        if (subgroupElect()) workgroup_total = total;
+    }
+    barrier();
+
+    const uint result = workgroup_total;
+    barrier(); // before a next call overwrites it
+    return result;
+}
+
+// The exclusive prefix sum of `value` over the workgroup, in order of `gl_LocalInvocationIndex`; leaves the sum of
+// all of them in `workgroup_total`. Must be called in uniform control flow, and only once per dispatch.
+uint workgroupExclusiveAdd(const uint value) {
+
+    const uint subgroup_prefix = subgroupExclusiveAdd(value);
+    const uint subgroup_total = subgroupAdd(value);
+    if (subgroupElect()) subgroup_totals[gl_SubgroupID] = subgroup_total;
+    barrier();
+
+    // the first subgroup scans the totals in place, a subgroup's worth at a time
+    if (gl_SubgroupID == 0)
+    {
+        uint carry = 0;
+        for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize)
+        {
+            const uint i = first + gl_SubgroupInvocationID;
+            const uint total = (i < gl_NumSubgroups) ? subgroup_totals[i] : 0u;
+            const uint prefix = subgroupExclusiveAdd(total);
+            if (i < gl_NumSubgroups) subgroup_totals[i] = carry + prefix;
+            carry += subgroupAdd(total);
+        }
+        if (subgroupElect()) workgroup_total = carry;
+    }
+    barrier();
+
+    return subgroup_totals[gl_SubgroupID] + subgroup_prefix;
+}
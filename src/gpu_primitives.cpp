@@ -0,0 +1,856 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "types.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "defer.hpp"
+#include "file_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "gpu_primitives.hpp"
+
+namespace gpu_primitives {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 WORKGROUP_SIZE = 256;
+
+// The bindings of gpu_primitives.comp.h: the input, the output, the scratch buffer and an auxiliary one, in the
+// order of a `createPlan()` row; and, for the sort, those of fluidSim_radixSort.comp.h, whose histograms and state
+// are the last two.
+constexpr u32 BINDING_COUNT = 6;
+
+// Must match the defines in gpu_primitives.comp.h.
+constexpr u32 FLAG_PREDICATE = 1 << 0;
+constexpr u32 FLAG_FINAL_PASS = 1 << 1;
+constexpr u32 SCAN_ITEMS_PER_INVOCATION = 4;
+constexpr u32 SCAN_BLOCK_SIZE = WORKGROUP_SIZE * SCAN_ITEMS_PER_INVOCATION;
+// which covers 2^30 words
+constexpr u32 MAX_SCAN_LEVEL_COUNT = 3;
+
+// The workgroups of the first passes of the two-pass kernels, which stride over their inputs; a reduction's final
+// workgroup then has a partial per invocation, and a histogram's final pass sums a column this tall per bin.
+constexpr u32 REDUCE_WORKGROUP_COUNT = WORKGROUP_SIZE;
+constexpr u32 HISTOGRAM_WORKGROUP_COUNT = 64;
+constexpr u32 HISTOGRAM_KEYS_PER_INVOCATION = 16; // at least, before the workgroup count is capped
+constexpr u32 SEGMENTED_REDUCE_MAX_WORKGROUP_COUNT = 4096;
+
+// Must match the constants in fluidSim_radixSort.comp.h.
+constexpr u32 RADIX_SORT_BITS_PER_PASS = 8;
+constexpr u32 RADIX_SORT_ITEMS_PER_INVOCATION = 16;
+constexpr u32 RADIX_SORT_TILE_SIZE = WORKGROUP_SIZE * RADIX_SORT_ITEMS_PER_INVOCATION;
+constexpr u32 RADIX_SORT_STATE_WORD_COUNT = 10; // `SortState`, which these stages don't use
+
+/// Must match `PushConstants` in gpu_primitives.comp.h.
+struct PushConstants {
+    u32 count;
+    u32 input_offset; // in words; as are the others
+    u32 output_offset;
+    u32 scratch_offset;
+    u32 flags; // FLAG_*
+    u32 param_0;
+    u32 param_1;
+    u32 param_2;
+};
+
+/// Must match `PushConstants` in fluidSim_radixSort.comp.h, which is a prefix of the pipeline layout's range.
+struct RadixSortPushConstants {
+    u32 array_size;
+    u32 bit_shift;
+    u32 tile_count;
+    u32 is_first_pass;
+};
+
+enum Pipeline {
+    PIPELINE_SCAN_BLOCKS,
+    PIPELINE_ADD_BLOCK_OFFSETS,
+    PIPELINE_COMPACT,
+    PIPELINE_REDUCE,
+    PIPELINE_SEGMENTED_REDUCE,
+    PIPELINE_HISTOGRAM,
+    PIPELINE_RADIX_SORT_HISTOGRAM,
+    PIPELINE_RADIX_SORT_SCAN,
+    PIPELINE_RADIX_SORT_SCATTER,
+    PIPELINE_COUNT,
+};
+
+const char* const PIPELINE_SPIRV_FILEPATHS[PIPELINE_COUNT] {
+    "build/shaders/gpu_primitives_scanBlocks.comp.spv",
+    "build/shaders/gpu_primitives_addBlockOffsets.comp.spv",
+    "build/shaders/gpu_primitives_compact.comp.spv",
+    "build/shaders/gpu_primitives_reduce.comp.spv",
+    "build/shaders/gpu_primitives_segmentedReduce.comp.spv",
+    "build/shaders/gpu_primitives_histogram.comp.spv",
+    "build/shaders/fluidSim_radixSort_histogram.comp.spv",
+    "build/shaders/fluidSim_radixSort_scan.comp.spv",
+    "build/shaders/fluidSim_radixSort_scatter.comp.spv",
+};
+
+struct Context {
+    VkDescriptorSetLayout descriptor_set_layout;
+    // shared by the pipelines, so that a set and the push constants stay bound across them
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipelines[PIPELINE_COUNT];
+};
+
+enum PlanKind {
+    PLAN_KIND_SCAN,
+    PLAN_KIND_COMPACT,
+    PLAN_KIND_REDUCE,
+    PLAN_KIND_SEGMENTED_REDUCE,
+    PLAN_KIND_HISTOGRAM,
+    PLAN_KIND_RADIX_SORT,
+};
+
+// The plans' sets, by what they bind. The scans of the levels past the first bind only the scratch buffer.
+constexpr u32 PLAN_SET_FIRST = 0;
+constexpr u32 PLAN_SET_SCRATCH = 1; // a scan's; a sort's second set swaps the first's pairs of ranges
+constexpr u32 PLAN_SET_COMPACT = 2;
+constexpr u32 PLAN_MAX_SET_COUNT = 3;
+
+struct Plan {
+    PlanKind kind;
+    u32 capacity;
+    ReduceOp op;
+    u32 bin_count;
+
+    VkBuffer scratch_buffer;
+    VmaAllocation scratch_allocation;
+    VkDeviceSize scratch_size;
+
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet descriptor_sets[PLAN_MAX_SET_COUNT];
+
+    // A scan's and a compaction's, in words into the scratch buffer: the block totals of each level past the
+    // first, `scan_level_offsets[level]`, and the total of the whole scan, which the top level's block writes.
+    u32 scan_level_offsets[MAX_SCAN_LEVEL_COUNT];
+    u32 scan_total_offset;
+};
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+static inline u32 divCeil(u32 a, u32 b) {
+    return (a + b - 1) / b;
+}
+
+
+static inline VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+static VkShaderModule createShaderModuleFromSpirvFile(const VulkanContext* vk_ctx, const char* spirv_filepath) {
+
+    size_t spirv_byte_count = 0;
+    void* spirv_bytes = file_util::readEntireFile(spirv_filepath, &spirv_byte_count);
+    if (spirv_bytes == NULL) ABORT_F("Failed to read SPIR-V file `%s`.", spirv_filepath);
+    defer(free(spirv_bytes));
+
+    alwaysAssert(spirv_byte_count % sizeof(u32) == 0);
+    alwaysAssert((uintptr_t)spirv_bytes % alignof(u32) == 0);
+
+    const VkShaderModuleCreateInfo module_info {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = spirv_byte_count,
+        .pCode = (const u32*)spirv_bytes,
+    };
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    VkResult result = vk_ctx->procs_dev.CreateShaderModule(vk_ctx->device, &module_info, NULL, &shader_module);
+    assertVk(result);
+
+    return shader_module;
+}
+
+
+extern Context* createContext(const VulkanContext* vk_ctx) {
+
+    ZoneScoped;
+
+    VkResult result;
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+
+    const VkPhysicalDeviceSubgroupProperties* subgroup_props = &vk_ctx->physical_device_subgroup_properties;
+    const VkSubgroupFeatureFlags required_subgroup_ops =
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_VOTE_BIT;
+    if (
+        (subgroup_props->supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) == 0
+        or (subgroup_props->supportedOperations & required_subgroup_ops) != required_subgroup_ops
+        or WORKGROUP_SIZE % subgroup_props->subgroupSize != 0
+    ) {
+        ABORT_F("The GPU primitives need subgroup arithmetic and vote operations in compute shaders.");
+    }
+
+    Context* ctx = callocArray(1, Context);
+
+    VkDescriptorSetLayoutBinding bindings[BINDING_COUNT] {};
+    for (u32 i = 0; i < BINDING_COUNT; i++)
+    {
+        bindings[i] = VkDescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+    const VkDescriptorSetLayoutCreateInfo layout_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = BINDING_COUNT,
+        .pBindings = bindings,
+    };
+    result = procs->CreateDescriptorSetLayout(vk_ctx->device, &layout_info, NULL, &ctx->descriptor_set_layout);
+    assertVk(result);
+
+    static_assert(sizeof(RadixSortPushConstants) <= sizeof(PushConstants));
+    const VkPushConstantRange push_constant_range {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(PushConstants),
+    };
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &ctx->descriptor_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range,
+    };
+    result = procs->CreatePipelineLayout(vk_ctx->device, &pipeline_layout_info, NULL, &ctx->pipeline_layout);
+    assertVk(result);
+
+    const VkSpecializationMapEntry specialization_map_entry {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(u32),
+    };
+    const VkSpecializationInfo specialization_info {
+        .mapEntryCount = 1,
+        .pMapEntries = &specialization_map_entry,
+        .dataSize = sizeof(u32),
+        .pData = &WORKGROUP_SIZE,
+    };
+
+    VkShaderModule shader_modules[PIPELINE_COUNT] {};
+    VkComputePipelineCreateInfo pipeline_infos[PIPELINE_COUNT] {};
+    for (u32 i = 0; i < PIPELINE_COUNT; i++)
+    {
+        shader_modules[i] = createShaderModuleFromSpirvFile(vk_ctx, PIPELINE_SPIRV_FILEPATHS[i]);
+        pipeline_infos[i] = VkComputePipelineCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shader_modules[i],
+                .pName = "main",
+                .pSpecializationInfo = &specialization_info,
+            },
+            .layout = ctx->pipeline_layout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = -1,
+        };
+    }
+    result = procs->CreateComputePipelines(
+        vk_ctx->device, vk_ctx->pipeline_cache, PIPELINE_COUNT, pipeline_infos, NULL, ctx->pipelines
+    );
+    assertVk(result);
+
+    for (u32 i = 0; i < PIPELINE_COUNT; i++) procs->DestroyShaderModule(vk_ctx->device, shader_modules[i], NULL);
+
+    return ctx;
+}
+
+
+extern void destroyContext(Context* ctx, const VulkanContext* vk_ctx) {
+
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+    for (u32 i = 0; i < PIPELINE_COUNT; i++) procs->DestroyPipeline(vk_ctx->device, ctx->pipelines[i], NULL);
+    procs->DestroyPipelineLayout(vk_ctx->device, ctx->pipeline_layout, NULL);
+    procs->DestroyDescriptorSetLayout(vk_ctx->device, ctx->descriptor_set_layout, NULL);
+    free(ctx);
+}
+
+//
+// ===========================================================================================================
+//
+
+/// Creates the plan with its scratch buffer of `scratch_size` bytes, and `set_count` sets, each binding the ranges
+/// of its row of `set_ranges`. A range whose buffer is VK_NULL_HANDLE is of the scratch buffer instead, at its
+/// offset, or all of it if its size is 0.
+static Plan* createPlan(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    PlanKind kind,
+    VkDeviceSize scratch_size,
+    u32 set_count,
+    const BufferRange set_ranges[][BINDING_COUNT]
+) {
+
+    VkResult result;
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+
+    Plan* plan = callocArray(1, Plan);
+    plan->kind = kind;
+    plan->scratch_size = math::max(scratch_size, (VkDeviceSize)sizeof(u32));
+
+    // the caller may record the plan on any of the queues
+    u32 queue_families[3];
+    const u32 queue_family_count = getSharedQueueFamilies(vk_ctx, queue_families);
+    const VkBufferCreateInfo buffer_info {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = plan->scratch_size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = (queue_family_count > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = queue_family_count,
+        .pQueueFamilyIndices = queue_families,
+    };
+    const VmaAllocationCreateInfo alloc_info {
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+    };
+    result = vmaCreateBuffer(
+        vk_ctx->vma_allocator, &buffer_info, &alloc_info, &plan->scratch_buffer, &plan->scratch_allocation, NULL
+    );
+    assertVk(result);
+    TracyAllocN(plan->scratch_buffer, plan->scratch_size, "gpu primitives scratch");
+
+    const VkDescriptorPoolSize pool_size {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = set_count * BINDING_COUNT,
+    };
+    const VkDescriptorPoolCreateInfo pool_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = set_count,
+        .poolSizeCount = 1,
+        .pPoolSizes = &pool_size,
+    };
+    result = procs->CreateDescriptorPool(vk_ctx->device, &pool_info, NULL, &plan->descriptor_pool);
+    assertVk(result);
+
+    alwaysAssert(set_count <= PLAN_MAX_SET_COUNT);
+    VkDescriptorSetLayout layouts[PLAN_MAX_SET_COUNT];
+    for (u32 i = 0; i < set_count; i++) layouts[i] = ctx->descriptor_set_layout;
+    const VkDescriptorSetAllocateInfo set_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = plan->descriptor_pool,
+        .descriptorSetCount = set_count,
+        .pSetLayouts = layouts,
+    };
+    result = procs->AllocateDescriptorSets(vk_ctx->device, &set_info, plan->descriptor_sets);
+    assertVk(result);
+
+    VkDescriptorBufferInfo buffer_infos[PLAN_MAX_SET_COUNT * BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[PLAN_MAX_SET_COUNT * BINDING_COUNT] {};
+    for (u32 set_idx = 0; set_idx < set_count; set_idx++)
+    {
+        for (u32 binding = 0; binding < BINDING_COUNT; binding++)
+        {
+            const u32 write_idx = set_idx * BINDING_COUNT + binding;
+            BufferRange range = set_ranges[set_idx][binding];
+            if (range.buffer == VK_NULL_HANDLE)
+            {
+                range.buffer = plan->scratch_buffer;
+                if (range.size == 0) range.size = VK_WHOLE_SIZE;
+            }
+
+            buffer_infos[write_idx] = VkDescriptorBufferInfo {
+                .buffer = range.buffer,
+                .offset = range.offset,
+                .range = range.size,
+            };
+            writes[write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = plan->descriptor_sets[set_idx],
+                .dstBinding = binding,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &buffer_infos[write_idx],
+                .pTexelBufferView = NULL,
+            };
+        }
+    }
+    procs->UpdateDescriptorSets(vk_ctx->device, set_count * BINDING_COUNT, writes, 0, NULL);
+
+    return plan;
+}
+
+
+/// Lays out the block totals of the levels of a scan of up to `capacity` words in the scratch buffer, from
+/// `first_offset` words in, and returns the words that they take up, with the total's.
+static u32 layOutScanLevels(Plan* plan, u32 capacity, u32 first_offset) {
+
+    u32 offset = first_offset;
+    u32 level_capacity = capacity;
+    u32 level_idx = 1;
+    while (level_capacity > SCAN_BLOCK_SIZE)
+    {
+        level_capacity = divCeil(level_capacity, SCAN_BLOCK_SIZE);
+        alwaysAssert(level_idx < MAX_SCAN_LEVEL_COUNT);
+        plan->scan_level_offsets[level_idx] = offset;
+        offset += level_capacity;
+        level_idx++;
+    }
+    plan->scan_total_offset = offset;
+    offset++;
+
+    return offset - first_offset;
+}
+
+
+extern Plan* createScan(
+    const Context* ctx, const VulkanContext* vk_ctx, BufferRange input, BufferRange output, u32 capacity
+) {
+
+    Plan dummy {};
+    const u32 scratch_word_count = layOutScanLevels(&dummy, capacity, 0);
+
+    const BufferRange set_ranges[2][BINDING_COUNT] {
+        { input, output },
+        {},
+    };
+    Plan* plan = createPlan(ctx, vk_ctx, PLAN_KIND_SCAN, scratch_word_count * sizeof(u32), 2, set_ranges);
+    plan->capacity = capacity;
+    (void)layOutScanLevels(plan, capacity, 0);
+
+    return plan;
+}
+
+
+extern Plan* createCompact(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    BufferRange flags,
+    BufferRange indices_out,
+    BufferRange count_out,
+    u32 capacity
+) {
+
+    // the flags' scan comes first in the scratch buffer, as they must stay as they are for the scatter
+    Plan dummy {};
+    const u32 scratch_word_count = capacity + layOutScanLevels(&dummy, capacity, capacity);
+
+    const BufferRange set_ranges[3][BINDING_COUNT] {
+        { flags },
+        {},
+        { flags, indices_out, {}, count_out },
+    };
+    Plan* plan = createPlan(ctx, vk_ctx, PLAN_KIND_COMPACT, scratch_word_count * sizeof(u32), 3, set_ranges);
+    plan->capacity = capacity;
+    (void)layOutScanLevels(plan, capacity, capacity);
+
+    return plan;
+}
+
+
+extern Plan* createReduce(
+    const Context* ctx, const VulkanContext* vk_ctx, BufferRange input, BufferRange result_out, ReduceOp op
+) {
+
+    const BufferRange set_ranges[1][BINDING_COUNT] {
+        { input, result_out },
+    };
+    Plan* plan = createPlan(
+        ctx, vk_ctx, PLAN_KIND_REDUCE, REDUCE_WORKGROUP_COUNT * sizeof(u32), 1, set_ranges
+    );
+    plan->capacity = UINT32_MAX;
+    plan->op = op;
+
+    return plan;
+}
+
+
+extern Plan* createSegmentedReduce(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    BufferRange values,
+    BufferRange segment_firsts,
+    BufferRange results_out,
+    ReduceOp op
+) {
+
+    const BufferRange set_ranges[1][BINDING_COUNT] {
+        { values, results_out, {}, segment_firsts },
+    };
+    Plan* plan = createPlan(ctx, vk_ctx, PLAN_KIND_SEGMENTED_REDUCE, 0, 1, set_ranges);
+    plan->capacity = UINT32_MAX;
+    plan->op = op;
+
+    return plan;
+}
+
+
+extern Plan* createHistogram(
+    const Context* ctx, const VulkanContext* vk_ctx, BufferRange keys, BufferRange bins_out, u32 bin_count
+) {
+
+    alwaysAssert(bin_count > 0 and bin_count <= HISTOGRAM_MAX_BIN_COUNT);
+    alwaysAssert((bin_count & (bin_count - 1)) == 0);
+
+    const BufferRange set_ranges[1][BINDING_COUNT] {
+        { keys, bins_out },
+    };
+    Plan* plan = createPlan(
+        ctx, vk_ctx, PLAN_KIND_HISTOGRAM, HISTOGRAM_WORKGROUP_COUNT * bin_count * sizeof(u32), 1, set_ranges
+    );
+    plan->capacity = UINT32_MAX;
+    plan->bin_count = bin_count;
+
+    return plan;
+}
+
+
+extern Plan* createRadixSort(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    const BufferRange keys[2],
+    const BufferRange values[2],
+    u32 capacity
+) {
+
+    // the histograms, then the state, at an offset that a descriptor may start at
+    const VkDeviceSize alignment = vk_ctx->physical_device_properties.limits.minStorageBufferOffsetAlignment;
+    const VkDeviceSize histograms_size =
+        (VkDeviceSize)math::max(divCeil(capacity, RADIX_SORT_TILE_SIZE), 1u)
+        * (1 << RADIX_SORT_BITS_PER_PASS) * sizeof(u32);
+    const VkDeviceSize state_offset = alignUp(histograms_size, alignment);
+    const VkDeviceSize state_size = RADIX_SORT_STATE_WORD_COUNT * sizeof(u32);
+
+    const BufferRange histograms { VK_NULL_HANDLE, 0, histograms_size };
+    const BufferRange state { VK_NULL_HANDLE, state_offset, state_size };
+    const BufferRange set_ranges[2][BINDING_COUNT] {
+        { keys[0], values[0], keys[1], values[1], histograms, state },
+        { keys[1], values[1], keys[0], values[0], histograms, state },
+    };
+    Plan* plan = createPlan(ctx, vk_ctx, PLAN_KIND_RADIX_SORT, state_offset + state_size, 2, set_ranges);
+    plan->capacity = capacity;
+
+    return plan;
+}
+
+
+extern void destroyPlan(Plan* plan, const VulkanContext* vk_ctx) {
+
+    vk_ctx->procs_dev.DestroyDescriptorPool(vk_ctx->device, plan->descriptor_pool, NULL);
+    TracyFreeN(plan->scratch_buffer, "gpu primitives scratch");
+    vmaDestroyBuffer(vk_ctx->vma_allocator, plan->scratch_buffer, plan->scratch_allocation);
+    free(plan);
+}
+
+
+extern VkDeviceSize getScratchSize(const Plan* plan) {
+    return plan->scratch_size;
+}
+
+//
+// ===========================================================================================================
+//
+
+static void recordComputeBarrier(const VulkanContext* vk_ctx, VkCommandBuffer cmd) {
+
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+}
+
+
+static void recordDispatch(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    Pipeline pipeline,
+    VkDescriptorSet descriptor_set,
+    const PushConstants* push_constants,
+    u32 workgroup_count
+) {
+
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+    procs->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx->pipelines[pipeline]);
+    procs->CmdBindDescriptorSets(
+        cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx->pipeline_layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    procs->CmdPushConstants(
+        cmd, ctx->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), push_constants
+    );
+    procs->CmdDispatch(cmd, workgroup_count, 1, 1);
+}
+
+
+/// Scans `count` words of the first set's input into its output, at `output_offset` words, block by block, level
+/// by level, then adds each level's block offsets to the level below. Leaves the total at `scan_total_offset`.
+static void recordScanLevels(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    const Plan* plan,
+    u32 count,
+    u32 output_offset,
+    u32 first_level_flags
+) {
+
+    u32 level_counts[MAX_SCAN_LEVEL_COUNT] { count };
+    u32 level_count = 1;
+    while (level_counts[level_count - 1] > SCAN_BLOCK_SIZE)
+    {
+        alwaysAssert(level_count < MAX_SCAN_LEVEL_COUNT);
+        level_counts[level_count] = divCeil(level_counts[level_count - 1], SCAN_BLOCK_SIZE);
+        level_count++;
+    }
+
+    PushConstants levels_push_constants[MAX_SCAN_LEVEL_COUNT] {};
+    for (u32 level_idx = 0; level_idx < level_count; level_idx++)
+    {
+        const bool is_top = level_idx + 1 == level_count;
+        levels_push_constants[level_idx] = PushConstants {
+            .count = level_counts[level_idx],
+            .input_offset = (level_idx == 0) ? 0 : plan->scan_level_offsets[level_idx],
+            .output_offset = (level_idx == 0) ? output_offset : plan->scan_level_offsets[level_idx],
+            .scratch_offset = is_top ? plan->scan_total_offset : plan->scan_level_offsets[level_idx + 1],
+            .flags = (level_idx == 0) ? first_level_flags : 0,
+        };
+    }
+
+    // down, writing each level's block totals to the next level; an empty scan still writes its total
+    for (u32 level_idx = 0; level_idx < level_count; level_idx++)
+    {
+        const u32 set_idx = (level_idx == 0) ? PLAN_SET_FIRST : PLAN_SET_SCRATCH;
+        recordDispatch(
+            ctx, vk_ctx, cmd, PIPELINE_SCAN_BLOCKS, plan->descriptor_sets[set_idx],
+            &levels_push_constants[level_idx], math::max(divCeil(level_counts[level_idx], SCAN_BLOCK_SIZE), 1u)
+        );
+        if (level_idx + 1 < level_count) recordComputeBarrier(vk_ctx, cmd);
+    }
+
+    // then up, adding the scanned block totals of the level above to each level
+    for (u32 level_idx = level_count - 1; level_idx-- > 0;)
+    {
+        recordComputeBarrier(vk_ctx, cmd);
+        const u32 set_idx = (level_idx == 0) ? PLAN_SET_FIRST : PLAN_SET_SCRATCH;
+        recordDispatch(
+            ctx, vk_ctx, cmd, PIPELINE_ADD_BLOCK_OFFSETS, plan->descriptor_sets[set_idx],
+            &levels_push_constants[level_idx], divCeil(level_counts[level_idx], SCAN_BLOCK_SIZE)
+        );
+    }
+}
+
+
+extern void recordScan(
+    const Context* ctx, const VulkanContext* vk_ctx, VkCommandBuffer cmd, const Plan* plan, u32 count
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_SCAN);
+    alwaysAssert(count <= plan->capacity);
+
+    recordScanLevels(ctx, vk_ctx, cmd, plan, count, 0, 0);
+}
+
+
+extern void recordCompact(
+    const Context* ctx, const VulkanContext* vk_ctx, VkCommandBuffer cmd, const Plan* plan, u32 count
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_COMPACT);
+    alwaysAssert(count <= plan->capacity);
+
+    // the flags' scan, as 0s and 1s, to the start of the scratch buffer
+    recordScanLevels(ctx, vk_ctx, cmd, plan, count, 0, FLAG_PREDICATE);
+    recordComputeBarrier(vk_ctx, cmd);
+
+    const PushConstants push_constants {
+        .count = count,
+        .scratch_offset = 0,
+        .param_0 = plan->scan_total_offset,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_COMPACT, plan->descriptor_sets[PLAN_SET_COMPACT], &push_constants,
+        math::max(divCeil(count, WORKGROUP_SIZE), 1u)
+    );
+}
+
+
+extern void recordReduce(
+    const Context* ctx, const VulkanContext* vk_ctx, VkCommandBuffer cmd, const Plan* plan, u32 count
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_REDUCE);
+
+    const u32 workgroup_count = math::clamp(divCeil(count, WORKGROUP_SIZE), 1u, REDUCE_WORKGROUP_COUNT);
+    const PushConstants partials_push_constants {
+        .count = count,
+        .param_0 = plan->op,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_REDUCE, plan->descriptor_sets[PLAN_SET_FIRST], &partials_push_constants,
+        workgroup_count
+    );
+    recordComputeBarrier(vk_ctx, cmd);
+
+    const PushConstants final_push_constants {
+        .count = workgroup_count,
+        .flags = FLAG_FINAL_PASS,
+        .param_0 = plan->op,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_REDUCE, plan->descriptor_sets[PLAN_SET_FIRST], &final_push_constants, 1
+    );
+}
+
+
+extern void recordSegmentedReduce(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    const Plan* plan,
+    u32 value_count,
+    u32 segment_count
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_SEGMENTED_REDUCE);
+    if (segment_count == 0) return;
+
+    // a subgroup per segment
+    const u32 subgroups_per_workgroup = WORKGROUP_SIZE / vk_ctx->physical_device_subgroup_properties.subgroupSize;
+    const u32 workgroup_count =
+        math::min(divCeil(segment_count, subgroups_per_workgroup), SEGMENTED_REDUCE_MAX_WORKGROUP_COUNT);
+
+    const PushConstants push_constants {
+        .count = value_count,
+        .param_0 = segment_count,
+        .param_1 = plan->op,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_SEGMENTED_REDUCE, plan->descriptor_sets[PLAN_SET_FIRST], &push_constants,
+        workgroup_count
+    );
+}
+
+
+extern void recordHistogram(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    const Plan* plan,
+    u32 key_count,
+    u32 bit_shift
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_HISTOGRAM);
+    alwaysAssert(bit_shift < 32);
+
+    const u32 workgroup_count = math::clamp(
+        divCeil(key_count, WORKGROUP_SIZE * HISTOGRAM_KEYS_PER_INVOCATION), 1u, HISTOGRAM_WORKGROUP_COUNT
+    );
+    const PushConstants partials_push_constants {
+        .count = key_count,
+        .param_0 = bit_shift,
+        .param_1 = plan->bin_count,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_HISTOGRAM, plan->descriptor_sets[PLAN_SET_FIRST], &partials_push_constants,
+        workgroup_count
+    );
+    recordComputeBarrier(vk_ctx, cmd);
+
+    const PushConstants final_push_constants {
+        .count = workgroup_count,
+        .flags = FLAG_FINAL_PASS,
+        .param_0 = bit_shift,
+        .param_1 = plan->bin_count,
+    };
+    recordDispatch(
+        ctx, vk_ctx, cmd, PIPELINE_HISTOGRAM, plan->descriptor_sets[PLAN_SET_FIRST], &final_push_constants,
+        divCeil(plan->bin_count, WORKGROUP_SIZE)
+    );
+}
+
+
+extern u32 recordRadixSort(
+    const Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    const Plan* plan,
+    u32 count,
+    u32 pass_count,
+    bool index_values
+) {
+
+    alwaysAssert(plan->kind == PLAN_KIND_RADIX_SORT);
+    alwaysAssert(count <= plan->capacity);
+    alwaysAssert(pass_count * RADIX_SORT_BITS_PER_PASS <= 32);
+
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+    const u32 tile_count = divCeil(count, RADIX_SORT_TILE_SIZE);
+    const Pipeline stage_pipelines[3] {
+        PIPELINE_RADIX_SORT_HISTOGRAM, PIPELINE_RADIX_SORT_SCAN, PIPELINE_RADIX_SORT_SCATTER,
+    };
+    const u32 stage_workgroup_counts[3] { tile_count, 1, tile_count };
+
+    for (u32 pass_idx = 0; pass_idx < pass_count; pass_idx++)
+    {
+        // the stages' layouts are the same, so the set and the push constants stay bound across them
+        procs->CmdBindDescriptorSets(
+            cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx->pipeline_layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &plan->descriptor_sets[pass_idx % 2],
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        const RadixSortPushConstants push_constants {
+            .array_size = count,
+            .bit_shift = pass_idx * RADIX_SORT_BITS_PER_PASS,
+            .tile_count = tile_count,
+            .is_first_pass = pass_idx == 0 and index_values,
+        };
+        procs->CmdPushConstants(
+            cmd, ctx->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants
+        );
+
+        for (u32 stage_idx = 0; stage_idx < 3; stage_idx++)
+        {
+            if (pass_idx > 0 or stage_idx > 0) recordComputeBarrier(vk_ctx, cmd);
+            procs->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx->pipelines[stage_pipelines[stage_idx]]);
+            procs->CmdDispatch(cmd, stage_workgroup_counts[stage_idx], 1, 1);
+        }
+    }
+
+    return pass_count % 2;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
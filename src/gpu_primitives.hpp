@@ -0,0 +1,123 @@
+#ifndef _GPU_PRIMITIVES_HPP
+#define _GPU_PRIMITIVES_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+
+/// Data-parallel building blocks over u32 arrays in storage buffers, which any compute work may record into its own
+/// command buffers, over its own buffers: an exclusive scan, a stream compaction, a reduction and a segmented one, a
+/// histogram, and the sim's LSD radix sort (see fluidSim_radixSort.comp.h). Their kernels are the
+/// `gpu_primitives_*.comp` shaders, built ahead of time into build/shaders, whose workgroup-wide steps are subgroup
+/// operations rather than rounds through shared memory.
+///
+/// A `Context` holds the pipelines, and is shared by everything on the device. A `Plan` is one primitive bound to a
+/// set of the caller's buffers, up to a capacity: it owns its descriptor sets and whatever scratch memory it needs,
+/// so that recording it is only dispatches and the barriers between them. The caller places the barriers before
+/// (for its writes of the inputs) and after (for its reads of the outputs): every kernel reads and writes its
+/// buffers in the compute stage, as shader reads and writes. A plan's scratch is reused by each recording, so a
+/// plan mustn't be recorded again until the GPU is done with the previous recording, like the caller's buffers.
+///
+/// The `BufferRange` offsets must be multiples of `minStorageBufferOffsetAlignment`.
+/// See src/headless/gpu_primitives_benchmark.cpp for their throughputs on a device.
+namespace gpu_primitives {
+
+//
+// ===========================================================================================================
+//
+
+struct BufferRange {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size; // or VK_WHOLE_SIZE
+};
+
+/// Must match the REDUCE_OP_* defines in gpu_primitives.comp.h.
+enum ReduceOp : u32 {
+    REDUCE_OP_ADD = 0, // wraps around
+    REDUCE_OP_MIN = 1,
+    REDUCE_OP_MAX = 2,
+};
+
+/// The most bins of a histogram plan.
+constexpr u32 HISTOGRAM_MAX_BIN_COUNT = 2048;
+
+struct Context;
+struct Plan;
+
+/// Aborts if the device lacks the subgroup operations that the kernels need (arithmetic and vote, in compute
+/// shaders), or if a kernel's SPIR-V can't be read.
+Context* createContext(const VulkanContext*);
+void destroyContext(Context*, const VulkanContext*);
+
+/// The exclusive prefix sum of up to `capacity` words of `input` into `output`, which may be the same range.
+Plan* createScan(const Context*, const VulkanContext*, BufferRange input, BufferRange output, u32 capacity);
+
+/// The indices of the nonzero words of up to `capacity` words of `flags`, in increasing order, into `indices_out`,
+/// and how many there are into the first word of `count_out`.
+Plan* createCompact(
+    const Context*, const VulkanContext*,
+    BufferRange flags, BufferRange indices_out, BufferRange count_out, u32 capacity
+);
+
+/// The reduction of `input` by `op` into the first word of `result_out`; to the identity if `input` is empty.
+Plan* createReduce(
+    const Context*, const VulkanContext*, BufferRange input, BufferRange result_out, ReduceOp op
+);
+
+/// The reduction of each segment of `values` by `op` into its word of `results_out`. The segments are given by
+/// their first indices into `values`, in increasing order, in `segment_firsts`: segment `s` is
+/// `[segment_firsts[s], segment_firsts[s + 1])`, and the last one ends at the value count.
+Plan* createSegmentedReduce(
+    const Context*, const VulkanContext*,
+    BufferRange values, BufferRange segment_firsts, BufferRange results_out, ReduceOp op
+);
+
+/// The counts of `keys` into `bin_count` words of `bins_out`, by `(key >> bit_shift) & (bin_count - 1)`.
+/// `bin_count` is a power of two, up to HISTOGRAM_MAX_BIN_COUNT.
+Plan* createHistogram(
+    const Context*, const VulkanContext*, BufferRange keys, BufferRange bins_out, u32 bin_count
+);
+
+/// Sorts up to `capacity` (key, value) pairs by their keys, stably, 8 bits of the keys per pass. The passes
+/// ping-pong between the two pairs of ranges: the first reads `keys[0]` and `values[0]`, and writes `keys[1]` and
+/// `values[1]`, the second writes the first ones back, and so on. Each range holds `capacity` words.
+Plan* createRadixSort(
+    const Context*, const VulkanContext*, const BufferRange keys[2], const BufferRange values[2], u32 capacity
+);
+
+void destroyPlan(Plan*, const VulkanContext*);
+
+/// The bytes of device memory that the plan owns.
+VkDeviceSize getScratchSize(const Plan*);
+
+// The `count`s are at most the plan's capacity.
+
+void recordScan(const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 count);
+
+void recordCompact(const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 count);
+
+void recordReduce(const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 count);
+
+void recordSegmentedReduce(
+    const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 value_count, u32 segment_count
+);
+
+void recordHistogram(
+    const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 key_count, u32 bit_shift
+);
+
+/// Sorts by the low `8 * pass_count` bits of the keys. If `index_values`, the values are ignored, and each key's
+/// value is its index in `keys[0]`. Returns the index of the pair of ranges that holds the result,
+/// `pass_count % 2`.
+[[nodiscard]] u32 recordRadixSort(
+    const Context*, const VulkanContext*, VkCommandBuffer, const Plan*, u32 count, u32 pass_count, bool index_values
+);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
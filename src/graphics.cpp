@@ -1,8 +1,11 @@
 #include <cerrno>
 #include <cinttypes>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 // TODO I'd rather not have a dependency on any windowing library in this file. We should be able to
 // completely replace GLFW; we're only using:
@@ -36,6 +39,7 @@
 #include <tracy/tracy/TracyVulkan.hpp>
 
 #include "types.hpp"
+#include "trace.hpp"
 #include "math_util.hpp"
 #include "error_util.hpp"
 #include "vk_procs.hpp"
@@ -46,7 +50,11 @@
 #include "file_watch.hpp"
 #include "vulkan_context.hpp"
 #include "file_util.hpp"
+#include "thread_pool.hpp"
+#include "gpu_primitives.hpp"
 #include "graphics.hpp"
+#include "voxel_store.hpp"
+#include "voxel_mesh.hpp"
 
 namespace graphics {
 
@@ -54,6 +62,8 @@ using glm::mat4;
 using glm::vec2;
 using glm::vec3;
 using glm::vec4;
+using glm::ivec2;
+using glm::uvec2;
 
 //
 // Type definitions that have to exist early on in the file :( very annoying =================================
@@ -67,6 +77,19 @@ enum PipelineIndex {
     PIPELINE_INDEX_CUBE_OUTLINE_PIPELINE,
     PIPELINE_INDEX_PARTICLE_PIPELINE,
     PIPELINE_INDEX_PARTICLE_RASTERIZE_PIPELINE,
+    PIPELINE_INDEX_FLUID_DEPTH_PIPELINE,
+    PIPELINE_INDEX_FLUID_THICKNESS_PIPELINE,
+    PIPELINE_INDEX_FLUID_COMPOSITE_PIPELINE,
+    PIPELINE_INDEX_SURFACE_MESH_PIPELINE,
+    PIPELINE_INDEX_PARTICLE_LOD_PIPELINE,
+    PIPELINE_INDEX_PARTICLE_UPSCALE_PIPELINE,
+    PIPELINE_INDEX_VOXEL_ID_PIPELINE,
+    PIPELINE_INDEX_PARTICLE_ID_PIPELINE,
+    PIPELINE_INDEX_LINE_PIPELINE,
+    PIPELINE_INDEX_PARTICLE_TRANSLUCENT_PIPELINE,
+    PIPELINE_INDEX_VISIBILITY_VOXEL_PIPELINE,
+    PIPELINE_INDEX_VISIBILITY_SHADE_PIPELINE,
+    PIPELINE_INDEX_DENSITY_VOLUME_PIPELINE,
 
     PIPELINE_INDEX_COUNT,
 };
@@ -98,6 +121,13 @@ struct PipelineAndLayout {
     VkPipelineLayout layout;
 };
 
+struct ComputePipelineBuildInfo {
+    const char* spirv_filepath;
+    u32 workgroup_size;
+    u32 push_constants_size;
+    PipelineAndLayout* p_pipeline;
+};
+
 struct ShaderSourceFileWatchIds {
     filewatch::FileID vertex_shader_id;
     filewatch::FileID fragment_shader_id;
@@ -108,6 +138,16 @@ struct GraphicsPipelineShaderModules {
     VkShaderModule fragment_shader_module;
 };
 
+/// The hot reload of a pipeline; see `startShaderReload()`.
+struct PipelineReload {
+    u32 pipeline_idx;
+    VkShaderStageFlags modified_shaders; // the shaders to recompile, VERTEX and/or FRAGMENT
+    // only if `success`; the shader modules that weren't recompiled are the current ones
+    GraphicsPipelineShaderModules new_shader_modules;
+    PipelineAndLayout new_pipeline;
+    bool success;
+};
+
 //
 // Forward declarations ======================================================================================
 //
@@ -117,6 +157,18 @@ static FN_CreatePipeline createGridPipeline;
 static FN_CreatePipeline createCubeOutlinePipeline;
 static FN_CreatePipeline createParticlePipeline;
 static FN_CreatePipeline createParticleRasterizePipeline;
+static FN_CreatePipeline createFluidDepthPipeline;
+static FN_CreatePipeline createFluidThicknessPipeline;
+static FN_CreatePipeline createFluidCompositePipeline;
+static FN_CreatePipeline createSurfaceMeshPipeline;
+static FN_CreatePipeline createParticleLodPipeline;
+static FN_CreatePipeline createParticleUpscalePipeline;
+static FN_CreatePipeline createVoxelIdPipeline;
+static FN_CreatePipeline createParticleIdPipeline;
+static FN_CreatePipeline createLinePipeline;
+static FN_CreatePipeline createParticleTranslucentPipeline;
+static FN_CreatePipeline createVisibilityShadePipeline;
+static FN_CreatePipeline createDensityVolumePipeline;
 
 //
 // Global constants ==========================================================================================
@@ -128,6 +180,8 @@ static FN_CreatePipeline createParticleRasterizePipeline;
 //     Implement a check to verify that this format is supported. If it isn't, either pick a different format
 //     or abort.
 const VkFormat SWAPCHAIN_FORMAT = VK_FORMAT_B8G8R8A8_SRGB;
+// see `getLastRenderedOffscreenImage()`
+const VkImageLayout OFFSCREEN_IMAGE_FINAL_LAYOUT = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 const VkColorSpaceKHR SWAPCHAIN_COLOR_SPACE = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 
 // TODO FIXME:
@@ -142,10 +196,96 @@ const u32 INVALID_PHYSICAL_DEVICE_IDX = UINT32_MAX;
 const u32 INVALID_SWAPCHAIN_IMAGE_IDX = UINT32_MAX;
 const u32 INVALID_SUBPASS_IDX = UINT32_MAX;
 
-const u32fast MAX_FRAMES_IN_FLIGHT = 2;
-
 const u32fast PHYSICAL_DEVICE_TYPE_COUNT = 5; // number of VK_PHYSICAL_DEVICE_TYPE_xxx variants
 
+// Followed by the device's `pipelineCacheUUID` in hex, so that switching devices or drivers doesn't discard the
+// other caches.
+const char* const PIPELINE_CACHE_FILEPATH_PREFIX = "build/pipeline_cache_";
+
+// The SPIR-V of the hot-reloaded shaders, by a hash of their preprocessed source and compile options; see
+// `compileShaderSrcFileToSpirv()`. Bump the version to discard it, when something that isn't hashed changes how the
+// shaders compile.
+const char* const SPIRV_CACHE_DIRPATH = "build/spirv_cache";
+const u32 SPIRV_CACHE_VERSION = 1;
+const u32 SPIRV_MAGIC_NUMBER = 0x07230203;
+
+// Not hot-reloaded, unlike the graphics pipelines.
+const char* const VOXEL_CULL_SPIRV_FILEPATH = "build/shaders/voxel_cull.comp.spv";
+const u32 VOXEL_CULL_WORKGROUP_SIZE = 64;
+
+// The stages of the tiled particle rendering; see particle_tiles.comp.h. Not hot-reloaded either.
+const char* const PARTICLE_TILES_COUNT_SPIRV_FILEPATH = "build/shaders/particle_tiles_count.comp.spv";
+const char* const PARTICLE_TILES_SCAN_SPIRV_FILEPATH = "build/shaders/particle_tiles_scan.comp.spv";
+const char* const PARTICLE_TILES_BIN_SPIRV_FILEPATH = "build/shaders/particle_tiles_bin.comp.spv";
+const char* const PARTICLE_TILES_SORT_SPIRV_FILEPATH = "build/shaders/particle_tiles_sort.comp.spv";
+const u32 PARTICLE_TILES_WORKGROUP_SIZE = 64; // count and bin; a particle per invocation
+const u32 PARTICLE_TILES_SCAN_WORKGROUP_SIZE = 256;
+const u32 PARTICLE_TILES_SORT_WORKGROUP_SIZE = 256;
+
+// The mesh-shaded particle rendering, if the device supports `VK_EXT_mesh_shader`. Not hot-reloaded either; the
+// fragment shader is particle_rasterize.frag, as built.
+const char* const PARTICLE_MESH_TASK_SPIRV_FILEPATH = "build/shaders/particle_mesh.task.spv";
+const char* const PARTICLE_MESH_MESH_SPIRV_FILEPATH = "build/shaders/particle_mesh.mesh.spv";
+const char* const PARTICLE_MESH_FRAGMENT_SPIRV_FILEPATH = "build/shaders/particle_rasterize.frag.spv";
+// Must match particle_mesh.mesh.h. Within the minimum limits of `VkPhysicalDeviceMeshShaderPropertiesEXT`.
+const u32 PARTICLE_CLUSTER_SIZE = 32; // particles per mesh workgroup
+const u32 PARTICLE_CLUSTERS_PER_TASK = 32; // clusters per task workgroup
+
+// The smoothing of the screen-space fluid surface; see `recordFluidSurface()`. Not hot-reloaded either.
+const char* const FLUID_SMOOTH_SPIRV_FILEPATH = "build/shaders/fluid_smooth.comp.spv";
+const u32 FLUID_SMOOTH_WORKGROUP_SIZE = 64; // a texel per invocation, along a row
+
+// The stages of the surface mesh extraction; see surface_mesh.comp.h and `recordSurfaceMesh()`. Not hot-reloaded
+// either.
+const char* const SURFACE_MESH_MARK_SPIRV_FILEPATH = "build/shaders/surface_mesh_mark.comp.spv";
+const char* const SURFACE_MESH_PREPARE_SPIRV_FILEPATH = "build/shaders/surface_mesh_prepare.comp.spv";
+const char* const SURFACE_MESH_CLASSIFY_SPIRV_FILEPATH = "build/shaders/surface_mesh_classify.comp.spv";
+const char* const SURFACE_MESH_SCAN_SPIRV_FILEPATH = "build/shaders/surface_mesh_scan.comp.spv";
+const char* const SURFACE_MESH_EMIT_SPIRV_FILEPATH = "build/shaders/surface_mesh_emit.comp.spv";
+const u32 SURFACE_MESH_MARK_WORKGROUP_SIZE = 64; // a particle per invocation
+const u32 SURFACE_MESH_PREPARE_WORKGROUP_SIZE = 1;
+const u32 SURFACE_MESH_BLOCK_WORKGROUP_SIZE = 128; // classify and emit; a workgroup per block, about a sample each
+const u32 SURFACE_MESH_SCAN_WORKGROUP_SIZE = 1024;
+
+// The level of detail of the rasterized particles; see particle_lod.comp and `recordParticleLod()`. Not
+// hot-reloaded either.
+const char* const PARTICLE_LOD_SPIRV_FILEPATH = "build/shaders/particle_lod.comp.spv";
+const u32 PARTICLE_LOD_WORKGROUP_SIZE = 64; // an entry of the cell list per invocation
+
+// The budgeted subsampling of the rasterized particles; see particle_subsample.comp and `recordParticleSubsample()`.
+// Not hot-reloaded either.
+const char* const PARTICLE_SUBSAMPLE_SPIRV_FILEPATH = "build/shaders/particle_subsample.comp.spv";
+const u32 PARTICLE_SUBSAMPLE_WORKGROUP_SIZE = 64; // a particle per invocation
+
+// The depth pyramid of occlusion culling; see depth_pyramid.comp.h and `recordOcclusionCulling()`. Not hot-reloaded
+// either.
+const char* const DEPTH_PYRAMID_SPIRV_FILEPATH = "build/shaders/depth_pyramid.comp.spv";
+const u32 DEPTH_PYRAMID_WORKGROUP_SIZE = 64; // a texel per invocation
+
+// The resolve of a pick; see object_id_resolve.comp and `recordPick()`. Not hot-reloaded either.
+const char* const OBJECT_ID_RESOLVE_SPIRV_FILEPATH = "build/shaders/object_id_resolve.comp.spv";
+const u32 OBJECT_ID_RESOLVE_WORKGROUP_SIZE = 64; // a texel per invocation, along a row
+
+// The blend of two sim states into the particles; see particle_interpolate.comp and `recordParticleInterpolation()`.
+// Not hot-reloaded either.
+const char* const PARTICLE_INTERPOLATE_SPIRV_FILEPATH = "build/shaders/particle_interpolate.comp.spv";
+const u32 PARTICLE_INTERPOLATE_WORKGROUP_SIZE = 256; // a particle per invocation
+
+// The segments of the debug vector field; see vector_field.comp and `recordVectorField()`. Not hot-reloaded either.
+const char* const VECTOR_FIELD_SPIRV_FILEPATH = "build/shaders/vector_field.comp.spv";
+const u32 VECTOR_FIELD_WORKGROUP_SIZE = 256; // a particle per invocation
+
+// The depth sort of the translucent particles; see `recordParticleDepthSort()`. The keys and the gather are the
+// renderer's; the sort is `gpu_primitives_`'s. Not hot-reloaded either.
+const char* const PARTICLE_DEPTH_SORT_KEYS_SPIRV_FILEPATH = "build/shaders/particle_depth_sort_keys.comp.spv";
+const char* const PARTICLE_DEPTH_SORT_GATHER_SPIRV_FILEPATH = "build/shaders/particle_depth_sort_gather.comp.spv";
+const u32 PARTICLE_DEPTH_SORT_WORKGROUP_SIZE = 256; // a particle per invocation
+
+// The splat of the density volume; see density_volume_splat.comp and `recordDensityVolume()`. Not hot-reloaded
+// either.
+const char* const DENSITY_VOLUME_SPLAT_SPIRV_FILEPATH = "build/shaders/density_volume_splat.comp.spv";
+const u32 DENSITY_VOLUME_SPLAT_WORKGROUP_SIZE = 64; // an entry of the cell list per invocation
+
 const PipelineBuildFromSpirvFilesInfo PIPELINE_BUILD_FROM_SPIRV_FILES_INFOS[PIPELINE_INDEX_COUNT] {
     [PIPELINE_INDEX_VOXEL_PIPELINE] = {
         .vertex_shader_spirv_filepath = "build/shaders/voxel.vert.spv",
@@ -172,6 +312,71 @@ const PipelineBuildFromSpirvFilesInfo PIPELINE_BUILD_FROM_SPIRV_FILES_INFOS[PIPE
         .fragment_shader_spirv_filepath = "build/shaders/particle_rasterize.frag.spv",
         .pfn_createPipeline = createParticleRasterizePipeline,
     },
+    [PIPELINE_INDEX_FLUID_DEPTH_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle_rasterize.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/fluid_depth.frag.spv",
+        .pfn_createPipeline = createFluidDepthPipeline,
+    },
+    [PIPELINE_INDEX_FLUID_THICKNESS_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle_rasterize.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/fluid_thickness.frag.spv",
+        .pfn_createPipeline = createFluidThicknessPipeline,
+    },
+    [PIPELINE_INDEX_FLUID_COMPOSITE_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/fluid_composite.frag.spv",
+        .pfn_createPipeline = createFluidCompositePipeline,
+    },
+    [PIPELINE_INDEX_SURFACE_MESH_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/surface_mesh.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/surface_mesh.frag.spv",
+        .pfn_createPipeline = createSurfaceMeshPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_LOD_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle_lod.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/particle_lod.frag.spv",
+        .pfn_createPipeline = createParticleLodPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_UPSCALE_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/particle_upscale.frag.spv",
+        .pfn_createPipeline = createParticleUpscalePipeline,
+    },
+    [PIPELINE_INDEX_VOXEL_ID_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/voxel.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/object_id_voxel.frag.spv",
+        .pfn_createPipeline = createVoxelIdPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_ID_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle_rasterize.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/object_id_particle.frag.spv",
+        .pfn_createPipeline = createParticleIdPipeline,
+    },
+    [PIPELINE_INDEX_LINE_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/line.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/line.frag.spv",
+        .pfn_createPipeline = createLinePipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_TRANSLUCENT_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/particle_rasterize.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/particle_translucent.frag.spv",
+        .pfn_createPipeline = createParticleTranslucentPipeline,
+    },
+    [PIPELINE_INDEX_VISIBILITY_VOXEL_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/voxel.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/visibility_voxel.frag.spv",
+        .pfn_createPipeline = createVoxelIdPipeline,
+    },
+    [PIPELINE_INDEX_VISIBILITY_SHADE_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/grid.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/visibility_shade.frag.spv",
+        .pfn_createPipeline = createVisibilityShadePipeline,
+    },
+    [PIPELINE_INDEX_DENSITY_VOLUME_PIPELINE] = {
+        .vertex_shader_spirv_filepath = "build/shaders/grid.vert.spv",
+        .fragment_shader_spirv_filepath = "build/shaders/density_volume.frag.spv",
+        .pfn_createPipeline = createDensityVolumePipeline,
+    },
 };
 
 const PipelineHotReloadInfo PIPELINE_HOT_RELOAD_INFOS[PIPELINE_INDEX_COUNT] {
@@ -200,6 +405,71 @@ const PipelineHotReloadInfo PIPELINE_HOT_RELOAD_INFOS[PIPELINE_INDEX_COUNT] {
         .fragment_shader_src_filepath = "src/particle_rasterize.frag",
         .pfn_createPipeline = createParticleRasterizePipeline,
     },
+    [PIPELINE_INDEX_FLUID_DEPTH_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle_rasterize.vert",
+        .fragment_shader_src_filepath = "src/fluid_depth.frag",
+        .pfn_createPipeline = createFluidDepthPipeline,
+    },
+    [PIPELINE_INDEX_FLUID_THICKNESS_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle_rasterize.vert",
+        .fragment_shader_src_filepath = "src/fluid_thickness.frag",
+        .pfn_createPipeline = createFluidThicknessPipeline,
+    },
+    [PIPELINE_INDEX_FLUID_COMPOSITE_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle.vert",
+        .fragment_shader_src_filepath = "src/fluid_composite.frag",
+        .pfn_createPipeline = createFluidCompositePipeline,
+    },
+    [PIPELINE_INDEX_SURFACE_MESH_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/surface_mesh.vert",
+        .fragment_shader_src_filepath = "src/surface_mesh.frag",
+        .pfn_createPipeline = createSurfaceMeshPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_LOD_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle_lod.vert",
+        .fragment_shader_src_filepath = "src/particle_lod.frag",
+        .pfn_createPipeline = createParticleLodPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_UPSCALE_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle.vert",
+        .fragment_shader_src_filepath = "src/particle_upscale.frag",
+        .pfn_createPipeline = createParticleUpscalePipeline,
+    },
+    [PIPELINE_INDEX_VOXEL_ID_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/voxel.vert",
+        .fragment_shader_src_filepath = "src/object_id_voxel.frag",
+        .pfn_createPipeline = createVoxelIdPipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_ID_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle_rasterize.vert",
+        .fragment_shader_src_filepath = "src/object_id_particle.frag",
+        .pfn_createPipeline = createParticleIdPipeline,
+    },
+    [PIPELINE_INDEX_LINE_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/line.vert",
+        .fragment_shader_src_filepath = "src/line.frag",
+        .pfn_createPipeline = createLinePipeline,
+    },
+    [PIPELINE_INDEX_PARTICLE_TRANSLUCENT_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/particle_rasterize.vert",
+        .fragment_shader_src_filepath = "src/particle_translucent.frag",
+        .pfn_createPipeline = createParticleTranslucentPipeline,
+    },
+    [PIPELINE_INDEX_VISIBILITY_VOXEL_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/voxel.vert",
+        .fragment_shader_src_filepath = "src/visibility_voxel.frag",
+        .pfn_createPipeline = createVoxelIdPipeline,
+    },
+    [PIPELINE_INDEX_VISIBILITY_SHADE_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/grid.vert",
+        .fragment_shader_src_filepath = "src/visibility_shade.frag",
+        .pfn_createPipeline = createVisibilityShadePipeline,
+    },
+    [PIPELINE_INDEX_DENSITY_VOLUME_PIPELINE] = {
+        .vertex_shader_src_filepath = "src/grid.vert",
+        .fragment_shader_src_filepath = "src/density_volume.frag",
+        .pfn_createPipeline = createDensityVolumePipeline,
+    },
 };
 
 //
@@ -214,27 +484,106 @@ static VulkanContext vk_ctx_ {};
 
 static bool initialized_ = false;
 
+// The pipelines are created on it, concurrently; see `init()`.
+static thread_pool::ThreadPool* thread_pool_ = NULL;
+
 static shaderc_compiler_t libshaderc_compiler_ = NULL;
 
 static VkInstance instance_ = VK_NULL_HANDLE;
 static VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
 static VkPhysicalDeviceProperties physical_device_properties_ {};
+static VkPhysicalDeviceSubgroupProperties physical_device_subgroup_properties_ {};
 static u32 queue_family_ = INVALID_QUEUE_FAMILY_IDX;
 static VkDevice device_ = VK_NULL_HANDLE;
 static VkQueue queue_ = VK_NULL_HANDLE;
+// The same as `queue_family_` and `queue_` if there is no separate compute queue. A second queue of
+// `queue_family_` if `compute_queue_idx_` is 1.
+static u32 compute_queue_family_ = INVALID_QUEUE_FAMILY_IDX;
+static u32 compute_queue_idx_ = 0;
+static VkQueue compute_queue_ = VK_NULL_HANDLE;
+// The same as `compute_queue_family_` and `compute_queue_` if the device has no transfer-only queue family.
+static u32 transfer_queue_family_ = INVALID_QUEUE_FAMILY_IDX;
+static VkQueue transfer_queue_ = VK_NULL_HANDLE;
 
 static PipelineAndLayout pipelines_[PIPELINE_INDEX_COUNT] {};
 static GraphicsPipelineShaderModules shader_modules_[PIPELINE_INDEX_COUNT] {};
+static PipelineAndLayout voxel_cull_pipeline_ {};
+static PipelineAndLayout particle_tiles_count_pipeline_ {};
+static PipelineAndLayout particle_tiles_scan_pipeline_ {};
+static PipelineAndLayout particle_tiles_bin_pipeline_ {};
+static PipelineAndLayout particle_tiles_sort_pipeline_ {};
+
+// Whether `VK_EXT_mesh_shader` is enabled. If not, `particle_mesh_pipeline_`, `cmdDrawMeshTasksEXT_` and
+// `cmdDrawMeshTasksIndirectEXT_` are null.
+static bool mesh_shaders_supported_ = false;
+// for the visibility buffer; see `setVisibilityBufferEnabled()`
+static bool draw_indirect_first_instance_supported_ = false;
+static PipelineAndLayout particle_mesh_pipeline_ {};
+static PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasksEXT_ = NULL;
+static PFN_vkCmdDrawMeshTasksIndirectEXT cmdDrawMeshTasksIndirectEXT_ = NULL;
+// Null unless the device has `VK_KHR_push_descriptor`; see `VulkanContext::cmd_push_descriptor_set`.
+static PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSetKHR_ = NULL;
+// Whether `VK_KHR_present_id` and `VK_KHR_present_wait` are enabled. If not, `waitForPresentKHR_` is null, and the
+// presents don't have ids; see `waitForLastPresent()`.
+static bool present_wait_supported_ = false;
+static PFN_vkWaitForPresentKHR waitForPresentKHR_ = NULL;
+static PipelineAndLayout fluid_smooth_pipeline_ {};
+static PipelineAndLayout surface_mesh_mark_pipeline_ {};
+static PipelineAndLayout surface_mesh_prepare_pipeline_ {};
+static PipelineAndLayout surface_mesh_classify_pipeline_ {};
+static PipelineAndLayout surface_mesh_scan_pipeline_ {};
+static PipelineAndLayout surface_mesh_emit_pipeline_ {};
+static PipelineAndLayout particle_lod_pipeline_ {};
+static PipelineAndLayout particle_subsample_pipeline_ {};
+static PipelineAndLayout depth_pyramid_pipeline_ {};
+static PipelineAndLayout object_id_resolve_pipeline_ {};
+static PipelineAndLayout particle_interpolate_pipeline_ {};
+static PipelineAndLayout vector_field_pipeline_ {};
+static PipelineAndLayout particle_depth_sort_keys_pipeline_ {};
+static PipelineAndLayout particle_depth_sort_gather_pipeline_ {};
+static PipelineAndLayout density_volume_splat_pipeline_ {};
+// For the depth sort; created once `vk_ctx_` is.
+static gpu_primitives::Context* gpu_primitives_ = NULL;
+// nearest; for the `texelFetch()`es of fluid_composite.frag, particle_upscale.frag and depth_pyramid.comp, which ignore
+// it anyway
+static VkSampler fluid_surface_sampler_ = VK_NULL_HANDLE;
 
 static VmaAllocator vma_allocator_ = NULL;
 
 static VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
 
+static VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+
 static bool shader_source_file_watch_enabled_ = false;
 static filewatch::Watchlist shader_source_file_watchlist_ = NULL;
 static ShaderSourceFileWatchIds shader_source_file_watch_ids_[PIPELINE_INDEX_COUNT] {};
 
+// The shader reload that runs in the background, on the thread pool, while the frames go on with the old pipelines;
+// see `pollShaderReload()`. One at a time: the shaders that are to be reloaded in the meantime wait in
+// `queued_modified_shaders_`.
+static bool shader_reload_in_progress_ = false;
+static thread_pool::TaskGroup shader_reload_tasks_ {};
+static u32 shader_reload_count_ = 0;
+static PipelineReload shader_reloads_[PIPELINE_INDEX_COUNT] {};
+static timespec shader_reload_start_time_ {};
+static VkShaderStageFlags queued_modified_shaders_[PIPELINE_INDEX_COUNT] {};
+
 static bool grid_enabled_ = false;
+static bool occlusion_culling_enabled_ = true;
+static bool visibility_buffer_enabled_ = false;
+static bool particle_depth_bounds_enabled_ = true;
+// see `setDynamicResolutionBudget()`; 0 if it's off
+static f64 dynamic_resolution_budget_ns_ = 0.0;
+// see `setParticleSubsamplingBudget()`; 0 if it's off
+static f64 particle_subsampling_budget_ns_ = 0.0;
+static bool particle_subsampling_suspended_ = false;
+static TranslucentParticleSettings translucent_particle_settings_ {
+    .opacity = 0.35f,
+    .resort_distance_radii = 4.f,
+    .max_sort_age_frames = 8,
+};
+
+static MemoryUsage memory_usage_ {};
 
 //
 // Vulkan proc initializers ==================================================================================
@@ -343,6 +692,240 @@ struct GridPipelineFragmentShaderPushConstants {
     alignas(16) vec2 viewport_offset_in_window;
     alignas( 8) vec2 viewport_size_in_window;
 };
+// The bindings of the `ParticleGrid` buffers, in the order of `writeParticleGridDescriptors()`. Must match
+// particle.frag. 7 and 8 are the sim's counting sort scratch, which the renderer doesn't bind.
+constexpr u32 PARTICLE_GRID_BINDINGS[] { 5, 6, 9, 10, 11, 12 };
+constexpr u32 PARTICLE_GRID_BINDING_COUNT = sizeof(PARTICLE_GRID_BINDINGS) / sizeof(PARTICLE_GRID_BINDINGS[0]);
+
+// Must match CELL_TABLE_* in particle.frag.
+constexpr u32 PARTICLE_CELL_TABLE_NONE = 0;
+constexpr u32 PARTICLE_CELL_TABLE_HASH = 1;
+constexpr u32 PARTICLE_CELL_TABLE_SLOTS = 2;
+
+// The bindings of the frame's `particle_tile_*_buffer`s: counts, ranges, entries. Must match particle_tiles.comp.h
+// and particle.frag.
+constexpr u32 PARTICLE_TILES_FIRST_BINDING = 13;
+constexpr u32 PARTICLE_TILES_BINDING_COUNT = 3;
+// In pixels, along each side. Must match TILE_SIZE in particle_tiles.comp.h and particle.frag.
+constexpr u32 PARTICLE_TILE_SIZE = 16;
+// 4096x4096 pixels; a larger viewport falls back to the untiled rendering.
+constexpr u32 MAX_PARTICLE_TILE_COUNT = 256 * 256;
+// Per frame. A particle has an entry in each tile that it may cover. The tiles whose entries don't fit fall back to
+// testing every particle, in particle.frag.
+constexpr u32 PARTICLE_TILE_ENTRY_CAPACITY = 1 << 21;
+
+// The bindings of the frame's screen-space fluid images: the distances and the smoothing's intermediate, as storage
+// images; then the distances and the thickness, for fluid_composite.frag. Must match fluid_smooth.comp and
+// fluid_composite.frag.
+constexpr u32 FLUID_SURFACE_FIRST_BINDING = 16;
+constexpr u32 FLUID_SURFACE_BINDING_COUNT = 4;
+// The fluid surface is splatted and smoothed at this many times less resolution, along each side, than the
+// swapchain; it's smooth anyway, and the smoothing costs per texel. Then at the render scale of that; see
+// `recordFluidSurface()`.
+constexpr u32 FLUID_SURFACE_DOWNSCALE = 2;
+
+/// The buffers of the surface mesh, in the order of their bindings; see surface_mesh.comp.h, which they must match.
+enum SurfaceMeshBuffer {
+    SURFACE_MESH_BUFFER_BLOCK_SLOTS, // two copies of the block table
+    SURFACE_MESH_BUFFER_BLOCKS,
+    SURFACE_MESH_BUFFER_DENSITIES,
+    SURFACE_MESH_BUFFER_VERTICES, // two copies; also the vertex buffer of the draw
+    SURFACE_MESH_BUFFER_STATE, // a `SurfaceMeshState`; also the indirect buffer of the dispatches and the draw
+    SURFACE_MESH_BUFFER_COUNT,
+};
+constexpr u32 SURFACE_MESH_FIRST_BINDING = 20;
+constexpr u32 SURFACE_MESH_BINDING_COUNT = SURFACE_MESH_BUFFER_COUNT;
+// Must match surface_mesh.comp.h.
+constexpr u32 SURFACE_MESH_BLOCK_SUBDIVISIONS = 4;
+constexpr u32 SURFACE_MESH_BLOCK_SAMPLE_COUNT =
+    (SURFACE_MESH_BLOCK_SUBDIVISIONS + 1) * (SURFACE_MESH_BLOCK_SUBDIVISIONS + 1) * (SURFACE_MESH_BLOCK_SUBDIVISIONS + 1);
+constexpr u32 SURFACE_MESH_BLOCK_TABLE_SIZE = 1 << 16;
+constexpr u32 SURFACE_MESH_BLOCK_CAPACITY = 1 << 15;
+constexpr u32 SURFACE_MESH_VERTEX_CAPACITY = 1 << 20;
+// `BlockSlot` and `Block` in surface_mesh.comp.h, as std430 lays them out
+constexpr VkDeviceSize SURFACE_MESH_BLOCK_SLOT_SIZE = 5 * sizeof(u32);
+constexpr VkDeviceSize SURFACE_MESH_BLOCK_SIZE = 32;
+
+// The bindings of the frame's `particle_lod_instances_buffer` and `particle_lod_draw_command_buffer`. Must match
+// particle_lod.comp.
+constexpr u32 PARTICLE_LOD_FIRST_BINDING = 25;
+constexpr u32 PARTICLE_LOD_BINDING_COUNT = 2;
+
+// The bindings of occlusion culling; see `recordOcclusionCulling()`: the frame's depth buffer, which the depth pyramid
+// is built from; `RenderResourcesImpl::depth_pyramid_buffer`; and the frame's `occluded_voxels_buffer` and
+// `particle_occlusion_buffer`. Must match depth_pyramid.comp.h, depth_pyramid.comp, voxel_cull.comp and
+// particle_mesh.task.
+constexpr u32 OCCLUSION_FIRST_BINDING = 27;
+constexpr u32 OCCLUSION_BINDING_COUNT = 4;
+
+// The binding of `RenderResourcesImpl::voxel_mesh_buffer`. Must match voxel_cull.comp.
+constexpr u32 VOXEL_MESH_BINDING = 31;
+
+// The bindings of the frame's `scaled_particle_images`, which particle_upscale.frag samples: the color, then the
+// depth. Must match particle_upscale.frag.
+constexpr u32 SCALED_PARTICLE_FIRST_BINDING = 32;
+constexpr u32 SCALED_PARTICLE_BINDING_COUNT = 2;
+
+// The bindings of picking; see `recordPick()`: the frame's `object_id_image`, as a storage image, then its
+// `pick_results_buffer` and `pick_id_set_buffer`, then the particle ids that the picked particles are translated to;
+// see `writePickParticleIdsDescriptor()`. Must match object_id_resolve.comp.
+constexpr u32 OBJECT_ID_FIRST_BINDING = 34;
+constexpr u32 OBJECT_ID_BINDING_COUNT = 4;
+constexpr VkFormat OBJECT_ID_FORMAT = VK_FORMAT_R32_UINT;
+// The object ids of voxels; the particles' are their index plus 1, below `OBJECT_ID_VOXEL_BIT`. Must match
+// object_id_voxel.frag.
+constexpr u32 OBJECT_ID_VOXEL_BIT = 1u << 31;
+constexpr u32 OBJECT_ID_VOXEL_AXIS_BITS = 10;
+// The ids of the visibility buffer, in the same image; see `recordVisibilityBuffer()`. The particles' are as above,
+// and the voxel quads' are this bit, then their index in the frame's `visible_voxels_buffer`. Must match
+// visibility_voxel.frag and visibility_shade.frag.
+constexpr u32 VISIBILITY_VOXEL_BIT = 1u << 31;
+// Of the hash set that `recordPick()` deduplicates the ids through; a power of 2, and a few times
+// `MAX_PICKED_OBJECT_COUNT`, so that the probes stay short.
+constexpr u32 PICK_ID_SET_SIZE = 1 << 18;
+static_assert(PICK_ID_SET_SIZE >= 4 * MAX_PICKED_OBJECT_COUNT);
+
+// The bindings of the states that `recordParticleInterpolation()` blends into the particles: the previous, then the
+// next; see `writeParticleInterpolationDescriptors()`. Must match particle_interpolate.comp.
+constexpr u32 PARTICLE_INTERPOLATION_FIRST_BINDING = 38;
+constexpr u32 PARTICLE_INTERPOLATION_BINDING_COUNT = 2;
+
+// The bindings of the debug vector field; see `recordVectorField()`: the vectors, then the frame's
+// `vector_field_segments_buffer`, `vector_field_draw_command_buffer` and `vector_field_claims_buffer`; see
+// `writeVectorFieldDescriptors()`. Must match vector_field.comp.
+constexpr u32 VECTOR_FIELD_FIRST_BINDING = 40;
+constexpr u32 VECTOR_FIELD_BINDING_COUNT = 4;
+// Of the frame's `vector_field_claims_buffer`, a word per square of the viewport; the spacing of the squares is
+// raised until they fit.
+constexpr u32 VECTOR_FIELD_CLAIM_CAPACITY = 1 << 20;
+
+/// The buffers of the translucent particles' depth sort, `RenderResourcesImpl::particle_depth_sort_buffers`; see
+/// `recordParticleDepthSort()`. Each as large as the particle buffer holds particles.
+enum ParticleDepthSortBuffer {
+    // the keys and the particle indices; each pass of the sort reads one pair and writes the other
+    PARTICLE_DEPTH_SORT_BUFFER_KEYS_0,
+    PARTICLE_DEPTH_SORT_BUFFER_VALUES_0,
+    PARTICLE_DEPTH_SORT_BUFFER_KEYS_1,
+    PARTICLE_DEPTH_SORT_BUFFER_VALUES_1,
+    PARTICLE_DEPTH_SORT_BUFFER_SORTED_PARTICLES, // the particles in the order of the last sort; a vertex buffer
+    PARTICLE_DEPTH_SORT_BUFFER_COUNT,
+};
+// The bindings of the depth sort in the main descriptor set: the keys, which particle_depth_sort_keys.comp writes;
+// the order of the last sort; and the sorted particles, which particle_depth_sort_gather.comp writes. Must match
+// them.
+constexpr u32 PARTICLE_DEPTH_SORT_FIRST_BINDING = 44;
+constexpr u32 PARTICLE_DEPTH_SORT_BINDING_COUNT = 3;
+// The keys of particle_depth_sort_keys.comp have 24 bits, 8 per pass of the sort. An odd number of passes, so that
+// the last pass writes `PARTICLE_DEPTH_SORT_BUFFER_VALUES_1`.
+constexpr u32 PARTICLE_DEPTH_SORT_PASS_COUNT = 3;
+
+// The binding of `RenderResourcesImpl::density_volume_buffer`: DENSITY_VOLUME_RESOLUTION^3 particle counts, a word
+// per voxel, x fastest, then a count per brick of DENSITY_VOLUME_BRICK_SIZE^3 voxels, in the same order, of the
+// voxels that the brick's samples read, for the ray march to skip the bricks where they're all 0. The voxels are
+// cubes, DENSITY_VOLUME_RESOLUTION of them across the domain's longest side. Must match density_volume_splat.comp and
+// density_volume.frag.
+constexpr u32 DENSITY_VOLUME_BINDING = 47;
+constexpr u32 DENSITY_VOLUME_RESOLUTION = 64;
+constexpr u32 DENSITY_VOLUME_BRICK_SIZE = 8;
+constexpr u32 DENSITY_VOLUME_VOXEL_COUNT =
+    DENSITY_VOLUME_RESOLUTION * DENSITY_VOLUME_RESOLUTION * DENSITY_VOLUME_RESOLUTION;
+constexpr u32 DENSITY_VOLUME_BRICK_COUNT = DENSITY_VOLUME_VOXEL_COUNT /
+    (DENSITY_VOLUME_BRICK_SIZE * DENSITY_VOLUME_BRICK_SIZE * DENSITY_VOLUME_BRICK_SIZE);
+constexpr VkDeviceSize DENSITY_VOLUME_BUFFER_SIZE =
+    (VkDeviceSize)(DENSITY_VOLUME_VOXEL_COUNT + DENSITY_VOLUME_BRICK_COUNT) * sizeof(u32);
+
+// Dynamic resolution; see `setDynamicResolutionBudget()` and `updateRenderScale()`. The scaled passes never go below
+// this fraction of their full resolution, along each side.
+constexpr f32 MIN_RENDER_SCALE = 0.25f;
+// Each frame moves the scale this fraction of the way to where the last measured frame says it should be, so that
+// one noisy frame doesn't make the resolution swing.
+constexpr f32 RENDER_SCALE_SMOOTHING = 0.25f;
+// Likewise for the subsampling of the rasterized particles; see `setParticleSubsamplingBudget()` and
+// `updateParticleSubsampleFraction()`. At a sixteenth of the particles, each is drawn at 4 times the radius, and the
+// fluid is mostly gone anyway.
+constexpr f32 MIN_PARTICLE_SUBSAMPLE_FRACTION = 1.f / 16.f;
+constexpr f32 PARTICLE_SUBSAMPLE_SMOOTHING = 0.25f;
+// The quad buffer's capacity, which bounds the voxels that can be drawn; the greedy meshing merges the faces of
+// neighbours, so that it's the voxels' surface that counts, not their number.
+constexpr u32 MAX_VOXEL_QUAD_COUNT = 1 << 21;
+static_assert(MAX_VOXEL_QUAD_COUNT <= VISIBILITY_VOXEL_BIT);
+// The most quads that a frame uploads, at least the most of a chunk; the chunks that don't fit are re-meshed by the
+// next frames.
+constexpr u32 VOXEL_MESH_STAGING_QUAD_COUNT = 1 << 20;
+static_assert(VOXEL_MESH_STAGING_QUAD_COUNT >= 3 * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE);
+
+/// The images of the screen-space fluid surface, per frame; see `recordFluidSurface()`.
+enum FluidSurfaceImage {
+    // per texel, the distance along its ray from the camera to the nearest particle, or 0; then smoothed
+    FLUID_SURFACE_IMAGE_DEPTH,
+    // the smoothing's horizontal pass writes it, and its vertical pass reads it
+    FLUID_SURFACE_IMAGE_DEPTH_TEMP,
+    // per texel, the total length of its ray inside particles
+    FLUID_SURFACE_IMAGE_THICKNESS,
+    // for the depth test of `FLUID_SURFACE_IMAGE_DEPTH`'s splatting
+    FLUID_SURFACE_IMAGE_DEPTH_BUFFER,
+    FLUID_SURFACE_IMAGE_COUNT,
+};
+struct FluidSurfaceImageInfo {
+    VkFormat format;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+    VkImageLayout layout; // for its whole lifetime
+};
+const FluidSurfaceImageInfo FLUID_SURFACE_IMAGE_INFOS[FLUID_SURFACE_IMAGE_COUNT] {
+    [FLUID_SURFACE_IMAGE_DEPTH] = {
+        .format = VK_FORMAT_R32_SFLOAT,
+        .usage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+    [FLUID_SURFACE_IMAGE_DEPTH_TEMP] = {
+        .format = VK_FORMAT_R32_SFLOAT,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+    // R16 rather than R32, which isn't guaranteed to support blending
+    [FLUID_SURFACE_IMAGE_THICKNESS] = {
+        .format = VK_FORMAT_R16_SFLOAT,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+    [FLUID_SURFACE_IMAGE_DEPTH_BUFFER] = {
+        .format = DEPTH_FORMAT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
+        .layout = DEPTH_IMAGE_LAYOUT,
+    },
+};
+
+/// The images that the ray-marched particles are drawn into at the dynamic resolution, per frame, before
+/// particle_upscale.frag upscales them into the frame; see `recordScaledParticles()`.
+enum ScaledParticleImage {
+    // particle.frag's colors; (0, 0, 0, 0) where there's no particle
+    SCALED_PARTICLE_IMAGE_COLOR,
+    // particle.frag's depths; 1 where there's no particle
+    SCALED_PARTICLE_IMAGE_DEPTH,
+    SCALED_PARTICLE_IMAGE_COUNT,
+};
+// The particle pipeline draws into them as it does into the swapchain, so they have the same formats.
+const FluidSurfaceImageInfo SCALED_PARTICLE_IMAGE_INFOS[SCALED_PARTICLE_IMAGE_COUNT] {
+    [SCALED_PARTICLE_IMAGE_COLOR] = {
+        .format = SWAPCHAIN_FORMAT,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+    [SCALED_PARTICLE_IMAGE_DEPTH] = {
+        .format = DEPTH_FORMAT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+};
+
 struct ParticlePipelineFragmentShaderPushConstants {
     alignas(16) mat4 world_to_screen_transform_inverse;
     alignas(16) vec2 viewport_offset_in_window;
@@ -350,13 +933,195 @@ struct ParticlePipelineFragmentShaderPushConstants {
     alignas( 8) uint particle_count;
     alignas( 4) float particle_radius;
     alignas( 4) float max_travel_distance;
+    alignas( 4) uint cell_table_kind; // PARTICLE_CELL_TABLE_*
+    alignas( 4) uint cell_table_size;
+    alignas( 4) uint permuted;
+    alignas( 4) float cell_size_reciprocal;
+    alignas( 4) float max_displacement;
+    alignas( 4) uint domain_bounds_slot;
+    alignas( 4) uint tile_count_x; // 0 if the particles weren't binned into tiles this frame
+    alignas( 4) uint tile_count_y; // 0 if the tiles aren't drawn at their depth bounds; see particle.vert
+};
+static_assert(sizeof(ParticlePipelineFragmentShaderPushConstants) <= 128); // the minimum `maxPushConstantsSize`
+struct ParticleRasterizePipelinePushConstants {
+    alignas(16) vec3 camera_position;
+    alignas( 4) float particle_radius;
+};
+// Starts like `ParticleRasterizePipelinePushConstants`, which its vertex shader reads.
+struct ParticleTranslucentPipelinePushConstants {
+    alignas(16) vec3 camera_position;
+    alignas( 4) float particle_radius;
+    alignas( 4) float opacity;
+};
+// Starts like `ParticleRasterizePipelinePushConstants`, which its fragment shader reads.
+struct ParticleMeshPipelinePushConstants {
+    alignas(16) vec3 camera_position;
+    alignas( 4) float particle_radius;
+    alignas(16) vec4 frustum_planes[6];
+    alignas( 4) uint particle_count;
+    alignas( 4) uint phase; // of occlusion culling; see particle_mesh.task
+};
+static_assert(sizeof(ParticleMeshPipelinePushConstants) <= 128); // the minimum `maxPushConstantsSize`
+
+struct FluidSmoothPipelinePushConstants {
+    alignas( 4) uint image_width;
+    alignas( 4) uint image_height;
+    alignas( 4) uint vertical; // the second pass
+    alignas( 4) float particle_radius;
+    alignas( 4) float texels_per_unit;
+};
+struct FluidCompositePipelinePushConstants {
+    alignas(16) mat4 world_to_screen_transform_inverse;
+    alignas(16) vec3 camera_position;
+    alignas( 4) float particle_radius;
+    alignas( 8) vec2 viewport_offset_in_window;
+    alignas( 8) vec2 viewport_size_in_window;
+    alignas( 4) float texels_per_pixel; // of the fluid surface images, along each side; see `recordFluidSurface()`
+};
+struct ParticleUpscalePipelinePushConstants {
+    alignas( 8) vec2 viewport_offset_in_window;
+    alignas( 8) uvec2 scaled_extent; // drawn by `recordScaledParticles()`, from the top left of the images
+    alignas( 4) float render_scale;
+};
+
+struct SurfaceMeshPipelinePushConstants {
+    alignas( 4) uint particle_count;
+    alignas( 4) uint cell_table_kind; // PARTICLE_CELL_TABLE_*, but never NONE
+    alignas( 4) uint cell_table_size;
+    alignas( 4) uint permuted;
+    alignas( 4) float cell_size_reciprocal;
+    alignas( 4) float max_displacement;
+    alignas( 4) uint domain_bounds_slot;
+    alignas( 4) float block_size;
+    alignas( 4) float iso_density;
+    alignas( 4) uint copy;
+    alignas( 4) uint previous_valid;
 };
-struct ParticleRasterizePipelineVertexShaderPushConstants {
+/// `State` in surface_mesh.comp.h.
+struct SurfaceMeshState {
+    VkDispatchIndirectCommand block_dispatch;
+    VkDrawIndirectCommand draw_command;
+    u32 block_count;
+};
+static_assert(offsetof(SurfaceMeshState, draw_command) == 3 * sizeof(u32));
+
+struct ParticleLodPipelinePushConstants {
+    alignas(16) vec4 clip_w_row;
+    alignas( 4) float pixels_per_unit;
+    alignas( 4) float threshold_pixels;
+    alignas( 4) uint particle_count;
+    alignas( 4) float particle_radius;
+    alignas( 4) uint permuted;
+    alignas( 4) float cell_size_reciprocal;
+    alignas( 4) uint domain_bounds_slot;
+};
+/// An instance of the particle LOD pipeline: a particle, or a sphere in place of a cell's particles. `Instance` in
+/// particle_lod.comp, as std430 lays it out.
+struct ParticleLodInstance {
+    vec3 center;
+    f32 radius;
+    u8vec4 color;
+    u32 padding[3];
+};
+static_assert(sizeof(ParticleLodInstance) == 32);
+
+// Read by both density_volume_splat.comp and density_volume.frag.
+struct DensityVolumePipelinePushConstants {
+    alignas(16) mat4 world_to_screen_transform_inverse;
+    alignas(16) vec3 camera_position;
     alignas( 4) float particle_radius;
+    alignas( 8) vec2 viewport_offset_in_window;
+    alignas( 8) vec2 viewport_size_in_window;
+    alignas( 4) uint particle_count;
+    alignas( 4) uint permuted;
+    alignas( 4) float cell_size_reciprocal;
+    alignas( 4) uint domain_bounds_slot;
+    alignas( 4) float rest_particle_density; // particles / m^3
+};
+static_assert(sizeof(DensityVolumePipelinePushConstants) <= 128); // the minimum `maxPushConstantsSize`
+
+struct ParticleSubsamplePipelinePushConstants {
+    alignas(4) uint particle_count;
+    alignas(4) uint threshold;
+    alignas(4) float particle_radius;
+    alignas(4) float radius_scale;
+    alignas(4) uint particle_ids;
 };
 
 struct UniformBuffer {
     alignas(16) mat4 world_to_screen_transform;
+    // for occlusion culling; see depth_pyramid.comp.h
+    alignas(16) vec4 viewport; // offset, then size, in pixels of the depth buffer
+    alignas( 8) uvec2 depth_buffer_size;
+    alignas( 4) uint depth_pyramid_level_count;
+    alignas( 4) uint depth_pyramid_valid;
+};
+struct VoxelCullPipelinePushConstants {
+    alignas(16) vec4 frustum_planes[6];
+    alignas(16) vec3 camera_position;
+    alignas( 4) float voxel_diameter;
+    alignas( 4) uint quad_count;
+    alignas( 4) uint phase; // of occlusion culling; see voxel_cull.comp
+    alignas( 4) uint append_second_phase; // for the visibility buffer; see voxel_cull.comp
+};
+static_assert(sizeof(VoxelCullPipelinePushConstants) <= 128); // the minimum `maxPushConstantsSize`
+/// The contents of a frame's `voxel_draw_command_buffer`; `Commands` in voxel_cull.comp.
+struct VoxelCullCommands {
+    VkDrawIndirectCommand draw_commands[2]; // a draw per phase of occlusion culling
+    VkDispatchIndirectCommand occluded_dispatch; // the second phase's culling
+    u32 occluded_count;
+};
+static_assert(offsetof(VoxelCullCommands, occluded_dispatch) == 2 * sizeof(VkDrawIndirectCommand));
+/// The start of a frame's `particle_occlusion_buffer`, which the indices of the occluded clusters follow;
+/// `OccludedClusters` in particle_mesh.task.
+struct ParticleOcclusion {
+    VkDrawMeshTasksIndirectCommandEXT occluded_draw; // the second phase
+    u32 occluded_cluster_count;
+};
+struct DepthPyramidPipelinePushConstants {
+    alignas( 4) uint level;
+};
+struct ObjectIdVoxelPipelinePushConstants {
+    alignas(16) ivec3 origin; // the voxel that the ids' coordinates are relative to
+};
+struct ObjectIdResolvePipelinePushConstants {
+    alignas( 8) ivec2 rect_offset;
+    alignas( 8) uvec2 rect_extent;
+    alignas( 4) uint capacity;
+    alignas( 4) uint set_size;
+    alignas( 4) uint particle_ids; // nonzero to translate the particles' ids; see `writePickParticleIdsDescriptor()`
+};
+/// The start of a frame's `pick_results_buffer`, which the picked ids follow; `Results` in object_id_resolve.comp.
+struct PickResultsHeader {
+    u32 count;
+    u32 dropped_texel_count;
+    u32 padding[2];
+};
+struct ParticleInterpolatePipelinePushConstants {
+    alignas( 4) uint particle_count;
+    alignas( 4) f32 alpha;
+};
+struct ParticleDepthSortPipelinePushConstants {
+    alignas(16) vec3 camera_position;
+    alignas( 4) uint particle_count;
+};
+struct VectorFieldPipelinePushConstants {
+    alignas( 8) vec2 viewport_size;
+    alignas( 8) uvec2 cell_counts;
+    alignas( 4) uint particle_count;
+    alignas( 4) uint vector_stride;
+    alignas( 4) uint half_vectors;
+    alignas( 4) f32 scale;
+    alignas( 4) f32 cell_size_pixels;
+};
+struct ParticleTilesPipelinePushConstants {
+    alignas(16) mat4 world_to_screen_transform;
+    alignas( 8) vec2 viewport_size;
+    alignas( 4) uint particle_count;
+    alignas( 4) float particle_radius;
+    alignas( 4) uint tile_count_x;
+    alignas( 4) uint tile_count_y;
+    alignas( 4) uint entry_capacity;
 };
 
 struct RenderResourcesImpl {
@@ -375,41 +1140,243 @@ struct RenderResourcesImpl {
         // just to be sure that it wasn't left signalled?
         VkSemaphore render_finished_semaphore;
 
+        // A begin and an end timestamp per `RenderPass`, then the frame's; see `TIMESTAMP_QUERY_COUNT`.
+        // VK_NULL_HANDLE if the device doesn't support timestamps.
+        VkQueryPool timestamp_query_pool;
+        // Whether the last submission of `command_buffer` wrote timestamps that haven't been read yet.
+        bool timestamps_pending;
+        // the `RenderResourcesImpl::render_scale` that the last submission was recorded with
+        f32 render_scale;
+        // the `RenderResourcesImpl::particle_subsample_fraction` that the last submission drew the rasterized
+        // particles at, 1 if it drew them all under the budget; or 0 if subsampling was off or suspended, or they
+        // weren't drawn, so that its timestamps say nothing about the fraction
+        f32 particle_subsample_fraction;
+
         VkBuffer uniform_buffer;
         VmaAllocation uniform_buffer_allocation;
         VmaAllocationInfo uniform_buffer_allocation_info;
 
-        VkBuffer voxels_buffer;
-        VmaAllocation voxels_buffer_allocation;
-        VmaAllocationInfo voxels_buffer_allocation_info;
-
-        VkBuffer outlined_voxels_index_buffer;
-        VmaAllocation outlined_voxels_index_buffer_allocation;
-        VmaAllocationInfo outlined_voxels_index_buffer_allocation_info;
+        // host-visible; what `render()` copies the quads of the re-meshed voxel chunks from
+        VkBuffer voxels_staging_buffer;
+        VmaAllocation voxels_staging_buffer_allocation;
+        VmaAllocationInfo voxels_staging_buffer_allocation_info;
+
+        // host-visible; what `render()` copies the outlined voxels from, when they change
+        VkBuffer outlined_voxels_staging_buffer;
+        VmaAllocation outlined_voxels_staging_buffer_allocation;
+        VmaAllocationInfo outlined_voxels_staging_buffer_allocation_info;
+
+        // Device-local; written by `recordVoxelCulling()`, then by `recordOcclusionCulling()`: the quads of the voxel
+        // mesh that each phase of the culling found visible, and a `VoxelCullCommands`.
+        VkBuffer visible_voxels_buffer;
+        VmaAllocation visible_voxels_buffer_allocation;
+        VkBuffer voxel_draw_command_buffer;
+        VmaAllocation voxel_draw_command_buffer_allocation;
+
+        // Device-local; written by the first phase of occlusion culling, for the second: the voxel quads in the view
+        // frustum that the previous frame's depth pyramid hid; and, for the mesh-shaded particles' clusters, a
+        // `ParticleOcclusion` followed by the indices of the hidden clusters.
+        VkBuffer occluded_voxels_buffer;
+        VmaAllocation occluded_voxels_buffer_allocation;
+        VkBuffer particle_occlusion_buffer;
+        VmaAllocation particle_occlusion_buffer_allocation;
+
+        // Device-local; written by `recordParticleTiling()`: per tile, a count, the range of its entries, and the
+        // entries. See particle_tiles.comp.h.
+        VkBuffer particle_tile_counts_buffer;
+        VmaAllocation particle_tile_counts_buffer_allocation;
+        VkBuffer particle_tile_ranges_buffer;
+        VmaAllocation particle_tile_ranges_buffer_allocation;
+        VkBuffer particle_tile_entries_buffer;
+        VmaAllocation particle_tile_entries_buffer_allocation;
+
+        // Device-local; written by `recordParticleLod()`: the instances of the particle LOD pipeline, as many as the
+        // particle buffer holds particles, and the `VkDrawIndirectCommand` that draws them.
+        VkBuffer particle_lod_instances_buffer;
+        VmaAllocation particle_lod_instances_buffer_allocation;
+        VkBuffer particle_lod_draw_command_buffer;
+        VmaAllocation particle_lod_draw_command_buffer_allocation;
+
+        // Device-local; written by `recordVectorField()`: the segments of the debug vector field, as many as the
+        // particle buffer holds particles, each two `vec3`s; the `VkDrawIndirectCommand` that draws them; and the
+        // squares of the viewport that the segments were drawn in.
+        VkBuffer vector_field_segments_buffer;
+        VmaAllocation vector_field_segments_buffer_allocation;
+        VkBuffer vector_field_draw_command_buffer;
+        VmaAllocation vector_field_draw_command_buffer_allocation;
+        VkBuffer vector_field_claims_buffer;
+        VmaAllocation vector_field_claims_buffer_allocation;
+
+        // Written by `recordPick()`, if the frame picks: a `PickResultsHeader` followed by the picked ids, in
+        // host-visible memory, for `readPickResults()`; and, device-local, the hash set that they're deduplicated
+        // through.
+        VkBuffer pick_results_buffer;
+        VmaAllocation pick_results_buffer_allocation;
+        VmaAllocationInfo pick_results_buffer_allocation_info;
+        VkBuffer pick_id_set_buffer;
+        VmaAllocation pick_id_set_buffer_allocation;
+        // Whether the last submission of `command_buffer` picked, and its results haven't been read yet; the voxel
+        // that its voxels' ids are relative to; and whether its particles' ids are stable ids, not indices.
+        bool pick_pending;
+        ivec3 pick_origin;
+        bool pick_particle_ids;
 
         VkDescriptorSet descriptor_set;
 
         // Lifetime: as long as this RenderResourcesImpl is attached to a SurfaceImpl.
         // In theory, we only need to destroy them when we attach to a surface of different size than these
-        // resources; but we can destroy them for simplicity.
+        // resources; but we can destroy them for simplicity. When the attached surface is resized, `render()`
+        // recreates them the next time that it uses this frame; see `resizeSwapchainSizedFrameResources()`.
+
+        // the extent of the surface that they were created for
+        VkExtent2D swapchain_extent;
 
         VkImage depth_buffer;
         VkImageView depth_buffer_view;
         VmaAllocation depth_buffer_allocation;
+
+        // `FLUID_SURFACE_DOWNSCALE` times smaller than the swapchain; see `FluidSurfaceImage`
+        VkImage fluid_surface_images[FLUID_SURFACE_IMAGE_COUNT];
+        VkImageView fluid_surface_image_views[FLUID_SURFACE_IMAGE_COUNT];
+        VmaAllocation fluid_surface_image_allocations[FLUID_SURFACE_IMAGE_COUNT];
+
+        // the size of the swapchain, as the render scale is at most 1; see `ScaledParticleImage`
+        VkImage scaled_particle_images[SCALED_PARTICLE_IMAGE_COUNT];
+        VkImageView scaled_particle_image_views[SCALED_PARTICLE_IMAGE_COUNT];
+        VmaAllocation scaled_particle_image_allocations[SCALED_PARTICLE_IMAGE_COUNT];
+
+        // `OBJECT_ID_FORMAT`, the size of the swapchain; what `recordPick()` draws the object ids into
+        VkImage object_id_image;
+        VkImageView object_id_image_view;
+        VmaAllocation object_id_image_allocation;
     };
 
     VkCommandPool command_pool;
 
-    VkBuffer voxels_staging_buffer;
-    VmaAllocation voxels_staging_buffer_allocation;
-    VmaAllocationInfo voxels_staging_buffer_allocation_info;
+    // The app's voxels; see `setVoxelStore()`. NULL until it's set.
+    VoxelStore* voxel_store;
+
+    // Device-local, and shared by the frames in flight: the quads of `voxel_mesh`, the mesh of `voxel_store`, which
+    // voxel_cull.comp culls into the frame's `visible_voxels_buffer`. `render()` re-meshes the store's dirty chunks,
+    // and `recordVoxelMeshEdits()` applies the changes through the frame's `voxels_staging_buffer`.
+    VkBuffer voxel_mesh_buffer;
+    VmaAllocation voxel_mesh_buffer_allocation;
+    VoxelMesh* voxel_mesh;
+    ArrayList<VoxelQuadRange> voxel_mesh_cleared_ranges;
+    ArrayList<VoxelQuad> voxel_mesh_staged_quads;
+    ArrayList<VoxelQuadCopy> voxel_mesh_copies;
+
+    // Device-local, and shared by the frames in flight: the coordinates of the first `outlined_voxel_count` voxels
+    // that the cube outline pipeline draws. `setOutlinedVoxels()` puts the new ones in `outlined_voxels_staged`, and
+    // `recordOutlinedVoxelsUpload()` copies them in through the frame's `outlined_voxels_staging_buffer`.
+    VkBuffer outlined_voxels_buffer;
+    VmaAllocation outlined_voxels_buffer_allocation;
+    u32 outlined_voxel_count;
+    ArrayList<ivec3> outlined_voxels_staged;
+    bool outlined_voxels_dirty;
+
+    // Device-local, and shared by the frames in flight, whose builds are ordered by the queue: the buffers of
+    // surface_mesh.comp.h. See `recordSurfaceMesh()`.
+    VkBuffer surface_mesh_buffers[SURFACE_MESH_BUFFER_COUNT];
+    VmaAllocation surface_mesh_buffer_allocations[SURFACE_MESH_BUFFER_COUNT];
+    // the copy of the table and of the vertices that the last build wrote, and what it was built with; the next
+    // build only reuses its triangles if it's valid and they're the same
+    u32 surface_mesh_copy;
+    bool surface_mesh_valid;
+    f32 surface_mesh_block_size;
+    f32 surface_mesh_iso_density;
+
+    // Device-local, and shared by the frames in flight, whose sorts are ordered by the queue: the buffers of the
+    // translucent particles' depth sort, and the sort's plan over them, whose first pass reads the `_0` buffers and
+    // writes the `_1` ones. See `recordParticleDepthSort()`.
+    VkBuffer particle_depth_sort_buffers[PARTICLE_DEPTH_SORT_BUFFER_COUNT];
+    VmaAllocation particle_depth_sort_buffer_allocations[PARTICLE_DEPTH_SORT_BUFFER_COUNT];
+    gpu_primitives::Plan* particle_depth_sort_plan;
+    // Whether `PARTICLE_DEPTH_SORT_BUFFER_VALUES_1` holds the order of a sort that the next frame may reuse; then
+    // where the camera was, how many particles there were, and how many frames ago that was. See
+    // `TranslucentParticleSettings`.
+    bool particle_depth_sort_valid;
+    vec3 particle_depth_sort_camera_position;
+    u32 particle_depth_sort_particle_count;
+    u32 particle_depth_sort_age_frames;
+
+    // Device-local, and shared by the frames in flight, whose splats are ordered by the queue: the density volume of
+    // `PARTICLE_RENDER_MODE_DENSITY_VOLUME`, its counts then its bricks'. See `recordDensityVolume()`.
+    VkBuffer density_volume_buffer;
+    VmaAllocation density_volume_buffer_allocation;
+
+    // Device-local, and shared by the frames in flight, whose builds are ordered by the queue: the depth pyramid of
+    // occlusion culling, as depth_pyramid.comp.h lays it out. Recreated with the surface, to its size,
+    // `depth_pyramid_extent`.
+    VkBuffer depth_pyramid_buffer;
+    VmaAllocation depth_pyramid_buffer_allocation;
+    VkExtent2D depth_pyramid_extent;
+    u32 depth_pyramid_level_count;
+    // whether the last frame built the pyramid, for the next frame's first phase to test against
+    bool depth_pyramid_valid;
+
+    // What a resize of the attached surface replaced while the frames in flight may still have been using it: the
+    // old swapchain, with its per-image resources, or the old depth pyramid. Rather than waiting for the queue to
+    // idle, `render()` destroys it once each frame's fence has been waited for since; see
+    // `releaseRetiredResources()`.
+    struct RetiredResources {
+        u32 frames_left; // whose fences are still to be waited for
+        VkSwapchainKHR swapchain; // VK_NULL_HANDLE if none
+        u32 swapchain_image_count;
+        VkImage* swapchain_images;
+        VkImageView* swapchain_image_views;
+        VkSemaphore* swapchain_image_acquired_semaphores;
+        VkBuffer depth_pyramid_buffer; // VK_NULL_HANDLE if none
+        VmaAllocation depth_pyramid_buffer_allocation;
+    };
+    ArrayList<RetiredResources> retired_resources;
 
+    // the first `frames_in_flight` of `frame_resources_array` are used, in turn
+    u32 frames_in_flight;
     u32 last_used_frame_idx;
     PerFrameResources frame_resources_array[MAX_FRAMES_IN_FLIGHT];
 
+    // see `getRenderPassGpuTimes()` and `getFrameGpuTime()`
+    bool pass_gpu_times_valid;
+    f64 pass_gpu_times_ns[RENDER_PASS_ENUM_COUNT];
+    f64 frame_gpu_time_ns;
+
+    TransferStats transfers; // see `getTransferStats()`
+
+    // The fraction of their full resolution, along each side, that the scaled passes are drawn at, in
+    // [MIN_RENDER_SCALE, 1]; see `updateRenderScale()`.
+    f32 render_scale;
+    // The fraction of the rasterized particles that are drawn, in [MIN_PARTICLE_SUBSAMPLE_FRACTION, 1]; see
+    // `updateParticleSubsampleFraction()`.
+    f32 particle_subsample_fraction;
+
+    // Picking; see `requestPick()`. The rectangle that the next `render()` picks in, if `pick_requested`; then the
+    // latest results that were read back, which `getPickResult()` hasn't returned yet if `pick_result_new`.
+    bool pick_requested;
+    VkRect2D pick_rect;
+    bool pick_result_new;
+    bool pick_result_truncated;
+    u32 picked_voxel_count;
+    u32 picked_particle_count;
+    ivec3 picked_voxel_coords[MAX_PICKED_OBJECT_COUNT];
+    u32 picked_particle_indices[MAX_PICKED_OBJECT_COUNT];
+    bool picked_particle_ids;
+
+    // The vector field that the next `render()` draws, if `vector_field_requested`; see `requestVectorField()`.
+    bool vector_field_requested;
+    VectorField vector_field;
+
+    // the views that the next `render()` draws after its own; see `requestExtraViews()`
+    u32 extra_view_count;
+    View extra_views[MAX_EXTRA_VIEW_COUNT];
+
+
+    PerFrameResources* peekNextFrameResources(void) {
+        return &this->frame_resources_array[(this->last_used_frame_idx + 1) % this->frames_in_flight];
+    }
 
     PerFrameResources* getNextFrameResources(void) {
-        u32 this_frame_idx = (this->last_used_frame_idx + 1) % MAX_FRAMES_IN_FLIGHT;
+        u32 this_frame_idx = (this->last_used_frame_idx + 1) % this->frames_in_flight;
         this->last_used_frame_idx = this_frame_idx;
         return &this->frame_resources_array[this_frame_idx];
     }
@@ -432,6 +1399,17 @@ struct SurfaceResourcesImpl {
     RenderResourcesImpl* attached_render_resources; // can be NULL if nothing is attached
 
     PresentModeFlags supported_present_modes;
+
+    // The id of the last present to `swapchain`, if `present_wait_supported_`; 0 if there was none. They count up
+    // from 1 again with each new swapchain.
+    u64 last_present_id;
+
+    // If true, there's no surface or swapchain, nor acquired semaphores: the images are allocated here, and
+    // `render()` draws into them in turn, without acquiring or presenting them; see
+    // `createOffscreenSurfaceResources()`.
+    bool offscreen;
+    VmaAllocation* offscreen_image_allocations;
+    u32 last_rendered_offscreen_image_idx;
 };
 
 //
@@ -548,6 +1526,25 @@ static void emptyQueueSubmit(
     assertVk(result);
 }
 
+/// For a `render()` that returns before reading the interpolated states; their owner waits for the signal.
+static void signalParticleInterpolationRead(const ParticleInterpolation* p_interpolation) {
+    ZoneScoped;
+
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &p_interpolation->signal_value,
+    };
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &p_interpolation->signal_semaphore,
+    };
+    VkResult result = vk_dev_procs.QueueSubmit(queue_, 1, &submit_info, VK_NULL_HANDLE);
+    assertVk(result);
+}
+
 
 /// If no satisfactory device is found, `device_out` is set to `VK_NULL_HANDLE`.
 /// You may request a specific physical device using `specific_physical_device_request`.
@@ -632,9 +1629,129 @@ static void selectPhysicalDeviceAndQueueFamily(
 }
 
 
+/// Returns INVALID_QUEUE_FAMILY_IDX if the device has no family that supports compute but not graphics.
+static u32 firstComputeOnlyQueueFamily(VkPhysicalDevice device) {
+
+    u32 family_count = 0;
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, NULL);
+
+    VkQueueFamilyProperties* family_props_list = mallocArray(family_count, VkQueueFamilyProperties);
+    defer(free(family_props_list));
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, family_props_list);
+
+    for (u32 fam = 0; fam < family_count; fam++) {
+        const VkQueueFlags flags = family_props_list[fam].queueFlags;
+        if (
+            flagsSubset(VK_QUEUE_COMPUTE_BIT, flags) and
+            !flagsSubset(VK_QUEUE_GRAPHICS_BIT, flags) and
+            family_props_list[fam].queueCount > 0
+        ) return fam;
+    }
+    return INVALID_QUEUE_FAMILY_IDX;
+}
+
+
+/// A family of transfer-only queues, which usually run on the device's copy engines.
+static u32 firstTransferOnlyQueueFamily(VkPhysicalDevice device) {
+
+    u32 family_count = 0;
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, NULL);
+
+    VkQueueFamilyProperties* family_props_list = mallocArray(family_count, VkQueueFamilyProperties);
+    defer(free(family_props_list));
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, family_props_list);
+
+    for (u32 fam = 0; fam < family_count; fam++) {
+        const VkQueueFlags flags = family_props_list[fam].queueFlags;
+        if (
+            flagsSubset(VK_QUEUE_TRANSFER_BIT, flags) and
+            !flagsSubset(VK_QUEUE_GRAPHICS_BIT, flags) and
+            !flagsSubset(VK_QUEUE_COMPUTE_BIT, flags) and
+            family_props_list[fam].queueCount > 0
+        ) return fam;
+    }
+    return INVALID_QUEUE_FAMILY_IDX;
+}
+
+
+static u32 queueFamilyQueueCount(VkPhysicalDevice device, u32 family) {
+
+    u32 family_count = 0;
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, NULL);
+
+    VkQueueFamilyProperties* family_props_list = mallocArray(family_count, VkQueueFamilyProperties);
+    defer(free(family_props_list));
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, family_props_list);
+
+    return family < family_count ? family_props_list[family].queueCount : 0;
+}
+
+
 /// If `specific_device_request` isn't NULL, attempts to select a device with that name.
 /// If no such device exists or doesn't satisfactory requirements, silently selects a different device.
-static void initGraphicsUptoQueueCreation(const char* app_name, const char* specific_named_device_request) {
+static bool physicalDeviceHasExtension(VkPhysicalDevice device, const char* extension_name) {
+
+    u32 extension_count = 0;
+    VkResult result = vk_inst_procs.EnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+    assertVk(result);
+    if (extension_count == 0) return false;
+
+    VkExtensionProperties* extensions = mallocArray(extension_count, VkExtensionProperties);
+    defer(free(extensions));
+    result = vk_inst_procs.EnumerateDeviceExtensionProperties(device, NULL, &extension_count, extensions);
+    assertVk(result);
+
+    for (u32 i = 0; i < extension_count; i++) {
+        if (strcmp(extensions[i].extensionName, extension_name) == 0) return true;
+    }
+    return false;
+}
+
+/// Whether the device has `VK_KHR_present_id` and `VK_KHR_present_wait`, with both features.
+static bool physicalDeviceSupportsPresentWait(VkPhysicalDevice device) {
+
+    if (!physicalDeviceHasExtension(device, VK_KHR_PRESENT_ID_EXTENSION_NAME)) return false;
+    if (!physicalDeviceHasExtension(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) return false;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+    };
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+        .pNext = &present_wait_features,
+    };
+    VkPhysicalDeviceFeatures2 features {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &present_id_features,
+    };
+    vk_inst_procs.GetPhysicalDeviceFeatures2(device, &features);
+
+    return present_id_features.presentId and present_wait_features.presentWait;
+}
+
+/// Whether the device has `VK_EXT_mesh_shader`, with both task and mesh shaders.
+static bool physicalDeviceSupportsMeshShaders(VkPhysicalDevice device) {
+
+    if (!physicalDeviceHasExtension(device, VK_EXT_MESH_SHADER_EXTENSION_NAME)) return false;
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+    };
+    VkPhysicalDeviceFeatures2 features {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &mesh_shader_features,
+    };
+    vk_inst_procs.GetPhysicalDeviceFeatures2(device, &features);
+
+    return mesh_shader_features.taskShader and mesh_shader_features.meshShader;
+}
+
+
+static void initGraphicsUptoQueueCreation(
+    const char* app_name,
+    const char* specific_named_device_request,
+    bool request_async_compute_queue
+) {
     ZoneScoped;
 
     if (!glfwVulkanSupported()) ABORT_F("Failed to find Vulkan; do you need to install drivers?");
@@ -747,42 +1864,163 @@ static void initGraphicsUptoQueueCreation(const char* app_name, const char* spec
 
         vk_inst_procs.GetPhysicalDeviceProperties(physical_device_, &physical_device_properties_);
         LOG_F(INFO, "Selected physical device `%s`.", physical_device_properties_.deviceName);
+
+        physical_device_subgroup_properties_ = VkPhysicalDeviceSubgroupProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        };
+        VkPhysicalDeviceProperties2 properties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &physical_device_subgroup_properties_,
+        };
+        vk_inst_procs.GetPhysicalDeviceProperties2(physical_device_, &properties2);
+        physical_device_subgroup_properties_.pNext = NULL;
         LOG_IF_F(
             WARNING,
             specific_named_device_request != NULL and physical_device_idx != requested_device_idx,
             "Didn't select requested device named `%s`.", specific_named_device_request
         );
+
+        compute_queue_family_ = queue_family_;
+        if (request_async_compute_queue) {
+            const u32 fam = firstComputeOnlyQueueFamily(physical_device_);
+            if (fam != INVALID_QUEUE_FAMILY_IDX) {
+                LOG_F(INFO, "Selected compute-only queue family %" PRIu32 " for async compute.", fam);
+                compute_queue_family_ = fam;
+            }
+            // A second queue of the same family still lets another thread submit without sharing `queue_`, and the
+            // driver may run the two concurrently.
+            else if (queueFamilyQueueCount(physical_device_, queue_family_) >= 2) {
+                LOG_F(
+                    INFO, "Device has no compute-only queue family; using a second queue of family %" PRIu32
+                    " for async compute.", queue_family_
+                );
+                compute_queue_idx_ = 1;
+            }
+            else LOG_F(WARNING, "Device has no compute-only queue family; not using async compute.");
+        }
+
+        // for the copies that needn't wait behind the compute work; see `VulkanContext::transfer_queue`
+        transfer_queue_family_ = firstTransferOnlyQueueFamily(physical_device_);
+        if (transfer_queue_family_ != INVALID_QUEUE_FAMILY_IDX) {
+            LOG_F(INFO, "Selected transfer-only queue family %" PRIu32 " for copies.", transfer_queue_family_);
+        }
+        else transfer_queue_family_ = compute_queue_family_;
     }
 
     // Create logical device and queues ----------------------------------------------------------------------
     {
-        // NOTE: using only 1 queue, because some cards only provide 1 queue.
-        // (E.g. the Intel integrated graphics on my laptop.)
+        // NOTE: using only 1 queue per family, because some cards only provide 1 queue.
+        // (E.g. the Intel integrated graphics on my laptop.) Except for the second queue of the graphics family that
+        // async compute may use; see above.
         const u32fast queue_count = 1;
-        const f32 queue_priorities[queue_count] = { 1.0 };
-        VkDeviceQueueCreateInfo queue_cinfo {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .queueFamilyIndex = queue_family_,
-            .queueCount = queue_count,
-            .pQueuePriorities = queue_priorities,
+        const f32 queue_priorities[2] = { 1.0, 1.0 };
+        VkDeviceQueueCreateInfo queue_cinfos[3] {
+            {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = queue_family_,
+                .queueCount = (u32)queue_count + compute_queue_idx_,
+                .pQueuePriorities = queue_priorities,
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = compute_queue_family_,
+                .queueCount = queue_count,
+                .pQueuePriorities = queue_priorities,
+            },
         };
+        // each family may only appear once
+        u32 queue_cinfo_count = (compute_queue_family_ == queue_family_) ? 1 : 2;
+        // a transfer-only family is neither of the others
+        if (transfer_queue_family_ != compute_queue_family_) {
+            queue_cinfos[queue_cinfo_count++] = VkDeviceQueueCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = transfer_queue_family_,
+                .queueCount = (u32)queue_count,
+                .pQueuePriorities = queue_priorities,
+            };
+        }
 
-        const u32 device_extension_count = 1;
-        const char* device_extensions[] = { "VK_KHR_swapchain" };
+        mesh_shaders_supported_ = physicalDeviceSupportsMeshShaders(physical_device_);
+        LOG_F(INFO, "Mesh shaders %s.", mesh_shaders_supported_ ? "supported" : "not supported");
 
+        // for the sim, which pushes the descriptors that change between its passes; see `VulkanContext`
+        const bool push_descriptors_supported =
+            physicalDeviceHasExtension(physical_device_, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        LOG_F(INFO, "Push descriptors %s.", push_descriptors_supported ? "supported" : "not supported");
+
+        // for the app's low-latency mode; see `waitForLastPresent()`
+        present_wait_supported_ = physicalDeviceSupportsPresentWait(physical_device_);
+        LOG_F(INFO, "Present wait %s.", present_wait_supported_ ? "supported" : "not supported");
+
+        // for the visibility buffer, whose second phase of voxel culling draws after the first's quads
+        VkPhysicalDeviceFeatures2 supported_features { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+        vk_inst_procs.GetPhysicalDeviceFeatures2(physical_device_, &supported_features);
+        draw_indirect_first_instance_supported_ = supported_features.features.drawIndirectFirstInstance;
+        LOG_F(
+            INFO, "Draw indirect first instance %s.",
+            draw_indirect_first_instance_supported_ ? "supported" : "not supported"
+        );
+
+        u32 device_extension_count = 0;
+        const char* device_extensions[5] {};
+        device_extensions[device_extension_count++] = "VK_KHR_swapchain";
+        if (mesh_shaders_supported_) device_extensions[device_extension_count++] = VK_EXT_MESH_SHADER_EXTENSION_NAME;
+        if (push_descriptors_supported) {
+            device_extensions[device_extension_count++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+        }
+        if (present_wait_supported_) {
+            device_extensions[device_extension_count++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+            device_extensions[device_extension_count++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+        }
+
+        VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+            .presentWait = VK_TRUE,
+        };
+        VkPhysicalDevicePresentIdFeaturesKHR present_id_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+            .pNext = &present_wait_features,
+            .presentId = VK_TRUE,
+        };
+        VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+            .pNext = present_wait_supported_ ? &present_id_features : NULL,
+            .taskShader = VK_TRUE,
+            .meshShader = VK_TRUE,
+        };
+        void* p_optional_features = NULL;
+        if (present_wait_supported_) p_optional_features = &present_id_features;
+        if (mesh_shaders_supported_) p_optional_features = &mesh_shader_features;
+
+        // Mandatory since Vulkan 1.3, so there is no need to check for support.
+        VkPhysicalDeviceSynchronization2Features synchronization2_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+            .pNext = p_optional_features,
+            .synchronization2 = VK_TRUE,
+        };
+        // Mandatory since Vulkan 1.2, so there is no need to check for support.
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .pNext = &synchronization2_features,
+            .timelineSemaphore = VK_TRUE,
+        };
         VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+            .pNext = &timeline_semaphore_features,
             .dynamicRendering = VK_TRUE,
         };
         VkPhysicalDeviceFeatures2 features {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
             .pNext = &dynamic_rendering_features,
+            .features = VkPhysicalDeviceFeatures {
+                .drawIndirectFirstInstance = draw_indirect_first_instance_supported_,
+            },
         };
         VkDeviceCreateInfo device_cinfo {
             .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
             .pNext = &features,
-            .queueCreateInfoCount = 1,
-            .pQueueCreateInfos = &queue_cinfo,
+            .queueCreateInfoCount = queue_cinfo_count,
+            .pQueueCreateInfos = queue_cinfos,
             .enabledExtensionCount = device_extension_count,
             .ppEnabledExtensionNames = device_extensions,
         };
@@ -792,43 +2030,195 @@ static void initGraphicsUptoQueueCreation(const char* app_name, const char* spec
 
         vk_dev_procs = VulkanDeviceProcs_init(device_, vk_inst_procs.GetDeviceProcAddr);
 
+        if (mesh_shaders_supported_) {
+            cmdDrawMeshTasksEXT_ =
+                (PFN_vkCmdDrawMeshTasksEXT)vk_inst_procs.GetDeviceProcAddr(device_, "vkCmdDrawMeshTasksEXT");
+            if (cmdDrawMeshTasksEXT_ == NULL) ABORT_F("Failed to load device procedure `vkCmdDrawMeshTasksEXT`.");
+
+            cmdDrawMeshTasksIndirectEXT_ = (PFN_vkCmdDrawMeshTasksIndirectEXT)vk_inst_procs.GetDeviceProcAddr(
+                device_, "vkCmdDrawMeshTasksIndirectEXT"
+            );
+            if (cmdDrawMeshTasksIndirectEXT_ == NULL) {
+                ABORT_F("Failed to load device procedure `vkCmdDrawMeshTasksIndirectEXT`.");
+            }
+        }
+        if (push_descriptors_supported) {
+            cmdPushDescriptorSetKHR_ =
+                (PFN_vkCmdPushDescriptorSetKHR)vk_inst_procs.GetDeviceProcAddr(device_, "vkCmdPushDescriptorSetKHR");
+            if (cmdPushDescriptorSetKHR_ == NULL) {
+                ABORT_F("Failed to load device procedure `vkCmdPushDescriptorSetKHR`.");
+            }
+        }
+        if (present_wait_supported_) {
+            waitForPresentKHR_ =
+                (PFN_vkWaitForPresentKHR)vk_inst_procs.GetDeviceProcAddr(device_, "vkWaitForPresentKHR");
+            if (waitForPresentKHR_ == NULL) ABORT_F("Failed to load device procedure `vkWaitForPresentKHR`.");
+        }
+
         // NOTE: Vk Spec 1.3.259:
         //     vkGetDeviceQueue must only be used to get queues that were created with the `flags` parameter
         //     of VkDeviceQueueCreateInfo set to zero.
         vk_dev_procs.GetDeviceQueue(device_, queue_family_, 0, &queue_);
+        vk_dev_procs.GetDeviceQueue(device_, compute_queue_family_, compute_queue_idx_, &compute_queue_);
+        if (transfer_queue_family_ != compute_queue_family_) {
+            vk_dev_procs.GetDeviceQueue(device_, transfer_queue_family_, 0, &transfer_queue_);
+        }
+        else transfer_queue_ = compute_queue_;
     }
 }
 
 
-/// You own the returned result. You are responsible for calling `shaderc_result_release()` to free it.
-static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
-    const char* shader_src_filename,
-    shaderc_shader_kind shader_type
+static u64 hashBytesFnv1a(u64 hash, const void* p_data, size_t size) {
+    const u8* p_bytes = (const u8*)p_data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ p_bytes[i]) * 0x100000001b3;
+    return hash;
+}
+
+/// Logs the errors, and returns false, unless the compilation succeeded.
+static bool checkShaderCompilation(shaderc_compilation_result_t result, const char* shader_src_filepath) {
+
+    shaderc_compilation_status status = libshaderc_procs_.result_get_compilation_status(result);
+    if (status == shaderc_compilation_status_success) return true;
+
+    u32fast error_count = libshaderc_procs_.result_get_num_errors(result);
+    const char* error_message = libshaderc_procs_.result_get_error_message(result);
+    if (error_message == NULL) error_message = "(NO ERROR MESSAGE PROVIDED)";
+
+    LOG_F(
+        ERROR, "Failed to compile shader `%s`. %" PRIuFAST32 " errors: `%s`.",
+        shader_src_filepath, error_count, error_message
+    );
+    return false;
+}
+
+/// Returns the SPIR-V of an earlier compilation of the same preprocessed source with the same options, from
+/// `SPIRV_CACHE_DIRPATH`, if there is one; otherwise compiles it, and adds it to the cache. So only the shaders whose
+/// text or includes have actually changed are compiled again. The cache is only ever added to; delete the directory
+/// to clear it.
+///
+/// You own the returned buffer. You may free it using `free()`. Logs an error and returns NULL on failure. Safe to
+/// call from several threads at once.
+[[nodiscard]] static u32* compileShaderSrcFileToSpirv(
+    const char* shader_src_filepath,
+    shaderc_shader_kind shader_type,
+    size_t* spirv_byte_count_out
 ) {
     ZoneScoped;
 
     // TODO: should we lock the source file while reading it? Maybe using something like `fcntl` or `flock`.
 
     size_t file_size = 0;
-    void* file_contents = file_util::readEntireFile(shader_src_filename, &file_size);
+    void* file_contents = file_util::readEntireFile(shader_src_filepath, &file_size);
     if (file_contents == NULL) {
-        LOG_F(ERROR, "Failed to read shader src file `%s`.", shader_src_filename);
+        LOG_F(ERROR, "Failed to read shader src file `%s`.", shader_src_filepath);
         return NULL;
     }
     defer(free(file_contents));
 
-    shaderc_compilation_result_t compilation_result = libshaderc_procs_.compile_into_spv(
+    const char* entry_point_name = "main";
+
+    // Preprocessing is much cheaper than compiling, and sees through the includes and macros.
+    char cache_filepath[256];
+    {
+        ZoneScopedN("hash preprocessed source");
+
+        shaderc_compilation_result_t preprocess_result = libshaderc_procs_.compile_into_preprocessed_text(
+            libshaderc_compiler_,
+            (const char*)file_contents, // source_text
+            file_size, // source_text_size
+            shader_type, // shader_kind
+            shader_src_filepath, // input_file_name
+            entry_point_name,
+            0 // additional_options
+        );
+        alwaysAssert(preprocess_result != NULL);
+        defer(libshaderc_procs_.result_release(preprocess_result));
+        if (!checkShaderCompilation(preprocess_result, shader_src_filepath)) return NULL;
+
+        u64 hash = 0xcbf29ce484222325; // FNV-1a offset basis
+        hash = hashBytesFnv1a(hash, &SPIRV_CACHE_VERSION, sizeof(SPIRV_CACHE_VERSION));
+        hash = hashBytesFnv1a(hash, &shader_type, sizeof(shader_type));
+        hash = hashBytesFnv1a(hash, entry_point_name, strlen(entry_point_name));
+        hash = hashBytesFnv1a(
+            hash,
+            libshaderc_procs_.result_get_bytes(preprocess_result),
+            libshaderc_procs_.result_get_length(preprocess_result)
+        );
+
+        int char_count = snprintf(
+            cache_filepath, sizeof(cache_filepath), "%s/%016" PRIx64 ".spv", SPIRV_CACHE_DIRPATH, hash
+        );
+        alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(cache_filepath));
+    }
+
+    if (access(cache_filepath, R_OK) == 0) {
+
+        size_t spirv_byte_count = 0;
+        void* p_spirv = file_util::readEntireFile(cache_filepath, &spirv_byte_count);
+        // readEntireFile() already logged why, if it failed
+        if (p_spirv != NULL) {
+            // A torn or foreign file isn't trusted; it's compiled and written again.
+            const bool valid = spirv_byte_count >= sizeof(u32) and spirv_byte_count % sizeof(u32) == 0
+                and *(const u32*)p_spirv == SPIRV_MAGIC_NUMBER;
+            if (valid) {
+                LOG_F(INFO, "Reusing the cached SPIR-V `%s` of shader `%s`.", cache_filepath, shader_src_filepath);
+                *spirv_byte_count_out = spirv_byte_count;
+                return (u32*)p_spirv;
+            }
+            LOG_F(WARNING, "Ignoring invalid cached SPIR-V `%s`.", cache_filepath);
+            free(p_spirv);
+        }
+    }
+
+    // The same text that was hashed, not the file again, which may have changed since.
+    shaderc_compilation_result_t compile_result = libshaderc_procs_.compile_into_spv(
         libshaderc_compiler_,
         (const char*)file_contents, // source_text
         file_size, // source_text_size
         shader_type, // shader_kind
-        shader_src_filename, // input_file_name
-        "main", // entry_point_name
+        shader_src_filepath, // input_file_name
+        entry_point_name,
         0 // additional_options
     );
-    alwaysAssert(compilation_result != NULL);
+    alwaysAssert(compile_result != NULL);
+    defer(libshaderc_procs_.result_release(compile_result));
+    if (!checkShaderCompilation(compile_result, shader_src_filepath)) return NULL;
+
+    const size_t spirv_byte_count = libshaderc_procs_.result_get_length(compile_result);
+    alwaysAssert(spirv_byte_count % sizeof(u32) == 0);
+
+    u32* p_spirv = (u32*)malloc(spirv_byte_count);
+    assertErrno(p_spirv != NULL);
+    memcpy(p_spirv, libshaderc_procs_.result_get_bytes(compile_result), spirv_byte_count);
+
+    // Written to a file of its own, then renamed into place, so that another thread or instance never reads a
+    // partial file. Failing to cache it isn't an error.
+    {
+        ZoneScopedN("write SPIR-V cache");
+
+        static u32 temp_file_counter = 0;
+        const u32 temp_file_idx = __atomic_fetch_add(&temp_file_counter, 1, __ATOMIC_RELAXED);
+
+        char temp_filepath[sizeof(cache_filepath) + 32];
+        int char_count = snprintf(
+            temp_filepath, sizeof(temp_filepath), "%s.%ld.%" PRIu32 ".tmp",
+            cache_filepath, (long)getpid(), temp_file_idx
+        );
+        alwaysAssert(char_count > 0 and (size_t)char_count < sizeof(temp_filepath));
+
+        if (mkdir(SPIRV_CACHE_DIRPATH, 0755) != 0 and errno != EEXIST) {
+            LOG_F(WARNING, "Failed to create `%s`: `%s`.", SPIRV_CACHE_DIRPATH, strerror(errno));
+        }
+        else if (file_util::writeEntireFile(temp_filepath, p_spirv, spirv_byte_count)) {
+            if (rename(temp_filepath, cache_filepath) != 0) {
+                LOG_F(WARNING, "Failed to rename `%s`: `%s`.", temp_filepath, strerror(errno));
+                unlink(temp_filepath);
+            }
+        }
+    }
 
-    return compilation_result;
+    *spirv_byte_count_out = spirv_byte_count;
+    return p_spirv;
 }
 
 
@@ -851,11 +2241,35 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 };
 
 
-[[nodiscard]] static bool createVoxelPipeline(
-    VkDevice device,
-    VkShaderModule vertex_shader_module,
-    VkShaderModule fragment_shader_module,
+/// For the shaders that are built ahead of time, rather than hot-reloaded. Aborts if the file can't be read.
+static VkShaderModule createShaderModuleFromSpirvFile(VkDevice device, const char* spirv_filepath) {
+
+    size_t spirv_byte_count = 0;
+    void* spirv_bytes = file_util::readEntireFile(spirv_filepath, &spirv_byte_count);
+    if (spirv_bytes == NULL) ABORT_F("Failed to read SPIR-V file `%s`.", spirv_filepath);
+    defer(free(spirv_bytes));
+
+    alwaysAssert(spirv_byte_count % sizeof(u32) == 0);
+    alwaysAssert((uintptr_t)spirv_bytes % alignof(u32) == 0);
+
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    VkResult result = createShaderModuleFromSpirv(
+        device, (u32)spirv_byte_count, (const u32*)spirv_bytes, &shader_module
+    );
+    assertVk(result);
+
+    return shader_module;
+}
+
+
+/// The quads of the voxel mesh: into the swapchain's format; or, if `object_id`, into `OBJECT_ID_FORMAT`, with the
+/// fragment shader's `ObjectIdVoxelPipelinePushConstants`. See `recordPick()`.
+[[nodiscard]] static bool createVoxelQuadPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
     VkDescriptorSetLayout descriptor_set_layout,
+    bool object_id,
     VkPipeline* pipeline_out,
     VkPipelineLayout* pipeline_layout_out
 ) {
@@ -894,9 +2308,10 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
+    // a quad of the voxel mesh per instance; see voxel.vert
     VkVertexInputBindingDescription vertex_binding_description {
         .binding = 0,
-        .stride = sizeof(Voxel),
+        .stride = sizeof(VoxelQuad),
         .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
     };
 
@@ -905,14 +2320,14 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
         {
             .location = 0,
             .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SINT,
-            .offset = offsetof(Voxel, coord),
+            .format = VK_FORMAT_R32G32B32_UINT,
+            .offset = offsetof(VoxelQuad, packed),
         },
         {
             .location = 1,
             .binding = 0,
             .format = VK_FORMAT_R8G8B8A8_UNORM,
-            .offset = offsetof(Voxel, color),
+            .offset = offsetof(VoxelQuad, color),
         },
     };
 
@@ -1015,8 +2430,14 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
-    constexpr u32 push_constant_range_count = 0;
-    VkPushConstantRange* push_constant_ranges = NULL;
+    const u32 push_constant_range_count = object_id ? 1 : 0;
+    VkPushConstantRange push_constant_ranges[1] {
+        VkPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,
+            .size = sizeof(ObjectIdVoxelPipelinePushConstants),
+        },
+    };
 
     const VkPipelineLayoutCreateInfo pipeline_layout_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -1032,7 +2453,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
 
     constexpr u32 color_attachment_count = 1;
-    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+    VkFormat color_attachment_formats[color_attachment_count] { object_id ? OBJECT_ID_FORMAT : SWAPCHAIN_FORMAT };
 
     const VkPipelineRenderingCreateInfo pipeline_rendering_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -1065,7 +2486,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline pipeline = VK_NULL_HANDLE;
     result = vk_dev_procs.CreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE, // pipelineCache
+        pipeline_cache_, // pipelineCache
         1, // createInfoCount
         &pipeline_info,
         NULL, // allocationCallbacks
@@ -1088,6 +2509,34 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     return true;
 }
 
+[[nodiscard]] static bool createVoxelPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createVoxelQuadPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+[[nodiscard]] static bool createVoxelIdPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createVoxelQuadPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, true,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
 
 [[nodiscard]] static bool createParticlePipeline(
     VkDevice device,
@@ -1219,8 +2668,9 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
     constexpr u32 push_constant_range_count = 1;
     VkPushConstantRange push_constant_ranges[push_constant_range_count] {
+        // particle.vert reads the tile counts
         VkPushConstantRange {
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             .offset = 0,
             .size = sizeof(ParticlePipelineFragmentShaderPushConstants),
         },
@@ -1273,7 +2723,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline pipeline = VK_NULL_HANDLE;
     result = vk_dev_procs.CreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE, // pipelineCache
+        pipeline_cache_, // pipelineCache
         1, // createInfoCount
         &pipeline_info,
         NULL, // allocationCallbacks
@@ -1297,11 +2747,18 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 }
 
 
-[[nodiscard]] static bool createParticleRasterizePipeline(
+/// A sphere impostor per instance: per particle, from the particle buffer; or, if `lod`, per `ParticleLodInstance`,
+/// from the frame's `particle_lod_instances_buffer`. Into the swapchain's format; or, if `object_id`, into
+/// `OBJECT_ID_FORMAT`; see `recordPick()`. If `translucent`, blended over what's behind, without writing the depth;
+/// see `PARTICLE_RENDER_MODE_TRANSLUCENT`.
+[[nodiscard]] static bool createParticleImpostorPipeline(
     VkDevice device,
     VkShaderModule vertex_shader_module,
     VkShaderModule fragment_shader_module,
     VkDescriptorSetLayout descriptor_set_layout,
+    bool lod,
+    bool object_id,
+    bool translucent,
     VkPipeline* pipeline_out,
     VkPipelineLayout* pipeline_layout_out
 ) {
@@ -1328,23 +2785,30 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
     VkVertexInputBindingDescription vertex_binding_description {
         .binding = 0,
-        .stride = sizeof(Particle),
+        .stride = lod ? (u32)sizeof(ParticleLodInstance) : (u32)sizeof(Particle),
         .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
     };
 
-    constexpr u32 vertex_attribute_description_count = 2;
-    VkVertexInputAttributeDescription vertex_attribute_descriptions[vertex_attribute_description_count] {
+    // the LOD instances also have a radius
+    const u32 vertex_attribute_description_count = lod ? 3 : 2;
+    VkVertexInputAttributeDescription vertex_attribute_descriptions[3] {
         {
             .location = 0,
             .binding = 0,
             .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(Particle, coord),
+            .offset = lod ? (u32)offsetof(ParticleLodInstance, center) : (u32)offsetof(Particle, coord),
         },
         {
             .location = 1,
             .binding = 0,
             .format = VK_FORMAT_R8G8B8A8_UNORM,
-            .offset = offsetof(Particle, color),
+            .offset = lod ? (u32)offsetof(ParticleLodInstance, color) : (u32)offsetof(Particle, color),
+        },
+        {
+            .location = 2,
+            .binding = 0,
+            .format = VK_FORMAT_R32_SFLOAT,
+            .offset = offsetof(ParticleLodInstance, radius),
         },
     };
 
@@ -1359,7 +2823,8 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
     const VkPipelineInputAssemblyStateCreateInfo input_assembly_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        // a quad per instance
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
         .primitiveRestartEnable = VK_FALSE,
     };
 
@@ -1378,7 +2843,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
         .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
+        .cullMode = VK_CULL_MODE_NONE, // the quads always face the camera
         .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
         .depthBiasEnable = VK_FALSE,
         .depthBiasConstantFactor = 0.0,
@@ -1402,7 +2867,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
+        .depthWriteEnable = !translucent,
         .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
@@ -1413,13 +2878,14 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
+    // the translucent particles come back to front, each over the ones behind it; the frame's alpha is kept
     const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
-        .blendEnable = VK_FALSE,
-        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .blendEnable = translucent,
+        .srcColorBlendFactor = translucent ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ZERO,
+        .dstColorBlendFactor = translucent ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO,
         .colorBlendOp = VK_BLEND_OP_ADD,
         .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = translucent ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ZERO,
         .alphaBlendOp = VK_BLEND_OP_ADD,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
     };
@@ -1450,9 +2916,11 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     constexpr u32 push_constant_range_count = 1;
     VkPushConstantRange push_constant_ranges[push_constant_range_count] {
         VkPushConstantRange {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             .offset = 0,
-            .size = sizeof(ParticleRasterizePipelineVertexShaderPushConstants),
+            .size = translucent
+                ? (u32)sizeof(ParticleTranslucentPipelinePushConstants)
+                : (u32)sizeof(ParticleRasterizePipelinePushConstants),
         },
     };
 
@@ -1471,7 +2939,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
 
     constexpr u32 color_attachment_count = 1;
-    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+    VkFormat color_attachment_formats[color_attachment_count] { object_id ? OBJECT_ID_FORMAT : SWAPCHAIN_FORMAT };
 
     const VkPipelineRenderingCreateInfo pipeline_rendering_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -1504,7 +2972,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline pipeline = VK_NULL_HANDLE;
     result = vk_dev_procs.CreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE, // pipelineCache
+        pipeline_cache_, // pipelineCache
         1, // createInfoCount
         &pipeline_info,
         NULL, // allocationCallbacks
@@ -1528,7 +2996,49 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 }
 
 
-[[nodiscard]] static bool createGridPipeline(
+[[nodiscard]] static bool createParticleRasterizePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createParticleImpostorPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false, false, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+[[nodiscard]] static bool createParticleLodPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createParticleImpostorPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, true, false, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+[[nodiscard]] static bool createParticleIdPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createParticleImpostorPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false, true, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+[[nodiscard]] static bool createParticleTranslucentPipeline(
     VkDevice device,
     VkShaderModule vertex_shader_module,
     VkShaderModule fragment_shader_module,
@@ -1536,6 +3046,25 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline* pipeline_out,
     VkPipelineLayout* pipeline_layout_out
 ) {
+    return createParticleImpostorPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false, false, true,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+
+/// The impostor quads of `createParticleRasterizePipeline()`, into the screen-space fluid images: with a depth test,
+/// into `FLUID_SURFACE_IMAGE_DEPTH`; or, if `thickness`, without one and added up, into
+/// `FLUID_SURFACE_IMAGE_THICKNESS`. See `recordFluidSurface()`.
+[[nodiscard]] static bool createFluidSplatPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    bool thickness,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
 
     VkResult result;
 
@@ -1557,18 +3086,41 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
+    VkVertexInputBindingDescription vertex_binding_description {
+        .binding = 0,
+        .stride = sizeof(Particle),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+    };
+
+    constexpr u32 vertex_attribute_description_count = 2;
+    VkVertexInputAttributeDescription vertex_attribute_descriptions[vertex_attribute_description_count] {
+        {
+            .location = 0,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = offsetof(Particle, coord),
+        },
+        {
+            .location = 1,
+            .binding = 0,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .offset = offsetof(Particle, color),
+        },
+    };
+
     const VkPipelineVertexInputStateCreateInfo vertex_input_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 0,
-        .pVertexBindingDescriptions = NULL,
-        .vertexAttributeDescriptionCount = 0,
-        .pVertexAttributeDescriptions = NULL,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertex_binding_description,
+        .vertexAttributeDescriptionCount = vertex_attribute_description_count,
+        .pVertexAttributeDescriptions = vertex_attribute_descriptions,
     };
 
 
     const VkPipelineInputAssemblyStateCreateInfo input_assembly_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        // a quad per instance
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
         .primitiveRestartEnable = VK_FALSE,
     };
 
@@ -1587,7 +3139,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
         .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
+        .cullMode = VK_CULL_MODE_NONE, // the quads always face the camera
         .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
         .depthBiasEnable = VK_FALSE,
         .depthBiasConstantFactor = 0.0,
@@ -1610,8 +3162,8 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
     const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
+        .depthTestEnable = !thickness,
+        .depthWriteEnable = !thickness,
         .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
@@ -1622,18 +3174,16 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
-    // VK_BLEND_OP_ADD :
-    //    alpha: a_new = a_src * srcAlphaBlendFactor + a_dst * dstAlphaBlendFactor
-    //    color: C_new = C_src * srcColorBlendFactor + C_dst * dstColorBlendFactor
+    // the thickness adds up
     const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
-        .blendEnable = VK_TRUE,
-        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .blendEnable = thickness,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
         .colorBlendOp = VK_BLEND_OP_ADD,
         .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
         .alphaBlendOp = VK_BLEND_OP_ADD,
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT,
     };
 
     const VkPipelineColorBlendStateCreateInfo color_blend_info {
@@ -1662,12 +3212,13 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     constexpr u32 push_constant_range_count = 1;
     VkPushConstantRange push_constant_ranges[push_constant_range_count] {
         VkPushConstantRange {
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             .offset = 0,
-            .size = sizeof(GridPipelineFragmentShaderPushConstants),
+            .size = sizeof(ParticleRasterizePipelinePushConstants),
         },
     };
 
+
     const VkPipelineLayoutCreateInfo pipeline_layout_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = 1,
@@ -1681,15 +3232,20 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     assertVk(result);
 
 
+    const FluidSurfaceImageInfo* p_color_image_info = thickness
+        ? &FLUID_SURFACE_IMAGE_INFOS[FLUID_SURFACE_IMAGE_THICKNESS]
+        : &FLUID_SURFACE_IMAGE_INFOS[FLUID_SURFACE_IMAGE_DEPTH];
+
     constexpr u32 color_attachment_count = 1;
-    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+    VkFormat color_attachment_formats[color_attachment_count] { p_color_image_info->format };
 
     const VkPipelineRenderingCreateInfo pipeline_rendering_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
         .viewMask = 0, // TODO FIXME verify that this can be 0
         .colorAttachmentCount = color_attachment_count,
         .pColorAttachmentFormats = color_attachment_formats,
-        .depthAttachmentFormat = DEPTH_FORMAT,
+        .depthAttachmentFormat =
+            thickness ? VK_FORMAT_UNDEFINED : FLUID_SURFACE_IMAGE_INFOS[FLUID_SURFACE_IMAGE_DEPTH_BUFFER].format,
     };
 
 
@@ -1715,7 +3271,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline pipeline = VK_NULL_HANDLE;
     result = vk_dev_procs.CreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE, // pipelineCache
+        pipeline_cache_, // pipelineCache
         1, // createInfoCount
         &pipeline_info,
         NULL, // allocationCallbacks
@@ -1738,12 +3294,46 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     return true;
 }
 
+[[nodiscard]] static bool createFluidDepthPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createFluidSplatPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+[[nodiscard]] static bool createFluidThicknessPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createFluidSplatPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, true,
+        pipeline_out, pipeline_layout_out
+    );
+}
 
-[[nodiscard]] static bool createCubeOutlinePipeline(
+
+/// A fullscreen quad, like `createParticlePipeline()`, that blends what the fragment shader writes over what's been
+/// drawn, with a depth test; for the fragment shaders that composite an offscreen pass into the frame, which read
+/// `push_constants_size` bytes of push constants. If `opaque`, what it writes replaces what's there, without a depth
+/// test, for a pass that shades what an earlier one left in the depth buffer.
+[[nodiscard]] static bool createCompositePipeline(
     VkDevice device,
     VkShaderModule vertex_shader_module,
     VkShaderModule fragment_shader_module,
     VkDescriptorSetLayout descriptor_set_layout,
+    u32 push_constants_size,
+    bool opaque,
     VkPipeline* pipeline_out,
     VkPipelineLayout* pipeline_layout_out
 ) {
@@ -1751,19 +3341,6 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkResult result;
 
 
-    VkSpecializationMapEntry vertex_shader_specialization_map_entry {
-        .constantID = 0,
-        .offset = 0,
-        .size = sizeof(f32),
-    };
-    VkSpecializationInfo vertex_shader_specialization_info {
-        .mapEntryCount = 1,
-        .pMapEntries = &vertex_shader_specialization_map_entry,
-        .dataSize = sizeof(f32),
-        .pData = &VOXEL_RADIUS,
-    };
-    static_assert(sizeof(VOXEL_RADIUS) == sizeof(f32));
-
     constexpr u32 shader_stage_info_count = 2;
     const VkPipelineShaderStageCreateInfo shader_stage_infos[shader_stage_info_count] {
         {
@@ -1771,7 +3348,6 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
             .stage = VK_SHADER_STAGE_VERTEX_BIT,
             .module = vertex_shader_module,
             .pName = "main",
-            .pSpecializationInfo = &vertex_shader_specialization_info
         },
         {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -1782,23 +3358,12 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
-    VkVertexInputBindingDescription vertex_binding_description {
-        .binding = 0,
-        .stride = sizeof(u32),
-        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
-    };
-    VkVertexInputAttributeDescription vertex_attribute_description {
-        .location = 0,
-        .binding = 0,
-        .format = VK_FORMAT_R32_UINT,
-        .offset = 0,
-    };
     const VkPipelineVertexInputStateCreateInfo vertex_input_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &vertex_binding_description,
-        .vertexAttributeDescriptionCount = 1,
-        .pVertexAttributeDescriptions = &vertex_attribute_description,
+        .vertexBindingDescriptionCount = 0,
+        .pVertexBindingDescriptions = NULL,
+        .vertexAttributeDescriptionCount = 0,
+        .pVertexAttributeDescriptions = NULL,
     };
 
 
@@ -1823,7 +3388,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
         .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_NONE,
+        .cullMode = VK_CULL_MODE_BACK_BIT,
         .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
         .depthBiasEnable = VK_FALSE,
         .depthBiasConstantFactor = 0.0,
@@ -1846,8 +3411,8 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
 
     const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
+        .depthTestEnable = !opaque,
+        .depthWriteEnable = !opaque,
         .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
@@ -1858,13 +3423,14 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
+    // e.g. over what's behind the fluid, as much as it absorbs; opaque where the alpha is 1
     const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
-        .blendEnable = VK_FALSE,
-        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .blendEnable = !opaque,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
         .colorBlendOp = VK_BLEND_OP_ADD,
-        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
         .alphaBlendOp = VK_BLEND_OP_ADD,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
     };
@@ -1892,8 +3458,14 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     };
 
 
-    constexpr u32 push_constant_range_count = 0;
-    VkPushConstantRange* push_constant_ranges = NULL;
+    constexpr u32 push_constant_range_count = 1;
+    VkPushConstantRange push_constant_ranges[push_constant_range_count] {
+        VkPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,
+            .size = push_constants_size,
+        },
+    };
 
     const VkPipelineLayoutCreateInfo pipeline_layout_info {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -1942,7 +3514,7 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     VkPipeline pipeline = VK_NULL_HANDLE;
     result = vk_dev_procs.CreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE, // pipelineCache
+        pipeline_cache_, // pipelineCache
         1, // createInfoCount
         &pipeline_info,
         NULL, // allocationCallbacks
@@ -1965,211 +3537,5207 @@ static shaderc_compilation_result_t compileShaderSrcFileToSpirv(
     return true;
 }
 
-
-/// On failure, sets `p_present_mode_count_out` to 0 and returns `NULL`.
-/// You own the returned array. You are responsible for freeing it via `free()`.
-static VkPresentModeKHR* getSupportedVkPresentModes(VkSurfaceKHR surface, u32* p_present_mode_count_out) {
-
-    assert(initialized_);
-    VkResult result;
-
-
-    result = vk_inst_procs.GetPhysicalDeviceSurfacePresentModesKHR(
-        physical_device_, surface, p_present_mode_count_out, NULL
-    );
-    assertVk(result);
-    if (p_present_mode_count_out == 0) return NULL;
-
-    VkPresentModeKHR* p_present_modes = mallocArray(*p_present_mode_count_out, VkPresentModeKHR);
-    result = vk_inst_procs.GetPhysicalDeviceSurfacePresentModesKHR(
-        physical_device_, surface, p_present_mode_count_out, p_present_modes
+/// Shades the screen-space fluid surface over what's been drawn; see `recordFluidSurface()`.
+[[nodiscard]] static bool createFluidCompositePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createCompositePipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout,
+        sizeof(FluidCompositePipelinePushConstants), false, pipeline_out, pipeline_layout_out
     );
-    assertVk(result);
-
-
-    return p_present_modes;
 }
 
-
-/// Doesn't verify present mode support. You must do so before calling this.
-/// Doesn't verify surface support. You must do so before calling this.
-/// `fallback_extent` is used if the surface doesn't report a specific extent via Vulkan surface properties.
-///     If you want resizing to work on all platforms, you should probably get the window's current dimensions
-///     from your window provider. Some providers supposedly don't report their current dimensions via Vulkan,
-///     according to
-///     https://gist.github.com/nanokatze/bb03a486571e13a7b6a8709368bd87cf#file-handling-window-resize-md
-/// Doesn't destroy `old_swapchain`; simply retires it. You are responsible for destroying it.
-/// `old_swapchain` may be `VK_NULL_HANDLE`.
-/// `swapchain_out` and `extent_out` must not be NULL.
-static Result createSwapchain(
-     VkPhysicalDevice physical_device,
-     VkDevice device,
-     VkSurfaceKHR surface,
-     VkExtent2D fallback_extent,
-     u32 queue_family_index,
-     VkPresentModeKHR present_mode,
-     VkSwapchainKHR old_swapchain,
-     VkSwapchainKHR* swapchain_out,
-     VkExtent2D* extent_out
+/// Upscales the ray-marched particles, with their depths, from the scaled particle images into the frame; see
+/// `recordScaledParticles()`.
+[[nodiscard]] static bool createParticleUpscalePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
 ) {
-    ZoneScoped;
-
-    #ifndef NDEBUG
-    {
-        u32 supported_mode_count = 0;
-        VkPresentModeKHR* supported_modes = getSupportedVkPresentModes(surface, &supported_mode_count);
-
-        bool present_mode_supported = false;
-        for (u32fast i = 0; i < supported_mode_count; i++) {
-            present_mode_supported |= (supported_modes[i] == present_mode);
-        }
-        assert(present_mode_supported);
-
-        free(supported_modes);
-    }
-    #endif
+    return createCompositePipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout,
+        sizeof(ParticleUpscalePipelinePushConstants), false, pipeline_out, pipeline_layout_out
+    );
+}
 
+/// Shades the visibility buffer into the frame, over the depths that its ids were drawn with; see
+/// `recordVisibilityBuffer()`. visibility_shade.frag reads the same push constants as fluid_composite.frag.
+[[nodiscard]] static bool createVisibilityShadePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createCompositePipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout,
+        sizeof(FluidCompositePipelinePushConstants), true, pipeline_out, pipeline_layout_out
+    );
+}
 
-    VkSurfaceCapabilitiesKHR surface_capabilities {};
-    VkResult result = vk_inst_procs.GetPhysicalDeviceSurfaceCapabilitiesKHR(
-        physical_device, surface, &surface_capabilities
+/// Ray marches the density volume that `recordDensityVolume()` splatted, over what's been drawn.
+[[nodiscard]] static bool createDensityVolumePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createCompositePipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout,
+        sizeof(DensityVolumePipelinePushConstants), false, pipeline_out, pipeline_layout_out
     );
-    assertVk(result);
+}
 
 
-    // Vk spec 1.3.259, appendix VK_KHR_swapchain, issue 12: suggests using capabilities.minImageCount + 1
-    // to guarantee that vkAcquireNextImageKHR is non-blocking when using Mailbox present mode.
-    // In FIFO mode, having a larger queue of submitted images increases input latency, so we request the
-    // minimum possible in that case.
-    // In Immediate mode, I assume the number of images doesn't matter.
-    u32 min_image_count_request = surface_capabilities.minImageCount;
-    if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) min_image_count_request += 1;
-    {
-        u32 count_preclamp = min_image_count_request;
-        min_image_count_request = math::max(min_image_count_request, surface_capabilities.minImageCount);
-        if (surface_capabilities.maxImageCount != 0) {
-            min_image_count_request = math::min(min_image_count_request, surface_capabilities.maxImageCount);
-        }
+/// The triangles that `recordSurfaceMesh()` leaves in the surface mesh vertex buffer, opaque.
+[[nodiscard]] static bool createSurfaceMeshPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
 
-        if (min_image_count_request != count_preclamp) LOG_F(
-            WARNING,
-            "Min swapchain image count clamped from %" PRIu32 " to %" PRIu32 ", to fit surface limits.",
-            count_preclamp, min_image_count_request
-        );
-    }
+    VkResult result;
 
 
-    // Vk spec 1.3.234:
-    //     On some platforms, it is normal that maxImageExtent may become (0, 0), for example when the window
-    //     is minimized. In such a case, it is not possible to create a swapchain due to the Valid Usage
-    //     requirements.
-    const VkExtent2D max_extent = surface_capabilities.maxImageExtent;
-    if (max_extent.width == 0 or max_extent.height == 0) {
-        LOG_F(INFO, "Aborting swapchain build: SurfaceCapabilities::maxImageExtent contains a 0.");
-        return Result::error_window_size_zero;
-    }
+    constexpr u32 shader_stage_info_count = 2;
+    const VkPipelineShaderStageCreateInfo shader_stage_infos[shader_stage_info_count] {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertex_shader_module,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragment_shader_module,
+            .pName = "main",
+        },
+    };
 
-    VkExtent2D extent = surface_capabilities.currentExtent;
-    // Vk spec 1.3.234:
-    //     currentExtent is the current width and height of the surface, or the special value (0xFFFFFFFF,
-    //     0xFFFFFFFF) indicating that the surface size will be determined by the extent of a swapchain
-    //     targeting the surface.
-    if (extent.width == 0xFF'FF'FF'FF and extent.height == 0xFF'FF'FF'FF) {
 
-        LOG_F(INFO, "Surface currentExtent is (0xFFFFFFFF, 0xFFFFFFFF); using fallback extent.");
-        if (fallback_extent.width == 0 or fallback_extent.height == 0) {
-            LOG_F(INFO, "Aborting swapchain build: `fallback_extent` contains a 0.");
-            return Result::error_window_size_zero;
-        }
+    // the `vertices_` of surface_mesh.comp.h
+    VkVertexInputBindingDescription vertex_binding_description {
+        .binding = 0,
+        .stride = sizeof(vec4),
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+    };
 
-        const VkExtent2D min_extent = surface_capabilities.minImageExtent;
+    constexpr u32 vertex_attribute_description_count = 1;
+    VkVertexInputAttributeDescription vertex_attribute_descriptions[vertex_attribute_description_count] {
+        {
+            .location = 0,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = 0,
+        },
+    };
 
-        extent.width = math::clamp(fallback_extent.width, min_extent.width, max_extent.width);
-        extent.height = math::clamp(fallback_extent.height, min_extent.height, max_extent.height);
-        if (extent.width != fallback_extent.width or extent.height != fallback_extent.height) LOG_F(
-            WARNING,
-            "Adjusted fallback swapchain extent (%" PRIu32 ", %" PRIu32 ") to (%" PRIu32 ", %" PRIu32 "), to fit surface limits.",
-            fallback_extent.width, fallback_extent.height, extent.width, extent.height
-        );
-    }
+    const VkPipelineVertexInputStateCreateInfo vertex_input_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertex_binding_description,
+        .vertexAttributeDescriptionCount = vertex_attribute_description_count,
+        .pVertexAttributeDescriptions = vertex_attribute_descriptions,
+    };
 
 
-    LOG_F(
-        INFO, "Requesting minImageCount=%" PRIu32 ", presentMode=%i for swapchain creation.",
-        min_image_count_request, present_mode
-    );
-    VkSwapchainCreateInfoKHR swapchain_info {
-        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-        .surface = surface,
-        .minImageCount = min_image_count_request,
-        .imageFormat = SWAPCHAIN_FORMAT,
-        .imageColorSpace = SWAPCHAIN_COLOR_SPACE,
-        .imageExtent = extent,
-        .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = &queue_family_index,
-        .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
-        .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-        .presentMode = present_mode,
-        .clipped = VK_FALSE,
-        .oldSwapchain = old_swapchain,
+    const VkPipelineInputAssemblyStateCreateInfo input_assembly_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
     };
-    alwaysAssert(surface_capabilities.supportedUsageFlags & swapchain_info.imageUsage);
 
-    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
-    {
-        ZoneScopedN("vkCreateSwapchainKHR");
 
-        result = vk_dev_procs.CreateSwapchainKHR(device, &swapchain_info, NULL, &swapchain);
-        assertVk(result);
-    }
+    const VkPipelineViewportStateCreateInfo viewport_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = NULL, // using dynamic viewport
+        .scissorCount = 1,
+        .pScissors = NULL, // using dynamic scissor
+    };
 
-    LOG_F(INFO, "Built swapchain %p.", swapchain);
-    *swapchain_out = swapchain;
-    *extent_out = extent;
-    return Result::success;
-}
 
+    const VkPipelineRasterizationStateCreateInfo rasterization_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        // the camera can be inside the fluid, and surface_mesh.frag faces the normals toward it anyway
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0,
+        .depthBiasClamp = 0.0,
+        .depthBiasSlopeFactor = 0.0,
+        .lineWidth = 1.0,
+    };
 
-static void createPerSwapchainImageSurfaceResources(
-    VkSwapchainKHR swapchain,
-    u32* image_count_out,
-    VkImage** images_out,
-    VkImageView** image_views_out,
-    VkSemaphore** image_acquired_semaphores_out
-) {
 
-    u32 image_count = 0;
-    VkResult result = vk_dev_procs.GetSwapchainImagesKHR(device_, swapchain, &image_count, NULL);
-    assertVk(result);
+    const VkPipelineMultisampleStateCreateInfo multisample_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
 
-    LOG_F(INFO, "Got %" PRIu32 " images from swapchain %p.", image_count, swapchain);
 
+    const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+        .front = {},
+        .back = {},
+        .minDepthBounds = 0.0,
+        .maxDepthBounds = 1.0,
+    };
 
-    VkImage* swapchain_images = mallocArray(image_count, VkImage);
-    result = vk_dev_procs.GetSwapchainImagesKHR(device_, swapchain, &image_count, swapchain_images);
-    assertVk(result);
 
+    const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
+        .blendEnable = VK_FALSE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+    };
 
-    VkImageView* swapchain_image_views = mallocArray(image_count, VkImageView);
+    const VkPipelineColorBlendStateCreateInfo color_blend_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_CLEAR,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment_info,
+        .blendConstants = {0.0, 0.0, 0.0, 0.0},
+    };
+
+
+    constexpr u32 dynamic_state_count = 2;
+    const VkDynamicState dynamic_states[dynamic_state_count] {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    const VkPipelineDynamicStateCreateInfo dynamic_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = dynamic_state_count,
+        .pDynamicStates = dynamic_states,
+    };
+
+
+    constexpr u32 push_constant_range_count = 1;
+    VkPushConstantRange push_constant_ranges[push_constant_range_count] {
+        VkPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,
+            .size = sizeof(ParticleRasterizePipelinePushConstants), // surface_mesh.frag only reads the camera
+        },
+    };
+
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout,
+        .pushConstantRangeCount = push_constant_range_count,
+        .pPushConstantRanges = push_constant_ranges,
+    };
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout);
+    assertVk(result);
+
+
+    constexpr u32 color_attachment_count = 1;
+    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+
+    const VkPipelineRenderingCreateInfo pipeline_rendering_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = 0, // TODO FIXME verify that this can be 0
+        .colorAttachmentCount = color_attachment_count,
+        .pColorAttachmentFormats = color_attachment_formats,
+        .depthAttachmentFormat = DEPTH_FORMAT,
+    };
+
+
+    const VkGraphicsPipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &pipeline_rendering_info,
+        .stageCount = shader_stage_info_count,
+        .pStages = shader_stage_infos,
+        .pVertexInputState = &vertex_input_info,
+        .pInputAssemblyState = &input_assembly_info,
+        .pTessellationState = NULL,
+        .pViewportState = &viewport_info,
+        .pRasterizationState = &rasterization_info,
+        .pMultisampleState = &multisample_info,
+        .pDepthStencilState = &depth_stencil_state_info,
+        .pColorBlendState = &color_blend_info,
+        .pDynamicState = &dynamic_state_info,
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateGraphicsPipelines(
+        device,
+        pipeline_cache_, // pipelineCache
+        1, // createInfoCount
+        &pipeline_info,
+        NULL, // allocationCallbacks
+        &pipeline
+    );
+    if (result == VK_ERROR_INVALID_SHADER_NV) {
+        LOG_F(
+            ERROR, "Failed to create pipeline for shader modules {%p, %p}.",
+            vertex_shader_module, fragment_shader_module
+        );
+        vk_dev_procs.DestroyPipelineLayout(device, pipeline_layout, NULL);
+        return false;
+    }
+    assertVk(result);
+
+
+    *pipeline_layout_out = pipeline_layout;
+    *pipeline_out = pipeline;
+
+    return true;
+}
+
+
+/// Like `createParticleRasterizePipeline()`, but with a task and a mesh shader instead of the vertex shader, and no
+/// vertex input. Only if `mesh_shaders_supported_`.
+[[nodiscard]] static bool createParticleMeshPipeline(
+    VkDevice device,
+    VkShaderModule task_shader_module,
+    VkShaderModule mesh_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    VkResult result;
+
+
+    assert(mesh_shaders_supported_);
+
+
+    constexpr u32 shader_stage_info_count = 3;
+    const VkPipelineShaderStageCreateInfo shader_stage_infos[shader_stage_info_count] {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_TASK_BIT_EXT,
+            .module = task_shader_module,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_MESH_BIT_EXT,
+            .module = mesh_shader_module,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragment_shader_module,
+            .pName = "main",
+        },
+    };
+
+
+    const VkPipelineViewportStateCreateInfo viewport_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = NULL, // using dynamic viewport
+        .scissorCount = 1,
+        .pScissors = NULL, // using dynamic scissor
+    };
+
+
+    const VkPipelineRasterizationStateCreateInfo rasterization_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE, // the quads always face the camera
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0,
+        .depthBiasClamp = 0.0,
+        .depthBiasSlopeFactor = 0.0,
+        .lineWidth = 1.0,
+    };
+
+
+    const VkPipelineMultisampleStateCreateInfo multisample_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
+
+
+    const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+        .front = {},
+        .back = {},
+        .minDepthBounds = 0.0,
+        .maxDepthBounds = 1.0,
+    };
+
+
+    const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
+        .blendEnable = VK_FALSE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+    };
+
+    const VkPipelineColorBlendStateCreateInfo color_blend_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_CLEAR,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment_info,
+        .blendConstants = {0.0, 0.0, 0.0, 0.0},
+    };
+
+
+    constexpr u32 dynamic_state_count = 2;
+    const VkDynamicState dynamic_states[dynamic_state_count] {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    const VkPipelineDynamicStateCreateInfo dynamic_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = dynamic_state_count,
+        .pDynamicStates = dynamic_states,
+    };
+
+
+    constexpr u32 push_constant_range_count = 1;
+    VkPushConstantRange push_constant_ranges[push_constant_range_count] {
+        VkPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,
+            .size = sizeof(ParticleMeshPipelinePushConstants),
+        },
+    };
+
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout,
+        .pushConstantRangeCount = push_constant_range_count,
+        .pPushConstantRanges = push_constant_ranges,
+    };
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout);
+    assertVk(result);
+
+
+    constexpr u32 color_attachment_count = 1;
+    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+
+    const VkPipelineRenderingCreateInfo pipeline_rendering_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = 0, // TODO FIXME verify that this can be 0
+        .colorAttachmentCount = color_attachment_count,
+        .pColorAttachmentFormats = color_attachment_formats,
+        .depthAttachmentFormat = DEPTH_FORMAT,
+    };
+
+
+    const VkGraphicsPipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &pipeline_rendering_info,
+        .stageCount = shader_stage_info_count,
+        .pStages = shader_stage_infos,
+        .pVertexInputState = NULL, // ignored with a mesh shader
+        .pInputAssemblyState = NULL,
+        .pTessellationState = NULL,
+        .pViewportState = &viewport_info,
+        .pRasterizationState = &rasterization_info,
+        .pMultisampleState = &multisample_info,
+        .pDepthStencilState = &depth_stencil_state_info,
+        .pColorBlendState = &color_blend_info,
+        .pDynamicState = &dynamic_state_info,
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateGraphicsPipelines(
+        device,
+        pipeline_cache_, // pipelineCache
+        1, // createInfoCount
+        &pipeline_info,
+        NULL, // allocationCallbacks
+        &pipeline
+    );
+    if (result == VK_ERROR_INVALID_SHADER_NV) {
+        LOG_F(
+            ERROR, "Failed to create pipeline for shader modules {%p, %p, %p}.",
+            task_shader_module, mesh_shader_module, fragment_shader_module
+        );
+        vk_dev_procs.DestroyPipelineLayout(device, pipeline_layout, NULL);
+        return false;
+    }
+    assertVk(result);
+
+
+    *pipeline_layout_out = pipeline_layout;
+    *pipeline_out = pipeline;
+
+    return true;
+}
+
+
+[[nodiscard]] static bool createGridPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    VkResult result;
+
+
+    constexpr u32 shader_stage_info_count = 2;
+    const VkPipelineShaderStageCreateInfo shader_stage_infos[shader_stage_info_count] {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertex_shader_module,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragment_shader_module,
+            .pName = "main",
+        },
+    };
+
+
+    const VkPipelineVertexInputStateCreateInfo vertex_input_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 0,
+        .pVertexBindingDescriptions = NULL,
+        .vertexAttributeDescriptionCount = 0,
+        .pVertexAttributeDescriptions = NULL,
+    };
+
+
+    const VkPipelineInputAssemblyStateCreateInfo input_assembly_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+
+    const VkPipelineViewportStateCreateInfo viewport_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = NULL, // using dynamic viewport
+        .scissorCount = 1,
+        .pScissors = NULL, // using dynamic scissor
+    };
+
+
+    const VkPipelineRasterizationStateCreateInfo rasterization_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_BACK_BIT,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0,
+        .depthBiasClamp = 0.0,
+        .depthBiasSlopeFactor = 0.0,
+        .lineWidth = 1.0,
+    };
+
+
+    const VkPipelineMultisampleStateCreateInfo multisample_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
+
+
+    const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+        .front = {},
+        .back = {},
+        .minDepthBounds = 0.0,
+        .maxDepthBounds = 1.0,
+    };
+
+
+    // VK_BLEND_OP_ADD :
+    //    alpha: a_new = a_src * srcAlphaBlendFactor + a_dst * dstAlphaBlendFactor
+    //    color: C_new = C_src * srcColorBlendFactor + C_dst * dstColorBlendFactor
+    const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+    };
+
+    const VkPipelineColorBlendStateCreateInfo color_blend_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_CLEAR,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment_info,
+        .blendConstants = {0.0, 0.0, 0.0, 0.0},
+    };
+
+
+    constexpr u32 dynamic_state_count = 2;
+    const VkDynamicState dynamic_states[dynamic_state_count] {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    const VkPipelineDynamicStateCreateInfo dynamic_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = dynamic_state_count,
+        .pDynamicStates = dynamic_states,
+    };
+
+
+    constexpr u32 push_constant_range_count = 1;
+    VkPushConstantRange push_constant_ranges[push_constant_range_count] {
+        VkPushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,
+            .size = sizeof(GridPipelineFragmentShaderPushConstants),
+        },
+    };
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout,
+        .pushConstantRangeCount = push_constant_range_count,
+        .pPushConstantRanges = push_constant_ranges,
+    };
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout);
+    assertVk(result);
+
+
+    constexpr u32 color_attachment_count = 1;
+    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+
+    const VkPipelineRenderingCreateInfo pipeline_rendering_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = 0, // TODO FIXME verify that this can be 0
+        .colorAttachmentCount = color_attachment_count,
+        .pColorAttachmentFormats = color_attachment_formats,
+        .depthAttachmentFormat = DEPTH_FORMAT,
+    };
+
+
+    const VkGraphicsPipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &pipeline_rendering_info,
+        .stageCount = shader_stage_info_count,
+        .pStages = shader_stage_infos,
+        .pVertexInputState = &vertex_input_info,
+        .pInputAssemblyState = &input_assembly_info,
+        .pTessellationState = NULL,
+        .pViewportState = &viewport_info,
+        .pRasterizationState = &rasterization_info,
+        .pMultisampleState = &multisample_info,
+        .pDepthStencilState = &depth_stencil_state_info,
+        .pColorBlendState = &color_blend_info,
+        .pDynamicState = &dynamic_state_info,
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateGraphicsPipelines(
+        device,
+        pipeline_cache_, // pipelineCache
+        1, // createInfoCount
+        &pipeline_info,
+        NULL, // allocationCallbacks
+        &pipeline
+    );
+    if (result == VK_ERROR_INVALID_SHADER_NV) {
+        LOG_F(
+            ERROR, "Failed to create pipeline for shader modules {%p, %p}.",
+            vertex_shader_module, fragment_shader_module
+        );
+        vk_dev_procs.DestroyPipelineLayout(device, pipeline_layout, NULL);
+        return false;
+    }
+    assertVk(result);
+
+
+    *pipeline_layout_out = pipeline_layout;
+    *pipeline_out = pipeline;
+
+    return true;
+}
+
+
+/// Thin lines, drawn as quads of triangles by the vertex shader: the outlines of the voxels, an instance per voxel
+/// (see cube_outline.vert); or, if `segments`, line segments, an instance per segment of two `vec3`s (see line.vert).
+[[nodiscard]] static bool createLineQuadPipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    bool segments,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    VkResult result;
+
+
+    VkSpecializationMapEntry vertex_shader_specialization_map_entry {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(f32),
+    };
+    VkSpecializationInfo vertex_shader_specialization_info {
+        .mapEntryCount = 1,
+        .pMapEntries = &vertex_shader_specialization_map_entry,
+        .dataSize = sizeof(f32),
+        .pData = &VOXEL_RADIUS,
+    };
+    static_assert(sizeof(VOXEL_RADIUS) == sizeof(f32));
+
+    constexpr u32 shader_stage_info_count = 2;
+    const VkPipelineShaderStageCreateInfo shader_stage_infos[shader_stage_info_count] {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertex_shader_module,
+            .pName = "main",
+            .pSpecializationInfo = segments ? NULL : &vertex_shader_specialization_info
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragment_shader_module,
+            .pName = "main",
+        },
+    };
+
+
+    // an outlined voxel's coordinates per instance; see cube_outline.vert. Or a segment's start and end points.
+    VkVertexInputBindingDescription vertex_binding_description {
+        .binding = 0,
+        .stride = segments ? (u32)(2 * sizeof(vec3)) : (u32)sizeof(ivec3),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+    };
+    VkVertexInputAttributeDescription vertex_attribute_descriptions[2] {
+        {
+            .location = 0,
+            .binding = 0,
+            .format = segments ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R32G32B32_SINT,
+            .offset = 0,
+        },
+        {
+            .location = 1,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = sizeof(vec3),
+        },
+    };
+    const VkPipelineVertexInputStateCreateInfo vertex_input_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertex_binding_description,
+        .vertexAttributeDescriptionCount = segments ? (u32)2 : (u32)1,
+        .pVertexAttributeDescriptions = vertex_attribute_descriptions,
+    };
+
+
+    const VkPipelineInputAssemblyStateCreateInfo input_assembly_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+
+    const VkPipelineViewportStateCreateInfo viewport_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = NULL, // using dynamic viewport
+        .scissorCount = 1,
+        .pScissors = NULL, // using dynamic scissor
+    };
+
+
+    const VkPipelineRasterizationStateCreateInfo rasterization_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0,
+        .depthBiasClamp = 0.0,
+        .depthBiasSlopeFactor = 0.0,
+        .lineWidth = 1.0,
+    };
+
+
+    const VkPipelineMultisampleStateCreateInfo multisample_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
+
+
+    const VkPipelineDepthStencilStateCreateInfo depth_stencil_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+        .front = {},
+        .back = {},
+        .minDepthBounds = 0.0,
+        .maxDepthBounds = 1.0,
+    };
+
+
+    const VkPipelineColorBlendAttachmentState color_blend_attachment_info {
+        .blendEnable = VK_FALSE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+    };
+
+    const VkPipelineColorBlendStateCreateInfo color_blend_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_CLEAR,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment_info,
+        .blendConstants = {0.0, 0.0, 0.0, 0.0},
+    };
+
+
+    constexpr u32 dynamic_state_count = 2;
+    const VkDynamicState dynamic_states[dynamic_state_count] {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    const VkPipelineDynamicStateCreateInfo dynamic_state_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = dynamic_state_count,
+        .pDynamicStates = dynamic_states,
+    };
+
+
+    constexpr u32 push_constant_range_count = 0;
+    VkPushConstantRange* push_constant_ranges = NULL;
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout,
+        .pushConstantRangeCount = push_constant_range_count,
+        .pPushConstantRanges = push_constant_ranges,
+    };
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout);
+    assertVk(result);
+
+
+    constexpr u32 color_attachment_count = 1;
+    VkFormat color_attachment_formats[color_attachment_count] { SWAPCHAIN_FORMAT };
+
+    const VkPipelineRenderingCreateInfo pipeline_rendering_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .viewMask = 0, // TODO FIXME verify that this can be 0
+        .colorAttachmentCount = color_attachment_count,
+        .pColorAttachmentFormats = color_attachment_formats,
+        .depthAttachmentFormat = DEPTH_FORMAT,
+    };
+
+
+    const VkGraphicsPipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &pipeline_rendering_info,
+        .stageCount = shader_stage_info_count,
+        .pStages = shader_stage_infos,
+        .pVertexInputState = &vertex_input_info,
+        .pInputAssemblyState = &input_assembly_info,
+        .pTessellationState = NULL,
+        .pViewportState = &viewport_info,
+        .pRasterizationState = &rasterization_info,
+        .pMultisampleState = &multisample_info,
+        .pDepthStencilState = &depth_stencil_state_info,
+        .pColorBlendState = &color_blend_info,
+        .pDynamicState = &dynamic_state_info,
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateGraphicsPipelines(
+        device,
+        pipeline_cache_, // pipelineCache
+        1, // createInfoCount
+        &pipeline_info,
+        NULL, // allocationCallbacks
+        &pipeline
+    );
+    if (result == VK_ERROR_INVALID_SHADER_NV) {
+        LOG_F(
+            ERROR, "Failed to create pipeline for shader modules {%p, %p}.",
+            vertex_shader_module, fragment_shader_module
+        );
+        vk_dev_procs.DestroyPipelineLayout(device, pipeline_layout, NULL);
+        return false;
+    }
+    assertVk(result);
+
+
+    *pipeline_layout_out = pipeline_layout;
+    *pipeline_out = pipeline;
+
+    return true;
+}
+
+[[nodiscard]] static bool createCubeOutlinePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createLineQuadPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, false,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+/// The segments of the debug vector field, from the frame's `vector_field_segments_buffer`; see
+/// `recordVectorField()`.
+[[nodiscard]] static bool createLinePipeline(
+    VkDevice device,
+    VkShaderModule vertex_shader_module,
+    VkShaderModule fragment_shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+    return createLineQuadPipeline(
+        device, vertex_shader_module, fragment_shader_module, descriptor_set_layout, true,
+        pipeline_out, pipeline_layout_out
+    );
+}
+
+
+/// A compute pipeline whose workgroup size is specialization constant 0, and whose push constants are
+/// `push_constants_size` bytes.
+static void createComputePipeline(
+    VkDevice device,
+    VkShaderModule shader_module,
+    VkDescriptorSetLayout descriptor_set_layout,
+    u32 workgroup_size,
+    u32 push_constants_size,
+    VkPipeline* pipeline_out,
+    VkPipelineLayout* pipeline_layout_out
+) {
+
+    VkResult result;
+
+
+    const VkSpecializationMapEntry specialization_map_entry {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(u32),
+    };
+    const VkSpecializationInfo specialization_info {
+        .mapEntryCount = 1,
+        .pMapEntries = &specialization_map_entry,
+        .dataSize = sizeof(u32),
+        .pData = &workgroup_size,
+    };
+
+
+    const VkPushConstantRange push_constant_range {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = push_constants_size,
+    };
+    const VkPipelineLayoutCreateInfo pipeline_layout_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range,
+    };
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout);
+    assertVk(result);
+
+
+    const VkComputePipelineCreateInfo pipeline_info {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName = "main",
+            .pSpecializationInfo = &specialization_info,
+        },
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateComputePipelines(device, pipeline_cache_, 1, &pipeline_info, NULL, &pipeline);
+    assertVk(result);
+
+
+    *pipeline_layout_out = pipeline_layout;
+    *pipeline_out = pipeline;
+}
+
+
+/// On failure, sets `p_present_mode_count_out` to 0 and returns `NULL`.
+/// You own the returned array. You are responsible for freeing it via `free()`.
+static VkPresentModeKHR* getSupportedVkPresentModes(VkSurfaceKHR surface, u32* p_present_mode_count_out) {
+
+    assert(initialized_);
+    VkResult result;
+
+
+    result = vk_inst_procs.GetPhysicalDeviceSurfacePresentModesKHR(
+        physical_device_, surface, p_present_mode_count_out, NULL
+    );
+    assertVk(result);
+    if (p_present_mode_count_out == 0) return NULL;
+
+    VkPresentModeKHR* p_present_modes = mallocArray(*p_present_mode_count_out, VkPresentModeKHR);
+    result = vk_inst_procs.GetPhysicalDeviceSurfacePresentModesKHR(
+        physical_device_, surface, p_present_mode_count_out, p_present_modes
+    );
+    assertVk(result);
+
+
+    return p_present_modes;
+}
+
+
+/// Doesn't verify present mode support. You must do so before calling this.
+/// Doesn't verify surface support. You must do so before calling this.
+/// `fallback_extent` is used if the surface doesn't report a specific extent via Vulkan surface properties.
+///     If you want resizing to work on all platforms, you should probably get the window's current dimensions
+///     from your window provider. Some providers supposedly don't report their current dimensions via Vulkan,
+///     according to
+///     https://gist.github.com/nanokatze/bb03a486571e13a7b6a8709368bd87cf#file-handling-window-resize-md
+/// Doesn't destroy `old_swapchain`; simply retires it. You are responsible for destroying it.
+/// `old_swapchain` may be `VK_NULL_HANDLE`.
+/// `swapchain_out` and `extent_out` must not be NULL.
+static Result createSwapchain(
+     VkPhysicalDevice physical_device,
+     VkDevice device,
+     VkSurfaceKHR surface,
+     VkExtent2D fallback_extent,
+     u32 queue_family_index,
+     VkPresentModeKHR present_mode,
+     VkSwapchainKHR old_swapchain,
+     VkSwapchainKHR* swapchain_out,
+     VkExtent2D* extent_out
+) {
+    ZoneScoped;
+
+    #ifndef NDEBUG
+    {
+        u32 supported_mode_count = 0;
+        VkPresentModeKHR* supported_modes = getSupportedVkPresentModes(surface, &supported_mode_count);
+
+        bool present_mode_supported = false;
+        for (u32fast i = 0; i < supported_mode_count; i++) {
+            present_mode_supported |= (supported_modes[i] == present_mode);
+        }
+        assert(present_mode_supported);
+
+        free(supported_modes);
+    }
+    #endif
+
+
+    VkSurfaceCapabilitiesKHR surface_capabilities {};
+    VkResult result = vk_inst_procs.GetPhysicalDeviceSurfaceCapabilitiesKHR(
+        physical_device, surface, &surface_capabilities
+    );
+    assertVk(result);
+
+
+    // Vk spec 1.3.259, appendix VK_KHR_swapchain, issue 12: suggests using capabilities.minImageCount + 1
+    // to guarantee that vkAcquireNextImageKHR is non-blocking when using Mailbox present mode.
+    // In FIFO mode, having a larger queue of submitted images increases input latency, so we request the
+    // minimum possible in that case.
+    // In Immediate mode, I assume the number of images doesn't matter.
+    u32 min_image_count_request = surface_capabilities.minImageCount;
+    if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) min_image_count_request += 1;
+    {
+        u32 count_preclamp = min_image_count_request;
+        min_image_count_request = math::max(min_image_count_request, surface_capabilities.minImageCount);
+        if (surface_capabilities.maxImageCount != 0) {
+            min_image_count_request = math::min(min_image_count_request, surface_capabilities.maxImageCount);
+        }
+
+        if (min_image_count_request != count_preclamp) LOG_F(
+            WARNING,
+            "Min swapchain image count clamped from %" PRIu32 " to %" PRIu32 ", to fit surface limits.",
+            count_preclamp, min_image_count_request
+        );
+    }
+
+
+    // Vk spec 1.3.234:
+    //     On some platforms, it is normal that maxImageExtent may become (0, 0), for example when the window
+    //     is minimized. In such a case, it is not possible to create a swapchain due to the Valid Usage
+    //     requirements.
+    const VkExtent2D max_extent = surface_capabilities.maxImageExtent;
+    if (max_extent.width == 0 or max_extent.height == 0) {
+        LOG_F(INFO, "Aborting swapchain build: SurfaceCapabilities::maxImageExtent contains a 0.");
+        return Result::error_window_size_zero;
+    }
+
+    VkExtent2D extent = surface_capabilities.currentExtent;
+    // Vk spec 1.3.234:
+    //     currentExtent is the current width and height of the surface, or the special value (0xFFFFFFFF,
+    //     0xFFFFFFFF) indicating that the surface size will be determined by the extent of a swapchain
+    //     targeting the surface.
+    if (extent.width == 0xFF'FF'FF'FF and extent.height == 0xFF'FF'FF'FF) {
+
+        LOG_F(INFO, "Surface currentExtent is (0xFFFFFFFF, 0xFFFFFFFF); using fallback extent.");
+        if (fallback_extent.width == 0 or fallback_extent.height == 0) {
+            LOG_F(INFO, "Aborting swapchain build: `fallback_extent` contains a 0.");
+            return Result::error_window_size_zero;
+        }
+
+        const VkExtent2D min_extent = surface_capabilities.minImageExtent;
+
+        extent.width = math::clamp(fallback_extent.width, min_extent.width, max_extent.width);
+        extent.height = math::clamp(fallback_extent.height, min_extent.height, max_extent.height);
+        if (extent.width != fallback_extent.width or extent.height != fallback_extent.height) LOG_F(
+            WARNING,
+            "Adjusted fallback swapchain extent (%" PRIu32 ", %" PRIu32 ") to (%" PRIu32 ", %" PRIu32 "), to fit surface limits.",
+            fallback_extent.width, fallback_extent.height, extent.width, extent.height
+        );
+    }
+
+
+    LOG_F(
+        INFO, "Requesting minImageCount=%" PRIu32 ", presentMode=%i for swapchain creation.",
+        min_image_count_request, present_mode
+    );
+    VkSwapchainCreateInfoKHR swapchain_info {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+        .surface = surface,
+        .minImageCount = min_image_count_request,
+        .imageFormat = SWAPCHAIN_FORMAT,
+        .imageColorSpace = SWAPCHAIN_COLOR_SPACE,
+        .imageExtent = extent,
+        .imageArrayLayers = 1,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &queue_family_index,
+        .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+        .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+        .presentMode = present_mode,
+        .clipped = VK_FALSE,
+        .oldSwapchain = old_swapchain,
+    };
+    alwaysAssert(surface_capabilities.supportedUsageFlags & swapchain_info.imageUsage);
+
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    {
+        ZoneScopedN("vkCreateSwapchainKHR");
+
+        result = vk_dev_procs.CreateSwapchainKHR(device, &swapchain_info, NULL, &swapchain);
+        assertVk(result);
+    }
+
+    LOG_F(INFO, "Built swapchain %p.", swapchain);
+    *swapchain_out = swapchain;
+    *extent_out = extent;
+    return Result::success;
+}
+
+
+static void createPerSwapchainImageSurfaceResources(
+    VkSwapchainKHR swapchain,
+    u32* image_count_out,
+    VkImage** images_out,
+    VkImageView** image_views_out,
+    VkSemaphore** image_acquired_semaphores_out
+) {
+
+    u32 image_count = 0;
+    VkResult result = vk_dev_procs.GetSwapchainImagesKHR(device_, swapchain, &image_count, NULL);
+    assertVk(result);
+
+    LOG_F(INFO, "Got %" PRIu32 " images from swapchain %p.", image_count, swapchain);
+
+
+    VkImage* swapchain_images = mallocArray(image_count, VkImage);
+    result = vk_dev_procs.GetSwapchainImagesKHR(device_, swapchain, &image_count, swapchain_images);
+    assertVk(result);
+
+
+    VkImageView* swapchain_image_views = mallocArray(image_count, VkImageView);
+
+    for (u32fast im_idx = 0; im_idx < image_count; im_idx++) {
+
+        VkImageViewCreateInfo image_view_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = swapchain_images[im_idx],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = SWAPCHAIN_FORMAT,
+            .components = VkComponentMapping {
+                .r = VK_COMPONENT_SWIZZLE_R,
+                .g = VK_COMPONENT_SWIZZLE_G,
+                .b = VK_COMPONENT_SWIZZLE_B,
+                .a = VK_COMPONENT_SWIZZLE_A,
+            },
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = vk_dev_procs.CreateImageView(
+            device_, &image_view_info, NULL, &swapchain_image_views[im_idx]
+        );
+        assertVk(result);
+    }
+
+
+    VkSemaphore* swapchain_image_acquired_semaphores = mallocArray(image_count, VkSemaphore);
+    {
+        VkSemaphoreCreateInfo semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+        for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
+            result = vk_dev_procs.CreateSemaphore(
+                device_, &semaphore_info, NULL, &swapchain_image_acquired_semaphores[im_idx]
+            );
+            assertVk(result);
+        }
+    }
+
+
+    *image_count_out = image_count;
+    *images_out = swapchain_images;
+    *image_views_out = swapchain_image_views;
+    *image_acquired_semaphores_out = swapchain_image_acquired_semaphores;
+}
+
+/// Does not synchronize.
+/// You are responsible for ensuring the resources are not in use (e.g. via vkDeviceWaitIdle).
+static void destroyPerSwapchainImageSurfaceResources(
+    u32 image_count,
+    VkImage* p_images,
+    VkImageView* p_image_views,
+    VkSemaphore* p_image_acquired_semaphores
+) {
+    assert(p_images != NULL);
+    assert(p_image_views != NULL);
+    assert(p_image_acquired_semaphores != NULL);
+
+    for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
+        vk_dev_procs.DestroySemaphore(device_, p_image_acquired_semaphores[im_idx], NULL);
+    }
+    free(p_image_acquired_semaphores);
+
+    for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
+        vk_dev_procs.DestroyImageView(device_, p_image_views[im_idx], NULL);
+    }
+    free(p_image_views);
+
+    free(p_images);
+}
+
+
+// The timestamp queries of a frame: a begin and an end per `RenderPass`, then the frame's begin and end.
+constexpr u32 FRAME_TIMESTAMP_QUERY_IDX = 2 * RENDER_PASS_ENUM_COUNT;
+constexpr u32 TIMESTAMP_QUERY_COUNT = FRAME_TIMESTAMP_QUERY_IDX + 2;
+
+/// Does not call `BeginCommandBuffer` and `EndCommandBuffer`; you are responsible for doing that.
+/// Returns `true` if successful.
+/// Writes the begin (or, if `end`, the end) timestamp of `pass` to the frame's `query_pool`, once the commands
+/// before it have finished. Does nothing if `query_pool` is VK_NULL_HANDLE, e.g. if the device doesn't support
+/// timestamps.
+static void recordRenderPassTimestamp(
+    VkQueryPool query_pool,
+    VkCommandBuffer command_buffer,
+    RenderPass pass,
+    bool end
+) {
+    if (query_pool == VK_NULL_HANDLE) return;
+
+    const u32 query_idx = 2 * (u32)pass + (end ? 1u : 0u);
+    vk_dev_procs.CmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, query_idx);
+}
+
+
+/// Reads the timestamps of the last submission of `p_frame_resources`'s command buffer, which must have
+/// finished, into `p_render_resources->pass_gpu_times_ns` and `frame_gpu_time_ns`. Returns whether it did.
+static bool readRenderPassTimestamps(
+    RenderResourcesImpl* p_render_resources,
+    RenderResourcesImpl::PerFrameResources* p_frame_resources
+) {
+    if (!p_frame_resources->timestamps_pending) return false;
+    p_frame_resources->timestamps_pending = false;
+
+    u64 timestamps[TIMESTAMP_QUERY_COUNT] {};
+    const VkResult result = vk_dev_procs.GetQueryPoolResults(
+        device_, p_frame_resources->timestamp_query_pool,
+        0, TIMESTAMP_QUERY_COUNT,
+        sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+        VK_QUERY_RESULT_64_BIT
+    );
+    // The fence has been waited on, so this shouldn't happen; but a missed sample isn't worth aborting over.
+    if (result == VK_NOT_READY) return false;
+    assertVk(result);
+
+    const f64 ns_per_tick = (f64)physical_device_properties_.limits.timestampPeriod;
+    for (u32 pass = 0; pass < RENDER_PASS_ENUM_COUNT; pass++) {
+        const u64 begin = timestamps[2 * pass];
+        const u64 end = timestamps[2 * pass + 1];
+        p_render_resources->pass_gpu_times_ns[pass] = (f64)(end - begin) * ns_per_tick;
+    }
+    const u64 frame_begin = timestamps[FRAME_TIMESTAMP_QUERY_IDX];
+    const u64 frame_end = timestamps[FRAME_TIMESTAMP_QUERY_IDX + 1];
+    p_render_resources->frame_gpu_time_ns = (f64)(frame_end - frame_begin) * ns_per_tick;
+    p_render_resources->pass_gpu_times_valid = true;
+    return true;
+}
+
+
+/// Reads the results of the pick of the last submission of `p_frame_resources`'s command buffer, which must have
+/// finished, into `p_render_resources->picked_*`, for `getPickResult()`. Returns whether there was a pick.
+static bool readPickResults(
+    RenderResourcesImpl* p_render_resources,
+    RenderResourcesImpl::PerFrameResources* p_frame_resources
+) {
+    if (!p_frame_resources->pick_pending) return false;
+    p_frame_resources->pick_pending = false;
+
+    const VkResult result = vmaInvalidateAllocation(
+        vma_allocator_, p_frame_resources->pick_results_buffer_allocation, 0, VK_WHOLE_SIZE
+    );
+    assertVk(result);
+
+    const void* p_mapped = p_frame_resources->pick_results_buffer_allocation_info.pMappedData;
+    const PickResultsHeader* header = (const PickResultsHeader*)p_mapped;
+    const u32* ids = (const u32*)((const u8*)p_mapped + sizeof(PickResultsHeader));
+    const u32 id_count = math::min(header->count, MAX_PICKED_OBJECT_COUNT);
+    p_render_resources->transfers.download_byte_counts[RENDER_TRANSFER_PICKING] +=
+        sizeof(PickResultsHeader) + id_count * sizeof(u32);
+    p_render_resources->transfers.download_counts[RENDER_TRANSFER_PICKING]++;
+
+    // see object_id_voxel.frag and object_id_particle.frag
+    const u32 axis_mask = (1u << OBJECT_ID_VOXEL_AXIS_BITS) - 1;
+    const i32 axis_offset = 1 << (OBJECT_ID_VOXEL_AXIS_BITS - 1);
+    u32 voxel_count = 0;
+    u32 particle_count = 0;
+    for (u32 i = 0; i < id_count; i++) {
+        const u32 id = ids[i];
+        if (id & OBJECT_ID_VOXEL_BIT) {
+            const ivec3 coord = ivec3(
+                (i32)(id & axis_mask),
+                (i32)((id >> OBJECT_ID_VOXEL_AXIS_BITS) & axis_mask),
+                (i32)((id >> (2 * OBJECT_ID_VOXEL_AXIS_BITS)) & axis_mask)
+            );
+            p_render_resources->picked_voxel_coords[voxel_count++] =
+                p_frame_resources->pick_origin + coord - axis_offset;
+        }
+        else {
+            p_render_resources->picked_particle_indices[particle_count++] = id - 1;
+        }
+    }
+    p_render_resources->picked_voxel_count = voxel_count;
+    p_render_resources->picked_particle_count = particle_count;
+    p_render_resources->picked_particle_ids = p_frame_resources->pick_particle_ids;
+    p_render_resources->pick_result_truncated =
+        header->count > MAX_PICKED_OBJECT_COUNT || header->dropped_texel_count > 0;
+    p_render_resources->pick_result_new = true;
+    return true;
+}
+
+
+/// Moves `p_render_resources->render_scale` towards the scale at which the frame whose timestamps were just read,
+/// drawn at `frame_render_scale`, would have taken `dynamic_resolution_budget_ns_`; see
+/// `setDynamicResolutionBudget()`. The scaled passes cost about in proportion to their pixels, the square of the
+/// scale; the rest of the frame, as if it didn't depend on it. Frames that draw no scaled pass leave it be.
+static void updateRenderScale(RenderResourcesImpl* p_render_resources, f32 frame_render_scale) {
+
+    // off; back to full resolution
+    if (dynamic_resolution_budget_ns_ <= 0.0) {
+        p_render_resources->render_scale = 1.f;
+        return;
+    }
+
+    const f64 scaled_ns =
+        p_render_resources->pass_gpu_times_ns[RENDER_PASS_FLUID_SURFACE] +
+        p_render_resources->pass_gpu_times_ns[RENDER_PASS_SCALED_PARTICLES];
+    if (scaled_ns <= 0.0) return;
+
+    const f64 unscaled_ns = math::max(p_render_resources->frame_gpu_time_ns - scaled_ns, 0.0);
+    const f64 available_ns = dynamic_resolution_budget_ns_ - unscaled_ns;
+    // if the rest of the frame is over the budget by itself, the scaled passes can't make up for it
+    const f32 target_scale =
+        (available_ns > 0.0) ? frame_render_scale * (f32)sqrt(available_ns / scaled_ns) : MIN_RENDER_SCALE;
+
+    const f32 scale = p_render_resources->render_scale;
+    p_render_resources->render_scale =
+        math::clamp(scale + RENDER_SCALE_SMOOTHING * (target_scale - scale), MIN_RENDER_SCALE, 1.f);
+}
+
+
+/// Moves `p_render_resources->particle_subsample_fraction` towards the fraction at which the frame whose timestamps
+/// were just read, which drew `frame_fraction` of the rasterized particles, would have taken
+/// `particle_subsampling_budget_ns_`; see `setParticleSubsamplingBudget()`. Like `updateRenderScale()`, but the
+/// particles cost about in proportion to how many are drawn. Frames that didn't subsample leave it be, so that the
+/// fraction picks up where it was after a suspension.
+static void updateParticleSubsampleFraction(RenderResourcesImpl* p_render_resources, f32 frame_fraction) {
+
+    // off; back to every particle
+    if (particle_subsampling_budget_ns_ <= 0.0) {
+        p_render_resources->particle_subsample_fraction = 1.f;
+        return;
+    }
+    if (frame_fraction <= 0.f) return;
+
+    const f64 particles_ns = p_render_resources->pass_gpu_times_ns[RENDER_PASS_PARTICLES];
+    if (particles_ns <= 0.0) return;
+
+    const f64 other_ns = math::max(p_render_resources->frame_gpu_time_ns - particles_ns, 0.0);
+    const f64 available_ns = particle_subsampling_budget_ns_ - other_ns;
+    const f32 target_fraction =
+        (available_ns > 0.0) ? frame_fraction * (f32)(available_ns / particles_ns) : MIN_PARTICLE_SUBSAMPLE_FRACTION;
+
+    const f32 fraction = p_render_resources->particle_subsample_fraction;
+    p_render_resources->particle_subsample_fraction = math::clamp(
+        fraction + PARTICLE_SUBSAMPLE_SMOOTHING * (target_fraction - fraction), MIN_PARTICLE_SUBSAMPLE_FRACTION, 1.f
+    );
+}
+
+
+/// Records the pending changes of the voxel mesh: the clears of the chunks' old quads, then the copies of their new
+/// ones from `staging_buffer` (where `render()` has put `voxel_mesh_staged_quads`); and forgets them.
+static void recordVoxelMeshEdits(
+    RenderResourcesImpl* p_render_resources, VkBuffer staging_buffer, VkCommandBuffer command_buffer
+) {
+    ArrayList<VoxelQuadRange>* cleared_ranges = &p_render_resources->voxel_mesh_cleared_ranges;
+    ArrayList<VoxelQuadCopy>* copies = &p_render_resources->voxel_mesh_copies;
+    if (cleared_ranges->size == 0 && copies->size == 0) return;
+
+    const VkBuffer voxel_mesh_buffer = p_render_resources->voxel_mesh_buffer;
+
+    // The culling of the earlier frames reads the buffer; it precedes this in submission order, so an execution
+    // dependency is enough.
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // dstStageMask
+        0, 0, NULL, 0, NULL, 0, NULL
+    );
+
+    // empty quads are all zeros
+    for (u32 i = 0; i < cleared_ranges->size; i++) {
+        const VoxelQuadRange* range = &cleared_ranges->ptr[i];
+        vk_dev_procs.CmdFillBuffer(
+            command_buffer, voxel_mesh_buffer,
+            range->first * sizeof(VoxelQuad), range->count * sizeof(VoxelQuad), 0
+        );
+    }
+
+    // a chunk's new quads may take the place of another's cleared ones
+    if (cleared_ranges->size > 0 && copies->size > 0) {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    for (u32 i = 0; i < copies->size; i++) {
+        const VoxelQuadCopy* copy = &copies->ptr[i];
+        const VkBufferCopy region {
+            .srcOffset = copy->src_idx * sizeof(VoxelQuad),
+            .dstOffset = copy->dst_idx * sizeof(VoxelQuad),
+            .size = copy->count * sizeof(VoxelQuad),
+        };
+        vk_dev_procs.CmdCopyBuffer(command_buffer, staging_buffer, voxel_mesh_buffer, 1, &region);
+    }
+
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    };
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+
+    cleared_ranges->resetSize();
+    copies->resetSize();
+    p_render_resources->voxel_mesh_staged_quads.resetSize();
+}
+
+
+/// Records the copy of the outlined voxels that `setOutlinedVoxels()` set from `staging_buffer` (where `render()`
+/// has put them) into `outlined_voxels_buffer`, if they changed.
+static void recordOutlinedVoxelsUpload(
+    RenderResourcesImpl* p_render_resources, VkBuffer staging_buffer, VkCommandBuffer command_buffer
+) {
+    if (!p_render_resources->outlined_voxels_dirty) return;
+    p_render_resources->outlined_voxels_dirty = false;
+
+    p_render_resources->outlined_voxel_count = p_render_resources->outlined_voxels_staged.size;
+    p_render_resources->outlined_voxels_staged.resetSize();
+    if (p_render_resources->outlined_voxel_count == 0) return;
+
+    // The outlines of the earlier frames read the buffer; they precede this in submission order, so an execution
+    // dependency is enough.
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // dstStageMask
+        0, 0, NULL, 0, NULL, 0, NULL
+    );
+
+    const VkBufferCopy region {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = p_render_resources->outlined_voxel_count * sizeof(ivec3),
+    };
+    vk_dev_procs.CmdCopyBuffer(command_buffer, staging_buffer, p_render_resources->outlined_voxels_buffer, 1, &region);
+
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+    };
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // dstStageMask
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+}
+
+
+/// Points the particle grid bindings of `descriptor_set` at the buffers of `p_grid_optional`, or, if it's NULL,
+/// at `fallback_buffer`, so that they are valid even though the shader doesn't read them. The set must not be in
+/// use.
+static void writeParticleGridDescriptors(
+    VkDescriptorSet descriptor_set,
+    const ParticleGrid* p_grid_optional,
+    VkBuffer fallback_buffer
+) {
+
+    const ParticleGrid* g = p_grid_optional;
+    const VkBuffer buffers[PARTICLE_GRID_BINDING_COUNT] {
+        g != NULL ? g->cells : fallback_buffer,
+        g != NULL ? g->hash_buckets : fallback_buffer,
+        g != NULL ? g->cell_slots : fallback_buffer,
+        g != NULL ? g->permutation : fallback_buffer,
+        g != NULL ? g->reference_positions : fallback_buffer,
+        g != NULL ? g->domain_bounds : fallback_buffer,
+    };
+
+    VkDescriptorBufferInfo buffer_infos[PARTICLE_GRID_BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[PARTICLE_GRID_BINDING_COUNT] {};
+    for (u32 i = 0; i < PARTICLE_GRID_BINDING_COUNT; i++)
+    {
+        buffer_infos[i] = VkDescriptorBufferInfo {
+            .buffer = buffers[i],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = PARTICLE_GRID_BINDINGS[i],
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &buffer_infos[i],
+            .pTexelBufferView = NULL,
+        };
+    }
+    vk_dev_procs.UpdateDescriptorSets(device_, PARTICLE_GRID_BINDING_COUNT, writes, 0, NULL);
+}
+
+/// Points the particle interpolation's bindings at the two states; they change from frame to frame.
+static void writeParticleInterpolationDescriptors(
+    VkDescriptorSet descriptor_set,
+    const ParticleInterpolation* p_interpolation
+) {
+    const VkBuffer buffers[PARTICLE_INTERPOLATION_BINDING_COUNT] {
+        p_interpolation->previous_particles,
+        p_interpolation->next_particles,
+    };
+
+    VkDescriptorBufferInfo buffer_infos[PARTICLE_INTERPOLATION_BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[PARTICLE_INTERPOLATION_BINDING_COUNT] {};
+    for (u32 i = 0; i < PARTICLE_INTERPOLATION_BINDING_COUNT; i++)
+    {
+        buffer_infos[i] = VkDescriptorBufferInfo {
+            .buffer = buffers[i],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = PARTICLE_INTERPOLATION_FIRST_BINDING + i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &buffer_infos[i],
+            .pTexelBufferView = NULL,
+        };
+    }
+    vk_dev_procs.UpdateDescriptorSets(device_, PARTICLE_INTERPOLATION_BINDING_COUNT, writes, 0, NULL);
+}
+
+/// Points the vector field's bindings at the field's vectors, which change from frame to frame, and at the frame's
+/// buffers. The set must not be in use.
+static void writeVectorFieldDescriptors(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const VectorField* p_field
+) {
+    const VkBuffer buffers[VECTOR_FIELD_BINDING_COUNT] {
+        p_field->vectors,
+        p_frame_resources->vector_field_segments_buffer,
+        p_frame_resources->vector_field_draw_command_buffer,
+        p_frame_resources->vector_field_claims_buffer,
+    };
+
+    VkDescriptorBufferInfo buffer_infos[VECTOR_FIELD_BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[VECTOR_FIELD_BINDING_COUNT] {};
+    for (u32 i = 0; i < VECTOR_FIELD_BINDING_COUNT; i++)
+    {
+        buffer_infos[i] = VkDescriptorBufferInfo {
+            .buffer = buffers[i],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_frame_resources->descriptor_set,
+            .dstBinding = VECTOR_FIELD_FIRST_BINDING + i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &buffer_infos[i],
+            .pTexelBufferView = NULL,
+        };
+    }
+    vk_dev_procs.UpdateDescriptorSets(device_, VECTOR_FIELD_BINDING_COUNT, writes, 0, NULL);
+}
+
+
+static VkExtent2D getFluidSurfaceExtent(VkExtent2D swapchain_extent) {
+    return VkExtent2D {
+        .width = (swapchain_extent.width + FLUID_SURFACE_DOWNSCALE - 1) / FLUID_SURFACE_DOWNSCALE,
+        .height = (swapchain_extent.height + FLUID_SURFACE_DOWNSCALE - 1) / FLUID_SURFACE_DOWNSCALE,
+    };
+}
+
+/// `extent` at `render_scale`, rounded up, and at least a pixel along each side.
+static VkExtent2D getScaledExtent(VkExtent2D extent, f32 render_scale) {
+    return VkExtent2D {
+        .width = math::max((u32)ceilf((f32)extent.width * render_scale), 1u),
+        .height = math::max((u32)ceilf((f32)extent.height * render_scale), 1u),
+    };
+}
+
+/// Points the fluid surface bindings at the frame's `fluid_surface_image_views`, which are recreated with the
+/// surface.
+static void writeFluidSurfaceDescriptors(const RenderResourcesImpl::PerFrameResources* p_frame_resources) {
+
+    const FluidSurfaceImage images[FLUID_SURFACE_BINDING_COUNT] {
+        FLUID_SURFACE_IMAGE_DEPTH,
+        FLUID_SURFACE_IMAGE_DEPTH_TEMP,
+        FLUID_SURFACE_IMAGE_DEPTH,
+        FLUID_SURFACE_IMAGE_THICKNESS,
+    };
+
+    VkDescriptorImageInfo image_infos[FLUID_SURFACE_BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[FLUID_SURFACE_BINDING_COUNT] {};
+    for (u32 i = 0; i < FLUID_SURFACE_BINDING_COUNT; i++)
+    {
+        // the first two are storage images; see the descriptor set layout
+        const bool storage = i < 2;
+        image_infos[i] = VkDescriptorImageInfo {
+            .sampler = VK_NULL_HANDLE, // immutable
+            .imageView = p_frame_resources->fluid_surface_image_views[images[i]],
+            .imageLayout = FLUID_SURFACE_IMAGE_INFOS[images[i]].layout,
+        };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_frame_resources->descriptor_set,
+            .dstBinding = FLUID_SURFACE_FIRST_BINDING + i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &image_infos[i],
+            .pBufferInfo = NULL,
+            .pTexelBufferView = NULL,
+        };
+    }
+    vk_dev_procs.UpdateDescriptorSets(device_, FLUID_SURFACE_BINDING_COUNT, writes, 0, NULL);
+}
+
+/// Points the scaled particle bindings at the frame's `scaled_particle_image_views`, which are recreated with the
+/// surface.
+static void writeScaledParticleDescriptors(const RenderResourcesImpl::PerFrameResources* p_frame_resources) {
+
+    VkDescriptorImageInfo image_infos[SCALED_PARTICLE_BINDING_COUNT] {};
+    VkWriteDescriptorSet writes[SCALED_PARTICLE_BINDING_COUNT] {};
+    for (u32 i = 0; i < SCALED_PARTICLE_BINDING_COUNT; i++)
+    {
+        // in the order of `ScaledParticleImage`
+        image_infos[i] = VkDescriptorImageInfo {
+            .sampler = VK_NULL_HANDLE, // immutable
+            .imageView = p_frame_resources->scaled_particle_image_views[i],
+            .imageLayout = SCALED_PARTICLE_IMAGE_INFOS[i].layout,
+        };
+        writes[i] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_frame_resources->descriptor_set,
+            .dstBinding = SCALED_PARTICLE_FIRST_BINDING + i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &image_infos[i],
+            .pBufferInfo = NULL,
+            .pTexelBufferView = NULL,
+        };
+    }
+    vk_dev_procs.UpdateDescriptorSets(device_, SCALED_PARTICLE_BINDING_COUNT, writes, 0, NULL);
+}
+
+/// Points the object id image's binding at the frame's `object_id_image_view`, which is recreated with the surface.
+/// The other bindings of picking are written with the renderer.
+static void writeObjectIdDescriptors(const RenderResourcesImpl::PerFrameResources* p_frame_resources) {
+
+    const VkDescriptorImageInfo image_info {
+        .sampler = VK_NULL_HANDLE,
+        .imageView = p_frame_resources->object_id_image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    const VkWriteDescriptorSet write {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = p_frame_resources->descriptor_set,
+        .dstBinding = OBJECT_ID_FIRST_BINDING,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo = &image_info,
+        .pBufferInfo = NULL,
+        .pTexelBufferView = NULL,
+    };
+    vk_dev_procs.UpdateDescriptorSets(device_, 1, &write, 0, NULL);
+}
+
+/// Points the binding of the particle ids that a pick translates to, and that the particle subsampling hashes, at
+/// `particle_ids_buffer`, or at a placeholder if it's VK_NULL_HANDLE; rewritten by every frame that picks or
+/// subsamples, as the sim may have been recreated since the last.
+static void writePickParticleIdsDescriptor(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkBuffer particle_ids_buffer
+) {
+    const VkDescriptorBufferInfo buffer_info {
+        // not read by object_id_resolve.comp then
+        .buffer = particle_ids_buffer != VK_NULL_HANDLE ? particle_ids_buffer : p_frame_resources->pick_id_set_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    const VkWriteDescriptorSet write {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = p_frame_resources->descriptor_set,
+        .dstBinding = OBJECT_ID_FIRST_BINDING + 3,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = NULL,
+        .pBufferInfo = &buffer_info,
+        .pTexelBufferView = NULL,
+    };
+    vk_dev_procs.UpdateDescriptorSets(device_, 1, &write, 0, NULL);
+}
+
+/// Points the bindings of the depth buffer and the depth pyramid at the frame's `depth_buffer_view` and at
+/// `depth_pyramid_buffer`, which are recreated with the surface. The other bindings of occlusion culling are written
+/// with the renderer.
+static void writeDepthPyramidDescriptors(
+    const RenderResourcesImpl* p_render_resources,
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources
+) {
+    // read by depth_pyramid.comp while `recordOcclusionCulling()` has it in this layout
+    const VkDescriptorImageInfo image_info {
+        .sampler = VK_NULL_HANDLE, // immutable
+        .imageView = p_frame_resources->depth_buffer_view,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+    };
+    const VkDescriptorBufferInfo buffer_info {
+        .buffer = p_render_resources->depth_pyramid_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    const VkWriteDescriptorSet writes[2] {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_frame_resources->descriptor_set,
+            .dstBinding = OCCLUSION_FIRST_BINDING,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &image_info,
+            .pBufferInfo = NULL,
+            .pTexelBufferView = NULL,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_frame_resources->descriptor_set,
+            .dstBinding = OCCLUSION_FIRST_BINDING + 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &buffer_info,
+            .pTexelBufferView = NULL,
+        },
+    };
+    vk_dev_procs.UpdateDescriptorSets(device_, 2, writes, 0, NULL);
+}
+
+
+/// Records the first phase of occlusion culling, for the voxel mesh's quads, and resets the frame's
+/// `particle_occlusion_buffer` for the first phase of particle_mesh.task; see voxel_cull.comp. Writes the frame's
+/// `visible_voxels_buffer`, `occluded_voxels_buffer` and `voxel_draw_command_buffer`. Outside of rendering, after
+/// `recordVoxelMeshEdits()`.
+static void recordVoxelCulling(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const VoxelCullPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    assert(push_constants->phase == 0);
+
+    // The frame's previous use of these buffers was waited for by `command_buffer_pending_fence`, and an earlier
+    // view's, by `recordExtraView()`.
+    const VkDrawIndirectCommand initial_draw_command {
+        .vertexCount = 6, // a quad; see voxel.vert
+        .instanceCount = 0,
+        .firstVertex = 0,
+        .firstInstance = 0,
+    };
+    const VoxelCullCommands initial_commands {
+        .draw_commands = { initial_draw_command, initial_draw_command },
+        .occluded_dispatch = VkDispatchIndirectCommand { .x = 0, .y = 1, .z = 1 },
+        .occluded_count = 0,
+    };
+    vk_dev_procs.CmdUpdateBuffer(
+        command_buffer, p_frame_resources->voxel_draw_command_buffer, 0, sizeof(initial_commands), &initial_commands
+    );
+    const ParticleOcclusion initial_particle_occlusion {
+        .occluded_draw = VkDrawMeshTasksIndirectCommandEXT { .groupCountX = 0, .groupCountY = 1, .groupCountZ = 1 },
+        .occluded_cluster_count = 0,
+    };
+    vk_dev_procs.CmdUpdateBuffer(
+        command_buffer, p_frame_resources->particle_occlusion_buffer, 0, sizeof(initial_particle_occlusion),
+        &initial_particle_occlusion
+    );
+    {
+        // also orders the previous frame's build of the depth pyramid, in an earlier submission, before the tests
+        // against it
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                (mesh_shaders_supported_ ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT : 0), // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    if (push_constants->quad_count > 0) {
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, voxel_cull_pipeline_.layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, voxel_cull_pipeline_.pipeline);
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, voxel_cull_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(VoxelCullPipelinePushConstants), push_constants
+        );
+
+        const u32 workgroup_count = (push_constants->quad_count + VOXEL_CULL_WORKGROUP_SIZE - 1) / VOXEL_CULL_WORKGROUP_SIZE;
+        vk_dev_procs.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+    }
+
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// The size of a level of the depth pyramid; see depth_pyramid.comp.h.
+static VkExtent2D depthPyramidLevelExtent(VkExtent2D depth_buffer_extent, u32 level) {
+    return VkExtent2D {
+        .width = (depth_buffer_extent.width + (2u << level) - 1) >> (level + 1),
+        .height = (depth_buffer_extent.height + (2u << level) - 1) >> (level + 1),
+    };
+}
+
+
+/// Records the middle of occlusion culling, between the draws of its two phases, outside of rendering. Builds the
+/// depth pyramid from the frame's depth buffer, which then holds the depths of what the first phase found visible;
+/// then the second phase of the voxels' culling tests the quads that the first phase set aside against it. The
+/// particles' second phase is in particle_mesh.task, which tests against the pyramid as it draws. Leaves the depth
+/// buffer in `DEPTH_IMAGE_LAYOUT`, for the second phase's draws to continue in.
+///
+/// The pyramid that the first phase tested against was the previous frame's, which this overwrites; the frames in
+/// flight share it, being ordered by the queue. So objects that come into view are drawn in the same frame, by the
+/// second phase, while the depths of the first stay in front of everything that they hide.
+static void recordOcclusionCulling(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkExtent2D depth_buffer_extent,
+    u32 depth_pyramid_level_count,
+    const VoxelCullPipelinePushConstants* voxel_cull_push_constants, // the first phase's
+    VkCommandBuffer command_buffer
+) {
+
+    const VkPipelineStageFlags task_shader_stage =
+        mesh_shaders_supported_ ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT : 0;
+
+    const VkImageSubresourceRange depth_subresource_range {
+        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    {
+        // The pyramid was last read by the first phase's tests, and the set-aside quads were written by them; the
+        // visible quads were last read by the first phase's draw, and the second phase rewrites them.
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        const VkImageMemoryBarrier depth_image_barrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .oldLayout = DEPTH_IMAGE_LAYOUT,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            .srcQueueFamilyIndex = queue_family_,
+            .dstQueueFamilyIndex = queue_family_,
+            .image = p_frame_resources->depth_buffer,
+            .subresourceRange = depth_subresource_range,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | task_shader_stage, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &barrier, // pMemoryBarriers
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            1, // imageMemoryBarrierCount
+            &depth_image_barrier // pImageMemoryBarriers
+        );
+    }
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_pyramid_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_pyramid_pipeline_.pipeline);
+
+    // each level from the one below
+    for (u32 level = 0; level < depth_pyramid_level_count; level++)
+    {
+        if (level > 0) {
+            const VkMemoryBarrier barrier {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            };
+            vk_dev_procs.CmdPipelineBarrier(
+                command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &barrier, 0, NULL, 0, NULL
+            );
+        }
+
+        const DepthPyramidPipelinePushConstants push_constants { .level = level };
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, depth_pyramid_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(DepthPyramidPipelinePushConstants), &push_constants
+        );
+
+        const VkExtent2D level_extent = depthPyramidLevelExtent(depth_buffer_extent, level);
+        const u32 texel_count = level_extent.width * level_extent.height;
+        vk_dev_procs.CmdDispatch(
+            command_buffer, (texel_count + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, 1, 1
+        );
+    }
+
+    {
+        // The second phase's culling reads the pyramid, and its dispatch and draws were written by the first phase.
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | task_shader_stage, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    VoxelCullPipelinePushConstants second_phase_push_constants = *voxel_cull_push_constants;
+    second_phase_push_constants.phase = 1;
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, voxel_cull_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, voxel_cull_pipeline_.pipeline);
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, voxel_cull_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(VoxelCullPipelinePushConstants), &second_phase_push_constants
+    );
+    // a workgroup per `VOXEL_CULL_WORKGROUP_SIZE` set-aside quads, as counted by the first phase
+    vk_dev_procs.CmdDispatchIndirect(
+        command_buffer, p_frame_resources->voxel_draw_command_buffer, offsetof(VoxelCullCommands, occluded_dispatch)
+    );
+
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        };
+        const VkImageMemoryBarrier depth_image_barrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_NONE,
+            .dstAccessMask =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            .newLayout = DEPTH_IMAGE_LAYOUT,
+            .srcQueueFamilyIndex = queue_family_,
+            .dstQueueFamilyIndex = queue_family_,
+            .image = p_frame_resources->depth_buffer,
+            .subresourceRange = depth_subresource_range,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, // dstStageMask
+            0, // dependencyFlags
+            1, // memoryBarrierCount
+            &barrier, // pMemoryBarriers
+            0, // bufferMemoryBarrierCount
+            NULL, // pBufferMemoryBarriers
+            1, // imageMemoryBarrierCount
+            &depth_image_barrier // pImageMemoryBarriers
+        );
+    }
+}
+
+
+/// Records the dispatches that bin the particles into the screen tiles of `push_constants`, in the frame's
+/// `particle_tile_*_buffer`s, for particle.frag to read; see particle_tiles.comp.h. Outside of rendering.
+static void recordParticleTiling(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const ParticleTilesPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    const u32 tile_count = push_constants->tile_count_x * push_constants->tile_count_y;
+    assert(tile_count <= MAX_PARTICLE_TILE_COUNT);
+
+    // The frame's previous use of these buffers was waited for by `command_buffer_pending_fence`, and an earlier
+    // view's, by `recordExtraView()`.
+    vk_dev_procs.CmdFillBuffer(
+        command_buffer, p_frame_resources->particle_tile_counts_buffer, 0, tile_count * sizeof(uvec2), 0
+    );
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    // The stages' layouts are compatible, having the same descriptor set layout and push constant range, so the
+    // descriptor set and the push constants stay bound across them.
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_tiles_count_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, particle_tiles_count_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(ParticleTilesPipelinePushConstants), push_constants
+    );
+
+    const u32 particle_workgroup_count =
+        (push_constants->particle_count + PARTICLE_TILES_WORKGROUP_SIZE - 1) / PARTICLE_TILES_WORKGROUP_SIZE;
+
+    constexpr u32 stage_count = 4;
+    const PipelineAndLayout* const stage_pipelines[stage_count] {
+        &particle_tiles_count_pipeline_,
+        &particle_tiles_scan_pipeline_,
+        &particle_tiles_bin_pipeline_,
+        &particle_tiles_sort_pipeline_,
+    };
+    const u32 stage_workgroup_counts[stage_count][2] {
+        { particle_workgroup_count, 1 },
+        { 1, 1 },
+        { particle_workgroup_count, 1 },
+        { push_constants->tile_count_x, push_constants->tile_count_y }, // a workgroup per tile
+    };
+
+    for (u32 stage_idx = 0; stage_idx < stage_count; stage_idx++)
+    {
+        vk_dev_procs.CmdBindPipeline(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, stage_pipelines[stage_idx]->pipeline
+        );
+        vk_dev_procs.CmdDispatch(
+            command_buffer, stage_workgroup_counts[stage_idx][0], stage_workgroup_counts[stage_idx][1], 1
+        );
+
+        // the last stage is read by particle.vert and particle.frag
+        const bool last = stage_idx == stage_count - 1;
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = last ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            last
+                ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+                : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records a dispatch of `*p_pipeline` that appends to the frame's `particle_lod_instances_buffer`, and counts them
+/// in `particle_lod_draw_command_buffer`, for the particle LOD pipeline to draw: `recordParticleLod()`'s or
+/// `recordParticleSubsample()`'s. Outside of rendering.
+static void recordParticleInstances(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const PipelineAndLayout* p_pipeline,
+    u32 push_constants_size,
+    const void* push_constants,
+    u32 workgroup_count,
+    VkCommandBuffer command_buffer
+) {
+
+    // The frame's previous use of these buffers was waited for by `command_buffer_pending_fence`, and an earlier
+    // view's, by `recordExtraView()`.
+    const VkDrawIndirectCommand initial_draw_command {
+        .vertexCount = 4,
+        .instanceCount = 0,
+        .firstVertex = 0,
+        .firstInstance = 0,
+    };
+    vk_dev_procs.CmdUpdateBuffer(
+        command_buffer, p_frame_resources->particle_lod_draw_command_buffer, 0, sizeof(initial_draw_command),
+        &initial_draw_command
+    );
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_pipeline->layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_pipeline->pipeline);
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, p_pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constants_size, push_constants
+    );
+
+    vk_dev_procs.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records the dispatch that writes the frame's `particle_lod_instances_buffer` and
+/// `particle_lod_draw_command_buffer`, for the particle LOD pipeline to draw; see particle_lod.comp. Outside of
+/// rendering.
+static void recordParticleLod(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const ParticleLodPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+    const u32 workgroup_count =
+        (push_constants->particle_count + PARTICLE_LOD_WORKGROUP_SIZE - 1) / PARTICLE_LOD_WORKGROUP_SIZE;
+    recordParticleInstances(
+        p_frame_resources, &particle_lod_pipeline_, sizeof(*push_constants), push_constants, workgroup_count,
+        command_buffer
+    );
+}
+
+
+/// Records the dispatch that writes the subset of the particles that `setParticleSubsamplingBudget()` draws to the
+/// frame's `particle_lod_instances_buffer` and `particle_lod_draw_command_buffer`, in place of the particle LOD's;
+/// see particle_subsample.comp. Outside of rendering.
+static void recordParticleSubsample(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const ParticleSubsamplePipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+    const u32 workgroup_count =
+        (push_constants->particle_count + PARTICLE_SUBSAMPLE_WORKGROUP_SIZE - 1) / PARTICLE_SUBSAMPLE_WORKGROUP_SIZE;
+    recordParticleInstances(
+        p_frame_resources, &particle_subsample_pipeline_, sizeof(*push_constants), push_constants, workgroup_count,
+        command_buffer
+    );
+}
+
+
+/// Records the blend of the two states of `writeParticleInterpolationDescriptors()` into the particles, before anything
+/// reads them. The particle buffer is shared by the frames in flight, so this waits for every earlier use of it.
+static void recordParticleInterpolation(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const ParticleInterpolatePipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    // Only the earlier frames' reads of the particles need to be waited for; their vertex, mesh, fragment and
+    // compute shaders.
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, NULL, 0, NULL, 0, NULL
+    );
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_interpolate_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_interpolate_pipeline_.pipeline
+    );
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, particle_interpolate_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(ParticleInterpolatePipelinePushConstants), push_constants
+    );
+
+    const u32 workgroup_count = (push_constants->particle_count + PARTICLE_INTERPOLATE_WORKGROUP_SIZE - 1)
+        / PARTICLE_INTERPOLATE_WORKGROUP_SIZE;
+    vk_dev_procs.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+
+    {
+        // read as vertices, and from storage buffers by every kind of shader
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records the dispatch that writes the frame's `vector_field_segments_buffer` and `vector_field_draw_command_buffer`
+/// from the vectors of `writeVectorFieldDescriptors()`, for the line pipeline to draw; see vector_field.comp. After
+/// the particle interpolation, if any, and outside of rendering.
+static void recordVectorField(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const VectorFieldPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    // The frame's previous use of these buffers was waited for by `command_buffer_pending_fence`, and an earlier
+    // view's, by `recordExtraView()`.
+    const VkDrawIndirectCommand initial_draw_command {
+        .vertexCount = 6, // a quad of two triangles; see line.vert
+        .instanceCount = 0,
+        .firstVertex = 0,
+        .firstInstance = 0,
+    };
+    vk_dev_procs.CmdUpdateBuffer(
+        command_buffer, p_frame_resources->vector_field_draw_command_buffer, 0, sizeof(initial_draw_command),
+        &initial_draw_command
+    );
+    if (push_constants->cell_size_pixels > 0.f) {
+        vk_dev_procs.CmdFillBuffer(
+            command_buffer, p_frame_resources->vector_field_claims_buffer, 0,
+            push_constants->cell_counts.x * push_constants->cell_counts.y * sizeof(u32), 0
+        );
+    }
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vector_field_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vector_field_pipeline_.pipeline);
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, vector_field_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(VectorFieldPipelinePushConstants), push_constants
+    );
+
+    const u32 workgroup_count =
+        (push_constants->particle_count + VECTOR_FIELD_WORKGROUP_SIZE - 1) / VECTOR_FIELD_WORKGROUP_SIZE;
+    vk_dev_procs.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records the passes of the screen-space fluid surface that come before rendering, into the frame's
+/// `fluid_surface_images`, at `FLUID_SURFACE_DOWNSCALE` times less resolution, and at `render_scale` of that (in the
+/// top left of the images):
+///     1. depth: the particles' impostor quads (see `createParticleRasterizePipeline()`), with a depth test, write
+///        the distance to the nearest sphere per texel.
+///     2. thickness: the same quads, without one, add up the lengths of the ray inside the spheres per texel.
+///     3. smoothing: fluid_smooth.comp filters the distances, horizontally and then vertically.
+/// fluid_composite.frag then shades the surface during rendering. Only the quads cost per particle; the rest costs
+/// per texel, with a bounded kernel.
+static void recordFluidSurface(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkCommandBuffer command_buffer,
+    u32 particle_count,
+    VkBuffer particles_vertex_buffer,
+    VkExtent2D dst_image_extent,
+    VkRect2D dst_image_roi,
+    f32 render_scale,
+    const ParticleRasterizePipelinePushConstants* splat_push_constants,
+    f32 texels_per_unit // at distance 1, at `render_scale`; see `FluidSmoothPipelinePushConstants`
+) {
+
+    const VkExtent2D extent = getFluidSurfaceExtent(dst_image_extent);
+    // must match `FluidCompositePipelinePushConstants::texels_per_pixel`
+    const f32 texels_per_pixel = render_scale / (f32)FLUID_SURFACE_DOWNSCALE;
+
+    // the viewport and the scissor of the scene, scaled down
+    const VkViewport viewport {
+        .x = (f32)dst_image_roi.offset.x * texels_per_pixel,
+        .y = (f32)dst_image_roi.offset.y * texels_per_pixel,
+        .width = (f32)dst_image_roi.extent.width * texels_per_pixel,
+        .height = (f32)dst_image_roi.extent.height * texels_per_pixel,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+    const VkOffset2D scissor_offset { (i32)floorf(viewport.x), (i32)floorf(viewport.y) };
+    const i32 scissor_end_x = math::min((i32)ceilf(viewport.x + viewport.width), (i32)extent.width);
+    const i32 scissor_end_y = math::min((i32)ceilf(viewport.y + viewport.height), (i32)extent.height);
+    const VkRect2D scissor {
+        .offset = scissor_offset,
+        .extent = { (u32)(scissor_end_x - scissor_offset.x), (u32)(scissor_end_y - scissor_offset.y) },
+    };
+
+    for (u32 pass_idx = 0; pass_idx < 2; pass_idx++)
+    {
+        const bool thickness = pass_idx == 1;
+        const FluidSurfaceImage color_image = thickness ? FLUID_SURFACE_IMAGE_THICKNESS : FLUID_SURFACE_IMAGE_DEPTH;
+
+        VkRenderingAttachmentInfo rendering_color_attachment_info {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+            .imageView = p_frame_resources->fluid_surface_image_views[color_image],
+            .imageLayout = FLUID_SURFACE_IMAGE_INFOS[color_image].layout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .resolveImageView = NULL,
+            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            // no fluid
+            .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 0} } },
+        };
+        VkRenderingAttachmentInfo rendering_depth_attachment_info {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+            .imageView = p_frame_resources->fluid_surface_image_views[FLUID_SURFACE_IMAGE_DEPTH_BUFFER],
+            .imageLayout = FLUID_SURFACE_IMAGE_INFOS[FLUID_SURFACE_IMAGE_DEPTH_BUFFER].layout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .resolveImageView = NULL,
+            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
+        };
+        VkRenderingInfo rendering_info {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+            .renderArea = VkRect2D { .offset = {0, 0}, .extent = extent },
+            .layerCount = 1,
+            .viewMask = 0,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &rendering_color_attachment_info,
+            .pDepthAttachment = thickness ? NULL : &rendering_depth_attachment_info,
+        };
+        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+        vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &viewport);
+        vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &scissor);
+
+        PipelineAndLayout* p_pipeline = &pipelines_[
+            thickness ? PIPELINE_INDEX_FLUID_THICKNESS_PIPELINE : PIPELINE_INDEX_FLUID_DEPTH_PIPELINE
+        ];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(*splat_push_constants), splat_push_constants
+        );
+
+        VkDeviceSize offset_in_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(command_buffer, 0, 1, &particles_vertex_buffer, &offset_in_vertex_buf);
+
+        vk_dev_procs.CmdDraw(command_buffer, 4, particle_count, 0, 0);
+
+        vk_dev_procs.CmdEndRendering(command_buffer);
+    }
+    {
+        // the distances are smoothed in place, and the thickness is read by fluid_composite.frag
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, fluid_smooth_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, fluid_smooth_pipeline_.pipeline);
+
+    // only up to the end of the scissor, as the rest of the images isn't drawn at less than full scale
+    FluidSmoothPipelinePushConstants smooth_push_constants {
+        .image_width = (u32)scissor_end_x,
+        .image_height = (u32)scissor_end_y,
+        .particle_radius = splat_push_constants->particle_radius,
+        .texels_per_unit = texels_per_unit,
+    };
+    for (u32 vertical = 0; vertical < 2; vertical++)
+    {
+        smooth_push_constants.vertical = vertical;
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, fluid_smooth_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(smooth_push_constants), &smooth_push_constants
+        );
+        // a row of texels per workgroup row
+        const u32 workgroup_count_x =
+            (smooth_push_constants.image_width + FLUID_SMOOTH_WORKGROUP_SIZE - 1) / FLUID_SMOOTH_WORKGROUP_SIZE;
+        vk_dev_procs.CmdDispatch(command_buffer, workgroup_count_x, smooth_push_constants.image_height, 1);
+
+        // the vertical pass is read by fluid_composite.frag
+        const bool last = vertical == 1;
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = last ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            last ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// The instance count of the particle pipeline's draw: a quad per tile, at the tile's depth bound, or a single quad
+/// over the whole viewport; see particle.vert.
+static u32 getParticleQuadCount(const ParticlePipelineFragmentShaderPushConstants* push_constants) {
+    return (push_constants->tile_count_y != 0) ? push_constants->tile_count_x * push_constants->tile_count_y : 1;
+}
+
+
+/// Records the ray-marched particles into the frame's `scaled_particle_images`, at the render scale, before
+/// rendering: particle.frag, as it draws into the frame, but over `scaled_extent` from the top left of the images,
+/// with `push_constants` for a viewport of that size at the origin. particle_upscale.frag then upscales them into the
+/// frame during rendering; see `createParticleUpscalePipeline()`.
+static void recordScaledParticles(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkCommandBuffer command_buffer,
+    VkExtent2D scaled_extent,
+    const ParticlePipelineFragmentShaderPushConstants* push_constants
+) {
+
+    const VkRenderingAttachmentInfo rendering_color_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->scaled_particle_image_views[SCALED_PARTICLE_IMAGE_COLOR],
+        .imageLayout = SCALED_PARTICLE_IMAGE_INFOS[SCALED_PARTICLE_IMAGE_COLOR].layout,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        // no particle
+        .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 0} } },
+    };
+    const VkRenderingAttachmentInfo rendering_depth_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->scaled_particle_image_views[SCALED_PARTICLE_IMAGE_DEPTH],
+        .imageLayout = SCALED_PARTICLE_IMAGE_INFOS[SCALED_PARTICLE_IMAGE_DEPTH].layout,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
+    };
+    const VkRenderingInfo rendering_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = VkRect2D { .offset = {0, 0}, .extent = scaled_extent },
+        .layerCount = 1,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &rendering_color_attachment_info,
+        .pDepthAttachment = &rendering_depth_attachment_info,
+    };
+    vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+    const VkViewport viewport {
+        .x = 0,
+        .y = 0,
+        .width = push_constants->viewport_size_in_window.x,
+        .height = push_constants->viewport_size_in_window.y,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+    const VkRect2D scissor { .offset = {0, 0}, .extent = scaled_extent };
+    vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &viewport);
+    vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_PIPELINE];
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+        sizeof(*push_constants), push_constants
+    );
+
+    vk_dev_procs.CmdDraw(command_buffer, 6, getParticleQuadCount(push_constants), 0, 0);
+
+    vk_dev_procs.CmdEndRendering(command_buffer);
+
+    // read by particle_upscale.frag
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    };
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+}
+
+
+/// Returns the planes of the frustum that `world_to_screen_transform` maps to the Vulkan clip volume, as
+/// (normal, distance) with unit normals pointing inward.
+static void getFrustumPlanes(const mat4* world_to_screen_transform, vec4* p_planes_out) {
+
+    const mat4 m = glm::transpose(*world_to_screen_transform); // so that m[i] is row i
+    const vec4 planes[6] {
+        m[3] + m[0], // left
+        m[3] - m[0], // right
+        m[3] + m[1], // top or bottom
+        m[3] - m[1],
+        m[2],        // near; 0 <= z
+        m[3] - m[2], // far
+    };
+
+    for (u32 i = 0; i < 6; i++) {
+        const f32 normal_length = glm::length(vec3(planes[i]));
+        // a far plane at infinity, which culls nothing
+        if (normal_length < 1e-20f) p_planes_out[i] = vec4(0.f, 0.f, 0.f, 1.f);
+        else p_planes_out[i] = planes[i] / normal_length;
+    }
+}
+
+
+/// Records the dispatches that extract the surface mesh of the particles, for the draw of
+/// `PARTICLE_RENDER_MODE_SURFACE_MESH`: into the `push_constants->copy` of the table and of the vertices in
+/// `surface_mesh_buffers`, reusing the triangles of the blocks that didn't change since the other copy was built;
+/// see surface_mesh.comp.h. Outside of rendering.
+static void recordSurfaceMesh(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const VkBuffer* surface_mesh_buffers, // [SURFACE_MESH_BUFFER_COUNT]
+    const SurfaceMeshPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    // The buffers are shared by the frames in flight, so the previous frame's build and draw must be done with
+    // them; and its build's writes are this one's previous copy.
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask =
+                VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+                | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    constexpr VkDeviceSize table_size = SURFACE_MESH_BLOCK_TABLE_SIZE * SURFACE_MESH_BLOCK_SLOT_SIZE;
+    vk_dev_procs.CmdFillBuffer(
+        command_buffer, surface_mesh_buffers[SURFACE_MESH_BUFFER_BLOCK_SLOTS], push_constants->copy * table_size,
+        table_size, 0
+    );
+    vk_dev_procs.CmdFillBuffer(
+        command_buffer, surface_mesh_buffers[SURFACE_MESH_BUFFER_STATE], 0, sizeof(SurfaceMeshState), 0
+    );
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    // The stages' layouts are compatible, having the same descriptor set layout and push constant range, so the
+    // descriptor set and the push constants stay bound across them.
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, surface_mesh_mark_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, surface_mesh_mark_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(SurfaceMeshPipelinePushConstants), push_constants
+    );
+
+    const u32 particle_workgroup_count =
+        (push_constants->particle_count + SURFACE_MESH_MARK_WORKGROUP_SIZE - 1) / SURFACE_MESH_MARK_WORKGROUP_SIZE;
+
+    constexpr u32 stage_count = 5;
+    const PipelineAndLayout* const stage_pipelines[stage_count] {
+        &surface_mesh_mark_pipeline_,
+        &surface_mesh_prepare_pipeline_,
+        &surface_mesh_classify_pipeline_,
+        &surface_mesh_scan_pipeline_,
+        &surface_mesh_emit_pipeline_,
+    };
+    // 0: a workgroup per block, as counted by mark and written by prepare
+    const u32 stage_workgroup_counts[stage_count] { particle_workgroup_count, 1, 0, 1, 0 };
+
+    for (u32 stage_idx = 0; stage_idx < stage_count; stage_idx++)
+    {
+        vk_dev_procs.CmdBindPipeline(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, stage_pipelines[stage_idx]->pipeline
+        );
+        if (stage_workgroup_counts[stage_idx] > 0) {
+            vk_dev_procs.CmdDispatch(command_buffer, stage_workgroup_counts[stage_idx], 1, 1);
+        }
+        else {
+            vk_dev_procs.CmdDispatchIndirect(
+                command_buffer, surface_mesh_buffers[SURFACE_MESH_BUFFER_STATE],
+                offsetof(SurfaceMeshState, block_dispatch)
+            );
+        }
+
+        // the last stage is read by the draw; the others by the next stages, and their indirect dispatches
+        const bool last = stage_idx == stage_count - 1;
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = last
+                ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+                : VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            last
+                ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+                : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records the splat of the occupied cells' particle counts into `density_volume_buffer`, for the ray march of
+/// `PARTICLE_RENDER_MODE_DENSITY_VOLUME`; see density_volume_splat.comp. Like the particle LOD, it walks the sim's
+/// cell list, so it costs per particle only to find where the cells start. Outside of rendering.
+static void recordDensityVolume(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkBuffer density_volume_buffer,
+    const DensityVolumePipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+
+    // The buffer is shared by the frames in flight, so the previous frame's splat and ray march must be done with it.
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_TRANSFER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdFillBuffer(command_buffer, density_volume_buffer, 0, DENSITY_VOLUME_BUFFER_SIZE, 0);
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, density_volume_splat_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, density_volume_splat_pipeline_.pipeline
+    );
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, density_volume_splat_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(*push_constants), push_constants
+    );
+    const u32 workgroup_count = (push_constants->particle_count + DENSITY_VOLUME_SPLAT_WORKGROUP_SIZE - 1)
+        / DENSITY_VOLUME_SPLAT_WORKGROUP_SIZE;
+    vk_dev_procs.CmdDispatch(command_buffer, workgroup_count, 1, 1);
+
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+/// Records the gather of the particles into `PARTICLE_DEPTH_SORT_BUFFER_SORTED_PARTICLES`, farthest from the camera
+/// first, for the draw of `PARTICLE_RENDER_MODE_TRANSLUCENT`; if `resort`, after sorting them again by their
+/// distance from `push_constants->camera_position`, otherwise in the previous sort's order, which must then be of
+/// as many particles. The sort is `gpu_primitives::recordRadixSort()`, over 24-bit keys.
+/// Outside of rendering.
+static void recordParticleDepthSort(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const RenderResourcesImpl* p_render_resources,
+    const ParticleDepthSortPipelinePushConstants* push_constants,
+    bool resort,
+    VkCommandBuffer command_buffer
+) {
+
+    // The buffers are shared by the frames in flight, so the previous frame's sort and draw must be done with them.
+    {
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+    const VkMemoryBarrier compute_barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    const u32 particle_count = push_constants->particle_count;
+    const u32 particle_workgroup_count =
+        (particle_count + PARTICLE_DEPTH_SORT_WORKGROUP_SIZE - 1) / PARTICLE_DEPTH_SORT_WORKGROUP_SIZE;
+
+    if (resort) {
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_depth_sort_keys_pipeline_.layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_depth_sort_keys_pipeline_.pipeline
+        );
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, particle_depth_sort_keys_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(ParticleDepthSortPipelinePushConstants), push_constants
+        );
+        vk_dev_procs.CmdDispatch(command_buffer, particle_workgroup_count, 1, 1);
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &compute_barrier, 0, NULL, 0, NULL
+        );
+
+        // the first pass writes the indices that the others carry along
+        const u32 result_pair = gpu_primitives::recordRadixSort(
+            gpu_primitives_, &vk_ctx_, command_buffer, p_render_resources->particle_depth_sort_plan,
+            particle_count, PARTICLE_DEPTH_SORT_PASS_COUNT, true
+        );
+        assert(result_pair == 1);
+        (void)result_pair;
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &compute_barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    // Gathered every frame, even with the previous order, since the particles have moved since.
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_depth_sort_gather_pipeline_.layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+    vk_dev_procs.CmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_depth_sort_gather_pipeline_.pipeline
+    );
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, particle_depth_sort_gather_pipeline_.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(ParticleDepthSortPipelinePushConstants), push_constants
+    );
+    vk_dev_procs.CmdDispatch(command_buffer, particle_workgroup_count, 1, 1);
+
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+    };
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+}
+
+
+/// Records the draw of the voxel quads that a phase of occlusion culling found visible; see voxel_cull.comp. Within
+/// rendering; of the frame's `object_id_image` if `visibility`, which the quads then write their ids into.
+static void recordVoxelDraw(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    u32 phase,
+    bool visibility,
+    VkCommandBuffer command_buffer
+) {
+    PipelineAndLayout* p_pipeline =
+        &pipelines_[visibility ? PIPELINE_INDEX_VISIBILITY_VOXEL_PIPELINE : PIPELINE_INDEX_VOXEL_PIPELINE];
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+    VkDeviceSize offset_in_voxels_vertex_buf = 0;
+    vk_dev_procs.CmdBindVertexBuffers(
+        command_buffer, 0, 1, &p_frame_resources->visible_voxels_buffer, &offset_in_voxels_vertex_buf
+    );
+
+    // the instance count was written by the phase's culling
+    vk_dev_procs.CmdDrawIndirect(
+        command_buffer, p_frame_resources->voxel_draw_command_buffer,
+        offsetof(VoxelCullCommands, draw_commands) + phase * sizeof(VkDrawIndirectCommand), 1,
+        sizeof(VkDrawIndirectCommand)
+    );
+}
+
+/// Records the draw of the mesh-shaded particles for `push_constants->phase` of occlusion culling; see
+/// particle_mesh.task. Within rendering.
+static void recordParticleMeshDraw(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const ParticleMeshPipelinePushConstants* push_constants,
+    VkCommandBuffer command_buffer
+) {
+    PipelineAndLayout* p_pipeline = &particle_mesh_pipeline_;
+
+    vk_dev_procs.CmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+        0, // firstSet
+        1, // descriptorSetCount
+        &p_frame_resources->descriptor_set,
+        0, // dynamicOffsetCount
+        NULL // pDynamicOffsets
+    );
+
+    vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+    vk_dev_procs.CmdPushConstants(
+        command_buffer, p_pipeline->layout,
+        VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+        sizeof(*push_constants), push_constants
+    );
+
+    if (push_constants->phase == 0) {
+        // a task workgroup per `PARTICLE_CLUSTERS_PER_TASK` clusters, which launches a mesh workgroup per
+        // visible cluster
+        constexpr u32 particles_per_task = PARTICLE_CLUSTER_SIZE * PARTICLE_CLUSTERS_PER_TASK;
+        const u32 task_workgroup_count = (push_constants->particle_count + particles_per_task - 1) / particles_per_task;
+        cmdDrawMeshTasksEXT_(command_buffer, task_workgroup_count, 1, 1);
+    }
+    else {
+        // likewise, over the clusters that the first phase set aside
+        cmdDrawMeshTasksIndirectEXT_(
+            command_buffer, p_frame_resources->particle_occlusion_buffer, offsetof(ParticleOcclusion, occluded_draw),
+            1, sizeof(VkDrawMeshTasksIndirectCommandEXT)
+        );
+    }
+}
+
+
+/// Records the visibility buffer's pass, before the frame's rendering, once the first phase of occlusion culling is
+/// recorded: the voxel quads, and the rasterized particles if `particles`, are drawn as their ids (see
+/// `VISIBILITY_VOXEL_BIT`) into the frame's `object_id_image`, and into the depth buffer, both cleared; then the rest
+/// of occlusion culling, if `depth_pyramid_level_count > 0`, and the second phase's quads. The rendering then loads
+/// the depth buffer, and visibility_shade.frag shades each pixel once from its id, rather than each fragment that
+/// passed the depth test. Times the voxels, the occlusion culling, and the particles if `particles`, in place of the
+/// rendering.
+static void recordVisibilityBuffer(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkExtent2D dst_image_extent,
+    VkRect2D dst_image_roi,
+    const VoxelCullPipelinePushConstants* voxel_cull_push_constants, // the first phase's
+    u32 depth_pyramid_level_count, // 0 to skip the rest of occlusion culling
+    bool particles,
+    u32 particle_count,
+    VkBuffer particles_vertex_buffer,
+    const ParticleRasterizePipelinePushConstants* particle_rasterize_pipeline_push_constants,
+    VkQueryPool timestamp_query_pool,
+    VkCommandBuffer command_buffer
+) {
+    TracyVkZone(vk_ctx_.tracy_vk_ctx, command_buffer, "visibility buffer");
+
+    // The object id image was last used by an earlier submission of this frame, which `command_buffer_pending_fence`
+    // waited for, and the depth buffer is cleared as the rendering would.
+    VkRenderingAttachmentInfo rendering_color_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->object_id_image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .color = VkClearColorValue { .uint32 = {0, 0, 0, 0} } }, // no object
+    };
+    VkRenderingAttachmentInfo rendering_depth_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->depth_buffer_view,
+        .imageLayout = DEPTH_IMAGE_LAYOUT,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
+    };
+    VkRenderingInfo rendering_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = VkRect2D { .offset = {0, 0}, .extent = dst_image_extent },
+        .layerCount = 1,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &rendering_color_attachment_info,
+        .pDepthAttachment = &rendering_depth_attachment_info,
+    };
+    vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+    const VkViewport viewport {
+        .x = (f32)dst_image_roi.offset.x,
+        .y = (f32)dst_image_roi.offset.y,
+        .width = (f32)dst_image_roi.extent.width,
+        .height = (f32)dst_image_roi.extent.height,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+    vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &viewport);
+    vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &dst_image_roi);
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXELS, false);
+    recordVoxelDraw(p_frame_resources, 0, true, command_buffer);
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXELS, true);
+
+    if (particles) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, false);
+    }
+    if (particles && particle_count > 0) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_ID_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(*particle_rasterize_pipeline_push_constants), particle_rasterize_pipeline_push_constants
+        );
+
+        VkDeviceSize offset_in_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(command_buffer, 0, 1, &particles_vertex_buffer, &offset_in_vertex_buf);
+
+        // the same spheres as the rasterized particles, as their index plus 1; see object_id_particle.frag
+        vk_dev_procs.CmdDraw(command_buffer, 4, particle_count, 0, 0);
+    }
+    if (particles) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, true);
+    }
+
+    // as in `recordCommandBuffer()`, but the second phase's quads are drawn after the first's, see voxel_cull.comp,
+    // so that both stay in the visible voxels for the shading
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_OCCLUSION_CULLING, false);
+    if (depth_pyramid_level_count > 0) {
+        vk_dev_procs.CmdEndRendering(command_buffer);
+
+        recordOcclusionCulling(
+            p_frame_resources, dst_image_extent, depth_pyramid_level_count, voxel_cull_push_constants,
+            command_buffer
+        );
+
+        rendering_color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        rendering_depth_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+        recordVoxelDraw(p_frame_resources, 1, true, command_buffer);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_OCCLUSION_CULLING, true);
+
+    vk_dev_procs.CmdEndRendering(command_buffer);
+
+    {
+        // The shading reads the ids, and the visible voxels that the culling wrote; the rendering tests against,
+        // and draws over, the depths.
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask =
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+static bool recordCommandBuffer(
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    u32 outlined_voxel_count,
+    VkBuffer outlined_voxels_buffer, // see `RenderResourcesImpl::outlined_voxels_buffer`
+    u32 particle_count,
+    VkBuffer particles_vertex_buffer,
+    VkExtent2D dst_image_extent,
+    VkRect2D dst_image_roi,
+    VkImageView dst_image_view,
+    VkImageLayout dst_image_layout,
+    const VoxelCullPipelinePushConstants* voxel_cull_push_constants, // the first phase's
+    u32 depth_pyramid_level_count, // 0 to skip the rest of occlusion culling
+    const GridPipelineFragmentShaderPushConstants* grid_pipeline_push_constants,
+    const ParticlePipelineFragmentShaderPushConstants* particle_pipeline_push_constants,
+    const ParticleRasterizePipelinePushConstants* particle_rasterize_pipeline_push_constants,
+    const ParticleMeshPipelinePushConstants* particle_mesh_pipeline_push_constants,
+    const FluidCompositePipelinePushConstants* fluid_composite_pipeline_push_constants,
+    f32 fluid_surface_texels_per_unit,
+    const VkBuffer* surface_mesh_buffers, // [SURFACE_MESH_BUFFER_COUNT]
+    const SurfaceMeshPipelinePushConstants* surface_mesh_pipeline_push_constants,
+    VkBuffer density_volume_buffer,
+    const DensityVolumePipelinePushConstants* density_volume_pipeline_push_constants,
+    // [PARTICLE_DEPTH_SORT_BUFFER_COUNT], whose sorted particles `recordParticleDepthSort()` wrote for the main view
+    const VkBuffer* particle_depth_sort_buffers,
+    ParticleRenderMode particle_render_mode,
+    // whether `recordParticleLod()` or `recordParticleSubsample()` was recorded, for `PARTICLE_RENDER_MODE_RASTERIZED`
+    bool particle_lod,
+    bool vector_field, // whether `recordVectorField()` was recorded
+    // whether the voxels, and the rasterized particles without LOD, go through `recordVisibilityBuffer()`; not for an
+    // extra view
+    bool visibility_buffer,
+    // One of `requestExtraViews()`'s, see `recordExtraView()`: draws over the frame rather than clearing it, isn't
+    // timed, and draws the surface mesh and the density volume that the main view built.
+    bool extra_view,
+    f32 render_scale,
+    // NULL to ray march the fancy particles into the frame directly, rather than with `recordScaledParticles()`,
+    // whose viewport `particle_pipeline_push_constants` is then for
+    const ParticleUpscalePipelinePushConstants* particle_upscale_pipeline_push_constants,
+    ImDrawData* imgui_draw_data
+) {
+    ZoneScoped;
+
+    const bool fancy_particle_rendering =
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED ||
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED_TILED;
+    const bool mesh_shaded_particle_rendering = particle_render_mode == PARTICLE_RENDER_MODE_MESH_SHADED;
+    const bool fluid_surface_rendering = particle_render_mode == PARTICLE_RENDER_MODE_FLUID_SURFACE;
+    const bool surface_mesh_rendering = particle_render_mode == PARTICLE_RENDER_MODE_SURFACE_MESH;
+    const bool translucent_particle_rendering = particle_render_mode == PARTICLE_RENDER_MODE_TRANSLUCENT;
+    const bool density_volume_rendering = particle_render_mode == PARTICLE_RENDER_MODE_DENSITY_VOLUME;
+    const bool visibility_buffer_particles =
+        visibility_buffer && particle_render_mode == PARTICLE_RENDER_MODE_RASTERIZED && !particle_lod;
+    assert(!(visibility_buffer && extra_view));
+
+    if (fancy_particle_rendering) assert(particle_pipeline_push_constants != NULL);
+    else if (mesh_shaded_particle_rendering) {
+        assert(particle_mesh_pipeline_push_constants != NULL);
+        assert(mesh_shaders_supported_);
+    }
+    else if (fluid_surface_rendering) {
+        // the splatting uses the rasterized particles' push constants
+        assert(particle_rasterize_pipeline_push_constants != NULL);
+        assert(fluid_composite_pipeline_push_constants != NULL);
+    }
+    else if (surface_mesh_rendering) {
+        // surface_mesh.frag reads the camera position from the rasterized particles' push constants
+        assert(particle_rasterize_pipeline_push_constants != NULL);
+        assert(surface_mesh_pipeline_push_constants != NULL);
+    }
+    else if (translucent_particle_rendering) {
+        assert(particle_rasterize_pipeline_push_constants != NULL);
+        assert(particle_depth_sort_buffers != NULL);
+    }
+    else if (density_volume_rendering) assert(density_volume_pipeline_push_constants != NULL);
+    else assert(particle_rasterize_pipeline_push_constants != NULL);
+
+    VkCommandBuffer command_buffer = p_frame_resources->command_buffer;
+
+    // Every pass writes both of its timestamps, even if it's skipped, so that they all read as available. `render()`
+    // has reset the query pool. A query may only be written once, so they're the main view's.
+    const VkQueryPool timestamp_query_pool = extra_view ? VK_NULL_HANDLE : p_frame_resources->timestamp_query_pool;
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_FLUID_SURFACE, false);
+    if (fluid_surface_rendering && particle_count > 0) {
+        recordFluidSurface(
+            p_frame_resources, command_buffer, particle_count, particles_vertex_buffer, dst_image_extent,
+            dst_image_roi, render_scale, particle_rasterize_pipeline_push_constants, fluid_surface_texels_per_unit
+        );
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_FLUID_SURFACE, true);
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_SCALED_PARTICLES, false);
+    if (fancy_particle_rendering && particle_upscale_pipeline_push_constants != NULL && particle_count > 0) {
+        const VkExtent2D scaled_extent {
+            particle_upscale_pipeline_push_constants->scaled_extent.x,
+            particle_upscale_pipeline_push_constants->scaled_extent.y,
+        };
+        recordScaledParticles(p_frame_resources, command_buffer, scaled_extent, particle_pipeline_push_constants);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_SCALED_PARTICLES, true);
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_SURFACE_MESH, false);
+    if (surface_mesh_rendering && particle_count > 0 && !extra_view) {
+        recordSurfaceMesh(
+            p_frame_resources, surface_mesh_buffers, surface_mesh_pipeline_push_constants, command_buffer
+        );
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_SURFACE_MESH, true);
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_DENSITY_VOLUME, false);
+    if (density_volume_rendering && particle_count > 0 && !extra_view) {
+        recordDensityVolume(
+            p_frame_resources, density_volume_buffer, density_volume_pipeline_push_constants, command_buffer
+        );
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_DENSITY_VOLUME, true);
+
+    if (visibility_buffer) {
+        recordVisibilityBuffer(
+            p_frame_resources, dst_image_extent, dst_image_roi, voxel_cull_push_constants, depth_pyramid_level_count,
+            visibility_buffer_particles, particle_count, particles_vertex_buffer,
+            particle_rasterize_pipeline_push_constants, timestamp_query_pool, command_buffer
+        );
+    }
+
+    // The rendering is split in two by occlusion culling, whose second phase continues where the first left off.
+    VkRenderingAttachmentInfo rendering_color_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = dst_image_view,
+        .imageLayout = dst_image_layout,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = extra_view ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 1} } },
+    };
+    VkRenderingAttachmentInfo rendering_depth_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->depth_buffer_view,
+        .imageLayout = DEPTH_IMAGE_LAYOUT,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        // the visibility buffer's depths
+        .loadOp = visibility_buffer ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
+    };
+    VkRenderingInfo rendering_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = VkRect2D { .offset = {0, 0}, .extent = dst_image_extent },
+        .layerCount = 1,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &rendering_color_attachment_info,
+        .pDepthAttachment = &rendering_depth_attachment_info,
+    };
+    vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+    const VkViewport viewport {
+        .x = (f32)dst_image_roi.offset.x,
+        .y = (f32)dst_image_roi.offset.y,
+        .width = (f32)dst_image_roi.extent.width,
+        .height = (f32)dst_image_roi.extent.height,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+    vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &viewport);
+    vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &dst_image_roi);
+
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VISIBILITY_SHADING, false);
+    if (visibility_buffer) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_VISIBILITY_SHADE_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(*fluid_composite_pipeline_push_constants), fluid_composite_pipeline_push_constants
+        );
+
+        // what `recordVisibilityBuffer()` left in the frame's object id image, over the whole viewport
+        vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VISIBILITY_SHADING, true);
+
+    // the visibility buffer's voxels are timed by `recordVisibilityBuffer()`
+    if (!visibility_buffer) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXELS, false);
+        recordVoxelDraw(p_frame_resources, 0, false, command_buffer);
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXELS, true);
+    }
+
+    // The translucent particles are blended over everything that's opaque, so they're drawn last, and timed there;
+    // likewise, the visibility buffer's particles in `recordVisibilityBuffer()`.
+    const bool particles_timed_here = !translucent_particle_rendering && !visibility_buffer_particles;
+    if (particles_timed_here) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, false);
+    }
+    if (particle_count > 0 && particles_timed_here) {
+        if (fancy_particle_rendering && particle_upscale_pipeline_push_constants != NULL) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_UPSCALE_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*particle_upscale_pipeline_push_constants), particle_upscale_pipeline_push_constants
+            );
+
+            // the particles that `recordScaledParticles()` left in the frame's images, over the whole viewport
+            vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+        }
+        else if (fancy_particle_rendering) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*particle_pipeline_push_constants), particle_pipeline_push_constants
+            );
+
+            vk_dev_procs.CmdDraw(command_buffer, 6, getParticleQuadCount(particle_pipeline_push_constants), 0, 0);
+        }
+        else if (mesh_shaded_particle_rendering) {
+            recordParticleMeshDraw(p_frame_resources, particle_mesh_pipeline_push_constants, command_buffer);
+        }
+        else if (fluid_surface_rendering) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_FLUID_COMPOSITE_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*fluid_composite_pipeline_push_constants), fluid_composite_pipeline_push_constants
+            );
+
+            // the surface that `recordFluidSurface()` left in the frame's images, over the whole viewport
+            vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+        }
+        else if (surface_mesh_rendering) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_SURFACE_MESH_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*particle_rasterize_pipeline_push_constants), particle_rasterize_pipeline_push_constants
+            );
+
+            // the copy of the vertices that `recordSurfaceMesh()` just wrote
+            VkDeviceSize offset_in_vertex_buf =
+                surface_mesh_pipeline_push_constants->copy * SURFACE_MESH_VERTEX_CAPACITY * sizeof(vec4);
+            vk_dev_procs.CmdBindVertexBuffers(
+                command_buffer, 0, 1, &surface_mesh_buffers[SURFACE_MESH_BUFFER_VERTICES], &offset_in_vertex_buf
+            );
+
+            // the vertex count was written by `recordSurfaceMesh()`
+            vk_dev_procs.CmdDrawIndirect(
+                command_buffer, surface_mesh_buffers[SURFACE_MESH_BUFFER_STATE],
+                offsetof(SurfaceMeshState, draw_command), 1, sizeof(VkDrawIndirectCommand)
+            );
+        }
+        else if (density_volume_rendering) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_DENSITY_VOLUME_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*density_volume_pipeline_push_constants), density_volume_pipeline_push_constants
+            );
+
+            // the volume that `recordDensityVolume()` splatted, ray marched over the whole viewport
+            vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+        }
+        else if (particle_lod) {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_LOD_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*particle_rasterize_pipeline_push_constants), particle_rasterize_pipeline_push_constants
+            );
+
+            VkDeviceSize offset_in_vertex_buf = 0;
+            vk_dev_procs.CmdBindVertexBuffers(
+                command_buffer, 0, 1, &p_frame_resources->particle_lod_instances_buffer, &offset_in_vertex_buf
+            );
+
+            // the instance count was written by `recordParticleLod()`
+            vk_dev_procs.CmdDrawIndirect(
+                command_buffer, p_frame_resources->particle_lod_draw_command_buffer, 0, 1,
+                sizeof(VkDrawIndirectCommand)
+            );
+        }
+        else {
+            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_RASTERIZE_PIPELINE];
+
+            vk_dev_procs.CmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+                0, // firstSet
+                1, // descriptorSetCount
+                &p_frame_resources->descriptor_set,
+                0, // dynamicOffsetCount
+                NULL // pDynamicOffsets
+            );
+
+            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+            vk_dev_procs.CmdPushConstants(
+                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(*particle_rasterize_pipeline_push_constants), particle_rasterize_pipeline_push_constants
+            );
+
+            VkDeviceSize offset_in_vertex_buf = 0;
+            vk_dev_procs.CmdBindVertexBuffers(
+                command_buffer, 0, 1, &particles_vertex_buffer, &offset_in_vertex_buf
+            );
+
+            // a camera-facing quad per particle, which particle_rasterize.frag ray casts the sphere in
+            vk_dev_procs.CmdDraw(command_buffer, 4, particle_count, 0, 0);
+        }
+    }
+    if (particles_timed_here) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, true);
+    }
+
+    // Only the voxels and the mesh-shaded particles are occlusion culled; the other particles are drawn in the first
+    // phase, and their depths count towards the pyramid. With the visibility buffer, `recordVisibilityBuffer()` has
+    // built the pyramid already, from this frame's voxels, so the mesh-shaded particles' first phase was tested
+    // against it, and the clusters that it set aside are hidden; there's no second phase.
+    if (!visibility_buffer) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_OCCLUSION_CULLING, false);
+    }
+    if (depth_pyramid_level_count > 0 && !visibility_buffer) {
+        vk_dev_procs.CmdEndRendering(command_buffer);
+
+        recordOcclusionCulling(
+            p_frame_resources, dst_image_extent, depth_pyramid_level_count, voxel_cull_push_constants,
+            command_buffer
+        );
+
+        rendering_color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        rendering_depth_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+        recordVoxelDraw(p_frame_resources, 1, false, command_buffer);
+        if (mesh_shaded_particle_rendering && particle_count > 0) {
+            ParticleMeshPipelinePushConstants second_phase_push_constants = *particle_mesh_pipeline_push_constants;
+            second_phase_push_constants.phase = 1;
+            recordParticleMeshDraw(p_frame_resources, &second_phase_push_constants, command_buffer);
+        }
+    }
+    if (!visibility_buffer) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_OCCLUSION_CULLING, true);
+    }
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXEL_OUTLINES, false);
+    {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_CUBE_OUTLINE_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        VkDeviceSize offset_in_outlined_voxel_coords_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(
+            command_buffer, 0, 1, &outlined_voxels_buffer, &offset_in_outlined_voxel_coords_buf
+        );
+
+        vk_dev_procs.CmdDraw(command_buffer, 72, outlined_voxel_count, 0, 0);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_VOXEL_OUTLINES, true);
+
+    if (translucent_particle_rendering) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, false);
+    }
+    if (translucent_particle_rendering && particle_count > 0) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_TRANSLUCENT_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        const ParticleTranslucentPipelinePushConstants push_constants {
+            .camera_position = particle_rasterize_pipeline_push_constants->camera_position,
+            .particle_radius = particle_rasterize_pipeline_push_constants->particle_radius,
+            .opacity = translucent_particle_settings_.opacity,
+        };
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(push_constants), &push_constants
+        );
+
+        // the particles in the order that `recordParticleDepthSort()` gathered them, farthest first, and without
+        // depth writes, so that each is blended over those behind it
+        VkDeviceSize offset_in_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(
+            command_buffer, 0, 1, &particle_depth_sort_buffers[PARTICLE_DEPTH_SORT_BUFFER_SORTED_PARTICLES],
+            &offset_in_vertex_buf
+        );
+
+        vk_dev_procs.CmdDraw(command_buffer, 4, particle_count, 0, 0);
+    }
+    if (translucent_particle_rendering) {
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLES, true);
+    }
+
+    if (vector_field) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_LINE_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        VkDeviceSize offset_in_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(
+            command_buffer, 0, 1, &p_frame_resources->vector_field_segments_buffer, &offset_in_vertex_buf
+        );
+
+        // the instance count was written by `recordVectorField()`
+        vk_dev_procs.CmdDrawIndirect(
+            command_buffer, p_frame_resources->vector_field_draw_command_buffer, 0, 1,
+            sizeof(VkDrawIndirectCommand)
+        );
+    }
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_GRID, false);
+    if (grid_enabled_) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_GRID_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(*grid_pipeline_push_constants), grid_pipeline_push_constants
+        );
+
+        vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_GRID, true);
+
+
+    vk_dev_procs.CmdEndRendering(command_buffer);
+
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_IMGUI, false);
+    if (imgui_draw_data != NULL) {
+
+        VkRenderingAttachmentInfo rendering_color_attachment_info {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+            .imageView = dst_image_view,
+            .imageLayout = dst_image_layout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .resolveImageView = NULL,
+            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 1} } },
+        };
+        VkRenderingInfo rendering_info {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+            .renderArea = VkRect2D { .offset = {0, 0}, .extent = dst_image_extent },
+            .layerCount = 1,
+            .viewMask = 0,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &rendering_color_attachment_info,
+            .pDepthAttachment = NULL,
+        };
+        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+        {
+            ZoneScopedN("ImGui_ImplVulkan_RenderDrawData");
+            ImGui_ImplVulkan_RenderDrawData(imgui_draw_data, command_buffer);
+        }
+        vk_dev_procs.CmdEndRendering(command_buffer);
+    }
+    recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_IMGUI, true);
+
+
+    return true;
+}
+
+
+/// Records a pick of `rect`, in pixels of the swapchain image, which must be within `viewport`; see `requestPick()`.
+/// After `recordCommandBuffer()`, which leaves the depth buffer free: the whole voxel mesh, and the particles as
+/// rasterized spheres, whatever the render mode, are drawn again over `rect` into the frame's `object_id_image`, with
+/// the depth buffer cleared; then object_id_resolve.comp collects the distinct ids in it into the frame's
+/// `pick_results_buffer`, for `readPickResults()` once the frame has finished. The voxels are drawn whole, rather than
+/// as culled, as the culling of this frame was for its view and not for picking, and a pick is rare.
+static void recordPick(
+    const RenderResourcesImpl* p_render_resources,
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    VkRect2D rect,
+    VkRect2D viewport,
+    const ObjectIdVoxelPipelinePushConstants* voxel_push_constants,
+    const ParticleRasterizePipelinePushConstants* particle_push_constants,
+    u32 particle_count,
+    VkBuffer particles_vertex_buffer,
+    VkCommandBuffer command_buffer
+) {
+    TracyVkZone(vk_ctx_.tracy_vk_ctx, command_buffer, "pick");
+
+    {
+        // The depth buffer was last written by the frame's rendering; the object id image was last read, and the
+        // pick buffers last written, by the resolve of an earlier submission of this frame, or the image by the
+        // rendering's visibility shading; the voxel mesh was last written by `recordVoxelMeshEdits()`, for compute.
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    vk_dev_procs.CmdFillBuffer(command_buffer, p_frame_resources->pick_id_set_buffer, 0, VK_WHOLE_SIZE, 0);
+    vk_dev_procs.CmdFillBuffer(
+        command_buffer, p_frame_resources->pick_results_buffer, 0, sizeof(PickResultsHeader), 0
+    );
+
+    VkRenderingAttachmentInfo rendering_color_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->object_id_image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = VkClearValue { .color = VkClearColorValue { .uint32 = {0, 0, 0, 0} } }, // no object
+    };
+    // the frame's depth is lost; nothing reads it after `recordCommandBuffer()`
+    VkRenderingAttachmentInfo rendering_depth_attachment_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = p_frame_resources->depth_buffer_view,
+        .imageLayout = DEPTH_IMAGE_LAYOUT,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = NULL,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
+    };
+    VkRenderingInfo rendering_info {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = rect,
+        .layerCount = 1,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &rendering_color_attachment_info,
+        .pDepthAttachment = &rendering_depth_attachment_info,
+    };
+    vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
+
+    const VkViewport vk_viewport {
+        .x = (f32)viewport.offset.x,
+        .y = (f32)viewport.offset.y,
+        .width = (f32)viewport.extent.width,
+        .height = (f32)viewport.extent.height,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+    vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &vk_viewport);
+    vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &rect);
+
+    const u32 voxel_quad_slot_count = getVoxelMeshQuadSlotCount(p_render_resources->voxel_mesh);
+    if (voxel_quad_slot_count > 0) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_VOXEL_ID_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT,
+            0, sizeof(ObjectIdVoxelPipelinePushConstants), voxel_push_constants
+        );
+
+        VkDeviceSize offset_in_voxels_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(
+            command_buffer, 0, 1, &p_render_resources->voxel_mesh_buffer, &offset_in_voxels_vertex_buf
+        );
+        // the empty slots are zeroed quads, of size 0, which don't rasterize
+        vk_dev_procs.CmdDraw(command_buffer, 6, voxel_quad_slot_count, 0, 0);
+    }
+
+    if (particle_count > 0) {
+        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_ID_PIPELINE];
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0, sizeof(ParticleRasterizePipelinePushConstants), particle_push_constants
+        );
+
+        VkDeviceSize offset_in_particles_vertex_buf = 0;
+        vk_dev_procs.CmdBindVertexBuffers(
+            command_buffer, 0, 1, &particles_vertex_buffer, &offset_in_particles_vertex_buf
+        );
+        vk_dev_procs.CmdDraw(command_buffer, 4, particle_count, 0, 0);
+    }
+
+    vk_dev_procs.CmdEndRendering(command_buffer);
+
+    {
+        // the ids, and the clears of the set and the results
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    {
+        PipelineAndLayout* p_pipeline = &object_id_resolve_pipeline_;
+
+        vk_dev_procs.CmdBindDescriptorSets(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_pipeline->layout,
+            0, // firstSet
+            1, // descriptorSetCount
+            &p_frame_resources->descriptor_set,
+            0, // dynamicOffsetCount
+            NULL // pDynamicOffsets
+        );
+        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_pipeline->pipeline);
+
+        const ObjectIdResolvePipelinePushConstants push_constants {
+            .rect_offset = ivec2(rect.offset.x, rect.offset.y),
+            .rect_extent = uvec2(rect.extent.width, rect.extent.height),
+            .capacity = MAX_PICKED_OBJECT_COUNT,
+            .set_size = PICK_ID_SET_SIZE,
+            .particle_ids = p_frame_resources->pick_particle_ids,
+        };
+        vk_dev_procs.CmdPushConstants(
+            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants
+        );
+
+        // a row of the rectangle per row of workgroups
+        const u32 workgroup_count_x =
+            (rect.extent.width + OBJECT_ID_RESOLVE_WORKGROUP_SIZE - 1) / OBJECT_ID_RESOLVE_WORKGROUP_SIZE;
+        vk_dev_procs.CmdDispatch(command_buffer, workgroup_count_x, rect.extent.height, 1);
+    }
+
+    {
+        // read on the host once the frame's fence has signalled
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_HOST_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+    }
+}
+
+
+static void imguiVkResultCheckCallback(VkResult result) {
+
+    if (result == VK_SUCCESS) return;
+
+    // TODO what if it's a recoverable result, similarly to VK_SUBOPTIMAL_KHR?
+    ABORT_F("Imgui encountered VkResult %i.", result);
+}
+
+
+static PFN_vkVoidFunction imguiLoadVkProcCallback(const char* proc_name, void* user_data) {
+    (void)user_data;
+
+    assert(initialized_);
+
+    // NOTE I assume here, without a strong reason, that ImGui will only attempt to get procedures that can be
+    // obtained via vkGetDeviceProcAddr.
+    return vk_base_procs.GetInstanceProcAddr(instance_, proc_name);
+}
+
+
+extern bool initImGuiVulkanBackend(void) {
+
+    alwaysAssert(initialized_);
+
+    bool success = ImGui_ImplVulkan_LoadFunctions(imguiLoadVkProcCallback, NULL);
+    alwaysAssert(success);
+
+    // This descriptor pool initialization was pretty much copied from imgui's `example_glfw_vulkan`
+    // TODO do we actually need this?
+    VkDescriptorPoolSize descriptor_pool_size {
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = 1,
+    };
+    VkDescriptorPoolCreateInfo descriptor_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptor_pool_size,
+    };
+
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    VkResult result = vk_dev_procs.CreateDescriptorPool(
+        device_, &descriptor_pool_info, NULL, &descriptor_pool
+    );
+    assertVk(result);
+
+    ImGui_ImplVulkan_InitInfo imgui_vk_init_info {
+        .Instance = instance_,
+        .PhysicalDevice = physical_device_,
+        .Device = device_,
+        .QueueFamily = queue_family_,
+        .Queue = queue_,
+        .PipelineCache = pipeline_cache_,
+        .DescriptorPool = descriptor_pool,
+        // Imgui asserts >= 2. Pretty sure the actual number doesn't matter, because
+        // Imgui doesn't even use this, as long as we don't use its swapchain creation helpers.
+        .MinImageCount = 2,
+        // ImGui cycles through this many vertex buffers, one per frame, so it must be at least the frames in flight
+        // of any renderer
+        .ImageCount = MAX_FRAMES_IN_FLIGHT,
+        .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+        .UseDynamicRendering = true,
+        .ColorAttachmentFormat = SWAPCHAIN_FORMAT,
+        .CheckVkResultFn = imguiVkResultCheckCallback,
+    };
+    bool imgui_result = ImGui_ImplVulkan_Init(&imgui_vk_init_info, VK_NULL_HANDLE);
+    return imgui_result;
+}
+
+
+/// `out` must have room for the prefix, 2 characters per UUID byte, and the null terminator.
+static void getPipelineCacheFilepath(char* out, size_t out_size) {
+
+    int char_count = snprintf(out, out_size, "%s", PIPELINE_CACHE_FILEPATH_PREFIX);
+    alwaysAssert(char_count > 0);
+    size_t offset = (size_t)char_count;
+
+    for (u32fast byte_idx = 0; byte_idx < VK_UUID_SIZE; byte_idx++) {
+        alwaysAssert(offset < out_size);
+        char_count = snprintf(
+            out + offset, out_size - offset, "%02x", physical_device_properties_.pipelineCacheUUID[byte_idx]
+        );
+        alwaysAssert(char_count == 2);
+        offset += 2;
+    }
+}
+
+/// Starts from the cache file written by a previous `savePipelineCache()`, if there is one and it was written
+/// for this device and driver. Otherwise starts empty.
+static VkPipelineCache createPipelineCache(void) {
+
+    ZoneScoped;
+
+    char filepath[256];
+    getPipelineCacheFilepath(filepath, sizeof(filepath));
+
+    size_t cache_data_size = 0;
+    void* cache_data = NULL;
+    if (access(filepath, R_OK) == 0) cache_data = file_util::readEntireFile(filepath, &cache_data_size);
+    defer(free(cache_data));
+
+    if (cache_data != NULL) {
+        // The driver is supposed to reject incompatible data itself, but not every driver does.
+        VkPipelineCacheHeaderVersionOne header {};
+        bool compatible = cache_data_size >= sizeof(header);
+        if (compatible) {
+            memcpy(&header, cache_data, sizeof(header));
+            compatible =
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE and
+                header.vendorID == physical_device_properties_.vendorID and
+                header.deviceID == physical_device_properties_.deviceID and
+                memcmp(
+                    header.pipelineCacheUUID, physical_device_properties_.pipelineCacheUUID, VK_UUID_SIZE
+                ) == 0;
+        }
+        if (!compatible) {
+            LOG_F(WARNING, "Ignoring pipeline cache `%s`: it was written for a different device.", filepath);
+            cache_data_size = 0;
+        }
+        else LOG_F(INFO, "Loaded pipeline cache `%s` (%zu bytes).", filepath, cache_data_size);
+    }
+
+    const VkPipelineCacheCreateInfo pipeline_cache_info {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = cache_data_size,
+        .pInitialData = cache_data_size > 0 ? cache_data : NULL,
+    };
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+    VkResult result = vk_dev_procs.CreatePipelineCache(device_, &pipeline_cache_info, NULL, &pipeline_cache);
+    assertVk(result);
+
+    return pipeline_cache;
+}
+
+
+#ifdef TRACY_ENABLE
+/// Tracy needs a separate context per queue.
+static tracy::VkCtx* createTracyVkCtx(u32 queue_family, VkQueue queue) {
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    VkCommandPool tracy_command_pool = VK_NULL_HANDLE;
+    {
+        VkCommandPoolCreateInfo command_pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = queue_family,
+        };
+        result = vk_dev_procs.CreateCommandPool(device_, &command_pool_info, NULL, &tracy_command_pool);
+        assertVk(result);
+    }
+
+    VkCommandBuffer tracy_command_buffer = NULL;
+    {
+        VkCommandBufferAllocateInfo cmd_buf_alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = tracy_command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result = vk_dev_procs.AllocateCommandBuffers(device_, &cmd_buf_alloc_info, &tracy_command_buffer);
+        assertVk(result);
+    }
+
+    // TODO FIXME Use TracyVkContextCalibrated? (See Tracy manual for additonal required parameters)
+    tracy::VkCtx* tracy_vk_ctx = TracyVkContext(
+        instance_, physical_device_, device_, queue, tracy_command_buffer,
+        vk_base_procs.GetInstanceProcAddr, vk_inst_procs.GetDeviceProcAddr
+    );
+    alwaysAssert(tracy_vk_ctx != NULL);
+
+    return tracy_vk_ctx;
+}
+#endif
+
+
+/// A `thread_pool` task that creates `pipelines_[pipeline_idx]`, and `shader_modules_[pipeline_idx]`, from the
+/// SPIR-V files of `PIPELINE_BUILD_FROM_SPIRV_FILES_INFOS[pipeline_idx]`. `p_arg` is the `u32` `pipeline_idx`.
+static void createPipelineFromSpirvFilesTask(void* p_arg) {
+
+    ZoneScoped;
+
+    const u32 pipeline_idx = *(const u32*)p_arg;
+    const PipelineBuildFromSpirvFilesInfo* p_build_info = &PIPELINE_BUILD_FROM_SPIRV_FILES_INFOS[pipeline_idx];
+
+    GraphicsPipelineShaderModules* p_shader_modules = &shader_modules_[pipeline_idx];
+    p_shader_modules->vertex_shader_module =
+        createShaderModuleFromSpirvFile(device_, p_build_info->vertex_shader_spirv_filepath);
+    p_shader_modules->fragment_shader_module =
+        createShaderModuleFromSpirvFile(device_, p_build_info->fragment_shader_spirv_filepath);
+
+    PipelineAndLayout* p_pipeline = &pipelines_[pipeline_idx];
+    bool success = p_build_info->pfn_createPipeline(
+        device_,
+        p_shader_modules->vertex_shader_module, p_shader_modules->fragment_shader_module,
+        descriptor_set_layout_,
+        &p_pipeline->pipeline, &p_pipeline->layout
+    );
+    alwaysAssert(success);
+}
+
+/// A `thread_pool` task that creates a compute pipeline. `p_arg` is its `const ComputePipelineBuildInfo*`.
+static void createComputePipelineTask(void* p_arg) {
+
+    ZoneScoped;
+
+    const ComputePipelineBuildInfo* p_info = (const ComputePipelineBuildInfo*)p_arg;
+
+    VkShaderModule shader_module = createShaderModuleFromSpirvFile(device_, p_info->spirv_filepath);
+    defer(vk_dev_procs.DestroyShaderModule(device_, shader_module, NULL));
+
+    createComputePipeline(
+        device_, shader_module, descriptor_set_layout_, p_info->workgroup_size, p_info->push_constants_size,
+        &p_info->p_pipeline->pipeline, &p_info->p_pipeline->layout
+    );
+}
+
+/// A `thread_pool` task that creates `particle_mesh_pipeline_`. `p_arg` is unused.
+static void createParticleMeshPipelineTask(void* p_arg) {
+
+    ZoneScoped;
+    (void)p_arg;
+
+    VkShaderModule task_shader_module = createShaderModuleFromSpirvFile(device_, PARTICLE_MESH_TASK_SPIRV_FILEPATH);
+    defer(vk_dev_procs.DestroyShaderModule(device_, task_shader_module, NULL));
+    VkShaderModule mesh_shader_module = createShaderModuleFromSpirvFile(device_, PARTICLE_MESH_MESH_SPIRV_FILEPATH);
+    defer(vk_dev_procs.DestroyShaderModule(device_, mesh_shader_module, NULL));
+    VkShaderModule fragment_shader_module =
+        createShaderModuleFromSpirvFile(device_, PARTICLE_MESH_FRAGMENT_SPIRV_FILEPATH);
+    defer(vk_dev_procs.DestroyShaderModule(device_, fragment_shader_module, NULL));
+
+    bool success = createParticleMeshPipeline(
+        device_, task_shader_module, mesh_shader_module, fragment_shader_module, descriptor_set_layout_,
+        &particle_mesh_pipeline_.pipeline, &particle_mesh_pipeline_.layout
+    );
+    alwaysAssert(success);
+}
+
+
+extern void init(
+    const char* app_name,
+    const char* specific_named_device_request,
+    bool request_async_compute_queue,
+    thread_pool::ThreadPool* thread_pool
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(thread_pool != NULL);
+    thread_pool_ = thread_pool;
+
+    // TODO remaining work:
+    // Set up validation layer debug logging thing, to log their messages as loguru messages. This way they
+    // will be logged if we're logging to a file.
+
+    initGraphicsUptoQueueCreation(app_name, specific_named_device_request, request_async_compute_queue);
+
+
+    VmaVulkanFunctions vma_vulkan_functions {
+        .vkGetInstanceProcAddr = vk_base_procs.GetInstanceProcAddr,
+        .vkGetDeviceProcAddr = vk_inst_procs.GetDeviceProcAddr,
+    };
+
+    VmaAllocatorCreateInfo vma_allocator_info {
+        .physicalDevice = physical_device_,
+        .device = device_,
+        .pVulkanFunctions = &vma_vulkan_functions,
+        .instance = instance_,
+        .vulkanApiVersion = VULKAN_API_VERSION,
+    };
+    VkResult result = vmaCreateAllocator(&vma_allocator_info, &vma_allocator_);
+    assertVk(result);
+
+
+    pipeline_cache_ = createPipelineCache();
+
+
+    // the stages that may only be named if their feature is enabled
+    const VkShaderStageFlags mesh_shader_stages =
+        mesh_shaders_supported_ ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+
+    {
+        const VkSamplerCreateInfo sampler_info {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = VK_FALSE,
+            .maxAnisotropy = 1.0f,
+            .compareEnable = VK_FALSE,
+            .compareOp = VK_COMPARE_OP_ALWAYS,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+            .unnormalizedCoordinates = VK_FALSE,
+        };
+        result = vk_dev_procs.CreateSampler(device_, &sampler_info, NULL, &fluid_surface_sampler_);
+        assertVk(result);
+    }
+
+    constexpr u32 descriptor_set_layout_binding_count =
+        4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + FLUID_SURFACE_BINDING_COUNT
+        + SURFACE_MESH_BINDING_COUNT + PARTICLE_LOD_BINDING_COUNT + OCCLUSION_BINDING_COUNT + 1
+        + SCALED_PARTICLE_BINDING_COUNT + OBJECT_ID_BINDING_COUNT + PARTICLE_INTERPOLATION_BINDING_COUNT
+        + VECTOR_FIELD_BINDING_COUNT + PARTICLE_DEPTH_SORT_BINDING_COUNT + 1;
+    // the density volume's binding is the last, after the depth sort's and the vector field's; those before are
+    // counted back from there
+    constexpr u32 vector_field_binding_idx =
+        descriptor_set_layout_binding_count - 1 - PARTICLE_DEPTH_SORT_BINDING_COUNT - VECTOR_FIELD_BINDING_COUNT;
+    VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[descriptor_set_layout_binding_count] {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags =
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
+                | mesh_shader_stages,
+            .pImmutableSamplers = NULL,
+        },
+        // particles
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | mesh_shader_stages,
+            .pImmutableSamplers = NULL,
+        },
+        // visible voxels; visibility_shade.frag reads them back
+        {
+            .binding = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        },
+        // voxel draw command
+        {
+            .binding = 4,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        },
+    };
+    // the particle grid; see `writeParticleGridDescriptors()`. Read by particle.frag, and by the surface mesh.
+    for (u32 i = 0; i < PARTICLE_GRID_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[4 + i] = VkDescriptorSetLayoutBinding {
+            .binding = PARTICLE_GRID_BINDINGS[i],
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // the particle tiles; see `recordParticleTiling()`. particle.vert reads the depth bounds and the ranges.
+    for (u32 i = 0; i < PARTICLE_TILES_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[4 + PARTICLE_GRID_BINDING_COUNT + i] = VkDescriptorSetLayoutBinding {
+            .binding = PARTICLE_TILES_FIRST_BINDING + i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // the fluid surface; see `writeFluidSurfaceDescriptors()`
+    for (u32 i = 0; i < FLUID_SURFACE_BINDING_COUNT; i++)
+    {
+        // the first two are smoothed in place, the others are read by fluid_composite.frag
+        const bool storage = i < 2;
+        descriptor_set_layout_bindings[4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + i] =
+            VkDescriptorSetLayoutBinding {
+                .binding = FLUID_SURFACE_FIRST_BINDING + i,
+                .descriptorType =
+                    storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = 1,
+                .stageFlags = storage ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_FRAGMENT_BIT,
+                .pImmutableSamplers = storage ? NULL : &fluid_surface_sampler_,
+            };
+    }
+    // the surface mesh; see `recordSurfaceMesh()`
+    for (u32 i = 0; i < SURFACE_MESH_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[
+            4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + FLUID_SURFACE_BINDING_COUNT + i
+        ] = VkDescriptorSetLayoutBinding {
+            .binding = SURFACE_MESH_FIRST_BINDING + i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // the particle LOD; see `recordParticleLod()`
+    for (u32 i = 0; i < PARTICLE_LOD_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[
+            4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + FLUID_SURFACE_BINDING_COUNT
+            + SURFACE_MESH_BINDING_COUNT + i
+        ] = VkDescriptorSetLayoutBinding {
+            .binding = PARTICLE_LOD_FIRST_BINDING + i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // occlusion culling; see `recordOcclusionCulling()`
+    for (u32 i = 0; i < OCCLUSION_BINDING_COUNT; i++)
+    {
+        // the first is the depth buffer, which only depth_pyramid.comp samples; particle_mesh.task tests against
+        // the pyramid
+        const bool depth_buffer = i == 0;
+        descriptor_set_layout_bindings[
+            4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + FLUID_SURFACE_BINDING_COUNT
+            + SURFACE_MESH_BINDING_COUNT + PARTICLE_LOD_BINDING_COUNT + i
+        ] = VkDescriptorSetLayoutBinding {
+            .binding = OCCLUSION_FIRST_BINDING + i,
+            .descriptorType =
+                depth_buffer ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = depth_buffer ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_COMPUTE_BIT | mesh_shader_stages,
+            .pImmutableSamplers = depth_buffer ? &fluid_surface_sampler_ : NULL,
+        };
+    }
+    // the voxel mesh, which voxel_cull.comp culls
+    descriptor_set_layout_bindings[
+        vector_field_binding_idx - PARTICLE_INTERPOLATION_BINDING_COUNT - OBJECT_ID_BINDING_COUNT
+        - SCALED_PARTICLE_BINDING_COUNT - 1
+    ] = VkDescriptorSetLayoutBinding {
+        .binding = VOXEL_MESH_BINDING,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = NULL,
+    };
+    // the scaled particles; see `writeScaledParticleDescriptors()`
+    for (u32 i = 0; i < SCALED_PARTICLE_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[
+            vector_field_binding_idx - PARTICLE_INTERPOLATION_BINDING_COUNT - OBJECT_ID_BINDING_COUNT
+            - SCALED_PARTICLE_BINDING_COUNT + i
+        ] = VkDescriptorSetLayoutBinding {
+            .binding = SCALED_PARTICLE_FIRST_BINDING + i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = &fluid_surface_sampler_,
+        };
+    }
+    // picking; see `recordPick()`
+    for (u32 i = 0; i < OBJECT_ID_BINDING_COUNT; i++)
+    {
+        // the first is the object id image, which visibility_shade.frag also reads; the others are buffers
+        const bool image = i == 0;
+        descriptor_set_layout_bindings[
+            vector_field_binding_idx - PARTICLE_INTERPOLATION_BINDING_COUNT - OBJECT_ID_BINDING_COUNT + i
+        ] = VkDescriptorSetLayoutBinding {
+            .binding = OBJECT_ID_FIRST_BINDING + i,
+            .descriptorType = image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | (image ? VK_SHADER_STAGE_FRAGMENT_BIT : 0u),
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // the particle interpolation; see `recordParticleInterpolation()`
+    for (u32 i = 0; i < PARTICLE_INTERPOLATION_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[vector_field_binding_idx - PARTICLE_INTERPOLATION_BINDING_COUNT + i] =
+            VkDescriptorSetLayoutBinding {
+                .binding = PARTICLE_INTERPOLATION_FIRST_BINDING + i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = NULL,
+            };
+    }
+    // the debug vector field; see `recordVectorField()`
+    for (u32 i = 0; i < VECTOR_FIELD_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[vector_field_binding_idx + i] = VkDescriptorSetLayoutBinding {
+            .binding = VECTOR_FIELD_FIRST_BINDING + i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    // the translucent particles' depth sort; see `recordParticleDepthSort()`
+    for (u32 i = 0; i < PARTICLE_DEPTH_SORT_BINDING_COUNT; i++)
+    {
+        descriptor_set_layout_bindings[vector_field_binding_idx + VECTOR_FIELD_BINDING_COUNT + i] =
+            VkDescriptorSetLayoutBinding {
+                .binding = PARTICLE_DEPTH_SORT_FIRST_BINDING + i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = NULL,
+            };
+    }
+    // the density volume; see `recordDensityVolume()`
+    descriptor_set_layout_bindings[descriptor_set_layout_binding_count - 1] = VkDescriptorSetLayoutBinding {
+        .binding = DENSITY_VOLUME_BINDING,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = NULL,
+    };
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = descriptor_set_layout_binding_count,
+        .pBindings = descriptor_set_layout_bindings,
+    };
+    result = vk_dev_procs.CreateDescriptorSetLayout(
+        device_, &descriptor_set_layout_info, NULL, &descriptor_set_layout_
+    );
+    assertVk(result);
+
+
+    {
+        ZoneScopedN("pipeline init");
+
+        // Pipeline creation is thread-safe, and the pipeline cache is internally synchronized, so each pipeline is
+        // created by a task of its own; they write to their own slots of the pipeline arrays.
+        thread_pool::TaskGroup pipeline_tasks {};
+
+        u32 pipeline_indices[PIPELINE_INDEX_COUNT];
+        for (u32 pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+            pipeline_indices[pipeline_idx] = pipeline_idx;
+        }
+        thread_pool::enqueueTasks(
+            thread_pool_, &pipeline_tasks, PIPELINE_INDEX_COUNT, createPipelineFromSpirvFilesTask,
+            pipeline_indices, sizeof(pipeline_indices[0])
+        );
+
+        constexpr u32 compute_pipeline_count = 19;
+        const ComputePipelineBuildInfo compute_pipeline_infos[compute_pipeline_count] {
+            {
+                VOXEL_CULL_SPIRV_FILEPATH, VOXEL_CULL_WORKGROUP_SIZE,
+                sizeof(VoxelCullPipelinePushConstants), &voxel_cull_pipeline_
+            },
+            {
+                PARTICLE_TILES_COUNT_SPIRV_FILEPATH, PARTICLE_TILES_WORKGROUP_SIZE,
+                sizeof(ParticleTilesPipelinePushConstants), &particle_tiles_count_pipeline_
+            },
+            {
+                PARTICLE_TILES_SCAN_SPIRV_FILEPATH, PARTICLE_TILES_SCAN_WORKGROUP_SIZE,
+                sizeof(ParticleTilesPipelinePushConstants), &particle_tiles_scan_pipeline_
+            },
+            {
+                PARTICLE_TILES_BIN_SPIRV_FILEPATH, PARTICLE_TILES_WORKGROUP_SIZE,
+                sizeof(ParticleTilesPipelinePushConstants), &particle_tiles_bin_pipeline_
+            },
+            {
+                PARTICLE_TILES_SORT_SPIRV_FILEPATH, PARTICLE_TILES_SORT_WORKGROUP_SIZE,
+                sizeof(ParticleTilesPipelinePushConstants), &particle_tiles_sort_pipeline_
+            },
+            {
+                FLUID_SMOOTH_SPIRV_FILEPATH, FLUID_SMOOTH_WORKGROUP_SIZE,
+                sizeof(FluidSmoothPipelinePushConstants), &fluid_smooth_pipeline_
+            },
+            {
+                SURFACE_MESH_MARK_SPIRV_FILEPATH, SURFACE_MESH_MARK_WORKGROUP_SIZE,
+                sizeof(SurfaceMeshPipelinePushConstants), &surface_mesh_mark_pipeline_
+            },
+            {
+                SURFACE_MESH_PREPARE_SPIRV_FILEPATH, SURFACE_MESH_PREPARE_WORKGROUP_SIZE,
+                sizeof(SurfaceMeshPipelinePushConstants), &surface_mesh_prepare_pipeline_
+            },
+            {
+                SURFACE_MESH_CLASSIFY_SPIRV_FILEPATH, SURFACE_MESH_BLOCK_WORKGROUP_SIZE,
+                sizeof(SurfaceMeshPipelinePushConstants), &surface_mesh_classify_pipeline_
+            },
+            {
+                SURFACE_MESH_SCAN_SPIRV_FILEPATH, SURFACE_MESH_SCAN_WORKGROUP_SIZE,
+                sizeof(SurfaceMeshPipelinePushConstants), &surface_mesh_scan_pipeline_
+            },
+            {
+                SURFACE_MESH_EMIT_SPIRV_FILEPATH, SURFACE_MESH_BLOCK_WORKGROUP_SIZE,
+                sizeof(SurfaceMeshPipelinePushConstants), &surface_mesh_emit_pipeline_
+            },
+            {
+                PARTICLE_LOD_SPIRV_FILEPATH, PARTICLE_LOD_WORKGROUP_SIZE,
+                sizeof(ParticleLodPipelinePushConstants), &particle_lod_pipeline_
+            },
+            {
+                PARTICLE_SUBSAMPLE_SPIRV_FILEPATH, PARTICLE_SUBSAMPLE_WORKGROUP_SIZE,
+                sizeof(ParticleSubsamplePipelinePushConstants), &particle_subsample_pipeline_
+            },
+            {
+                DEPTH_PYRAMID_SPIRV_FILEPATH, DEPTH_PYRAMID_WORKGROUP_SIZE,
+                sizeof(DepthPyramidPipelinePushConstants), &depth_pyramid_pipeline_
+            },
+            {
+                OBJECT_ID_RESOLVE_SPIRV_FILEPATH, OBJECT_ID_RESOLVE_WORKGROUP_SIZE,
+                sizeof(ObjectIdResolvePipelinePushConstants), &object_id_resolve_pipeline_
+            },
+            {
+                PARTICLE_INTERPOLATE_SPIRV_FILEPATH, PARTICLE_INTERPOLATE_WORKGROUP_SIZE,
+                sizeof(ParticleInterpolatePipelinePushConstants), &particle_interpolate_pipeline_
+            },
+            {
+                VECTOR_FIELD_SPIRV_FILEPATH, VECTOR_FIELD_WORKGROUP_SIZE,
+                sizeof(VectorFieldPipelinePushConstants), &vector_field_pipeline_
+            },
+            {
+                PARTICLE_DEPTH_SORT_KEYS_SPIRV_FILEPATH, PARTICLE_DEPTH_SORT_WORKGROUP_SIZE,
+                sizeof(ParticleDepthSortPipelinePushConstants), &particle_depth_sort_keys_pipeline_
+            },
+            {
+                PARTICLE_DEPTH_SORT_GATHER_SPIRV_FILEPATH, PARTICLE_DEPTH_SORT_WORKGROUP_SIZE,
+                sizeof(ParticleDepthSortPipelinePushConstants), &particle_depth_sort_gather_pipeline_
+            },
+            {
+                DENSITY_VOLUME_SPLAT_SPIRV_FILEPATH, DENSITY_VOLUME_SPLAT_WORKGROUP_SIZE,
+                sizeof(DensityVolumePipelinePushConstants), &density_volume_splat_pipeline_
+            },
+        };
+        thread_pool::enqueueTasks(
+            thread_pool_, &pipeline_tasks, compute_pipeline_count, createComputePipelineTask,
+            (void*)compute_pipeline_infos, sizeof(compute_pipeline_infos[0])
+        );
+
+        if (mesh_shaders_supported_) {
+            thread_pool::enqueueTask(thread_pool_, &pipeline_tasks, createParticleMeshPipelineTask, NULL);
+        }
+
+        // The infos and indices that the tasks read are on this stack frame.
+        thread_pool::waitForGroup(thread_pool_, &pipeline_tasks);
+
+        for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+            LOG_F(
+                INFO, "Created pipeline index %" PRIuFAST32 ", handle %p.",
+                pipeline_idx, pipelines_[pipeline_idx].pipeline
+            );
+        }
+    }
+
+
+    {
+        ZoneScopedN("libshaderc init");
+        bool success = libshaderc_procs_.init();
+        // TODO FIXME we should just log an error message, disable the hot-reloading feature, and continue
+        // running. This isn't fatal, after all.
+        alwaysAssert(success);
+
+        libshaderc_compiler_ = libshaderc_procs_.compiler_initialize();
+        alwaysAssert(libshaderc_compiler_ != NULL);
+    }
+
+
+    tracy::VkCtx* tracy_vk_ctx = NULL;
+    tracy::VkCtx* compute_tracy_vk_ctx = NULL;
+    #ifdef TRACY_ENABLE
+    {
+        tracy_vk_ctx = createTracyVkCtx(queue_family_, queue_);
+        compute_tracy_vk_ctx = (compute_queue_ == queue_)
+            ? tracy_vk_ctx
+            : createTracyVkCtx(compute_queue_family_, compute_queue_);
+    }
+    #endif
+
+
+    // TODO FIXME: use this to store all these things, instead of just copying them over into it
+    vk_ctx_ = VulkanContext {
+        .procs_base = vk_base_procs,
+        .procs_inst = vk_inst_procs,
+        .procs_dev = vk_dev_procs,
+
+        .vma_allocator = vma_allocator_,
+
+        .device = device_,
+        .queue_family_index = queue_family_,
+        .queue = queue_,
+        .compute_queue_family_index = compute_queue_family_,
+        .compute_queue = compute_queue_,
+        .transfer_queue_family_index = transfer_queue_family_,
+        .transfer_queue = transfer_queue_,
+
+        .physical_device_properties = physical_device_properties_,
+        .physical_device_subgroup_properties = physical_device_subgroup_properties_,
+
+        .pipeline_cache = pipeline_cache_,
+
+        .tracy_vk_ctx = tracy_vk_ctx,
+        .compute_tracy_vk_ctx = compute_tracy_vk_ctx,
+
+        .cmd_push_descriptor_set = cmdPushDescriptorSetKHR_,
+    };
+
+    gpu_primitives_ = gpu_primitives::createContext(&vk_ctx_);
+
+    initialized_ = true;
+}
+
+
+extern Result createOffscreenSurfaceResources(
+    VkExtent2D extent,
+    u32 image_count,
+    SurfaceResources* surface_resources_out
+) {
+    ZoneScoped;
+
+    alwaysAssert(image_count > 0);
+    if (extent.width == 0 or extent.height == 0) return Result::error_window_size_zero;
+
+    SurfaceResourcesImpl* p_resources = (SurfaceResourcesImpl*)calloc(1, sizeof(SurfaceResourcesImpl));
+    assertErrno(p_resources != NULL);
+
+    p_resources->offscreen = true;
+    p_resources->swapchain_extent = extent;
+    p_resources->swapchain_image_count = image_count;
+    // so that the first `render()` draws into image 0
+    p_resources->last_rendered_offscreen_image_idx = image_count - 1;
+
+    p_resources->swapchain_images = mallocArray(image_count, VkImage);
+    p_resources->swapchain_image_views = mallocArray(image_count, VkImageView);
+    p_resources->offscreen_image_allocations = mallocArray(image_count, VmaAllocation);
+
+    for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
+
+        const VkImageCreateInfo image_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = SWAPCHAIN_FORMAT,
+            .extent = VkExtent3D { extent.width, extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        const VmaAllocationCreateInfo image_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo image_allocation_info {};
+        VkResult result = vmaCreateImage(
+            vma_allocator_, &image_info, &image_alloc_info,
+            &p_resources->swapchain_images[im_idx],
+            &p_resources->offscreen_image_allocations[im_idx],
+            &image_allocation_info
+        );
+        assertVk(result);
+        memory_usage_.offscreen_image_bytes += image_allocation_info.size;
+        TracyAllocN(p_resources->swapchain_images[im_idx], image_allocation_info.size, "gfx offscreen images");
+
+        const VkImageViewCreateInfo image_view_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = p_resources->swapchain_images[im_idx],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = SWAPCHAIN_FORMAT,
+            .components = VkComponentMapping {
+                .r = VK_COMPONENT_SWIZZLE_R,
+                .g = VK_COMPONENT_SWIZZLE_G,
+                .b = VK_COMPONENT_SWIZZLE_B,
+                .a = VK_COMPONENT_SWIZZLE_A,
+            },
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = vk_dev_procs.CreateImageView(
+            device_, &image_view_info, NULL, &p_resources->swapchain_image_views[im_idx]
+        );
+        assertVk(result);
+    }
+
+    LOG_F(
+        INFO, "Created %" PRIu32 " offscreen images of %" PRIu32 "x%" PRIu32 ".",
+        image_count, extent.width, extent.height
+    );
+
+    surface_resources_out->impl = p_resources;
+    return Result::success;
+}
+
+extern VkImage getLastRenderedOffscreenImage(SurfaceResources surface_resources) {
+    const SurfaceResourcesImpl* p_surface_resources = (const SurfaceResourcesImpl*)surface_resources.impl;
+    alwaysAssert(p_surface_resources->offscreen);
+    return p_surface_resources->swapchain_images[p_surface_resources->last_rendered_offscreen_image_idx];
+}
+
+
+extern PresentModeFlags getSupportedPresentModes(SurfaceResources surface_resources) {
+    const SurfaceResourcesImpl* p_surface_resources = (const SurfaceResourcesImpl*)surface_resources.impl;
+    return p_surface_resources->supported_present_modes;
+};
+
+
+/// Returns VK_PRESENT_MODE_MAX_ENUM_KHR if there is no mode in `p_modes` whose priority > 0.
+static VkPresentModeKHR selectHighestPriorityPresentMode(
+    const PresentModePriorities priorities,
+    u32 mode_count,
+    VkPresentModeKHR* p_modes
+) {
+    VkPresentModeKHR highest_priority_mode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+    u8 highest_priority = 0;
+
+    for (u32fast mode_idx = 0; mode_idx < mode_count; mode_idx++) {
+
+        VkPresentModeKHR mode = p_modes[mode_idx];
+        if (mode >= (int)PRESENT_MODE_ENUM_COUNT) continue;
+
+        u8 priority = priorities[mode];
+        if (priority <= highest_priority) continue;
+
+        highest_priority_mode = mode;
+        highest_priority = priority;
+    }
+
+    return highest_priority_mode;
+};
+
+
+extern Result createSurfaceResources(
+    VkSurfaceKHR surface,
+    const PresentModePriorities present_mode_priorities,
+    VkExtent2D fallback_window_size,
+    SurfaceResources* surface_resources_out,
+    PresentMode* selected_present_mode_out
+) {
+    ZoneScoped;
+
+    SurfaceResourcesImpl* p_resources = (SurfaceResourcesImpl*)calloc(1, sizeof(SurfaceResourcesImpl));
+    assertErrno(p_resources != NULL);
+
+
+    p_resources->surface = surface;
+    p_resources->attached_render_resources = NULL;
+    p_resources->last_used_swapchain_image_acquired_semaphore_idx = 0;
+
+
+    VkPresentModeKHR present_mode;
+    {
+        u32 supported_mode_count = 0;
+        VkPresentModeKHR* p_supported_modes = getSupportedVkPresentModes(surface, &supported_mode_count);
+        alwaysAssert(p_supported_modes != NULL);
+        defer(free(p_supported_modes));
+
+        PresentModeFlags supported_mode_flags = 0;
+        for (u32fast i = 0; i < supported_mode_count; i++) {
+            VkPresentModeKHR mode = p_supported_modes[i];
+            if (p_supported_modes[i] < (int)PRESENT_MODE_ENUM_COUNT) {
+                supported_mode_flags |= PresentModeFlagBits_fromMode((PresentMode)mode);
+            }
+        }
+
+        p_resources->supported_present_modes = supported_mode_flags;
+
+        present_mode = selectHighestPriorityPresentMode(
+            present_mode_priorities, supported_mode_count, p_supported_modes
+        );
+        alwaysAssert(present_mode != VK_PRESENT_MODE_MAX_ENUM_KHR);
+    }
+
+
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    VkExtent2D swapchain_extent {};
+    Result res = createSwapchain(
+        physical_device_, device_, surface, fallback_window_size, queue_family_, present_mode,
+        VK_NULL_HANDLE, // old_swapchain
+        &swapchain, &swapchain_extent
+    );
+    if (res == Result::error_window_size_zero) {
+        free(p_resources);
+        return res;
+    };
+    assertGraphics(res);
+
+    p_resources->swapchain = swapchain;
+    p_resources->swapchain_extent = swapchain_extent;
+
+
+    createPerSwapchainImageSurfaceResources(
+        swapchain,
+        &p_resources->swapchain_image_count,
+        &p_resources->swapchain_images,
+        &p_resources->swapchain_image_views,
+        &p_resources->swapchain_image_acquired_semaphores
+    );
+
+
+    surface_resources_out->impl = p_resources;
+    if (selected_present_mode_out != NULL) *selected_present_mode_out = (PresentMode)present_mode;
+    return Result::success;
+}
+
+
+/// Creates `depth_pyramid_buffer`, for a surface of `swapchain_extent`. The pyramid is invalid until a frame builds
+/// it.
+static void createDepthPyramidBuffer(RenderResourcesImpl* p_render_resources, VkExtent2D swapchain_extent) {
+
+    VkResult result;
+
+    // every level, down to 1x1; see depth_pyramid.comp.h
+    u32 level_count = 0;
+    VkDeviceSize texel_count = 0;
+    while (true) {
+        const VkExtent2D level_extent = depthPyramidLevelExtent(swapchain_extent, level_count);
+        texel_count += (VkDeviceSize)level_extent.width * level_extent.height;
+        level_count++;
+        if (level_extent.width <= 1 && level_extent.height <= 1) break;
+    }
+
+    VkBufferCreateInfo buffer_info {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = texel_count * sizeof(f32),
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &queue_family_,
+    };
+    VmaAllocationCreateInfo alloc_info {
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+    };
+    VmaAllocationInfo allocation_info {};
+    result = vmaCreateBuffer(
+        vma_allocator_, &buffer_info, &alloc_info,
+        &p_render_resources->depth_pyramid_buffer,
+        &p_render_resources->depth_pyramid_buffer_allocation,
+        &allocation_info
+    );
+    assertVk(result);
+    memory_usage_.depth_buffer_bytes += allocation_info.size;
+    TracyAllocN(p_render_resources->depth_pyramid_buffer, allocation_info.size, "gfx depth buffers");
+
+    p_render_resources->depth_pyramid_extent = swapchain_extent;
+    p_render_resources->depth_pyramid_level_count = level_count;
+    // it's built by the first frame
+    p_render_resources->depth_pyramid_valid = false;
+}
+
+
+/// Does not synchronize; the buffer must not be in use.
+static void destroyDepthPyramidBuffer(VkBuffer buffer, VmaAllocation allocation) {
+
+    VmaAllocationInfo allocation_info {};
+    vmaGetAllocationInfo(vma_allocator_, allocation, &allocation_info);
+    memory_usage_.depth_buffer_bytes -= allocation_info.size;
+    TracyFreeN(buffer, "gfx depth buffers");
+
+    vmaDestroyBuffer(vma_allocator_, buffer, allocation);
+}
+
+
+/// Creates the frame's images that are the size of the surface, `swapchain_extent`, and their views. They're in
+/// `VK_IMAGE_LAYOUT_UNDEFINED` until `recordSwapchainSizedImageLayoutTransitions()` has run, and the frame's
+/// descriptors still point at the old ones.
+static void createSwapchainSizedImages(
+    RenderResourcesImpl::PerFrameResources* this_frame_resources,
+    VkExtent2D swapchain_extent
+) {
+
+    VkResult result;
+
+    VkImageCreateInfo depth_image_info {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = DEPTH_FORMAT,
+        .extent = VkExtent3D { swapchain_extent.width, swapchain_extent.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        // sampled by depth_pyramid.comp
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &queue_family_,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VmaAllocationCreateInfo depth_image_alloc_info {
+        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+    VmaAllocationInfo depth_image_allocation_info {};
+    result = vmaCreateImage(
+        vma_allocator_, &depth_image_info, &depth_image_alloc_info,
+        &this_frame_resources->depth_buffer,
+        &this_frame_resources->depth_buffer_allocation,
+        &depth_image_allocation_info
+    );
+    assertVk(result);
+    memory_usage_.depth_buffer_bytes += depth_image_allocation_info.size;
+    TracyAllocN(this_frame_resources->depth_buffer, depth_image_allocation_info.size, "gfx depth buffers");
+
+    const VkExtent2D fluid_surface_extent = getFluidSurfaceExtent(swapchain_extent);
+    for (u32 image_idx = 0; image_idx < FLUID_SURFACE_IMAGE_COUNT; image_idx++)
+    {
+        VkImageCreateInfo image_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = FLUID_SURFACE_IMAGE_INFOS[image_idx].format,
+            .extent = VkExtent3D { fluid_surface_extent.width, fluid_surface_extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = FLUID_SURFACE_IMAGE_INFOS[image_idx].usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        VmaAllocationCreateInfo image_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo image_allocation_info {};
+        result = vmaCreateImage(
+            vma_allocator_, &image_info, &image_alloc_info,
+            &this_frame_resources->fluid_surface_images[image_idx],
+            &this_frame_resources->fluid_surface_image_allocations[image_idx],
+            &image_allocation_info
+        );
+        assertVk(result);
+        memory_usage_.fluid_surface_image_bytes += image_allocation_info.size;
+        TracyAllocN(
+            this_frame_resources->fluid_surface_images[image_idx], image_allocation_info.size,
+            "gfx fluid surface images"
+        );
+    }
+    for (u32 image_idx = 0; image_idx < SCALED_PARTICLE_IMAGE_COUNT; image_idx++)
+    {
+        VkImageCreateInfo image_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = SCALED_PARTICLE_IMAGE_INFOS[image_idx].format,
+            .extent = VkExtent3D { swapchain_extent.width, swapchain_extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = SCALED_PARTICLE_IMAGE_INFOS[image_idx].usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        VmaAllocationCreateInfo image_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo image_allocation_info {};
+        result = vmaCreateImage(
+            vma_allocator_, &image_info, &image_alloc_info,
+            &this_frame_resources->scaled_particle_images[image_idx],
+            &this_frame_resources->scaled_particle_image_allocations[image_idx],
+            &image_allocation_info
+        );
+        assertVk(result);
+        memory_usage_.scaled_particle_image_bytes += image_allocation_info.size;
+        TracyAllocN(
+            this_frame_resources->scaled_particle_images[image_idx], image_allocation_info.size,
+            "gfx scaled particle images"
+        );
+    }
+    {
+        VkImageCreateInfo image_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = OBJECT_ID_FORMAT,
+            .extent = VkExtent3D { swapchain_extent.width, swapchain_extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            // read by object_id_resolve.comp
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        VmaAllocationCreateInfo image_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo image_allocation_info {};
+        result = vmaCreateImage(
+            vma_allocator_, &image_info, &image_alloc_info,
+            &this_frame_resources->object_id_image,
+            &this_frame_resources->object_id_image_allocation,
+            &image_allocation_info
+        );
+        assertVk(result);
+        memory_usage_.object_id_image_bytes += image_allocation_info.size;
+        TracyAllocN(this_frame_resources->object_id_image, image_allocation_info.size, "gfx object id images");
+    }
 
-    for (u32fast im_idx = 0; im_idx < image_count; im_idx++) {
 
+    VkImageViewCreateInfo depth_image_view_info {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = this_frame_resources->depth_buffer,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = DEPTH_FORMAT,
+        .components = {
+            .r = VK_COMPONENT_SWIZZLE_R,
+            .g = VK_COMPONENT_SWIZZLE_G,
+            .b = VK_COMPONENT_SWIZZLE_B,
+            .a = VK_COMPONENT_SWIZZLE_A,
+        },
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+    result = vk_dev_procs.CreateImageView(
+        device_,
+        &depth_image_view_info,
+        NULL,
+        &this_frame_resources->depth_buffer_view
+    );
+    assertVk(result);
+
+    for (u32 image_idx = 0; image_idx < FLUID_SURFACE_IMAGE_COUNT; image_idx++)
+    {
         VkImageViewCreateInfo image_view_info {
             .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .image = swapchain_images[im_idx],
+            .image = this_frame_resources->fluid_surface_images[image_idx],
             .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = SWAPCHAIN_FORMAT,
-            .components = VkComponentMapping {
+            .format = FLUID_SURFACE_IMAGE_INFOS[image_idx].format,
+            .components = {
                 .r = VK_COMPONENT_SWIZZLE_R,
                 .g = VK_COMPONENT_SWIZZLE_G,
                 .b = VK_COMPONENT_SWIZZLE_B,
                 .a = VK_COMPONENT_SWIZZLE_A,
             },
             .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .aspectMask = FLUID_SURFACE_IMAGE_INFOS[image_idx].aspect,
                 .baseMipLevel = 0,
                 .levelCount = 1,
                 .baseArrayLayer = 0,
@@ -2177,602 +8745,472 @@ static void createPerSwapchainImageSurfaceResources(
             },
         };
         result = vk_dev_procs.CreateImageView(
-            device_, &image_view_info, NULL, &swapchain_image_views[im_idx]
+            device_,
+            &image_view_info,
+            NULL,
+            &this_frame_resources->fluid_surface_image_views[image_idx]
         );
         assertVk(result);
     }
-
-
-    VkSemaphore* swapchain_image_acquired_semaphores = mallocArray(image_count, VkSemaphore);
+    for (u32 image_idx = 0; image_idx < SCALED_PARTICLE_IMAGE_COUNT; image_idx++)
     {
-        VkSemaphoreCreateInfo semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
-        for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
-            result = vk_dev_procs.CreateSemaphore(
-                device_, &semaphore_info, NULL, &swapchain_image_acquired_semaphores[im_idx]
-            );
-            assertVk(result);
-        }
-    }
-
-
-    *image_count_out = image_count;
-    *images_out = swapchain_images;
-    *image_views_out = swapchain_image_views;
-    *image_acquired_semaphores_out = swapchain_image_acquired_semaphores;
-}
-
-/// Does not synchronize.
-/// You are responsible for ensuring the resources are not in use (e.g. via vkDeviceWaitIdle).
-static void destroyPerSwapchainImageSurfaceResources(
-    u32 image_count,
-    VkImage* p_images,
-    VkImageView* p_image_views,
-    VkSemaphore* p_image_acquired_semaphores
-) {
-    assert(p_images != NULL);
-    assert(p_image_views != NULL);
-    assert(p_image_acquired_semaphores != NULL);
-
-    for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
-        vk_dev_procs.DestroySemaphore(device_, p_image_acquired_semaphores[im_idx], NULL);
+        VkImageViewCreateInfo image_view_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = this_frame_resources->scaled_particle_images[image_idx],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = SCALED_PARTICLE_IMAGE_INFOS[image_idx].format,
+            .components = {
+                .r = VK_COMPONENT_SWIZZLE_R,
+                .g = VK_COMPONENT_SWIZZLE_G,
+                .b = VK_COMPONENT_SWIZZLE_B,
+                .a = VK_COMPONENT_SWIZZLE_A,
+            },
+            .subresourceRange = {
+                .aspectMask = SCALED_PARTICLE_IMAGE_INFOS[image_idx].aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = vk_dev_procs.CreateImageView(
+            device_,
+            &image_view_info,
+            NULL,
+            &this_frame_resources->scaled_particle_image_views[image_idx]
+        );
+        assertVk(result);
     }
-    free(p_image_acquired_semaphores);
-
-    for (u32 im_idx = 0; im_idx < image_count; im_idx++) {
-        vk_dev_procs.DestroyImageView(device_, p_image_views[im_idx], NULL);
+    {
+        VkImageViewCreateInfo image_view_info {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = this_frame_resources->object_id_image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = OBJECT_ID_FORMAT,
+            .components = {
+                .r = VK_COMPONENT_SWIZZLE_R,
+                .g = VK_COMPONENT_SWIZZLE_G,
+                .b = VK_COMPONENT_SWIZZLE_B,
+                .a = VK_COMPONENT_SWIZZLE_A,
+            },
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = vk_dev_procs.CreateImageView(
+            device_,
+            &image_view_info,
+            NULL,
+            &this_frame_resources->object_id_image_view
+        );
+        assertVk(result);
     }
-    free(p_image_views);
 
-    free(p_images);
+    this_frame_resources->swapchain_extent = swapchain_extent;
 }
 
 
 /// Does not call `BeginCommandBuffer` and `EndCommandBuffer`; you are responsible for doing that.
-/// Returns `true` if successful.
-static bool recordCommandBuffer(
-    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
-    u32 voxel_count,
-    u32 outlined_voxel_count,
-    u32 particle_count,
-    VkBuffer particles_vertex_buffer,
-    VkExtent2D dst_image_extent,
-    VkRect2D dst_image_roi,
-    VkImageView dst_image_view,
-    VkImageLayout dst_image_layout,
-    const GridPipelineFragmentShaderPushConstants* grid_pipeline_push_constants,
-    const ParticlePipelineFragmentShaderPushConstants* particle_pipeline_push_constants,
-    const ParticleRasterizePipelineVertexShaderPushConstants* particle_rasterize_pipeline_push_constants,
-    bool fancy_particle_rendering,
-    ImDrawData* imgui_draw_data
+/// Moves the images of `createSwapchainSizedImages()` into the layouts that they stay in.
+static void recordSwapchainSizedImageLayoutTransitions(
+    VkCommandBuffer command_buffer,
+    const RenderResourcesImpl::PerFrameResources* this_frame_resources
 ) {
-    ZoneScoped;
-
-    if (fancy_particle_rendering) assert(particle_pipeline_push_constants != NULL);
-    else assert(particle_rasterize_pipeline_push_constants != NULL);
-
-    VkCommandBuffer command_buffer = p_frame_resources->command_buffer;
-
+    constexpr u32 image_barrier_count = 1 + FLUID_SURFACE_IMAGE_COUNT + SCALED_PARTICLE_IMAGE_COUNT + 1;
+    VkImageMemoryBarrier image_barriers[image_barrier_count] {
+        // depth image
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_NONE,
+            .dstAccessMask =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = DEPTH_IMAGE_LAYOUT,
+            .srcQueueFamilyIndex = queue_family_,
+            .dstQueueFamilyIndex = queue_family_,
+            .image = this_frame_resources->depth_buffer,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        },
+    };
+    // the fluid surface images, which stay in these layouts
+    for (u32 image_idx = 0; image_idx < FLUID_SURFACE_IMAGE_COUNT; image_idx++)
     {
-        VkRenderingAttachmentInfo rendering_color_attachment_info {
-            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = dst_image_view,
-            .imageLayout = dst_image_layout,
-            .resolveMode = VK_RESOLVE_MODE_NONE,
-            .resolveImageView = NULL,
-            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 1} } },
-        };
-        VkRenderingAttachmentInfo rendering_depth_attachment_info {
-            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = p_frame_resources->depth_buffer_view,
-            .imageLayout = DEPTH_IMAGE_LAYOUT,
-            .resolveMode = VK_RESOLVE_MODE_NONE,
-            .resolveImageView = NULL,
-            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .clearValue = VkClearValue { .depthStencil = VkClearDepthStencilValue { .depth = 1 } },
-        };
-        VkRenderingInfo rendering_info {
-            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-            .renderArea = VkRect2D { .offset = {0, 0}, .extent = dst_image_extent },
-            .layerCount = 1,
-            .viewMask = 0,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &rendering_color_attachment_info,
-            .pDepthAttachment = &rendering_depth_attachment_info,
+        const bool depth = FLUID_SURFACE_IMAGE_INFOS[image_idx].aspect == VK_IMAGE_ASPECT_DEPTH_BIT;
+        image_barriers[1 + image_idx] = VkImageMemoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_NONE,
+            .dstAccessMask = depth
+                ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+                : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = FLUID_SURFACE_IMAGE_INFOS[image_idx].layout,
+            .srcQueueFamilyIndex = queue_family_,
+            .dstQueueFamilyIndex = queue_family_,
+            .image = this_frame_resources->fluid_surface_images[image_idx],
+            .subresourceRange = {
+                .aspectMask = FLUID_SURFACE_IMAGE_INFOS[image_idx].aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
         };
-        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
     }
-
-    const VkViewport viewport {
-        .x = (f32)dst_image_roi.offset.x,
-        .y = (f32)dst_image_roi.offset.y,
-        .width = (f32)dst_image_roi.extent.width,
-        .height = (f32)dst_image_roi.extent.height,
-        .minDepth = 0,
-        .maxDepth = 1,
-    };
-    vk_dev_procs.CmdSetViewport(command_buffer, 0, 1, &viewport);
-    vk_dev_procs.CmdSetScissor(command_buffer, 0, 1, &dst_image_roi);
-
-
+    // likewise, the scaled particle images
+    for (u32 image_idx = 0; image_idx < SCALED_PARTICLE_IMAGE_COUNT; image_idx++)
     {
-        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_VOXEL_PIPELINE];
-
-        vk_dev_procs.CmdBindDescriptorSets(
-            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
-            0, // firstSet
-            1, // descriptorSetCount
-            &p_frame_resources->descriptor_set,
-            0, // dynamicOffsetCount
-            NULL // pDynamicOffsets
-        );
-
-        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
-
-        VkDeviceSize offset_in_voxels_vertex_buf = 0;
-        vk_dev_procs.CmdBindVertexBuffers(
-            command_buffer, 0, 1, &p_frame_resources->voxels_buffer, &offset_in_voxels_vertex_buf
-        );
-
-        vk_dev_procs.CmdDraw(command_buffer, 36, voxel_count, 0, 0);
+        const bool depth = SCALED_PARTICLE_IMAGE_INFOS[image_idx].aspect == VK_IMAGE_ASPECT_DEPTH_BIT;
+        image_barriers[1 + FLUID_SURFACE_IMAGE_COUNT + image_idx] = VkImageMemoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_NONE,
+            .dstAccessMask = depth
+                ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+                : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = SCALED_PARTICLE_IMAGE_INFOS[image_idx].layout,
+            .srcQueueFamilyIndex = queue_family_,
+            .dstQueueFamilyIndex = queue_family_,
+            .image = this_frame_resources->scaled_particle_images[image_idx],
+            .subresourceRange = {
+                .aspectMask = SCALED_PARTICLE_IMAGE_INFOS[image_idx].aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
     }
-    if (particle_count > 0) {
-        if (fancy_particle_rendering) {
-            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_PIPELINE];
-
-            vk_dev_procs.CmdBindDescriptorSets(
-                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
-                0, // firstSet
-                1, // descriptorSetCount
-                &p_frame_resources->descriptor_set,
-                0, // dynamicOffsetCount
-                NULL // pDynamicOffsets
-            );
-
-            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
-
-            vk_dev_procs.CmdPushConstants(
-                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                sizeof(*particle_pipeline_push_constants), particle_pipeline_push_constants
-            );
-
-            vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
-        }
-        else {
-            PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_PARTICLE_RASTERIZE_PIPELINE];
+    // likewise, the object id image
+    image_barriers[image_barrier_count - 1] = VkImageMemoryBarrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_NONE,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = queue_family_,
+        .dstQueueFamilyIndex = queue_family_,
+        .image = this_frame_resources->object_id_image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
 
-            vk_dev_procs.CmdBindDescriptorSets(
-                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
-                0, // firstSet
-                1, // descriptorSetCount
-                &p_frame_resources->descriptor_set,
-                0, // dynamicOffsetCount
-                NULL // pDynamicOffsets
-            );
+    vk_dev_procs.CmdPipelineBarrier(
+        command_buffer,
+        // TOP_OF_PIPE_BIT "specifies no stage of execution when specified in the first scope"
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // srcStageMask
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
+        0, // dependencyFlags
+        0, // memoryBarrierCount
+        NULL, // pMemoryBarriers
+        0, // bufferMemoryBarrierCount
+        NULL, // pBufferMemoryBarriers
+        image_barrier_count, // imageMemoryBarrierCount
+        image_barriers // pImageMemoryBarriers
+    );
+}
 
-            vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
 
-            vk_dev_procs.CmdPushConstants(
-                command_buffer, p_pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                sizeof(*particle_rasterize_pipeline_push_constants), particle_rasterize_pipeline_push_constants
-            );
+/// Does not synchronize; the frame's command buffer must not be pending.
+static void destroySwapchainSizedImages(RenderResourcesImpl::PerFrameResources* this_frame_resources) {
 
-            VkDeviceSize offset_in_vertex_buf = 0;
-            vk_dev_procs.CmdBindVertexBuffers(
-                command_buffer, 0, 1, &particles_vertex_buffer, &offset_in_vertex_buf
-            );
+    VmaAllocationInfo depth_image_allocation_info {};
+    vmaGetAllocationInfo(vma_allocator_, this_frame_resources->depth_buffer_allocation, &depth_image_allocation_info);
+    memory_usage_.depth_buffer_bytes -= depth_image_allocation_info.size;
+    TracyFreeN(this_frame_resources->depth_buffer, "gfx depth buffers");
 
-            vk_dev_procs.CmdDraw(command_buffer, 36, particle_count, 0, 0);
-        }
-    }
-    {
-        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_CUBE_OUTLINE_PIPELINE];
+    vk_dev_procs.DestroyImageView(device_, this_frame_resources->depth_buffer_view, NULL);
+    vmaDestroyImage(
+        vma_allocator_,
+        this_frame_resources->depth_buffer,
+        this_frame_resources->depth_buffer_allocation
+    );
+    this_frame_resources->depth_buffer = VK_NULL_HANDLE;
+    this_frame_resources->depth_buffer_allocation = VMA_NULL;
 
-        vk_dev_procs.CmdBindDescriptorSets(
-            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
-            0, // firstSet
-            1, // descriptorSetCount
-            &p_frame_resources->descriptor_set,
-            0, // dynamicOffsetCount
-            NULL // pDynamicOffsets
+    for (u32 image_idx = 0; image_idx < FLUID_SURFACE_IMAGE_COUNT; image_idx++)
+    {
+        VmaAllocationInfo image_allocation_info {};
+        vmaGetAllocationInfo(
+            vma_allocator_, this_frame_resources->fluid_surface_image_allocations[image_idx], &image_allocation_info
         );
+        memory_usage_.fluid_surface_image_bytes -= image_allocation_info.size;
+        TracyFreeN(this_frame_resources->fluid_surface_images[image_idx], "gfx fluid surface images");
 
-        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
-
-        VkDeviceSize offset_in_outlined_voxels_index_buf = 0;
-        vk_dev_procs.CmdBindVertexBuffers(
-            command_buffer, 0, 1, &p_frame_resources->outlined_voxels_index_buffer, &offset_in_outlined_voxels_index_buf
+        vk_dev_procs.DestroyImageView(device_, this_frame_resources->fluid_surface_image_views[image_idx], NULL);
+        vmaDestroyImage(
+            vma_allocator_,
+            this_frame_resources->fluid_surface_images[image_idx],
+            this_frame_resources->fluid_surface_image_allocations[image_idx]
         );
-
-        vk_dev_procs.CmdDraw(command_buffer, 72, outlined_voxel_count, 0, 0);
+        this_frame_resources->fluid_surface_images[image_idx] = VK_NULL_HANDLE;
+        this_frame_resources->fluid_surface_image_allocations[image_idx] = VMA_NULL;
     }
-    if (grid_enabled_) {
-        PipelineAndLayout* p_pipeline = &pipelines_[PIPELINE_INDEX_GRID_PIPELINE];
 
-        vk_dev_procs.CmdBindDescriptorSets(
-            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->layout,
-            0, // firstSet
-            1, // descriptorSetCount
-            &p_frame_resources->descriptor_set,
-            0, // dynamicOffsetCount
-            NULL // pDynamicOffsets
+    for (u32 image_idx = 0; image_idx < SCALED_PARTICLE_IMAGE_COUNT; image_idx++)
+    {
+        VmaAllocationInfo image_allocation_info {};
+        vmaGetAllocationInfo(
+            vma_allocator_, this_frame_resources->scaled_particle_image_allocations[image_idx],
+            &image_allocation_info
         );
-        vk_dev_procs.CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->pipeline);
+        memory_usage_.scaled_particle_image_bytes -= image_allocation_info.size;
+        TracyFreeN(this_frame_resources->scaled_particle_images[image_idx], "gfx scaled particle images");
 
-        vk_dev_procs.CmdPushConstants(
-            command_buffer, p_pipeline->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-            sizeof(*grid_pipeline_push_constants), grid_pipeline_push_constants
+        vk_dev_procs.DestroyImageView(device_, this_frame_resources->scaled_particle_image_views[image_idx], NULL);
+        vmaDestroyImage(
+            vma_allocator_,
+            this_frame_resources->scaled_particle_images[image_idx],
+            this_frame_resources->scaled_particle_image_allocations[image_idx]
         );
-
-        vk_dev_procs.CmdDraw(command_buffer, 6, 1, 0, 0);
+        this_frame_resources->scaled_particle_images[image_idx] = VK_NULL_HANDLE;
+        this_frame_resources->scaled_particle_image_allocations[image_idx] = VMA_NULL;
     }
 
+    {
+        VmaAllocationInfo image_allocation_info {};
+        vmaGetAllocationInfo(
+            vma_allocator_, this_frame_resources->object_id_image_allocation, &image_allocation_info
+        );
+        memory_usage_.object_id_image_bytes -= image_allocation_info.size;
+        TracyFreeN(this_frame_resources->object_id_image, "gfx object id images");
 
-    vk_dev_procs.CmdEndRendering(command_buffer);
-
-    if (imgui_draw_data != NULL) {
-
-        VkRenderingAttachmentInfo rendering_color_attachment_info {
-            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = dst_image_view,
-            .imageLayout = dst_image_layout,
-            .resolveMode = VK_RESOLVE_MODE_NONE,
-            .resolveImageView = NULL,
-            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .clearValue = VkClearValue { .color = VkClearColorValue { .float32 = {0, 0, 0, 1} } },
-        };
-        VkRenderingInfo rendering_info {
-            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-            .renderArea = VkRect2D { .offset = {0, 0}, .extent = dst_image_extent },
-            .layerCount = 1,
-            .viewMask = 0,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &rendering_color_attachment_info,
-            .pDepthAttachment = NULL,
-        };
-        vk_dev_procs.CmdBeginRendering(command_buffer, &rendering_info);
-        {
-            ZoneScopedN("ImGui_ImplVulkan_RenderDrawData");
-            ImGui_ImplVulkan_RenderDrawData(imgui_draw_data, command_buffer);
-        }
-        vk_dev_procs.CmdEndRendering(command_buffer);
+        vk_dev_procs.DestroyImageView(device_, this_frame_resources->object_id_image_view, NULL);
+        vmaDestroyImage(
+            vma_allocator_, this_frame_resources->object_id_image, this_frame_resources->object_id_image_allocation
+        );
+        this_frame_resources->object_id_image = VK_NULL_HANDLE;
+        this_frame_resources->object_id_image_allocation = VMA_NULL;
     }
 
-
-    return true;
+    this_frame_resources->swapchain_extent = VkExtent2D {};
 }
 
 
-static void imguiVkResultCheckCallback(VkResult result) {
-
-    if (result == VK_SUCCESS) return;
-
-    // TODO what if it's a recoverable result, similarly to VK_SUBOPTIMAL_KHR?
-    ABORT_F("Imgui encountered VkResult %i.", result);
+/// Points the frame's descriptors at its images of `createSwapchainSizedImages()`, and at `depth_pyramid_buffer`.
+/// The frame's command buffer must not be pending.
+static void writeSwapchainSizedDescriptors(
+    const RenderResourcesImpl* p_render_resources,
+    const RenderResourcesImpl::PerFrameResources* this_frame_resources
+) {
+    writeFluidSurfaceDescriptors(this_frame_resources);
+    writeScaledParticleDescriptors(this_frame_resources);
+    writeDepthPyramidDescriptors(p_render_resources, this_frame_resources);
+    writeObjectIdDescriptors(this_frame_resources);
 }
 
 
-static PFN_vkVoidFunction imguiLoadVkProcCallback(const char* proc_name, void* user_data) {
-    (void)user_data;
-
-    assert(initialized_);
+/// Does not synchronize; nothing that was submitted before `p_retired` was retired may still be pending.
+static void destroyRetiredResources(const RenderResourcesImpl::RetiredResources* p_retired) {
 
-    // NOTE I assume here, without a strong reason, that ImGui will only attempt to get procedures that can be
-    // obtained via vkGetDeviceProcAddr.
-    return vk_base_procs.GetInstanceProcAddr(instance_, proc_name);
+    if (p_retired->swapchain != VK_NULL_HANDLE) {
+        destroyPerSwapchainImageSurfaceResources(
+            p_retired->swapchain_image_count,
+            p_retired->swapchain_images,
+            p_retired->swapchain_image_views,
+            p_retired->swapchain_image_acquired_semaphores
+        );
+        vk_dev_procs.DestroySwapchainKHR(device_, p_retired->swapchain, NULL);
+    }
+    if (p_retired->depth_pyramid_buffer != VK_NULL_HANDLE) {
+        destroyDepthPyramidBuffer(p_retired->depth_pyramid_buffer, p_retired->depth_pyramid_buffer_allocation);
+    }
 }
 
 
-extern bool initImGuiVulkanBackend(void) {
-
-    alwaysAssert(initialized_);
-
-    bool success = ImGui_ImplVulkan_LoadFunctions(imguiLoadVkProcCallback, NULL);
-    alwaysAssert(success);
+/// Call after waiting for a frame's `command_buffer_pending_fence`. Destroys what was retired before each of the
+/// frames in flight had been waited for since; or, if `all`, everything that was retired, in which case the queue
+/// must be idle.
+static void releaseRetiredResources(RenderResourcesImpl* p_render_resources, bool all) {
 
-    // This descriptor pool initialization was pretty much copied from imgui's `example_glfw_vulkan`
-    // TODO do we actually need this?
-    VkDescriptorPoolSize descriptor_pool_size {
-        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = 1,
-    };
-    VkDescriptorPoolCreateInfo descriptor_pool_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-        .maxSets = 1,
-        .poolSizeCount = 1,
-        .pPoolSizes = &descriptor_pool_size,
-    };
+    ArrayList<RenderResourcesImpl::RetiredResources>* retired = &p_render_resources->retired_resources;
 
-    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
-    VkResult result = vk_dev_procs.CreateDescriptorPool(
-        device_, &descriptor_pool_info, NULL, &descriptor_pool
-    );
-    assertVk(result);
+    u32 kept_count = 0;
+    for (u32 i = 0; i < retired->size; i++)
+    {
+        RenderResourcesImpl::RetiredResources* p_retired = &retired->ptr[i];
+        p_retired->frames_left--;
 
-    ImGui_ImplVulkan_InitInfo imgui_vk_init_info {
-        .Instance = instance_,
-        .PhysicalDevice = physical_device_,
-        .Device = device_,
-        .QueueFamily = queue_family_,
-        .Queue = queue_,
-        .PipelineCache = VK_NULL_HANDLE,
-        .DescriptorPool = descriptor_pool,
-        // Imgui asserts >= 2. Pretty sure the actual number doesn't matter, because
-        // Imgui doesn't even use this, as long as we don't use its swapchain creation helpers.
-        .MinImageCount = 2,
-        .ImageCount = MAX_FRAMES_IN_FLIGHT, // NOTE I _think_ this is right, but not sure
-        .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
-        .UseDynamicRendering = true,
-        .ColorAttachmentFormat = SWAPCHAIN_FORMAT,
-        .CheckVkResultFn = imguiVkResultCheckCallback,
-    };
-    bool imgui_result = ImGui_ImplVulkan_Init(&imgui_vk_init_info, VK_NULL_HANDLE);
-    return imgui_result;
+        if (all || p_retired->frames_left == 0) destroyRetiredResources(p_retired);
+        else retired->ptr[kept_count++] = *p_retired;
+    }
+    retired->size = kept_count;
 }
 
 
-extern void init(const char* app_name, const char* specific_named_device_request) {
+/// Call after waiting for the frame's `command_buffer_pending_fence`. If the surface has been resized since the
+/// frame's images were created (see `updateSurfaceResources()`), recreates them, and the depth pyramid if no frame
+/// has yet, and points the frame's descriptors at them. Returns true if the frame's images were recreated, in
+/// which case the frame's command buffer must begin with `recordSwapchainSizedImageLayoutTransitions()`.
+static bool resizeSwapchainSizedFrameResources(
+    RenderResourcesImpl* p_render_resources,
+    RenderResourcesImpl::PerFrameResources* this_frame_resources,
+    VkExtent2D swapchain_extent
+) {
+    const VkExtent2D frame_extent = this_frame_resources->swapchain_extent;
+    if (frame_extent.width == swapchain_extent.width && frame_extent.height == swapchain_extent.height) return false;
 
     ZoneScoped;
 
-    // TODO remaining work:
-    // Set up validation layer debug logging thing, to log their messages as loguru messages. This way they
-    // will be logged if we're logging to a file.
-
-    initGraphicsUptoQueueCreation(app_name, specific_named_device_request);
-
-
-    VmaVulkanFunctions vma_vulkan_functions {
-        .vkGetInstanceProcAddr = vk_base_procs.GetInstanceProcAddr,
-        .vkGetDeviceProcAddr = vk_inst_procs.GetDeviceProcAddr,
-    };
-
-    VmaAllocatorCreateInfo vma_allocator_info {
-        .physicalDevice = physical_device_,
-        .device = device_,
-        .pVulkanFunctions = &vma_vulkan_functions,
-        .instance = instance_,
-        .vulkanApiVersion = VULKAN_API_VERSION,
-    };
-    VkResult result = vmaCreateAllocator(&vma_allocator_info, &vma_allocator_);
-    assertVk(result);
-
-
-    constexpr u32 descriptor_set_layout_binding_count = 3;
-    VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[descriptor_set_layout_binding_count] {
-        {
-            .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-            .pImmutableSamplers = NULL,
-        },
-        // voxels
-        {
-            .binding = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-            .pImmutableSamplers = NULL,
-        },
-        // particles
-        {
-            .binding = 2,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .pImmutableSamplers = NULL,
-        },
-    };
-    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = descriptor_set_layout_binding_count,
-        .pBindings = descriptor_set_layout_bindings,
-    };
-    result = vk_dev_procs.CreateDescriptorSetLayout(
-        device_, &descriptor_set_layout_info, NULL, &descriptor_set_layout_
-    );
-    assertVk(result);
-
-
-    {
-        ZoneScopedN("pipeline init");
-
-        for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
-
-            const PipelineBuildFromSpirvFilesInfo* p_build_info =
-                &PIPELINE_BUILD_FROM_SPIRV_FILES_INFOS[pipeline_idx];
+    // The other frames in flight may still be using the old pyramid.
+    const VkExtent2D pyramid_extent = p_render_resources->depth_pyramid_extent;
+    if (pyramid_extent.width != swapchain_extent.width || pyramid_extent.height != swapchain_extent.height) {
+
+        p_render_resources->retired_resources.push(RenderResourcesImpl::RetiredResources {
+            .frames_left = p_render_resources->frames_in_flight,
+            .swapchain = VK_NULL_HANDLE,
+            .depth_pyramid_buffer = p_render_resources->depth_pyramid_buffer,
+            .depth_pyramid_buffer_allocation = p_render_resources->depth_pyramid_buffer_allocation,
+        });
+        createDepthPyramidBuffer(p_render_resources, swapchain_extent);
+    }
 
+    // Only this frame uses its images, and it has been waited for.
+    destroySwapchainSizedImages(this_frame_resources);
+    createSwapchainSizedImages(this_frame_resources, swapchain_extent);
+    writeSwapchainSizedDescriptors(p_render_resources, this_frame_resources);
 
-            size_t vertex_shader_spirv_byte_count = 0;
-            void* vertex_shader_spirv_bytes = file_util::readEntireFile(
-                p_build_info->vertex_shader_spirv_filepath,
-                &vertex_shader_spirv_byte_count
-            );
-            alwaysAssert(vertex_shader_spirv_bytes != NULL);
-            defer(free(vertex_shader_spirv_bytes));
+    return true;
+}
 
-            alwaysAssert(vertex_shader_spirv_byte_count % sizeof(u32) == 0);
-            alwaysAssert((uintptr_t)vertex_shader_spirv_bytes % alignof(u32) == 0);
 
-            VkShaderModule vertex_shader_module = VK_NULL_HANDLE;
-            result = createShaderModuleFromSpirv(
-                device_,
-                (u32)vertex_shader_spirv_byte_count,
-                (const u32*)vertex_shader_spirv_bytes,
-                &vertex_shader_module
-            );
-            assertVk(result);
-            shader_modules_[pipeline_idx].vertex_shader_module = vertex_shader_module;
+/// `renderer` must not currently have any surface attached.
+/// `surface` must not currently have any renderer attached.
+extern void attachSurfaceToRenderer(SurfaceResources surface, RenderResources renderer) {
+    ZoneScoped;
 
+    VkResult result;
 
-            size_t fragment_shader_spirv_byte_count = 0;
-            void* fragment_shader_spirv_bytes = file_util::readEntireFile(
-                p_build_info->fragment_shader_spirv_filepath,
-                &fragment_shader_spirv_byte_count
-            );
-            alwaysAssert(fragment_shader_spirv_bytes != NULL);
-            defer(free(fragment_shader_spirv_bytes));
+    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface.impl;
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
 
-            alwaysAssert(vertex_shader_spirv_byte_count % sizeof(u32) == 0);
-            alwaysAssert((uintptr_t)vertex_shader_spirv_bytes % alignof(u32) == 0);
+    LOG_F(INFO, "Attaching surface %p to renderer %p.", p_surface_resources, p_render_resources);
 
-            VkShaderModule fragment_shader_module = VK_NULL_HANDLE;
-            result = createShaderModuleFromSpirv(
-                device_,
-                (u32)fragment_shader_spirv_byte_count,
-                (const u32*)fragment_shader_spirv_bytes,
-                &fragment_shader_module
-            );
-            assertVk(result);
-            shader_modules_[pipeline_idx].fragment_shader_module = fragment_shader_module;
+    if (p_surface_resources->attached_render_resources != NULL) {
+        ABORT_F("Attempt to attach surface to renderer, but surface is already attached to a renderer.");
+    }
+    p_surface_resources->attached_render_resources = p_render_resources;
 
+    u32 swapchain_image_count = p_surface_resources->swapchain_image_count;
+    alwaysAssert(0 < swapchain_image_count);
 
-            PipelineAndLayout* p_pipeline = &pipelines_[pipeline_idx];
-            bool success = p_build_info->pfn_createPipeline(
-                device_,
-                vertex_shader_module, fragment_shader_module,
-                descriptor_set_layout_,
-                &p_pipeline->pipeline, &p_pipeline->layout
-            );
-            alwaysAssert(success);
-            LOG_F(
-                INFO, "Created pipeline index %" PRIuFAST32 ", handle %p.", pipeline_idx, p_pipeline->pipeline
-            );
-        }
-    }
 
+    VkExtent2D swapchain_extent = p_surface_resources->swapchain_extent;
 
-    {
-        ZoneScopedN("libshaderc init");
-        bool success = libshaderc_procs_.init();
-        // TODO FIXME we should just log an error message, disable the hot-reloading feature, and continue
-        // running. This isn't fatal, after all.
-        alwaysAssert(success);
 
-        libshaderc_compiler_ = libshaderc_procs_.compiler_initialize();
-        alwaysAssert(libshaderc_compiler_ != NULL);
-    }
+    result = vk_dev_procs.QueueWaitIdle(queue_); // ensure none of the command buffers are busy
+    assertVk(result);
 
+    createDepthPyramidBuffer(p_render_resources, swapchain_extent);
 
-    tracy::VkCtx* tracy_vk_ctx = NULL;
-    #ifdef TRACY_ENABLE
-    {
-        VkCommandPool tracy_command_pool = VK_NULL_HANDLE;
-        {
-            VkCommandPoolCreateInfo command_pool_info {
-                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-                .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-                .queueFamilyIndex = queue_family_,
-            };
-            result = vk_dev_procs.CreateCommandPool(device_, &command_pool_info, NULL, &tracy_command_pool);
-            assertVk(result);
-        }
+    for (u32 frame_idx = 0; frame_idx < p_render_resources->frames_in_flight; frame_idx++) {
 
-        VkCommandBuffer tracy_command_buffer = NULL;
-        {
-            VkCommandBufferAllocateInfo cmd_buf_alloc_info {
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-                .commandPool = tracy_command_pool,
-                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-                .commandBufferCount = 1,
-            };
-            result = vk_dev_procs.AllocateCommandBuffers(device_, &cmd_buf_alloc_info, &tracy_command_buffer);
-            assertVk(result);
-        }
+        RenderResourcesImpl::PerFrameResources* this_frame_resources =
+            &p_render_resources->frame_resources_array[frame_idx];
 
-        // TODO FIXME Use TracyVkContextCalibrated? (See Tracy manual for additonal required parameters)
-        tracy_vk_ctx = TracyVkContext(
-            instance_, physical_device_, device_, queue_, tracy_command_buffer,
-            vk_base_procs.GetInstanceProcAddr, vk_inst_procs.GetDeviceProcAddr
-        );
-        alwaysAssert(tracy_vk_ctx != NULL);
-    }
-    #endif
+        createSwapchainSizedImages(this_frame_resources, swapchain_extent);
 
 
-    // TODO FIXME: use this to store all these things, instead of just copying them over into it
-    vk_ctx_ = VulkanContext {
-        .procs_base = vk_base_procs,
-        .procs_inst = vk_inst_procs,
-        .procs_dev = vk_dev_procs,
+        VkCommandBuffer command_buffer = this_frame_resources->command_buffer;
 
-        .vma_allocator = vma_allocator_,
+        VkCommandBufferBeginInfo cmd_buf_begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        result = vk_dev_procs.BeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
+        assertVk(result);
 
-        .device = device_,
-        .queue_family_index = queue_family_,
-        .queue = queue_,
+        recordSwapchainSizedImageLayoutTransitions(command_buffer, this_frame_resources);
 
-        .physical_device_properties = physical_device_properties_,
+        result = vk_dev_procs.EndCommandBuffer(command_buffer);
+        assertVk(result);
 
-        .tracy_vk_ctx = tracy_vk_ctx,
-    };
+        VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+        };
+        result = vk_dev_procs.QueueSubmit(queue_, 1, &submit_info, VK_NULL_HANDLE);
+        assertVk(result);
 
+        // the frame's command buffer isn't pending, having been waited for above
+        writeSwapchainSizedDescriptors(p_render_resources, this_frame_resources);
+    }
 
-    initialized_ = true;
+    // wait for any command buffers we just submitted, such as barriers for image layout transitions
+    result = vk_dev_procs.QueueWaitIdle(queue_);
+    assertVk(result);
 }
 
+extern void detachSurfaceFromRenderer(SurfaceResources surface, RenderResources renderer) {
+    ZoneScoped;
 
-extern PresentModeFlags getSupportedPresentModes(SurfaceResources surface_resources) {
-    const SurfaceResourcesImpl* p_surface_resources = (const SurfaceResourcesImpl*)surface_resources.impl;
-    return p_surface_resources->supported_present_modes;
-};
+    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface.impl;
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
 
+    LOG_F(INFO, "Detaching surface %p from renderer %p.", p_surface_resources, p_render_resources);
 
-/// Returns VK_PRESENT_MODE_MAX_ENUM_KHR if there is no mode in `p_modes` whose priority > 0.
-static VkPresentModeKHR selectHighestPriorityPresentMode(
-    const PresentModePriorities priorities,
-    u32 mode_count,
-    VkPresentModeKHR* p_modes
-) {
-    VkPresentModeKHR highest_priority_mode = VK_PRESENT_MODE_MAX_ENUM_KHR;
-    u8 highest_priority = 0;
+    alwaysAssert(p_surface_resources->attached_render_resources == p_render_resources);
+    p_surface_resources->attached_render_resources = NULL;
 
-    for (u32fast mode_idx = 0; mode_idx < mode_count; mode_idx++) {
 
-        VkPresentModeKHR mode = p_modes[mode_idx];
-        if (mode >= (int)PRESENT_MODE_ENUM_COUNT) continue;
+    VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
+    assertVk(result);
 
-        u8 priority = priorities[mode];
-        if (priority <= highest_priority) continue;
+    releaseRetiredResources(p_render_resources, true);
 
-        highest_priority_mode = mode;
-        highest_priority = priority;
+    for (u32 frame_idx = 0; frame_idx < p_render_resources->frames_in_flight; frame_idx++) {
+        destroySwapchainSizedImages(&p_render_resources->frame_resources_array[frame_idx]);
     }
 
-    return highest_priority_mode;
-};
+    destroyDepthPyramidBuffer(
+        p_render_resources->depth_pyramid_buffer, p_render_resources->depth_pyramid_buffer_allocation
+    );
+    p_render_resources->depth_pyramid_buffer = VK_NULL_HANDLE;
+    p_render_resources->depth_pyramid_buffer_allocation = VMA_NULL;
+    p_render_resources->depth_pyramid_extent = VkExtent2D {};
+    p_render_resources->depth_pyramid_level_count = 0;
+    p_render_resources->depth_pyramid_valid = false;
+}
 
 
-extern Result createSurfaceResources(
-    VkSurfaceKHR surface,
+/// Use if a window resize has caused the resources to be out-of-date, or to switch present modes.
+/// Doesn't wait for the queue: the old swapchain is handed to the new one, and destroyed once the attached
+/// renderer's frames in flight are done with it.
+extern Result updateSurfaceResources(
+    SurfaceResources surface_resources,
     const PresentModePriorities present_mode_priorities,
     VkExtent2D fallback_window_size,
-    SurfaceResources* surface_resources_out,
     PresentMode* selected_present_mode_out
 ) {
     ZoneScoped;
 
-    SurfaceResourcesImpl* p_resources = (SurfaceResourcesImpl*)calloc(1, sizeof(SurfaceResourcesImpl));
-    assertErrno(p_resources != NULL);
-
-
-    p_resources->surface = surface;
-    p_resources->attached_render_resources = NULL;
-    p_resources->last_used_swapchain_image_acquired_semaphore_idx = 0;
+    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface_resources.impl;
+    // nothing to update; the size is fixed
+    if (p_surface_resources->offscreen) return Result::success;
 
 
     VkPresentModeKHR present_mode;
     {
         u32 supported_mode_count = 0;
-        VkPresentModeKHR* p_supported_modes = getSupportedVkPresentModes(surface, &supported_mode_count);
+        VkPresentModeKHR* p_supported_modes = getSupportedVkPresentModes(
+            p_surface_resources->surface, &supported_mode_count
+        );
         alwaysAssert(p_supported_modes != NULL);
         defer(free(p_supported_modes));
 
@@ -2784,7 +9222,7 @@ extern Result createSurfaceResources(
             }
         }
 
-        p_resources->supported_present_modes = supported_mode_flags;
+        p_surface_resources->supported_present_modes = supported_mode_flags;
 
         present_mode = selectHighestPriorityPresentMode(
             present_mode_priorities, supported_mode_count, p_supported_modes
@@ -2793,545 +9231,1016 @@ extern Result createSurfaceResources(
     }
 
 
-    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
-    VkExtent2D swapchain_extent {};
-    Result res = createSwapchain(
-        physical_device_, device_, surface, fallback_window_size, queue_family_, present_mode,
-        VK_NULL_HANDLE, // old_swapchain
-        &swapchain, &swapchain_extent
-    );
-    if (res == Result::error_window_size_zero) {
-        free(p_resources);
-        return res;
-    };
-    assertGraphics(res);
-
-    p_resources->swapchain = swapchain;
-    p_resources->swapchain_extent = swapchain_extent;
-
+    VkSwapchainKHR old_swapchain = p_surface_resources->swapchain;
+    VkSwapchainKHR new_swapchain = VK_NULL_HANDLE;
 
-    createPerSwapchainImageSurfaceResources(
-        swapchain,
-        &p_resources->swapchain_image_count,
-        &p_resources->swapchain_images,
-        &p_resources->swapchain_image_views,
-        &p_resources->swapchain_image_acquired_semaphores
+    Result res = createSwapchain(
+        physical_device_, device_, p_surface_resources->surface, fallback_window_size, queue_family_,
+        present_mode, old_swapchain, &new_swapchain, &p_surface_resources->swapchain_extent
     );
+    if (res == Result::error_window_size_zero) return res;
+    else assertGraphics(res);
 
+    p_surface_resources->swapchain = new_swapchain;
+    p_surface_resources->last_present_id = 0;
 
-    surface_resources_out->impl = p_resources;
-    if (selected_present_mode_out != NULL) *selected_present_mode_out = (PresentMode)present_mode;
-    return Result::success;
-}
 
+    // Destroy out-of-date resources, once they're not in use.
+    {
+        RenderResourcesImpl* p_render_resources = p_surface_resources->attached_render_resources;
+
+        const RenderResourcesImpl::RetiredResources retired {
+            .frames_left = (p_render_resources != NULL) ? p_render_resources->frames_in_flight : 0,
+            .swapchain = old_swapchain,
+            .swapchain_image_count = p_surface_resources->swapchain_image_count,
+            .swapchain_images = p_surface_resources->swapchain_images,
+            .swapchain_image_views = p_surface_resources->swapchain_image_views,
+            .swapchain_image_acquired_semaphores = p_surface_resources->swapchain_image_acquired_semaphores,
+            .depth_pyramid_buffer = VK_NULL_HANDLE,
+            .depth_pyramid_buffer_allocation = VMA_NULL,
+        };
 
-/// `renderer` must not currently have any surface attached.
-/// `surface` must not currently have any renderer attached.
-extern void attachSurfaceToRenderer(SurfaceResources surface, RenderResources renderer) {
-    ZoneScoped;
+        if (p_render_resources != NULL) {
+            // The frames in flight may still be drawing into, or presenting, the old images; the renderer destroys
+            // them once it has waited for each of them, so that a resize doesn't stall the queue.
+            p_render_resources->retired_resources.push(retired);
+        }
+        else {
+            ZoneScopedN("vkQueueWaitIdle");
 
-    VkResult result;
+            VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
+            assertVk(result);
 
-    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface.impl;
-    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+            destroyRetiredResources(&retired);
+        }
+    }
 
-    LOG_F(INFO, "Attaching surface %p to renderer %p.", p_surface_resources, p_render_resources);
+    // Recreate resources.
+    {
+        createPerSwapchainImageSurfaceResources(
+            new_swapchain,
+            &p_surface_resources->swapchain_image_count,
+            &p_surface_resources->swapchain_images,
+            &p_surface_resources->swapchain_image_views,
+            &p_surface_resources->swapchain_image_acquired_semaphores
+        );
 
-    if (p_surface_resources->attached_render_resources != NULL) {
-        ABORT_F("Attempt to attach surface to renderer, but surface is already attached to a renderer.");
+        p_surface_resources->last_used_swapchain_image_acquired_semaphore_idx = 0;
     }
-    p_surface_resources->attached_render_resources = p_render_resources;
 
-    u32 swapchain_image_count = p_surface_resources->swapchain_image_count;
-    alwaysAssert(0 < swapchain_image_count);
+    // If a renderer is attached, `render()` recreates its images the size of the swapchain, frame by frame; see
+    // `resizeSwapchainSizedFrameResources()`.
 
+    if (selected_present_mode_out != NULL) *selected_present_mode_out = (PresentMode)present_mode;
+    return Result::success;
+}
 
-    VkExtent2D swapchain_extent = p_surface_resources->swapchain_extent;
 
+extern Result createRenderer(
+    RenderResources* render_resources_out,
+    VkDeviceSize particles_buffer_size,
+    VkBuffer particles_buffer,
+    u32 frames_in_flight
+) {
+    ZoneScoped;
 
-    result = vk_dev_procs.QueueWaitIdle(queue_); // ensure none of the command buffers are busy
-    assertVk(result);
+    alwaysAssert(1 <= frames_in_flight and frames_in_flight <= MAX_FRAMES_IN_FLIGHT);
 
-    for (u32 frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; frame_idx++) {
+    VkResult result;
 
-        RenderResourcesImpl::PerFrameResources* this_frame_resources =
-            &p_render_resources->frame_resources_array[frame_idx];
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)calloc(1, sizeof(RenderResourcesImpl));
+    assertErrno(p_render_resources != NULL);
+    p_render_resources->frames_in_flight = frames_in_flight;
+    p_render_resources->render_scale = 1.f;
+    p_render_resources->particle_subsample_fraction = 1.f;
 
 
-        VkImageCreateInfo depth_image_info {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-            .imageType = VK_IMAGE_TYPE_2D,
-            .format = DEPTH_FORMAT,
-            .extent = VkExtent3D { swapchain_extent.width, swapchain_extent.height, 1 },
-            .mipLevels = 1,
-            .arrayLayers = 1,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .tiling = VK_IMAGE_TILING_OPTIMAL,
-            .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount = 1,
-            .pQueueFamilyIndices = &queue_family_,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        };
-        VmaAllocationCreateInfo depth_image_alloc_info {
-            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        };
-        result = vmaCreateImage(
-            vma_allocator_, &depth_image_info, &depth_image_alloc_info,
-            &this_frame_resources->depth_buffer,
-            &this_frame_resources->depth_buffer_allocation,
-            NULL // pAllocationInfo, an output parameter
-        );
-        assertVk(result);
+    // TODO find a way to couple this to other parts of descriptor creation and updating, so that you don't
+    // have to run around updating the code in 3-4 different places after forgetting and getting validation
+    // errors.
+    constexpr u32 descriptor_pool_size_count = 4;
+    VkDescriptorPoolSize descriptor_pool_sizes[descriptor_pool_size_count] {
+        {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = frames_in_flight,
+        },
+        // particles, visible voxels, voxel draw command, voxel mesh, particle grid, particle tiles, surface mesh,
+        // particle LOD, occlusion culling's but the depth buffer, picking's but the object id image, the particle
+        // interpolation, the vector field, the depth sort, and the density volume
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount =
+                (
+                    4 + PARTICLE_GRID_BINDING_COUNT + PARTICLE_TILES_BINDING_COUNT + SURFACE_MESH_BINDING_COUNT
+                    + PARTICLE_LOD_BINDING_COUNT + (OCCLUSION_BINDING_COUNT - 1) + (OBJECT_ID_BINDING_COUNT - 1)
+                    + PARTICLE_INTERPOLATION_BINDING_COUNT + VECTOR_FIELD_BINDING_COUNT
+                    + PARTICLE_DEPTH_SORT_BINDING_COUNT + 1
+                ) * frames_in_flight,
+        },
+        // fluid surface distances and their smoothing's intermediate, and the object id image
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 3 * frames_in_flight,
+        },
+        // fluid surface distances and thickness, the depth buffer of occlusion culling, and the scaled particles
+        {
+            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = (3 + SCALED_PARTICLE_BINDING_COUNT) * frames_in_flight,
+        },
+    };
+    VkDescriptorPoolCreateInfo descriptor_pool_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = frames_in_flight,
+        .poolSizeCount = descriptor_pool_size_count,
+        .pPoolSizes = descriptor_pool_sizes,
+    };
 
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    result = vk_dev_procs.CreateDescriptorPool(device_, &descriptor_pool_info, NULL, &descriptor_pool);
+    assertVk(result);
 
-        VkCommandBuffer command_buffer = this_frame_resources->command_buffer;
+    VkDescriptorSetLayout descriptor_set_layouts[MAX_FRAMES_IN_FLIGHT];
+    for (u32fast i = 0; i < frames_in_flight; i++)
+        descriptor_set_layouts[i] = descriptor_set_layout_;
+    VkDescriptorSetAllocateInfo descriptor_set_alloc_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = descriptor_pool,
+        .descriptorSetCount = frames_in_flight,
+        .pSetLayouts = descriptor_set_layouts,
+    };
 
-        VkCommandBufferBeginInfo cmd_buf_begin_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-        };
-        result = vk_dev_procs.BeginCommandBuffer(command_buffer, &cmd_buf_begin_info);
-        assertVk(result);
+    VkDescriptorSet descriptor_sets[MAX_FRAMES_IN_FLIGHT] {};
+    result = vk_dev_procs.AllocateDescriptorSets(device_, &descriptor_set_alloc_info, descriptor_sets);
+    assertVk(result);
+    // NOTE: these descriptor sets need to be copied into the per-frame structs in this procedure
 
-        constexpr u32 image_barrier_count = 1;
-        VkImageMemoryBarrier image_barriers[image_barrier_count] {
-            // depth image
-            {
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                .srcAccessMask = VK_ACCESS_NONE,
-                .dstAccessMask =
-                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                .newLayout = DEPTH_IMAGE_LAYOUT,
-                .srcQueueFamilyIndex = queue_family_,
-                .dstQueueFamilyIndex = queue_family_,
-                .image = this_frame_resources->depth_buffer,
-                .subresourceRange = {
-                    .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount = 1,
-                },
-            },
-        };
 
-        vk_dev_procs.CmdPipelineBarrier(
-            command_buffer,
-            // TOP_OF_PIPE_BIT "specifies no stage of execution when specified in the first scope"
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // srcStageMask
-            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // dstStageMask
-            0, // dependencyFlags
-            0, // memoryBarrierCount
-            NULL, // pMemoryBarriers
-            0, // bufferMemoryBarrierCount
-            NULL, // pBufferMemoryBarriers
-            image_barrier_count, // imageMemoryBarrierCount
-            image_barriers // pImageMemoryBarriers
-        );
+    const VkCommandPoolCreateInfo command_pool_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queue_family_,
+    };
 
-        result = vk_dev_procs.EndCommandBuffer(command_buffer);
-        assertVk(result);
+    result = vk_dev_procs.CreateCommandPool(
+        device_, &command_pool_info, NULL, &p_render_resources->command_pool
+    );
+    assertVk(result);
 
-        VkSubmitInfo submit_info {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &command_buffer,
+    VkCommandBuffer command_buffers[MAX_FRAMES_IN_FLIGHT] {};
+    {
+        VkCommandBufferAllocateInfo cmd_buf_alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = p_render_resources->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = frames_in_flight,
         };
-        result = vk_dev_procs.QueueSubmit(queue_, 1, &submit_info, VK_NULL_HANDLE);
+        result = vk_dev_procs.AllocateCommandBuffers(device_, &cmd_buf_alloc_info, command_buffers);
         assertVk(result);
+    }
+    // NOTE: these command buffers need to be copied into the per-frame structs in this procedure
 
 
-        VkImageViewCreateInfo depth_image_view_info {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .image = this_frame_resources->depth_buffer,
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = DEPTH_FORMAT,
-            .components = {
-                .r = VK_COMPONENT_SWIZZLE_R,
-                .g = VK_COMPONENT_SWIZZLE_G,
-                .b = VK_COMPONENT_SWIZZLE_B,
-                .a = VK_COMPONENT_SWIZZLE_A,
-            },
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
+    {
+        VkBufferCreateInfo voxel_mesh_buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = MAX_VOXEL_QUAD_COUNT * sizeof(VoxelQuad),
+            // the transfers are the mesh's edits; `recordPick()` draws it whole, as a vertex buffer
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                   | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
         };
-        result = vk_dev_procs.CreateImageView(
-            device_,
-            &depth_image_view_info,
-            NULL,
-            &this_frame_resources->depth_buffer_view
+        VmaAllocationCreateInfo voxel_mesh_buffer_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo voxel_mesh_buffer_allocation_info {};
+        result = vmaCreateBuffer(
+            vma_allocator_, &voxel_mesh_buffer_info, &voxel_mesh_buffer_alloc_info,
+            &p_render_resources->voxel_mesh_buffer, &p_render_resources->voxel_mesh_buffer_allocation,
+            &voxel_mesh_buffer_allocation_info
         );
         assertVk(result);
+        memory_usage_.voxel_buffer_bytes += voxel_mesh_buffer_allocation_info.size;
+        TracyAllocN(p_render_resources->voxel_mesh_buffer, voxel_mesh_buffer_allocation_info.size, "gfx voxel buffer");
+
+        p_render_resources->voxel_store = NULL;
+        p_render_resources->voxel_mesh = createVoxelMesh(MAX_VOXEL_QUAD_COUNT);
+        p_render_resources->voxel_mesh_cleared_ranges = ArrayList<VoxelQuadRange>::create();
+        p_render_resources->voxel_mesh_staged_quads = ArrayList<VoxelQuad>::create();
+        p_render_resources->voxel_mesh_copies = ArrayList<VoxelQuadCopy>::create();
     }
 
-    // wait for any command buffers we just submitted, such as barriers for image layout transitions
-    result = vk_dev_procs.QueueWaitIdle(queue_);
-    assertVk(result);
-}
-
-extern void detachSurfaceFromRenderer(SurfaceResources surface, RenderResources renderer) {
-    ZoneScoped;
-
-    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface.impl;
-    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
-
-    LOG_F(INFO, "Detaching surface %p from renderer %p.", p_surface_resources, p_render_resources);
-
-    alwaysAssert(p_surface_resources->attached_render_resources == p_render_resources);
-    p_surface_resources->attached_render_resources = NULL;
-
+    {
+        VkBufferCreateInfo outlined_voxels_buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = MAX_OUTLINED_VOXEL_COUNT * sizeof(ivec3),
+            .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+        };
+        VmaAllocationCreateInfo outlined_voxels_buffer_alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+        VmaAllocationInfo outlined_voxels_buffer_allocation_info {};
+        result = vmaCreateBuffer(
+            vma_allocator_, &outlined_voxels_buffer_info, &outlined_voxels_buffer_alloc_info,
+            &p_render_resources->outlined_voxels_buffer, &p_render_resources->outlined_voxels_buffer_allocation,
+            &outlined_voxels_buffer_allocation_info
+        );
+        assertVk(result);
+        memory_usage_.voxel_buffer_bytes += outlined_voxels_buffer_allocation_info.size;
+        TracyAllocN(
+            p_render_resources->outlined_voxels_buffer, outlined_voxels_buffer_allocation_info.size, "gfx voxel buffer"
+        );
 
-    VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
-    assertVk(result);
+        p_render_resources->outlined_voxel_count = 0;
+        p_render_resources->outlined_voxels_staged = ArrayList<ivec3>::create();
+        p_render_resources->retired_resources = ArrayList<RenderResourcesImpl::RetiredResources>::create();
+        p_render_resources->outlined_voxels_dirty = false;
+        // the mesh starts out with only empty quads; the first frame clears the buffer to match
+        p_render_resources->voxel_mesh_cleared_ranges.push(VoxelQuadRange {
+            .first = 0,
+            .count = MAX_VOXEL_QUAD_COUNT,
+        });
+    }
 
-    for (u32 frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; frame_idx++) {
+    // shared by the frames, since each build reads the previous one; see `recordSurfaceMesh()`
+    {
+        const VkDeviceSize buffer_sizes[SURFACE_MESH_BUFFER_COUNT] {
+            2 * SURFACE_MESH_BLOCK_TABLE_SIZE * SURFACE_MESH_BLOCK_SLOT_SIZE, // block slots
+            SURFACE_MESH_BLOCK_CAPACITY * SURFACE_MESH_BLOCK_SIZE, // blocks
+            SURFACE_MESH_BLOCK_CAPACITY * SURFACE_MESH_BLOCK_SAMPLE_COUNT * sizeof(f32), // densities
+            2 * SURFACE_MESH_VERTEX_CAPACITY * sizeof(vec4), // vertices
+            sizeof(SurfaceMeshState), // state
+        };
+        const VkBufferUsageFlags extra_usages[SURFACE_MESH_BUFFER_COUNT] {
+            0,
+            0,
+            0,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        };
+        VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
 
-        RenderResourcesImpl::PerFrameResources* this_frame_resources =
-            &p_render_resources->frame_resources_array[frame_idx];
+        for (u32 i = 0; i < SURFACE_MESH_BUFFER_COUNT; i++)
+        {
+            VkBufferCreateInfo buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = buffer_sizes[i],
+                // the block slots and the state are cleared by `vkCmdFillBuffer`
+                .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | extra_usages[i],
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
 
-        vk_dev_procs.DestroyImageView(device_, this_frame_resources->depth_buffer_view, NULL);
-        vmaDestroyImage(
-            vma_allocator_,
-            this_frame_resources->depth_buffer,
-            this_frame_resources->depth_buffer_allocation
-        );
-        this_frame_resources->depth_buffer = VK_NULL_HANDLE;
-        this_frame_resources->depth_buffer_allocation = VMA_NULL;
+            VmaAllocationInfo allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &buffer_info, &alloc_info,
+                &p_render_resources->surface_mesh_buffers[i], &p_render_resources->surface_mesh_buffer_allocations[i],
+                &allocation_info
+            );
+            assertVk(result);
+            memory_usage_.surface_mesh_buffer_bytes += allocation_info.size;
+            TracyAllocN(p_render_resources->surface_mesh_buffers[i], allocation_info.size, "gfx surface mesh buffers");
+        }
+        // nothing was built yet
+        p_render_resources->surface_mesh_copy = 0;
+        p_render_resources->surface_mesh_valid = false;
     }
-}
 
+    // shared by the frames, since a sort's order is reused by the next frames; see `recordParticleDepthSort()`
+    {
+        const VkDeviceSize particle_capacity = particles_buffer_size / sizeof(Particle);
+        const VkDeviceSize array_size = math::max(particle_capacity, (VkDeviceSize)1) * sizeof(u32);
+        const VkDeviceSize buffer_sizes[PARTICLE_DEPTH_SORT_BUFFER_COUNT] {
+            array_size, // keys
+            array_size, // values
+            array_size,
+            array_size,
+            math::max(particle_capacity, (VkDeviceSize)1) * sizeof(Particle), // sorted particles
+        };
+        VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
 
-/// Use if a window resize has caused the resources to be out-of-date, or to switch present modes.
-extern Result updateSurfaceResources(
-    SurfaceResources surface_resources,
-    const PresentModePriorities present_mode_priorities,
-    VkExtent2D fallback_window_size,
-    PresentMode* selected_present_mode_out
-) {
-    ZoneScoped;
-
-    SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface_resources.impl;
+        for (u32 i = 0; i < PARTICLE_DEPTH_SORT_BUFFER_COUNT; i++)
+        {
+            // the sorted particles are drawn as instances
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if (i == PARTICLE_DEPTH_SORT_BUFFER_SORTED_PARTICLES) usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            VkBufferCreateInfo buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = buffer_sizes[i],
+                .usage = usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
 
+            VmaAllocationInfo allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &buffer_info, &alloc_info,
+                &p_render_resources->particle_depth_sort_buffers[i],
+                &p_render_resources->particle_depth_sort_buffer_allocations[i],
+                &allocation_info
+            );
+            assertVk(result);
+            memory_usage_.particle_depth_sort_buffer_bytes += allocation_info.size;
+            TracyAllocN(
+                p_render_resources->particle_depth_sort_buffers[i], allocation_info.size, "gfx depth sort buffers"
+            );
+        }
 
-    VkPresentModeKHR present_mode;
-    {
-        u32 supported_mode_count = 0;
-        VkPresentModeKHR* p_supported_modes = getSupportedVkPresentModes(
-            p_surface_resources->surface, &supported_mode_count
+        const VkBuffer* b = p_render_resources->particle_depth_sort_buffers;
+        const gpu_primitives::BufferRange keys[2] {
+            { b[PARTICLE_DEPTH_SORT_BUFFER_KEYS_0], 0, VK_WHOLE_SIZE },
+            { b[PARTICLE_DEPTH_SORT_BUFFER_KEYS_1], 0, VK_WHOLE_SIZE },
+        };
+        const gpu_primitives::BufferRange values[2] {
+            { b[PARTICLE_DEPTH_SORT_BUFFER_VALUES_0], 0, VK_WHOLE_SIZE },
+            { b[PARTICLE_DEPTH_SORT_BUFFER_VALUES_1], 0, VK_WHOLE_SIZE },
+        };
+        p_render_resources->particle_depth_sort_plan = gpu_primitives::createRadixSort(
+            gpu_primitives_, &vk_ctx_, keys, values, (u32)particle_capacity
         );
-        alwaysAssert(p_supported_modes != NULL);
-        defer(free(p_supported_modes));
+        memory_usage_.particle_depth_sort_buffer_bytes +=
+            gpu_primitives::getScratchSize(p_render_resources->particle_depth_sort_plan);
 
-        PresentModeFlags supported_mode_flags = 0;
-        for (u32fast i = 0; i < supported_mode_count; i++) {
-            VkPresentModeKHR mode = p_supported_modes[i];
-            if (p_supported_modes[i] < (int)PRESENT_MODE_ENUM_COUNT) {
-                supported_mode_flags |= PresentModeFlagBits_fromMode((PresentMode)mode);
-            }
-        }
+        // nothing was sorted yet
+        p_render_resources->particle_depth_sort_valid = false;
+    }
 
-        p_surface_resources->supported_present_modes = supported_mode_flags;
+    // shared by the frames, like the surface mesh's; see `recordDensityVolume()`
+    {
+        VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = DENSITY_VOLUME_BUFFER_SIZE,
+            // cleared by `vkCmdFillBuffer` before each splat
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &queue_family_,
+        };
+        VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
 
-        present_mode = selectHighestPriorityPresentMode(
-            present_mode_priorities, supported_mode_count, p_supported_modes
+        VmaAllocationInfo allocation_info {};
+        result = vmaCreateBuffer(
+            vma_allocator_, &buffer_info, &alloc_info,
+            &p_render_resources->density_volume_buffer, &p_render_resources->density_volume_buffer_allocation,
+            &allocation_info
         );
-        alwaysAssert(present_mode != VK_PRESENT_MODE_MAX_ENUM_KHR);
+        assertVk(result);
+        memory_usage_.density_volume_buffer_bytes += allocation_info.size;
+        TracyAllocN(p_render_resources->density_volume_buffer, allocation_info.size, "gfx density volume buffer");
     }
 
+    for (u32fast frame_idx = 0; frame_idx < frames_in_flight; frame_idx++) {
 
-    VkSwapchainKHR old_swapchain = p_surface_resources->swapchain;
-    VkSwapchainKHR new_swapchain = VK_NULL_HANDLE;
-
-    Result res = createSwapchain(
-        physical_device_, device_, p_surface_resources->surface, fallback_window_size, queue_family_,
-        present_mode, old_swapchain, &new_swapchain, &p_surface_resources->swapchain_extent
-    );
-    if (res == Result::error_window_size_zero) return res;
-    else assertGraphics(res);
+        RenderResourcesImpl::PerFrameResources* this_frame_resources =
+            &p_render_resources->frame_resources_array[frame_idx];
 
-    p_surface_resources->swapchain = new_swapchain;
+        this_frame_resources->command_buffer = command_buffers[frame_idx];
+        this_frame_resources->descriptor_set = descriptor_sets[frame_idx];
 
+        VkFence* p_fence = &p_render_resources->frame_resources_array[frame_idx].command_buffer_pending_fence;
+        {
+            VkFenceCreateInfo fence_info {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+            result = vk_dev_procs.CreateFence(device_, &fence_info, NULL, p_fence);
+            assertVk(result);
+        }
 
-    // Destory out-of-date resources.
-    {
-        // Make sure they're not in use.
+        VkSemaphore* p_semaphore = &p_render_resources->frame_resources_array[frame_idx].render_finished_semaphore;
         {
-            ZoneScopedN("vkQueueWaitIdle");
+            VkSemaphoreCreateInfo semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+            result = vk_dev_procs.CreateSemaphore(device_, &semaphore_info, NULL, p_semaphore);
+            assertVk(result);
+        }
 
-            VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
+        if (physical_device_properties_.limits.timestampComputeAndGraphics) {
+            const VkQueryPoolCreateInfo query_pool_info {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = TIMESTAMP_QUERY_COUNT,
+            };
+            result = vk_dev_procs.CreateQueryPool(
+                device_, &query_pool_info, NULL, &this_frame_resources->timestamp_query_pool
+            );
             assertVk(result);
         }
+        else if (frame_idx == 0) {
+            LOG_F(WARNING, "Can't time the render passes, because the device doesn't support timestamps.");
+        }
 
-        destroyPerSwapchainImageSurfaceResources(
-            p_surface_resources->swapchain_image_count,
-            p_surface_resources->swapchain_images,
-            p_surface_resources->swapchain_image_views,
-            p_surface_resources->swapchain_image_acquired_semaphores
-        );
+        VkBuffer* p_uniform_buffer = &this_frame_resources->uniform_buffer;
+        VmaAllocation* p_uniform_buffer_allocation = &this_frame_resources->uniform_buffer_allocation;
+        VmaAllocationInfo* p_uniform_buffer_allocation_info = &this_frame_resources->uniform_buffer_allocation_info;
+        {
+            // TODO are we guaranteed to have a memory type supporting both HOST_VISIBLE and USAGE_UNIFORM_BUFFER?
+            VkBufferCreateInfo uniform_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = sizeof(UniformBuffer),
+                // rewritten with `vkCmdUpdateBuffer()` for each extra view; see `recordExtraView()`
+                .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo uniform_buffer_alloc_info {
+                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                       | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .usage = VMA_MEMORY_USAGE_AUTO,
+                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            };
+            result = vmaCreateBuffer(
+                vma_allocator_, &uniform_buffer_info, &uniform_buffer_alloc_info,
+                p_uniform_buffer, p_uniform_buffer_allocation, p_uniform_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += p_uniform_buffer_allocation_info->size;
+            TracyAllocN(*p_uniform_buffer, p_uniform_buffer_allocation_info->size, "gfx frame buffers");
+        }
 
-        vk_dev_procs.DestroySwapchainKHR(device_, old_swapchain, NULL);
-    }
+        VkBuffer* p_voxels_staging_buffer = &this_frame_resources->voxels_staging_buffer;
+        VmaAllocation* p_voxels_staging_buffer_allocation = &this_frame_resources->voxels_staging_buffer_allocation;
+        VmaAllocationInfo* p_voxels_staging_buffer_allocation_info = &this_frame_resources->voxels_staging_buffer_allocation_info;
+        {
+            VkBufferCreateInfo voxels_staging_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = VOXEL_MESH_STAGING_QUAD_COUNT * sizeof(VoxelQuad),
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo voxels_staging_buffer_alloc_info {
+                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                       | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            };
+            result = vmaCreateBuffer(
+                vma_allocator_, &voxels_staging_buffer_info, &voxels_staging_buffer_alloc_info,
+                p_voxels_staging_buffer, p_voxels_staging_buffer_allocation, p_voxels_staging_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += p_voxels_staging_buffer_allocation_info->size;
+            TracyAllocN(*p_voxels_staging_buffer, p_voxels_staging_buffer_allocation_info->size, "gfx frame buffers");
+        }
 
-    // Recreate resources.
-    {
-        createPerSwapchainImageSurfaceResources(
-            new_swapchain,
-            &p_surface_resources->swapchain_image_count,
-            &p_surface_resources->swapchain_images,
-            &p_surface_resources->swapchain_image_views,
-            &p_surface_resources->swapchain_image_acquired_semaphores
-        );
+        VkBuffer* p_outlined_voxel_coords_buffer = &this_frame_resources->outlined_voxels_staging_buffer;
+        VmaAllocation* p_outlined_voxel_coords_buffer_allocation = &this_frame_resources->outlined_voxels_staging_buffer_allocation;
+        VmaAllocationInfo* p_outlined_voxel_coords_buffer_allocation_info = &this_frame_resources->outlined_voxels_staging_buffer_allocation_info;
+        {
+            VkBufferCreateInfo cube_outlines_coords_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = MAX_OUTLINED_VOXEL_COUNT * sizeof(ivec3),
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo cube_outlines_coords_buffer_alloc_info {
+                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                       | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .usage = VMA_MEMORY_USAGE_AUTO,
+                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            };
+            result = vmaCreateBuffer(
+                vma_allocator_, &cube_outlines_coords_buffer_info, &cube_outlines_coords_buffer_alloc_info,
+                p_outlined_voxel_coords_buffer, p_outlined_voxel_coords_buffer_allocation, p_outlined_voxel_coords_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += p_outlined_voxel_coords_buffer_allocation_info->size;
+            TracyAllocN(*p_outlined_voxel_coords_buffer, p_outlined_voxel_coords_buffer_allocation_info->size, "gfx frame buffers");
+        }
 
-        p_surface_resources->last_used_swapchain_image_acquired_semaphore_idx = 0;
-    }
+        {
+            VkBufferCreateInfo visible_voxels_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = MAX_VOXEL_QUAD_COUNT * sizeof(VoxelQuad),
+                .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VkBufferCreateInfo voxel_draw_command_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = sizeof(VoxelCullCommands),
+                .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                       | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
 
-    RenderResourcesImpl* p_render_resources = p_surface_resources->attached_render_resources;
-    if (p_render_resources != NULL) { // a renderer is attached
-        // OPTIMIZE: defaulted to nuclear option here; consider whether we want to do this more efficiently.
-        detachSurfaceFromRenderer(surface_resources, RenderResources { .impl = p_render_resources });
-        attachSurfaceToRenderer(surface_resources, RenderResources { .impl = p_render_resources });
-    }
+            VmaAllocationInfo visible_voxels_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &visible_voxels_buffer_info, &alloc_info,
+                &this_frame_resources->visible_voxels_buffer,
+                &this_frame_resources->visible_voxels_buffer_allocation,
+                &visible_voxels_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += visible_voxels_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->visible_voxels_buffer, visible_voxels_buffer_allocation_info.size, "gfx frame buffers");
 
-    if (selected_present_mode_out != NULL) *selected_present_mode_out = (PresentMode)present_mode;
-    return Result::success;
-}
+            VmaAllocationInfo voxel_draw_command_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &voxel_draw_command_buffer_info, &alloc_info,
+                &this_frame_resources->voxel_draw_command_buffer,
+                &this_frame_resources->voxel_draw_command_buffer_allocation,
+                &voxel_draw_command_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += voxel_draw_command_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->voxel_draw_command_buffer, voxel_draw_command_buffer_allocation_info.size, "gfx frame buffers");
+        }
 
+        {
+            VkBufferCreateInfo occluded_voxels_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = MAX_VOXEL_QUAD_COUNT * sizeof(VoxelQuad),
+                .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            // a cluster per `PARTICLE_CLUSTER_SIZE` particles of the particle buffer
+            const VkDeviceSize max_cluster_count =
+                (particles_buffer_size / sizeof(Particle) + PARTICLE_CLUSTER_SIZE - 1) / PARTICLE_CLUSTER_SIZE;
+            VkBufferCreateInfo particle_occlusion_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = sizeof(ParticleOcclusion) + max_cluster_count * sizeof(u32),
+                .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                       | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
 
-extern Result createRenderer(
-    RenderResources* render_resources_out,
-    VkDeviceSize particles_buffer_size,
-    VkBuffer particles_buffer
-) {
-    ZoneScoped;
+            VmaAllocationInfo occluded_voxels_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &occluded_voxels_buffer_info, &alloc_info,
+                &this_frame_resources->occluded_voxels_buffer,
+                &this_frame_resources->occluded_voxels_buffer_allocation,
+                &occluded_voxels_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += occluded_voxels_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->occluded_voxels_buffer, occluded_voxels_buffer_allocation_info.size, "gfx frame buffers");
 
-    VkResult result;
+            VmaAllocationInfo particle_occlusion_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &particle_occlusion_buffer_info, &alloc_info,
+                &this_frame_resources->particle_occlusion_buffer,
+                &this_frame_resources->particle_occlusion_buffer_allocation,
+                &particle_occlusion_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += particle_occlusion_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->particle_occlusion_buffer, particle_occlusion_buffer_allocation_info.size, "gfx frame buffers");
+        }
 
-    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)calloc(1, sizeof(RenderResourcesImpl));
-    assertErrno(p_render_resources != NULL);
+        {
+            const VkDeviceSize buffer_sizes[PARTICLE_TILES_BINDING_COUNT] {
+                MAX_PARTICLE_TILE_COUNT * sizeof(uvec2), // counts and depth bounds
+                MAX_PARTICLE_TILE_COUNT * sizeof(uvec2), // ranges
+                PARTICLE_TILE_ENTRY_CAPACITY * sizeof(uvec2), // entries
+            };
+            VkBuffer* const p_buffers[PARTICLE_TILES_BINDING_COUNT] {
+                &this_frame_resources->particle_tile_counts_buffer,
+                &this_frame_resources->particle_tile_ranges_buffer,
+                &this_frame_resources->particle_tile_entries_buffer,
+            };
+            VmaAllocation* const p_allocations[PARTICLE_TILES_BINDING_COUNT] {
+                &this_frame_resources->particle_tile_counts_buffer_allocation,
+                &this_frame_resources->particle_tile_ranges_buffer_allocation,
+                &this_frame_resources->particle_tile_entries_buffer_allocation,
+            };
+            VmaAllocationCreateInfo alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
 
+            for (u32 i = 0; i < PARTICLE_TILES_BINDING_COUNT; i++)
+            {
+                VkBufferCreateInfo buffer_info {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = buffer_sizes[i],
+                    // the counts are zeroed by `vkCmdFillBuffer`
+                    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = 1,
+                    .pQueueFamilyIndices = &queue_family_,
+                };
+
+                VmaAllocationInfo allocation_info {};
+                result = vmaCreateBuffer(
+                    vma_allocator_, &buffer_info, &alloc_info, p_buffers[i], p_allocations[i], &allocation_info
+                );
+                assertVk(result);
+                memory_usage_.frame_buffer_bytes += allocation_info.size;
+                TracyAllocN(*p_buffers[i], allocation_info.size, "gfx frame buffers");
+            }
+        }
 
-    // TODO find a way to couple this to other parts of descriptor creation and updating, so that you don't
-    // have to run around updating the code in 3-4 different places after forgetting and getting validation
-    // errors.
-    constexpr u32 descriptor_pool_size_count = 3;
-    VkDescriptorPoolSize descriptor_pool_sizes[descriptor_pool_size_count] {
-        {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-        },
         {
-            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-        },
-        {
-            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-        },
-    };
-    VkDescriptorPoolCreateInfo descriptor_pool_info {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = MAX_FRAMES_IN_FLIGHT,
-        .poolSizeCount = descriptor_pool_size_count,
-        .pPoolSizes = descriptor_pool_sizes,
-    };
-
-    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
-    result = vk_dev_procs.CreateDescriptorPool(device_, &descriptor_pool_info, NULL, &descriptor_pool);
-    assertVk(result);
+            // A cell's particles are replaced by at most as many instances.
+            VkBufferCreateInfo particle_lod_instances_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = (particles_buffer_size / sizeof(Particle)) * sizeof(ParticleLodInstance),
+                .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VkBufferCreateInfo particle_lod_draw_command_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = sizeof(VkDrawIndirectCommand),
+                .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                       | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
 
-    VkDescriptorSetLayout descriptor_set_layouts[MAX_FRAMES_IN_FLIGHT];
-    for (u32fast i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        descriptor_set_layouts[i] = descriptor_set_layout_;
-    VkDescriptorSetAllocateInfo descriptor_set_alloc_info {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pool,
-        .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
-        .pSetLayouts = descriptor_set_layouts,
-    };
+            VmaAllocationInfo particle_lod_instances_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &particle_lod_instances_buffer_info, &alloc_info,
+                &this_frame_resources->particle_lod_instances_buffer,
+                &this_frame_resources->particle_lod_instances_buffer_allocation,
+                &particle_lod_instances_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += particle_lod_instances_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->particle_lod_instances_buffer, particle_lod_instances_buffer_allocation_info.size, "gfx frame buffers");
 
-    VkDescriptorSet descriptor_sets[MAX_FRAMES_IN_FLIGHT] {};
-    result = vk_dev_procs.AllocateDescriptorSets(device_, &descriptor_set_alloc_info, descriptor_sets);
-    assertVk(result);
-    // NOTE: these descriptor sets need to be copied into the per-frame structs in this procedure
+            VmaAllocationInfo particle_lod_draw_command_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &particle_lod_draw_command_buffer_info, &alloc_info,
+                &this_frame_resources->particle_lod_draw_command_buffer,
+                &this_frame_resources->particle_lod_draw_command_buffer_allocation,
+                &particle_lod_draw_command_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += particle_lod_draw_command_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->particle_lod_draw_command_buffer, particle_lod_draw_command_buffer_allocation_info.size, "gfx frame buffers");
+        }
 
+        {
+            // at most a segment per particle; see vector_field.comp
+            const VkDeviceSize buffer_sizes[3] {
+                (particles_buffer_size / sizeof(Particle)) * 2 * sizeof(vec3),
+                sizeof(VkDrawIndirectCommand),
+                VECTOR_FIELD_CLAIM_CAPACITY * sizeof(u32),
+            };
+            const VkBufferUsageFlags buffer_usages[3] {
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                // reset by `vkCmdUpdateBuffer`
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                    | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                // cleared by `vkCmdFillBuffer`
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            };
+            VkBuffer* const p_buffers[3] {
+                &this_frame_resources->vector_field_segments_buffer,
+                &this_frame_resources->vector_field_draw_command_buffer,
+                &this_frame_resources->vector_field_claims_buffer,
+            };
+            VmaAllocation* const p_allocations[3] {
+                &this_frame_resources->vector_field_segments_buffer_allocation,
+                &this_frame_resources->vector_field_draw_command_buffer_allocation,
+                &this_frame_resources->vector_field_claims_buffer_allocation,
+            };
+            VmaAllocationCreateInfo alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
 
-    const VkCommandPoolCreateInfo command_pool_info {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queue_family_,
-    };
+            for (u32 i = 0; i < 3; i++)
+            {
+                VkBufferCreateInfo buffer_info {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = buffer_sizes[i],
+                    .usage = buffer_usages[i],
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = 1,
+                    .pQueueFamilyIndices = &queue_family_,
+                };
+
+                VmaAllocationInfo allocation_info {};
+                result = vmaCreateBuffer(
+                    vma_allocator_, &buffer_info, &alloc_info, p_buffers[i], p_allocations[i], &allocation_info
+                );
+                assertVk(result);
+                memory_usage_.frame_buffer_bytes += allocation_info.size;
+                TracyAllocN(*p_buffers[i], allocation_info.size, "gfx frame buffers");
+            }
+        }
 
-    result = vk_dev_procs.CreateCommandPool(
-        device_, &command_pool_info, NULL, &p_render_resources->command_pool
-    );
-    assertVk(result);
+        {
+            // the transfers are `recordPick()`'s clears; the results are read on the host, so they're written there
+            // directly, rather than copied
+            VkBufferCreateInfo pick_results_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = sizeof(PickResultsHeader) + MAX_PICKED_OBJECT_COUNT * sizeof(u32),
+                .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo pick_results_buffer_alloc_info {
+                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .usage = VMA_MEMORY_USAGE_AUTO,
+                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            };
+            result = vmaCreateBuffer(
+                vma_allocator_, &pick_results_buffer_info, &pick_results_buffer_alloc_info,
+                &this_frame_resources->pick_results_buffer, &this_frame_resources->pick_results_buffer_allocation,
+                &this_frame_resources->pick_results_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += this_frame_resources->pick_results_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->pick_results_buffer, this_frame_resources->pick_results_buffer_allocation_info.size, "gfx frame buffers");
 
-    VkCommandBuffer command_buffers[MAX_FRAMES_IN_FLIGHT] {};
-    {
-        VkCommandBufferAllocateInfo cmd_buf_alloc_info {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = p_render_resources->command_pool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
-        };
-        result = vk_dev_procs.AllocateCommandBuffers(device_, &cmd_buf_alloc_info, command_buffers);
-        assertVk(result);
+            VkBufferCreateInfo pick_id_set_buffer_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = PICK_ID_SET_SIZE * sizeof(u32),
+                .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 1,
+                .pQueueFamilyIndices = &queue_family_,
+            };
+            VmaAllocationCreateInfo pick_id_set_buffer_alloc_info {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
+            VmaAllocationInfo pick_id_set_buffer_allocation_info {};
+            result = vmaCreateBuffer(
+                vma_allocator_, &pick_id_set_buffer_info, &pick_id_set_buffer_alloc_info,
+                &this_frame_resources->pick_id_set_buffer, &this_frame_resources->pick_id_set_buffer_allocation,
+                &pick_id_set_buffer_allocation_info
+            );
+            assertVk(result);
+            memory_usage_.frame_buffer_bytes += pick_id_set_buffer_allocation_info.size;
+            TracyAllocN(this_frame_resources->pick_id_set_buffer, pick_id_set_buffer_allocation_info.size, "gfx frame buffers");
+        }
     }
-    // NOTE: these command buffers need to be copied into the per-frame structs in this procedure
 
 
-    for (u32fast frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; frame_idx++) {
+    // TODO instead of hardcoding 3 here and other places, you can create an enum Descriptor where you encode
+    // this info, with descriptors_per_frame_count = Descriptor_COUNT.
+    // Then you can use the descriptor enum names as indices intead of hardcoding 0, 1, 2 here and elsewhere.
+    constexpr u32 descriptors_per_frame_count =
+        5 + PARTICLE_TILES_BINDING_COUNT + SURFACE_MESH_BINDING_COUNT + PARTICLE_LOD_BINDING_COUNT + 2
+        + (OBJECT_ID_BINDING_COUNT - 1) + PARTICLE_DEPTH_SORT_BINDING_COUNT + 1;
+    constexpr u32 max_descriptor_write_count = MAX_FRAMES_IN_FLIGHT * descriptors_per_frame_count;
+    const u32 descriptor_write_count = frames_in_flight * descriptors_per_frame_count;
+
+    VkDescriptorBufferInfo descriptor_buffer_infos[max_descriptor_write_count] {};
+    VkWriteDescriptorSet descriptor_writes[max_descriptor_write_count] {};
+    u32fast descriptor_write_idx = 0;
 
-        RenderResourcesImpl::PerFrameResources* this_frame_resources =
-            &p_render_resources->frame_resources_array[frame_idx];
+    for (u32fast frame_idx = 0; frame_idx < frames_in_flight; frame_idx++) {
 
-        this_frame_resources->command_buffer = command_buffers[frame_idx];
-        this_frame_resources->descriptor_set = descriptor_sets[frame_idx];
+        {
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = p_render_resources->frame_resources_array[frame_idx].uniform_buffer,
+                .offset = 0,
+                .range = sizeof(UniformBuffer),
+            };
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = 0,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
+            };
+        }
+        descriptor_write_idx++;
 
-        VkFence* p_fence = &p_render_resources->frame_resources_array[frame_idx].command_buffer_pending_fence;
         {
-            VkFenceCreateInfo fence_info {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = particles_buffer,
+                .offset = 0,
+                .range = particles_buffer_size,
+            };
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = 2,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
             };
-            result = vk_dev_procs.CreateFence(device_, &fence_info, NULL, p_fence);
-            assertVk(result);
         }
+        descriptor_write_idx++;
 
-        VkSemaphore* p_semaphore = &p_render_resources->frame_resources_array[frame_idx].render_finished_semaphore;
         {
-            VkSemaphoreCreateInfo semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
-            result = vk_dev_procs.CreateSemaphore(device_, &semaphore_info, NULL, p_semaphore);
-            assertVk(result);
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = p_render_resources->frame_resources_array[frame_idx].visible_voxels_buffer,
+                .offset = 0,
+                .range = MAX_VOXEL_QUAD_COUNT * sizeof(VoxelQuad),
+            };
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = 3,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
+            };
+        }
+        descriptor_write_idx++;
+
+        {
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = p_render_resources->frame_resources_array[frame_idx].voxel_draw_command_buffer,
+                .offset = 0,
+                .range = sizeof(VoxelCullCommands),
+            };
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = 4,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
+            };
+        }
+        descriptor_write_idx++;
+
+        {
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = p_render_resources->voxel_mesh_buffer,
+                .offset = 0,
+                .range = MAX_VOXEL_QUAD_COUNT * sizeof(VoxelQuad),
+            };
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = VOXEL_MESH_BINDING,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
+            };
         }
+        descriptor_write_idx++;
 
-        VkBuffer* p_uniform_buffer = &this_frame_resources->uniform_buffer;
-        VmaAllocation* p_uniform_buffer_allocation = &this_frame_resources->uniform_buffer_allocation;
-        VmaAllocationInfo* p_uniform_buffer_allocation_info = &this_frame_resources->uniform_buffer_allocation_info;
+        const VkBuffer particle_tile_buffers[PARTICLE_TILES_BINDING_COUNT] {
+            p_render_resources->frame_resources_array[frame_idx].particle_tile_counts_buffer,
+            p_render_resources->frame_resources_array[frame_idx].particle_tile_ranges_buffer,
+            p_render_resources->frame_resources_array[frame_idx].particle_tile_entries_buffer,
+        };
+        for (u32 i = 0; i < PARTICLE_TILES_BINDING_COUNT; i++)
         {
-            // TODO are we guaranteed to have a memory type supporting both HOST_VISIBLE and USAGE_UNIFORM_BUFFER?
-            VkBufferCreateInfo uniform_buffer_info {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = sizeof(UniformBuffer),
-                .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-                .queueFamilyIndexCount = 1,
-                .pQueueFamilyIndices = &queue_family_,
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = particle_tile_buffers[i],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE,
             };
-            VmaAllocationCreateInfo uniform_buffer_alloc_info {
-                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                .usage = VMA_MEMORY_USAGE_AUTO,
-                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = PARTICLE_TILES_FIRST_BINDING + i,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
             };
-            result = vmaCreateBuffer(
-                vma_allocator_, &uniform_buffer_info, &uniform_buffer_alloc_info,
-                p_uniform_buffer, p_uniform_buffer_allocation, p_uniform_buffer_allocation_info
-            );
-            assertVk(result);
+            descriptor_write_idx++;
         }
 
-        VkBuffer* p_voxels_buffer = &this_frame_resources->voxels_buffer;
-        VmaAllocation* p_voxels_buffer_allocation = &this_frame_resources->voxels_buffer_allocation;
-        VmaAllocationInfo* p_voxels_buffer_allocation_info = &this_frame_resources->voxels_buffer_allocation_info;
+        for (u32 i = 0; i < SURFACE_MESH_BUFFER_COUNT; i++)
         {
-            // TODO are we guaranteed to have a memory type supporting both HOST_VISIBLE and USAGE_VERTEX_BUFFER?
-            VkBufferCreateInfo voxels_buffer_info {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = MAX_VOXEL_COUNT * sizeof(Voxel),
-                .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-                .queueFamilyIndexCount = 1,
-                .pQueueFamilyIndices = &queue_family_,
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = p_render_resources->surface_mesh_buffers[i],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE,
             };
-            VmaAllocationCreateInfo voxels_buffer_alloc_info {
-                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                .usage = VMA_MEMORY_USAGE_AUTO,
-                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = SURFACE_MESH_FIRST_BINDING + i,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
             };
-            result = vmaCreateBuffer(
-                vma_allocator_, &voxels_buffer_info, &voxels_buffer_alloc_info,
-                p_voxels_buffer, p_voxels_buffer_allocation, p_voxels_buffer_allocation_info
-            );
-            assertVk(result);
+            descriptor_write_idx++;
         }
 
-        VkBuffer* p_outlined_voxels_index_buffer = &this_frame_resources->outlined_voxels_index_buffer;
-        VmaAllocation* p_outlined_voxels_index_buffer_allocation = &this_frame_resources->outlined_voxels_index_buffer_allocation;
-        VmaAllocationInfo* p_outlined_voxels_index_buffer_allocation_info = &this_frame_resources->outlined_voxels_index_buffer_allocation_info;
+        const VkBuffer particle_lod_buffers[PARTICLE_LOD_BINDING_COUNT] {
+            p_render_resources->frame_resources_array[frame_idx].particle_lod_instances_buffer,
+            p_render_resources->frame_resources_array[frame_idx].particle_lod_draw_command_buffer,
+        };
+        for (u32 i = 0; i < PARTICLE_LOD_BINDING_COUNT; i++)
         {
-            // TODO are we guaranteed to have a memory type supporting both HOST_VISIBLE and USAGE_VERTEX_BUFFER?
-            VkBufferCreateInfo cube_outlines_index_buffer_info {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = MAX_OUTLINED_VOXEL_COUNT * sizeof(u32),
-                .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-                .queueFamilyIndexCount = 1,
-                .pQueueFamilyIndices = &queue_family_,
+            descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+                .buffer = particle_lod_buffers[i],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE,
             };
-            VmaAllocationCreateInfo cube_outlines_index_buffer_alloc_info {
-                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                .usage = VMA_MEMORY_USAGE_AUTO,
-                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+                .dstBinding = PARTICLE_LOD_FIRST_BINDING + i,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pImageInfo = NULL,
+                .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+                .pTexelBufferView = NULL,
             };
-            result = vmaCreateBuffer(
-                vma_allocator_, &cube_outlines_index_buffer_info, &cube_outlines_index_buffer_alloc_info,
-                p_outlined_voxels_index_buffer, p_outlined_voxels_index_buffer_allocation, p_outlined_voxels_index_buffer_allocation_info
-            );
-            assertVk(result);
+            descriptor_write_idx++;
         }
-    }
-
-
-    // TODO instead of hardcoding 3 here and other places, you can create an enum Descriptor where you encode
-    // this info, with descriptors_per_frame_count = Descriptor_COUNT.
-    // Then you can use the descriptor enum names as indices intead of hardcoding 0, 1, 2 here and elsewhere.
-    constexpr u32 descriptors_per_frame_count = 3;
-    constexpr u32 descriptor_write_count = MAX_FRAMES_IN_FLIGHT * descriptors_per_frame_count;
-
-    VkDescriptorBufferInfo descriptor_buffer_infos[descriptor_write_count] {};
-    VkWriteDescriptorSet descriptor_writes[descriptor_write_count] {};
-    u32fast descriptor_write_idx = 0;
-
-    for (u32fast frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; frame_idx++) {
 
+        // the rest of occlusion culling's, after the depth buffer and the depth pyramid; see
+        // `writeDepthPyramidDescriptors()`
+        const VkBuffer occlusion_buffers[2] {
+            p_render_resources->frame_resources_array[frame_idx].occluded_voxels_buffer,
+            p_render_resources->frame_resources_array[frame_idx].particle_occlusion_buffer,
+        };
+        for (u32 i = 0; i < 2; i++)
         {
             descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
-                .buffer = p_render_resources->frame_resources_array[frame_idx].uniform_buffer,
+                .buffer = occlusion_buffers[i],
                 .offset = 0,
-                .range = sizeof(UniformBuffer),
+                .range = VK_WHOLE_SIZE,
             };
             descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
                 .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                 .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
-                .dstBinding = 0,
+                .dstBinding = OCCLUSION_FIRST_BINDING + 2 + i,
                 .dstArrayElement = 0,
                 .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                 .pImageInfo = NULL,
                 .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
                 .pTexelBufferView = NULL,
             };
+            descriptor_write_idx++;
         }
-        descriptor_write_idx++;
 
+        // picking's, after the object id image; see `writeObjectIdDescriptors()`. The particle ids get a
+        // placeholder until a frame picks; see `writePickParticleIdsDescriptor()`.
+        const VkBuffer pick_buffers[OBJECT_ID_BINDING_COUNT - 1] {
+            p_render_resources->frame_resources_array[frame_idx].pick_results_buffer,
+            p_render_resources->frame_resources_array[frame_idx].pick_id_set_buffer,
+            p_render_resources->frame_resources_array[frame_idx].pick_id_set_buffer,
+        };
+        for (u32 i = 0; i < OBJECT_ID_BINDING_COUNT - 1; i++)
         {
             descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
-                .buffer = p_render_resources->frame_resources_array[frame_idx].voxels_buffer,
+                .buffer = pick_buffers[i],
                 .offset = 0,
-                .range = MAX_VOXEL_COUNT * sizeof(Voxel),
+                .range = VK_WHOLE_SIZE,
             };
             descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
                 .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                 .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
-                .dstBinding = 1,
+                .dstBinding = OBJECT_ID_FIRST_BINDING + 1 + i,
                 .dstArrayElement = 0,
                 .descriptorCount = 1,
                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
@@ -3339,19 +10248,26 @@ extern Result createRenderer(
                 .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
                 .pTexelBufferView = NULL,
             };
+            descriptor_write_idx++;
         }
-        descriptor_write_idx++;
 
+        // the depth sort's keys, its final order, and the particles gathered in that order
+        const VkBuffer depth_sort_buffers[PARTICLE_DEPTH_SORT_BINDING_COUNT] {
+            p_render_resources->particle_depth_sort_buffers[PARTICLE_DEPTH_SORT_BUFFER_KEYS_0],
+            p_render_resources->particle_depth_sort_buffers[PARTICLE_DEPTH_SORT_BUFFER_VALUES_1],
+            p_render_resources->particle_depth_sort_buffers[PARTICLE_DEPTH_SORT_BUFFER_SORTED_PARTICLES],
+        };
+        for (u32 i = 0; i < PARTICLE_DEPTH_SORT_BINDING_COUNT; i++)
         {
             descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
-                .buffer = particles_buffer,
+                .buffer = depth_sort_buffers[i],
                 .offset = 0,
-                .range = particles_buffer_size,
+                .range = VK_WHOLE_SIZE,
             };
             descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
                 .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                 .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
-                .dstBinding = 2,
+                .dstBinding = PARTICLE_DEPTH_SORT_FIRST_BINDING + i,
                 .dstArrayElement = 0,
                 .descriptorCount = 1,
                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
@@ -3359,7 +10275,26 @@ extern Result createRenderer(
                 .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
                 .pTexelBufferView = NULL,
             };
+            descriptor_write_idx++;
         }
+
+        // the density volume
+        descriptor_buffer_infos[descriptor_write_idx] = VkDescriptorBufferInfo {
+            .buffer = p_render_resources->density_volume_buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+        descriptor_writes[descriptor_write_idx] = VkWriteDescriptorSet {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p_render_resources->frame_resources_array[frame_idx].descriptor_set,
+            .dstBinding = DENSITY_VOLUME_BINDING,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &descriptor_buffer_infos[descriptor_write_idx],
+            .pTexelBufferView = NULL,
+        };
         descriptor_write_idx++;
     }
     vk_dev_procs.UpdateDescriptorSets(
@@ -3367,6 +10302,11 @@ extern Result createRenderer(
          descriptor_write_count, descriptor_writes,
          0, NULL
     );
+    for (u32fast frame_idx = 0; frame_idx < frames_in_flight; frame_idx++) {
+        writeParticleGridDescriptors(
+            p_render_resources->frame_resources_array[frame_idx].descriptor_set, NULL, particles_buffer
+        );
+    }
 
 
     p_render_resources->last_used_frame_idx = 0;
@@ -3387,39 +10327,18 @@ extern Result createRenderer(
 ) {
     ZoneScoped;
 
-    shaderc_compilation_result_t compile_result = compileShaderSrcFileToSpirv(
-        shader_src_filepath, shader_type
-    );
-    if (compile_result == NULL) {
+    size_t spirv_byte_count = 0;
+    u32* p_spirv = compileShaderSrcFileToSpirv(shader_src_filepath, shader_type, &spirv_byte_count);
+    if (p_spirv == NULL) {
         LOG_F(ERROR, "Failed to compile shader src file `%s` to spirv.", shader_src_filepath);
         return false;
     };
-    defer(libshaderc_procs_.result_release(compile_result));
-
-    shaderc_compilation_status compile_status = libshaderc_procs_.result_get_compilation_status(compile_result);
-    if (compile_status != shaderc_compilation_status_success) {
-
-        u32fast error_count = libshaderc_procs_.result_get_num_errors(compile_result);
-        const char* error_message = libshaderc_procs_.result_get_error_message(compile_result);
-        if (error_message == NULL) error_message = "(NO ERROR MESSAGE PROVIDED)";
-
-        LOG_F(
-             ERROR, "Failed to compile shader `%s`. %" PRIuFAST32 " errors: `%s`.",
-             shader_src_filepath, error_count, error_message
-         );
-        return false;
-    }
-
-    size_t spirv_byte_count = libshaderc_procs_.result_get_length(compile_result);
-    const void* p_spirv_bytes = (const void*)libshaderc_procs_.result_get_bytes(compile_result);
+    defer(free(p_spirv));
 
     alwaysAssert(spirv_byte_count % sizeof(u32) == 0);
-    alwaysAssert((uintptr_t)p_spirv_bytes % alignof(u32) == 0);
 
     VkShaderModule shader_module = VK_NULL_HANDLE;
-    VkResult result = createShaderModuleFromSpirv(
-        device, (u32)spirv_byte_count, (const u32*)p_spirv_bytes, &shader_module
-    );
+    VkResult result = createShaderModuleFromSpirv(device, (u32)spirv_byte_count, p_spirv, &shader_module);
     if (result == VK_ERROR_INVALID_SHADER_NV) {
         LOG_F(
             ERROR, "Failed to create shader module from spirv for shader `%s`: VK_ERROR_INVALID_SHADER_NV.",
@@ -3434,87 +10353,146 @@ extern Result createRenderer(
 }
 
 
-bool reloadAllShaders(RenderResources renderer) {
+/// A `thread_pool` task that recompiles the modified shaders of a pipeline from their source files, and creates the
+/// new pipeline from them. `p_arg` is the `PipelineReload*`. On failure, leaves nothing behind.
+static void reloadPipelineTask(void* p_arg) {
 
     ZoneScoped;
 
-    LOG_F(INFO, "Reloading all shaders");
+    PipelineReload* p_reload = (PipelineReload*)p_arg;
+    const PipelineHotReloadInfo* p_info = &PIPELINE_HOT_RELOAD_INFOS[p_reload->pipeline_idx];
+    const bool vertex_modified = p_reload->modified_shaders & VK_SHADER_STAGE_VERTEX_BIT;
+    const bool fragment_modified = p_reload->modified_shaders & VK_SHADER_STAGE_FRAGMENT_BIT;
 
+    p_reload->success = false;
+    GraphicsPipelineShaderModules shader_modules = shader_modules_[p_reload->pipeline_idx];
 
-    timespec start_time {};
-    {
-        int success = timespec_get(&start_time, TIME_UTC);
-        LOG_IF_F(ERROR, !success, "Failed to get shader rebuild start time.");
+    if (vertex_modified) {
+        bool success = createShaderModuleFromShaderSourceFile(
+            device_, p_info->vertex_shader_src_filepath, shaderc_glsl_vertex_shader,
+            &shader_modules.vertex_shader_module
+        );
+        if (!success) return;
+    }
+    if (fragment_modified) {
+        bool success = createShaderModuleFromShaderSourceFile(
+            device_, p_info->fragment_shader_src_filepath, shaderc_glsl_fragment_shader,
+            &shader_modules.fragment_shader_module
+        );
+        if (!success) {
+            if (vertex_modified) vk_dev_procs.DestroyShaderModule(device_, shader_modules.vertex_shader_module, NULL);
+            return;
+        }
     }
 
+    PipelineAndLayout pipeline {};
+    bool success = p_info->pfn_createPipeline(
+        device_,
+        shader_modules.vertex_shader_module,
+        shader_modules.fragment_shader_module,
+        descriptor_set_layout_,
+        &pipeline.pipeline,
+        &pipeline.layout
+    );
+    if (!success) {
+        if (vertex_modified) vk_dev_procs.DestroyShaderModule(device_, shader_modules.vertex_shader_module, NULL);
+        if (fragment_modified) vk_dev_procs.DestroyShaderModule(device_, shader_modules.fragment_shader_module, NULL);
+        return;
+    }
 
-    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
-    assert(p_render_resources != NULL);
-    // TODO FIXME hack to hide "unused variable" complaint; just remove the input parameter entirely
-    (void)p_render_resources;
+    p_reload->new_shader_modules = shader_modules;
+    p_reload->new_pipeline = pipeline;
+    p_reload->success = true;
+}
 
+/// Starts reloading the queued shaders' pipelines in the background, if there are any and no reload is already in
+/// progress: the reloads run concurrently, on the thread pool; shaderc compiles concurrently with the same compiler,
+/// as the compilations don't share options.
+static void startShaderReload(void) {
 
-    GraphicsPipelineShaderModules new_shader_modules[PIPELINE_INDEX_COUNT];
-    memcpy(new_shader_modules, shader_modules_, PIPELINE_INDEX_COUNT * sizeof(GraphicsPipelineShaderModules));
+    ZoneScoped;
 
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+    if (shader_reload_in_progress_) return;
 
-        bool success;
+    shader_reload_count_ = 0;
+    for (u32 pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+        if (queued_modified_shaders_[pipeline_idx] == 0) continue;
+        shader_reloads_[shader_reload_count_] = PipelineReload {
+            .pipeline_idx = pipeline_idx,
+            .modified_shaders = queued_modified_shaders_[pipeline_idx],
+        };
+        shader_reload_count_++;
+        queued_modified_shaders_[pipeline_idx] = 0;
+    }
+    if (shader_reload_count_ == 0) return;
 
-        VkShaderModule vertex_shader_module = VK_NULL_HANDLE;
-        success = createShaderModuleFromShaderSourceFile(
-            device_,
-            PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].vertex_shader_src_filepath,
-            shaderc_glsl_vertex_shader,
-            &vertex_shader_module
-        );
-        if (!success) return false;
-        new_shader_modules[pipeline_idx].vertex_shader_module = vertex_shader_module;
+    int success = timespec_get(&shader_reload_start_time_, TIME_UTC);
+    LOG_IF_F(ERROR, !success, "Failed to get shader rebuild start time.");
 
-        VkShaderModule fragment_shader_module = VK_NULL_HANDLE;
-        success = createShaderModuleFromShaderSourceFile(
-            device_,
-            PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].fragment_shader_src_filepath,
-            shaderc_glsl_fragment_shader,
-            &fragment_shader_module
-        );
-        if (!success) return false;
-        new_shader_modules[pipeline_idx].fragment_shader_module = fragment_shader_module;
-    }
+    shader_reload_tasks_ = thread_pool::TaskGroup {};
+    thread_pool::enqueueTasks(
+        thread_pool_, &shader_reload_tasks_, shader_reload_count_, reloadPipelineTask,
+        shader_reloads_, sizeof(shader_reloads_[0])
+    );
+    shader_reload_in_progress_ = true;
+}
 
+/// Once the reload in progress has finished: if all of its pipelines were created, swaps them and their shader
+/// modules in for the old ones, which it destroys once the queue is idle. Otherwise, keeps the old ones, destroys
+/// the new ones, and returns false.
+[[nodiscard]] static bool finishShaderReload(void) {
 
-    PipelineAndLayout new_pipelines[PIPELINE_INDEX_COUNT];
-    memcpy(new_pipelines, pipelines_, PIPELINE_INDEX_COUNT * sizeof(PipelineAndLayout));
+    ZoneScoped;
 
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+    assert(shader_reload_in_progress_);
+    thread_pool::waitForGroup(thread_pool_, &shader_reload_tasks_);
+    shader_reload_in_progress_ = false;
 
-        bool success = PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].pfn_createPipeline(
-            device_,
-            new_shader_modules[pipeline_idx].vertex_shader_module,
-            new_shader_modules[pipeline_idx].fragment_shader_module,
-            descriptor_set_layout_,
-            &new_pipelines[pipeline_idx].pipeline,
-            &new_pipelines[pipeline_idx].layout
-        );
-        if (!success) return false;
+    bool all_succeeded = true;
+    for (u32 i = 0; i < shader_reload_count_; i++) all_succeeded = all_succeeded && shader_reloads_[i].success;
+
+    if (!all_succeeded) {
+        for (u32 i = 0; i < shader_reload_count_; i++) {
+
+            const PipelineReload* p_reload = &shader_reloads_[i];
+            if (!p_reload->success) continue;
+
+            vk_dev_procs.DestroyPipeline(device_, p_reload->new_pipeline.pipeline, NULL);
+            vk_dev_procs.DestroyPipelineLayout(device_, p_reload->new_pipeline.layout, NULL);
+            if (p_reload->modified_shaders & VK_SHADER_STAGE_VERTEX_BIT) vk_dev_procs.DestroyShaderModule(
+                device_, p_reload->new_shader_modules.vertex_shader_module, NULL
+            );
+            if (p_reload->modified_shaders & VK_SHADER_STAGE_FRAGMENT_BIT) vk_dev_procs.DestroyShaderModule(
+                device_, p_reload->new_shader_modules.fragment_shader_module, NULL
+            );
+        }
+        return false;
     }
 
 
+    // The frames in flight may still use the old ones; only a frame's worth of waiting, unlike the compiles.
     VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
     assertVk(result);
 
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
-        vk_dev_procs.DestroyShaderModule(device_, shader_modules_[pipeline_idx].vertex_shader_module, NULL);
-        vk_dev_procs.DestroyShaderModule(device_, shader_modules_[pipeline_idx].fragment_shader_module, NULL);
-    }
-    memcpy(shader_modules_, new_shader_modules, sizeof(shader_modules_));
+    for (u32 i = 0; i < shader_reload_count_; i++) {
+
+        const PipelineReload* p_reload = &shader_reloads_[i];
+        const u32 pipeline_idx = p_reload->pipeline_idx;
 
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
         vk_dev_procs.DestroyPipeline(device_, pipelines_[pipeline_idx].pipeline, NULL);
         // OPTIMIZE we probably don't need to rebuild the layout
         vk_dev_procs.DestroyPipelineLayout(device_, pipelines_[pipeline_idx].layout, NULL);
+
+        if (p_reload->modified_shaders & VK_SHADER_STAGE_VERTEX_BIT) vk_dev_procs.DestroyShaderModule(
+            device_, shader_modules_[pipeline_idx].vertex_shader_module, NULL
+        );
+        if (p_reload->modified_shaders & VK_SHADER_STAGE_FRAGMENT_BIT) vk_dev_procs.DestroyShaderModule(
+            device_, shader_modules_[pipeline_idx].fragment_shader_module, NULL
+        );
+
+        shader_modules_[pipeline_idx] = p_reload->new_shader_modules;
+        pipelines_[pipeline_idx] = p_reload->new_pipeline;
     }
-    memcpy(pipelines_, new_pipelines, sizeof(pipelines_));
 
 
     timespec end_time;
@@ -3524,15 +10502,318 @@ bool reloadAllShaders(RenderResources renderer) {
     }
 
     f64 duration_milliseconds =
-        (f64)(end_time.tv_sec - start_time.tv_sec) * 1'000. +
-        (f64)(end_time.tv_nsec - start_time.tv_nsec) / 1'000'000.;
-    LOG_F(INFO, "Shaders reloaded (%.0lf ms).", duration_milliseconds);
-
+        (f64)(end_time.tv_sec - shader_reload_start_time_.tv_sec) * 1'000. +
+        (f64)(end_time.tv_nsec - shader_reload_start_time_.tv_nsec) / 1'000'000.;
+    LOG_F(INFO, "Shaders reloaded (%.0lf ms, in the background).", duration_milliseconds);
 
     return true;
 }
 
 
+void reloadAllShaders(RenderResources renderer) {
+
+    ZoneScoped;
+
+    LOG_F(INFO, "Reloading all shaders");
+
+
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    assert(p_render_resources != NULL);
+    // TODO FIXME hack to hide "unused variable" complaint; just remove the input parameter entirely
+    (void)p_render_resources;
+
+
+    for (u32 pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
+        queued_modified_shaders_[pipeline_idx] = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    startShaderReload();
+}
+
+extern ShaderReloadResult pollShaderReload(void) {
+
+    ZoneScoped;
+
+    assert(initialized_);
+
+    ShaderReloadResult reload_result = ShaderReloadResult::no_shaders_need_reloading;
+    if (shader_reload_in_progress_) {
+        if (!thread_pool::isGroupFinished(&shader_reload_tasks_)) return ShaderReloadResult::in_progress;
+        bool success = finishShaderReload();
+        reload_result = success ? ShaderReloadResult::success : ShaderReloadResult::error;
+    }
+
+    // the shaders that changed while it was running
+    startShaderReload();
+    return reload_result;
+}
+
+
+/// The push constants of `recordVectorField()`, for a viewport of `viewport_extent`.
+static VectorFieldPipelinePushConstants getVectorFieldPushConstants(
+    const VectorField* p_field,
+    VkExtent2D viewport_extent,
+    u32 particle_count
+) {
+    const vec2 viewport_size = vec2(viewport_extent.width, viewport_extent.height);
+
+    // the squares are made larger until they fit in the frame's `vector_field_claims_buffer`
+    f32 cell_size_pixels = p_field->min_spacing_pixels;
+    uvec2 cell_counts = uvec2(1, 1);
+    if (cell_size_pixels > 0.f) {
+        while (true) {
+            cell_counts = uvec2(glm::ceil(viewport_size / cell_size_pixels));
+            if ((u64)cell_counts.x * cell_counts.y <= VECTOR_FIELD_CLAIM_CAPACITY) break;
+            cell_size_pixels *= 1.25f;
+        }
+    }
+
+    return VectorFieldPipelinePushConstants {
+        .viewport_size = viewport_size,
+        .cell_counts = cell_counts,
+        .particle_count = particle_count,
+        .vector_stride = p_field->component_stride,
+        .half_vectors = p_field->half_vectors,
+        .scale = p_field->scale,
+        .cell_size_pixels = cell_size_pixels,
+    };
+}
+
+
+/// The push constants of `recordParticleLod()`, for a viewport of `viewport_extent`.
+static ParticleLodPipelinePushConstants getParticleLodPushConstants(
+    const mat4* world_to_screen_transform,
+    VkExtent2D viewport_extent,
+    f32 threshold_pixels,
+    u32 particle_count,
+    f32 particle_radius,
+    const ParticleGrid* p_particle_grid
+) {
+    return ParticleLodPipelinePushConstants {
+        .clip_w_row = glm::transpose(*world_to_screen_transform)[3],
+        // as for `render()`'s `fluid_surface_texels_per_unit`, at full resolution
+        .pixels_per_unit =
+            0.5f * (f32)viewport_extent.height * glm::length(vec3(glm::transpose(*world_to_screen_transform)[1])),
+        .threshold_pixels = threshold_pixels,
+        .particle_count = particle_count,
+        .particle_radius = particle_radius,
+        .permuted = p_particle_grid->permuted,
+        .cell_size_reciprocal = p_particle_grid->cell_size_reciprocal,
+        .domain_bounds_slot = p_particle_grid->domain_bounds_slot,
+    };
+}
+
+
+/// Records `*p_view`, one of `requestExtraViews()`'s, after the main view of the frame and its pick: the passes
+/// that depend on the camera, i.e. the voxel culling, the particle passes and the draws, for the render mode and
+/// the grid that `render()` settled on, with the frame's uniforms rewritten for the view. As the views use the same
+/// buffers and images of the frame, each first waits for everything before it. The particle interpolation, the voxel
+/// mesh edits and the surface mesh are the main view's; the fancy particles are ray marched at full resolution.
+static void recordExtraView(
+    const RenderResourcesImpl* p_render_resources,
+    const RenderResourcesImpl::PerFrameResources* p_frame_resources,
+    const View* p_view,
+    VkExtent2D dst_image_extent,
+    VkImageView dst_image_view,
+    f32 particle_radius,
+    f32 raymarch_max_travel_distance,
+    u32 particle_count,
+    VkBuffer particles_vertex_buffer,
+    ParticleRenderMode particle_render_mode,
+    const ParticleGrid* p_particle_grid, // NULL unless the render mode reads it
+    bool particle_lod,
+    f32 particle_lod_threshold_pixels,
+    const SurfaceMeshPipelinePushConstants* surface_mesh_pipeline_push_constants,
+    const DensityVolumePipelinePushConstants* density_volume_pipeline_push_constants, // the main view's
+    const VectorField* p_vector_field_optional, // whose descriptors `render()` has written
+    ImDrawData* imgui_draw_data
+) {
+    ZoneScoped;
+
+    VkCommandBuffer command_buffer = p_frame_resources->command_buffer;
+    TracyVkZone(vk_ctx_.tracy_vk_ctx, command_buffer, "extra view");
+
+    const VkRect2D viewport = p_view->window_subregion;
+    const mat4* world_to_screen_transform = &p_view->world_to_screen_transform;
+    const mat4* world_to_screen_transform_inverse = &p_view->world_to_screen_transform_inverse;
+    const vec2 viewport_offset = vec2(viewport.offset.x, viewport.offset.y);
+    const vec2 viewport_size = vec2(viewport.extent.width, viewport.extent.height);
+    const f32 render_scale = p_render_resources->render_scale;
+
+    {
+        // Everything before may still use what this view rewrites, the uniforms included.
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // dstStageMask
+            0, 1, &barrier, 0, NULL, 0, NULL
+        );
+
+        const UniformBuffer uniform_data {
+            .world_to_screen_transform = *world_to_screen_transform,
+            .viewport = vec4(viewport_offset, viewport_size),
+            .depth_buffer_size = uvec2(dst_image_extent.width, dst_image_extent.height),
+            // the pyramid is the main view's
+            .depth_pyramid_level_count = p_render_resources->depth_pyramid_level_count,
+            .depth_pyramid_valid = false,
+        };
+        vk_dev_procs.CmdUpdateBuffer(
+            command_buffer, p_frame_resources->uniform_buffer, 0, sizeof(uniform_data), &uniform_data
+        );
+
+        const VkMemoryBarrier uniform_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT,
+        };
+        vk_dev_procs.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, // srcStageMask
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // dstStageMask
+            0, 1, &uniform_barrier, 0, NULL, 0, NULL
+        );
+    }
+
+    // as in `render()`, without the dynamic resolution
+    const u32 particle_tile_count_x = (viewport.extent.width + PARTICLE_TILE_SIZE - 1) / PARTICLE_TILE_SIZE;
+    const u32 particle_tile_count_y = (viewport.extent.height + PARTICLE_TILE_SIZE - 1) / PARTICLE_TILE_SIZE;
+    const bool particle_tiling =
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED_TILED &&
+        particle_count > 0 &&
+        particle_tile_count_x * particle_tile_count_y <= MAX_PARTICLE_TILE_COUNT;
+
+    const GridPipelineFragmentShaderPushConstants grid_pipeline_frag_shader_push_constants {
+        .world_to_screen_transform_inverse = *world_to_screen_transform_inverse,
+        .viewport_offset_in_window = viewport_offset,
+        .viewport_size_in_window = viewport_size,
+    };
+    ParticlePipelineFragmentShaderPushConstants particle_pipeline_frag_shader_push_constants {
+        .world_to_screen_transform_inverse = *world_to_screen_transform_inverse,
+        .viewport_offset_in_window = viewport_offset,
+        .viewport_size_in_window = viewport_size,
+        .particle_count = particle_count,
+        .particle_radius = particle_radius,
+        .max_travel_distance = raymarch_max_travel_distance,
+        .cell_table_kind = PARTICLE_CELL_TABLE_NONE,
+        .tile_count_x = particle_tiling ? particle_tile_count_x : 0,
+        .tile_count_y = (particle_tiling && particle_depth_bounds_enabled_) ? particle_tile_count_y : 0,
+    };
+    if (p_particle_grid != NULL) {
+        const bool slots = p_particle_grid->cell_slot_count > 0;
+        ParticlePipelineFragmentShaderPushConstants* c = &particle_pipeline_frag_shader_push_constants;
+        c->cell_table_kind = slots ? PARTICLE_CELL_TABLE_SLOTS : PARTICLE_CELL_TABLE_HASH;
+        c->cell_table_size = slots ? p_particle_grid->cell_slot_count : p_particle_grid->hash_table_size;
+        c->permuted = p_particle_grid->permuted;
+        c->cell_size_reciprocal = p_particle_grid->cell_size_reciprocal;
+        c->max_displacement = p_particle_grid->max_displacement;
+        c->domain_bounds_slot = p_particle_grid->domain_bounds_slot;
+    }
+    const vec4 camera_position_homogeneous = *world_to_screen_transform_inverse * vec4(0.f, 0.f, 1.f, 0.f);
+    const ParticleRasterizePipelinePushConstants particle_rasterize_pipeline_push_constants {
+        .camera_position = vec3(camera_position_homogeneous) / camera_position_homogeneous.w,
+        .particle_radius = particle_radius,
+    };
+    ParticleMeshPipelinePushConstants particle_mesh_pipeline_push_constants {
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .particle_radius = particle_radius,
+        .particle_count = particle_count,
+        .phase = 0,
+    };
+    getFrustumPlanes(world_to_screen_transform, particle_mesh_pipeline_push_constants.frustum_planes);
+    const FluidCompositePipelinePushConstants fluid_composite_pipeline_push_constants {
+        .world_to_screen_transform_inverse = *world_to_screen_transform_inverse,
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .particle_radius = particle_radius,
+        .viewport_offset_in_window = viewport_offset,
+        .viewport_size_in_window = viewport_size,
+        .texels_per_pixel = render_scale / (f32)FLUID_SURFACE_DOWNSCALE,
+    };
+    // the main view's volume, marched from this one
+    DensityVolumePipelinePushConstants density_volume_view_push_constants = *density_volume_pipeline_push_constants;
+    density_volume_view_push_constants.world_to_screen_transform_inverse = *world_to_screen_transform_inverse;
+    density_volume_view_push_constants.camera_position = particle_rasterize_pipeline_push_constants.camera_position;
+    density_volume_view_push_constants.viewport_offset_in_window = viewport_offset;
+    density_volume_view_push_constants.viewport_size_in_window = viewport_size;
+    const f32 fluid_surface_texels_per_unit =
+        0.5f * (viewport_size.y * fluid_composite_pipeline_push_constants.texels_per_pixel) *
+        glm::length(vec3(glm::transpose(*world_to_screen_transform)[1]));
+
+    VoxelCullPipelinePushConstants voxel_cull_push_constants {
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .voxel_diameter = VOXEL_DIAMETER,
+        .quad_count = getVoxelMeshQuadSlotCount(p_render_resources->voxel_mesh),
+        .phase = 0,
+    };
+    getFrustumPlanes(world_to_screen_transform, voxel_cull_push_constants.frustum_planes);
+    recordVoxelCulling(p_frame_resources, &voxel_cull_push_constants, command_buffer);
+
+    if (particle_tiling) {
+        const ParticleTilesPipelinePushConstants particle_tiles_push_constants {
+            .world_to_screen_transform = *world_to_screen_transform,
+            .viewport_size = viewport_size,
+            .particle_count = particle_count,
+            .particle_radius = particle_radius,
+            .tile_count_x = particle_tile_count_x,
+            .tile_count_y = particle_tile_count_y,
+            .entry_capacity = PARTICLE_TILE_ENTRY_CAPACITY,
+        };
+        recordParticleTiling(p_frame_resources, &particle_tiles_push_constants, command_buffer);
+    }
+
+    if (particle_lod) {
+        const ParticleLodPipelinePushConstants particle_lod_push_constants = getParticleLodPushConstants(
+            world_to_screen_transform, viewport.extent, particle_lod_threshold_pixels, particle_count,
+            particle_radius, p_particle_grid
+        );
+        recordParticleLod(p_frame_resources, &particle_lod_push_constants, command_buffer);
+    }
+
+    if (p_vector_field_optional != NULL) {
+        const VectorFieldPipelinePushConstants vector_field_push_constants =
+            getVectorFieldPushConstants(p_vector_field_optional, viewport.extent, particle_count);
+        recordVectorField(p_frame_resources, &vector_field_push_constants, command_buffer);
+    }
+
+    bool success = recordCommandBuffer(
+        p_frame_resources,
+        p_render_resources->outlined_voxel_count,
+        p_render_resources->outlined_voxels_buffer,
+        particle_count,
+        particles_vertex_buffer,
+        dst_image_extent,
+        viewport,
+        dst_image_view,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        &voxel_cull_push_constants,
+        0, // depth_pyramid_level_count
+        &grid_pipeline_frag_shader_push_constants,
+        &particle_pipeline_frag_shader_push_constants,
+        &particle_rasterize_pipeline_push_constants,
+        &particle_mesh_pipeline_push_constants,
+        &fluid_composite_pipeline_push_constants,
+        fluid_surface_texels_per_unit,
+        p_render_resources->surface_mesh_buffers,
+        surface_mesh_pipeline_push_constants,
+        p_render_resources->density_volume_buffer,
+        &density_volume_view_push_constants,
+        p_render_resources->particle_depth_sort_buffers,
+        particle_render_mode,
+        particle_lod,
+        p_vector_field_optional != NULL,
+        false, // visibility_buffer
+        true, // extra_view
+        render_scale,
+        NULL, // particle_upscale_pipeline_push_constants
+        imgui_draw_data
+    );
+    alwaysAssert(success);
+}
+
+
 RenderResult render(
     SurfaceResources surface,
     VkRect2D window_subregion,
@@ -3541,13 +10822,14 @@ RenderResult render(
     f32 particle_radius,
     f32 raymarch_max_travel_distance,
     ImDrawData* imgui_draw_data,
-    u32 voxel_count,
-    const Voxel* p_voxels,
-    u32 outlined_voxel_index_count,
-    const u32* p_outlined_voxel_indices,
     u32 particle_count,
     VkBuffer particles_vertex_buffer,
-    bool fancy_particle_rendering,
+    VkBuffer particle_ids_buffer_optional,
+    ParticleRenderMode particle_render_mode,
+    const ParticleGrid* p_particle_grid_optional,
+    f32 rest_particle_density,
+    f32 particle_lod_threshold_pixels,
+    const ParticleInterpolation* p_particle_interpolation_optional,
     VkSemaphore optional_wait_semaphore, // optional
     VkSemaphore optional_signal_semaphore // optional
 ) {
@@ -3556,15 +10838,51 @@ RenderResult render(
 
     VkResult result;
 
+    if (particle_render_mode == PARTICLE_RENDER_MODE_MESH_SHADED and !mesh_shaders_supported_) {
+        particle_render_mode = PARTICLE_RENDER_MODE_RASTERIZED;
+    }
+    // the surface mesh is extracted from the grid's cells, and the density volume splatted from them
+    if (particle_render_mode == PARTICLE_RENDER_MODE_SURFACE_MESH and p_particle_grid_optional == NULL) {
+        particle_render_mode = PARTICLE_RENDER_MODE_RASTERIZED;
+    }
+    if (particle_render_mode == PARTICLE_RENDER_MODE_DENSITY_VOLUME and p_particle_grid_optional == NULL) {
+        particle_render_mode = PARTICLE_RENDER_MODE_RASTERIZED;
+    }
+
+    const bool fancy_particle_rendering =
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED ||
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED_TILED;
+    const bool surface_mesh_rendering = particle_render_mode == PARTICLE_RENDER_MODE_SURFACE_MESH;
+    const bool translucent_particle_rendering = particle_render_mode == PARTICLE_RENDER_MODE_TRANSLUCENT;
+    const bool density_volume_rendering = particle_render_mode == PARTICLE_RENDER_MODE_DENSITY_VOLUME;
+    // the LOD walks the grid's cell list
+    const bool particle_lod =
+        particle_render_mode == PARTICLE_RENDER_MODE_RASTERIZED &&
+        p_particle_grid_optional != NULL &&
+        particle_lod_threshold_pixels > 0.f &&
+        particle_count > 0;
+    // the grid is only read by the untiled fancy rendering, by the surface mesh, by the LOD, and by the density volume
+    const ParticleGrid* p_particle_grid =
+        (
+            particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED || surface_mesh_rendering || particle_lod ||
+            density_volume_rendering
+        )
+        ? p_particle_grid_optional : NULL;
+
     SurfaceResourcesImpl* p_surface_resources = (SurfaceResourcesImpl*)surface.impl;
     RenderResourcesImpl* p_render_resources = p_surface_resources->attached_render_resources;
 
     if (p_render_resources == NULL) ABORT_F("render(): Surface is not attached to a renderer.");
 
 
+    // NULL for offscreen surfaces, whose images are used in turn
     u32 acquired_swapchain_image_idx = INVALID_SWAPCHAIN_IMAGE_IDX;
     VkSemaphore swapchain_image_acquired_semaphore = VK_NULL_HANDLE;
-    {
+    if (p_surface_resources->offscreen) {
+        acquired_swapchain_image_idx =
+            (p_surface_resources->last_rendered_offscreen_image_idx + 1) % p_surface_resources->swapchain_image_count;
+    }
+    else {
         u32 im_acquired_semaphore_idx =
             (p_surface_resources->last_used_swapchain_image_acquired_semaphore_idx + 1)
             % p_surface_resources->swapchain_image_count;
@@ -3587,6 +10905,9 @@ RenderResult render(
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             LOG_F(INFO, "acquireNextImageKHR returned VK_ERROR_OUT_OF_DATE_KHR. `render()` returning early.");
             emptyQueueSubmit(&vk_ctx_, optional_wait_semaphore, optional_signal_semaphore, VK_NULL_HANDLE);
+            if (p_particle_interpolation_optional != NULL) {
+                signalParticleInterpolationRead(p_particle_interpolation_optional);
+            }
             return RenderResult::error_surface_resources_out_of_date;
         }
         else if (result == VK_SUBOPTIMAL_KHR) {} // do nothing; we'll handle it after vkQueuePresentKHR
@@ -3610,61 +10931,133 @@ RenderResult render(
     result = vk_dev_procs.ResetFences(device_, 1, &command_buffer_pending_fence);
     assertVk(result);
 
+    releaseRetiredResources(p_render_resources, false);
+    const bool swapchain_sized_images_recreated = resizeSwapchainSizedFrameResources(
+        p_render_resources, this_frame_resources, p_surface_resources->swapchain_extent
+    );
+
+    if (readRenderPassTimestamps(p_render_resources, this_frame_resources)) {
+        updateRenderScale(p_render_resources, this_frame_resources->render_scale);
+        updateParticleSubsampleFraction(p_render_resources, this_frame_resources->particle_subsample_fraction);
+    }
+    readPickResults(p_render_resources, this_frame_resources);
+    const f32 render_scale = p_render_resources->render_scale;
+    this_frame_resources->render_scale = render_scale;
+
+    // Without the LOD, which writes the same instances, the rasterized particles are subsampled to the budget; at a
+    // fraction of 1 they're drawn as usual, but still measured for it. See `setParticleSubsamplingBudget()`.
+    const bool particle_subsampling_budgeted =
+        particle_subsampling_budget_ns_ > 0.0 &&
+        !particle_subsampling_suspended_ &&
+        particle_render_mode == PARTICLE_RENDER_MODE_RASTERIZED &&
+        !particle_lod &&
+        particle_count > 0;
+    const f32 particle_subsample_fraction =
+        particle_subsampling_budgeted ? p_render_resources->particle_subsample_fraction : 0.f;
+    this_frame_resources->particle_subsample_fraction = particle_subsample_fraction;
+    const bool particle_subsampling = particle_subsample_fraction > 0.f && particle_subsample_fraction < 1.f;
+    if (particle_subsampling) {
+        writePickParticleIdsDescriptor(this_frame_resources, particle_ids_buffer_optional);
+    }
+
+    // With dynamic resolution, the fancy particles are ray marched offscreen and upscaled, even at full scale, so
+    // that their cost is measured alike.
+    const bool scaled_particle_rendering = fancy_particle_rendering && dynamic_resolution_budget_ns_ > 0.0;
+    // the viewport that the fancy particles are ray marched over
+    const VkRect2D particle_viewport = scaled_particle_rendering
+        ? VkRect2D { .offset = {0, 0}, .extent = getScaledExtent(window_subregion.extent, render_scale) }
+        : window_subregion;
+
+    const u32 particle_tile_count_x = (particle_viewport.extent.width + PARTICLE_TILE_SIZE - 1) / PARTICLE_TILE_SIZE;
+    const u32 particle_tile_count_y = (particle_viewport.extent.height + PARTICLE_TILE_SIZE - 1) / PARTICLE_TILE_SIZE;
+    const bool particle_tiling =
+        particle_render_mode == PARTICLE_RENDER_MODE_RAY_MARCHED_TILED &&
+        particle_count > 0 &&
+        particle_tile_count_x * particle_tile_count_y <= MAX_PARTICLE_TILE_COUNT;
+
+    // The sim may have been recreated since the last frame, so the grid's buffers are rewritten every frame.
+    if (fancy_particle_rendering || surface_mesh_rendering || particle_lod || density_volume_rendering) {
+        writeParticleGridDescriptors(this_frame_resources->descriptor_set, p_particle_grid, particles_vertex_buffer);
+    }
+    const ParticleInterpolation* p_particle_interpolation = p_particle_interpolation_optional;
+    if (p_particle_interpolation != NULL) {
+        writeParticleInterpolationDescriptors(this_frame_resources->descriptor_set, p_particle_interpolation);
+    }
+
 
     // upload data
     {
         ZoneScopedN("upload data");
 
-        // OPTIMIZE keep stuff persistently mapped?
+        // These buffers are persistently mapped.
         {
             const VmaAllocation allocation = this_frame_resources->uniform_buffer_allocation;
-
-            void* ptr_to_mapped_memory = NULL;
-            result = vmaMapMemory(vma_allocator_, allocation, &ptr_to_mapped_memory);
-            assertVk(result);
+            void* ptr_to_mapped_memory = this_frame_resources->uniform_buffer_allocation_info.pMappedData;
 
             UniformBuffer uniform_data {
                 // OPTIMIZE copying 64 bytes here, is that a lot?
-                .world_to_screen_transform = *world_to_screen_transform
+                .world_to_screen_transform = *world_to_screen_transform,
+                // the depth buffer is the size of the swapchain
+                .viewport = vec4(
+                    window_subregion.offset.x, window_subregion.offset.y,
+                    window_subregion.extent.width, window_subregion.extent.height
+                ),
+                .depth_buffer_size = uvec2(
+                    p_surface_resources->swapchain_extent.width, p_surface_resources->swapchain_extent.height
+                ),
+                .depth_pyramid_level_count = p_render_resources->depth_pyramid_level_count,
+                .depth_pyramid_valid = occlusion_culling_enabled_ && p_render_resources->depth_pyramid_valid,
             };
             *(UniformBuffer*)ptr_to_mapped_memory = uniform_data;
 
             result = vmaFlushAllocation(vma_allocator_, allocation, 0, sizeof(uniform_data));
             assertVk(result);
-
-            vmaUnmapMemory(vma_allocator_, allocation);
+            p_render_resources->transfers.upload_byte_counts[RENDER_TRANSFER_UNIFORMS] += sizeof(uniform_data);
+            p_render_resources->transfers.upload_counts[RENDER_TRANSFER_UNIFORMS]++;
         }
 
-        {
-            const VmaAllocation allocation = this_frame_resources->voxels_buffer_allocation;
-
-            void* ptr_to_mapped_memory = NULL;
-            result = vmaMapMemory(vma_allocator_, allocation, &ptr_to_mapped_memory);
-            assertVk(result);
+        // the quads of the chunks that were edited since the last frame; `recordVoxelMeshEdits()` copies them into
+        // place
+        VoxelStore* voxel_store = p_render_resources->voxel_store;
+        if (voxel_store != NULL && getDirtyVoxelChunkCount(voxel_store) != 0) {
+            ZoneScopedN("voxel meshing");
+
+            updateVoxelMesh(
+                p_render_resources->voxel_mesh,
+                voxel_store,
+                VOXEL_MESH_STAGING_QUAD_COUNT,
+                &p_render_resources->voxel_mesh_cleared_ranges,
+                &p_render_resources->voxel_mesh_staged_quads,
+                &p_render_resources->voxel_mesh_copies
+            );
+        }
+        if (p_render_resources->voxel_mesh_staged_quads.size != 0) {
+            const VmaAllocation allocation = this_frame_resources->voxels_staging_buffer_allocation;
+            void* ptr_to_mapped_memory = this_frame_resources->voxels_staging_buffer_allocation_info.pMappedData;
 
-            const VkDeviceSize memcpy_size = voxel_count * sizeof(Voxel);
-            memcpy(ptr_to_mapped_memory, p_voxels, memcpy_size);
+            const VkDeviceSize memcpy_size = p_render_resources->voxel_mesh_staged_quads.size * sizeof(VoxelQuad);
+            memcpy(ptr_to_mapped_memory, p_render_resources->voxel_mesh_staged_quads.ptr, memcpy_size);
 
             result = vmaFlushAllocation(vma_allocator_, allocation, 0, memcpy_size);
             assertVk(result);
-
-            vmaUnmapMemory(vma_allocator_, allocation);
+            p_render_resources->transfers.upload_byte_counts[RENDER_TRANSFER_VOXEL_MESH] += memcpy_size;
+            p_render_resources->transfers.upload_counts[RENDER_TRANSFER_VOXEL_MESH]++;
         }
 
-        if (outlined_voxel_index_count != 0) {
-            const VmaAllocation allocation = this_frame_resources->outlined_voxels_index_buffer_allocation;
+        // the outlined voxels that `setOutlinedVoxels()` changed; `recordOutlinedVoxelsUpload()` copies them into
+        // place
+        if (p_render_resources->outlined_voxels_dirty && p_render_resources->outlined_voxels_staged.size != 0) {
+            const VmaAllocation allocation = this_frame_resources->outlined_voxels_staging_buffer_allocation;
+            void* ptr_to_mapped_memory =
+                this_frame_resources->outlined_voxels_staging_buffer_allocation_info.pMappedData;
 
-            void* ptr_to_mapped_memory = NULL;
-            result = vmaMapMemory(vma_allocator_, allocation, &ptr_to_mapped_memory);
-            assertVk(result);
-
-            const VkDeviceSize memcpy_size = outlined_voxel_index_count * sizeof(u32);
-            memcpy(ptr_to_mapped_memory, p_outlined_voxel_indices, memcpy_size);
+            const VkDeviceSize memcpy_size = p_render_resources->outlined_voxels_staged.size * sizeof(ivec3);
+            memcpy(ptr_to_mapped_memory, p_render_resources->outlined_voxels_staged.ptr, memcpy_size);
 
             result = vmaFlushAllocation(vma_allocator_, allocation, 0, memcpy_size);
             assertVk(result);
-
-            vmaUnmapMemory(vma_allocator_, allocation);
+            p_render_resources->transfers.upload_byte_counts[RENDER_TRANSFER_VOXEL_OUTLINES] += memcpy_size;
+            p_render_resources->transfers.upload_counts[RENDER_TRANSFER_VOXEL_OUTLINES]++;
         }
     }
 
@@ -3681,15 +11074,180 @@ RenderResult render(
     };
     ParticlePipelineFragmentShaderPushConstants particle_pipeline_frag_shader_push_constants {
         .world_to_screen_transform_inverse = *world_to_screen_transform_inverse, // OPTIMIZE this is a 64-byte copy, is that a lot?
-        .viewport_offset_in_window = vec2(window_subregion.offset.x, window_subregion.offset.y),
-        .viewport_size_in_window = vec2(window_subregion.extent.width, window_subregion.extent.height),
+        .viewport_offset_in_window = vec2(particle_viewport.offset.x, particle_viewport.offset.y),
+        // exactly `render_scale` of the window's, if scaled, rather than rounded up to whole pixels
+        .viewport_size_in_window = scaled_particle_rendering
+            ? render_scale * vec2(window_subregion.extent.width, window_subregion.extent.height)
+            : vec2(window_subregion.extent.width, window_subregion.extent.height),
         .particle_count = particle_count,
         .particle_radius = particle_radius,
         .max_travel_distance = raymarch_max_travel_distance,
+        .cell_table_kind = PARTICLE_CELL_TABLE_NONE,
+        .tile_count_x = particle_tiling ? particle_tile_count_x : 0,
+        .tile_count_y = (particle_tiling && particle_depth_bounds_enabled_) ? particle_tile_count_y : 0,
+    };
+    if (p_particle_grid != NULL) {
+        const bool slots = p_particle_grid->cell_slot_count > 0;
+        ParticlePipelineFragmentShaderPushConstants* c = &particle_pipeline_frag_shader_push_constants;
+        c->cell_table_kind = slots ? PARTICLE_CELL_TABLE_SLOTS : PARTICLE_CELL_TABLE_HASH;
+        c->cell_table_size = slots ? p_particle_grid->cell_slot_count : p_particle_grid->hash_table_size;
+        c->permuted = p_particle_grid->permuted;
+        c->cell_size_reciprocal = p_particle_grid->cell_size_reciprocal;
+        c->max_displacement = p_particle_grid->max_displacement;
+        c->domain_bounds_slot = p_particle_grid->domain_bounds_slot;
+    }
+    // The eye is the point that the transform maps to w = 0 on the view axis, i.e. clip-space (0, 0, 1, 0) up to
+    // scale.
+    const vec4 camera_position_homogeneous = *world_to_screen_transform_inverse * vec4(0.f, 0.f, 1.f, 0.f);
+    ParticleRasterizePipelinePushConstants particle_rasterize_pipeline_push_constants {
+        .camera_position = vec3(camera_position_homogeneous) / camera_position_homogeneous.w,
+        .particle_radius = particle_radius,
+    };
+    ParticleMeshPipelinePushConstants particle_mesh_pipeline_push_constants {
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .particle_radius = particle_radius,
+        .particle_count = particle_count,
+        .phase = 0,
+    };
+    getFrustumPlanes(world_to_screen_transform, particle_mesh_pipeline_push_constants.frustum_planes);
+    const FluidCompositePipelinePushConstants fluid_composite_pipeline_push_constants {
+        .world_to_screen_transform_inverse = *world_to_screen_transform_inverse,
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .particle_radius = particle_radius,
+        .viewport_offset_in_window = vec2(window_subregion.offset.x, window_subregion.offset.y),
+        .viewport_size_in_window = vec2(window_subregion.extent.width, window_subregion.extent.height),
+        .texels_per_pixel = render_scale / (f32)FLUID_SURFACE_DOWNSCALE,
+    };
+    // A length l at distance w from the camera spans about l * |xyz of the transform's row y| / w in NDC, where a
+    // unit is half the viewport; if the camera's transform doesn't scale.
+    const f32 fluid_surface_texels_per_unit =
+        0.5f * ((f32)window_subregion.extent.height * fluid_composite_pipeline_push_constants.texels_per_pixel) *
+        glm::length(vec3(glm::transpose(*world_to_screen_transform)[1]));
+    const ParticleUpscalePipelinePushConstants particle_upscale_pipeline_push_constants {
+        .viewport_offset_in_window = vec2(window_subregion.offset.x, window_subregion.offset.y),
+        .scaled_extent = uvec2(particle_viewport.extent.width, particle_viewport.extent.height),
+        .render_scale = render_scale,
     };
-    ParticleRasterizePipelineVertexShaderPushConstants particle_rasterize_pipeline_vert_shader_push_constants {
+    SurfaceMeshPipelinePushConstants surface_mesh_pipeline_push_constants {};
+    if (surface_mesh_rendering) {
+        const bool slots = p_particle_grid->cell_slot_count > 0;
+        // a block per cell of the sim, so that the particles in a block are few
+        const f32 block_size = 1.f / p_particle_grid->cell_size_reciprocal;
+        // the surface is where the density falls to half of the interior's
+        const f32 iso_density = 0.5f * rest_particle_density;
+        surface_mesh_pipeline_push_constants = SurfaceMeshPipelinePushConstants {
+            .particle_count = particle_count,
+            .cell_table_kind = slots ? PARTICLE_CELL_TABLE_SLOTS : PARTICLE_CELL_TABLE_HASH,
+            .cell_table_size = slots ? p_particle_grid->cell_slot_count : p_particle_grid->hash_table_size,
+            .permuted = p_particle_grid->permuted,
+            .cell_size_reciprocal = p_particle_grid->cell_size_reciprocal,
+            .max_displacement = p_particle_grid->max_displacement,
+            .domain_bounds_slot = p_particle_grid->domain_bounds_slot,
+            .block_size = block_size,
+            .iso_density = iso_density,
+            // the copy that the previous build didn't write
+            .copy = 1 - p_render_resources->surface_mesh_copy,
+            // the previous build's triangles are only reusable if they were sampled the same way
+            .previous_valid =
+                p_render_resources->surface_mesh_valid &&
+                block_size == p_render_resources->surface_mesh_block_size &&
+                iso_density == p_render_resources->surface_mesh_iso_density,
+        };
+        if (particle_count > 0) {
+            p_render_resources->surface_mesh_copy = surface_mesh_pipeline_push_constants.copy;
+            p_render_resources->surface_mesh_valid = true;
+            p_render_resources->surface_mesh_block_size = block_size;
+            p_render_resources->surface_mesh_iso_density = iso_density;
+        }
+    }
+    DensityVolumePipelinePushConstants density_volume_pipeline_push_constants {
+        .world_to_screen_transform_inverse = *world_to_screen_transform_inverse,
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
         .particle_radius = particle_radius,
+        .viewport_offset_in_window = vec2(window_subregion.offset.x, window_subregion.offset.y),
+        .viewport_size_in_window = vec2(window_subregion.extent.width, window_subregion.extent.height),
+        .particle_count = particle_count,
+        .rest_particle_density = rest_particle_density,
+    };
+    if (density_volume_rendering) {
+        density_volume_pipeline_push_constants.permuted = p_particle_grid->permuted;
+        density_volume_pipeline_push_constants.cell_size_reciprocal = p_particle_grid->cell_size_reciprocal;
+        density_volume_pipeline_push_constants.domain_bounds_slot = p_particle_grid->domain_bounds_slot;
+    }
+
+
+    // the pick that `requestPick()` asked for, if any, within the viewport; an empty one is answered right away
+    bool pick = false;
+    VkRect2D pick_rect {};
+    if (p_render_resources->pick_requested) {
+        p_render_resources->pick_requested = false;
+
+        const VkRect2D requested = p_render_resources->pick_rect;
+        const i32 x0 = math::max(requested.offset.x, window_subregion.offset.x);
+        const i32 y0 = math::max(requested.offset.y, window_subregion.offset.y);
+        const i32 x1 = math::min(
+            requested.offset.x + (i32)requested.extent.width,
+            window_subregion.offset.x + (i32)window_subregion.extent.width
+        );
+        const i32 y1 = math::min(
+            requested.offset.y + (i32)requested.extent.height,
+            window_subregion.offset.y + (i32)window_subregion.extent.height
+        );
+        if (x0 < x1 && y0 < y1) {
+            pick = true;
+            pick_rect = VkRect2D { .offset = {x0, y0}, .extent = {(u32)(x1 - x0), (u32)(y1 - y0)} };
+            this_frame_resources->pick_particle_ids = particle_ids_buffer_optional != VK_NULL_HANDLE;
+            writePickParticleIdsDescriptor(this_frame_resources, particle_ids_buffer_optional);
+        }
+        else {
+            p_render_resources->picked_voxel_count = 0;
+            p_render_resources->picked_particle_count = 0;
+            p_render_resources->pick_result_truncated = false;
+            p_render_resources->pick_result_new = true;
+        }
+    }
+
+    // the vector field that `requestVectorField()` asked for, if any
+    const bool vector_field = p_render_resources->vector_field_requested && particle_count > 0;
+    p_render_resources->vector_field_requested = false;
+    VectorFieldPipelinePushConstants vector_field_push_constants {};
+    if (vector_field) {
+        vector_field_push_constants =
+            getVectorFieldPushConstants(&p_render_resources->vector_field, window_subregion.extent, particle_count);
+        writeVectorFieldDescriptors(this_frame_resources, &p_render_resources->vector_field);
+    }
+
+    // The depth order is kept for a few frames, while the camera stays near where it was sorted from; see
+    // `TranslucentParticleSettings`.
+    const ParticleDepthSortPipelinePushConstants particle_depth_sort_push_constants {
+        .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+        .particle_count = particle_count,
     };
+    bool particle_depth_resort = false;
+    if (translucent_particle_rendering && particle_count > 0) {
+        const f32 resort_distance = translucent_particle_settings_.resort_distance_radii * particle_radius;
+        particle_depth_resort =
+            !p_render_resources->particle_depth_sort_valid ||
+            p_render_resources->particle_depth_sort_particle_count != particle_count ||
+            glm::distance(
+                p_render_resources->particle_depth_sort_camera_position,
+                particle_depth_sort_push_constants.camera_position
+            ) > resort_distance ||
+            p_render_resources->particle_depth_sort_age_frames >= translucent_particle_settings_.max_sort_age_frames;
+        if (particle_depth_resort) {
+            p_render_resources->particle_depth_sort_valid = true;
+            p_render_resources->particle_depth_sort_camera_position =
+                particle_depth_sort_push_constants.camera_position;
+            p_render_resources->particle_depth_sort_particle_count = particle_count;
+            p_render_resources->particle_depth_sort_age_frames = 0;
+        }
+        else p_render_resources->particle_depth_sort_age_frames++;
+    }
+    else p_render_resources->particle_depth_sort_valid = false;
+
+    // the views that `requestExtraViews()` asked for, if any
+    const u32 extra_view_count = p_render_resources->extra_view_count;
+    p_render_resources->extra_view_count = 0;
 
 
     VkCommandBufferBeginInfo begin_info {
@@ -3702,6 +11260,18 @@ RenderResult render(
         TracyVkZone(vk_ctx_.tracy_vk_ctx, command_buffer, "render");
         ZoneScopedN("cmd buf record");
 
+        if (swapchain_sized_images_recreated) {
+            recordSwapchainSizedImageLayoutTransitions(command_buffer, this_frame_resources);
+        }
+
+        const VkQueryPool timestamp_query_pool = this_frame_resources->timestamp_query_pool;
+        if (timestamp_query_pool != VK_NULL_HANDLE) {
+            vk_dev_procs.CmdResetQueryPool(command_buffer, timestamp_query_pool, 0, TIMESTAMP_QUERY_COUNT);
+            vk_dev_procs.CmdWriteTimestamp(
+                command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, FRAME_TIMESTAMP_QUERY_IDX
+            );
+        }
+
         {
             // Vk spec 1.3.259, vkQueuePresentKHR:
             //     Any writes to memory backing the images referenced by the pImageIndices and pSwapchains
@@ -3715,6 +11285,7 @@ RenderResult render(
                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                 .srcAccessMask = VK_ACCESS_NONE,
                 .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                // the previous contents are discarded
                 .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
                 .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                 .srcQueueFamilyIndex = queue_family_,
@@ -3732,7 +11303,10 @@ RenderResult render(
                 command_buffer,
                 // Vk spec 1.3.259: VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT [...] specifies
                 // no stage of execution when specified in the first scope.
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // srcStageMask
+                // An offscreen image has no acquire semaphore, so this waits for the readback of its previous frame
+                // instead (see `getLastRenderedOffscreenImage()`), which is on the same queue.
+                p_surface_resources->offscreen ?
+                    VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // srcStageMask
                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // dstStageMask
                 0, // dependencyFlags
                 0, // memoryBarrierCount
@@ -3744,27 +11318,152 @@ RenderResult render(
             );
         }
 
+        if (p_particle_interpolation != NULL && particle_count > 0) {
+            const ParticleInterpolatePipelinePushConstants particle_interpolate_push_constants {
+                .particle_count = particle_count,
+                .alpha = p_particle_interpolation->alpha,
+            };
+            recordParticleInterpolation(this_frame_resources, &particle_interpolate_push_constants, command_buffer);
+        }
+
+        recordVoxelMeshEdits(p_render_resources, this_frame_resources->voxels_staging_buffer, command_buffer);
+        recordOutlinedVoxelsUpload(
+            p_render_resources, this_frame_resources->outlined_voxels_staging_buffer, command_buffer
+        );
+
+        VoxelCullPipelinePushConstants voxel_cull_push_constants {
+            .camera_position = particle_rasterize_pipeline_push_constants.camera_position,
+            .voxel_diameter = VOXEL_DIAMETER,
+            .quad_count = getVoxelMeshQuadSlotCount(p_render_resources->voxel_mesh),
+            .phase = 0,
+            .append_second_phase = visibility_buffer_enabled_,
+        };
+        getFrustumPlanes(world_to_screen_transform, voxel_cull_push_constants.frustum_planes);
+        recordVoxelCulling(this_frame_resources, &voxel_cull_push_constants, command_buffer);
+
+        // the next frame's first phase of occlusion culling tests against the pyramid that this one builds, if any
+        const u32 depth_pyramid_level_count =
+            occlusion_culling_enabled_ ? p_render_resources->depth_pyramid_level_count : 0;
+        p_render_resources->depth_pyramid_valid = occlusion_culling_enabled_;
+
+        if (particle_tiling) {
+            const ParticleTilesPipelinePushConstants particle_tiles_push_constants {
+                .world_to_screen_transform = *world_to_screen_transform,
+                .viewport_size = particle_pipeline_frag_shader_push_constants.viewport_size_in_window,
+                .particle_count = particle_count,
+                .particle_radius = particle_radius,
+                .tile_count_x = particle_tile_count_x,
+                .tile_count_y = particle_tile_count_y,
+                .entry_capacity = PARTICLE_TILE_ENTRY_CAPACITY,
+            };
+            recordParticleTiling(this_frame_resources, &particle_tiles_push_constants, command_buffer);
+        }
+
+        if (particle_lod) {
+            const ParticleLodPipelinePushConstants particle_lod_push_constants = getParticleLodPushConstants(
+                world_to_screen_transform, window_subregion.extent, particle_lod_threshold_pixels, particle_count,
+                particle_radius, p_particle_grid
+            );
+            recordParticleLod(this_frame_resources, &particle_lod_push_constants, command_buffer);
+        }
+        else if (particle_subsampling) {
+            const ParticleSubsamplePipelinePushConstants particle_subsample_push_constants {
+                .particle_count = particle_count,
+                .threshold = (u32)math::min((f64)particle_subsample_fraction * 4294967296.0, 4294967295.0),
+                .particle_radius = particle_radius,
+                // the same screen coverage from fewer spheres
+                .radius_scale = 1.f / sqrtf(particle_subsample_fraction),
+                .particle_ids = particle_ids_buffer_optional != VK_NULL_HANDLE,
+            };
+            recordParticleSubsample(this_frame_resources, &particle_subsample_push_constants, command_buffer);
+        }
+
+        if (vector_field) recordVectorField(this_frame_resources, &vector_field_push_constants, command_buffer);
+
+        // for the extra views too, which draw in the main view's order
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLE_DEPTH_SORT, false);
+        if (translucent_particle_rendering && particle_count > 0) {
+            recordParticleDepthSort(
+                this_frame_resources, p_render_resources, &particle_depth_sort_push_constants, particle_depth_resort,
+                command_buffer
+            );
+        }
+        recordRenderPassTimestamp(timestamp_query_pool, command_buffer, RENDER_PASS_PARTICLE_DEPTH_SORT, true);
+
         // TODO maybe we shouldn't hardcode this, if we're doing the whole "attached renderer" thing?
         // Maybe have a function pointer in the renderer or something to the appropriate Render function. Idk,
         // this is getting kinda weird. Maybe we should just ditch the whole generic crap.
         bool success = recordCommandBuffer(
             this_frame_resources,
-            voxel_count,
-            outlined_voxel_index_count,
+            p_render_resources->outlined_voxel_count,
+            p_render_resources->outlined_voxels_buffer,
             particle_count,
             particles_vertex_buffer,
             p_surface_resources->swapchain_extent,
             window_subregion,
             p_surface_resources->swapchain_image_views[acquired_swapchain_image_idx],
             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            &voxel_cull_push_constants,
+            depth_pyramid_level_count,
             &grid_pipeline_frag_shader_push_constants,
             &particle_pipeline_frag_shader_push_constants,
-            &particle_rasterize_pipeline_vert_shader_push_constants,
-            fancy_particle_rendering,
-            imgui_draw_data
+            &particle_rasterize_pipeline_push_constants,
+            &particle_mesh_pipeline_push_constants,
+            &fluid_composite_pipeline_push_constants,
+            fluid_surface_texels_per_unit,
+            p_render_resources->surface_mesh_buffers,
+            &surface_mesh_pipeline_push_constants,
+            p_render_resources->density_volume_buffer,
+            &density_volume_pipeline_push_constants,
+            p_render_resources->particle_depth_sort_buffers,
+            particle_render_mode,
+            particle_lod || particle_subsampling, // drawn alike
+            vector_field,
+            visibility_buffer_enabled_,
+            false, // extra_view
+            render_scale,
+            scaled_particle_rendering ? &particle_upscale_pipeline_push_constants : NULL,
+            (extra_view_count > 0) ? NULL : imgui_draw_data // over the last view
         );
         alwaysAssert(success);
 
+        if (pick) {
+            // the voxel that the camera is in, so that the voxels near it can be picked; see object_id_voxel.frag
+            const ivec3 pick_origin = ivec3(
+                glm::floor(particle_rasterize_pipeline_push_constants.camera_position / VOXEL_DIAMETER + 0.5f)
+            );
+            this_frame_resources->pick_origin = pick_origin;
+            const ObjectIdVoxelPipelinePushConstants object_id_voxel_push_constants { .origin = pick_origin };
+            recordPick(
+                p_render_resources, this_frame_resources, pick_rect, window_subregion,
+                &object_id_voxel_push_constants, &particle_rasterize_pipeline_push_constants,
+                particle_count, particles_vertex_buffer, command_buffer
+            );
+        }
+
+        // after the pick, which reads the uniforms that they rewrite
+        for (u32 view_idx = 0; view_idx < extra_view_count; view_idx++) {
+            recordExtraView(
+                p_render_resources,
+                this_frame_resources,
+                &p_render_resources->extra_views[view_idx],
+                p_surface_resources->swapchain_extent,
+                p_surface_resources->swapchain_image_views[acquired_swapchain_image_idx],
+                particle_radius,
+                raymarch_max_travel_distance,
+                particle_count,
+                particles_vertex_buffer,
+                particle_render_mode,
+                p_particle_grid,
+                particle_lod,
+                particle_lod_threshold_pixels,
+                &surface_mesh_pipeline_push_constants,
+                &density_volume_pipeline_push_constants,
+                vector_field ? &p_render_resources->vector_field : NULL,
+                (view_idx == extra_view_count - 1) ? imgui_draw_data : NULL
+            );
+        }
+
         {
             // Vk spec 1.3.259, vkQueuePresentKHR:
             //     Any writes to memory backing the images referenced by the pImageIndices and pSwapchains
@@ -3774,12 +11473,14 @@ RenderResult render(
             //     and happens-before the presentation engine accesses the image.
             // I take this to mean that we can set `dstAccessMask = VK_ACCESS_NONE`.
 
+            // An offscreen image is read back instead, by transfer commands that are submitted later.
             VkImageMemoryBarrier color_image_barrier {
                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                 .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                .dstAccessMask = VK_ACCESS_NONE,
+                .dstAccessMask = p_surface_resources->offscreen ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_NONE,
                 .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                .newLayout = p_surface_resources->offscreen ?
+                    OFFSCREEN_IMAGE_FINAL_LAYOUT : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                 .srcQueueFamilyIndex = queue_family_,
                 .dstQueueFamilyIndex = queue_family_,
                 .image = p_surface_resources->swapchain_images[acquired_swapchain_image_idx],
@@ -3794,7 +11495,9 @@ RenderResult render(
             vk_dev_procs.CmdPipelineBarrier(
                 command_buffer,
                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // srcStageMask
-                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dstStageMask
+                p_surface_resources->offscreen ?
+                    VK_PIPELINE_STAGE_TRANSFER_BIT :
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dstStageMask
                 0, // dependencyFlags
                 0, // memoryBarrierCount
                 NULL, // pMemoryBarriers
@@ -3805,6 +11508,13 @@ RenderResult render(
             );
         }
 
+        if (timestamp_query_pool != VK_NULL_HANDLE) {
+            vk_dev_procs.CmdWriteTimestamp(
+                command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool,
+                FRAME_TIMESTAMP_QUERY_IDX + 1
+            );
+        }
+
         TracyVkCollect(vk_ctx_.tracy_vk_ctx, command_buffer);
     }
     result = vk_dev_procs.EndCommandBuffer(command_buffer);
@@ -3812,33 +11522,68 @@ RenderResult render(
 
 
     constexpr u32 wait_semaphore_base_count = 1;
-    const u32 wait_semaphore_count =
-        wait_semaphore_base_count +
-        (optional_wait_semaphore == VK_NULL_HANDLE ? 0 : 1);
+    // an offscreen surface has nothing to acquire
+    u32 wait_semaphore_count = p_surface_resources->offscreen ? 0 : wait_semaphore_base_count;
 
-    const VkSemaphore wait_semaphores[wait_semaphore_base_count + 1] {
-        swapchain_image_acquired_semaphore,
-        optional_wait_semaphore
-    };
-    const VkPipelineStageFlags wait_dst_stage_mask[wait_semaphore_base_count + 1] {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+    VkSemaphore wait_semaphores[wait_semaphore_base_count + 3] { swapchain_image_acquired_semaphore };
+    VkPipelineStageFlags wait_dst_stage_mask[wait_semaphore_base_count + 3] {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
     };
+    // ignored for the binary semaphores
+    u64 wait_semaphore_values[wait_semaphore_base_count + 3] {};
+
+    if (optional_wait_semaphore != VK_NULL_HANDLE) {
+        wait_semaphores[wait_semaphore_count] = optional_wait_semaphore;
+        wait_dst_stage_mask[wait_semaphore_count] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        wait_semaphore_count++;
+    }
+    // The binary semaphore from the sim only covers the positions; the grid is built after them.
+    if (p_particle_grid != NULL) {
+        wait_semaphores[wait_semaphore_count] = p_particle_grid->timeline_semaphore;
+        // read by particle.frag, or by the surface mesh's or the LOD's compute
+        wait_dst_stage_mask[wait_semaphore_count] =
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        wait_semaphore_values[wait_semaphore_count] = p_particle_grid->timeline_value;
+        wait_semaphore_count++;
+    }
+    if (p_particle_interpolation != NULL) {
+        wait_semaphores[wait_semaphore_count] = p_particle_interpolation->wait_semaphore;
+        // read by particle_interpolate.comp
+        wait_dst_stage_mask[wait_semaphore_count] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        wait_semaphore_values[wait_semaphore_count] = p_particle_interpolation->wait_value;
+        wait_semaphore_count++;
+    }
 
 
+    // `render_finished_semaphore` is only waited for by the present
     constexpr u32 signal_semaphore_base_count = 1;
-    const u32 signal_semaphore_count =
-        signal_semaphore_base_count +
-        (optional_signal_semaphore == VK_NULL_HANDLE ? 0 : 1);
-
-    const VkSemaphore signal_semaphores[signal_semaphore_base_count + 1] {
-        this_frame_resources->render_finished_semaphore,
-        optional_signal_semaphore
-    };
+    u32 signal_semaphore_count = 0;
+    VkSemaphore signal_semaphores[signal_semaphore_base_count + 2] {};
+    // ignored for the binary semaphores
+    u64 signal_semaphore_values[signal_semaphore_base_count + 2] {};
+    if (!p_surface_resources->offscreen) {
+        signal_semaphores[signal_semaphore_count++] = this_frame_resources->render_finished_semaphore;
+    }
+    if (optional_signal_semaphore != VK_NULL_HANDLE) {
+        signal_semaphores[signal_semaphore_count++] = optional_signal_semaphore;
+    }
+    if (p_particle_interpolation != NULL) {
+        signal_semaphores[signal_semaphore_count] = p_particle_interpolation->signal_semaphore;
+        signal_semaphore_values[signal_semaphore_count] = p_particle_interpolation->signal_value;
+        signal_semaphore_count++;
+    }
 
 
+    const VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = wait_semaphore_count,
+        .pWaitSemaphoreValues = wait_semaphore_values,
+        .signalSemaphoreValueCount = signal_semaphore_count,
+        .pSignalSemaphoreValues = signal_semaphore_values,
+    };
     const VkSubmitInfo submit_info {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = (p_particle_grid != NULL || p_particle_interpolation != NULL) ? &timeline_info : NULL,
         .waitSemaphoreCount = wait_semaphore_count,
         .pWaitSemaphores = wait_semaphores,
         .pWaitDstStageMask = wait_dst_stage_mask,
@@ -3849,10 +11594,24 @@ RenderResult render(
     };
     result = vk_dev_procs.QueueSubmit(queue_, 1, &submit_info, command_buffer_pending_fence);
     assertVk(result);
+    this_frame_resources->timestamps_pending = this_frame_resources->timestamp_query_pool != VK_NULL_HANDLE;
+    this_frame_resources->pick_pending = pick;
+
+    if (p_surface_resources->offscreen) {
+        p_surface_resources->last_rendered_offscreen_image_idx = acquired_swapchain_image_idx;
+        return RenderResult::success;
+    }
 
 
+    const u64 present_id = p_surface_resources->last_present_id + 1;
+    const VkPresentIdKHR present_id_info {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+        .swapchainCount = 1,
+        .pPresentIds = &present_id,
+    };
     VkPresentInfoKHR present_info {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .pNext = present_wait_supported_ ? &present_id_info : NULL,
         .waitSemaphoreCount = 1,
         .pWaitSemaphores = &this_frame_resources->render_finished_semaphore,
         .swapchainCount = 1,
@@ -3863,6 +11622,8 @@ RenderResult render(
         ZoneScopedN("queuePresent");
         result = vk_dev_procs.QueuePresentKHR(queue_, &present_info);
     }
+    // the id is used up even if the present fails
+    if (present_wait_supported_) p_surface_resources->last_present_id = present_id;
 
     switch (result) {
         case VK_ERROR_OUT_OF_DATE_KHR: return RenderResult::error_surface_resources_out_of_date;
@@ -3879,10 +11640,218 @@ extern VkInstance getVkInstance(void) {
 }
 
 
+extern bool meshShadersSupported(void) {
+    return mesh_shaders_supported_;
+}
+
+extern bool visibilityBufferSupported(void) {
+    return draw_indirect_first_instance_supported_;
+}
+
+
+extern bool presentWaitSupported(void) {
+    return present_wait_supported_;
+}
+
+extern u64 waitForLastPresent(SurfaceResources surface, u64 timeout_ns) {
+
+    ZoneScoped;
+
+    const SurfaceResourcesImpl* p_surface_resources = (const SurfaceResourcesImpl*)surface.impl;
+    const u64 present_id = p_surface_resources->last_present_id;
+    if (!present_wait_supported_ or present_id == 0) return 0;
+
+    VkResult result = waitForPresentKHR_(device_, p_surface_resources->swapchain, present_id, timeout_ns);
+    switch (result) {
+        // the next `render()` finds out that the swapchain is out of date, and the app recreates it
+        case VK_TIMEOUT:
+        case VK_ERROR_OUT_OF_DATE_KHR:
+        case VK_ERROR_SURFACE_LOST_KHR: return 0;
+        case VK_SUBOPTIMAL_KHR: return present_id;
+        default: assertVk(result); return present_id;
+    }
+}
+
+extern u64 getLastPresentId(SurfaceResources surface) {
+    const SurfaceResourcesImpl* p_surface_resources = (const SurfaceResourcesImpl*)surface.impl;
+    return p_surface_resources->last_present_id;
+}
+
+
+extern bool getRenderPassGpuTimes(RenderResources renderer, f64* p_pass_times_ns_out) {
+
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    if (!p_render_resources->pass_gpu_times_valid) return false;
+
+    for (u32 pass = 0; pass < RENDER_PASS_ENUM_COUNT; pass++) {
+        p_pass_times_ns_out[pass] = p_render_resources->pass_gpu_times_ns[pass];
+    }
+    return true;
+}
+
+extern bool getFrameGpuTime(RenderResources renderer, f64* p_frame_time_ns_out) {
+
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    if (!p_render_resources->pass_gpu_times_valid) return false;
+
+    *p_frame_time_ns_out = p_render_resources->frame_gpu_time_ns;
+    return true;
+}
+
+
+extern TransferStats getTransferStats(RenderResources renderer) {
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    return p_render_resources->transfers;
+}
+
+
+extern void requestPick(RenderResources renderer, VkRect2D rect_in_window_pixels) {
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+    p_render_resources->pick_requested = true;
+    p_render_resources->pick_rect = rect_in_window_pixels;
+}
+
+extern void requestVectorField(RenderResources renderer, const VectorField* p_field) {
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+    p_render_resources->vector_field_requested = true;
+    p_render_resources->vector_field = *p_field;
+}
+
+extern void setOutlinedVoxels(RenderResources renderer, u32 voxel_count, const ivec3* p_voxel_coords) {
+    alwaysAssert(voxel_count <= MAX_OUTLINED_VOXEL_COUNT);
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+
+    ArrayList<ivec3>* staged = &p_render_resources->outlined_voxels_staged;
+    staged->resetSize();
+    staged->reserve(voxel_count);
+    if (voxel_count != 0) memcpy(staged->ptr, p_voxel_coords, voxel_count * sizeof(ivec3));
+    staged->size = voxel_count;
+    p_render_resources->outlined_voxels_dirty = true;
+}
+
+extern void requestExtraViews(RenderResources renderer, const View* p_views, u32 view_count) {
+    alwaysAssert(view_count <= MAX_EXTRA_VIEW_COUNT);
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+    p_render_resources->extra_view_count = view_count;
+    for (u32 i = 0; i < view_count; i++) p_render_resources->extra_views[i] = p_views[i];
+}
+
+extern bool getPickResult(RenderResources renderer, PickResult* p_result_out) {
+
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+
+    // the frames that have finished since `render()` last read one, from the oldest, so that the newest pick wins
+    const u32 frames_in_flight = p_render_resources->frames_in_flight;
+    for (u32 i = 1; i <= frames_in_flight; i++) {
+        const u32 frame_idx = (p_render_resources->last_used_frame_idx + i) % frames_in_flight;
+        RenderResourcesImpl::PerFrameResources* p_frame_resources = &p_render_resources->frame_resources_array[frame_idx];
+        if (!p_frame_resources->pick_pending) continue;
+
+        const VkResult result = vk_dev_procs.GetFenceStatus(device_, p_frame_resources->command_buffer_pending_fence);
+        if (result == VK_NOT_READY) continue;
+        assertVk(result);
+        readPickResults(p_render_resources, p_frame_resources);
+    }
+
+    if (!p_render_resources->pick_result_new) return false;
+    p_render_resources->pick_result_new = false;
+
+    *p_result_out = PickResult {
+        .voxel_count = p_render_resources->picked_voxel_count,
+        .voxel_coords = p_render_resources->picked_voxel_coords,
+        .particle_count = p_render_resources->picked_particle_count,
+        .particle_indices = p_render_resources->picked_particle_indices,
+        .particle_ids = p_render_resources->picked_particle_ids,
+        .truncated = p_render_resources->pick_result_truncated,
+    };
+    return true;
+}
+
+
+extern void waitForNextFrameResources(RenderResources renderer) {
+
+    ZoneScoped;
+
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+    const VkFence fence = p_render_resources->peekNextFrameResources()->command_buffer_pending_fence;
+
+    // not reset: `render()` waits on it again, which then returns at once
+    const VkResult result = vk_dev_procs.WaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+    assertVk(result);
+}
+
 extern void setGridEnabled(bool enable) {
     grid_enabled_ = enable;
 }
 
+extern void setOcclusionCullingEnabled(bool enable) {
+    occlusion_culling_enabled_ = enable;
+}
+
+extern void setVisibilityBufferEnabled(bool enable) {
+    visibility_buffer_enabled_ = enable and draw_indirect_first_instance_supported_;
+}
+
+extern void setParticleDepthBoundsEnabled(bool enable) {
+    particle_depth_bounds_enabled_ = enable;
+}
+
+extern void setDynamicResolutionBudget(f64 budget_ms) {
+    alwaysAssert(budget_ms >= 0.0);
+    dynamic_resolution_budget_ns_ = 1e6 * budget_ms;
+}
+
+extern void setParticleSubsamplingBudget(f64 budget_ms) {
+    alwaysAssert(budget_ms >= 0.0);
+    particle_subsampling_budget_ns_ = 1e6 * budget_ms;
+}
+
+extern void setParticleSubsamplingSuspended(bool suspend) {
+    particle_subsampling_suspended_ = suspend;
+}
+
+extern void setTranslucentParticleSettings(const TranslucentParticleSettings* p_settings) {
+    alwaysAssert(p_settings->opacity > 0.f && p_settings->opacity <= 1.f);
+    alwaysAssert(p_settings->resort_distance_radii >= 0.f);
+    translucent_particle_settings_ = *p_settings;
+}
+
+extern f32 getRenderScale(RenderResources renderer) {
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    return p_render_resources->render_scale;
+}
+
+extern f32 getParticleSubsampleFraction(RenderResources renderer) {
+    const RenderResourcesImpl* p_render_resources = (const RenderResourcesImpl*)renderer.impl;
+    return p_render_resources->particle_subsample_fraction;
+}
+
+
+extern MemoryUsage getMemoryUsage(void) {
+    return memory_usage_;
+}
+
+
+extern void setVoxelStore(RenderResources renderer, VoxelStore* voxel_store) {
+
+    RenderResourcesImpl* p_render_resources = (RenderResourcesImpl*)renderer.impl;
+    if (voxel_store == p_render_resources->voxel_store) return;
+
+    // a new mesh, of the whole store; the quads of the old one are cleared with the next frame's mesh edits
+    destroyVoxelMesh(p_render_resources->voxel_mesh);
+    p_render_resources->voxel_mesh = createVoxelMesh(MAX_VOXEL_QUAD_COUNT);
+    p_render_resources->voxel_mesh_cleared_ranges.resetSize();
+    p_render_resources->voxel_mesh_staged_quads.resetSize();
+    p_render_resources->voxel_mesh_copies.resetSize();
+    p_render_resources->voxel_mesh_cleared_ranges.push(VoxelQuadRange {
+        .first = 0,
+        .count = MAX_VOXEL_QUAD_COUNT,
+    });
+
+    p_render_resources->voxel_store = voxel_store;
+    if (voxel_store != NULL) markAllVoxelChunksDirty(voxel_store);
+}
+
 
 extern bool setShaderSourceFileModificationTracking(bool enable) {
 
@@ -3952,18 +11921,7 @@ extern ShaderReloadResult reloadModifiedShaderSourceFiles(RenderResources render
     if (event_count == 0) return ShaderReloadResult::no_shaders_need_reloading;
 
 
-    timespec start_time {};
-    {
-        int success = timespec_get(&start_time, TIME_UTC);
-        LOG_IF_F(ERROR, !success, "Failed to get shader rebuild start time.");
-    }
-
-
-    VkShaderStageFlags modified_shaders[PIPELINE_INDEX_COUNT] {};
-
-    GraphicsPipelineShaderModules new_shader_modules[PIPELINE_INDEX_COUNT];
-    memcpy(new_shader_modules, shader_modules_, PIPELINE_INDEX_COUNT * sizeof(GraphicsPipelineShaderModules));
-
+    bool any_queued = false;
     for (u32fast event_idx = 0; event_idx < event_count; event_idx++) {
         for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
 
@@ -3971,20 +11929,14 @@ extern ShaderReloadResult reloadModifiedShaderSourceFiles(RenderResources render
             ShaderSourceFileWatchIds* this_pipeline_watch_ids = &shader_source_file_watch_ids_[pipeline_idx];
 
             const char* shader_src_filepath = NULL;
-            shaderc_shader_kind shader_type;
-            VkShaderModule* p_shader_module = NULL;
 
             if (this_pipeline_watch_ids->vertex_shader_id == event_watch_id) {
                 shader_src_filepath = PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].vertex_shader_src_filepath;
-                shader_type = shaderc_glsl_vertex_shader;
-                p_shader_module = &new_shader_modules[pipeline_idx].vertex_shader_module;
-                modified_shaders[pipeline_idx] |= VK_SHADER_STAGE_VERTEX_BIT;
+                queued_modified_shaders_[pipeline_idx] |= VK_SHADER_STAGE_VERTEX_BIT;
             }
             else if (this_pipeline_watch_ids->fragment_shader_id == event_watch_id) {
                 shader_src_filepath = PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].fragment_shader_src_filepath;
-                shader_type = shaderc_glsl_fragment_shader;
-                p_shader_module = &new_shader_modules[pipeline_idx].fragment_shader_module;
-                modified_shaders[pipeline_idx] |= VK_SHADER_STAGE_FRAGMENT_BIT;
+                queued_modified_shaders_[pipeline_idx] |= VK_SHADER_STAGE_FRAGMENT_BIT;
             }
             else continue;
 
@@ -3992,76 +11944,47 @@ extern ShaderReloadResult reloadModifiedShaderSourceFiles(RenderResources render
                  INFO, "Shader `%s` (pipeline idx %" PRIuFAST32 ") changed. Will reload.",
                  shader_src_filepath, pipeline_idx
             );
-
-            bool success = createShaderModuleFromShaderSourceFile(
-                device_, shader_src_filepath, shader_type, p_shader_module
-            );
-            if (!success) return ShaderReloadResult::error;
-        }
-    }
-
-
-    PipelineAndLayout new_pipelines[PIPELINE_INDEX_COUNT];
-    memcpy(new_pipelines, pipelines_, PIPELINE_INDEX_COUNT * sizeof(PipelineAndLayout));
-
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
-        if (modified_shaders[pipeline_idx] != 0) {
-            bool success = PIPELINE_HOT_RELOAD_INFOS[pipeline_idx].pfn_createPipeline(
-                device_,
-                new_shader_modules[pipeline_idx].vertex_shader_module,
-                new_shader_modules[pipeline_idx].fragment_shader_module,
-                descriptor_set_layout_,
-                &new_pipelines[pipeline_idx].pipeline,
-                &new_pipelines[pipeline_idx].layout
-            );
-            if (!success) return ShaderReloadResult::error;
+            any_queued = true;
         }
     }
+    // the events may all be for files that no pipeline uses anymore
+    if (!any_queued) return ShaderReloadResult::no_shaders_need_reloading;
 
+    startShaderReload();
+    return ShaderReloadResult::in_progress;
+}
 
-    VkResult result = vk_dev_procs.QueueWaitIdle(queue_);
-    assertVk(result);
-
-    for (u32fast pipeline_idx = 0; pipeline_idx < PIPELINE_INDEX_COUNT; pipeline_idx++) {
-
-        VkShaderStageFlags this_pipeline_modified_shaders = modified_shaders[pipeline_idx];
+extern const VulkanContext* getVkContext(void) {
+    assert(initialized_);
+    return &vk_ctx_;
+}
 
-        if (this_pipeline_modified_shaders != 0) {
-            vk_dev_procs.DestroyPipeline(device_, pipelines_[pipeline_idx].pipeline, NULL);
-            // OPTIMIZE we probably don't need to rebuild the layout
-            vk_dev_procs.DestroyPipelineLayout(device_, pipelines_[pipeline_idx].layout, NULL);
+extern void savePipelineCache(void) {
 
-            if (this_pipeline_modified_shaders & VK_SHADER_STAGE_VERTEX_BIT) vk_dev_procs.DestroyShaderModule(
-                device_, shader_modules_[pipeline_idx].vertex_shader_module, NULL
-            );
-            if (this_pipeline_modified_shaders & VK_SHADER_STAGE_FRAGMENT_BIT) vk_dev_procs.DestroyShaderModule(
-                device_, shader_modules_[pipeline_idx].fragment_shader_module, NULL
-            );
-        }
-    }
+    ZoneScoped;
 
-    memcpy(shader_modules_, new_shader_modules, sizeof(shader_modules_));
-    memcpy(pipelines_, new_pipelines, sizeof(pipelines_));
+    assert(initialized_);
 
+    // so that the pipelines of a background shader reload are in it too
+    if (shader_reload_in_progress_) thread_pool::waitForGroup(thread_pool_, &shader_reload_tasks_);
 
-    timespec end_time;
-    {
-        int success = timespec_get(&end_time, TIME_UTC);
-        LOG_IF_F(ERROR, !success, "Failed to get shader rebuild end time.");
-    }
+    size_t cache_data_size = 0;
+    VkResult result = vk_dev_procs.GetPipelineCacheData(device_, pipeline_cache_, &cache_data_size, NULL);
+    assertVk(result);
 
-    f64 duration_milliseconds =
-        (f64)(end_time.tv_sec - start_time.tv_sec) * 1'000. +
-        (f64)(end_time.tv_nsec - start_time.tv_nsec) / 1'000'000.;
-    LOG_F(INFO, "Shaders reloaded (%.0lf ms).", duration_milliseconds);
+    void* cache_data = malloc(cache_data_size);
+    assertErrno(cache_data != NULL or cache_data_size == 0);
+    defer(free(cache_data));
 
+    // VK_INCOMPLETE if pipelines were added since the size query; what we got is still a valid cache.
+    result = vk_dev_procs.GetPipelineCacheData(device_, pipeline_cache_, &cache_data_size, cache_data);
+    if (result != VK_INCOMPLETE) assertVk(result);
 
-    return ShaderReloadResult::success;
-}
+    char filepath[256];
+    getPipelineCacheFilepath(filepath, sizeof(filepath));
 
-extern const VulkanContext* getVkContext(void) {
-    assert(initialized_);
-    return &vk_ctx_;
+    bool success = file_util::writeEntireFile(filepath, cache_data, cache_data_size);
+    if (success) LOG_F(INFO, "Saved pipeline cache `%s` (%zu bytes).", filepath, cache_data_size);
 }
 
 //
@@ -8,6 +8,7 @@
 // #include "types.hpp"
 // #include "vk_procs.hpp"
 // #include "vulkan_context.hpp"
+// #include "thread_pool.hpp"
 
 namespace graphics {
 
@@ -21,8 +22,12 @@ using glm::mat4;
 // ===========================================================================================================
 //
 
-constexpr u32 MAX_VOXEL_COUNT = 1'000'000;
 constexpr u32 MAX_OUTLINED_VOXEL_COUNT = 1'000'000;
+// The most objects that a pick returns; see `requestPick()`.
+constexpr u32 MAX_PICKED_OBJECT_COUNT = 1 << 16;
+
+// The most frames that a renderer can have in flight; see `createRenderer()`.
+constexpr u32 MAX_FRAMES_IN_FLIGHT = 3;
 
 constexpr f32 VOXEL_RADIUS = 1. / 16.;
 constexpr f32 VOXEL_DIAMETER = 2. * VOXEL_RADIUS;
@@ -38,6 +43,9 @@ struct Voxel {
 static_assert(alignof(Voxel) == 4);
 static_assert(sizeof(Voxel) == 4 * 4);
 
+/// See voxel_store.hpp.
+struct VoxelStore;
+
 struct Particle {
     vec3 coord;
     u8vec4 color;
@@ -45,6 +53,60 @@ struct Particle {
 static_assert(alignof(Particle) == 4);
 static_assert(sizeof(Particle) == 4 * 4);
 
+/// The sim's cells, for the fancy particle rendering to ray march through instead of testing every particle.
+/// Mirrors `fluid_sim::SpatialStructureBuffers`; see there.
+struct ParticleGrid {
+    VkBuffer cells;
+    VkBuffer hash_buckets;
+    VkBuffer cell_slots;
+    u32 hash_table_size;
+    u32 cell_slot_count; // if nonzero, `cell_slots` replaces the 2 buffers above; not counting its header slot
+
+    bool permuted;
+    VkBuffer permutation;
+    VkBuffer reference_positions;
+    f32 max_displacement;
+
+    VkBuffer domain_bounds;
+    u32 domain_bounds_slot;
+    f32 cell_size_reciprocal;
+
+    // `render()` waits for it before reading the buffers
+    VkSemaphore timeline_semaphore;
+    u64 timeline_value;
+};
+
+/// Two states of the particles that `render()` blends into the particle buffer before drawing, for a sim that steps
+/// at its own rate; see sim_thread.hpp. Mirrors `sim_thread::Frame`.
+struct ParticleInterpolation {
+    // `Particle`s, in the same order; the colors are taken from `next_particles`
+    VkBuffer previous_particles;
+    VkBuffer next_particles;
+    f32 alpha; // 0 draws `previous_particles`, 1 `next_particles`
+
+    // `render()` waits for it before reading the buffers
+    VkSemaphore wait_semaphore;
+    u64 wait_value;
+    // and signals it once it has, even if rendering fails
+    VkSemaphore signal_semaphore;
+    u64 signal_value;
+};
+
+/// A vector per particle, e.g. the sim's velocities (see `fluid_sim::getVelocitiesBuffer()`), that `render()` draws
+/// as a line segment from each particle; see `requestVectorField()`.
+struct VectorField {
+    // In the same order as the particles: an array of u32 per component, `component_stride` words apart, of floats;
+    // or, if `half_vectors`, two, `packHalf2x16(x, y)` and `packHalf2x16(z, 0)`. The layout of the sim's velocities.
+    // Written by the same step as the particles, so `render()`'s `optional_wait_semaphore` covers it.
+    VkBuffer vectors;
+    u32 component_stride;
+    bool half_vectors;
+    f32 scale; // a particle's segment is its vector times this, in m
+    // At most a segment is drawn per square of this many pixels of the viewport, so that the field stays legible
+    // and its cost follows the screen; 0 draws every particle's.
+    f32 min_spacing_pixels;
+};
+
 struct SurfaceResources {
     void* impl;
 };
@@ -67,6 +129,7 @@ enum class [[nodiscard]] ShaderReloadResult {
     success,
     no_shaders_need_reloading,
     error,
+    in_progress,
 };
 
 enum PresentMode {
@@ -89,6 +152,71 @@ static inline PresentModeFlagBits PresentModeFlagBits_fromMode(PresentMode mode)
     return (PresentModeFlagBits)(1 << mode);
 }
 
+/// The parts of a `render()` that are timed with timestamp queries; see `getRenderPassGpuTimes()`.
+enum RenderPass {
+    RENDER_PASS_VOXELS = 0,
+    RENDER_PASS_PARTICLES = 1,
+    RENDER_PASS_VOXEL_OUTLINES = 2,
+    RENDER_PASS_GRID = 3,
+    RENDER_PASS_IMGUI = 4,
+    // the passes of `PARTICLE_RENDER_MODE_FLUID_SURFACE` before rendering; its shading counts as particles
+    RENDER_PASS_FLUID_SURFACE = 5,
+    // the extraction of `PARTICLE_RENDER_MODE_SURFACE_MESH`'s mesh; its drawing counts as particles
+    RENDER_PASS_SURFACE_MESH = 6,
+    // the depth pyramid and the second phase of occlusion culling, including its draws
+    RENDER_PASS_OCCLUSION_CULLING = 7,
+    // the ray march of `PARTICLE_RENDER_MODE_RAY_MARCHED(_TILED)` at the dynamic resolution, before rendering; its
+    // upscale counts as particles. See `setDynamicResolutionBudget()`.
+    RENDER_PASS_SCALED_PARTICLES = 8,
+    // the depth sort of `PARTICLE_RENDER_MODE_TRANSLUCENT`, or only its gather on the frames that reuse the order
+    RENDER_PASS_PARTICLE_DEPTH_SORT = 9,
+    // the shading of the visibility buffer; its ids' draws count as voxels and particles. See
+    // `setVisibilityBufferEnabled()`.
+    RENDER_PASS_VISIBILITY_SHADING = 10,
+    // the splat of `PARTICLE_RENDER_MODE_DENSITY_VOLUME`'s volume; its ray march counts as particles
+    RENDER_PASS_DENSITY_VOLUME = 11,
+    RENDER_PASS_ENUM_COUNT
+};
+constexpr const char* RENDER_PASS_NAMES[RENDER_PASS_ENUM_COUNT] {
+    "voxels", "particles", "voxel outlines", "grid", "imgui", "fluid surface", "surface mesh", "occlusion culling",
+    "scaled particles", "particle depth sort", "visibility shading", "density volume",
+};
+
+/// How `render()` draws the particles.
+enum ParticleRenderMode {
+    // each particle as a camera-facing quad, in which its sphere is ray cast
+    PARTICLE_RENDER_MODE_RASTERIZED = 0,
+    // a ray per pixel, tested against the particles; see `render()`
+    PARTICLE_RENDER_MODE_RAY_MARCHED = 1,
+    // the same, but tested only against the particles binned into the pixel's screen tile by a compute pre-pass
+    PARTICLE_RENDER_MODE_RAY_MARCHED_TILED = 2,
+    // the same quads as `PARTICLE_RENDER_MODE_RASTERIZED`, emitted by a mesh shader for the clusters of particles
+    // that a task shader didn't cull; falls back to `PARTICLE_RENDER_MODE_RASTERIZED` without
+    // `meshShadersSupported()`
+    PARTICLE_RENDER_MODE_MESH_SHADED = 3,
+    // a surface over the particles, in screen space: their distances and thicknesses are splatted at reduced
+    // resolution, the distances are smoothed, and the surface is shaded from them
+    PARTICLE_RENDER_MODE_FLUID_SURFACE = 4,
+    // a triangle mesh of the surface where the particles' smoothed density is half the sim's rest density,
+    // extracted with marching cubes by compute passes, which only redo the parts of the fluid that changed; needs
+    // the particle grid, and falls back to `PARTICLE_RENDER_MODE_RASTERIZED` without it
+    PARTICLE_RENDER_MODE_SURFACE_MESH = 5,
+    // the same quads as `PARTICLE_RENDER_MODE_RASTERIZED`, but translucent, blended back to front over the opaque
+    // geometry: a compute pass sorts the particles by their distance from the camera, with the sim's GPU radix sort,
+    // and gathers them into a buffer in that order; see `setTranslucentParticleSettings()`
+    PARTICLE_RENDER_MODE_TRANSLUCENT = 6,
+    // the fluid as a participating medium: a compute pass walks the sim's cell list and splats each occupied cell's
+    // particle count into a coarse density volume, which each pixel ray marches, skipping its empty bricks, for a
+    // bounded number of samples whatever the particle count; needs the particle grid, and falls back to
+    // `PARTICLE_RENDER_MODE_RASTERIZED` without it
+    PARTICLE_RENDER_MODE_DENSITY_VOLUME = 7,
+    PARTICLE_RENDER_MODE_ENUM_COUNT
+};
+constexpr const char* PARTICLE_RENDER_MODE_NAMES[PARTICLE_RENDER_MODE_ENUM_COUNT] {
+    "rasterized", "ray-marched", "ray-marched, tiled", "mesh-shaded", "fluid surface", "surface mesh", "translucent",
+    "density volume",
+};
+
 /// Initialize using the PresentMode enum as an index.
 /// Larger number indicates higher priority.
 /// 0 means "don't use this present mode in any case".
@@ -100,7 +228,16 @@ using PresentModePriorities = u8[PRESENT_MODE_ENUM_COUNT];
 
 /// If `specific_device_request` isn't NULL, attempts to select a device with that name.
 /// If no such device exists or no such device satisfies requirements, silently selects a different device.
-void init(const char* app_name, const char* specific_named_device_request);
+/// If `request_async_compute_queue`, also creates a queue from a compute-only family, if the device has one, or
+/// else a second queue of the graphics family, if it has one, and exposes it as `VulkanContext::compute_queue`.
+/// The pipelines are created concurrently on `thread_pool`, which must outlive the graphics, as shader reloads use it
+/// too.
+void init(
+    const char* app_name,
+    const char* specific_named_device_request,
+    bool request_async_compute_queue,
+    thread_pool::ThreadPool* thread_pool
+);
 
 /// Calls `ImGui_ImplVulkan_Init()`. You might need to call `ImGui::CreateContext()` earlier, idk.
 bool initImGuiVulkanBackend(void);
@@ -128,18 +265,61 @@ Result updateSurfaceResources(
 );
 void destroySurfaceResources(SurfaceResources);
 
+/// Surface resources without a surface, for rendering without a window (e.g. for `video_export`): `render()` draws
+/// into `image_count` images of `extent` in turn, which are `VK_FORMAT_B8G8R8A8_SRGB`, instead of presenting them.
+/// More images let more frames be read back at once. `updateSurfaceResources()` does nothing to them, and they support
+/// no present modes. Returns `error_window_size_zero` if the extent is.
+Result createOffscreenSurfaceResources(
+    VkExtent2D extent,
+    u32 image_count,
+    SurfaceResources* surface_resources_out
+);
+/// The image that the last `render()` to the offscreen `surface_resources` drew into. When that `render()` returns,
+/// its commands are submitted to `VulkanContext::queue`, and they leave the image in
+/// `VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL`, available to transfer reads. Transfer commands that are submitted to that
+/// queue afterwards may read it, until the `render()` that draws into it again; which waits for them first.
+VkImage getLastRenderedOffscreenImage(SurfaceResources surface_resources);
+
 void attachSurfaceToRenderer(SurfaceResources surface, RenderResources renderer);
 void detachSurfaceFromRenderer(SurfaceResources surface, RenderResources renderer);
 
+/// `frames_in_flight`, in [1, MAX_FRAMES_IN_FLIGHT], is how many frames the CPU may record while the GPU is still
+/// rendering the earlier ones: 1 has the least latency, as the CPU waits for each frame to finish before starting on
+/// the next, but leaves the GPU idle while it records; more keep the GPU busy, at a frame's latency each.
 Result createRenderer(
     RenderResources* render_resources_out,
     VkDeviceSize particles_buffer_size,
-    VkBuffer particles_buffer
+    VkBuffer particles_buffer,
+    u32 frames_in_flight
 );
 
+/// The renderer draws the voxels of the store, which the app keeps and edits, as a greedy mesh of their exposed
+/// faces in device-local memory, so that `render()` doesn't upload them every frame: each `render()` re-meshes the
+/// store's dirty chunks, and uploads only their quads (as many as fit; the rest wait for the next frames). It's meant
+/// for voxels that change rarely, and only the mesh's capacity bounds their number. The store must outlive the
+/// renderer, or be replaced first; NULL, the default, draws no voxels. Replacing it re-meshes the new one whole.
+void setVoxelStore(RenderResources renderer, VoxelStore* voxel_store);
+
+/// The voxels that `render()` outlines, e.g. the selection; at most `MAX_OUTLINED_VOXEL_COUNT`. They're copied, and
+/// the next `render()` uploads them to device-local memory, where they stay until the next call, so an outline
+/// costs nothing to upload while it doesn't change. None, initially.
+void setOutlinedVoxels(RenderResources renderer, u32 voxel_count, const ivec3* p_voxel_coords);
+
 /// If `imgui_draw_data` is non-null, calls `ImGui_ImplVulkan_RenderDrawData`.
 /// `optional_wait_semaphore` will be eventually be cleared, and `optional_signal_semaphore` will eventually
 /// be signalled, even if rendering fails.
+/// With `PARTICLE_RENDER_MODE_RAY_MARCHED`, if `p_particle_grid_optional` is non-null, each pixel's ray only visits
+/// the grid cells that it crosses; otherwise it tests every particle. `PARTICLE_RENDER_MODE_SURFACE_MESH` needs the
+/// grid, to sample the density, and `rest_particle_density` (particles / m^3), to place the surface;
+/// `PARTICLE_RENDER_MODE_DENSITY_VOLUME` needs both too, to splat the cells and to scale its opacity. With
+/// `PARTICLE_RENDER_MODE_RASTERIZED` and the grid, the particles of each cell whose bounding sphere would cover fewer
+/// than `particle_lod_threshold_pixels` pixels across are drawn as a single sphere; 0 draws every particle.
+/// If `p_particle_interpolation_optional` is non-null, the first `particle_count` particles are first blended from it
+/// into `particles_vertex_buffer`, which must then be the buffer given to `createRenderer()`; as it must with
+/// `PARTICLE_RENDER_MODE_TRANSLUCENT`, whose sort reads that buffer.
+/// `particle_ids_buffer_optional`, if not VK_NULL_HANDLE, holds a stable id per particle of `particles_vertex_buffer`,
+/// in the same order (e.g. `fluid_sim::getParticleIdsBuffer()`); a pick then returns those, instead of the indices
+/// that only hold until the sim sorts its particles again. The ids must be below 2^31 - 1.
 RenderResult render(
     SurfaceResources surface,
     VkRect2D window_subregion,
@@ -148,13 +328,14 @@ RenderResult render(
     f32 particle_radius,
     f32 raymarch_max_travel_distance,
     ImDrawData* imgui_draw_data,
-    u32 voxel_count,
-    const Voxel* p_voxels,
-    u32 outlined_voxel_index_count,
-    const u32* p_outlined_voxel_indices,
     u32 particle_count,
     VkBuffer particles_vertex_buffer,
-    bool fancy_particle_rendering,
+    VkBuffer particle_ids_buffer_optional,
+    ParticleRenderMode particle_render_mode,
+    const ParticleGrid* p_particle_grid_optional,
+    f32 rest_particle_density,
+    f32 particle_lod_threshold_pixels,
+    const ParticleInterpolation* p_particle_interpolation_optional,
     VkSemaphore optional_wait_semaphore, // optional
     VkSemaphore optional_signal_semaphore // optional
 );
@@ -164,18 +345,197 @@ VkInstance getVkInstance(void);
 
 const VulkanContext* getVkContext(void);
 
+/// Whether the device supports `VK_EXT_mesh_shader`, for `PARTICLE_RENDER_MODE_MESH_SHADED`.
+bool meshShadersSupported(void);
+
+/// Whether the device supports `drawIndirectFirstInstance`, for `setVisibilityBufferEnabled()`.
+bool visibilityBufferSupported(void);
+
+/// Whether the device supports `VK_KHR_present_id` and `VK_KHR_present_wait`, for `waitForLastPresent()`.
+bool presentWaitSupported(void);
+/// Waits, for up to `timeout_ns`, until the image of the last `render()` to `surface` is being shown, then returns the
+/// id of that present (see `getLastPresentId()`). For a low-latency mode: once it returns, no other image is queued for
+/// display, so the app can sample its input after this, and the next frame is shown as soon as it's rendered. Returns
+/// 0 without waiting if present wait isn't supported or nothing was presented yet, and 0 if the wait timed out or the
+/// swapchain is out of date.
+u64 waitForLastPresent(SurfaceResources surface, u64 timeout_ns);
+/// The id of the last present to `surface`, which increases with each `render()`; 0 if present wait isn't supported,
+/// or nothing was presented to its current swapchain yet.
+u64 getLastPresentId(SurfaceResources surface);
+
+/// Writes the pipeline cache to disk, so that the next run doesn't have to compile the same pipelines again.
+/// Call it at shutdown; the cache only grows, so calling it more often is harmless but wasteful.
+void savePipelineCache(void);
+
 void setGridEnabled(bool enable);
+/// Whether the voxels and the mesh-shaded particles are culled against a depth pyramid of what's already drawn, in
+/// addition to the view frustum. On by default.
+void setOcclusionCullingEnabled(bool enable);
+/// Whether the voxels, and the particles of `PARTICLE_RENDER_MODE_RASTERIZED` without LOD, only write an id per pixel
+/// into a visibility buffer, with their depths, which a fullscreen pass then shades, each pixel once; rather than
+/// shading every fragment that passes the depth test, which, in a dense scene, is many per pixel. Only for the main
+/// view, and only if `visibilityBufferSupported()`. Off by default.
+void setVisibilityBufferEnabled(bool enable);
+/// Whether `PARTICLE_RENDER_MODE_RAY_MARCHED_TILED` draws each tile at the least depth of its particles, rather than
+/// the whole viewport at the near plane, so that the depth test rejects the pixels behind what's already drawn, and
+/// the empty tiles aren't shaded at all. On by default.
+void setParticleDepthBoundsEnabled(bool enable);
+/// Dynamic resolution, for the passes whose cost goes with the pixels that they cover: the ray march of
+/// `PARTICLE_RENDER_MODE_RAY_MARCHED(_TILED)`, which is then drawn offscreen and upscaled into the frame, and the
+/// fluid surface of `PARTICLE_RENDER_MODE_FLUID_SURFACE`, which already is. Each `render()` scales their resolution
+/// so that the frame's GPU time (see `getFrameGpuTime()`) comes to about `budget_ms`, from the timestamps of the last
+/// frame that finished; down to a quarter of it along each side. 0, the default, turns it off, and draws them at full
+/// resolution.
+void setDynamicResolutionBudget(f64 budget_ms);
+/// The fraction of their full resolution, along each side, that the scaled passes are drawn at; 1 if dynamic
+/// resolution is off.
+f32 getRenderScale(RenderResources renderer);
+/// Subsampling, for `PARTICLE_RENDER_MODE_RASTERIZED` without the LOD of `render()`: each `render()` draws the
+/// fraction of the particles that brings the frame's GPU time to about `budget_ms`, from the timestamps of the last
+/// frame that finished, as `setDynamicResolutionBudget()` does with the resolution; down to a sixteenth of them.
+/// Which particles are drawn is decided by a hash of each one's id (see `render()`'s `particle_ids_buffer_optional`;
+/// otherwise its index, which the sim's sorting shuffles), so the subset is stable from frame to frame, and a
+/// smaller fraction draws a subset of a larger one's. The drawn particles are scaled up so that they cover about as
+/// much as all of them would. Extra views, and picks, still draw all of them. 0, the default, turns it off.
+void setParticleSubsamplingBudget(f64 budget_ms);
+/// While suspended, e.g. when the scene is still or the frames are captured, every particle is drawn, whatever the
+/// budget; the fraction is kept for when subsampling resumes. Not suspended by default.
+void setParticleSubsamplingSuspended(bool suspend);
+/// The fraction of the rasterized particles that subsampling draws, when it isn't suspended; 1 if it's off.
+f32 getParticleSubsampleFraction(RenderResources renderer);
+
+/// How `PARTICLE_RENDER_MODE_TRANSLUCENT` draws. Sorting a million particles costs more than drawing them, so a
+/// frame only sorts them again if the camera has moved by more than `resort_distance_radii` particle radii since the
+/// last sort, or if the particle count changed, or if the last sort is `max_sort_age_frames` frames old; the others
+/// draw the particles where they are now, in the order of the last sort. The particles don't move far in a few
+/// frames, and the sim's own sorting of them into cells only moves each a few places in the buffer, so the order
+/// stays about right; 0 frames sorts every frame.
+struct TranslucentParticleSettings {
+    f32 opacity; // of a ray through the middle of a particle, in (0, 1]
+    f32 resort_distance_radii;
+    u32 max_sort_age_frames;
+};
+/// See `TranslucentParticleSettings`. By default, an opacity of 0.35, and a sort every 8 frames, or whenever the
+/// camera has moved by 4 particle radii.
+void setTranslucentParticleSettings(const TranslucentParticleSettings* p_settings);
+
+/// The GPU memory that the renderer has allocated, by what it's for. The swapchain images are allocated by the
+/// driver, and only show up in the heap budgets (`vmaGetHeapBudgets()`); the sim counts its own buffers.
+struct MemoryUsage {
+    u64 depth_buffer_bytes; // of every frame in flight, and the depth pyramid; they're recreated with the surface
+    u64 fluid_surface_image_bytes; // likewise; see `PARTICLE_RENDER_MODE_FLUID_SURFACE`
+    u64 scaled_particle_image_bytes; // likewise; see `setDynamicResolutionBudget()`
+    u64 object_id_image_bytes; // likewise; see `requestPick()`
+    u64 offscreen_image_bytes; // see `createOffscreenSurfaceResources()`
+    u64 voxel_buffer_bytes; // device-local, the voxels' mesh; see `setVoxelStore()`
+    u64 surface_mesh_buffer_bytes; // device-local; see `PARTICLE_RENDER_MODE_SURFACE_MESH`
+    u64 particle_depth_sort_buffer_bytes; // device-local; see `PARTICLE_RENDER_MODE_TRANSLUCENT`
+    u64 density_volume_buffer_bytes; // device-local; see `PARTICLE_RENDER_MODE_DENSITY_VOLUME`
+    u64 frame_buffer_bytes; // the uniform, voxel staging and outlined voxel buffers of every frame in flight
+};
+MemoryUsage getMemoryUsage(void);
+
+/// Writes the GPU time (ns) that each `RenderPass` took in the most recent frame that has finished rendering to
+/// `p_pass_times_ns_out[RENDER_PASS_ENUM_COUNT]`: 0 for the passes that it skipped. The results of a frame are
+/// read when `render()` reuses its resources, so they lag by as many frames as can be in flight.
+/// Returns false, and writes nothing, if the device doesn't support timestamps or no frame has finished yet.
+/// Doesn't wait for the GPU.
+bool getRenderPassGpuTimes(RenderResources renderer, f64* p_pass_times_ns_out);
+/// Like `getRenderPassGpuTimes()`, but the GPU time (ns) of the whole frame, from the start of its command buffer to
+/// the end, including what the passes don't time.
+bool getFrameGpuTime(RenderResources renderer, f64* p_frame_time_ns_out);
+
+/// What `render()` writes to or reads from mapped GPU memory; see `getTransferStats()`.
+enum RenderTransfer {
+    RENDER_TRANSFER_UNIFORMS = 0,
+    RENDER_TRANSFER_VOXEL_MESH = 1, // the quads of the edited chunks
+    RENDER_TRANSFER_VOXEL_OUTLINES = 2, // only when they change; see `setOutlinedVoxels()`
+    RENDER_TRANSFER_PICKING = 3, // the pick results, read back
+    RENDER_TRANSFER_ENUM_COUNT
+};
+constexpr const char* RENDER_TRANSFER_NAMES[RENDER_TRANSFER_ENUM_COUNT] {
+    "uniforms", "voxel mesh", "voxel outlines", "picking",
+};
+/// Like `fluid_sim::TransferStats`: the bytes that the renderer has written to or read from mapped GPU memory since
+/// it was created, and in how many writes or reads, per `RenderTransfer`.
+struct TransferStats {
+    u64 upload_byte_counts[RENDER_TRANSFER_ENUM_COUNT];
+    u64 upload_counts[RENDER_TRANSFER_ENUM_COUNT];
+    u64 download_byte_counts[RENDER_TRANSFER_ENUM_COUNT];
+    u64 download_counts[RENDER_TRANSFER_ENUM_COUNT];
+};
+TransferStats getTransferStats(RenderResources renderer);
+
+/// What `getPickResult()` returns. The arrays belong to the renderer, and are valid until the next `render()` or
+/// `getPickResult()`.
+struct PickResult {
+    u32 voxel_count;
+    const ivec3* voxel_coords;
+    u32 particle_count;
+    // into the particles of the `render()` that picked; or, if `particle_ids`, the ids from its
+    // `particle_ids_buffer_optional`
+    const u32* particle_indices;
+    bool particle_ids;
+    // If true, some of the objects in the rectangle are missing: it held more than `MAX_PICKED_OBJECT_COUNT`.
+    bool truncated;
+};
+/// GPU picking: the next `render()` draws the ids of the voxels and particles into an object id image over `rect`,
+/// in pixels of the window (like `render()`'s `window_subregion`, which it's clipped to), and collects the distinct
+/// ones, i.e. what's visible in the rectangle; a 1x1 rectangle picks the object under a pixel. The particles are
+/// picked as spheres, as `PARTICLE_RENDER_MODE_RASTERIZED` draws them, whatever the render mode; the voxels, only
+/// within 512 voxels of the camera along each axis. The results are
+/// read back without waiting for the GPU; see `getPickResult()`. A request replaces the one before it, if no
+/// `render()` took it yet.
+void requestPick(RenderResources renderer, VkRect2D rect_in_window_pixels);
+/// Returns true, and writes the results of the latest pick that finished on the GPU since the last call, usually a
+/// frame or more after its `render()`; otherwise false. Doesn't wait for the GPU.
+bool getPickResult(RenderResources renderer, PickResult* p_result_out);
+
+/// Debug vector fields: the next `render()` draws `*p_field` (which is copied) with the line shaders, from a compute
+/// pass that writes the segments into an indirect draw, so that even a million particles cost about a dispatch and
+/// a draw. Like `requestPick()`, it's only for the next `render()`, so it's to be requested each frame.
+void requestVectorField(RenderResources renderer, const VectorField* p_field);
+
+/// A camera's view of the scene, over a part of the window; see `requestExtraViews()`.
+struct View {
+    VkRect2D window_subregion; // like `render()`'s
+    mat4 world_to_screen_transform;
+    mat4 world_to_screen_transform_inverse;
+};
+constexpr u32 MAX_EXTRA_VIEW_COUNT = 4;
+/// Split viewports: the next `render()` also draws the scene from each of the `view_count` views (which are copied),
+/// in order, over the main view's frame, e.g. a top and a side view inset in it. The views share the frame's work
+/// that doesn't depend on the camera: the particle interpolation, the voxel mesh edits and the surface mesh's
+/// extraction are recorded once, for the main view, and each extra view only records its own culling, particle
+/// passes and draws, into the same command buffer. They don't occlusion cull, as the depth pyramid is the main
+/// view's, and their passes aren't timed, so they draw at the main view's render scale; a pick only sees the main
+/// view, and the GUI is drawn over the last one. Like `requestPick()`, it's only for the next `render()`. At most
+/// `MAX_EXTRA_VIEW_COUNT` views.
+void requestExtraViews(RenderResources renderer, const View* p_views, u32 view_count);
+
+/// Waits until the frame resources that the next `render()` will use are no longer in use by the GPU, which
+/// `render()` would otherwise wait for itself. For frame pacing: the app can sample its input after this, rather
+/// than before the wait, so that the input is newer by the time that the frame is shown.
+void waitForNextFrameResources(RenderResources renderer);
 
 
 /// Watch shader source files, taking note when they are modified.
 /// Returns false on failure to enable or disable.
 [[nodiscard]] bool setShaderSourceFileModificationTracking(bool enable);
 
-/// Shader source tracking must be enabled before running this.
+/// Starts reloading the pipelines of the modified shaders in the background, and returns `in_progress`; or returns
+/// `no_shaders_need_reloading`. The frames keep using the old pipelines until `pollShaderReload()` swaps the new ones
+/// in. Shader source tracking must be enabled before running this.
 [[nodiscard]] ShaderReloadResult reloadModifiedShaderSourceFiles(RenderResources renderer);
 
-/// This can be run without source-file tracking enabled.
-[[nodiscard]] bool reloadAllShaders(RenderResources renderer);
+/// Like `reloadModifiedShaderSourceFiles()`, for every shader. This can be run without source-file tracking enabled.
+void reloadAllShaders(RenderResources renderer);
+
+/// Call once per frame, before `render()`. Once the background shader reload has finished, swaps its pipelines in,
+/// and returns `success`; or `error` if any of them failed to compile or build, and keeps the old ones. Until then,
+/// returns `in_progress`; and `no_shaders_need_reloading` if there's no reload. A reload started while another is in
+/// progress runs after it.
+[[nodiscard]] ShaderReloadResult pollShaderReload(void);
 
 //
 // ===========================================================================================================
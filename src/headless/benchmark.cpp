@@ -0,0 +1,875 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <glm/glm.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../error_util.hpp"
+#include "../defer.hpp"
+#include "../file_util.hpp"
+#include "../vk_procs.hpp"
+#include "../vulkan_context.hpp"
+#include "../thread_pool.hpp"
+#include "../file_watch.hpp"
+#include "../sort.hpp"
+#include "../plugin.hpp"
+#include "../../plugins_src/fluid_sim/fluid_sim_types.hpp"
+#include "../../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "../fluid_sim_params_default.hpp"
+#include "compute_context.hpp"
+#include "headless_util.hpp"
+
+// Times the fluid sim on a fixed set of scenes, and writes the results as JSON.
+//
+// Each scene is a random cube of particles, seeded like the app's scene. The scenes sweep every particle count
+// in `--particles` at every density in `--densities` (particles / m^3); by default, at the density of the app's
+// 100k particles in 5 m, so that the scenes only differ in size. Each scene's sim is created from scratch, and
+// the scenes that wouldn't fit in memory are skipped. After `--warmup-steps` untimed steps, each of the
+// `--steps` measured steps is timed on the host (the `advanceSubsteps()` call, and the call plus waiting for
+// the GPU), and on the GPU per `fluid_sim::SimStage` with `SimParameters::stage_timestamps`. The host waits for
+// the GPU after every measured step, so the steps don't overlap as they do in the app. After the measured
+// steps, the spatial structure's stats are read, since the neighbor count and the hash chain length explain
+// most of the cliffs in the time per particle. The bytes that the measured steps moved between the host and the
+// GPU, per `fluid_sim::TransferCategory`, are in the results too.
+//
+// With `--csv PATH`, also writes a row per scene with the times per step and per particle, for plotting the
+// scaling curves directly.
+//
+// With `--runs N`, each scene is run N times, each with a new sim, and the results also have the median and the
+// median absolute deviation (MAD) across the runs of the time per step and of each stage's GPU time. With
+// `--compare BASELINE`, the results are then compared with a baseline, which is the output of an earlier run on
+// the same kind of machine (the device and the backend must match; keep one per machine class). A scene's step
+// or stage has regressed if its median exceeds the baseline's by more than `--threshold` (a fraction of the
+// baseline's median) and by more than `--mad-factor` times the noise, i.e. the MADs of both. The regressions are
+// logged, and the exit status is 1 if there are any, for CI; a scene that's in only one of the files is skipped.
+//
+// Usage: benchmark [--warmup-steps N] [--steps N] [--delta-t SECONDS] [--substeps N] [--particles N,N,...]
+//                  [--densities D,D,...] [--output PATH] [--csv PATH] [--runs N] [--compare PATH]
+//                  [--threshold FRACTION] [--mad-factor K]
+// Reads `PHYSICAL_DEVICE_NAME`, `FLUID_SIM_CPU_BACKEND`, `FLUID_SIM_HYBRID_GPU_UPDATE` and `FLUID_SIM_GPU_RESIDENT`
+// from the environment. Like `headless`, must be run from the repository root.
+
+using fluid_sim::FluidSimProcs;
+using fluid_sim::SIM_STAGE_COUNT;
+using fluid_sim::SIM_STAGE_NAMES;
+using fluid_sim::TRANSFER_CATEGORY_COUNT;
+using fluid_sim::TRANSFER_CATEGORY_NAMES;
+
+using headless_util::parseUnsignedArg;
+using headless_util::parsePositiveFloatArg;
+
+//
+// ===========================================================================================================
+//
+
+const char* APP_NAME = "an game (benchmark)";
+
+constexpr u32 MAX_PARTICLE_COUNT_COUNT = 16;
+constexpr u32 MAX_DENSITY_COUNT = 8;
+constexpr u32 MAX_SCENE_COUNT = MAX_PARTICLE_COUNT_COUNT * MAX_DENSITY_COUNT;
+constexpr u32 MAX_RUN_COUNT = 32;
+
+// The MAD times this estimates the standard deviation of normally distributed times.
+constexpr f64 MAD_TO_STANDARD_DEVIATION = 1.4826;
+// Below this, a difference is timer resolution rather than a regression, however small the stage.
+constexpr f64 MIN_REGRESSION_MS = 0.02;
+
+// the app's scene
+constexpr u32fast REFERENCE_PARTICLE_COUNT = 100000;
+constexpr f32 REFERENCE_CUBE_SIDE_LENGTH = 5.0f; // m
+constexpr f32 REFERENCE_DENSITY = (f32)REFERENCE_PARTICLE_COUNT
+    / (REFERENCE_CUBE_SIDE_LENGTH * REFERENCE_CUBE_SIDE_LENGTH * REFERENCE_CUBE_SIDE_LENGTH); // particles / m^3
+
+struct Options {
+    u32fast warmup_step_count;
+    u32fast step_count;
+    f32 delta_t;
+    u32 substep_count;
+    u32 particle_count_count;
+    u32fast particle_counts[MAX_PARTICLE_COUNT_COUNT];
+    u32 density_count;
+    f32 densities[MAX_DENSITY_COUNT]; // particles / m^3
+    const char* output_filepath;
+    const char* csv_filepath; // NULL for no CSV
+    u32 run_count;
+    const char* baseline_filepath; // NULL to not compare
+    f32 regression_threshold; // a fraction of the baseline's median
+    f32 regression_mad_factor;
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .warmup_step_count = 20,
+    .step_count = 100,
+    .delta_t = 1.0f / 60.0f,
+    .substep_count = 1,
+    .particle_count_count = 4,
+    .particle_counts = { 10000, 100000, 1000000, 4000000 },
+    .density_count = 1,
+    .densities = { REFERENCE_DENSITY },
+    .output_filepath = "benchmark.json",
+    .csv_filepath = NULL,
+    .run_count = 1,
+    .baseline_filepath = NULL,
+    .regression_threshold = 0.1f,
+    .regression_mad_factor = 3.0f,
+};
+
+struct SceneResults {
+    u32fast particle_count;
+    f32 density;
+    f32 cube_side_length;
+    bool skipped; // because the sim wouldn't fit in memory; nothing else is set then
+
+    // per measured step of every run, in seconds
+    f64 advance_time_sum;
+    f64 advance_time_min;
+    f64 advance_time_max;
+    f64 step_time_sum; // including the wait for the GPU
+    f64 step_time_min;
+    f64 step_time_max;
+
+    u64 uploaded_byte_count_sum;
+    u32fast spatial_structure_rebuild_count;
+    // `SimData::transfers` during the measured steps
+    u64 transfer_upload_byte_sums[TRANSFER_CATEGORY_COUNT];
+    u64 transfer_upload_count_sums[TRANSFER_CATEGORY_COUNT];
+    u64 transfer_download_byte_sums[TRANSFER_CATEGORY_COUNT];
+    u64 transfer_download_count_sums[TRANSFER_CATEGORY_COUNT];
+
+    // false if the stage timestamps are unavailable, e.g. with the CPU backend
+    bool has_stage_gpu_times;
+    f64 stage_gpu_time_sums_ns[SIM_STAGE_COUNT];
+
+    // after the last measured step of the last run
+    fluid_sim::SpatialStructureStats spatial_stats;
+
+    // per run, the mean over its measured steps
+    f64 run_step_ms[MAX_RUN_COUNT];
+    f64 run_stage_gpu_ms[MAX_RUN_COUNT][SIM_STAGE_COUNT];
+    // across the runs
+    f64 step_ms_median;
+    f64 step_ms_mad;
+    f64 stage_gpu_ms_medians[SIM_STAGE_COUNT];
+    f64 stage_gpu_ms_mads[SIM_STAGE_COUNT];
+};
+
+//
+// ===========================================================================================================
+//
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--warmup-steps") == 0) {
+            options.warmup_step_count = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--steps") == 0) options.step_count = (u32fast)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--substeps") == 0) options.substep_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--delta-t") == 0) options.delta_t = parsePositiveFloatArg(name, value);
+        else if (strcmp(name, "--output") == 0) options.output_filepath = value;
+        else if (strcmp(name, "--csv") == 0) options.csv_filepath = value;
+        else if (strcmp(name, "--runs") == 0) options.run_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--compare") == 0) options.baseline_filepath = value;
+        else if (strcmp(name, "--threshold") == 0) options.regression_threshold = parsePositiveFloatArg(name, value);
+        else if (strcmp(name, "--mad-factor") == 0) {
+            options.regression_mad_factor = parsePositiveFloatArg(name, value);
+        }
+        else if (strcmp(name, "--particles") == 0 or strcmp(name, "--densities") == 0) {
+
+            const bool densities = strcmp(name, "--densities") == 0;
+            const u32 max_count = densities ? MAX_DENSITY_COUNT : MAX_PARTICLE_COUNT_COUNT;
+            u32* p_count = densities ? &options.density_count : &options.particle_count_count;
+
+            // comma-separated; parsed in place, one value at a time
+            char buffer[256] {};
+            if (strlen(value) >= sizeof(buffer)) ABORT_F("Value for `%s` is too long.", name);
+            strcpy(buffer, value);
+
+            *p_count = 0;
+            char* save_ptr = NULL;
+            char* token = strtok_r(buffer, ",", &save_ptr);
+            for (; token != NULL; token = strtok_r(NULL, ",", &save_ptr)) {
+                if (*p_count == max_count) ABORT_F("At most %u values for `%s`.", max_count, name);
+                if (densities) options.densities[(*p_count)++] = parsePositiveFloatArg(name, token);
+                else options.particle_counts[(*p_count)++] = (u32fast)parseUnsignedArg(name, token);
+            }
+        }
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    alwaysAssert(options.step_count > 0);
+    alwaysAssert(options.substep_count > 0);
+    alwaysAssert(options.particle_count_count > 0);
+    alwaysAssert(options.density_count > 0);
+    if (options.run_count == 0 or options.run_count > MAX_RUN_COUNT) {
+        ABORT_F("`--runs` must be in [1, %" PRIu32 "].", MAX_RUN_COUNT);
+    }
+    if (options.baseline_filepath != NULL and options.run_count < 3) {
+        LOG_F(WARNING, "Comparing with fewer than 3 runs; the MAD can't tell noise from a regression.");
+    }
+    for (u32 i = 0; i < options.particle_count_count; i++) alwaysAssert(options.particle_counts[i] > 0);
+
+    return options;
+}
+
+
+/// The median of `count` values, and their median absolute deviation from it.
+static void medianAndMad(const f64* p_values, u32 count, f64* p_median_out, f64* p_mad_out) {
+
+    alwaysAssert(count > 0 and count <= MAX_RUN_COUNT);
+    f64 sorted[MAX_RUN_COUNT];
+    memcpy(sorted, p_values, count * sizeof(f64));
+
+    const auto median = [count](f64* p_sorted) {
+        std::sort(p_sorted, p_sorted + count);
+        return (count % 2 == 1) ? p_sorted[count / 2] : 0.5 * (p_sorted[count / 2 - 1] + p_sorted[count / 2]);
+    };
+
+    *p_median_out = median(sorted);
+    for (u32 i = 0; i < count; i++) sorted[i] = fabs(p_values[i] - *p_median_out);
+    *p_mad_out = median(sorted);
+}
+
+
+/// One run of the scene, with a new sim; adds its steps to `p_results`.
+static void runSceneOnce(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const Options* options,
+    u32 run_idx,
+    SceneResults* p_results
+) {
+
+    ZoneScoped;
+
+    fluid_sim::SimData sim_data = headless_util::createSim(
+        procs, params, vk_ctx, thread_pool, p_results->particle_count, p_results->cube_side_length, false
+    );
+    defer(procs->destroy(&sim_data, vk_ctx));
+
+    for (u32fast step_idx = 0; step_idx < options->warmup_step_count; step_idx++) {
+        procs->advanceSubsteps(
+            &sim_data, vk_ctx, thread_pool, options->delta_t, options->substep_count,
+            VK_NULL_HANDLE, VK_NULL_HANDLE
+        );
+    }
+    headless_util::waitForSim(procs, &sim_data, vk_ctx);
+
+    f64 run_step_time_sum = 0.0;
+    f64 run_stage_gpu_time_sums_ns[SIM_STAGE_COUNT] {};
+    const fluid_sim::TransferStats transfers_before = sim_data.transfers;
+
+    for (u32fast step_idx = 0; step_idx < options->step_count; step_idx++) {
+
+        ZoneScopedN("MeasuredStep");
+
+        const timespec start_time = headless_util::now();
+        procs->advanceSubsteps(
+            &sim_data, vk_ctx, thread_pool, options->delta_t, options->substep_count,
+            VK_NULL_HANDLE, VK_NULL_HANDLE
+        );
+        const f64 advance_time = headless_util::secondsSince(&start_time);
+        headless_util::waitForSim(procs, &sim_data, vk_ctx);
+        const f64 step_time = headless_util::secondsSince(&start_time);
+
+        p_results->advance_time_sum += advance_time;
+        p_results->advance_time_min = glm::min(p_results->advance_time_min, advance_time);
+        p_results->advance_time_max = glm::max(p_results->advance_time_max, advance_time);
+        p_results->step_time_sum += step_time;
+        p_results->step_time_min = glm::min(p_results->step_time_min, step_time);
+        p_results->step_time_max = glm::max(p_results->step_time_max, step_time);
+        run_step_time_sum += step_time;
+
+        p_results->uploaded_byte_count_sum += sim_data.uploaded_byte_count;
+        if (sim_data.spatial_structure_rebuilt_last_step) p_results->spatial_structure_rebuild_count++;
+
+        f64 stage_gpu_times_ns[SIM_STAGE_COUNT] {};
+        if (procs->getStageGpuTimes(&sim_data, vk_ctx, true, stage_gpu_times_ns)) {
+            for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+                p_results->stage_gpu_time_sums_ns[stage] += stage_gpu_times_ns[stage];
+                run_stage_gpu_time_sums_ns[stage] += stage_gpu_times_ns[stage];
+            }
+        }
+        else p_results->has_stage_gpu_times = false;
+
+        FrameMark;
+    }
+
+    const fluid_sim::TransferStats* transfers = &sim_data.transfers;
+    for (u32 i = 0; i < TRANSFER_CATEGORY_COUNT; i++) {
+        p_results->transfer_upload_byte_sums[i] +=
+            transfers->upload_byte_counts[i] - transfers_before.upload_byte_counts[i];
+        p_results->transfer_upload_count_sums[i] += transfers->upload_counts[i] - transfers_before.upload_counts[i];
+        p_results->transfer_download_byte_sums[i] +=
+            transfers->download_byte_counts[i] - transfers_before.download_byte_counts[i];
+        p_results->transfer_download_count_sums[i] +=
+            transfers->download_counts[i] - transfers_before.download_counts[i];
+    }
+
+    procs->getSpatialStructureStats(&sim_data, vk_ctx, &p_results->spatial_stats);
+
+    const f64 run_step_count = (f64)options->step_count;
+    p_results->run_step_ms[run_idx] = 1e3 * run_step_time_sum / run_step_count;
+    for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+        p_results->run_stage_gpu_ms[run_idx][stage] = 1e-6 * run_stage_gpu_time_sums_ns[stage] / run_step_count;
+    }
+}
+
+
+static SceneResults runScene(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const Options* options,
+    u32fast particle_count,
+    f32 density
+) {
+
+    ZoneScoped;
+
+    SceneResults results {
+        .particle_count = particle_count,
+        .density = density,
+        .cube_side_length = cbrtf((f32)particle_count / density),
+        .advance_time_min = INFINITY,
+        .step_time_min = INFINITY,
+        .has_stage_gpu_times = true,
+    };
+
+    fluid_sim::SimMemoryUsage memory_usage {};
+    if (!procs->checkMemoryUsage(params, vk_ctx, particle_count, NULL, &memory_usage)) {
+        LOG_F(ERROR, "Skipping %" PRIuFAST32 " particles, which wouldn't fit in memory.", particle_count);
+        results.skipped = true;
+        return results;
+    }
+
+    for (u32 run_idx = 0; run_idx < options->run_count; run_idx++) {
+        runSceneOnce(procs, params, vk_ctx, thread_pool, options, run_idx, &results);
+    }
+
+    medianAndMad(results.run_step_ms, options->run_count, &results.step_ms_median, &results.step_ms_mad);
+    for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+        f64 run_stage_ms[MAX_RUN_COUNT];
+        for (u32 run_idx = 0; run_idx < options->run_count; run_idx++) {
+            run_stage_ms[run_idx] = results.run_stage_gpu_ms[run_idx][stage];
+        }
+        medianAndMad(
+            run_stage_ms, options->run_count, &results.stage_gpu_ms_medians[stage], &results.stage_gpu_ms_mads[stage]
+        );
+    }
+
+    const f64 step_count = (f64)(options->step_count * options->run_count);
+    LOG_F(
+        INFO, "%" PRIuFAST32 " particles at %.1f / m^3: %.3lf ms per step (%.3lf ms in `advanceSubsteps()`), "
+        "%.3lf ns per particle; median of %" PRIu32 " runs %.3lf ms, MAD %.3lf ms.",
+        particle_count, (f64)density, 1e3 * results.step_time_sum / step_count,
+        1e3 * results.advance_time_sum / step_count, 1e9 * results.step_time_sum / step_count / (f64)particle_count,
+        options->run_count, results.step_ms_median, results.step_ms_mad
+    );
+
+    return results;
+}
+
+
+/// Device names are printable ASCII, but may contain quotes.
+static void writeJsonString(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* c = str; *c != '\0'; c++) {
+        if (*c == '"' or *c == '\\') fputc('\\', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+
+static void writeResults(
+    const char* filepath,
+    const VulkanContext* vk_ctx,
+    const fluid_sim::SimParameters* params,
+    const Options* options,
+    const SceneResults* p_scene_results,
+    u32 scene_count
+) {
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    const f64 step_count = (f64)(options->step_count * options->run_count);
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"device\": ");
+    writeJsonString(file, vk_ctx->physical_device_properties.deviceName);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"cpu_backend\": %s,\n", params->cpu_backend ? "true" : "false");
+    fprintf(file, "  \"hybrid_gpu_update\": %s,\n", params->hybrid_gpu_update ? "true" : "false");
+    fprintf(file, "  \"gpu_resident\": %s,\n", params->gpu_resident ? "true" : "false");
+    fprintf(file, "  \"verlet_skin\": %g,\n", (f64)params->verlet_skin);
+    fprintf(file, "  \"delta_t_s\": %g,\n", (f64)options->delta_t);
+    fprintf(file, "  \"substep_count\": %" PRIu32 ",\n", options->substep_count);
+    fprintf(file, "  \"warmup_step_count\": %" PRIuFAST32 ",\n", options->warmup_step_count);
+    fprintf(file, "  \"step_count\": %" PRIuFAST32 ",\n", options->step_count);
+    fprintf(file, "  \"run_count\": %" PRIu32 ",\n", options->run_count);
+    fprintf(file, "  \"scenes\": [\n");
+
+    bool first_scene = true;
+    for (u32 scene_idx = 0; scene_idx < scene_count; scene_idx++) {
+
+        const SceneResults* r = &p_scene_results[scene_idx];
+        if (r->skipped) continue;
+        const f64 particle_count = (f64)r->particle_count;
+
+        fprintf(file, "%s    {\n", first_scene ? "" : ",\n");
+        first_scene = false;
+        fprintf(file, "      \"particle_count\": %" PRIuFAST32 ",\n", r->particle_count);
+        fprintf(file, "      \"density_per_m3\": %g,\n", (f64)r->density);
+        fprintf(file, "      \"cube_side_length_m\": %g,\n", (f64)r->cube_side_length);
+        fprintf(
+            file, "      \"step_ms\": { \"mean\": %.4lf, \"min\": %.4lf, \"max\": %.4lf },\n",
+            1e3 * r->step_time_sum / step_count, 1e3 * r->step_time_min, 1e3 * r->step_time_max
+        );
+        fprintf(
+            file, "      \"step_ns_per_particle\": %.4lf,\n", 1e9 * r->step_time_sum / step_count / particle_count
+        );
+        fprintf(
+            file, "      \"advance_call_ms\": { \"mean\": %.4lf, \"min\": %.4lf, \"max\": %.4lf },\n",
+            1e3 * r->advance_time_sum / step_count, 1e3 * r->advance_time_min, 1e3 * r->advance_time_max
+        );
+        fprintf(
+            file, "      \"uploaded_bytes_per_step\": %.1lf,\n", (f64)r->uploaded_byte_count_sum / step_count
+        );
+        fprintf(file, "      \"transfers_per_step\": {");
+        for (u32 i = 0; i < TRANSFER_CATEGORY_COUNT; i++) {
+            fprintf(
+                file, "%s \"%s\": { \"upload_bytes\": %.1lf, \"uploads\": %.2lf, \"download_bytes\": %.1lf, "
+                "\"downloads\": %.2lf }",
+                (i == 0) ? "" : ",", TRANSFER_CATEGORY_NAMES[i],
+                (f64)r->transfer_upload_byte_sums[i] / step_count, (f64)r->transfer_upload_count_sums[i] / step_count,
+                (f64)r->transfer_download_byte_sums[i] / step_count,
+                (f64)r->transfer_download_count_sums[i] / step_count
+            );
+        }
+        fprintf(file, " },\n");
+        fprintf(
+            file, "      \"spatial_structure_rebuild_fraction\": %.4lf,\n",
+            (f64)r->spatial_structure_rebuild_count / step_count
+        );
+        fprintf(
+            file, "      \"neighbor_count_mean\": %.3lf,\n", (f64)r->spatial_stats.neighbor_count_mean
+        );
+        fprintf(
+            file, "      \"cell_occupancy_mean\": %.3lf,\n", (f64)r->spatial_stats.cell_occupancy_mean
+        );
+        fprintf(
+            file, "      \"hash_chain_length_mean\": %.3lf,\n", (f64)r->spatial_stats.hash_chain_length_mean
+        );
+
+        // across the runs, for `--compare`
+        fprintf(
+            file, "      \"runs\": { \"step_ms\": { \"median\": %.4lf, \"mad\": %.4lf }, \"stage_gpu_ms\": ",
+            r->step_ms_median, r->step_ms_mad
+        );
+        if (r->has_stage_gpu_times) {
+            fprintf(file, "{");
+            for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+                fprintf(
+                    file, "%s \"%s\": { \"median\": %.4lf, \"mad\": %.4lf }",
+                    (stage == 0) ? "" : ",", SIM_STAGE_NAMES[stage],
+                    r->stage_gpu_ms_medians[stage], r->stage_gpu_ms_mads[stage]
+                );
+            }
+            fprintf(file, " } },\n");
+        }
+        else fprintf(file, "null },\n");
+
+        fprintf(file, "      \"stage_gpu_ms\": ");
+        if (r->has_stage_gpu_times) {
+            fprintf(file, "{");
+            for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+                fprintf(
+                    file, "%s \"%s\": %.4lf",
+                    (stage == 0) ? "" : ",", SIM_STAGE_NAMES[stage],
+                    1e-6 * r->stage_gpu_time_sums_ns[stage] / step_count
+                );
+            }
+            fprintf(file, " }\n");
+        }
+        else fprintf(file, "null\n");
+
+        fprintf(file, "    }");
+    }
+
+    fprintf(file, "\n  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) ABORT_F("Failed to write `%s`.", filepath);
+    LOG_F(INFO, "Wrote results to `%s`.", filepath);
+}
+
+
+/// A row per scene that wasn't skipped, with the times per step and per particle; the stage columns are empty
+/// without stage timestamps.
+static void writeResultsCsv(
+    const char* filepath,
+    const Options* options,
+    const SceneResults* p_scene_results,
+    u32 scene_count
+) {
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    const f64 step_count = (f64)(options->step_count * options->run_count);
+
+    fprintf(file, "particle_count,density_per_m3,cube_side_length_m,step_ms,step_ns_per_particle");
+    for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+        fprintf(file, ",%s_gpu_ns_per_particle", SIM_STAGE_NAMES[stage]);
+    }
+    fprintf(file, ",neighbor_count_mean,cell_occupancy_mean,hash_chain_length_mean\n");
+
+    for (u32 scene_idx = 0; scene_idx < scene_count; scene_idx++) {
+
+        const SceneResults* r = &p_scene_results[scene_idx];
+        if (r->skipped) continue;
+        const f64 particle_count = (f64)r->particle_count;
+
+        fprintf(
+            file, "%" PRIuFAST32 ",%g,%g,%.4lf,%.4lf",
+            r->particle_count, (f64)r->density, (f64)r->cube_side_length,
+            1e3 * r->step_time_sum / step_count, 1e9 * r->step_time_sum / step_count / particle_count
+        );
+        for (u32 stage = 0; stage < SIM_STAGE_COUNT; stage++) {
+            if (r->has_stage_gpu_times) {
+                fprintf(file, ",%.5lf", r->stage_gpu_time_sums_ns[stage] / step_count / particle_count);
+            }
+            else fprintf(file, ",");
+        }
+        fprintf(
+            file, ",%.3lf,%.3lf,%.3lf\n",
+            (f64)r->spatial_stats.neighbor_count_mean, (f64)r->spatial_stats.cell_occupancy_mean,
+            (f64)r->spatial_stats.hash_chain_length_mean
+        );
+    }
+
+    if (fclose(file) != 0) ABORT_F("Failed to write `%s`.", filepath);
+    LOG_F(INFO, "Wrote results to `%s`.", filepath);
+}
+
+//
+// baseline ==================================================================================================
+//
+
+// Just enough JSON to read back the results that `writeResults()` wrote: each function takes a pointer to the
+// start of a value, and returns NULL if it isn't the kind of value asked for.
+
+static const char* skipJsonWhitespace(const char* c) {
+    while (*c == ' ' or *c == '\n' or *c == '\r' or *c == '\t') c++;
+    return c;
+}
+
+
+/// Past the value.
+static const char* skipJsonValue(const char* c) {
+
+    if (*c == '"') {
+        for (c++; *c != '"'; c++) {
+            if (*c == '\0') return NULL;
+            if (*c == '\\' and *(++c) == '\0') return NULL;
+        }
+        return c + 1;
+    }
+
+    if (*c == '{' or *c == '[') {
+        const char close = (*c == '{') ? '}' : ']';
+        c = skipJsonWhitespace(c + 1);
+        while (*c != close) {
+            c = skipJsonValue(c); // a key, or an element
+            if (c == NULL) return NULL;
+            c = skipJsonWhitespace(c);
+            if (close == '}') {
+                if (*c != ':') return NULL;
+                c = skipJsonValue(skipJsonWhitespace(c + 1));
+                if (c == NULL) return NULL;
+                c = skipJsonWhitespace(c);
+            }
+            if (*c == ',') c = skipJsonWhitespace(c + 1);
+            else if (*c != close) return NULL;
+        }
+        return c + 1;
+    }
+
+    // a number, `true`, `false` or `null`
+    const char* start = c;
+    while (*c != '\0' and strchr(",]} \n\r\t", *c) == NULL) c++;
+    return (c == start) ? NULL : c;
+}
+
+
+/// Whether the string value holds `str`.
+static bool jsonStringEquals(const char* c, const char* str) {
+
+    if (*c != '"') return false;
+    for (c++; *c != '"'; c++, str++) {
+        if (*c == '\\') c++;
+        if (*c == '\0' or *c != *str) return false;
+    }
+    return *str == '\0';
+}
+
+
+/// The value of the object's member `key`.
+static const char* findJsonMember(const char* c, const char* key) {
+
+    if (c == NULL or *c != '{') return NULL;
+    c = skipJsonWhitespace(c + 1);
+    while (*c == '"') {
+        const bool found = jsonStringEquals(c, key);
+        c = skipJsonValue(c);
+        if (c == NULL) return NULL;
+        c = skipJsonWhitespace(c);
+        if (*c != ':') return NULL;
+        c = skipJsonWhitespace(c + 1);
+        if (found) return c;
+
+        c = skipJsonValue(c);
+        if (c == NULL) return NULL;
+        c = skipJsonWhitespace(c);
+        if (*c == ',') c = skipJsonWhitespace(c + 1);
+    }
+    return NULL;
+}
+
+
+static bool readJsonNumber(const char* c, f64* p_out) {
+
+    if (c == NULL) return false;
+    char* end = NULL;
+    *p_out = strtod(c, &end);
+    return end != c;
+}
+
+
+/// Whether a `current` median of `current_mad` is a regression from a baseline of `baseline_median` and
+/// `baseline_mad`; see `--threshold` and `--mad-factor`.
+static bool isRegression(
+    const Options* options, f64 baseline_median, f64 baseline_mad, f64 current_median, f64 current_mad
+) {
+    const f64 noise_ms = MAD_TO_STANDARD_DEVIATION * sqrt(baseline_mad * baseline_mad + current_mad * current_mad);
+    const f64 allowance_ms = glm::max(
+        glm::max((f64)options->regression_threshold * baseline_median, (f64)options->regression_mad_factor * noise_ms),
+        MIN_REGRESSION_MS
+    );
+    return current_median - baseline_median > allowance_ms;
+}
+
+
+/// Compares the results with the baseline's, which must be from the same device and backend, and logs each
+/// scene's step or stage that has regressed. Returns how many have.
+static u32 compareWithBaseline(
+    const char* baseline_filepath,
+    const VulkanContext* vk_ctx,
+    const fluid_sim::SimParameters* params,
+    const SceneResults* p_scene_results,
+    u32 scene_count,
+    const Options* options
+) {
+
+    ZoneScoped;
+
+    size_t file_size = 0;
+    char* baseline = (char*)file_util::readEntireFile(baseline_filepath, &file_size);
+    if (baseline == NULL) ABORT_F("Failed to read the baseline `%s`.", baseline_filepath);
+    defer(free(baseline));
+    baseline = (char*)realloc(baseline, file_size + 1);
+    alwaysAssert(baseline != NULL);
+    baseline[file_size] = '\0';
+
+    const char* root = skipJsonWhitespace(baseline);
+    if (skipJsonValue(root) == NULL) ABORT_F("The baseline `%s` isn't valid JSON.", baseline_filepath);
+
+    // the machine class
+    const char* device = findJsonMember(root, "device");
+    if (device == NULL or !jsonStringEquals(device, vk_ctx->physical_device_properties.deviceName)) {
+        ABORT_F(
+            "The baseline `%s` is from another device than `%s`.",
+            baseline_filepath, vk_ctx->physical_device_properties.deviceName
+        );
+    }
+    const char* cpu_backend = findJsonMember(root, "cpu_backend");
+    const char* gpu_resident = findJsonMember(root, "gpu_resident");
+    if (
+        cpu_backend == NULL or gpu_resident == NULL or
+        (strncmp(cpu_backend, "true", 4) == 0) != params->cpu_backend or
+        (strncmp(gpu_resident, "true", 4) == 0) != params->gpu_resident
+    ) {
+        ABORT_F("The baseline `%s` is from another backend.", baseline_filepath);
+    }
+
+    const char* scenes = findJsonMember(root, "scenes");
+    if (scenes == NULL or *scenes != '[') ABORT_F("The baseline `%s` has no scenes.", baseline_filepath);
+
+    u32 regression_count = 0;
+    u32 compared_scene_count = 0;
+
+    for (const char* scene = skipJsonWhitespace(scenes + 1); *scene == '{';) {
+
+        f64 particle_count = 0.0;
+        f64 density = 0.0;
+        if (
+            !readJsonNumber(findJsonMember(scene, "particle_count"), &particle_count) or
+            !readJsonNumber(findJsonMember(scene, "density_per_m3"), &density)
+        ) {
+            ABORT_F("A scene of the baseline `%s` has no particle count or density.", baseline_filepath);
+        }
+        const char* runs = findJsonMember(scene, "runs");
+        if (runs == NULL) ABORT_F("The baseline `%s` predates `--runs`; record it again.", baseline_filepath);
+
+        // the scene that was run now; the density was written with 6 significant digits
+        const SceneResults* r = NULL;
+        for (u32 scene_idx = 0; scene_idx < scene_count; scene_idx++) {
+            const SceneResults* candidate = &p_scene_results[scene_idx];
+            if (
+                !candidate->skipped and (f64)candidate->particle_count == particle_count and
+                fabs((f64)candidate->density - density) <= 1e-5 * density
+            ) {
+                r = candidate;
+            }
+        }
+
+        if (r != NULL) {
+            compared_scene_count++;
+
+            const char* step_ms = findJsonMember(runs, "step_ms");
+            f64 baseline_median = 0.0;
+            f64 baseline_mad = 0.0;
+            if (
+                readJsonNumber(findJsonMember(step_ms, "median"), &baseline_median) and
+                readJsonNumber(findJsonMember(step_ms, "mad"), &baseline_mad) and
+                isRegression(options, baseline_median, baseline_mad, r->step_ms_median, r->step_ms_mad)
+            ) {
+                LOG_F(
+                    ERROR, "Regression: %" PRIuFAST32 " particles at %.1f / m^3, step: %.3lf ms (MAD %.3lf), "
+                    "baseline %.3lf ms (MAD %.3lf), +%.1f%%.",
+                    r->particle_count, (f64)r->density, r->step_ms_median, r->step_ms_mad, baseline_median,
+                    baseline_mad, 100.0 * (r->step_ms_median / baseline_median - 1.0)
+                );
+                regression_count++;
+            }
+
+            // null without stage timestamps
+            const char* stage_gpu_ms = findJsonMember(runs, "stage_gpu_ms");
+            for (u32 stage = 0; stage < SIM_STAGE_COUNT and r->has_stage_gpu_times; stage++) {
+
+                const char* stage_ms = findJsonMember(stage_gpu_ms, SIM_STAGE_NAMES[stage]);
+                if (
+                    !readJsonNumber(findJsonMember(stage_ms, "median"), &baseline_median) or
+                    !readJsonNumber(findJsonMember(stage_ms, "mad"), &baseline_mad)
+                ) {
+                    continue;
+                }
+
+                const f64 median = r->stage_gpu_ms_medians[stage];
+                const f64 mad = r->stage_gpu_ms_mads[stage];
+                if (!isRegression(options, baseline_median, baseline_mad, median, mad)) continue;
+
+                LOG_F(
+                    ERROR, "Regression: %" PRIuFAST32 " particles at %.1f / m^3, stage `%s`: %.3lf ms GPU "
+                    "(MAD %.3lf), baseline %.3lf ms (MAD %.3lf).",
+                    r->particle_count, (f64)r->density, SIM_STAGE_NAMES[stage], median, mad, baseline_median,
+                    baseline_mad
+                );
+                regression_count++;
+            }
+        }
+        else {
+            LOG_F(
+                WARNING, "The baseline's scene of %.0lf particles at %.1lf / m^3 wasn't run; not comparing it.",
+                particle_count, density
+            );
+        }
+
+        scene = skipJsonWhitespace(skipJsonValue(scene));
+        if (*scene == ',') scene = skipJsonWhitespace(scene + 1);
+    }
+
+    LOG_F(
+        INFO, "Compared %" PRIu32 " scenes with `%s`: %" PRIu32 " regressions.",
+        compared_scene_count, baseline_filepath, regression_count
+    );
+    return regression_count;
+}
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+
+    thread_pool::ThreadPool* thread_pool = headless_util::createThreadPool();
+    alwaysAssert(thread_pool != NULL);
+    defer(thread_pool::destroy(thread_pool));
+
+    const char* specific_device_request = getenv("PHYSICAL_DEVICE_NAME"); // can be NULL
+    compute_context::init(APP_NAME, specific_device_request);
+    const VulkanContext* vk_ctx = compute_context::getVkContext();
+
+    plugin::init();
+    const FluidSimProcs* fluid_sim_procs = NULL;
+    PLUGIN_LOAD(fluid_sim_procs, FluidSim);
+    alwaysAssert(fluid_sim_procs != NULL);
+
+    fluid_sim::SimParameters params = FLUID_SIM_PARAMS_DEFAULT;
+    params.stage_timestamps = true;
+    if (getenv("FLUID_SIM_CPU_BACKEND") != NULL) params.cpu_backend = true;
+    if (getenv("FLUID_SIM_HYBRID_GPU_UPDATE") != NULL) params.hybrid_gpu_update = true;
+    if (getenv("FLUID_SIM_GPU_RESIDENT") != NULL) params.gpu_resident = true;
+
+    // the particle counts for each density, so that each scaling curve is contiguous
+    static SceneResults scene_results[MAX_SCENE_COUNT] {};
+    u32 scene_count = 0;
+    for (u32 density_idx = 0; density_idx < options.density_count; density_idx++) {
+        for (u32 count_idx = 0; count_idx < options.particle_count_count; count_idx++) {
+            scene_results[scene_count++] = runScene(
+                fluid_sim_procs, &params, vk_ctx, thread_pool, &options,
+                options.particle_counts[count_idx], options.densities[density_idx]
+            );
+        }
+    }
+
+    writeResults(options.output_filepath, vk_ctx, &params, &options, scene_results, scene_count);
+    if (options.csv_filepath != NULL) writeResultsCsv(options.csv_filepath, &options, scene_results, scene_count);
+
+    if (options.baseline_filepath != NULL) {
+        const u32 regression_count = compareWithBaseline(
+            options.baseline_filepath, vk_ctx, &params, scene_results, scene_count, &options
+        );
+        if (regression_count > 0) return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,482 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+
+#define VMA_IMPLEMENTATION
+#define VMA_STATIC_VULKAN_FUNCTIONS 0
+#define VMA_DYNAMIC_VULKAN_FUNCTIONS 1
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include <tracy/tracy/Tracy.hpp>
+#include <tracy/tracy/TracyVulkan.hpp>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../vk_procs.hpp"
+#include "../vulkan_context.hpp"
+#include "compute_context.hpp"
+
+namespace compute_context {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 VULKAN_API_VERSION = VK_API_VERSION_1_3;
+
+constexpr u32 INVALID_PHYSICAL_DEVICE_IDX = UINT32_MAX;
+constexpr u32 INVALID_QUEUE_FAMILY_IDX = UINT32_MAX;
+
+//
+// ===========================================================================================================
+//
+
+static VulkanBaseProcs vk_base_procs {};
+static VulkanInstanceProcs vk_inst_procs {};
+static VulkanDeviceProcs vk_dev_procs {};
+
+static VkInstance instance_ = VK_NULL_HANDLE;
+static VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+static VkDevice device_ = VK_NULL_HANDLE;
+static u32 queue_family_ = INVALID_QUEUE_FAMILY_IDX;
+static VkQueue queue_ = VK_NULL_HANDLE;
+// The same as `queue_family_` and `queue_` if the device has no transfer-only queue family.
+static u32 transfer_queue_family_ = INVALID_QUEUE_FAMILY_IDX;
+static VkQueue transfer_queue_ = VK_NULL_HANDLE;
+
+static VulkanContext vk_ctx_ {};
+static bool initialized_ = false;
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+/// The surface and swapchain extensions aren't enabled, so their procedures stay NULL. Any other missing
+/// procedure is fatal, like in `graphics.cpp`.
+static bool procMayBeMissing(const char* proc_name) {
+    const size_t len = strlen(proc_name);
+    return len >= 3 and strcmp(proc_name + len - 3, "KHR") == 0;
+}
+
+static VulkanBaseProcs VulkanBaseProcs_init(PFN_vkGetInstanceProcAddr getInstanceProcAddr) {
+
+    VulkanBaseProcs procs {};
+
+    #define INITIALIZE_PROC_PTR(PROC_NAME) \
+        { \
+            const char* proc_name = "vk" #PROC_NAME; \
+            procs.PROC_NAME = (PFN_vk##PROC_NAME)getInstanceProcAddr(NULL, proc_name); \
+            if (procs.PROC_NAME == NULL) ABORT_F("Failed to load base procedure `%s`.", proc_name); \
+        }
+
+    FOR_EACH_VK_BASE_PROC(INITIALIZE_PROC_PTR);
+
+    #undef INITIALIZE_PROC_PTR
+
+    return procs;
+}
+
+static VulkanInstanceProcs VulkanInstanceProcs_init(
+    VkInstance instance,
+    PFN_vkGetInstanceProcAddr getInstanceProcAddr
+) {
+    VulkanInstanceProcs procs {};
+
+    #define INITIALIZE_PROC_PTR(PROC_NAME) \
+        { \
+            const char* proc_name = "vk" #PROC_NAME; \
+            procs.PROC_NAME = (PFN_vk##PROC_NAME)getInstanceProcAddr(instance, proc_name); \
+            if (procs.PROC_NAME == NULL and !procMayBeMissing(proc_name)) { \
+                ABORT_F("Failed to load instance procedure `%s`.", proc_name); \
+            } \
+        }
+
+    FOR_EACH_VK_INSTANCE_PROC(INITIALIZE_PROC_PTR);
+
+    #undef INITIALIZE_PROC_PTR
+
+    return procs;
+}
+
+static VulkanDeviceProcs VulkanDeviceProcs_init(VkDevice device, PFN_vkGetDeviceProcAddr getDeviceProcAddr) {
+
+    VulkanDeviceProcs procs {};
+
+    #define INITIALIZE_PROC_PTR(PROC_NAME) \
+        { \
+            const char* proc_name = "vk" #PROC_NAME; \
+            procs.PROC_NAME = (PFN_vk##PROC_NAME)getDeviceProcAddr(device, proc_name); \
+            if (procs.PROC_NAME == NULL and !procMayBeMissing(proc_name)) { \
+                ABORT_F("Failed to load device procedure `%s`.", proc_name); \
+            } \
+        }
+
+    FOR_EACH_VK_DEVICE_PROC(INITIALIZE_PROC_PTR);
+
+    #undef INITIALIZE_PROC_PTR
+
+    return procs;
+}
+
+//
+// ===========================================================================================================
+//
+
+/// Returns INVALID_QUEUE_FAMILY_IDX if the device has no family that supports compute.
+static u32 firstComputeQueueFamily(VkPhysicalDevice device) {
+
+    u32 family_count = 0;
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, NULL);
+    if (family_count == 0) return INVALID_QUEUE_FAMILY_IDX;
+
+    VkQueueFamilyProperties* family_props_list = mallocArray(family_count, VkQueueFamilyProperties);
+    defer(free(family_props_list));
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, family_props_list);
+
+    for (u32 fam = 0; fam < family_count; fam++) {
+        if (
+            (family_props_list[fam].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 and
+            family_props_list[fam].queueCount > 0
+        ) return fam;
+    }
+    return INVALID_QUEUE_FAMILY_IDX;
+}
+
+/// Returns INVALID_QUEUE_FAMILY_IDX if the device has no family that only supports transfers; see
+/// `VulkanContext::transfer_queue`.
+static u32 firstTransferOnlyQueueFamily(VkPhysicalDevice device) {
+
+    u32 family_count = 0;
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, NULL);
+    if (family_count == 0) return INVALID_QUEUE_FAMILY_IDX;
+
+    VkQueueFamilyProperties* family_props_list = mallocArray(family_count, VkQueueFamilyProperties);
+    defer(free(family_props_list));
+    vk_inst_procs.GetPhysicalDeviceQueueFamilyProperties(device, &family_count, family_props_list);
+
+    for (u32 fam = 0; fam < family_count; fam++) {
+        const VkQueueFlags flags = family_props_list[fam].queueFlags;
+        if (
+            (flags & VK_QUEUE_TRANSFER_BIT) != 0 and
+            (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0 and
+            family_props_list[fam].queueCount > 0
+        ) return fam;
+    }
+    return INVALID_QUEUE_FAMILY_IDX;
+}
+
+/// Larger is better; 0 means "don't use". CPU implementations are allowed, for nodes without a GPU.
+static u8 physicalDeviceTypePriority(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+        default: return 0;
+    }
+}
+
+
+#ifdef TRACY_ENABLE
+static tracy::VkCtx* createTracyVkCtx(void) {
+
+    VkCommandPool tracy_command_pool = VK_NULL_HANDLE;
+    {
+        VkCommandPoolCreateInfo command_pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = queue_family_,
+        };
+        VkResult result =
+            vk_dev_procs.CreateCommandPool(device_, &command_pool_info, NULL, &tracy_command_pool);
+        assertVk(result);
+    }
+
+    VkCommandBuffer tracy_command_buffer = NULL;
+    {
+        VkCommandBufferAllocateInfo cmd_buf_alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = tracy_command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        VkResult result =
+            vk_dev_procs.AllocateCommandBuffers(device_, &cmd_buf_alloc_info, &tracy_command_buffer);
+        assertVk(result);
+    }
+
+    tracy::VkCtx* tracy_vk_ctx = TracyVkContext(
+        instance_, physical_device_, device_, queue_, tracy_command_buffer,
+        vk_base_procs.GetInstanceProcAddr, vk_inst_procs.GetDeviceProcAddr
+    );
+    alwaysAssert(tracy_vk_ctx != NULL);
+
+    return tracy_vk_ctx;
+}
+#endif
+
+
+extern void init(const char* app_name, const char* specific_named_device_request) {
+
+    ZoneScoped;
+
+    alwaysAssert(!initialized_);
+
+    // Load the loader ourselves, since there is no GLFW to ask. It stays loaded until exit.
+    {
+        void* vulkan_lib = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (vulkan_lib == NULL) ABORT_F("Failed to load `libvulkan.so.1`; do you need to install drivers?");
+
+        PFN_vkGetInstanceProcAddr getInstanceProcAddr =
+            (PFN_vkGetInstanceProcAddr)dlsym(vulkan_lib, "vkGetInstanceProcAddr");
+        if (getInstanceProcAddr == NULL) ABORT_F("`libvulkan.so.1` has no `vkGetInstanceProcAddr`.");
+
+        vk_base_procs = VulkanBaseProcs_init(getInstanceProcAddr);
+    }
+
+    // Create instance ---------------------------------------------------------------------------------------
+    {
+        #ifndef NDEBUG
+            LOG_F(INFO, "Will enable validation layers.");
+            const u32 instance_layer_count = 1;
+            const char* instance_layers[instance_layer_count] = {"VK_LAYER_KHRONOS_validation"};
+        #else
+            LOG_F(INFO, "Not enabling validation layers.");
+            const u32 instance_layer_count = 0;
+            const char* instance_layers[instance_layer_count] = {};
+        #endif
+
+        VkApplicationInfo app_info {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = app_name,
+            .apiVersion = VULKAN_API_VERSION,
+        };
+
+        VkInstanceCreateInfo instance_info {
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pApplicationInfo = &app_info,
+            .enabledLayerCount = instance_layer_count,
+            .ppEnabledLayerNames = instance_layers,
+        };
+
+        VkResult result = vk_base_procs.CreateInstance(&instance_info, NULL, &instance_);
+        assertVk(result);
+
+        vk_inst_procs = VulkanInstanceProcs_init(instance_, vk_base_procs.GetInstanceProcAddr);
+    }
+
+    // Select physical device and queue family ---------------------------------------------------------------
+    {
+        u32 physical_device_count = 0;
+        VkResult result = vk_inst_procs.EnumeratePhysicalDevices(instance_, &physical_device_count, NULL);
+        assertVk(result);
+
+        if (physical_device_count == 0) ABORT_F("Found no Vulkan devices.");
+
+        VkPhysicalDevice* physical_devices = mallocArray(physical_device_count, VkPhysicalDevice);
+        defer(free(physical_devices));
+
+        result = vk_inst_procs.EnumeratePhysicalDevices(instance_, &physical_device_count, physical_devices);
+        assertVk(result);
+
+        u32 selected_device_idx = INVALID_PHYSICAL_DEVICE_IDX;
+        u8 selected_device_priority = 0;
+        bool selected_device_was_requested = false;
+
+        for (u32 dev_idx = 0; dev_idx < physical_device_count; dev_idx++) {
+
+            VkPhysicalDeviceProperties props {};
+            vk_inst_procs.GetPhysicalDeviceProperties(physical_devices[dev_idx], &props);
+            LOG_F(INFO, "Found physical device %" PRIu32 ": `%s`.", dev_idx, props.deviceName);
+
+            const bool requested =
+                specific_named_device_request != NULL and
+                strcmp(specific_named_device_request, props.deviceName) == 0;
+            const u8 priority = physicalDeviceTypePriority(props.deviceType);
+
+            if (selected_device_was_requested) continue;
+            if (!requested and priority <= selected_device_priority) continue;
+
+            if (firstComputeQueueFamily(physical_devices[dev_idx]) == INVALID_QUEUE_FAMILY_IDX) {
+                LOG_F(INFO, "Physical device %" PRIu32 " has no compute queue family.", dev_idx);
+                continue;
+            }
+
+            selected_device_idx = dev_idx;
+            selected_device_priority = priority;
+            selected_device_was_requested = requested;
+        }
+        LOG_IF_F(
+            WARNING,
+            specific_named_device_request != NULL and !selected_device_was_requested,
+            "Didn't select requested device named `%s`.", specific_named_device_request
+        );
+        CHECK_F(selected_device_idx != INVALID_PHYSICAL_DEVICE_IDX, "Found no satisfactory physical device.");
+
+        physical_device_ = physical_devices[selected_device_idx];
+        queue_family_ = firstComputeQueueFamily(physical_device_);
+
+        transfer_queue_family_ = firstTransferOnlyQueueFamily(physical_device_);
+        if (transfer_queue_family_ != INVALID_QUEUE_FAMILY_IDX) {
+            LOG_F(INFO, "Selected transfer-only queue family %" PRIu32 " for copies.", transfer_queue_family_);
+        }
+        else transfer_queue_family_ = queue_family_;
+    }
+
+    VkPhysicalDeviceProperties physical_device_properties {};
+    VkPhysicalDeviceSubgroupProperties physical_device_subgroup_properties {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+    };
+    {
+        vk_inst_procs.GetPhysicalDeviceProperties(physical_device_, &physical_device_properties);
+        LOG_F(INFO, "Selected physical device `%s`.", physical_device_properties.deviceName);
+
+        VkPhysicalDeviceProperties2 properties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &physical_device_subgroup_properties,
+        };
+        vk_inst_procs.GetPhysicalDeviceProperties2(physical_device_, &properties2);
+        physical_device_subgroup_properties.pNext = NULL;
+    }
+
+    // Create logical device and queue -----------------------------------------------------------------------
+    {
+        const f32 queue_priority = 1.0f;
+        const VkDeviceQueueCreateInfo queue_cinfos[2] {
+            {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = queue_family_,
+                .queueCount = 1,
+                .pQueuePriorities = &queue_priority,
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = transfer_queue_family_,
+                .queueCount = 1,
+                .pQueuePriorities = &queue_priority,
+            },
+        };
+
+        // Mandatory since Vulkan 1.3, so there is no need to check for support.
+        VkPhysicalDeviceSynchronization2Features synchronization2_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+            .synchronization2 = VK_TRUE,
+        };
+        // Mandatory since Vulkan 1.2, so there is no need to check for support.
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .pNext = &synchronization2_features,
+            .timelineSemaphore = VK_TRUE,
+        };
+        VkPhysicalDeviceFeatures2 features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &timeline_semaphore_features,
+        };
+        VkDeviceCreateInfo device_cinfo {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .pNext = &features,
+            // each family may only appear once
+            .queueCreateInfoCount = (transfer_queue_family_ == queue_family_) ? (u32)1 : (u32)2,
+            .pQueueCreateInfos = queue_cinfos,
+        };
+
+        VkResult result = vk_inst_procs.CreateDevice(physical_device_, &device_cinfo, NULL, &device_);
+        assertVk(result);
+
+        vk_dev_procs = VulkanDeviceProcs_init(device_, vk_inst_procs.GetDeviceProcAddr);
+        vk_dev_procs.GetDeviceQueue(device_, queue_family_, 0, &queue_);
+        vk_dev_procs.GetDeviceQueue(device_, transfer_queue_family_, 0, &transfer_queue_);
+    }
+
+    VmaAllocator vma_allocator = NULL;
+    {
+        VmaVulkanFunctions vma_vulkan_functions {
+            .vkGetInstanceProcAddr = vk_base_procs.GetInstanceProcAddr,
+            .vkGetDeviceProcAddr = vk_inst_procs.GetDeviceProcAddr,
+        };
+        VmaAllocatorCreateInfo vma_allocator_info {
+            .physicalDevice = physical_device_,
+            .device = device_,
+            .pVulkanFunctions = &vma_vulkan_functions,
+            .instance = instance_,
+            .vulkanApiVersion = VULKAN_API_VERSION,
+        };
+        VkResult result = vmaCreateAllocator(&vma_allocator_info, &vma_allocator);
+        assertVk(result);
+    }
+
+    // Not persisted: batch runs are long enough that compiling the pipelines once per run doesn't matter.
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+    {
+        const VkPipelineCacheCreateInfo pipeline_cache_info {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        };
+        VkResult result =
+            vk_dev_procs.CreatePipelineCache(device_, &pipeline_cache_info, NULL, &pipeline_cache);
+        assertVk(result);
+    }
+
+    tracy::VkCtx* tracy_vk_ctx = NULL;
+    #ifdef TRACY_ENABLE
+        tracy_vk_ctx = createTracyVkCtx();
+    #endif
+
+    vk_ctx_ = VulkanContext {
+        .procs_base = vk_base_procs,
+        .procs_inst = vk_inst_procs,
+        .procs_dev = vk_dev_procs,
+
+        .vma_allocator = vma_allocator,
+
+        .device = device_,
+        .queue_family_index = queue_family_,
+        .queue = queue_,
+        .compute_queue_family_index = queue_family_,
+        .compute_queue = queue_,
+        .transfer_queue_family_index = transfer_queue_family_,
+        .transfer_queue = transfer_queue_,
+
+        .physical_device_properties = physical_device_properties,
+        .physical_device_subgroup_properties = physical_device_subgroup_properties,
+
+        .pipeline_cache = pipeline_cache,
+
+        .tracy_vk_ctx = tracy_vk_ctx,
+        .compute_tracy_vk_ctx = tracy_vk_ctx,
+    };
+
+    initialized_ = true;
+}
+
+
+extern const VulkanContext* getVkContext(void) {
+    alwaysAssert(initialized_);
+    return &vk_ctx_;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
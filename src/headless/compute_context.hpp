@@ -0,0 +1,30 @@
+#ifndef _COMPUTE_CONTEXT_HPP
+#define _COMPUTE_CONTEXT_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "../types.hpp"
+// #include "../vulkan_context.hpp"
+
+namespace compute_context {
+
+//
+// ===========================================================================================================
+//
+
+/// A slimmer `graphics::init()` for running without a window: loads Vulkan directly instead of through GLFW,
+/// enables no surface or swapchain extensions, and only requires a queue family that supports compute. That
+/// family is both `VulkanContext::queue` and `VulkanContext::compute_queue`.
+/// If `specific_named_device_request` isn't NULL, attempts to select a device with that name.
+/// If no such device exists or no such device satisfies requirements, silently selects a different device.
+void init(const char* app_name, const char* specific_named_device_request);
+
+/// `init()` must have been called before this.
+const VulkanContext* getVkContext(void);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
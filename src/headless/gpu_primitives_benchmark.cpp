@@ -0,0 +1,600 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../vk_procs.hpp"
+#include "../vulkan_context.hpp"
+#include "../gpu_primitives.hpp"
+#include "compute_context.hpp"
+
+// Times each of the `gpu_primitives` on `--count` random words, and writes the results to stdout and to a JSON
+// file. Each primitive is first run once and checked against the same computation on the CPU, then recorded
+// `--repeats` times into one command buffer, between a pair of timestamps. The inputs:
+//     scan              random words in [0, 16)
+//     compact           random flags, half of them set
+//     reduce            random words, added
+//     segmented reduce  the same words, added per segment; the segments are 1 to 32 words long, like cells
+//     histogram         random words, into 256 bins by their low byte
+//     radix sort        random 24-bit keys, like the renderer's depth sort: 3 passes, with the indices as values
+//
+// Usage: gpu_primitives_benchmark [--count N] [--repeats N] [--output PATH]
+// The device may be chosen with the `PHYSICAL_DEVICE_NAME` environment variable, as for `benchmark`.
+
+//
+// ===========================================================================================================
+//
+
+const char* APP_NAME = "an game (gpu primitives benchmark)";
+
+struct Options {
+    u32 count; // of the words of each input
+    u32 repeat_count;
+    const char* output_filepath;
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .count = 1 << 22,
+    .repeat_count = 20,
+    .output_filepath = "gpu_primitives_benchmark.json",
+};
+
+constexpr u32 HISTOGRAM_BIN_COUNT = 256;
+constexpr u32 MAX_SEGMENT_LENGTH = 32;
+constexpr u32 SORT_PASS_COUNT = 3;
+constexpr u32 SORT_KEY_MASK = (1u << (8 * SORT_PASS_COUNT)) - 1;
+
+enum Primitive {
+    PRIMITIVE_SCAN,
+    PRIMITIVE_COMPACT,
+    PRIMITIVE_REDUCE,
+    PRIMITIVE_SEGMENTED_REDUCE,
+    PRIMITIVE_HISTOGRAM,
+    PRIMITIVE_RADIX_SORT,
+    PRIMITIVE_COUNT,
+};
+
+const char* const PRIMITIVE_NAMES[PRIMITIVE_COUNT] {
+    "scan", "compact", "reduce", "segmented reduce", "histogram", "radix sort",
+};
+
+/// The device buffers, of `Options::count` words each but `BUFFER_SMALL`.
+enum Buffer {
+    BUFFER_VALUES, // the scan's and the reductions' input
+    BUFFER_FLAGS,
+    BUFFER_KEYS_0, // the histogram's and the sort's input
+    BUFFER_KEYS_1,
+    BUFFER_INDICES_0, // the sort's values
+    BUFFER_INDICES_1,
+    BUFFER_SEGMENT_FIRSTS,
+    BUFFER_OUTPUT,
+    BUFFER_SMALL, // HISTOGRAM_BIN_COUNT words; a reduction's result and a compaction's count are at the start
+    BUFFER_COUNT,
+};
+
+struct Results {
+    f64 ms_per_run;
+    f64 words_per_second;
+    bool valid;
+};
+
+/// The one command buffer that every submission records into, and waits for.
+struct Commands {
+    VkCommandPool pool;
+    VkCommandBuffer buffer;
+    VkFence fence;
+};
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+static u64 parseUnsignedArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 or end == value or *end != '\0') ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return (u64)parsed;
+}
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--count") == 0) options.count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--repeats") == 0) options.repeat_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--output") == 0) options.output_filepath = value;
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    alwaysAssert(options.count > 0);
+    alwaysAssert(options.repeat_count > 0);
+
+    return options;
+}
+
+
+/// splitmix64, so that a given count always gives the same inputs.
+static u32 nextRandom(u64* p_state) {
+    u64 z = (*p_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (u32)((z ^ (z >> 31)) >> 32);
+}
+
+//
+// ===========================================================================================================
+//
+
+static void beginCommands(const VulkanContext* vk_ctx, const Commands* commands) {
+
+    VkResult result = vk_ctx->procs_dev.ResetCommandBuffer(commands->buffer, 0);
+    assertVk(result);
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(commands->buffer, &begin_info);
+    assertVk(result);
+}
+
+
+static void submitAndWait(const VulkanContext* vk_ctx, const Commands* commands) {
+
+    VkResult result = vk_ctx->procs_dev.EndCommandBuffer(commands->buffer);
+    assertVk(result);
+
+    const VkSubmitInfo submit_info {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commands->buffer,
+    };
+    result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->queue, 1, &submit_info, commands->fence);
+    assertVk(result);
+    result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &commands->fence, VK_TRUE, UINT64_MAX);
+    assertVk(result);
+    result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &commands->fence);
+    assertVk(result);
+}
+
+
+/// Makes everything before it visible to everything after it: the transfers and the compute shaders.
+static void recordFullBarrier(const VulkanContext* vk_ctx, VkCommandBuffer cmd) {
+
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+    };
+    const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vk_ctx->procs_dev.CmdPipelineBarrier(cmd, stages, stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+
+/// Copies `word_count` words between the host and a device buffer, through the mapped staging buffer.
+static void copyWords(
+    const VulkanContext* vk_ctx,
+    const Commands* commands,
+    VkBuffer staging_buffer,
+    void* p_staging,
+    VkBuffer device_buffer,
+    u32 word_count,
+    const u32* p_upload, // or NULL
+    u32* p_download_out // or NULL
+) {
+
+    if (p_upload != NULL) memcpy(p_staging, p_upload, word_count * sizeof(u32));
+
+    beginCommands(vk_ctx, commands);
+    const VkBufferCopy region { .srcOffset = 0, .dstOffset = 0, .size = word_count * sizeof(u32) };
+    if (p_upload != NULL) {
+        vk_ctx->procs_dev.CmdCopyBuffer(commands->buffer, staging_buffer, device_buffer, 1, &region);
+    }
+    else {
+        vk_ctx->procs_dev.CmdCopyBuffer(commands->buffer, device_buffer, staging_buffer, 1, &region);
+        const VkMemoryBarrier host_barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            commands->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &host_barrier, 0, NULL, 0, NULL
+        );
+    }
+    submitAndWait(vk_ctx, commands);
+
+    if (p_download_out != NULL) memcpy(p_download_out, p_staging, word_count * sizeof(u32));
+}
+
+
+/// Records the primitive of `plan` over `count` words.
+static void recordPrimitive(
+    const gpu_primitives::Context* ctx,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    Primitive primitive,
+    const gpu_primitives::Plan* plan,
+    u32 count,
+    u32 segment_count
+) {
+
+    switch (primitive) {
+        case PRIMITIVE_SCAN: gpu_primitives::recordScan(ctx, vk_ctx, cmd, plan, count); break;
+        case PRIMITIVE_COMPACT: gpu_primitives::recordCompact(ctx, vk_ctx, cmd, plan, count); break;
+        case PRIMITIVE_REDUCE: gpu_primitives::recordReduce(ctx, vk_ctx, cmd, plan, count); break;
+        case PRIMITIVE_SEGMENTED_REDUCE:
+            gpu_primitives::recordSegmentedReduce(ctx, vk_ctx, cmd, plan, count, segment_count);
+            break;
+        case PRIMITIVE_HISTOGRAM: gpu_primitives::recordHistogram(ctx, vk_ctx, cmd, plan, count, 0); break;
+        case PRIMITIVE_RADIX_SORT:
+            // 24-bit keys, so the sort reads the `_0` buffers and ends in the `_1` ones. Its second pass writes the
+            // `_0` ones, so each repeat sorts the same keys in another order, which is the same work
+            (void)gpu_primitives::recordRadixSort(ctx, vk_ctx, cmd, plan, count, SORT_PASS_COUNT, true);
+            break;
+        default: alwaysAssert(false);
+    }
+}
+
+
+static void writeResults(const char* filepath, const Options* options, const Results* p_results) {
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"count\": %" PRIu32 ",\n", options->count);
+    fprintf(file, "  \"repeat_count\": %" PRIu32 ",\n", options->repeat_count);
+    fprintf(file, "  \"primitives\": [\n");
+
+    for (u32 i = 0; i < PRIMITIVE_COUNT; i++) {
+        const Results* r = &p_results[i];
+        fprintf(
+            file,
+            "    { \"name\": \"%s\", \"ms_per_run\": %.4lf, \"words_per_second\": %.0lf, \"valid\": %s }%s\n",
+            PRIMITIVE_NAMES[i], r->ms_per_run, r->words_per_second, r->valid ? "true" : "false",
+            (i + 1 == PRIMITIVE_COUNT) ? "" : ","
+        );
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) ABORT_F("Failed to write `%s`.", filepath);
+    LOG_F(INFO, "Wrote results to `%s`.", filepath);
+}
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+    const u32 count = options.count;
+
+    const char* specific_device_request = getenv("PHYSICAL_DEVICE_NAME"); // can be NULL
+    compute_context::init(APP_NAME, specific_device_request);
+    const VulkanContext* vk_ctx = compute_context::getVkContext();
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+    VkResult result;
+
+    gpu_primitives::Context* ctx = gpu_primitives::createContext(vk_ctx);
+    defer(gpu_primitives::destroyContext(ctx, vk_ctx));
+
+    // the inputs, and what the CPU makes of them
+    u32* values = mallocArray(count, u32);
+    u32* flags = mallocArray(count, u32);
+    u32* keys = mallocArray(count, u32);
+    u32* segment_firsts = mallocArray(count, u32);
+    u32* expected = mallocArray(count, u32);
+    u32* actual = mallocArray(count, u32);
+    u32* actual_values = mallocArray(count, u32);
+    defer(free(values));
+    defer(free(flags));
+    defer(free(keys));
+    defer(free(segment_firsts));
+    defer(free(expected));
+    defer(free(actual));
+    defer(free(actual_values));
+
+    u32 segment_count = 0;
+    {
+        u64 random_state = count;
+        for (u32 i = 0; i < count; i++) {
+            values[i] = nextRandom(&random_state) % 16;
+            flags[i] = nextRandom(&random_state) & 1;
+            keys[i] = nextRandom(&random_state) & SORT_KEY_MASK;
+        }
+        for (u32 first = 0; first < count; first += 1 + nextRandom(&random_state) % MAX_SEGMENT_LENGTH) {
+            segment_firsts[segment_count++] = first;
+        }
+    }
+
+    // the device's buffers, and a staging buffer for the uploads and the downloads
+    VkBuffer buffers[BUFFER_COUNT] {};
+    VmaAllocation allocations[BUFFER_COUNT] {};
+    for (u32 i = 0; i < BUFFER_COUNT; i++) {
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = ((i == BUFFER_SMALL) ? HISTOGRAM_BIN_COUNT : count) * sizeof(u32),
+            .usage =
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        const VmaAllocationCreateInfo alloc_info { .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE };
+        result = vmaCreateBuffer(vk_ctx->vma_allocator, &buffer_info, &alloc_info, &buffers[i], &allocations[i], NULL);
+        assertVk(result);
+    }
+    defer(
+        for (u32 i = 0; i < BUFFER_COUNT; i++) vmaDestroyBuffer(vk_ctx->vma_allocator, buffers[i], allocations[i])
+    );
+
+    VkBuffer staging_buffer = VK_NULL_HANDLE;
+    VmaAllocation staging_allocation = VK_NULL_HANDLE;
+    VmaAllocationInfo staging_allocation_info {};
+    {
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = count * sizeof(u32),
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &staging_buffer, &staging_allocation, &staging_allocation_info
+        );
+        assertVk(result);
+    }
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, staging_buffer, staging_allocation));
+    void* p_staging = staging_allocation_info.pMappedData;
+
+    Commands commands {};
+    {
+        const VkCommandPoolCreateInfo pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = vk_ctx->queue_family_index,
+        };
+        result = procs->CreateCommandPool(vk_ctx->device, &pool_info, NULL, &commands.pool);
+        assertVk(result);
+
+        const VkCommandBufferAllocateInfo alloc_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = commands.pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result = procs->AllocateCommandBuffers(vk_ctx->device, &alloc_info, &commands.buffer);
+        assertVk(result);
+
+        const VkFenceCreateInfo fence_info { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        result = procs->CreateFence(vk_ctx->device, &fence_info, NULL, &commands.fence);
+        assertVk(result);
+    }
+    defer(procs->DestroyFence(vk_ctx->device, commands.fence, NULL));
+    defer(procs->DestroyCommandPool(vk_ctx->device, commands.pool, NULL));
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    {
+        const VkQueryPoolCreateInfo query_pool_info {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+        };
+        result = procs->CreateQueryPool(vk_ctx->device, &query_pool_info, NULL, &query_pool);
+        assertVk(result);
+    }
+    defer(procs->DestroyQueryPool(vk_ctx->device, query_pool, NULL));
+
+    const struct { Buffer buffer; const u32* p_words; u32 word_count; } uploads[] {
+        { BUFFER_VALUES, values, count },
+        { BUFFER_FLAGS, flags, count },
+        { BUFFER_KEYS_0, keys, count },
+        { BUFFER_SEGMENT_FIRSTS, segment_firsts, segment_count },
+    };
+    for (const auto& upload : uploads) {
+        copyWords(
+            vk_ctx, &commands, staging_buffer, p_staging,
+            buffers[upload.buffer], upload.word_count, upload.p_words, NULL
+        );
+    }
+
+    auto range = [&](Buffer buffer) {
+        return gpu_primitives::BufferRange { buffers[buffer], 0, VK_WHOLE_SIZE };
+    };
+    const gpu_primitives::BufferRange sort_keys[2] { range(BUFFER_KEYS_0), range(BUFFER_KEYS_1) };
+    const gpu_primitives::BufferRange sort_values[2] { range(BUFFER_INDICES_0), range(BUFFER_INDICES_1) };
+
+    gpu_primitives::Plan* plans[PRIMITIVE_COUNT] {
+        gpu_primitives::createScan(ctx, vk_ctx, range(BUFFER_VALUES), range(BUFFER_OUTPUT), count),
+        gpu_primitives::createCompact(
+            ctx, vk_ctx, range(BUFFER_FLAGS), range(BUFFER_OUTPUT), range(BUFFER_SMALL), count
+        ),
+        gpu_primitives::createReduce(
+            ctx, vk_ctx, range(BUFFER_VALUES), range(BUFFER_SMALL), gpu_primitives::REDUCE_OP_ADD
+        ),
+        gpu_primitives::createSegmentedReduce(
+            ctx, vk_ctx, range(BUFFER_VALUES), range(BUFFER_SEGMENT_FIRSTS), range(BUFFER_OUTPUT),
+            gpu_primitives::REDUCE_OP_ADD
+        ),
+        gpu_primitives::createHistogram(
+            ctx, vk_ctx, range(BUFFER_KEYS_0), range(BUFFER_SMALL), HISTOGRAM_BIN_COUNT
+        ),
+        gpu_primitives::createRadixSort(ctx, vk_ctx, sort_keys, sort_values, count),
+    };
+    defer(for (u32 i = 0; i < PRIMITIVE_COUNT; i++) gpu_primitives::destroyPlan(plans[i], vk_ctx));
+
+    printf("%16s %12s %16s %8s\n", "primitive", "ms/run", "words/s", "valid");
+
+    Results results[PRIMITIVE_COUNT] {};
+    bool all_valid = true;
+    for (u32 primitive_idx = 0; primitive_idx < PRIMITIVE_COUNT; primitive_idx++) {
+
+        const Primitive primitive = (Primitive)primitive_idx;
+        const gpu_primitives::Plan* plan = plans[primitive_idx];
+        Results* r = &results[primitive_idx];
+
+        // once, to check
+        beginCommands(vk_ctx, &commands);
+        recordPrimitive(ctx, vk_ctx, commands.buffer, primitive, plan, count, segment_count);
+        submitAndWait(vk_ctx, &commands);
+
+        switch (primitive) {
+            case PRIMITIVE_SCAN: {
+                u32 sum = 0;
+                for (u32 i = 0; i < count; i++) {
+                    expected[i] = sum;
+                    sum += values[i];
+                }
+                copyWords(vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_OUTPUT], count, NULL, actual);
+                r->valid = memcmp(expected, actual, count * sizeof(u32)) == 0;
+                break;
+            }
+            case PRIMITIVE_COMPACT: {
+                u32 kept_count = 0;
+                for (u32 i = 0; i < count; i++) if (flags[i] != 0) expected[kept_count++] = i;
+                u32 actual_count = 0;
+                copyWords(vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_SMALL], 1, NULL, &actual_count);
+                r->valid = actual_count == kept_count;
+                if (r->valid) {
+                    copyWords(
+                        vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_OUTPUT], kept_count, NULL, actual
+                    );
+                    r->valid = memcmp(expected, actual, kept_count * sizeof(u32)) == 0;
+                }
+                break;
+            }
+            case PRIMITIVE_REDUCE: {
+                u32 sum = 0;
+                for (u32 i = 0; i < count; i++) sum += values[i];
+                u32 actual_sum = 0;
+                copyWords(vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_SMALL], 1, NULL, &actual_sum);
+                r->valid = actual_sum == sum;
+                break;
+            }
+            case PRIMITIVE_SEGMENTED_REDUCE: {
+                for (u32 s = 0; s < segment_count; s++) {
+                    const u32 end = (s + 1 < segment_count) ? segment_firsts[s + 1] : count;
+                    expected[s] = 0;
+                    for (u32 i = segment_firsts[s]; i < end; i++) expected[s] += values[i];
+                }
+                copyWords(
+                    vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_OUTPUT], segment_count, NULL, actual
+                );
+                r->valid = memcmp(expected, actual, segment_count * sizeof(u32)) == 0;
+                break;
+            }
+            case PRIMITIVE_HISTOGRAM: {
+                memset(expected, 0, HISTOGRAM_BIN_COUNT * sizeof(u32));
+                for (u32 i = 0; i < count; i++) expected[keys[i] & (HISTOGRAM_BIN_COUNT - 1)]++;
+                copyWords(
+                    vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_SMALL], HISTOGRAM_BIN_COUNT, NULL,
+                    actual
+                );
+                r->valid = memcmp(expected, actual, HISTOGRAM_BIN_COUNT * sizeof(u32)) == 0;
+                break;
+            }
+            case PRIMITIVE_RADIX_SORT: {
+                copyWords(vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_KEYS_1], count, NULL, actual);
+                copyWords(
+                    vk_ctx, &commands, staging_buffer, p_staging, buffers[BUFFER_INDICES_1], count, NULL,
+                    actual_values
+                );
+                // sorted, stably, and a permutation of the keys; the indices are distinct if each is where its
+                // key is, and in increasing order within a key
+                r->valid = true;
+                for (u32 i = 0; r->valid and i < count; i++) {
+                    const u32 idx = actual_values[i];
+                    r->valid = idx < count and keys[idx] == actual[i];
+                    if (r->valid and i > 0) {
+                        r->valid =
+                            actual[i - 1] < actual[i] or (actual[i - 1] == actual[i] and actual_values[i - 1] < idx);
+                    }
+                }
+                break;
+            }
+            default: alwaysAssert(false);
+        }
+        all_valid = all_valid and r->valid;
+
+        // then the repeats, timed
+        beginCommands(vk_ctx, &commands);
+        procs->CmdResetQueryPool(commands.buffer, query_pool, 0, 2);
+        procs->CmdWriteTimestamp(commands.buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+        for (u32 repeat = 0; repeat < options.repeat_count; repeat++) {
+            recordPrimitive(ctx, vk_ctx, commands.buffer, primitive, plan, count, segment_count);
+            recordFullBarrier(vk_ctx, commands.buffer);
+        }
+        procs->CmdWriteTimestamp(commands.buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1);
+        submitAndWait(vk_ctx, &commands);
+
+        u64 timestamps[2] {};
+        result = procs->GetQueryPoolResults(
+            vk_ctx->device, query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(u64),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+        );
+        assertVk(result);
+
+        const f64 ns_per_tick = (f64)vk_ctx->physical_device_properties.limits.timestampPeriod;
+        const f64 seconds_per_run =
+            1e-9 * ns_per_tick * (f64)(timestamps[1] - timestamps[0]) / (f64)options.repeat_count;
+        r->ms_per_run = 1e3 * seconds_per_run;
+        r->words_per_second = (f64)count / seconds_per_run;
+
+        printf(
+            "%16s %12.4lf %16.0lf %8s\n",
+            PRIMITIVE_NAMES[primitive_idx], r->ms_per_run, r->words_per_second, r->valid ? "yes" : "NO"
+        );
+    }
+
+    writeResults(options.output_filepath, &options, results);
+
+    if (!all_valid) LOG_F(ERROR, "A primitive's results didn't match the CPU's.");
+    return all_valid ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <glm/glm.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../vk_procs.hpp"
+#include "../vulkan_context.hpp"
+#include "../thread_pool.hpp"
+#include "../file_watch.hpp"
+#include "../sort.hpp"
+#include "../../plugins_src/fluid_sim/fluid_sim_types.hpp"
+#include "../../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "headless_util.hpp"
+
+namespace headless_util {
+
+using glm::vec3;
+using glm::vec4;
+using glm::u8vec4;
+
+using fluid_sim::FluidSimProcs;
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+//
+// ===========================================================================================================
+//
+
+u64 parseUnsignedArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 or end == value or *end != '\0') ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return (u64)parsed;
+}
+
+
+f32 parsePositiveFloatArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    const f32 parsed = strtof(value, &end);
+    if (end == value or *end != '\0' or !(parsed > 0.0f)) ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return parsed;
+}
+
+
+thread_pool::ThreadPool* createThreadPool(void) {
+
+    // like `createThreadPool()` in `main.cpp`
+    thread_pool::Topology topology = thread_pool::Topology::unpinned;
+    const char* topology_name = getenv("THREAD_POOL_TOPOLOGY");
+    if (topology_name != NULL and !thread_pool::parseTopology(topology_name, &topology)) {
+        LOG_F(ERROR, "Unknown THREAD_POOL_TOPOLOGY `%s`; using `unpinned`.", topology_name);
+    }
+
+    thread_pool::ThreadPool* thread_pool = thread_pool::create(topology, 100);
+    LOG_F(INFO, "Using thread_count=%u for thread pool.", thread_pool::getThreadCount(thread_pool));
+
+    return thread_pool;
+}
+
+
+void generateParticles(u32fast particle_count, f32 cube_side_length, bool index_attributes, vec4* p_particles_out) {
+
+    alwaysAssert(!index_attributes or particle_count <= (u32fast)INDEX_ATTRIBUTE_MASK + 1);
+
+    srand(2039519);
+
+    for (u32fast particle_idx = 0; particle_idx < particle_count; particle_idx++) {
+
+        vec3 random_0_to_1 {
+            (f32)rand() / (f32)RAND_MAX,
+            (f32)rand() / (f32)RAND_MAX,
+            (f32)rand() / (f32)RAND_MAX,
+        };
+
+        u8vec4 color = u8vec4(
+            0.f, 50.f + 150.f * ((f32)particle_idx / (f32)particle_count), 255.f,
+            255.f
+        );
+
+        const u32 index_attribute = INDEX_ATTRIBUTE_BITS | (u32)particle_idx;
+
+        *(vec3*)(&p_particles_out[particle_idx]) = (random_0_to_1 - 0.5f) * cube_side_length;
+        p_particles_out[particle_idx].w = index_attributes ? *(f32*)(&index_attribute) : *(f32*)(&color);
+    }
+}
+
+
+fluid_sim::SimData createSim(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    f32 cube_side_length,
+    bool index_attributes
+) {
+    vec4* p_initial_particles = callocArray(particle_count, vec4);
+    defer(free(p_initial_particles));
+    generateParticles(particle_count, cube_side_length, index_attributes, p_initial_particles);
+
+    return procs->create(params, vk_ctx, thread_pool, particle_count, p_initial_particles);
+}
+
+
+void waitForSim(const FluidSimProcs* procs, const fluid_sim::SimData* sim_data, const VulkanContext* vk_ctx) {
+
+    const VkSemaphore timeline_semaphore = procs->getTimelineSemaphore(sim_data);
+    const u64 timeline_value = procs->getTimelineValue(sim_data);
+    const VkSemaphoreWaitInfo wait_info {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline_semaphore,
+        .pValues = &timeline_value,
+    };
+    VkResult result = vk_ctx->procs_dev.WaitSemaphores(vk_ctx->device, &wait_info, UINT64_MAX);
+    assertVk(result);
+}
+
+
+timespec now(void) {
+    timespec result {};
+    clock_gettime(CLOCK_MONOTONIC, &result);
+    return result;
+}
+
+f64 secondsSince(const timespec* start) {
+    const timespec end = now();
+    return (f64)(end.tv_sec - start->tv_sec) + 1e-9 * (f64)(end.tv_nsec - start->tv_nsec);
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
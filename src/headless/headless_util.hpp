@@ -0,0 +1,71 @@
+#ifndef _HEADLESS_UTIL_HPP
+#define _HEADLESS_UTIL_HPP
+
+// #include <ctime>
+// #include "../types.hpp"
+// #include "../vulkan_context.hpp"
+// #include "../thread_pool.hpp"
+// #include "../../plugins_src/fluid_sim/fluid_sim_types.hpp"
+// #include "../../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+
+/// What the headless programs (`headless` and `benchmark`) share.
+namespace headless_util {
+
+//
+// ===========================================================================================================
+//
+
+/// Aborts unless `value` is a whole decimal number. `name` is the option, for the error message.
+u64 parseUnsignedArg(const char* name, const char* value);
+/// Aborts unless `value` is a positive number.
+f32 parsePositiveFloatArg(const char* name, const char* value);
+
+/// One thread per logical CPU, or per physical core, with the `THREAD_POOL_TOPOLOGY` environment variable.
+thread_pool::ThreadPool* createThreadPool(void);
+
+/// With `createSim()`'s `index_attributes`, the attribute of particle `i` has the bits `INDEX_ATTRIBUTE_BITS | i`:
+/// a float in [1, 2) that holds `i` exactly, so that the same particle can be found in two sims after their sorts
+/// have reordered them differently.
+constexpr u32 INDEX_ATTRIBUTE_BITS = 0x3F800000;
+constexpr u32 INDEX_ATTRIBUTE_MASK = 0x007FFFFF;
+
+/// Writes `particle_count` random positions in a cube of side `cube_side_length` (m) centred on the origin to
+/// `p_particles_out`, seeded and colored like the app's `initFluidSim()`, so that a given `particle_count` always
+/// gives the same scene. With `index_attributes`, the particles carry their index instead of a color (see
+/// `INDEX_ATTRIBUTE_BITS`); then `particle_count` must fit `INDEX_ATTRIBUTE_MASK`.
+void generateParticles(
+    u32fast particle_count,
+    f32 cube_side_length,
+    bool index_attributes,
+    glm::vec4* p_particles_out
+);
+
+/// A sim of the particles of `generateParticles()`.
+fluid_sim::SimData createSim(
+    const fluid_sim::FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast particle_count,
+    f32 cube_side_length,
+    bool index_attributes
+);
+
+/// Waits until everything the sim has submitted so far is done.
+void waitForSim(
+    const fluid_sim::FluidSimProcs* procs,
+    const fluid_sim::SimData* sim_data,
+    const VulkanContext* vk_ctx
+);
+
+/// `CLOCK_MONOTONIC`.
+timespec now(void);
+f64 secondsSince(const timespec* start);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
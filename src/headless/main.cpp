@@ -0,0 +1,1018 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <glm/glm.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../vk_procs.hpp"
+#include "../vulkan_context.hpp"
+#include "../thread_pool.hpp"
+#include "../file_watch.hpp"
+#include "../sort.hpp"
+#include "../plugin.hpp"
+#include "../fence_waiter.hpp"
+#include "../frame_capture.hpp"
+#include "../../plugins_src/fluid_sim/fluid_sim_types.hpp"
+#include "../../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "../fluid_sim_params_default.hpp"
+#include "compute_context.hpp"
+#include "headless_util.hpp"
+
+// Steps the fluid sim without a window: no GLFW, no swapchain, no ImGui, and nothing that waits for vsync.
+// Writes the final particles to a file, as `particle_count` little-endian vec4s (xyz position, w attribute).
+//
+// With `--capture-every K`, also records the positions of every K-th step to `--capture-output`, through
+// `frame_capture`; `--capture-quantization METERS` makes the frames lossy but smaller, and `--capture-lod N` keeps
+// only every N-th particle. With `--stream-port PORT`, the captured frames are also streamed to the viewers that
+// connect to the port, and only written to a file if `--capture-output` is given too.
+//
+// With `--compare-half-velocities K`, also steps a second sim with `SimParameters::half_velocities` from the same
+// particles, and every K-th step (and after the last) logs how far each particle of it is from the same particle
+// of the full-precision sim; the time then covers both sims.
+//
+// With `--compare-morton-ranges N`, only steps the scene N times with the cell traversal and, from the same
+// particles, with `SimParameters::morton_range_traversal`, then compares each particle's velocity in the two sims,
+// and exits with 1 if any differ by more than `MORTON_RANGE_VELOCITY_TOLERANCE`; see `runMortonRangeComparison()`.
+// `morton_range_check` checks the traversal's block walk against brute force on the CPU.
+//
+// With `--out-of-core-capacity N`, the particles live in host memory, and the sim only holds N of them at a time:
+// each step, they are sorted along the longest axis of their bounds and cut into slabs, and each slab is stepped
+// in turn together with the halo of particles around it that its particles interact with; see `runOutOfCore()`.
+// This is for more particles than fit on the GPU, and doesn't combine with the capture or the comparison.
+//
+// With `--trace-output PATH`, the zones of the last `--trace-frames N` steps (each step is a frame) are written to
+// PATH in the Chrome trace format at the end, by the built-in tracer (see trace.hpp), with the GPU times of the
+// sim's stages; with `--trace-slow-frame-ms MS`, a step that takes longer than MS, and longer than the slow steps
+// before it, writes them instead.
+//
+// Usage: headless [--steps N] [--delta-t SECONDS] [--substeps N] [--particles N] [--output PATH]
+//                 [--capture-every K] [--capture-output PATH] [--capture-quantization METERS]
+//                 [--capture-lod N] [--stream-port PORT]
+//                 [--compare-half-velocities K] [--compare-morton-ranges N] [--out-of-core-capacity N]
+//                 [--trace-output PATH] [--trace-frames N] [--trace-slow-frame-ms MS]
+// Like the app, reads `PHYSICAL_DEVICE_NAME`, `FLUID_SIM_CPU_BACKEND`, `FLUID_SIM_HYBRID_GPU_UPDATE` and
+// `FLUID_SIM_PERIODIC_BOX` ("X Y Z", a periodic box of that size around the origin) from the environment, and
+// must be run from the repository root so that it finds the plugin and the shaders under `build/`.
+
+using glm::vec3;
+using glm::vec4;
+
+using fluid_sim::FluidSimProcs;
+
+using headless_util::parseUnsignedArg;
+using headless_util::parsePositiveFloatArg;
+
+//
+// ===========================================================================================================
+//
+
+const char* APP_NAME = "an game (headless)";
+
+struct Options {
+    u32fast step_count;
+    f32 delta_t;
+    u32 substep_count;
+    u32fast particle_count;
+    const char* output_filepath;
+    u32fast capture_interval; // in steps; 0 for no capture
+    const char* capture_filepath; // NULL for the default
+    f32 capture_quantization_step; // m; 0 for lossless
+    u32 capture_lod_stride; // 0 or 1 for every particle
+    u16 stream_port; // 0 for no streaming
+    u32fast half_velocity_comparison_interval; // in steps; 0 for no comparison
+    u32fast morton_range_comparison_step_count; // 0 for no comparison
+    u32fast out_of_core_capacity; // particles in the sim at a time; 0 to keep them all in the sim
+    const char* trace_filepath; // NULL for no trace
+    u32 trace_frame_count;
+    f32 trace_slow_frame_threshold_ms; // 0 to only write the trace at the end
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .step_count = 1000,
+    .delta_t = 1.0f / 60.0f,
+    .substep_count = 1,
+    .particle_count = 100000,
+    .output_filepath = "headless_particles.bin",
+    .capture_interval = 0,
+    .capture_filepath = NULL,
+    .capture_quantization_step = 0.0f,
+    .capture_lod_stride = 1,
+    .stream_port = 0,
+    .half_velocity_comparison_interval = 0,
+    .morton_range_comparison_step_count = 0,
+    .out_of_core_capacity = 0,
+    .trace_filepath = NULL,
+    .trace_frame_count = 60,
+    .trace_slow_frame_threshold_ms = 0.0f,
+};
+
+constexpr u32 CAPTURE_SLOT_COUNT = 4;
+constexpr u32 CAPTURE_KEYFRAME_INTERVAL = 60;
+
+constexpr u32 TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+// How far apart a particle's velocities in the two sims of `--compare-morton-ranges` may be, relative to the larger
+// of its speed and the RMS speed of all the particles, so that the ones nearly at rest don't fail on rounding
+// alone. The two traversals sum the same pairs in different orders, which after one step differs by a few ULPs
+// per pair; this leaves room for that to grow for a few steps, but not for a missed or doubled pair.
+constexpr f32 MORTON_RANGE_VELOCITY_TOLERANCE = 1e-4f;
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--steps") == 0) options.step_count = (u32fast)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--substeps") == 0) options.substep_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--particles") == 0) {
+            options.particle_count = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--output") == 0) options.output_filepath = value;
+        else if (strcmp(name, "--delta-t") == 0) options.delta_t = parsePositiveFloatArg(name, value);
+        else if (strcmp(name, "--capture-every") == 0) {
+            options.capture_interval = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--capture-output") == 0) options.capture_filepath = value;
+        else if (strcmp(name, "--capture-quantization") == 0) {
+            options.capture_quantization_step = parsePositiveFloatArg(name, value);
+        }
+        else if (strcmp(name, "--capture-lod") == 0) options.capture_lod_stride = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--stream-port") == 0) {
+            const u64 port = parseUnsignedArg(name, value);
+            if (port == 0 or port > UINT16_MAX) ABORT_F("Invalid port `%s`.", value);
+            options.stream_port = (u16)port;
+        }
+        else if (strcmp(name, "--compare-half-velocities") == 0) {
+            options.half_velocity_comparison_interval = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--compare-morton-ranges") == 0) {
+            options.morton_range_comparison_step_count = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--out-of-core-capacity") == 0) {
+            options.out_of_core_capacity = (u32fast)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--trace-output") == 0) options.trace_filepath = value;
+        else if (strcmp(name, "--trace-frames") == 0) options.trace_frame_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--trace-slow-frame-ms") == 0) {
+            options.trace_slow_frame_threshold_ms = parsePositiveFloatArg(name, value);
+        }
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    alwaysAssert(options.substep_count > 0);
+    alwaysAssert(options.particle_count > 0);
+    alwaysAssert(options.trace_frame_count > 0);
+
+    if (options.out_of_core_capacity > 0)
+    {
+        // the slabs' particles carry their index in the slab
+        if (options.out_of_core_capacity > (u32fast)headless_util::INDEX_ATTRIBUTE_MASK + 1)
+        {
+            ABORT_F("`--out-of-core-capacity` can be at most %" PRIu32 ".", headless_util::INDEX_ATTRIBUTE_MASK + 1);
+        }
+        if (options.capture_interval > 0 or options.half_velocity_comparison_interval > 0)
+        {
+            ABORT_F("`--out-of-core-capacity` doesn't combine with the capture or the comparison.");
+        }
+    }
+    if (options.morton_range_comparison_step_count > 0)
+    {
+        const bool other_mode =
+            options.out_of_core_capacity > 0 or options.capture_interval > 0
+            or options.half_velocity_comparison_interval > 0;
+        if (other_mode)
+        {
+            ABORT_F("`--compare-morton-ranges` doesn't combine with the other modes.");
+        }
+        // the sims' particles carry their index
+        if (options.particle_count > (u32fast)headless_util::INDEX_ATTRIBUTE_MASK + 1)
+        {
+            ABORT_F(
+                "`--compare-morton-ranges` takes at most %" PRIu32 " particles.",
+                headless_util::INDEX_ATTRIBUTE_MASK + 1
+            );
+        }
+    }
+
+    // a stream alone doesn't need a file
+    if (options.capture_filepath == NULL and options.stream_port == 0) options.capture_filepath = "headless_frames.bin";
+
+    return options;
+}
+
+
+/// Copies the live particles into `p_particles_out`, once the sim's submissions are done.
+static void readParticles(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimData* sim_data,
+    const VulkanContext* vk_ctx,
+    vec4* p_particles_out
+) {
+    ZoneScoped;
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    VkBuffer positions_buffer = VK_NULL_HANDLE;
+    VkDeviceSize positions_buffer_size = 0;
+    procs->getPositionsVertexBuffer(sim_data, &positions_buffer, &positions_buffer_size);
+
+    const VkDeviceSize byte_count = sim_data->particle_count * sizeof(vec4);
+    alwaysAssert(byte_count <= positions_buffer_size);
+
+    VkBuffer readback_buffer = VK_NULL_HANDLE;
+    VmaAllocation readback_allocation = NULL;
+    VmaAllocationInfo readback_allocation_info {};
+    {
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = byte_count,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        const VmaAllocationCreateInfo allocation_info {
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &allocation_info,
+            &readback_buffer, &readback_allocation, &readback_allocation_info
+        );
+        assertVk(result);
+    }
+    defer(vmaDestroyBuffer(vk_ctx->vma_allocator, readback_buffer, readback_allocation));
+
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    {
+        const VkCommandPoolCreateInfo command_pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = vk_ctx->compute_queue_family_index,
+        };
+        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &command_pool_info, NULL, &command_pool);
+        assertVk(result);
+    }
+    defer(vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, command_pool, NULL));
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    {
+        const VkCommandBufferAllocateInfo command_buffer_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result =
+            vk_ctx->procs_dev.AllocateCommandBuffers(vk_ctx->device, &command_buffer_info, &command_buffer);
+        assertVk(result);
+    }
+
+    {
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+        assertVk(result);
+
+        const VkBufferCopy region { .srcOffset = 0, .dstOffset = 0, .size = byte_count };
+        vk_ctx->procs_dev.CmdCopyBuffer(command_buffer, positions_buffer, readback_buffer, 1, &region);
+
+        // make the copy visible to the host
+        const VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vk_ctx->procs_dev.CmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL
+        );
+
+        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+        assertVk(result);
+    }
+
+    VkFence fence = VK_NULL_HANDLE;
+    {
+        const VkFenceCreateInfo fence_info { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        result = vk_ctx->procs_dev.CreateFence(vk_ctx->device, &fence_info, NULL, &fence);
+        assertVk(result);
+    }
+    defer(vk_ctx->procs_dev.DestroyFence(vk_ctx->device, fence, NULL));
+
+    {
+        const VkSemaphore wait_semaphore = procs->getTimelineSemaphore(sim_data);
+        const u64 wait_value = procs->getTimelineValue(sim_data);
+        const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        const VkTimelineSemaphoreSubmitInfo timeline_info {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &wait_value,
+        };
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &wait_semaphore,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+        };
+        result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, fence);
+        assertVk(result);
+
+        result = vk_ctx->procs_dev.WaitForFences(vk_ctx->device, 1, &fence, true, UINT64_MAX);
+        assertVk(result);
+    }
+
+    result = vmaInvalidateAllocation(vk_ctx->vma_allocator, readback_allocation, 0, VK_WHOLE_SIZE);
+    assertVk(result);
+
+    memcpy(p_particles_out, readback_allocation_info.pMappedData, byte_count);
+}
+
+
+/// Writes `count` particles to `filepath`.
+static void writeParticleFile(const vec4* p_particles, u32fast count, const char* filepath) {
+
+    ZoneScoped;
+
+    const size_t byte_count = count * sizeof(vec4);
+
+    FILE* file = fopen(filepath, "wb");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    const size_t written = fwrite(p_particles, 1, byte_count, file);
+    const int close_result = fclose(file);
+    if (written != byte_count or close_result != 0) ABORT_F("Failed to write `%s`.", filepath);
+
+    LOG_F(INFO, "Wrote %" PRIuFAST32 " particles (%" PRIu64 " bytes) to `%s`.", count, (u64)byte_count, filepath);
+}
+
+
+/// Copies the live particles into host memory and writes them to `filepath`, once the sim's submissions are
+/// done.
+static void writeParticles(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimData* sim_data,
+    const VulkanContext* vk_ctx,
+    const char* filepath
+) {
+    ZoneScoped;
+
+    vec4* p_particles = callocArray(sim_data->particle_count, vec4);
+    defer(free(p_particles));
+    readParticles(procs, sim_data, vk_ctx, p_particles);
+
+    writeParticleFile(p_particles, sim_data->particle_count, filepath);
+}
+
+
+/// Logs the max and the root mean square distance between each particle of `half_sim` and the same particle of
+/// `full_sim`, which must both carry their index (see `headless_util::INDEX_ATTRIBUTE_BITS`), once the sims'
+/// submissions are done.
+static void compareHalfVelocitySim(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimData* full_sim,
+    const fluid_sim::SimData* half_sim,
+    const VulkanContext* vk_ctx,
+    u32fast step_count
+) {
+    ZoneScoped;
+
+    const u32fast count = full_sim->particle_count;
+    alwaysAssert(half_sim->particle_count == count);
+
+    vec4* p_full = callocArray(count, vec4);
+    defer(free(p_full));
+    vec4* p_half = callocArray(count, vec4);
+    defer(free(p_half));
+    readParticles(procs, full_sim, vk_ctx, p_full);
+    readParticles(procs, half_sim, vk_ctx, p_half);
+
+    // where each particle is in `p_half`
+    u32* p_half_idx = callocArray(count, u32);
+    defer(free(p_half_idx));
+    for (u32fast i = 0; i < count; i++)
+    {
+        const u32 particle = *(const u32*)(&p_half[i].w) & headless_util::INDEX_ATTRIBUTE_MASK;
+        alwaysAssert(particle < count);
+        p_half_idx[particle] = (u32)i;
+    }
+
+    f64 max_distance = 0.0;
+    f64 sum_of_squares = 0.0;
+    for (u32fast i = 0; i < count; i++)
+    {
+        const u32 particle = *(const u32*)(&p_full[i].w) & headless_util::INDEX_ATTRIBUTE_MASK;
+        alwaysAssert(particle < count);
+        const vec3 offset = vec3(p_half[p_half_idx[particle]]) - vec3(p_full[i]);
+        const f64 distance_squared = (f64)glm::dot(offset, offset);
+
+        max_distance = math::max(max_distance, sqrt(distance_squared));
+        sum_of_squares += distance_squared;
+    }
+
+    LOG_F(
+        INFO, "After %" PRIuFAST32 " steps, the half-velocity particles are at most %g m, and %g m RMS, away.",
+        step_count, max_distance, count > 0 ? sqrt(sum_of_squares / (f64)count) : 0.0
+    );
+}
+
+
+/// Steps the app's scene `options->morton_range_comparison_step_count` times with the cell traversal, and from the
+/// same particles with `SimParameters::morton_range_traversal`, which sums the same pairs in Morton order. Then
+/// compares each particle's velocity in the two sims; after the first step, that is its acceleration times the time
+/// step. Logs the largest differences, and returns how many particles are further apart than
+/// `MORTON_RANGE_VELOCITY_TOLERANCE`.
+static u32fast runMortonRangeComparison(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const Options* options
+) {
+    ZoneScoped;
+
+    // where the traversal isn't used, see `SimParameters::morton_range_traversal`
+    if (
+        params->cpu_backend or params->hybrid_gpu_update or params->hilbert_cell_order
+        or glm::any(glm::greaterThan(params->periodic_box_size, vec3(0.0f)))
+        or params->neighbor_list_capacity > 0 or params->tiled_particle_update or params->subgroup_particle_update
+        or params->quantized_neighbor_positions
+    ) {
+        ABORT_F("The sim parameters don't use the Morton range traversal, or only use it for some particles.");
+    }
+
+    const u32fast count = options->particle_count;
+
+    fluid_sim::SimParameters cell_params = *params;
+    cell_params.morton_range_traversal = false;
+    fluid_sim::SimData cell_sim = headless_util::createSim(
+        procs, &cell_params, vk_ctx, thread_pool, count, 5.0f, true
+    );
+    defer(procs->destroy(&cell_sim, vk_ctx));
+
+    fluid_sim::SimParameters morton_params = *params;
+    morton_params.morton_range_traversal = true;
+    fluid_sim::SimData morton_sim = headless_util::createSim(
+        procs, &morton_params, vk_ctx, thread_pool, count, 5.0f, true
+    );
+    defer(procs->destroy(&morton_sim, vk_ctx));
+
+    for (u32fast step_idx = 0; step_idx < options->morton_range_comparison_step_count; step_idx++)
+    {
+        procs->advanceSubsteps(
+            &cell_sim, vk_ctx, thread_pool, options->delta_t, options->substep_count, VK_NULL_HANDLE, VK_NULL_HANDLE
+        );
+        procs->advanceSubsteps(
+            &morton_sim, vk_ctx, thread_pool, options->delta_t, options->substep_count, VK_NULL_HANDLE, VK_NULL_HANDLE
+        );
+        FrameMark;
+    }
+
+    alwaysAssert(cell_sim.particle_count == count and morton_sim.particle_count == count);
+
+    vec4* p_cell_positions = callocArray(count, vec4);
+    defer(free(p_cell_positions));
+    vec3* p_cell_velocities = callocArray(count, vec3);
+    defer(free(p_cell_velocities));
+    vec4* p_morton_positions = callocArray(count, vec4);
+    defer(free(p_morton_positions));
+    vec3* p_morton_velocities = callocArray(count, vec3);
+    defer(free(p_morton_velocities));
+    procs->readBackParticles(&cell_sim, vk_ctx, p_cell_positions, p_cell_velocities);
+    procs->readBackParticles(&morton_sim, vk_ctx, p_morton_positions, p_morton_velocities);
+
+    // each particle's velocity in the cell sim, by its index
+    vec3* p_cell_velocity_of = callocArray(count, vec3);
+    defer(free(p_cell_velocity_of));
+    f64 sum_of_squared_speeds = 0.0;
+    for (u32fast i = 0; i < count; i++)
+    {
+        const u32 particle = *(const u32*)(&p_cell_positions[i].w) & headless_util::INDEX_ATTRIBUTE_MASK;
+        alwaysAssert(particle < count);
+        p_cell_velocity_of[particle] = p_cell_velocities[i];
+        sum_of_squared_speeds += (f64)glm::dot(p_cell_velocities[i], p_cell_velocities[i]);
+    }
+    const f32 rms_speed = (f32)sqrt(sum_of_squared_speeds / (f64)count);
+
+    constexpr u32fast MAX_LOGGED_MISMATCH_COUNT = 10;
+    u32fast mismatch_count = 0;
+    f32 max_relative_difference = 0.0f;
+    for (u32fast i = 0; i < count; i++)
+    {
+        const u32 particle = *(const u32*)(&p_morton_positions[i].w) & headless_util::INDEX_ATTRIBUTE_MASK;
+        alwaysAssert(particle < count);
+        const vec3 cell_velocity = p_cell_velocity_of[particle];
+
+        const f32 scale = glm::max(glm::length(cell_velocity), rms_speed);
+        const f32 relative_difference =
+            scale > 0.0f ? glm::length(p_morton_velocities[i] - cell_velocity) / scale : 0.0f;
+        max_relative_difference = glm::max(max_relative_difference, relative_difference);
+
+        if (relative_difference <= MORTON_RANGE_VELOCITY_TOLERANCE) continue;
+        if (mismatch_count < MAX_LOGGED_MISMATCH_COUNT)
+        {
+            LOG_F(
+                ERROR, "Particle %" PRIu32 " has the velocity (%g, %g, %g) m/s with the Morton ranges, but (%g, %g, "
+                "%g) m/s with the cells.",
+                particle, (f64)p_morton_velocities[i].x, (f64)p_morton_velocities[i].y, (f64)p_morton_velocities[i].z,
+                (f64)cell_velocity.x, (f64)cell_velocity.y, (f64)cell_velocity.z
+            );
+        }
+        mismatch_count++;
+    }
+
+    LOG_F(
+        INFO, "After %" PRIuFAST32 " steps, %" PRIuFAST32 " of %" PRIuFAST32 " particles' velocities differ by more "
+        "than %g of their speed (or of the RMS speed, %g m/s); the largest difference is %g.",
+        options->morton_range_comparison_step_count, mismatch_count, count, (f64)MORTON_RANGE_VELOCITY_TOLERANCE,
+        (f64)rms_speed, (f64)max_relative_difference
+    );
+    return mismatch_count;
+}
+
+
+/// The bits of `value`, as a key that sorts like the float.
+static u32 getSortableKey(f32 value) {
+    const u32 bits = *(const u32*)(&value);
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+
+/// The first of the `count` particles, which are sorted along `axis`, whose coordinate along it is at least
+/// `value`, or more than `value` if `past`; `count` if there is none.
+static u32fast findSortedParticle(
+    const vec4* p_positions,
+    u32fast count,
+    glm::length_t axis,
+    f32 value,
+    bool past
+) {
+    u32fast begin = 0;
+    u32fast end = count;
+    while (begin < end)
+    {
+        const u32fast mid = begin + (end - begin) / 2;
+        const f32 coordinate = p_positions[mid][axis];
+        const bool before = past ? coordinate <= value : coordinate < value;
+        if (before) begin = mid + 1;
+        else end = mid;
+    }
+    return begin;
+}
+
+
+/// Steps `options->particle_count` particles, which live in host memory, with a sim of only
+/// `options->out_of_core_capacity`. Each step, the particles are sorted along the longest axis of their bounds,
+/// and cut into slabs of consecutive particles. Each slab replaces the sim's particles in turn, together with
+/// the particles within a halo width of it on either side, and is stepped. Only the slab's own particles are
+/// kept; the halo's are there for the slab's particles to interact with, and are stepped by their own slab.
+/// The slab's particles carry their index in the slab in the attribute (see `headless_util::INDEX_ATTRIBUTE_BITS`),
+/// through the sim's sorts, and get their own attribute back afterwards. Writes the particles to
+/// `options->output_filepath` at the end.
+static void runOutOfCore(
+    const FluidSimProcs* procs,
+    const fluid_sim::SimParameters* params,
+    const VulkanContext* vk_ctx,
+    thread_pool::ThreadPool* thread_pool,
+    const Options* options
+) {
+    ZoneScoped;
+
+    const u32fast count = options->particle_count;
+    const u32fast capacity = glm::min(options->out_of_core_capacity, count);
+
+    {
+        fluid_sim::SimMemoryUsage memory_usage {};
+        const bool fits = procs->checkMemoryUsage(params, vk_ctx, capacity, NULL, &memory_usage);
+        if (!fits) ABORT_F("Not enough memory for %" PRIuFAST32 " particles.", capacity);
+    }
+
+    // the current particles, and the next ones, which the sort and each step write to
+    vec4* p_positions = callocArray(count, vec4);
+    defer(free(p_positions));
+    vec3* p_velocities = callocArray(count, vec3);
+    defer(free(p_velocities));
+    vec4* p_positions_next = callocArray(count, vec4);
+    defer(free(p_positions_next));
+    vec3* p_velocities_next = callocArray(count, vec3);
+    defer(free(p_velocities_next));
+
+    KeyVal* p_keys = callocArray(count, KeyVal);
+    defer(free(p_keys));
+    KeyVal* p_keys_scratch = callocArray(count, KeyVal);
+    defer(free(p_keys_scratch));
+
+    const u32 thread_count = thread_pool::getThreadCount(thread_pool);
+    SortContext* sort_context = createSortContext(thread_count);
+    defer(destroySortContext(sort_context));
+
+    // the particles of one slab and its halo
+    vec4* p_slab_positions = callocArray(capacity, vec4);
+    defer(free(p_slab_positions));
+    vec3* p_slab_velocities = callocArray(capacity, vec3);
+    defer(free(p_slab_velocities));
+
+    headless_util::generateParticles(count, 5.0f, false, p_positions);
+
+    fluid_sim::SimData sim_data = procs->create(params, vk_ctx, thread_pool, capacity, p_positions);
+    defer(procs->destroy(&sim_data, vk_ctx));
+
+    // A particle's forces depend on its neighbors' densities, which depend on their own neighbors, so the halo is
+    // two interaction radii deep for each substep.
+    const u32 max_substep_count =
+        sim_data.parameters.adaptive_time_step ? sim_data.parameters.max_substep_count : options->substep_count;
+    const f32 halo_width = 2.0f * sim_data.parameters.particle_interaction_radius * (f32)max_substep_count;
+
+    LOG_F(
+        INFO,
+        "Running %" PRIuFAST32 " steps of %g s (%" PRIu32 " substeps each) with %" PRIuFAST32 " particles, "
+        "%" PRIuFAST32 " at a time, with halos of %g m.",
+        options->step_count, (f64)options->delta_t, options->substep_count, count, capacity, (f64)halo_width
+    );
+
+    const timespec start_time = headless_util::now();
+    u64 slab_count = 0;
+    u64 stepped_particle_count = 0; // including the halos
+
+    for (u32fast step_idx = 0; step_idx < options->step_count; step_idx++) {
+
+        // Sort along the longest axis, which gives the thinnest halos.
+        glm::length_t axis = 0;
+        {
+            ZoneScopedN("Sort");
+
+            vec3 bounds_min = vec3(INFINITY);
+            vec3 bounds_max = vec3(-INFINITY);
+            for (u32fast i = 0; i < count; i++)
+            {
+                bounds_min = glm::min(bounds_min, vec3(p_positions[i]));
+                bounds_max = glm::max(bounds_max, vec3(p_positions[i]));
+            }
+            const vec3 extent = bounds_max - bounds_min;
+            if (extent.y > extent[axis]) axis = 1;
+            if (extent.z > extent[axis]) axis = 2;
+
+            for (u32fast i = 0; i < count; i++)
+            {
+                p_keys[i] = KeyVal { .key = getSortableKey(p_positions[i][axis]), .val = (u32)i };
+            }
+            radixSortMultiThreaded(sort_context, thread_pool, thread_count, count, p_keys, p_keys_scratch);
+
+            for (u32fast i = 0; i < count; i++)
+            {
+                p_positions_next[i] = p_positions[p_keys[i].val];
+                p_velocities_next[i] = p_velocities[p_keys[i].val];
+            }
+            std::swap(p_positions, p_positions_next);
+            std::swap(p_velocities, p_velocities_next);
+        }
+
+        u32fast slab_begin = 0;
+        while (slab_begin < count)
+        {
+            ZoneScopedN("Slab");
+
+            // Whether the slab of the next `slab_size` particles fits in the sim with its halo, and where the halo
+            // begins and ends. The halo only grows with the slab.
+            u32fast halo_begin = 0;
+            u32fast halo_end = 0;
+            const auto fits = [&](u32fast slab_size) {
+                const f32 front = p_positions[slab_begin][axis];
+                const f32 back = p_positions[slab_begin + slab_size - 1][axis];
+                halo_begin = findSortedParticle(p_positions, count, axis, front - halo_width, false);
+                halo_end = findSortedParticle(p_positions, count, axis, back + halo_width, true);
+                return halo_end - halo_begin <= capacity;
+            };
+
+            // the largest slab that fits
+            u32fast min_size = 1;
+            u32fast max_size = glm::min(count - slab_begin, capacity);
+            while (min_size < max_size)
+            {
+                const u32fast size = max_size - (max_size - min_size) / 2;
+                if (fits(size)) min_size = size;
+                else max_size = size - 1;
+            }
+            if (!fits(min_size))
+            {
+                ABORT_F(
+                    "A slab's halo has more than %" PRIuFAST32 " particles; raise `--out-of-core-capacity`.",
+                    capacity
+                );
+            }
+            const u32fast slab_end = slab_begin + min_size;
+            const u32fast local_count = halo_end - halo_begin;
+
+            for (u32fast i = 0; i < local_count; i++)
+            {
+                const u32 index_attribute = headless_util::INDEX_ATTRIBUTE_BITS | (u32)i;
+                p_slab_positions[i] = vec4(vec3(p_positions[halo_begin + i]), *(const f32*)(&index_attribute));
+            }
+            const bool replaced =
+                procs->replaceParticles(&sim_data, vk_ctx, local_count, p_slab_positions, &p_velocities[halo_begin]);
+            alwaysAssert(replaced);
+
+            procs->advanceSubsteps(
+                &sim_data, vk_ctx, thread_pool, options->delta_t, options->substep_count,
+                VK_NULL_HANDLE, VK_NULL_HANDLE
+            );
+
+            alwaysAssert(sim_data.particle_count == local_count);
+            procs->readBackParticles(&sim_data, vk_ctx, p_slab_positions, p_slab_velocities);
+
+            for (u32fast i = 0; i < local_count; i++)
+            {
+                const u32 local_idx =
+                    *(const u32*)(&p_slab_positions[i].w) & headless_util::INDEX_ATTRIBUTE_MASK;
+                const u32fast particle = halo_begin + local_idx;
+                if (particle < slab_begin or particle >= slab_end) continue; // the halo's
+
+                p_positions_next[particle] = vec4(vec3(p_slab_positions[i]), p_positions[particle].w);
+                p_velocities_next[particle] = p_slab_velocities[i];
+            }
+
+            slab_begin = slab_end;
+            slab_count++;
+            stepped_particle_count += local_count;
+        }
+        std::swap(p_positions, p_positions_next);
+        std::swap(p_velocities, p_velocities_next);
+
+        FrameMark;
+    }
+
+    const f64 elapsed_seconds = headless_util::secondsSince(&start_time);
+    LOG_F(
+        INFO, "Ran %" PRIuFAST32 " steps in %.3lf s (%.3lf ms per step), in %.1lf slabs per step, which stepped "
+        "%.2lfx the particles with their halos.",
+        options->step_count, elapsed_seconds,
+        options->step_count > 0 ? 1e3 * elapsed_seconds / (f64)options->step_count : 0.0,
+        options->step_count > 0 ? (f64)slab_count / (f64)options->step_count : 0.0,
+        options->step_count > 0 ? (f64)stepped_particle_count / (f64)(count * options->step_count) : 0.0
+    );
+
+    writeParticleFile(p_positions, count, options->output_filepath);
+}
+
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+
+    thread_pool::ThreadPool* thread_pool = headless_util::createThreadPool();
+    alwaysAssert(thread_pool != NULL);
+    defer(thread_pool::destroy(thread_pool));
+
+    const char* specific_device_request = getenv("PHYSICAL_DEVICE_NAME"); // can be NULL
+    compute_context::init(APP_NAME, specific_device_request);
+    const VulkanContext* vk_ctx = compute_context::getVkContext();
+
+    plugin::init();
+    const FluidSimProcs* fluid_sim_procs = NULL;
+    PLUGIN_LOAD(fluid_sim_procs, FluidSim);
+    alwaysAssert(fluid_sim_procs != NULL);
+
+    fluid_sim::SimParameters params = FLUID_SIM_PARAMS_DEFAULT;
+    if (getenv("FLUID_SIM_CPU_BACKEND") != NULL) params.cpu_backend = true;
+    if (getenv("FLUID_SIM_HYBRID_GPU_UPDATE") != NULL) params.hybrid_gpu_update = true;
+    if (const char* box_str = getenv("FLUID_SIM_PERIODIC_BOX"); box_str != NULL)
+    {
+        vec3 size {};
+        if (sscanf(box_str, "%f %f %f", &size.x, &size.y, &size.z) != 3) ABORT_F("Invalid `FLUID_SIM_PERIODIC_BOX`.");
+        params.periodic_box_size = size;
+        params.periodic_box_min = -0.5f * size;
+    }
+
+    trace::Tracer* tracer = NULL;
+    if (options.trace_filepath != NULL)
+    {
+        const trace::CreateInfo trace_info {
+            .filepath = options.trace_filepath,
+            .events_per_thread = TRACE_EVENTS_PER_THREAD,
+            .frame_count = options.trace_frame_count,
+            .slow_frame_threshold_ms = (f64)options.trace_slow_frame_threshold_ms,
+        };
+        tracer = trace::create(&trace_info);
+        trace::setTracer(tracer);
+        fluid_sim_procs->setTracer(tracer);
+
+        // for the GPU times of the sim's stages
+        params.stage_timestamps = true;
+    }
+    defer(
+        if (tracer != NULL)
+        {
+            trace::setTracer(NULL);
+            fluid_sim_procs->setTracer(NULL);
+            trace::destroy(tracer);
+        }
+    );
+
+    if (options.out_of_core_capacity > 0)
+    {
+        runOutOfCore(fluid_sim_procs, &params, vk_ctx, thread_pool, &options);
+        return 0;
+    }
+
+    {
+        fluid_sim::SimMemoryUsage memory_usage {};
+        const bool fits = fluid_sim_procs->checkMemoryUsage(
+            &params, vk_ctx, options.particle_count, NULL, &memory_usage
+        );
+        if (!fits) ABORT_F("Not enough memory for %" PRIuFAST32 " particles.", options.particle_count);
+    }
+
+    if (options.morton_range_comparison_step_count > 0)
+    {
+        const u32fast mismatch_count =
+            runMortonRangeComparison(fluid_sim_procs, &params, vk_ctx, thread_pool, &options);
+        return mismatch_count > 0 ? 1 : 0;
+    }
+
+    // the app's scene
+    const bool compare = options.half_velocity_comparison_interval > 0;
+    fluid_sim::SimData sim_data = headless_util::createSim(
+        fluid_sim_procs, &params, vk_ctx, thread_pool, options.particle_count, 5.0f, compare
+    );
+    defer(fluid_sim_procs->destroy(&sim_data, vk_ctx));
+
+    // the same scene with half velocities, if comparing
+    fluid_sim::SimData half_sim_data {};
+    if (compare)
+    {
+        alwaysAssert(!params.cpu_backend); // which ignores `half_velocities`
+        fluid_sim::SimParameters half_params = params;
+        half_params.half_velocities = true;
+        half_sim_data = headless_util::createSim(
+            fluid_sim_procs, &half_params, vk_ctx, thread_pool, options.particle_count, 5.0f, true
+        );
+    }
+    defer(if (compare) fluid_sim_procs->destroy(&half_sim_data, vk_ctx));
+
+    LOG_F(
+        INFO,
+        "Running %" PRIuFAST32 " steps of %g s (%" PRIu32 " substeps each) with %" PRIuFAST32 " particles.",
+        options.step_count, (f64)options.delta_t, options.substep_count, sim_data.particle_count
+    );
+
+    fence_waiter::FenceWaiter* fence_waiter = NULL;
+    frame_capture::FrameCapture* capture = NULL;
+    if (options.capture_interval > 0)
+    {
+        fence_waiter = fence_waiter::create(vk_ctx, thread_pool);
+
+        const frame_capture::CreateInfo capture_info {
+            .filepath = options.capture_filepath,
+            .particle_capacity = sim_data.particle_capacity,
+            .slot_count = CAPTURE_SLOT_COUNT,
+            .keyframe_interval = CAPTURE_KEYFRAME_INTERVAL,
+            .quantization_step = options.capture_quantization_step,
+            .lod_stride = options.capture_lod_stride,
+            .stream_port = options.stream_port,
+        };
+        capture = frame_capture::create(vk_ctx, fence_waiter, &capture_info);
+        if (capture == NULL) ABORT_F("Failed to create the frame capture.");
+    }
+
+    const timespec start_time = headless_util::now();
+
+    // the previous capture's copy, which the next step must wait for before it overwrites the positions
+    VkSemaphore capture_semaphore = VK_NULL_HANDLE;
+    for (u32fast step_idx = 0; step_idx < options.step_count; step_idx++) {
+
+        // the previous step's, if it has finished; polled before the step overwrites them
+        if (tracer != NULL)
+        {
+            f64 stage_times_ns[fluid_sim::SIM_STAGE_COUNT] {};
+            if (fluid_sim_procs->getStageGpuTimes(&sim_data, vk_ctx, false, stage_times_ns))
+            {
+                for (u32 stage = 0; stage < fluid_sim::SIM_STAGE_COUNT; stage++)
+                {
+                    trace::recordGpuTime(fluid_sim::SIM_STAGE_NAMES[stage], stage_times_ns[stage]);
+                }
+            }
+        }
+
+        {
+            ZoneScopedNFrame("fluid_sim::advanceSubsteps");
+            fluid_sim_procs->advanceSubsteps(
+                &sim_data, vk_ctx, thread_pool, options.delta_t, options.substep_count,
+                capture_semaphore, VK_NULL_HANDLE
+            );
+        }
+        capture_semaphore = VK_NULL_HANDLE;
+
+        if (compare)
+        {
+            fluid_sim_procs->advanceSubsteps(
+                &half_sim_data, vk_ctx, thread_pool, options.delta_t, options.substep_count,
+                VK_NULL_HANDLE, VK_NULL_HANDLE
+            );
+            if ((step_idx + 1) % options.half_velocity_comparison_interval == 0)
+            {
+                compareHalfVelocitySim(fluid_sim_procs, &sim_data, &half_sim_data, vk_ctx, step_idx + 1);
+            }
+        }
+
+        if (capture != NULL and step_idx % options.capture_interval == 0)
+        {
+            VkBuffer positions_buffer = VK_NULL_HANDLE;
+            VkDeviceSize positions_buffer_size = 0;
+            fluid_sim_procs->getPositionsVertexBuffer(&sim_data, &positions_buffer, &positions_buffer_size);
+
+            capture_semaphore = frame_capture::captureFrame(
+                capture, positions_buffer, sim_data.particle_count,
+                fluid_sim_procs->getTimelineSemaphore(&sim_data), fluid_sim_procs->getTimelineValue(&sim_data),
+                step_idx
+            );
+        }
+        FrameMark;
+    }
+
+    // Wait for the GPU too, so that the time covers the whole run and not just the submissions.
+    headless_util::waitForSim(fluid_sim_procs, &sim_data, vk_ctx);
+
+    if (capture != NULL)
+    {
+        // `waitForSim()` doesn't cover the last copy, but `destroy()` waits for it to be written.
+        const frame_capture::Stats capture_stats = frame_capture::getStats(capture);
+        if (capture_stats.dropped_frame_count > 0)
+        {
+            LOG_F(
+                WARNING, "Dropped %" PRIu64 " of %" PRIu64 " captured frames.",
+                capture_stats.dropped_frame_count,
+                capture_stats.captured_frame_count + capture_stats.dropped_frame_count
+            );
+        }
+        frame_capture::destroy(capture);
+        fence_waiter::destroy(fence_waiter);
+    }
+
+    const f64 elapsed_seconds = headless_util::secondsSince(&start_time);
+    LOG_F(
+        INFO, "Ran %" PRIuFAST32 " steps in %.3lf s (%.3lf ms per step).",
+        options.step_count, elapsed_seconds,
+        options.step_count > 0 ? 1e3 * elapsed_seconds / (f64)options.step_count : 0.0
+    );
+
+    if (compare and options.step_count % options.half_velocity_comparison_interval != 0)
+    {
+        compareHalfVelocitySim(fluid_sim_procs, &sim_data, &half_sim_data, vk_ctx, options.step_count);
+    }
+
+    writeParticles(fluid_sim_procs, &sim_data, vk_ctx, options.output_filepath);
+
+    return 0;
+}
@@ -0,0 +1,369 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../morton.hpp"
+
+// Checks the Morton range traversal of `SimParameters::morton_range_traversal` against brute force, on the CPU,
+// through `morton::isInBox()` and `morton::bigMin()`, which are the same as the shader's functions:
+//     box     for random boxes of cells, including the 3x3x3 blocks of the traversal around cells next to the
+//             powers of two, where the codes jump: that `isInBox()` agrees with decoding the components, and that
+//             `bigMin()` of codes between the corners is the next code in the box, found by enumerating its cells
+//     walk    for random sets of occupied cells, sorted by code like the Morton-ordered cell list: that the walk
+//             of `interactionsWithMortonRanges()` visits exactly the occupied cells of each cell's block
+// Logs the first mismatches, and exits with 1 if there are any, 0 otherwise. That the traversal gives the same
+// forces on the GPU is checked by `headless --compare-morton-ranges`.
+//
+// Usage: morton_range_check [--boxes N] [--walks N] [--seed N]
+
+//
+// ===========================================================================================================
+//
+
+struct Options {
+    u32 box_count;
+    u32 walk_count;
+    u64 seed;
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .box_count = 100000,
+    .walk_count = 20,
+    .seed = 1,
+};
+
+// the cells of a random box are at most this many along each axis
+constexpr u32 MAX_BOX_EXTENT = 8;
+// codes tested against `bigMin()` per box, besides the ones just after each of its cells
+constexpr u32 RANDOM_CODES_PER_BOX = 16;
+// the occupied cells of a walk are in a cube of this many along each axis, each with `WALK_OCCUPANCY`
+constexpr u32 WALK_CUBE_EXTENT = 24;
+constexpr f32 WALK_OCCUPANCY = 0.3f;
+constexpr u32 MAX_LOGGED_MISMATCH_COUNT = 10;
+
+// the largest component of a 63-bit code
+constexpr u32 MAX_COMPONENT = (1u << 21) - 1;
+
+//
+// ===========================================================================================================
+//
+
+static u64 parseUnsignedArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 or end == value or *end != '\0') ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return (u64)parsed;
+}
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--boxes") == 0) options.box_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--walks") == 0) options.walk_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--seed") == 0) options.seed = parseUnsignedArg(name, value);
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    return options;
+}
+
+
+static u32 nextRandom(u64* state) {
+    u64 z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (u32)((z ^ (z >> 31)) >> 32);
+}
+
+static f32 nextRandomUnit(u64* state) {
+    return (f32)(nextRandom(state) >> 8) * (1.0f / (f32)(1u << 24));
+}
+
+/// A random component in `[0, max]`: half the time next to a power of two, where the most code bits change.
+static u32 randomComponent(u64* state, u32 max) {
+
+    u32 component = 0;
+    if (nextRandom(state) % 2 == 0) component = nextRandom(state) % (max + 1);
+    else
+    {
+        const u32 power = 1u << (nextRandom(state) % 21);
+        component = power - math::min(power, 2u) + nextRandom(state) % 4;
+    }
+    return math::min(component, max);
+}
+
+
+struct Box {
+    u32 min[3];
+    u32 max[3];
+};
+
+static u64 encodeCell(const u32* cell) {
+    return morton::encode63(cell[0], cell[1], cell[2]);
+}
+
+static bool isInBoxBruteForce(u64 code, const Box* box) {
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        const u32 component = morton::decode63(code, axis);
+        if (component < box->min[axis] or component > box->max[axis]) return false;
+    }
+    return true;
+}
+
+/// Writes the codes of the cells of `box` to `p_codes_out`, sorted, and returns how many there are.
+static u32 enumerateBox(const Box* box, u64* p_codes_out) {
+
+    u32 count = 0;
+    u32 cell[3] {};
+    for (cell[2] = box->min[2]; cell[2] <= box->max[2]; cell[2]++)
+    {
+        for (cell[1] = box->min[1]; cell[1] <= box->max[1]; cell[1]++)
+        {
+            for (cell[0] = box->min[0]; cell[0] <= box->max[0]; cell[0]++) p_codes_out[count++] = encodeCell(cell);
+        }
+    }
+    std::sort(p_codes_out, p_codes_out + count);
+    return count;
+}
+
+
+/// Counts a mismatch, and logs it if it's one of the first.
+static void reportMismatch(
+    u64* p_mismatch_count,
+    const char* what,
+    u64 code,
+    const Box* box,
+    u64 got,
+    u64 expected
+) {
+
+    if (*p_mismatch_count < MAX_LOGGED_MISMATCH_COUNT)
+    {
+        LOG_F(
+            ERROR, "%s of 0x%016" PRIx64 " in the box (%" PRIu32 ", %" PRIu32 ", %" PRIu32 ")..(%" PRIu32 ", %"
+            PRIu32 ", %" PRIu32 ") is 0x%016" PRIx64 ", expected 0x%016" PRIx64 ".",
+            what, code, box->min[0], box->min[1], box->min[2], box->max[0], box->max[1], box->max[2], got, expected
+        );
+    }
+    (*p_mismatch_count)++;
+}
+
+/// Checks `isInBox()` and `bigMin()` for the codes just after each cell of `box` and some random codes between
+/// its corners. `p_codes` is scratch for the box's cells.
+static void checkBox(const Box* box, u64* random_state, u64* p_codes, u64* p_mismatch_count) {
+
+    const u32 count = enumerateBox(box, p_codes);
+    const u64 box_min = encodeCell(box->min);
+    const u64 box_max = encodeCell(box->max);
+    alwaysAssert(p_codes[0] == box_min and p_codes[count - 1] == box_max);
+
+    const auto check = [&](u64 code) {
+
+        const bool in_box = morton::isInBox(code, box_min, box_max);
+        const bool expected_in_box = isInBoxBruteForce(code, box);
+        if (in_box != expected_in_box)
+        {
+            reportMismatch(p_mismatch_count, "isInBox", code, box, in_box, expected_in_box);
+        }
+        if (expected_in_box) return;
+
+        // the first code of the box after `code`
+        const u64* p_next = std::upper_bound(p_codes, p_codes + count, code);
+        const u64 expected_big_min = (p_next == p_codes + count) ? UINT64_MAX : *p_next;
+        const u64 big_min = morton::bigMin(code, box_min, box_max);
+        if (big_min != expected_big_min)
+        {
+            reportMismatch(p_mismatch_count, "bigMin", code, box, big_min, expected_big_min);
+        }
+    };
+
+    for (u32 i = 0; i + 1 < count; i++) check(p_codes[i] + 1);
+    for (u32 i = 0; i < RANDOM_CODES_PER_BOX; i++)
+    {
+        const u64 random = (u64)nextRandom(random_state) << 32 | nextRandom(random_state);
+        check(box_min + random % (box_max - box_min + 1));
+    }
+}
+
+/// Checks `box_count` random boxes, and as many 3x3x3 blocks of the traversal.
+static u64 checkBoxes(u32 box_count, u64* random_state) {
+
+    ZoneScoped;
+
+    u64* p_codes = mallocArray(MAX_BOX_EXTENT * MAX_BOX_EXTENT * MAX_BOX_EXTENT, u64);
+    defer(free(p_codes));
+
+    u64 mismatch_count = 0;
+    for (u32 i = 0; i < box_count; i++)
+    {
+        Box box {};
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            box.min[axis] = randomComponent(random_state, MAX_COMPONENT - (MAX_BOX_EXTENT - 1));
+            box.max[axis] = box.min[axis] + nextRandom(random_state) % MAX_BOX_EXTENT;
+        }
+        checkBox(&box, random_state, p_codes, &mismatch_count);
+
+        // like `interactionsWithMortonRanges()`: cells below 0 don't exist
+        Box block {};
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            const u32 cell = randomComponent(random_state, MAX_COMPONENT - 1);
+            block.min[axis] = cell - math::min(cell, 1u);
+            block.max[axis] = cell + 1;
+        }
+        checkBox(&block, random_state, p_codes, &mismatch_count);
+    }
+
+    LOG_F(INFO, "Checked %" PRIu32 " boxes and %" PRIu32 " blocks: %" PRIu64 " mismatches.", box_count, box_count,
+        mismatch_count);
+    return mismatch_count;
+}
+
+
+/// Checks the walk of `interactionsWithMortonRanges()` over a random set of occupied cells, for the block of each
+/// of them. The walk's searches are plain binary searches here, rather than galloping ones.
+static u64 checkWalk(u64* random_state, u64* p_codes, u32* p_visited, u64* p_mismatch_count) {
+
+    // a cube around a random corner, so that it can straddle the powers of two
+    u32 corner[3] {};
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        corner[axis] = randomComponent(random_state, MAX_COMPONENT - WALK_CUBE_EXTENT);
+    }
+
+    u32 count = 0;
+    u32 cell[3] {};
+    for (u32 z = 0; z < WALK_CUBE_EXTENT; z++)
+    {
+        for (u32 y = 0; y < WALK_CUBE_EXTENT; y++)
+        {
+            for (u32 x = 0; x < WALK_CUBE_EXTENT; x++)
+            {
+                if (nextRandomUnit(random_state) >= WALK_OCCUPANCY) continue;
+                cell[0] = corner[0] + x;
+                cell[1] = corner[1] + y;
+                cell[2] = corner[2] + z;
+                p_codes[count++] = encodeCell(cell);
+            }
+        }
+    }
+    std::sort(p_codes, p_codes + count);
+    u64* p_end = p_codes + count;
+
+    for (u32 own = 0; own < count; own++)
+    {
+        Box block {};
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            const u32 component = morton::decode63(p_codes[own], axis);
+            block.min[axis] = component - math::min(component, 1u);
+            block.max[axis] = component + 1;
+        }
+        const u64 block_min = encodeCell(block.min);
+        const u64 block_max = encodeCell(block.max);
+
+        u32 visited_count = 0;
+        u32 walk_cell = (u32)(std::lower_bound(p_codes, p_end, block_min) - p_codes);
+        while (walk_cell < count)
+        {
+            const u64 code = p_codes[walk_cell];
+            if (code > block_max) break;
+
+            if (!morton::isInBox(code, block_min, block_max))
+            {
+                const u64 next_code = morton::bigMin(code, block_min, block_max);
+                walk_cell = (u32)(std::lower_bound(p_codes + walk_cell + 1, p_end, next_code) - p_codes);
+                continue;
+            }
+
+            p_visited[visited_count++] = walk_cell;
+            walk_cell++;
+        }
+
+        u32 expected_count = 0;
+        bool same = true;
+        for (u32 i = 0; i < count; i++)
+        {
+            if (!isInBoxBruteForce(p_codes[i], &block)) continue;
+            if (expected_count >= visited_count or p_visited[expected_count] != i) same = false;
+            expected_count++;
+        }
+        if (!same or visited_count != expected_count)
+        {
+            if (*p_mismatch_count < MAX_LOGGED_MISMATCH_COUNT)
+            {
+                LOG_F(
+                    ERROR, "The walk for the cell 0x%016" PRIx64 " visited %" PRIu32 " cells, not just the %" PRIu32
+                    " occupied cells of its block.",
+                    p_codes[own], visited_count, expected_count
+                );
+            }
+            (*p_mismatch_count)++;
+        }
+    }
+
+    return count;
+}
+
+static u64 checkWalks(u32 walk_count, u64* random_state) {
+
+    ZoneScoped;
+
+    constexpr u32 max_cell_count = WALK_CUBE_EXTENT * WALK_CUBE_EXTENT * WALK_CUBE_EXTENT;
+    u64* p_codes = mallocArray(max_cell_count, u64);
+    defer(free(p_codes));
+    u32* p_visited = mallocArray(max_cell_count, u32);
+    defer(free(p_visited));
+
+    u64 mismatch_count = 0;
+    u64 block_count = 0;
+    for (u32 i = 0; i < walk_count; i++) block_count += checkWalk(random_state, p_codes, p_visited, &mismatch_count);
+
+    LOG_F(INFO, "Checked %" PRIu32 " walks of %" PRIu64 " blocks: %" PRIu64 " mismatches.", walk_count, block_count,
+        mismatch_count);
+    return mismatch_count;
+}
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+
+    u64 random_state = options.seed;
+    u64 mismatch_count = checkBoxes(options.box_count, &random_state);
+    mismatch_count += checkWalks(options.walk_count, &random_state);
+
+    return mismatch_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,494 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <immintrin.h>
+
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../thread_pool.hpp"
+#include "../sort.hpp"
+#include "../morton.hpp"
+
+// Times the `KeyVal` sorts in `sort.hpp` on a few key distributions, sizes and thread counts, and writes the
+// throughput (keys/s) to stdout and to a JSON file. The multi-threaded sorts also get their scaling efficiency:
+// the throughput divided by `thread_count` times their own single-threaded throughput.
+//
+// The distributions:
+//     morton         the cell Morton codes of uniformly random particles, about `PARTICLES_PER_CELL` per cell,
+//                    like the CPU backend's first step
+//     nearly_sorted  the same particles, sorted by cell and then moved by a fraction of a cell, like the CPU
+//                    backend's later steps
+//     random         uniformly random 32-bit keys
+//     duplicates     uniformly random keys below `DUPLICATE_KEY_COUNT`
+//
+// Usage: sort_benchmark [--sizes N,N,...] [--max-threads N] [--repetitions N] [--output PATH]
+// To compare a new sort, add it to `SORT_ALGORITHMS`.
+
+//
+// ===========================================================================================================
+//
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*arr))
+
+constexpr u32 MAX_SIZE_COUNT = 16;
+
+struct Options {
+    u32 size_count;
+    u32fast sizes[MAX_SIZE_COUNT];
+    u32 max_thread_count; // 0 means the processor count
+    u32 repetition_count; // the fastest repetition counts
+    const char* output_filepath;
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .size_count = 4,
+    .sizes = { 10000, 100000, 1000000, 4000000 },
+    .max_thread_count = 0,
+    .repetition_count = 5,
+    .output_filepath = "sort_benchmark.json",
+};
+
+
+// about the app's scene: 100k particles in a 5 m cube, with cells the size of the interaction radius
+constexpr f32 PARTICLES_PER_CELL = 10.0f;
+// in cells
+constexpr f32 NEARLY_SORTED_MAX_DISPLACEMENT = 0.05f;
+constexpr u32 DUPLICATE_KEY_COUNT = 16;
+
+enum KeyDistribution : u32 {
+    KEY_DISTRIBUTION_MORTON,
+    KEY_DISTRIBUTION_NEARLY_SORTED,
+    KEY_DISTRIBUTION_RANDOM,
+    KEY_DISTRIBUTION_DUPLICATES,
+    KEY_DISTRIBUTION_COUNT,
+};
+
+constexpr const char* KEY_DISTRIBUTION_NAMES[KEY_DISTRIBUTION_COUNT] {
+    "morton",
+    "nearly_sorted",
+    "random",
+    "duplicates",
+};
+
+
+using PFN_Sort = void (*)(
+    SortContext* sort_context,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    u32fast arr_size,
+    KeyVal* p_arr,
+    KeyVal* p_scratch
+);
+
+struct SortAlgorithm {
+    const char* name;
+    bool multi_threaded; // if false, only timed with 1 thread
+    PFN_Sort sort;
+};
+
+static void sortMergeSort(
+    SortContext*, thread_pool::ThreadPool*, u32fast, u32fast arr_size, KeyVal* p_arr, KeyVal* p_scratch
+) {
+    mergeSort(arr_size, p_arr, p_scratch);
+}
+
+static void sortNaturalMergeSort(
+    SortContext*, thread_pool::ThreadPool*, u32fast, u32fast arr_size, KeyVal* p_arr, KeyVal* p_scratch
+) {
+    naturalMergeSort(arr_size, p_arr, p_scratch);
+}
+
+static void sortRadixSort(
+    SortContext*, thread_pool::ThreadPool*, u32fast, u32fast arr_size, KeyVal* p_arr, KeyVal* p_scratch
+) {
+    radixSort(arr_size, p_arr, p_scratch);
+}
+
+static void sortMergeSortSimd(
+    SortContext*, thread_pool::ThreadPool*, u32fast, u32fast arr_size, KeyVal* p_arr, KeyVal* p_scratch
+) {
+    mergeSortSimd(arr_size, p_arr, p_scratch);
+}
+
+static void sortMergeSortMultiThreaded(
+    SortContext* sort_context,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    u32fast arr_size,
+    KeyVal* p_arr,
+    KeyVal* p_scratch
+) {
+    mergeSortMultiThreaded(sort_context, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+}
+
+static void sortSampleSortMultiThreaded(
+    SortContext* sort_context,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    u32fast arr_size,
+    KeyVal* p_arr,
+    KeyVal* p_scratch
+) {
+    sampleSortMultiThreaded(sort_context, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+}
+
+static void sortRadixSortMultiThreaded(
+    SortContext* sort_context,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    u32fast arr_size,
+    KeyVal* p_arr,
+    KeyVal* p_scratch
+) {
+    radixSortMultiThreaded(sort_context, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+}
+
+constexpr SortAlgorithm SORT_ALGORITHMS[] {
+    { .name = "mergeSort", .multi_threaded = false, .sort = sortMergeSort },
+    { .name = "naturalMergeSort", .multi_threaded = false, .sort = sortNaturalMergeSort },
+    { .name = "radixSort", .multi_threaded = false, .sort = sortRadixSort },
+    { .name = "mergeSortSimd", .multi_threaded = false, .sort = sortMergeSortSimd },
+    { .name = "mergeSortMultiThreaded", .multi_threaded = true, .sort = sortMergeSortMultiThreaded },
+    { .name = "sampleSortMultiThreaded", .multi_threaded = true, .sort = sortSampleSortMultiThreaded },
+    { .name = "radixSortMultiThreaded", .multi_threaded = true, .sort = sortRadixSortMultiThreaded },
+};
+
+
+struct Measurement {
+    KeyDistribution distribution;
+    u32fast size;
+    u32 algorithm_idx;
+    u32 thread_count;
+    f64 keys_per_second;
+    f64 scaling_efficiency; // 1 for the single-threaded runs
+};
+
+//
+// ===========================================================================================================
+//
+
+static u64 parseUnsignedArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 or end == value or *end != '\0') ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return (u64)parsed;
+}
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--max-threads") == 0) options.max_thread_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--repetitions") == 0) {
+            options.repetition_count = (u32)parseUnsignedArg(name, value);
+        }
+        else if (strcmp(name, "--output") == 0) options.output_filepath = value;
+        else if (strcmp(name, "--sizes") == 0) {
+
+            char buffer[256] {};
+            if (strlen(value) >= sizeof(buffer)) ABORT_F("Value for `%s` is too long.", name);
+            strcpy(buffer, value);
+
+            options.size_count = 0;
+            char* save_ptr = NULL;
+            char* token = strtok_r(buffer, ",", &save_ptr);
+            for (; token != NULL; token = strtok_r(NULL, ",", &save_ptr)) {
+                if (options.size_count == MAX_SIZE_COUNT) ABORT_F("At most %u sizes.", MAX_SIZE_COUNT);
+                options.sizes[options.size_count++] = (u32fast)parseUnsignedArg(name, token);
+            }
+        }
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    alwaysAssert(options.size_count > 0);
+    alwaysAssert(options.repetition_count > 0);
+    for (u32 i = 0; i < options.size_count; i++) alwaysAssert(options.sizes[i] > 0);
+
+    if (options.max_thread_count == 0) {
+        const long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+        options.max_thread_count = (processor_count > 0) ? (u32)processor_count : 1;
+    }
+
+    return options;
+}
+
+
+/// splitmix64, so that the keys don't depend on the libc's `rand()`.
+static u32 nextRandom(u64* state) {
+    u64 z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (u32)((z ^ (z >> 31)) >> 32);
+}
+
+static f32 nextRandomUnit(u64* state) {
+    return (f32)(nextRandom(state) >> 8) * (1.0f / (f32)(1u << 24));
+}
+
+
+static u32 cellMortonCode(const f32* position) {
+    return morton::encode30((u32)position[0], (u32)position[1], (u32)position[2]);
+}
+
+
+/// `p_keys_out[i].val` is `i`.
+static void generateKeys(KeyDistribution distribution, u32fast size, KeyVal* p_keys_out) {
+
+    ZoneScoped;
+
+    u64 random_state = 2039519;
+
+    switch (distribution)
+    {
+        case KEY_DISTRIBUTION_RANDOM:
+        case KEY_DISTRIBUTION_DUPLICATES:
+        {
+            for (u32fast i = 0; i < size; i++) {
+                u32 key = nextRandom(&random_state);
+                if (distribution == KEY_DISTRIBUTION_DUPLICATES) key %= DUPLICATE_KEY_COUNT;
+                p_keys_out[i] = KeyVal { .key = key, .val = (u32)i };
+            }
+            break;
+        }
+
+        case KEY_DISTRIBUTION_MORTON:
+        case KEY_DISTRIBUTION_NEARLY_SORTED:
+        {
+            // positions in units of cells
+            const f32 cells_per_axis = fmaxf(1.0f, floorf(cbrtf((f32)size / PARTICLES_PER_CELL)));
+            alwaysAssert(cells_per_axis <= 1024.0f);
+
+            f32* positions = mallocArray(3 * size, f32);
+            defer(free(positions));
+
+            for (u32fast i = 0; i < 3 * size; i++) {
+                positions[i] = fminf(nextRandomUnit(&random_state) * cells_per_axis, cells_per_axis - 1e-3f);
+            }
+            for (u32fast i = 0; i < size; i++) {
+                p_keys_out[i] = KeyVal { .key = cellMortonCode(&positions[3 * i]), .val = (u32)i };
+            }
+
+            if (distribution == KEY_DISTRIBUTION_MORTON) break;
+
+            // Sort the particles by cell, as the previous step would have, and move them a little.
+            KeyVal* scratch = mallocArray(size, KeyVal);
+            defer(free(scratch));
+            radixSort(size, p_keys_out, scratch);
+
+            for (u32fast k = 0; k < size; k++) {
+                const f32* position = &positions[3 * p_keys_out[k].val];
+
+                f32 moved_position[3];
+                for (u32 d = 0; d < 3; d++) {
+                    const f32 displacement =
+                        (2.0f * nextRandomUnit(&random_state) - 1.0f) * NEARLY_SORTED_MAX_DISPLACEMENT;
+                    moved_position[d] = fminf(fmaxf(position[d] + displacement, 0.0f), cells_per_axis - 1e-3f);
+                }
+
+                p_keys_out[k] = KeyVal { .key = cellMortonCode(moved_position), .val = (u32)k };
+            }
+            break;
+        }
+
+        case KEY_DISTRIBUTION_COUNT: alwaysAssert(false);
+    }
+}
+
+
+/// Aborts unless `p_keys` is sorted by key, and holds each of the values `0..size` that `generateKeys()` wrote.
+static void checkSorted(const char* algorithm_name, u32fast size, const KeyVal* p_keys) {
+
+    u64 val_sum = 0;
+    for (u32fast i = 0; i < size; i++) {
+        if (i > 0 and p_keys[i - 1].key > p_keys[i].key) ABORT_F("`%s` didn't sort the keys.", algorithm_name);
+        val_sum += p_keys[i].val;
+    }
+    if (val_sum != (u64)size * (u64)(size - 1) / 2) ABORT_F("`%s` lost some values.", algorithm_name);
+}
+
+
+static f64 secondsSince(const timespec* start) {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (f64)(now.tv_sec - start->tv_sec) + 1e-9 * (f64)(now.tv_nsec - start->tv_nsec);
+}
+
+/// The fastest of `repetition_count` sorts of `p_input`, in keys/s. Checks the first result.
+static f64 timeSort(
+    const SortAlgorithm* algorithm,
+    SortContext* sort_context,
+    thread_pool::ThreadPool* thread_pool,
+    u32 thread_count,
+    u32 repetition_count,
+    u32fast size,
+    const KeyVal* p_input,
+    KeyVal* p_work,
+    KeyVal* p_scratch
+) {
+
+    ZoneScoped;
+
+    f64 best_time = INFINITY;
+    for (u32 repetition = 0; repetition < repetition_count; repetition++) {
+
+        memcpy(p_work, p_input, size * sizeof(KeyVal));
+
+        timespec start_time {};
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        algorithm->sort(sort_context, thread_pool, thread_count, size, p_work, p_scratch);
+        best_time = fmin(best_time, secondsSince(&start_time));
+
+        if (repetition == 0) checkSorted(algorithm->name, size, p_work);
+    }
+
+    return (f64)size / best_time;
+}
+
+
+static void writeResults(
+    const char* filepath,
+    const Options* options,
+    const Measurement* p_measurements,
+    u32fast measurement_count
+) {
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"max_thread_count\": %" PRIu32 ",\n", options->max_thread_count);
+    fprintf(file, "  \"repetition_count\": %" PRIu32 ",\n", options->repetition_count);
+    fprintf(file, "  \"measurements\": [\n");
+
+    for (u32fast i = 0; i < measurement_count; i++) {
+        const Measurement* m = &p_measurements[i];
+        fprintf(
+            file,
+            "    { \"distribution\": \"%s\", \"size\": %" PRIuFAST32 ", \"algorithm\": \"%s\", "
+            "\"thread_count\": %" PRIu32 ", \"keys_per_second\": %.0lf, \"scaling_efficiency\": %.3lf }%s\n",
+            KEY_DISTRIBUTION_NAMES[m->distribution], m->size, SORT_ALGORITHMS[m->algorithm_idx].name,
+            m->thread_count, m->keys_per_second, m->scaling_efficiency,
+            (i + 1 == measurement_count) ? "" : ","
+        );
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) ABORT_F("Failed to write `%s`.", filepath);
+    LOG_F(INFO, "Wrote results to `%s`.", filepath);
+}
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+
+    thread_pool::ThreadPool* thread_pool = thread_pool::create(options.max_thread_count, 100);
+    alwaysAssert(thread_pool != NULL);
+    defer(thread_pool::destroy(thread_pool));
+
+    SortContext* sort_context = createSortContext(options.max_thread_count);
+    defer(destroySortContext(sort_context));
+
+    u32fast max_size = 0;
+    for (u32 i = 0; i < options.size_count; i++) max_size = math::max(max_size, options.sizes[i]);
+
+    KeyVal* input = mallocArray(max_size, KeyVal);
+    defer(free(input));
+    KeyVal* work = mallocArray(max_size, KeyVal);
+    defer(free(work));
+    KeyVal* scratch = mallocArray(max_size, KeyVal);
+    defer(free(scratch));
+
+    // 1, 2, 4, ..., and `max_thread_count` itself
+    u32 thread_counts[32] {};
+    u32 thread_count_count = 0;
+    for (u32 t = 1; t < options.max_thread_count; t *= 2) thread_counts[thread_count_count++] = t;
+    thread_counts[thread_count_count++] = options.max_thread_count;
+
+    const u32fast max_measurement_count =
+        KEY_DISTRIBUTION_COUNT * options.size_count * ARRAY_SIZE(SORT_ALGORITHMS) * thread_count_count;
+    Measurement* measurements = callocArray(max_measurement_count, Measurement);
+    defer(free(measurements));
+    u32fast measurement_count = 0;
+
+    printf(
+        "%-14s %9s %-24s %7s %10s %10s\n",
+        "distribution", "size", "algorithm", "threads", "Mkeys/s", "efficiency"
+    );
+
+    for (u32 distribution = 0; distribution < KEY_DISTRIBUTION_COUNT; distribution++) {
+        for (u32 size_idx = 0; size_idx < options.size_count; size_idx++) {
+
+            const u32fast size = options.sizes[size_idx];
+            generateKeys((KeyDistribution)distribution, size, input);
+
+            for (u32 algorithm_idx = 0; algorithm_idx < ARRAY_SIZE(SORT_ALGORITHMS); algorithm_idx++) {
+
+                const SortAlgorithm* algorithm = &SORT_ALGORITHMS[algorithm_idx];
+                const u32 algorithm_thread_count_count = algorithm->multi_threaded ? thread_count_count : 1;
+
+                f64 single_thread_keys_per_second = 0.0;
+                for (u32 t = 0; t < algorithm_thread_count_count; t++) {
+
+                    const u32 thread_count = thread_counts[t];
+                    const f64 keys_per_second = timeSort(
+                        algorithm, sort_context, thread_pool, thread_count, options.repetition_count,
+                        size, input, work, scratch
+                    );
+                    if (thread_count == 1) single_thread_keys_per_second = keys_per_second;
+
+                    const Measurement measurement {
+                        .distribution = (KeyDistribution)distribution,
+                        .size = size,
+                        .algorithm_idx = algorithm_idx,
+                        .thread_count = thread_count,
+                        .keys_per_second = keys_per_second,
+                        .scaling_efficiency =
+                            keys_per_second / ((f64)thread_count * single_thread_keys_per_second),
+                    };
+                    measurements[measurement_count++] = measurement;
+
+                    printf(
+                        "%-14s %9" PRIuFAST32 " %-24s %7" PRIu32 " %10.2lf %10.3lf\n",
+                        KEY_DISTRIBUTION_NAMES[distribution], size, algorithm->name, thread_count,
+                        1e-6 * keys_per_second, measurement.scaling_efficiency
+                    );
+                }
+            }
+        }
+    }
+
+    writeResults(options.output_filepath, &options, measurements, measurement_count);
+
+    return 0;
+}
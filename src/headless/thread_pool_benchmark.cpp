@@ -0,0 +1,261 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "../types.hpp"
+#include "../trace.hpp"
+#include "../math_util.hpp"
+#include "../error_util.hpp"
+#include "../alloc_util.hpp"
+#include "../defer.hpp"
+#include "../thread_pool.hpp"
+
+// Times `thread_pool` with 1, 2, 4, ... threads, up to `--max-threads`, and writes the results to stdout and to
+// a JSON file. For each thread count:
+//     latency     from just before `enqueueTask()` to the start of the task, with every thread idle; one task
+//                 at a time
+//     throughput  empty tasks per second, enqueued `THROUGHPUT_BATCH_SIZE` at a time and then waited for
+//     fan-out     the time to enqueue one empty task per thread in a group and wait for the group, like each
+//                 pass of `mergeSortMultiThreaded()`
+//
+// Usage: thread_pool_benchmark [--max-threads N] [--samples N] [--output PATH]
+
+//
+// ===========================================================================================================
+//
+
+struct Options {
+    u32 max_thread_count;
+    u32 sample_count; // per thread count and measurement
+    const char* output_filepath;
+};
+
+constexpr Options DEFAULT_OPTIONS {
+    .max_thread_count = 64,
+    .sample_count = 10000,
+    .output_filepath = "thread_pool_benchmark.json",
+};
+
+constexpr u32 THROUGHPUT_BATCH_SIZE = 64;
+// enough for a batch, or a fan-out to every thread, so that the queue doesn't grow while it's timed
+constexpr u32 MAX_QUEUE_SIZE = 256;
+
+struct Results {
+    u32 thread_count;
+    // in microseconds
+    f64 latency_mean;
+    f64 latency_p50;
+    f64 latency_p99;
+    f64 tasks_per_second;
+    f64 fan_out_mean;
+};
+
+//
+// ===========================================================================================================
+//
+
+static u64 parseUnsignedArg(const char* name, const char* value) {
+
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 or end == value or *end != '\0') ABORT_F("Invalid value `%s` for `%s`.", value, name);
+
+    return (u64)parsed;
+}
+
+static Options parseOptions(int argc, char** argv) {
+
+    Options options = DEFAULT_OPTIONS;
+
+    for (int i = 1; i < argc; i++) {
+
+        const char* name = argv[i];
+        if (i + 1 == argc) ABORT_F("Missing value for `%s`.", name);
+        const char* value = argv[++i];
+
+        if (strcmp(name, "--max-threads") == 0) options.max_thread_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--samples") == 0) options.sample_count = (u32)parseUnsignedArg(name, value);
+        else if (strcmp(name, "--output") == 0) options.output_filepath = value;
+        else ABORT_F("Unknown argument `%s`.", name);
+    }
+
+    alwaysAssert(options.max_thread_count > 0);
+    alwaysAssert(options.max_thread_count <= MAX_QUEUE_SIZE);
+    alwaysAssert(options.sample_count > 0);
+
+    return options;
+}
+
+
+/// `CLOCK_MONOTONIC`, in ns.
+static u64 nowNs(void) {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+
+static void emptyTask(void*) {}
+
+/// `p_arg` is a `u64`, which gets the start time.
+static void timestampTask(void* p_arg) {
+    *(u64*)p_arg = nowNs();
+}
+
+
+static int compareF64(const void* p_a, const void* p_b) {
+    const f64 a = *(const f64*)p_a;
+    const f64 b = *(const f64*)p_b;
+    return (a > b) - (a < b);
+}
+
+
+static Results runThreadCount(u32 thread_count, u32 sample_count) {
+
+    ZoneScoped;
+
+    Results results { .thread_count = thread_count };
+
+    thread_pool::ThreadPool* thread_pool = thread_pool::create(thread_count, MAX_QUEUE_SIZE);
+    alwaysAssert(thread_pool != NULL);
+    defer(thread_pool::destroy(thread_pool));
+
+    // latency
+    {
+        f64* latencies = mallocArray(sample_count, f64);
+        defer(free(latencies));
+
+        f64 latency_sum = 0.0;
+        for (u32 i = 0; i < sample_count; i++) {
+
+            u64 start_time = 0;
+            const u64 enqueue_time = nowNs();
+            const thread_pool::TaskId task = thread_pool::enqueueTask(thread_pool, timestampTask, &start_time);
+            thread_pool::waitForTask(thread_pool, task);
+
+            latencies[i] = 1e-3 * (f64)(start_time - enqueue_time);
+            latency_sum += latencies[i];
+        }
+
+        qsort(latencies, sample_count, sizeof(f64), compareF64);
+        results.latency_mean = latency_sum / (f64)sample_count;
+        results.latency_p50 = latencies[sample_count / 2];
+        results.latency_p99 = latencies[math::min(sample_count - 1, (u32)((f64)sample_count * 0.99))];
+    }
+
+    // throughput
+    {
+        thread_pool::TaskId tasks[THROUGHPUT_BATCH_SIZE] {};
+
+        const u32 batch_count = math::max(1u, sample_count / THROUGHPUT_BATCH_SIZE);
+        const u64 start_time = nowNs();
+        for (u32 batch = 0; batch < batch_count; batch++) {
+            for (u32 i = 0; i < THROUGHPUT_BATCH_SIZE; i++) {
+                tasks[i] = thread_pool::enqueueTask(thread_pool, emptyTask, NULL);
+            }
+            for (u32 i = 0; i < THROUGHPUT_BATCH_SIZE; i++) thread_pool::waitForTask(thread_pool, tasks[i]);
+        }
+        const f64 elapsed_seconds = 1e-9 * (f64)(nowNs() - start_time);
+
+        results.tasks_per_second = (f64)(batch_count * THROUGHPUT_BATCH_SIZE) / elapsed_seconds;
+    }
+
+    // fan-out/fan-in
+    {
+        thread_pool::TaskGroup tasks {};
+
+        const u64 start_time = nowNs();
+        for (u32 round = 0; round < sample_count; round++) {
+            for (u32 i = 0; i < thread_count; i++) thread_pool::enqueueTask(thread_pool, &tasks, emptyTask, NULL);
+            thread_pool::waitForGroup(thread_pool, &tasks);
+        }
+
+        results.fan_out_mean = 1e-3 * (f64)(nowNs() - start_time) / (f64)sample_count;
+    }
+
+    return results;
+}
+
+
+static void writeResults(
+    const char* filepath,
+    const Options* options,
+    const Results* p_results,
+    u32 result_count
+) {
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) ABORT_F("Failed to open `%s` for writing: %s.", filepath, strerror(errno));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"sample_count\": %" PRIu32 ",\n", options->sample_count);
+    fprintf(file, "  \"throughput_batch_size\": %" PRIu32 ",\n", THROUGHPUT_BATCH_SIZE);
+    fprintf(file, "  \"thread_counts\": [\n");
+
+    for (u32 i = 0; i < result_count; i++) {
+        const Results* r = &p_results[i];
+        fprintf(
+            file,
+            "    { \"thread_count\": %" PRIu32 ", \"latency_us\": { \"mean\": %.3lf, \"p50\": %.3lf, "
+            "\"p99\": %.3lf }, \"empty_tasks_per_second\": %.0lf, \"fan_out_us\": %.3lf }%s\n",
+            r->thread_count, r->latency_mean, r->latency_p50, r->latency_p99,
+            r->tasks_per_second, r->fan_out_mean,
+            (i + 1 == result_count) ? "" : ","
+        );
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) ABORT_F("Failed to write `%s`.", filepath);
+    LOG_F(INFO, "Wrote results to `%s`.", filepath);
+}
+
+//
+// ===========================================================================================================
+//
+
+int main(int argc, char** argv) {
+
+    ZoneScoped;
+
+    loguru::init(argc, argv);
+    const Options options = parseOptions(argc, argv);
+
+    // 1, 2, 4, ..., and `max_thread_count` itself
+    u32 thread_counts[32] {};
+    u32 thread_count_count = 0;
+    for (u32 t = 1; t < options.max_thread_count; t *= 2) thread_counts[thread_count_count++] = t;
+    thread_counts[thread_count_count++] = options.max_thread_count;
+
+    printf(
+        "%7s %16s %16s %16s %14s %14s\n",
+        "threads", "latency mean/us", "latency p50/us", "latency p99/us", "empty tasks/s", "fan-out/us"
+    );
+
+    Results results[32] {};
+    for (u32 i = 0; i < thread_count_count; i++) {
+
+        results[i] = runThreadCount(thread_counts[i], options.sample_count);
+
+        const Results* r = &results[i];
+        printf(
+            "%7" PRIu32 " %16.3lf %16.3lf %16.3lf %14.0lf %14.3lf\n",
+            r->thread_count, r->latency_mean, r->latency_p50, r->latency_p99,
+            r->tasks_per_second, r->fan_out_mean
+        );
+    }
+
+    writeResults(options.output_filepath, &options, results, thread_count_count);
+
+    return 0;
+}
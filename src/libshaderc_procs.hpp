@@ -8,8 +8,15 @@
 //
 
 #define FOR_EACH_SHADERC_PROC(X) \
+    X(compile_into_preprocessed_text) \
     X(compile_into_spv) \
+    X(compile_options_initialize) \
+    X(compile_options_release) \
+    X(compile_options_set_generate_debug_info) \
+    X(compile_options_set_include_callbacks) \
+    X(compile_options_set_target_env) \
     X(compiler_initialize) \
+    X(compiler_release) \
     X(result_get_bytes) \
     X(result_get_compilation_status) \
     X(result_get_error_message) \
@@ -1,7 +1,11 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <cerrno>
 #include <cinttypes>
+#include <ctime>
+#include <algorithm>
+#include <immintrin.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -17,25 +21,32 @@
 #include <VulkanMemoryAllocator/vk_mem_alloc.h>
 
 #include "types.hpp"
+#include "trace.hpp"
 #include "math_util.hpp"
 #include "error_util.hpp"
 #include "vk_procs.hpp"
 #include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "fence_waiter.hpp"
 #include "graphics.hpp"
+#include "video_export.hpp"
+#include "voxel_store.hpp"
+#include "voxel_file.hpp"
 #include "alloc_util.hpp"
 #include "str_util.hpp"
 #include "defer.hpp"
-#include "thread_pool.hpp"
-#include "sort.hpp"
 
+#include "file_watch.hpp"
+#include "sort.hpp"
 #include "plugin.hpp"
 #include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
 #include "../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "fluid_sim_params_default.hpp"
+#include "sim_thread.hpp"
+#include "voxel_collider.hpp"
 
 #include "../build/env_vars.hpp"
 
-#include "main_internal.hpp"
-
 namespace gfx = graphics;
 
 using glm::mat3;
@@ -46,6 +57,7 @@ using glm::vec4;
 using glm::dvec2;
 using glm::ivec2;
 using glm::ivec3;
+using glm::uvec3;
 using glm::u8vec4;
 
 using fluid_sim::FluidSimProcs;
@@ -78,19 +90,56 @@ const f32 VIEW_FRUSTUM_FAR_SIDE_SIZE_Y =
     VIEW_FRUSTUM_NEAR_SIDE_SIZE_Y / (f32)VIEW_FRUSTUM_NEAR_SIDE_DISTANCE * (f32)VIEW_FRUSTUM_FAR_SIDE_DISTANCE;
 const vec2 VIEW_FRUSTUM_FAR_SIDE_SIZE { VIEW_FRUSTUM_FAR_SIDE_SIZE_X, VIEW_FRUSTUM_FAR_SIDE_SIZE_Y };
 
-const u32fast INVALID_VOXEL_IDX = UINT32_MAX;
-
 constexpr f64 FRAMETIME_PLOT_DISPLAY_DOMAIN_SECONDS = 10.0;
 constexpr f64 FRAMETIME_PLOT_SAMPLE_INTERVAL_SECONDS = 1. / 30.;
 constexpr u32fast FRAMETIME_PLOT_MAX_SAMPLE_COUNT =
     (u32fast)(FRAMETIME_PLOT_DISPLAY_DOMAIN_SECONDS / FRAMETIME_PLOT_SAMPLE_INTERVAL_SECONDS);
 
+// See `FrametimeStats`. The values are in microseconds; those below 2 * FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT have a
+// bucket each, and the others fall into FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT buckets per power of two, up to
+// 2^(FRAMETIME_HISTOGRAM_MAX_EXPONENT + 1) us (about a minute).
+constexpr u32 FRAMETIME_HISTOGRAM_SUB_BUCKET_BITS = 5; // a relative error of at most 1/32
+constexpr u32 FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT = 1 << FRAMETIME_HISTOGRAM_SUB_BUCKET_BITS;
+constexpr u32 FRAMETIME_HISTOGRAM_MAX_EXPONENT = 25;
+constexpr u32 FRAMETIME_HISTOGRAM_BUCKET_COUNT =
+    2 * FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT
+    + (FRAMETIME_HISTOGRAM_MAX_EXPONENT - FRAMETIME_HISTOGRAM_SUB_BUCKET_BITS) * FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT;
+// the raw series that are kept for the export; about 18 minutes at 60 fps
+constexpr u32 FRAMETIME_RECORD_CAPACITY = 1 << 16;
+
+// See `SlowFrameWatchdog`. The frames that it keeps, about 8 seconds at 60 fps, and the frames that it needs
+// before their median means anything.
+constexpr u32 SLOW_FRAME_HISTORY_CAPACITY = 512;
+constexpr u32 SLOW_FRAME_MIN_HISTORY_COUNT = 60;
+
+// the phases that `StartupProfile` can hold
+constexpr u32 STARTUP_PHASE_CAPACITY = 32;
+
+// See `RenderBenchmark`. The frames measured per render mode, unless RENDER_BENCHMARK_FRAMES says otherwise, and the
+// frames before them that aren't, while the mode's pipelines and buffers settle.
+constexpr u32 RENDER_BENCHMARK_DEFAULT_FRAME_COUNT = 600;
+constexpr u32 RENDER_BENCHMARK_WARMUP_FRAME_COUNT = 60;
+constexpr u32 RENDER_BENCHMARK_KEYFRAME_CAPACITY = 256;
+
+// See `InputRecording`; changed with the file's format.
+constexpr u32 INPUT_RECORDING_VERSION = 1;
+
 const u8 DEFAULT_PRESENT_MODE_PRIORITIES[3] {
     [gfx::PRESENT_MODE_IMMEDIATE] = 2,
     [gfx::PRESENT_MODE_MAILBOX] = 3,
     [gfx::PRESENT_MODE_FIFO] = 1,
 };
 
+// Overridden by the FRAMES_IN_FLIGHT environment variable; see `gfx::createRenderer()`.
+constexpr u32 DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+// see `FramePacer`
+constexpr f64 FRAME_PACER_SMOOTHING = 0.1; // the weight of each new reading in the averages
+constexpr f64 FRAME_PACER_SLACK_FRACTION = 0.8; // the part of the estimated slack that the delay uses
+constexpr f64 FRAME_PACER_MAX_DELAY_SECONDS = 0.05;
+// so that a hidden window, whose images may never be shown, doesn't stall the loop
+constexpr u64 FRAME_PACER_PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+
 //
 // Global variables ==========================================================================================
 //
@@ -125,24 +174,66 @@ bool right_mouse_is_pressed_ = false;
 
 bool imgui_overlay_visible_ = false;
 
-u32fast voxel_count_ = 0;
-gfx::Voxel* p_voxels_ = NULL;
+gfx::VoxelStore* voxel_store_ = NULL;
+
+// The fluid sim collides with the voxels within this many of the origin, per axis (see `voxel_collider`).
+constexpr i32 COLLIDER_REGION_HALF_EXTENT = 256;
+// the bricks that the collider can gain through edits, beyond twice those of the initial voxels
+constexpr u32 COLLIDER_EXTRA_BRICK_CAPACITY = 4096;
+voxel_collider::VoxelCollider* voxel_collider_ = NULL;
 
-u32fast voxels_in_frustum_count_ = 0;
-VoxelPosAndIndex* p_voxels_in_frustum_ = NULL;
+u32* p_voxel_cull_chunk_counts_ = NULL; // in `frame_arena_`; scratch for `frustumCull()`
 
-u32fast selected_voxel_index_count_ = 0;
-u32 p_selected_voxel_indices_[gfx::MAX_OUTLINED_VOXEL_COUNT];
+// For the temporaries of a frame; reset at the start of each. Only the selection's per-chunk counts are in it, so
+// it has room for this many chunks of the voxel store.
+constexpr u32 FRAME_ARENA_MAX_VOXEL_CHUNK_COUNT = 1 << 20;
+FrameArena frame_arena_;
+
+u32 selected_voxel_count_ = 0;
+ivec3 p_selected_voxel_coords_[gfx::MAX_OUTLINED_VOXEL_COUNT];
 
 bool selection_active_;
 vec2 selection_point1_windowspace_;
 vec2 selection_point2_windowspace_;
 
+// If true, the selection is what's visible in its rectangle, picked on the GPU (see `gfx::requestPick()`), and
+// includes particles; otherwise it's every voxel in its frustum, hidden or not.
+bool gpu_picking_ = false;
+u32 selected_particle_count_ = 0;
+bool selection_truncated_ = false;
+
 bool shader_autoreload_enabled_ = true;
 bool shader_file_tracking_enabled_ = false;
 bool last_shader_reload_failed_ = false;
 
 bool grid_shader_enabled_ = true;
+bool occlusion_culling_enabled_ = true;
+bool visibility_buffer_enabled_ = false;
+bool particle_depth_bounds_enabled_ = true;
+gfx::ParticleRenderMode particle_render_mode_ = gfx::PARTICLE_RENDER_MODE_RASTERIZED;
+// see `gfx::render()`
+f32 particle_lod_threshold_pixels_ = 2.f;
+// see `gfx::setDynamicResolutionBudget()`; 0 is off
+f32 dynamic_resolution_budget_ms_ = 0.f;
+// see `gfx::setParticleSubsamplingBudget()`; 0 is off
+f32 particle_subsampling_budget_ms_ = 0.f;
+// the last frame's, to tell whether the camera moved; see `gfx::setParticleSubsamplingSuspended()`
+mat4 last_world_to_screen_transform_ {};
+// see `gfx::setTranslucentParticleSettings()`; the renderer's defaults
+gfx::TranslucentParticleSettings translucent_particle_settings_ {
+    .opacity = 0.35f,
+    .resort_distance_radii = 4.f,
+    .max_sort_age_frames = 8,
+};
+// the sim's velocities, drawn as line segments; see `gfx::requestVectorField()`
+bool velocity_field_enabled_ = false;
+f32 velocity_field_scale_ = 0.05f; // s; a segment is where the particle would be after this long
+f32 velocity_field_spacing_pixels_ = 8.f;
+// a top and a side view of what the camera looks at, inset in its view; see `gfx::requestExtraViews()`
+bool extra_views_enabled_ = false;
+constexpr f32 EXTRA_VIEW_FOCUS_DISTANCE = 4.f; // m, from the camera, of the point that the views look at
+constexpr f32 EXTRA_VIEW_DISTANCE = 8.f; // m, from that point, of the views' eyes
+constexpr u32 EXTRA_VIEW_SCALE_DOWN = 4; // of the views' size, from the main view's
 
 struct FrametimePlot {
     u32fast first_sample_index = 0;
@@ -173,19 +264,488 @@ u32fast frametimeplot_frames_since_last_sample_ = 0;
 f64 frametimeplot_largest_reading_since_last_sample_ = 0;
 bool frametimeplot_paused_ = false;
 
+// a series per `fluid_sim::SimStage`, then one per `gfx::RenderPass`
+constexpr u32fast GPUTIMEPLOT_SERIES_COUNT = fluid_sim::SIM_STAGE_COUNT + gfx::RENDER_PASS_ENUM_COUNT;
+
+/// Sampled with the `FrametimePlot`, in the same scrolling layout. Each sample is the average of the readings
+/// since the previous one.
+struct GpuTimePlot {
+    u32fast first_sample_index = 0;
+    u32fast sample_count = 0;
+    f32 samples_milliseconds[GPUTIMEPLOT_SERIES_COUNT][FRAMETIME_PLOT_MAX_SAMPLE_COUNT];
+
+    f64 reading_sums_ns[GPUTIMEPLOT_SERIES_COUNT];
+    u32fast reading_counts[GPUTIMEPLOT_SERIES_COUNT];
+
+    inline void addReadings(u32fast first_series, u32fast series_count, const f64* readings_ns) {
+        for (u32fast i = 0; i < series_count; i++) {
+            this->reading_sums_ns[first_series + i] += readings_ns[i];
+            this->reading_counts[first_series + i]++;
+        }
+    }
+
+    /// The series without readings get a 0 sample.
+    inline void push(void) {
+        const u32fast sample_idx = (this->sample_count < FRAMETIME_PLOT_MAX_SAMPLE_COUNT) ?
+            this->sample_count : this->first_sample_index;
+
+        for (u32fast series = 0; series < GPUTIMEPLOT_SERIES_COUNT; series++) {
+            const u32fast count = this->reading_counts[series];
+            const f64 avg_ns = (count == 0) ? 0.0 : this->reading_sums_ns[series] / (f64)count;
+            this->samples_milliseconds[series][sample_idx] = (f32)(avg_ns * 1e-6);
+        }
+
+        if (this->sample_count < FRAMETIME_PLOT_MAX_SAMPLE_COUNT) this->sample_count++;
+        else this->first_sample_index = (this->first_sample_index + 1) % FRAMETIME_PLOT_MAX_SAMPLE_COUNT;
+    }
+
+    inline void clearReadings(void) {
+        for (u32fast series = 0; series < GPUTIMEPLOT_SERIES_COUNT; series++) {
+            this->reading_sums_ns[series] = 0.0;
+            this->reading_counts[series] = 0;
+        }
+    }
+
+    inline void reset(void) {
+        this->sample_count = 0;
+        this->first_sample_index = 0;
+        this->clearReadings();
+    }
+} gputimeplot_samples_scrolling_buffer_;
+
+// The series of `FrametimeStats`: the whole frame, then the parts of it. Not every part is measured every frame.
+enum FrametimeSeries : u32 {
+    FRAMETIME_SERIES_FRAME, // from the start of the main loop iteration to its end, pacing included
+    FRAMETIME_SERIES_INPUT, // from the input sampling until the frame stages start: events, camera, GUI
+    FRAMETIME_SERIES_CULL, // `frameStage_selectVoxels()`; only while selecting
+    FRAMETIME_SERIES_SIM_HOST, // `frameStage_advanceFluidSim()`; not with the sim thread
+    FRAMETIME_SERIES_SIM_GPU, // the sum of `fluid_sim::getStageGpuTimes()`, a step or more late
+    FRAMETIME_SERIES_RENDER, // `gfx::render()`, on the host
+    FRAMETIME_SERIES_RENDER_GPU, // `gfx::getFrameGpuTime()`, a frame or more late
+    FRAMETIME_SERIES_COUNT,
+};
+const char* const FRAMETIME_SERIES_NAMES[FRAMETIME_SERIES_COUNT] {
+    [FRAMETIME_SERIES_FRAME] = "frame",
+    [FRAMETIME_SERIES_INPUT] = "input",
+    [FRAMETIME_SERIES_CULL] = "cull",
+    [FRAMETIME_SERIES_SIM_HOST] = "sim_host",
+    [FRAMETIME_SERIES_SIM_GPU] = "sim_gpu",
+    [FRAMETIME_SERIES_RENDER] = "render",
+    [FRAMETIME_SERIES_RENDER_GPU] = "render_gpu",
+};
+constexpr u32 FRAMETIME_PERCENTILE_COUNT = 4;
+const f64 FRAMETIME_PERCENTILES[FRAMETIME_PERCENTILE_COUNT] { 0.5, 0.9, 0.99, 0.999 };
+const char* const FRAMETIME_PERCENTILE_NAMES[FRAMETIME_PERCENTILE_COUNT] { "p50", "p90", "p99", "p99.9" };
+
+/// Every frame's time, and its parts', unlike the plots, whose samples average over many frames and hide the rare
+/// slow ones. Each series has an HDR-style histogram, with a bounded relative error, for its percentiles; and the
+/// raw series of the last `FRAMETIME_RECORD_CAPACITY` frames are kept for the export, to diff across builds.
+struct FrametimeStats {
+    u64 histogram_counts[FRAMETIME_SERIES_COUNT][FRAMETIME_HISTOGRAM_BUCKET_COUNT];
+    u64 histogram_totals[FRAMETIME_SERIES_COUNT];
+    f32 max_milliseconds[FRAMETIME_SERIES_COUNT];
+
+    // a ring; negative where the part wasn't measured
+    f32 records_milliseconds[FRAMETIME_RECORD_CAPACITY][FRAMETIME_SERIES_COUNT];
+    u64 record_count; // since the reset; the ring holds the last `min(record_count, FRAMETIME_RECORD_CAPACITY)`
+
+    static inline u32 bucketIndex(u64 microseconds) {
+        constexpr u32 sub_bucket_count = FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT;
+        if (microseconds < 2 * sub_bucket_count) return (u32)microseconds;
+
+        const u32 exponent = 63 - (u32)__builtin_clzll(microseconds);
+        if (exponent > FRAMETIME_HISTOGRAM_MAX_EXPONENT) return FRAMETIME_HISTOGRAM_BUCKET_COUNT - 1;
+
+        const u32 shift = exponent - FRAMETIME_HISTOGRAM_SUB_BUCKET_BITS;
+        return 2 * sub_bucket_count + (shift - 1) * sub_bucket_count + (u32)(microseconds >> shift) - sub_bucket_count;
+    }
+
+    /// The middle of the bucket.
+    static inline f64 bucketMilliseconds(u32 bucket) {
+        constexpr u32 sub_bucket_count = FRAMETIME_HISTOGRAM_SUB_BUCKET_COUNT;
+        if (bucket < 2 * sub_bucket_count) return 1e-3 * ((f64)bucket + 0.5);
+
+        const u32 shift = (bucket - 2 * sub_bucket_count) / sub_bucket_count + 1;
+        const u64 lower = (u64)((bucket - 2 * sub_bucket_count) % sub_bucket_count + sub_bucket_count) << shift;
+        return 1e-3 * ((f64)lower + 0.5 * (f64)((u64)1 << shift));
+    }
+
+    /// `p_milliseconds[FRAMETIME_SERIES_COUNT]`, negative for the parts that weren't measured.
+    inline void push(const f32* p_milliseconds) {
+        for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+            const f32 ms = p_milliseconds[series];
+            this->records_milliseconds[this->record_count % FRAMETIME_RECORD_CAPACITY][series] = ms;
+            if (ms < 0.f) continue;
+
+            this->histogram_counts[series][bucketIndex((u64)(1e3f * ms + 0.5f))]++;
+            this->histogram_totals[series]++;
+            this->max_milliseconds[series] = glm::max(this->max_milliseconds[series], ms);
+        }
+        this->record_count++;
+    }
+
+    /// 0 if the series has no readings.
+    inline f64 percentileMilliseconds(u32 series, f64 percentile) const {
+        const u64 total = this->histogram_totals[series];
+        if (total == 0) return 0.0;
+
+        const u64 rank = glm::max((u64)1, (u64)ceil(percentile * (f64)total));
+        u64 count = 0;
+        for (u32 bucket = 0; bucket < FRAMETIME_HISTOGRAM_BUCKET_COUNT; bucket++) {
+            count += this->histogram_counts[series][bucket];
+            if (count >= rank) return bucketMilliseconds(bucket);
+        }
+        return bucketMilliseconds(FRAMETIME_HISTOGRAM_BUCKET_COUNT - 1);
+    }
+
+    inline void reset(void) {
+        memset(this->histogram_counts, 0, sizeof(this->histogram_counts));
+        memset(this->histogram_totals, 0, sizeof(this->histogram_totals));
+        memset(this->max_milliseconds, 0, sizeof(this->max_milliseconds));
+        this->record_count = 0;
+    }
+} frametime_stats_;
+
+/// Catches the rare frames that take much longer than the ones before them, which are hard to reproduce. Keeps the
+/// last `SLOW_FRAME_HISTORY_CAPACITY` frames' parts, with the GPU times of the sim's stages and of the render
+/// passes, and the thread pool's activity; once a frame takes more than `spike_factor` times their median, they
+/// are written with the sim's statistics by `writeSlowFrameCapture()`, to attach to a bug report. The next capture
+/// waits for a whole new history.
+struct SlowFrameWatchdog {
+    struct Record {
+        f32 milliseconds[FRAMETIME_SERIES_COUNT]; // like `FrametimeStats`'s records
+        // negative where it wasn't measured in the frame
+        f32 sim_stage_gpu_milliseconds[fluid_sim::SIM_STAGE_COUNT];
+        f32 render_pass_gpu_milliseconds[gfx::RENDER_PASS_ENUM_COUNT];
+        // the thread pool's, during the frame
+        u64 thread_pool_wake_count;
+        u64 thread_pool_wake_latency_ns; // in total
+        u32 thread_pool_queued_count; // at the end of the frame
+    };
+
+    bool enabled;
+    f32 spike_factor;
+
+    Record records[SLOW_FRAME_HISTORY_CAPACITY]; // a ring
+    u64 record_count;
+    u64 next_capture_record_count; // before which no frame is captured
+    u32 capture_count;
+    thread_pool::Stats previous_thread_pool_stats; // at the end of the previous frame
+
+    /// Adds the frame's record, and returns true if it's a spike to capture; then writes the median frame time
+    /// of the frames before it to `p_median_ms_out`.
+    inline bool push(const Record* record, f32* p_median_ms_out) {
+
+        const u64 history_count = glm::min(this->record_count, (u64)SLOW_FRAME_HISTORY_CAPACITY);
+        bool spike = false;
+        if (history_count >= SLOW_FRAME_MIN_HISTORY_COUNT and this->record_count >= this->next_capture_record_count)
+        {
+            f32 frame_milliseconds[SLOW_FRAME_HISTORY_CAPACITY];
+            for (u64 i = 0; i < history_count; i++) {
+                frame_milliseconds[i] = this->records[i].milliseconds[FRAMETIME_SERIES_FRAME];
+            }
+            std::nth_element(
+                frame_milliseconds, frame_milliseconds + history_count / 2, frame_milliseconds + history_count
+            );
+            const f32 median_ms = frame_milliseconds[history_count / 2];
+
+            spike = record->milliseconds[FRAMETIME_SERIES_FRAME] > this->spike_factor * median_ms;
+            *p_median_ms_out = median_ms;
+        }
+
+        this->records[this->record_count % SLOW_FRAME_HISTORY_CAPACITY] = *record;
+        this->record_count++;
+
+        if (spike) {
+            this->next_capture_record_count = this->record_count + SLOW_FRAME_HISTORY_CAPACITY;
+            this->capture_count++;
+        }
+        return spike;
+    }
+} slow_frame_watchdog_ {
+    .enabled = false,
+    .spike_factor = 3.0f,
+};
+
+/// How long each phase of startup took, up to the first frame, which is logged as the time to first frame. The main
+/// thread's phases follow each other; a phase that ran on the thread pool meanwhile is logged with the main thread's
+/// phase that waited for it.
+struct StartupProfile {
+    struct Phase {
+        const char* name; // a string literal
+        f64 milliseconds;
+        bool concurrent; // ran on the thread pool, overlapping the main thread's phases
+    };
+
+    u64 begin_ns; // see `trace::now()`
+    u64 phase_begin_ns; // of the main thread's current phase
+    Phase phases[STARTUP_PHASE_CAPACITY];
+    u32 phase_count;
+
+    inline void begin(void) {
+        this->begin_ns = trace::now();
+        this->phase_begin_ns = this->begin_ns;
+    }
+
+    inline void add(const char* name, f64 milliseconds, bool concurrent) {
+        if (this->phase_count == STARTUP_PHASE_CAPACITY) return;
+        this->phases[this->phase_count] = Phase {
+            .name = name, .milliseconds = milliseconds, .concurrent = concurrent
+        };
+        this->phase_count++;
+    }
+
+    /// Ends the main thread's current phase, which was `name`, and begins the next one.
+    inline void endPhase(const char* name) {
+        const u64 now_ns = trace::now();
+        this->add(name, 1e-6 * (f64)(now_ns - this->phase_begin_ns), false);
+        this->phase_begin_ns = now_ns;
+    }
+
+    void log(void) const {
+        const f64 total_ms = 1e-6 * (f64)(trace::now() - this->begin_ns);
+        LOG_F(INFO, "Time to first frame: %.1lf ms.", total_ms);
+        for (u32 i = 0; i < this->phase_count; i++) {
+            const Phase* phase = &this->phases[i];
+            LOG_F(
+                INFO, "    %-32s %8.1lf ms%s",
+                phase->name, phase->milliseconds, phase->concurrent ? " (on the thread pool, concurrently)" : ""
+            );
+        }
+    }
+} startup_profile_ {};
+
 gfx::PresentMode present_mode_ = gfx::PRESENT_MODE_ENUM_COUNT;
 gfx::PresentModePriorities present_mode_priorities_ {};
 
+u32 frames_in_flight_ = DEFAULT_FRAMES_IN_FLIGHT;
+
+/// With MAILBOX and IMMEDIATE, nothing holds the CPU back but the frames in flight, so when the GPU is the bottleneck,
+/// a frame's input would wait behind the other frames in flight before the GPU gets to it. So each frame first waits
+/// for its frame resources (see `gfx::waitForNextFrameResources()`); by then the GPU still has the other frames in
+/// flight to render, about (frames_in_flight - 1) * its frame time, and if that's more than the CPU takes to record
+/// the frame, the input sampling is delayed by part of the difference, for the frame to be submitted as the GPU gets
+/// to it, with newer input. The sim's GPU time isn't counted, which only makes the delay shorter than it could be.
+///
+/// In low-latency mode, which needs `gfx::presentWaitSupported()`, each frame instead waits until the last one is
+/// shown (see `gfx::waitForLastPresent()`), in any present mode, so that there's never more than one frame queued
+/// ahead of the display; and the time from a frame's input sampling until it's shown is measured.
+struct FramePacer {
+    bool enabled = true;
+    bool low_latency = false;
+    // averages over the recent frames
+    f64 cpu_frame_seconds = 0.0; // from the input sampling to `gfx::render()` returning
+    f64 gpu_frame_seconds = 0.0; // see `gfx::getFrameGpuTime()`
+    // From the input sampling until `gfx::waitForLastPresent()` returns; an estimate of the input-to-photon latency,
+    // without the input device's and the display's own latencies. Only measured in low-latency mode.
+    f64 input_to_photon_seconds = 0.0;
+    f64 delay_seconds = 0.0; // the last frame's
+    f64 input_sample_time_seconds = 0.0;
+    // the last frame that was presented; see `gfx::getLastPresentId()`
+    u64 last_present_id = 0;
+    f64 last_present_input_sample_time_seconds = 0.0;
+    bool last_present_measured = false;
+
+    inline f64 computeDelaySeconds(u32 frames_in_flight) const {
+        const f64 slack = (f64)(frames_in_flight - 1) * this->gpu_frame_seconds - this->cpu_frame_seconds;
+        return glm::clamp(FRAME_PACER_SLACK_FRACTION * slack, 0.0, FRAME_PACER_MAX_DELAY_SECONDS);
+    }
+
+    static inline void addReading(f64* p_average, f64 reading) {
+        *p_average = (*p_average == 0.0) ? reading : glm::mix(*p_average, reading, FRAME_PACER_SMOOTHING);
+    }
+} frame_pacer_;
+
+/// GPU times that don't depend on where the camera happened to be, which moves them a lot (the fancy particle modes,
+/// the voxels' overdraw): plays a scripted camera path over a sim that doesn't step, once per particle render mode,
+/// and writes each mode's times; see RENDER_BENCHMARK in `main()`. The path is played by frame rather than by wall
+/// time, so every run draws the same views. Each mode first draws `RENDER_BENCHMARK_WARMUP_FRAME_COUNT` frames at the
+/// path's start, then `frame_count` along it; as its GPU times arrive as many frames late as can be in flight, it
+/// then keeps drawing the path's last view until they have.
+struct RenderBenchmark {
+    struct Keyframe {
+        f32 seconds;
+        vec3 pos;
+        vec2 angles; // like `camera_angles_`, but not wrapped, so that a path can turn past a full circle
+    };
+
+    bool active;
+    Keyframe keyframes[RENDER_BENCHMARK_KEYFRAME_CAPACITY]; // by increasing time
+    u32 keyframe_count;
+    u32 frame_count; // measured per mode
+
+    gfx::ParticleRenderMode mode; // being measured
+    u32 mode_frame; // of this mode, the warmup included
+    u32 measured_mode_count;
+
+    // this mode's readings (ms), of the frames along the path, in order
+    f32* p_frame_ms; // on the host, of the whole main loop iteration
+    f32* p_render_gpu_ms; // see `gfx::getFrameGpuTime()`
+    f32* p_pass_gpu_ms; // `frame_count` per `gfx::RenderPass`; see `gfx::getRenderPassGpuTimes()`
+    u32 frame_reading_count;
+    u32 gpu_reading_count;
+    f32* p_scratch; // `frame_count`, for the percentiles
+
+    FILE* results_file;
+    char results_filepath[64];
+
+    /// The index along the path of the frame that `mode_frame` draws.
+    inline u32 pathFrame(void) const {
+        if (this->mode_frame < RENDER_BENCHMARK_WARMUP_FRAME_COUNT) return 0;
+        return glm::min(this->mode_frame - RENDER_BENCHMARK_WARMUP_FRAME_COUNT, this->frame_count - 1);
+    }
+
+    /// The camera at `path_frame` of `frame_count`, which are spread evenly over the path's time; linear between the
+    /// keyframes.
+    inline void sampleCamera(u32 path_frame, vec3* p_pos_out, vec2* p_angles_out) const {
+        const Keyframe* first = &this->keyframes[0];
+        const Keyframe* last = &this->keyframes[this->keyframe_count - 1];
+        const f32 fraction = (this->frame_count > 1) ? (f32)path_frame / (f32)(this->frame_count - 1) : 0.f;
+        const f32 seconds = glm::mix(first->seconds, last->seconds, fraction);
+
+        u32 k = 0;
+        while (k + 2 < this->keyframe_count and this->keyframes[k + 1].seconds <= seconds) k++;
+        const Keyframe* a = &this->keyframes[k];
+        const Keyframe* b = &this->keyframes[glm::min(k + 1, this->keyframe_count - 1)];
+        const f32 alpha = (b->seconds > a->seconds) ?
+            glm::clamp((seconds - a->seconds) / (b->seconds - a->seconds), 0.f, 1.f) : 0.f;
+
+        *p_pos_out = glm::mix(a->pos, b->pos, alpha);
+        const vec2 angles = glm::mix(a->angles, b->angles, alpha);
+        *p_angles_out = vec2(
+            (f32)glm::mod((f64)angles.x, 2.*M_PI),
+            (f32)glm::clamp((f64)angles.y, -0.5*M_PI, 0.5*M_PI)
+        );
+    }
+} render_benchmark_ {};
+
+enum InputRecordingMode : u8 {
+    INPUT_RECORDING_MODE_OFF,
+    INPUT_RECORDING_MODE_RECORD,
+    INPUT_RECORDING_MODE_REPLAY,
+};
 
-constexpr fluid_sim::SimParameters FLUID_SIM_PARAMS_DEFAULT {
-    .rest_particle_density = 1000,
-    .rest_particle_interaction_count_approx = 50,
-    .spring_stiffness = 0.05f, // TODO FIXME didn't really think about this
+// `InputRecording::Frame::keys`
+enum InputRecordingKeyBits : u32 {
+    INPUT_RECORDING_KEY_W = 1 << 0,
+    INPUT_RECORDING_KEY_A = 1 << 1,
+    INPUT_RECORDING_KEY_S = 1 << 2,
+    INPUT_RECORDING_KEY_D = 1 << 3,
+    INPUT_RECORDING_KEY_SPACE = 1 << 4,
+    INPUT_RECORDING_KEY_LEFT_SHIFT = 1 << 5,
+    INPUT_RECORDING_KEY_LEFT_CONTROL = 1 << 6,
+    INPUT_RECORDING_KEY_LEFT_ALT = 1 << 7,
+    INPUT_RECORDING_KEY_R = 1 << 8,
+    INPUT_RECORDING_KEY_G = 1 << 9,
 };
+
+/// A session's inputs, frame by frame, so that a slow session can be run again and profiled: INPUT_RECORD=<file>
+/// writes them as the session runs, and INPUT_REPLAY=<file> plays them back in place of the window's, then writes
+/// the replay's frame times and exits; see `main()`. A frame's inputs are its `delta_t`, the camera it was drawn
+/// from, the cursor, the keys and the mouse buttons as the main loop read them, the render mode, and whether the sim
+/// was paused; and the events before it that changed the sim or the pipelines: the parameters that `setParams()`
+/// got, the sim's resets, its plugin's reloads and version switches, and shader reloads. The replay takes the camera
+/// as recorded, rather than moving it by the keys again, so it can't drift; the keys are there to read. The sim's
+/// particles and the generated voxels come from the recorded seed, voxel count and parameters, so with the same
+/// build, device and window size, the replay steps the same sim through the same views and selections. The graphics
+/// settings other than the render mode aren't recorded.
+///
+/// The file is text, a record per line, and the replay reads it as it goes:
+///     input_recording <version> <sizeof(SimParameters)>
+///     seed <the seed of the sim's particles>
+///     voxels <VOXEL_COUNT>
+///     voxel_world <VOXEL_WORLD, or nothing if the voxels were generated>
+///     params <the initial SimParameters, as hex bytes>
+/// then each frame's events, `event params <hex>`, `event reset`, `event plugin_reload`, `event plugin_version <n>`
+/// or `event shader_reload`, followed by the frame:
+///     frame <delta_t> <x> <y> <z> <yaw> <pitch> <cursor x> <cursor y> <keys> <mouse buttons> <render mode> <flags>
+/// with the angles in radians, and the keys (`InputRecordingKeyBits`), the mouse buttons (1: left, 2: right) and
+/// the flags (1: the cursor is visible, 2: the sim is paused) in hex.
+struct InputRecording {
+    struct Frame {
+        f64 delta_t_seconds;
+        vec3 camera_pos;
+        vec2 camera_angles;
+        dvec2 cursor_pos;
+        u32 keys;
+        bool left_mouse_pressed;
+        bool right_mouse_pressed;
+        gfx::ParticleRenderMode particle_render_mode;
+        bool cursor_visible;
+        bool sim_paused;
+    };
+
+    InputRecordingMode mode;
+    FILE* file;
+    char filepath[256];
+    char voxel_world_filepath[256]; // when replaying, VOXEL_WORLD of the recording, or empty
+    u32 line_number; // when replaying, of the last line read
+
+    // When recording, the one being recorded, which is written once its inputs are all read. When replaying, the one
+    // being played; once the file is out of frames, the last one is held until the GPU times of the frames that it
+    // ended with have arrived.
+    Frame frame;
+    u32 frame_count;
+    bool end_of_file;
+    u32 frames_past_end;
+
+    // the replay's readings (ms), for the results file: of each frame, and the GPU's as they arrive
+    ArrayList<f32> frame_ms;
+    ArrayList<f32> render_gpu_ms;
+    ArrayList<f32> sim_gpu_ms;
+
+    inline bool replaying(void) const {
+        return this->mode == INPUT_RECORDING_MODE_REPLAY;
+    }
+} input_recording_ {};
+
+
 fluid_sim::SimParameters fluid_sim_params_ = FLUID_SIM_PARAMS_DEFAULT;
 
 bool fluid_sim_paused_ = false;
 
+// Set by the FLUID_SIM_VOLUME_EXPORT environment variable, to the path prefix of the files that each frame's density
+// field is written to; see `fluid_sim::startVolumeExport()`. Only exported when the sim is stepped once per frame.
+const char* volume_export_path_ = NULL;
+
+// Set by the SIM_THREAD environment variable, to the sim's step rate in Hz; then the sim steps on a thread of its
+// own, and the frames draw its latest two steps, blended. NULL if it's stepped once per frame instead. See
+// `sim_thread`.
+sim_thread::SimThread* sim_thread_ = NULL;
+constexpr u32 SIM_THREAD_MAX_STEPS_PER_WAKE = 4;
+bool sim_thread_interpolation_ = true;
+// Their last values; read only when the sim thread isn't holding the sim, so that the GUI doesn't wait for a step.
+u64 fluid_sim_uploaded_byte_count_ = 0;
+fluid_sim::TransferStats fluid_sim_transfers_ {};
+fluid_sim::SimData::TimeStep fluid_sim_time_step_ {};
+fluid_sim::SimData::Diagnostics fluid_sim_diagnostics_ {};
+fluid_sim::SimMemoryUsage fluid_sim_memory_usage_ {};
+
+// The sim's and the renderer's transfers between the host and the GPU per frame, averaged over the frames of the
+// last `TRANSFER_RATE_INTERVAL_SECONDS`, from the totals of `fluid_sim::TransferStats` and `gfx::TransferStats`.
+constexpr f64 TRANSFER_RATE_INTERVAL_SECONDS = 0.5;
+struct TransferRates {
+    fluid_sim::TransferStats previous_sim_totals;
+    gfx::TransferStats previous_render_totals;
+    u64 previous_frame;
+    f64 previous_time_seconds;
+
+    // per frame
+    f64 sim_upload_bytes[fluid_sim::TRANSFER_CATEGORY_COUNT];
+    f64 sim_uploads[fluid_sim::TRANSFER_CATEGORY_COUNT];
+    f64 sim_download_bytes[fluid_sim::TRANSFER_CATEGORY_COUNT];
+    f64 sim_downloads[fluid_sim::TRANSFER_CATEGORY_COUNT];
+    f64 render_upload_bytes[gfx::RENDER_TRANSFER_ENUM_COUNT];
+    f64 render_uploads[gfx::RENDER_TRANSFER_ENUM_COUNT];
+    f64 render_download_bytes[gfx::RENDER_TRANSFER_ENUM_COUNT];
+    f64 render_downloads[gfx::RENDER_TRANSFER_ENUM_COUNT];
+} transfer_rates_ {};
+
+// 0 disables the spatial structure stats; they cost a readback of the whole structure each time.
+u32fast fluid_sim_spatial_stats_interval_frames_ = 0;
+bool fluid_sim_spatial_stats_valid_ = false;
+fluid_sim::SpatialStructureStats fluid_sim_spatial_stats_ {};
+
 // TODO maybe the `fluid_sim` namespace should be a subspace of `plugin`?
 const FluidSimProcs* fluid_sim_procs_ = NULL;
 
@@ -281,6 +841,13 @@ VkFence general_purpose_fence_ = VK_NULL_HANDLE;
 
 
 thread_pool::ThreadPool* thread_pool_ = NULL;
+// Per thread of `thread_pool_`: the busy fraction over the last sample interval of the `FrametimePlot`, and the
+// busy time up to its start.
+f32* threadpoolplot_busy_fractions_ = NULL;
+u64* threadpoolplot_prev_busy_ns_ = NULL;
+
+// Of each memory heap, queried every frame; see `guiWindow_memory()`.
+VmaBudget memory_heap_budgets_[VK_MAX_MEMORY_HEAPS] {};
 
 
 //
@@ -399,6 +966,31 @@ static inline vec2 windowspaceToNormalizedScreenspace(vec2 p, const VkRect2D* vi
 }
 
 
+/// From world space to Vulkan's clip space, for a camera at `eye` that looks at `target`, with the app's projection.
+static mat4 getWorldToScreenTransform(vec3 eye, vec3 target, vec3 up_unit) {
+
+    mat4 world_to_camera_transform = glm::lookAt(
+        eye,
+        target, // position you're looking at
+        up_unit // "Normalized up vector, how the camera is oriented."
+    );
+    mat4 camera_to_clip_transform = glm::perspective(
+        (f32)FOV_Y, // fovy
+        (f32)ASPECT_RATIO_X_OVER_Y, // aspect
+        (f32)VIEW_FRUSTUM_NEAR_SIDE_DISTANCE, // zNear
+        (f32)VIEW_FRUSTUM_FAR_SIDE_DISTANCE // zFar
+    );
+
+    // By default:
+    //     In GLM clip coordinates: the Y axis points upward.
+    //     In Vulkan normalized device coordinates: the Y axis points downward.
+    mat4 glm_to_vulkan = glm::identity<mat4>();
+    glm_to_vulkan[1][1] = -1.0f; // mirror y axis
+
+    return glm_to_vulkan * camera_to_clip_transform * world_to_camera_transform;
+}
+
+
 /// Returns a 16:9 subregion centered in an image, which maximizes the subregion's area.
 static VkRect2D centeredSubregion_16x9(u32 image_width, u32 image_height) {
 
@@ -445,90 +1037,86 @@ static inline ivec3 worldspaceToIndexspaceInt(vec3 pos) {
 }
 
 
-struct AxisAlignedBox {
-    f32 x_min;
-    f32 y_min;
-    f32 z_min;
-    f32 x_max;
-    f32 y_max;
-    f32 z_max;
-};
-struct RaycastRay {
-    vec3 origin;
-    vec3 direction_reciprocal;
-};
-// TODO OPTIMIZE
-// src: https://tavianator.com/2022/ray_box_boundary.html
-/// Returns a number <= 0 if there is no collision.
-/// TODO FIXME:
-/// 1. Doesn't handle the case where the ray is parallel to an axis.
-/// 2. Don't know if it handles the case where the ray origin is inside the box.
-static inline f32 rayBoxInteriorCollisionTime(const RaycastRay* ray, const AxisAlignedBox* box) {
+/// When the ray crosses the next boundary of the grid of `cell_size` cells on each axis, from `cell`.
+static inline vec3 rayNextBoundaryTimes(vec3 origin, vec3 direction, ivec3 cell, f32 cell_size) {
+
+    vec3 t_next = vec3(INFINITY);
+    for (glm::length_t axis = 0; axis < 3; axis++) {
+        if (direction[axis] > 0.f) t_next[axis] = ((f32)(cell[axis] + 1) * cell_size - origin[axis]) / direction[axis];
+        if (direction[axis] < 0.f) t_next[axis] = ((f32)cell[axis] * cell_size - origin[axis]) / direction[axis];
+    }
+    return t_next;
+}
 
-    f32 t_x0 = (box->x_min - ray->origin.x) * ray->direction_reciprocal.x;
-    f32 t_y0 = (box->y_min - ray->origin.y) * ray->direction_reciprocal.y;
-    f32 t_z0 = (box->z_min - ray->origin.z) * ray->direction_reciprocal.z;
 
-    f32 t_x1 = (box->x_max - ray->origin.x) * ray->direction_reciprocal.x;
-    f32 t_y1 = (box->y_max - ray->origin.y) * ray->direction_reciprocal.y;
-    f32 t_z1 = (box->z_max - ray->origin.z) * ray->direction_reciprocal.z;
+static inline glm::length_t minAxis(vec3 v) {
+    glm::length_t axis = 0;
+    if (v[1] < v[axis]) axis = 1;
+    if (v[2] < v[axis]) axis = 2;
+    return axis;
+}
 
 
-    f32 t_min_x = glm::min(t_x0, t_x1);
-    f32 t_max_x = glm::max(t_x0, t_x1);
+/// Returns whether the ray enters a voxel within `max_distance`, and if so writes the first one's coordinates to
+/// `coord_out`; the voxel that contains the origin doesn't count. Walks the chunks of the store, and the cells of
+/// the nonempty ones (Amanatides & Woo), so it takes time in proportion to the distance rather than to the voxel
+/// count.
+static bool rayCast(
+    const gfx::VoxelStore* voxel_store, vec3 ray_origin, vec3 ray_direction_unit, f32 max_distance, ivec3* coord_out
+) {
 
-    f32 t_min_y = glm::min(t_y0, t_y1);
-    f32 t_max_y = glm::max(t_y0, t_y1);
+    ZoneScoped;
 
-    f32 t_min_z = glm::min(t_z0, t_z1);
-    f32 t_max_z = glm::max(t_z0, t_z1);
+    // Shifted by half a voxel, so that each voxel's cell is [coord, coord + 1).
+    const vec3 origin = worldspaceToIndexspaceFloat(ray_origin) + 0.5f;
+    const vec3 direction = ray_direction_unit; // the scale is the same on each axis, so it's still a unit vector
+    const f32 t_max = max_distance / gfx::VOXEL_DIAMETER;
 
+    constexpr i32 chunk_size = (i32)gfx::VOXEL_CHUNK_SIZE;
+    const ivec3 step = ivec3(glm::sign(direction));
+    const vec3 t_delta = glm::abs(1.f / direction);
+    const ivec3 origin_cell = ivec3(glm::floor(origin));
 
-    f32 t_entry = glm::max(t_min_x, t_min_y, t_min_z);
-    f32 t_exit  = glm::min(t_max_x, t_max_y, t_max_z);
-    f32 time_spent_in_box = t_exit - t_entry;
-    bool box_entered = time_spent_in_box > 0.0f;
-    return (f32)box_entered * t_entry;
-}
+    // Stepped on integers, rather than found from the position at each step, so that rounding can't send it back.
+    ivec3 chunk_coord = origin_cell >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2;
+    vec3 t_next_chunk = rayNextBoundaryTimes(origin, direction, chunk_coord, (f32)chunk_size);
+    f32 t_chunk_entry = 0.f;
 
+    while (t_chunk_entry < t_max) {
 
-/// Returns the index of the voxel with the earliest collision, or INVALID_VOXEL_IDX if there are no collisions.
-static u32fast rayCast(
-    vec3 ray_origin,
-    vec3 ray_direction,
-    u32fast voxel_count,
-    const VoxelPosAndIndex* p_voxels
-) {
-    ZoneScoped;
+        const glm::length_t chunk_exit_axis = minAxis(t_next_chunk);
+        const f32 t_chunk_exit = t_next_chunk[chunk_exit_axis];
 
-    u32fast earliest_collision_idx = INVALID_VOXEL_IDX;
-    f32 earliest_collision_time = INFINITY;
+        const u32 chunk_idx = gfx::findVoxelChunk(voxel_store, chunk_coord);
+        if (chunk_idx != gfx::INVALID_VOXEL_CHUNK_IDX && gfx::getVoxelChunk(voxel_store, chunk_idx).voxel_count != 0) {
 
-    RaycastRay ray {
-        .origin = worldspaceToIndexspaceFloat(ray_origin),
-        .direction_reciprocal = 1.f / ray_direction,
-    };
+            const ivec3 chunk_first_cell = chunk_coord * chunk_size;
+            ivec3 cell = glm::clamp(
+                ivec3(glm::floor(origin + t_chunk_entry * direction)), chunk_first_cell, chunk_first_cell + chunk_size - 1
+            );
+            vec3 t_next_cell = rayNextBoundaryTimes(origin, direction, cell, 1.f);
+            f32 t_cell_entry = t_chunk_entry;
 
-    for (u32fast voxel_idx = 0; voxel_idx < voxel_count; voxel_idx++) {
+            while (t_cell_entry < t_chunk_exit and t_cell_entry < t_max) {
 
-        vec3 voxel_coord = p_voxels[voxel_idx].pos;
-        AxisAlignedBox box {
-            .x_min = (f32)voxel_coord.x - 0.5f,
-            .y_min = (f32)voxel_coord.y - 0.5f,
-            .z_min = (f32)voxel_coord.z - 0.5f,
-            .x_max = (f32)voxel_coord.x + 0.5f,
-            .y_max = (f32)voxel_coord.y + 0.5f,
-            .z_max = (f32)voxel_coord.z + 0.5f,
-        };
+                if (cell != origin_cell && gfx::findVoxel(voxel_store, cell, NULL)) {
+                    *coord_out = cell;
+                    return true;
+                }
 
-        f32 t = rayBoxInteriorCollisionTime(&ray, &box);
-        if (0.0f < t and t < earliest_collision_time) {
-            earliest_collision_time = t;
-            earliest_collision_idx = p_voxels[voxel_idx].idx;
+                const glm::length_t axis = minAxis(t_next_cell);
+                t_cell_entry = t_next_cell[axis];
+                cell[axis] += step[axis];
+                t_next_cell[axis] += t_delta[axis];
+            }
         }
+
+        t_chunk_entry = t_chunk_exit;
+        chunk_coord[chunk_exit_axis] += step[chunk_exit_axis];
+        t_next_chunk[chunk_exit_axis] += (f32)chunk_size * t_delta[chunk_exit_axis];
     }
 
-    return earliest_collision_idx;
+    return false;
 }
 
 
@@ -620,30 +1208,168 @@ static Hexahedron frustumFromScreenspacePoints(
 };
 
 
-static inline bool pointIsInHexahedron(const Hexahedron* f, vec3 p) {
+// Store chunks per `parallelFor()` chunk of `frustumCull()`; each has up to 32^3 voxels.
+constexpr u64 VOXEL_CULL_GRAIN = 4;
+
+struct FrustumCullContext {
+    // (normal, distance) with unit normals pointing inward, so that the signed distance of `p` is
+    // `dot(normal, p) + distance`
+    vec4 planes[6];
+    f32 voxel_bounding_sphere_radius;
+    const gfx::VoxelStore* voxel_store;
+    // First each chunk's count of visible voxels; then, once they're turned into offsets, each chunk's visible voxels
+    // are written from its offset, up to `coord_capacity`, if `p_coords_out` isn't NULL.
+    u32* p_chunk_counts;
+    ivec3* p_coords_out;
+    u32 coord_capacity;
+};
+
+
+/// Culls the voxels of a store chunk that isn't entirely inside or outside the frustum. Writes the first
+/// `out_capacity` visible ones to `p_out`, unless it's NULL, and returns the count of all of them.
+static u32 frustumCullChunkVoxels(
+    const FrustumCullContext* ctx, const gfx::VoxelChunk* chunk, ivec3* p_out, u32 out_capacity
+) {
+
+    const gfx::Voxel* p_voxels = chunk->p_voxels;
+    const u32 voxel_count = chunk->voxel_count;
+    u32 out_count = 0;
+
+    #ifdef __AVX2__
+    {
+        __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+        for (u32 p = 0; p < 6; p++) {
+            plane_x[p] = _mm256_set1_ps(ctx->planes[p].x);
+            plane_y[p] = _mm256_set1_ps(ctx->planes[p].y);
+            plane_z[p] = _mm256_set1_ps(ctx->planes[p].z);
+            plane_w[p] = _mm256_set1_ps(ctx->planes[p].w);
+        }
+        const __m256 min_signed_distance = _mm256_set1_ps(-ctx->voxel_bounding_sphere_radius);
+
+        // the voxels are 4 ints each, so the coordinates are gathered; the lanes past the end aren't loaded
+        static_assert(sizeof(gfx::Voxel) == 4 * sizeof(i32));
+        const __m256i lane_indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i x_offsets = _mm256_slli_epi32(lane_indices, 2);
+        const __m256i y_offsets = _mm256_add_epi32(x_offsets, _mm256_set1_epi32(1));
+        const __m256i z_offsets = _mm256_add_epi32(x_offsets, _mm256_set1_epi32(2));
+
+        for (u32 i = 0; i < voxel_count; i += 8) {
+
+            const int* p_base = (const int*)&p_voxels[i];
+            const __m256i lane_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((i32)(voxel_count - i)), lane_indices);
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256 x = _mm256_cvtepi32_ps(_mm256_mask_i32gather_epi32(zero, p_base, x_offsets, lane_mask, 4));
+            const __m256 y = _mm256_cvtepi32_ps(_mm256_mask_i32gather_epi32(zero, p_base, y_offsets, lane_mask, 4));
+            const __m256 z = _mm256_cvtepi32_ps(_mm256_mask_i32gather_epi32(zero, p_base, z_offsets, lane_mask, 4));
+
+            __m256 signed_distance = _mm256_set1_ps(INFINITY);
+            for (u32 p = 0; p < 6; p++) {
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(plane_x[p], x), plane_w[p]);
+                d = _mm256_add_ps(_mm256_mul_ps(plane_y[p], y), d);
+                d = _mm256_add_ps(_mm256_mul_ps(plane_z[p], z), d);
+                signed_distance = _mm256_min_ps(signed_distance, d);
+            }
+
+            u32 mask = (u32)_mm256_movemask_ps(_mm256_cmp_ps(signed_distance, min_signed_distance, _CMP_GE_OQ));
+            mask &= (u32)_mm256_movemask_ps(_mm256_castsi256_ps(lane_mask));
+
+            while (mask != 0) {
+                const u32 voxel_idx = i + (u32)__builtin_ctz(mask);
+                mask &= mask - 1;
+                if (p_out != NULL && out_count < out_capacity) p_out[out_count] = p_voxels[voxel_idx].coord;
+                out_count++;
+            }
+        }
+    }
+    #else
+    for (u32 voxel_idx = 0; voxel_idx < voxel_count; voxel_idx++) {
+
+        const vec3 p = vec3(p_voxels[voxel_idx].coord);
+
+        f32 signed_distance = INFINITY;
+        for (u32 plane_idx = 0; plane_idx < 6; plane_idx++) {
+            const vec4 plane = ctx->planes[plane_idx];
+            signed_distance = glm::min(signed_distance, glm::dot(vec3(plane), p) + plane.w);
+        }
+
+        if (signed_distance >= -ctx->voxel_bounding_sphere_radius) {
+            if (p_out != NULL && out_count < out_capacity) p_out[out_count] = p_voxels[voxel_idx].coord;
+            out_count++;
+        }
+    }
+    #endif
+
+    return out_count;
+}
+
+
+static void frustumCullChunks(void* p_ctx, u64 chunk_begin, u64 chunk_end) {
+
+    const FrustumCullContext* ctx = (const FrustumCullContext*)p_ctx;
+    const f32 r = ctx->voxel_bounding_sphere_radius;
 
-    bool inside = true;
+    for (u64 chunk_idx = chunk_begin; chunk_idx < chunk_end; chunk_idx++) {
 
-    inside &= glm::dot(p - f->near_bot_left_p, f->near_normal) > 0.0f;
-    inside &= glm::dot(p - f->near_bot_left_p, f->bot_normal) > 0.0f;
-    inside &= glm::dot(p - f->near_bot_left_p, f->left_normal) > 0.0f;
+        const gfx::VoxelChunk chunk = gfx::getVoxelChunk(ctx->voxel_store, (u32)chunk_idx);
 
-    inside &= glm::dot(p - f->far_top_right_p, f->far_normal) > 0.0f;
-    inside &= glm::dot(p - f->far_top_right_p, f->top_normal) > 0.0f;
-    inside &= glm::dot(p - f->far_top_right_p, f->right_normal) > 0.0f;
+        // where its voxels go, if this is the pass that writes them
+        ivec3* p_out = NULL;
+        u32 out_capacity = 0;
+        if (ctx->p_coords_out != NULL) {
+            const u32 offset = ctx->p_chunk_counts[chunk_idx];
+            if (offset >= ctx->coord_capacity) continue;
+            p_out = &ctx->p_coords_out[offset];
+            out_capacity = ctx->coord_capacity - offset;
+        }
+
+        u32 out_count = 0;
+        if (chunk.voxel_count != 0) {
+
+            // the signed distances of the nearest and farthest corners of the chunk's bounds, for each plane
+            const vec3 center = 0.5f * vec3(chunk.bounds_min + chunk.bounds_max);
+            const vec3 half_extent = 0.5f * vec3(chunk.bounds_max - chunk.bounds_min);
+            bool outside = false;
+            bool inside = true;
+            for (u32 p = 0; p < 6; p++) {
+                const vec4 plane = ctx->planes[p];
+                const f32 center_distance = glm::dot(vec3(plane), center) + plane.w;
+                const f32 radius = glm::dot(glm::abs(vec3(plane)), half_extent);
+                outside |= center_distance + radius < -r;
+                inside &= center_distance - radius >= -r;
+            }
+
+            if (outside) {}
+            else if (inside) {
+                out_count = chunk.voxel_count;
+                for (u32 i = 0; p_out != NULL && i < math::min(out_count, out_capacity); i++) {
+                    p_out[i] = chunk.p_voxels[i].coord;
+                }
+            }
+            else out_count = frustumCullChunkVoxels(ctx, &chunk, p_out, out_capacity);
+        }
 
-    return inside;
+        if (ctx->p_coords_out == NULL) ctx->p_chunk_counts[chunk_idx] = out_count;
+    }
 }
 
 
+/// The voxels whose bounding spheres of radius `voxel_radius` intersect `frustum`; 0 for the voxels whose
+/// centers are in it. For selecting; the renderer culls the voxels that it draws on the GPU.
 /// The points in `frustum` must be in index space.
 /// The normals in `frustum` must be unit vectors.
-/// Returns the number of points remaining after culling.
-static u32fast frustumCull(
+/// Tests each chunk of the store against the frustum first, and only the voxels of those that it cuts through, in
+/// two passes: the first counts each chunk's visible voxels, and the second writes them, so that the output only
+/// needs room for `coord_capacity`. `p_chunk_counts_scratch` must have room for a count per chunk of the store.
+/// The visible voxels are in the store's order.
+/// Returns the number of visible voxels, at most `coord_capacity`; the rest are dropped.
+static u32 frustumCull(
+    thread_pool::ThreadPool* pool,
     const Hexahedron* frustum,
-    u32fast voxel_count,
-    const gfx::Voxel* p_voxels,
-    VoxelPosAndIndex* p_voxels_out
+    f32 voxel_radius,
+    const gfx::VoxelStore* voxel_store,
+    u32 coord_capacity,
+    ivec3* p_coords_out,
+    u32* p_chunk_counts_scratch
 ) {
     ZoneScoped;
 
@@ -654,90 +1380,164 @@ static u32fast frustumCull(
     assert(glm::abs(1.f - glm::length(frustum->left_normal)) < 1e-5);
     assert(glm::abs(1.f - glm::length(frustum->right_normal)) < 1e-5);
 
-    constexpr f32 voxel_bounding_sphere_radius = 0.707106781186548f + 1e-5f; // sqrt(0.5*0.5 + 0.5*0.5)
+    const u32 chunk_count = gfx::getVoxelChunkCount(voxel_store);
+    if (chunk_count == 0) return 0;
+
+    FrustumCullContext ctx {
+        .planes = {
+            vec4(frustum->near_normal, -glm::dot(frustum->near_normal, frustum->near_bot_left_p)),
+            vec4(frustum->bot_normal, -glm::dot(frustum->bot_normal, frustum->near_bot_left_p)),
+            vec4(frustum->left_normal, -glm::dot(frustum->left_normal, frustum->near_bot_left_p)),
+            vec4(frustum->far_normal, -glm::dot(frustum->far_normal, frustum->far_top_right_p)),
+            vec4(frustum->top_normal, -glm::dot(frustum->top_normal, frustum->far_top_right_p)),
+            vec4(frustum->right_normal, -glm::dot(frustum->right_normal, frustum->far_top_right_p)),
+        },
+        .voxel_bounding_sphere_radius = voxel_radius,
+        .voxel_store = voxel_store,
+        .p_chunk_counts = p_chunk_counts_scratch,
+        .p_coords_out = NULL,
+        .coord_capacity = coord_capacity,
+    };
 
-    u32fast voxel_out_idx = 0;
-    for (u32fast voxel_idx = 0; voxel_idx < voxel_count; voxel_idx++) {
+    thread_pool::parallelFor(pool, 0, chunk_count, VOXEL_CULL_GRAIN, frustumCullChunks, &ctx);
 
-        ivec3 voxel_coord_int = p_voxels[voxel_idx].coord;
-        vec3 p = vec3(voxel_coord_int);
+    // the counts into offsets
+    u64 total_count = 0;
+    for (u32 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx++) {
+        const u32 count = p_chunk_counts_scratch[chunk_idx];
+        p_chunk_counts_scratch[chunk_idx] = (u32)math::min(total_count, (u64)coord_capacity);
+        total_count += count;
+    }
 
-        f32 signed_distance = INFINITY;
+    ctx.p_coords_out = p_coords_out;
+    thread_pool::parallelFor(pool, 0, chunk_count, VOXEL_CULL_GRAIN, frustumCullChunks, &ctx);
 
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->near_bot_left_p, frustum->near_normal));
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->near_bot_left_p, frustum->bot_normal));
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->near_bot_left_p, frustum->left_normal));
+    return (u32)math::min(total_count, (u64)coord_capacity);
+}
 
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->far_top_right_p, frustum->far_normal));
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->far_top_right_p, frustum->top_normal));
-        signed_distance = glm::min(signed_distance, glm::dot(p - frustum->far_top_right_p, frustum->right_normal));
 
-        if (signed_distance >= -voxel_bounding_sphere_radius) {
-            p_voxels_out[voxel_out_idx] = VoxelPosAndIndex {
-                .pos = voxel_coord_int,
-                .idx = (u32)voxel_idx,
-            };
-            voxel_out_idx++;
-        }
-    }
+constexpr u32fast FLUID_SIM_PARTICLE_COUNT = 100000;
+// of the sim's initial particles; INPUT_REPLAY sets it to the recording's
+u32 fluid_sim_generator_seed_ = 2039519;
 
-    return voxel_out_idx;
+/// Around anything that touches the sim or changes `fluid_sim_procs_`, in case `sim_thread_` is stepping it; they
+/// do nothing otherwise.
+static void lockFluidSim(void) {
+    if (sim_thread_ != NULL) sim_thread::lock(sim_thread_);
+}
+/// Returns false, without the lock, if the sim thread is stepping.
+[[nodiscard]] static bool tryLockFluidSim(void) {
+    return sim_thread_ == NULL or sim_thread::tryLock(sim_thread_);
+}
+static void unlockFluidSim(void) {
+    if (sim_thread_ != NULL) sim_thread::unlock(sim_thread_);
 }
 
+/// Returns false, and leaves `*p_sim` alone, if the new sim wouldn't fit in memory. Otherwise destroys `*p_sim`
+/// if `destroy_old`, and replaces it.
+[[nodiscard]] static bool initFluidSim(
+    const fluid_sim::SimParameters* params,
+    bool destroy_old,
+    fluid_sim::SimData* p_sim
+) {
 
-static fluid_sim::SimData initFluidSim(const fluid_sim::SimParameters* params) {
-
-    // OPTIMIZE if needed. This was written without much thought.
-
-    srand(2039519);
+    fluid_sim::SimMemoryUsage memory_usage {};
+    const bool fits = fluid_sim_procs_->checkMemoryUsage(
+        params, gfx::getVkContext(), FLUID_SIM_PARTICLE_COUNT, destroy_old ? p_sim : NULL, &memory_usage
+    );
+    if (!fits) return false;
+
+    if (destroy_old) fluid_sim_procs_->destroy(p_sim, gfx::getVkContext());
+
+    // The sim keeps the attribute with the particle, and the renderer reads it as the color (see
+    // `gfx::Particle`).
+    const u8vec4 color_first = u8vec4(0, 50, 255, 255);
+    const u8vec4 color_last = u8vec4(0, 200, 255, 255);
+
+    const fluid_sim::ParticleGenerator generator {
+        .shape = fluid_sim::PARTICLE_GENERATOR_BOX,
+        .box_min = vec3(-2.5f),
+        .box_max = vec3(2.5f),
+        .seed = fluid_sim_generator_seed_,
+        .attribute_first = *(const u32*)(&color_first),
+        .attribute_last = *(const u32*)(&color_last),
+    };
 
-    fluid_sim::SimData sim_data {};
-    {
-        u32fast particle_count = 100000;
+    *p_sim = fluid_sim_procs_->createFromGenerator(
+        params, gfx::getVkContext(), thread_pool_, FLUID_SIM_PARTICLE_COUNT, &generator
+    );
+    if (!voxel_collider::uploadAll(voxel_collider_, fluid_sim_procs_, p_sim, gfx::getVkContext())) {
+        LOG_F(WARNING, "The fluid sim only collides with some of the voxels.");
+    }
 
-        vec4* p_initial_particles = callocArray(particle_count, vec4);
-        defer(free(p_initial_particles));
+    // its compute shaders are reloaded along with the renderer's
+    if (shader_file_tracking_enabled_ and !fluid_sim_procs_->setShaderSourceFileModificationTracking(p_sim, true)) {
+        LOG_F(WARNING, "Not watching the fluid sim's compute shaders; they won't be reloaded.");
+    }
 
-        for (u32fast particle_idx = 0; particle_idx < particle_count; particle_idx++) {
+    // custom physics in GLSL, e.g. FLUID_SIM_BODY_ACCELERATION="return vec3(0.0f, -2.0f * pos.y, 0.0f);"
+    const char* body_acceleration = getenv("FLUID_SIM_BODY_ACCELERATION");
+    if (body_acceleration != NULL) {
+        const fluid_sim::ForceKernels kernels { .body_acceleration = body_acceleration };
+        if (!fluid_sim_procs_->setForceKernels(p_sim, gfx::getVkContext(), thread_pool_, &kernels)) {
+            LOG_F(WARNING, "The fluid sim runs without the body acceleration of FLUID_SIM_BODY_ACCELERATION.");
+        }
+    }
 
-            vec3 random_0_to_1 {
-                (f32)rand() / (f32)RAND_MAX,
-                (f32)rand() / (f32)RAND_MAX,
-                (f32)rand() / (f32)RAND_MAX,
-            };
+    if (volume_export_path_ != NULL
+        and !fluid_sim_procs_->startVolumeExport(p_sim, gfx::getVkContext(), thread_pool_, volume_export_path_)) {
+        LOG_F(WARNING, "Not exporting the fluid sim's density to `%s_*.vol`.", volume_export_path_);
+    }
+    return true;
+}
 
-            u8vec4 color = u8vec4(
-                0.f, 50.f + 150.f * ((f32)particle_idx / (f32)particle_count), 255.f,
-                255.f
-            );
+/// Rebuilds the pipelines of the fluid sim's modified compute shaders, keeping its particles.
+static void reloadModifiedFluidSimShaders(fluid_sim::SimData* p_sim) {
+    lockFluidSim();
+    fluid_sim::ShaderReloadResult reload_result = fluid_sim_procs_->reloadModifiedShaderSourceFiles(
+        p_sim, gfx::getVkContext(), thread_pool_
+    );
+    unlockFluidSim();
+    switch (reload_result) {
+        case fluid_sim::ShaderReloadResult::no_shaders_need_reloading : break;
+        case fluid_sim::ShaderReloadResult::success : last_shader_reload_failed_ = false; break;
+        case fluid_sim::ShaderReloadResult::error : last_shader_reload_failed_ = true; break;
+    }
+}
 
-            *(vec3*)(&p_initial_particles[particle_idx]) = (random_0_to_1 - 0.5f) * 5.0f;
+/// Hands `*p_sim` over to the plugin version `procs` (see `fluid_sim::migrate()`), keeping its state, and switches to
+/// it. Returns false, and keeps the current version, if that version can't adopt the sim.
+[[nodiscard]] static bool switchFluidSimPluginVersion(
+    u32fast version,
+    const FluidSimProcs* procs,
+    fluid_sim::SimData* p_sim
+) {
 
-            // TODO FIXME: This relies on the fact that the fluid simulator doesn't modify the w component;
-            // but the fluid simulator makes no such guarantee.
-            p_initial_particles[particle_idx].w = *(f32*)(&color);
-        }
+    lockFluidSim();
+    defer(unlockFluidSim());
 
-        sim_data = fluid_sim_procs_->create(
-            params,
-            gfx::getVkContext(),
-            particle_count,
-            p_initial_particles
+    if (!procs->migrate(p_sim, gfx::getVkContext(), fluid_sim::SIM_DATA_LAYOUT_VERSION, sizeof(fluid_sim::SimData))) {
+        LOG_F(
+            ERROR, "Fluid sim plugin version %" PRIuFAST32 " can't adopt the running sim; keeping version %"
+            PRIuFAST32 ". Rebuild the app if `SimData` changed.", version, fluid_sim_selected_plugin_version_
         );
+        return false;
     }
 
-    return sim_data;
+    fluid_sim_procs_ = procs;
+    fluid_sim_selected_plugin_version_ = version;
+    return true;
 }
 
-static void updateFluidSimPluginVersionAndProcs(const FluidSimProcs* new_procs) {
+static void updateFluidSimPluginVersionAndProcs(const FluidSimProcs* new_procs, fluid_sim::SimData* p_sim) {
     assert(new_procs != NULL);
 
     u32fast new_version = fluid_sim_plugin_versions_.procs.size;
     assert(new_version == plugin::getLatestVersionNumber(PluginID_FluidSim));
 
+    // listed even if it can't take over, to keep the numbering
     fluid_sim_plugin_versions_.push(new_procs);
-    fluid_sim_procs_ = new_procs;
-    fluid_sim_selected_plugin_version_ = new_version;
+    if (!switchFluidSimPluginVersion(new_version, new_procs, p_sim)) return;
 
     LOG_F(
         INFO, "Newly loaded fluid sim plugin version is %" PRIuFAST32 ".",
@@ -745,61 +1545,1025 @@ static void updateFluidSimPluginVersionAndProcs(const FluidSimProcs* new_procs)
     );
 }
 
-//
-// ImGui windows =============================================================================================
-//
+/// Writes the raw series of the last frames, oldest first, to `frametimes_<date>_<time>.csv` or `.json` in the working
+/// directory; the parts that weren't measured are empty or null. The JSON also has the percentiles of the whole
+/// histogram, and the build date, for diffing across builds. Logs an error and returns false on failure.
+static bool exportFrametimeStats(const FrametimeStats* stats, bool json) {
 
-static inline int guiGetCommonWindowFlags(void) {
-    int flags = ImGuiWindowFlags_NoFocusOnAppearing;
-    if (!cursor_visible_) flags |= ImGuiWindowFlags_NoInputs;
-    return flags;
-}
+    char filepath[64];
+    {
+        const time_t now = time(NULL);
+        tm local_time {};
+        localtime_r(&now, &local_time);
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &local_time);
+        snprintf(filepath, sizeof(filepath), "frametimes_%s.%s", timestamp, json ? "json" : "csv");
+    }
 
-static void guiWindow_camera(vec3* p_camera_pos, vec2* p_camera_angles, f32* p_camera_speed) {
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            filepath, errno, strerror(errno)
+        );
+        return false;
+    }
 
-    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
-    ImGui::Begin("Camera", NULL, window_flags);
-    defer(ImGui::End());
+    // the frame numbers count from the last reset
+    const u64 record_count = glm::min(stats->record_count, (u64)FRAMETIME_RECORD_CAPACITY);
+    const u64 first_frame = stats->record_count - record_count;
 
+    if (!json) {
+        fprintf(file, "frame");
+        for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+            fprintf(file, ",%s_ms", FRAMETIME_SERIES_NAMES[series]);
+        }
+        fprintf(file, "\n");
+
+        for (u64 frame = first_frame; frame < stats->record_count; frame++) {
+            const f32* record = stats->records_milliseconds[frame % FRAMETIME_RECORD_CAPACITY];
+            fprintf(file, "%" PRIu64, frame);
+            for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+                if (record[series] < 0.f) fprintf(file, ",");
+                else fprintf(file, ",%.4f", record[series]);
+            }
+            fprintf(file, "\n");
+        }
+    }
+    else {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+        fprintf(file, "  \"frames_in_flight\": %" PRIu32 ",\n", frames_in_flight_);
+        fprintf(file, "  \"first_frame\": %" PRIu64 ",\n", first_frame);
+
+        fprintf(file, "  \"series\": [");
+        for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+            fprintf(file, "%s\"%s\"", series == 0 ? "" : ", ", FRAMETIME_SERIES_NAMES[series]);
+        }
+        fprintf(file, "],\n");
 
-    f32 user_pos_input[3] { p_camera_pos->x, p_camera_pos->y, p_camera_pos->z };
-    if (ImGui::DragFloat3("Position", user_pos_input, 0.1f, 0.0, 0.0, "%.1f")) {
-        p_camera_pos->x = user_pos_input[0];
-        p_camera_pos->y = user_pos_input[1];
-        p_camera_pos->z = user_pos_input[2];
-    };
+        fprintf(file, "  \"percentiles_ms\": {\n");
+        for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+            fprintf(
+                file, "    \"%s\": { \"count\": %" PRIu64, FRAMETIME_SERIES_NAMES[series],
+                stats->histogram_totals[series]
+            );
+            for (u32 i = 0; i < FRAMETIME_PERCENTILE_COUNT; i++) {
+                fprintf(
+                    file, ", \"%s\": %.4f", FRAMETIME_PERCENTILE_NAMES[i],
+                    stats->percentileMilliseconds(series, FRAMETIME_PERCENTILES[i])
+                );
+            }
+            fprintf(
+                file, ", \"max\": %.4f }%s\n", stats->max_milliseconds[series],
+                series == FRAMETIME_SERIES_COUNT - 1 ? "" : ","
+            );
+        }
+        fprintf(file, "  },\n");
+
+        fprintf(file, "  \"frames_ms\": [\n");
+        for (u64 frame = first_frame; frame < stats->record_count; frame++) {
+            const f32* record = stats->records_milliseconds[frame % FRAMETIME_RECORD_CAPACITY];
+            fprintf(file, "    [");
+            for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+                if (series > 0) fprintf(file, ", ");
+                if (record[series] < 0.f) fprintf(file, "null");
+                else fprintf(file, "%.4f", record[series]);
+            }
+            fprintf(file, "]%s\n", frame == stats->record_count - 1 ? "" : ",");
+        }
+        fprintf(file, "  ]\n");
+        fprintf(file, "}\n");
+    }
 
-    ImGui::SliderAngle("Rotation X", &p_camera_angles->x, 0.0, 360.0);
-    ImGui::SliderAngle("Rotation Y", &p_camera_angles->y, -90.0, 90.0);
+    const bool write_failed = ferror(file) != 0;
+    if (fclose(file) != 0 or write_failed) {
+        LOG_F(ERROR, "Failed to write file `%s`.", filepath);
+        return false;
+    }
 
-    ImGui::DragFloat("Movement speed", p_camera_speed, 1.0f, 0.0f, FLT_MAX / (f32)INT_MAX);
+    LOG_F(INFO, "Exported the times of %" PRIu64 " frames to `%s`.", record_count, filepath);
+    return true;
 }
 
-static void guiWindow_selection(void) {
-
-    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
-    ImGui::Begin("Selection", NULL, window_flags);
-    defer(ImGui::End());
-
 
-    ImGui::Text("Selected voxels: %" PRIuFAST32, selected_voxel_index_count_);
+/// The render mode that the render benchmark measures after `mode`, or PARTICLE_RENDER_MODE_ENUM_COUNT if none is
+/// left. The mesh-shaded mode is skipped without mesh shaders, as it'd only measure its fallback under its name.
+static gfx::ParticleRenderMode nextRenderBenchmarkMode(u32 mode) {
+    for (mode++; mode < gfx::PARTICLE_RENDER_MODE_ENUM_COUNT; mode++) {
+        if (mode == gfx::PARTICLE_RENDER_MODE_MESH_SHADED and !gfx::meshShadersSupported()) continue;
+        break;
+    }
+    return (gfx::ParticleRenderMode)mode;
 }
 
-struct GuiWindowGraphicsResult {
-    bool button_pressed_reload_all_shaders;
-};
-[[nodiscard]] static GuiWindowGraphicsResult guiWindow_graphics(
-    const bool last_shader_reload_failed,
-    const bool shader_file_tracking_enabled,
-    bool* p_shader_autoreload_enabled,
-    bool* p_grid_shader_enabled,
-    const gfx::PresentModeFlags supported_present_modes,
-    gfx::PresentMode* p_selected_present_mode
-) {
-
-    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
-    ImGui::Begin("Graphics", NULL, window_flags);
-    defer(ImGui::End());
+/// Reads the camera path of the render benchmark from `path_filepath`, and creates its results file,
+/// `render_benchmark_<date>_<time>.json` in the working directory. The path is a keyframe per line,
+/// `<seconds> <x> <y> <z> <yaw> <pitch>`, with the angles in degrees, like the Camera window's, and the seconds
+/// increasing; blank lines and lines that start with '#' are skipped. `frame_count` frames per mode are spread evenly
+/// over the path's time. Logs an error and returns false on failure.
+[[nodiscard]] static bool startRenderBenchmark(RenderBenchmark* b, const char* path_filepath, u32 frame_count) {
+
+    if (frame_count == 0) {
+        LOG_F(ERROR, "The render benchmark needs at least a frame per mode.");
+        return false;
+    }
+
+    FILE* path_file = fopen(path_filepath, "r");
+    if (path_file == NULL) {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            path_filepath, errno, strerror(errno)
+        );
+        return false;
+    }
+    defer(fclose(path_file));
+
+    b->keyframe_count = 0;
+    char line[256];
+    for (u32 line_number = 1; fgets(line, sizeof(line), path_file) != NULL; line_number++) {
+        const char* p = line;
+        while (*p == ' ' or *p == '\t') p++;
+        if (*p == '#' or *p == '\n' or *p == '\r' or *p == '\0') continue;
+
+        RenderBenchmark::Keyframe keyframe {};
+        vec2 angles_degrees {};
+        const int field_count = sscanf(
+            p, "%f %f %f %f %f %f", &keyframe.seconds,
+            &keyframe.pos.x, &keyframe.pos.y, &keyframe.pos.z, &angles_degrees.x, &angles_degrees.y
+        );
+        if (field_count != 6) {
+            LOG_F(
+                ERROR, "`%s`, line %" PRIu32 ": expected `<seconds> <x> <y> <z> <yaw> <pitch>`.",
+                path_filepath, line_number
+            );
+            return false;
+        }
+        if (b->keyframe_count > 0 and !(keyframe.seconds > b->keyframes[b->keyframe_count - 1].seconds)) {
+            LOG_F(ERROR, "`%s`, line %" PRIu32 ": the keyframes' times must increase.", path_filepath, line_number);
+            return false;
+        }
+        if (b->keyframe_count == RENDER_BENCHMARK_KEYFRAME_CAPACITY) {
+            LOG_F(
+                ERROR, "`%s` has more than %" PRIu32 " keyframes.", path_filepath, RENDER_BENCHMARK_KEYFRAME_CAPACITY
+            );
+            return false;
+        }
+        keyframe.angles = glm::radians(angles_degrees);
+        b->keyframes[b->keyframe_count] = keyframe;
+        b->keyframe_count++;
+    }
+    if (b->keyframe_count == 0) {
+        LOG_F(ERROR, "`%s` has no keyframes.", path_filepath);
+        return false;
+    }
+
+    {
+        const time_t now = time(NULL);
+        tm local_time {};
+        localtime_r(&now, &local_time);
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &local_time);
+        snprintf(b->results_filepath, sizeof(b->results_filepath), "render_benchmark_%s.json", timestamp);
+    }
+    b->results_file = fopen(b->results_filepath, "w");
+    if (b->results_file == NULL) {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            b->results_filepath, errno, strerror(errno)
+        );
+        return false;
+    }
+    fprintf(b->results_file, "{\n");
+    fprintf(b->results_file, "  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+    fprintf(b->results_file, "  \"camera_path\": \"%s\",\n", path_filepath);
+    fprintf(b->results_file, "  \"keyframe_count\": %" PRIu32 ",\n", b->keyframe_count);
+    fprintf(b->results_file, "  \"frame_count\": %" PRIu32 ",\n", frame_count);
+    fprintf(b->results_file, "  \"warmup_frame_count\": %" PRIu32 ",\n", RENDER_BENCHMARK_WARMUP_FRAME_COUNT);
+    fprintf(b->results_file, "  \"modes\": [");
+
+    b->frame_count = frame_count;
+    b->p_frame_ms = mallocArray(frame_count, f32);
+    b->p_render_gpu_ms = mallocArray(frame_count, f32);
+    b->p_pass_gpu_ms = mallocArray(gfx::RENDER_PASS_ENUM_COUNT * frame_count, f32);
+    b->p_scratch = mallocArray(frame_count, f32);
+    // the first mode, which every device supports; it's called before `gfx::init()`
+    b->mode = gfx::PARTICLE_RENDER_MODE_RASTERIZED;
+    b->active = true;
+
+    LOG_F(
+        INFO, "Render benchmark: %" PRIu32 " frames per mode along the %" PRIu32 " keyframes of `%s`.",
+        frame_count, b->keyframe_count, path_filepath
+    );
+    return true;
+}
+
+/// The nearest rank, as `FrametimeStats::percentileMilliseconds()` takes it, of `p_sorted[count]`; 0 if it's empty.
+static f32 sortedPercentile(const f32* p_sorted, u32 count, f64 percentile) {
+    if (count == 0) return 0.f;
+    const u64 rank = glm::max((u64)1, (u64)ceil(percentile * (f64)count));
+    return p_sorted[glm::min(rank, (u64)count) - 1];
+}
+
+/// Writes the mean, the `FRAMETIME_PERCENTILES` and the max of `count` readings (ms), as a JSON object named
+/// `name`. Sorts a copy in `p_scratch[count]`.
+static void writeRenderBenchmarkSeries(FILE* file, const char* name, const f32* p_ms, u32 count, f32* p_scratch) {
+
+    memcpy(p_scratch, p_ms, count * sizeof(f32));
+    std::sort(p_scratch, p_scratch + count);
+
+    f64 sum = 0.0;
+    for (u32 i = 0; i < count; i++) sum += (f64)p_scratch[i];
+
+    fprintf(file, "\"%s\": { \"mean\": %.4f", name, (count > 0) ? sum / (f64)count : 0.0);
+    for (u32 i = 0; i < FRAMETIME_PERCENTILE_COUNT; i++) {
+        fprintf(
+            file, ", \"%s\": %.4f", FRAMETIME_PERCENTILE_NAMES[i],
+            sortedPercentile(p_scratch, count, FRAMETIME_PERCENTILES[i])
+        );
+    }
+    fprintf(file, ", \"max\": %.4f }", sortedPercentile(p_scratch, count, 1.0));
+}
+
+/// Writes the results of the mode that the render benchmark just measured, and logs a summary of them.
+static void finishRenderBenchmarkMode(RenderBenchmark* b) {
+
+    FILE* file = b->results_file;
+    fprintf(file, "%s\n    {\n", b->measured_mode_count == 0 ? "" : ",");
+    fprintf(file, "      \"mode\": \"%s\",\n", gfx::PARTICLE_RENDER_MODE_NAMES[b->mode]);
+    fprintf(
+        file, "      \"extent\": [%" PRIu32 ", %" PRIu32 "],\n",
+        window_draw_region_.extent.width, window_draw_region_.extent.height
+    );
+    fprintf(file, "      \"frames\": %" PRIu32 ",\n", b->frame_reading_count);
+    fprintf(file, "      \"gpu_frames\": %" PRIu32 ",\n", b->gpu_reading_count);
+    fprintf(file, "      ");
+    writeRenderBenchmarkSeries(file, "frame_ms", b->p_frame_ms, b->frame_reading_count, b->p_scratch);
+    fprintf(file, ",\n      ");
+    writeRenderBenchmarkSeries(file, "render_gpu_ms", b->p_render_gpu_ms, b->gpu_reading_count, b->p_scratch);
+    fprintf(file, ",\n      \"pass_gpu_ms\": {\n");
+    for (u32 pass = 0; pass < gfx::RENDER_PASS_ENUM_COUNT; pass++) {
+        fprintf(file, "        ");
+        writeRenderBenchmarkSeries(
+            file, gfx::RENDER_PASS_NAMES[pass], &b->p_pass_gpu_ms[pass * b->frame_count], b->gpu_reading_count,
+            b->p_scratch
+        );
+        fprintf(file, "%s\n", pass == gfx::RENDER_PASS_ENUM_COUNT - 1 ? "" : ",");
+    }
+    fprintf(file, "      }\n    }");
+
+    const u32 count = b->gpu_reading_count;
+    memcpy(b->p_scratch, b->p_render_gpu_ms, count * sizeof(f32));
+    std::sort(b->p_scratch, b->p_scratch + count);
+    LOG_F(
+        INFO, "Render benchmark, %-20s GPU frame p50 %7.3f ms, p99 %7.3f ms, max %7.3f ms (%" PRIu32 " frames).",
+        gfx::PARTICLE_RENDER_MODE_NAMES[b->mode],
+        sortedPercentile(b->p_scratch, count, 0.5), sortedPercentile(b->p_scratch, count, 0.99),
+        sortedPercentile(b->p_scratch, count, 1.0), count
+    );
+    b->measured_mode_count++;
+}
+
+/// Records the frame that was just drawn, and moves on to the next mode once this one has all its readings.
+/// `p_pass_gpu_ns` (`gfx::RENDER_PASS_ENUM_COUNT`) and `frame_gpu_ns` are the GPU times that were read this frame, of
+/// the frame as many frames in flight ago; NULL if there weren't any. Returns false once every mode is measured, after
+/// closing the results file.
+[[nodiscard]] static bool advanceRenderBenchmark(
+    RenderBenchmark* b, f32 frame_ms, const f64* p_pass_gpu_ns, f64 frame_gpu_ns
+) {
+
+    const u32 path_begin = RENDER_BENCHMARK_WARMUP_FRAME_COUNT;
+    const u32 path_end = path_begin + b->frame_count;
+    // the frames whose GPU times are read this frame were drawn this many frames ago
+    const u32 lag = frames_in_flight_;
+
+    if (path_begin <= b->mode_frame and b->mode_frame < path_end) {
+        b->p_frame_ms[b->frame_reading_count] = frame_ms;
+        b->frame_reading_count++;
+    }
+    if (p_pass_gpu_ns != NULL and path_begin + lag <= b->mode_frame and b->mode_frame < path_end + lag) {
+        const u32 i = b->gpu_reading_count;
+        b->p_render_gpu_ms[i] = (f32)(1e-6 * frame_gpu_ns);
+        for (u32 pass = 0; pass < gfx::RENDER_PASS_ENUM_COUNT; pass++) {
+            b->p_pass_gpu_ms[pass * b->frame_count + i] = (f32)(1e-6 * p_pass_gpu_ns[pass]);
+        }
+        b->gpu_reading_count++;
+    }
+
+    b->mode_frame++;
+    if (b->mode_frame < path_end + lag) return true;
+
+    finishRenderBenchmarkMode(b);
+    b->mode = nextRenderBenchmarkMode(b->mode);
+    b->mode_frame = 0;
+    b->frame_reading_count = 0;
+    b->gpu_reading_count = 0;
+    if (b->mode < gfx::PARTICLE_RENDER_MODE_ENUM_COUNT) return true;
+
+    fprintf(b->results_file, "\n  ]\n}\n");
+    const bool write_failed = ferror(b->results_file) != 0;
+    if (fclose(b->results_file) != 0 or write_failed) LOG_F(ERROR, "Failed to write file `%s`.", b->results_filepath);
+    else LOG_F(INFO, "Wrote the render benchmark's results to `%s`.", b->results_filepath);
+    b->results_file = NULL;
+    b->active = false;
+    return false;
+}
+
+
+// the longest line of an input recording, `event params <hex>`, with room to spare
+constexpr u32 INPUT_RECORDING_LINE_CAPACITY = 2 * sizeof(fluid_sim::SimParameters) + 256;
+
+/// Creates the input recording `filepath`, and writes its header up to the sim's parameters, which
+/// `writeInputRecordingParams()` writes once they're set. Logs an error and returns false on failure.
+[[nodiscard]] static bool startInputRecording(
+    InputRecording* r, const char* filepath, u64 voxel_count, const char* voxel_world_filepath
+) {
+
+    r->file = fopen(filepath, "w");
+    if (r->file == NULL) {
+        LOG_F(ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno));
+        return false;
+    }
+    snprintf(r->filepath, sizeof(r->filepath), "%s", filepath);
+
+    fprintf(r->file, "input_recording %" PRIu32 " %zu\n", INPUT_RECORDING_VERSION, sizeof(fluid_sim::SimParameters));
+    fprintf(r->file, "seed %" PRIu32 "\n", fluid_sim_generator_seed_);
+    fprintf(r->file, "voxels %" PRIu64 "\n", voxel_count);
+    fprintf(r->file, "voxel_world %s\n", (voxel_world_filepath != NULL) ? voxel_world_filepath : "");
+    r->mode = INPUT_RECORDING_MODE_RECORD;
+
+    LOG_F(INFO, "Recording the inputs to `%s`.", filepath);
+    return true;
+}
+
+/// Writes `prefix`, then the bytes of `*params` in hex, as a line.
+static void writeInputRecordingParams(FILE* file, const char* prefix, const fluid_sim::SimParameters* params) {
+    fprintf(file, "%s ", prefix);
+    const u8* p_bytes = (const u8*)params;
+    for (size_t i = 0; i < sizeof(*params); i++) fprintf(file, "%02x", p_bytes[i]);
+    fprintf(file, "\n");
+}
+
+/// Records an event before the frame being recorded, if recording: `event` is its name and arguments.
+static void recordInputEvent(InputRecording* r, const char* event) {
+    if (r->mode != INPUT_RECORDING_MODE_RECORD) return;
+    fprintf(r->file, "event %s\n", event);
+}
+
+static void recordInputParamsEvent(InputRecording* r, const fluid_sim::SimParameters* params) {
+    if (r->mode != INPUT_RECORDING_MODE_RECORD) return;
+    writeInputRecordingParams(r->file, "event params", params);
+}
+
+/// Writes the frame being recorded, whose camera angles are already set, with the rest of its inputs as the main loop
+/// has them now.
+static void recordInputFrame(InputRecording* r, GLFWwindow* window, f64 delta_t_seconds) {
+
+    // in the order of `InputRecordingKeyBits`
+    constexpr int KEYS[] {
+        GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_SPACE, GLFW_KEY_LEFT_SHIFT, GLFW_KEY_LEFT_CONTROL,
+        GLFW_KEY_LEFT_ALT, GLFW_KEY_R, GLFW_KEY_G,
+    };
+    u32 keys = 0;
+    for (u32 i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); i++) {
+        if (glfwGetKey(window, KEYS[i]) == GLFW_PRESS) keys |= 1u << i;
+    }
+    abortIfGlfwError();
+
+    InputRecording::Frame* f = &r->frame;
+    f->delta_t_seconds = delta_t_seconds;
+    f->camera_pos = camera_pos_;
+    f->cursor_pos = cursor_pos_;
+    f->keys = keys;
+    f->left_mouse_pressed = left_mouse_is_pressed_;
+    f->right_mouse_pressed = right_mouse_is_pressed_;
+    f->particle_render_mode = particle_render_mode_;
+    f->cursor_visible = cursor_visible_;
+    f->sim_paused = fluid_sim_paused_;
+
+    // enough digits for each value to read back the same
+    fprintf(
+        r->file, "frame %.17g %.9g %.9g %.9g %.9g %.9g %.17g %.17g %" PRIx32 " %" PRIx32 " %" PRIu32 " %" PRIx32 "\n",
+        f->delta_t_seconds, f->camera_pos.x, f->camera_pos.y, f->camera_pos.z, f->camera_angles.x, f->camera_angles.y,
+        f->cursor_pos.x, f->cursor_pos.y, f->keys,
+        (u32)f->left_mouse_pressed | (u32)f->right_mouse_pressed << 1,
+        (u32)f->particle_render_mode,
+        (u32)f->cursor_visible | (u32)f->sim_paused << 1
+    );
+    r->frame_count++;
+}
+
+/// Closes the input recording, and logs whether it was written.
+static void finishInputRecording(InputRecording* r) {
+    const bool write_failed = ferror(r->file) != 0;
+    if (fclose(r->file) != 0 or write_failed) LOG_F(ERROR, "Failed to write file `%s`.", r->filepath);
+    else LOG_F(INFO, "Recorded the inputs of %" PRIu32 " frames to `%s`.", r->frame_count, r->filepath);
+    r->file = NULL;
+    r->mode = INPUT_RECORDING_MODE_OFF;
+}
+
+/// Reads the replay's next line into `line`, without the line break. Returns false at the end of the file, and if the
+/// line doesn't fit, after logging an error.
+static bool readInputReplayLine(InputRecording* r, char* line, u32 line_capacity) {
+
+    if (fgets(line, (int)line_capacity, r->file) == NULL) return false;
+    r->line_number++;
+
+    const size_t length = strlen(line);
+    if (length + 1 == line_capacity and line[length - 1] != '\n' and !feof(r->file)) {
+        LOG_F(ERROR, "`%s`, line %" PRIu32 ": the line is too long.", r->filepath, r->line_number);
+        return false;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    return true;
+}
+
+/// Reads the bytes of `*p_params` from `hex`, which must be all of them in hex and nothing else; returns false, and
+/// leaves `*p_params` alone, if it isn't.
+static bool parseInputRecordingParams(const char* hex, fluid_sim::SimParameters* p_params) {
+
+    u8 p_bytes[sizeof(fluid_sim::SimParameters)];
+    if (strlen(hex) != 2 * sizeof(p_bytes)) return false;
+
+    for (size_t i = 0; i < sizeof(p_bytes); i++) {
+        u32 digits[2];
+        for (u32 d = 0; d < 2; d++) {
+            const char c = hex[2 * i + d];
+            if ('0' <= c and c <= '9') digits[d] = (u32)(c - '0');
+            else if ('a' <= c and c <= 'f') digits[d] = (u32)(c - 'a' + 10);
+            else if ('A' <= c and c <= 'F') digits[d] = (u32)(c - 'A' + 10);
+            else return false;
+        }
+        p_bytes[i] = (u8)(digits[0] << 4 | digits[1]);
+    }
+    memcpy(p_params, p_bytes, sizeof(p_bytes));
+    return true;
+}
+
+/// Opens the input recording `filepath` to replay, and reads its header up to the sim's parameters, which
+/// `readInputReplayParams()` reads: sets the seed of the sim's particles, `*p_voxel_count`, and
+/// `*p_voxel_world_filepath` (NULL if the recording's voxels were generated) to the recording's. Logs an error and
+/// returns false on failure.
+[[nodiscard]] static bool startInputReplay(
+    InputRecording* r, const char* filepath, u64* p_voxel_count, const char** p_voxel_world_filepath
+) {
+
+    r->file = fopen(filepath, "r");
+    if (r->file == NULL) {
+        LOG_F(ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno));
+        return false;
+    }
+    snprintf(r->filepath, sizeof(r->filepath), "%s", filepath);
+
+    char line[INPUT_RECORDING_LINE_CAPACITY];
+    u32 version = 0;
+    size_t params_size = 0;
+    if (
+        !readInputReplayLine(r, line, sizeof(line))
+        or sscanf(line, "input_recording %" SCNu32 " %zu", &version, &params_size) != 2
+    ) {
+        LOG_F(ERROR, "`%s` isn't an input recording.", filepath);
+        return false;
+    }
+    if (version != INPUT_RECORDING_VERSION or params_size != sizeof(fluid_sim::SimParameters)) {
+        LOG_F(
+            ERROR, "`%s` was recorded by another version of the app (format %" PRIu32 ", %zu bytes of parameters; "
+            "this one has %" PRIu32 " and %zu).", filepath, version, params_size, INPUT_RECORDING_VERSION,
+            sizeof(fluid_sim::SimParameters)
+        );
+        return false;
+    }
+
+    u32 seed = 0;
+    u64 voxel_count = 0;
+    if (
+        !readInputReplayLine(r, line, sizeof(line)) or sscanf(line, "seed %" SCNu32, &seed) != 1
+        or !readInputReplayLine(r, line, sizeof(line)) or sscanf(line, "voxels %" SCNu64, &voxel_count) != 1
+        or !readInputReplayLine(r, line, sizeof(line)) or strncmp(line, "voxel_world", 11) != 0
+    ) {
+        LOG_F(ERROR, "`%s`, line %" PRIu32 ": expected the seed, then the voxels.", filepath, r->line_number);
+        return false;
+    }
+    // the path is the rest of the line, which is empty if there's none
+    const char* voxel_world_filepath = &line[11];
+    if (*voxel_world_filepath == ' ') voxel_world_filepath++;
+    snprintf(r->voxel_world_filepath, sizeof(r->voxel_world_filepath), "%s", voxel_world_filepath);
+
+    fluid_sim_generator_seed_ = seed;
+    *p_voxel_count = voxel_count;
+    *p_voxel_world_filepath = (r->voxel_world_filepath[0] != '\0') ? r->voxel_world_filepath : NULL;
+    r->mode = INPUT_RECORDING_MODE_REPLAY;
+
+    LOG_F(INFO, "Replaying the inputs of `%s`.", filepath);
+    return true;
+}
+
+/// Reads the replay's initial sim parameters into `*p_params`. Logs an error and returns false on failure.
+[[nodiscard]] static bool readInputReplayParams(InputRecording* r, fluid_sim::SimParameters* p_params) {
+    char line[INPUT_RECORDING_LINE_CAPACITY];
+    if (
+        !readInputReplayLine(r, line, sizeof(line)) or strncmp(line, "params ", 7) != 0
+        or !parseInputRecordingParams(&line[7], p_params)
+    ) {
+        LOG_F(ERROR, "`%s`, line %" PRIu32 ": expected the sim's parameters.", r->filepath, r->line_number);
+        return false;
+    }
+    return true;
+}
+
+/// Plays the events before the replay's next frame, and reads that frame into `r->frame`, for the main loop to take
+/// its inputs from. Once there are no more frames, or a line is malformed, which is logged, keeps the last frame.
+static void playInputReplayFrame(InputRecording* r, fluid_sim::SimData* p_sim, gfx::RenderResources renderer) {
+
+    if (r->end_of_file) {
+        r->frames_past_end++;
+        return;
+    }
+
+    char line[INPUT_RECORDING_LINE_CAPACITY];
+    bool malformed = false;
+    while (true) {
+        if (!readInputReplayLine(r, line, sizeof(line))) {
+            r->end_of_file = true;
+            break;
+        }
+        if (strncmp(line, "frame ", 6) == 0) break;
+
+        u32 plugin_version = 0;
+        if (strncmp(line, "event params ", 13) == 0) {
+            if (!parseInputRecordingParams(&line[13], &fluid_sim_params_)) {
+                malformed = true;
+                break;
+            }
+            lockFluidSim();
+            fluid_sim_procs_->setParams(p_sim, &fluid_sim_params_);
+            unlockFluidSim();
+        }
+        else if (strcmp(line, "event reset") == 0) {
+            lockFluidSim();
+            if (initFluidSim(&fluid_sim_params_, true, p_sim)) fluid_sim_spatial_stats_valid_ = false;
+            else LOG_F(ERROR, "Not resetting the fluid sim, because the new one wouldn't fit in memory.");
+            unlockFluidSim();
+        }
+        else if (strcmp(line, "event plugin_reload") == 0) {
+            const FluidSimProcs* new_plugin_procs = NULL;
+            PLUGIN_RELOAD(new_plugin_procs, FluidSim);
+            if (new_plugin_procs == NULL) LOG_F(ERROR, "Failed to reload fluid sim plugin.");
+            else updateFluidSimPluginVersionAndProcs(new_plugin_procs, p_sim);
+        }
+        else if (sscanf(line, "event plugin_version %" SCNu32, &plugin_version) == 1) {
+            if (plugin_version >= fluid_sim_plugin_versions_.procs.size) {
+                LOG_F(
+                    WARNING, "The replay switches to fluid sim plugin version %" PRIu32 ", which wasn't loaded.",
+                    plugin_version
+                );
+            }
+            else if (plugin_version != fluid_sim_selected_plugin_version_) {
+                (void)switchFluidSimPluginVersion(
+                    plugin_version, fluid_sim_plugin_versions_.procs.ptr[plugin_version], p_sim
+                );
+            }
+        }
+        else if (strcmp(line, "event shader_reload") == 0) {
+            // Every shader's pipelines are rebuilt, as the ones that the recording's reload rebuilt aren't modified
+            // here; the fluid sim's are only if they are.
+            gfx::reloadAllShaders(renderer);
+            reloadModifiedFluidSimShaders(p_sim);
+        }
+        else {
+            malformed = true;
+            break;
+        }
+    }
+
+    if (!r->end_of_file and !malformed) {
+        InputRecording::Frame f {};
+        u32 mouse_buttons = 0;
+        u32 particle_render_mode = 0;
+        u32 flags = 0;
+        const int field_count = sscanf(
+            line, "frame %lf %f %f %f %f %f %lf %lf %" SCNx32 " %" SCNx32 " %" SCNu32 " %" SCNx32,
+            &f.delta_t_seconds, &f.camera_pos.x, &f.camera_pos.y, &f.camera_pos.z, &f.camera_angles.x,
+            &f.camera_angles.y, &f.cursor_pos.x, &f.cursor_pos.y, &f.keys, &mouse_buttons, &particle_render_mode,
+            &flags
+        );
+        if (field_count == 12 and particle_render_mode < gfx::PARTICLE_RENDER_MODE_ENUM_COUNT) {
+            f.left_mouse_pressed = (mouse_buttons & 1) != 0;
+            f.right_mouse_pressed = (mouse_buttons & 2) != 0;
+            f.particle_render_mode = (gfx::ParticleRenderMode)particle_render_mode;
+            f.cursor_visible = (flags & 1) != 0;
+            f.sim_paused = (flags & 2) != 0;
+            r->frame = f;
+            r->frame_count++;
+            return;
+        }
+        malformed = true;
+    }
+
+    if (malformed) {
+        LOG_F(ERROR, "`%s`, line %" PRIu32 ": malformed; ending the replay there.", r->filepath, r->line_number);
+    }
+    r->end_of_file = true;
+    r->frames_past_end = 1;
+    LOG_F(INFO, "Replayed the %" PRIu32 " frames of `%s`.", r->frame_count, r->filepath);
+}
+
+/// Writes `count` readings (ms) as a JSON array named `name`.
+static void writeInputReplayReadings(FILE* file, const char* name, const f32* p_ms, u32 count) {
+    fprintf(file, "\"%s\": [", name);
+    for (u32 i = 0; i < count; i++) fprintf(file, "%s%.4f", (i == 0) ? "" : ", ", p_ms[i]);
+    fprintf(file, "]");
+}
+
+/// Writes the replay's times to `input_replay_<date>_<time>.json` in the working directory: the statistics of each
+/// series, like the render benchmark's, and the series themselves, so that the slow frames can be found in the
+/// recording. Logs an error on failure.
+static void writeInputReplayResults(const InputRecording* r) {
+
+    char filepath[64];
+    {
+        const time_t now = time(NULL);
+        tm local_time {};
+        localtime_r(&now, &local_time);
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &local_time);
+        snprintf(filepath, sizeof(filepath), "input_replay_%s.json", timestamp);
+    }
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) {
+        LOG_F(ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno));
+        return;
+    }
+
+    const u32 max_count = glm::max(r->frame_ms.size, glm::max(r->render_gpu_ms.size, r->sim_gpu_ms.size));
+    f32* p_scratch = mallocArray(glm::max(max_count, 1u), f32);
+    defer(free(p_scratch));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+    fprintf(file, "  \"recording\": \"%s\",\n", r->filepath);
+    fprintf(
+        file, "  \"extent\": [%" PRIu32 ", %" PRIu32 "],\n",
+        window_draw_region_.extent.width, window_draw_region_.extent.height
+    );
+    fprintf(file, "  \"frames_in_flight\": %" PRIu32 ",\n", frames_in_flight_);
+    fprintf(file, "  \"frame_count\": %" PRIu32 ",\n", r->frame_count);
+    fprintf(file, "  ");
+    writeRenderBenchmarkSeries(file, "frame_ms", r->frame_ms.ptr, r->frame_ms.size, p_scratch);
+    fprintf(file, ",\n  ");
+    writeRenderBenchmarkSeries(file, "render_gpu_ms", r->render_gpu_ms.ptr, r->render_gpu_ms.size, p_scratch);
+    fprintf(file, ",\n  ");
+    writeRenderBenchmarkSeries(file, "sim_gpu_ms", r->sim_gpu_ms.ptr, r->sim_gpu_ms.size, p_scratch);
+    // by frame of the recording; the GPU's as they were read, each of a frame `frames_in_flight` before
+    fprintf(file, ",\n  \"series\": {\n    ");
+    writeInputReplayReadings(file, "frame_ms", r->frame_ms.ptr, r->frame_ms.size);
+    fprintf(file, ",\n    ");
+    writeInputReplayReadings(file, "render_gpu_ms", r->render_gpu_ms.ptr, r->render_gpu_ms.size);
+    fprintf(file, ",\n    ");
+    writeInputReplayReadings(file, "sim_gpu_ms", r->sim_gpu_ms.ptr, r->sim_gpu_ms.size);
+    fprintf(file, "\n  }\n}\n");
+
+    const bool write_failed = ferror(file) != 0;
+    if (fclose(file) != 0 or write_failed) LOG_F(ERROR, "Failed to write file `%s`.", filepath);
+    else LOG_F(INFO, "Wrote the input replay's times to `%s`.", filepath);
+}
+
+/// Records the times of the frame that was just replayed. `render_gpu_ms` and `sim_gpu_ms` are the GPU times that
+/// were read this frame, of an earlier frame; negative if there weren't any. Returns false once the GPU times of the
+/// replay's last frame have arrived, after closing the recording and writing the results.
+[[nodiscard]] static bool advanceInputReplay(InputRecording* r, f32 frame_ms, f32 render_gpu_ms, f32 sim_gpu_ms) {
+
+    if (!r->end_of_file) r->frame_ms.push(frame_ms);
+    if (render_gpu_ms >= 0.f) r->render_gpu_ms.push(render_gpu_ms);
+    if (sim_gpu_ms >= 0.f) r->sim_gpu_ms.push(sim_gpu_ms);
+
+    // the frames whose GPU times are read this frame were drawn this many frames ago
+    if (!r->end_of_file or r->frames_past_end < frames_in_flight_) return true;
+
+    fclose(r->file);
+    r->file = NULL;
+    writeInputReplayResults(r);
+    r->mode = INPUT_RECORDING_MODE_OFF;
+    return false;
+}
+
+
+/// Writes the watchdog's history up to and including the slow frame, oldest first, with the sim's statistics at the
+/// time, to `slow_frame_<date>_<time>.json` in the working directory; the parts that weren't measured are null.
+/// Logs an error and returns false on failure.
+static bool writeSlowFrameCapture(
+    const SlowFrameWatchdog* watchdog, f32 median_ms, const fluid_sim::SpatialStructureStats* sim_stats,
+    u32 substep_count
+) {
+    char filepath[64];
+    {
+        const time_t now = time(NULL);
+        tm local_time {};
+        localtime_r(&now, &local_time);
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &local_time);
+        snprintf(filepath, sizeof(filepath), "slow_frame_%s.json", timestamp);
+    }
+
+    FILE* file = fopen(filepath, "w");
+    if (file == NULL) {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            filepath, errno, strerror(errno)
+        );
+        return false;
+    }
+
+    const u64 record_count = glm::min(watchdog->record_count, (u64)SLOW_FRAME_HISTORY_CAPACITY);
+    const SlowFrameWatchdog::Record* slow_record =
+        &watchdog->records[(watchdog->record_count - 1) % SLOW_FRAME_HISTORY_CAPACITY];
+
+    const auto writeMilliseconds = [&](const char* name, const f32* milliseconds, const char* const* names, u32 count)
+    {
+        fprintf(file, "\"%s\": {", name);
+        for (u32 i = 0; i < count; i++) {
+            fprintf(file, "%s\"%s\": ", i == 0 ? " " : ", ", names[i]);
+            if (milliseconds[i] < 0.f) fprintf(file, "null");
+            else fprintf(file, "%.4f", milliseconds[i]);
+        }
+        fprintf(file, " }");
+    };
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+    fprintf(file, "  \"frames_in_flight\": %" PRIu32 ",\n", frames_in_flight_);
+    fprintf(file, "  \"frame_ms\": %.4f,\n", slow_record->milliseconds[FRAMETIME_SERIES_FRAME]);
+    fprintf(file, "  \"median_frame_ms\": %.4f,\n", median_ms);
+    fprintf(file, "  \"spike_factor\": %.2f,\n", watchdog->spike_factor);
+
+    fprintf(file, "  \"sim\": {\n");
+    fprintf(file, "    \"particle_count\": %" PRIu32 ",\n", sim_stats->particle_count);
+    fprintf(file, "    \"substep_count\": %" PRIu32 ",\n", substep_count);
+    fprintf(file, "    \"cell_count\": %" PRIu32 ",\n", sim_stats->cell_count);
+    fprintf(file, "    \"cell_occupancy_mean\": %.4f,\n", sim_stats->cell_occupancy_mean);
+    fprintf(file, "    \"cell_occupancy_max\": %" PRIu32 ",\n", sim_stats->cell_occupancy_max);
+    fprintf(file, "    \"hash_table_size\": %" PRIu32 ",\n", sim_stats->hash_table_size);
+    fprintf(file, "    \"open_addressing\": %s,\n", sim_stats->open_addressing ? "true" : "false");
+    fprintf(file, "    \"dense_grid\": %s,\n", sim_stats->dense_grid ? "true" : "false");
+    fprintf(file, "    \"hash_chain_length_mean\": %.4f,\n", sim_stats->hash_chain_length_mean);
+    fprintf(file, "    \"hash_chain_length_max\": %" PRIu32 ",\n", sim_stats->hash_chain_length_max);
+    fprintf(file, "    \"hash_chain_length_histogram\": [");
+    for (u32 i = 0; i < fluid_sim::SPATIAL_STATS_HISTOGRAM_BIN_COUNT; i++) {
+        fprintf(file, "%s%" PRIu32, i == 0 ? "" : ", ", sim_stats->hash_chain_length_histogram[i]);
+    }
+    fprintf(file, "]\n");
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"frames\": [\n");
+    for (u64 i = watchdog->record_count - record_count; i < watchdog->record_count; i++) {
+        const SlowFrameWatchdog::Record* record = &watchdog->records[i % SLOW_FRAME_HISTORY_CAPACITY];
+
+        fprintf(file, "    { ");
+        writeMilliseconds("ms", record->milliseconds, FRAMETIME_SERIES_NAMES, FRAMETIME_SERIES_COUNT);
+        fprintf(file, ", ");
+        writeMilliseconds(
+            "sim_gpu_ms", record->sim_stage_gpu_milliseconds, fluid_sim::SIM_STAGE_NAMES, fluid_sim::SIM_STAGE_COUNT
+        );
+        fprintf(file, ", ");
+        writeMilliseconds(
+            "render_gpu_ms", record->render_pass_gpu_milliseconds, gfx::RENDER_PASS_NAMES,
+            gfx::RENDER_PASS_ENUM_COUNT
+        );
+        fprintf(
+            file, ", \"thread_pool\": { \"wakes\": %" PRIu64 ", \"wake_latency_ns\": %" PRIu64
+            ", \"queued\": %" PRIu32 " } }%s\n",
+            record->thread_pool_wake_count, record->thread_pool_wake_latency_ns, record->thread_pool_queued_count,
+            i == watchdog->record_count - 1 ? "" : ","
+        );
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    const bool write_failed = ferror(file) != 0;
+    if (fclose(file) != 0 or write_failed) {
+        LOG_F(ERROR, "Failed to write file `%s`.", filepath);
+        return false;
+    }
+
+    LOG_F(
+        INFO, "Frame took %.2f ms, %.1fx the median; wrote the last %" PRIu64 " frames to `%s`.",
+        slow_record->milliseconds[FRAMETIME_SERIES_FRAME],
+        slow_record->milliseconds[FRAMETIME_SERIES_FRAME] / median_ms, record_count, filepath
+    );
+    return true;
+}
+
+/// Per frame, over the `frame_count` frames since the total was `previous`; a total that went down, e.g. of a new
+/// sim, restarted from 0.
+static f64 getPerFrame(u64 total, u64 previous, u64 frame_count) {
+    return (f64)((total >= previous) ? total - previous : total) / (f64)frame_count;
+}
+
+
+/// Updates the rates once `TRANSFER_RATE_INTERVAL_SECONDS` have passed since the last update.
+static void updateTransferRates(
+    TransferRates* rates,
+    const fluid_sim::TransferStats* sim_totals,
+    const gfx::TransferStats* render_totals,
+    u64 frame,
+    f64 time_seconds
+) {
+    if (time_seconds - rates->previous_time_seconds < TRANSFER_RATE_INTERVAL_SECONDS) return;
+
+    if (frame > rates->previous_frame) {
+        const u64 frame_count = frame - rates->previous_frame;
+
+        const fluid_sim::TransferStats* sim_previous = &rates->previous_sim_totals;
+        for (u32 i = 0; i < fluid_sim::TRANSFER_CATEGORY_COUNT; i++) {
+            rates->sim_upload_bytes[i] =
+                getPerFrame(sim_totals->upload_byte_counts[i], sim_previous->upload_byte_counts[i], frame_count);
+            rates->sim_uploads[i] =
+                getPerFrame(sim_totals->upload_counts[i], sim_previous->upload_counts[i], frame_count);
+            rates->sim_download_bytes[i] =
+                getPerFrame(sim_totals->download_byte_counts[i], sim_previous->download_byte_counts[i], frame_count);
+            rates->sim_downloads[i] =
+                getPerFrame(sim_totals->download_counts[i], sim_previous->download_counts[i], frame_count);
+        }
+
+        const gfx::TransferStats* render_previous = &rates->previous_render_totals;
+        for (u32 i = 0; i < gfx::RENDER_TRANSFER_ENUM_COUNT; i++) {
+            rates->render_upload_bytes[i] =
+                getPerFrame(render_totals->upload_byte_counts[i], render_previous->upload_byte_counts[i], frame_count);
+            rates->render_uploads[i] =
+                getPerFrame(render_totals->upload_counts[i], render_previous->upload_counts[i], frame_count);
+            rates->render_download_bytes[i] = getPerFrame(
+                render_totals->download_byte_counts[i], render_previous->download_byte_counts[i], frame_count
+            );
+            rates->render_downloads[i] =
+                getPerFrame(render_totals->download_counts[i], render_previous->download_counts[i], frame_count);
+        }
+    }
+
+    rates->previous_sim_totals = *sim_totals;
+    rates->previous_render_totals = *render_totals;
+    rates->previous_frame = frame;
+    rates->previous_time_seconds = time_seconds;
+}
+
+//
+// frame stages ==============================================================================================
+//
+
+// The CPU stages of a frame that run as a `thread_pool::TaskGraph`, so that the independent ones overlap; e.g.
+// voxel culling and picking run while the fluid sim steps, which sorts on the pool in the CPU backend.
+// The stages don't touch GLFW or ImGui, which are only for the main thread.
+struct FrameStages {
+    fluid_sim::SimData* p_sim_data;
+    f32 delta_t;
+
+    Hexahedron selection_frustum;
+    vec3 ray_origin;
+    vec3 ray_direction_unit;
+
+    // output
+    bool looking_at_voxel;
+    ivec3 voxel_being_looked_at;
+    // negative if the stage didn't run; see `FrametimeSeries`
+    f64 sim_host_seconds;
+    f64 cull_seconds;
+};
+
+static void frameStage_advanceFluidSim(void* p_stages) {
+    FrameStages* stages = (FrameStages*)p_stages;
+
+    if (!fluid_sim_paused_) {
+        const f64 start_time = glfwGetTime();
+        // TODO FIXME:
+        //     This if-statement a hack to handle lag spikes.
+        //     This assumes that any dt over an 8th of a second is an anomaly.
+        //     If the dt is consistently that large, this will just freeze the sim, which is bad.
+        // if (delta_t_seconds > (1.0 / 8.0)) {
+        //     LOG_F(WARNING, "Lag spike detected; not advancing fluid sim for this frame. This is a hack and you should find another solution.");
+        // }
+        // else {
+        ZoneScopedNFrame("fluid_sim::advance");
+        fluid_sim_procs_->advance(
+            stages->p_sim_data,
+            gfx::getVkContext(),
+            thread_pool_,
+            stages->delta_t,
+            render_finished_semaphore_will_be_signalled_ ? render_finished_semaphore_ : VK_NULL_HANDLE,
+            sim_finished_semaphore_
+        );
+        render_finished_semaphore_will_be_signalled_ = false;
+        sim_finished_semaphore_will_be_signalled_ = true;
+        // doesn't wait for the GPU; skips the frame if the previous volumes are still being computed or written
+        fluid_sim_procs_->exportVolume(stages->p_sim_data, gfx::getVkContext());
+        stages->sim_host_seconds = glfwGetTime() - start_time;
+        // }
+    }
+    else if (render_finished_semaphore_will_be_signalled_) {
+        clearSemaphore(gfx::getVkContext(), render_finished_semaphore_, general_purpose_fence_);
+        render_finished_semaphore_will_be_signalled_ = false;
+    }
+}
+
+static void frameStage_selectVoxels(void* p_stages) {
+    ZoneScopedN("Get selected voxels");
+
+    FrameStages* stages = (FrameStages*)p_stages;
+
+    const f64 start_time = glfwGetTime();
+    selected_voxel_count_ = frustumCull(
+        thread_pool_, &stages->selection_frustum, 0.f, voxel_store_, gfx::MAX_OUTLINED_VOXEL_COUNT,
+        p_selected_voxel_coords_, p_voxel_cull_chunk_counts_
+    );
+    stages->cull_seconds = glfwGetTime() - start_time;
+}
+
+static void frameStage_rayCast(void* p_stages) {
+    FrameStages* stages = (FrameStages*)p_stages;
+
+    stages->looking_at_voxel = rayCast(
+        voxel_store_,
+        stages->ray_origin,
+        stages->ray_direction_unit,
+        (f32)(VIEW_FRUSTUM_FAR_SIDE_DISTANCE - VIEW_FRUSTUM_NEAR_SIDE_DISTANCE),
+        &stages->voxel_being_looked_at
+    );
+}
+
+//
+// ImGui windows =============================================================================================
+//
+
+static inline int guiGetCommonWindowFlags(void) {
+    int flags = ImGuiWindowFlags_NoFocusOnAppearing;
+    if (!cursor_visible_) flags |= ImGuiWindowFlags_NoInputs;
+    return flags;
+}
+
+static void guiWindow_camera(vec3* p_camera_pos, vec2* p_camera_angles, f32* p_camera_speed) {
+
+    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
+    ImGui::Begin("Camera", NULL, window_flags);
+    defer(ImGui::End());
+
+
+    f32 user_pos_input[3] { p_camera_pos->x, p_camera_pos->y, p_camera_pos->z };
+    if (ImGui::DragFloat3("Position", user_pos_input, 0.1f, 0.0, 0.0, "%.1f")) {
+        p_camera_pos->x = user_pos_input[0];
+        p_camera_pos->y = user_pos_input[1];
+        p_camera_pos->z = user_pos_input[2];
+    };
+
+    ImGui::SliderAngle("Rotation X", &p_camera_angles->x, 0.0, 360.0);
+    ImGui::SliderAngle("Rotation Y", &p_camera_angles->y, -90.0, 90.0);
+
+    ImGui::DragFloat("Movement speed", p_camera_speed, 1.0f, 0.0f, FLT_MAX / (f32)INT_MAX);
+}
+
+static void guiWindow_selection(void) {
+
+    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
+    ImGui::Begin("Selection", NULL, window_flags);
+    defer(ImGui::End());
+
+
+    ImGui::Checkbox("Pick visible objects on the GPU", &gpu_picking_);
+    ImGui::Text("Selected voxels: %" PRIu32, selected_voxel_count_);
+    if (gpu_picking_) {
+        ImGui::Text("Selected particles: %" PRIu32, selected_particle_count_);
+        if (selection_truncated_) ImGui::TextUnformatted("(truncated)");
+    }
+}
+
+struct GuiWindowGraphicsResult {
+    bool button_pressed_reload_all_shaders;
+};
+[[nodiscard]] static GuiWindowGraphicsResult guiWindow_graphics(
+    const bool last_shader_reload_failed,
+    const bool shader_file_tracking_enabled,
+    bool* p_shader_autoreload_enabled,
+    bool* p_grid_shader_enabled,
+    bool* p_occlusion_culling_enabled,
+    bool* p_visibility_buffer_enabled,
+    gfx::ParticleRenderMode* p_particle_render_mode,
+    bool* p_particle_depth_bounds_enabled,
+    f32* p_particle_lod_threshold_pixels,
+    f32* p_particle_subsampling_budget_ms,
+    f32* p_dynamic_resolution_budget_ms,
+    gfx::TranslucentParticleSettings* p_translucent_particle_settings,
+    bool* p_velocity_field_enabled,
+    f32* p_velocity_field_scale,
+    f32* p_velocity_field_spacing_pixels,
+    bool* p_extra_views_enabled,
+    f32 render_scale,
+    f32 particle_subsample_fraction,
+    const gfx::PresentModeFlags supported_present_modes,
+    gfx::PresentMode* p_selected_present_mode,
+    u32 frames_in_flight,
+    FramePacer* p_frame_pacer
+) {
+
+    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
+    ImGui::Begin("Graphics", NULL, window_flags);
+    defer(ImGui::End());
 
 
     GuiWindowGraphicsResult ret {};
@@ -821,6 +2585,72 @@ struct GuiWindowGraphicsResult {
         }
 
         ImGui::Checkbox("Grid", p_grid_shader_enabled);
+        ImGui::Checkbox("Occlusion culling", p_occlusion_culling_enabled);
+        ImGui::BeginDisabled(!gfx::visibilityBufferSupported());
+        ImGui::Checkbox("Visibility buffer", p_visibility_buffer_enabled);
+        ImGui::EndDisabled();
+    }
+    ImGui::SeparatorText("Particles");
+    {
+        int selected_particle_render_mode = (int)*p_particle_render_mode;
+        for (int mode = 0; mode < gfx::PARTICLE_RENDER_MODE_ENUM_COUNT; mode++) {
+            // the surface mesh samples the density through the sim's grid, and the density volume walks its cell
+            // list, which the CPU backend doesn't have
+            ImGui::BeginDisabled(
+                (mode == gfx::PARTICLE_RENDER_MODE_MESH_SHADED and !gfx::meshShadersSupported()) or
+                (mode == gfx::PARTICLE_RENDER_MODE_SURFACE_MESH and fluid_sim_params_.cpu_backend) or
+                (mode == gfx::PARTICLE_RENDER_MODE_DENSITY_VOLUME and fluid_sim_params_.cpu_backend)
+            );
+            ImGui::RadioButton(gfx::PARTICLE_RENDER_MODE_NAMES[mode], &selected_particle_render_mode, mode);
+            ImGui::EndDisabled();
+        }
+        *p_particle_render_mode = (gfx::ParticleRenderMode)selected_particle_render_mode;
+
+        // the LOD walks the sim's cell list, which the CPU backend doesn't have
+        ImGui::BeginDisabled(
+            *p_particle_render_mode != gfx::PARTICLE_RENDER_MODE_RASTERIZED or fluid_sim_params_.cpu_backend
+        );
+        ImGui::SliderFloat("LOD threshold (px)", p_particle_lod_threshold_pixels, 0.f, 16.f, "%.1f");
+        ImGui::EndDisabled();
+
+        // draws a stable subset of the particles when the LOD is off; 0 is off
+        ImGui::BeginDisabled(*p_particle_render_mode != gfx::PARTICLE_RENDER_MODE_RASTERIZED);
+        ImGui::SliderFloat("Subsampling budget (ms)", p_particle_subsampling_budget_ms, 0.f, 33.3f, "%.1f");
+        ImGui::Text("Particles drawn: %.0f%%", 100.f * particle_subsample_fraction);
+        ImGui::EndDisabled();
+
+        ImGui::BeginDisabled(*p_particle_render_mode != gfx::PARTICLE_RENDER_MODE_RAY_MARCHED_TILED);
+        ImGui::Checkbox("Tile depth bounds", p_particle_depth_bounds_enabled);
+        ImGui::EndDisabled();
+
+        ImGui::BeginDisabled(*p_particle_render_mode != gfx::PARTICLE_RENDER_MODE_TRANSLUCENT);
+        ImGui::SliderFloat("Opacity", &p_translucent_particle_settings->opacity, 0.01f, 1.f, "%.2f");
+        // the camera movement, and the frames, that a depth sort is reused for
+        ImGui::SliderFloat(
+            "Resort distance (radii)", &p_translucent_particle_settings->resort_distance_radii, 0.f, 32.f, "%.1f"
+        );
+        int max_sort_age_frames = (int)p_translucent_particle_settings->max_sort_age_frames;
+        ImGui::SliderInt("Max sort age (frames)", &max_sort_age_frames, 0, 60);
+        p_translucent_particle_settings->max_sort_age_frames = (u32)max_sort_age_frames;
+        ImGui::EndDisabled();
+
+        // scales the ray-marched particles and the fluid surface; 0 is off
+        ImGui::SliderFloat("GPU budget (ms)", p_dynamic_resolution_budget_ms, 0.f, 33.3f, "%.1f");
+        ImGui::Text("Render scale: %.2f", render_scale);
+    }
+    ImGui::SeparatorText("Velocities");
+    {
+        // the CPU backend's velocities are on the host, and the sim thread's snapshots don't carry them
+        ImGui::BeginDisabled(fluid_sim_params_.cpu_backend or sim_thread_ != NULL);
+        ImGui::Checkbox("Draw velocities", p_velocity_field_enabled);
+        ImGui::SliderFloat("Scale (s)", p_velocity_field_scale, 0.f, 0.5f, "%.3f");
+        // 0 draws every particle's
+        ImGui::SliderFloat("Spacing (px)", p_velocity_field_spacing_pixels, 0.f, 64.f, "%.0f");
+        ImGui::EndDisabled();
+    }
+    ImGui::SeparatorText("Views");
+    {
+        ImGui::Checkbox("Top and side views", p_extra_views_enabled);
     }
     ImGui::SeparatorText("Present mode");
     {
@@ -846,23 +2676,66 @@ struct GuiWindowGraphicsResult {
         }
         *p_selected_present_mode = (gfx::PresentMode)selected_present_mode;
     }
+    ImGui::SeparatorText("Frame pacing");
+    {
+        ImGui::Text("Frames in flight: %" PRIu32 " (FRAMES_IN_FLIGHT)", frames_in_flight);
+
+        ImGui::BeginDisabled(!gfx::presentWaitSupported());
+        ImGui::Checkbox(
+            gfx::presentWaitSupported() ? "Low latency (wait for present)" : "Low latency (unavailable)",
+            &p_frame_pacer->low_latency
+        );
+        ImGui::EndDisabled();
+
+        ImGui::BeginDisabled(*p_selected_present_mode == gfx::PRESENT_MODE_FIFO or p_frame_pacer->low_latency);
+        ImGui::Checkbox("Delay input sampling", &p_frame_pacer->enabled);
+        ImGui::EndDisabled();
+
+        ImGui::Text(
+            "CPU %.2f ms, GPU %.2f ms, delay %.2f ms",
+            1e3 * p_frame_pacer->cpu_frame_seconds,
+            1e3 * p_frame_pacer->gpu_frame_seconds,
+            1e3 * p_frame_pacer->delay_seconds
+        );
+    }
 
     return ret;
 }
 
-static void guiWindow_performance(
+struct GuiWindowPerformanceResult {
+    bool button_pressed_reset_frametime_stats;
+    bool button_pressed_export_csv;
+    bool button_pressed_export_json;
+};
+[[nodiscard]] static GuiWindowPerformanceResult guiWindow_performance(
     const char* axis_label,
     const FrametimePlot* frametime_plot_data,
-    bool* p_plot_paused
+    const GpuTimePlot* gpu_time_plot_data,
+    const FrametimeStats* p_frametime_stats,
+    SlowFrameWatchdog* p_slow_frame_watchdog,
+    bool* p_plot_paused,
+    u64 sim_uploaded_byte_count,
+    const TransferRates* p_transfer_rates,
+    const FramePacer* p_frame_pacer,
+    thread_pool::ThreadPool* thread_pool,
+    const f32* p_thread_busy_fractions
 ) {
 
     int window_flags = guiGetCommonWindowFlags();
     ImGui::Begin("Performance", NULL, window_flags);
     defer(ImGui::End());
 
+
+    GuiWindowPerformanceResult ret {};
+
     ImGui::Checkbox("Pause plot", p_plot_paused);
+    ImGui::Text("Sim host->GPU upload: %" PRIu64 " B/frame", sim_uploaded_byte_count);
+    if (p_frame_pacer->low_latency and p_frame_pacer->input_to_photon_seconds > 0.0) {
+        ImGui::Text("Input to photon (estimate): %.2f ms", 1e3 * p_frame_pacer->input_to_photon_seconds);
+    }
+    else ImGui::Text("Input to photon (estimate): n/a (low latency mode only)");
 
-    if (ImPlot::BeginPlot(axis_label, ImVec2(-1,-1))) {
+    if (ImPlot::BeginPlot(axis_label, ImVec2(-1, 0.5f * ImGui::GetContentRegionAvail().y))) {
         defer(ImPlot::EndPlot());
 
         ImPlot::SetupAxis(ImAxis_X1, NULL, ImPlotAxisFlags_Lock);
@@ -893,6 +2766,259 @@ static void guiWindow_performance(
             (int)frametime_plot_data->first_sample_index // offset
         );
     }
+
+    if (ImPlot::BeginPlot("GPU time per pass (ms)", ImVec2(-1, 0.5f * ImGui::GetContentRegionAvail().y))) {
+        defer(ImPlot::EndPlot());
+
+        ImPlot::SetupAxis(ImAxis_X1, NULL, ImPlotAxisFlags_Lock);
+        ImPlot::SetupAxisLimits(ImAxis_X1, -FRAMETIME_PLOT_DISPLAY_DOMAIN_SECONDS, 0.0);
+        ImPlot::SetupAxisFormat(ImAxis_X1, "%.0fs");
+
+        ImPlot::SetupAxis(ImAxis_Y1, NULL, ImPlotAxisFlags_LockMin);
+        ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0, 1.0);
+
+        for (u32fast series = 0; series < GPUTIMEPLOT_SERIES_COUNT; series++) {
+
+            char label[64];
+            if (series < fluid_sim::SIM_STAGE_COUNT) {
+                snprintf(label, sizeof(label), "sim: %s", fluid_sim::SIM_STAGE_NAMES[series]);
+            }
+            else {
+                const u32fast pass = series - fluid_sim::SIM_STAGE_COUNT;
+                snprintf(label, sizeof(label), "render: %s", gfx::RENDER_PASS_NAMES[pass]);
+            }
+
+            ImPlot::PlotLine<f32>(
+                label,
+                (const f32*)&gpu_time_plot_data->samples_milliseconds[series],
+                (int)gpu_time_plot_data->sample_count,
+                FRAMETIME_PLOT_SAMPLE_INTERVAL_SECONDS, // xscale
+                -FRAMETIME_PLOT_DISPLAY_DOMAIN_SECONDS, // xstart
+                ImPlotLineFlags_None, // flags
+                (int)gpu_time_plot_data->first_sample_index // offset
+            );
+        }
+    }
+
+    ImGui::SeparatorText("Frame time percentiles");
+    {
+        ImGui::Text(
+            "Over %" PRIu64 " frames; the last %" PRIu64 " are exported.",
+            p_frametime_stats->histogram_totals[FRAMETIME_SERIES_FRAME],
+            glm::min(p_frametime_stats->record_count, (u64)FRAMETIME_RECORD_CAPACITY)
+        );
+        ret.button_pressed_reset_frametime_stats = ImGui::Button("Reset");
+        ImGui::SameLine();
+        ret.button_pressed_export_csv = ImGui::Button("Export CSV");
+        ImGui::SameLine();
+        ret.button_pressed_export_json = ImGui::Button("Export JSON");
+
+        ImGui::Checkbox("Capture slow frames", &p_slow_frame_watchdog->enabled);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip(
+                "Writes the last %u frames to slow_frame_<time>.json when one takes longer than the factor\n"
+                "times their median.",
+                SLOW_FRAME_HISTORY_CAPACITY
+            );
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(0.3f * ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("factor", &p_slow_frame_watchdog->spike_factor, 1.5f, 10.f, "%.1f");
+        ImGui::SameLine();
+        ImGui::Text("captured: %" PRIu32, p_slow_frame_watchdog->capture_count);
+
+        if (ImGui::BeginTable("frametime_percentiles", 2 + FRAMETIME_PERCENTILE_COUNT, ImGuiTableFlags_Borders)) {
+            defer(ImGui::EndTable());
+
+            ImGui::TableSetupColumn("ms");
+            for (u32 i = 0; i < FRAMETIME_PERCENTILE_COUNT; i++) ImGui::TableSetupColumn(FRAMETIME_PERCENTILE_NAMES[i]);
+            ImGui::TableSetupColumn("max");
+            ImGui::TableHeadersRow();
+
+            for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(FRAMETIME_SERIES_NAMES[series]);
+                for (u32 i = 0; i < FRAMETIME_PERCENTILE_COUNT; i++) {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", p_frametime_stats->percentileMilliseconds(series, FRAMETIME_PERCENTILES[i]));
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", p_frametime_stats->max_milliseconds[series]);
+            }
+        }
+
+        // The frame time by percentile, with each nine of the percentile as wide as the last, as HdrHistogram
+        // plots it; so the tail, where the stutter is, isn't squeezed into the right edge.
+        if (ImPlot::BeginPlot("Frame time by percentile (ms)", ImVec2(-1, 0.4f * ImGui::GetContentRegionAvail().y))) {
+            defer(ImPlot::EndPlot());
+
+            constexpr u32 tick_count = 5;
+            const f64 tick_values[tick_count] { 0.0, 1.0, 2.0, 3.0, 4.0 };
+            const char* const tick_labels[tick_count] { "0%", "90%", "99%", "99.9%", "99.99%" };
+            ImPlot::SetupAxis(ImAxis_X1, NULL, ImPlotAxisFlags_AutoFit);
+            ImPlot::SetupAxisTicks(ImAxis_X1, tick_values, (int)tick_count, tick_labels);
+            ImPlot::SetupAxis(ImAxis_Y1, NULL, ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_LockMin);
+
+            const u64* counts = p_frametime_stats->histogram_counts[FRAMETIME_SERIES_FRAME];
+            const u64 total = p_frametime_stats->histogram_totals[FRAMETIME_SERIES_FRAME];
+
+            // a point where each occupied bucket starts
+            f64 xs[FRAMETIME_HISTOGRAM_BUCKET_COUNT];
+            f64 ys[FRAMETIME_HISTOGRAM_BUCKET_COUNT];
+            u32 point_count = 0;
+            u64 count_below = 0;
+            for (u32 bucket = 0; bucket < FRAMETIME_HISTOGRAM_BUCKET_COUNT and total > 0; bucket++) {
+                if (counts[bucket] == 0) continue;
+                xs[point_count] = -log10(1.0 - (f64)count_below / (f64)total);
+                ys[point_count] = FrametimeStats::bucketMilliseconds(bucket);
+                point_count++;
+                count_below += counts[bucket];
+            }
+            ImPlot::PlotStairs<f64>("frame", xs, ys, (int)point_count);
+        }
+    }
+
+    ImGui::SeparatorText("Host<->GPU transfers per frame");
+    if (ImGui::BeginTable("transfers", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        defer(ImGui::EndTable());
+
+        ImGui::TableSetupColumn("");
+        ImGui::TableSetupColumn("upload");
+        ImGui::TableSetupColumn("uploads");
+        ImGui::TableSetupColumn("download");
+        ImGui::TableSetupColumn("downloads");
+        ImGui::TableHeadersRow();
+
+        const auto row = [](
+            const char* owner, const char* name, f64 upload_bytes, f64 uploads, f64 download_bytes, f64 downloads
+        ) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s %s", owner, name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f KiB", upload_bytes / 1024.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", uploads);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f KiB", download_bytes / 1024.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", downloads);
+        };
+
+        const TransferRates* r = p_transfer_rates;
+        for (u32 i = 0; i < fluid_sim::TRANSFER_CATEGORY_COUNT; i++) {
+            row(
+                "sim", fluid_sim::TRANSFER_CATEGORY_NAMES[i],
+                r->sim_upload_bytes[i], r->sim_uploads[i], r->sim_download_bytes[i], r->sim_downloads[i]
+            );
+        }
+        for (u32 i = 0; i < gfx::RENDER_TRANSFER_ENUM_COUNT; i++) {
+            row(
+                "render", gfx::RENDER_TRANSFER_NAMES[i],
+                r->render_upload_bytes[i], r->render_uploads[i], r->render_download_bytes[i], r->render_downloads[i]
+            );
+        }
+    }
+
+    ImGui::SeparatorText("Thread pool");
+    {
+        const thread_pool::Stats stats = thread_pool::getStats(thread_pool);
+        const u32 thread_count = thread_pool::getThreadCount(thread_pool);
+
+        ImGui::Text(
+            "Queued tasks: %u (max %u); contended external enqueues: %" PRIu64,
+            stats.queued_count, stats.max_queued_count, stats.external_deque_contention_count
+        );
+        ImGui::Text(
+            "Background tasks: %u queued, %u running", stats.background_queued_count, stats.background_running_count
+        );
+        ImGui::Text(
+            "Wakes: %" PRIu64 "; latency mean %.1f us, max %.1f us",
+            stats.wake_count,
+            stats.wake_count > 0 ? 1e-3 * (f64)stats.total_wake_latency_ns / (f64)stats.wake_count : 0.0,
+            1e-3 * (f64)stats.max_wake_latency_ns
+        );
+
+        if (ImPlot::BeginPlot("Busy fraction per thread", ImVec2(0.5f * ImGui::GetContentRegionAvail().x, -1))) {
+            defer(ImPlot::EndPlot());
+
+            ImPlot::SetupAxis(ImAxis_X1, NULL, ImPlotAxisFlags_AutoFit);
+            ImPlot::SetupAxis(ImAxis_Y1, NULL, ImPlotAxisFlags_Lock);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0, 1.0);
+
+            ImPlot::PlotBars<f32>("Busy", p_thread_busy_fractions, (int)thread_count);
+        }
+
+        ImGui::SameLine();
+
+        if (ImPlot::BeginPlot("Task start latency (log2 ns)", ImVec2(-1, -1))) {
+            defer(ImPlot::EndPlot());
+
+            ImPlot::SetupAxis(ImAxis_X1, NULL, ImPlotAxisFlags_AutoFit);
+            ImPlot::SetupAxis(ImAxis_Y1, NULL, ImPlotAxisFlags_AutoFit);
+
+            f64 task_counts[thread_pool::START_LATENCY_BUCKET_COUNT];
+            for (u32fast i = 0; i < thread_pool::START_LATENCY_BUCKET_COUNT; i++) {
+                task_counts[i] = (f64)stats.start_latency_histogram[i];
+            }
+            ImPlot::PlotBars<f64>("Tasks", task_counts, (int)thread_pool::START_LATENCY_BUCKET_COUNT);
+        }
+    }
+
+    return ret;
+}
+
+static void guiWindow_memory(const VmaBudget* p_heap_budgets, const fluid_sim::SimMemoryUsage* p_sim_usage) {
+
+    int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
+    ImGui::Begin("Memory", NULL, window_flags);
+    defer(ImGui::End());
+
+    constexpr f64 MIB = 1024.0 * 1024.0;
+
+    const VkPhysicalDeviceMemoryProperties* mem_props = NULL;
+    vmaGetMemoryProperties(gfx::getVkContext()->vma_allocator, &mem_props);
+
+    ImGui::SeparatorText("GPU heaps");
+    for (u32 heap_idx = 0; heap_idx < mem_props->memoryHeapCount; heap_idx++) {
+
+        const VmaBudget* budget = &p_heap_budgets[heap_idx];
+        const bool device_local = mem_props->memoryHeaps[heap_idx].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+        // `usage` is the whole process's, as reported by the driver; `allocationBytes` are VMA's
+        const f32 fraction = budget->budget > 0 ? (f32)((f64)budget->usage / (f64)budget->budget) : 0.0f;
+        char* overlay = allocSprintf(
+            "%.0lf / %.0lf MiB", (f64)budget->usage / MIB, (f64)budget->budget / MIB
+        );
+        defer(free(overlay));
+
+        ImGui::Text("Heap %" PRIu32 " (%s)", heap_idx, device_local ? "device-local" : "host");
+        ImGui::ProgressBar(fraction, ImVec2(300.0f, 0.0f), overlay);
+        ImGui::Text(
+            "Allocated by VMA: %.1lf MiB in %" PRIu32 " allocations",
+            (f64)budget->statistics.allocationBytes / MIB, budget->statistics.allocationCount
+        );
+    }
+
+    const gfx::MemoryUsage gfx_usage = gfx::getMemoryUsage();
+
+    ImGui::SeparatorText("By subsystem");
+    ImGui::Text(
+        "Sim GPU buffers: %.1lf MiB (%.1lf MiB saved by aliasing)",
+        (f64)p_sim_usage->gpu_bytes / MIB, (f64)p_sim_usage->gpu_bytes_aliased / MIB
+    );
+    ImGui::Text("Sim host arrays: %.1lf MiB", (f64)p_sim_usage->host_bytes / MIB);
+    ImGui::Text("Depth buffers: %.1lf MiB", (f64)gfx_usage.depth_buffer_bytes / MIB);
+    ImGui::Text("Fluid surface images: %.1lf MiB", (f64)gfx_usage.fluid_surface_image_bytes / MIB);
+    ImGui::Text("Scaled particle images: %.1lf MiB", (f64)gfx_usage.scaled_particle_image_bytes / MIB);
+    ImGui::Text("Object id images: %.1lf MiB", (f64)gfx_usage.object_id_image_bytes / MIB);
+    ImGui::Text("Offscreen images: %.1lf MiB", (f64)gfx_usage.offscreen_image_bytes / MIB);
+    ImGui::Text("Voxel buffer: %.1lf MiB", (f64)gfx_usage.voxel_buffer_bytes / MIB);
+    ImGui::Text("Surface mesh buffers: %.1lf MiB", (f64)gfx_usage.surface_mesh_buffer_bytes / MIB);
+    ImGui::Text("Particle depth sort buffers: %.1lf MiB", (f64)gfx_usage.particle_depth_sort_buffer_bytes / MIB);
+    ImGui::Text("Density volume buffer: %.1lf MiB", (f64)gfx_usage.density_volume_buffer_bytes / MIB);
+    ImGui::Text("Per-frame buffers (voxel staging, uniforms): %.1lf MiB", (f64)gfx_usage.frame_buffer_bytes / MIB);
 }
 
 struct GuiWindowFluidSimResult {
@@ -908,7 +3034,13 @@ struct GuiWindowFluidSimResult {
     ArrayList<FluidSimPluginVersionUiElement>* p_ui_elements,
     u32fast *const p_hidden_ui_element_count,
     u32fast *const p_selected_plugin_version,
-    fluid_sim::SimParameters* p_sim_params
+    fluid_sim::SimParameters* p_sim_params,
+    const fluid_sim::SimData::TimeStep* p_time_step,
+    const fluid_sim::SimData::Diagnostics* p_diagnostics,
+    u32fast* p_spatial_stats_interval_frames,
+    const fluid_sim::SpatialStructureStats* p_spatial_stats, // NULL if not computed yet
+    const sim_thread::Stats* p_sim_thread_stats, // NULL if the sim is stepped once per frame
+    bool* p_sim_thread_interpolation
 ) {
 
     int window_flags = guiGetCommonWindowFlags() | ImGuiWindowFlags_AlwaysAutoResize;
@@ -924,21 +3056,197 @@ struct GuiWindowFluidSimResult {
 
         ret.button_pressed_reset_state = ImGui::Button("Reset state");
     }
+    if (p_sim_thread_stats != NULL) {
+        ImGui::SeparatorText("Sim thread (SIM_THREAD)");
+
+        ImGui::Checkbox("Interpolate between steps", p_sim_thread_interpolation);
+        ImGui::Text(
+            "Steps: %" PRIu64 ", dropped %" PRIu64, p_sim_thread_stats->step_count,
+            p_sim_thread_stats->dropped_step_count
+        );
+        ImGui::Text(
+            "Snapshots: %" PRIu64 ", skipped %" PRIu64, p_sim_thread_stats->published_snapshot_count,
+            p_sim_thread_stats->skipped_snapshot_count
+        );
+    }
     ImGui::SeparatorText("Parameters");
     {
         bool params_modified = false;
 
         if (ImGui::Button("Reset params")) {
             params_modified = true;
+            const bool cpu_backend = p_sim_params->cpu_backend; // chosen at startup, for the device
+            // sized at startup, for the voxels
+            const u32 collider_brick_capacity = p_sim_params->collider_brick_capacity;
+            const f32 collider_cell_size = p_sim_params->collider_cell_size;
+            // from the environment
+            const glm::vec3 periodic_box_size = p_sim_params->periodic_box_size;
+            const glm::vec3 periodic_box_min = p_sim_params->periodic_box_min;
+            const bool adaptive_resolution = p_sim_params->adaptive_resolution;
+            const u32 flip_grid_resolution = p_sim_params->flip_grid_resolution;
             *p_sim_params = FLUID_SIM_PARAMS_DEFAULT;
+            p_sim_params->cpu_backend = cpu_backend;
+            p_sim_params->collider_brick_capacity = collider_brick_capacity;
+            p_sim_params->collider_cell_size = collider_cell_size;
+            p_sim_params->periodic_box_size = periodic_box_size;
+            p_sim_params->periodic_box_min = periodic_box_min;
+            p_sim_params->adaptive_resolution = adaptive_resolution;
+            p_sim_params->flip_grid_resolution = flip_grid_resolution;
+            p_sim_params->stage_timestamps = true; // for the Performance window
+
         }
 
         params_modified |= ImGui::DragFloat("Rest particle density", &p_sim_params->rest_particle_density, 10.0f, 1.0f, FLT_MAX / (f32)INT_MAX);
         params_modified |= ImGui::DragFloat("Rest interaction count", &p_sim_params->rest_particle_interaction_count_approx, 2.0f, 1.0f, FLT_MAX / (f32)INT_MAX);
         params_modified |= ImGui::DragFloat("Spring stiffness", &p_sim_params->spring_stiffness, 0.01f, 0.0f, FLT_MAX / (f32)INT_MAX);
+        params_modified |= ImGui::Checkbox("SPH", &p_sim_params->sph);
+        params_modified |= ImGui::DragFloat("SPH stiffness", &p_sim_params->sph_stiffness, 0.1f, 0.0f, FLT_MAX / (f32)INT_MAX);
+        params_modified |= ImGui::DragFloat("SPH viscosity", &p_sim_params->sph_viscosity, 0.01f, 0.0f, FLT_MAX / (f32)INT_MAX);
+        params_modified |= ImGui::Checkbox("PBF", &p_sim_params->pbf);
+        {
+            int pbf_iteration_count = (int)p_sim_params->pbf_iteration_count;
+            params_modified |= ImGui::DragInt("PBF iterations", &pbf_iteration_count, 0.1f, 1, 32);
+            p_sim_params->pbf_iteration_count = (u32)pbf_iteration_count;
+        }
+        params_modified |= ImGui::DragFloat("PBF relaxation", &p_sim_params->pbf_relaxation, 0.001f, 0.0f, 1.0f);
+        if (p_sim_params->flip_grid_resolution > 0) {
+            params_modified |= ImGui::Checkbox("FLIP", &p_sim_params->flip);
+            params_modified |= ImGui::SliderFloat("FLIP ratio", &p_sim_params->flip_ratio, 0.0f, 1.0f);
+            int iteration_count = (int)p_sim_params->flip_pressure_iteration_count;
+            params_modified |= ImGui::DragInt("FLIP pressure iterations", &iteration_count, 0.1f, 1, 64);
+            p_sim_params->flip_pressure_iteration_count = (u32)iteration_count;
+        }
+        if (p_sim_params->adaptive_resolution) {
+            int interval = (int)p_sim_params->adaptive_resolution_interval;
+            params_modified |= ImGui::DragInt("Adapt resolution every N steps (0: off)", &interval, 1.0f, 0, 10000);
+            p_sim_params->adaptive_resolution_interval = (u32)interval;
+
+            int max_level = (int)p_sim_params->adaptive_max_level;
+            params_modified |=
+                ImGui::SliderInt("Max particle level", &max_level, 0, (int)fluid_sim::MAX_PARTICLE_LEVEL);
+            p_sim_params->adaptive_max_level = (u32)max_level;
+
+            // of the rest neighborhood; the surface fraction may not exceed the interior one
+            params_modified |= ImGui::DragFloat(
+                "Interior mass fraction", &p_sim_params->adaptive_interior_fraction, 0.01f, 0.0f, 2.0f
+            );
+            params_modified |= ImGui::DragFloat(
+                "Surface mass fraction", &p_sim_params->adaptive_surface_fraction, 0.01f,
+                0.0f, p_sim_params->adaptive_interior_fraction
+            );
+        }
+        params_modified |= ImGui::DragFloat("Verlet skin", &p_sim_params->verlet_skin, 0.01f, 0.0f, 1.0f);
+        params_modified |= ImGui::Checkbox("Adaptive time step", &p_sim_params->adaptive_time_step);
+        params_modified |= ImGui::DragFloat("CFL number", &p_sim_params->cfl_number, 0.01f, 0.01f, 1.0f);
+        {
+            int max_substep_count = (int)p_sim_params->max_substep_count;
+            params_modified |= ImGui::DragInt("Max substeps", &max_substep_count, 0.1f, 1, 64);
+            p_sim_params->max_substep_count = (u32)max_substep_count;
+        }
+        ImGui::Text(
+            "Step: %" PRIu32 " x %.3f ms; max speed %.2f m/s, max accel %.1f m/s^2",
+            p_time_step->substep_count, 1e3f * p_time_step->substep_delta_t,
+            p_time_step->max_speed, p_time_step->max_acceleration
+        );
+        params_modified |= ImGui::Checkbox("Diagnostics", &p_sim_params->diagnostics);
+        if (p_sim_params->diagnostics and p_diagnostics->step_count > 0) {
+            ImGui::Text(
+                "Kinetic energy %.4g, momentum (%.3g, %.3g, %.3g), max density %.1f, escaped %.1f",
+                p_diagnostics->kinetic_energy,
+                p_diagnostics->momentum.x, p_diagnostics->momentum.y, p_diagnostics->momentum.z,
+                p_diagnostics->max_density, p_diagnostics->escaped_particle_count
+            );
+        }
+        params_modified |= ImGui::Checkbox("Sleeping particles", &p_sim_params->sleeping);
+        params_modified |= ImGui::DragFloat("Sleep speed", &p_sim_params->sleep_speed, 0.001f, 0.0f, FLT_MAX / (f32)INT_MAX);
+        params_modified |= ImGui::DragFloat("Sleep acceleration", &p_sim_params->sleep_acceleration, 0.01f, 0.0f, FLT_MAX / (f32)INT_MAX);
+        {
+            int sleep_step_count = (int)p_sim_params->sleep_step_count;
+            params_modified |= ImGui::DragInt("Sleep steps", &sleep_step_count, 0.2f, 1, 1000);
+            p_sim_params->sleep_step_count = (u32)sleep_step_count;
+        }
+        params_modified |= ImGui::Checkbox("GPU-resident advance", &p_sim_params->gpu_resident);
+        params_modified |= ImGui::Checkbox("Fuse Morton codes into update", &p_sim_params->fuse_morton_codes_into_update);
+        params_modified |= ImGui::Checkbox("Cell-tiled particle update", &p_sim_params->tiled_particle_update);
+        params_modified |= ImGui::Checkbox("Subgroup-shuffle particle update", &p_sim_params->subgroup_particle_update);
+        {
+            // 0 for the plain update
+            int persistent_update_workgroup_count = (int)p_sim_params->persistent_update_workgroup_count;
+            params_modified |= ImGui::DragInt(
+                "Persistent update workgroups", &persistent_update_workgroup_count, 1.0f, 0, 4096
+            );
+            p_sim_params->persistent_update_workgroup_count = (u32)persistent_update_workgroup_count;
+        }
+        params_modified |= ImGui::Checkbox("Cluster-pair spring forces (CPU)", &p_sim_params->cluster_pair_forces);
+        params_modified |= ImGui::Checkbox("Quantized neighbor positions", &p_sim_params->quantized_neighbor_positions);
+        params_modified |= ImGui::Checkbox("Morton range traversal", &p_sim_params->morton_range_traversal);
+        {
+            int cell_level_count = (int)p_sim_params->cell_level_count;
+            params_modified |= ImGui::SliderInt("Cell levels", &cell_level_count, 1, (int)fluid_sim::MAX_CELL_LEVEL_COUNT);
+            p_sim_params->cell_level_count = (u32)cell_level_count;
+
+            int sparse_cell_particle_count = (int)p_sim_params->sparse_cell_particle_count;
+            params_modified |= ImGui::DragInt("Sparse cell particles", &sparse_cell_particle_count, 0.2f, 0, 1000);
+            p_sim_params->sparse_cell_particle_count = (u32)sparse_cell_particle_count;
+        }
+        params_modified |= ImGui::Checkbox("Bake sim params into update", &p_sim_params->bake_sim_params_into_update);
+        {
+            int hash_table_resize_interval = (int)p_sim_params->hash_table_resize_interval;
+            params_modified |= ImGui::DragInt("Fit hash table every N steps (0: off)", &hash_table_resize_interval, 1.0f, 0, 10000);
+            p_sim_params->hash_table_resize_interval = (u32)hash_table_resize_interval;
+        }
 
         ret.sim_params_modified = params_modified;
     }
+    ImGui::SeparatorText("Spatial structure");
+    {
+        int interval = (int)*p_spatial_stats_interval_frames;
+        ImGui::DragInt("Update every N frames (0: off)", &interval, 1.0f, 0, 10000);
+        *p_spatial_stats_interval_frames = (u32fast)interval;
+
+        if (p_spatial_stats != NULL) {
+
+            const fluid_sim::SpatialStructureStats* stats = p_spatial_stats;
+
+            ImGui::Text("Cells: %" PRIu32 ", particles: %" PRIu32, stats->cell_count, stats->particle_count);
+            ImGui::Text(
+                "Particles per cell: mean %.2f, max %" PRIu32,
+                stats->cell_occupancy_mean, stats->cell_occupancy_max
+            );
+            ImGui::Text(
+                "%s: %" PRIu32 " %s; %s mean %.2f, max %" PRIu32,
+                stats->dense_grid ? "Dense cell grid" : stats->open_addressing ? "Open-addressing table" : "Hash table",
+                stats->hash_table_size,
+                stats->open_addressing ? "slots" : "buckets",
+                stats->open_addressing ? "probes per cell" : "reads per cell lookup",
+                stats->hash_chain_length_mean, stats->hash_chain_length_max
+            );
+            const f32 neighbor_ratio = (stats->neighbor_candidate_count_mean > 0.0f) ?
+                stats->neighbor_count_mean / stats->neighbor_candidate_count_mean : 0.0f;
+            ImGui::Text(
+                "Neighbors per particle: %.1f of %.1f candidates (%.0f%%), over %" PRIu32 " samples",
+                stats->neighbor_count_mean, stats->neighbor_candidate_count_mean, 100.0f * neighbor_ratio,
+                stats->neighbor_sample_count
+            );
+
+            constexpr u32 bin_count = fluid_sim::SPATIAL_STATS_HISTOGRAM_BIN_COUNT;
+            f32 occupancy_histogram[bin_count];
+            f32 chain_length_histogram[bin_count];
+            for (u32 bin = 0; bin < bin_count; bin++) {
+                occupancy_histogram[bin] = (f32)stats->cell_occupancy_histogram[bin];
+                chain_length_histogram[bin] = (f32)stats->hash_chain_length_histogram[bin];
+            }
+            ImGui::PlotHistogram(
+                "Cells by particle count", occupancy_histogram, (int)bin_count,
+                0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60)
+            );
+            ImGui::PlotHistogram(
+                stats->open_addressing ? "Cells by probe count" : "Buckets by chain length",
+                chain_length_histogram, (int)bin_count,
+                0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60)
+            );
+        }
+    }
     ImGui::SeparatorText("Plugin");
     {
         ImGui::Text("Last reload:");
@@ -990,35 +3298,210 @@ struct GuiWindowFluidSimResult {
     return ret;
 }
 
+static void sleepSeconds(f64 seconds) {
+    const time_t whole_seconds = (time_t)seconds;
+    const timespec duration {
+        .tv_sec = whole_seconds,
+        .tv_nsec = (long)((seconds - (f64)whole_seconds) * 1e9),
+    };
+    // if it's interrupted, it's just cut short
+    nanosleep(&duration, NULL);
+}
+
 static thread_pool::ThreadPool* createThreadPool(void)
 {
-    long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
-
-    if (processor_count < 0)
+    // one of the names accepted by `thread_pool::parseTopology()`
+    thread_pool::Topology topology = thread_pool::Topology::unpinned;
+    const char* topology_name = getenv("THREAD_POOL_TOPOLOGY");
+    if (topology_name != NULL and !thread_pool::parseTopology(topology_name, &topology))
     {
-        const int err = errno;
-        const char* err_description = strerror(err);
-        if (err_description == NULL) err_description = "(NO DESCRIPTION PROVIDED)";
-
-        LOG_F(
-            ERROR, "Failed to get processor count; (errno %i, description `%s`).",
-            err, err_description
-        );
-        processor_count = 1;
+        LOG_F(ERROR, "Unknown THREAD_POOL_TOPOLOGY `%s`; using `unpinned`.", topology_name);
     }
-    else if (processor_count == 0)
+
+    // the queue grows past this if needed
+    thread_pool::ThreadPool* thread_pool = thread_pool::create(topology, 100);
+    const u32 thread_count = thread_pool::getThreadCount(thread_pool);
+    LOG_F(INFO, "Using thread_count=%u for thread pool.", thread_count);
+
+    // the most threads that run background tasks at once; see `thread_pool::enqueueBackgroundTask()`
+    if (const char* limit_str = getenv("THREAD_POOL_BACKGROUND_THREADS"); limit_str != NULL)
     {
-        LOG_F(ERROR, "Failed to get processor count (got 0).");
-        processor_count = 1;
+        const u32 limit = (u32)strtoul(limit_str, NULL, 10);
+        if (limit >= 1 and limit <= thread_count) thread_pool::setBackgroundThreadLimit(thread_pool, limit);
+        else LOG_F(ERROR, "THREAD_POOL_BACKGROUND_THREADS must be in [1, %u]; ignoring it.", thread_count);
     }
 
-    LOG_F(INFO, "Using processor_count=%li for thread pool.", processor_count);
+    return thread_pool;
+};
+
+// The generated scene: VOXEL_COUNT voxels (this by default) at random, in a cube of this many world units across
+// around the origin.
+constexpr u64 GENERATED_VOXEL_DEFAULT_COUNT = 100'000;
+constexpr f32 GENERATED_VOXEL_REGION_SIZE = 500.0f;
+
+struct VoxelGenerationTask {
+    gfx::VoxelStore* voxel_store;
+    const char* world_filepath; // VOXEL_WORLD, to load instead of generating; can be NULL
+    const char* save_filepath; // VOXEL_WORLD_SAVE, to save the voxels to once they're loaded; can be NULL
+    u64 generated_voxel_count; // VOXEL_COUNT
+    f64 milliseconds; // how long it took
+};
 
-    // TODO FIXME max_queue_size chosen arbitrarily. Should probably make it growable so you don't have to
-    //     worry about overflowing it.
-    return thread_pool::create((u32)processor_count, 100);
+/// A layer of chunks of the generated scene, which a task fills with its share of the voxels.
+struct VoxelGenerationSlab {
+    ivec3 region_min; // of the whole scene, in voxel coordinates, inclusive
+    ivec3 region_max;
+    i32 z_min; // of the slab, in voxel coordinates, inclusive; within a single layer of chunks
+    i32 z_max;
+    u32 seed;
+    u32 voxel_count;
+    gfx::Voxel* p_voxels; // `voxel_count` of them, which the task writes grouped by chunk
 };
 
+
+// The PCG hash from Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020); the same as `pcgHash()` in
+// fluid_sim.cpp.
+static u32 pcgHash(u32 x) {
+    const u32 state = x * 747796405u + 2891336453u;
+    const u32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+
+static f32 random01(u32 seed, u32 counter) {
+    return (f32)(pcgHash(pcgHash(counter) ^ seed) >> 8u) * (1.0f / 16777216.0f);
+}
+
+
+/// Fills the slab with random voxels, colored by where they are in the scene as a whole, and then sorts them by
+/// chunk with a counting sort, so that they go into the store a chunk at a time. Each slab has its own seed, so the
+/// scene doesn't depend on the order the tasks run in.
+static void generateVoxelSlabTask(void* p_arg) {
+
+    ZoneScoped;
+
+    VoxelGenerationSlab* slab = (VoxelGenerationSlab*)p_arg;
+    if (slab->voxel_count == 0) return;
+
+    const ivec3 cell_min = ivec3(slab->region_min.x, slab->region_min.y, slab->z_min);
+    const ivec3 cell_extent = ivec3(slab->region_max.x, slab->region_max.y, slab->z_max) - cell_min + 1;
+    const ivec3 chunk_min = cell_min >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2;
+    const ivec2 chunk_extent =
+        ivec2((cell_min + cell_extent - 1) >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2) - ivec2(chunk_min) + 1;
+    const vec3 region_extent = vec3(slab->region_max - slab->region_min + 1);
+
+    gfx::Voxel* p_unsorted = mallocArray(slab->voxel_count, gfx::Voxel);
+    defer(free(p_unsorted));
+    u32* p_chunk_offsets = callocArray((u32)(chunk_extent.x * chunk_extent.y) + 1, u32);
+    defer(free(p_chunk_offsets));
+
+    for (u32 voxel_idx = 0; voxel_idx < slab->voxel_count; voxel_idx++) {
+
+        ivec3 coord;
+        for (u32 axis = 0; axis < 3; axis++) {
+            const f32 r = random01(slab->seed, 3 * voxel_idx + axis);
+            coord[axis] = cell_min[axis] + math::min((i32)(r * (f32)cell_extent[axis]), cell_extent[axis] - 1);
+        }
+        const vec3 color = vec3(coord - slab->region_min) / region_extent;
+        p_unsorted[voxel_idx] = gfx::Voxel { .coord = coord, .color = vec4(color * 255.0f, 255.0f) };
+
+        const ivec2 chunk = ivec2(coord >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2) - ivec2(chunk_min);
+        p_chunk_offsets[1 + chunk.x + chunk_extent.x * chunk.y]++;
+    }
+
+    const u32 chunk_count = (u32)(chunk_extent.x * chunk_extent.y);
+    for (u32 i = 0; i < chunk_count; i++) p_chunk_offsets[i + 1] += p_chunk_offsets[i];
+    for (u32 voxel_idx = 0; voxel_idx < slab->voxel_count; voxel_idx++) {
+        const gfx::Voxel voxel = p_unsorted[voxel_idx];
+        const ivec2 chunk = ivec2(voxel.coord >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2) - ivec2(chunk_min);
+        slab->p_voxels[p_chunk_offsets[chunk.x + chunk_extent.x * chunk.y]++] = voxel;
+    }
+}
+
+
+/// Generates the scene's voxels a layer of chunks per task, then adds them to the store a chunk at a time, which
+/// isn't thread-safe.
+static void generateVoxels(gfx::VoxelStore* voxel_store, u64 voxel_count) {
+
+    ZoneScoped;
+
+    const i32 half_extent = (i32)(0.5f * GENERATED_VOXEL_REGION_SIZE / gfx::VOXEL_DIAMETER);
+    const ivec3 region_min = ivec3(-half_extent);
+    const ivec3 region_max = ivec3(half_extent - 1);
+    alwaysAssert(voxel_count <= UINT32_MAX);
+
+    const i32 first_chunk_z = region_min.z >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2;
+    const u32 slab_count = (u32)((region_max.z >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2) - first_chunk_z + 1);
+    VoxelGenerationSlab* p_slabs = callocArray(slab_count, VoxelGenerationSlab);
+    defer(free(p_slabs));
+    gfx::Voxel* p_voxels = mallocArray(math::max(voxel_count, (u64)1), gfx::Voxel);
+    defer(free(p_voxels));
+
+    // each slab gets the share of the voxels of its share of the cells, so that the counts add up exactly
+    const u64 z_extent = (u64)(region_max.z - region_min.z + 1);
+    u64 voxels_before = 0;
+    for (u32 i = 0; i < slab_count; i++) {
+        const i32 chunk_z = first_chunk_z + (i32)i;
+        const i32 z_min = math::max(chunk_z * (i32)gfx::VOXEL_CHUNK_SIZE, region_min.z);
+        const i32 z_max = math::min((chunk_z + 1) * (i32)gfx::VOXEL_CHUNK_SIZE - 1, region_max.z);
+        const u64 voxels_through = voxel_count * (u64)(z_max - region_min.z + 1) / z_extent;
+
+        p_slabs[i] = VoxelGenerationSlab {
+            .region_min = region_min,
+            .region_max = region_max,
+            .z_min = z_min,
+            .z_max = z_max,
+            .seed = pcgHash(i),
+            .voxel_count = (u32)(voxels_through - voxels_before),
+            .p_voxels = &p_voxels[voxels_before],
+        };
+        voxels_before = voxels_through;
+    }
+
+    thread_pool::TaskGroup group {};
+    thread_pool::enqueueTasks(
+        thread_pool_, &group, slab_count, generateVoxelSlabTask, p_slabs, sizeof(VoxelGenerationSlab)
+    );
+    thread_pool::waitForGroup(thread_pool_, &group);
+
+    // the voxels of a chunk are together, as each slab is a layer of whole chunks
+    u64 run_begin = 0;
+    for (u64 voxel_idx = 1; voxel_idx <= voxel_count; voxel_idx++) {
+        const ivec3 chunk_coord = p_voxels[run_begin].coord >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2;
+        if (
+            voxel_idx < voxel_count and
+            p_voxels[voxel_idx].coord >> (i32)gfx::VOXEL_CHUNK_SIZE_LOG2 == chunk_coord
+        ) continue;
+
+        gfx::setVoxelChunk(voxel_store, chunk_coord, &p_voxels[run_begin], (u32)(voxel_idx - run_begin));
+        run_begin = voxel_idx;
+    }
+}
+
+
+/// Fills the store with the voxels of the scene, from VOXEL_WORLD or generated, on the thread pool while the main
+/// thread initializes the window and Vulkan, which don't touch the store.
+static void generateVoxelsTask(void* p_arg) {
+
+    ZoneScoped;
+
+    VoxelGenerationTask* task = (VoxelGenerationTask*)p_arg;
+    const u64 begin_ns = trace::now();
+
+    bool loaded = false;
+    if (task->world_filepath != NULL) {
+        loaded = voxel_file::load(task->world_filepath, task->voxel_store, NULL);
+        if (!loaded) LOG_F(ERROR, "Failed to load the voxel world `%s`; generating one.", task->world_filepath);
+    }
+    if (!loaded) generateVoxels(task->voxel_store, task->generated_voxel_count);
+
+    task->milliseconds = 1e-6 * (f64)(trace::now() - begin_ns);
+
+    if (task->save_filepath != NULL and !voxel_file::save(task->save_filepath, task->voxel_store)) {
+        LOG_F(ERROR, "Failed to save the voxel world to `%s`.", task->save_filepath);
+    }
+}
+
 //
 // ===========================================================================================================
 //
@@ -1027,6 +3510,8 @@ int main(int argc, char** argv) {
 
     ZoneScoped;
 
+    startup_profile_.begin();
+
     loguru::init(argc, argv);
     #ifndef NDEBUG
         LOG_F(INFO, "NDEBUG is not defined.");
@@ -1049,14 +3534,98 @@ int main(int argc, char** argv) {
 
     thread_pool_ = createThreadPool();
     alwaysAssert(thread_pool_ != NULL);
+    threadpoolplot_busy_fractions_ = callocArray(thread_pool::getThreadCount(thread_pool_), f32);
+    threadpoolplot_prev_busy_ns_ = callocArray(thread_pool::getThreadCount(thread_pool_), u64);
+    startup_profile_.endPhase("thread pool");
+
+    // The voxels don't depend on the window or on Vulkan, so they're generated meanwhile; nothing reads the store
+    // until the task is waited for, before the voxel collider is created. VOXEL_WORLD=<file> loads them instead
+    // (see voxel_file.hpp), VOXEL_WORLD_SAVE=<file> saves them once they're there, and VOXEL_COUNT sets how many
+    // are generated.
+    voxel_store_ = gfx::createVoxelStore();
+    VoxelGenerationTask voxel_generation_task {
+        .voxel_store = voxel_store_,
+        .world_filepath = getenv("VOXEL_WORLD"),
+        .save_filepath = getenv("VOXEL_WORLD_SAVE"),
+        .generated_voxel_count = GENERATED_VOXEL_DEFAULT_COUNT,
+    };
+    if (const char* voxel_count_str = getenv("VOXEL_COUNT"); voxel_count_str != NULL) {
+        voxel_generation_task.generated_voxel_count = (u64)strtoull(voxel_count_str, NULL, 10);
+    }
+    // INPUT_RECORD=<file> records the session's inputs, and INPUT_REPLAY=<file> replays a recording's, over its
+    // voxels and sim, then writes the replay's frame times and exits; see `InputRecording`.
+    const char* input_record_filepath = getenv("INPUT_RECORD");
+    if (const char* input_replay_filepath = getenv("INPUT_REPLAY"); input_replay_filepath != NULL) {
+        if (input_record_filepath != NULL) LOG_F(WARNING, "Replaying INPUT_REPLAY; ignoring INPUT_RECORD.");
+        if (!startInputReplay(
+            &input_recording_, input_replay_filepath,
+            &voxel_generation_task.generated_voxel_count, &voxel_generation_task.world_filepath
+        )) {
+            ABORT_F("Failed to start the input replay.");
+        }
+    }
+    else if (input_record_filepath != NULL) {
+        if (!startInputRecording(
+            &input_recording_, input_record_filepath,
+            voxel_generation_task.generated_voxel_count, voxel_generation_task.world_filepath
+        )) {
+            ABORT_F("Failed to start the input recording.");
+        }
+    }
+    const thread_pool::TaskId voxel_generation_task_id =
+        thread_pool::enqueueTask(thread_pool_, generateVoxelsTask, &voxel_generation_task);
 
 
     int success = glfwInit();
     assertGlfw(success);
+    startup_profile_.endPhase("glfwInit");
 
 
     const char* specific_device_request = getenv("PHYSICAL_DEVICE_NAME"); // can be NULL
-    gfx::init(APP_NAME, specific_device_request);
+    const char* sim_thread_rate_str = getenv("SIM_THREAD"); // can be NULL
+
+    // RENDER_BENCHMARK=<file> plays the camera path in the file once per particle render mode, over the sim's
+    // initial particles, or RENDER_BENCHMARK_CHECKPOINT's (see `fluid_sim::saveCheckpoint()`), which don't step;
+    // writes each mode's frame and pass times, and exits. RENDER_BENCHMARK_FRAMES sets the frames per mode. See
+    // `RenderBenchmark` and `startRenderBenchmark()`.
+    const char* render_benchmark_filepath = getenv("RENDER_BENCHMARK");
+    if (render_benchmark_filepath != NULL) {
+        u32 frame_count = RENDER_BENCHMARK_DEFAULT_FRAME_COUNT;
+        if (const char* frame_count_str = getenv("RENDER_BENCHMARK_FRAMES"); frame_count_str != NULL) {
+            frame_count = (u32)strtoul(frame_count_str, NULL, 10);
+        }
+        if (!startRenderBenchmark(&render_benchmark_, render_benchmark_filepath, frame_count)) {
+            ABORT_F("Failed to start the render benchmark.");
+        }
+        // the same frame for every mode, at whatever rate the GPU draws it
+        frame_pacer_.enabled = false;
+        frame_pacer_.low_latency = false;
+        if (sim_thread_rate_str != NULL) {
+            LOG_F(WARNING, "The render benchmark draws the sim's own particles; ignoring SIM_THREAD.");
+            sim_thread_rate_str = NULL;
+        }
+        if (input_recording_.mode != INPUT_RECORDING_MODE_OFF) {
+            LOG_F(WARNING, "The render benchmark plays its own inputs; ignoring INPUT_RECORD and INPUT_REPLAY.");
+            fclose(input_recording_.file);
+            input_recording_.mode = INPUT_RECORDING_MODE_OFF;
+        }
+    }
+    if (input_recording_.mode != INPUT_RECORDING_MODE_OFF and sim_thread_rate_str != NULL) {
+        LOG_F(WARNING, "The inputs are recorded with the sim stepped once per frame; ignoring SIM_THREAD.");
+        sim_thread_rate_str = NULL;
+    }
+    if (input_recording_.replaying()) {
+        // at whatever rate the GPU draws the frames, which doesn't change their `delta_t`
+        frame_pacer_.enabled = false;
+        frame_pacer_.low_latency = false;
+        // only the recording's reloads
+        shader_autoreload_enabled_ = false;
+        fluid_sim_plugin_autoreload_enabled_ = false;
+    }
+    // the sim thread submits to the compute queue, which the renderer doesn't
+    const bool request_async_compute_queue = getenv("ASYNC_COMPUTE") != NULL or sim_thread_rate_str != NULL;
+    gfx::init(APP_NAME, specific_device_request, request_async_compute_queue, thread_pool_);
+    startup_profile_.endPhase("gfx::init");
 
     success = gfx::setShaderSourceFileModificationTracking(true);
     shader_file_tracking_enabled_ = success;
@@ -1064,8 +3633,14 @@ int main(int argc, char** argv) {
         LOG_F(ERROR, "Failed to enable shader source file tracking.");
         shader_autoreload_enabled_ = false;
     }
+    startup_profile_.endPhase("shader source file tracking");
 
     gfx::setGridEnabled(grid_shader_enabled_);
+    gfx::setOcclusionCullingEnabled(occlusion_culling_enabled_);
+    gfx::setVisibilityBufferEnabled(visibility_buffer_enabled_);
+    gfx::setParticleDepthBoundsEnabled(particle_depth_bounds_enabled_);
+    gfx::setDynamicResolutionBudget(dynamic_resolution_budget_ms_);
+    gfx::setParticleSubsamplingBudget(particle_subsampling_budget_ms_);
 
 
     {
@@ -1106,6 +3681,7 @@ int main(int argc, char** argv) {
         result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &general_purpose_fence_);
         assertVk(result);
     }
+    startup_profile_.endPhase("fence and semaphores");
 
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // don't initialize OpenGL, because we're using Vulkan
@@ -1140,6 +3716,7 @@ int main(int argc, char** argv) {
     abortIfGlfwError();
     // TODO if current_width == current_height == 0, check if window is minimized or something; if it is, do
     // something that doesn't waste resources
+    startup_profile_.endPhase("window and surface");
 
 
     ImGuiContext* imgui_context = ImGui::CreateContext();
@@ -1159,25 +3736,23 @@ int main(int argc, char** argv) {
 
     success = gfx::initImGuiVulkanBackend();
     alwaysAssert(success);
+    startup_profile_.endPhase("ImGui");
 
 
-    voxel_count_ = 100'000;
-    p_voxels_ = mallocArray(gfx::MAX_VOXEL_COUNT, gfx::Voxel);
-    p_voxels_in_frustum_ = mallocArray(gfx::MAX_VOXEL_COUNT, typeof(*p_voxels_in_frustum_));
+    frame_arena_ = FrameArena::create(FRAME_ARENA_MAX_VOXEL_CHUNK_COUNT * sizeof(u32) + FRAME_ARENA_ALIGNMENT);
 
-    for (u32fast voxel_idx = 0; voxel_idx < voxel_count_; voxel_idx++) {
+    thread_pool::waitForTask(thread_pool_, voxel_generation_task_id);
+    startup_profile_.endPhase("wait for the voxels");
+    startup_profile_.add("voxel generation", voxel_generation_task.milliseconds, true);
 
-        vec3 random_0_to_1 {
-            (f32)rand() / (f32)RAND_MAX,
-            (f32)rand() / (f32)RAND_MAX,
-            (f32)rand() / (f32)RAND_MAX,
-        };
 
-        p_voxels_[voxel_idx] = gfx::Voxel {
-            .coord = worldspaceToIndexspaceInt((random_0_to_1 - 0.5f) * 500.0f),
-            .color = vec4(random_0_to_1 * 255.0f, 255.0f),
-        };
-    }
+    voxel_collider_ = voxel_collider::create(
+        voxel_store_, ivec3(-COLLIDER_REGION_HALF_EXTENT), ivec3(COLLIDER_REGION_HALF_EXTENT)
+    );
+    fluid_sim_params_.collider_brick_capacity =
+        2 * voxel_collider::countBricks(voxel_collider_) + COLLIDER_EXTRA_BRICK_CAPACITY;
+    fluid_sim_params_.collider_cell_size = voxel_collider::CELL_SIZE;
+    startup_profile_.endPhase("voxel collider");
 
 
     plugin::init();
@@ -1189,39 +3764,187 @@ int main(int argc, char** argv) {
     alwaysAssert(fluid_sim_procs_ != NULL);
 
     fluid_sim_plugin_versions_.push(fluid_sim_procs_);
+    startup_profile_.endPhase("fluid sim plugin load");
+
+    // for devices that can't run the sim's compute pipelines
+    if (getenv("FLUID_SIM_CPU_BACKEND") != NULL) fluid_sim_params_.cpu_backend = true;
+    // with it, to have the GPU take a share of the particle update
+    if (getenv("FLUID_SIM_HYBRID_GPU_UPDATE") != NULL) fluid_sim_params_.hybrid_gpu_update = true;
+    // "X Y Z", the size of a periodic box around the origin; see `SimParameters::periodic_box_size`
+    if (const char* box_str = getenv("FLUID_SIM_PERIODIC_BOX"); box_str != NULL) {
+        glm::vec3 size {};
+        if (sscanf(box_str, "%f %f %f", &size.x, &size.y, &size.z) != 3) ABORT_F("Invalid `FLUID_SIM_PERIODIC_BOX`.");
+        fluid_sim_params_.periodic_box_size = size;
+        fluid_sim_params_.periodic_box_min = -0.5f * size;
+    }
+    // merges the interior particles and splits the surface ones; the adaptation only runs in synchronous mode
+    if (getenv("FLUID_SIM_ADAPTIVE_RESOLUTION") != NULL) {
+        fluid_sim_params_.adaptive_resolution = true;
+        fluid_sim_params_.gpu_resident = false;
+    }
+    // the cells per axis of the FLIP grid, which turns the FLIP mode on; see `SimParameters::flip_grid_resolution`
+    if (const char* resolution_str = getenv("FLUID_SIM_FLIP_GRID_RESOLUTION"); resolution_str != NULL) {
+        fluid_sim_params_.flip_grid_resolution = (u32)strtoul(resolution_str, NULL, 10);
+        fluid_sim_params_.flip = fluid_sim_params_.flip_grid_resolution > 0;
+    }
+    // the path prefix of the density volume files, and the most bricks per file
+    volume_export_path_ = (sim_thread_rate_str == NULL) ? getenv("FLUID_SIM_VOLUME_EXPORT") : NULL;
+    if (volume_export_path_ != NULL) {
+        const char* brick_capacity_str = getenv("FLUID_SIM_VOLUME_EXPORT_BRICKS");
+        fluid_sim_params_.volume_export_brick_capacity =
+            (brick_capacity_str != NULL) ? (u32)strtoul(brick_capacity_str, NULL, 10) : 1u << 16;
+    }
+    // for the Performance window
+    fluid_sim_params_.stage_timestamps = true;
+    if (input_recording_.mode == INPUT_RECORDING_MODE_RECORD) {
+        writeInputRecordingParams(input_recording_.file, "params", &fluid_sim_params_);
+    }
+    else if (input_recording_.replaying() and !readInputReplayParams(&input_recording_, &fluid_sim_params_)) {
+        ABORT_F("Failed to start the input replay.");
+    }
+    fluid_sim::SimData sim_data {};
+    if (!initFluidSim(&fluid_sim_params_, false, &sim_data)) ABORT_F("Not enough memory for the fluid sim.");
+    if (render_benchmark_.active) {
+        fluid_sim_paused_ = true;
+        if (const char* checkpoint_filepath = getenv("RENDER_BENCHMARK_CHECKPOINT"); checkpoint_filepath != NULL) {
+            fluid_sim::SimParameters checkpoint_params {};
+            fluid_sim::SimData checkpoint_sim {};
+            if (!fluid_sim_procs_->loadCheckpoint(
+                gfx::getVkContext(), checkpoint_filepath, &checkpoint_params, &checkpoint_sim
+            )) {
+                ABORT_F("Failed to load RENDER_BENCHMARK_CHECKPOINT.");
+            }
+            fluid_sim_procs_->destroy(&sim_data, gfx::getVkContext());
+            sim_data = checkpoint_sim;
+            fluid_sim_params_ = checkpoint_params;
+        }
+    }
+    startup_profile_.endPhase("fluid sim init");
+
+    if (sim_thread_rate_str != NULL) {
+        const f64 rate_hz = strtod(sim_thread_rate_str, NULL);
+        const VulkanContext* vk_ctx = gfx::getVkContext();
+        if (!(rate_hz > 0.0)) {
+            LOG_F(ERROR, "SIM_THREAD must be the sim's step rate in Hz; stepping the sim once per frame.");
+        }
+        else if (vk_ctx->compute_queue == vk_ctx->queue) {
+            LOG_F(
+                WARNING, "SIM_THREAD needs a second queue, and the device has none; stepping the sim once per frame."
+            );
+        }
+        else {
+            // the thread's steps don't wait for the renderer
+            clearSemaphore(vk_ctx, render_finished_semaphore_, general_purpose_fence_);
+            render_finished_semaphore_will_be_signalled_ = false;
 
-    fluid_sim::SimData sim_data = initFluidSim(&fluid_sim_params_);
+            const sim_thread::CreateInfo sim_thread_info {
+                .pp_procs = &fluid_sim_procs_,
+                .p_sim = &sim_data,
+                .thread_pool = thread_pool_,
+                .step_seconds = (f32)(1.0 / rate_hz),
+                .max_steps_per_wake = SIM_THREAD_MAX_STEPS_PER_WAKE,
+            };
+            sim_thread_ = sim_thread::create(vk_ctx, &sim_thread_info);
+        }
+    }
 
 
     gfx::RenderResources gfx_renderer {};
 
     {
+        // the sim thread's blend of its snapshots, or the sim's own positions
         VkBuffer sim_vkbuffer = VK_NULL_HANDLE;
         VkDeviceSize sim_vkbuffer_size = 0;
-        fluid_sim_procs_->getPositionsVertexBuffer(&sim_data, &sim_vkbuffer, &sim_vkbuffer_size);
+        if (sim_thread_ != NULL) sim_thread::getParticlesBuffer(sim_thread_, &sim_vkbuffer, &sim_vkbuffer_size);
+        else fluid_sim_procs_->getPositionsVertexBuffer(&sim_data, &sim_vkbuffer, &sim_vkbuffer_size);
+
+        const char* frames_in_flight_str = getenv("FRAMES_IN_FLIGHT");
+        if (frames_in_flight_str != NULL) {
+            const unsigned long frames_in_flight = strtoul(frames_in_flight_str, NULL, 10);
+            if (1 <= frames_in_flight and frames_in_flight <= gfx::MAX_FRAMES_IN_FLIGHT) {
+                frames_in_flight_ = (u32)frames_in_flight;
+            }
+            else {
+                LOG_F(
+                    ERROR, "FRAMES_IN_FLIGHT must be in [1, %" PRIu32 "]; using %" PRIu32 ".",
+                    gfx::MAX_FRAMES_IN_FLIGHT, frames_in_flight_
+                );
+            }
+        }
 
-        gfx::Result result_gfx = gfx::createRenderer(&gfx_renderer, sim_vkbuffer_size, sim_vkbuffer);
+        gfx::Result result_gfx = gfx::createRenderer(
+            &gfx_renderer, sim_vkbuffer_size, sim_vkbuffer, frames_in_flight_
+        );
         assertGraphics(result_gfx);
+
+        // they don't change after this, so they're only meshed and uploaded once
+        gfx::setVoxelStore(gfx_renderer, voxel_store_);
     }
+    startup_profile_.endPhase("renderer");
 
 
     memcpy(present_mode_priorities_, DEFAULT_PRESENT_MODE_PRIORITIES, sizeof(present_mode_priorities_));
 
+    // If VIDEO_EXPORT_FILEPATH is set, the frames are rendered offscreen, at VIDEO_EXPORT_SIZE ("<width>x<height>"),
+    // and written to that file; see `video_export`. Nothing is presented to the window then.
+    fence_waiter::FenceWaiter* video_export_fence_waiter = NULL;
+    video_export::VideoExport* video_export = NULL;
+    VkExtent2D video_export_extent { .width = 1920, .height = 1080 };
+    const char* video_export_filepath = getenv("VIDEO_EXPORT_FILEPATH");
+    if (video_export_filepath != NULL) {
+        const char* size_str = getenv("VIDEO_EXPORT_SIZE");
+        if (size_str != NULL) {
+            u32 width = 0;
+            u32 height = 0;
+            if (sscanf(size_str, "%" SCNu32 "x%" SCNu32, &width, &height) == 2 and width > 0 and height > 0) {
+                video_export_extent = VkExtent2D { .width = width, .height = height };
+            }
+            else {
+                LOG_F(
+                    ERROR, "VIDEO_EXPORT_SIZE must be \"<width>x<height>\"; using %" PRIu32 "x%" PRIu32 ".",
+                    video_export_extent.width, video_export_extent.height
+                );
+            }
+        }
+    }
+
     gfx::SurfaceResources gfx_surface {};
-    gfx::Result result_gfx = gfx::createSurfaceResources(
-        vk_surface,
-        present_mode_priorities_,
-        VkExtent2D { .width = (u32)window_size_.x, .height = (u32)window_size_.y },
-        &gfx_surface,
-        &present_mode_
-    );
-    // TODO handle error_window_size_zero
-    assertGraphics(result_gfx);
+    gfx::Result result_gfx = gfx::Result::success;
+    if (video_export_filepath != NULL) {
+        constexpr u32 VIDEO_EXPORT_SLOT_COUNT = 4;
+
+        // one more than can be waiting for the copy, so that `render()` rarely waits for one
+        result_gfx = gfx::createOffscreenSurfaceResources(video_export_extent, 3, &gfx_surface);
+        assertGraphics(result_gfx);
+
+        video_export_fence_waiter = fence_waiter::create(gfx::getVkContext(), thread_pool_);
+        const video_export::CreateInfo video_export_info {
+            .filepath = video_export_filepath,
+            .extent = video_export_extent,
+            .slot_count = VIDEO_EXPORT_SLOT_COUNT,
+        };
+        video_export = video_export::create(gfx::getVkContext(), video_export_fence_waiter, &video_export_info);
+        alwaysAssert(video_export != NULL);
+
+        window_draw_region_ = VkRect2D { .offset = { 0, 0 }, .extent = video_export_extent };
+    }
+    else {
+        result_gfx = gfx::createSurfaceResources(
+            vk_surface,
+            present_mode_priorities_,
+            VkExtent2D { .width = (u32)window_size_.x, .height = (u32)window_size_.y },
+            &gfx_surface,
+            &present_mode_
+        );
+        // TODO handle error_window_size_zero
+        assertGraphics(result_gfx);
 
-    window_draw_region_ = centeredSubregion_16x9((u32)window_size_.x, (u32)window_size_.y);
+        window_draw_region_ = centeredSubregion_16x9((u32)window_size_.x, (u32)window_size_.y);
+    }
 
 
     gfx::attachSurfaceToRenderer(gfx_surface, gfx_renderer);
+    startup_profile_.endPhase("surface resources");
 
 
     checkedGlfwGetCursorPos(window, &cursor_pos_.x, &cursor_pos_.y);
@@ -1231,7 +3954,18 @@ int main(int argc, char** argv) {
     // main loop
     while (true) {
 
-        ZoneScopedN("main loop");
+        ZoneScopedNFrame("main loop");
+
+        frame_arena_.reset();
+
+        // this frame's parts, for `frametime_stats_`; negative until they're measured
+        f32 frametime_record_ms[FRAMETIME_SERIES_COUNT];
+        for (u32 series = 0; series < FRAMETIME_SERIES_COUNT; series++) frametime_record_ms[series] = -1.f;
+        // for `slow_frame_watchdog_`; negative where not measured
+        f32 sim_stage_gpu_ms[fluid_sim::SIM_STAGE_COUNT];
+        for (u32 stage = 0; stage < fluid_sim::SIM_STAGE_COUNT; stage++) sim_stage_gpu_ms[stage] = -1.f;
+        f32 render_pass_gpu_ms[gfx::RENDER_PASS_ENUM_COUNT];
+        for (u32 pass = 0; pass < gfx::RENDER_PASS_ENUM_COUNT; pass++) render_pass_gpu_ms[pass] = -1.f;
 
         f64 delta_t_seconds = 0.0;
         {
@@ -1251,37 +3985,52 @@ int main(int argc, char** argv) {
                     (f32)(time_since_last_sample / (f64)frametimeplot_frames_since_last_sample_),
                     (f32)frametimeplot_largest_reading_since_last_sample_
                 );
+                if (!frametimeplot_paused_) gputimeplot_samples_scrolling_buffer_.push();
+                for (u32 i = 0; i < thread_pool::getThreadCount(thread_pool_); i++) {
+                    // a task's time is counted when it finishes, so a long one can make this exceed 1
+                    const u64 busy_ns = thread_pool::getWorkerStats(thread_pool_, i).busy_ns;
+                    const f64 busy_seconds = 1e-9 * (f64)(busy_ns - threadpoolplot_prev_busy_ns_[i]);
+                    if (!frametimeplot_paused_) {
+                        threadpoolplot_busy_fractions_[i] = (f32)(busy_seconds / time_since_last_sample);
+                    }
+                    threadpoolplot_prev_busy_ns_[i] = busy_ns;
+                }
+                gputimeplot_samples_scrolling_buffer_.clearReadings();
                 frametimeplot_last_sample_time_ = time;
                 frametimeplot_frames_since_last_sample_ = 0;
                 frametimeplot_largest_reading_since_last_sample_ = 0.;
             }
         }
 
-        if (!fluid_sim_paused_) {
-            // TODO FIXME:
-            //     This if-statement a hack to handle lag spikes.
-            //     This assumes that any dt over an 8th of a second is an anomaly.
-            //     If the dt is consistently that large, this will just freeze the sim, which is bad.
-            // if (delta_t_seconds > (1.0 / 8.0)) {
-            //     LOG_F(WARNING, "Lag spike detected; not advancing fluid sim for this frame. This is a hack and you should find another solution.");
-            // }
-            // else {
-            ZoneScopedN("fluid_sim::advance");
-            fluid_sim_procs_->advance(
-                &sim_data,
-                gfx::getVkContext(),
-                thread_pool_,
-                (f32)delta_t_seconds,
-                render_finished_semaphore_will_be_signalled_ ? render_finished_semaphore_ : VK_NULL_HANDLE,
-                sim_finished_semaphore_
-            );
-            render_finished_semaphore_will_be_signalled_ = false;
-            sim_finished_semaphore_will_be_signalled_ = true;
-            // }
+        {
+            const VmaAllocator allocator = gfx::getVkContext()->vma_allocator;
+            vmaGetHeapBudgets(allocator, memory_heap_budgets_);
+
+            const VkPhysicalDeviceMemoryProperties* mem_props = NULL;
+            vmaGetMemoryProperties(allocator, &mem_props);
+            u64 usage_bytes = 0;
+            for (u32 i = 0; i < mem_props->memoryHeapCount; i++) usage_bytes += memory_heap_budgets_[i].usage;
+            TracyPlot("GPU memory usage (MiB)", (f64)usage_bytes / (1024.0 * 1024.0));
         }
-        else if (render_finished_semaphore_will_be_signalled_) {
-            clearSemaphore(gfx::getVkContext(), render_finished_semaphore_, general_purpose_fence_);
-            render_finished_semaphore_will_be_signalled_ = false;
+
+        // the previous step's, if it has finished; polled before `advance()` overwrites it
+        if (!fluid_sim_paused_ and tryLockFluidSim()) {
+            f64 stage_times_ns[fluid_sim::SIM_STAGE_COUNT] {};
+            if (fluid_sim_procs_->getStageGpuTimes(&sim_data, gfx::getVkContext(), false, stage_times_ns)) {
+                gputimeplot_samples_scrolling_buffer_.addReadings(0, fluid_sim::SIM_STAGE_COUNT, stage_times_ns);
+
+                f64 sim_gpu_time_ns = 0.0;
+                for (u32 stage = 0; stage < fluid_sim::SIM_STAGE_COUNT; stage++) {
+                    sim_gpu_time_ns += stage_times_ns[stage];
+                    sim_stage_gpu_ms[stage] = (f32)(1e-6 * stage_times_ns[stage]);
+                }
+                frametime_record_ms[FRAMETIME_SERIES_SIM_GPU] = (f32)(1e-6 * sim_gpu_time_ns);
+            }
+            fluid_sim_uploaded_byte_count_ = sim_data.uploaded_byte_count;
+            fluid_sim_transfers_ = sim_data.transfers;
+            fluid_sim_time_step_ = sim_data.time_step;
+            fluid_sim_diagnostics_ = sim_data.diagnostics;
+            unlockFluidSim();
         }
 
         // autoreload
@@ -1290,6 +4039,21 @@ int main(int argc, char** argv) {
                 gfx::ShaderReloadResult reload_result = gfx::reloadModifiedShaderSourceFiles(gfx_renderer);
                 switch (reload_result) {
                     case gfx::ShaderReloadResult::no_shaders_need_reloading : break;
+                    case gfx::ShaderReloadResult::in_progress : break;
+                    case gfx::ShaderReloadResult::success : last_shader_reload_failed_ = false; break;
+                    case gfx::ShaderReloadResult::error : last_shader_reload_failed_ = true; break;
+                }
+                if (reload_result != gfx::ShaderReloadResult::no_shaders_need_reloading) {
+                    recordInputEvent(&input_recording_, "shader_reload");
+                }
+                reloadModifiedFluidSimShaders(&sim_data);
+            }
+            // Swaps in the pipelines of a finished background reload, from autoreload, the keybind, or the button.
+            {
+                gfx::ShaderReloadResult reload_result = gfx::pollShaderReload();
+                switch (reload_result) {
+                    case gfx::ShaderReloadResult::no_shaders_need_reloading : break;
+                    case gfx::ShaderReloadResult::in_progress : break;
                     case gfx::ShaderReloadResult::success : last_shader_reload_failed_ = false; break;
                     case gfx::ShaderReloadResult::error : last_shader_reload_failed_ = true; break;
                 }
@@ -1311,9 +4075,40 @@ int main(int argc, char** argv) {
                 else if (new_plugin_procs != NULL) {
                     LOG_F(INFO, "Fluid sim plugin auto-reloaded (%.1lf s).", reload_duration);
                     fluid_sim_plugin_last_reload_failed_ = false;
-                    updateFluidSimPluginVersionAndProcs(new_plugin_procs);
+                    updateFluidSimPluginVersionAndProcs(new_plugin_procs, &sim_data);
+                    recordInputEvent(&input_recording_, "plugin_reload");
+                }
+            }
+        }
+
+        {
+            ZoneScopedNFrame("frame pacing");
+
+            gfx::waitForNextFrameResources(gfx_renderer);
+
+            if (frame_pacer_.low_latency and gfx::presentWaitSupported()) {
+                const u64 present_id = gfx::waitForLastPresent(gfx_surface, FRAME_PACER_PRESENT_WAIT_TIMEOUT_NS);
+                if (
+                    present_id != 0 and present_id == frame_pacer_.last_present_id
+                    and !frame_pacer_.last_present_measured
+                ) {
+                    FramePacer::addReading(
+                        &frame_pacer_.input_to_photon_seconds,
+                        glfwGetTime() - frame_pacer_.last_present_input_sample_time_seconds
+                    );
+                    frame_pacer_.last_present_measured = true;
                 }
+                frame_pacer_.delay_seconds = 0.0;
+            }
+            else {
+                const bool present_mode_unpaced =
+                    present_mode_ == gfx::PRESENT_MODE_MAILBOX or present_mode_ == gfx::PRESENT_MODE_IMMEDIATE;
+                frame_pacer_.delay_seconds = (frame_pacer_.enabled and present_mode_unpaced) ?
+                    frame_pacer_.computeDelaySeconds(frames_in_flight_) : 0.0;
+                if (frame_pacer_.delay_seconds > 0.0) sleepSeconds(frame_pacer_.delay_seconds);
             }
+
+            frame_pacer_.input_sample_time_seconds = glfwGetTime();
         }
 
         glfwPollEvents();
@@ -1338,7 +4133,8 @@ int main(int argc, char** argv) {
             glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
         abortIfGlfwError();
 
-        if (!left_ctrl_r_was_pressed and left_ctrl_r_is_pressed_) {
+        // the replay's reloads are the recording's
+        if (!left_ctrl_r_was_pressed and left_ctrl_r_is_pressed_ and !input_recording_.replaying()) {
 
             LOG_F(INFO, "Shader-reload keybind pressed. Triggering reload of modified shaders.");
 
@@ -1346,9 +4142,12 @@ int main(int argc, char** argv) {
                 gfx::ShaderReloadResult reload_result = gfx::reloadModifiedShaderSourceFiles(gfx_renderer);
                 switch (reload_result) {
                     case gfx::ShaderReloadResult::no_shaders_need_reloading : break;
+                    case gfx::ShaderReloadResult::in_progress : break;
                     case gfx::ShaderReloadResult::success : last_shader_reload_failed_ = false; break;
                     case gfx::ShaderReloadResult::error : last_shader_reload_failed_ = true; break;
                 }
+                reloadModifiedFluidSimShaders(&sim_data);
+                recordInputEvent(&input_recording_, "shader_reload");
             }
             else {
                 LOG_F(ERROR, "Shader-reload keybind pressed, but shader file tracking is disabled. Doing nothing.");
@@ -1361,7 +4160,8 @@ int main(int argc, char** argv) {
         left_alt_is_pressed_ = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS;
         abortIfGlfwError();
 
-        if (!left_alt_was_pressed and left_alt_is_pressed_) {
+        // the replay's cursor is the recording's
+        if (!left_alt_was_pressed and left_alt_is_pressed_ and !input_recording_.replaying()) {
 
             cursor_visible_ = !cursor_visible_;
 
@@ -1406,13 +4206,14 @@ int main(int argc, char** argv) {
             glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
         abortIfGlfwError();
 
-        if (!left_ctrl_o_was_pressed and left_ctrl_g_is_pressed_) {
+        // the GUI could change what the replay plays
+        if (!left_ctrl_o_was_pressed and left_ctrl_g_is_pressed_ and !input_recording_.replaying()) {
             imgui_overlay_visible_ = !imgui_overlay_visible_;
         }
 
         if (imgui_overlay_visible_) {
 
-            ZoneScopedN("Imgui");
+            ZoneScopedNFrame("Imgui");
 
             // Crosshair.
             // TODO Should we do this in our own renderer?
@@ -1431,6 +4232,12 @@ int main(int argc, char** argv) {
 
             {
                 bool grid_shader_enabled = grid_shader_enabled_;
+                bool occlusion_culling_enabled = occlusion_culling_enabled_;
+                bool visibility_buffer_enabled = visibility_buffer_enabled_;
+                bool particle_depth_bounds_enabled = particle_depth_bounds_enabled_;
+                f32 dynamic_resolution_budget_ms = dynamic_resolution_budget_ms_;
+                f32 particle_subsampling_budget_ms = particle_subsampling_budget_ms_;
+                gfx::TranslucentParticleSettings translucent_particle_settings = translucent_particle_settings_;
                 gfx::PresentModeFlags supported_present_modes = gfx::getSupportedPresentModes(gfx_surface);
                 gfx::PresentMode selected_present_mode = present_mode_;
 
@@ -1439,8 +4246,24 @@ int main(int argc, char** argv) {
                     shader_file_tracking_enabled_,
                     &shader_autoreload_enabled_,
                     &grid_shader_enabled,
+                    &occlusion_culling_enabled,
+                    &visibility_buffer_enabled,
+                    &particle_render_mode_,
+                    &particle_depth_bounds_enabled,
+                    &particle_lod_threshold_pixels_,
+                    &particle_subsampling_budget_ms,
+                    &dynamic_resolution_budget_ms,
+                    &translucent_particle_settings,
+                    &velocity_field_enabled_,
+                    &velocity_field_scale_,
+                    &velocity_field_spacing_pixels_,
+                    &extra_views_enabled_,
+                    gfx::getRenderScale(gfx_renderer),
+                    gfx::getParticleSubsampleFraction(gfx_renderer),
                     supported_present_modes,
-                    &selected_present_mode
+                    &selected_present_mode,
+                    frames_in_flight_,
+                    &frame_pacer_
                 );
                 assert(shader_file_tracking_enabled_ or !shader_autoreload_enabled_);
 
@@ -1448,11 +4271,41 @@ int main(int argc, char** argv) {
                     grid_shader_enabled_ = grid_shader_enabled;
                     gfx::setGridEnabled(grid_shader_enabled_);
                 }
+                if (occlusion_culling_enabled != occlusion_culling_enabled_) {
+                    occlusion_culling_enabled_ = occlusion_culling_enabled;
+                    gfx::setOcclusionCullingEnabled(occlusion_culling_enabled_);
+                }
+                if (visibility_buffer_enabled != visibility_buffer_enabled_) {
+                    visibility_buffer_enabled_ = visibility_buffer_enabled;
+                    gfx::setVisibilityBufferEnabled(visibility_buffer_enabled_);
+                }
+                if (particle_depth_bounds_enabled != particle_depth_bounds_enabled_) {
+                    particle_depth_bounds_enabled_ = particle_depth_bounds_enabled;
+                    gfx::setParticleDepthBoundsEnabled(particle_depth_bounds_enabled_);
+                }
+                if (dynamic_resolution_budget_ms != dynamic_resolution_budget_ms_) {
+                    dynamic_resolution_budget_ms_ = dynamic_resolution_budget_ms;
+                    gfx::setDynamicResolutionBudget(dynamic_resolution_budget_ms_);
+                }
+                if (particle_subsampling_budget_ms != particle_subsampling_budget_ms_) {
+                    particle_subsampling_budget_ms_ = particle_subsampling_budget_ms;
+                    gfx::setParticleSubsamplingBudget(particle_subsampling_budget_ms_);
+                }
+                if (
+                    translucent_particle_settings.opacity != translucent_particle_settings_.opacity or
+                    translucent_particle_settings.resort_distance_radii !=
+                        translucent_particle_settings_.resort_distance_radii or
+                    translucent_particle_settings.max_sort_age_frames !=
+                        translucent_particle_settings_.max_sort_age_frames
+                ) {
+                    translucent_particle_settings_ = translucent_particle_settings;
+                    gfx::setTranslucentParticleSettings(&translucent_particle_settings_);
+                }
 
                 if (res.button_pressed_reload_all_shaders) {
                     LOG_F(INFO, "Reload-all-shaders button pressed. Triggering reload.");
-                    success = gfx::reloadAllShaders(gfx_renderer);
-                    last_shader_reload_failed_ = !success;
+                    gfx::reloadAllShaders(gfx_renderer);
+                    recordInputEvent(&input_recording_, "shader_reload");
                 }
 
                 if (selected_present_mode != present_mode_) {
@@ -1479,16 +4332,35 @@ int main(int argc, char** argv) {
 
             {
                 bool pause = frametimeplot_paused_;
-                guiWindow_performance(
-                    frametimeplot_axis_label, &frametimeplot_samples_scrolling_buffer_, &pause
+                GuiWindowPerformanceResult res = guiWindow_performance(
+                    frametimeplot_axis_label, &frametimeplot_samples_scrolling_buffer_,
+                    &gputimeplot_samples_scrolling_buffer_, &frametime_stats_, &slow_frame_watchdog_, &pause,
+                    fluid_sim_uploaded_byte_count_, &transfer_rates_,
+                    &frame_pacer_, thread_pool_, threadpoolplot_busy_fractions_
                 );
-                if (frametimeplot_paused_ and !pause) frametimeplot_samples_scrolling_buffer_.reset();
+                if (res.button_pressed_reset_frametime_stats) frametime_stats_.reset();
+                if (res.button_pressed_export_csv) (void)exportFrametimeStats(&frametime_stats_, false);
+                if (res.button_pressed_export_json) (void)exportFrametimeStats(&frametime_stats_, true);
+                if (frametimeplot_paused_ and !pause) {
+                    frametimeplot_samples_scrolling_buffer_.reset();
+                    gputimeplot_samples_scrolling_buffer_.reset();
+                }
                 frametimeplot_paused_ = pause;
             }
 
+            {
+                if (tryLockFluidSim()) {
+                    fluid_sim_procs_->getMemoryUsage(&sim_data, &fluid_sim_memory_usage_);
+                    unlockFluidSim();
+                }
+                guiWindow_memory(memory_heap_budgets_, &fluid_sim_memory_usage_);
+            }
+
             {
 
                 u32fast selected_plugin_version = fluid_sim_selected_plugin_version_;
+                sim_thread::Stats sim_thread_stats {};
+                if (sim_thread_ != NULL) sim_thread_stats = sim_thread::getStats(sim_thread_);
                 GuiWindowFluidSimResult res = guiWindow_fluidSim(
                     fluid_sim_plugin_last_reload_failed_,
                     fluid_sim_plugin_filewatch_enabled_,
@@ -1497,20 +4369,44 @@ int main(int argc, char** argv) {
                     &fluid_sim_plugin_versions_.ui_elements,
                     &fluid_sim_plugin_versions_.hidden_ui_element_count,
                     &selected_plugin_version,
-                    &fluid_sim_params_
+                    &fluid_sim_params_,
+                    &fluid_sim_time_step_,
+                    &fluid_sim_diagnostics_,
+                    &fluid_sim_spatial_stats_interval_frames_,
+                    fluid_sim_spatial_stats_valid_ ? &fluid_sim_spatial_stats_ : NULL,
+                    sim_thread_ != NULL ? &sim_thread_stats : NULL,
+                    &sim_thread_interpolation_
                 );
 
-                if (res.sim_params_modified) fluid_sim_procs_->setParams(&sim_data, &fluid_sim_params_);
+                lockFluidSim();
+
+                if (res.sim_params_modified) {
+                    fluid_sim_procs_->setParams(&sim_data, &fluid_sim_params_);
+                    recordInputParamsEvent(&input_recording_, &fluid_sim_params_);
+                }
 
                 if (res.button_pressed_reset_state) {
-                    fluid_sim_procs_->destroy(&sim_data, gfx::getVkContext());
-                    sim_data = initFluidSim(&fluid_sim_params_);
+                    recordInputEvent(&input_recording_, "reset");
+                    // with the new parameters, which may need more memory
+                    if (initFluidSim(&fluid_sim_params_, true, &sim_data)) {
+                        fluid_sim_spatial_stats_valid_ = false;
+                        // the new particles aren't blended with the old ones
+                        if (sim_thread_ != NULL) sim_thread::resetSnapshots(sim_thread_);
+                    }
+                    else LOG_F(ERROR, "Not resetting the fluid sim, because the new one wouldn't fit in memory.");
                 }
 
+                unlockFluidSim();
+
                 if (selected_plugin_version != fluid_sim_selected_plugin_version_) {
                     LOG_F(INFO, "Switching to fluid sim plugin version %" PRIuFAST32 " due to user selection.", selected_plugin_version);
-                    fluid_sim_selected_plugin_version_ = selected_plugin_version;
-                    fluid_sim_procs_ = fluid_sim_plugin_versions_.procs.ptr[selected_plugin_version];
+                    (void)switchFluidSimPluginVersion(
+                        selected_plugin_version, fluid_sim_plugin_versions_.procs.ptr[selected_plugin_version],
+                        &sim_data
+                    );
+                    char event[48];
+                    snprintf(event, sizeof(event), "plugin_version %" PRIuFAST32, selected_plugin_version);
+                    recordInputEvent(&input_recording_, event);
                 }
 
                 if (res.button_pressed_reload) {
@@ -1530,7 +4426,8 @@ int main(int argc, char** argv) {
                     }
                     else {
                         LOG_F(INFO, "Fluid sim plugin reloaded (%.1lf s).", reload_duration);
-                        updateFluidSimPluginVersionAndProcs(new_plugin_procs);
+                        updateFluidSimPluginVersionAndProcs(new_plugin_procs, &sim_data);
+                        recordInputEvent(&input_recording_, "plugin_reload");
                     }
                 }
             }
@@ -1566,12 +4463,34 @@ int main(int argc, char** argv) {
             );
             assertGraphics(result_gfx);
 
-            window_draw_region_ = centeredSubregion_16x9((u32)window_size_.x, (u32)window_size_.y);
+            // offscreen, the draw region is the whole image, whatever the window's size
+            if (video_export == NULL) {
+                window_draw_region_ = centeredSubregion_16x9((u32)window_size_.x, (u32)window_size_.y);
+            }
 
             window_or_surface_out_of_date_ = false;
         }
 
 
+        if (render_benchmark_.active) {
+            render_benchmark_.sampleCamera(render_benchmark_.pathFrame(), &camera_pos_, &camera_angles_);
+            particle_render_mode_ = render_benchmark_.mode;
+        }
+        if (input_recording_.replaying()) {
+            playInputReplayFrame(&input_recording_, &sim_data, gfx_renderer);
+            const InputRecording::Frame* replay_frame = &input_recording_.frame;
+            delta_t_seconds = replay_frame->delta_t_seconds;
+            camera_pos_ = replay_frame->camera_pos;
+            camera_angles_ = replay_frame->camera_angles;
+            particle_render_mode_ = replay_frame->particle_render_mode;
+            cursor_visible_ = replay_frame->cursor_visible;
+            fluid_sim_paused_ = replay_frame->sim_paused;
+        }
+        // the angles that the frame is drawn with; the mouse turns the camera after
+        else if (input_recording_.mode == INPUT_RECORDING_MODE_RECORD) {
+            input_recording_.frame.camera_angles = camera_angles_;
+        }
+
         vec3 camera_direction_unit = glm::rotate(vec3(1, 0, 0), camera_angles_.y, vec3(0, 0, 1));
         camera_direction_unit = glm::rotate(camera_direction_unit, camera_angles_.x, vec3(0, 1, 0));
 
@@ -1592,7 +4511,7 @@ int main(int argc, char** argv) {
         );
 
         vec3 camera_vel = vec3(0);
-        if (!cursor_visible_) {
+        if (!cursor_visible_ and !render_benchmark_.active and !input_recording_.replaying()) {
 
             int w_key_state = glfwGetKey(window, GLFW_KEY_W);
             int s_key_state = glfwGetKey(window, GLFW_KEY_S);
@@ -1623,6 +4542,7 @@ int main(int argc, char** argv) {
             ZoneScopedN("checkedGlfwGetCursorPos");
             checkedGlfwGetCursorPos(window, &cursor_pos_.x, &cursor_pos_.y);
         }
+        if (input_recording_.replaying()) cursor_pos_ = input_recording_.frame.cursor_pos;
 
         // If window is resized or moved, the virtual cursor position reported by glfw changes even if the
         // user did not move it. We must ignore the cursor position change in this case.
@@ -1631,7 +4551,7 @@ int main(int argc, char** argv) {
 
 
         // compute new camera direction
-        if (!cursor_visible_) {
+        if (!cursor_visible_ and !render_benchmark_.active and !input_recording_.replaying()) {
             // We don't need to scale anything by delta_t here; `cursor_pos - prev_cursor_pos` already scales
             // linearly with frame duration.
 
@@ -1661,20 +4581,22 @@ int main(int argc, char** argv) {
         if (imgui_io.WantCaptureMouse) right_mouse_is_pressed_ = false;
         (void)right_mouse_was_pressed; // TODO FIXME delet dis
 
+        if (input_recording_.replaying()) {
+            left_mouse_is_pressed_ = input_recording_.frame.left_mouse_pressed;
+            right_mouse_is_pressed_ = input_recording_.frame.right_mouse_pressed;
+        }
+        else if (input_recording_.mode == INPUT_RECORDING_MODE_RECORD) {
+            recordInputFrame(&input_recording_, window, delta_t_seconds);
+        }
 
-        Hexahedron view_frustum = frustumFromScreenspacePoints(
-            camera_pos_,
-            camera_direction_unit,
-            camera_horizontal_right_direction_unit,
-            camera_y_axis_unit,
-            vec2 { -1.f, -1.f },
-            vec2 { 1.f, 1.f }
-        );
-        view_frustum.near_bot_left_p = worldspaceToIndexspaceFloat(view_frustum.near_bot_left_p);
-        view_frustum.far_top_right_p = worldspaceToIndexspaceFloat(view_frustum.far_top_right_p);
 
-        voxels_in_frustum_count_ = frustumCull(&view_frustum, voxel_count_, p_voxels_, p_voxels_in_frustum_);
+        FrameStages frame_stages {};
+        frame_stages.p_sim_data = &sim_data;
+        frame_stages.delta_t = (f32)delta_t_seconds;
+        frame_stages.sim_host_seconds = -1.0;
+        frame_stages.cull_seconds = -1.0;
 
+        bool select_voxels = false;
 
         if (cursor_visible_) {
             if (!left_mouse_was_pressed and left_mouse_is_pressed_) {
@@ -1699,17 +4621,21 @@ int main(int argc, char** argv) {
                 frustum.near_bot_left_p = worldspaceToIndexspaceFloat(frustum.near_bot_left_p);
                 frustum.far_top_right_p = worldspaceToIndexspaceFloat(frustum.far_top_right_p);
 
-                u32fast selected_voxel_idx = 0;
-                {
-                    ZoneScopedN("Get selected voxels");
-                    for (u32fast voxel_idx = 0; voxel_idx < voxels_in_frustum_count_; voxel_idx++) {
-                        if (pointIsInHexahedron(&frustum, p_voxels_in_frustum_[voxel_idx].pos)) {
-                            p_selected_voxel_indices_[selected_voxel_idx] = p_voxels_in_frustum_[voxel_idx].idx;
-                            selected_voxel_idx++;
-                        };
-                    }
+                if (gpu_picking_) {
+                    const vec2 p1 = selection_point1_windowspace_;
+                    const vec2 p2 = selection_point2_windowspace_;
+                    const ivec2 min = ivec2(glm::floor(glm::min(p1, p2)));
+                    const ivec2 max = ivec2(glm::floor(glm::max(p1, p2)));
+                    // the pixels that the corners are in, so at least the one under the cursor
+                    gfx::requestPick(gfx_renderer, VkRect2D {
+                        .offset = { min.x, min.y },
+                        .extent = { (u32)(max.x - min.x + 1), (u32)(max.y - min.y + 1) },
+                    });
+                }
+                else {
+                    frame_stages.selection_frustum = frustum;
+                    select_voxels = true;
                 }
-                selected_voxel_index_count_ = selected_voxel_idx;
 
                 ImGui::GetBackgroundDrawList()->AddRect(
                     ImVec2 { selection_point1_windowspace_.x, selection_point1_windowspace_.y },
@@ -1720,34 +4646,11 @@ int main(int argc, char** argv) {
         }
 
 
-        mat4 world_to_screen_transform = glm::identity<mat4>();
-        {
-            mat4 world_to_camera_transform = glm::lookAt(
-                camera_pos_, // eye
-                camera_pos_ + camera_direction_unit, // position you're looking at
-                camera_y_axis_unit // "Normalized up vector, how the camera is oriented."
-            );
-            mat4 camera_to_clip_transform = glm::perspective(
-                (f32)FOV_Y, // fovy
-                (f32)ASPECT_RATIO_X_OVER_Y, // aspect
-                (f32)VIEW_FRUSTUM_NEAR_SIDE_DISTANCE, // zNear
-                (f32)VIEW_FRUSTUM_FAR_SIDE_DISTANCE // zFar
-            );
-
-            // By default:
-            //     In GLM clip coordinates: the Y axis points upward.
-            //     In Vulkan normalized device coordinates: the Y axis points downward.
-            mat4 glm_to_vulkan = glm::identity<mat4>();
-            glm_to_vulkan[1][1] = -1.0f; // mirror y axis
-
-            world_to_screen_transform = world_to_camera_transform * world_to_screen_transform;
-            world_to_screen_transform = camera_to_clip_transform * world_to_screen_transform;
-            world_to_screen_transform = glm_to_vulkan * world_to_screen_transform;
-        }
+        mat4 world_to_screen_transform =
+            getWorldToScreenTransform(camera_pos_, camera_pos_ + camera_direction_unit, camera_y_axis_unit);
         mat4 world_to_screen_transform_inverse = glm::inverse(world_to_screen_transform);
 
 
-        u32fast voxel_being_looked_at_idx = INVALID_VOXEL_IDX;
         {
             vec3 ray_origin = camera_pos_ + camera_direction_unit * (f32)VIEW_FRUSTUM_NEAR_SIDE_DISTANCE;
             vec3 ray_direction_unit = camera_direction_unit;
@@ -1770,19 +4673,66 @@ int main(int argc, char** argv) {
                 ray_direction_unit = glm::normalize(ray_origin - camera_pos_);
             }
 
-            voxel_being_looked_at_idx = rayCast(
-                ray_origin,
-                ray_direction_unit,
-                voxels_in_frustum_count_,
-                p_voxels_in_frustum_
+            frame_stages.ray_origin = ray_origin;
+            frame_stages.ray_direction_unit = ray_direction_unit;
+        }
+
+        if (voxel_collider::hasEdits(voxel_collider_)) {
+            lockFluidSim();
+            voxel_collider::uploadEdits(voxel_collider_, fluid_sim_procs_, &sim_data, gfx::getVkContext());
+            unlockFluidSim();
+        }
+
+        {
+            ZoneScopedNFrame("frame stages");
+
+            thread_pool::TaskGraph frame_graph {};
+
+            // the sim thread steps it otherwise
+            if (sim_thread_ == NULL) {
+                thread_pool::addTaskGraphNode(&frame_graph, frameStage_advanceFluidSim, &frame_stages, 0, NULL);
+            }
+            else sim_thread::setPaused(sim_thread_, fluid_sim_paused_);
+            thread_pool::addTaskGraphNode(&frame_graph, frameStage_rayCast, &frame_stages, 0, NULL);
+            if (select_voxels) {
+                p_voxel_cull_chunk_counts_ = frame_arena_.allocArray<u32>(gfx::getVoxelChunkCount(voxel_store_));
+                thread_pool::addTaskGraphNode(&frame_graph, frameStage_selectVoxels, &frame_stages, 0, NULL);
+            }
+
+            const f64 frame_stages_start_time = glfwGetTime();
+            frametime_record_ms[FRAMETIME_SERIES_INPUT] =
+                (f32)(1e3 * (frame_stages_start_time - frame_pacer_.input_sample_time_seconds));
+
+            thread_pool::runTaskGraph(thread_pool_, &frame_graph);
+
+            if (frame_stages.sim_host_seconds >= 0.0) {
+                frametime_record_ms[FRAMETIME_SERIES_SIM_HOST] = (f32)(1e3 * frame_stages.sim_host_seconds);
+            }
+            if (frame_stages.cull_seconds >= 0.0) {
+                frametime_record_ms[FRAMETIME_SERIES_CULL] = (f32)(1e3 * frame_stages.cull_seconds);
+                gfx::setOutlinedVoxels(gfx_renderer, selected_voxel_count_, p_selected_voxel_coords_);
+            }
+        }
+
+        if (
+            fluid_sim_spatial_stats_interval_frames_ > 0 and
+            frame_counter % fluid_sim_spatial_stats_interval_frames_ == 0
+        ) {
+            ZoneScopedN("fluid_sim::getSpatialStructureStats");
+            lockFluidSim();
+            fluid_sim_procs_->getSpatialStructureStats(
+                &sim_data, gfx::getVkContext(), &fluid_sim_spatial_stats_
             );
+            unlockFluidSim();
+            fluid_sim_spatial_stats_valid_ = true;
         }
-        if (voxel_being_looked_at_idx != INVALID_VOXEL_IDX) {
+
+        if (frame_stages.looking_at_voxel) {
 
             ImDrawList* draw_list = ImGui::GetBackgroundDrawList();
             assert(draw_list != NULL);
 
-            const vec3 cube_center = indexspaceToWorldspace(p_voxels_[voxel_being_looked_at_idx].coord);
+            const vec3 cube_center = indexspaceToWorldspace(frame_stages.voxel_being_looked_at);
             const f32 rad = gfx::VOXEL_RADIUS;
 
             vec4 vec4_p000 = world_to_screen_transform * vec4(cube_center + vec3(-rad, -rad, -rad), 1.0f);
@@ -1834,8 +4784,122 @@ int main(int argc, char** argv) {
 
         VkBuffer sim_vkbuffer = VK_NULL_HANDLE;
         VkDeviceSize sim_vkbuffer_size = 0;
-        fluid_sim_procs_->getPositionsVertexBuffer(&sim_data, &sim_vkbuffer, &sim_vkbuffer_size);
+        u32 particle_count = 0;
+        gfx::ParticleInterpolation particle_interpolation {};
+        bool particle_interpolation_valid = false;
+        if (sim_thread_ != NULL) {
+            sim_thread::getParticlesBuffer(sim_thread_, &sim_vkbuffer, &sim_vkbuffer_size);
+
+            sim_thread::Frame frame {};
+            particle_interpolation_valid = sim_thread::getFrame(sim_thread_, sim_thread_interpolation_, &frame);
+            if (particle_interpolation_valid) {
+                particle_count = frame.particle_count;
+                particle_interpolation = gfx::ParticleInterpolation {
+                    .previous_particles = frame.previous_particles,
+                    .next_particles = frame.next_particles,
+                    .alpha = frame.alpha,
+                    .wait_semaphore = frame.wait_semaphore,
+                    .wait_value = frame.wait_value,
+                    .signal_semaphore = frame.signal_semaphore,
+                    .signal_value = frame.signal_value,
+                };
+            }
+        }
+        else {
+            fluid_sim_procs_->getPositionsVertexBuffer(&sim_data, &sim_vkbuffer, &sim_vkbuffer_size);
+            particle_count = (u32)sim_data.particle_count;
+        }
+
+        // So that the picked particles are named by ids that survive the sim's sorts; left null if the sim has
+        // none. The sim thread's snapshots don't carry them, so not with it.
+        VkBuffer particle_ids_vkbuffer = VK_NULL_HANDLE;
+        VkDeviceSize particle_ids_vkbuffer_size = 0;
+        if (sim_thread_ == NULL) {
+            fluid_sim_procs_->getParticleIdsBuffer(&sim_data, &particle_ids_vkbuffer, &particle_ids_vkbuffer_size);
+        }
+
+        // Without it (with the CPU backend), the ray marching tests every particle, the surface mesh and the density
+        // volume fall back to rasterizing them, and the rasterizing draws every particle. The sim thread's is of a
+        // later step than the particles that are drawn, so it's not used then either.
+        gfx::ParticleGrid particle_grid {};
+        bool particle_grid_valid = false;
+        if (sim_thread_ == NULL and (
+            particle_render_mode_ == gfx::PARTICLE_RENDER_MODE_RAY_MARCHED or
+            particle_render_mode_ == gfx::PARTICLE_RENDER_MODE_SURFACE_MESH or
+            particle_render_mode_ == gfx::PARTICLE_RENDER_MODE_DENSITY_VOLUME or
+            (particle_render_mode_ == gfx::PARTICLE_RENDER_MODE_RASTERIZED and particle_lod_threshold_pixels_ > 0.f)
+        )) {
+            fluid_sim::SpatialStructureBuffers b {};
+            particle_grid_valid = fluid_sim_procs_->getSpatialStructureBuffers(&sim_data, &b);
+            particle_grid = gfx::ParticleGrid {
+                .cells = b.cells,
+                .hash_buckets = b.hash_buckets,
+                .cell_slots = b.cell_slots,
+                .hash_table_size = b.hash_table_size,
+                .cell_slot_count = b.cell_slot_count,
+                .permuted = b.permuted,
+                .permutation = b.permutation,
+                .reference_positions = b.reference_positions,
+                .max_displacement = b.max_displacement,
+                .domain_bounds = b.domain_bounds,
+                .domain_bounds_slot = b.domain_bounds_slot,
+                .cell_size_reciprocal = b.cell_size_reciprocal,
+                .timeline_semaphore = b.timeline_semaphore,
+                .timeline_value = b.timeline_value,
+            };
+        }
+
+        // written by the step that wrote the particles, so the render's wait for the sim covers them
+        if (velocity_field_enabled_ and sim_thread_ == NULL) {
+            gfx::VectorField velocity_field {
+                .scale = velocity_field_scale_,
+                .min_spacing_pixels = velocity_field_spacing_pixels_,
+            };
+            if (fluid_sim_procs_->getVelocitiesBuffer(
+                &sim_data, &velocity_field.vectors, &velocity_field.component_stride, &velocity_field.half_vectors
+            )) {
+                gfx::requestVectorField(gfx_renderer, &velocity_field);
+            }
+        }
+
+        // Insets along the right side of the main view: from above, facing the way the camera does, and from its
+        // right. The renderer shares the sim's buffers and the voxel mesh between them.
+        if (extra_views_enabled_ and video_export == NULL) {
+            const vec3 focus = camera_pos_ + camera_direction_unit * EXTRA_VIEW_FOCUS_DISTANCE;
+            const vec3 eyes[2] {
+                focus + vec3(0, EXTRA_VIEW_DISTANCE, 0),
+                focus + camera_horizontal_right_direction_unit * EXTRA_VIEW_DISTANCE,
+            };
+            const vec3 ups[2] { camera_horizontal_direction_unit, vec3(0, 1, 0) };
+
+            const VkExtent2D extent {
+                window_draw_region_.extent.width / EXTRA_VIEW_SCALE_DOWN,
+                window_draw_region_.extent.height / EXTRA_VIEW_SCALE_DOWN,
+            };
+            gfx::View views[2] {};
+            for (u32 i = 0; i < 2; i++) {
+                views[i].window_subregion = VkRect2D {
+                    .offset = {
+                        window_draw_region_.offset.x + (i32)(window_draw_region_.extent.width - extent.width),
+                        window_draw_region_.offset.y + (i32)(i * extent.height),
+                    },
+                    .extent = extent,
+                };
+                views[i].world_to_screen_transform = getWorldToScreenTransform(eyes[i], focus, ups[i]);
+                views[i].world_to_screen_transform_inverse = glm::inverse(views[i].world_to_screen_transform);
+            }
+            if (extent.width > 0 and extent.height > 0) gfx::requestExtraViews(gfx_renderer, views, 2);
+        }
+
+        // Every particle while nothing on screen moves, and in the video, the benchmark and the replay, which must not
+        // depend on how fast the frames happen to be.
+        gfx::setParticleSubsamplingSuspended(
+            video_export != NULL or render_benchmark_.active or input_recording_.replaying() or
+            (fluid_sim_paused_ and world_to_screen_transform == last_world_to_screen_transform_)
+        );
+        last_world_to_screen_transform_ = world_to_screen_transform;
 
+        const f64 render_start_time = glfwGetTime();
         gfx::RenderResult render_result = gfx::render(
             gfx_surface,
             window_draw_region_,
@@ -1843,19 +4907,94 @@ int main(int argc, char** argv) {
             &world_to_screen_transform_inverse,
             (1.f / 128.f), // particle_radius
             (f32)(VIEW_FRUSTUM_FAR_SIDE_DISTANCE - VIEW_FRUSTUM_NEAR_SIDE_DISTANCE), // raymarch_max_travel_distance
-            imgui_draw_data,
-            (u32)voxel_count_,
-            p_voxels_,
-            (u32)selected_voxel_index_count_,
-            p_selected_voxel_indices_,
-            (u32)sim_data.particle_count,
+            // the GUI isn't part of the video, nor of the benchmark's or the replay's times
+            (video_export == NULL and !render_benchmark_.active and !input_recording_.replaying()) ?
+                imgui_draw_data : NULL,
+            particle_count,
             sim_vkbuffer,
-            false,
+            particle_ids_vkbuffer,
+            particle_render_mode_,
+            particle_grid_valid ? &particle_grid : NULL,
+            fluid_sim_params_.rest_particle_density,
+            particle_lod_threshold_pixels_,
+            particle_interpolation_valid ? &particle_interpolation : NULL,
             sim_finished_semaphore_will_be_signalled_ ? sim_finished_semaphore_ : VK_NULL_HANDLE,
-            render_finished_semaphore_
+            // the sim thread's steps wait for nothing of the renderer's
+            sim_thread_ == NULL ? render_finished_semaphore_ : VK_NULL_HANDLE
         );
         sim_finished_semaphore_will_be_signalled_ = false;
-        render_finished_semaphore_will_be_signalled_ = true;
+        render_finished_semaphore_will_be_signalled_ = sim_thread_ == NULL;
+        frametime_record_ms[FRAMETIME_SERIES_RENDER] = (f32)(1e3 * (glfwGetTime() - render_start_time));
+
+        if (video_export != NULL) {
+            video_export::captureFrame(video_export, gfx::getLastRenderedOffscreenImage(gfx_surface));
+        }
+
+        FramePacer::addReading(
+            &frame_pacer_.cpu_frame_seconds, glfwGetTime() - frame_pacer_.input_sample_time_seconds
+        );
+        {
+            // unchanged if `render()` didn't present
+            const u64 present_id = gfx::getLastPresentId(gfx_surface);
+            if (present_id != frame_pacer_.last_present_id) {
+                frame_pacer_.last_present_id = present_id;
+                frame_pacer_.last_present_input_sample_time_seconds = frame_pacer_.input_sample_time_seconds;
+                frame_pacer_.last_present_measured = false;
+            }
+        }
+
+        {
+            // lags the selection by a frame or more
+            gfx::PickResult pick_result {};
+            if (gfx::getPickResult(gfx_renderer, &pick_result) and gpu_picking_) {
+                selected_voxel_count_ = math::min(pick_result.voxel_count, gfx::MAX_OUTLINED_VOXEL_COUNT);
+                memcpy(p_selected_voxel_coords_, pick_result.voxel_coords, selected_voxel_count_ * sizeof(ivec3));
+                gfx::setOutlinedVoxels(gfx_renderer, selected_voxel_count_, p_selected_voxel_coords_);
+                selected_particle_count_ = pick_result.particle_count;
+                selection_truncated_ = pick_result.truncated;
+            }
+        }
+
+        {
+            f64 pass_gpu_times_ns[gfx::RENDER_PASS_ENUM_COUNT] {};
+            const bool pass_gpu_times_valid = gfx::getRenderPassGpuTimes(gfx_renderer, pass_gpu_times_ns);
+            if (pass_gpu_times_valid) {
+                gputimeplot_samples_scrolling_buffer_.addReadings(
+                    fluid_sim::SIM_STAGE_COUNT, gfx::RENDER_PASS_ENUM_COUNT, pass_gpu_times_ns
+                );
+                for (u32 pass = 0; pass < gfx::RENDER_PASS_ENUM_COUNT; pass++) {
+                    render_pass_gpu_ms[pass] = (f32)(1e-6 * pass_gpu_times_ns[pass]);
+                }
+            }
+            f64 frame_gpu_time_ns = 0.0;
+            const bool frame_gpu_time_valid = gfx::getFrameGpuTime(gfx_renderer, &frame_gpu_time_ns);
+            if (frame_gpu_time_valid) {
+                FramePacer::addReading(&frame_pacer_.gpu_frame_seconds, 1e-9 * frame_gpu_time_ns);
+                frametime_record_ms[FRAMETIME_SERIES_RENDER_GPU] = (f32)(1e-6 * frame_gpu_time_ns);
+            }
+
+            if (render_benchmark_.active and !advanceRenderBenchmark(
+                &render_benchmark_,
+                (f32)(1e3 * (glfwGetTime() - frame_start_time_seconds_)),
+                (pass_gpu_times_valid and frame_gpu_time_valid) ? pass_gpu_times_ns : NULL,
+                frame_gpu_time_ns
+            )) {
+                goto LABEL_EXIT_MAIN_LOOP;
+            }
+            if (input_recording_.replaying() and !advanceInputReplay(
+                &input_recording_,
+                (f32)(1e3 * (glfwGetTime() - frame_start_time_seconds_)),
+                frame_gpu_time_valid ? (f32)(1e-6 * frame_gpu_time_ns) : -1.f,
+                frametime_record_ms[FRAMETIME_SERIES_SIM_GPU]
+            )) {
+                goto LABEL_EXIT_MAIN_LOOP;
+            }
+
+            const gfx::TransferStats render_transfers = gfx::getTransferStats(gfx_renderer);
+            updateTransferRates(
+                &transfer_rates_, &fluid_sim_transfers_, &render_transfers, frame_counter, glfwGetTime()
+            );
+        }
 
         switch (render_result) {
             case gfx::RenderResult::error_surface_resources_out_of_date:
@@ -1868,12 +5007,70 @@ int main(int argc, char** argv) {
             case gfx::RenderResult::success: break;
         }
 
+        if (!frametimeplot_paused_) {
+            frametime_record_ms[FRAMETIME_SERIES_FRAME] = (f32)(1e3 * (glfwGetTime() - frame_start_time_seconds_));
+            frametime_stats_.push(frametime_record_ms);
+
+            if (slow_frame_watchdog_.enabled) {
+                const thread_pool::Stats pool_stats = thread_pool::getStats(thread_pool_);
+                const thread_pool::Stats* previous = &slow_frame_watchdog_.previous_thread_pool_stats;
+                // no previous frame since it was enabled, or the pool was recreated and its counts restarted
+                const bool pool_restarted =
+                    slow_frame_watchdog_.record_count == 0 or pool_stats.wake_count < previous->wake_count or
+                    pool_stats.total_wake_latency_ns < previous->total_wake_latency_ns;
+
+                SlowFrameWatchdog::Record record {
+                    .thread_pool_wake_count = pool_restarted ? 0 : pool_stats.wake_count - previous->wake_count,
+                    .thread_pool_wake_latency_ns =
+                        pool_restarted ? 0 : pool_stats.total_wake_latency_ns - previous->total_wake_latency_ns,
+                    .thread_pool_queued_count = pool_stats.queued_count,
+                };
+                memcpy(record.milliseconds, frametime_record_ms, sizeof(record.milliseconds));
+                memcpy(record.sim_stage_gpu_milliseconds, sim_stage_gpu_ms, sizeof(sim_stage_gpu_ms));
+                memcpy(record.render_pass_gpu_milliseconds, render_pass_gpu_ms, sizeof(render_pass_gpu_ms));
+                slow_frame_watchdog_.previous_thread_pool_stats = pool_stats;
+
+                f32 median_ms = 0.f;
+                if (slow_frame_watchdog_.push(&record, &median_ms)) {
+                    ZoneScopedN("writeSlowFrameCapture");
+                    fluid_sim::SpatialStructureStats sim_stats {};
+                    lockFluidSim();
+                    fluid_sim_procs_->getSpatialStructureStats(&sim_data, gfx::getVkContext(), &sim_stats);
+                    unlockFluidSim();
+                    (void)writeSlowFrameCapture(
+                        &slow_frame_watchdog_, median_ms, &sim_stats, fluid_sim_time_step_.substep_count
+                    );
+                }
+            }
+            else {
+                // starts a new history when enabled again
+                slow_frame_watchdog_.record_count = 0;
+                slow_frame_watchdog_.next_capture_record_count = 0;
+            }
+        }
+
+        if (frame_counter == 0) {
+            startup_profile_.endPhase("first frame");
+            startup_profile_.log();
+        }
+
         frame_counter++;
         FrameMark;
     };
 
     LABEL_EXIT_MAIN_LOOP: {}
 
+    if (sim_thread_ != NULL) sim_thread::destroy(sim_thread_);
+    if (input_recording_.mode == INPUT_RECORDING_MODE_RECORD) finishInputRecording(&input_recording_);
+    // writes the pending volumes
+    fluid_sim_procs_->stopVolumeExport(&sim_data, gfx::getVkContext());
+
+    if (video_export != NULL) {
+        video_export::destroy(video_export);
+        fence_waiter::destroy(video_export_fence_waiter);
+    }
+
+    gfx::savePipelineCache();
 
     // glfwTerminate(); // commented out because this sometimes adds significant shutdown time
     exit(0);
@@ -1,22 +0,0 @@
-#ifndef _MAIN_INTERNAL_HPP
-#define _MAIN_INTERNAL_HPP
-
-// #include <glm/glm.hpp>
-// #include "types.hpp"
-
-using glm::ivec3;
-
-//
-// ===========================================================================================================
-//
-
-struct VoxelPosAndIndex {
-    ivec3 pos;
-    u32 idx;
-};
-
-//
-// ===========================================================================================================
-//
-
-#endif // include guard
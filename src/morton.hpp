@@ -0,0 +1,134 @@
+#ifndef _MORTON_HPP
+#define _MORTON_HPP
+
+// #include <immintrin.h>
+// #include "types.hpp"
+
+/// Morton codes of 3D cell indices, on the CPU: 30-bit codes of 10-bit components, and 63-bit codes of 21-bit
+/// components, in the same bit order as `cellMortonCode30()` and `cellMortonCode()` in `fluidSim_util.comp.h`
+/// (x in bit 0, y in bit 1, z in bit 2). With BMI2, which `-march=native` enables where the CPU has it, each
+/// component is a single `pdep`/`pext`; otherwise they're the shift-and-mask cascades, with multiplies in place
+/// of the shift-and-or, as in https://fgiesen.wordpress.com/2022/09/09/morton-codes-addendum/.
+namespace morton {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 BITS_30_X = 0x09249249;
+constexpr u64 BITS_63_X = 0x1249249249249249;
+
+/// Moves bit `i` of the low 10 bits of `x` to bit `3 * i`.
+static inline u32 spreadBits30(u32 x) {
+#ifdef __BMI2__
+    return _pdep_u32(x, BITS_30_X);
+#else
+    // the shifted copies never overlap, so each multiply is a shift-and-or
+    x &= 0x000003ff;
+    x = (x * 0x00010001) & 0xff0000ff;
+    x = (x * 0x00000101) & 0x0300f00f;
+    x = (x * 0x00000011) & 0x030c30c3;
+    x = (x * 0x00000005) & BITS_30_X;
+    return x;
+#endif
+}
+
+/// Moves bit `i` of the low 21 bits of `x` to bit `3 * i`.
+static inline u64 spreadBits63(u32 x) {
+#ifdef __BMI2__
+    return _pdep_u64(x, BITS_63_X);
+#else
+    u64 spread = x & 0x1fffff;
+    spread = (spread | (spread << 32)) & 0x001f00000000ffff;
+    spread = (spread | (spread << 16)) & 0x001f0000ff0000ff;
+    spread = (spread | (spread <<  8)) & 0x100f00f00f00f00f;
+    spread = (spread | (spread <<  4)) & 0x10c30c30c30c30c3;
+    spread = (spread | (spread <<  2)) & BITS_63_X;
+    return spread;
+#endif
+}
+
+/// Inverse of `spreadBits63()`; ignores the bits in between.
+static inline u32 compactBits63(u64 x) {
+#ifdef __BMI2__
+    return (u32)_pext_u64(x, BITS_63_X);
+#else
+    x &= BITS_63_X;
+    x = (x ^ (x >>  2)) & 0x10c30c30c30c30c3;
+    x = (x ^ (x >>  4)) & 0x100f00f00f00f00f;
+    x = (x ^ (x >>  8)) & 0x001f0000ff0000ff;
+    x = (x ^ (x >> 16)) & 0x001f00000000ffff;
+    x = (x ^ (x >> 32)) & 0x00000000001fffff;
+    return (u32)x;
+#endif
+}
+
+/// The 30-bit code of the low 10 bits of each component.
+static inline u32 encode30(u32 x, u32 y, u32 z) {
+    return spreadBits30(x) | (spreadBits30(y) << 1) | (spreadBits30(z) << 2);
+}
+
+/// The 63-bit code of the low 21 bits of each component. If every component is less than 1024, this is also
+/// `encode30()`.
+static inline u64 encode63(u32 x, u32 y, u32 z) {
+    return spreadBits63(x) | (spreadBits63(y) << 1) | (spreadBits63(z) << 2);
+}
+
+/// Component `axis` (0 to 2) of a 63-bit code; for a 30-bit code too.
+static inline u32 decode63(u64 code, u32 axis) {
+    return compactBits63(code >> axis);
+}
+
+/// Whether the cell with 63-bit code `code` is in the box of cells whose corners have the codes `box_min` and
+/// `box_max`. Same as `mortonCodeIsInBox()` in `fluidSim_util.comp.h`.
+static inline bool isInBox(u64 code, u64 box_min, u64 box_max) {
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        const u64 mask = BITS_63_X << axis;
+        if ((code & mask) < (box_min & mask) or (code & mask) > (box_max & mask)) return false;
+    }
+    return true;
+}
+
+/// The smallest 63-bit code greater than `code` that is in the box with corners `box_min` and `box_max`, where
+/// `code` is between the corners but not in the box; UINT64_MAX if there is none. Same as `mortonCodeBigMin()`
+/// in `fluidSim_util.comp.h`, which has the explanation; `morton_range_check` checks it against brute force.
+static inline u64 bigMin(u64 code, u64 box_min, u64 box_max) {
+
+    u64 big_min = UINT64_MAX;
+
+    for (u32 bit = 63; bit-- > 0; )
+    {
+        const u64 bit_mask = (u64)1 << bit;
+        // the lower bits of the same component
+        const u64 component_below_mask = (BITS_63_X << (bit % 3)) & (bit_mask - 1);
+
+        const bool code_bit = (code & bit_mask) != 0;
+        const bool min_bit = (box_min & bit_mask) != 0;
+        const bool max_bit = (box_max & bit_mask) != 0;
+
+        if (!min_bit and max_bit)
+        {
+            const u64 upper_min = (box_min | bit_mask) & ~component_below_mask;
+            const u64 lower_max = (box_max & ~bit_mask) | component_below_mask;
+
+            if (code_bit) box_min = upper_min;
+            else
+            {
+                big_min = upper_min;
+                box_max = lower_max;
+            }
+        }
+        else if (code_bit != min_bit) return code_bit ? big_min : box_min;
+    }
+
+    return big_min;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,39 @@
+#version 450
+
+layout(location = 0) in vec3 position_worldspace_in_;
+layout(location = 1) flat in vec3 particle_coord_worldspace_in_;
+layout(location = 3) flat in uint particle_idx_in_;
+
+layout(location = 0) out uint object_id_out_;
+// see particle_rasterize.frag
+layout(depth_greater) out float gl_FragDepth;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp, and particle_rasterize.vert.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+};
+
+// The object id of the particle under the fragment, for `recordPick()` in graphics.cpp: its index plus 1, with the
+// top bit clear, which voxels' ids set. The sphere is ray cast like particle_rasterize.frag does, so that the ids
+// cover exactly what's drawn.
+void main(void) {
+
+    const float r = particle_radius_;
+    const vec3 ray_direction_unit = normalize(position_worldspace_in_ - camera_position_);
+    const vec3 to_center = particle_coord_worldspace_in_ - camera_position_;
+
+    const float b = dot(ray_direction_unit, to_center);
+    const float discriminant = b * b - (dot(to_center, to_center) - r * r);
+    if (discriminant < 0.0f) discard;
+    const float t = b - sqrt(discriminant);
+
+    const vec3 hit = camera_position_ + t * ray_direction_unit;
+    const vec4 hit_clip_space = world_to_screen_transform_ * vec4(hit, 1.0f);
+    gl_FragDepth = hit_clip_space.z / hit_clip_space.w;
+
+    object_id_out_ = particle_idx_in_ + 1u;
+}
@@ -0,0 +1,43 @@
+#version 450
+
+layout(location = 1) flat in uvec3 packed_in_;
+layout(location = 2) in vec2 quad_coord_in_;
+
+layout(location = 0) out uint object_id_out_;
+
+// Must match `ObjectIdVoxelPipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    ivec3 origin_; // the voxel that the coordinates in the ids are relative to
+};
+
+// Must match the `OBJECT_ID_VOXEL_*` constants in graphics.cpp.
+#define OBJECT_ID_VOXEL_BIT 0x80000000u
+#define OBJECT_ID_VOXEL_AXIS_BITS 10
+
+// The object id of the voxel under the fragment, for `recordPick()` in graphics.cpp: `OBJECT_ID_VOXEL_BIT`, then its
+// coordinates relative to `origin_`, offset to be unsigned, in `OBJECT_ID_VOXEL_AXIS_BITS` each from x in the lowest
+// bits. The voxels that are too far from `origin_` for that get 0, i.e. they hide what's behind them, but can't be
+// picked.
+void main(void) {
+
+    // see voxel.vert
+    const ivec3 first_voxel = bitfieldExtract(ivec3(packed_in_), 0, 24);
+    const uint direction = packed_in_.x >> 24;
+    const ivec2 size = ivec2(packed_in_.y >> 24, packed_in_.z >> 24);
+    const uint axis = direction >> 1;
+
+    // clamped, as interpolation can overshoot the quad's far edges a little
+    ivec3 voxel = first_voxel;
+    voxel[(axis + 1) % 3] += clamp(int(quad_coord_in_.x), 0, size.x - 1);
+    voxel[(axis + 2) % 3] += clamp(int(quad_coord_in_.y), 0, size.y - 1);
+
+    const int axis_range = 1 << OBJECT_ID_VOXEL_AXIS_BITS;
+    const ivec3 coord = voxel - origin_ + axis_range / 2;
+    if (any(lessThan(coord, ivec3(0))) || any(greaterThanEqual(coord, ivec3(axis_range)))) {
+        object_id_out_ = 0u;
+        return;
+    }
+
+    object_id_out_ = OBJECT_ID_VOXEL_BIT | uint(coord.x) | (uint(coord.y) << OBJECT_ID_VOXEL_AXIS_BITS) |
+        (uint(coord.z) << (2 * OBJECT_ID_VOXEL_AXIS_BITS));
+}
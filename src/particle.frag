@@ -1,6 +1,9 @@
 #version 450
 
 layout(location = 0) out vec4 fragment_color_out_;
+// Every hit is behind the quad that particle.vert drew, so the depth test may still reject the pixel before it's
+// shaded.
+layout(depth_greater) out float gl_FragDepth;
 
 layout(binding = 0, std140) uniform Uniforms {
     mat4 world_to_screen_transform_;
@@ -8,6 +11,34 @@ layout(binding = 0, std140) uniform Uniforms {
 layout(binding = 2, std430) buffer Particles {
     vec3 particles_[];
 };
+
+// The sim's spatial structure; see `gfx::ParticleGrid`. Only read if `cell_table_kind_ != CELL_TABLE_NONE`.
+// (first particle, particle count) per cell, in hash order; (first cell, cell count) per hash bucket
+layout(binding = 5, std430) readonly buffer Cells { uvec2 cells_[]; };
+layout(binding = 6, std430) readonly buffer HashBuckets { uvec2 hash_buckets_[]; };
+layout(binding = 9, std430) readonly buffer CellSlots { uvec4 cell_slots_[]; };
+layout(binding = 10, std430) readonly buffer Permutation { uint permutation_[]; };
+layout(binding = 11, std430) readonly buffer PositionsReference { vec3 positions_reference_[]; };
+// a min and a max per slot
+layout(binding = 12, std430) readonly buffer DomainBounds { vec4 domain_bounds_[]; };
+
+// The particles binned into screen tiles by the `particle_tiles_*.comp` stages; see particle_tiles.comp.h. Only
+// read if `tile_count_x_ != 0`.
+// (first entry, entry count) per tile
+layout(binding = 14, std430) readonly buffer TileRanges { uvec2 tile_ranges_[]; };
+// (depth key, particle index)
+layout(binding = 15, std430) readonly buffer TileEntries { uvec2 tile_entries_[]; };
+
+// Must match particle_tiles.comp.h.
+#define TILE_SIZE 16
+#define TILE_OVERFLOWED 0xFFFFFFFFu
+#define TILE_SORT_CAPACITY 1024
+
+// Must match PARTICLE_CELL_TABLE_* in graphics.cpp.
+#define CELL_TABLE_NONE 0 // test every particle
+#define CELL_TABLE_HASH 1 // `hash_buckets_`, `cells_`
+#define CELL_TABLE_SLOTS 2 // `cell_slots_`
+
 layout(push_constant, std140) uniform PushConstants {
     mat4 world_to_screen_transform_inverse_;
     vec2 viewport_offset_in_window_;
@@ -16,8 +47,28 @@ layout(push_constant, std140) uniform PushConstants {
     uint particle_count_;
     float particle_radius_;
     float max_travel_distance_;
+
+    uint cell_table_kind_;
+    uint cell_table_size_;
+    // See `gfx::ParticleGrid::permuted`.
+    uint permuted_;
+    float cell_size_reciprocal_;
+    float max_displacement_;
+    uint domain_bounds_slot_;
+
+    // 0 if the particles weren't binned into tiles
+    uint tile_count_x_;
+    // see particle.vert
+    uint tile_count_y_;
 };
 
+// the origin of the cells
+#define DOMAIN_MIN (domain_bounds_[2 * domain_bounds_slot_].xyz)
+#define DOMAIN_MAX (domain_bounds_[2 * domain_bounds_slot_ + 1].xyz)
+
+// Bounds the ray march, in case of a huge domain.
+#define MAX_CELL_STEPS 4096
+
 
 float getParticleIntersectionDistance(vec3 ray_origin, vec3 ray_direction_unit, vec3 particle_pos) {
 
@@ -55,6 +106,229 @@ float getNearestParticleIntersection(vec3 ray_origin, vec3 ray_direction_unit, o
     return min_distance;
 }
 
+// The cell lookup of the sim; must match `fluidSim_util.comp.h`, which we can't #include, because the shaders in
+// this file are compiled at runtime without an include callback.
+
+#define CELL_SLOT_EMPTY 0xFFFFFFFFu
+#define CELL_TABLE_DENSE 1u
+
+uint separateBitsByTwo(uint x) {
+    x &= 0x000003ff;
+    x = (x * 0x00010001u) & 0xff0000ff;
+    x = (x * 0x00000101u) & 0x0300f00f;
+    x = (x * 0x00000011u) & 0x030c30c3;
+    x = (x * 0x00000005u) & 0x09249249;
+    return x;
+}
+
+uint cellMortonCode30(uvec3 cell_index) {
+    return
+        (separateBitsByTwo(cell_index.x)     ) |
+        (separateBitsByTwo(cell_index.y) << 1) |
+        (separateBitsByTwo(cell_index.z) << 2) ;
+}
+
+uvec2 cellMortonCode(uvec3 cell_index) {
+
+    uint lo = cellMortonCode30(cell_index);
+    lo |= ((cell_index.x >> 10) & 1u) << 30;
+    lo |= ((cell_index.y >> 10) & 1u) << 31;
+    uint hi = (cell_index.z >> 10) & 1u;
+    hi |= cellMortonCode30(cell_index >> 11) << 1;
+
+    return uvec2(lo, hi);
+}
+
+uint denseCellSlot(uvec3 cell_idx_3d, uvec4 header) {
+    if (any(greaterThan(cell_idx_3d, header.xyz))) return CELL_SLOT_EMPTY;
+    const uvec3 dims = header.xyz + 1u;
+    return cell_idx_3d.x + dims.x * (cell_idx_3d.y + dims.y * cell_idx_3d.z);
+}
+
+uint mortonCodeHash(uvec2 cell_morton_code, uint hash_table_size) {
+    const uint key = cell_morton_code.x ^ (cell_morton_code.y * 0x85EBCA6Bu);
+    const int bit_count = findMSB(hash_table_size);
+    return (key * 0x9E3779B1u) >> (32 - bit_count);
+}
+
+/// The index in `particles_` of the particle at `cell_list_idx` in the cell list.
+uint cellListParticle(uint cell_list_idx) {
+    return (permuted_ != 0) ? permutation_[cell_list_idx] : cell_list_idx;
+}
+
+/// The first particle in the cell list of the cell, and the particle count, which is 0 if the cell is empty.
+uvec2 lookUpCell(ivec3 cell) {
+
+    // the domain has no cells below its origin
+    if (any(lessThan(cell, ivec3(0)))) return uvec2(0);
+
+    const uvec2 morton_code = cellMortonCode(uvec3(cell));
+
+    if (cell_table_kind_ == CELL_TABLE_SLOTS)
+    {
+        // The slot after the table is its header; see CELL_TABLE_DENSE in fluidSim_util.comp.h.
+        const uvec4 header = cell_slots_[cell_table_size_];
+        if (header.w == CELL_TABLE_DENSE)
+        {
+            const uint slot_idx = denseCellSlot(uvec3(cell), header);
+            if (slot_idx == CELL_SLOT_EMPTY) return uvec2(0);
+            const uvec4 slot = cell_slots_[slot_idx];
+            return (slot.z == CELL_SLOT_EMPTY) ? uvec2(0) : slot.zw;
+        }
+
+        // The table is never full, so this finds an empty slot if the cell doesn't exist.
+        uint slot_idx = mortonCodeHash(morton_code, cell_table_size_);
+        while (true)
+        {
+            const uvec4 slot = cell_slots_[slot_idx];
+            if (slot.z == CELL_SLOT_EMPTY) return uvec2(0);
+            if (slot.xy == morton_code) return slot.zw;
+
+            slot_idx = (slot_idx + 1) & (cell_table_size_ - 1);
+        }
+    }
+
+    const uvec2 bucket = hash_buckets_[mortonCodeHash(morton_code, cell_table_size_)];
+    const uint cell_idx_end = bucket.x + bucket.y;
+
+    for (uint cell_idx = bucket.x; cell_idx < cell_idx_end; cell_idx++)
+    {
+        // the cell of its first particle, as of when the structure was built
+        const uvec2 cell = cells_[cell_idx];
+        const vec3 first_position =
+            (permuted_ != 0) ? particles_[permutation_[cell.x]] : positions_reference_[cell.x];
+        const uvec3 first_cell = uvec3((first_position - DOMAIN_MIN) * cell_size_reciprocal_);
+
+        if (cellMortonCode(first_cell) == morton_code) return cell;
+    }
+
+    return uvec2(0);
+}
+
+void intersectParticlesInCells(
+    vec3 ray_origin,
+    vec3 ray_direction_unit,
+    ivec3 cells_min,
+    ivec3 cells_max,
+    inout float min_distance,
+    inout uint min_particle
+) {
+    for (int z = cells_min.z; z <= cells_max.z; z++)
+    for (int y = cells_min.y; y <= cells_max.y; y++)
+    for (int x = cells_min.x; x <= cells_max.x; x++)
+    {
+        const uvec2 cell = lookUpCell(ivec3(x, y, z));
+
+        for (uint i = cell.x; i < cell.x + cell.y; i++)
+        {
+            const uint particle_idx = cellListParticle(i);
+            const float dist =
+                getParticleIntersectionDistance(ray_origin, ray_direction_unit, particles_[particle_idx]);
+            if (dist < min_distance) {
+                min_distance = dist;
+                min_particle = particle_idx;
+            }
+        }
+    }
+}
+
+/// Like `getNearestParticleIntersection`, but only tests the particles listed near the cells that the ray
+/// crosses, which it visits in order with a 3D DDA ("A Fast Voxel Traversal Algorithm for Ray Tracing" by
+/// J. Amanatides and A. Woo), so it can stop at the first cell that contains a hit.
+float getNearestParticleIntersectionInGrid(vec3 ray_origin, vec3 ray_direction_unit, out uint particle_idx_out) {
+
+    float min_distance = (1.0f / 0.0f);
+    uint min_particle = particle_count_;
+    particle_idx_out = min_particle;
+
+    // A particle may have moved `max_displacement_` out of the cell it's listed in, and its sphere reaches
+    // `particle_radius_` further; so a hit in some cell can belong to a particle listed up to `neighbor_range`
+    // cells away.
+    const float reach = max_displacement_ + particle_radius_;
+    const int neighbor_range = int(ceil(reach * cell_size_reciprocal_));
+    const float cell_size = 1.0f / cell_size_reciprocal_;
+
+    // clip the ray to the domain, grown by `reach`, outside of which there is nothing to hit
+    const vec3 inv_direction = 1.0f / ray_direction_unit;
+    const vec3 domain_min = DOMAIN_MIN;
+    const vec3 t_to_min = (domain_min - reach - ray_origin) * inv_direction;
+    const vec3 t_to_max = (DOMAIN_MAX + reach - ray_origin) * inv_direction;
+    const vec3 t_near = min(t_to_min, t_to_max);
+    const vec3 t_far = max(t_to_min, t_to_max);
+    const float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0f));
+    const float t_exit = min(min(t_far.x, t_far.y), min(t_far.z, max_travel_distance_));
+    if (t_enter > t_exit) return min_distance;
+
+    // in cells, relative to the origin of the cells
+    const vec3 entry = (ray_origin + t_enter * ray_direction_unit - domain_min) * cell_size_reciprocal_;
+    ivec3 cell = ivec3(floor(entry));
+
+    const ivec3 step = ivec3(sign(ray_direction_unit));
+    const bvec3 axis_is_parallel = equal(step, ivec3(0));
+    // the ray distances to the next cell boundary along each axis, and between the boundaries
+    vec3 t_next = t_enter + (vec3(cell + max(step, ivec3(0))) - entry) * cell_size * inv_direction;
+    t_next = mix(t_next, vec3(1.0f / 0.0f), axis_is_parallel);
+    const vec3 t_delta = mix(abs(cell_size * inv_direction), vec3(1.0f / 0.0f), axis_is_parallel);
+
+    // the first cell's whole neighborhood; then, each step only adds the face of the neighborhood on the side
+    // that it stepped to
+    intersectParticlesInCells(
+        ray_origin, ray_direction_unit, cell - neighbor_range, cell + neighbor_range, min_distance, min_particle
+    );
+
+    for (uint i = 0; i < MAX_CELL_STEPS; i++)
+    {
+        // Every hit in the cells visited so far has been found, and later hits are further than the cell's exit.
+        const float t_cell_exit = min(min(t_next.x, t_next.y), t_next.z);
+        if (min_distance <= t_cell_exit || t_cell_exit > t_exit) break;
+
+        const uint axis = (t_next.x <= t_next.y && t_next.x <= t_next.z) ? 0u : (t_next.y <= t_next.z) ? 1u : 2u;
+        cell[axis] += step[axis];
+        t_next[axis] += t_delta[axis];
+
+        ivec3 face_min = cell - neighbor_range;
+        ivec3 face_max = cell + neighbor_range;
+        face_min[axis] = face_max[axis] = cell[axis] + step[axis] * neighbor_range;
+        intersectParticlesInCells(ray_origin, ray_direction_unit, face_min, face_max, min_distance, min_particle);
+    }
+
+    particle_idx_out = min_particle;
+    return min_distance;
+}
+
+/// Like `getNearestParticleIntersection`, but only tests the particles binned into the pixel's tile, which are
+/// sorted nearest first, so it can stop at the first one that can't be nearer than the nearest hit so far. Falls
+/// back to testing every particle if the tile's list overflowed.
+float getNearestParticleIntersectionInTile(vec3 ray_origin, vec3 ray_direction_unit, out uint particle_idx_out) {
+
+    const uvec2 tile = uvec2((gl_FragCoord.xy - viewport_offset_in_window_) / TILE_SIZE);
+    const uvec2 range = tile_ranges_[tile.y * tile_count_x_ + tile.x];
+    if (range.y == TILE_OVERFLOWED) return getNearestParticleIntersection(ray_origin, ray_direction_unit, particle_idx_out);
+
+    float min_distance = (1.0f / 0.0f);
+    uint min_particle = particle_count_;
+    // the clip-space w of the nearest hit, which the entries' keys are lower bounds of
+    float min_w = (1.0f / 0.0f);
+    const bool sorted = range.y <= TILE_SORT_CAPACITY;
+
+    for (uint i = range.x; i < range.x + range.y; i++)
+    {
+        const uvec2 entry = tile_entries_[i];
+        // strictly, since under an orthographic projection every key and w are equal
+        if (sorted && uintBitsToFloat(entry.x) > min_w) break;
+
+        const float dist = getParticleIntersectionDistance(ray_origin, ray_direction_unit, particles_[entry.y]);
+        if (dist < min_distance) {
+            min_distance = dist;
+            min_particle = entry.y;
+            min_w = (world_to_screen_transform_ * vec4(ray_origin + dist * ray_direction_unit, 1.0f)).w;
+        }
+    }
+
+    particle_idx_out = min_particle;
+    return min_distance;
+}
+
 void main(void) {
 
     vec2 f = gl_FragCoord.xy;
@@ -75,7 +349,10 @@ void main(void) {
     const vec3 start_pos = point_on_near_plane;
 
     uint particle_idx = particle_count_;
-    const float dist = getNearestParticleIntersection(start_pos, direction_unit, particle_idx);
+    const float dist =
+        (tile_count_x_ != 0) ? getNearestParticleIntersectionInTile(start_pos, direction_unit, particle_idx)
+        : (cell_table_kind_ == CELL_TABLE_NONE) ? getNearestParticleIntersection(start_pos, direction_unit, particle_idx)
+        : getNearestParticleIntersectionInGrid(start_pos, direction_unit, particle_idx);
     if (dist < 0 || dist > max_travel_distance_ || particle_idx >= particle_count_) discard;
 
     vec3 particle = particles_[particle_idx];
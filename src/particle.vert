@@ -1,5 +1,37 @@
 #version 450
 
+// The particles binned into screen tiles, and each tile's depth bound; see particle_tiles.comp.h. Only read if
+// `tile_count_y_ != 0`.
+// (count, inverted bits of the depth bound) per tile
+layout(binding = 13, std430) readonly buffer TileCounts { uvec2 tile_counts_[]; };
+// (first entry, entry count) per tile
+layout(binding = 14, std430) readonly buffer TileRanges { uvec2 tile_ranges_[]; };
+
+// Must match particle_tiles.comp.h.
+#define TILE_SIZE 16
+
+// Must match particle.frag.
+layout(push_constant, std140) uniform PushConstants {
+    mat4 world_to_screen_transform_inverse_;
+    vec2 viewport_offset_in_window_;
+    vec2 viewport_size_in_window_;
+
+    uint particle_count_;
+    float particle_radius_;
+    float max_travel_distance_;
+
+    uint cell_table_kind_;
+    uint cell_table_size_;
+    uint permuted_;
+    float cell_size_reciprocal_;
+    float max_displacement_;
+    uint domain_bounds_slot_;
+
+    uint tile_count_x_;
+    // 0 to draw the whole viewport as a single quad
+    uint tile_count_y_;
+};
+
 vec2 fullscreen_quad_vertices[6] = {
     { -1.0, -1.0 },
     { -1.0,  1.0 },
@@ -11,8 +43,27 @@ vec2 fullscreen_quad_vertices[6] = {
 };
 
 void main(void) {
-    // We're not doing `VertexIndex % 6` because you're only supposed to run this with one quad as input.
+    // We're not doing `VertexIndex % 6` because you're only supposed to run this with one quad per instance.
     vec2 vertex_pos = fullscreen_quad_vertices[gl_VertexIndex];
-    gl_Position = vec4(vertex_pos, 0.0, 1.0);
-}
 
+    // The whole viewport, at the near plane, which every hit is behind.
+    if (tile_count_y_ == 0) {
+        gl_Position = vec4(vertex_pos, 0.0, 1.0);
+        return;
+    }
+
+    // An instance per tile: the tile, at the least depth of the particles binned into it, which every hit in the
+    // tile is behind, as particle.frag declares with `depth_greater`; so that the depth test can reject the pixels
+    // where something nearer was drawn before they're shaded. The empty tiles aren't drawn at all.
+    const uint tile_idx = gl_InstanceIndex;
+    if (tile_ranges_[tile_idx].y == 0) {
+        gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    const uvec2 tile = uvec2(tile_idx % tile_count_x_, tile_idx / tile_count_x_);
+    // the same mapping from pixels to NDC as particle.frag; the last tiles are clipped to the viewport
+    const vec2 pixels = (vec2(tile) + 0.5 * (vertex_pos + 1.0)) * TILE_SIZE;
+    const float depth_bound = uintBitsToFloat(~tile_counts_[tile_idx].y);
+    gl_Position = vec4(2.0 * pixels / viewport_size_in_window_ - 1.0, depth_bound, 1.0);
+}
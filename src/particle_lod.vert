@@ -0,0 +1,61 @@
+#version 450
+
+// a `ParticleLodInstance`: a particle, or a sphere standing in for a cell's particles; see particle_lod.comp
+layout(location = 0) in vec3 particle_coord_worldspace_;
+layout(location = 1) in vec4 in_color_;
+layout(location = 2) in float particle_radius_;
+
+layout(location = 0) out vec3 out_position_worldspace_;
+layout(location = 1) flat out vec3 out_particle_coord_worldspace_;
+layout(location = 2) flat out vec4 out_color_;
+layout(location = 3) flat out float out_particle_radius_;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp; the radius is the instance's instead.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+};
+
+// a triangle strip
+const vec2 QUAD_CORNERS[4] = {
+    { -1.0f, -1.0f },
+    {  1.0f, -1.0f },
+    { -1.0f,  1.0f },
+    {  1.0f,  1.0f },
+};
+
+// Like particle_rasterize.vert, with the radius per instance.
+void main(void) {
+
+    const float r = particle_radius_;
+    const vec3 to_center = particle_coord_worldspace_ - camera_position_;
+    const float center_distance = length(to_center);
+
+    // the camera is inside the sphere; degenerate, so that it's not drawn
+    if (center_distance <= r) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    const vec3 forward = to_center / center_distance;
+    const vec3 up_hint = (abs(forward.y) < 0.99f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    const vec3 right = normalize(cross(forward, up_hint));
+    const vec3 up = cross(right, forward);
+
+    // Touching the front of the sphere, so that every point of the sphere is behind the quad (see the
+    // `depth_greater` in particle_rasterize.frag); and as wide as the cone from the camera that grazes the sphere.
+    const float plane_distance = center_distance - r;
+    const float half_size = r * plane_distance / sqrt(center_distance * center_distance - r * r);
+
+    const vec2 corner = QUAD_CORNERS[gl_VertexIndex];
+    const vec3 position =
+        camera_position_ + plane_distance * forward + half_size * (corner.x * right + corner.y * up);
+
+    gl_Position = world_to_screen_transform_ * vec4(position, 1.0f);
+    out_position_worldspace_ = position;
+    out_particle_coord_worldspace_ = particle_coord_worldspace_;
+    out_color_ = in_color_;
+    out_particle_radius_ = r;
+}
@@ -0,0 +1,31 @@
+
+// Shared by particle_mesh.task and particle_mesh.mesh.
+
+// Must match PARTICLE_CLUSTER_SIZE and PARTICLE_CLUSTERS_PER_TASK in graphics.cpp.
+#define PARTICLE_CLUSTER_SIZE 32
+#define PARTICLE_CLUSTERS_PER_TASK 32
+
+// `gfx::Particle`
+struct Particle {
+    vec3 coord;
+    uint color; // RGBA8
+};
+layout(binding = 2, std430) readonly buffer Particles {
+    Particle particles_[];
+};
+
+// Must match `ParticleMeshPipelinePushConstants` in graphics.cpp. Starts like the push constants of
+// particle_rasterize.frag, which is the fragment shader.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+    // in world space; (normal, distance), with unit normals pointing into the frustum
+    vec4 frustum_planes_[6];
+    uint particle_count_;
+    // of occlusion culling; see particle_mesh.task
+    uint phase_;
+};
+
+struct ParticleMeshTaskPayload {
+    uint cluster_indices[PARTICLE_CLUSTERS_PER_TASK];
+};
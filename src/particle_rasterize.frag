@@ -1,10 +1,41 @@
 #version 450
 
-layout(location = 0) in vec4 color_in_;
+layout(location = 0) in vec3 position_worldspace_in_;
+layout(location = 1) flat in vec3 particle_coord_worldspace_in_;
+layout(location = 2) flat in vec4 color_in_;
 
 layout(location = 0) out vec4 color_out_;
+// The sphere is behind its quad, so the depth test against the quad's depth can still be done early.
+layout(depth_greater) out float gl_FragDepth;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp, and particle_rasterize.vert; the mesh pipeline
+// shares the fragment shader, so also the start of `ParticleMeshPipelinePushConstants` and particle_mesh.mesh.h.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+};
 
 void main(void) {
-    color_out_ = color_in_;
-}
 
+    const float r = particle_radius_;
+    const vec3 ray_direction_unit = normalize(position_worldspace_in_ - camera_position_);
+    const vec3 to_center = particle_coord_worldspace_in_ - camera_position_;
+
+    // the nearer root of |camera + t * direction - center| = r
+    const float b = dot(ray_direction_unit, to_center);
+    const float discriminant = b * b - (dot(to_center, to_center) - r * r);
+    if (discriminant < 0.0f) discard;
+    const float t = b - sqrt(discriminant);
+
+    const vec3 hit = camera_position_ + t * ray_direction_unit;
+    const vec3 normal_unit = (hit - particle_coord_worldspace_in_) / r;
+
+    const float diffuse = max(dot(normal_unit, normalize(vec3(1.0f))), 0.0f);
+    color_out_ = vec4(color_in_.rgb * (0.3f + 0.7f * diffuse), color_in_.a);
+
+    const vec4 hit_clip_space = world_to_screen_transform_ * vec4(hit, 1.0f);
+    gl_FragDepth = hit_clip_space.z / hit_clip_space.w;
+}
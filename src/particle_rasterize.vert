@@ -1,60 +1,61 @@
 #version 450
 
-layout(location = 0) in vec3 voxel_coord_worldspace_;
+layout(location = 0) in vec3 particle_coord_worldspace_;
 layout(location = 1) in vec4 in_color_;
 
-layout(location = 0) out vec4 out_color_;
+layout(location = 0) out vec3 out_position_worldspace_;
+layout(location = 1) flat out vec3 out_particle_coord_worldspace_;
+layout(location = 2) flat out vec4 out_color_;
+layout(location = 3) flat out uint out_particle_idx_; // for object_id_particle.frag
 
 layout(binding = 0, std140) uniform Uniforms {
     mat4 world_to_screen_transform_;
 };
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp, and particle_rasterize.frag.
 layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
     float particle_radius_;
 };
 
-const vec3 CUBE_VERTICES[8] = {
-    { -1.0f, -1.0f,  1.0f },
-    {  1.0f, -1.0f,  1.0f },
-    { -1.0f,  1.0f,  1.0f },
-    {  1.0f,  1.0f,  1.0f },
-    { -1.0f, -1.0f, -1.0f },
-    {  1.0f, -1.0f, -1.0f },
-    { -1.0f,  1.0f, -1.0f },
-    {  1.0f,  1.0f, -1.0f },
-};
-
-const uint TRIANGLES_VERTEX_INDICES[36] = {
-    // back face
-    1, 2, 0,
-    1, 3, 2,
-    // front face
-    5, 4, 6,
-    5, 6, 7,
-    // left face
-    0, 2, 6,
-    0, 6, 4,
-    // right face
-    1, 5, 7,
-    1, 7, 3,
-    // top face
-    1, 0, 4,
-    1, 4, 5,
-    // bottom face
-    7, 6, 2,
-    7, 2, 3,
+// a triangle strip
+const vec2 QUAD_CORNERS[4] = {
+    { -1.0f, -1.0f },
+    {  1.0f, -1.0f },
+    { -1.0f,  1.0f },
+    {  1.0f,  1.0f },
 };
 
+// An impostor: a quad facing the camera, in front of the sphere, that covers its silhouette; particle_rasterize.frag
+// ray casts the sphere in it.
 void main(void) {
 
-    const uint cube_vertex_idx = TRIANGLES_VERTEX_INDICES[gl_VertexIndex];
-    vec4 vertex_pos = vec4(particle_radius_ * CUBE_VERTICES[cube_vertex_idx], 1.0);
-
-    vertex_pos.xyz = vertex_pos.xyz + voxel_coord_worldspace_;
-    vertex_pos = world_to_screen_transform_ * vertex_pos;
-
-    gl_Position = vertex_pos;
-    // out_color_ = vec4((float(cube_vertex_idx) * (1.0f / 7.0f)) * vec3(0.0f, 0.5f, 1.0f), 1.0f);
+    const float r = particle_radius_;
+    const vec3 to_center = particle_coord_worldspace_ - camera_position_;
+    const float center_distance = length(to_center);
+
+    // the camera is inside the sphere; degenerate, so that it's not drawn
+    if (center_distance <= r) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    const vec3 forward = to_center / center_distance;
+    const vec3 up_hint = (abs(forward.y) < 0.99f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    const vec3 right = normalize(cross(forward, up_hint));
+    const vec3 up = cross(right, forward);
+
+    // Touching the front of the sphere, so that every point of the sphere is behind the quad (see the
+    // `depth_greater` in particle_rasterize.frag); and as wide as the cone from the camera that grazes the sphere.
+    const float plane_distance = center_distance - r;
+    const float half_size = r * plane_distance / sqrt(center_distance * center_distance - r * r);
+
+    const vec2 corner = QUAD_CORNERS[gl_VertexIndex];
+    const vec3 position =
+        camera_position_ + plane_distance * forward + half_size * (corner.x * right + corner.y * up);
+
+    gl_Position = world_to_screen_transform_ * vec4(position, 1.0f);
+    out_position_worldspace_ = position;
+    out_particle_coord_worldspace_ = particle_coord_worldspace_;
     out_color_ = in_color_;
+    out_particle_idx_ = gl_InstanceIndex;
 }
-
-
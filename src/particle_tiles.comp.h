@@ -0,0 +1,121 @@
+
+// Shared by the `particle_tiles_*.comp` stages, which bin the particles into the screen tiles that their spheres
+// cover, for particle.frag to test only its tile's list:
+//     1. count: each particle adds 1 to `tile_counts_` of each tile it covers, and lowers the tile's depth bound to
+//        its own.
+//     2. scan: a single workgroup turns the counts into `tile_ranges_`, and zeroes the counts.
+//     3. bin: each particle writes its entry into each tile it covers, counting again to find its place.
+//     4. sort: a workgroup per tile sorts the tile's entries by depth, nearest first.
+// `tile_counts_` must be 0 before the count dispatch. particle.vert then draws each tile at its depth bound.
+
+// Must match PARTICLE_TILE_SIZE in graphics.cpp and TILE_SIZE in particle.frag.
+#define TILE_SIZE 16
+// `tile_ranges_[tile].y` of a tile whose entries didn't fit in `tile_entries_`, which is then left without a
+// list. Must match particle.frag.
+#define TILE_OVERFLOWED 0xFFFFFFFFu
+// Tiles with more entries than this aren't sorted. Must match particle.frag.
+#define TILE_SORT_CAPACITY 1024
+
+layout(binding = 2, std430) readonly buffer Particles {
+    vec3 particles_[];
+};
+// (count, depth bound) per tile. The bound is the least `depthBound()` of the tile's particles, as its inverted
+// float bits: non-negative floats sort like their bits, so `atomicMax()` of the inverted ones keeps the least, and
+// a zeroed count is no bound at all. Must match particle.vert.
+layout(binding = 13, std430) buffer TileCounts {
+    uvec2 tile_counts_[];
+};
+// (first entry, entry count) per tile
+layout(binding = 14, std430) buffer TileRanges {
+    uvec2 tile_ranges_[];
+};
+// (depth key, particle index); see `depthKey()`
+layout(binding = 15, std430) buffer TileEntries {
+    uvec2 tile_entries_[];
+};
+
+// Must match `ParticleTilesPipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    mat4 world_to_screen_transform_;
+    vec2 viewport_size_;
+    uint particle_count_;
+    float particle_radius_;
+    uint tile_count_x_;
+    uint tile_count_y_;
+    uint entry_capacity_;
+};
+
+/// Whether the sphere of `particle_pos` may cover a pixel in front of the camera, and, if so, the inclusive range
+/// of tiles that it covers.
+bool getCoveredTiles(vec3 particle_pos, out uvec2 tiles_min_out, out uvec2 tiles_max_out) {
+
+    tiles_min_out = uvec2(0);
+    tiles_max_out = uvec2(0);
+
+    // The projection of the sphere is inside the projection of its bounding cube, which, since the projection
+    // preserves convexity in front of the camera, is inside the bounding box of the projected corners.
+    vec2 ndc_min = vec2(1.0f / 0.0f);
+    vec2 ndc_max = vec2(-1.0f / 0.0f);
+    uint corners_in_front = 0;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        const vec3 offset = mix(vec3(-particle_radius_), vec3(particle_radius_), bvec3(uvec3(corner) & uvec3(1, 2, 4)));
+        const vec4 p = world_to_screen_transform_ * vec4(particle_pos + offset, 1.0f);
+        if (p.w <= 0.0f) continue;
+
+        corners_in_front++;
+        ndc_min = min(ndc_min, p.xy / p.w);
+        ndc_max = max(ndc_max, p.xy / p.w);
+    }
+    if (corners_in_front == 0) return false;
+    // straddles the camera plane, so it may cover any pixel
+    if (corners_in_front < 8) {
+        ndc_min = vec2(-1.0f);
+        ndc_max = vec2(1.0f);
+    }
+
+    // the same mapping from pixels to rays as particle.frag
+    const vec2 pixels_min = (ndc_min + 1.0f) * 0.5f * viewport_size_;
+    const vec2 pixels_max = (ndc_max + 1.0f) * 0.5f * viewport_size_;
+    const vec2 tile_counts = vec2(tile_count_x_, tile_count_y_);
+    if (any(lessThan(pixels_max, vec2(0.0f))) || any(greaterThanEqual(pixels_min, tile_counts * TILE_SIZE))) {
+        return false;
+    }
+
+    tiles_min_out = uvec2(clamp(floor(pixels_min / TILE_SIZE), vec2(0.0f), tile_counts - 1.0f));
+    tiles_max_out = uvec2(clamp(floor(pixels_max / TILE_SIZE), vec2(0.0f), tile_counts - 1.0f));
+    return true;
+}
+
+/// A lower bound of the clip-space w of the points of the sphere, as uint bits that sort like the float. W is
+/// linear in the position, so particle.frag can stop at the first entry whose key is at least the w of its
+/// nearest hit.
+uint depthKey(vec3 particle_pos) {
+
+    const vec4 w_row = vec4(
+        world_to_screen_transform_[0][3], world_to_screen_transform_[1][3],
+        world_to_screen_transform_[2][3], world_to_screen_transform_[3][3]
+    );
+    const float w_min = dot(w_row, vec4(particle_pos, 1.0f)) - particle_radius_ * length(w_row.xyz);
+
+    // non-negative floats sort like their bits
+    return floatBitsToUint(max(w_min, 0.0f));
+}
+
+/// A lower bound of the depth (clip-space z / w) of the points of the sphere, for particle.vert to draw its tiles
+/// at: that of the nearest corner of its bounding cube, since z / w, a ratio of linear functions, is least at a
+/// corner of a convex region in front of the camera. 0 if the cube straddles the camera plane.
+float depthBound(vec3 particle_pos) {
+
+    float depth_min = 1.0f;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        const vec3 offset = mix(vec3(-particle_radius_), vec3(particle_radius_), bvec3(uvec3(corner) & uvec3(1, 2, 4)));
+        const vec4 p = world_to_screen_transform_ * vec4(particle_pos + offset, 1.0f);
+        if (p.w <= 0.0f) return 0.0f;
+
+        depth_min = min(depth_min, p.z / p.w);
+    }
+
+    return max(depth_min, 0.0f);
+}
@@ -0,0 +1,47 @@
+#version 450
+
+layout(location = 0) out vec4 color_out_;
+
+// The ray-marched particles, which particle.frag drew into the frame's scaled particle images at the render scale;
+// see `recordScaledParticles()` in graphics.cpp. Must match the SCALED_PARTICLE_* bindings there.
+layout(binding = 32) uniform sampler2D scaled_color_;
+layout(binding = 33) uniform sampler2D scaled_depth_;
+
+// Must match `ParticleUpscalePipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    vec2 viewport_offset_in_window_;
+    // the texels of the images that were drawn, from the top left
+    uvec2 scaled_extent_;
+    float render_scale_;
+};
+
+vec4 fetchColor(ivec2 texel) {
+    return texelFetch(scaled_color_, clamp(texel, ivec2(0), ivec2(scaled_extent_) - 1), 0);
+}
+
+// The last pass of the ray-marched particles at the render scale: upscales them into the frame, with their depths.
+// The depth, and so whether there's a particle, is the nearest texel's, as depths don't interpolate across a
+// silhouette; the color is interpolated bilinearly, from the texels with a particle.
+void main(void) {
+
+    // in texels of the scaled images
+    const vec2 coord = (gl_FragCoord.xy - viewport_offset_in_window_) * render_scale_;
+
+    const ivec2 nearest = clamp(ivec2(coord), ivec2(0), ivec2(scaled_extent_) - 1);
+    const float depth = texelFetch(scaled_depth_, nearest, 0).r;
+    // cleared; see `ScaledParticleImage`
+    if (depth == 1.0f) discard;
+
+    const vec2 p = coord - 0.5f;
+    const ivec2 p0 = ivec2(floor(p));
+    const vec2 f = p - vec2(p0);
+    // The texels without a particle are (0, 0, 0, 0), and those with one have an alpha of 1, so the alpha is the
+    // weight of the ones with a particle.
+    const vec4 color = mix(
+        mix(fetchColor(p0), fetchColor(p0 + ivec2(1, 0)), f.x),
+        mix(fetchColor(p0 + ivec2(0, 1)), fetchColor(p0 + ivec2(1, 1)), f.x),
+        f.y
+    );
+    color_out_ = (color.a > 0.0f) ? vec4(color.rgb / color.a, 1.0f) : vec4(fetchColor(nearest).rgb, 1.0f);
+    gl_FragDepth = depth;
+}
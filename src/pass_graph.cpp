@@ -0,0 +1,417 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "error_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "pass_graph.hpp"
+
+namespace pass_graph {
+
+//
+// ===========================================================================================================
+//
+
+/// The barrier before a level, or after the graph. When the buffer barriers run out, the rest are merged into
+/// `memory_barrier`, which then covers every buffer.
+struct BarrierBatch {
+    VkBufferMemoryBarrier2 buffer_barriers[MAX_ACCESS_COUNT];
+    u32 buffer_barrier_count;
+    VkMemoryBarrier2 memory_barrier; // the execution dependencies of the writes after reads, and the overflow
+};
+
+//
+// ===========================================================================================================
+//
+
+static inline VkDeviceSize rangeEnd(VkDeviceSize offset, VkDeviceSize size) {
+    return (size == VK_WHOLE_SIZE) ? VK_WHOLE_SIZE : offset + size;
+}
+
+
+static bool accessesConflict(const Access* a, const Access* b) {
+    return
+        (a->write or b->write) and a->buffer == b->buffer
+        and a->offset < rangeEnd(b->offset, b->size) and b->offset < rangeEnd(a->offset, a->size);
+}
+
+
+static bool passesConflict(const Graph* graph, const Pass* a, const Pass* b) {
+
+    for (u32 i = 0; i < a->access_count; i++) {
+        for (u32 j = 0; j < b->access_count; j++) {
+            const Access* access_a = &graph->accesses[a->first_access_idx + i];
+            const Access* access_b = &graph->accesses[b->first_access_idx + j];
+            if (accessesConflict(access_a, access_b)) return true;
+        }
+    }
+    return false;
+}
+
+
+/// Makes `src`'s write of `[offset, offset + size)` visible to `dst_stage_mask` and `dst_access_mask`.
+static void addBufferBarrier(
+    BarrierBatch* batch,
+    const Access* src,
+    VkDeviceSize offset,
+    VkDeviceSize size,
+    VkPipelineStageFlags2 dst_stage_mask,
+    VkAccessFlags2 dst_access_mask
+) {
+
+    for (u32 i = 0; i < batch->buffer_barrier_count; i++) {
+        VkBufferMemoryBarrier2* barrier = &batch->buffer_barriers[i];
+        if (barrier->buffer == src->buffer and barrier->offset == offset and barrier->size == size)
+        {
+            barrier->srcStageMask |= src->stage_mask;
+            barrier->srcAccessMask |= src->access_mask;
+            barrier->dstStageMask |= dst_stage_mask;
+            barrier->dstAccessMask |= dst_access_mask;
+            return;
+        }
+    }
+
+    if (batch->buffer_barrier_count == MAX_ACCESS_COUNT)
+    {
+        VkMemoryBarrier2* barrier = &batch->memory_barrier;
+        barrier->srcStageMask |= src->stage_mask;
+        barrier->srcAccessMask |= src->access_mask;
+        barrier->dstStageMask |= dst_stage_mask;
+        barrier->dstAccessMask |= dst_access_mask;
+        return;
+    }
+
+    batch->buffer_barriers[batch->buffer_barrier_count++] = VkBufferMemoryBarrier2 {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = src->stage_mask,
+        .srcAccessMask = src->access_mask,
+        .dstStageMask = dst_stage_mask,
+        .dstAccessMask = dst_access_mask,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = src->buffer,
+        .offset = offset,
+        .size = size,
+    };
+}
+
+
+/// The dependency of `dst` on `src`, where they conflict.
+static void addDependency(BarrierBatch* batch, const Access* src, const Access* dst) {
+
+    if (!src->write)
+    {
+        // a write after a read: the write only has to wait for the read
+        batch->memory_barrier.srcStageMask |= src->stage_mask;
+        batch->memory_barrier.dstStageMask |= dst->stage_mask;
+        return;
+    }
+
+    const VkDeviceSize offset = (src->offset > dst->offset) ? src->offset : dst->offset;
+    const VkDeviceSize src_end = rangeEnd(src->offset, src->size);
+    const VkDeviceSize dst_end = rangeEnd(dst->offset, dst->size);
+    const VkDeviceSize end = (src_end < dst_end) ? src_end : dst_end;
+    const VkDeviceSize size = (end == VK_WHOLE_SIZE) ? VK_WHOLE_SIZE : end - offset;
+
+    addBufferBarrier(batch, src, offset, size, dst->stage_mask, dst->access_mask);
+}
+
+
+static void recordBarrierBatch(const VulkanContext* vk_ctx, VkCommandBuffer cmd, const BarrierBatch* batch) {
+
+    const bool memory_barrier = batch->memory_barrier.srcStageMask != 0;
+    if (batch->buffer_barrier_count == 0 and !memory_barrier) return;
+
+    const VkDependencyInfo dependency_info {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = memory_barrier ? 1u : 0u,
+        .pMemoryBarriers = &batch->memory_barrier,
+        .bufferMemoryBarrierCount = batch->buffer_barrier_count,
+        .pBufferMemoryBarriers = batch->buffer_barriers,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+
+static void recordPass(const VulkanContext* vk_ctx, VkCommandBuffer cmd, const Pass* pass) {
+
+    const VulkanDeviceProcs* procs = &vk_ctx->procs_dev;
+
+    switch (pass->kind) {
+        case PASS_KIND_DISPATCH:
+        case PASS_KIND_DISPATCH_INDIRECT:
+            procs->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipeline);
+            if (pass->descriptor_set != VK_NULL_HANDLE) procs->CmdBindDescriptorSets(
+                cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipeline_layout, 0, 1, &pass->descriptor_set, 0, NULL
+            );
+            if (pass->push_constants_size != 0) procs->CmdPushConstants(
+                cmd, pass->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pass->push_constants_size, pass->data
+            );
+            if (pass->kind == PASS_KIND_DISPATCH) procs->CmdDispatch(cmd, pass->workgroup_count, 1, 1);
+            else procs->CmdDispatchIndirect(cmd, pass->buffer, pass->offset);
+            break;
+        case PASS_KIND_FILL:
+            procs->CmdFillBuffer(cmd, pass->buffer, pass->offset, pass->size, pass->fill_value);
+            break;
+        case PASS_KIND_UPDATE:
+            procs->CmdUpdateBuffer(cmd, pass->buffer, pass->offset, pass->size, pass->data);
+            break;
+        case PASS_KIND_HOST_READ:
+            break;
+        default: alwaysAssert(false);
+    }
+}
+
+//
+// ===========================================================================================================
+//
+
+static Pass* addPass(Graph* graph, PassKind kind) {
+
+    alwaysAssert(graph->pass_count < MAX_PASS_COUNT);
+    Pass* pass = &graph->passes[graph->pass_count++];
+    *pass = Pass { .kind = kind, .first_access_idx = graph->access_count, .access_count = 0 };
+    return pass;
+}
+
+
+static Pass* addDispatchPass(
+    Graph* graph,
+    PassKind kind,
+    VkPipeline pipeline,
+    VkPipelineLayout pipeline_layout,
+    VkDescriptorSet descriptor_set,
+    u32 push_constants_size,
+    const void* p_push_constants
+) {
+
+    alwaysAssert(push_constants_size <= MAX_PUSH_CONSTANTS_SIZE);
+
+    Pass* pass = addPass(graph, kind);
+    pass->pipeline = pipeline;
+    pass->pipeline_layout = pipeline_layout;
+    pass->descriptor_set = descriptor_set;
+    pass->push_constants_size = push_constants_size;
+    if (push_constants_size != 0) memcpy(pass->data, p_push_constants, push_constants_size);
+    return pass;
+}
+
+
+extern void addDispatch(
+    Graph* graph,
+    VkPipeline pipeline,
+    VkPipelineLayout pipeline_layout,
+    VkDescriptorSet descriptor_set,
+    u32 push_constants_size,
+    const void* p_push_constants,
+    u32 workgroup_count
+) {
+    Pass* pass = addDispatchPass(
+        graph, PASS_KIND_DISPATCH,
+        pipeline, pipeline_layout, descriptor_set, push_constants_size, p_push_constants
+    );
+    pass->workgroup_count = workgroup_count;
+}
+
+
+extern void addDispatchIndirect(
+    Graph* graph,
+    VkPipeline pipeline,
+    VkPipelineLayout pipeline_layout,
+    VkDescriptorSet descriptor_set,
+    u32 push_constants_size,
+    const void* p_push_constants,
+    VkBuffer indirect_buffer,
+    VkDeviceSize indirect_offset
+) {
+    Pass* pass = addDispatchPass(
+        graph, PASS_KIND_DISPATCH_INDIRECT,
+        pipeline, pipeline_layout, descriptor_set, push_constants_size, p_push_constants
+    );
+    pass->buffer = indirect_buffer;
+    pass->offset = indirect_offset;
+
+    addAccess(graph, Access {
+        .buffer = indirect_buffer,
+        .offset = indirect_offset,
+        .size = sizeof(VkDispatchIndirectCommand),
+        .stage_mask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+        .access_mask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+        .write = false,
+    });
+}
+
+
+extern void addFill(Graph* graph, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, u32 value) {
+
+    Pass* pass = addPass(graph, PASS_KIND_FILL);
+    pass->buffer = buffer;
+    pass->offset = offset;
+    pass->size = size;
+    pass->fill_value = value;
+
+    addAccess(graph, Access {
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .stage_mask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .access_mask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .write = true,
+    });
+}
+
+
+extern void addUpdate(Graph* graph, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, const void* p_data) {
+
+    alwaysAssert(size <= MAX_UPDATE_SIZE and size % 4 == 0);
+
+    Pass* pass = addPass(graph, PASS_KIND_UPDATE);
+    pass->buffer = buffer;
+    pass->offset = offset;
+    pass->size = size;
+    memcpy(pass->data, p_data, size);
+
+    addAccess(graph, Access {
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .stage_mask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .access_mask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .write = true,
+    });
+}
+
+
+extern void addHostRead(Graph* graph, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+
+    addPass(graph, PASS_KIND_HOST_READ);
+    addAccess(graph, Access {
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .stage_mask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .access_mask = VK_ACCESS_2_HOST_READ_BIT,
+        .write = false,
+    });
+}
+
+
+extern void reads(Graph* graph, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    addAccess(graph, Access {
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .stage_mask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .access_mask = VK_ACCESS_2_SHADER_READ_BIT,
+        .write = false,
+    });
+}
+
+
+extern void writes(Graph* graph, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    addAccess(graph, Access {
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+        .stage_mask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .access_mask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, // atomics read too
+        .write = true,
+    });
+}
+
+
+extern void addAccess(Graph* graph, Access access) {
+
+    alwaysAssert(graph->pass_count > 0);
+    if (access.buffer == VK_NULL_HANDLE or access.size == 0) return;
+
+    alwaysAssert(graph->access_count < MAX_ACCESS_COUNT);
+    graph->accesses[graph->access_count++] = access;
+    graph->passes[graph->pass_count - 1].access_count++;
+}
+
+
+extern void record(
+    const Graph* graph,
+    const VulkanContext* vk_ctx,
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags2 final_dst_stage_mask,
+    VkAccessFlags2 final_dst_access_mask
+) {
+
+    ZoneScoped;
+
+    const u32 pass_count = graph->pass_count;
+
+    // each pass goes right after the last one it conflicts with
+    u32 levels[MAX_PASS_COUNT] {};
+    u32 level_count = 0;
+    for (u32 j = 0; j < pass_count; j++) {
+        for (u32 i = 0; i < j; i++) {
+            if (levels[i] + 1 > levels[j] and passesConflict(graph, &graph->passes[i], &graph->passes[j])) {
+                levels[j] = levels[i] + 1;
+            }
+        }
+        if (levels[j] + 1 > level_count) level_count = levels[j] + 1;
+    }
+
+    BarrierBatch batch_storage;
+    BarrierBatch* batch = &batch_storage;
+
+    const VkMemoryBarrier2 empty_memory_barrier { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+
+    for (u32 level = 0; level < level_count; level++) {
+
+        if (level > 0)
+        {
+            batch->buffer_barrier_count = 0;
+            batch->memory_barrier = empty_memory_barrier;
+
+            for (u32 j = 0; j < pass_count; j++) {
+                if (levels[j] != level) continue;
+                const Pass* dst = &graph->passes[j];
+
+                for (u32 i = 0; i < j; i++) {
+                    if (levels[i] >= level) continue;
+                    const Pass* src = &graph->passes[i];
+
+                    for (u32 a = 0; a < src->access_count; a++) {
+                        for (u32 b = 0; b < dst->access_count; b++) {
+                            const Access* src_access = &graph->accesses[src->first_access_idx + a];
+                            const Access* dst_access = &graph->accesses[dst->first_access_idx + b];
+                            if (accessesConflict(src_access, dst_access)) addDependency(batch, src_access, dst_access);
+                        }
+                    }
+                }
+            }
+            recordBarrierBatch(vk_ctx, cmd, batch);
+        }
+
+        for (u32 j = 0; j < pass_count; j++) if (levels[j] == level) recordPass(vk_ctx, cmd, &graph->passes[j]);
+    }
+
+    if (final_dst_stage_mask != 0)
+    {
+        batch->buffer_barrier_count = 0;
+        batch->memory_barrier = empty_memory_barrier;
+        for (u32 i = 0; i < graph->access_count; i++) {
+            const Access* access = &graph->accesses[i];
+            if (!access->write) continue;
+            addBufferBarrier(
+                batch, access, access->offset, access->size, final_dst_stage_mask, final_dst_access_mask
+            );
+        }
+        recordBarrierBatch(vk_ctx, cmd, batch);
+    }
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
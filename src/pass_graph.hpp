@@ -0,0 +1,138 @@
+#ifndef _PASS_GRAPH_HPP
+#define _PASS_GRAPH_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+
+/// A sequence of compute and transfer passes that is recorded with the barriers between them worked out from what
+/// each pass says it reads and writes, instead of by hand. The passes are described first, as data; recording
+/// then puts each one at the earliest level after all of the passes that it conflicts with (a read after a write,
+/// a write after a read, or a write after a write, of overlapping ranges of a buffer), records the levels in
+/// order, and places one `vkCmdPipelineBarrier2()` between consecutive levels. The barrier has one buffer barrier
+/// for each range that a later level reads or writes after an earlier one wrote it. It covers only that range,
+/// with only the writer's and the reader's stages and accesses, and it merges barriers of the same range. A
+/// write after a read needs only an execution dependency, and those go in one memory barrier with no accesses.
+/// Passes that don't conflict share a level, so no barrier separates them, whatever order they were added in.
+///
+/// The caller places the barrier for the writes before the graph. The last argument of `record()` makes all of
+/// the graph's writes visible to what comes after it, or the caller places that barrier too.
+///
+/// Declaring too few accesses is a race. Declaring too many only adds dependencies, so when in doubt about what a
+/// shader touches, declare it.
+namespace pass_graph {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 MAX_PASS_COUNT = 32;
+constexpr u32 MAX_ACCESS_COUNT = 256;
+constexpr u32 MAX_PUSH_CONSTANTS_SIZE = 128; // the least `maxPushConstantsSize`
+constexpr u32 MAX_UPDATE_SIZE = 64;
+
+enum PassKind : u8 {
+    PASS_KIND_DISPATCH,
+    PASS_KIND_DISPATCH_INDIRECT,
+    PASS_KIND_FILL, // vkCmdFillBuffer
+    PASS_KIND_UPDATE, // vkCmdUpdateBuffer, of up to MAX_UPDATE_SIZE bytes
+    PASS_KIND_HOST_READ, // no commands: only orders the host's reads, after the submission, after the writes
+};
+
+/// `size` may be VK_WHOLE_SIZE.
+struct Access {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    VkPipelineStageFlags2 stage_mask;
+    VkAccessFlags2 access_mask;
+    bool write;
+};
+
+struct Pass {
+    PassKind kind;
+    u32 first_access_idx;
+    u32 access_count;
+
+    // PASS_KIND_DISPATCH and PASS_KIND_DISPATCH_INDIRECT
+    VkPipeline pipeline;
+    VkPipelineLayout pipeline_layout;
+    VkDescriptorSet descriptor_set; // or VK_NULL_HANDLE if the pipeline has none, or they were pushed
+    u32 push_constants_size;
+    u32 workgroup_count; // PASS_KIND_DISPATCH
+
+    // PASS_KIND_DISPATCH_INDIRECT, PASS_KIND_FILL and PASS_KIND_UPDATE
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size; // PASS_KIND_FILL and PASS_KIND_UPDATE
+    u32 fill_value;
+
+    // the push constants, or PASS_KIND_UPDATE's data
+    alignas(8) u8 data[MAX_PUSH_CONSTANTS_SIZE];
+};
+
+/// Value-initialize it (`pass_graph::Graph graph {};`), add the passes, then `record()` it. It's only data, so it
+/// may be a local.
+struct Graph {
+    Pass passes[MAX_PASS_COUNT];
+    Access accesses[MAX_ACCESS_COUNT];
+    u32 pass_count;
+    u32 access_count;
+};
+
+//
+// ===========================================================================================================
+//
+
+// Each of these adds a pass after the others. A pass's own accesses are added by the calls after it, up to the
+// next pass: the ones that the pass's commands imply (the fill's or the update's write, the indirect dispatch's
+// read of its command, the host's read) are already added.
+
+void addDispatch(
+    Graph*,
+    VkPipeline, VkPipelineLayout, VkDescriptorSet,
+    u32 push_constants_size, const void* p_push_constants,
+    u32 workgroup_count
+);
+
+/// Reads a `VkDispatchIndirectCommand` at `indirect_offset` in `indirect_buffer` when the dispatch executes.
+void addDispatchIndirect(
+    Graph*,
+    VkPipeline, VkPipelineLayout, VkDescriptorSet,
+    u32 push_constants_size, const void* p_push_constants,
+    VkBuffer indirect_buffer, VkDeviceSize indirect_offset
+);
+
+void addFill(Graph*, VkBuffer, VkDeviceSize offset, VkDeviceSize size, u32 value);
+
+void addUpdate(Graph*, VkBuffer, VkDeviceSize offset, VkDeviceSize size, const void* p_data);
+
+void addHostRead(Graph*, VkBuffer, VkDeviceSize offset, VkDeviceSize size);
+
+/// Shader reads and writes, in the compute stage, by the last dispatch added.
+void reads(Graph*, VkBuffer, VkDeviceSize offset, VkDeviceSize size);
+void writes(Graph*, VkBuffer, VkDeviceSize offset, VkDeviceSize size);
+
+/// Any other access by the last pass added.
+void addAccess(Graph*, Access);
+
+// Accesses of VK_NULL_HANDLE, and empty ones, are dropped, so that the buffers of optional features may be
+// declared whether or not they exist.
+
+/// Records the passes, and the barriers between them, then a barrier that makes each of the graph's writes
+/// visible to `final_dst_stage_mask` and `final_dst_access_mask`, unless they're 0.
+void record(
+    const Graph*,
+    const VulkanContext*,
+    VkCommandBuffer,
+    VkPipelineStageFlags2 final_dst_stage_mask,
+    VkAccessFlags2 final_dst_access_mask
+);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
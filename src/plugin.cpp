@@ -1,4 +1,8 @@
 #include <dlfcn.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
@@ -10,6 +14,7 @@
 #include <tracy/tracy/Tracy.hpp>
 
 #include "types.hpp"
+#include "trace.hpp"
 #include "defer.hpp"
 #include "error_util.hpp"
 #include "math_util.hpp"
@@ -147,31 +152,77 @@ extern const void* load(PluginID plugin_id) {
     return p_new_lib->p_procs_struct;
 }
 
-static bool runCommand(const char* command) {
+/// Logs `output`, one line at a time, at INFO if `failed` is false and at ERROR otherwise. Modifies it in place.
+static void logCommandOutput(char* output, bool failed) {
+    char* save_ptr = NULL;
+    for (char* line = strtok_r(output, "\n", &save_ptr); line != NULL; line = strtok_r(NULL, "\n", &save_ptr)) {
+        if (failed) LOG_F(ERROR, "    %s", line);
+        else LOG_F(INFO, "    %s", line);
+    }
+}
 
-    ZoneScoped;
+/// Runs the executable `argv[0]` with the NULL-terminated `argv` and this process's environment (which has the build
+/// configuration; see `main()`), without a shell, and logs what it writes to stdout and stderr. Waits for it to
+/// exit, and returns true iff it exits with 0.
+/// It's spawned with `posix_spawn()`, which doesn't copy this process's page tables the way `fork()` does.
+static bool runCommand(const char* const* argv) {
 
-    errno = 0;
-    // TODO replace `system` with something that doesn't involve a shell.
-    //     You can't use `popen` because it also spawns a shell.
-    //     You probably want:
-    //         1. fork
-    //         2. execve ; make sure to pass the environment variable ANGAME_RELEASE=1 when appropriate
-    //         3. waitpid
-    int ret = system(command);
+    ZoneScoped;
 
-    if (ret == 0) return true;
-    else {
-        int err = errno;
-        const char* err_description = strerror(err);
-        if (err_description == NULL) err_description = "(NO ERROR DESCRIPTION PROVIDED)";
-        LOG_F(
-            ERROR, "Failed to run command `%s`; return code %i, errno %i, strerror(): `%s`.",
-            command, ret, err, err_description
-        );
+    int pipe_fds[2] {};
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        LOG_F(ERROR, "Failed to create a pipe for `%s`; strerror(): `%s`.", argv[0], strerror(errno));
+        return false;
+    }
 
+    // The pipe's ends are close-on-exec; the duplicates aren't.
+    posix_spawn_file_actions_t file_actions {};
+    int result = posix_spawn_file_actions_init(&file_actions);
+    alwaysAssert(result == 0);
+    result = posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[1], STDOUT_FILENO);
+    alwaysAssert(result == 0);
+    result = posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[1], STDERR_FILENO);
+    alwaysAssert(result == 0);
+
+    pid_t pid = -1;
+    result = posix_spawn(&pid, argv[0], &file_actions, NULL, (char* const*)argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    close(pipe_fds[1]);
+    if (result != 0) {
+        LOG_F(ERROR, "Failed to run `%s`; strerror(): `%s`.", argv[0], strerror(result));
+        close(pipe_fds[0]);
         return false;
     }
+
+    // until it closes its end, by exiting
+    size_t output_capacity = 4096;
+    size_t output_size = 0;
+    char* output = mallocArray(output_capacity, char);
+    defer(free(output));
+    while (true) {
+        if (output_size + 1 == output_capacity) {
+            output_capacity *= 2;
+            output = reallocArray(output, output_capacity, char);
+        }
+        const ssize_t read_size = read(pipe_fds[0], output + output_size, output_capacity - 1 - output_size);
+        if (read_size < 0 and errno == EINTR) continue;
+        if (read_size <= 0) break;
+        output_size += (size_t)read_size;
+    }
+    output[output_size] = '\0';
+    close(pipe_fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1) alwaysAssert(errno == EINTR);
+
+    const bool success = WIFEXITED(status) and WEXITSTATUS(status) == 0;
+    if (!success) {
+        if (WIFEXITED(status)) LOG_F(ERROR, "`%s` exited with %i; its output:", argv[0], WEXITSTATUS(status));
+        else LOG_F(ERROR, "`%s` was terminated; its output:", argv[0]);
+    }
+    logCommandOutput(output, !success);
+
+    return success;
 }
 
 extern const void* reload(PluginID plugin_id) {
@@ -200,13 +251,12 @@ extern const void* reload(PluginID plugin_id) {
     {
         ZoneScopedN("Compile plugin");
 
-        char* command = allocSprintf("%s %s", plugin_info->compile_script, plugin_info->name);
-        defer(free(command));
+        // only recompiles the modified sources, in parallel
+        const char* const argv[] { plugin_info->compile_script, plugin_info->name, NULL };
 
-        LOG_F(INFO, "Compiling plugin with ID %i using command `%s`.", plugin_id, command);
+        LOG_F(INFO, "Compiling plugin with ID %i using command `%s %s`.", plugin_id, argv[0], argv[1]);
         {
-            // TODO Capture stdout+stderr so you can properly log the compiler errors in case of failure.
-            bool success = runCommand(command);
+            bool success = runCommand(argv);
             if (!success) {
                 LOG_F(ERROR, "Failed to compile plugin with ID %i.", plugin_id);
                 return NULL;
@@ -216,15 +266,15 @@ extern const void* reload(PluginID plugin_id) {
     {
         ZoneScopedN("Link plugin");
 
-        char* command = allocSprintf(
-            "%s %s %" PRIuFAST32, plugin_info->link_script, plugin_info->name, new_version_number
-        );
-        defer(free(command));
+        char* version_str = allocSprintf("%" PRIuFAST32, new_version_number);
+        defer(free(version_str));
+        const char* const argv[] { plugin_info->link_script, plugin_info->name, version_str, NULL };
 
-        LOG_F(INFO, "Linking plugin with ID %i using command `%s`.", plugin_id, command);
+        LOG_F(
+            INFO, "Linking plugin with ID %i using command `%s %s %s`.", plugin_id, argv[0], argv[1], argv[2]
+        );
         {
-            // TODO Capture stdout+stderr so you can properly log the linker errors in case of failure.
-            bool success = runCommand(command);
+            bool success = runCommand(argv);
             if (!success) {
                 LOG_F(ERROR, "Failed to link plugin with ID %i.", plugin_id);
                 return NULL;
@@ -0,0 +1,412 @@
+#include <cassert>
+#include <cstdlib>
+#include <pthread.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "fence_waiter.hpp"
+#include "readback_ring.hpp"
+
+namespace readback_ring {
+
+//
+// ===========================================================================================================
+//
+
+struct RingSlot {
+    Ring* ring;
+    VkBuffer readback_buffer;
+    VmaAllocation readback_allocation;
+    VmaAllocationInfo readback_allocation_info;
+    VkCommandBuffer command_buffer;
+    VkFence fence; // signaled by the copy; unsignaled from `beginFrame()` until then
+    VkSemaphore copy_finished_semaphore;
+    VkDeviceSize copy_size;
+
+    bool copy_finished; // guarded by `Ring::mutex`
+};
+
+struct Ring {
+    const VulkanContext* vk_ctx;
+    fence_waiter::FenceWaiter* fence_waiter;
+    CreateInfo info;
+
+    // only used by the capturing thread, so it needs no lock
+    VkCommandPool command_pool;
+    RingSlot* slots;
+
+    pthread_mutex_t mutex;
+    // broadcast whenever a frame has been written, and when the writer stops
+    pthread_cond_t frame_written_condition;
+    // guarded by `mutex`
+    // The frames in [written_frame_count, captured_frame_count) are waiting to be written, once their copies
+    // have finished.
+    bool writer_active;
+    Stats stats;
+};
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+/// The writer task: writes the waiting frames in order until there are none left whose copy has finished. At
+/// most one runs at a time.
+static void writerTask(void* p_arg) {
+
+    ZoneScoped;
+
+    Ring* ring = (Ring*)p_arg;
+
+    while (true)
+    {
+        int result = pthread_mutex_lock(&ring->mutex);
+        alwaysAssert(result == 0);
+
+        const u32 slot_idx = (u32)(ring->stats.written_frame_count % ring->info.slot_count);
+        const RingSlot* slot = &ring->slots[slot_idx];
+        if (ring->stats.written_frame_count == ring->stats.captured_frame_count or !slot->copy_finished)
+        {
+            ring->writer_active = false;
+            result = pthread_cond_broadcast(&ring->frame_written_condition);
+            alwaysAssert(result == 0);
+
+            result = pthread_mutex_unlock(&ring->mutex);
+            alwaysAssert(result == 0);
+            return;
+        }
+
+        const bool write_failed = ring->stats.write_failed;
+
+        result = pthread_mutex_unlock(&ring->mutex);
+        alwaysAssert(result == 0);
+
+        // After a failure, the frames are only counted, so that their slots can be reused.
+        bool success = false;
+        if (!write_failed)
+        {
+            const VkResult vk_result = vmaInvalidateAllocation(
+                ring->vk_ctx->vma_allocator, slot->readback_allocation, 0, slot->copy_size
+            );
+            assertVk(vk_result);
+
+            success = ring->info.p_write_frame(
+                ring->info.p_user_data, slot_idx, slot->readback_allocation_info.pMappedData
+            );
+        }
+
+        result = pthread_mutex_lock(&ring->mutex);
+        alwaysAssert(result == 0);
+
+        ring->stats.written_frame_count++;
+        if (!success) ring->stats.write_failed = true;
+
+        result = pthread_cond_broadcast(&ring->frame_written_condition);
+        alwaysAssert(result == 0);
+
+        result = pthread_mutex_unlock(&ring->mutex);
+        alwaysAssert(result == 0);
+    }
+}
+
+
+/// Enqueued by the fence waiter once the copy into the slot `p_arg` has finished; starts the writer, unless it's
+/// running already.
+static void copyFinishedTask(void* p_arg) {
+
+    RingSlot* slot = (RingSlot*)p_arg;
+    Ring* ring = slot->ring;
+
+    int result = pthread_mutex_lock(&ring->mutex);
+    alwaysAssert(result == 0);
+
+    slot->copy_finished = true;
+    const bool start_writer = !ring->writer_active;
+    ring->writer_active = true;
+
+    result = pthread_mutex_unlock(&ring->mutex);
+    alwaysAssert(result == 0);
+
+    if (start_writer) writerTask(ring);
+}
+
+//
+// ===========================================================================================================
+//
+
+Ring* create(
+    const VulkanContext* vk_ctx,
+    fence_waiter::FenceWaiter* fence_waiter,
+    const CreateInfo* info
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(info->slot_size > 0);
+    alwaysAssert(info->slot_count > 0);
+    alwaysAssert(info->p_write_frame != NULL);
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    Ring* ring = callocArray(1, Ring);
+    ring->vk_ctx = vk_ctx;
+    ring->fence_waiter = fence_waiter;
+    ring->info = *info;
+
+    {
+        const VkCommandPoolCreateInfo pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = info->queue_family_index,
+        };
+        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &pool_info, NULL, &ring->command_pool);
+        assertVk(result);
+    }
+
+    ring->slots = callocArray(info->slot_count, RingSlot);
+    for (u32 slot_idx = 0; slot_idx < info->slot_count; slot_idx++)
+    {
+        RingSlot* slot = &ring->slots[slot_idx];
+        slot->ring = ring;
+
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = info->slot_size,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &slot->readback_buffer, &slot->readback_allocation, &slot->readback_allocation_info
+        );
+        assertVk(result);
+
+        const VkCommandBufferAllocateInfo command_buffer_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = ring->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result = vk_ctx->procs_dev.AllocateCommandBuffers(
+            vk_ctx->device, &command_buffer_info, &slot->command_buffer
+        );
+        assertVk(result);
+
+        // signaled, so that `beginFrame()` can always reset it
+        const VkFenceCreateInfo fence_info {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        };
+        result = vk_ctx->procs_dev.CreateFence(vk_ctx->device, &fence_info, NULL, &slot->fence);
+        assertVk(result);
+
+        if (info->copy_finished_semaphores)
+        {
+            const VkSemaphoreCreateInfo semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+            result = vk_ctx->procs_dev.CreateSemaphore(
+                vk_ctx->device, &semaphore_info, NULL, &slot->copy_finished_semaphore
+            );
+            assertVk(result);
+        }
+    }
+
+    int pthread_result = pthread_mutex_init(&ring->mutex, NULL);
+    alwaysAssert(pthread_result == 0);
+    pthread_result = pthread_cond_init(&ring->frame_written_condition, NULL);
+    alwaysAssert(pthread_result == 0);
+
+    return ring;
+}
+
+
+Stats destroy(Ring* ring) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = ring->vk_ctx;
+
+    int result = pthread_mutex_lock(&ring->mutex);
+    alwaysAssert(result == 0);
+    while (ring->writer_active or ring->stats.written_frame_count != ring->stats.captured_frame_count)
+    {
+        result = pthread_cond_wait(&ring->frame_written_condition, &ring->mutex);
+        alwaysAssert(result == 0);
+    }
+    const Stats stats = ring->stats;
+    result = pthread_mutex_unlock(&ring->mutex);
+    alwaysAssert(result == 0);
+
+    // every fence has been waited for by the fence waiter
+    for (u32 slot_idx = 0; slot_idx < ring->info.slot_count; slot_idx++)
+    {
+        RingSlot* slot = &ring->slots[slot_idx];
+        if (slot->copy_finished_semaphore != VK_NULL_HANDLE)
+        {
+            vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, slot->copy_finished_semaphore, NULL);
+        }
+        vk_ctx->procs_dev.DestroyFence(vk_ctx->device, slot->fence, NULL);
+        vmaDestroyBuffer(vk_ctx->vma_allocator, slot->readback_buffer, slot->readback_allocation);
+    }
+    vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, ring->command_pool, NULL);
+
+    pthread_cond_destroy(&ring->frame_written_condition);
+    pthread_mutex_destroy(&ring->mutex);
+
+    free(ring->slots);
+    free(ring);
+
+    return stats;
+}
+
+
+bool beginFrame(Ring* ring, bool wait_for_slot, Slot* p_slot_out) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = ring->vk_ctx;
+
+    int pthread_result = pthread_mutex_lock(&ring->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    const bool ring_full = ring->stats.captured_frame_count - ring->stats.written_frame_count == ring->info.slot_count;
+    if (!wait_for_slot and (ring_full or ring->stats.write_failed))
+    {
+        ring->stats.dropped_frame_count++;
+
+        pthread_result = pthread_mutex_unlock(&ring->mutex);
+        alwaysAssert(pthread_result == 0);
+        return false;
+    }
+    if (ring_full)
+    {
+        ZoneScopedN("wait for a slot");
+
+        ring->stats.stalled_frame_count++;
+        while (ring->stats.captured_frame_count - ring->stats.written_frame_count == ring->info.slot_count)
+        {
+            pthread_result = pthread_cond_wait(&ring->frame_written_condition, &ring->mutex);
+            alwaysAssert(pthread_result == 0);
+        }
+    }
+
+    // The writer doesn't touch this slot until `captured_frame_count` covers it.
+    const u32 slot_idx = (u32)(ring->stats.captured_frame_count % ring->info.slot_count);
+    RingSlot* slot = &ring->slots[slot_idx];
+    slot->copy_finished = false;
+
+    pthread_result = pthread_mutex_unlock(&ring->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    VkResult result = vk_ctx->procs_dev.ResetFences(vk_ctx->device, 1, &slot->fence);
+    assertVk(result);
+
+    result = vk_ctx->procs_dev.ResetCommandBuffer(slot->command_buffer, 0);
+    assertVk(result);
+
+    const VkCommandBufferBeginInfo begin_info {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vk_ctx->procs_dev.BeginCommandBuffer(slot->command_buffer, &begin_info);
+    assertVk(result);
+
+    *p_slot_out = Slot {
+        .idx = slot_idx,
+        .command_buffer = slot->command_buffer,
+        .readback_buffer = slot->readback_buffer,
+        .copy_finished_semaphore = slot->copy_finished_semaphore,
+    };
+    return true;
+}
+
+
+void submitFrame(Ring* ring, const Slot* p_slot, VkQueue queue, VkSubmitInfo submit_info, VkDeviceSize copy_size) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = ring->vk_ctx;
+
+    alwaysAssert(copy_size <= ring->info.slot_size);
+
+    RingSlot* slot = &ring->slots[p_slot->idx];
+    slot->copy_size = copy_size;
+
+    // make the copy visible to the host
+    const VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    };
+    vk_ctx->procs_dev.CmdPipelineBarrier(
+        slot->command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &barrier,
+        0, NULL,
+        0, NULL
+    );
+
+    VkResult result = vk_ctx->procs_dev.EndCommandBuffer(slot->command_buffer);
+    assertVk(result);
+
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &slot->command_buffer;
+    result = vk_ctx->procs_dev.QueueSubmit(queue, 1, &submit_info, slot->fence);
+    assertVk(result);
+
+    int pthread_result = pthread_mutex_lock(&ring->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    ring->stats.captured_frame_count++;
+
+    pthread_result = pthread_mutex_unlock(&ring->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    fence_waiter::enqueueTaskAfterFence(ring->fence_waiter, slot->fence, copyFinishedTask, slot);
+}
+
+
+Stats getStats(Ring* ring) {
+
+    int result = pthread_mutex_lock(&ring->mutex);
+    alwaysAssert(result == 0);
+
+    const Stats stats = ring->stats;
+
+    result = pthread_mutex_unlock(&ring->mutex);
+    alwaysAssert(result == 0);
+
+    return stats;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
@@ -0,0 +1,78 @@
+#ifndef _READBACK_RING_HPP
+#define _READBACK_RING_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+// #include "fence_waiter.hpp"
+
+/// A ring of host-visible readback buffers that frames are copied into on the GPU timeline, and written from in
+/// order, without the thread that captures them waiting for the GPU or the disk. Each slot has a command buffer
+/// and a fence; once a slot's copy has finished, the `fence_waiter` enqueues a `thread_pool` task that runs the
+/// writer, which hands each finished frame to `CreateInfo::p_write_frame`, in capture order, until it reaches one
+/// whose copy hasn't finished. At most one writer runs at a time. Frame `n` is in slot `n % slot_count`.
+///
+/// Used by `frame_capture` and `video_export`, which only record the copy and encode what it read back.
+namespace readback_ring {
+
+//
+// ===========================================================================================================
+//
+
+/// Writes the frame read back into slot `slot_idx`, whose `copy_size` bytes are at `p_data`; called by the writer.
+/// Returns false on failure, after which the later frames are only counted, so that their slots can be reused.
+typedef bool (*PFN_WriteFrame)(void* p_user_data, u32 slot_idx, const void* p_data);
+
+struct CreateInfo {
+    u32 queue_family_index; // of the queue that the copies are submitted to
+    VkDeviceSize slot_size; // bytes
+    u32 slot_count;
+    /// If true, each slot has a binary semaphore, `Slot::copy_finished_semaphore`, for its submission to signal.
+    bool copy_finished_semaphores;
+    PFN_WriteFrame p_write_frame;
+    void* p_user_data;
+};
+
+struct Stats {
+    u64 captured_frame_count; // including the ones that haven't been written yet
+    u64 written_frame_count;
+    u64 dropped_frame_count; // for which `beginFrame()` found no slot, without `wait_for_slot`
+    u64 stalled_frame_count; // for which `beginFrame()` had to wait for a slot
+    bool write_failed;
+};
+
+/// A slot between `beginFrame()` and `submitFrame()`.
+struct Slot {
+    u32 idx;
+    VkCommandBuffer command_buffer; // begun; the caller records the copy into `readback_buffer`
+    VkBuffer readback_buffer;
+    VkSemaphore copy_finished_semaphore; // VK_NULL_HANDLE unless `CreateInfo::copy_finished_semaphores`
+};
+
+struct Ring;
+
+/// `vk_ctx` and `fence_waiter` must outlive the ring.
+Ring* create(const VulkanContext*, fence_waiter::FenceWaiter*, const CreateInfo* info);
+/// Waits for the frames that are left to be written, and returns the final `Stats`. Every submission that waits
+/// on a slot's `copy_finished_semaphore` must have finished.
+Stats destroy(Ring*);
+
+/// Takes the slot of the next frame, and begins its command buffer. If every slot is still waiting to be
+/// written, waits for the oldest one if `wait_for_slot`, and otherwise returns false; without `wait_for_slot`,
+/// it also returns false once a write has failed. Only one thread may capture frames.
+bool beginFrame(Ring*, bool wait_for_slot, Slot* p_slot_out);
+
+/// Ends the slot's command buffer, after a barrier that makes the transfer writes visible to the host, and
+/// submits it to `queue` with `submit_info`'s semaphores, to signal the slot's fence. `copy_size` bytes are read
+/// back, from the start of the buffer.
+void submitFrame(Ring*, const Slot*, VkQueue queue, VkSubmitInfo submit_info, VkDeviceSize copy_size);
+
+Stats getStats(Ring*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,702 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <glm/glm.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "file_watch.hpp"
+#include "sort.hpp"
+#include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
+#include "../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "sim_thread.hpp"
+
+namespace sim_thread {
+
+using glm::vec4;
+
+//
+// ===========================================================================================================
+//
+
+// Enough for the two that a frame reads, those of the frames still in flight (see `gfx::MAX_FRAMES_IN_FLIGHT`), and
+// one being copied into.
+constexpr u32 SNAPSHOT_COUNT = 6;
+
+struct Snapshot {
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    VkCommandBuffer command_buffer; // the copy into it
+
+    // guarded by `SimThread::mutex`
+    // It may be overwritten once `SimThread::snapshot_semaphore` reaches `copy_value`, and `SimThread::read_semaphore`
+    // reaches `read_value`; 0 if never.
+    u64 copy_value;
+    u64 read_value;
+};
+
+struct Published {
+    u32 snapshot_idx;
+    u32 particle_count;
+    u64 time_ns; // when the last step that it contains was due
+};
+
+struct SimThread {
+    const VulkanContext* vk_ctx;
+    CreateInfo info;
+    u64 step_ns;
+    pthread_t thread;
+
+    // held by the thread while it steps and publishes; see `lock()`
+    pthread_mutex_t sim_mutex;
+    // guarded by `sim_mutex`
+    VkCommandPool command_pool;
+    VkSemaphore snapshot_semaphore; // timeline
+    u64 snapshot_value;
+    // Binary: signalled by each copy out of the sim's positions, and waited for by the next step, which overwrites
+    // them.
+    VkSemaphore positions_released_semaphore;
+    bool positions_released_semaphore_will_be_signalled;
+
+    Snapshot snapshots[SNAPSHOT_COUNT];
+    VkSemaphore read_semaphore; // timeline; signalled by the renderer
+    VkDeviceSize snapshot_size; // bytes; the sim's particle capacity at `create()`
+
+    // the renderer's; on the graphics queue only
+    VkBuffer particles_buffer;
+    VmaAllocation particles_allocation;
+
+    pthread_mutex_t mutex;
+    // signalled when the thread should quit, and when it's resumed
+    pthread_cond_t wake_condition; // on `CLOCK_MONOTONIC`
+    // guarded by `mutex`
+    bool should_quit;
+    bool paused;
+    u64 next_step_time_ns;
+    bool has_latest;
+    bool has_previous;
+    Published latest;
+    Published previous;
+    u64 read_value; // the last one given out by `getFrame()`
+    Stats stats;
+};
+
+//
+// ===========================================================================================================
+//
+
+static void _assertVk(VkResult result, const char* file, int line) {
+
+    if (result == VK_SUCCESS) return;
+
+    LOG_F(
+        FATAL, "VkResult is %i, file `%s`, line %i",
+        result, file, line
+    );
+    abort();
+}
+#define assertVk(result) _assertVk(result, __FILE__, __LINE__)
+
+
+static u64 nowNs(void) {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000 + (u64)time.tv_nsec;
+}
+
+
+static u64 getSemaphoreCounterValue(const VulkanContext* vk_ctx, VkSemaphore semaphore) {
+    u64 value = 0;
+    VkResult result = vk_ctx->procs_dev.GetSemaphoreCounterValue(vk_ctx->device, semaphore, &value);
+    assertVk(result);
+    return value;
+}
+
+
+/// Copies the sim's current positions into a snapshot that the GPU is done with, and makes it the latest; or counts
+/// it as skipped if there is none. With `sim_mutex`.
+static void publishSnapshot(SimThread* sim_thread, u64 time_ns) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = sim_thread->vk_ctx;
+    const fluid_sim::FluidSimProcs* procs = *sim_thread->info.pp_procs;
+    const fluid_sim::SimData* sim = sim_thread->info.p_sim;
+
+    // read before taking `mutex`; a snapshot that becomes available in the meantime is just not chosen
+    const u64 copied_value = getSemaphoreCounterValue(vk_ctx, sim_thread->snapshot_semaphore);
+    const u64 read_value = getSemaphoreCounterValue(vk_ctx, sim_thread->read_semaphore);
+
+    int pthread_result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    u32 snapshot_idx = SNAPSHOT_COUNT;
+    for (u32 i = 0; i < SNAPSHOT_COUNT; i++)
+    {
+        if (sim_thread->has_latest and i == sim_thread->latest.snapshot_idx) continue;
+        if (sim_thread->has_previous and i == sim_thread->previous.snapshot_idx) continue;
+
+        const Snapshot* snapshot = &sim_thread->snapshots[i];
+        if (copied_value < snapshot->copy_value or read_value < snapshot->read_value) continue;
+
+        snapshot_idx = i;
+        break;
+    }
+    if (snapshot_idx == SNAPSHOT_COUNT) sim_thread->stats.skipped_snapshot_count++;
+
+    // `getFrame()` only touches the latest two, so the chosen one needs no lock until it's published
+    pthread_result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    if (snapshot_idx == SNAPSHOT_COUNT) return;
+    Snapshot* snapshot = &sim_thread->snapshots[snapshot_idx];
+
+    VkBuffer positions_buffer = VK_NULL_HANDLE;
+    VkDeviceSize positions_buffer_size = 0;
+    procs->getPositionsVertexBuffer(sim, &positions_buffer, &positions_buffer_size);
+
+    // a sim recreated with more particles than at `create()` is cut off
+    u32 particle_count = (u32)sim->particle_count;
+    if (particle_count * sizeof(vec4) > sim_thread->snapshot_size)
+    {
+        particle_count = (u32)(sim_thread->snapshot_size / sizeof(vec4));
+    }
+
+    const VkCommandBuffer command_buffer = snapshot->command_buffer;
+    {
+        VkResult result = vk_ctx->procs_dev.ResetCommandBuffer(command_buffer, 0);
+        assertVk(result);
+
+        const VkCommandBufferBeginInfo begin_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        result = vk_ctx->procs_dev.BeginCommandBuffer(command_buffer, &begin_info);
+        assertVk(result);
+
+        if (particle_count > 0)
+        {
+            const VkBufferCopy region {
+                .srcOffset = 0,
+                .dstOffset = 0,
+                .size = particle_count * sizeof(vec4),
+            };
+            vk_ctx->procs_dev.CmdCopyBuffer(command_buffer, positions_buffer, snapshot->buffer, 1, &region);
+        }
+
+        result = vk_ctx->procs_dev.EndCommandBuffer(command_buffer);
+        assertVk(result);
+    }
+
+    {
+        // The semaphores' memory dependencies cover the copy: the sim's makes its writes visible to it, and the
+        // renderer's makes it visible to the renderer.
+        u32 wait_semaphore_count = 1;
+        VkSemaphore wait_semaphores[2] { procs->getTimelineSemaphore(sim) };
+        const VkPipelineStageFlags wait_dst_stage_mask[2] {
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+        };
+        // ignored for the binary semaphore
+        const u64 wait_semaphore_values[2] { procs->getTimelineValue(sim), 0 };
+        // Not waited for by a step since the last copy, e.g. after `resetSnapshots()`; waited for here instead, so
+        // that it can be signalled again.
+        if (sim_thread->positions_released_semaphore_will_be_signalled)
+        {
+            wait_semaphores[wait_semaphore_count++] = sim_thread->positions_released_semaphore;
+        }
+
+        const VkSemaphore signal_semaphores[2] {
+            sim_thread->snapshot_semaphore, sim_thread->positions_released_semaphore
+        };
+        const u64 signal_semaphore_values[2] { ++sim_thread->snapshot_value, 0 };
+
+        const VkTimelineSemaphoreSubmitInfo timeline_info {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = wait_semaphore_count,
+            .pWaitSemaphoreValues = wait_semaphore_values,
+            .signalSemaphoreValueCount = 2,
+            .pSignalSemaphoreValues = signal_semaphore_values,
+        };
+        const VkSubmitInfo submit_info {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = wait_semaphore_count,
+            .pWaitSemaphores = wait_semaphores,
+            .pWaitDstStageMask = wait_dst_stage_mask,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+            .signalSemaphoreCount = 2,
+            .pSignalSemaphores = signal_semaphores,
+        };
+        VkResult result = vk_ctx->procs_dev.QueueSubmit(vk_ctx->compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+        assertVk(result);
+        sim_thread->positions_released_semaphore_will_be_signalled = true;
+    }
+
+    pthread_result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    snapshot->copy_value = sim_thread->snapshot_value;
+    if (sim_thread->has_latest)
+    {
+        sim_thread->previous = sim_thread->latest;
+        sim_thread->has_previous = true;
+    }
+    sim_thread->latest = Published {
+        .snapshot_idx = snapshot_idx,
+        .particle_count = particle_count,
+        .time_ns = time_ns,
+    };
+    sim_thread->has_latest = true;
+    sim_thread->stats.published_snapshot_count++;
+
+    pthread_result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+}
+
+
+static void* threadProcedure(void* p_sim_thread) {
+
+    SimThread* sim_thread = (SimThread*)p_sim_thread;
+    const u64 step_ns = sim_thread->step_ns;
+
+    while (true)
+    {
+        int result = pthread_mutex_lock(&sim_thread->mutex);
+        alwaysAssert(result == 0);
+
+        u64 now_ns = nowNs();
+        while (!sim_thread->should_quit and (sim_thread->paused or now_ns < sim_thread->next_step_time_ns))
+        {
+            if (sim_thread->paused)
+            {
+                result = pthread_cond_wait(&sim_thread->wake_condition, &sim_thread->mutex);
+                alwaysAssert(result == 0);
+            }
+            else
+            {
+                const timespec deadline {
+                    .tv_sec = (time_t)(sim_thread->next_step_time_ns / 1000000000),
+                    .tv_nsec = (long)(sim_thread->next_step_time_ns % 1000000000),
+                };
+                result = pthread_cond_timedwait(&sim_thread->wake_condition, &sim_thread->mutex, &deadline);
+                alwaysAssert(result == 0 or result == ETIMEDOUT);
+            }
+            now_ns = nowNs();
+        }
+
+        if (sim_thread->should_quit)
+        {
+            result = pthread_mutex_unlock(&sim_thread->mutex);
+            alwaysAssert(result == 0);
+            return NULL;
+        }
+
+        // every step that has come due, up to the limit
+        const u64 due_step_count = (now_ns - sim_thread->next_step_time_ns) / step_ns + 1;
+        const u64 step_count = (due_step_count < sim_thread->info.max_steps_per_wake) ?
+            due_step_count : (u64)sim_thread->info.max_steps_per_wake;
+        sim_thread->stats.step_count += step_count;
+        sim_thread->stats.dropped_step_count += due_step_count - step_count;
+        sim_thread->next_step_time_ns += due_step_count * step_ns;
+        const u64 last_step_time_ns = sim_thread->next_step_time_ns - step_ns;
+
+        result = pthread_mutex_unlock(&sim_thread->mutex);
+        alwaysAssert(result == 0);
+
+        result = pthread_mutex_lock(&sim_thread->sim_mutex);
+        alwaysAssert(result == 0);
+
+        for (u64 step_idx = 0; step_idx < step_count; step_idx++)
+        {
+            ZoneScopedNFrame("fluid_sim::advance");
+
+            // the first step overwrites the positions that the last snapshot copied
+            const bool wait = sim_thread->positions_released_semaphore_will_be_signalled;
+            (*sim_thread->info.pp_procs)->advance(
+                sim_thread->info.p_sim,
+                sim_thread->vk_ctx,
+                sim_thread->info.thread_pool,
+                sim_thread->info.step_seconds,
+                wait ? sim_thread->positions_released_semaphore : VK_NULL_HANDLE,
+                VK_NULL_HANDLE
+            );
+            sim_thread->positions_released_semaphore_will_be_signalled = false;
+        }
+        publishSnapshot(sim_thread, last_step_time_ns);
+
+        result = pthread_mutex_unlock(&sim_thread->sim_mutex);
+        alwaysAssert(result == 0);
+    }
+}
+
+//
+// ===========================================================================================================
+//
+
+SimThread* create(const VulkanContext* vk_ctx, const CreateInfo* info) {
+
+    ZoneScoped;
+
+    alwaysAssert(vk_ctx->compute_queue != vk_ctx->queue);
+    alwaysAssert(info->step_seconds > 0.f);
+    alwaysAssert(info->max_steps_per_wake > 0);
+
+    VkResult result = VK_ERROR_UNKNOWN;
+
+    SimThread* sim_thread = callocArray(1, SimThread);
+    sim_thread->vk_ctx = vk_ctx;
+    sim_thread->info = *info;
+    sim_thread->step_ns = (u64)((f64)info->step_seconds * 1e9);
+
+    {
+        VkBuffer positions_buffer = VK_NULL_HANDLE;
+        (*info->pp_procs)->getPositionsVertexBuffer(info->p_sim, &positions_buffer, &sim_thread->snapshot_size);
+    }
+
+    {
+        const VkCommandPoolCreateInfo pool_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = vk_ctx->compute_queue_family_index,
+        };
+        result = vk_ctx->procs_dev.CreateCommandPool(vk_ctx->device, &pool_info, NULL, &sim_thread->command_pool);
+        assertVk(result);
+    }
+
+    {
+        const VkSemaphoreTypeCreateInfo semaphore_type_info {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        const VkSemaphoreCreateInfo timeline_semaphore_info {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphore_type_info,
+        };
+        result = vk_ctx->procs_dev.CreateSemaphore(
+            vk_ctx->device, &timeline_semaphore_info, NULL, &sim_thread->snapshot_semaphore
+        );
+        assertVk(result);
+        result = vk_ctx->procs_dev.CreateSemaphore(
+            vk_ctx->device, &timeline_semaphore_info, NULL, &sim_thread->read_semaphore
+        );
+        assertVk(result);
+
+        const VkSemaphoreCreateInfo binary_semaphore_info { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+        result = vk_ctx->procs_dev.CreateSemaphore(
+            vk_ctx->device, &binary_semaphore_info, NULL, &sim_thread->positions_released_semaphore
+        );
+        assertVk(result);
+    }
+
+    // copied into on the compute queue, and read on the graphics queue; see `createBuffers()` in fluid_sim.cpp
+    const u32 queue_family_indices[2] { vk_ctx->compute_queue_family_index, vk_ctx->queue_family_index };
+    const bool share_with_graphics_queue = vk_ctx->compute_queue_family_index != vk_ctx->queue_family_index;
+
+    for (u32 i = 0; i < SNAPSHOT_COUNT; i++)
+    {
+        Snapshot* snapshot = &sim_thread->snapshots[i];
+
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = sim_thread->snapshot_size,
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = share_with_graphics_queue ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = share_with_graphics_queue ? (u32)2 : (u32)1,
+            .pQueueFamilyIndices = queue_family_indices,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info, &snapshot->buffer, &snapshot->allocation, NULL
+        );
+        assertVk(result);
+
+        const VkCommandBufferAllocateInfo command_buffer_info {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = sim_thread->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        result = vk_ctx->procs_dev.AllocateCommandBuffers(
+            vk_ctx->device, &command_buffer_info, &snapshot->command_buffer
+        );
+        assertVk(result);
+    }
+
+    {
+        // written by particle_interpolate.comp, then read like the sim's positions would be
+        const VkBufferCreateInfo buffer_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = sim_thread->snapshot_size,
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &vk_ctx->queue_family_index,
+        };
+        const VmaAllocationCreateInfo alloc_info {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        };
+        result = vmaCreateBuffer(
+            vk_ctx->vma_allocator, &buffer_info, &alloc_info,
+            &sim_thread->particles_buffer, &sim_thread->particles_allocation, NULL
+        );
+        assertVk(result);
+    }
+
+    int pthread_result = pthread_mutex_init(&sim_thread->sim_mutex, NULL);
+    alwaysAssert(pthread_result == 0);
+    pthread_result = pthread_mutex_init(&sim_thread->mutex, NULL);
+    alwaysAssert(pthread_result == 0);
+    {
+        // for the absolute deadlines of `pthread_cond_timedwait()`, which `nowNs()` gives
+        pthread_condattr_t condattr;
+        pthread_result = pthread_condattr_init(&condattr);
+        alwaysAssert(pthread_result == 0);
+        pthread_result = pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+        alwaysAssert(pthread_result == 0);
+        pthread_result = pthread_cond_init(&sim_thread->wake_condition, &condattr);
+        alwaysAssert(pthread_result == 0);
+        pthread_condattr_destroy(&condattr);
+    }
+
+    // so that the renderer has something to draw before the first step
+    const u64 now_ns = nowNs();
+    publishSnapshot(sim_thread, now_ns);
+    sim_thread->next_step_time_ns = now_ns + sim_thread->step_ns;
+
+    pthread_result = pthread_create(&sim_thread->thread, NULL, threadProcedure, sim_thread);
+    alwaysAssert(pthread_result == 0);
+
+    LOG_F(
+        INFO, "Stepping the fluid sim on its own thread, every %.2f ms, at most %" PRIu32 " steps at once.",
+        1e3 * info->step_seconds, info->max_steps_per_wake
+    );
+
+    return sim_thread;
+}
+
+
+void destroy(SimThread* sim_thread) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = sim_thread->vk_ctx;
+
+    int pthread_result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    sim_thread->should_quit = true;
+    pthread_result = pthread_cond_signal(&sim_thread->wake_condition);
+    alwaysAssert(pthread_result == 0);
+
+    const u64 read_value = sim_thread->read_value;
+    const Stats stats = sim_thread->stats;
+
+    pthread_result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(pthread_result == 0);
+
+    pthread_result = pthread_join(sim_thread->thread, NULL);
+    alwaysAssert(pthread_result == 0);
+
+    {
+        // the last copy, and the last frame's reads
+        const VkSemaphore semaphores[2] { sim_thread->snapshot_semaphore, sim_thread->read_semaphore };
+        const u64 values[2] { sim_thread->snapshot_value, read_value };
+        const VkSemaphoreWaitInfo wait_info {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 2,
+            .pSemaphores = semaphores,
+            .pValues = values,
+        };
+        VkResult result = vk_ctx->procs_dev.WaitSemaphores(vk_ctx->device, &wait_info, UINT64_MAX);
+        assertVk(result);
+    }
+
+    for (u32 i = 0; i < SNAPSHOT_COUNT; i++)
+    {
+        vmaDestroyBuffer(vk_ctx->vma_allocator, sim_thread->snapshots[i].buffer, sim_thread->snapshots[i].allocation);
+    }
+    vmaDestroyBuffer(vk_ctx->vma_allocator, sim_thread->particles_buffer, sim_thread->particles_allocation);
+    vk_ctx->procs_dev.DestroyCommandPool(vk_ctx->device, sim_thread->command_pool, NULL);
+    // A pending signal of the binary semaphore has finished along with the last copy, and destroying a signalled
+    // semaphore is fine.
+    vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, sim_thread->positions_released_semaphore, NULL);
+    vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, sim_thread->read_semaphore, NULL);
+    vk_ctx->procs_dev.DestroySemaphore(vk_ctx->device, sim_thread->snapshot_semaphore, NULL);
+
+    LOG_F(
+        INFO,
+        "Sim thread stepped %" PRIu64 " times, and dropped %" PRIu64 " steps. Published %" PRIu64 " snapshots, and "
+        "skipped %" PRIu64 ".",
+        stats.step_count, stats.dropped_step_count, stats.published_snapshot_count, stats.skipped_snapshot_count
+    );
+
+    pthread_cond_destroy(&sim_thread->wake_condition);
+    pthread_mutex_destroy(&sim_thread->mutex);
+    pthread_mutex_destroy(&sim_thread->sim_mutex);
+
+    free(sim_thread);
+}
+
+
+void lock(SimThread* sim_thread) {
+    ZoneScoped;
+    int result = pthread_mutex_lock(&sim_thread->sim_mutex);
+    alwaysAssert(result == 0);
+}
+
+
+bool tryLock(SimThread* sim_thread) {
+    int result = pthread_mutex_trylock(&sim_thread->sim_mutex);
+    alwaysAssert(result == 0 or result == EBUSY);
+    return result == 0;
+}
+
+
+void unlock(SimThread* sim_thread) {
+    int result = pthread_mutex_unlock(&sim_thread->sim_mutex);
+    alwaysAssert(result == 0);
+}
+
+
+void setPaused(SimThread* sim_thread, bool paused) {
+
+    int result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+
+    if (paused != sim_thread->paused)
+    {
+        sim_thread->paused = paused;
+        if (!paused)
+        {
+            // Starts again from the latest snapshot, as if it had just been taken; the time spent paused isn't
+            // caught up on, and isn't blended across.
+            const u64 now_ns = nowNs();
+            sim_thread->next_step_time_ns = now_ns + sim_thread->step_ns;
+            sim_thread->latest.time_ns = now_ns;
+            sim_thread->has_previous = false;
+
+            result = pthread_cond_signal(&sim_thread->wake_condition);
+            alwaysAssert(result == 0);
+        }
+    }
+
+    result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+}
+
+
+void resetSnapshots(SimThread* sim_thread) {
+
+    ZoneScoped;
+
+    int result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+
+    // Still readable by the frames in flight, but no longer drawn; `publishSnapshot()` checks the semaphores
+    // before overwriting them either way.
+    sim_thread->has_latest = false;
+    sim_thread->has_previous = false;
+    const u64 now_ns = nowNs();
+    sim_thread->next_step_time_ns = now_ns + sim_thread->step_ns;
+
+    result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+
+    publishSnapshot(sim_thread, now_ns);
+}
+
+
+void getParticlesBuffer(const SimThread* sim_thread, VkBuffer* buffer_out, VkDeviceSize* buffer_size_out) {
+    *buffer_out = sim_thread->particles_buffer;
+    *buffer_size_out = sim_thread->snapshot_size;
+}
+
+
+bool getFrame(SimThread* sim_thread, bool interpolate, Frame* frame_out) {
+
+    ZoneScoped;
+
+    int result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+
+    if (!sim_thread->has_latest)
+    {
+        result = pthread_mutex_unlock(&sim_thread->mutex);
+        alwaysAssert(result == 0);
+        return false;
+    }
+
+    const Published next = sim_thread->latest;
+    Published previous = next;
+    f32 alpha = 1.f;
+    if (
+        interpolate and sim_thread->has_previous and !sim_thread->paused and
+        sim_thread->previous.particle_count == next.particle_count
+    ) {
+        previous = sim_thread->previous;
+
+        // one step behind the sim's clock, so that the frame usually falls between the two
+        const i64 time_since_previous_ns = (i64)nowNs() - (i64)sim_thread->step_ns - (i64)previous.time_ns;
+        const i64 interval_ns = (i64)next.time_ns - (i64)previous.time_ns;
+        const f64 t = (interval_ns > 0) ? (f64)time_since_previous_ns / (f64)interval_ns : 1.0;
+        alpha = (f32)((t < 0.0) ? 0.0 : (t > 1.0) ? 1.0 : t);
+    }
+
+    // The renderer signals this once it has read both; they can't be overwritten until then.
+    const u64 read_value = ++sim_thread->read_value;
+    sim_thread->snapshots[previous.snapshot_idx].read_value = read_value;
+    sim_thread->snapshots[next.snapshot_idx].read_value = read_value;
+
+    *frame_out = Frame {
+        .previous_particles = sim_thread->snapshots[previous.snapshot_idx].buffer,
+        .next_particles = sim_thread->snapshots[next.snapshot_idx].buffer,
+        .alpha = alpha,
+        .particle_count = next.particle_count,
+        // the later of the two copies
+        .wait_semaphore = sim_thread->snapshot_semaphore,
+        .wait_value = sim_thread->snapshots[next.snapshot_idx].copy_value,
+        .signal_semaphore = sim_thread->read_semaphore,
+        .signal_value = read_value,
+    };
+
+    result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+    return true;
+}
+
+
+Stats getStats(SimThread* sim_thread) {
+
+    int result = pthread_mutex_lock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+
+    const Stats stats = sim_thread->stats;
+
+    result = pthread_mutex_unlock(&sim_thread->mutex);
+    alwaysAssert(result == 0);
+    return stats;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
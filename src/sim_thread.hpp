@@ -0,0 +1,100 @@
+#ifndef _SIM_THREAD_HPP
+#define _SIM_THREAD_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+// #include "thread_pool.hpp"
+// #include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
+// #include "../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+
+/// Steps the fluid sim on a thread of its own, at a fixed timestep, instead of once per rendered frame with the
+/// frame's duration; so the sim's step doesn't change with the framerate, and the sim doesn't wait for the present.
+/// After each wake's steps, the thread copies the positions into one of a ring of snapshots, on the GPU timeline:
+/// the copy waits for the sim's timeline semaphore, and signals the thread's own. The renderer draws the latest two
+/// snapshots, blended by where the frame's time falls between them (see `gfx::ParticleInterpolation`), and signals
+/// a second timeline semaphore once it has read them. A snapshot is only overwritten once the GPU is done with it,
+/// so neither side ever waits for the other; if every snapshot is still in use, the step just isn't published.
+///
+/// The thread submits to `VulkanContext::compute_queue`, which must differ from `VulkanContext::queue`, as the
+/// submissions of different threads to one queue would need a lock that the renderer doesn't take.
+namespace sim_thread {
+
+//
+// ===========================================================================================================
+//
+
+struct CreateInfo {
+    /// Read by the thread before each step, while holding `lock()`; so the plugin can be swapped under it.
+    const fluid_sim::FluidSimProcs* const* pp_procs;
+    /// Stepped by the thread. Anything else may only touch it while holding `lock()`.
+    fluid_sim::SimData* p_sim;
+    thread_pool::ThreadPool* thread_pool;
+    f32 step_seconds; // the fixed timestep
+    /// After a stall, e.g. a slow step, the thread catches up with at most this many steps at once; the steps
+    /// beyond them are dropped, so that the sim slows down instead of falling further and further behind.
+    u32 max_steps_per_wake;
+};
+
+struct Stats {
+    u64 step_count;
+    u64 dropped_step_count; // see `CreateInfo::max_steps_per_wake`
+    u64 published_snapshot_count;
+    u64 skipped_snapshot_count; // because every snapshot was still in use
+};
+
+/// The two snapshots that the renderer should blend; mirrors `gfx::ParticleInterpolation`, see there.
+struct Frame {
+    VkBuffer previous_particles;
+    VkBuffer next_particles;
+    f32 alpha;
+    u32 particle_count; // of both
+
+    VkSemaphore wait_semaphore;
+    u64 wait_value;
+    VkSemaphore signal_semaphore;
+    u64 signal_value;
+};
+
+struct SimThread;
+
+/// Aborts if `vk_ctx->compute_queue` is `vk_ctx->queue`. `vk_ctx` and `*info->pp_procs` must outlive the thread.
+/// The thread starts stepping right away.
+SimThread* create(const VulkanContext*, const CreateInfo* info);
+/// Stops the thread after its current steps, and waits for the GPU to finish with the snapshots.
+void destroy(SimThread*);
+
+/// For anything other than the thread that touches the sim, or changes `*pp_procs`. The thread holds it while it
+/// steps, so this can wait for a step's host work.
+void lock(SimThread*);
+/// Returns false, without the lock, if the thread is stepping; for work that can just be skipped then.
+bool tryLock(SimThread*);
+void unlock(SimThread*);
+
+/// While paused, the thread doesn't step, and the renderer gets the latest snapshot. When resumed, the sim starts
+/// again from there, without catching up.
+void setPaused(SimThread*, bool paused);
+
+/// With `lock()`. Forgets the snapshots, for a sim that was recreated, or whose particles were added or removed,
+/// and publishes the sim's current state as the only one; so the renderer doesn't blend unrelated particles.
+void resetSnapshots(SimThread*);
+
+/// The buffer that the renderer blends the snapshots into: pass it to `gfx::createRenderer()` and to
+/// `gfx::render()` in place of the sim's positions. It fits the sim's particle capacity at `create()`.
+void getParticlesBuffer(const SimThread*, VkBuffer* buffer_out, VkDeviceSize* buffer_size_out);
+
+/// Returns false before the first snapshot. Otherwise the renderer must signal `frame_out->signal_semaphore` to
+/// `frame_out->signal_value`, even if it fails, or the two snapshots can never be overwritten; `gfx::render()` does.
+/// Without `interpolate`, or if the latest two snapshots have different particle counts, both are the latest.
+/// The frame is drawn one step behind the sim's clock, so that it falls between the latest two snapshots.
+bool getFrame(SimThread*, bool interpolate, Frame* frame_out);
+
+Stats getStats(SimThread*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -1,8 +1,11 @@
 #include <cstring>
+#include <type_traits>
+#include <immintrin.h>
 
 #include <tracy/tracy/Tracy.hpp>
 
 #include "types.hpp"
+#include "trace.hpp"
 #include "math_util.hpp"
 #include "error_util.hpp"
 #include "thread_pool.hpp"
@@ -24,7 +27,7 @@
 
 static inline void mergeSort_merge(
 
-    KeyVal* arr_in,
+    const KeyVal* arr_in,
     KeyVal* arr_out,
 
     u32fast idx_a,
@@ -38,15 +41,12 @@ static inline void mergeSort_merge(
 
     for (; idx_dst < idx_dst_end; idx_dst++)
     {
-        u32 key_a;
-        if (idx_a < idx_a_end) key_a = arr_in[idx_a].key;
-        else key_a = UINT32_MAX;
+        // Not a UINT32_MAX sentinel for the exhausted side, because that's also a valid key.
+        const bool take_a =
+            idx_b >= idx_b_end
+            or (idx_a < idx_a_end and arr_in[idx_a].key <= arr_in[idx_b].key);
 
-        u32 key_b;
-        if (idx_b < idx_b_end) key_b = arr_in[idx_b].key;
-        else key_b = UINT32_MAX;
-
-        if (key_a <= key_b)
+        if (take_a)
         {
             arr_out[idx_dst] = arr_in[idx_a];
             idx_a++;
@@ -66,7 +66,7 @@ extern void mergeSort(
     const u32fast skip_to_bucket_size
 ) {
 
-    ZoneScoped;
+    ZoneScopedTask;
 
     if (arr_size < 2) return;
 
@@ -125,7 +125,228 @@ static void mergeSortMultiThreaded_thread(void* p_params_struct)
     );
 };
 
-extern void mergeSortMultiThreaded(
+/// One thread's share of a merge level of `mergeSortMultiThreaded()`: the outputs `[idx_dst_begin,
+/// idx_dst_end)` of merging each pair of adjacent runs of `run_size` elements of `p_src` into `p_dst`. The
+/// share may span several pairs, or part of one.
+struct MergePathThreadParams {
+    const KeyVal* p_src;
+    KeyVal* p_dst;
+    u32fast arr_size;
+    u32fast run_size;
+    u32fast idx_dst_begin;
+    u32fast idx_dst_end;
+};
+
+/// The number of elements of `a` among the first `k` outputs of the stable merge of `a` and `b`, which take
+/// from `a` on ties; the rest are the first `k - result` of `b`. A binary search along the merge path.
+static u32fast mergePathCoRank(
+    const KeyVal* a,
+    const u32fast a_size,
+    const KeyVal* b,
+    const u32fast b_size,
+    const u32fast k
+) {
+
+    u32fast lo = (k > b_size) ? k - b_size : 0;
+    u32fast hi = math::min(k, a_size);
+    while (lo < hi)
+    {
+        const u32fast i = lo + (hi - lo) / 2;
+        const u32fast j = k - i;
+        // `a[i]` would be output before `b[j - 1]`, so more than `i` of the outputs come from `a`
+        if (j > 0 and a[i].key <= b[j - 1].key) lo = i + 1;
+        else hi = i;
+    }
+
+    return lo;
+}
+
+static void mergeSortMultiThreaded_mergePath(void* p_params_struct) {
+
+    const MergePathThreadParams* params = (const MergePathThreadParams*)p_params_struct;
+
+    const u32fast arr_size = params->arr_size;
+    const u32fast run_size = params->run_size;
+
+    u32fast idx_dst = params->idx_dst_begin;
+    while (idx_dst < params->idx_dst_end)
+    {
+        const u32fast pair_begin = idx_dst - idx_dst % (2 * run_size);
+        const u32fast a_begin = pair_begin;
+        const u32fast b_begin = math::min(pair_begin + run_size, arr_size);
+        const u32fast b_end = math::min(pair_begin + 2 * run_size, arr_size);
+
+        const u32fast idx_dst_end = math::min(params->idx_dst_end, b_end);
+
+        const KeyVal* a = &params->p_src[a_begin];
+        const KeyVal* b = &params->p_src[b_begin];
+        const u32fast a_size = b_begin - a_begin;
+        const u32fast b_size = b_end - b_begin;
+
+        const u32fast i_begin = mergePathCoRank(a, a_size, b, b_size, idx_dst - pair_begin);
+        const u32fast i_end = mergePathCoRank(a, a_size, b, b_size, idx_dst_end - pair_begin);
+
+        mergeSort_merge(
+            params->p_src,
+            params->p_dst,
+            a_begin + i_begin, b_begin + (idx_dst - pair_begin - i_begin), idx_dst,
+            a_begin + i_end, b_begin + (idx_dst_end - pair_begin - i_end), idx_dst_end
+        );
+
+        idx_dst = idx_dst_end;
+    }
+}
+
+// `radixSortMultiThreaded()` picks the fewest passes with digits of at most this many bits, so that the
+// histograms and the write-combining buffers of each thread stay in L2.
+constexpr u32 RADIX_SORT_MT_MAX_DIGIT_BITS = 11;
+constexpr u32 RADIX_SORT_MT_MAX_BUCKET_COUNT = 1 << RADIX_SORT_MT_MAX_DIGIT_BITS;
+// KeyVals per bucket in the write-combining buffers: a cache line.
+constexpr u32 RADIX_SORT_MT_WRITE_COMBINING_SIZE = 64 / sizeof(KeyVal);
+// Fewer keys per thread than this aren't worth the synchronization.
+constexpr u32fast RADIX_SORT_MT_MIN_KEYS_PER_THREAD = 1 << 14;
+
+/// The state of one thread of `radixSortMultiThreaded()`, which owns the keys in `[idx_begin, idx_end)` of the
+/// source array in each pass.
+struct RadixSortThreadParams {
+    u32fast idx_begin;
+    u32fast idx_end;
+
+    const KeyVal* p_src;
+    KeyVal* p_dst;
+    u32 shift;
+    u32 bucket_count;
+
+    u32 max_key; // output of `radixSortMultiThreaded_maxKey()`
+    // `bucket_count` each
+    u32fast* histogram;
+    u32fast* offsets; // where the thread scatters the next key of each bucket
+    u32* write_combining_fill;
+    KeyVal* write_combining_buffers; // `RADIX_SORT_MT_WRITE_COMBINING_SIZE` per bucket
+};
+
+// `mergeSortMultiThreaded()` hands arrays of at least this many keys per thread, on at least this many threads,
+// to `sampleSortMultiThreaded()`: from 4 merge levels on, its passes over the array cost more than the sample
+// sort's scatter and bucket sorts, which stay in each thread's cache.
+constexpr u32fast SAMPLE_SORT_MIN_THREAD_COUNT = 16;
+constexpr u32fast SAMPLE_SORT_MIN_KEYS_PER_THREAD = 1 << 14;
+// At least this many buckets per thread, rounded up to a power of 2, so that a thread that gets small buckets
+// takes more of them.
+constexpr u32fast SAMPLE_SORT_BUCKETS_PER_THREAD = 4;
+// Samples per bucket; the more, the more even the buckets.
+constexpr u32fast SAMPLE_SORT_OVERSAMPLING = 32;
+
+/// One thread's share `[idx_begin, idx_end)` of the array, in the counting and scatter passes of
+/// `sampleSortMultiThreaded()`.
+struct SampleSortThreadParams {
+    const KeyVal* p_src;
+    KeyVal* p_dst;
+    u32fast idx_begin;
+    u32fast idx_end;
+    const u64* p_splitters; // `bucket_count - 1`
+    u32 bucket_count;
+    // `bucket_count`: the thread's count of each bucket, and then where it scatters the next key of each
+    u32fast* p_bucket_offsets;
+};
+
+/// A bucket of `sampleSortMultiThreaded()`: it's sorted where it was scattered to, and then copied to `p_dst`.
+struct SampleSortBucketParams {
+    KeyVal* p_keys;
+    KeyVal* p_dst;
+    u32fast size;
+};
+
+static u32fast getSampleSortBucketCount(u32fast thread_count) {
+
+    u32fast bucket_count = 1;
+    while (bucket_count < SAMPLE_SORT_BUCKETS_PER_THREAD * thread_count) bucket_count *= 2;
+    return bucket_count;
+}
+
+struct SortContext {
+    u32fast max_thread_count;
+    // `max_thread_count` each
+    MergeSortThreadParams* merge_sort_params;
+    MergePathThreadParams* merge_path_params;
+    RadixSortThreadParams* radix_sort_params;
+    SampleSortThreadParams* sample_sort_params;
+    // `getSampleSortBucketCount(max_thread_count)` each, or that many per thread for `sample_sort_counts`, or
+    // `2 * SAMPLE_SORT_OVERSAMPLING` times that for the samples and their scratch
+    SampleSortBucketParams* sample_sort_bucket_params;
+    u32fast* sample_sort_counts;
+    SortItem<u64, NoVal>* sample_sort_samples;
+    u64* sample_sort_splitters;
+    // `RADIX_SORT_MT_MAX_BUCKET_COUNT` per thread, or twice that for `radix_sort_counts`
+    u32fast* radix_sort_counts;
+    u32* radix_sort_write_combining_fills;
+    // `RADIX_SORT_MT_MAX_BUCKET_COUNT * RADIX_SORT_MT_WRITE_COMBINING_SIZE` per thread
+    KeyVal* radix_sort_write_combining_buffers;
+};
+
+extern SortContext* createSortContext(const u32fast max_thread_count) {
+
+    ZoneScoped;
+
+    alwaysAssert(max_thread_count > 0);
+
+    SortContext* ctx = (SortContext*)calloc(1, sizeof(SortContext));
+    alwaysAssert(ctx != NULL);
+
+    ctx->max_thread_count = max_thread_count;
+    ctx->merge_sort_params = (MergeSortThreadParams*)calloc(max_thread_count, sizeof(MergeSortThreadParams));
+    ctx->merge_path_params = (MergePathThreadParams*)calloc(max_thread_count, sizeof(MergePathThreadParams));
+    ctx->radix_sort_params = (RadixSortThreadParams*)calloc(max_thread_count, sizeof(RadixSortThreadParams));
+    ctx->radix_sort_counts = (u32fast*)calloc(
+        2 * max_thread_count * RADIX_SORT_MT_MAX_BUCKET_COUNT, sizeof(u32fast)
+    );
+    ctx->radix_sort_write_combining_fills = (u32*)calloc(
+        max_thread_count * RADIX_SORT_MT_MAX_BUCKET_COUNT, sizeof(u32)
+    );
+    ctx->radix_sort_write_combining_buffers = (KeyVal*)calloc(
+        max_thread_count * RADIX_SORT_MT_MAX_BUCKET_COUNT * RADIX_SORT_MT_WRITE_COMBINING_SIZE, sizeof(KeyVal)
+    );
+    const u32fast max_bucket_count = getSampleSortBucketCount(max_thread_count);
+    ctx->sample_sort_params = (SampleSortThreadParams*)calloc(max_thread_count, sizeof(SampleSortThreadParams));
+    ctx->sample_sort_bucket_params = (SampleSortBucketParams*)calloc(max_bucket_count, sizeof(SampleSortBucketParams));
+    ctx->sample_sort_counts = (u32fast*)calloc(max_thread_count * max_bucket_count, sizeof(u32fast));
+    ctx->sample_sort_samples = (SortItem<u64, NoVal>*)calloc(
+        2 * SAMPLE_SORT_OVERSAMPLING * max_bucket_count, sizeof(SortItem<u64, NoVal>)
+    );
+    ctx->sample_sort_splitters = (u64*)calloc(max_bucket_count, sizeof(u64));
+    alwaysAssert(
+        ctx->merge_sort_params != NULL and ctx->merge_path_params != NULL and
+        ctx->radix_sort_params != NULL and
+        ctx->radix_sort_counts != NULL and ctx->radix_sort_write_combining_fills != NULL and
+        ctx->radix_sort_write_combining_buffers != NULL and
+        ctx->sample_sort_params != NULL and ctx->sample_sort_bucket_params != NULL and
+        ctx->sample_sort_counts != NULL and ctx->sample_sort_samples != NULL and ctx->sample_sort_splitters != NULL
+    );
+
+    return ctx;
+}
+
+extern void destroySortContext(SortContext* ctx) {
+
+    if (ctx == NULL) return;
+
+    free(ctx->merge_sort_params);
+    free(ctx->merge_path_params);
+    free(ctx->radix_sort_params);
+    free(ctx->radix_sort_counts);
+    free(ctx->radix_sort_write_combining_fills);
+    free(ctx->radix_sort_write_combining_buffers);
+    free(ctx->sample_sort_params);
+    free(ctx->sample_sort_bucket_params);
+    free(ctx->sample_sort_counts);
+    free(ctx->sample_sort_samples);
+    free(ctx->sample_sort_splitters);
+    free(ctx);
+}
+
+
+/// `mergeSortMultiThreaded()`, without handing the array to `sampleSortMultiThreaded()`.
+static void mergeSortMultiThreaded_levels(
+    SortContext* ctx,
     thread_pool::ThreadPool* thread_pool,
     u32fast thread_count,
     const u32fast arr_size,
@@ -136,6 +357,7 @@ extern void mergeSortMultiThreaded(
     ZoneScoped;
 
     assert(thread_count > 0);
+    alwaysAssert(thread_count <= ctx->max_thread_count);
 
     if (arr_size < 2) return;
 
@@ -150,17 +372,11 @@ extern void mergeSortMultiThreaded(
     // Because spawning a thread just to have it sort 2 values is dumb.
 
 
-    // OPTIMIZE: Instead of heap-allocating here (this function may be called every frame!), we can write a
-    // `mergeSortMultithreaded_init()` procedure that does the alloc once.
-
-    thread_pool::TaskId* tasks = (thread_pool::TaskId*)calloc(thread_count, sizeof(thread_pool::TaskId));
-    defer(free(tasks));
+    thread_pool::TaskGroup tasks {};
+    MergeSortThreadParams* thread_params = ctx->merge_sort_params;
 
-    MergeSortThreadParams* thread_params = (MergeSortThreadParams*)calloc(thread_count, sizeof(MergeSortThreadParams));
-    defer(free(thread_params));
 
-
-    u32fast block_size = arr_size / thread_count;
+    const u32fast block_size = arr_size / thread_count;
     {
         u32fast remaining_element_count = arr_size;
 
@@ -179,14 +395,21 @@ extern void mergeSortMultiThreaded(
                     .p_scratch = param_p_scratch,
                 };
 
-                tasks[i] = thread_pool::enqueueTask(thread_pool, mergeSortMultiThreaded_thread, &thread_params[i]);
-
                 param_p_arr += block_size;
                 param_p_scratch += block_size;
 
                 assert(remaining_element_count >= block_size);
                 remaining_element_count -= block_size;
             }
+
+            thread_pool::enqueueTasks(
+                thread_pool,
+                &tasks,
+                (u32)thread_count,
+                mergeSortMultiThreaded_thread,
+                thread_params,
+                sizeof(MergeSortThreadParams)
+            );
         }
 
         if (remaining_element_count > 0)
@@ -202,62 +425,1110 @@ extern void mergeSortMultiThreaded(
         {
             ZoneScopedN("join threads");
 
-            for (u32 i = 0; i < thread_count; i++)
-            {
-                thread_pool::waitForTask(thread_pool, tasks[i]);
-            }
+            thread_pool::waitForGroup(thread_pool, &tasks);
         }
     }
 
-    while (true)
+    // The array is now sorted runs of `block_size`, except for a shorter last one. Each level merges the
+    // pairs of adjacent runs, split by output position into `thread_count` equal shares, so that every level
+    // keeps every thread busy, instead of halving the number of merges.
+    MergePathThreadParams* merge_params = ctx->merge_path_params;
+
+    KeyVal* arr1 = p_arr;
+    KeyVal* arr2 = p_scratch;
+
+    for (u32fast run_size = block_size; run_size < arr_size; run_size *= 2)
+    {
+        ZoneScopedN("merge level");
+
+        const u32fast share_size = arr_size / thread_count;
+        for (u32fast i = 0; i < thread_count; i++)
+        {
+            merge_params[i] = MergePathThreadParams {
+                .p_src = arr1,
+                .p_dst = arr2,
+                .arr_size = arr_size,
+                .run_size = run_size,
+                .idx_dst_begin = i * share_size,
+                .idx_dst_end = (i + 1 == thread_count) ? arr_size : (i + 1) * share_size,
+            };
+        }
+
+        thread_pool::enqueueTasks(
+            thread_pool,
+            &tasks,
+            (u32)(thread_count - 1),
+            mergeSortMultiThreaded_mergePath,
+            &merge_params[1],
+            sizeof(MergePathThreadParams)
+        );
+        mergeSortMultiThreaded_mergePath(&merge_params[0]);
+        thread_pool::waitForGroup(thread_pool, &tasks);
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        // TODO profile this
+        memcpy(p_arr, arr1, arr_size * sizeof(KeyVal));
+    }
+};
+
+/// The key in the high bits and the index in the low bits, so that the items are unique, and order like a
+/// stable sort leaves them.
+static inline u64 sampleSortItem(const KeyVal* p_arr, u32fast idx) {
+    return (u64)p_arr[idx].key << 32 | (u64)idx;
+}
+
+/// The number of splitters at or before `item`; there's one fewer splitter than buckets, a power of 2.
+static inline u32 sampleSortBucket(const u64* p_splitters, u32 bucket_count, u64 item) {
+
+    u32 bucket = 0;
+    for (u32 step = bucket_count / 2; step > 0; step /= 2)
+    {
+        if (item >= p_splitters[bucket + step - 1]) bucket += step;
+    }
+    return bucket;
+}
+
+static void sampleSortMultiThreaded_count(void* p_params_struct) {
+
+    ZoneScopedTask;
+
+    SampleSortThreadParams* params = (SampleSortThreadParams*)p_params_struct;
+
+    u32fast* counts = params->p_bucket_offsets;
+    for (u32 bucket = 0; bucket < params->bucket_count; bucket++) counts[bucket] = 0;
+
+    for (u32fast idx = params->idx_begin; idx < params->idx_end; idx++)
     {
-        u32fast remaining_block_size = arr_size;
+        counts[sampleSortBucket(params->p_splitters, params->bucket_count, sampleSortItem(params->p_src, idx))]++;
+    }
+}
+
+/// In the order of the array, so that equal keys stay in order within a bucket, as each thread's share of a
+/// bucket comes after those of the threads before it.
+static void sampleSortMultiThreaded_scatter(void* p_params_struct) {
+
+    ZoneScopedTask;
+
+    SampleSortThreadParams* params = (SampleSortThreadParams*)p_params_struct;
+
+    u32fast* offsets = params->p_bucket_offsets;
+    for (u32fast idx = params->idx_begin; idx < params->idx_end; idx++)
+    {
+        const u64 item = sampleSortItem(params->p_src, idx);
+        const u32 bucket = sampleSortBucket(params->p_splitters, params->bucket_count, item);
+        params->p_dst[offsets[bucket]++] = params->p_src[idx];
+    }
+}
+
+/// The bucket is small enough to stay in the thread's cache, so copying it back costs little next to its sort.
+static void sampleSortMultiThreaded_sortBucket(void* p_params_struct) {
+
+    const SampleSortBucketParams* params = (const SampleSortBucketParams*)p_params_struct;
+
+    mergeSort(params->size, params->p_keys, params->p_dst);
+    memcpy(params->p_dst, params->p_keys, params->size * sizeof(KeyVal));
+}
+
+extern void sampleSortMultiThreaded(
+    SortContext* ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    ZoneScoped;
+
+    assert(thread_count > 0);
+    alwaysAssert(thread_count <= ctx->max_thread_count);
 
-        u32fast old_block_size = block_size;
-        block_size *= 2;
-        thread_count = arr_size / block_size;
-        if (thread_count < 2) break;
+    if (arr_size < 2) return;
+
+    const u32fast bucket_count = getSampleSortBucketCount(thread_count);
+    const u32fast sample_count = bucket_count * SAMPLE_SORT_OVERSAMPLING;
+    // the indices must fit in the low half of the items
+    if (thread_count == 1 or arr_size < 2 * sample_count or arr_size > UINT32_MAX)
+    {
+        mergeSortMultiThreaded_levels(ctx, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+        return;
+    }
+
+    thread_pool::TaskGroup tasks {};
 
-        u32fast idx_start = 0;
+    // The splitters: every `SAMPLE_SORT_OVERSAMPLING`th of the sorted sample, which is an item from each of
+    // `sample_count` equal strides of the array, at a pseudo-random offset so that it doesn't alias with patterns
+    // in the keys.
+    u64* splitters = ctx->sample_sort_splitters;
+    {
+        ZoneScopedN("splitters");
 
+        SortItem<u64, NoVal>* samples = ctx->sample_sort_samples;
+        const u32fast stride = arr_size / sample_count;
+        for (u32fast i = 0; i < sample_count; i++)
         {
-            ZoneScopedN("spawn threads");
+            const u32fast idx = i * stride + (u32fast)((u32)i * 2654435769u) % stride;
+            samples[i].key = sampleSortItem(p_arr, idx);
+        }
+        mergeSortItems<u64, NoVal>(sample_count, samples, &samples[sample_count]);
 
-            for (u32fast i = 0; i < thread_count; i++)
-            {
-                thread_params[i] = MergeSortThreadParams {
-                    .array_size = block_size,
-                    .skip_to_bucket_size = old_block_size,
-                    .p_array = p_arr + idx_start,
-                    .p_scratch = p_scratch + idx_start,
-                };
+        for (u32fast i = 0; i + 1 < bucket_count; i++) splitters[i] = samples[(i + 1) * SAMPLE_SORT_OVERSAMPLING].key;
+    }
+
+    SampleSortThreadParams* thread_params = ctx->sample_sort_params;
+    const u32fast share_size = arr_size / thread_count;
+    for (u32fast i = 0; i < thread_count; i++)
+    {
+        thread_params[i] = SampleSortThreadParams {
+            .p_src = p_arr,
+            .p_dst = p_scratch,
+            .idx_begin = i * share_size,
+            .idx_end = (i + 1 == thread_count) ? arr_size : (i + 1) * share_size,
+            .p_splitters = splitters,
+            .bucket_count = (u32)bucket_count,
+            .p_bucket_offsets = &ctx->sample_sort_counts[i * bucket_count],
+        };
+    }
 
-                tasks[i] = thread_pool::enqueueTask(thread_pool, mergeSortMultiThreaded_thread, &thread_params[i]);
+    {
+        ZoneScopedN("count");
 
-                idx_start += block_size;
-                assert(remaining_block_size >= block_size);
-                remaining_block_size -= block_size;
-            }
+        thread_pool::enqueueTasks(
+            thread_pool,
+            &tasks,
+            (u32)(thread_count - 1),
+            sampleSortMultiThreaded_count,
+            &thread_params[1],
+            sizeof(SampleSortThreadParams)
+        );
+        sampleSortMultiThreaded_count(&thread_params[0]);
+        thread_pool::waitForGroup(thread_pool, &tasks);
+    }
 
-            assert(idx_start + remaining_block_size == arr_size);
+    // Bucket by bucket, and thread by thread within a bucket, the counts become where each thread scatters the
+    // first key of each bucket.
+    SampleSortBucketParams* bucket_params = ctx->sample_sort_bucket_params;
+    u32fast offset = 0;
+    for (u32fast bucket = 0; bucket < bucket_count; bucket++)
+    {
+        const u32fast bucket_begin = offset;
+        for (u32fast i = 0; i < thread_count; i++)
+        {
+            u32fast* p_offset = &thread_params[i].p_bucket_offsets[bucket];
+            const u32fast count = *p_offset;
+            *p_offset = offset;
+            offset += count;
         }
+        bucket_params[bucket] = SampleSortBucketParams {
+            .p_keys = &p_scratch[bucket_begin],
+            .p_dst = &p_arr[bucket_begin],
+            .size = offset - bucket_begin,
+        };
+    }
+    assert(offset == arr_size);
+
+    {
+        ZoneScopedN("scatter");
+
+        thread_pool::enqueueTasks(
+            thread_pool,
+            &tasks,
+            (u32)(thread_count - 1),
+            sampleSortMultiThreaded_scatter,
+            &thread_params[1],
+            sizeof(SampleSortThreadParams)
+        );
+        sampleSortMultiThreaded_scatter(&thread_params[0]);
+        thread_pool::waitForGroup(thread_pool, &tasks);
+    }
+
+    // The buckets' keys are all before the next bucket's, and each bucket is sorted by whichever thread takes it,
+    // which also writes its part of the output.
+    {
+        ZoneScopedN("sort buckets");
+
+        thread_pool::enqueueTasks(
+            thread_pool,
+            &tasks,
+            (u32)(bucket_count - 1),
+            sampleSortMultiThreaded_sortBucket,
+            &bucket_params[1],
+            sizeof(SampleSortBucketParams)
+        );
+        sampleSortMultiThreaded_sortBucket(&bucket_params[0]);
+        thread_pool::waitForGroup(thread_pool, &tasks);
+    }
+}
+
+extern void mergeSortMultiThreaded(
+    SortContext* ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    const bool sample_sort =
+        thread_count >= SAMPLE_SORT_MIN_THREAD_COUNT and
+        arr_size >= SAMPLE_SORT_MIN_KEYS_PER_THREAD * thread_count;
+    if (sample_sort) sampleSortMultiThreaded(ctx, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+    else mergeSortMultiThreaded_levels(ctx, thread_pool, thread_count, arr_size, p_arr, p_scratch);
+}
+
+
+/// The end of the non-descending run that starts at `idx`.
+static inline u32fast findRunEnd(const KeyVal* arr, u32fast idx, const u32fast arr_size) {
+
+    idx++;
+    while (idx < arr_size and arr[idx - 1].key <= arr[idx].key) idx++;
+    return idx;
+}
+
+extern void naturalMergeSort(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    ZoneScopedTask;
+
+    if (arr_size < 2) return;
+
 
-        if (remaining_block_size > 0)
+    KeyVal* arr1 = p_arr;
+    KeyVal* arr2 = p_scratch;
+
+
+    // Each pass merges pairs of adjacent runs, so it halves the number of runs.
+    while (true)
+    {
+        u32fast idx_b = findRunEnd(arr1, 0, arr_size);
+        if (idx_b == arr_size) break;
+
+        u32fast idx_a = 0;
+        while (idx_a < arr_size)
         {
-            mergeSort(
-                remaining_block_size,
-                p_arr + idx_start,
-                p_scratch + idx_start,
-                old_block_size
+            const u32fast idx_b_end = (idx_b < arr_size) ? findRunEnd(arr1, idx_b, arr_size) : arr_size;
+
+            mergeSort_merge(
+                arr1,
+                arr2,
+                idx_a, idx_b, idx_a,
+                idx_b, idx_b_end, idx_b_end
             );
+
+            idx_a = idx_b_end;
+            if (idx_a < arr_size) idx_b = findRunEnd(arr1, idx_a, arr_size);
+        }
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        memcpy(p_arr, arr1, arr_size * sizeof(KeyVal));
+    }
+}
+
+
+constexpr u32 RADIX_SORT_BITS_PER_PASS = 8;
+constexpr u32 RADIX_SORT_BUCKET_COUNT = 1 << RADIX_SORT_BITS_PER_PASS;
+constexpr u32 RADIX_SORT_PASS_COUNT = 32 / RADIX_SORT_BITS_PER_PASS;
+
+extern void radixSort(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    ZoneScopedTask;
+
+    if (arr_size < 2) return;
+
+
+    // the histograms of all the passes, in one pass over the keys
+    u32fast histograms[RADIX_SORT_PASS_COUNT][RADIX_SORT_BUCKET_COUNT] {};
+    for (u32fast i = 0; i < arr_size; i++)
+    {
+        const u32 key = p_arr[i].key;
+        for (u32 pass = 0; pass < RADIX_SORT_PASS_COUNT; pass++)
+        {
+            histograms[pass][(key >> (pass * RADIX_SORT_BITS_PER_PASS)) & (RADIX_SORT_BUCKET_COUNT - 1)]++;
         }
+    }
+
 
+    KeyVal* arr1 = p_arr;
+    KeyVal* arr2 = p_scratch;
+
+
+    for (u32 pass = 0; pass < RADIX_SORT_PASS_COUNT; pass++)
+    {
+        const u32 shift = pass * RADIX_SORT_BITS_PER_PASS;
+        const u32fast* histogram = histograms[pass];
+
+        // If all the keys have the same digit, the pass wouldn't move anything. Common for the high digits of
+        // Morton codes.
+        if (histogram[(arr1[0].key >> shift) & (RADIX_SORT_BUCKET_COUNT - 1)] == arr_size) continue;
+
+        u32fast offsets[RADIX_SORT_BUCKET_COUNT];
         {
-            ZoneScopedN("join threads");
-            for (u32fast i = 0; i < thread_count; i++) thread_pool::waitForTask(thread_pool, tasks[i]);
+            u32fast offset = 0;
+            for (u32 bucket = 0; bucket < RADIX_SORT_BUCKET_COUNT; bucket++)
+            {
+                offsets[bucket] = offset;
+                offset += histogram[bucket];
+            }
+        }
+
+        for (u32fast i = 0; i < arr_size; i++)
+        {
+            const u32 bucket = (arr1[i].key >> shift) & (RADIX_SORT_BUCKET_COUNT - 1);
+            arr2[offsets[bucket]++] = arr1[i];
         }
+
+        SWAP(arr1, arr2);
     }
 
-    assert(block_size <= arr_size);
-    mergeSort(arr_size, p_arr, p_scratch, block_size / 2);
-};
+    if (arr1 != p_arr)
+    {
+        memcpy(p_arr, arr1, arr_size * sizeof(KeyVal));
+    }
+}
+
+
+static void radixSortMultiThreaded_maxKey(void* p_params_struct) {
+
+    RadixSortThreadParams* params = (RadixSortThreadParams*)p_params_struct;
+
+    u32 max_key = 0;
+    for (u32fast i = params->idx_begin; i < params->idx_end; i++)
+    {
+        max_key = math::max(max_key, params->p_src[i].key);
+    }
+    params->max_key = max_key;
+}
+
+static void radixSortMultiThreaded_histogram(void* p_params_struct) {
+
+    RadixSortThreadParams* params = (RadixSortThreadParams*)p_params_struct;
+
+    const u32 mask = params->bucket_count - 1;
+    memset(params->histogram, 0, params->bucket_count * sizeof(u32fast));
+    for (u32fast i = params->idx_begin; i < params->idx_end; i++)
+    {
+        params->histogram[(params->p_src[i].key >> params->shift) & mask]++;
+    }
+}
+
+/// Scatters through a cache line per bucket, so that each write to the destination is a whole line instead of
+/// one of up to `bucket_count` scattered partial lines.
+static void radixSortMultiThreaded_scatter(void* p_params_struct) {
+
+    RadixSortThreadParams* params = (RadixSortThreadParams*)p_params_struct;
+
+    const u32 mask = params->bucket_count - 1;
+    u32fast* offsets = params->offsets;
+    u32* fill = params->write_combining_fill;
+    KeyVal* buffers = params->write_combining_buffers;
+    memset(fill, 0, params->bucket_count * sizeof(u32));
+
+    for (u32fast i = params->idx_begin; i < params->idx_end; i++)
+    {
+        const KeyVal kv = params->p_src[i];
+        const u32 bucket = (kv.key >> params->shift) & mask;
+
+        KeyVal* buffer = &buffers[bucket * RADIX_SORT_MT_WRITE_COMBINING_SIZE];
+        buffer[fill[bucket]++] = kv;
+        if (fill[bucket] == RADIX_SORT_MT_WRITE_COMBINING_SIZE)
+        {
+            memcpy(
+                &params->p_dst[offsets[bucket]], buffer, RADIX_SORT_MT_WRITE_COMBINING_SIZE * sizeof(KeyVal)
+            );
+            offsets[bucket] += RADIX_SORT_MT_WRITE_COMBINING_SIZE;
+            fill[bucket] = 0;
+        }
+    }
+
+    for (u32 bucket = 0; bucket < params->bucket_count; bucket++)
+    {
+        memcpy(
+            &params->p_dst[offsets[bucket]],
+            &buffers[bucket * RADIX_SORT_MT_WRITE_COMBINING_SIZE],
+            fill[bucket] * sizeof(KeyVal)
+        );
+    }
+}
+
+static void radixSortMultiThreaded_copy(void* p_params_struct) {
+
+    const RadixSortThreadParams* params = (const RadixSortThreadParams*)p_params_struct;
+
+    memcpy(
+        &params->p_dst[params->idx_begin],
+        &params->p_src[params->idx_begin],
+        (params->idx_end - params->idx_begin) * sizeof(KeyVal)
+    );
+}
+
+/// Runs `p_procedure` for each thread's params, on the calling thread for the first one.
+static void radixSortMultiThreaded_run(
+    thread_pool::ThreadPool* thread_pool,
+    const u32fast thread_count,
+    thread_pool::PFN_TaskProc p_procedure,
+    RadixSortThreadParams* p_thread_params
+) {
+
+    thread_pool::TaskGroup tasks {};
+    thread_pool::enqueueTasks(
+        thread_pool, &tasks, (u32)(thread_count - 1), p_procedure, &p_thread_params[1], sizeof(RadixSortThreadParams)
+    );
+    p_procedure(&p_thread_params[0]);
+    thread_pool::waitForGroup(thread_pool, &tasks);
+}
+
+extern void radixSortMultiThreaded(
+    SortContext* ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    ZoneScoped;
+
+    assert(thread_count > 0);
+    alwaysAssert(thread_count <= ctx->max_thread_count);
+
+    if (arr_size < 2) return;
+
+    thread_count = math::min(thread_count, arr_size / RADIX_SORT_MT_MIN_KEYS_PER_THREAD);
+    if (thread_count < 2)
+    {
+        radixSort(arr_size, p_arr, p_scratch);
+        return;
+    }
+
+
+    RadixSortThreadParams* thread_params = ctx->radix_sort_params;
+    u32fast* counts = ctx->radix_sort_counts;
+    u32* fills = ctx->radix_sort_write_combining_fills;
+    KeyVal* write_combining_buffers = ctx->radix_sort_write_combining_buffers;
+
+    {
+        const u32fast block_size = arr_size / thread_count;
+        for (u32fast t = 0; t < thread_count; t++)
+        {
+            thread_params[t] = RadixSortThreadParams {
+                .idx_begin = t * block_size,
+                .idx_end = (t + 1 == thread_count) ? arr_size : (t + 1) * block_size,
+                .p_src = p_arr,
+                .p_dst = p_scratch,
+                .shift = 0,
+                .bucket_count = 0,
+                .max_key = 0,
+                .histogram = &counts[(2 * t) * RADIX_SORT_MT_MAX_BUCKET_COUNT],
+                .offsets = &counts[(2 * t + 1) * RADIX_SORT_MT_MAX_BUCKET_COUNT],
+                .write_combining_fill = &fills[t * RADIX_SORT_MT_MAX_BUCKET_COUNT],
+                .write_combining_buffers = &write_combining_buffers[
+                    t * RADIX_SORT_MT_MAX_BUCKET_COUNT * RADIX_SORT_MT_WRITE_COMBINING_SIZE
+                ],
+            };
+        }
+    }
+
+
+    // Only sort the bits that some key has, e.g. 3 passes of 10 bits for 30-bit Morton codes.
+    u32 bit_count = 0;
+    {
+        ZoneScopedN("max key");
+
+        radixSortMultiThreaded_run(
+            thread_pool, thread_count, radixSortMultiThreaded_maxKey, thread_params
+        );
+
+        u32 max_key = 0;
+        for (u32fast t = 0; t < thread_count; t++) max_key = math::max(max_key, thread_params[t].max_key);
+        while (bit_count < 32 and (max_key >> bit_count) != 0) bit_count++;
+    }
+    if (bit_count == 0) return; // all the keys are 0
+
+    const u32 pass_count = (bit_count + RADIX_SORT_MT_MAX_DIGIT_BITS - 1) / RADIX_SORT_MT_MAX_DIGIT_BITS;
+    const u32 digit_bit_count = (bit_count + pass_count - 1) / pass_count;
+    const u32 bucket_count = 1u << digit_bit_count;
+
+
+    KeyVal* arr1 = p_arr;
+    KeyVal* arr2 = p_scratch;
+
+    for (u32 pass = 0; pass < pass_count; pass++)
+    {
+        ZoneScopedN("pass");
+
+        for (u32fast t = 0; t < thread_count; t++)
+        {
+            thread_params[t].p_src = arr1;
+            thread_params[t].p_dst = arr2;
+            thread_params[t].shift = pass * digit_bit_count;
+            thread_params[t].bucket_count = bucket_count;
+        }
+
+        radixSortMultiThreaded_run(
+            thread_pool, thread_count, radixSortMultiThreaded_histogram, thread_params
+        );
+
+        // Bucket-major, then thread-major, so that the threads' keys of each bucket stay in order, which
+        // keeps the sort stable.
+        bool pass_moves_keys = true;
+        {
+            u32fast offset = 0;
+            for (u32 bucket = 0; bucket < bucket_count; bucket++)
+            {
+                u32fast bucket_size = 0;
+                for (u32fast t = 0; t < thread_count; t++)
+                {
+                    thread_params[t].offsets[bucket] = offset;
+                    offset += thread_params[t].histogram[bucket];
+                    bucket_size += thread_params[t].histogram[bucket];
+                }
+                // If all the keys have the same digit, the pass wouldn't move anything.
+                if (bucket_size == arr_size) pass_moves_keys = false;
+            }
+        }
+        if (!pass_moves_keys) continue;
+
+        radixSortMultiThreaded_run(
+            thread_pool, thread_count, radixSortMultiThreaded_scatter, thread_params
+        );
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        ZoneScopedN("copy");
+
+        for (u32fast t = 0; t < thread_count; t++)
+        {
+            thread_params[t].p_src = arr1;
+            thread_params[t].p_dst = p_arr;
+        }
+        radixSortMultiThreaded_run(
+            thread_pool, thread_count, radixSortMultiThreaded_copy, thread_params
+        );
+    }
+}
+
+
+//
+// ===========================================================================================================
+//
+
+// `mergeSortSimd()` compares KeyVals as `u64`s with the key in the high half, i.e. by key and then by val. A
+// bitonic network moves equal keys past each other, so it can't be stable, but with a total order any correct
+// merge of the same runs gives the same result.
+
+static inline u64 packKeyVal(const KeyVal kv) {
+    return ((u64)kv.key << 32) | kv.val;
+}
+
+/// Merges the sorted arrays `p_a`, `p_b` and `p_c` (which may be empty) one element at a time.
+static void mergeThreeByKeyVal(
+    const KeyVal* p_a, const u32fast a_size,
+    const KeyVal* p_b, const u32fast b_size,
+    const KeyVal* p_c, const u32fast c_size,
+    KeyVal* p_out
+) {
+
+    u32fast ia = 0, ib = 0, ic = 0;
+    while (ia < a_size or ib < b_size or ic < c_size)
+    {
+        // an exhausted input compares as the largest KeyVal; the loop ends before all of them are exhausted
+        const u64 a = (ia < a_size) ? packKeyVal(p_a[ia]) : UINT64_MAX;
+        const u64 b = (ib < b_size) ? packKeyVal(p_b[ib]) : UINT64_MAX;
+        const u64 c = (ic < c_size) ? packKeyVal(p_c[ic]) : UINT64_MAX;
+
+        if (ia < a_size and a <= b and a <= c) *p_out++ = p_a[ia++];
+        else if (ib < b_size and b <= c) *p_out++ = p_b[ib++];
+        else *p_out++ = p_c[ic++];
+    }
+}
+
+static void sortBlockByKeyVal_scalar(KeyVal* p_arr, const u32fast size) {
+
+    // insertion sort; the blocks are a few elements
+    for (u32fast i = 1; i < size; i++)
+    {
+        const KeyVal kv = p_arr[i];
+        u32fast j = i;
+        for (; j > 0 and packKeyVal(p_arr[j - 1]) > packKeyVal(kv); j--) p_arr[j] = p_arr[j - 1];
+        p_arr[j] = kv;
+    }
+}
+
+
+// The kernels are compiled for their instruction set whatever the build flags are, and only called if the CPU
+// has it. The loops around them are templates that get inlined into a function per instruction set, because
+// code can only be inlined into functions with a superset of its instruction sets.
+#define SORT_TARGET_AVX2 __attribute__((target("avx2")))
+#define SORT_TARGET_AVX512 __attribute__((target("avx512f")))
+#define SORT_ALWAYS_INLINE __attribute__((always_inline))
+
+// The templates pass registers by value, which GCC warns about because it would be a different ABI without the
+// instruction set, but they're always inlined. GCC 12 also warns about the `_mm512_undefined_*()` in its own
+// intrinsics once they're inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/// AVX2: 4 KeyVals per register. There is no unsigned 64-bit compare, so the lanes are kept with the sign bit
+/// flipped, which makes the signed compare order them like the unsigned `packKeyVal()`s.
+struct SimdAvx2 {
+
+    using Vec = __m256i;
+    static constexpr u32 WIDTH = 4;
+
+    SORT_TARGET_AVX2 static inline Vec load(const KeyVal* p) {
+        const Vec v = _mm256_loadu_si256((const Vec*)p);
+        // swap the key and the val in each lane
+        return _mm256_xor_si256(_mm256_shuffle_epi32(v, 0xB1), _mm256_set1_epi64x(INT64_MIN));
+    }
+
+    SORT_TARGET_AVX2 static inline void store(KeyVal* p, const Vec v) {
+        const Vec unflipped = _mm256_xor_si256(v, _mm256_set1_epi64x(INT64_MIN));
+        _mm256_storeu_si256((Vec*)p, _mm256_shuffle_epi32(unflipped, 0xB1));
+    }
+
+    SORT_TARGET_AVX2 static inline void minMax(const Vec a, const Vec b, Vec* p_min, Vec* p_max) {
+        const Vec a_greater = _mm256_cmpgt_epi64(a, b);
+        *p_min = _mm256_blendv_epi8(a, b, a_greater);
+        *p_max = _mm256_blendv_epi8(b, a, a_greater);
+    }
+
+    /// Sorts a bitonic register.
+    SORT_TARGET_AVX2 static inline Vec bitonicMerge(Vec v) {
+        Vec lo, hi;
+        // lanes (0, 2), (1, 3)
+        minMax(v, _mm256_permute4x64_epi64(v, 0x4E), &lo, &hi);
+        v = _mm256_blend_epi32(lo, hi, 0xF0);
+        // lanes (0, 1), (2, 3)
+        minMax(v, _mm256_permute4x64_epi64(v, 0xB1), &lo, &hi);
+        return _mm256_blend_epi32(lo, hi, 0xCC);
+    }
+
+    SORT_TARGET_AVX2 static inline Vec sort(Vec v) {
+        Vec lo, hi;
+        // lanes (0, 1), (2, 3)
+        minMax(v, _mm256_permute4x64_epi64(v, 0xB1), &lo, &hi);
+        v = _mm256_blend_epi32(lo, hi, 0xCC);
+        // lanes (0, 2), (1, 3)
+        minMax(v, _mm256_permute4x64_epi64(v, 0x4E), &lo, &hi);
+        v = _mm256_blend_epi32(lo, hi, 0xF0);
+        // lanes (1, 2); lanes 0 and 3 are compared with themselves
+        minMax(v, _mm256_permute4x64_epi64(v, 0xD8), &lo, &hi);
+        return _mm256_blend_epi32(lo, hi, 0xF0);
+    }
+
+    /// `a` and `b` sorted; `*p_lo` gets the smaller half of their elements, and `*p_hi` the larger, sorted.
+    SORT_TARGET_AVX2 static inline void merge(const Vec a, const Vec b, Vec* p_lo, Vec* p_hi) {
+        Vec lo, hi;
+        minMax(a, _mm256_permute4x64_epi64(b, 0x1B), &lo, &hi);
+        *p_lo = bitonicMerge(lo);
+        *p_hi = bitonicMerge(hi);
+    }
+};
+
+/// AVX-512: 8 KeyVals per register. The compare-exchange steps of the bitonic networks are written once, for
+/// the lanes `i` and `i ^ j`.
+struct SimdAvx512 {
+
+    using Vec = __m512i;
+    static constexpr u32 WIDTH = 8;
+
+    SORT_TARGET_AVX512 static inline Vec load(const KeyVal* p) {
+        return _mm512_shuffle_epi32(_mm512_loadu_si512((const void*)p), _MM_PERM_CDAB);
+    }
+
+    SORT_TARGET_AVX512 static inline void store(KeyVal* p, const Vec v) {
+        _mm512_storeu_si512((void*)p, _mm512_shuffle_epi32(v, _MM_PERM_CDAB));
+    }
+
+    /// The step of the bitonic sort stage `k` that compares lanes `j` apart: lane `i` takes the larger one iff
+    /// `i & j` and `i & k` differ, so that the blocks of `k` lanes alternate between ascending and descending.
+    static constexpr __mmask8 stepMaxMask(const u32 k, const u32 j) {
+        u32 mask = 0;
+        for (u32 i = 0; i < WIDTH; i++) if (((i & j) != 0) != ((i & k) != 0)) mask |= 1u << i;
+        return (__mmask8)mask;
+    }
+
+    template<u32 k, u32 j>
+    SORT_TARGET_AVX512 static inline Vec step(const Vec v) {
+        const Vec partner_idx = _mm512_set_epi64(7 ^ j, 6 ^ j, 5 ^ j, 4 ^ j, 3 ^ j, 2 ^ j, 1 ^ j, 0 ^ j);
+        const Vec partner = _mm512_permutexvar_epi64(partner_idx, v);
+        return _mm512_mask_blend_epi64(
+            stepMaxMask(k, j), _mm512_min_epu64(v, partner), _mm512_max_epu64(v, partner)
+        );
+    }
+
+    SORT_TARGET_AVX512 static inline Vec bitonicMerge(Vec v) {
+        v = step<8, 4>(v);
+        v = step<8, 2>(v);
+        return step<8, 1>(v);
+    }
+
+    SORT_TARGET_AVX512 static inline Vec sort(Vec v) {
+        v = step<2, 1>(v);
+        v = step<4, 2>(v);
+        v = step<4, 1>(v);
+        return bitonicMerge(v);
+    }
+
+    SORT_TARGET_AVX512 static inline void merge(const Vec a, const Vec b, Vec* p_lo, Vec* p_hi) {
+        const Vec b_reversed = _mm512_permutexvar_epi64(_mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7), b);
+        *p_lo = bitonicMerge(_mm512_min_epu64(a, b_reversed));
+        *p_hi = bitonicMerge(_mm512_max_epu64(a, b_reversed));
+    }
+};
+
+
+/// Merges a register at a time: the larger half of each merge stays in a register and is merged with the next
+/// register from whichever input has the smaller next element, so every element that is stored is final.
+template<typename Simd>
+SORT_ALWAYS_INLINE static inline void mergeByKeyVal_simd(
+    const KeyVal* p_a, const u32fast a_size,
+    const KeyVal* p_b, const u32fast b_size,
+    KeyVal* p_out
+) {
+
+    using Vec = typename Simd::Vec;
+    constexpr u32 W = Simd::WIDTH;
+
+    if (a_size < W or b_size < W)
+    {
+        mergeThreeByKeyVal(p_a, a_size, p_b, b_size, NULL, 0, p_out);
+        return;
+    }
+
+    Vec lo, hi;
+    Simd::merge(Simd::load(p_a), Simd::load(p_b), &lo, &hi);
+    Simd::store(p_out, lo);
+    u32fast ia = W, ib = W, io = W;
+
+    while (ia < a_size or ib < b_size)
+    {
+        const bool take_a = ib == b_size or (ia < a_size and packKeyVal(p_a[ia]) <= packKeyVal(p_b[ib]));
+
+        Vec next;
+        if (take_a)
+        {
+            if (a_size - ia < W) break;
+            next = Simd::load(&p_a[ia]);
+            ia += W;
+        }
+        else
+        {
+            if (b_size - ib < W) break;
+            next = Simd::load(&p_b[ib]);
+            ib += W;
+        }
+
+        Simd::merge(hi, next, &lo, &hi);
+        Simd::store(&p_out[io], lo);
+        io += W;
+    }
+
+    KeyVal tail[W];
+    Simd::store(tail, hi);
+    mergeThreeByKeyVal(tail, W, &p_a[ia], a_size - ia, &p_b[ib], b_size - ib, &p_out[io]);
+}
+
+template<typename Simd>
+SORT_ALWAYS_INLINE static inline void sortBlocksByKeyVal_simd(KeyVal* p_arr, const u32fast arr_size) {
+
+    constexpr u32 W = Simd::WIDTH;
+
+    u32fast i = 0;
+    for (; i + W <= arr_size; i += W) Simd::store(&p_arr[i], Simd::sort(Simd::load(&p_arr[i])));
+    sortBlockByKeyVal_scalar(&p_arr[i], arr_size - i);
+}
+
+
+SORT_TARGET_AVX2 static void mergeByKeyVal_avx2(
+    const KeyVal* p_a, u32fast a_size, const KeyVal* p_b, u32fast b_size, KeyVal* p_out
+) {
+    mergeByKeyVal_simd<SimdAvx2>(p_a, a_size, p_b, b_size, p_out);
+}
+
+SORT_TARGET_AVX2 static void sortBlocksByKeyVal_avx2(KeyVal* p_arr, u32fast arr_size) {
+    sortBlocksByKeyVal_simd<SimdAvx2>(p_arr, arr_size);
+}
+
+SORT_TARGET_AVX512 static void mergeByKeyVal_avx512(
+    const KeyVal* p_a, u32fast a_size, const KeyVal* p_b, u32fast b_size, KeyVal* p_out
+) {
+    mergeByKeyVal_simd<SimdAvx512>(p_a, a_size, p_b, b_size, p_out);
+}
+
+SORT_TARGET_AVX512 static void sortBlocksByKeyVal_avx512(KeyVal* p_arr, u32fast arr_size) {
+    sortBlocksByKeyVal_simd<SimdAvx512>(p_arr, arr_size);
+}
+
+#pragma GCC diagnostic pop
+
+
+using PFN_MergeByKeyVal = void (*)(const KeyVal*, u32fast, const KeyVal*, u32fast, KeyVal*);
+using PFN_SortBlocksByKeyVal = void (*)(KeyVal*, u32fast);
+
+struct SimdSortKernels {
+    const char* name;
+    u32fast block_size;
+    PFN_MergeByKeyVal merge;
+    PFN_SortBlocksByKeyVal sort_blocks;
+};
+
+static void mergeByKeyVal_scalar(
+    const KeyVal* p_a, u32fast a_size, const KeyVal* p_b, u32fast b_size, KeyVal* p_out
+) {
+    mergeThreeByKeyVal(p_a, a_size, p_b, b_size, NULL, 0, p_out);
+}
+
+constexpr u32fast SCALAR_SORT_BLOCK_SIZE = 4;
+
+static void sortBlocksByKeyVal_scalar(KeyVal* p_arr, const u32fast arr_size) {
+    for (u32fast i = 0; i < arr_size; i += SCALAR_SORT_BLOCK_SIZE)
+    {
+        sortBlockByKeyVal_scalar(&p_arr[i], math::min(SCALAR_SORT_BLOCK_SIZE, arr_size - i));
+    }
+}
+
+/// The widest kernels that the CPU supports, picked on the first call.
+static const SimdSortKernels* getSimdSortKernels(void) {
+
+    static const SimdSortKernels avx512 {
+        .name = "avx512",
+        .block_size = SimdAvx512::WIDTH,
+        .merge = mergeByKeyVal_avx512,
+        .sort_blocks = sortBlocksByKeyVal_avx512,
+    };
+    static const SimdSortKernels avx2 {
+        .name = "avx2",
+        .block_size = SimdAvx2::WIDTH,
+        .merge = mergeByKeyVal_avx2,
+        .sort_blocks = sortBlocksByKeyVal_avx2,
+    };
+    static const SimdSortKernels scalar {
+        .name = "scalar",
+        .block_size = SCALAR_SORT_BLOCK_SIZE,
+        .merge = mergeByKeyVal_scalar,
+        .sort_blocks = sortBlocksByKeyVal_scalar,
+    };
+
+    static const SimdSortKernels* kernels = __builtin_cpu_supports("avx512f") ? &avx512
+                                          : __builtin_cpu_supports("avx2") ? &avx2
+                                          : &scalar;
+    return kernels;
+}
+
+extern void mergeSortSimd(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+) {
+
+    ZoneScopedTask;
+
+    if (arr_size < 2) return;
+
+    const SimdSortKernels* kernels = getSimdSortKernels();
+    kernels->sort_blocks(p_arr, arr_size);
+
+
+    KeyVal* arr1 = p_arr;
+    KeyVal* arr2 = p_scratch;
+
+    for (u32fast run_size = kernels->block_size; run_size < arr_size; run_size *= 2)
+    {
+        for (u32fast idx_a = 0; idx_a < arr_size; idx_a += 2 * run_size)
+        {
+            const u32fast idx_b = math::min(idx_a + run_size, arr_size);
+            const u32fast idx_b_end = math::min(idx_a + 2 * run_size, arr_size);
+
+            kernels->merge(&arr1[idx_a], idx_b - idx_a, &arr1[idx_b], idx_b_end - idx_b, &arr2[idx_a]);
+        }
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        memcpy(p_arr, arr1, arr_size * sizeof(KeyVal));
+    }
+}
+
+
+//
+// ===========================================================================================================
+//
+
+/// Whether `a` goes strictly before `b`. With `SORT_UNSTABLE`, a key and value that fit in a `u64` are
+/// compared as one: the key in the high bits.
+template<typename Key, typename Val, u32 flags>
+static inline bool sortItemPrecedes(const SortItem<Key, Val>* a, const SortItem<Key, Val>* b) {
+
+    constexpr bool descending = (flags & SORT_DESCENDING) != 0;
+    constexpr bool pack =
+        (flags & SORT_UNSTABLE) != 0
+        and not std::is_same<Val, NoVal>::value
+        and sizeof(Key) + sizeof(Val) <= sizeof(u64);
+
+    if constexpr (pack)
+    {
+        constexpr u32 val_bits = 8 * sizeof(Val);
+        const u64 packed_a = ((u64)a->key << val_bits) | (u64)a->val;
+        const u64 packed_b = ((u64)b->key << val_bits) | (u64)b->val;
+        return descending ? packed_a > packed_b : packed_a < packed_b;
+    }
+    else
+    {
+        return descending ? a->key > b->key : a->key < b->key;
+    }
+}
+
+template<typename Key, typename Val, u32 flags>
+void mergeSortItems(
+    const u32fast arr_size,
+    SortItem<Key, Val> *const p_arr,
+    SortItem<Key, Val> *const p_scratch
+) {
+
+    ZoneScopedTask;
+
+    static_assert(std::is_unsigned<Key>::value);
+
+    if (arr_size < 2) return;
+
+
+    SortItem<Key, Val>* arr1 = p_arr;
+    SortItem<Key, Val>* arr2 = p_scratch;
+
+    for (u32fast run_size = 1; run_size < arr_size; run_size *= 2)
+    {
+        for (u32fast idx_a = 0; idx_a < arr_size; idx_a += 2 * run_size)
+        {
+            const u32fast idx_a_end = math::min(idx_a + run_size, arr_size);
+            const u32fast idx_b_end = math::min(idx_a + 2 * run_size, arr_size);
+
+            u32fast ia = idx_a;
+            u32fast ib = idx_a_end;
+            for (u32fast idx_dst = idx_a; idx_dst < idx_b_end; idx_dst++)
+            {
+                // ties take from `a`, which keeps the sort stable
+                const bool take_a =
+                    ib >= idx_b_end
+                    or (ia < idx_a_end and not sortItemPrecedes<Key, Val, flags>(&arr1[ib], &arr1[ia]));
+
+                arr2[idx_dst] = take_a ? arr1[ia++] : arr1[ib++];
+            }
+        }
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        memcpy(p_arr, arr1, arr_size * sizeof(SortItem<Key, Val>));
+    }
+}
+
+/// The digit of `key` at `shift`; complemented if descending, so that larger digits go in earlier buckets.
+template<typename Key, u32 flags>
+static inline u32 radixSortItems_bucket(const Key key, const u32 shift) {
+    const u32 digit = (u32)(key >> shift) & (RADIX_SORT_BUCKET_COUNT - 1);
+    return ((flags & SORT_DESCENDING) != 0) ? (RADIX_SORT_BUCKET_COUNT - 1) ^ digit : digit;
+}
+
+template<typename Key, typename Val, u32 flags>
+void radixSortItems(
+    const u32fast arr_size,
+    SortItem<Key, Val> *const p_arr,
+    SortItem<Key, Val> *const p_scratch
+) {
+
+    ZoneScopedTask;
+
+    static_assert(std::is_unsigned<Key>::value);
+
+    constexpr u32 pass_count = 8 * sizeof(Key) / RADIX_SORT_BITS_PER_PASS;
+
+    if (arr_size < 2) return;
+
+
+    // the histograms of all the passes, in one pass over the keys
+    u32fast histograms[pass_count][RADIX_SORT_BUCKET_COUNT] {};
+    for (u32fast i = 0; i < arr_size; i++)
+    {
+        const Key key = p_arr[i].key;
+        for (u32 pass = 0; pass < pass_count; pass++)
+        {
+            histograms[pass][radixSortItems_bucket<Key, flags>(key, pass * RADIX_SORT_BITS_PER_PASS)]++;
+        }
+    }
+
+
+    SortItem<Key, Val>* arr1 = p_arr;
+    SortItem<Key, Val>* arr2 = p_scratch;
+
+    for (u32 pass = 0; pass < pass_count; pass++)
+    {
+        const u32 shift = pass * RADIX_SORT_BITS_PER_PASS;
+        const u32fast* histogram = histograms[pass];
+
+        // If all the keys have the same digit, the pass wouldn't move anything.
+        if (histogram[radixSortItems_bucket<Key, flags>(arr1[0].key, shift)] == arr_size) continue;
+
+        u32fast offsets[RADIX_SORT_BUCKET_COUNT];
+        {
+            u32fast offset = 0;
+            for (u32 bucket = 0; bucket < RADIX_SORT_BUCKET_COUNT; bucket++)
+            {
+                offsets[bucket] = offset;
+                offset += histogram[bucket];
+            }
+        }
+
+        for (u32fast i = 0; i < arr_size; i++)
+        {
+            const u32 bucket = radixSortItems_bucket<Key, flags>(arr1[i].key, shift);
+            arr2[offsets[bucket]++] = arr1[i];
+        }
+
+        SWAP(arr1, arr2);
+    }
+
+    if (arr1 != p_arr)
+    {
+        memcpy(p_arr, arr1, arr_size * sizeof(SortItem<Key, Val>));
+    }
+}
+
+
+#define INSTANTIATE_SORT_ITEMS(Key, Val, flags) \
+    template void mergeSortItems<Key, Val, flags>(u32fast, SortItem<Key, Val>*, SortItem<Key, Val>*); \
+    template void radixSortItems<Key, Val, flags>(u32fast, SortItem<Key, Val>*, SortItem<Key, Val>*);
+
+#define INSTANTIATE_SORT_ITEMS_ALL_FLAGS(Key, Val) \
+    INSTANTIATE_SORT_ITEMS(Key, Val, 0) \
+    INSTANTIATE_SORT_ITEMS(Key, Val, SORT_DESCENDING) \
+    INSTANTIATE_SORT_ITEMS(Key, Val, SORT_UNSTABLE) \
+    INSTANTIATE_SORT_ITEMS(Key, Val, SORT_DESCENDING | SORT_UNSTABLE)
+
+INSTANTIATE_SORT_ITEMS_ALL_FLAGS(u32, u32)
+INSTANTIATE_SORT_ITEMS_ALL_FLAGS(u32, NoVal)
+INSTANTIATE_SORT_ITEMS_ALL_FLAGS(u64, u32)
+INSTANTIATE_SORT_ITEMS_ALL_FLAGS(u64, NoVal)
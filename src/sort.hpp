@@ -14,6 +14,14 @@ struct KeyVal {
     u32 val;
 };
 
+/// The per-thread state of the multi-threaded sorts, so that they don't allocate. Create one per
+/// caller that sorts every frame; a context can't be used by two sorts at once.
+struct SortContext;
+
+/// For sorts on up to `max_thread_count` threads.
+SortContext* createSortContext(const u32fast max_thread_count);
+void destroySortContext(SortContext*);
+
 void mergeSort(
     const u32fast arr_size,
     KeyVal *const p_arr,
@@ -21,7 +29,11 @@ void mergeSort(
     const u32fast skip_to_bucket_size = 1
 );
 
+/// Merge sorts a block per thread (including the calling one), then merges the blocks in log2(`thread_count`)
+/// levels, each split evenly over the threads. Stable. Hands large arrays on many threads to
+/// `sampleSortMultiThreaded()`, which passes over the array fewer times.
 void mergeSortMultiThreaded(
+    SortContext* ctx,
     thread_pool::ThreadPool* thread_pool,
     const u32fast thread_count,
     const u32fast arr_size,
@@ -29,6 +41,106 @@ void mergeSortMultiThreaded(
     KeyVal *const p_scratch
 );
 
+/// A merge sort that merges the runs already in the array, instead of starting from runs of 1. Returns after a
+/// single pass over an already sorted array, and takes `log2(run count)` passes otherwise, which makes it cheap
+/// for keys that are nearly in order, like the cells of particles that were sorted by cell the step before.
+/// Stable, like `mergeSort()`.
+void naturalMergeSort(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+);
+
+/// A sample sort on `thread_count` threads (including the calling one): splitters drawn from a sample of the
+/// array cut it into a few buckets per thread, each thread scatters its share of the array into them in a single
+/// pass, and then each bucket is merge-sorted on its own. The splitters are (key, index) pairs, so the buckets
+/// stay even however many keys are equal, and it's stable. Falls back to `mergeSortMultiThreaded()`'s merge
+/// levels for arrays too small to split.
+void sampleSortMultiThreaded(
+    SortContext* ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+);
+
+/// An LSD radix sort with 8-bit digits. Skips the passes whose digit is the same for every key. Stable.
+void radixSort(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+);
+
+/// An LSD radix sort on `thread_count` threads (including the calling one), with per-thread histograms and
+/// write-combining scatter buffers. Only sorts the bits below the highest set bit of the largest key, in the
+/// fewest passes of digits of up to 11 bits: e.g. 3 passes of 10 bits for 30-bit Morton codes. Falls back to
+/// `radixSort()` for small arrays. Stable.
+void radixSortMultiThreaded(
+    SortContext* ctx,
+    thread_pool::ThreadPool* thread_pool,
+    u32fast thread_count,
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+);
+
+/// A merge sort with bitonic networks on AVX-512 or AVX2 registers, whichever the CPU has (or scalar code if
+/// neither). Orders by key and then by val, so it isn't stable, but gives the same result as `mergeSort()` if
+/// the vals of equal keys are in ascending order, like particle indices.
+void mergeSortSimd(
+    const u32fast arr_size,
+    KeyVal *const p_arr,
+    KeyVal *const p_scratch
+);
+
+//
+// ===========================================================================================================
+//
+
+// Sorts templated on the key type, the value type and the order, for when `KeyVal` doesn't fit: 64-bit keys,
+// or keys without values (with the permutation derived afterwards), which moves half the bytes. Defined and
+// instantiated in sort.cpp for `Key` in {u32, u64}, `Val` in {u32, NoVal}, and every combination of flags.
+
+/// The `Val` of keys without values.
+struct NoVal {};
+
+/// A key, and a value that moves with it. `Key` is an unsigned integer. `SortItem<u32, u32>` is laid out like
+/// `KeyVal`.
+template<typename Key, typename Val>
+struct SortItem {
+    Key key;
+    Val val;
+};
+
+template<typename Key>
+struct SortItem<Key, NoVal> {
+    Key key;
+};
+
+enum SortFlagBits : u32 {
+    SORT_DESCENDING = 1 << 0,
+    /// Items with equal keys may be in any order. Lets `mergeSortItems()` compare a key and a value that fit in
+    /// 64 bits as one `u64`, by key and then by value; the same as stable if the values of equal keys ascend.
+    SORT_UNSTABLE = 1 << 1,
+};
+
+/// Like `mergeSort()`, from runs of 1. Stable unless `SORT_UNSTABLE`.
+template<typename Key, typename Val, u32 flags = 0>
+void mergeSortItems(
+    const u32fast arr_size,
+    SortItem<Key, Val> *const p_arr,
+    SortItem<Key, Val> *const p_scratch
+);
+
+/// Like `radixSort()`, with a pass per byte of `Key`. Always stable.
+template<typename Key, typename Val, u32 flags = 0>
+void radixSortItems(
+    const u32fast arr_size,
+    SortItem<Key, Val> *const p_arr,
+    SortItem<Key, Val> *const p_scratch
+);
+
 //
 // ===========================================================================================================
 //
@@ -0,0 +1,346 @@
+// Shared by the `surface_mesh_*.comp` stages, which extract a triangle mesh of the fluid's surface with marching
+// cubes, for surface_mesh.vert to draw. The surface is where the particles' density, as smoothed by a kernel of
+// radius `KERNEL_RADIUS_IN_BLOCKS` blocks, is `iso_density_`.
+//
+// The density is sampled in blocks: cubes of the sim's cell size, aligned with the world origin, each sampled at
+// the corners of `BLOCK_SUBDIVISIONS`^3 marching cubes. Only the blocks that some particle's kernel reaches exist;
+// the density is 0 everywhere else, so the surface can't cross into the others. Neighboring blocks sample their
+// shared face at the same points, so their triangles meet.
+//
+// The mesh is built incrementally. The block table and the vertices have two copies, which alternate between
+// builds: `copy_` is written, and the other one holds the previous build. A block's signature is the count and
+// the sum of the hashed, quantized positions of the particles that its kernel reaches; a block whose signature
+// didn't change since the previous build keeps its triangles, which are only copied, and only the others sample
+// the density and run marching cubes.
+//
+// The stages:
+//     1. mark: each particle inserts the blocks that its kernel reaches into the table, and adds itself to their
+//        signatures. Whoever inserts a block appends it to `blocks_`.
+//     2. prepare: a single invocation writes the dispatch of the next stages, a workgroup per block.
+//     3. classify: finds each block in the previous build; if its signature changed, samples its density into
+//        `densities_` and counts the vertices that marching cubes emits, otherwise takes the previous count.
+//     4. scan: a single workgroup turns the vertex counts into the blocks' first vertices, and writes the draw
+//        command.
+//     5. emit: copies each unchanged block's vertices from the previous build, and emits each changed block's
+//        triangles.
+// The current copy of the table and the state must be 0 before the mark dispatch.
+
+#include "fluidSim_util.comp.h"
+
+// The marching cubes along each side of a block. Must match SURFACE_MESH_BLOCK_SUBDIVISIONS in graphics.cpp.
+#define BLOCK_SUBDIVISIONS 4
+#define BLOCK_SAMPLE_COUNT ((BLOCK_SUBDIVISIONS + 1) * (BLOCK_SUBDIVISIONS + 1) * (BLOCK_SUBDIVISIONS + 1))
+#define BLOCK_CUBE_COUNT (BLOCK_SUBDIVISIONS * BLOCK_SUBDIVISIONS * BLOCK_SUBDIVISIONS)
+
+// Beyond this, a particle adds nothing to the density; so its kernel reaches at most 2 blocks along each axis.
+#define KERNEL_RADIUS_IN_BLOCKS 0.5f
+
+// Must match the SURFACE_MESH_* capacities in graphics.cpp. The table is twice the block capacity, so that its
+// probes stay short; the blocks past the capacity, and the blocks whose vertices don't fit, aren't drawn.
+#define BLOCK_TABLE_SIZE_LOG2 16
+#define BLOCK_TABLE_SIZE (1u << BLOCK_TABLE_SIZE_LOG2)
+#define BLOCK_CAPACITY (1u << 15)
+#define VERTEX_CAPACITY (1u << 20)
+
+// `BlockSlot::key` of an empty slot; the keys of blocks are offset by 1.
+#define BLOCK_SLOT_EMPTY 0u
+// `Block::source` of a block whose triangles are emitted anew; and `BlockSlot::first_vertex` of a block whose
+// vertices weren't emitted, so that the next build doesn't copy them.
+#define BLOCK_CHANGED 0xFFFFFFFFu
+
+// Moves of a particle within this fraction of the distance between samples may not change its block's
+// signature, so the mesh may lag that far behind.
+#define POSITION_QUANTUM_IN_SAMPLES 0.125f
+
+// Must match CELL_TABLE_* in particle.frag.
+#define CELL_TABLE_HASH 1
+#define CELL_TABLE_SLOTS 2
+
+layout(binding = 2, std430) readonly buffer Particles {
+    vec3 particles_[];
+};
+
+// The sim's spatial structure; see `gfx::ParticleGrid`, and particle.frag.
+layout(binding = 5, std430) readonly buffer Cells { uvec2 cells_[]; };
+layout(binding = 6, std430) readonly buffer HashBuckets { uvec2 hash_buckets_[]; };
+layout(binding = 9, std430) readonly buffer CellSlots { uvec4 cell_slots_[]; };
+layout(binding = 10, std430) readonly buffer Permutation { uint permutation_[]; };
+layout(binding = 11, std430) readonly buffer PositionsReference { vec3 positions_reference_[]; };
+layout(binding = 12, std430) readonly buffer DomainBounds { vec4 domain_bounds_[]; };
+
+// Must match the SURFACE_MESH_* bindings in graphics.cpp.
+struct BlockSlot {
+    uint key; // see `blockKey()`
+    uint particle_count;
+    uint position_hash; // the sum of the particles' `positionHash()`es
+    uint vertex_count;
+    uint first_vertex;
+};
+// two copies of `BLOCK_TABLE_SIZE` slots, open-addressed with linear probing
+layout(binding = 20, std430) buffer BlockSlots {
+    BlockSlot block_slots_[];
+};
+struct Block {
+    ivec3 coord; // in blocks, from the world origin
+    uint slot; // in the current copy of the table
+    uint source; // the block's first vertex in the previous build, or BLOCK_CHANGED
+};
+layout(binding = 21, std430) buffer Blocks {
+    Block blocks_[];
+};
+// `BLOCK_SAMPLE_COUNT` per block, x-major, of the changed blocks
+layout(binding = 22, std430) buffer Densities {
+    float densities_[];
+};
+// two copies of `VERTEX_CAPACITY`, a triangle per 3 vertices; w is unused
+layout(binding = 23, std430) buffer Vertices {
+    vec4 vertices_[];
+};
+// Must match `SurfaceMeshState` in graphics.cpp.
+layout(binding = 24, std430) buffer State {
+    uint block_dispatch_[3]; // a `VkDispatchIndirectCommand` for classify and emit
+    uint draw_command_[4]; // a `VkDrawIndirectCommand`
+    uint block_count_; // may exceed `BLOCK_CAPACITY`
+};
+
+// Must match `SurfaceMeshPipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    uint particle_count_;
+    uint cell_table_kind_;
+    uint cell_table_size_;
+    // See `gfx::ParticleGrid::permuted`.
+    uint permuted_;
+    float cell_size_reciprocal_;
+    float max_displacement_;
+    uint domain_bounds_slot_;
+    // the sim's cell size
+    float block_size_;
+    // particles / m^3
+    float iso_density_;
+    // 0 or 1; the copy of the table and of the vertices that this build writes
+    uint copy_;
+    // whether the other copy holds a previous build, of the same density
+    uint previous_valid_;
+};
+
+#define DOMAIN_MIN (domain_bounds_[2 * domain_bounds_slot_].xyz)
+
+#define KERNEL_RADIUS (KERNEL_RADIUS_IN_BLOCKS * block_size_)
+#define SAMPLE_SPACING (block_size_ / BLOCK_SUBDIVISIONS)
+
+/// The table key of the block at `coord`, which only keeps 10 bits of each component; so the fluid must span
+/// fewer than 1024 blocks along each axis, like the sim's cells with 30-bit Morton codes.
+uint blockKey(ivec3 coord) {
+    const uvec3 c = uvec3(coord) & 1023u;
+    return (c.x | (c.y << 10) | (c.z << 20)) + 1;
+}
+
+uint blockHash(uint key) {
+    return (key * 0x9E3779B1u) >> (32 - BLOCK_TABLE_SIZE_LOG2);
+}
+
+/// The slot of the block with `key` in `copy`, or BLOCK_TABLE_SIZE if it isn't there.
+uint findBlock(uint copy, uint key) {
+
+    uint slot = blockHash(key);
+    for (uint probe = 0; probe < BLOCK_TABLE_SIZE; probe++)
+    {
+        const uint slot_key = block_slots_[copy * BLOCK_TABLE_SIZE + slot].key;
+        if (slot_key == key) return slot;
+        if (slot_key == BLOCK_SLOT_EMPTY) break;
+        slot = (slot + 1) & (BLOCK_TABLE_SIZE - 1);
+    }
+    return BLOCK_TABLE_SIZE;
+}
+
+/// A hash of the particle's position, quantized to `POSITION_QUANTUM_IN_SAMPLES`.
+uint positionHash(vec3 particle_pos) {
+
+    const uvec3 q = uvec3(ivec3(floor(particle_pos / (POSITION_QUANTUM_IN_SAMPLES * SAMPLE_SPACING))));
+    uint h = (q.x * 0x8DA6B343u) ^ (q.y * 0xD8163841u) ^ (q.z * 0xCB1AB31Fu);
+    // a finalizer, so that the sum of the hashes doesn't cancel out nearby moves
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/// The index in `particles_` of the particle at `cell_list_idx` in the cell list.
+uint cellListParticle(uint cell_list_idx) {
+    return (permuted_ != 0) ? permutation_[cell_list_idx] : cell_list_idx;
+}
+
+/// The first particle in the cell list of the sim's cell, and the particle count, which is 0 if the cell is empty.
+/// Like `lookUpCell()` in particle.frag.
+uvec2 lookUpCell(ivec3 cell) {
+
+    // the domain has no cells below its origin
+    if (any(lessThan(cell, ivec3(0)))) return uvec2(0);
+
+    const uvec2 morton_code = cellMortonCode(uvec3(cell));
+
+    if (cell_table_kind_ == CELL_TABLE_SLOTS)
+    {
+        // The slot after the table is its header; see CELL_TABLE_DENSE in fluidSim_util.comp.h.
+        const uvec4 header = cell_slots_[cell_table_size_];
+        if (header.w == CELL_TABLE_DENSE)
+        {
+            const uint slot_idx = denseCellSlot(uvec3(cell), header);
+            if (slot_idx == CELL_SLOT_EMPTY) return uvec2(0);
+            const uvec4 slot = cell_slots_[slot_idx];
+            return (slot.z == CELL_SLOT_EMPTY) ? uvec2(0) : slot.zw;
+        }
+
+        // The table is never full, so this finds an empty slot if the cell doesn't exist.
+        uint slot_idx = mortonCodeHash(morton_code, cell_table_size_);
+        while (true)
+        {
+            const uvec4 slot = cell_slots_[slot_idx];
+            if (slot.z == CELL_SLOT_EMPTY) return uvec2(0);
+            if (slot.xy == morton_code) return slot.zw;
+
+            slot_idx = (slot_idx + 1) & (cell_table_size_ - 1);
+        }
+    }
+
+    const uvec2 bucket = hash_buckets_[mortonCodeHash(morton_code, cell_table_size_)];
+    const uint cell_idx_end = bucket.x + bucket.y;
+
+    for (uint cell_idx = bucket.x; cell_idx < cell_idx_end; cell_idx++)
+    {
+        // the cell of its first particle, as of when the structure was built
+        const uvec2 cell = cells_[cell_idx];
+        const vec3 first_position =
+            (permuted_ != 0) ? particles_[permutation_[cell.x]] : positions_reference_[cell.x];
+        const uvec3 first_cell = uvec3((first_position - DOMAIN_MIN) * cell_size_reciprocal_);
+
+        if (cellMortonCode(first_cell) == morton_code) return cell;
+    }
+
+    return uvec2(0);
+}
+
+/// The index in a block's samples of the sample at `coord`, in samples from the block's corner.
+uint sampleIndex(uvec3 coord) {
+    return (coord.z * (BLOCK_SUBDIVISIONS + 1) + coord.y) * (BLOCK_SUBDIVISIONS + 1) + coord.x;
+}
+
+/// The position of the block's sample at `coord`; the same for the blocks that share it.
+vec3 samplePosition(ivec3 block_coord, uvec3 coord) {
+    return vec3(block_coord * BLOCK_SUBDIVISIONS + ivec3(coord)) * SAMPLE_SPACING;
+}
+
+/// The block's cube at `cube_idx`, x-major, as the coordinate of its first corner's sample.
+uvec3 cubeCoord(uint cube_idx) {
+    return uvec3(cube_idx, cube_idx / BLOCK_SUBDIVISIONS, cube_idx / (BLOCK_SUBDIVISIONS * BLOCK_SUBDIVISIONS))
+        % BLOCK_SUBDIVISIONS;
+}
+
+// The corners of a cube are numbered x | y << 1 | z << 2. The edges are numbered x-edges, y-edges, then
+// z-edges, each by its first corner; an edge goes from its lower corner to its upper corner.
+const uvec2 EDGE_CORNERS[12] = uvec2[12](
+    uvec2(0, 1), uvec2(2, 3), uvec2(4, 5), uvec2(6, 7),
+    uvec2(0, 2), uvec2(1, 3), uvec2(4, 6), uvec2(5, 7),
+    uvec2(0, 4), uvec2(1, 5), uvec2(2, 6), uvec2(3, 7)
+);
+
+// Per case, i.e. per set of corners where the density is at least `iso_density_` (bit `corner`), the edges of its
+// triangles: the vertex count in bits 0..3, then an edge per 4 bits, low word first, 3 per triangle. The triangles
+// face away from the fluid. The table was generated by walking each cube face's crossings, always separating the
+// fluid corners of a face whose diagonal corners are both in the fluid, which only depends on the face; so
+// neighboring cubes agree, and the mesh is closed.
+const uvec2 TRIANGLE_TABLE[256] = uvec2[256](
+    uvec2(0x00000000u, 0x00000000u), uvec2(0x00008403u, 0x00000000u), uvec2(0x00005903u, 0x00000000u), uvec2(0x09845946u, 0x00000000u),
+    uvec2(0x00004A13u, 0x00000000u), uvec2(0x0A108A06u, 0x00000000u), uvec2(0x04A15906u, 0x00000000u), uvec2(0x19815919u, 0x0000008Au),
+    uvec2(0x0000B513u, 0x00000000u), uvec2(0x0B518406u, 0x00000000u), uvec2(0x0B901B06u, 0x00000000u), uvec2(0x1981B919u, 0x00000084u),
+    uvec2(0x0B54AB46u, 0x00000000u), uvec2(0x0AB08A09u, 0x000000B5u), uvec2(0x0AB04A09u, 0x000000B9u), uvec2(0x0B98AB86u, 0x00000000u),
+    uvec2(0x00006823u, 0x00000000u), uvec2(0x06402606u, 0x00000000u), uvec2(0x06825906u, 0x00000000u), uvec2(0x24526429u, 0x00000059u),
+    uvec2(0x06824A16u, 0x00000000u), uvec2(0x06A02609u, 0x000000A1u), uvec2(0x24A15909u, 0x00000068u), uvec2(0x1921591Cu, 0x0006A126u),
+    uvec2(0x0682B516u, 0x00000000u), uvec2(0x16402609u, 0x000000B5u), uvec2(0x2B901B09u, 0x00000068u), uvec2(0x1921B91Cu, 0x00064126u),
+    uvec2(0x4AB46829u, 0x000000B5u), uvec2(0x06A0260Cu, 0x000B50ABu), uvec2(0x0AB04A0Cu, 0x000682B9u), uvec2(0x2AB26A29u, 0x000000B9u),
+    uvec2(0x00009723u, 0x00000000u), uvec2(0x09728406u, 0x00000000u), uvec2(0x07205706u, 0x00000000u), uvec2(0x24528429u, 0x00000057u),
+    uvec2(0x09724A16u, 0x00000000u), uvec2(0x2A108A09u, 0x00000097u), uvec2(0x17205709u, 0x0000004Au), uvec2(0x1721571Cu, 0x0008A128u),
+    uvec2(0x0972B516u, 0x00000000u), uvec2(0x2B518409u, 0x00000097u), uvec2(0x0B701B09u, 0x00000072u), uvec2(0x1721B71Cu, 0x00084128u),
+    uvec2(0x4AB49729u, 0x000000B5u), uvec2(0x0AB08A0Cu, 0x000972B5u), uvec2(0x0AB04A0Cu, 0x000720B7u), uvec2(0x2AB28A29u, 0x000000B7u),
+    uvec2(0x09768966u, 0x00000000u), uvec2(0x07609709u, 0x00000064u), uvec2(0x07605709u, 0x00000068u), uvec2(0x07645746u, 0x00000000u),
+    uvec2(0x68964A19u, 0x00000097u), uvec2(0x0760970Cu, 0x000A106Au), uvec2(0x0760570Cu, 0x0004A168u), uvec2(0x17615719u, 0x0000006Au),
+    uvec2(0x6896B519u, 0x00000097u), uvec2(0x0760970Cu, 0x000B5164u), uvec2(0x0B701B0Cu, 0x00068076u), uvec2(0x1761B719u, 0x00000064u),
+    uvec2(0x6B54AB4Cu, 0x00097689u), uvec2(0x0760970Fu, 0xB50AB06Au), uvec2(0x0AB04A0Fu, 0x680760B7u), uvec2(0x0B76AB66u, 0x00000000u),
+    uvec2(0x0000A633u, 0x00000000u), uvec2(0x0A638406u, 0x00000000u), uvec2(0x0A635906u, 0x00000000u), uvec2(0x4594A639u, 0x00000098u),
+    uvec2(0x06314616u, 0x00000000u), uvec2(0x06308609u, 0x00000031u), uvec2(0x14615909u, 0x00000063u), uvec2(0x1981591Cu, 0x00063186u),
+    uvec2(0x0A63B516u, 0x00000000u), uvec2(0x3B518409u, 0x000000A6u), uvec2(0x3B901B09u, 0x000000A6u), uvec2(0x1981B91Cu, 0x000A6384u),
+    uvec2(0x3543B539u, 0x00000046u), uvec2(0x0630860Cu, 0x000B503Bu), uvec2(0x0630460Cu, 0x000B903Bu), uvec2(0x3983B939u, 0x00000086u),
+    uvec2(0x0A823A26u, 0x00000000u), uvec2(0x03A02309u, 0x000000A4u), uvec2(0x23A25909u, 0x000000A8u), uvec2(0x2A423A2Cu, 0x00059245u),
+    uvec2(0x18214819u, 0x00000023u), uvec2(0x03102306u, 0x00000000u), uvec2(0x1481590Cu, 0x00023182u), uvec2(0x19215919u, 0x00000023u),
+    uvec2(0x23A2B519u, 0x000000A8u), uvec2(0x03A0230Cu, 0x000B51A4u), uvec2(0x2B901B0Cu, 0x000A823Au), uvec2(0x93A9239Fu, 0x1B9419A4u),
+    uvec2(0x2B523B2Cu, 0x00048254u), uvec2(0x03B02309u, 0x000000B5u), uvec2(0x4234824Fu, 0x904B943Bu), uvec2(0x0B923B26u, 0x00000000u),
+    uvec2(0x0A639726u, 0x00000000u), uvec2(0x39728409u, 0x000000A6u), uvec2(0x37205709u, 0x000000A6u), uvec2(0x2452842Cu, 0x000A6357u),
+    uvec2(0x26314619u, 0x00000097u), uvec2(0x0630860Cu, 0x00097231u), uvec2(0x1720570Cu, 0x00063146u), uvec2(0x1721571Fu, 0x63186128u),
+    uvec2(0x3972B519u, 0x000000A6u), uvec2(0x2B51840Cu, 0x000A6397u), uvec2(0x0B701B0Cu, 0x000A6372u), uvec2(0x1721B71Fu, 0xA6384128u),
+    uvec2(0x3B53972Cu, 0x00046354u), uvec2(0x0630860Fu, 0x972B503Bu), uvec2(0x0630460Fu, 0x720B703Bu), uvec2(0x83B8638Cu, 0x000728B7u),
+    uvec2(0x3893A839u, 0x00000097u), uvec2(0x0730970Cu, 0x000A403Au), uvec2(0x0730570Cu, 0x000A803Au), uvec2(0x3453A439u, 0x00000057u),
+    uvec2(0x1891481Cu, 0x00073197u), uvec2(0x07309709u, 0x00000031u), uvec2(0x7147317Fu, 0x05780748u), uvec2(0x07315716u, 0x00000000u),
+    uvec2(0x3A83B51Cu, 0x00097389u), uvec2(0x0730970Fu, 0xB51A403Au), uvec2(0x0B701B0Fu, 0xA803A073u), uvec2(0x7A473A7Cu, 0x0001B741u),
+    uvec2(0x3543B53Fu, 0x97389348u), uvec2(0x0730970Cu, 0x000B503Bu), uvec2(0x0B734806u, 0x00000000u), uvec2(0x0000B733u, 0x00000000u),
+    uvec2(0x00007B33u, 0x00000000u), uvec2(0x07B38406u, 0x00000000u), uvec2(0x07B35906u, 0x00000000u), uvec2(0x45947B39u, 0x00000098u),
+    uvec2(0x07B34A16u, 0x00000000u), uvec2(0x3A108A09u, 0x0000007Bu), uvec2(0x34A15909u, 0x0000007Bu), uvec2(0x1981591Cu, 0x0007B38Au),
+    uvec2(0x07513716u, 0x00000000u), uvec2(0x13718409u, 0x00000075u), uvec2(0x03701309u, 0x00000079u), uvec2(0x1791371Cu, 0x00084198u),
+    uvec2(0x35437539u, 0x0000004Au), uvec2(0x0A308A0Cu, 0x00075037u), uvec2(0x0A304A0Cu, 0x00079037u), uvec2(0x39837939u, 0x0000008Au),
+    uvec2(0x07B36826u, 0x00000000u), uvec2(0x36402609u, 0x0000007Bu), uvec2(0x36825909u, 0x0000007Bu), uvec2(0x2452642Cu, 0x0007B359u),
+    uvec2(0x36824A19u, 0x0000007Bu), uvec2(0x06A0260Cu, 0x0007B3A1u), uvec2(0x24A1590Cu, 0x0007B368u), uvec2(0x1921591Fu, 0x7B36A126u),
+    uvec2(0x27513719u, 0x00000068u), uvec2(0x1640260Cu, 0x00075137u), uvec2(0x0370130Cu, 0x00068279u), uvec2(0x1791371Fu, 0x64126192u),
+    uvec2(0x3753682Cu, 0x0004A354u), uvec2(0x06A0260Fu, 0x750370A3u), uvec2(0x0A304A0Fu, 0x68279037u), uvec2(0xA79A37ACu, 0x00026A92u),
+    uvec2(0x0B329B26u, 0x00000000u), uvec2(0x29B28409u, 0x000000B3u), uvec2(0x0B305B09u, 0x00000032u), uvec2(0x2452842Cu, 0x000B325Bu),
+    uvec2(0x29B24A19u, 0x000000B3u), uvec2(0x2A108A0Cu, 0x000B329Bu), uvec2(0x0B305B0Cu, 0x0004A132u), uvec2(0x5325B35Fu, 0xA158A528u),
+    uvec2(0x12913219u, 0x00000095u), uvec2(0x1321840Cu, 0x00095129u), uvec2(0x03201306u, 0x00000000u), uvec2(0x12813219u, 0x00000084u),
+    uvec2(0x2542952Cu, 0x000A324Au), uvec2(0xA29A32AFu, 0x08A50A95u), uvec2(0x0A304A09u, 0x00000032u), uvec2(0x0A328A26u, 0x00000000u),
+    uvec2(0x38936839u, 0x0000009Bu), uvec2(0x0B309B0Cu, 0x00064036u), uvec2(0x0B305B0Cu, 0x00068036u), uvec2(0x34536439u, 0x0000005Bu),
+    uvec2(0x36834A1Cu, 0x0009B389u), uvec2(0x0B309B0Fu, 0xA106A036u), uvec2(0x0B305B0Fu, 0x4A168036u), uvec2(0x5365B35Cu, 0x000A156Au),
+    uvec2(0x1681361Cu, 0x00095189u), uvec2(0x9139519Fu, 0x40964936u), uvec2(0x03601309u, 0x00000068u), uvec2(0x06413616u, 0x00000000u),
+    uvec2(0x3893683Fu, 0x4A354395u), uvec2(0x06A39506u, 0x00000000u), uvec2(0x0A304A0Cu, 0x00068036u), uvec2(0x00006A33u, 0x00000000u),
+    uvec2(0x0BA67B66u, 0x00000000u), uvec2(0x67B68409u, 0x000000BAu), uvec2(0x67B65909u, 0x000000BAu), uvec2(0x6984594Cu, 0x000BA67Bu),
+    uvec2(0x16714619u, 0x0000007Bu), uvec2(0x0670860Cu, 0x000B107Bu), uvec2(0x1461590Cu, 0x0007B167u), uvec2(0x1981591Fu, 0x7B167186u),
+    uvec2(0x1671A619u, 0x00000075u), uvec2(0x1A61840Cu, 0x00075167u), uvec2(0x0A601A0Cu, 0x00079067u), uvec2(0x1671A61Fu, 0x84198179u),
+    uvec2(0x07546746u, 0x00000000u), uvec2(0x06708609u, 0x00000075u), uvec2(0x06704609u, 0x00000079u), uvec2(0x09867966u, 0x00000000u),
+    uvec2(0x2BA27B29u, 0x000000A8u), uvec2(0x07B0270Cu, 0x000A40BAu), uvec2(0x27B2590Cu, 0x000A82BAu), uvec2(0x2BA27B2Fu, 0x592452A4u),
+    uvec2(0x1821481Cu, 0x0007B127u), uvec2(0x07B02709u, 0x000000B1u), uvec2(0x1481590Fu, 0x7B127182u), uvec2(0x1921591Cu, 0x0007B127u),
+    uvec2(0x1821A81Cu, 0x00075127u), uvec2(0x2512752Fu, 0x402A421Au), uvec2(0x1821A81Fu, 0x90179127u), uvec2(0x0792A416u, 0x00000000u),
+    uvec2(0x25427529u, 0x00000048u), uvec2(0x07502706u, 0x00000000u), uvec2(0x4274824Cu, 0x00090479u), uvec2(0x00007923u, 0x00000000u),
+    uvec2(0x2BA29B29u, 0x000000A6u), uvec2(0x29B2840Cu, 0x000A62BAu), uvec2(0x0BA05B0Cu, 0x000620A6u), uvec2(0x2452842Fu, 0xA62BA25Bu),
+    uvec2(0x1621461Cu, 0x0009B129u), uvec2(0x69B6296Fu, 0x086106B1u), uvec2(0xB46B14BFu, 0x05B20B62u), uvec2(0x08625B16u, 0x00000000u),
+    uvec2(0x1621A61Cu, 0x00095129u), uvec2(0x1A61840Fu, 0x95129162u), uvec2(0x0A601A09u, 0x00000062u), uvec2(0x1621A61Cu, 0x00084128u),
+    uvec2(0x25429529u, 0x00000046u), uvec2(0x6956296Cu, 0x00008650u), uvec2(0x06204606u, 0x00000000u), uvec2(0x00008623u, 0x00000000u),
+    uvec2(0x0BA89B86u, 0x00000000u), uvec2(0x0BA09B09u, 0x000000A4u), uvec2(0x0BA05B09u, 0x000000A8u), uvec2(0x0BA45B46u, 0x00000000u),
+    uvec2(0x18914819u, 0x0000009Bu), uvec2(0x0B109B06u, 0x00000000u), uvec2(0xB48B14BCu, 0x00005B80u), uvec2(0x00005B13u, 0x00000000u),
+    uvec2(0x1891A819u, 0x00000095u), uvec2(0x91A9519Cu, 0x000409A4u), uvec2(0x0A801A06u, 0x00000000u), uvec2(0x0000A413u, 0x00000000u),
+    uvec2(0x09548946u, 0x00000000u), uvec2(0x00009503u, 0x00000000u), uvec2(0x00004803u, 0x00000000u), uvec2(0x00000000u, 0x00000000u)
+);
+
+/// The corner of a cube, as an offset in samples.
+uvec3 cornerOffset(uint corner) {
+    return uvec3(corner, corner >> 1, corner >> 2) & 1u;
+}
+
+/// The case of a cube, from the density at its corners.
+uint cubeCase(float corner_densities[8]) {
+
+    uint cube_case = 0;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        if (corner_densities[corner] >= iso_density_) cube_case |= 1u << corner;
+    }
+    return cube_case;
+}
+
+uint caseVertexCount(uint cube_case) {
+    return TRIANGLE_TABLE[cube_case].x & 15u;
+}
+
+/// The edge of the `i`th vertex of the case's triangles.
+uint caseVertexEdge(uint cube_case, uint i) {
+    const uvec2 entry = TRIANGLE_TABLE[cube_case];
+    const uint nibble = i + 1;
+    return ((nibble < 8) ? (entry.x >> (4 * nibble)) : (entry.y >> (4 * (nibble - 8)))) & 15u;
+}
@@ -0,0 +1,35 @@
+#version 450
+
+layout(location = 0) in vec3 position_worldspace_in_;
+
+layout(location = 0) out vec4 color_out_;
+
+// Must match `ParticleRasterizePipelinePushConstants` in graphics.cpp.
+layout(push_constant, std140) uniform PushConstants {
+    vec3 camera_position_;
+    float particle_radius_;
+};
+
+// Like fluid_composite.frag, but opaque.
+const vec3 LIGHT_DIRECTION_UNIT = vec3(0.57735027f);
+const vec3 FLUID_COLOR = vec3(0.0f, 0.5f, 1.0f);
+const vec3 SKY_COLOR = vec3(0.6f, 0.7f, 0.8f);
+
+// Shades the surface mesh with the flat normal of each triangle, facing the camera; the triangles are small
+// enough that it looks faceted only up close.
+void main(void) {
+
+    const vec3 view_direction_unit = normalize(camera_position_ - position_worldspace_in_);
+
+    vec3 normal = cross(dFdx(position_worldspace_in_), dFdy(position_worldspace_in_));
+    normal = (dot(normal, normal) > 0.0f) ? normalize(normal) : view_direction_unit;
+    if (dot(normal, view_direction_unit) < 0.0f) normal = -normal;
+
+    const float diffuse = max(dot(normal, LIGHT_DIRECTION_UNIT), 0.0f);
+    const float specular = pow(max(dot(normal, normalize(LIGHT_DIRECTION_UNIT + view_direction_unit)), 0.0f), 64.0f);
+    // Schlick's approximation, for water
+    const float fresnel = 0.02f + 0.98f * pow(1.0f - max(dot(normal, view_direction_unit), 0.0f), 5.0f);
+
+    const vec3 color = mix(FLUID_COLOR * (0.3f + 0.7f * diffuse), SKY_COLOR, fresnel) + specular;
+    color_out_ = vec4(color, 1.0f);
+}
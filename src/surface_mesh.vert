@@ -0,0 +1,17 @@
+#version 450
+
+layout(location = 0) in vec3 position_worldspace_;
+
+layout(location = 0) out vec3 out_position_worldspace_;
+
+layout(binding = 0, std140) uniform Uniforms {
+    mat4 world_to_screen_transform_;
+};
+
+// The triangles of the fluid's surface, as extracted by the `surface_mesh_*.comp` stages; see
+// `recordSurfaceMesh()` in graphics.cpp.
+void main(void) {
+
+    gl_Position = world_to_screen_transform_ * vec4(position_worldspace_, 1.0f);
+    out_position_worldspace_ = position_worldspace_;
+}
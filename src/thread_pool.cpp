@@ -1,11 +1,22 @@
+#include <alloca.h>
+#include <cerrno>
 #include <cassert>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <tracy/tracy/Tracy.hpp>
 
 #include "types.hpp"
+#include "trace.hpp"
 #include "error_util.hpp"
 #include "thread_pool.hpp"
 
@@ -16,115 +27,663 @@ namespace thread_pool
 // ===========================================================================================================
 //
 
+// Each thread has a Chase-Lev deque of tasks: it pushes the tasks that it enqueues at the bottom and takes its
+// next task from there, and the idle threads steal from the tops of the others' deques. Tasks enqueued from
+// outside the pool go to a shared deque that only the threads steal from. Nothing is locked to enqueue, run or
+// finish a task, except by threads outside the pool enqueueing at the same time. An idle thread spins for
+// `ThreadPool::idle_spin_ns` before it parks on a futex, so that the bursts of tasks of a frame don't pay for a
+// kernel wake-up each; the mutexes are only for blocking in `waitForTask()` and `waitForGroup()`.
+//
+// Background tasks go to a deque of their own, which is pushed to under a lock like the external one, and only
+// stolen from by a thread that found no other task, and holds one of `ThreadPool::background_thread_limit`
+// slots while it runs one.
+//
+// Nothing is bounded: when the freelist is empty, a new segment of tasks is allocated, as big as all the ones
+// before it; and a deque that is full is moved to an array twice as big. Neither is ever moved or freed until
+// the pool is destroyed, because other threads may still be reading them.
+
 constexpr u32 IDX_NONE = UINT32_MAX;
 
+// Segment 0 has `ThreadPool::first_segment_size` tasks, and segment `k > 0` has `first_segment_size << (k - 1)`,
+// so this is enough for any u32 index.
+constexpr u32 MAX_TASK_SEGMENT_COUNT = 33;
+
+// With `grain` 0, `parallelFor()` makes about this many chunks per participating thread, so that a thread that
+// gets slow chunks can be helped by the others.
+constexpr u64 CHUNKS_PER_THREAD = 8;
+
+constexpr u32 DEFAULT_IDLE_SPIN_US = 50;
+// Tries between reads of the clock, while an idle thread spins.
+constexpr u32 IDLE_SPIN_CLOCK_INTERVAL = 64;
+
+// Tries before `waitForTask()` or `waitForGroup()` blocks. Short, so that a thread that's oversubscribed
+// doesn't take the time of the one it's waiting for.
+constexpr u32 SPIN_COUNT = 64;
+
 struct Task
 {
     // A task has 3 states, which it cycles through in this order:
-    // 1. Free (not a task)
-    // 2. Enqueued (waiting for a thread to begin executing it)
+    // 1. Free (not a task): in the freelist
+    // 2. Enqueued (waiting for a thread to begin executing it): in a deque
     // 3. InProgress (being executed by a thread)
-    u32 freelist_next_idx; // valid if this task is Free; otherwise IDX_NONE
-    u32 tasklist_next_idx; // valid if this task is Enqueued; otherwise IDX_NONE
-    // If both of the above are IDX_NONE, the task is InProgress.
+    u32 freelist_next_idx; // valid if this task is Free; atomic
 
     PFN_TaskProc p_procedure;
     void* p_arg;
+    TaskGroup* group; // NULL if it isn't in one
+    bool background; // see `enqueueBackgroundTask()`
+
+    u32 generation; // when a task completes, its generation is incremented; atomic
+    u32 waiter_count; // threads blocked in `waitForTask()` on it; atomic
+    pthread_cond_t finished_condition; // with `ThreadPool::wait_mutex`
 
-    u32 generation; // when a task completes, its generation is incremented
-    pthread_cond_t finished_condition;
+    u64 enqueue_ns; // for the start latency
+};
+
+struct DequeArray
+{
+    u64 capacity; // power of two
+    u32* p_slots; // atomic
+    DequeArray* p_previous; // the one that this one replaced, freed with the pool; or NULL
+};
+
+/// A Chase-Lev work-stealing deque of task indices (Chase and Lev, "Dynamic Circular Work-Stealing Deque",
+/// 2005), with the memory orders of Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models"
+/// (2013). Only the owner pushes and takes, at the bottom; any thread steals from the top. It never grows: it
+/// grows by replacing its array with one twice as big.
+struct Deque
+{
+    i64 top; // atomic
+    u8 _padding0[56]; // so that the owner and the thieves don't write the same cache line
+    i64 bottom; // atomic
+    DequeArray* array; // atomic; only the owner replaces it
+    u8 _padding1[48];
+};
+
+struct Worker
+{
+    ThreadPool* pool;
+    u32 idx; // of the thread, and of its deque
+    u32 numa_node; // of the CPU it's pinned to; 0 if it isn't pinned
+
+    // see `WorkerStats`; atomic
+    u64 busy_ns;
+    u64 task_count;
+    // of the tasks that it started; see `Stats::start_latency_histogram`; atomic
+    u64 start_latency_histogram[START_LATENCY_BUCKET_COUNT];
+};
+
+/// A logical CPU, from sysfs.
+struct CpuInfo
+{
+    u32 cpu;
+    u32 numa_node;
+    u32 package;
+    u32 core; // within the package
 };
 
 struct ThreadPool
 {
     u32 thread_count;
     pthread_t* p_threads;
+    Worker* p_workers;
+
+    // `segment_count` of them are allocated; see MAX_TASK_SEGMENT_COUNT.
+    Task* p_task_segments[MAX_TASK_SEGMENT_COUNT]; // atomic
+    u32 segment_count; // with `grow_mutex`
+    u32 first_segment_size_log2;
+    u32 task_capacity; // atomic
+    pthread_mutex_t grow_mutex;
+
+    // The top 32 bits count the pops, so that a pop can't succeed with a `next` that changed since it read it.
+    u64 freelist_head; // atomic
+
+    // `thread_count` per-thread deques, then the one for tasks enqueued from outside the pool, then the one for
+    // background tasks.
+    Deque* p_deques;
+    // the owner of the external deque is whichever thread holds this
+    pthread_mutex_t external_deque_mutex;
+    u64 external_deque_contention_count; // atomic
+    // likewise for the background deque
+    pthread_mutex_t background_deque_mutex;
+
+    // Enqueued tasks that no thread has taken yet, but for the background ones. Incremented before the task is
+    // pushed, so it may count one that isn't in a deque yet, but never misses one.
+    u32 queued_count; // atomic
+    u32 max_queued_count; // atomic
+
+    // Likewise, of the background tasks.
+    u32 background_queued_count; // atomic
+    // The threads that hold a slot to run a background task; at most `background_thread_limit`, unless the limit
+    // was lowered while they ran.
+    u32 background_running_count; // atomic
+    u32 background_thread_limit; // atomic
+
+    u64 idle_spin_ns; // atomic; see `setIdleSpinTime()`
+
+    // Parked threads wait on `wake_futex` for it to change. It's incremented, and they're woken:
+    // 1. When a new task has been enqueued while `parked_count > 0`; one thread.
+    // 2. When a slot for background tasks is given back while some are queued; one thread.
+    // 3. When it is time for the threads to quit; all of them, after `all_threads_should_quit` is set.
+    u32 parked_count; // atomic
+    u32 wake_futex; // atomic
+    bool all_threads_should_quit; // atomic
+    u64 last_wake_ns; // atomic; when `wake_futex` was last incremented, for the wake latency
+
+    u64 wake_count; // atomic
+    u64 total_wake_latency_ns; // atomic
+    u64 max_wake_latency_ns; // atomic
+
+    // of the tasks started by threads outside the pool, while waiting; atomic
+    u64 external_start_latency_histogram[START_LATENCY_BUCKET_COUNT];
+
+    pthread_mutex_t wait_mutex;
+
+    // Threads blocked in `waitForGroup()`, on any group. It's counted on the pool rather than on the group,
+    // because the group may be gone as soon as its last task has decremented `pending_count`.
+    u32 group_waiter_count; // atomic
+    // Broadcast when the last task of a group completes while `group_waiter_count > 0`; with `wait_mutex`.
+    pthread_cond_t group_finished_condition;
+};
 
-    Task* p_tasks;
+// The worker that the current thread is, if it's one of a pool's; lets `enqueueTask()` push to its own deque.
+static thread_local const Worker* tls_worker = NULL;
 
-    u32 tasklist_first_idx;
-    u32 freelist_first_idx;
 
-    // There are two conditions for signalling this variable:
-    // 1. A new task has been enqueued.
-    // 2. It is time for the threads to quit.
-    //     In this case, `all_threads_should_quit` will be set to true before signalling.
-    pthread_cond_t new_task_available_condition;
-    bool all_threads_should_quit;
+static inline void cpuRelax(void)
+{
+    #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+    #endif
+}
 
-    pthread_mutex_t mutex;
-};
+static inline u64 nowNs(void)
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000 + (u64)time.tv_nsec;
+}
 
-static void* threadProcedure(void *const p_task_queue)
+static void futexWait(u32* p_word, u32 expected_value)
 {
-    ZoneScoped;
+    // returns early if the word has changed, or spuriously; the callers check again
+    syscall(SYS_futex, p_word, FUTEX_WAIT_PRIVATE, expected_value, NULL, NULL, 0);
+}
 
-    ThreadPool *const queue = (ThreadPool*)p_task_queue;
+static void futexWake(u32* p_word, int thread_count)
+{
+    syscall(SYS_futex, p_word, FUTEX_WAKE_PRIVATE, thread_count, NULL, NULL, 0);
+}
 
+static void atomicMax(u64* p_max, u64 value)
+{
+    u64 max = __atomic_load_n(p_max, __ATOMIC_RELAXED);
+    while (value > max)
+    {
+        const bool raised = __atomic_compare_exchange_n(p_max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        if (raised) break;
+    }
+}
 
-    int result = pthread_mutex_lock(&queue->mutex);
-    alwaysAssert(result == 0);
+static inline Task* getTask(ThreadPool* pool, u32 task_idx)
+{
+    const u32 first_segment_multiple = task_idx >> pool->first_segment_size_log2;
+    if (first_segment_multiple == 0) return &pool->p_task_segments[0][task_idx];
+
+    // the segment `k` such that `first_segment_multiple` is in `[1 << (k - 1), 1 << k)`
+    const u32 segment_idx = 32 - (u32)__builtin_clz(first_segment_multiple);
+    const u32 segment_begin = 1u << (pool->first_segment_size_log2 + segment_idx - 1);
+
+    Task* segment = __atomic_load_n(&pool->p_task_segments[segment_idx], __ATOMIC_ACQUIRE);
+    return &segment[task_idx - segment_begin];
+}
+
+
+static DequeArray* createDequeArray(u64 capacity, DequeArray* p_previous)
+{
+    DequeArray* array = (DequeArray*)calloc(1, sizeof(DequeArray));
+    assertErrno(array != NULL);
+
+    array->capacity = capacity;
+    array->p_slots = (u32*)calloc(capacity, sizeof(u32));
+    assertErrno(array->p_slots != NULL);
+    array->p_previous = p_previous;
 
+    return array;
+}
+
+/// Only the owner of the deque. Pushes the `count` tasks from `first_task_idx`, which are linked by their
+/// `freelist_next_idx` while they're out of the freelist; they become visible to the thieves together.
+static void dequePush(ThreadPool* pool, u32 deque_idx, u32 first_task_idx, u32 count)
+{
+    Deque* deque = &pool->p_deques[deque_idx];
+
+    const i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    const i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    DequeArray* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+
+    if (bottom - top + count > (i64)array->capacity)
+    {
+        // full; the thieves may still read the old array, so it's kept
+        u64 new_capacity = 2 * array->capacity;
+        while (bottom - top + count > (i64)new_capacity) new_capacity *= 2;
+
+        DequeArray* new_array = createDequeArray(new_capacity, array);
+        for (i64 i = top; i < bottom; i++)
+        {
+            new_array->p_slots[(u64)i & (new_array->capacity - 1)] =
+                __atomic_load_n(&array->p_slots[(u64)i & (array->capacity - 1)], __ATOMIC_RELAXED);
+        }
+
+        __atomic_store_n(&deque->array, new_array, __ATOMIC_RELEASE);
+        array = new_array;
+    }
+
+    u32 task_idx = first_task_idx;
+    for (u32 i = 0; i < count; i++)
+    {
+        const u64 slot = (u64)(bottom + i) & (array->capacity - 1);
+        __atomic_store_n(&array->p_slots[slot], task_idx, __ATOMIC_RELAXED);
+        task_idx = __atomic_load_n(&getTask(pool, task_idx)->freelist_next_idx, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + count, __ATOMIC_RELAXED);
+}
+
+/// Only the owner of the deque. Returns IDX_NONE if it's empty.
+static u32 dequeTake(ThreadPool* pool, u32 deque_idx)
+{
+    Deque* deque = &pool->p_deques[deque_idx];
+    const DequeArray* array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+
+    const i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom)
+    {
+        // empty
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return IDX_NONE;
+    }
+
+    u32 task_idx = __atomic_load_n(&array->p_slots[(u64)bottom & (array->capacity - 1)], __ATOMIC_RELAXED);
+    if (top == bottom)
+    {
+        // the last task; a thief may be stealing it
+        const bool won = __atomic_compare_exchange_n(
+            &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED
+        );
+        if (!won) task_idx = IDX_NONE;
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return task_idx;
+}
+
+/// Any thread. Returns IDX_NONE if it's empty, or if another thread took the task first.
+static u32 dequeSteal(ThreadPool* pool, u32 deque_idx)
+{
+    Deque* deque = &pool->p_deques[deque_idx];
+
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom) return IDX_NONE;
+
+    // If the owner has grown the deque since, either array has the task at `top`.
+    const DequeArray* array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+    const u32 task_idx = __atomic_load_n(&array->p_slots[(u64)top & (array->capacity - 1)], __ATOMIC_RELAXED);
+    const bool won = __atomic_compare_exchange_n(
+        &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED
+    );
+
+    return won ? task_idx : IDX_NONE;
+}
+
+
+/// Pushes the tasks `first_idx`, ..., `last_idx`, which are already linked by their `freelist_next_idx`.
+static void freelistPush(ThreadPool* pool, u32 first_idx, u32 last_idx)
+{
+    u64 head = __atomic_load_n(&pool->freelist_head, __ATOMIC_RELAXED);
     while (true)
     {
-        // wait for a task to be enqueued --------------------------------------------------------------------
+        __atomic_store_n(&getTask(pool, last_idx)->freelist_next_idx, (u32)head, __ATOMIC_RELAXED);
+
+        const u64 new_head = (head & 0xFFFFFFFF00000000) | first_idx;
+        const bool pushed = __atomic_compare_exchange_n(
+            &pool->freelist_head, &head, new_head, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED
+        );
+        if (pushed) return;
+    }
+}
+
+/// Allocates the next segment of tasks, and pushes them to the freelist; unless another thread has pushed a
+/// task since the freelist was found empty.
+static void growTasks(ThreadPool* pool)
+{
+    ZoneScoped;
+
+    int result = pthread_mutex_lock(&pool->grow_mutex);
+    alwaysAssert(result == 0);
+
+    if ((u32)__atomic_load_n(&pool->freelist_head, __ATOMIC_ACQUIRE) == IDX_NONE)
+    {
+        const u32 segment_idx = pool->segment_count;
+        alwaysAssert(segment_idx < MAX_TASK_SEGMENT_COUNT);
 
+        const u32 first_idx = 1u << (pool->first_segment_size_log2 + segment_idx - 1);
+        const u32 segment_size = first_idx; // as big as all the ones before it
+        alwaysAssert(segment_size - 1 <= IDX_NONE - 1 - first_idx); // the last index isn't IDX_NONE
+
+        Task* segment = (Task*)calloc(segment_size, sizeof(Task));
+        assertErrno(segment != NULL);
+        for (u32 i = 0; i < segment_size; i++)
         {
-            ZoneScopedN("wait for task");
+            segment[i].freelist_next_idx = first_idx + i + 1; // the last one is set by `freelistPush()`
 
-            while (queue->tasklist_first_idx == IDX_NONE)
-            {
-                result = pthread_cond_wait(&queue->new_task_available_condition, &queue->mutex);
-                alwaysAssert(result == 0);
+            result = pthread_cond_init(&segment[i].finished_condition, NULL);
+            alwaysAssert(result == 0);
+        }
 
-                if (queue->all_threads_should_quit)
-                {
-                    result = pthread_mutex_unlock(&queue->mutex);
-                    alwaysAssert(result == 0);
-                    pthread_exit(NULL);
-                }
-            }
+        __atomic_store_n(&pool->p_task_segments[segment_idx], segment, __ATOMIC_RELEASE);
+        pool->segment_count++;
+        __atomic_add_fetch(&pool->task_capacity, segment_size, __ATOMIC_RELAXED);
+
+        freelistPush(pool, first_idx, first_idx + segment_size - 1);
+    }
+
+    result = pthread_mutex_unlock(&pool->grow_mutex);
+    alwaysAssert(result == 0);
+}
+
+static u32 freelistPop(ThreadPool* pool)
+{
+    u64 head = __atomic_load_n(&pool->freelist_head, __ATOMIC_ACQUIRE);
+    while (true)
+    {
+        const u32 task_idx = (u32)head;
+        if (task_idx == IDX_NONE)
+        {
+            growTasks(pool);
+            head = __atomic_load_n(&pool->freelist_head, __ATOMIC_ACQUIRE);
+            continue;
         }
 
-        // pop the task from the queue -----------------------------------------------------------------------
+        const u32 next_idx = __atomic_load_n(&getTask(pool, task_idx)->freelist_next_idx, __ATOMIC_RELAXED);
+        const u64 new_head = ((head >> 32) + 1) << 32 | next_idx;
+        const bool popped = __atomic_compare_exchange_n(
+            &pool->freelist_head, &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE
+        );
+        if (popped) return task_idx;
+    }
+}
 
-        u32 task_idx = queue->tasklist_first_idx;
-        assert(task_idx != IDX_NONE);
 
-        Task* task = &queue->p_tasks[task_idx];
-        queue->tasklist_first_idx = task->tasklist_next_idx;
-        task->tasklist_next_idx = IDX_NONE;
 
-        result = pthread_mutex_unlock(&queue->mutex);
-        alwaysAssert(result == 0);
+/// From the external deque, and then the other threads' deques, those on the NUMA node of `worker_idx` first.
+/// `worker_idx` is IDX_NONE for a thread outside the pool. Returns IDX_NONE if it found nothing.
+static u32 stealTask(ThreadPool* pool, u32 worker_idx)
+{
+    u32 task_idx = dequeSteal(pool, pool->thread_count);
+    if (task_idx != IDX_NONE) return task_idx;
 
-        // execute the task ----------------------------------------------------------------------------------
+    const u32 thread_count = pool->thread_count;
+    const u32 first_victim_idx = (worker_idx == IDX_NONE) ? 0 : worker_idx + 1;
+    const u32 numa_node = (worker_idx == IDX_NONE) ? 0 : pool->p_workers[worker_idx].numa_node;
 
+    for (u32 pass = 0; pass < 2; pass++)
+    {
+        const bool same_node = (pass == 0);
+        for (u32 i = 0; i < thread_count; i++)
         {
-            ZoneScopedN("execute task");
-            task->p_procedure(task->p_arg);
+            const u32 victim_idx = (first_victim_idx + i) % thread_count;
+            if (victim_idx == worker_idx) continue;
+            if ((pool->p_workers[victim_idx].numa_node == numa_node) != same_node) continue;
+
+            task_idx = dequeSteal(pool, victim_idx);
+            if (task_idx != IDX_NONE) return task_idx;
         }
+    }
 
-        // mark the task complete ----------------------------------------------------------------------------
+    return IDX_NONE;
+}
 
-        result = pthread_mutex_lock(&queue->mutex);
-        alwaysAssert(result == 0);
+/// Its own deque first, then the external one, then the other threads'. Returns IDX_NONE if it found nothing.
+static u32 findTask(ThreadPool* pool, u32 worker_idx)
+{
+    const u32 task_idx = dequeTake(pool, worker_idx);
+    if (task_idx != IDX_NONE) return task_idx;
+
+    return stealTask(pool, worker_idx);
+}
+
+/// Wakes up to `count` parked threads, if there are any.
+static void wakeThreads(ThreadPool* pool, u32 count)
+{
+    if (__atomic_load_n(&pool->parked_count, __ATOMIC_SEQ_CST) == 0) return;
+
+    __atomic_store_n(&pool->last_wake_ns, nowNs(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->wake_futex, 1, __ATOMIC_SEQ_CST);
+    futexWake(&pool->wake_futex, count > INT32_MAX ? INT32_MAX : (int)count);
+}
+
+/// Whether a thread that found no other task could take a background task now.
+static bool isBackgroundTaskAvailable(ThreadPool* pool)
+{
+    return
+        __atomic_load_n(&pool->background_queued_count, __ATOMIC_SEQ_CST) > 0 and
+        __atomic_load_n(&pool->background_running_count, __ATOMIC_SEQ_CST) <
+            __atomic_load_n(&pool->background_thread_limit, __ATOMIC_RELAXED);
+}
+
+/// Gives back a slot for background tasks. A thread may have parked because there was no free slot, so one is
+/// woken if there are background tasks left; the same ordering as for a new task (see `threadProcedure()`), on
+/// `background_running_count`.
+static void releaseBackgroundSlot(ThreadPool* pool)
+{
+    __atomic_sub_fetch(&pool->background_running_count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->background_queued_count, __ATOMIC_SEQ_CST) > 0) wakeThreads(pool, 1);
+}
+
+/// For one of the pool's threads that found no other task: takes a slot for background tasks, and the oldest
+/// one. Returns IDX_NONE, and keeps no slot, if there's no free slot or no task.
+static u32 takeBackgroundTask(ThreadPool* pool)
+{
+    if (__atomic_load_n(&pool->background_queued_count, __ATOMIC_ACQUIRE) == 0) return IDX_NONE;
+
+    u32 running_count = __atomic_load_n(&pool->background_running_count, __ATOMIC_RELAXED);
+    while (true)
+    {
+        if (running_count >= __atomic_load_n(&pool->background_thread_limit, __ATOMIC_RELAXED)) return IDX_NONE;
+
+        const bool claimed = __atomic_compare_exchange_n(
+            &pool->background_running_count, &running_count, running_count + 1, true,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED
+        );
+        if (claimed) break;
+    }
+
+    // the thieves take from the top, so it's the oldest
+    const u32 task_idx = dequeSteal(pool, pool->thread_count + 1);
+    if (task_idx == IDX_NONE) releaseBackgroundSlot(pool);
+    else __atomic_sub_fetch(&pool->background_queued_count, 1, __ATOMIC_RELAXED);
+
+    return task_idx;
+}
+
+static void runTask(ThreadPool* pool, u32 task_idx)
+{
+    Task* task = getTask(pool, task_idx);
+
+    {
+        const u64 start_latency_ns = nowNs() - task->enqueue_ns;
+        u32 bucket = start_latency_ns == 0 ? 0 : 63 - (u32)__builtin_clzll(start_latency_ns);
+        if (bucket >= START_LATENCY_BUCKET_COUNT) bucket = START_LATENCY_BUCKET_COUNT - 1;
+
+        const Worker* worker = tls_worker;
+        u64* p_histogram = (worker != NULL and worker->pool == pool)
+            ? pool->p_workers[worker->idx].start_latency_histogram
+            : pool->external_start_latency_histogram;
+        __atomic_add_fetch(&p_histogram[bucket], 1, __ATOMIC_RELAXED);
+    }
+
+    {
+        ZoneScopedNTask("execute task");
+        task->p_procedure(task->p_arg);
+    }
+
+    // mark the task complete --------------------------------------------------------------------------------
+
+    __atomic_add_fetch(&task->generation, 1, __ATOMIC_SEQ_CST);
 
-        task->generation++;
-        task->freelist_next_idx = queue->freelist_first_idx;
-        queue->freelist_first_idx = task_idx;
+    // A waiter increments `waiter_count` before it checks the generation, so it either sees the new
+    // generation, or is counted here; and it checks under `wait_mutex`, so it can't miss the broadcast.
+    if (__atomic_load_n(&task->waiter_count, __ATOMIC_SEQ_CST) > 0)
+    {
+        int result = pthread_mutex_lock(&pool->wait_mutex);
+        alwaysAssert(result == 0);
 
         result = pthread_cond_broadcast(&task->finished_condition);
         alwaysAssert(result == 0);
+
+        result = pthread_mutex_unlock(&pool->wait_mutex);
+        alwaysAssert(result == 0);
+    }
+
+    // Nothing reads the group after this decrement, so that its waiter may return as soon as it sees 0; the
+    // same ordering as for `waiter_count` above, but on `group_waiter_count`.
+    TaskGroup* group = task->group;
+    if (group != NULL and __atomic_sub_fetch(&group->pending_count, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        if (__atomic_load_n(&pool->group_waiter_count, __ATOMIC_SEQ_CST) > 0)
+        {
+            int result = pthread_mutex_lock(&pool->wait_mutex);
+            alwaysAssert(result == 0);
+
+            result = pthread_cond_broadcast(&pool->group_finished_condition);
+            alwaysAssert(result == 0);
+
+            result = pthread_mutex_unlock(&pool->wait_mutex);
+            alwaysAssert(result == 0);
+        }
     }
+
+    freelistPush(pool, task_idx, task_idx);
+}
+
+/// For a thread that's waiting for a task or group: runs one of the queued tasks, if there are any. One of the
+/// pool's threads takes the last task that it enqueued first, which is likely one of those it's waiting for;
+/// any other thread steals one. Returns whether it ran a task.
+static bool helpWithTask(ThreadPool* pool)
+{
+    if (__atomic_load_n(&pool->queued_count, __ATOMIC_ACQUIRE) == 0) return false;
+
+    const Worker* worker = tls_worker;
+    const u32 task_idx =
+        (worker != NULL and worker->pool == pool) ? findTask(pool, worker->idx) : stealTask(pool, IDX_NONE);
+    if (task_idx == IDX_NONE) return false;
+
+    __atomic_sub_fetch(&pool->queued_count, 1, __ATOMIC_RELAXED);
+    runTask(pool, task_idx);
+
+    return true;
 }
 
-extern ThreadPool* create(u32 thread_count, u32 max_queue_size)
+static void* threadProcedure(void *const p_worker)
 {
     ZoneScoped;
 
+    Worker* worker = (Worker*)p_worker;
+    ThreadPool *const pool = worker->pool;
+    tls_worker = worker;
+
+    while (true)
+    {
+        // find a task ------------------------------------------------------------------------------------------
+
+        u32 task_idx = IDX_NONE;
+        {
+            const u64 spin_end_ns = nowNs() + __atomic_load_n(&pool->idle_spin_ns, __ATOMIC_RELAXED);
+            for (u32 i = 1; task_idx == IDX_NONE; i++)
+            {
+                if (__atomic_load_n(&pool->queued_count, __ATOMIC_ACQUIRE) > 0)
+                {
+                    task_idx = findTask(pool, worker->idx);
+                    if (task_idx != IDX_NONE) break;
+                }
+                // only once there are no frame tasks to take
+                task_idx = takeBackgroundTask(pool);
+                if (task_idx != IDX_NONE) break;
+                cpuRelax();
+
+                if (i % IDLE_SPIN_CLOCK_INTERVAL == 0 and nowNs() >= spin_end_ns) break;
+            }
+        }
+
+        if (task_idx != IDX_NONE)
+        {
+            // it's back in the freelist once it has run
+            const bool background = getTask(pool, task_idx)->background;
+            if (!background) __atomic_sub_fetch(&pool->queued_count, 1, __ATOMIC_RELAXED);
+
+            // including the tasks that it helps with while this one waits
+            const u64 start_ns = nowNs();
+            runTask(pool, task_idx);
+            __atomic_add_fetch(&worker->busy_ns, nowNs() - start_ns, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&worker->task_count, 1, __ATOMIC_RELAXED);
+
+            if (background) releaseBackgroundSlot(pool);
+            continue;
+        }
+
+        // park until a task is enqueued -------------------------------------------------------------------------
+
+        {
+            ZoneScopedNTask("wait for task");
+
+            // The enqueuer increments `queued_count` before it checks `parked_count`, so either the thread sees
+            // the task here, or the enqueuer increments `wake_futex` after it was read here, and the wait returns.
+            const u32 wake_value = __atomic_load_n(&pool->wake_futex, __ATOMIC_ACQUIRE);
+            __atomic_add_fetch(&pool->parked_count, 1, __ATOMIC_SEQ_CST);
+
+            const bool parks =
+                __atomic_load_n(&pool->queued_count, __ATOMIC_SEQ_CST) == 0 and
+                !isBackgroundTaskAvailable(pool) and
+                !__atomic_load_n(&pool->all_threads_should_quit, __ATOMIC_SEQ_CST);
+            if (parks) futexWait(&pool->wake_futex, wake_value);
+
+            __atomic_sub_fetch(&pool->parked_count, 1, __ATOMIC_SEQ_CST);
+
+            if (parks and __atomic_load_n(&pool->wake_futex, __ATOMIC_ACQUIRE) != wake_value)
+            {
+                // From the latest wake, which may not have been this thread's, so it's an underestimate when
+                // several are woken at once.
+                const u64 wake_latency_ns = nowNs() - __atomic_load_n(&pool->last_wake_ns, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&pool->wake_count, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&pool->total_wake_latency_ns, wake_latency_ns, __ATOMIC_RELAXED);
+                atomicMax(&pool->max_wake_latency_ns, wake_latency_ns);
+                TracyPlot("thread_pool::WakeLatencyUs", (f64)wake_latency_ns * 1e-3);
+            }
+
+            // the pending tasks are finished before quitting, the background ones too
+            const bool should_quit =
+                __atomic_load_n(&pool->all_threads_should_quit, __ATOMIC_SEQ_CST) and
+                __atomic_load_n(&pool->queued_count, __ATOMIC_SEQ_CST) == 0 and
+                __atomic_load_n(&pool->background_queued_count, __ATOMIC_SEQ_CST) == 0;
+            if (should_quit) pthread_exit(NULL);
+        }
+    }
+}
+
+/// Pins thread `i` to `p_cpus_optional[i]`, unless it's NULL.
+static ThreadPool* createPool(u32 thread_count, const CpuInfo* p_cpus_optional, u32 initial_queue_size)
+{
     alwaysAssert(thread_count > 0);
-    alwaysAssert(max_queue_size > 0);
+    alwaysAssert(initial_queue_size > 0);
+    alwaysAssert(initial_queue_size <= 1u << 31);
 
 
     // We heap-allocate the queue (instead of just returning it on the stack) to ensure that any pointers to
@@ -133,135 +692,744 @@ extern ThreadPool* create(u32 thread_count, u32 max_queue_size)
     assertErrno(p_queue != NULL);
 
 
-    int result = pthread_mutex_init(&p_queue->mutex, NULL);
+    int result = pthread_mutex_init(&p_queue->wait_mutex, NULL);
     alwaysAssert(result == 0);
-
-    result = pthread_mutex_lock(&p_queue->mutex);
+    result = pthread_mutex_init(&p_queue->external_deque_mutex, NULL);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_init(&p_queue->background_deque_mutex, NULL);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_init(&p_queue->grow_mutex, NULL);
     alwaysAssert(result == 0);
 
-
-    result = pthread_cond_init(&p_queue->new_task_available_condition, NULL);
+    result = pthread_cond_init(&p_queue->group_finished_condition, NULL);
     alwaysAssert(result == 0);
 
-    p_queue->tasklist_first_idx = IDX_NONE;
-    p_queue->freelist_first_idx = 0;
 
+    while ((1u << p_queue->first_segment_size_log2) < initial_queue_size) p_queue->first_segment_size_log2++;
+    const u32 first_segment_size = 1u << p_queue->first_segment_size_log2;
 
-    p_queue->p_tasks = (Task*)calloc(max_queue_size, sizeof(Task));
-    assertErrno(p_queue->p_tasks != NULL);
+    Task* first_segment = (Task*)calloc(first_segment_size, sizeof(Task));
+    assertErrno(first_segment != NULL);
 
-    for (u32 i = 0; i < max_queue_size; i++)
+    for (u32 i = 0; i < first_segment_size; i++)
     {
-        Task* task = &p_queue->p_tasks[i];
+        Task* task = &first_segment[i];
 
-        task->freelist_next_idx = i + 1;
-        task->tasklist_next_idx = IDX_NONE;
+        task->freelist_next_idx = (i + 1 == first_segment_size) ? IDX_NONE : i + 1;
 
         result = pthread_cond_init(&task->finished_condition, NULL);
         alwaysAssert(result == 0);
     }
-    p_queue->p_tasks[max_queue_size - 1].freelist_next_idx = IDX_NONE;
+    p_queue->p_task_segments[0] = first_segment;
+    p_queue->segment_count = 1;
+    p_queue->task_capacity = first_segment_size;
+    p_queue->freelist_head = 0; // pop count 0, task 0
+
+
+    const u32 deque_count = thread_count + 2;
+    p_queue->p_deques = (Deque*)calloc(deque_count, sizeof(Deque));
+    assertErrno(p_queue->p_deques != NULL);
+    for (u32 i = 0; i < deque_count; i++) p_queue->p_deques[i].array = createDequeArray(first_segment_size, NULL);
 
 
     p_queue->all_threads_should_quit = false;
+    p_queue->idle_spin_ns = (u64)DEFAULT_IDLE_SPIN_US * 1000;
+    p_queue->background_thread_limit = (thread_count + 1) / 2;
 
     p_queue->thread_count = thread_count;
     p_queue->p_threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
     assertErrno(p_queue->p_threads != NULL);
+    p_queue->p_workers = (Worker*)calloc(thread_count, sizeof(Worker));
+    assertErrno(p_queue->p_workers != NULL);
 
+    // the stores above are visible to the threads, because `pthread_create()` synchronizes memory
     for (u32 i = 0; i < thread_count; i++)
     {
-        result = pthread_create(&p_queue->p_threads[i], NULL, threadProcedure, p_queue);
+        p_queue->p_workers[i] = Worker {
+            .pool = p_queue,
+            .idx = i,
+            .numa_node = (p_cpus_optional != NULL) ? p_cpus_optional[i].numa_node : 0,
+        };
+
+        pthread_attr_t attr;
+        result = pthread_attr_init(&attr);
         alwaysAssert(result == 0);
-    }
 
+        if (p_cpus_optional != NULL)
+        {
+            // before the thread starts, so that its stack is first touched on its node
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(p_cpus_optional[i].cpu, &cpu_set);
+            result = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+            alwaysAssert(result == 0);
+        }
 
-    result = pthread_mutex_unlock(&p_queue->mutex);
-    alwaysAssert(result == 0);
+        result = pthread_create(&p_queue->p_threads[i], &attr, threadProcedure, &p_queue->p_workers[i]);
+        alwaysAssert(result == 0);
+
+        result = pthread_attr_destroy(&attr);
+        alwaysAssert(result == 0);
+    }
 
     return p_queue;
 }
 
-extern TaskId enqueueTask(ThreadPool* queue, PFN_TaskProc p_procedure, void* p_arg)
+extern ThreadPool* create(u32 thread_count, u32 initial_queue_size)
 {
     ZoneScoped;
 
+    return createPool(thread_count, NULL, initial_queue_size);
+}
 
-    int result = pthread_mutex_lock(&queue->mutex);
-    alwaysAssert(result == 0);
 
-    u32 task_idx = queue->freelist_first_idx;
-    alwaysAssert(task_idx != IDX_NONE); // assert queue is not full
-    Task* task = &queue->p_tasks[task_idx];
+/// The number at `path`, or `default_value` if it can't be read.
+static u32 readSysfsNumber(const char* path, u32 default_value)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return default_value;
 
-    queue->freelist_first_idx = task->freelist_next_idx;
-    task->freelist_next_idx = IDX_NONE;
+    unsigned value = 0;
+    const int match_count = fscanf(file, "%u", &value);
+    fclose(file);
 
-    task->tasklist_next_idx = queue->tasklist_first_idx;
-    queue->tasklist_first_idx = task_idx;
+    return (match_count == 1) ? value : default_value;
+}
 
-    task->p_procedure = p_procedure;
-    task->p_arg = p_arg;
+/// The NUMA node of `cpu`, from the `nodeN` link in its sysfs directory; 0 if it has none.
+static u32 getNumaNode(u32 cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
 
-    TaskId task_id {
-        .idx = task_idx,
-        .generation = task->generation
-    };
+    DIR* dir = opendir(path);
+    if (dir == NULL) return 0;
 
-    result = pthread_cond_signal(&queue->new_task_available_condition);
-    alwaysAssert(result == 0);
+    u32 numa_node = 0;
+    for (const dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+    {
+        unsigned node = 0;
+        if (sscanf(entry->d_name, "node%u", &node) == 1)
+        {
+            numa_node = node;
+            break;
+        }
+    }
+    closedir(dir);
 
-    result = pthread_mutex_unlock(&queue->mutex);
-    alwaysAssert(result == 0);
+    return numa_node;
+}
+
+static int compareCpus(const void* p_a, const void* p_b)
+{
+    const CpuInfo* a = (const CpuInfo*)p_a;
+    const CpuInfo* b = (const CpuInfo*)p_b;
+
+    if (a->numa_node != b->numa_node) return (a->numa_node < b->numa_node) ? -1 : 1;
+    if (a->package != b->package) return (a->package < b->package) ? -1 : 1;
+    if (a->core != b->core) return (a->core < b->core) ? -1 : 1;
+    if (a->cpu != b->cpu) return (a->cpu < b->cpu) ? -1 : 1;
+    return 0;
+}
+
+/// The CPUs that this process may run on, sorted by NUMA node, package and core, so that the threads of a
+/// node are adjacent; with `physical_cores_only`, only the first logical CPU of each core. `p_cpus` must have
+/// room for CPU_SETSIZE. Returns the count.
+static u32 getCpus(bool physical_cores_only, CpuInfo* p_cpus)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    const int result = sched_getaffinity(0, sizeof(cpu_set), &cpu_set);
+    assertErrno(result == 0);
+
+    u32 cpu_count = 0;
+    for (u32 cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &cpu_set)) continue;
+
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+        const u32 package = readSysfsNumber(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+        // without topology information, every CPU counts as a core
+        const u32 core = readSysfsNumber(path, cpu);
+
+        p_cpus[cpu_count++] = CpuInfo { .cpu = cpu, .numa_node = getNumaNode(cpu), .package = package, .core = core };
+    }
+    alwaysAssert(cpu_count > 0);
+
+    qsort(p_cpus, cpu_count, sizeof(CpuInfo), compareCpus);
+
+    if (physical_cores_only)
+    {
+        // the logical CPUs of a core are adjacent after sorting
+        u32 core_count = 0;
+        for (u32 i = 0; i < cpu_count; i++)
+        {
+            const bool same_core =
+                core_count > 0 and
+                p_cpus[i].package == p_cpus[core_count - 1].package and
+                p_cpus[i].core == p_cpus[core_count - 1].core;
+            if (!same_core) p_cpus[core_count++] = p_cpus[i];
+        }
+        cpu_count = core_count;
+    }
+
+    return cpu_count;
+}
+
+extern ThreadPool* create(Topology topology, u32 initial_queue_size)
+{
+    ZoneScoped;
+
+    CpuInfo* p_cpus = (CpuInfo*)calloc(CPU_SETSIZE, sizeof(CpuInfo));
+    assertErrno(p_cpus != NULL);
+
+    const u32 cpu_count = getCpus(topology == Topology::pin_physical_cores, p_cpus);
+    ThreadPool* pool = createPool(cpu_count, (topology == Topology::unpinned) ? NULL : p_cpus, initial_queue_size);
+
+    free(p_cpus);
+    return pool;
+}
+
+extern bool parseTopology(const char* name, Topology* p_topology)
+{
+    if (strcmp(name, "unpinned") == 0) *p_topology = Topology::unpinned;
+    else if (strcmp(name, "pin_logical_cpus") == 0) *p_topology = Topology::pin_logical_cpus;
+    else if (strcmp(name, "pin_physical_cores") == 0) *p_topology = Topology::pin_physical_cores;
+    else return false;
+
+    return true;
+}
+
+extern u32 getThreadCount(const ThreadPool* pool)
+{
+    return pool->thread_count;
+}
+
+extern u32 getCurrentWorkerIdx(const ThreadPool* pool)
+{
+    const Worker* worker = tls_worker;
+    if (worker == NULL or worker->pool != pool) return pool->thread_count;
+    return worker->idx;
+}
+
+/// Enqueues `count` tasks, the `i`th of which gets `p_args` + `i * arg_stride` bytes, with a single push and
+/// wake.
+static void pushTasks(
+    ThreadPool* queue,
+    TaskGroup* group,
+    bool background,
+    u32 count,
+    PFN_TaskProc p_procedure,
+    void* p_args,
+    u64 arg_stride,
+    TaskId* p_ids_out_optional
+) {
+    if (count == 0) return;
+
+    u32 first_task_idx = IDX_NONE;
+    Task* last_task = NULL;
+    const u64 enqueue_ns = nowNs();
+    for (u32 i = 0; i < count; i++)
+    {
+        const u32 task_idx = freelistPop(queue);
+        Task* task = getTask(queue, task_idx);
+
+        task->p_procedure = p_procedure;
+        task->p_arg = (void*)((u8*)p_args + (u64)i * arg_stride);
+        task->group = group;
+        task->background = background;
+        task->enqueue_ns = enqueue_ns;
+
+        if (p_ids_out_optional != NULL)
+        {
+            p_ids_out_optional[i] = TaskId {
+                .idx = task_idx,
+                .generation = __atomic_load_n(&task->generation, __ATOMIC_RELAXED),
+            };
+        }
+
+        if (last_task == NULL) first_task_idx = task_idx;
+        else __atomic_store_n(&last_task->freelist_next_idx, task_idx, __ATOMIC_RELAXED);
+        last_task = task;
+    }
+
+    if (background)
+    {
+        __atomic_add_fetch(&queue->background_queued_count, count, __ATOMIC_SEQ_CST);
+
+        int result = pthread_mutex_lock(&queue->background_deque_mutex);
+        alwaysAssert(result == 0);
+
+        dequePush(queue, queue->thread_count + 1, first_task_idx, count);
+
+        result = pthread_mutex_unlock(&queue->background_deque_mutex);
+        alwaysAssert(result == 0);
+
+        wakeThreads(queue, count);
+        return;
+    }
+
+    const u32 queued_count = __atomic_add_fetch(&queue->queued_count, count, __ATOMIC_SEQ_CST);
+    u32 max_queued_count = __atomic_load_n(&queue->max_queued_count, __ATOMIC_RELAXED);
+    while (queued_count > max_queued_count)
+    {
+        const bool raised = __atomic_compare_exchange_n(
+            &queue->max_queued_count, &max_queued_count, queued_count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+        );
+        if (raised) break;
+    }
+    TracyPlot("thread_pool::QueuedCount", (int64_t)queued_count);
 
+    const Worker* worker = tls_worker;
+    if (worker != NULL and worker->pool == queue)
+    {
+        dequePush(queue, worker->idx, first_task_idx, count);
+    }
+    else
+    {
+        int result = pthread_mutex_trylock(&queue->external_deque_mutex);
+        if (result == EBUSY)
+        {
+            __atomic_add_fetch(&queue->external_deque_contention_count, 1, __ATOMIC_RELAXED);
+            result = pthread_mutex_lock(&queue->external_deque_mutex);
+        }
+        alwaysAssert(result == 0);
+
+        dequePush(queue, queue->thread_count, first_task_idx, count);
+
+        result = pthread_mutex_unlock(&queue->external_deque_mutex);
+        alwaysAssert(result == 0);
+    }
+
+    wakeThreads(queue, count);
+}
+
+extern TaskId enqueueTask(ThreadPool* queue, PFN_TaskProc p_procedure, void* p_arg)
+{
+    ZoneScopedTask;
+
+    TaskId task_id;
+    pushTasks(queue, NULL, false, 1, p_procedure, p_arg, 0, &task_id);
+    return task_id;
+}
+
+extern void enqueueTask(ThreadPool* queue, TaskGroup* group, PFN_TaskProc p_procedure, void* p_arg)
+{
+    ZoneScopedTask;
+
+    // before the task is pushed, so that it can't complete first
+    __atomic_add_fetch(&group->pending_count, 1, __ATOMIC_RELAXED);
+    pushTasks(queue, group, false, 1, p_procedure, p_arg, 0, NULL);
+}
+
+extern void enqueueTasks(
+    ThreadPool* queue,
+    u32 count,
+    PFN_TaskProc p_procedure,
+    void* p_args,
+    u64 arg_stride,
+    TaskId* p_ids_out_optional
+) {
+    ZoneScopedTask;
+
+    pushTasks(queue, NULL, false, count, p_procedure, p_args, arg_stride, p_ids_out_optional);
+}
+
+extern void enqueueTasks(
+    ThreadPool* queue,
+    TaskGroup* group,
+    u32 count,
+    PFN_TaskProc p_procedure,
+    void* p_args,
+    u64 arg_stride
+) {
+    ZoneScopedTask;
+
+    __atomic_add_fetch(&group->pending_count, count, __ATOMIC_RELAXED);
+    pushTasks(queue, group, false, count, p_procedure, p_args, arg_stride, NULL);
+}
+
+extern TaskId enqueueBackgroundTask(ThreadPool* queue, PFN_TaskProc p_procedure, void* p_arg)
+{
+    ZoneScopedTask;
+
+    TaskId task_id;
+    pushTasks(queue, NULL, true, 1, p_procedure, p_arg, 0, &task_id);
     return task_id;
 }
 
+extern void enqueueBackgroundTask(ThreadPool* queue, TaskGroup* group, PFN_TaskProc p_procedure, void* p_arg)
+{
+    ZoneScopedTask;
+
+    __atomic_add_fetch(&group->pending_count, 1, __ATOMIC_RELAXED);
+    pushTasks(queue, group, true, 1, p_procedure, p_arg, 0, NULL);
+}
+
+extern void setBackgroundThreadLimit(ThreadPool* queue, u32 thread_count)
+{
+    alwaysAssert(thread_count >= 1 and thread_count <= queue->thread_count);
+
+    __atomic_store_n(&queue->background_thread_limit, thread_count, __ATOMIC_SEQ_CST);
+    // for the new slots, if there are any; the threads that park meanwhile see the new limit
+    if (__atomic_load_n(&queue->background_queued_count, __ATOMIC_SEQ_CST) > 0) wakeThreads(queue, thread_count);
+}
+
 extern void waitForTask(ThreadPool* queue, const TaskId task_id)
 {
-    ZoneScoped;
+    ZoneScopedTask;
+
+
+    Task* p_task = getTask(queue, task_id.idx);
+
+    // Runs the queued tasks in the meantime, so that a pool thread that waits doesn't hold up the tasks that it
+    // waits for; and only blocks once there are none.
+    for (u32 i = 0; i < SPIN_COUNT; i++)
+    {
+        if (__atomic_load_n(&p_task->generation, __ATOMIC_ACQUIRE) != task_id.generation) return;
+        if (helpWithTask(queue)) i = 0;
+        else cpuRelax();
+    }
 
+    __atomic_add_fetch(&p_task->waiter_count, 1, __ATOMIC_SEQ_CST);
 
-    int result = pthread_mutex_lock(&queue->mutex);
+    int result = pthread_mutex_lock(&queue->wait_mutex);
     alwaysAssert(result == 0);
 
-    Task* p_task = &queue->p_tasks[task_id.idx];
-    while (p_task->generation == task_id.generation)
+    while (__atomic_load_n(&p_task->generation, __ATOMIC_SEQ_CST) == task_id.generation)
     {
-        result = pthread_cond_wait(&p_task->finished_condition, &queue->mutex);
+        result = pthread_cond_wait(&p_task->finished_condition, &queue->wait_mutex);
         alwaysAssert(result == 0);
     }
 
-    result = pthread_mutex_unlock(&queue->mutex);
+    result = pthread_mutex_unlock(&queue->wait_mutex);
     alwaysAssert(result == 0);
+
+    __atomic_sub_fetch(&p_task->waiter_count, 1, __ATOMIC_SEQ_CST);
 }
 
-extern void destroy(ThreadPool* queue)
+/// A `parallelFor()` or `parallelReduce()`, on the stack of the calling thread.
+struct ParallelLoop
+{
+    u64 next; // the beginning of the next chunk to be claimed; atomic
+    u64 end;
+    u64 chunk_size;
+
+    // one of these is set
+    PFN_RangeProc p_proc;
+    PFN_RangeReduceProc p_reduce_proc;
+    void* p_ctx;
+
+    // the helpers' partials, `partial_stride` bytes apart; for `parallelReduce()`
+    u8* p_partials;
+    u64 partial_stride;
+    u32 next_helper_idx; // atomic
+};
+
+static void runChunks(ParallelLoop* loop, void* p_partial)
+{
+    while (true)
+    {
+        const u64 chunk_begin = __atomic_fetch_add(&loop->next, loop->chunk_size, __ATOMIC_RELAXED);
+        if (chunk_begin >= loop->end) return;
+        const u64 chunk_end =
+            (loop->end - chunk_begin < loop->chunk_size) ? loop->end : chunk_begin + loop->chunk_size;
+
+        if (loop->p_reduce_proc != NULL) loop->p_reduce_proc(loop->p_ctx, chunk_begin, chunk_end, p_partial);
+        else loop->p_proc(loop->p_ctx, chunk_begin, chunk_end);
+    }
+}
+
+static void parallelLoopHelperTask(void* p_loop)
+{
+    ZoneScopedTask;
+
+    ParallelLoop* loop = (ParallelLoop*)p_loop;
+
+    void* p_partial = NULL;
+    if (loop->p_partials != NULL)
+    {
+        const u32 helper_idx = __atomic_fetch_add(&loop->next_helper_idx, 1, __ATOMIC_RELAXED);
+        p_partial = &loop->p_partials[helper_idx * loop->partial_stride];
+    }
+
+    runChunks(loop, p_partial);
+}
+
+/// The chunk size of a loop over `item_count` items; and the number of helper tasks, which is at most one per
+/// thread of the pool.
+static u64 getChunkSize(const ThreadPool* pool, u64 item_count, u64 grain, u32* p_helper_count)
+{
+    u64 chunk_size = grain;
+    if (chunk_size == 0)
+    {
+        chunk_size = item_count / ((pool->thread_count + 1) * CHUNKS_PER_THREAD);
+        if (chunk_size == 0) chunk_size = 1;
+    }
+
+    const u64 chunk_count = (item_count + chunk_size - 1) / chunk_size;
+    *p_helper_count = (chunk_count - 1 < pool->thread_count) ? (u32)(chunk_count - 1) : pool->thread_count;
+
+    return chunk_size;
+}
+
+extern void parallelFor(ThreadPool* pool, u64 begin, u64 end, u64 grain, PFN_RangeProc p_proc, void* p_ctx)
 {
     ZoneScoped;
 
+    if (begin >= end) return;
+    assert(end <= UINT64_MAX / 2); // so that claiming the chunks past the end doesn't overflow `next`
 
-    int result = pthread_mutex_lock(&queue->mutex);
-    alwaysAssert(result == 0);
+    u32 helper_count = 0;
+    const u64 chunk_size = getChunkSize(pool, end - begin, grain, &helper_count);
+
+    if (helper_count == 0)
+    {
+        p_proc(p_ctx, begin, end);
+        return;
+    }
+
+    ParallelLoop loop {
+        .next = begin,
+        .end = end,
+        .chunk_size = chunk_size,
+        .p_proc = p_proc,
+        .p_reduce_proc = NULL,
+        .p_ctx = p_ctx,
+        .p_partials = NULL,
+        .partial_stride = 0,
+        .next_helper_idx = 0,
+    };
+
+    TaskGroup helpers {};
+    for (u32 i = 0; i < helper_count; i++) enqueueTask(pool, &helpers, parallelLoopHelperTask, &loop);
 
-    // wait for pending tasks to complete --------------------------------------------------------------------
+    runChunks(&loop, NULL);
 
-    while (queue->tasklist_first_idx != IDX_NONE)
+    // the helpers that haven't started yet still read `loop`
+    waitForGroup(pool, &helpers);
+}
+
+extern void parallelReduce(
+    ThreadPool* pool,
+    u64 begin,
+    u64 end,
+    u64 grain,
+    PFN_RangeReduceProc p_proc,
+    PFN_CombineProc p_combine,
+    void* p_ctx,
+    void* p_result,
+    u64 partial_size
+) {
+    ZoneScoped;
+
+    if (begin >= end) return;
+    assert(end <= UINT64_MAX / 2); // so that claiming the chunks past the end doesn't overflow `next`
+    assert(partial_size > 0);
+
+    u32 helper_count = 0;
+    const u64 chunk_size = getChunkSize(pool, end - begin, grain, &helper_count);
+
+    if (helper_count == 0)
     {
-        Task* task = &queue->p_tasks[queue->tasklist_first_idx];
-        result = pthread_cond_wait(&task->finished_condition, &queue->mutex);
-        alwaysAssert(result == 0);
+        p_proc(p_ctx, begin, end, p_result);
+        return;
     }
 
-    // quit the threads --------------------------------------------------------------------------------------
+    // aligned like `alloca()`'s result
+    constexpr u64 ALIGNMENT = alignof(max_align_t);
+    const u64 partial_stride = (partial_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    u8* p_partials = (u8*)alloca(helper_count * partial_stride);
+    for (u32 i = 0; i < helper_count; i++) memcpy(&p_partials[i * partial_stride], p_result, partial_size);
+
+    ParallelLoop loop {
+        .next = begin,
+        .end = end,
+        .chunk_size = chunk_size,
+        .p_proc = NULL,
+        .p_reduce_proc = p_proc,
+        .p_ctx = p_ctx,
+        .p_partials = p_partials,
+        .partial_stride = partial_stride,
+        .next_helper_idx = 0,
+    };
+
+    TaskGroup helpers {};
+    for (u32 i = 0; i < helper_count; i++) enqueueTask(pool, &helpers, parallelLoopHelperTask, &loop);
+
+    runChunks(&loop, p_result);
+
+    waitForGroup(pool, &helpers);
+
+    for (u32 i = 0; i < helper_count; i++) p_combine(p_ctx, p_result, &p_partials[i * partial_stride]);
+}
+
+extern void waitForGroup(ThreadPool* queue, TaskGroup* group)
+{
+    ZoneScoped;
+
+
+    // like `waitForTask()`
+    for (u32 i = 0; i < SPIN_COUNT; i++)
+    {
+        if (__atomic_load_n(&group->pending_count, __ATOMIC_ACQUIRE) == 0) return;
+        if (helpWithTask(queue)) i = 0;
+        else cpuRelax();
+    }
+
+    __atomic_add_fetch(&queue->group_waiter_count, 1, __ATOMIC_SEQ_CST);
 
-    queue->all_threads_should_quit = true;
-    result = pthread_cond_broadcast(&queue->new_task_available_condition);
+    int result = pthread_mutex_lock(&queue->wait_mutex);
     alwaysAssert(result == 0);
 
-    result = pthread_mutex_unlock(&queue->mutex);
+    while (__atomic_load_n(&group->pending_count, __ATOMIC_SEQ_CST) != 0)
+    {
+        result = pthread_cond_wait(&queue->group_finished_condition, &queue->wait_mutex);
+        alwaysAssert(result == 0);
+    }
+
+    result = pthread_mutex_unlock(&queue->wait_mutex);
     alwaysAssert(result == 0);
 
+    __atomic_sub_fetch(&queue->group_waiter_count, 1, __ATOMIC_SEQ_CST);
+}
+
+extern bool isGroupFinished(const TaskGroup* group)
+{
+    return __atomic_load_n(&group->pending_count, __ATOMIC_ACQUIRE) == 0;
+}
+
+extern u32 addTaskGraphNode(
+    TaskGraph* graph,
+    PFN_TaskProc p_procedure,
+    void* p_arg,
+    u32 dependency_count,
+    const u32* p_dependencies
+) {
+    alwaysAssert(graph->node_count < MAX_TASK_GRAPH_NODE_COUNT);
+
+    const u32 node_idx = graph->node_count;
+    graph->nodes[node_idx] = TaskGraph::Node {
+        .p_procedure = p_procedure,
+        .p_arg = p_arg,
+        .graph = graph,
+        .dependent_mask = 0,
+        .dependency_count = dependency_count,
+        .pending_dependency_count = 0,
+    };
+    graph->node_count++;
+
+    for (u32 i = 0; i < dependency_count; i++)
+    {
+        assert(p_dependencies[i] < node_idx);
+        graph->nodes[p_dependencies[i]].dependent_mask |= 1ull << node_idx;
+    }
+
+    return node_idx;
+}
+
+static void taskGraphNodeTask(void* p_node)
+{
+    TaskGraph::Node* node = (TaskGraph::Node*)p_node;
+    TaskGraph* graph = node->graph;
+
+    node->p_procedure(node->p_arg);
+
+    u64 dependent_mask = node->dependent_mask;
+    while (dependent_mask != 0)
+    {
+        TaskGraph::Node* dependent = &graph->nodes[__builtin_ctzll(dependent_mask)];
+        dependent_mask &= dependent_mask - 1;
+
+        // The last dependency to complete enqueues it; the acquire-release makes the others' writes visible to
+        // it too. It's added to the group before this node's task completes, so the group can't finish early.
+        const u32 pending_dependency_count =
+            __atomic_sub_fetch(&dependent->pending_dependency_count, 1, __ATOMIC_ACQ_REL);
+        if (pending_dependency_count == 0) enqueueTask(graph->pool, &graph->tasks, taskGraphNodeTask, dependent);
+    }
+}
+
+extern void runTaskGraph(ThreadPool* pool, TaskGraph* graph)
+{
+    ZoneScoped;
+
+    graph->pool = pool;
+    for (u32 i = 0; i < graph->node_count; i++)
+    {
+        __atomic_store_n(&graph->nodes[i].pending_dependency_count, graph->nodes[i].dependency_count, __ATOMIC_RELAXED);
+    }
+
+    for (u32 i = 0; i < graph->node_count; i++)
+    {
+        if (graph->nodes[i].dependency_count == 0)
+        {
+            enqueueTask(pool, &graph->tasks, taskGraphNodeTask, &graph->nodes[i]);
+        }
+    }
+
+    waitForGroup(pool, &graph->tasks);
+}
+
+extern Stats getStats(ThreadPool* queue)
+{
+    Stats stats {
+        .task_capacity = __atomic_load_n(&queue->task_capacity, __ATOMIC_RELAXED),
+        .max_queued_count = __atomic_load_n(&queue->max_queued_count, __ATOMIC_RELAXED),
+        .wake_count = __atomic_load_n(&queue->wake_count, __ATOMIC_RELAXED),
+        .total_wake_latency_ns = __atomic_load_n(&queue->total_wake_latency_ns, __ATOMIC_RELAXED),
+        .max_wake_latency_ns = __atomic_load_n(&queue->max_wake_latency_ns, __ATOMIC_RELAXED),
+        .queued_count = __atomic_load_n(&queue->queued_count, __ATOMIC_RELAXED),
+        .background_queued_count = __atomic_load_n(&queue->background_queued_count, __ATOMIC_RELAXED),
+        .background_running_count = __atomic_load_n(&queue->background_running_count, __ATOMIC_RELAXED),
+        .external_deque_contention_count =
+            __atomic_load_n(&queue->external_deque_contention_count, __ATOMIC_RELAXED),
+        .start_latency_histogram = {},
+    };
+
+    for (u32 bucket = 0; bucket < START_LATENCY_BUCKET_COUNT; bucket++)
+    {
+        u64 count = __atomic_load_n(&queue->external_start_latency_histogram[bucket], __ATOMIC_RELAXED);
+        for (u32 i = 0; i < queue->thread_count; i++)
+        {
+            count += __atomic_load_n(&queue->p_workers[i].start_latency_histogram[bucket], __ATOMIC_RELAXED);
+        }
+        stats.start_latency_histogram[bucket] = count;
+    }
+
+    return stats;
+}
+
+extern WorkerStats getWorkerStats(ThreadPool* queue, u32 worker_idx)
+{
+    assert(worker_idx < queue->thread_count);
+    const Worker* worker = &queue->p_workers[worker_idx];
+
+    return WorkerStats {
+        .busy_ns = __atomic_load_n(&worker->busy_ns, __ATOMIC_RELAXED),
+        .task_count = __atomic_load_n(&worker->task_count, __ATOMIC_RELAXED),
+    };
+}
+
+extern void setIdleSpinTime(ThreadPool* queue, u32 microseconds)
+{
+    __atomic_store_n(&queue->idle_spin_ns, (u64)microseconds * 1000, __ATOMIC_RELAXED);
+}
+
+extern void destroy(ThreadPool* queue)
+{
+    ZoneScoped;
+
+
+    // quit the threads, once the pending tasks are complete ---------------------------------------------------
+
+    __atomic_store_n(&queue->all_threads_should_quit, true, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&queue->last_wake_ns, nowNs(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&queue->wake_futex, 1, __ATOMIC_SEQ_CST);
+    futexWake(&queue->wake_futex, INT32_MAX);
+
+    int result = 0;
     for (u32fast i = 0; i < queue->thread_count; i++)
     {
         result = pthread_join(queue->p_threads[i], NULL);
@@ -270,26 +1438,46 @@ extern void destroy(ThreadPool* queue)
 
     // destroy everything ------------------------------------------------------------------------------------
 
+    for (u32 segment_idx = 0; segment_idx < queue->segment_count; segment_idx++)
     {
-        u32 task_idx = queue->freelist_first_idx;
-        assert(task_idx != IDX_NONE);
+        const u32 segment_size =
+            (segment_idx == 0) ? 1u << queue->first_segment_size_log2
+                               : 1u << (queue->first_segment_size_log2 + segment_idx - 1);
 
-        while (task_idx != IDX_NONE)
+        Task* segment = queue->p_task_segments[segment_idx];
+        for (u32 i = 0; i < segment_size; i++)
         {
-            result = pthread_cond_destroy(&queue->p_tasks[task_idx].finished_condition);
+            result = pthread_cond_destroy(&segment[i].finished_condition);
             alwaysAssert(result == 0);
-
-            task_idx = queue->p_tasks[task_idx].tasklist_next_idx;
         }
+
+        free(segment);
     }
 
-    free(queue->p_tasks);
+    for (u32 i = 0; i < queue->thread_count + 2; i++)
+    {
+        for (DequeArray* array = queue->p_deques[i].array; array != NULL;)
+        {
+            DequeArray* p_previous = array->p_previous;
+            free(array->p_slots);
+            free(array);
+            array = p_previous;
+        }
+    }
+    free(queue->p_deques);
     free(queue->p_threads);
+    free(queue->p_workers);
 
-    result = pthread_cond_destroy(&queue->new_task_available_condition);
+    result = pthread_cond_destroy(&queue->group_finished_condition);
     alwaysAssert(result == 0);
 
-    result = pthread_mutex_destroy(&queue->mutex);
+    result = pthread_mutex_destroy(&queue->wait_mutex);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_destroy(&queue->external_deque_mutex);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_destroy(&queue->background_deque_mutex);
+    alwaysAssert(result == 0);
+    result = pthread_mutex_destroy(&queue->grow_mutex);
     alwaysAssert(result == 0);
 
     memset(queue, 0, sizeof(*queue));
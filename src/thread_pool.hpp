@@ -20,12 +20,182 @@ struct TaskId
 
 struct ThreadPool;
 
-ThreadPool* create(u32 thread_count, u32 max_queue_size);
+/// Tasks that are waited for together, with `waitForGroup()`. Zero-initialize it; it can be reused once
+/// `waitForGroup()` has returned.
+struct TaskGroup
+{
+    u32 pending_count; // atomic
+};
+
+/// How `create(Topology, ...)` places the threads. The threads are ordered by NUMA node, and idle threads steal
+/// from the threads on their own node first.
+enum class Topology
+{
+    unpinned, // a thread per logical CPU, which the scheduler may move
+    pin_logical_cpus, // a thread per logical CPU, pinned to it
+    pin_physical_cores, // a thread per physical core, pinned to one of its logical CPUs; the SMT siblings idle
+};
+
+/// The queue starts with room for `initial_queue_size` tasks, and grows whenever it's full.
+ThreadPool* create(u32 thread_count, u32 initial_queue_size);
+/// With threads for the CPUs that this process may run on.
+ThreadPool* create(Topology, u32 initial_queue_size);
 void destroy(ThreadPool*);
 
+/// "unpinned", "pin_logical_cpus" or "pin_physical_cores". Returns false for any other name.
+bool parseTopology(const char* name, Topology* p_topology);
+u32 getThreadCount(const ThreadPool*);
+/// The index of the calling thread in the pool, in `[0, getThreadCount())`; or `getThreadCount()` if it isn't
+/// one of the pool's threads. For indexing per-thread data, with one more slot for the thread outside the pool
+/// that uses it (there must only be one, such as the main thread).
+u32 getCurrentWorkerIdx(const ThreadPool*);
+
+constexpr u32 START_LATENCY_BUCKET_COUNT = 32;
+
+struct Stats
+{
+    u32 task_capacity; // the tasks that the queue has room for, so far
+    u32 max_queued_count; // the most tasks that have been enqueued and not yet started at once
+    // Of the threads that were parked and woken for a task: from the wake to when the thread ran again. Also
+    // plotted in Tracy.
+    u64 wake_count;
+    u64 total_wake_latency_ns;
+    u64 max_wake_latency_ns;
+
+    u32 queued_count; // enqueued and not yet started, now; not counting the background tasks
+    u32 background_queued_count; // see `enqueueBackgroundTask()`
+    u32 background_running_count;
+    // Enqueues from outside the pool that found another one holding the lock of the shared deque; the pool's own
+    // threads enqueue without a lock.
+    u64 external_deque_contention_count;
+    // Of every task that has started: from its enqueue to its start. Bucket `i` counts those that took [2^i,
+    // 2^(i+1)) ns; the first also counts 0, and the last everything longer.
+    u64 start_latency_histogram[START_LATENCY_BUCKET_COUNT];
+};
+Stats getStats(ThreadPool*);
+
+/// Totals since the pool was created, so the busy fraction of a thread over an interval is the change of
+/// `busy_ns` over its length.
+struct WorkerStats
+{
+    u64 busy_ns; // running tasks, including those it runs while one of them waits
+    u64 task_count; // not counting those it runs while one of them waits
+};
+WorkerStats getWorkerStats(ThreadPool*, u32 worker_idx);
+
+/// How long an idle thread looks for tasks before it parks; 50 us by default. Longer wastes more CPU time
+/// between bursts of tasks, and shorter makes the threads slower to start on the next burst.
+void setIdleSpinTime(ThreadPool*, u32 microseconds);
+
 TaskId enqueueTask(ThreadPool*, PFN_TaskProc p_procedure, void* p_arg);
+/// Runs queued tasks while the task isn't complete, so it may be called from a task, and the calling thread
+/// isn't idle; blocks only once there are no queued tasks.
 void waitForTask(ThreadPool*, TaskId);
 
+/// Like `enqueueTask()`, but the task is waited for with the rest of `group`, instead of by its `TaskId`.
+void enqueueTask(ThreadPool*, TaskGroup* group, PFN_TaskProc p_procedure, void* p_arg);
+/// Waits until every task enqueued in `group` is complete, running queued tasks in the meantime like
+/// `waitForTask()`. If it blocks, it wakes once, when the last one completes.
+void waitForGroup(ThreadPool*, TaskGroup* group);
+/// Whether every task enqueued in `group` is complete, without waiting; if so, their writes are visible, as after
+/// `waitForGroup()`.
+bool isGroupFinished(const TaskGroup* group);
+
+/// Enqueues `count` tasks at once, which are woken for together: the `i`th gets the argument `p_args` + `i *
+/// arg_stride` bytes, so it can index an array of params, or `arg_stride` can be 0 for the same argument. Writes
+/// their ids to `p_ids_out_optional`, unless it's NULL.
+void enqueueTasks(
+    ThreadPool*,
+    u32 count,
+    PFN_TaskProc p_procedure,
+    void* p_args,
+    u64 arg_stride,
+    TaskId* p_ids_out_optional
+);
+/// Like `enqueueTasks()`, in `group`.
+void enqueueTasks(ThreadPool*, TaskGroup* group, u32 count, PFN_TaskProc p_procedure, void* p_args, u64 arg_stride);
+
+/// Like `enqueueTask()`, but for work that no frame waits for, such as file I/O and shader compilation: a thread
+/// only starts a background task when it finds no other task queued, and at most `setBackgroundThreadLimit()`
+/// threads run them at once, so that the rest are free for the frame's tasks. They're started in the order they
+/// were enqueued; `waitForTask()` and `waitForGroup()` don't run them while they wait, so a background task must
+/// not wait for another one. The tasks that a background task enqueues are frame tasks, unless enqueued with this.
+TaskId enqueueBackgroundTask(ThreadPool*, PFN_TaskProc p_procedure, void* p_arg);
+/// Like `enqueueBackgroundTask()`, in `group`.
+void enqueueBackgroundTask(ThreadPool*, TaskGroup* group, PFN_TaskProc p_procedure, void* p_arg);
+/// In `[1, getThreadCount()]`; half of the threads by default, rounded up.
+void setBackgroundThreadLimit(ThreadPool*, u32 thread_count);
+
+constexpr u32 MAX_TASK_GRAPH_NODE_COUNT = 64;
+
+/// Tasks with dependencies between them, such as the stages of a frame: `runTaskGraph()` enqueues each node once
+/// the nodes it depends on have completed, so the independent ones run concurrently. Zero-initialize it, and add
+/// the nodes with `addTaskGraphNode()`; it can be run any number of times, but not concurrently.
+struct TaskGraph
+{
+    struct Node
+    {
+        PFN_TaskProc p_procedure;
+        void* p_arg;
+        TaskGraph* graph;
+        u64 dependent_mask; // bit `i` is set if node `i` depends on this one
+        u32 dependency_count;
+        u32 pending_dependency_count; // atomic
+    };
+
+    u32 node_count;
+    Node nodes[MAX_TASK_GRAPH_NODE_COUNT];
+
+    ThreadPool* pool; // of the current run
+    TaskGroup tasks;
+};
+
+/// Returns the index of the node, for the dependencies of the later ones; a node can only depend on nodes added
+/// before it, so there are no cycles.
+u32 addTaskGraphNode(
+    TaskGraph*,
+    PFN_TaskProc p_procedure,
+    void* p_arg,
+    u32 dependency_count,
+    const u32* p_dependencies
+);
+/// Returns once every node has completed, running queued tasks in the meantime like `waitForGroup()`; so the
+/// nodes may use the pool themselves.
+void runTaskGraph(ThreadPool*, TaskGraph*);
+
+/// Called on each chunk `[begin, end)` of a `parallelFor()`.
+using RangeProc = void (void* p_ctx, u64 begin, u64 end);
+using PFN_RangeProc = RangeProc*;
+
+/// Called on each chunk `[begin, end)` of a `parallelReduce()`; accumulates into `p_partial`.
+using RangeReduceProc = void (void* p_ctx, u64 begin, u64 end, void* p_partial);
+using PFN_RangeReduceProc = RangeReduceProc*;
+
+/// Accumulates `p_partial` into `p_accum`.
+using CombineProc = void (void* p_ctx, void* p_accum, const void* p_partial);
+using PFN_CombineProc = CombineProc*;
+
+/// Splits `[begin, end)` into chunks of `grain` items (or a size chosen from the thread count, if `grain` is 0),
+/// and calls `p_proc` on each of them. The calling thread and up to one task per thread of the pool claim the
+/// chunks until there are none left, so uneven chunks balance out. Returns once every chunk is done.
+void parallelFor(ThreadPool*, u64 begin, u64 end, u64 grain, PFN_RangeProc p_proc, void* p_ctx);
+
+/// Like `parallelFor()`, but each participating thread accumulates its chunks into its own `partial_size`-byte
+/// partial, and the partials are combined into `p_result` with `p_combine` at the end. `p_result` must hold the
+/// identity on entry; the other partials start as copies of it. The order in which the chunks are accumulated
+/// and combined is unspecified.
+void parallelReduce(
+    ThreadPool*,
+    u64 begin,
+    u64 end,
+    u64 grain,
+    PFN_RangeReduceProc p_proc,
+    PFN_CombineProc p_combine,
+    void* p_ctx,
+    void* p_result,
+    u64 partial_size
+);
+
 //
 // ===========================================================================================================
 //
@@ -0,0 +1,343 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "defer.hpp"
+#include "trace.hpp"
+
+namespace trace {
+
+//
+// ===========================================================================================================
+//
+
+enum EventType : u32 {
+    EVENT_ZONE,
+    EVENT_COUNTER,
+    EVENT_GPU_TIME,
+};
+
+struct Event {
+    const char* name;
+    u64 time_ns; // the begin of a zone
+    union {
+        u64 end_ns; // EVENT_ZONE
+        f64 value; // EVENT_COUNTER, and the ms of EVENT_GPU_TIME
+    };
+    EventType type;
+};
+
+/// The events of one thread in one module. Only that thread writes to it, and only a dump reads it.
+struct ThreadRing {
+    ThreadRing* next; // in `Tracer::rings`
+    pid_t thread_id;
+    // the events written so far, of which the last `CreateInfo::events_per_thread` are kept; atomic
+    u64 write_count;
+    Event* events;
+};
+
+struct Tracer {
+    u64 id; // tells the threads' rings of a tracer from those of an earlier one at the same address
+    char* filepath;
+    u32 events_per_thread;
+    u32 frame_count;
+    f64 slow_frame_threshold_ms;
+
+    pthread_mutex_t mutex; // guards `rings`, and the dumps
+    ThreadRing* rings;
+
+    // When each of the last `frame_count + 1` frames began, the current one included: frame `i` began at
+    // `frame_begins_ns[i % (frame_count + 1)]`. Only written by `markFrame()`.
+    u64* frame_begins_ns;
+    u64 frame_idx; // of the current frame
+    f64 slowest_dumped_frame_ms;
+    bool dumped_slow_frame;
+};
+
+// of this module; see `setTracer()`
+static Tracer* g_tracer = NULL;
+static u64 g_next_tracer_id = 1;
+
+// this thread's ring in this module, and the id of the tracer that it's in
+static thread_local ThreadRing* tls_ring = NULL;
+static thread_local u64 tls_ring_tracer_id = 0;
+
+//
+// ===========================================================================================================
+//
+
+Tracer* create(const CreateInfo* info) {
+
+    alwaysAssert(info->filepath != NULL);
+    alwaysAssert(info->events_per_thread > 0);
+    alwaysAssert(info->frame_count > 0);
+
+    Tracer* tracer = callocArray(1, Tracer);
+    tracer->id = __atomic_fetch_add(&g_next_tracer_id, 1, __ATOMIC_RELAXED);
+    tracer->filepath = strdup(info->filepath);
+    alwaysAssert(tracer->filepath != NULL);
+    tracer->events_per_thread = info->events_per_thread;
+    tracer->frame_count = info->frame_count;
+    tracer->slow_frame_threshold_ms = info->slow_frame_threshold_ms;
+
+    const int result = pthread_mutex_init(&tracer->mutex, NULL);
+    alwaysAssert(result == 0);
+
+    tracer->frame_begins_ns = callocArray(info->frame_count + 1, u64);
+    tracer->frame_begins_ns[0] = now();
+
+    return tracer;
+}
+
+
+void destroy(Tracer* tracer) {
+
+    if (!tracer->dumped_slow_frame) dump(tracer);
+
+    ThreadRing* ring = tracer->rings;
+    while (ring != NULL)
+    {
+        ThreadRing* next = ring->next;
+        free(ring->events);
+        free(ring);
+        ring = next;
+    }
+
+    pthread_mutex_destroy(&tracer->mutex);
+    free(tracer->frame_begins_ns);
+    free(tracer->filepath);
+    free(tracer);
+}
+
+
+void setTracer(Tracer* tracer) {
+    __atomic_store_n(&g_tracer, tracer, __ATOMIC_RELEASE);
+}
+
+
+bool isTracing(void) {
+    return __atomic_load_n(&g_tracer, __ATOMIC_RELAXED) != NULL;
+}
+
+
+u64 now(void) {
+    timespec time {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1'000'000'000 + (u64)time.tv_nsec;
+}
+
+
+/// The calling thread's ring in `tracer`, which is created the first time.
+static ThreadRing* getThreadRing(Tracer* tracer) {
+
+    if (tls_ring_tracer_id == tracer->id) return tls_ring;
+
+    ThreadRing* ring = callocArray(1, ThreadRing);
+    ring->thread_id = gettid();
+    ring->events = callocArray(tracer->events_per_thread, Event);
+
+    int result = pthread_mutex_lock(&tracer->mutex);
+    alwaysAssert(result == 0);
+    ring->next = tracer->rings;
+    tracer->rings = ring;
+    result = pthread_mutex_unlock(&tracer->mutex);
+    alwaysAssert(result == 0);
+
+    tls_ring = ring;
+    tls_ring_tracer_id = tracer->id;
+    return ring;
+}
+
+
+static void recordEvent(const Event* event) {
+
+    Tracer* tracer = __atomic_load_n(&g_tracer, __ATOMIC_ACQUIRE);
+    if (tracer == NULL) return;
+
+    ThreadRing* ring = getThreadRing(tracer);
+    const u64 idx = ring->write_count; // only this thread writes it
+    ring->events[idx % tracer->events_per_thread] = *event;
+    __atomic_store_n(&ring->write_count, idx + 1, __ATOMIC_RELEASE);
+}
+
+
+void recordZone(const char* name, u64 begin_ns, u64 end_ns) {
+    const Event event { .name = name, .time_ns = begin_ns, .end_ns = end_ns, .type = EVENT_ZONE };
+    recordEvent(&event);
+}
+
+
+void recordCounter(const char* name, f64 value) {
+    if (!isTracing()) return;
+    const Event event { .name = name, .time_ns = now(), .value = value, .type = EVENT_COUNTER };
+    recordEvent(&event);
+}
+
+
+void recordGpuTime(const char* name, f64 time_ns) {
+    if (!isTracing()) return;
+    const Event event { .name = name, .time_ns = now(), .value = 1e-6 * time_ns, .type = EVENT_GPU_TIME };
+    recordEvent(&event);
+}
+
+
+void markFrame(void) {
+
+    Tracer* tracer = __atomic_load_n(&g_tracer, __ATOMIC_ACQUIRE);
+    if (tracer == NULL) return;
+
+    const u64 time_ns = now();
+    const u64 slot_count = tracer->frame_count + 1;
+    const u64 begin_ns = tracer->frame_begins_ns[tracer->frame_idx % slot_count];
+
+    tracer->frame_idx++;
+    tracer->frame_begins_ns[tracer->frame_idx % slot_count] = time_ns;
+
+    const f64 frame_ms = 1e-6 * (f64)(time_ns - begin_ns);
+    const bool slow =
+        tracer->slow_frame_threshold_ms > 0.0 and frame_ms > tracer->slow_frame_threshold_ms and
+        frame_ms > tracer->slowest_dumped_frame_ms;
+    if (!slow) return;
+
+    LOG_F(
+        INFO, "Frame %" PRIu64 " took %.3lf ms; dumping the last frames to `%s`.",
+        tracer->frame_idx - 1, frame_ms, tracer->filepath
+    );
+    tracer->slowest_dumped_frame_ms = frame_ms;
+    tracer->dumped_slow_frame = true;
+    dump(tracer);
+}
+
+//
+// ===========================================================================================================
+//
+
+/// Writes `str` as the inside of a JSON string.
+static void writeJsonEscaped(FILE* file, const char* str) {
+
+    for (const char* c = str; *c != '\0'; c++)
+    {
+        if (*c == '"' or *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", (unsigned)*c);
+        else fputc(*c, file);
+    }
+}
+
+
+bool dump(Tracer* tracer) {
+
+    // the last `frame_count` frames, and the current one so far
+    const u64 slot_count = tracer->frame_count + 1;
+    const u64 first_frame_idx = tracer->frame_idx - math::min(tracer->frame_idx, (u64)tracer->frame_count);
+    const u64 window_begin_ns = tracer->frame_begins_ns[first_frame_idx % slot_count];
+
+    FILE* file = fopen(tracer->filepath, "w");
+    if (file == NULL)
+    {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            tracer->filepath, errno, strerror(errno)
+        );
+        return false;
+    }
+
+    const auto getTimestampUs = [&](u64 time_ns) { return 1e-3 * (f64)(time_ns - window_begin_ns); };
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first_event = true;
+    const auto beginEvent = [&]() {
+        if (!first_event) fprintf(file, ",\n");
+        first_event = false;
+    };
+
+    for (u64 frame_idx = first_frame_idx; frame_idx <= tracer->frame_idx; frame_idx++)
+    {
+        beginEvent();
+        fprintf(
+            file, "{\"name\":\"Frame %" PRIu64 "\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3lf,\"pid\":0,\"tid\":0}",
+            frame_idx, getTimestampUs(tracer->frame_begins_ns[frame_idx % slot_count])
+        );
+    }
+
+    // a copy of each ring, so that its thread can keep writing
+    Event* p_events = callocArray(tracer->events_per_thread, Event);
+    defer(free(p_events));
+
+    int result = pthread_mutex_lock(&tracer->mutex);
+    alwaysAssert(result == 0);
+
+    for (const ThreadRing* ring = tracer->rings; ring != NULL; ring = ring->next)
+    {
+        const u64 end = __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE);
+        u64 begin = end - math::min(end, (u64)tracer->events_per_thread);
+        for (u64 i = begin; i < end; i++) p_events[i - begin] = ring->events[i % tracer->events_per_thread];
+
+        // The events that the thread overwrote during the copy are torn, and so may be the one after them: the
+        // thread writes the slot of event `write_count` before it publishes `write_count + 1`.
+        const u64 end_after_copy = __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE) + 1;
+        const u64 overwritten_end = end_after_copy - math::min(end_after_copy, (u64)tracer->events_per_thread);
+        const u64 copy_begin = begin;
+        begin = math::max(begin, overwritten_end);
+
+        for (u64 i = begin; i < end; i++)
+        {
+            const Event* event = &p_events[i - copy_begin];
+            if (event->time_ns < window_begin_ns) continue;
+
+            beginEvent();
+            fprintf(file, (event->type == EVENT_GPU_TIME) ? "{\"name\":\"GPU ms: " : "{\"name\":\"");
+            writeJsonEscaped(file, event->name);
+            fprintf(file, "\"");
+
+            switch (event->type)
+            {
+                case EVENT_ZONE:
+                    fprintf(
+                        file, ",\"ph\":\"X\",\"ts\":%.3lf,\"dur\":%.3lf,\"pid\":0,\"tid\":%i}",
+                        getTimestampUs(event->time_ns), 1e-3 * (f64)(event->end_ns - event->time_ns),
+                        (int)ring->thread_id
+                    );
+                    break;
+                case EVENT_COUNTER:
+                case EVENT_GPU_TIME:
+                    fprintf(
+                        file, ",\"ph\":\"C\",\"ts\":%.3lf,\"pid\":0,\"args\":{\"value\":%.6g}}",
+                        getTimestampUs(event->time_ns), event->value
+                    );
+                    break;
+            }
+        }
+    }
+
+    result = pthread_mutex_unlock(&tracer->mutex);
+    alwaysAssert(result == 0);
+
+    fprintf(file, "\n]}\n");
+
+    const bool write_failed = ferror(file) != 0;
+    if (fclose(file) != 0 or write_failed)
+    {
+        LOG_F(ERROR, "Failed to write file `%s`; errno: `%i`.", tracer->filepath, errno);
+        return false;
+    }
+    return true;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
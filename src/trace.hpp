@@ -0,0 +1,133 @@
+#ifndef _TRACE_HPP
+#define _TRACE_HPP
+
+// #include <tracy/tracy/Tracy.hpp>
+// #include "types.hpp"
+
+/// A built-in tracer for the runs that no Tracy client can attach to, e.g. on batch nodes, where
+/// `TRACY_ON_DEMAND` records nothing. Each thread writes the zones that it ends to a ring of its own, without
+/// locks, and `FrameMark` ends a frame; a dump writes the zones of the last `CreateInfo::frame_count` frames in
+/// the Chrome trace event format (JSON), which chrome://tracing and ui.perfetto.dev open.
+///
+/// Including this after Tracy.hpp makes `ZoneScoped`, `ZoneScopedN`, `TracyPlot` and `FrameMark` record to the
+/// tracer too, so it sees the same zones as Tracy, and costs a call per zone while no tracer is set. Each module
+/// (the program, and each plugin, which compiles its own copy of trace.cpp) records to the tracer given to its
+/// own `setTracer()`; the fluid sim plugin's is its `setTracer` procedure.
+///
+/// Each zone has a level, and `ZONE_LEVEL` (`-DZONE_LEVEL=N`, from `ANGAME_ZONE_LEVEL` in the build scripts) is
+/// the finest level that gets compiled in; the zones past it are empty, so they cost nothing, in Tracy too:
+///  - `ZONE_LEVEL_FRAME`: `ZoneScopedFrame` and `ZoneScopedNFrame`, a few zones per frame.
+///  - `ZONE_LEVEL_STAGE`: `ZoneScoped` and `ZoneScopedN`, a zone per stage or pass.
+///  - `ZONE_LEVEL_TASK`: `ZoneScopedTask` and `ZoneScopedNTask`, the hot paths, e.g. a zone per thread pool task,
+///    or per sort of a task's range.
+/// `ZONE_LEVEL` 0 compiles none of them in. `TracyPlot` and `FrameMark` don't have a level. The zones of every
+/// level expand to `TRACE_ZONE_SCOPED` or `TRACE_ZONE_SCOPED_N`, so they nest in each other, at any level, as
+/// freely as Tracy's do.
+namespace trace {
+
+//
+// ===========================================================================================================
+//
+
+struct Tracer;
+
+struct CreateInfo {
+    const char* filepath; // where the dumps go; each replaces the previous one
+    u32 events_per_thread; // the size of each thread's ring; the oldest events are overwritten
+    u32 frame_count; // the frames that a dump covers
+    // A frame that takes longer than this, and longer than the slow frames dumped before it, dumps the frames up
+    // to it, so the file ends up with the slowest frame. 0 to only dump on `destroy()`.
+    f64 slow_frame_threshold_ms;
+};
+
+Tracer* create(const CreateInfo*);
+/// Dumps the last frames, unless a slow frame was dumped. No module may be recording to it anymore.
+void destroy(Tracer*);
+
+/// The tracer that this module records to, or NULL to record nothing.
+void setTracer(Tracer*);
+bool isTracing(void);
+
+/// `CLOCK_MONOTONIC`, in ns.
+u64 now(void);
+
+/// Records a zone of the calling thread. `name` must outlive the tracer, e.g. a string literal.
+void recordZone(const char* name, u64 begin_ns, u64 end_ns);
+/// Records a value to plot, like `TracyPlot`.
+void recordCounter(const char* name, f64 value);
+/// Records the GPU time of a pass, e.g. from `fluid_sim::getStageGpuTimes()`. The GPU's timestamps aren't on the
+/// host's clock, so the time is plotted like a counter, as "GPU ms: `name`", rather than drawn as a zone.
+void recordGpuTime(const char* name, f64 time_ns);
+/// Ends the frame; see `CreateInfo::slow_frame_threshold_ms`. Only one thread may mark the frames.
+void markFrame(void);
+
+/// Writes the zones of the last frames to `CreateInfo::filepath`. Returns false, and logs an error, on failure.
+bool dump(Tracer*);
+
+/// Records the zone from its construction to its destruction.
+struct Zone {
+    const char* name;
+    u64 begin_ns; // 0 if not tracing
+
+    Zone(const char* zone_name) : name(zone_name), begin_ns(isTracing() ? now() : 0) {}
+    ~Zone() { if (begin_ns != 0) recordZone(name, begin_ns, now()); }
+};
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#define ZONE_LEVEL_FRAME 1
+#define ZONE_LEVEL_STAGE 2
+#define ZONE_LEVEL_TASK 3
+#ifndef ZONE_LEVEL
+#   define ZONE_LEVEL ZONE_LEVEL_TASK
+#endif
+
+// The same zones as Tracy's; see above.
+#undef ZoneScoped
+#undef ZoneScopedN
+#undef TracyPlot
+#undef FrameMark
+// Each zone's locals get a name of their own, like Tracy's `ZoneNamed` source locations, so that zones may nest
+// without shadowing each other (-Wshadow).
+#define TRACE_CONCAT_INDIRECT(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INDIRECT(a, b)
+#define TRACE_ZONE_NAME(prefix) TRACE_CONCAT(prefix, __COUNTER__)
+#define TRACE_ZONE_SCOPED \
+    ZoneNamed(TRACE_ZONE_NAME(___tracy_scoped_zone_), true); trace::Zone TRACE_ZONE_NAME(___trace_zone_)(__func__)
+#define TRACE_ZONE_SCOPED_N(name) \
+    ZoneNamedN(TRACE_ZONE_NAME(___tracy_scoped_zone_), name, true); trace::Zone TRACE_ZONE_NAME(___trace_zone_)(name)
+#if ZONE_LEVEL >= ZONE_LEVEL_FRAME
+#   define ZoneScopedFrame TRACE_ZONE_SCOPED
+#   define ZoneScopedNFrame(name) TRACE_ZONE_SCOPED_N(name)
+#else
+#   define ZoneScopedFrame
+#   define ZoneScopedNFrame(name)
+#endif
+#if ZONE_LEVEL >= ZONE_LEVEL_STAGE
+#   define ZoneScoped TRACE_ZONE_SCOPED
+#   define ZoneScopedN(name) TRACE_ZONE_SCOPED_N(name)
+#else
+#   define ZoneScoped
+#   define ZoneScopedN(name)
+#endif
+#if ZONE_LEVEL >= ZONE_LEVEL_TASK
+#   define ZoneScopedTask TRACE_ZONE_SCOPED
+#   define ZoneScopedNTask(name) TRACE_ZONE_SCOPED_N(name)
+#else
+#   define ZoneScopedTask
+#   define ZoneScopedNTask(name)
+#endif
+#ifdef TRACY_ENABLE
+#   define TracyPlot(name, value) \
+        do { tracy::Profiler::PlotData(name, value); trace::recordCounter(name, (f64)(value)); } while (0)
+#   define FrameMark do { tracy::Profiler::SendFrameMark(nullptr); trace::markFrame(); } while (0)
+#else
+#   define TracyPlot(name, value) trace::recordCounter(name, (f64)(value))
+#   define FrameMark trace::markFrame()
+#endif
+
+#endif // include guard
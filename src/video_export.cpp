@@ -0,0 +1,197 @@
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+#include <VulkanMemoryAllocator/vk_mem_alloc.h>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "fence_waiter.hpp"
+#include "readback_ring.hpp"
+#include "video_export.hpp"
+
+namespace video_export {
+
+//
+// ===========================================================================================================
+//
+
+struct VideoExport {
+    const VulkanContext* vk_ctx;
+    CreateInfo info;
+    size_t frame_size; // bytes
+
+    FILE* file; // only used by the writer
+    readback_ring::Ring* ring;
+    u64 written_byte_count; // atomic; only the writer adds to it
+};
+
+//
+// ===========================================================================================================
+//
+
+/// `readback_ring::PFN_WriteFrame`.
+static bool writeFrame(void* p_user_data, u32 slot_idx, const void* p_data) {
+
+    ZoneScoped;
+
+    (void)slot_idx;
+    VideoExport* video_export = (VideoExport*)p_user_data;
+
+    const bool success = fwrite(p_data, video_export->frame_size, 1, video_export->file) == 1;
+    if (!success)
+    {
+        LOG_F(
+            ERROR, "Failed to write video file `%s`; errno: `%i`, description: `%s`.",
+            video_export->info.filepath, errno, strerror(errno)
+        );
+    }
+    else __atomic_add_fetch(&video_export->written_byte_count, video_export->frame_size, __ATOMIC_RELAXED);
+    return success;
+}
+
+//
+// ===========================================================================================================
+//
+
+VideoExport* create(
+    const VulkanContext* vk_ctx,
+    fence_waiter::FenceWaiter* fence_waiter,
+    const CreateInfo* info
+) {
+
+    ZoneScoped;
+
+    alwaysAssert(info->extent.width > 0 and info->extent.height > 0);
+    alwaysAssert(info->slot_count > 0);
+
+    FILE* file = fopen(info->filepath, "wb");
+    if (file == NULL)
+    {
+        LOG_F(
+            ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.",
+            info->filepath, errno, strerror(errno)
+        );
+        return NULL;
+    }
+
+    VideoExport* video_export = callocArray(1, VideoExport);
+    video_export->vk_ctx = vk_ctx;
+    video_export->info = *info;
+    video_export->frame_size = (size_t)BYTES_PER_TEXEL * info->extent.width * info->extent.height;
+    video_export->file = file;
+
+    const readback_ring::CreateInfo ring_info {
+        // the same queue as the renderer, whose barriers order the copies; see `gfx::getLastRenderedOffscreenImage()`
+        .queue_family_index = vk_ctx->queue_family_index,
+        .slot_size = video_export->frame_size,
+        .slot_count = info->slot_count,
+        .copy_finished_semaphores = false,
+        .p_write_frame = writeFrame,
+        .p_user_data = video_export,
+    };
+    video_export->ring = readback_ring::create(vk_ctx, fence_waiter, &ring_info);
+
+    LOG_F(
+        INFO,
+        "Exporting video to `%s`: %" PRIu32 "x%" PRIu32 ", slot_count=%u. Encode it with `ffmpeg -f rawvideo "
+        "-pixel_format bgra -video_size %" PRIu32 "x%" PRIu32 " -framerate 60 -i %s out.mp4`.",
+        info->filepath, info->extent.width, info->extent.height, info->slot_count,
+        info->extent.width, info->extent.height, info->filepath
+    );
+
+    return video_export;
+}
+
+
+void destroy(VideoExport* video_export) {
+
+    ZoneScoped;
+
+    // waits for the writer
+    const readback_ring::Stats ring_stats = readback_ring::destroy(video_export->ring);
+
+    if (fclose(video_export->file) != 0) LOG_F(ERROR, "Failed to close file `%s`.", video_export->info.filepath);
+
+    LOG_F(
+        INFO,
+        "Exported %" PRIu64 " frames to `%s`: %" PRIu64 " bytes. %" PRIu64 " frames waited for a slot.",
+        ring_stats.written_frame_count, video_export->info.filepath, video_export->written_byte_count,
+        ring_stats.stalled_frame_count
+    );
+    if (ring_stats.write_failed)
+    {
+        LOG_F(ERROR, "Some frames couldn't be written to `%s`.", video_export->info.filepath);
+    }
+
+    free(video_export);
+}
+
+
+void captureFrame(VideoExport* video_export, VkImage image) {
+
+    ZoneScoped;
+
+    const VulkanContext* vk_ctx = video_export->vk_ctx;
+
+    // Never dropped, as a video needs every frame. Only this thread stalls, so the count can't change in between.
+    const bool stalled_before = readback_ring::getStats(video_export->ring).stalled_frame_count > 0;
+    readback_ring::Slot slot {};
+    const bool acquired = readback_ring::beginFrame(video_export->ring, true, &slot);
+    alwaysAssert(acquired);
+
+    if (!stalled_before and readback_ring::getStats(video_export->ring).stalled_frame_count > 0)
+    {
+        LOG_F(WARNING, "Video export is waiting for the writer; it can't keep up with the renderer.");
+    }
+
+    // The renderer's last barrier made the image available to this, in this layout.
+    const VkBufferImageCopy region {
+        .bufferOffset = 0,
+        .bufferRowLength = 0, // tightly packed
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { video_export->info.extent.width, video_export->info.extent.height, 1 },
+    };
+    vk_ctx->procs_dev.CmdCopyImageToBuffer(
+        slot.command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.readback_buffer, 1, &region
+    );
+
+    const VkSubmitInfo submit_info { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    readback_ring::submitFrame(video_export->ring, &slot, vk_ctx->queue, submit_info, video_export->frame_size);
+}
+
+
+Stats getStats(VideoExport* video_export) {
+
+    const readback_ring::Stats ring_stats = readback_ring::getStats(video_export->ring);
+    return Stats {
+        .captured_frame_count = ring_stats.captured_frame_count,
+        .written_frame_count = ring_stats.written_frame_count,
+        .stalled_frame_count = ring_stats.stalled_frame_count,
+        .written_byte_count = __atomic_load_n(&video_export->written_byte_count, __ATOMIC_RELAXED),
+    };
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
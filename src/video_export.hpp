@@ -0,0 +1,61 @@
+#ifndef _VIDEO_EXPORT_HPP
+#define _VIDEO_EXPORT_HPP
+
+// #include <vulkan/vulkan.h>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+// #include "fence_waiter.hpp"
+
+/// Writes the frames that `gfx::render()` draws into an offscreen surface (see
+/// `gfx::createOffscreenSurfaceResources()`) to a file, without stalling the render loop on the readback: each frame
+/// is copied into a `readback_ring`, whose writer appends it to the file once the copy has finished. Unlike
+/// `frame_capture`, a frame is never dropped, as a video needs all of them: if every slot of the ring is still
+/// waiting to be written, `captureFrame()` waits for the oldest one, and counts it in `Stats::stalled_frame_count`.
+///
+/// The file is raw video, without a header: `4 * width * height` bytes per frame, of B8G8R8A8 (sRGB) texels, in rows
+/// from the top. E.g. `ffmpeg -f rawvideo -pixel_format bgra -video_size <width>x<height> -framerate 60 -i <file>
+/// out.mp4` encodes it.
+namespace video_export {
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 BYTES_PER_TEXEL = 4;
+
+struct CreateInfo {
+    const char* filepath; // created or truncated
+    VkExtent2D extent; // of the images that are captured
+    /// The slots of the readback ring; each is a whole image, `BYTES_PER_TEXEL * width * height` bytes.
+    u32 slot_count;
+};
+
+struct Stats {
+    u64 captured_frame_count; // including the ones that haven't been written yet
+    u64 written_frame_count;
+    u64 stalled_frame_count; // for which `captureFrame()` had to wait for a slot
+    u64 written_byte_count;
+};
+
+struct VideoExport;
+
+/// Logs an error and returns NULL if the file can't be created. `vk_ctx` and `fence_waiter` must outlive the
+/// export.
+VideoExport* create(const VulkanContext*, fence_waiter::FenceWaiter*, const CreateInfo* info);
+/// Waits for the frames that are left to be written, then closes the file and logs the `Stats`.
+void destroy(VideoExport*);
+
+/// Submits a copy of `image`, as `gfx::getLastRenderedOffscreenImage()` returns it, to `vk_ctx->queue`; so it must
+/// be called after the `gfx::render()` that drew it, and before the next one. Only waits for the disk if every slot
+/// is still waiting to be written.
+void captureFrame(VideoExport*, VkImage image);
+
+Stats getStats(VideoExport*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,72 @@
+#version 450
+
+layout(location = 0) out vec4 color_out_;
+
+// xyz is the position; w is the packed color
+layout(binding = 2, std430) readonly buffer Particles {
+    vec4 particles_[];
+};
+// Must match `VoxelQuad` in voxel_mesh.hpp; both phases of occlusion culling's, see voxel_cull.comp.
+layout(binding = 3, std430) readonly buffer VisibleQuads {
+    uvec4 visible_quads_[];
+};
+// The frame's visibility buffer, in its object id image; see `recordVisibilityBuffer()` in graphics.cpp. Must match
+// the OBJECT_ID_* bindings there.
+layout(binding = 34, r32ui) uniform readonly uimage2D visibility_ids_;
+
+// `FluidCompositePipelinePushConstants` in graphics.cpp, as fluid_composite.frag reads it; the texel scale at its end
+// isn't read.
+layout(push_constant, std140) uniform PushConstants {
+    mat4 world_to_screen_transform_inverse_;
+    vec3 camera_position_;
+    float particle_radius_;
+    vec2 viewport_offset_in_window_;
+    vec2 viewport_size_in_window_;
+};
+
+// Must match the `VISIBILITY_VOXEL_BIT` constant in graphics.cpp, and visibility_voxel.frag.
+#define VISIBILITY_VOXEL_BIT 0x80000000u
+
+/// The unit direction from the camera through `window_coord`, in pixels like gl_FragCoord; as in fluid_composite.frag.
+vec3 rayDirection(vec2 window_coord) {
+
+    // [-1, 1] over the viewport; the y-axis flip is done by the transform
+    const vec2 f = 2.0f * (window_coord - viewport_offset_in_window_) / viewport_size_in_window_ - 1.0f;
+
+    const vec4 pn = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 0.0f, 1.0f);
+    const vec4 pf = world_to_screen_transform_inverse_ * vec4(f.x, f.y, 1.0f, 1.0f);
+    return normalize(pf.xyz / pf.w - pn.xyz / pn.w);
+}
+
+// Shades each pixel of the visibility buffer once, from the id of what's nearest in it: a voxel quad's flat color, as
+// voxel.frag draws it, or a particle's sphere, lit as particle_rasterize.frag does, from the ray through the pixel's
+// center. The depth was left in the depth buffer by the visibility pass, so this writes none; the pixels without an
+// id keep the clear color.
+void main(void) {
+
+    const uint id = imageLoad(visibility_ids_, ivec2(gl_FragCoord.xy)).x;
+    if (id == 0u) discard;
+
+    if ((id & VISIBILITY_VOXEL_BIT) != 0u) {
+        color_out_ = unpackUnorm4x8(visible_quads_[id & ~VISIBILITY_VOXEL_BIT].w);
+        return;
+    }
+
+    const vec4 particle = particles_[id - 1u];
+    const vec4 color = unpackUnorm4x8(floatBitsToUint(particle.w));
+
+    // the nearer root of |camera + t * direction - center| = r; the ray grazes the sphere at worst, as the pixel was
+    // covered by its ray cast in object_id_particle.frag
+    const float r = particle_radius_;
+    const vec3 ray_direction_unit = rayDirection(gl_FragCoord.xy);
+    const vec3 to_center = particle.xyz - camera_position_;
+    const float b = dot(ray_direction_unit, to_center);
+    const float discriminant = max(b * b - (dot(to_center, to_center) - r * r), 0.0f);
+    const float t = b - sqrt(discriminant);
+
+    const vec3 hit = camera_position_ + t * ray_direction_unit;
+    const vec3 normal_unit = normalize(hit - particle.xyz);
+
+    const float diffuse = max(dot(normal_unit, normalize(vec3(1.0f))), 0.0f);
+    color_out_ = vec4(color.rgb * (0.3f + 0.7f * diffuse), color.a);
+}
@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 3) flat in uint quad_idx_in_;
+
+layout(location = 0) out uint visibility_id_out_;
+
+// Must match the `VISIBILITY_VOXEL_BIT` constant in graphics.cpp, and visibility_shade.frag.
+#define VISIBILITY_VOXEL_BIT 0x80000000u
+
+// The visibility id of the voxel quad under the fragment, for `recordVisibilityBuffer()` in graphics.cpp:
+// `VISIBILITY_VOXEL_BIT`, then the quad's index in the frame's visible voxels, which visibility_shade.frag reads it
+// back from. The instance index counts from the draw's first instance, so the second phase of occlusion culling's
+// quads, which are after the first's, have their own indices.
+void main(void) {
+    visibility_id_out_ = VISIBILITY_VOXEL_BIT | quad_idx_in_;
+}
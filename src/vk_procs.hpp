@@ -16,10 +16,12 @@
 
 #define FOR_EACH_VK_INSTANCE_PROC(X) \
     X(CreateDevice) \
+    X(EnumerateDeviceExtensionProperties) \
     X(EnumeratePhysicalDevices) \
     X(GetDeviceProcAddr) \
     X(GetPhysicalDeviceFeatures2) \
     X(GetPhysicalDeviceProperties) \
+    X(GetPhysicalDeviceProperties2) \
     X(GetPhysicalDeviceQueueFamilyProperties) \
     X(GetPhysicalDeviceSurfaceCapabilitiesKHR) \
     X(GetPhysicalDeviceSurfacePresentModesKHR)
@@ -37,13 +39,20 @@
     X(CmdCopyBuffer) \
     X(CmdCopyImage) \
     X(CmdDispatch) \
+    X(CmdDispatchIndirect) \
     X(CmdDraw) \
     X(CmdDrawIndexed) \
+    X(CmdDrawIndirect) \
     X(CmdEndRendering) \
+    X(CmdFillBuffer) \
     X(CmdPipelineBarrier) \
+    X(CmdPipelineBarrier2) \
     X(CmdPushConstants) \
+    X(CmdResetQueryPool) \
     X(CmdSetScissor) \
     X(CmdSetViewport) \
+    X(CmdUpdateBuffer) \
+    X(CmdWriteTimestamp) \
     X(CreateCommandPool) \
     X(CreateComputePipelines) \
     X(CreateDescriptorPool) \
@@ -51,7 +60,10 @@
     X(CreateFence) \
     X(CreateGraphicsPipelines) \
     X(CreateImageView) \
+    X(CreatePipelineCache) \
     X(CreatePipelineLayout) \
+    X(CreateQueryPool) \
+    X(CreateSampler) \
     X(CreateSemaphore) \
     X(CreateShaderModule) \
     X(CreateSwapchainKHR) \
@@ -62,6 +74,7 @@
     X(DestroyImageView) \
     X(DestroyPipeline) \
     X(DestroyPipelineLayout) \
+    X(DestroyQueryPool) \
     X(DestroySemaphore) \
     X(DestroyShaderModule) \
     X(DestroySwapchainKHR) \
@@ -71,6 +84,9 @@
     X(FreeDescriptorSets) \
     X(GetDeviceQueue) \
     X(GetFenceStatus) \
+    X(GetPipelineCacheData) \
+    X(GetQueryPoolResults) \
+    X(GetSemaphoreCounterValue) \
     X(GetSwapchainImagesKHR) \
     X(MapMemory) \
     X(QueuePresentKHR) \
@@ -81,7 +97,8 @@
     X(ResetFences) \
     X(UnmapMemory) \
     X(UpdateDescriptorSets) \
-    X(WaitForFences)
+    X(WaitForFences) \
+    X(WaitSemaphores)
 
 //
 // ===========================================================================================================
@@ -1,9 +1,15 @@
 #version 450
 
-layout(location = 0) in ivec3 voxel_coord_indexspace_;
+// A quad of the voxel mesh per instance. Must match `VoxelQuad` in voxel_mesh.hpp.
+layout(location = 0) in uvec3 packed_;
 layout(location = 1) in vec4 in_color_;
 
 layout(location = 0) out vec4 out_color_;
+// for object_id_voxel.frag: the quad as is, and the position in it, in voxels from its first voxel's corner
+layout(location = 1) flat out uvec3 out_packed_;
+layout(location = 2) out vec2 out_quad_coord_;
+// for visibility_voxel.frag: the quad's index in the instance buffer
+layout(location = 3) flat out uint out_quad_idx_;
 
 layout(binding = 0, std140) uniform Uniforms {
     mat4 world_to_screen_transform_;
@@ -12,48 +18,40 @@ layout(binding = 0, std140) uniform Uniforms {
 layout(constant_id = 0) const float CUBE_RADIUS = 0.5;
 #define CUBE_DIAMETER (2.0f * CUBE_RADIUS)
 
-const vec3 CUBE_VERTICES[8] = {
-    { -1.0f, -1.0f,  1.0f },
-    {  1.0f, -1.0f,  1.0f },
-    { -1.0f,  1.0f,  1.0f },
-    {  1.0f,  1.0f,  1.0f },
-    { -1.0f, -1.0f, -1.0f },
-    {  1.0f, -1.0f, -1.0f },
-    { -1.0f,  1.0f, -1.0f },
-    {  1.0f,  1.0f, -1.0f },
-};
-
-const uint TRIANGLES_VERTEX_INDICES[36] = {
-    // back face
-    1, 2, 0,
-    1, 3, 2,
-    // front face
-    5, 4, 6,
-    5, 6, 7,
-    // left face
-    0, 2, 6,
-    0, 6, 4,
-    // right face
-    1, 5, 7,
-    1, 7, 3,
-    // top face
-    1, 0, 4,
-    1, 4, 5,
-    // bottom face
-    7, 6, 2,
-    7, 2, 3,
+// The quad's corners as (u, v), in two triangles; counterclockwise seen from the side that they face, for the quads
+// that face towards +axis.
+const vec2 QUAD_CORNERS[6] = {
+    { 0.0f, 0.0f },
+    { 1.0f, 0.0f },
+    { 1.0f, 1.0f },
+    { 0.0f, 0.0f },
+    { 1.0f, 1.0f },
+    { 0.0f, 1.0f },
 };
 
 void main(void) {
 
-    const uint cube_vertex_idx = TRIANGLES_VERTEX_INDICES[gl_VertexIndex];
-    vec4 vertex_pos = vec4(CUBE_RADIUS * CUBE_VERTICES[cube_vertex_idx], 1.0);
+    const ivec3 first_voxel = bitfieldExtract(ivec3(packed_), 0, 24); // sign-extended
+    const uint direction = packed_.x >> 24;
+    const uvec2 size = uvec2(packed_.y >> 24, packed_.z >> 24);
+    const uint axis = direction >> 1;
+    const bool towards_negative = (direction & 1) != 0;
+
+    vec2 corner = QUAD_CORNERS[gl_VertexIndex];
+    // mirrored, so that those wind the other way
+    if (towards_negative) corner.x = 1.0f - corner.x;
 
-    vec3 voxel_coord_worldspace = vec3(voxel_coord_indexspace_) * CUBE_DIAMETER;
-    vertex_pos.xyz = vertex_pos.xyz + voxel_coord_worldspace;
-    vertex_pos = world_to_screen_transform_ * vertex_pos;
+    // in voxels, from the center of the first voxel
+    vec3 offset;
+    offset[axis] = towards_negative ? -0.5f : 0.5f;
+    offset[(axis + 1) % 3] = corner.x * float(size.x) - 0.5f;
+    offset[(axis + 2) % 3] = corner.y * float(size.y) - 0.5f;
 
-    gl_Position = vertex_pos;
+    const vec3 vertex_pos_worldspace = (vec3(first_voxel) + offset) * CUBE_DIAMETER;
+
+    gl_Position = world_to_screen_transform_ * vec4(vertex_pos_worldspace, 1.0f);
     out_color_ = in_color_;
+    out_packed_ = packed_;
+    out_quad_coord_ = corner * vec2(size);
+    out_quad_idx_ = gl_InstanceIndex;
 }
-
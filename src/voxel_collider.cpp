@@ -0,0 +1,388 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <loguru/loguru.hpp>
+#include <glm/glm.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "defer.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "file_watch.hpp"
+#include "sort.hpp"
+#include "graphics.hpp"
+#include "voxel_store.hpp"
+#include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
+#include "../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+#include "voxel_collider.hpp"
+
+namespace voxel_collider {
+
+namespace gfx = graphics;
+using fluid_sim::ColliderBrick;
+using fluid_sim::COLLIDER_BRICK_SIZE;
+using fluid_sim::COLLIDER_BRICK_SIZE_LOG2;
+using fluid_sim::COLLIDER_BRICK_SAMPLES_PER_AXIS;
+
+//
+// ===========================================================================================================
+//
+
+// In units of CELL_SIZE, voxel c spans the samples [2c - 1, 2c + 1], and brick b has the samples [8b, 8b + 8].
+static_assert(CELL_SIZE == 0.5f * gfx::VOXEL_DIAMETER);
+constexpr i32 BAND_WIDTH_IN_CELLS = 2;
+static_assert(BAND_WIDTH == BAND_WIDTH_IN_CELLS * CELL_SIZE);
+
+// The voxels that the samples of brick b are within the band of: [4b - 1, 4b + 5] per axis.
+constexpr i32 BRICK_VOXEL_SPAN = (i32)COLLIDER_BRICK_SIZE / 2 + 3;
+
+// The bricks are built and uploaded this many at a time, to bound the host memory.
+constexpr u32 UPLOAD_BATCH_BRICK_COUNT = 256;
+
+struct VoxelCollider {
+    const gfx::VoxelStore* voxel_store;
+    ivec3 region_min;
+    ivec3 region_max;
+    // The chunks that overlap the region, and their `gfx::VoxelChunk::edit_count` as of the last upload; 0 if never,
+    // as a chunk is only created by an edit.
+    ArrayList<u32> chunk_indices;
+    ArrayList<u32> chunk_edit_counts;
+    u32 seen_chunk_count; // the store's chunks from here on haven't been looked at
+};
+
+//
+// ===========================================================================================================
+//
+
+static inline bool isInRegion(const VoxelCollider* collider, ivec3 voxel_coord) {
+    return
+        glm::all(glm::greaterThanEqual(voxel_coord, collider->region_min)) and
+        glm::all(glm::lessThanEqual(voxel_coord, collider->region_max));
+}
+
+
+/// The bricks whose samples are within the band of the voxel, inclusive.
+static inline void getVoxelBrickRange(ivec3 voxel_coord, ivec3* min_out, ivec3* max_out) {
+    *min_out = (2 * voxel_coord - 1 - BAND_WIDTH_IN_CELLS - 1) >> (i32)COLLIDER_BRICK_SIZE_LOG2;
+    *max_out = (2 * voxel_coord + 1 + BAND_WIDTH_IN_CELLS) >> (i32)COLLIDER_BRICK_SIZE_LOG2;
+}
+
+
+static bool chunkOverlapsRegion(const VoxelCollider* collider, u32 chunk_idx) {
+
+    const ivec3 first_voxel = gfx::getVoxelChunk(collider->voxel_store, chunk_idx).coord * (i32)gfx::VOXEL_CHUNK_SIZE;
+    const ivec3 last_voxel = first_voxel + (i32)(gfx::VOXEL_CHUNK_SIZE - 1);
+    return
+        glm::all(glm::lessThanEqual(first_voxel, collider->region_max)) and
+        glm::all(glm::greaterThanEqual(last_voxel, collider->region_min));
+}
+
+
+/// Adds the store's chunks that it has gained since the last call, and that overlap the region, as never uploaded.
+static void addNewChunks(VoxelCollider* collider) {
+
+    const u32 chunk_count = gfx::getVoxelChunkCount(collider->voxel_store);
+    for (u32 chunk_idx = collider->seen_chunk_count; chunk_idx < chunk_count; chunk_idx++) {
+
+        if (!chunkOverlapsRegion(collider, chunk_idx)) continue;
+
+        collider->chunk_indices.push(chunk_idx);
+        collider->chunk_edit_counts.push(0);
+    }
+    collider->seen_chunk_count = chunk_count;
+}
+
+
+/// Adds the bricks that the chunk's voxels in the region need, with duplicates.
+static void collectChunkVoxelBricks(const VoxelCollider* collider, u32 chunk_idx, ArrayList<ivec3>* p_bricks) {
+
+    const gfx::VoxelChunk chunk = gfx::getVoxelChunk(collider->voxel_store, chunk_idx);
+    for (u32 voxel_idx = 0; voxel_idx < chunk.voxel_count; voxel_idx++) {
+
+        const ivec3 voxel_coord = chunk.p_voxels[voxel_idx].coord;
+        if (!isInRegion(collider, voxel_coord)) continue;
+
+        ivec3 brick_min, brick_max;
+        getVoxelBrickRange(voxel_coord, &brick_min, &brick_max);
+        for (i32 z = brick_min.z; z <= brick_max.z; z++) {
+            for (i32 y = brick_min.y; y <= brick_max.y; y++) {
+                for (i32 x = brick_min.x; x <= brick_max.x; x++) p_bricks->push(ivec3(x, y, z));
+            }
+        }
+    }
+}
+
+
+static int compareCoords(const void* p_a, const void* p_b) {
+
+    const ivec3 a = *(const ivec3*)p_a;
+    const ivec3 b = *(const ivec3*)p_b;
+
+    for (i32 axis = 2; axis >= 0; axis--) {
+        if (a[axis] != b[axis]) return (a[axis] < b[axis]) ? -1 : 1;
+    }
+    return 0;
+}
+
+
+static void sortAndRemoveDuplicates(ArrayList<ivec3>* p_coords) {
+
+    if (p_coords->size == 0) return;
+    qsort(p_coords->ptr, p_coords->size, sizeof(ivec3), compareCoords);
+
+    u32 unique_count = 1;
+    for (u32 i = 1; i < p_coords->size; i++) {
+        if (p_coords->ptr[i] != p_coords->ptr[unique_count - 1]) p_coords->ptr[unique_count++] = p_coords->ptr[i];
+    }
+    p_coords->size = unique_count;
+}
+
+
+/// Returns false, and leaves `*p_brick` alone, if no voxel is near enough for the brick to be needed.
+static bool buildBrick(const VoxelCollider* collider, ivec3 brick_coord, ColliderBrick* p_brick) {
+
+    // the voxels that the samples depend on, with those outside the region empty
+    bool p_occupied[BRICK_VOXEL_SPAN * BRICK_VOXEL_SPAN * BRICK_VOXEL_SPAN];
+    const ivec3 first_voxel = brick_coord * (i32)(COLLIDER_BRICK_SIZE / 2) - 1;
+    bool any_occupied = false;
+    {
+        u32 idx = 0;
+        for (i32 z = 0; z < BRICK_VOXEL_SPAN; z++) {
+            for (i32 y = 0; y < BRICK_VOXEL_SPAN; y++) {
+                for (i32 x = 0; x < BRICK_VOXEL_SPAN; x++) {
+                    const ivec3 voxel_coord = first_voxel + ivec3(x, y, z);
+                    const bool occupied =
+                        isInRegion(collider, voxel_coord) and gfx::findVoxel(collider->voxel_store, voxel_coord, NULL);
+                    p_occupied[idx++] = occupied;
+                    any_occupied = any_occupied or occupied;
+                }
+            }
+        }
+    }
+    if (!any_occupied) return false;
+
+    // Each sample's distance is to the nearest box of an occupied voxel, or, inside, to the nearest box of an empty
+    // one; in units of CELL_SIZE, squared, and capped just past the band.
+    constexpr i32 BEYOND_BAND_SQ = BAND_WIDTH_IN_CELLS * BAND_WIDTH_IN_CELLS + 1;
+
+    p_brick->coord = brick_coord;
+    const ivec3 first_sample = brick_coord * (i32)COLLIDER_BRICK_SIZE;
+    u32 sample_idx = 0;
+    for (i32 z = 0; z < (i32)COLLIDER_BRICK_SAMPLES_PER_AXIS; z++) {
+        for (i32 y = 0; y < (i32)COLLIDER_BRICK_SAMPLES_PER_AXIS; y++) {
+            for (i32 x = 0; x < (i32)COLLIDER_BRICK_SAMPLES_PER_AXIS; x++) {
+
+                const ivec3 sample = first_sample + ivec3(x, y, z);
+                // the voxels within the band of the sample
+                const ivec3 candidate_min = (sample - BAND_WIDTH_IN_CELLS) >> 1;
+                const ivec3 candidate_max = (sample + BAND_WIDTH_IN_CELLS + 1) >> 1;
+
+                i32 occupied_distance_sq = BEYOND_BAND_SQ;
+                i32 empty_distance_sq = BEYOND_BAND_SQ;
+                // whether each voxel whose box has the sample is occupied
+                bool inside = true;
+
+                for (i32 cz = candidate_min.z; cz <= candidate_max.z; cz++) {
+                    for (i32 cy = candidate_min.y; cy <= candidate_max.y; cy++) {
+                        for (i32 cx = candidate_min.x; cx <= candidate_max.x; cx++) {
+
+                            const ivec3 voxel_coord = ivec3(cx, cy, cz);
+                            const ivec3 offset = glm::max(glm::abs(sample - 2 * voxel_coord) - 1, 0);
+                            const i32 distance_sq = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+
+                            const ivec3 local = voxel_coord - first_voxel;
+                            const u32 local_idx =
+                                (u32)(local.x + BRICK_VOXEL_SPAN * (local.y + BRICK_VOXEL_SPAN * local.z));
+                            if (p_occupied[local_idx]) {
+                                occupied_distance_sq = glm::min(occupied_distance_sq, distance_sq);
+                            } else {
+                                empty_distance_sq = glm::min(empty_distance_sq, distance_sq);
+                                if (distance_sq == 0) inside = false;
+                            }
+                        }
+                    }
+                }
+
+                const f32 distance = inside ? -sqrtf((f32)empty_distance_sq) : sqrtf((f32)occupied_distance_sq);
+                p_brick->distances[sample_idx++] = glm::clamp(distance * CELL_SIZE, -BAND_WIDTH, BAND_WIDTH);
+            }
+        }
+    }
+    return true;
+}
+
+
+/// Builds the bricks at `p_coords` and uploads them, in batches; those that aren't needed are removed instead.
+static bool uploadBricks(
+    const VoxelCollider* collider,
+    const fluid_sim::FluidSimProcs* procs,
+    fluid_sim::SimData* p_sim,
+    const VulkanContext* vk_ctx,
+    const ArrayList<ivec3>* p_coords
+) {
+
+    ZoneScoped;
+
+    ColliderBrick* p_bricks = mallocArray(UPLOAD_BATCH_BRICK_COUNT, ColliderBrick);
+    defer(free(p_bricks));
+    ArrayList<ivec3> removed_coords = ArrayList<ivec3>::withCapacity(UPLOAD_BATCH_BRICK_COUNT);
+    defer(removed_coords.free());
+
+    bool success = true;
+    for (u32 batch_start = 0; batch_start < p_coords->size; batch_start += UPLOAD_BATCH_BRICK_COUNT) {
+
+        const u32 batch_end = glm::min(batch_start + UPLOAD_BATCH_BRICK_COUNT, p_coords->size);
+
+        u32 brick_count = 0;
+        removed_coords.resetSize();
+        for (u32 i = batch_start; i < batch_end; i++) {
+            const ivec3 coord = p_coords->ptr[i];
+            if (buildBrick(collider, coord, &p_bricks[brick_count])) brick_count++;
+            else removed_coords.push(coord);
+        }
+
+        const bool uploaded = procs->updateColliderBricks(
+            p_sim, vk_ctx, brick_count, p_bricks, removed_coords.size, removed_coords.ptr
+        );
+        if (!uploaded) success = false;
+    }
+    return success;
+}
+
+//
+// ===========================================================================================================
+//
+
+extern VoxelCollider* create(const gfx::VoxelStore* voxel_store, ivec3 region_min, ivec3 region_max) {
+
+    alwaysAssert(glm::all(glm::lessThanEqual(region_min, region_max)));
+
+    VoxelCollider* collider = mallocArray(1, VoxelCollider);
+    *collider = VoxelCollider {
+        .voxel_store = voxel_store,
+        .region_min = region_min,
+        .region_max = region_max,
+        .chunk_indices = ArrayList<u32>::create(),
+        .chunk_edit_counts = ArrayList<u32>::create(),
+        .seen_chunk_count = 0,
+    };
+    addNewChunks(collider);
+    return collider;
+}
+
+
+extern void destroy(VoxelCollider* collider) {
+    collider->chunk_indices.free();
+    collider->chunk_edit_counts.free();
+    free(collider);
+}
+
+
+extern u32 countBricks(const VoxelCollider* collider) {
+
+    ArrayList<ivec3> coords = ArrayList<ivec3>::create();
+    defer(coords.free());
+
+    for (u32 i = 0; i < collider->chunk_indices.size; i++) {
+        collectChunkVoxelBricks(collider, collider->chunk_indices.ptr[i], &coords);
+    }
+    sortAndRemoveDuplicates(&coords);
+    return coords.size;
+}
+
+
+extern bool uploadAll(
+    VoxelCollider* collider,
+    const fluid_sim::FluidSimProcs* procs,
+    fluid_sim::SimData* p_sim,
+    const VulkanContext* vk_ctx
+) {
+
+    ZoneScoped;
+
+    addNewChunks(collider);
+
+    ArrayList<ivec3> coords = ArrayList<ivec3>::create();
+    defer(coords.free());
+
+    for (u32 i = 0; i < collider->chunk_indices.size; i++) {
+        const u32 chunk_idx = collider->chunk_indices.ptr[i];
+        collectChunkVoxelBricks(collider, chunk_idx, &coords);
+        collider->chunk_edit_counts.ptr[i] = gfx::getVoxelChunk(collider->voxel_store, chunk_idx).edit_count;
+    }
+    sortAndRemoveDuplicates(&coords);
+
+    const bool success = uploadBricks(collider, procs, p_sim, vk_ctx, &coords);
+    LOG_IF_F(ERROR, !success, "Not all of the %u collider bricks of the voxels fit.", coords.size);
+    return success;
+}
+
+
+extern bool hasEdits(const VoxelCollider* collider) {
+
+    for (u32 i = 0; i < collider->chunk_indices.size; i++) {
+        const u32 edit_count = gfx::getVoxelChunk(collider->voxel_store, collider->chunk_indices.ptr[i]).edit_count;
+        if (edit_count != collider->chunk_edit_counts.ptr[i]) return true;
+    }
+
+    // a new chunk in the region
+    const u32 chunk_count = gfx::getVoxelChunkCount(collider->voxel_store);
+    for (u32 chunk_idx = collider->seen_chunk_count; chunk_idx < chunk_count; chunk_idx++) {
+        if (chunkOverlapsRegion(collider, chunk_idx)) return true;
+    }
+    return false;
+}
+
+
+extern bool uploadEdits(
+    VoxelCollider* collider,
+    const fluid_sim::FluidSimProcs* procs,
+    fluid_sim::SimData* p_sim,
+    const VulkanContext* vk_ctx
+) {
+
+    ZoneScoped;
+
+    addNewChunks(collider);
+
+    // Every brick within the band of the edited chunks' cells, whether or not their voxels need it now, so that
+    // those that no longer do are removed.
+    ArrayList<ivec3> coords = ArrayList<ivec3>::create();
+    defer(coords.free());
+
+    for (u32 i = 0; i < collider->chunk_indices.size; i++) {
+
+        const gfx::VoxelChunk chunk = gfx::getVoxelChunk(collider->voxel_store, collider->chunk_indices.ptr[i]);
+        if (chunk.edit_count == collider->chunk_edit_counts.ptr[i]) continue;
+        collider->chunk_edit_counts.ptr[i] = chunk.edit_count;
+
+        const ivec3 first_voxel = chunk.coord * (i32)gfx::VOXEL_CHUNK_SIZE;
+        ivec3 brick_min, unused, brick_max;
+        getVoxelBrickRange(first_voxel, &brick_min, &unused);
+        getVoxelBrickRange(first_voxel + (i32)(gfx::VOXEL_CHUNK_SIZE - 1), &unused, &brick_max);
+
+        for (i32 z = brick_min.z; z <= brick_max.z; z++) {
+            for (i32 y = brick_min.y; y <= brick_max.y; y++) {
+                for (i32 x = brick_min.x; x <= brick_max.x; x++) coords.push(ivec3(x, y, z));
+            }
+        }
+    }
+    sortAndRemoveDuplicates(&coords);
+
+    const bool success = uploadBricks(collider, procs, p_sim, vk_ctx, &coords);
+    LOG_IF_F(ERROR, !success, "The collider bricks of the edited voxels don't fit; the collider is out of date.");
+    return success;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
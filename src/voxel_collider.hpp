@@ -0,0 +1,56 @@
+#ifndef _VOXEL_COLLIDER_HPP
+#define _VOXEL_COLLIDER_HPP
+
+// #include <vulkan/vulkan.h>
+// #include <glm/glm.hpp>
+// #include "types.hpp"
+// #include "vulkan_context.hpp"
+// #include "graphics.hpp"
+// #include "voxel_store.hpp"
+// #include "../plugins_src/fluid_sim/fluid_sim_types.hpp"
+// #include "../build/A_generatePluginHeaders/fluid_sim/plugin_fluid_sim.hpp"
+
+/// Turns the voxels of a `graphics::VoxelStore` into the fluid sim's collider: a signed distance field, in the
+/// bricks that `fluid_sim::updateColliderBricks()` takes. The field is exact within a band of `BAND_WIDTH` around
+/// the voxels' surface, and clamped to it beyond that. Only the voxels in a region are voxelized, to bound the
+/// memory; the others are treated as empty. After an edit, only the bricks around the edited chunks are rebuilt.
+namespace voxel_collider {
+
+//
+// ===========================================================================================================
+//
+
+/// Half a voxel, so that a lone voxel has a sample at its center, inside it. Pass this as
+/// `fluid_sim::SimParameters::collider_cell_size`.
+constexpr f32 CELL_SIZE = 0.5f * graphics::VOXEL_DIAMETER;
+constexpr f32 BAND_WIDTH = 2.0f * CELL_SIZE;
+
+struct VoxelCollider;
+
+/// The region is in voxel coordinates, inclusive. Records the store's current voxels as the uploaded ones; call
+/// `uploadAll()` to upload them. The store must outlive the collider.
+VoxelCollider* create(const graphics::VoxelStore*, ivec3 region_min, ivec3 region_max);
+void destroy(VoxelCollider*);
+
+/// The number of bricks that the region's voxels need at the moment; for
+/// `fluid_sim::SimParameters::collider_brick_capacity`, which should leave room for the edits.
+u32 countBricks(const VoxelCollider*);
+
+/// Uploads every brick, for a sim that was just created. With the sim's lock (see `sim_thread::lock()`). Returns
+/// false if they didn't all fit.
+bool uploadAll(VoxelCollider*, const fluid_sim::FluidSimProcs*, fluid_sim::SimData*, const VulkanContext*);
+
+/// Whether any of the region's chunks was edited since the last upload; cheap enough to call every frame.
+bool hasEdits(const VoxelCollider*);
+/// Rebuilds and uploads the bricks around the edited chunks, and removes those that no longer have voxels nearby.
+/// With the sim's lock. Returns false if the new bricks didn't fit; the edits count as uploaded either way, so that
+/// a failure isn't retried every frame.
+bool uploadEdits(VoxelCollider*, const fluid_sim::FluidSimProcs*, fluid_sim::SimData*, const VulkanContext*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,229 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "defer.hpp"
+#include "file_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "graphics.hpp"
+#include "voxel_store.hpp"
+#include "voxel_file.hpp"
+
+namespace voxel_file {
+
+namespace gfx = graphics;
+
+//
+// ===========================================================================================================
+//
+
+constexpr char MAGIC[8] = { 'V', 'O', 'X', 'W', 'O', 'R', 'L', 'D' };
+constexpr u32 VERSION = 1;
+
+constexpr u32 CHUNK_CELL_COUNT = gfx::VOXEL_CHUNK_SIZE * gfx::VOXEL_CHUNK_SIZE * gfx::VOXEL_CHUNK_SIZE;
+constexpr i32 CHUNK_COORD_LIMIT = gfx::VOXEL_COORD_LIMIT >> gfx::VOXEL_CHUNK_SIZE_LOG2;
+
+struct Header {
+    char magic[8];
+    u32 version;
+    u32 chunk_count;
+    u64 voxel_count;
+};
+static_assert(sizeof(Header) == 24);
+
+/// An entry of the chunk table, which follows the header. The chunk's voxels are at `voxel_offset` bytes into the
+/// file, a multiple of 4: `voxel_count` colors, as `u8vec4`, then as many cell indices in the chunk, as `u16`.
+struct ChunkEntry {
+    ivec3 coord;
+    u32 voxel_count; // in [1, CHUNK_CELL_COUNT]
+    u64 voxel_offset;
+};
+static_assert(sizeof(ChunkEntry) == 24);
+
+constexpr u64 VOXEL_SIZE = sizeof(u32) + sizeof(u16);
+
+
+static inline u64 chunkDataSize(u32 voxel_count) {
+    return (VOXEL_SIZE * voxel_count + 3) & ~(u64)3;
+}
+
+//
+// ===========================================================================================================
+//
+
+extern bool save(const char* filepath, const gfx::VoxelStore* store) {
+
+    ZoneScoped;
+
+    const u32 store_chunk_count = gfx::getVoxelChunkCount(store);
+    u32 chunk_count = 0;
+    u64 file_size = sizeof(Header);
+    for (u32 i = 0; i < store_chunk_count; i++) {
+        const u32 voxel_count = gfx::getVoxelChunk(store, i).voxel_count;
+        if (voxel_count == 0) continue;
+        chunk_count++;
+        file_size += sizeof(ChunkEntry) + chunkDataSize(voxel_count);
+    }
+
+    u8* p_file = (u8*)calloc(file_size, 1);
+    assertErrno(p_file != NULL);
+    defer(free(p_file));
+
+    Header header { .version = VERSION, .chunk_count = chunk_count, .voxel_count = 0 };
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+
+    u64 entry_offset = sizeof(Header);
+    u64 voxel_offset = sizeof(Header) + (u64)chunk_count * sizeof(ChunkEntry);
+    for (u32 i = 0; i < store_chunk_count; i++) {
+        const gfx::VoxelChunk chunk = gfx::getVoxelChunk(store, i);
+        if (chunk.voxel_count == 0) continue;
+
+        const ChunkEntry entry {
+            .coord = chunk.coord,
+            .voxel_count = chunk.voxel_count,
+            .voxel_offset = voxel_offset,
+        };
+        memcpy(&p_file[entry_offset], &entry, sizeof(entry));
+        entry_offset += sizeof(entry);
+
+        u8* p_colors = &p_file[voxel_offset];
+        u8* p_cells = &p_colors[sizeof(u32) * chunk.voxel_count];
+        for (u32 v = 0; v < chunk.voxel_count; v++) {
+            const gfx::Voxel voxel = chunk.p_voxels[v];
+            const ivec3 c = voxel.coord & (i32)(gfx::VOXEL_CHUNK_SIZE - 1);
+            const u16 cell_idx = (u16)(c.x + gfx::VOXEL_CHUNK_SIZE * (c.y + gfx::VOXEL_CHUNK_SIZE * c.z));
+            memcpy(&p_colors[sizeof(u32) * v], &voxel.color, sizeof(u32));
+            memcpy(&p_cells[sizeof(u16) * v], &cell_idx, sizeof(u16));
+        }
+        voxel_offset += chunkDataSize(chunk.voxel_count);
+        header.voxel_count += chunk.voxel_count;
+    }
+    alwaysAssert(voxel_offset == file_size);
+    memcpy(p_file, &header, sizeof(header));
+
+    const bool success = file_util::writeEntireFile(filepath, p_file, file_size);
+    if (success) {
+        LOG_F(
+            INFO, "Saved %" PRIu64 " voxels in %u chunks to `%s`, %" PRIu64 " bytes.",
+            header.voxel_count, chunk_count, filepath, file_size
+        );
+    }
+    return success;
+}
+
+
+extern bool load(const char* filepath, gfx::VoxelStore* store, u64* p_voxel_count_out) {
+
+    ZoneScoped;
+
+    const int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        LOG_F(ERROR, "Failed to open file `%s`; errno: `%i`, description: `%s`.", filepath, errno, strerror(errno));
+        return false;
+    }
+    // the mapping stays valid after the descriptor is closed
+    defer(close(fd));
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        LOG_F(ERROR, "Failed to stat file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    const u64 file_size = (u64)file_stat.st_size;
+    if (file_size < sizeof(Header)) {
+        LOG_F(ERROR, "`%s` is too small to be a voxel world.", filepath);
+        return false;
+    }
+
+    const u8* p_file = (const u8*)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p_file == MAP_FAILED) {
+        LOG_F(ERROR, "Failed to map file `%s`; errno: `%i`.", filepath, errno);
+        return false;
+    }
+    defer(munmap((void*)p_file, file_size));
+    // the table is read twice, and the voxels once, front to back
+    (void)madvise((void*)p_file, file_size, MADV_SEQUENTIAL);
+
+    Header header {};
+    memcpy(&header, p_file, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_F(ERROR, "`%s` isn't a voxel world.", filepath);
+        return false;
+    }
+    if (header.version != VERSION) {
+        LOG_F(ERROR, "`%s` is a version %u voxel world, but this is version %u.", filepath, header.version, VERSION);
+        return false;
+    }
+
+    // all of the table first, so that a corrupt file leaves the store as it was
+    const u64 data_begin = sizeof(Header) + (u64)header.chunk_count * sizeof(ChunkEntry);
+    bool valid = data_begin <= file_size;
+    u64 voxel_count = 0;
+    for (u32 i = 0; valid and i < header.chunk_count; i++) {
+        ChunkEntry entry {};
+        memcpy(&entry, &p_file[sizeof(Header) + i * sizeof(ChunkEntry)], sizeof(entry));
+
+        valid =
+            glm::all(glm::greaterThanEqual(entry.coord, ivec3(-CHUNK_COORD_LIMIT))) and
+            glm::all(glm::lessThan(entry.coord, ivec3(CHUNK_COORD_LIMIT))) and
+            entry.voxel_count > 0 and entry.voxel_count <= CHUNK_CELL_COUNT and
+            entry.voxel_offset % 4 == 0 and entry.voxel_offset >= data_begin and
+            entry.voxel_offset <= file_size and VOXEL_SIZE * entry.voxel_count <= file_size - entry.voxel_offset;
+        voxel_count += entry.voxel_count;
+    }
+    if (!valid or voxel_count != header.voxel_count) {
+        LOG_F(ERROR, "The voxel world `%s` is truncated or corrupt.", filepath);
+        return false;
+    }
+
+    gfx::Voxel* p_voxels = mallocArray(CHUNK_CELL_COUNT, gfx::Voxel);
+    defer(free(p_voxels));
+
+    for (u32 i = 0; i < header.chunk_count; i++) {
+        ChunkEntry entry {};
+        memcpy(&entry, &p_file[sizeof(Header) + i * sizeof(ChunkEntry)], sizeof(entry));
+
+        const ivec3 chunk_origin = entry.coord * (i32)gfx::VOXEL_CHUNK_SIZE;
+        const u8* p_colors = &p_file[entry.voxel_offset];
+        const u8* p_cells = &p_colors[sizeof(u32) * entry.voxel_count];
+        for (u32 v = 0; v < entry.voxel_count; v++) {
+            u16 cell_idx = 0;
+            memcpy(&cell_idx, &p_cells[sizeof(u16) * v], sizeof(u16));
+            cell_idx &= CHUNK_CELL_COUNT - 1;
+
+            p_voxels[v].coord = chunk_origin + ivec3(
+                cell_idx & (gfx::VOXEL_CHUNK_SIZE - 1),
+                (cell_idx >> gfx::VOXEL_CHUNK_SIZE_LOG2) & (gfx::VOXEL_CHUNK_SIZE - 1),
+                cell_idx >> (2 * gfx::VOXEL_CHUNK_SIZE_LOG2)
+            );
+            memcpy(&p_voxels[v].color, &p_colors[sizeof(u32) * v], sizeof(u32));
+        }
+        gfx::setVoxelChunk(store, entry.coord, p_voxels, entry.voxel_count);
+    }
+
+    LOG_F(
+        INFO, "Loaded %" PRIu64 " voxels in %u chunks from `%s`.", header.voxel_count, header.chunk_count, filepath
+    );
+    if (p_voxel_count_out != NULL) *p_voxel_count_out = header.voxel_count;
+    return true;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
@@ -0,0 +1,32 @@
+#ifndef _VOXEL_FILE_HPP
+#define _VOXEL_FILE_HPP
+
+// #include "types.hpp"
+// #include "graphics.hpp"
+// #include "voxel_store.hpp"
+
+/// A voxel world on disk, in the chunks of `graphics::VoxelStore`: a header, a table of the non-empty chunks, then
+/// each chunk's voxels as their colors and then their cell indices in the chunk, 6 bytes a voxel instead of the 16
+/// of `graphics::Voxel`. It's loaded by mapping it and adding it to the store a chunk at a time; the renderer then
+/// meshes and uploads the chunks like any other dirty ones.
+namespace voxel_file {
+
+//
+// ===========================================================================================================
+//
+
+/// Writes the store's voxels, which may be loaded back with `load()`. Logs an error and returns false on failure.
+[[nodiscard]] bool save(const char* filepath, const graphics::VoxelStore*);
+
+/// Adds the file's voxels to the store, replacing those in the same cells, and writes how many there were to
+/// `p_voxel_count_out`, unless it's NULL. Logs an error and returns false, with the store untouched, if the file
+/// can't be read or isn't a voxel world.
+[[nodiscard]] bool load(const char* filepath, graphics::VoxelStore*, u64* p_voxel_count_out);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,425 @@
+#include <cinttypes>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <imgui/imgui.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "trace.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "graphics.hpp"
+#include "voxel_store.hpp"
+#include "voxel_mesh.hpp"
+
+namespace graphics {
+
+using glm::uvec3;
+
+//
+// ===========================================================================================================
+//
+
+// The cells of a chunk and of the layer of cells around it, whose voxels hide the chunk's faces on its border.
+constexpr u32 PADDED_CHUNK_SIZE = VOXEL_CHUNK_SIZE + 2;
+constexpr u32 PADDED_CHUNK_CELL_COUNT = PADDED_CHUNK_SIZE * PADDED_CHUNK_SIZE * PADDED_CHUNK_SIZE;
+
+// A slice of a chunk's faces per direction and cell along the direction's axis.
+constexpr u32 FACE_DIRECTION_COUNT = 6;
+constexpr u32 SLICE_COUNT = FACE_DIRECTION_COUNT * VOXEL_CHUNK_SIZE;
+constexpr u32 SLICE_CELL_COUNT = VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE;
+
+// The most quads that a chunk can have: a checkerboard of voxels, none of whose faces merge.
+constexpr u32 MAX_CHUNK_QUAD_COUNT = FACE_DIRECTION_COUNT * VOXEL_CHUNK_SIZE * SLICE_CELL_COUNT / 2;
+
+/// The rectangle of a slice that its faces are in, so that the greedy meshing doesn't visit the whole slice.
+struct SliceBounds {
+    u8 min_u, min_v, max_u, max_v;
+};
+
+struct VoxelMesh {
+    u32 quad_capacity;
+
+    // in the quad buffer, by chunk of the store; empty if the chunk has no quads
+    ArrayList<VoxelQuadRange> chunk_quads;
+
+    // the unused ranges of the quad buffer, in order, none adjacent to another
+    ArrayList<VoxelQuadRange> free_ranges;
+
+    // scratch for `updateVoxelMesh()`
+    // the voxels of the chunk being meshed, and those of the chunks next to it that are on its border
+    ArrayList<Voxel> chunk_voxels;
+    // the colors of the cells of `PADDED_CHUNK_SIZE`^3, and whether they're occupied; cleared after each chunk
+    u8vec4* p_cell_colors;
+    bool* p_cells_occupied;
+    // the exposed faces, per slice, by cell of the slice; cleared as they're merged
+    u8vec4* p_face_colors;
+    bool* p_faces_exposed;
+    SliceBounds* p_slice_bounds; // empty if min > max
+    ArrayList<u32> nonempty_slice_indices;
+};
+
+//
+// ===========================================================================================================
+//
+
+/// First fit. Returns false if there's no free range of `count` quads.
+static bool allocQuads(VoxelMesh* mesh, u32 count, u32* first_out) {
+
+    ArrayList<VoxelQuadRange>* free_ranges = &mesh->free_ranges;
+    for (u32 i = 0; i < free_ranges->size; i++) {
+
+        VoxelQuadRange* range = &free_ranges->ptr[i];
+        if (range->count < count) continue;
+
+        *first_out = range->first;
+        range->first += count;
+        range->count -= count;
+        if (range->count == 0) {
+            memmove(
+                &free_ranges->ptr[i], &free_ranges->ptr[i + 1], (free_ranges->size - i - 1) * sizeof(VoxelQuadRange)
+            );
+            free_ranges->size--;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/// Merges it with the free ranges next to it.
+static void freeQuads(VoxelMesh* mesh, VoxelQuadRange freed) {
+
+    if (freed.count == 0) return;
+
+    ArrayList<VoxelQuadRange>* free_ranges = &mesh->free_ranges;
+
+    // the first free range after it
+    u32 next_idx = 0;
+    while (next_idx < free_ranges->size && free_ranges->ptr[next_idx].first < freed.first) next_idx++;
+
+    const bool merges_prev =
+        next_idx > 0 &&
+        free_ranges->ptr[next_idx - 1].first + free_ranges->ptr[next_idx - 1].count == freed.first;
+    const bool merges_next =
+        next_idx < free_ranges->size &&
+        freed.first + freed.count == free_ranges->ptr[next_idx].first;
+
+    if (merges_prev && merges_next) {
+        free_ranges->ptr[next_idx - 1].count += freed.count + free_ranges->ptr[next_idx].count;
+        memmove(
+            &free_ranges->ptr[next_idx], &free_ranges->ptr[next_idx + 1],
+            (free_ranges->size - next_idx - 1) * sizeof(VoxelQuadRange)
+        );
+        free_ranges->size--;
+    }
+    else if (merges_prev) free_ranges->ptr[next_idx - 1].count += freed.count;
+    else if (merges_next) {
+        free_ranges->ptr[next_idx].first = freed.first;
+        free_ranges->ptr[next_idx].count += freed.count;
+    }
+    else {
+        free_ranges->pushUninitialized();
+        memmove(
+            &free_ranges->ptr[next_idx + 1], &free_ranges->ptr[next_idx],
+            (free_ranges->size - next_idx - 1) * sizeof(VoxelQuadRange)
+        );
+        free_ranges->ptr[next_idx] = freed;
+    }
+}
+
+//
+// ===========================================================================================================
+//
+
+static inline u32 paddedCellIdx(ivec3 coord_in_chunk) {
+    const uvec3 padded = uvec3(coord_in_chunk + 1);
+    return padded.x + PADDED_CHUNK_SIZE * (padded.y + PADDED_CHUNK_SIZE * padded.z);
+}
+
+
+/// Gathers into `chunk_voxels` the chunk's voxels, then those of the chunks next to it that are in the layer of cells
+/// around it.
+static void gatherChunkVoxels(VoxelMesh* mesh, const VoxelStore* store, const VoxelChunk* chunk) {
+
+    ArrayList<Voxel>* chunk_voxels = &mesh->chunk_voxels;
+    chunk_voxels->resetSize();
+    chunk_voxels->reserve(chunk->voxel_count);
+    memcpy(chunk_voxels->ptr, chunk->p_voxels, chunk->voxel_count * sizeof(Voxel));
+    chunk_voxels->size = chunk->voxel_count;
+
+    const ivec3 padded_min = chunk->coord * (i32)VOXEL_CHUNK_SIZE - 1;
+    const ivec3 padded_max = padded_min + (i32)PADDED_CHUNK_SIZE - 1;
+
+    for (u32 direction = 0; direction < FACE_DIRECTION_COUNT; direction++) {
+
+        const u32 axis = direction / 2;
+        ivec3 neighbor_coord = chunk->coord;
+        neighbor_coord[axis] += (direction & 1) ? -1 : 1;
+        const u32 neighbor_idx = findVoxelChunk(store, neighbor_coord);
+        if (neighbor_idx == INVALID_VOXEL_CHUNK_IDX) continue;
+
+        const VoxelChunk neighbor = getVoxelChunk(store, neighbor_idx);
+        if (neighbor.voxel_count == 0) continue;
+        // only its layer of cells next to the chunk is in the padded chunk
+        if (neighbor.bounds_max[axis] < padded_min[axis] || neighbor.bounds_min[axis] > padded_max[axis]) continue;
+
+        for (u32 i = 0; i < neighbor.voxel_count; i++) {
+            const i32 coord = neighbor.p_voxels[i].coord[axis];
+            if (coord >= padded_min[axis] && coord <= padded_max[axis]) chunk_voxels->push(neighbor.p_voxels[i]);
+        }
+    }
+}
+
+
+/// Appends the greedy mesh of the chunk to `quads_out`, from its voxels and those around it.
+static void meshChunk(VoxelMesh* mesh, const VoxelStore* store, u32 chunk_idx, ArrayList<VoxelQuad>* quads_out) {
+
+    const VoxelChunk chunk = getVoxelChunk(store, chunk_idx);
+    if (chunk.voxel_count == 0) return;
+
+    gatherChunkVoxels(mesh, store, &chunk);
+    const Voxel* p_voxels = mesh->chunk_voxels.ptr;
+    const u32 voxel_count = mesh->chunk_voxels.size;
+    const ivec3 chunk_origin = chunk.coord * (i32)VOXEL_CHUNK_SIZE;
+
+    for (u32 i = 0; i < voxel_count; i++) {
+        const u32 cell_idx = paddedCellIdx(p_voxels[i].coord - chunk_origin);
+        mesh->p_cell_colors[cell_idx] = p_voxels[i].color;
+        mesh->p_cells_occupied[cell_idx] = true;
+    }
+
+    // the exposed faces of the chunk's own voxels, which come first, into their slices
+    for (u32 i = 0; i < chunk.voxel_count; i++) {
+
+        const ivec3 coord_in_chunk = p_voxels[i].coord - chunk_origin;
+
+        const u8vec4 color = p_voxels[i].color;
+
+        for (u32 direction = 0; direction < FACE_DIRECTION_COUNT; direction++) {
+
+            const u32 axis = direction / 2;
+            ivec3 neighbor_coord = coord_in_chunk;
+            neighbor_coord[axis] += (direction & 1) ? -1 : 1;
+            if (mesh->p_cells_occupied[paddedCellIdx(neighbor_coord)]) continue;
+
+            const u32 u = (u32)coord_in_chunk[(axis + 1) % 3];
+            const u32 v = (u32)coord_in_chunk[(axis + 2) % 3];
+            const u32 slice_idx = direction * VOXEL_CHUNK_SIZE + (u32)coord_in_chunk[axis];
+            const u32 face_idx = slice_idx * SLICE_CELL_COUNT + v * VOXEL_CHUNK_SIZE + u;
+            mesh->p_face_colors[face_idx] = color;
+            mesh->p_faces_exposed[face_idx] = true;
+
+            SliceBounds* bounds = &mesh->p_slice_bounds[slice_idx];
+            if (bounds->min_u > bounds->max_u) mesh->nonempty_slice_indices.push(slice_idx);
+            bounds->min_u = (u8)math::min((u32)bounds->min_u, u);
+            bounds->min_v = (u8)math::min((u32)bounds->min_v, v);
+            bounds->max_u = (u8)math::max((u32)bounds->max_u, u);
+            bounds->max_v = (u8)math::max((u32)bounds->max_v, v);
+        }
+    }
+
+    for (u32 i = 0; i < voxel_count; i++) {
+        const u32 cell_idx = paddedCellIdx(p_voxels[i].coord - chunk_origin);
+        mesh->p_cells_occupied[cell_idx] = false;
+    }
+
+    // Greedy meshing: each face that isn't merged yet grows as far as it can along u, then along v, over the faces
+    // of its color, and takes them. The faces are cleared as they're taken, so the slices end up empty.
+    for (u32 i = 0; i < mesh->nonempty_slice_indices.size; i++) {
+
+        const u32 slice_idx = mesh->nonempty_slice_indices.ptr[i];
+        const u32 direction = slice_idx / VOXEL_CHUNK_SIZE;
+        const u32 axis = direction / 2;
+        const SliceBounds bounds = mesh->p_slice_bounds[slice_idx];
+        u8vec4* p_colors = &mesh->p_face_colors[slice_idx * SLICE_CELL_COUNT];
+        bool* p_exposed = &mesh->p_faces_exposed[slice_idx * SLICE_CELL_COUNT];
+
+        for (u32 v = bounds.min_v; v <= bounds.max_v; v++) {
+            for (u32 u = bounds.min_u; u <= bounds.max_u; u++) {
+
+                if (!p_exposed[v * VOXEL_CHUNK_SIZE + u]) continue;
+                const u8vec4 color = p_colors[v * VOXEL_CHUNK_SIZE + u];
+
+                u32 width = 1;
+                while (
+                    u + width <= bounds.max_u &&
+                    p_exposed[v * VOXEL_CHUNK_SIZE + u + width] &&
+                    p_colors[v * VOXEL_CHUNK_SIZE + u + width] == color
+                ) width++;
+
+                u32 height = 1;
+                while (v + height <= bounds.max_v) {
+                    bool row_matches = true;
+                    for (u32 du = 0; du < width; du++) {
+                        const u32 face_idx = (v + height) * VOXEL_CHUNK_SIZE + u + du;
+                        row_matches = row_matches && p_exposed[face_idx] && p_colors[face_idx] == color;
+                    }
+                    if (!row_matches) break;
+                    height++;
+                }
+
+                for (u32 dv = 0; dv < height; dv++) {
+                    for (u32 du = 0; du < width; du++) p_exposed[(v + dv) * VOXEL_CHUNK_SIZE + u + du] = false;
+                }
+
+                ivec3 coord = chunk_origin;
+                coord[axis] += (i32)(slice_idx % VOXEL_CHUNK_SIZE);
+                coord[(axis + 1) % 3] += (i32)u;
+                coord[(axis + 2) % 3] += (i32)v;
+                quads_out->push(VoxelQuad {
+                    .packed = {
+                        ((u32)coord.x & 0xFFFFFFu) | (direction << 24),
+                        ((u32)coord.y & 0xFFFFFFu) | (width << 24),
+                        ((u32)coord.z & 0xFFFFFFu) | (height << 24),
+                    },
+                    .color = color,
+                });
+            }
+        }
+
+        mesh->p_slice_bounds[slice_idx] = SliceBounds {
+            .min_u = VOXEL_CHUNK_SIZE, .min_v = VOXEL_CHUNK_SIZE, .max_u = 0, .max_v = 0,
+        };
+    }
+    mesh->nonempty_slice_indices.resetSize();
+}
+
+//
+// ===========================================================================================================
+//
+
+extern VoxelMesh* createVoxelMesh(u32 quad_capacity) {
+
+    VoxelMesh* mesh = mallocArray(1, VoxelMesh);
+
+    *mesh = VoxelMesh {
+        .quad_capacity = quad_capacity,
+        .chunk_quads = ArrayList<VoxelQuadRange>::create(),
+        .free_ranges = ArrayList<VoxelQuadRange>::create(),
+        .chunk_voxels = ArrayList<Voxel>::create(),
+        .p_cell_colors = mallocArray(PADDED_CHUNK_CELL_COUNT, u8vec4),
+        .p_cells_occupied = callocArray(PADDED_CHUNK_CELL_COUNT, bool),
+        .p_face_colors = mallocArray(SLICE_COUNT * SLICE_CELL_COUNT, u8vec4),
+        .p_faces_exposed = callocArray(SLICE_COUNT * SLICE_CELL_COUNT, bool),
+        .p_slice_bounds = mallocArray(SLICE_COUNT, SliceBounds),
+        .nonempty_slice_indices = ArrayList<u32>::create(),
+    };
+    for (u32 i = 0; i < SLICE_COUNT; i++) {
+        mesh->p_slice_bounds[i] = SliceBounds {
+            .min_u = VOXEL_CHUNK_SIZE, .min_v = VOXEL_CHUNK_SIZE, .max_u = 0, .max_v = 0,
+        };
+    }
+    if (quad_capacity > 0) mesh->free_ranges.push(VoxelQuadRange { .first = 0, .count = quad_capacity });
+
+    return mesh;
+}
+
+
+extern void destroyVoxelMesh(VoxelMesh* mesh) {
+
+    mesh->chunk_quads.free();
+    mesh->free_ranges.free();
+    mesh->chunk_voxels.free();
+    free(mesh->p_cell_colors);
+    free(mesh->p_cells_occupied);
+    free(mesh->p_face_colors);
+    free(mesh->p_faces_exposed);
+    free(mesh->p_slice_bounds);
+    mesh->nonempty_slice_indices.free();
+
+    free(mesh);
+}
+
+
+extern void updateVoxelMesh(
+    VoxelMesh* mesh,
+    VoxelStore* store,
+    u32 max_staged_quad_count,
+    ArrayList<VoxelQuadRange>* cleared_ranges_out,
+    ArrayList<VoxelQuad>* staged_quads_out,
+    ArrayList<VoxelQuadCopy>* copies_out
+) {
+
+    ZoneScoped;
+
+    // so that each update meshes at least one chunk
+    alwaysAssert(max_staged_quad_count >= MAX_CHUNK_QUAD_COUNT);
+
+    const u32 dirty_chunk_count = getDirtyVoxelChunkCount(store);
+    if (dirty_chunk_count == 0) return;
+    const u32* p_dirty_chunk_indices = getDirtyVoxelChunkIndices(store);
+
+    const u32 chunk_count = getVoxelChunkCount(store);
+    while (mesh->chunk_quads.size < chunk_count) mesh->chunk_quads.push(VoxelQuadRange { .first = 0, .count = 0 });
+
+    u32 meshed_count = 0;
+    for (; meshed_count < dirty_chunk_count; meshed_count++) {
+
+        const u32 chunk_idx = p_dirty_chunk_indices[meshed_count];
+        VoxelQuadRange* chunk_quads = &mesh->chunk_quads.ptr[chunk_idx];
+
+        const u32 quads_begin = staged_quads_out->size;
+        meshChunk(mesh, store, chunk_idx, staged_quads_out);
+        const u32 quad_count = staged_quads_out->size - quads_begin;
+        if (staged_quads_out->size > max_staged_quad_count) {
+            staged_quads_out->size = quads_begin;
+            break;
+        }
+
+        if (chunk_quads->count > 0) {
+            freeQuads(mesh, *chunk_quads);
+            cleared_ranges_out->push(*chunk_quads);
+        }
+        *chunk_quads = VoxelQuadRange { .first = 0, .count = 0 };
+
+        if (quad_count == 0) continue;
+
+        u32 first = 0;
+        if (!allocQuads(mesh, quad_count, &first)) {
+            const ivec3 chunk_coord = getVoxelChunk(store, chunk_idx).coord;
+            LOG_F(
+                ERROR, "The voxel mesh is out of room for the %" PRIu32 " quads of chunk (%" PRIi32 ", %" PRIi32
+                ", %" PRIi32 "); it isn't drawn.", quad_count, chunk_coord.x, chunk_coord.y, chunk_coord.z
+            );
+            staged_quads_out->size = quads_begin;
+            continue;
+        }
+        *chunk_quads = VoxelQuadRange { .first = first, .count = quad_count };
+
+        // consecutive chunks usually land next to each other, so that the copies merge
+        VoxelQuadCopy* last_copy = (copies_out->size > 0) ? &copies_out->ptr[copies_out->size - 1] : NULL;
+        if (
+            last_copy != NULL &&
+            last_copy->src_idx + last_copy->count == quads_begin &&
+            last_copy->dst_idx + last_copy->count == first
+        ) last_copy->count += quad_count;
+        else copies_out->push(VoxelQuadCopy { .src_idx = quads_begin, .dst_idx = first, .count = quad_count });
+    }
+
+    // the chunks that didn't fit stay dirty, in order
+    clearDirtyVoxelChunks(store, meshed_count);
+}
+
+
+extern u32 getVoxelMeshQuadSlotCount(const VoxelMesh* mesh) {
+
+    const ArrayList<VoxelQuadRange>* free_ranges = &mesh->free_ranges;
+    if (free_ranges->size == 0) return mesh->quad_capacity;
+
+    const VoxelQuadRange last = free_ranges->ptr[free_ranges->size - 1];
+    return (last.first + last.count == mesh->quad_capacity) ? last.first : mesh->quad_capacity;
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
@@ -0,0 +1,78 @@
+#ifndef _VOXEL_MESH_HPP
+#define _VOXEL_MESH_HPP
+
+// #include <glm/glm.hpp>
+// #include "types.hpp"
+// #include "alloc_util.hpp"
+// #include "graphics.hpp"
+// #include "voxel_store.hpp"
+
+namespace graphics {
+
+//
+// ===========================================================================================================
+//
+
+/// A rectangle of the exposed voxel faces, which the greedy meshing merged from coplanar faces of the same color.
+/// Packed, for voxel_mesh.comp.h:
+/// - the low 24 bits of `packed[0]`, `packed[1]` and `packed[2]` are the signed x, y and z of the voxel at its
+///   first corner;
+/// - the high 8 bits of `packed[0]` are the direction that it faces: 2 * axis, + 1 towards -axis;
+/// - those of `packed[1]` and `packed[2]` are its width and height, in voxels, along the next axis and the one
+///   after that ((axis + 1) % 3 and (axis + 2) % 3).
+/// All zeros is an empty quad, which isn't drawn; the unused parts of the quad buffer are filled with those.
+struct VoxelQuad {
+    u32 packed[3];
+    u8vec4 color;
+};
+static_assert(sizeof(VoxelQuad) == 4 * 4);
+
+/// A range of the quad buffer.
+struct VoxelQuadRange {
+    u32 first;
+    u32 count;
+};
+
+/// A copy of `count` of the staged quads, from `src_idx`, to `dst_idx` in the quad buffer.
+struct VoxelQuadCopy {
+    u32 src_idx;
+    u32 dst_idx;
+    u32 count;
+};
+
+/// The greedy mesh of a `VoxelStore`, by chunk, and where each chunk's quads are in the quad buffer, which the
+/// caller keeps (the renderer, on the GPU). Not thread-safe.
+struct VoxelMesh;
+
+/// The quad buffer has room for `quad_capacity` quads, all empty at first.
+VoxelMesh* createVoxelMesh(u32 quad_capacity);
+void destroyVoxelMesh(VoxelMesh*);
+
+/// Re-meshes the store's dirty chunks (see `getDirtyVoxelChunkIndices()`), each from its voxels and those of the
+/// chunks next to it, and clears them. Each chunk's old quads are freed, and appended to `cleared_ranges_out`, which
+/// the caller must fill with empty quads; then its new ones are appended to `staged_quads_out`, and their copy into
+/// the quad buffer to `copies_out`, which must come after the clears. Stops before the chunk whose quads would take
+/// `staged_quads_out` past `max_staged_quad_count`, and leaves it and the rest dirty for the next update; that must
+/// be at least the most quads that a chunk can have, 3 * VOXEL_CHUNK_SIZE^3. The outputs are appended to, not reset.
+///
+/// Takes time in proportion to the dirty chunks' voxels and faces. The mesh must only ever be updated from the same
+/// store.
+void updateVoxelMesh(
+    VoxelMesh*,
+    VoxelStore*,
+    u32 max_staged_quad_count,
+    ArrayList<VoxelQuadRange>* cleared_ranges_out,
+    ArrayList<VoxelQuad>* staged_quads_out,
+    ArrayList<VoxelQuadCopy>* copies_out
+);
+
+/// The quads of the buffer before this index may be nonempty; all those after are empty.
+u32 getVoxelMeshQuadSlotCount(const VoxelMesh*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -0,0 +1,433 @@
+#include <cinttypes>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <imgui/imgui.h>
+#include <loguru/loguru.hpp>
+#include <tracy/tracy/Tracy.hpp>
+
+#include "types.hpp"
+#include "math_util.hpp"
+#include "error_util.hpp"
+#include "alloc_util.hpp"
+#include "defer.hpp"
+#include "vk_procs.hpp"
+#include "vulkan_context.hpp"
+#include "thread_pool.hpp"
+#include "graphics.hpp"
+#include "voxel_store.hpp"
+
+namespace graphics {
+
+using glm::uvec3;
+
+//
+// ===========================================================================================================
+//
+
+constexpr u32 CHUNK_CELL_COUNT = VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE;
+static_assert(CHUNK_CELL_COUNT <= (1 << 16));
+
+// A slot of a chunk's cell table: the cell's index in the chunk in the high 16 bits, and its voxel's index in
+// `ChunkStorage::voxels` in the low 16 bits.
+constexpr u32 EMPTY_CELL_SLOT = UINT32_MAX;
+constexpr u32 INITIAL_CELL_SLOT_CAPACITY_LOG2 = 2;
+
+struct ChunkStorage {
+    ivec3 coord;
+    ArrayList<Voxel> voxels;
+    // Indices into `voxels` by cell: open addressing with linear probing, at most half full.
+    u32* p_cell_slots;
+    u32 cell_slot_capacity_log2;
+    // The voxels in each plane of cells across each axis, for the bounds to shrink as the voxels are removed.
+    u16 plane_voxel_counts[3][VOXEL_CHUNK_SIZE];
+    ivec3 bounds_min; // in cells of the chunk; only if there are voxels
+    ivec3 bounds_max;
+    bool dirty;
+    u32 edit_count;
+};
+
+struct VoxelStore {
+    ArrayList<ChunkStorage> chunks; // never removed
+    // Indices into `chunks` by chunk coordinate: open addressing with linear probing, at most half full.
+    u32* p_chunk_slots;
+    u32 chunk_slot_capacity_mask; // the capacity is a power of 2
+    ArrayList<u32> dirty_chunk_indices;
+    u64 voxel_count;
+};
+
+//
+// ===========================================================================================================
+//
+
+static inline u32 hashChunkCoord(ivec3 coord) {
+    return ((u32)coord.x * 73856093u) ^ ((u32)coord.y * 19349663u) ^ ((u32)coord.z * 83492791u);
+}
+
+
+static inline u32 cellIdx(ivec3 coord_in_chunk) {
+    const uvec3 coord = uvec3(coord_in_chunk);
+    return coord.x + VOXEL_CHUNK_SIZE * (coord.y + VOXEL_CHUNK_SIZE * coord.z);
+}
+
+
+/// Fibonacci hashing, as the cell indices are small and dense.
+static inline u32 homeCellSlot(u32 cell_idx, u32 capacity_log2) {
+    return (cell_idx * 2654435769u) >> (32 - capacity_log2);
+}
+
+
+/// The index of the cell's slot, which holds EMPTY_CELL_SLOT if the cell is empty.
+static u32 findCellSlot(const ChunkStorage* chunk, u32 cell_idx) {
+
+    const u32 mask = (1u << chunk->cell_slot_capacity_log2) - 1;
+    u32 slot_idx = homeCellSlot(cell_idx, chunk->cell_slot_capacity_log2);
+    while (true) {
+        const u32 slot = chunk->p_cell_slots[slot_idx];
+        if (slot == EMPTY_CELL_SLOT || slot >> 16 == cell_idx) return slot_idx;
+        slot_idx = (slot_idx + 1) & mask;
+    }
+}
+
+
+static void growCellSlots(ChunkStorage* chunk) {
+
+    const u32 old_capacity = 1u << chunk->cell_slot_capacity_log2;
+    u32* p_old_slots = chunk->p_cell_slots;
+    defer(free(p_old_slots));
+
+    chunk->cell_slot_capacity_log2++;
+    chunk->p_cell_slots = mallocArray(2 * old_capacity, u32);
+    for (u32 i = 0; i < 2 * old_capacity; i++) chunk->p_cell_slots[i] = EMPTY_CELL_SLOT;
+
+    for (u32 i = 0; i < old_capacity; i++) {
+        const u32 slot = p_old_slots[i];
+        if (slot != EMPTY_CELL_SLOT) chunk->p_cell_slots[findCellSlot(chunk, slot >> 16)] = slot;
+    }
+}
+
+
+/// Empties the slot, and moves the slots after it back into the gap where their probe sequences allow, so that no
+/// probe sequence is broken.
+static void removeCellSlot(ChunkStorage* chunk, u32 slot_idx) {
+
+    const u32 capacity_log2 = chunk->cell_slot_capacity_log2;
+    const u32 mask = (1u << capacity_log2) - 1;
+    u32* p_slots = chunk->p_cell_slots;
+
+    u32 gap_idx = slot_idx;
+    u32 idx = slot_idx;
+    while (true) {
+        idx = (idx + 1) & mask;
+        const u32 slot = p_slots[idx];
+        if (slot == EMPTY_CELL_SLOT) break;
+
+        // it stays if its home is cyclically in (gap_idx, idx]
+        const u32 home_idx = homeCellSlot(slot >> 16, capacity_log2);
+        const bool stays =
+            (gap_idx <= idx) ? (gap_idx < home_idx && home_idx <= idx) : (gap_idx < home_idx || home_idx <= idx);
+        if (stays) continue;
+
+        p_slots[gap_idx] = slot;
+        gap_idx = idx;
+    }
+    p_slots[gap_idx] = EMPTY_CELL_SLOT;
+}
+
+
+static u32 findChunk(const VoxelStore* store, ivec3 chunk_coord) {
+
+    u32 slot_idx = hashChunkCoord(chunk_coord) & store->chunk_slot_capacity_mask;
+    while (true) {
+        const u32 chunk_idx = store->p_chunk_slots[slot_idx];
+        if (chunk_idx == INVALID_VOXEL_CHUNK_IDX) return INVALID_VOXEL_CHUNK_IDX;
+        if (store->chunks.ptr[chunk_idx].coord == chunk_coord) return chunk_idx;
+        slot_idx = (slot_idx + 1) & store->chunk_slot_capacity_mask;
+    }
+}
+
+
+static void insertChunkSlot(VoxelStore* store, ivec3 chunk_coord, u32 chunk_idx) {
+
+    u32 slot_idx = hashChunkCoord(chunk_coord) & store->chunk_slot_capacity_mask;
+    while (store->p_chunk_slots[slot_idx] != INVALID_VOXEL_CHUNK_IDX) {
+        slot_idx = (slot_idx + 1) & store->chunk_slot_capacity_mask;
+    }
+    store->p_chunk_slots[slot_idx] = chunk_idx;
+}
+
+
+static u32 findOrAddChunk(VoxelStore* store, ivec3 chunk_coord) {
+
+    const u32 found_idx = findChunk(store, chunk_coord);
+    if (found_idx != INVALID_VOXEL_CHUNK_IDX) return found_idx;
+
+    const u32 chunk_idx = store->chunks.size;
+    ChunkStorage* chunk = store->chunks.pushZeroed();
+    chunk->coord = chunk_coord;
+    chunk->voxels = ArrayList<Voxel>::create();
+    chunk->cell_slot_capacity_log2 = INITIAL_CELL_SLOT_CAPACITY_LOG2;
+    chunk->p_cell_slots = mallocArray(1u << INITIAL_CELL_SLOT_CAPACITY_LOG2, u32);
+    for (u32 i = 0; i < 1u << INITIAL_CELL_SLOT_CAPACITY_LOG2; i++) chunk->p_cell_slots[i] = EMPTY_CELL_SLOT;
+
+    const u32 slot_capacity = store->chunk_slot_capacity_mask + 1;
+    if (2 * store->chunks.size > slot_capacity) {
+        // rehash into twice the slots
+        free(store->p_chunk_slots);
+        store->p_chunk_slots = mallocArray(2 * slot_capacity, u32);
+        store->chunk_slot_capacity_mask = 2 * slot_capacity - 1;
+        for (u32 i = 0; i < 2 * slot_capacity; i++) store->p_chunk_slots[i] = INVALID_VOXEL_CHUNK_IDX;
+        for (u32 i = 0; i < store->chunks.size; i++) insertChunkSlot(store, store->chunks.ptr[i].coord, i);
+    }
+    else insertChunkSlot(store, chunk_coord, chunk_idx);
+
+    return chunk_idx;
+}
+
+
+static void markChunkDirty(VoxelStore* store, u32 chunk_idx) {
+
+    ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+    if (chunk->dirty) return;
+    chunk->dirty = true;
+    store->dirty_chunk_indices.push(chunk_idx);
+}
+
+
+/// The voxel's own chunk, which must exist, and the existing chunks next to it whose border the voxel is on.
+static void markChunksOfVoxelDirty(VoxelStore* store, u32 chunk_idx, ivec3 coord_in_chunk) {
+
+    markChunkDirty(store, chunk_idx);
+
+    const ivec3 chunk_coord = store->chunks.ptr[chunk_idx].coord;
+    for (u32 axis = 0; axis < 3; axis++) {
+        ivec3 neighbor_coord = chunk_coord;
+        if (coord_in_chunk[axis] == 0) neighbor_coord[axis]--;
+        else if (coord_in_chunk[axis] == (i32)VOXEL_CHUNK_SIZE - 1) neighbor_coord[axis]++;
+        else continue;
+
+        const u32 neighbor_idx = findChunk(store, neighbor_coord);
+        if (neighbor_idx != INVALID_VOXEL_CHUNK_IDX) markChunkDirty(store, neighbor_idx);
+    }
+}
+
+/// `setVoxel()` in the voxel's chunk, which must exist.
+static void setVoxelInChunk(VoxelStore* store, u32 chunk_idx, Voxel voxel) {
+
+    ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+    const ivec3 coord_in_chunk = voxel.coord & (i32)(VOXEL_CHUNK_SIZE - 1);
+    const u32 cell_idx = cellIdx(coord_in_chunk);
+
+    chunk->edit_count++;
+
+    u32 slot_idx = findCellSlot(chunk, cell_idx);
+    if (chunk->p_cell_slots[slot_idx] != EMPTY_CELL_SLOT) {
+        chunk->voxels.ptr[chunk->p_cell_slots[slot_idx] & 0xFFFF] = voxel;
+        markChunksOfVoxelDirty(store, chunk_idx, coord_in_chunk);
+        return;
+    }
+
+    if (2 * (chunk->voxels.size + 1) > 1u << chunk->cell_slot_capacity_log2) {
+        growCellSlots(chunk);
+        slot_idx = findCellSlot(chunk, cell_idx);
+    }
+    chunk->p_cell_slots[slot_idx] = (cell_idx << 16) | chunk->voxels.size;
+    chunk->voxels.push(voxel);
+    store->voxel_count++;
+
+    if (chunk->voxels.size == 1) {
+        chunk->bounds_min = coord_in_chunk;
+        chunk->bounds_max = coord_in_chunk;
+    }
+    else {
+        chunk->bounds_min = glm::min(chunk->bounds_min, coord_in_chunk);
+        chunk->bounds_max = glm::max(chunk->bounds_max, coord_in_chunk);
+    }
+    for (u32 axis = 0; axis < 3; axis++) chunk->plane_voxel_counts[axis][coord_in_chunk[axis]]++;
+
+    markChunksOfVoxelDirty(store, chunk_idx, coord_in_chunk);
+}
+
+//
+// ===========================================================================================================
+//
+
+extern VoxelStore* createVoxelStore(void) {
+
+    VoxelStore* store = mallocArray(1, VoxelStore);
+
+    constexpr u32 initial_slot_capacity = 64;
+    *store = VoxelStore {
+        .chunks = ArrayList<ChunkStorage>::create(),
+        .p_chunk_slots = mallocArray(initial_slot_capacity, u32),
+        .chunk_slot_capacity_mask = initial_slot_capacity - 1,
+        .dirty_chunk_indices = ArrayList<u32>::create(),
+        .voxel_count = 0,
+    };
+    for (u32 i = 0; i < initial_slot_capacity; i++) store->p_chunk_slots[i] = INVALID_VOXEL_CHUNK_IDX;
+
+    return store;
+}
+
+
+extern void destroyVoxelStore(VoxelStore* store) {
+
+    for (u32 i = 0; i < store->chunks.size; i++) {
+        store->chunks.ptr[i].voxels.free();
+        free(store->chunks.ptr[i].p_cell_slots);
+    }
+    store->chunks.free();
+    free(store->p_chunk_slots);
+    store->dirty_chunk_indices.free();
+
+    free(store);
+}
+
+
+extern void setVoxel(VoxelStore* store, Voxel voxel) {
+
+    alwaysAssert(glm::all(glm::greaterThanEqual(voxel.coord, ivec3(-VOXEL_COORD_LIMIT))));
+    alwaysAssert(glm::all(glm::lessThan(voxel.coord, ivec3(VOXEL_COORD_LIMIT))));
+
+    setVoxelInChunk(store, findOrAddChunk(store, voxel.coord >> (i32)VOXEL_CHUNK_SIZE_LOG2), voxel);
+}
+
+
+extern void setVoxelChunk(VoxelStore* store, ivec3 chunk_coord, const Voxel* p_voxels, u32 count) {
+
+    ZoneScoped;
+
+    if (count == 0) return;
+    alwaysAssert(glm::all(glm::greaterThanEqual(chunk_coord, ivec3(-VOXEL_COORD_LIMIT >> VOXEL_CHUNK_SIZE_LOG2))));
+    alwaysAssert(glm::all(glm::lessThan(chunk_coord, ivec3(VOXEL_COORD_LIMIT >> VOXEL_CHUNK_SIZE_LOG2))));
+
+    const u32 chunk_idx = findOrAddChunk(store, chunk_coord);
+    ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+
+    // room for them all, as if none of their cells were taken yet; at most half full, like `setVoxel()` keeps it
+    const u32 max_voxel_count = math::min(chunk->voxels.size + count, CHUNK_CELL_COUNT);
+    chunk->voxels.reserve(max_voxel_count);
+    while (2 * max_voxel_count > 1u << chunk->cell_slot_capacity_log2) growCellSlots(chunk);
+
+    for (u32 i = 0; i < count; i++) {
+        alwaysAssert(p_voxels[i].coord >> (i32)VOXEL_CHUNK_SIZE_LOG2 == chunk_coord);
+        setVoxelInChunk(store, chunk_idx, p_voxels[i]);
+    }
+}
+
+
+extern bool removeVoxel(VoxelStore* store, ivec3 coord) {
+
+    const u32 chunk_idx = findChunk(store, coord >> (i32)VOXEL_CHUNK_SIZE_LOG2);
+    if (chunk_idx == INVALID_VOXEL_CHUNK_IDX) return false;
+    ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+    const ivec3 coord_in_chunk = coord & (i32)(VOXEL_CHUNK_SIZE - 1);
+
+    const u32 slot_idx = findCellSlot(chunk, cellIdx(coord_in_chunk));
+    if (chunk->p_cell_slots[slot_idx] == EMPTY_CELL_SLOT) return false;
+    const u32 voxel_idx = chunk->p_cell_slots[slot_idx] & 0xFFFF;
+    removeCellSlot(chunk, slot_idx);
+    chunk->edit_count++;
+
+    // the last voxel takes its place
+    const u32 last_idx = chunk->voxels.size - 1;
+    if (voxel_idx != last_idx) {
+        const Voxel moved = chunk->voxels.ptr[last_idx];
+        chunk->voxels.ptr[voxel_idx] = moved;
+        const u32 moved_cell_idx = cellIdx(moved.coord & (i32)(VOXEL_CHUNK_SIZE - 1));
+        chunk->p_cell_slots[findCellSlot(chunk, moved_cell_idx)] = (moved_cell_idx << 16) | voxel_idx;
+    }
+    chunk->voxels.size--;
+    store->voxel_count--;
+
+    for (u32 axis = 0; axis < 3; axis++) {
+        u16* p_counts = chunk->plane_voxel_counts[axis];
+        p_counts[coord_in_chunk[axis]]--;
+        if (chunk->voxels.size == 0) continue;
+        while (p_counts[chunk->bounds_min[axis]] == 0) chunk->bounds_min[axis]++;
+        while (p_counts[chunk->bounds_max[axis]] == 0) chunk->bounds_max[axis]--;
+    }
+
+    markChunksOfVoxelDirty(store, chunk_idx, coord_in_chunk);
+    return true;
+}
+
+
+extern bool findVoxel(const VoxelStore* store, ivec3 coord, Voxel* voxel_out) {
+
+    const u32 chunk_idx = findChunk(store, coord >> (i32)VOXEL_CHUNK_SIZE_LOG2);
+    if (chunk_idx == INVALID_VOXEL_CHUNK_IDX) return false;
+    const ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+    if (chunk->voxels.size == 0) return false;
+
+    const u32 slot = chunk->p_cell_slots[findCellSlot(chunk, cellIdx(coord & (i32)(VOXEL_CHUNK_SIZE - 1)))];
+    if (slot == EMPTY_CELL_SLOT) return false;
+
+    if (voxel_out != NULL) *voxel_out = chunk->voxels.ptr[slot & 0xFFFF];
+    return true;
+}
+
+
+extern u64 getVoxelStoreVoxelCount(const VoxelStore* store) {
+    return store->voxel_count;
+}
+
+
+extern u32 getVoxelChunkCount(const VoxelStore* store) {
+    return store->chunks.size;
+}
+
+
+extern VoxelChunk getVoxelChunk(const VoxelStore* store, u32 chunk_idx) {
+
+    alwaysAssert(chunk_idx < store->chunks.size);
+    const ChunkStorage* chunk = &store->chunks.ptr[chunk_idx];
+    const ivec3 chunk_origin = chunk->coord * (i32)VOXEL_CHUNK_SIZE;
+
+    return VoxelChunk {
+        .coord = chunk->coord,
+        .voxel_count = chunk->voxels.size,
+        .p_voxels = chunk->voxels.ptr,
+        .bounds_min = chunk_origin + chunk->bounds_min,
+        .bounds_max = chunk_origin + chunk->bounds_max,
+        .edit_count = chunk->edit_count,
+    };
+}
+
+
+extern u32 findVoxelChunk(const VoxelStore* store, ivec3 chunk_coord) {
+    return findChunk(store, chunk_coord);
+}
+
+
+extern u32 getDirtyVoxelChunkCount(const VoxelStore* store) {
+    return store->dirty_chunk_indices.size;
+}
+
+
+extern const u32* getDirtyVoxelChunkIndices(const VoxelStore* store) {
+    return store->dirty_chunk_indices.ptr;
+}
+
+
+extern void clearDirtyVoxelChunks(VoxelStore* store, u32 count) {
+
+    ArrayList<u32>* dirty = &store->dirty_chunk_indices;
+    alwaysAssert(count <= dirty->size);
+
+    for (u32 i = 0; i < count; i++) store->chunks.ptr[dirty->ptr[i]].dirty = false;
+    memmove(dirty->ptr, &dirty->ptr[count], (dirty->size - count) * sizeof(u32));
+    dirty->size -= count;
+}
+
+
+extern void markAllVoxelChunksDirty(VoxelStore* store) {
+    for (u32 i = 0; i < store->chunks.size; i++) markChunkDirty(store, i);
+}
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
@@ -0,0 +1,77 @@
+#ifndef _VOXEL_STORE_HPP
+#define _VOXEL_STORE_HPP
+
+// #include <glm/glm.hpp>
+// #include "types.hpp"
+// #include "graphics.hpp"
+
+namespace graphics {
+
+//
+// ===========================================================================================================
+//
+
+// The voxels are kept in chunks of 32x32x32 cells, in a hash table by chunk coordinate, so that what's empty takes
+// no room, and the voxel mesh (see voxel_mesh.hpp) is built per chunk.
+constexpr u32 VOXEL_CHUNK_SIZE_LOG2 = 5;
+constexpr u32 VOXEL_CHUNK_SIZE = 1 << VOXEL_CHUNK_SIZE_LOG2;
+
+// The voxel coordinates must be in [-VOXEL_COORD_LIMIT, VOXEL_COORD_LIMIT), for `VoxelQuad`.
+constexpr i32 VOXEL_COORD_LIMIT = 1 << 23;
+
+constexpr u32 INVALID_VOXEL_CHUNK_IDX = UINT32_MAX;
+
+/// The voxels, at most one per cell, by chunk. The single copy of them: the app edits it, picks and selects from
+/// it, and the renderer meshes it (see `setVoxelStore()`). Not thread-safe; it may be read from several threads at
+/// once, between edits.
+struct VoxelStore;
+
+/// A chunk of the store, as `getVoxelChunk()` sees it; valid until the next edit.
+struct VoxelChunk {
+    ivec3 coord; // the cell coordinates of its voxels, >> VOXEL_CHUNK_SIZE_LOG2
+    u32 voxel_count; // may be 0, as the chunks are never removed
+    const Voxel* p_voxels; // in no particular order
+    // the bounds of its voxels' cells, inclusive; only if `voxel_count` isn't 0
+    ivec3 bounds_min;
+    ivec3 bounds_max;
+    // Goes up with each edit of its voxels, so that what's derived from them can tell whether it's out of date,
+    // unlike the dirty chunks (see `getDirtyVoxelChunkIndices()`), which only the renderer clears.
+    u32 edit_count;
+};
+
+VoxelStore* createVoxelStore(void);
+void destroyVoxelStore(VoxelStore*);
+
+/// Adds the voxel, or replaces the one in its cell.
+void setVoxel(VoxelStore*, Voxel);
+/// Like `setVoxel()` on each of the voxels, which must all be in the chunk, but with a single lookup of the chunk,
+/// and its cell table grown once for them all; for loading and generating whole chunks.
+void setVoxelChunk(VoxelStore*, ivec3 chunk_coord, const Voxel* p_voxels, u32 count);
+/// Returns whether there was a voxel in the cell.
+bool removeVoxel(VoxelStore*, ivec3 coord);
+/// Returns whether there's a voxel in the cell, and if so writes it to `voxel_out`, unless that's NULL.
+bool findVoxel(const VoxelStore*, ivec3 coord, Voxel* voxel_out);
+u64 getVoxelStoreVoxelCount(const VoxelStore*);
+
+/// The chunks are numbered from 0, in the order that they were created; a chunk keeps its index.
+u32 getVoxelChunkCount(const VoxelStore*);
+VoxelChunk getVoxelChunk(const VoxelStore*, u32 chunk_idx);
+/// INVALID_VOXEL_CHUNK_IDX if there has never been a voxel in the chunk.
+u32 findVoxelChunk(const VoxelStore*, ivec3 chunk_coord);
+
+/// The chunks whose mesh is out of date, in the order that they became so: the chunks of the edited voxels, and the
+/// chunks next to them whose border they're on, as they may hide or expose their faces. For the renderer, which
+/// re-meshes them and then clears the first `count` with `clearDirtyVoxelChunks()`.
+u32 getDirtyVoxelChunkCount(const VoxelStore*);
+const u32* getDirtyVoxelChunkIndices(const VoxelStore*);
+void clearDirtyVoxelChunks(VoxelStore*, u32 count);
+/// For a new mesh of the whole store.
+void markAllVoxelChunksDirty(VoxelStore*);
+
+//
+// ===========================================================================================================
+//
+
+} // namespace
+
+#endif // include guard
@@ -22,12 +22,52 @@ struct VulkanContext {
     VkDevice device;
     u32 queue_family_index;
     VkQueue queue;
+    /// For work that doesn't need the graphics queue, like the simulation. From a separate compute-only
+    /// family if `graphics::init()` was asked for one and the device has one; otherwise the same as `queue`.
+    /// Buffers used by both queues must be created with `VK_SHARING_MODE_CONCURRENT` if the families differ.
+    u32 compute_queue_family_index;
+    VkQueue compute_queue;
+    /// For copies that shouldn't queue up behind the compute work, like uploads and frame captures. From a
+    /// transfer-only family if the device has one, which usually runs on a copy engine, alongside the other queues;
+    /// otherwise the same as `compute_queue`. Only takes transfer commands, and barriers of the transfer and host
+    /// stages. Buffers that it shares with the other queues are created concurrent; see `getSharedQueueFamilies()`.
+    u32 transfer_queue_family_index;
+    VkQueue transfer_queue;
 
     VkPhysicalDeviceProperties physical_device_properties;
+    VkPhysicalDeviceSubgroupProperties physical_device_subgroup_properties;
+
+    /// Shared by every pipeline creator, including plugins. Loaded from disk in `graphics::init()`, and written
+    /// back by `graphics::savePipelineCache()`. Internally synchronized.
+    VkPipelineCache pipeline_cache;
 
     tracy::VkCtx* tracy_vk_ctx;
+    /// For command buffers submitted to `compute_queue`.
+    tracy::VkCtx* compute_tracy_vk_ctx;
+
+    /// `vkCmdPushDescriptorSetKHR`, if the device has `VK_KHR_push_descriptor` and it was enabled; otherwise NULL,
+    /// and every descriptor set must be allocated.
+    PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set;
 };
 
+/// Writes the distinct families of `compute_queue`, `queue` and `transfer_queue` to `p_families_out`, for the
+/// `pQueueFamilyIndices` of a buffer that they share, and returns how many there are. If more than 1, the buffer
+/// must be created with `VK_SHARING_MODE_CONCURRENT`, which costs less than transferring its ownership between
+/// the families whenever another queue uses it.
+inline u32 getSharedQueueFamilies(const VulkanContext* vk_ctx, u32 p_families_out[3]) {
+
+    const u32 families[3] {
+        vk_ctx->compute_queue_family_index, vk_ctx->queue_family_index, vk_ctx->transfer_queue_family_index
+    };
+    u32 count = 0;
+    for (u32 i = 0; i < 3; i++) {
+        bool seen = false;
+        for (u32 j = 0; j < count; j++) seen = seen or p_families_out[j] == families[i];
+        if (!seen) p_families_out[count++] = families[i];
+    }
+    return count;
+}
+
 //
 // ===========================================================================================================
 //